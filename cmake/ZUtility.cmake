@@ -135,3 +135,37 @@ function(use_fast_math)
 		endif()
 	endforeach()
 endfunction()
+
+# Adds sources compiled for an instruction set beyond the baseline the rest of
+# the library assumes, and defines ZMUSIC_ISA_<Isa> for the target when it
+# could. Their code may only run once ZMusic_CPUFeatures reported the set, see
+# source/zmusic/cpufeatures.h. Isa is SSE41, AVX2 or AVX512. All are x86 only,
+# so elsewhere the sources are left out and the baseline versions used.
+function(add_isa_sources Tgt Visibility Isa)
+	if(NOT CMAKE_SYSTEM_PROCESSOR MATCHES "^([xX]86_64|AMD64|amd64|i.86|x86)$" OR CMAKE_OSX_ARCHITECTURES MATCHES "arm64")
+		return()
+	endif()
+
+	if(MSVC)
+		# MSVC allows SSE4.1 intrinsics anywhere.
+		set(Flags_SSE41 "")
+		set(Flags_AVX2 "/arch:AVX2")
+		set(Flags_AVX512 "/arch:AVX512")
+	elseif(COMPILER_IS_GNUCXX_COMPATIBLE)
+		set(Flags_SSE41 "-msse4.1")
+		set(Flags_AVX2 "-mavx2;-mfma")
+		set(Flags_AVX512 "-mavx512f;-mavx512bw;-mavx512dq;-mavx512vl;-mfma")
+	else()
+		return()
+	endif()
+
+	if(NOT DEFINED Flags_${Isa})
+		message(FATAL_ERROR "add_isa_sources: unknown instruction set ${Isa}")
+	endif()
+
+	if(Flags_${Isa})
+		set_property(SOURCE ${ARGN} APPEND PROPERTY COMPILE_OPTIONS ${Flags_${Isa}})
+	endif()
+	target_sources(${Tgt} ${Visibility} ${ARGN})
+	target_compile_definitions(${Tgt} ${Visibility} ZMUSIC_ISA_${Isa})
+endfunction()
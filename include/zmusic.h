@@ -77,6 +77,66 @@ typedef enum ChannelConfig_
 	ChannelConfig_Stereo
 } ChannelConfig;
 
+typedef struct ZMusicPerfCounters_
+{
+	uint64_t mCallbacks;		// number of times the stream was serviced.
+	uint64_t mEventsProcessed;	// MIDI events played by a software synth.
+	double mTotalTime;			// wall time spent rendering, in seconds.
+	double mMinTime;			// render time per callback, in milliseconds.
+	double mAvgTime;
+	double mMaxTime;
+	double mFragmentsPerBuffer;	// average number of synth render calls per callback.
+	double mRealtimeFactor;		// seconds of audio rendered per second of render time. Below 1 the song cannot keep up.
+	int mActiveVoices;			// as of the last callback. -1 if the synth does not report it.
+	int mQualityLevel;			// steps the synth's quality is currently lowered by to stay within zmusic_snd_midicpubudget.
+	uint64_t mBlockedCallbacks;	// callbacks served silence because another thread was stopping, seeking or reconfiguring the song.
+	uint64_t mStarvedCallbacks;	// callbacks served silence, or only partly filled, because the song's decoder or its ZMusicStreamReader fell behind.
+} ZMusicPerfCounters;
+
+typedef enum EZMusicMemoryCategory_
+{
+	ZMUSIC_MEM_OBJECTS,			// songs, sources, devices and decoders.
+	ZMUSIC_MEM_BUFFERS,			// render, decode and read-ahead buffers.
+	ZMUSIC_MEM_SONGDATA,		// parsed songs kept by the song cache.
+	ZMUSIC_MEM_SAMPLES,			// decoded audio, in the PCM cache and the Timidity++ resample cache.
+	ZMUSIC_MEM_INSTRUMENTS,		// loaded GUS patches and WildMidi instruments.
+
+	ZMUSIC_MEM_COUNT
+} EZMusicMemoryCategory;
+
+typedef enum EZMusicTrimLevel_
+{
+	ZMUSIC_TRIM_IDLE,			// the devices in the device pool and the WildMidi patches no song uses.
+	ZMUSIC_TRIM_CACHES,			// also the parsed songs in the song cache.
+	ZMUSIC_TRIM_ALL,			// also the FluidSynth sound font cache and the GUS instruments kept for the next song.
+} EZMusicTrimLevel;
+
+typedef struct ZMusicMemoryUsage_
+{
+	size_t mTotal;
+	size_t mCategory[ZMUSIC_MEM_COUNT];
+} ZMusicMemoryUsage;
+
+typedef enum EZMusicRTViolation_
+{
+	ZMUSIC_RT_ALLOC,			// memory allocated or freed.
+	ZMUSIC_RT_LOCK,				// a lock that was held by another thread.
+	ZMUSIC_RT_FILEIO,			// a file read or seek, including those of ZMusicCustomReader.
+	ZMUSIC_RT_PRINT,			// a message printed.
+
+	ZMUSIC_RT_COUNT
+} EZMusicRTViolation;
+
+typedef struct ZMusicRTViolations_
+{
+	uint64_t mCount[ZMUSIC_RT_COUNT];
+} ZMusicRTViolations;
+
+typedef enum ERenderFlags_
+{
+	ZMUSIC_RENDER_STOPATLOOP = 1,	// end the render at the song's first loop point instead of looping.
+} ERenderFlags;
+
 typedef struct SoundStreamInfoEx_
 {
 	int mBufferSize; // If mBufferSize is 0, the song doesn't use streaming but plays through a different interface.
@@ -89,7 +149,7 @@ typedef struct SoundStreamInfoEx_
 typedef enum EIntConfigKey_
 {
 	zmusic_adl_chips_count,
-	zmusic_adl_emulator_id,
+	zmusic_adl_emulator_id,	// -1 picks the most accurate emulator that fits in zmusic_snd_midicpubudget, or a quarter of real time without one.
 	zmusic_adl_run_at_pcm_rate,
 	zmusic_adl_fullpan,
 	zmusic_adl_bank,
@@ -106,11 +166,11 @@ typedef enum EIntConfigKey_
 	zmusic_fluid_chorus_type,
 
 	zmusic_opl_numchips,
-	zmusic_opl_core,
+	zmusic_opl_core,	// -1 picks one of the OPL3 cores like zmusic_adl_emulator_id.
 	zmusic_opl_fullpan,
 
 	zmusic_opn_chips_count,
-	zmusic_opn_emulator_id,
+	zmusic_opn_emulator_id,	// -1 picks one of the YM2612 cores like zmusic_adl_emulator_id.
 	zmusic_opn_run_at_pcm_rate,
 	zmusic_opn_fullpan,
 	zmusic_opn_use_custom_bank,
@@ -152,6 +212,43 @@ typedef enum EIntConfigKey_
 	zmusic_snd_mididevice,
 	zmusic_snd_outputrate,
 	zmusic_mod_preferredplayer,
+	zmusic_snd_midiprecompile,
+	zmusic_fluid_cachesoundfonts,	// keeps the last used soundfonts loaded between FluidSynth devices. Turning it off releases them.
+	zmusic_fluid_dynamicsamples,	// only reads the samples of presets a song uses. Takes effect when the next device is created.
+	zmusic_fluid_renderblock,	// minimum number of samples FluidSynth renders per call, 0 picks one based on zmusic_fluid_threads.
+	zmusic_snd_midicpubudget,	// percentage of real time software synths may spend rendering before they lower their quality. 0 disables this.
+	zmusic_fluid_decodethreads,	// threads used for decompressing SF3 samples, 0 uses all cores.
+	zmusic_fluid_floatsamples,	// keeps a float copy of the samples of the instruments a song uses, which is faster to interpolate.
+	zmusic_timidity_resample_cache,	// kilobytes of notes Timidity++ keeps resampled to the output rate, 0 disables the cache. Takes effect when the next device is created.
+	zmusic_timidity_threads,	// threads Timidity++ renders voices on, 0 uses all cores (up to 8). Takes effect when the next device is created.
+	zmusic_timidity_pre_resample,	// converts looped samples that always play on the same note, like most drums, to the output rate when Timidity++ loads them.
+	zmusic_wildmidi_patch_cache,	// kilobytes of patches WildMidi keeps loaded after the last song using them has ended, 0 frees them right away.
+	zmusic_opl_threads,	// threads the OPL chips are emulated on when there are several, 0 uses all cores. Takes effect when the next song starts.
+	zmusic_adl_shared_resampler,	// libADL chips run at their native rate and their sum is resampled once to the output rate. Ignored with zmusic_adl_run_at_pcm_rate.
+	zmusic_opn_threads,	// threads the libOPN chips are emulated on when there are several, 0 uses all cores. Takes effect when the next song starts.
+	zmusic_mod_threads,	// threads DUMB mixes the voices of a module on, 0 uses all cores. The output does not change. Takes effect when the next song starts.
+	zmusic_snd_silencetimeout,	// ms of silence after which a streamed, non-MIDI song counts as ended. Looping songs restart if they can seek. 0 disables this.
+	zmusic_snd_decodeahead,	// ms of audio files (libsndfile, mpg123) decoded ahead on a thread of their own, up to 10000. 0 decodes in the audio callback. Takes effect when the next song starts.
+	zmusic_snd_pcmcache,	// kilobytes below which audio files get decoded into memory once and play from there, shared by all songs of the same file. 0 disables this. Takes effect when the next song is opened.
+	zmusic_snd_dualloop,	// looping audio files keep a second decoder waiting at the loop start, so the loop needs no seek in the audio callback. Takes effect when the next song is opened.
+	zmusic_snd_loopcrossfade,	// ms the end of a loop is crossfaded with the part before its start with zmusic_snd_dualloop, up to 1000. 0 splices it sample exact.
+	zmusic_snd_xaresample,	// PSX XA songs get resampled to zmusic_snd_outputrate by ZMusic instead of being played at 37800 or 18900 Hz. Takes effect when the next song is opened.
+	zmusic_snd_prerenderthreads,	// threads shared by all streams that use ZMusic_SetPrerender, 0 uses all cores. There are never more than such streams.
+	zmusic_snd_cdprefetch,	// ms of CD images read ahead of playback by ZMusic_OpenCDImage songs, up to 30000. Takes effect when the next song is opened.
+	zmusic_snd_memorybudget,	// kilobytes the library's memory may reach before the song cache, unused WildMidi patches and the FluidSynth sound font cache get freed, checked whenever a song is started or closed. 0 means no limit.
+	zmusic_snd_jobthreads,	// worker threads shared by loading, decoding and the multithreaded synths, 0 uses all cores. With ZMusicCallbacks::SubmitJob this only limits how many jobs a task gets split into.
+	zmusic_snd_resamplequality,	// 1 (fast) to 4 (highest) makes ZMusic resample streamed songs whose own rate is not zmusic_snd_outputrate, which then play as 32 bit float. 0 leaves that to the client. Takes effect when the next song is opened.
+	zmusic_snd_renderquantum,	// frames songs always get rendered in, up to 8192, with whatever the client asks for beyond that kept for the next call. Makes the cost of every call the same. 0 renders exactly what is asked for. Takes effect when the next song starts.
+	zmusic_snd_dumpformat,	// what songs get dumped to disk as by ZMusic_MIDIDumpWave and ZMusic_DumpWave: 0 is 32 bit float WAV, 1 is 16 bit WAV, 2 is FLAC, which needs libsndfile.
+	zmusic_snd_midiquickstart,	// seconds, up to 60. MIDI songs start once the instruments they use this far in are loaded, the rest load in the background while they play. Only for the GUS synth and FluidSynth with dynamic sample loading. 0 loads everything before the song starts.
+	zmusic_snd_midirenderrate,	// rate FluidSynth, Timidity++, WildMidi, the GUS synth and libADL render at when it is below zmusic_snd_outputrate, with the output upsampled to that. Saves CPU at the cost of treble. Not used with stems or shared effects. 0 renders at the output rate.
+	zmusic_snd_mono,	// songs whose player can mix to one channel natively play mono: FluidSynth without stems or shared effects, the GUS synth and libxmp. The others stay stereo. Takes effect when the next song starts.
+	zmusic_snd_devicepool,	// software synths of stopped MIDI songs kept with their instruments loaded, up to 16. A song that would create the same device with the same settings takes one over. 0 deletes them right away.
+	zmusic_snd_streamprebuffer,	// kilobytes ZMusic_OpenSongStream waits for before it starts opening the song, up to 65536. Takes effect when the next song is opened.
+	zmusic_gme_ym2612_core,	// YM2612 emulator of VGM and GYM songs: 0 is the one the library was built with, 1 Nuked (the most accurate), 2 MAME (only if the library was built with it), 3 GENS, which needs a small fraction of Nuked's CPU time. Takes effect when the next song is opened.
+	zmusic_gme_fm_native_rate,	// FM chips of VGM and GYM songs run at their own rate instead of 1.5 times the output rate. Saves some resampling, at the cost of slightly more aliasing on high notes. Takes effect when the next song is opened.
+	zmusic_snd_mididensity,	// note-ons per second above which MIDI, HMI and XMI songs leave out the notes that would hardly be heard: very quiet or very short ones, repeats of a key in the same tick and any beyond 256 sounding at once. Such songs also get their events sent to the synth in larger batches. 0 plays every note. Takes effect when the next song is opened.
+	zmusic_snd_midiloopcache,	// kilobytes a looping MIDI song on a software synth may keep of one pass of its loop. Once a pass started and ended with the same channel state and held notes, the following passes play from it instead of being synthesized again, until anything about the song changes. 0 synthesizes every pass. Takes effect when the next song starts.
 
 	NUM_ZMUSIC_INT_CONFIGS
 } EIntConfigKey;
@@ -177,6 +274,10 @@ typedef enum EFloatConfigKey_
 	zmusic_snd_musicvolume,
 	zmusic_relative_volume,
 	zmusic_snd_mastervolume,
+	zmusic_snd_silencelevel,	// peak level below which zmusic_snd_silencetimeout counts the output as silent, 1 is full scale.
+	zmusic_gus_voice_floor,	// dB below full scale at which released notes of the GUS synth, and notes only held by the sustain pedal, get faded out early instead of playing on inaudibly, e.g. -80. 0 lets them play to their end.
+	zmusic_timidity_voice_floor,	// the same for Timidity++.
+	zmusic_wildmidi_voice_floor,	// the same for WildMidi.
 
 	NUM_FLOAT_CONFIGS
 } EFloatConfigKey;
@@ -191,10 +292,78 @@ typedef enum EStringConfigKey_
 	zmusic_gus_patchdir,
 	zmusic_timidity_config,
 	zmusic_wildmidi_config,
+	zmusic_fluid_samplecache,	// directory for keeping decompressed SF3 samples between runs, empty to disable.
+	zmusic_gus_samplecache,		// directory for keeping converted GUS patches between runs, empty to disable.
+	zmusic_snd_codeccache,		// file for remembering which libsndfile and mpg123 libraries got loaded, so later runs try those first. Empty to disable.
+	zmusic_snd_rendercache,		// existing directory for FLAC renders of MIDI, module and game music songs. The first open of a song queues its render in the background, later opens with the same device and settings play the render instead. Needs libsndfile. Empty to disable.
 
 	NUM_STRING_CONFIGS
 } EStringConfigKey;
 
+// One entry for ZMusic_ApplySettings. The key's range decides which of the values is used.
+typedef struct ZMusicSettingChange_
+{
+	int key;				// an EIntConfigKey, EFloatConfigKey or EStringConfigKey
+	int intValue;
+	float floatValue;
+	const char* stringValue;
+} ZMusicSettingChange;
+
+// One message for ZMusic_SendMidiEvents. data holds either a channel message,
+// status byte first, or a whole system exclusive message from 0xF0 to 0xF7.
+typedef struct ZMusicMidiEvent_
+{
+	uint32_t offset;		// frames after the sampleOffset of the call
+	uint32_t length;
+	const uint8_t* data;
+} ZMusicMidiEvent;
+
+// What one MIDI channel plays, see ZMusic_GetChannelActivity.
+typedef struct ZMusicChannelActivity_
+{
+	int voices;				// sounding voices, or held notes for synths that cannot tell
+	float level;			// of the loudest of them, as linear amplitude from 0 to 1
+	int program;			// the last program change, 0 before any
+} ZMusicChannelActivity;
+
+// Where a playing song is, see ZMusic_GetPosition. The musical part is only known for MIDI songs on
+// software synths and for modules, for other songs ticksPerBeat is 0 and order and row are -1.
+typedef struct ZMusicPosition_
+{
+	uint64_t frames;		// handed out by ZMusic_FillStream since ZMusic_Start, at the stream's sample rate
+	double tick;			// MIDI: the song's ticks since its start or its last loop. Modules: rows since the start of the order
+	double ticksPerBeat;	// MIDI: from the division and the time signature's beat. Modules: 4 rows
+	double tempo;			// in beats per minute, of the beats 'beat' counts
+	int bar;				// MIDI: from the time signatures, 4/4 until the song sets one. Modules: the order
+	int beatsPerBar;
+	double beat;			// within the bar, from 0
+	int order;				// modules only
+	int row;
+} ZMusicPosition;
+
+typedef enum EZMusicSongInfoState_
+{
+	ZMUSIC_SONGINFO_UNKNOWN,	// not in the cache
+	ZMUSIC_SONGINFO_PENDING,	// waiting for its analysis
+	ZMUSIC_SONGINFO_READY,
+	ZMUSIC_SONGINFO_FAILED,		// the song could not be played
+} EZMusicSongInfoState;
+
+// What the song info cache knows about a song, see ZMusic_GetSongInfo.
+typedef struct ZMusicSongInfo_
+{
+	uint64_t hash;			// with the size, what the cache knows the song by
+	uint64_t size;
+	int state;				// an EZMusicSongInfoState, the rest is only set once it is ready
+	int miditype;			// an EMIDIType, MIDI_NOTMIDI for songs that are not MIDI
+	int subsongs;
+	int length_ms;			// of the song or its first subsong, -1 if unknown. See ZMusic_GetSongSubsongLengths for the others.
+	int loopstart_ms;		// the loop region, the whole song for songs without one. Both -1 if unknown.
+	int loopend_ms;
+	float loudness;			// integrated loudness in LUFS as ITU-R BS.1770 measures it, -INFINITY for silence
+	int numinstruments;		// MIDI songs only, see ZMusic_GetSongInstruments
+} ZMusicSongInfo;
+
 
 typedef struct ZMusicCustomReader_
 {
@@ -206,6 +375,50 @@ typedef struct ZMusicCustomReader_
 	void (*close)(struct ZMusicCustomReader_* handle);
 } ZMusicCustomReader;
 
+#define ZMUSIC_READ_WOULDBLOCK (-2)
+
+// A reader for data that is still arriving, e.g. from the network. None of its functions may wait.
+typedef struct ZMusicStreamReader_
+{
+	void* handle;
+	// Returns the number of bytes read, 0 at the end of the data, -1 on errors, which also end it,
+	// or ZMUSIC_READ_WOULDBLOCK if nothing has arrived yet. Never called by two threads at once.
+	long (*read)(struct ZMusicStreamReader_* handle, void* buff, int32_t size);
+	// The total size, or -1 while it is not known. Songs only start before all data has arrived if it is known.
+	long (*length)(struct ZMusicStreamReader_* handle);
+	void (*close)(struct ZMusicStreamReader_* handle);
+	// Set by ZMusic when it takes the reader. Should be called whenever more data has arrived after a read
+	// returned ZMUSIC_READ_WOULDBLOCK, from any thread, but not once close was called. Without it ZMusic tries again every 50 ms.
+	void (*ready)(void* readyContext);
+	void* readyContext;
+} ZMusicStreamReader;
+
+typedef enum EZMusicConvertType_
+{
+	ZMUSIC_CONVERT_SMF,
+	ZMUSIC_CONVERT_WAV
+} EZMusicConvertType;
+
+typedef struct ZMusicConvertJob_
+{
+	const uint8_t* data;	// the song in any format ZMusic_CreateMIDISource accepts
+	size_t length;
+	const char* outname;
+	int subsong;			// only used for wave output
+	zmusic_bool success;	// the rest gets filled in by the conversion
+	char error[128];
+} ZMusicConvertJob;
+
+// Receives exported files. seek may be null, which costs the exporter a second pass over the song.
+// Otherwise seek gets offsets from the start of the file, so the writer must be positioned there initially.
+typedef struct ZMusicCustomWriter_
+{
+	void* handle;
+	long (*write)(struct ZMusicCustomWriter_* handle, const void* buff, int32_t size);
+	long (*seek)(struct ZMusicCustomWriter_* handle, long offset, int whence);
+	void (*close)(struct ZMusicCustomWriter_* handle);
+} ZMusicCustomWriter;
+
 typedef struct ZMusicMidiOutDevice_
 {
 	char *Name;
@@ -223,6 +436,23 @@ typedef enum EZMusicMessageSeverity_
 	ZMUSIC_MSG_FATAL = 666,
 } EZMusicMessageSeverity;
 
+typedef enum EZMusicJobPriority_
+{
+	ZMUSIC_JOB_REALTIME,		// parts of a buffer the audio callback is waiting for.
+	ZMUSIC_JOB_BACKGROUND,		// loading songs and instruments, decoding and scanning ahead of playback.
+	ZMUSIC_JOB_OFFLINE,			// batch conversions and exports.
+} EZMusicJobPriority;
+
+typedef enum EZMusicThreadRole_
+{
+	ZMUSIC_THREAD_WORKER,		// the shared job threads, see zmusic_snd_jobthreads. They run realtime jobs the audio callback waits for.
+	ZMUSIC_THREAD_PRERENDER,	// render songs ahead of playback, see zmusic_snd_prerenderthreads.
+	ZMUSIC_THREAD_SYNTH,		// FluidSynth's mixer threads, see zmusic_fluid_threads. The audio callback waits for them.
+	ZMUSIC_THREAD_STREAM,		// read and decode a single song ahead of playback.
+	ZMUSIC_THREAD_MIDIOUT,		// send the events of a song to a system MIDI device on time.
+	ZMUSIC_THREAD_LOADER,		// decode the samples of a sound font while it loads.
+} EZMusicThreadRole;
+
 typedef struct ZMusicCallbacks_
 {
 	// Callbacks the client can install to capture messages from the backends
@@ -254,6 +484,35 @@ typedef struct ZMusicCallbacks_
 
 	// Used to handle client-specific path macros. If not set, the path may not contain any special tokens that may need expansion.
 	const char *(*NicePath)(const char* path);
+
+	// Optional hooks for the client's profiler, called around the stages of the audio callback, decoder reads and instrument loading.
+	// They are called on whichever thread does the work and must be thread safe. ProfileBegin and ProfileEnd must be set together.
+	// The zone names and counter names are string literals that remain valid forever.
+	void (*ProfileBegin)(const char* zone);
+	void (*ProfileEnd)(void);
+	void (*ProfileCounter)(const char* name, double value);
+
+	// Optional allocator for the memory of songs, their synths and decoders. Must be set together and only be called with
+	// sizes the client's allocator accepts. The memory needs no particular alignment. Free may be called on any thread.
+	// Songs take their fixed size objects from an arena of their own, which comes from this allocator in 64 KB blocks.
+	void* (*Alloc)(size_t size);
+	void (*Free)(void* ptr);
+
+	// Optional job scheduler. Without it ZMusic runs its jobs on zmusic_snd_jobthreads threads of its own.
+	// Every job must be called exactly once with its context, on any thread. ZMusic never waits for a job
+	// that has not started yet, so scheduling it late is fine. Must not be changed while songs are open.
+	void (*SubmitJob)(int priority, void (*job)(void* context), void* context);
+
+	// Optional, for builds with ZMUSIC_RTCHECK. Called on the audio thread whenever ZMusic_FillStream or ZMusic_MixerFill
+	// does something that may block, with one of EZMusicRTViolation and a short description. This is the place to take a backtrace.
+	void (*RTViolation)(int kind, const char* what);
+
+	// Optional, for setting up the threads ZMusic starts, e.g. their priority, real-time scheduling class, MMCSS task or
+	// CPU affinity. ThreadStart is called on the new thread before it does any work, with one of EZMusicThreadRole and a
+	// name for debuggers. ThreadEnd is called on the same thread right before it exits, for undoing what needs undoing,
+	// and only on threads ThreadStart was called on. Threads that are already running are not told about a change.
+	void (*ThreadStart)(int role, const char* name);
+	void (*ThreadEnd)(int role);
 } ZMusicCallbacks;
 
 typedef enum ZMusicVariableType_
@@ -283,14 +542,22 @@ typedef struct ZMusicConfigurationSetting_
 // Note that the internal 'class' definitions are not C compatible!
 typedef struct _ZMusic_MidiSource_Struct { int zm1; } *ZMusic_MidiSource;
 typedef struct _ZMusic_MusicStream_Struct { int zm2; } *ZMusic_MusicStream;
+typedef struct _ZMusic_Mixer_Struct { int zm3; } *ZMusic_Mixer;
+typedef struct _ZMusic_AsyncOpen_Struct { int zm4; } *ZMusic_AsyncOpen;
+typedef struct _ZMusic_Context_Struct { int zm5; } *ZMusic_Context;
 struct SoundDecoder;
 #endif
 
+// Called on the library's worker thread once an asynchronous open has finished.
+typedef void (*ZMusicAsyncOpenCallback)(ZMusic_AsyncOpen handle, void* userdata);
+
 #ifndef ZMUSIC_NO_PROTOTYPES
 #ifdef __cplusplus
 extern "C"
 {
 #endif
+	// The error of the last failed call on the calling thread. Threads may open and convert songs in parallel
+	// without locking, each one only sees its own errors. Stays valid until the thread's next failing call.
 	DLL_IMPORT const char* ZMusic_GetLastError();
 
 	// Sets callbacks for functionality that the client needs to provide.
@@ -305,17 +572,143 @@ extern "C"
 	// Returns an array with all available configuration options - terminated with an empty entry where all elements are 0.
 	DLL_IMPORT const ZMusicConfigurationSetting* ZMusic_GetConfiguration();
 
+	// A context has its own copy of every setting, so that several clients in one process do not change each other's.
+	// The library uses the context set for the calling thread, the global one if there is none. Songs keep the context
+	// they were opened in, for their devices and everything done for them on other threads. The configuration keys
+	// zmusic_snd_jobthreads, zmusic_snd_prerenderthreads and zmusic_snd_memorybudget always change the global one.
+	// A new context starts with the global settings. It must outlive its songs.
+	DLL_IMPORT ZMusic_Context ZMusic_CreateContext();
+	DLL_IMPORT void ZMusic_DestroyContext(ZMusic_Context ctx);
+	// Returns the context the thread used before. Null stands for the global context.
+	DLL_IMPORT ZMusic_Context ZMusic_SetThreadContext(ZMusic_Context ctx);
+
 	// These exports are needed by the MIDI dumpers which need to remain on the client side because the need access to the client's file system.
 	DLL_IMPORT EMIDIType ZMusic_IdentifyMIDIType(uint32_t* id, int size);
 	DLL_IMPORT ZMusic_MidiSource ZMusic_CreateMIDISource(const uint8_t* data, size_t length, EMIDIType miditype);
 	DLL_IMPORT zmusic_bool ZMusic_MIDIDumpWave(ZMusic_MidiSource source, EMidiDevice devtype, const char* devarg, const char* outname, int subsong, int samplerate);
+	// Length and loop region of a MIDI source in milliseconds, computed without rendering. The length is -1 on failure.
+	DLL_IMPORT int ZMusic_GetMIDISourceLengthMs(ZMusic_MidiSource source);
+	DLL_IMPORT zmusic_bool ZMusic_GetMIDISourceLoopPoints(ZMusic_MidiSource source, int* loopstart_ms, int* loopend_ms);
 
 	DLL_IMPORT ZMusic_MusicStream ZMusic_OpenSong(ZMusicCustomReader* reader, EMidiDevice device, const char* Args);
 	DLL_IMPORT ZMusic_MusicStream ZMusic_OpenSongFile(const char *filename, EMidiDevice device, const char* Args);
 	DLL_IMPORT ZMusic_MusicStream ZMusic_OpenSongMem(const void *mem, size_t size, EMidiDevice device, const char* Args);
 	DLL_IMPORT ZMusic_MusicStream ZMusic_OpenCDSong(int track, int cdid);
+	// Opens a song while its data is still arriving, e.g. from the network. Waits for zmusic_snd_streamprebuffer of it,
+	// and for all of it unless libsndfile or mpg123 play it. Those start right away and always get decoded ahead, at
+	// least a second, so only the decoding thread ever waits for the reader. Whenever it falls behind the stream plays
+	// silence until it is that far ahead again, see mStarvedCallbacks. Everything read is kept in memory for seeking.
+	DLL_IMPORT ZMusic_MusicStream ZMusic_OpenSongStream(ZMusicStreamReader* reader, EMidiDevice device, const char* Args);
+	// Plays an audio track of a CUE sheet with BIN or WAVE files, on any platform. Track 0 plays all audio tracks in a row.
+	DLL_IMPORT ZMusic_MusicStream ZMusic_OpenCDImage(const char* cuefile, int track);
+	// Keeps up to 'bytes' of parsed MIDI songs so that opening the same data again skips decompression and parsing.
+	// Only applies to songs opened from memory or from a file. Off by default, 0 turns it off and frees the cache.
+	DLL_IMPORT void ZMusic_SetSongCacheSize(size_t bytes);
+	// The number of subsongs ZMusic_SetSubsong can select, 1 for formats where it selects a position instead.
+	DLL_IMPORT int ZMusic_GetSubsongCount(ZMusic_MusicStream song);
+
+	// Looks up a song in the song info cache by the hash of its content. Songs that are not in it yet are queued for
+	// an analysis that plays them once in a background job, with the global configuration and the default device,
+	// and are pending until it is done. Returns true if the info is ready. May be called from any thread.
+	DLL_IMPORT zmusic_bool ZMusic_GetSongInfo(const void* mem, size_t size, ZMusicSongInfo* info);
+	// The same for a file. Its analysis reads it again instead of keeping a copy.
+	DLL_IMPORT zmusic_bool ZMusic_GetSongInfoFile(const char* filename, ZMusicSongInfo* info);
+	// Only looks up what ZMusic_GetSongInfo returned earlier, without the song's data. Never queues an analysis.
+	DLL_IMPORT zmusic_bool ZMusic_GetSongInfoByHash(uint64_t hash, uint64_t size, ZMusicSongInfo* info);
+	// Copies up to max of the instruments a MIDI song plays, in the order they are first used, and returns how many it has.
+	// Each is the program in bits 0-6 and the bank in bits 7-13, with bit 14 set for drum kits.
+	DLL_IMPORT int ZMusic_GetSongInstruments(uint64_t hash, uint64_t size, uint16_t* instruments, int max);
+	// Copies up to max of the lengths in ms of a song's subsongs and returns how many it has, 0 for songs without several.
+	// Subsongs that did not end within 20 minutes of playing them without looping are -1. Songs with more than 256 only have the first 256.
+	DLL_IMPORT int ZMusic_GetSongSubsongLengths(uint64_t hash, uint64_t size, int* lengths, int max);
+	// Keeps the cache in a file, which gets loaded now and appended to whenever an analysis is done. Null keeps it in memory only.
+	// Switching files keeps what is in memory and writes all of it to the new one.
+	DLL_IMPORT zmusic_bool ZMusic_SetSongInfoCache(const char* filename);
+
+	// Opens a song on a worker thread, including the MIDI device setup that would otherwise be done by ZMusic_Start.
+	// Every handle must be released by exactly one call to ZMusic_FinishOpenAsync or ZMusic_CancelOpenAsync.
+	// The callback is optional, the handle can also be polled. Configuration must not be changed while an open is pending.
+	DLL_IMPORT ZMusic_AsyncOpen ZMusic_OpenSongAsync(ZMusicCustomReader* reader, EMidiDevice device, const char* Args, ZMusicAsyncOpenCallback callback, void* userdata);
+	DLL_IMPORT ZMusic_AsyncOpen ZMusic_OpenSongFileAsync(const char* filename, EMidiDevice device, const char* Args, ZMusicAsyncOpenCallback callback, void* userdata);
+	DLL_IMPORT ZMusic_AsyncOpen ZMusic_OpenSongMemAsync(const void* mem, size_t size, EMidiDevice device, const char* Args, ZMusicAsyncOpenCallback callback, void* userdata);
+	DLL_IMPORT ZMusic_AsyncOpen ZMusic_OpenSongStreamAsync(ZMusicStreamReader* reader, EMidiDevice device, const char* Args, ZMusicAsyncOpenCallback callback, void* userdata);
+	DLL_IMPORT zmusic_bool ZMusic_IsAsyncOpenDone(ZMusic_AsyncOpen handle);
+	// Waits for the open to finish if needed. Returns nullptr and sets the error if it failed.
+	DLL_IMPORT ZMusic_MusicStream ZMusic_FinishOpenAsync(ZMusic_AsyncOpen handle);
+	DLL_IMPORT void ZMusic_CancelOpenAsync(ZMusic_AsyncOpen handle);
+
+	// Queues a song the client expects to play soon, like the next one of a playlist. The same worker as the asynchronous opens
+	// parses it into the song cache and loads the instruments it plays with the device it will be opened with, behind any
+	// pending opens. The device is kept for ZMusic_Start if zmusic_snd_devicepool allows it. Prefetches are skipped while
+	// zmusic_snd_memorybudget is exceeded. Returns false if the data could not be queued.
+	DLL_IMPORT zmusic_bool ZMusic_PrefetchSongFile(const char* filename, EMidiDevice device, const char* Args);
+	DLL_IMPORT zmusic_bool ZMusic_PrefetchSongMem(const void* mem, size_t size, EMidiDevice device, const char* Args);
+	// Drops the prefetches that have not started yet, for when the playlist changed.
+	DLL_IMPORT void ZMusic_CancelPrefetch();
 
 	DLL_IMPORT zmusic_bool ZMusic_FillStream(ZMusic_MusicStream stream, void* buff, int len);
+	// Selects the format ZMusic_FillStream delivers. Planar output puts each channel's samples in consecutive blocks. Call after ZMusic_Start.
+	DLL_IMPORT zmusic_bool ZMusic_SetStreamFormat(ZMusic_MusicStream stream, SampleType type, zmusic_bool planar);
+	// Renders up to 'frames' frames as fast as possible. Returns the number of frames the song produced, which is lower if it ended. The rest of the buffer is silence.
+	// Meant for offline use. The stream must have been started and must not be serviced by ZMusic_FillStream at the same time.
+	DLL_IMPORT size_t ZMusic_RenderToBuffer(ZMusic_MusicStream stream, void* buff, size_t frames, int flags);
+	// Renders a started stream of any type to a file as zmusic_snd_dumpformat says, as fast as possible. Switches its output to float.
+	// Ends with the song or after maxseconds, if above 0. Looping songs repeat their loop region loops times, 0 ends them at the loop point.
+	// Looping songs that cannot tell where their loop is need maxseconds. The same restrictions as for ZMusic_RenderToBuffer apply.
+	DLL_IMPORT zmusic_bool ZMusic_DumpWave(ZMusic_MusicStream stream, const char* outname, int maxseconds, int loops);
+	// Dumps count streams to the matching files on up to numthreads of the job threads (0 for all of them). Each stream may only appear once.
+	// results, if not null, receives the outcome for every file. Returns false if any of them failed, and the error names the first of those.
+	DLL_IMPORT zmusic_bool ZMusic_DumpWaveBatch(const ZMusic_MusicStream* streams, const char* const* outnames, int count, int maxseconds, int loops, int numthreads, zmusic_bool* results);
+	// Renders one song from memory to a file on up to numthreads of the job threads (0 for all of them), without looping. Each thread renders
+	// a segment with a copy of the song that seeks a few seconds ahead of it to settle, and the segments are joined with short crossfades.
+	// Needs songs of known length that can seek, others are rendered in one piece like ZMusic_DumpWave does. So are songs on GUS, Timidity++
+	// and WildMidi, which share their instruments. The copies open and start one at a time.
+	DLL_IMPORT zmusic_bool ZMusic_DumpWaveParallel(const void* mem, size_t size, EMidiDevice device, const char* args, const char* outname, int maxseconds, int numthreads);
+	// Renders the stream ahead on a worker thread so that ZMusic_FillStream only copies finished data. Call after ZMusic_Start. 0 turns it off.
+	DLL_IMPORT zmusic_bool ZMusic_SetPrerender(ZMusic_MusicStream stream, int depth_ms);
+	DLL_IMPORT uint32_t ZMusic_GetPrerenderUnderruns(ZMusic_MusicStream stream);
+	// May be called from any thread.
+	DLL_IMPORT void ZMusic_GetPerfCounters(ZMusic_MusicStream stream, ZMusicPerfCounters* counters);
+	DLL_IMPORT void ZMusic_ResetPerfCounters(ZMusic_MusicStream stream);
+	// With a stream, what was allocated while it was opened and started. Without one, all memory of the library.
+	// Instruments and caches shared by several songs are only counted in the latter. May be called from any thread.
+	DLL_IMPORT void ZMusic_GetMemoryUsage(ZMusic_MusicStream stream, ZMusicMemoryUsage* usage);
+	// Frees what EZMusicTrimLevel says, for low memory warnings, and returns by how much ZMusic_GetMemoryUsage went down.
+	// Playing songs keep everything they use. The GUS instruments are those of the calling thread's context.
+	DLL_IMPORT size_t ZMusic_TrimMemory(int level);
+
+	// How often the render path did something that may block, by EZMusicRTViolation, since the last reset.
+	// Fails in builds without ZMUSIC_RTCHECK, which do not check.
+	DLL_IMPORT zmusic_bool ZMusic_GetRTViolations(ZMusicRTViolations* counts, zmusic_bool reset);
+
+	// Records the calls made on songs opened from here on, and all setting changes, into a compact binary file
+	// that samples/zmusic-replay plays back with per-call timings. Songs are only recorded by their hash and size,
+	// the replay needs the files themselves. Settings changed before the trace was started are not in it.
+	// Starting a trace stops the previous one. May be called from any thread.
+	DLL_IMPORT zmusic_bool ZMusic_StartTrace(const char* filename);
+	DLL_IMPORT void ZMusic_StopTrace();
+
+	// Mixes several streams into one interleaved float stereo buffer. All streams must use the mixer's sample rate.
+	// The mixer does not take ownership. Streams added to a mixer must not be passed to ZMusic_FillStream by the client.
+	DLL_IMPORT ZMusic_Mixer ZMusic_CreateMixer(int samplerate);
+	DLL_IMPORT void ZMusic_DestroyMixer(ZMusic_Mixer mixer);
+	DLL_IMPORT zmusic_bool ZMusic_MixerAddStream(ZMusic_Mixer mixer, ZMusic_MusicStream stream, float gain);
+	// The mixer's clock: the frames ZMusic_MixerFill has mixed so far. Does not lock, so it may be called from any thread.
+	DLL_IMPORT uint64_t ZMusic_MixerGetClock(ZMusic_Mixer mixer);
+	// Adds a stream that stays silent, without being rendered, until the mixer's clock reaches startframe, and then starts on exactly
+	// that frame. Streams added with the same startframe start on the same sample. A startframe that has already passed starts it right away.
+	DLL_IMPORT zmusic_bool ZMusic_MixerAddStreamAt(ZMusic_Mixer mixer, ZMusic_MusicStream stream, float gain, uint64_t startframe);
+	DLL_IMPORT zmusic_bool ZMusic_MixerRemoveStream(ZMusic_Mixer mixer, ZMusic_MusicStream stream);
+	// Lets a started stream take over from one in the mixer. With crossfade_ms 0 it starts right behind the last audible sample of 'stream' once that ends.
+	// Otherwise it fades in to gain while 'stream' fades out, both over crossfade_ms, from the next ZMusic_MixerFill on. Its first 100 ms get rendered
+	// right here, so the mix doesn't wait for the song's first render. ZMusic_OpenSongAsync prepares the rest. Queued streams keep their own effects.
+	DLL_IMPORT zmusic_bool ZMusic_MixerQueueStream(ZMusic_Mixer mixer, ZMusic_MusicStream stream, ZMusic_MusicStream next, float gain, int crossfade_ms);
+	// False once the mixer has let go of a stream, which for one that got replaced by ZMusic_MixerQueueStream means it may be closed.
+	DLL_IMPORT zmusic_bool ZMusic_MixerHasStream(ZMusic_Mixer mixer, ZMusic_MusicStream stream);
+	DLL_IMPORT zmusic_bool ZMusic_MixerSetGain(ZMusic_Mixer mixer, ZMusic_MusicStream stream, float gain, int fade_ms);
+	// Runs the reverb and chorus of all FluidSynth streams through one shared unit. The wet signal lags by 64 samples.
+	DLL_IMPORT zmusic_bool ZMusic_MixerShareEffects(ZMusic_Mixer mixer, zmusic_bool on);
+	DLL_IMPORT zmusic_bool ZMusic_MixerFill(ZMusic_Mixer mixer, void* buff, int len);
 	DLL_IMPORT zmusic_bool ZMusic_Start(ZMusic_MusicStream song, int subsong, zmusic_bool loop);
 	DLL_IMPORT void ZMusic_Pause(ZMusic_MusicStream song);
 	DLL_IMPORT void ZMusic_Resume(ZMusic_MusicStream song);
@@ -324,21 +717,79 @@ extern "C"
 	DLL_IMPORT void ZMusic_Stop(ZMusic_MusicStream song);
 	DLL_IMPORT void ZMusic_Close(ZMusic_MusicStream song);
 	DLL_IMPORT zmusic_bool ZMusic_SetSubsong(ZMusic_MusicStream song, int subsong);
+	// Starts rendering a subsong in the background, so the next ZMusic_SetSubsong to it switches over without a gap.
+	// The old subsong fades out over crossfade_ms, 0 cuts straight over. Only GME songs support this.
+	DLL_IMPORT zmusic_bool ZMusic_PrepareSubsong(ZMusic_MusicStream song, int subsong, int crossfade_ms);
+	// Seeks a playing song. MIDI songs only support this with software synths.
+	DLL_IMPORT zmusic_bool ZMusic_SetPosition(ZMusic_MusicStream song, unsigned int ms);
+	// A new stream playing on from where a MIDI song on a software synth is, with its own synth but the same channel state, held notes,
+	// looping and gain. The song data and instruments are shared, layers and stems are not. Close it like any other stream.
+	DLL_IMPORT ZMusic_MusicStream ZMusic_CloneStream(ZMusic_MusicStream song);
+	// Where a started song is, as of the last frame ZMusic_FillStream handed out. Does not lock, so it may be called from any thread.
+	// Songs rendered ahead by prerendering or zmusic_snd_renderquantum get taken back to that frame at the current tempo, but not across a bar line.
+	DLL_IMPORT zmusic_bool ZMusic_GetPosition(ZMusic_MusicStream song, ZMusicPosition* position);
+	// Sets how many event buffers (2-16) a MIDI song keeps queued and how many milliseconds (1-10000) each one covers.
+	// The buffer count takes effect the next time the song is started.
+	DLL_IMPORT zmusic_bool ZMusic_SetMIDIBuffering(ZMusic_MusicStream song, int numbuffers, int buffer_ms);
+	// Splits a FluidSynth song's output into numstems (up to 16) stereo stems. channelstems has 16 entries, the stem of every MIDI channel. 0 turns it off.
+	// Switching stems on for a playing song brings up a new synth in the background, like changing its soundfonts does.
+	DLL_IMPORT zmusic_bool ZMusic_SetMIDIStems(ZMusic_MusicStream song, int numstems, const uint8_t* channelstems);
+	// The stems of the last ZMusic_FillStream call, as float, planar: left then right for every stem, then for one more stem with reverb and chorus.
+	// Together they make up the stream's output. Valid until the next call on the thread servicing the stream. Null without stems or with prerendering.
+	DLL_IMPORT const float* ZMusic_GetMIDIStems(ZMusic_MusicStream song, int* numstems, int* frames);
+	// Plays another MIDI source on top of a playing FluidSynth song, on the same synth and in sync with it, on 16 MIDI channels of its own.
+	// The song owns the source once this succeeds. Returns the layer's number, or 0 on failure. System exclusive messages of layers are ignored.
+	DLL_IMPORT int ZMusic_AddMIDILayer(ZMusic_MusicStream song, ZMusic_MidiSource source, zmusic_bool loop);
+	DLL_IMPORT zmusic_bool ZMusic_RemoveMIDILayer(ZMusic_MusicStream song, int layer);
+	// False once a layer that doesn't loop has finished.
+	DLL_IMPORT zmusic_bool ZMusic_IsMIDILayerPlaying(ZMusic_MusicStream song, int layer);
+	// Plays live MIDI messages on a MIDI song's software synth alongside its own. Each is due sampleOffset plus its own offset frames,
+	// at the stream's rate, after the start of the next block the song renders. Does not lock, so it may be called from any thread,
+	// but calls from different threads take turns. Fails without sending anything if the queue cannot take all of them.
+	DLL_IMPORT zmusic_bool ZMusic_SendMidiEvents(ZMusic_MusicStream song, const ZMusicMidiEvent* events, int count, uint32_t sampleOffset);
+	// Fills channels[16] with what the MIDI channels of a song on a software synth played in the last block it rendered, for meters and visualizers.
+	// Does not lock, so it may be called from any thread. The first call only starts collecting it, with the next block, and returns all zeros.
+	// The channels are stored one by one, so they may come from two consecutive blocks. Fails for other songs and while the song is stopped.
+	DLL_IMPORT zmusic_bool ZMusic_GetChannelActivity(ZMusic_MusicStream song, ZMusicChannelActivity* channels);
+	// Scales a MIDI song's output, ramping linearly over fade_ms. Does not lock, so it may be called from any thread at any time.
+	// Software synths ramp per sample. Hardware devices change their channel volumes with the next buffer instead.
+	DLL_IMPORT zmusic_bool ZMusic_SetGain(ZMusic_MusicStream song, float gain, int fade_ms);
+	// A virtual song keeps playing silently without synthesizing, for when it is muted. MIDI songs on software synths only
+	// follow their channel state and come back without the notes started in between, GME songs skip ahead with their voices muted.
+	// Others keep rendering. Does not wait for the stream. Mixers make streams virtual by themselves while their gain is 0.
+	DLL_IMPORT void ZMusic_SetVirtual(ZMusic_MusicStream song, zmusic_bool on);
 	DLL_IMPORT zmusic_bool ZMusic_IsLooping(ZMusic_MusicStream song);
 	DLL_IMPORT int ZMusic_GetDeviceType(ZMusic_MusicStream song);
 	DLL_IMPORT zmusic_bool ZMusic_IsMIDI(ZMusic_MusicStream song);
 	DLL_IMPORT void ZMusic_VolumeChanged(ZMusic_MusicStream song);
 	DLL_IMPORT zmusic_bool ZMusic_WriteSMF(ZMusic_MidiSource source, const char* fn, int looplimit);
+	// Streams the SMF to the writer, which gets closed afterward if it has a close function.
+	DLL_IMPORT zmusic_bool ZMusic_WriteSMFToWriter(ZMusic_MidiSource source, ZMusicCustomWriter* writer, int looplimit);
+	// Converts count sources to the matching files on up to numthreads of the job threads (0 for all of them). Each source may only appear once.
+	// results, if not null, receives the outcome for every file. Returns false if any of them failed, and the error names the first of those.
+	DLL_IMPORT zmusic_bool ZMusic_WriteSMFBatch(const ZMusic_MidiSource* sources, const char* const* filenames, int count, int looplimit, int numthreads, zmusic_bool* results);
+	// Converts every job's song to a file on up to numthreads of the job threads (0 for all of them), reporting the outcome in the job.
+	// Wave output cannot use the system MIDI device. GUS, Timidity++ and WildMidi render one song at a time since they share their instruments.
+	// The configuration must not be changed while a batch is running. Returns false if any job failed.
+	DLL_IMPORT zmusic_bool ZMusic_ConvertMIDIBatch(ZMusicConvertJob* jobs, int count, EZMusicConvertType type, EMidiDevice devtype, const char* devarg, int samplerate, int looplimit, int numthreads);
 	DLL_IMPORT void ZMusic_GetStreamInfo(ZMusic_MusicStream song, SoundStreamInfo *info);
 	DLL_IMPORT void ZMusic_GetStreamInfoEx(ZMusic_MusicStream song, SoundStreamInfoEx *info);
+	// Same for an open song. Supported for MIDI, sndfile based streams and GME tracks whose file has their length. Songs without a loop region loop as a whole.
+	DLL_IMPORT int ZMusic_GetSongLengthMs(ZMusic_MusicStream song);
+	DLL_IMPORT zmusic_bool ZMusic_GetLoopPoints(ZMusic_MusicStream song, int* loopstart_ms, int* loopend_ms);
 	// Configuration interface. The return value specifies if a music restart is needed.
 	// RealValue should be written back to the CVAR or whatever other method the client uses to store configuration state.
 	DLL_IMPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, ZMusic_MusicStream song, int value, int* pRealValue);
 	DLL_IMPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, ZMusic_MusicStream song, float value, float* pRealValue);
 	DLL_IMPORT zmusic_bool ChangeMusicSettingString(EStringConfigKey key, ZMusic_MusicStream song, const char* value);
+	// Changes count settings like the three functions above. The song, if any, gets each changed parameter only once,
+	// without waiting for the thread that plays it. Returns true if any of the changes needs a music restart.
+	DLL_IMPORT zmusic_bool ZMusic_ApplySettings(ZMusic_MusicStream song, const ZMusicSettingChange* changes, int count);
 	DLL_IMPORT const char *ZMusic_GetStats(ZMusic_MusicStream song);
 
 
+	// Loads libsndfile and mpg123 right away instead of when the first song needs them. May be called on any thread.
+	DLL_IMPORT zmusic_bool ZMusic_PreloadCodecs();
 	DLL_IMPORT struct SoundDecoder* CreateDecoder(const uint8_t* data, size_t size, zmusic_bool isstatic);
 	DLL_IMPORT void SoundDecoder_GetInfo(struct SoundDecoder* decoder, int* samplerate, ChannelConfig* chans, SampleType* type);
 	DLL_IMPORT size_t SoundDecoder_Read(struct SoundDecoder* decoder, void* buffer, size_t length);
@@ -397,14 +848,64 @@ typedef void (*pfn_ZMusic_SetGenMidi)(const uint8_t* data);
 typedef void (*pfn_ZMusic_SetWgOpn)(const void* data, unsigned len);
 typedef void (*pfn_ZMusic_SetDmxGus)(const void* data, unsigned len);
 typedef const ZMusicConfigurationSetting* (*pfn_ZMusic_GetConfiguration)();
+typedef ZMusic_Context (*pfn_ZMusic_CreateContext)();
+typedef void (*pfn_ZMusic_DestroyContext)(ZMusic_Context ctx);
+typedef ZMusic_Context (*pfn_ZMusic_SetThreadContext)(ZMusic_Context ctx);
 typedef EMIDIType (*pfn_ZMusic_IdentifyMIDIType)(uint32_t* id, int size);
 typedef ZMusic_MidiSource (*pfn_ZMusic_CreateMIDISource)(const uint8_t* data, size_t length, EMIDIType miditype);
 typedef zmusic_bool (*pfn_ZMusic_MIDIDumpWave)(ZMusic_MidiSource source, EMidiDevice devtype, const char* devarg, const char* outname, int subsong, int samplerate);
+typedef int (*pfn_ZMusic_GetMIDISourceLengthMs)(ZMusic_MidiSource source);
+typedef zmusic_bool (*pfn_ZMusic_GetMIDISourceLoopPoints)(ZMusic_MidiSource source, int* loopstart_ms, int* loopend_ms);
 typedef ZMusic_MusicStream (*pfn_ZMusic_OpenSong)(ZMusicCustomReader* reader, EMidiDevice device, const char* Args);
 typedef ZMusic_MusicStream (*pfn_ZMusic_OpenSongFile)(const char *filename, EMidiDevice device, const char* Args);
 typedef ZMusic_MusicStream (*pfn_ZMusic_OpenSongMem)(const void *mem, size_t size, EMidiDevice device, const char* Args);
+typedef ZMusic_MusicStream (*pfn_ZMusic_OpenSongStream)(ZMusicStreamReader* reader, EMidiDevice device, const char* Args);
 typedef ZMusic_MusicStream (*pfn_ZMusic_OpenCDSong)(int track, int cdid);
+typedef ZMusic_MusicStream (*pfn_ZMusic_OpenCDImage)(const char* cuefile, int track);
+typedef void (*pfn_ZMusic_SetSongCacheSize)(size_t bytes);
+typedef int (*pfn_ZMusic_GetSubsongCount)(ZMusic_MusicStream song);
+typedef zmusic_bool (*pfn_ZMusic_GetSongInfo)(const void* mem, size_t size, ZMusicSongInfo* info);
+typedef zmusic_bool (*pfn_ZMusic_GetSongInfoFile)(const char* filename, ZMusicSongInfo* info);
+typedef zmusic_bool (*pfn_ZMusic_GetSongInfoByHash)(uint64_t hash, uint64_t size, ZMusicSongInfo* info);
+typedef int (*pfn_ZMusic_GetSongInstruments)(uint64_t hash, uint64_t size, uint16_t* instruments, int max);
+typedef int (*pfn_ZMusic_GetSongSubsongLengths)(uint64_t hash, uint64_t size, int* lengths, int max);
+typedef zmusic_bool (*pfn_ZMusic_SetSongInfoCache)(const char* filename);
+typedef ZMusic_AsyncOpen (*pfn_ZMusic_OpenSongAsync)(ZMusicCustomReader* reader, EMidiDevice device, const char* Args, ZMusicAsyncOpenCallback callback, void* userdata);
+typedef ZMusic_AsyncOpen (*pfn_ZMusic_OpenSongFileAsync)(const char* filename, EMidiDevice device, const char* Args, ZMusicAsyncOpenCallback callback, void* userdata);
+typedef ZMusic_AsyncOpen (*pfn_ZMusic_OpenSongMemAsync)(const void* mem, size_t size, EMidiDevice device, const char* Args, ZMusicAsyncOpenCallback callback, void* userdata);
+typedef ZMusic_AsyncOpen (*pfn_ZMusic_OpenSongStreamAsync)(ZMusicStreamReader* reader, EMidiDevice device, const char* Args, ZMusicAsyncOpenCallback callback, void* userdata);
+typedef zmusic_bool (*pfn_ZMusic_IsAsyncOpenDone)(ZMusic_AsyncOpen handle);
+typedef ZMusic_MusicStream (*pfn_ZMusic_FinishOpenAsync)(ZMusic_AsyncOpen handle);
+typedef void (*pfn_ZMusic_CancelOpenAsync)(ZMusic_AsyncOpen handle);
+typedef zmusic_bool (*pfn_ZMusic_PrefetchSongFile)(const char* filename, EMidiDevice device, const char* Args);
+typedef zmusic_bool (*pfn_ZMusic_PrefetchSongMem)(const void* mem, size_t size, EMidiDevice device, const char* Args);
+typedef void (*pfn_ZMusic_CancelPrefetch)();
 typedef zmusic_bool (*pfn_ZMusic_FillStream)(ZMusic_MusicStream stream, void* buff, int len);
+typedef zmusic_bool (*pfn_ZMusic_SetStreamFormat)(ZMusic_MusicStream stream, SampleType type, zmusic_bool planar);
+typedef size_t (*pfn_ZMusic_RenderToBuffer)(ZMusic_MusicStream stream, void* buff, size_t frames, int flags);
+typedef zmusic_bool (*pfn_ZMusic_DumpWave)(ZMusic_MusicStream stream, const char* outname, int maxseconds, int loops);
+typedef zmusic_bool (*pfn_ZMusic_DumpWaveBatch)(const ZMusic_MusicStream* streams, const char* const* outnames, int count, int maxseconds, int loops, int numthreads, zmusic_bool* results);
+typedef zmusic_bool (*pfn_ZMusic_DumpWaveParallel)(const void* mem, size_t size, EMidiDevice device, const char* args, const char* outname, int maxseconds, int numthreads);
+typedef zmusic_bool (*pfn_ZMusic_SetPrerender)(ZMusic_MusicStream stream, int depth_ms);
+typedef uint32_t (*pfn_ZMusic_GetPrerenderUnderruns)(ZMusic_MusicStream stream);
+typedef void (*pfn_ZMusic_GetPerfCounters)(ZMusic_MusicStream stream, ZMusicPerfCounters* counters);
+typedef void (*pfn_ZMusic_ResetPerfCounters)(ZMusic_MusicStream stream);
+typedef void (*pfn_ZMusic_GetMemoryUsage)(ZMusic_MusicStream stream, ZMusicMemoryUsage* usage);
+typedef size_t (*pfn_ZMusic_TrimMemory)(int level);
+typedef zmusic_bool (*pfn_ZMusic_GetRTViolations)(ZMusicRTViolations* counts, zmusic_bool reset);
+typedef zmusic_bool (*pfn_ZMusic_StartTrace)(const char* filename);
+typedef void (*pfn_ZMusic_StopTrace)();
+typedef ZMusic_Mixer (*pfn_ZMusic_CreateMixer)(int samplerate);
+typedef void (*pfn_ZMusic_DestroyMixer)(ZMusic_Mixer mixer);
+typedef zmusic_bool (*pfn_ZMusic_MixerAddStream)(ZMusic_Mixer mixer, ZMusic_MusicStream stream, float gain);
+typedef uint64_t (*pfn_ZMusic_MixerGetClock)(ZMusic_Mixer mixer);
+typedef zmusic_bool (*pfn_ZMusic_MixerAddStreamAt)(ZMusic_Mixer mixer, ZMusic_MusicStream stream, float gain, uint64_t startframe);
+typedef zmusic_bool (*pfn_ZMusic_MixerRemoveStream)(ZMusic_Mixer mixer, ZMusic_MusicStream stream);
+typedef zmusic_bool (*pfn_ZMusic_MixerQueueStream)(ZMusic_Mixer mixer, ZMusic_MusicStream stream, ZMusic_MusicStream next, float gain, int crossfade_ms);
+typedef zmusic_bool (*pfn_ZMusic_MixerHasStream)(ZMusic_Mixer mixer, ZMusic_MusicStream stream);
+typedef zmusic_bool (*pfn_ZMusic_MixerSetGain)(ZMusic_Mixer mixer, ZMusic_MusicStream stream, float gain, int fade_ms);
+typedef zmusic_bool (*pfn_ZMusic_MixerShareEffects)(ZMusic_Mixer mixer, zmusic_bool on);
+typedef zmusic_bool (*pfn_ZMusic_MixerFill)(ZMusic_Mixer mixer, void* buff, int len);
 typedef zmusic_bool (*pfn_ZMusic_Start)(ZMusic_MusicStream song, int subsong, zmusic_bool loop);
 typedef void (*pfn_ZMusic_Pause)(ZMusic_MusicStream song);
 typedef void (*pfn_ZMusic_Resume)(ZMusic_MusicStream song);
@@ -413,16 +914,37 @@ typedef zmusic_bool (*pfn_ZMusic_IsPlaying)(ZMusic_MusicStream song);
 typedef void (*pfn_ZMusic_Stop)(ZMusic_MusicStream song);
 typedef void (*pfn_ZMusic_Close)(ZMusic_MusicStream song);
 typedef zmusic_bool (*pfn_ZMusic_SetSubsong)(ZMusic_MusicStream song, int subsong);
+typedef zmusic_bool (*pfn_ZMusic_PrepareSubsong)(ZMusic_MusicStream song, int subsong, int crossfade_ms);
+typedef zmusic_bool (*pfn_ZMusic_SetPosition)(ZMusic_MusicStream song, unsigned int ms);
+typedef ZMusic_MusicStream (*pfn_ZMusic_CloneStream)(ZMusic_MusicStream song);
+typedef zmusic_bool (*pfn_ZMusic_GetPosition)(ZMusic_MusicStream song, ZMusicPosition* position);
+typedef zmusic_bool (*pfn_ZMusic_SetMIDIBuffering)(ZMusic_MusicStream song, int numbuffers, int buffer_ms);
+typedef zmusic_bool (*pfn_ZMusic_SetMIDIStems)(ZMusic_MusicStream song, int numstems, const uint8_t* channelstems);
+typedef const float* (*pfn_ZMusic_GetMIDIStems)(ZMusic_MusicStream song, int* numstems, int* frames);
+typedef int (*pfn_ZMusic_AddMIDILayer)(ZMusic_MusicStream song, ZMusic_MidiSource source, zmusic_bool loop);
+typedef zmusic_bool (*pfn_ZMusic_RemoveMIDILayer)(ZMusic_MusicStream song, int layer);
+typedef zmusic_bool (*pfn_ZMusic_IsMIDILayerPlaying)(ZMusic_MusicStream song, int layer);
+typedef zmusic_bool (*pfn_ZMusic_SendMidiEvents)(ZMusic_MusicStream song, const ZMusicMidiEvent* events, int count, uint32_t sampleOffset);
+typedef zmusic_bool (*pfn_ZMusic_GetChannelActivity)(ZMusic_MusicStream song, ZMusicChannelActivity* channels);
+typedef zmusic_bool (*pfn_ZMusic_SetGain)(ZMusic_MusicStream song, float gain, int fade_ms);
+typedef void (*pfn_ZMusic_SetVirtual)(ZMusic_MusicStream song, zmusic_bool on);
 typedef zmusic_bool (*pfn_ZMusic_IsLooping)(ZMusic_MusicStream song);
 typedef zmusic_bool (*pfn_ZMusic_IsMIDI)(ZMusic_MusicStream song);
 typedef void (*pfn_ZMusic_VolumeChanged)(ZMusic_MusicStream song);
 typedef zmusic_bool (*pfn_ZMusic_WriteSMF)(ZMusic_MidiSource source, const char* fn, int looplimit);
+typedef zmusic_bool (*pfn_ZMusic_WriteSMFToWriter)(ZMusic_MidiSource source, ZMusicCustomWriter* writer, int looplimit);
+typedef zmusic_bool (*pfn_ZMusic_WriteSMFBatch)(const ZMusic_MidiSource* sources, const char* const* filenames, int count, int looplimit, int numthreads, zmusic_bool* results);
+typedef zmusic_bool (*pfn_ZMusic_ConvertMIDIBatch)(ZMusicConvertJob* jobs, int count, EZMusicConvertType type, EMidiDevice devtype, const char* devarg, int samplerate, int looplimit, int numthreads);
 typedef void (*pfn_ZMusic_GetStreamInfo)(ZMusic_MusicStream song, SoundStreamInfo *info);
 typedef void (*pfn_ZMusic_GetStreamInfoEx)(ZMusic_MusicStream song, SoundStreamInfoEx *info);
+typedef int (*pfn_ZMusic_GetSongLengthMs)(ZMusic_MusicStream song);
+typedef zmusic_bool (*pfn_ZMusic_GetLoopPoints)(ZMusic_MusicStream song, int* loopstart_ms, int* loopend_ms);
 typedef zmusic_bool (*pfn_ChangeMusicSettingInt)(EIntConfigKey key, ZMusic_MusicStream song, int value, int* pRealValue);
 typedef zmusic_bool (*pfn_ChangeMusicSettingFloat)(EFloatConfigKey key, ZMusic_MusicStream song, float value, float* pRealValue);
 typedef zmusic_bool (*pfn_ChangeMusicSettingString)(EStringConfigKey key, ZMusic_MusicStream song, const char* value);
+typedef zmusic_bool (*pfn_ZMusic_ApplySettings)(ZMusic_MusicStream song, const ZMusicSettingChange* changes, int count);
 typedef const char *(*pfn_ZMusic_GetStats)(ZMusic_MusicStream song);
+typedef zmusic_bool (*pfn_ZMusic_PreloadCodecs)();
 typedef struct SoundDecoder* (*pfn_CreateDecoder)(const uint8_t* data, size_t size, zmusic_bool isstatic);
 typedef void (*pfn_SoundDecoder_GetInfo)(struct SoundDecoder* decoder, int* samplerate, ChannelConfig* chans, SampleType* type);
 typedef size_t (*pfn_SoundDecoder_Read)(struct SoundDecoder* decoder, void* buffer, size_t length);
@@ -0,0 +1,484 @@
+// Renders a directory of songs through every requested device and
+// configuration as fast as possible and reports the timings as JSON.
+//
+// zmusic-bench [options] <directory>
+//   -d <devices>   comma separated, each optionally followed by :args, e.g. fluidsynth:gm.sf2,opl
+//   -r <rates>     output sample rates, default 44100
+//   -b <frames>    frames per buffer, default 1024
+//   -t <threads>   thread counts for the synths that have one, 0 for all cores, default 0
+//   -l <seconds>   audio rendered per song at most, default 60
+//   -g <genmidi>   GENMIDI lump for the OPL device
+//   -o <file>      write the report there instead of stdout
+//   -c <report>    check the results against an earlier report, see below
+//   -x <dB>        with -c, accept output that differs if its RMS level is within this
+//   -p <percent>   with -c, how much slower than the reference a render may be, default 25
+//
+// Every combination of device, rate, buffer size and thread count gets one
+// entry per song. The peak RSS is that of the whole process so far.
+//
+// Each entry has a hash of the rendered samples. With -c the runs are
+// matched up with the entries of the reference report, and a run fails if
+// its output is not bit exact, or not within -x for backends with float
+// paths, or if it took longer than allowed. The exit code is 2 if anything
+// failed. Reports are written one entry per line, which is what -c reads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+#include <zmusic.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+struct Device
+{
+	const char *Name;
+	EMidiDevice Type;
+};
+
+static const Device Devices[] =
+{
+	{ "default", MDEV_DEFAULT },
+	{ "standard", MDEV_STANDARD },
+	{ "opl", MDEV_OPL },
+	{ "sndsys", MDEV_SNDSYS },
+	{ "timidity", MDEV_TIMIDITY },
+	{ "fluidsynth", MDEV_FLUIDSYNTH },
+	{ "gus", MDEV_GUS },
+	{ "wildmidi", MDEV_WILDMIDI },
+	{ "adl", MDEV_ADL },
+	{ "opn", MDEV_OPN },
+};
+
+struct DeviceSpec
+{
+	const Device *Dev;
+	std::string Args;
+};
+
+struct Result
+{
+	double OpenMs = 0;
+	double StartMs = 0;
+	double AudioSeconds = 0;
+	double RenderSeconds = 0;
+	double AvgBufferMs = 0;
+	double PeakBufferMs = 0;
+	int LateBuffers = 0;
+	long PeakRSSKB = 0;
+	uint64_t Hash = 14695981039346656037ull;	// FNV-1a of the samples
+	double RMS = 0;	// in dBFS
+	std::string Error;
+};
+
+struct Reference
+{
+	std::string Key;
+	uint64_t Hash;
+	double RMS;
+	double RenderSeconds;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double Ms(Clock::time_point from, Clock::time_point to)
+{
+	return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+static long PeakRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+	return long(pmc.PeakWorkingSetSize / 1024);
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return long(usage.ru_maxrss / 1024);	// bytes there, kilobytes everywhere else.
+#else
+	return long(usage.ru_maxrss);
+#endif
+#endif
+}
+
+static std::vector<std::string> Split(const char *list)
+{
+	std::vector<std::string> out;
+	std::string item;
+	for (const char *p = list; ; p++)
+	{
+		if (*p == ',' || *p == 0)
+		{
+			if (!item.empty()) out.push_back(item);
+			item.clear();
+			if (*p == 0) break;
+		}
+		else item += *p;
+	}
+	return out;
+}
+
+static std::vector<int> SplitInts(const char *list)
+{
+	std::vector<int> out;
+	for (auto &s : Split(list)) out.push_back(atoi(s.c_str()));
+	return out;
+}
+
+static std::string Json(const std::string &s)
+{
+	std::string out = "\"";
+	for (unsigned char c : s)
+	{
+		if (c == '"' || c == '\\') { out += '\\'; out += c; }
+		else if (c < 0x20) { char buf[8]; snprintf(buf, 8, "\\u%04x", c); out += buf; }
+		else out += c;
+	}
+	return out + "\"";
+}
+
+// Reports are only ever read back by this program, so this only has to work on its own output.
+static bool Field(const std::string &line, const char *name, std::string &value)
+{
+	std::string key = std::string("\"") + name + "\": ";
+	auto pos = line.find(key);
+	if (pos == std::string::npos) return false;
+	pos += key.size();
+	value.clear();
+	if (line[pos] != '"')
+	{
+		auto end = line.find_first_of(",}", pos);
+		value = line.substr(pos, end - pos);
+		return true;
+	}
+	for (pos++; pos < line.size() && line[pos] != '"'; pos++)
+	{
+		if (line[pos] == '\\' && pos + 1 < line.size())
+		{
+			pos++;
+			if (line[pos] == 'u') { value += (char)strtol(line.substr(pos + 1, 4).c_str(), nullptr, 16); pos += 4; }
+			else value += line[pos];
+		}
+		else value += line[pos];
+	}
+	return true;
+}
+
+static std::string RunKey(const std::string &file, const DeviceSpec &dev, int rate, int buffer, int threads)
+{
+	return file + '\n' + dev.Dev->Name + '\n' + dev.Args + '\n' + std::to_string(rate) + '\n' + std::to_string(buffer) + '\n' + std::to_string(threads);
+}
+
+static bool LoadReferences(const char *name, std::vector<Reference> &refs)
+{
+	FILE *f = fopen(name, "r");
+	if (!f) return false;
+	std::string line;
+	int c;
+	do
+	{
+		c = fgetc(f);
+		if (c != '\n' && c != EOF)
+		{
+			line += (char)c;
+			continue;
+		}
+		std::string file, device, args, rate, buffer, threads, hash, rms, render;
+		if (Field(line, "file", file) && Field(line, "device", device) && Field(line, "args", args) && Field(line, "rate", rate) &&
+			Field(line, "buffer", buffer) && Field(line, "threads", threads) && Field(line, "hash", hash) && Field(line, "rms_db", rms) && Field(line, "render_s", render))
+		{
+			auto dev = std::find_if(std::begin(Devices), std::end(Devices), [&](const Device &d) { return device == d.Name; });
+			if (dev != std::end(Devices))
+			{
+				DeviceSpec spec = { dev, args };
+				refs.push_back({ RunKey(file, spec, atoi(rate.c_str()), atoi(buffer.c_str()), atoi(threads.c_str())),
+					strtoull(hash.c_str(), nullptr, 16), atof(rms.c_str()), atof(render.c_str()) });
+			}
+		}
+		line.clear();
+	} while (c != EOF);
+	fclose(f);
+	return true;
+}
+
+static void Accumulate(Result &res, const uint8_t *data, size_t len, SampleType type, double &sumsq, size_t &samples)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		res.Hash = (res.Hash ^ data[i]) * 1099511628211ull;
+	}
+	if (type == SampleType_Float32)
+	{
+		for (size_t i = 0; i + 4 <= len; i += 4)
+		{
+			float v;
+			memcpy(&v, data + i, 4);
+			sumsq += double(v) * v;
+		}
+		samples += len / 4;
+	}
+	else if (type == SampleType_Int16)
+	{
+		for (size_t i = 0; i + 2 <= len; i += 2)
+		{
+			int16_t v;
+			memcpy(&v, data + i, 2);
+			sumsq += double(v) * v / (32768. * 32768.);
+		}
+		samples += len / 2;
+	}
+	else
+	{
+		for (size_t i = 0; i < len; i++)
+		{
+			double v = (data[i] - 128) / 128.;
+			sumsq += v * v;
+		}
+		samples += len;
+	}
+}
+
+static void SetThreads(int threads)
+{
+	static const EIntConfigKey keys[] = { zmusic_fluid_threads, zmusic_timidity_threads, zmusic_opl_threads, zmusic_opn_threads, zmusic_mod_threads };
+	for (auto key : keys) ChangeMusicSettingInt(key, nullptr, threads, nullptr);
+}
+
+static void Quiet(int severity, const char *msg)
+{
+}
+
+//==========================================================================
+//
+// Bench
+//
+// Opens, starts and renders one song. The song is not looped, so the
+// render ends with the song or after 'seconds'.
+//
+//==========================================================================
+
+static Result Bench(const std::string &file, const DeviceSpec &dev, int buffer, int seconds)
+{
+	Result res;
+	auto t0 = Clock::now();
+	ZMusic_MusicStream song = ZMusic_OpenSongFile(file.c_str(), dev.Dev->Type, dev.Args.empty() ? nullptr : dev.Args.c_str());
+	auto t1 = Clock::now();
+	res.OpenMs = Ms(t0, t1);
+	if (song == nullptr)
+	{
+		res.Error = ZMusic_GetLastError();
+		return res;
+	}
+	// Instruments and soundfonts get loaded here for MIDI songs.
+	bool started = ZMusic_Start(song, 0, false);
+	res.StartMs = Ms(t1, Clock::now());
+
+	SoundStreamInfoEx fmt;
+	ZMusic_GetStreamInfoEx(song, &fmt);
+	if (!started || fmt.mBufferSize <= 0 || fmt.mSampleRate <= 0)
+	{
+		res.Error = started ? "Song does not stream" : ZMusic_GetLastError();
+		ZMusic_Close(song);
+		return res;
+	}
+
+	int framesize = (fmt.mSampleType == SampleType_Int16 ? 2 : fmt.mSampleType == SampleType_UInt8 ? 1 : 4) * (fmt.mChannelConfig == ChannelConfig_Stereo ? 2 : 1);
+	std::vector<uint8_t> buf(size_t(buffer) * framesize);
+	double deadline = 1000.0 * buffer / fmt.mSampleRate;
+	int64_t maxbuffers = int64_t(seconds) * fmt.mSampleRate / buffer;
+	int64_t count = 0;
+	double total = 0;
+	double sumsq = 0;
+	size_t samples = 0;
+	for (; count < maxbuffers; count++)
+	{
+		auto b0 = Clock::now();
+		bool more = ZMusic_FillStream(song, buf.data(), int(buf.size()));
+		double ms = Ms(b0, Clock::now());
+		total += ms;
+		res.PeakBufferMs = std::max(res.PeakBufferMs, ms);
+		if (ms > deadline) res.LateBuffers++;
+		Accumulate(res, buf.data(), buf.size(), fmt.mSampleType, sumsq, samples);
+		if (!more) { count++; break; }
+	}
+	ZMusic_Close(song);
+
+	res.AudioSeconds = double(count) * buffer / fmt.mSampleRate;
+	res.RenderSeconds = total / 1000;
+	res.AvgBufferMs = count > 0 ? total / count : 0;
+	res.PeakRSSKB = PeakRSS();
+	res.RMS = samples > 0 && sumsq > 0 ? 10 * log10(sumsq / samples) : -200;
+	return res;
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: zmusic-bench [-d devices] [-r rates] [-b frames] [-t threads] [-l seconds] [-g genmidi] [-o file] [-c report [-x dB] [-p percent]] <directory>\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<DeviceSpec> devices;
+	std::vector<int> rates = { 44100 }, buffers = { 1024 }, threads = { 0 };
+	int seconds = 60;
+	const char *dir = nullptr, *outname = nullptr, *refname = nullptr;
+	double tolerance = -1, slack = 25;
+	std::vector<uint8_t> genmidi;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' || arg[1] == 0 || arg[2] != 0)
+		{
+			if (dir != nullptr) Usage();
+			dir = arg;
+			continue;
+		}
+		if (i + 1 >= argc) Usage();
+		const char *val = argv[++i];
+		switch (arg[1])
+		{
+		case 'd':
+			for (auto &spec : Split(val))
+			{
+				auto colon = spec.find(':');
+				std::string name = spec.substr(0, colon);
+				auto dev = std::find_if(std::begin(Devices), std::end(Devices), [&](const Device &d) { return name == d.Name; });
+				if (dev == std::end(Devices))
+				{
+					fprintf(stderr, "Unknown device %s\n", name.c_str());
+					return 1;
+				}
+				devices.push_back({ dev, colon == std::string::npos ? std::string() : spec.substr(colon + 1) });
+			}
+			break;
+		case 'r': rates = SplitInts(val); break;
+		case 'b': buffers = SplitInts(val); break;
+		case 't': threads = SplitInts(val); break;
+		case 'l': seconds = atoi(val); break;
+		case 'o': outname = val; break;
+		case 'c': refname = val; break;
+		case 'x': tolerance = atof(val); break;
+		case 'p': slack = atof(val); break;
+		case 'g':
+		{
+			FILE *f = fopen(val, "rb");
+			if (!f)
+			{
+				fprintf(stderr, "Cannot open %s\n", val);
+				return 1;
+			}
+			genmidi.resize(11908);	// ZMusic_SetGenMidi takes the lump as it is.
+			genmidi.resize(fread(genmidi.data(), 1, genmidi.size(), f));
+			fclose(f);
+			break;
+		}
+		default: Usage();
+		}
+	}
+	if (dir == nullptr || seconds <= 0) Usage();
+	if (devices.empty()) devices.push_back({ &Devices[0], "" });
+	for (int b : buffers) if (b <= 0) Usage();
+
+	std::vector<std::string> files;
+	std::error_code ec;
+	for (auto &entry : std::filesystem::recursive_directory_iterator(dir, ec))
+	{
+		if (entry.is_regular_file()) files.push_back(entry.path().string());
+	}
+	if (ec)
+	{
+		fprintf(stderr, "Cannot read %s: %s\n", dir, ec.message().c_str());
+		return 1;
+	}
+	std::sort(files.begin(), files.end());
+
+	std::vector<Reference> refs;
+	if (refname != nullptr && !LoadReferences(refname, refs))
+	{
+		fprintf(stderr, "Cannot read %s\n", refname);
+		return 1;
+	}
+
+	FILE *out = outname ? fopen(outname, "w") : stdout;
+	if (!out)
+	{
+		fprintf(stderr, "Cannot create %s\n", outname);
+		return 1;
+	}
+
+	ZMusicCallbacks callbacks = {};
+	callbacks.MessageFunc = Quiet;
+	ZMusic_SetCallbacks(&callbacks);
+	if (!genmidi.empty()) ZMusic_SetGenMidi(genmidi.data());
+
+	fprintf(out, "{\n  \"cores\": %u,\n  \"results\": [", std::thread::hardware_concurrency());
+	bool first = true;
+	int failures = 0;
+	for (int rate : rates)
+	{
+		ChangeMusicSettingInt(zmusic_snd_outputrate, nullptr, rate, nullptr);
+		for (int thr : threads)
+		{
+			SetThreads(thr);
+			for (auto &dev : devices)
+			{
+				for (int buffer : buffers)
+				{
+					for (auto &file : files)
+					{
+						Result res = Bench(file, dev, buffer, seconds);
+						fprintf(out, "%s\n    {\"file\": %s, \"device\": %s, \"args\": %s, \"rate\": %d, \"buffer\": %d, \"threads\": %d, ",
+							first ? "" : ",", Json(file).c_str(), Json(dev.Dev->Name).c_str(), Json(dev.Args).c_str(), rate, buffer, thr);
+						first = false;
+						if (!res.Error.empty())
+						{
+							fprintf(out, "\"open_ms\": %.3f, \"error\": %s}", res.OpenMs, Json(res.Error).c_str());
+						}
+						else
+						{
+							fprintf(out, "\"open_ms\": %.3f, \"start_ms\": %.3f, \"audio_s\": %.3f, \"render_s\": %.6f, \"realtime_factor\": %.2f, "
+								"\"buffer_avg_ms\": %.4f, \"buffer_peak_ms\": %.4f, \"late_buffers\": %d, \"peak_rss_kb\": %ld, "
+								"\"hash\": \"%016llx\", \"rms_db\": %.4f",
+								res.OpenMs, res.StartMs, res.AudioSeconds, res.RenderSeconds,
+								res.RenderSeconds > 0 ? res.AudioSeconds / res.RenderSeconds : 0.,
+								res.AvgBufferMs, res.PeakBufferMs, res.LateBuffers, res.PeakRSSKB,
+								(unsigned long long)res.Hash, res.RMS);
+							if (refname != nullptr)
+							{
+								std::string key = RunKey(file, dev, rate, buffer, thr);
+								auto ref = std::find_if(refs.begin(), refs.end(), [&](const Reference &r) { return r.Key == key; });
+								const char *check = "ok";
+								if (ref == refs.end()) check = "no reference";
+								else if (ref->Hash != res.Hash && (tolerance < 0 || fabs(ref->RMS - res.RMS) > tolerance)) check = "output differs";
+								else if (res.RenderSeconds > ref->RenderSeconds * (1 + slack / 100)) check = "too slow";
+								if (ref != refs.end() && strcmp(check, "ok")) failures++;
+								fprintf(out, ", \"check\": \"%s\"", check);
+							}
+							fprintf(out, "}");
+						}
+						fflush(out);
+					}
+				}
+			}
+		}
+	}
+	fprintf(out, "\n  ]\n}\n");
+	if (out != stdout) fclose(out);
+	if (failures > 0) fprintf(stderr, "%d runs failed the check against %s\n", failures, refname);
+	return failures > 0 ? 2 : 0;
+}
@@ -0,0 +1,548 @@
+// Plays back a trace recorded with ZMusic_StartTrace and reports how long
+// every call took when it was recorded and when it was replayed, as JSON.
+//
+// zmusic-replay [options] <trace> <songs>...
+//   -t <factor>    wait between calls as long as the client did, divided by this. Default 0, back to back
+//   -n <count>     how many of the slowest calls to list, default 20
+//   -g <genmidi>   GENMIDI lump for the OPL device
+//   -o <file>      write the report there instead of stdout
+//
+// The songs are files or directories, which are searched for files with
+// the size and hash of the songs in the trace. Calls on songs that are
+// not found are skipped, and listed under "missing".
+//
+// All calls are made on one thread, in the order they were recorded.
+// Songs are opened from memory whichever way the client opened them, and
+// setting changes are made on the global context. ZMusic_GetStats and the
+// other calls that only look at a song are not recorded.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+#include <zmusic.h>
+
+// The same as ETraceRecord in the library.
+enum ETraceRecord
+{
+	TRACE_NONE,
+	TRACE_OPEN,
+	TRACE_CLOSE,
+	TRACE_START,
+	TRACE_STOP,
+	TRACE_PAUSE,
+	TRACE_RESUME,
+	TRACE_UPDATE,
+	TRACE_VOLUMECHANGED,
+	TRACE_FILL,
+	TRACE_RENDER,
+	TRACE_SETSUBSONG,
+	TRACE_PREPARESUBSONG,
+	TRACE_SETPOSITION,
+	TRACE_SETGAIN,
+	TRACE_SETVIRTUAL,
+	TRACE_SETFORMAT,
+	TRACE_PRERENDER,
+	TRACE_SETBUFFERING,
+	TRACE_SETTINGINT,
+	TRACE_SETTINGFLOAT,
+	TRACE_SETTINGSTRING,
+	TRACE_COUNT
+};
+
+// Names, and the arguments as u(nsigned), s(igned), f(loat), h(ash) and t(ext).
+static const struct { const char *Name, *Args; } Calls[TRACE_COUNT] =
+{
+	{ "", "" },
+	{ "OpenSong", "utuht" },
+	{ "Close", "" },
+	{ "Start", "su" },
+	{ "Stop", "" },
+	{ "Pause", "" },
+	{ "Resume", "" },
+	{ "Update", "" },
+	{ "VolumeChanged", "" },
+	{ "FillStream", "u" },
+	{ "RenderToBuffer", "uu" },
+	{ "SetSubsong", "s" },
+	{ "PrepareSubsong", "ss" },
+	{ "SetPosition", "u" },
+	{ "SetGain", "fs" },
+	{ "SetVirtual", "u" },
+	{ "SetStreamFormat", "uu" },
+	{ "SetPrerender", "s" },
+	{ "SetMIDIBuffering", "ss" },
+	{ "ChangeMusicSettingInt", "us" },
+	{ "ChangeMusicSettingFloat", "uf" },
+	{ "ChangeMusicSettingString", "ut" },
+};
+
+struct Record
+{
+	int Type;
+	double Time;	// seconds after the first record.
+	uint64_t Thread;
+	uint64_t Stream;
+	uint64_t RecordedNs;
+	uint64_t ReplayedNs = 0;
+	std::vector<int64_t> Ints;	// all numbers, floats as their bits.
+	std::vector<std::string> Strings;
+	bool Replayed = false;
+};
+
+struct Song
+{
+	uint64_t Size;
+	uint64_t Hash;
+	std::string Name;
+	std::vector<uint8_t> Data;
+	bool Found = false;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t Fnv(const uint8_t *data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 1099511628211ull;
+	return hash;
+}
+
+static bool ReadFile(const std::string &name, std::vector<uint8_t> &data)
+{
+	FILE *f = fopen(name.c_str(), "rb");
+	if (!f) return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data.resize(size > 0 ? size : 0);
+	bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+	fclose(f);
+	return ok;
+}
+
+static std::string Json(const std::string &s)
+{
+	std::string out = "\"";
+	for (unsigned char c : s)
+	{
+		if (c == '"' || c == '\\') { out += '\\'; out += c; }
+		else if (c < 0x20) { char buf[8]; snprintf(buf, 8, "\\u%04x", c); out += buf; }
+		else out += c;
+	}
+	return out + "\"";
+}
+
+static float AsFloat(int64_t bits)
+{
+	uint32_t b = uint32_t(bits);
+	float f;
+	memcpy(&f, &b, 4);
+	return f;
+}
+
+//==========================================================================
+//
+// LoadTrace
+//
+//==========================================================================
+
+class Reader
+{
+	const std::vector<uint8_t> &Data;
+	size_t Pos;
+
+public:
+	bool Failed = false;
+
+	Reader(const std::vector<uint8_t> &data, size_t pos) : Data(data), Pos(pos) {}
+	bool AtEnd() const { return Pos >= Data.size(); }
+
+	uint64_t Unsigned()
+	{
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (Pos >= Data.size()) { Failed = true; return 0; }
+			uint8_t b = Data[Pos++];
+			value |= uint64_t(b & 0x7f) << shift;
+			if (!(b & 0x80)) return value;
+		}
+		Failed = true;
+		return 0;
+	}
+
+	int64_t Signed()
+	{
+		uint64_t v = Unsigned();
+		return int64_t(v >> 1) ^ -int64_t(v & 1);
+	}
+
+	uint64_t Fixed(int bytes)
+	{
+		if (Data.size() - Pos < size_t(bytes)) { Failed = true; Pos = Data.size(); return 0; }
+		uint64_t value = 0;
+		for (int i = 0; i < bytes; i++) value |= uint64_t(Data[Pos++]) << (i * 8);
+		return value;
+	}
+
+	std::string String()
+	{
+		uint64_t len = Unsigned();
+		if (Failed || Data.size() - Pos < len) { Failed = true; Pos = Data.size(); return {}; }
+		std::string s((const char *)Data.data() + Pos, size_t(len));
+		Pos += size_t(len);
+		return s;
+	}
+};
+
+static bool LoadTrace(const char *name, std::vector<Record> &records)
+{
+	std::vector<uint8_t> data;
+	if (!ReadFile(name, data) || data.size() < 8 || memcmp(data.data(), "ZMTRACE", 7) || data[7] != 1)
+	{
+		return false;
+	}
+	Reader rd(data, 8);
+	int64_t time = 0;
+	while (!rd.AtEnd())
+	{
+		Record rec;
+		rec.Type = int(rd.Fixed(1));
+		if (rec.Type <= TRACE_NONE || rec.Type >= TRACE_COUNT) return false;
+		time += rd.Signed();
+		rec.Time = time / 1e6;
+		rec.Thread = rd.Unsigned();
+		rec.Stream = rd.Unsigned();
+		rec.RecordedNs = rd.Unsigned();
+		for (const char *a = Calls[rec.Type].Args; *a; a++)
+		{
+			switch (*a)
+			{
+			case 'u': rec.Ints.push_back(int64_t(rd.Unsigned())); break;
+			case 's': rec.Ints.push_back(rd.Signed()); break;
+			case 'f': rec.Ints.push_back(int64_t(rd.Fixed(4))); break;
+			case 'h': rec.Ints.push_back(int64_t(rd.Fixed(8))); break;
+			case 't': rec.Strings.push_back(rd.String()); break;
+			}
+		}
+		// A trace whose client crashed can end in the middle of a record.
+		if (rd.Failed) break;
+		records.push_back(std::move(rec));
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// FindSongs
+//
+// Only files of a size that is in the trace get read and hashed.
+//
+//==========================================================================
+
+static void FindSongs(const std::vector<std::string> &paths, std::vector<Song> &songs)
+{
+	std::vector<std::string> files;
+	for (auto &path : paths)
+	{
+		std::error_code ec;
+		if (std::filesystem::is_directory(path, ec))
+		{
+			for (auto &entry : std::filesystem::recursive_directory_iterator(path, ec))
+			{
+				if (entry.is_regular_file()) files.push_back(entry.path().string());
+			}
+		}
+		else files.push_back(path);
+	}
+	for (auto &file : files)
+	{
+		std::error_code ec;
+		uint64_t size = std::filesystem::file_size(file, ec);
+		if (ec || std::none_of(songs.begin(), songs.end(), [&](const Song &s) { return !s.Found && s.Size == size; })) continue;
+		std::vector<uint8_t> data;
+		if (!ReadFile(file, data)) continue;
+		uint64_t hash = Fnv(data.data(), data.size());
+		for (auto &song : songs)
+		{
+			if (!song.Found && song.Size == size && song.Hash == hash)
+			{
+				song.Data = data;
+				song.Found = true;
+			}
+		}
+	}
+}
+
+//==========================================================================
+//
+// Replay
+//
+// Makes the call of one record on the streams opened so far.
+//
+//==========================================================================
+
+struct Player
+{
+	std::vector<Song> &Songs;
+	std::map<uint64_t, ZMusic_MusicStream> Streams;
+	std::vector<uint8_t> Buffer;
+
+	Player(std::vector<Song> &songs) : Songs(songs) {}
+
+	bool Replay(Record &rec)
+	{
+		ZMusic_MusicStream stream = nullptr;
+		if (rec.Stream != 0 && rec.Type != TRACE_OPEN)
+		{
+			auto it = Streams.find(rec.Stream);
+			if (it != Streams.end()) stream = it->second;
+			else if (rec.Type < TRACE_SETTINGINT) return false;
+		}
+		auto &v = rec.Ints;
+		auto t0 = Clock::now();
+		switch (rec.Type)
+		{
+		case TRACE_OPEN:
+		{
+			auto song = std::find_if(Songs.begin(), Songs.end(), [&](const Song &s) { return s.Size == uint64_t(v[1]) && s.Hash == uint64_t(v[2]); });
+			if (rec.Stream == 0 || song == Songs.end() || !song->Found) return false;
+			t0 = Clock::now();
+			stream = ZMusic_OpenSongMem(song->Data.data(), song->Data.size(), EMidiDevice(v[0]), rec.Strings[0].empty() ? nullptr : rec.Strings[0].c_str());
+			if (stream != nullptr) Streams[rec.Stream] = stream;
+			break;
+		}
+		case TRACE_CLOSE:
+			ZMusic_Close(stream);
+			Streams.erase(rec.Stream);
+			break;
+		case TRACE_START:			ZMusic_Start(stream, int(v[0]), v[1] != 0); break;
+		case TRACE_STOP:			ZMusic_Stop(stream); break;
+		case TRACE_PAUSE:			ZMusic_Pause(stream); break;
+		case TRACE_RESUME:			ZMusic_Resume(stream); break;
+		case TRACE_UPDATE:			ZMusic_Update(stream); break;
+		case TRACE_VOLUMECHANGED:	ZMusic_VolumeChanged(stream); break;
+		case TRACE_FILL:
+			if (Buffer.size() < size_t(v[0])) Buffer.resize(size_t(v[0]));
+			t0 = Clock::now();
+			ZMusic_FillStream(stream, Buffer.data(), int(v[0]));
+			break;
+		case TRACE_RENDER:
+			if (Buffer.size() < size_t(v[0]) * 8) Buffer.resize(size_t(v[0]) * 8);	// stereo float is the largest frame.
+			t0 = Clock::now();
+			ZMusic_RenderToBuffer(stream, Buffer.data(), size_t(v[0]), int(v[1]));
+			break;
+		case TRACE_SETSUBSONG:		ZMusic_SetSubsong(stream, int(v[0])); break;
+		case TRACE_PREPARESUBSONG:	ZMusic_PrepareSubsong(stream, int(v[0]), int(v[1])); break;
+		case TRACE_SETPOSITION:		ZMusic_SetPosition(stream, unsigned(v[0])); break;
+		case TRACE_SETGAIN:			ZMusic_SetGain(stream, AsFloat(v[0]), int(v[1])); break;
+		case TRACE_SETVIRTUAL:		ZMusic_SetVirtual(stream, v[0] != 0); break;
+		case TRACE_SETFORMAT:		ZMusic_SetStreamFormat(stream, SampleType(v[0]), v[1] != 0); break;
+		case TRACE_PRERENDER:		ZMusic_SetPrerender(stream, int(v[0])); break;
+		case TRACE_SETBUFFERING:	ZMusic_SetMIDIBuffering(stream, int(v[0]), int(v[1])); break;
+		case TRACE_SETTINGINT:		ChangeMusicSettingInt(EIntConfigKey(v[0]), stream, int(v[1]), nullptr); break;
+		case TRACE_SETTINGFLOAT:	ChangeMusicSettingFloat(EFloatConfigKey(v[0]), stream, AsFloat(v[1]), nullptr); break;
+		case TRACE_SETTINGSTRING:	ChangeMusicSettingString(EStringConfigKey(v[0]), stream, rec.Strings[0].c_str()); break;
+		}
+		rec.ReplayedNs = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+		return true;
+	}
+
+	~Player()
+	{
+		for (auto &s : Streams) ZMusic_Close(s.second);
+	}
+};
+
+//==========================================================================
+//
+// Report
+//
+//==========================================================================
+
+static std::map<int, std::string> SettingNames()
+{
+	std::map<int, std::string> names;
+	for (auto setting = ZMusic_GetConfiguration(); setting->name != nullptr; setting++)
+	{
+		names[setting->identifier] = setting->name;
+	}
+	return names;
+}
+
+static std::string Arguments(const Record &rec, const std::map<int, std::string> &settings)
+{
+	std::string out;
+	size_t ints = 0, strings = 0;
+	for (const char *a = Calls[rec.Type].Args; *a; a++)
+	{
+		if (!out.empty()) out += ", ";
+		char buf[64];
+		int64_t v = *a == 't' ? 0 : rec.Ints[ints++];
+		if (a == Calls[rec.Type].Args && rec.Type >= TRACE_SETTINGINT)
+		{
+			auto name = settings.find(int(v));
+			out += name != settings.end() ? name->second : std::to_string(v);
+			continue;
+		}
+		switch (*a)
+		{
+		case 'u': case 's': snprintf(buf, sizeof(buf), "%lld", (long long)v); break;
+		case 'f': snprintf(buf, sizeof(buf), "%g", AsFloat(v)); break;
+		case 'h': snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)v); break;
+		case 't': out += rec.Strings[strings++]; continue;
+		}
+		out += buf;
+	}
+	return out;
+}
+
+static void Slowest(FILE *out, const char *title, std::vector<const Record *> list, uint64_t Record::*ns, size_t count,
+	const std::vector<Record> &records, const std::map<int, std::string> &settings)
+{
+	std::sort(list.begin(), list.end(), [&](const Record *a, const Record *b) { return a->*ns > b->*ns; });
+	if (list.size() > count) list.resize(count);
+	fprintf(out, ",\n  \"%s\": [", title);
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		const Record &rec = *list[i];
+		fprintf(out, "%s\n    {\"record\": %zu, \"time_s\": %.6f, \"thread\": %llu, \"stream\": %llu, \"call\": \"%s\", \"args\": %s, \"recorded_us\": %.1f, \"replayed_us\": %.1f}",
+			i ? "," : "", size_t(&rec - records.data()), rec.Time, (unsigned long long)rec.Thread, (unsigned long long)rec.Stream,
+			Calls[rec.Type].Name, Json(Arguments(rec, settings)).c_str(), rec.RecordedNs / 1e3, rec.ReplayedNs / 1e3);
+	}
+	fprintf(out, "\n  ]");
+}
+
+static void Quiet(int severity, const char *msg)
+{
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: zmusic-replay [-t factor] [-n count] [-g genmidi] [-o file] <trace> <songs>...\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *tracename = nullptr, *outname = nullptr;
+	std::vector<std::string> paths;
+	double speed = 0;
+	size_t count = 20;
+	std::vector<uint8_t> genmidi;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' || arg[1] == 0 || arg[2] != 0)
+		{
+			if (tracename == nullptr) tracename = arg;
+			else paths.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc) Usage();
+		const char *val = argv[++i];
+		switch (arg[1])
+		{
+		case 't': speed = atof(val); break;
+		case 'n': count = size_t(atoi(val)); break;
+		case 'o': outname = val; break;
+		case 'g':
+			if (!ReadFile(val, genmidi))
+			{
+				fprintf(stderr, "Cannot open %s\n", val);
+				return 1;
+			}
+			break;
+		default: Usage();
+		}
+	}
+	if (tracename == nullptr) Usage();
+
+	std::vector<Record> records;
+	if (!LoadTrace(tracename, records))
+	{
+		fprintf(stderr, "%s is not a trace this program can read\n", tracename);
+		return 1;
+	}
+	std::vector<Song> songs;
+	for (auto &rec : records)
+	{
+		if (rec.Type == TRACE_OPEN && std::none_of(songs.begin(), songs.end(), [&](const Song &s) { return s.Size == uint64_t(rec.Ints[1]) && s.Hash == uint64_t(rec.Ints[2]); }))
+		{
+			songs.push_back({ uint64_t(rec.Ints[1]), uint64_t(rec.Ints[2]), rec.Strings[1] });
+		}
+	}
+	FindSongs(paths, songs);
+
+	FILE *out = outname ? fopen(outname, "w") : stdout;
+	if (!out)
+	{
+		fprintf(stderr, "Cannot create %s\n", outname);
+		return 1;
+	}
+
+	ZMusicCallbacks callbacks = {};
+	callbacks.MessageFunc = Quiet;
+	ZMusic_SetCallbacks(&callbacks);
+	if (!genmidi.empty()) ZMusic_SetGenMidi(genmidi.data());
+
+	size_t skipped = 0;
+	{
+		Player player(songs);
+		auto start = Clock::now();
+		for (auto &rec : records)
+		{
+			if (speed > 0) std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(rec.Time / speed)));
+			rec.Replayed = player.Replay(rec);
+			if (!rec.Replayed) skipped++;
+		}
+	}
+
+	fprintf(out, "{\n  \"trace\": %s,\n  \"records\": %zu,\n  \"skipped\": %zu,\n  \"missing\": [", Json(tracename).c_str(), records.size(), skipped);
+	bool first = true;
+	for (auto &song : songs)
+	{
+		if (song.Found) continue;
+		fprintf(out, "%s\n    {\"name\": %s, \"size\": %llu, \"hash\": \"%016llx\"}", first ? "" : ",", Json(song.Name).c_str(), (unsigned long long)song.Size, (unsigned long long)song.Hash);
+		first = false;
+	}
+	fprintf(out, "\n  ],\n  \"calls\": [");
+
+	std::vector<const Record *> replayed;
+	first = true;
+	for (int type = TRACE_OPEN; type < TRACE_COUNT; type++)
+	{
+		size_t n = 0;
+		uint64_t rtotal = 0, rmax = 0, ptotal = 0, pmax = 0;
+		for (auto &rec : records)
+		{
+			if (rec.Type != type || !rec.Replayed) continue;
+			n++;
+			rtotal += rec.RecordedNs;
+			rmax = std::max(rmax, rec.RecordedNs);
+			ptotal += rec.ReplayedNs;
+			pmax = std::max(pmax, rec.ReplayedNs);
+			replayed.push_back(&rec);
+		}
+		if (n == 0) continue;
+		fprintf(out, "%s\n    {\"call\": \"%s\", \"count\": %zu, \"recorded_avg_us\": %.1f, \"recorded_max_us\": %.1f, \"replayed_avg_us\": %.1f, \"replayed_max_us\": %.1f}",
+			first ? "" : ",", Calls[type].Name, n, rtotal / 1e3 / n, rmax / 1e3, ptotal / 1e3 / n, pmax / 1e3);
+		first = false;
+	}
+	fprintf(out, "\n  ]");
+
+	auto settings = SettingNames();
+	Slowest(out, "slowest_recorded", replayed, &Record::RecordedNs, count, records, settings);
+	Slowest(out, "slowest_replayed", replayed, &Record::ReplayedNs, count, records, settings);
+	fprintf(out, "\n}\n");
+	if (out != stdout) fclose(out);
+	return 0;
+}
@@ -33,6 +33,8 @@
 
 #include <algorithm>
 #include <stdio.h>
+#include <string.h>
+#include <mutex>
 #include "mpg123_decoder.h"
 #include "loader/i_module.h"
 
@@ -53,29 +55,42 @@ FModule MPG123Module{"MPG123"};
 
 bool IsMPG123Present()
 {
-#if !defined DYN_MPG123
-	return true;
-#else
+	static std::mutex lock;
 	static bool cached_result = false;
 	static bool done = false;
 
+	// ZMusic_PreloadCodecs may be doing this on another thread.
+	std::lock_guard<std::mutex> guard(lock);
 	if (!done)
 	{
 		done = true;
+#if !defined DYN_MPG123
+		cached_result = true;
+#else
 		auto abspath = FModule_GetProgDir() + "/" MPG123LIB;
 		cached_result = MPG123Module.Load({abspath.c_str(), MPG123LIB});
+#endif
+		if (cached_result) cached_result = mpg123_init() == MPG123_OK;
 	}
 	return cached_result;
-#endif
 }
 
 
-static bool inited = false;
+// A negative index size lets mpg123 grow the index in these steps, so it records every single frame.
+enum { INDEX_GROW_STEP = 1024 };
 
 
 off_t MPG123Decoder::file_lseek(void *handle, off_t offset, int whence)
 {
-    auto &reader = reinterpret_cast<MPG123Decoder*>(handle)->Reader;
+    auto self = reinterpret_cast<MPG123Decoder*>(handle);
+    auto &reader = self->Reader;
+
+    if(self->PretendEnd)
+    {
+        self->AtEnd = whence == SEEK_END;
+        if(self->AtEnd)
+            return (off_t)(reader->filelength() + offset);
+    }
 
     if(whence == SEEK_CUR)
     {
@@ -95,8 +110,13 @@ off_t MPG123Decoder::file_lseek(void *handle, off_t offset, int whence)
 
 ssize_t MPG123Decoder::file_read(void *handle, void *buffer, size_t bytes)
 {
-    auto &reader = reinterpret_cast<MPG123Decoder*>(handle)->Reader;
-    return (ssize_t)reader->read(buffer, (long)bytes);
+    auto self = reinterpret_cast<MPG123Decoder*>(handle);
+    if(self->AtEnd)
+    {
+        memset(buffer, 0, bytes);
+        return (ssize_t)bytes;
+    }
+    return (ssize_t)self->Reader->read(buffer, (long)bytes);
 }
 
 
@@ -114,19 +134,15 @@ MPG123Decoder::~MPG123Decoder()
 
 bool MPG123Decoder::open(MusicIO::FileInterface *reader)
 {
-    if(!inited)
-    {
-		if (!IsMPG123Present()) return false;
-		if(mpg123_init() != MPG123_OK) return false;
-		inited = true;
-    }
+	if (!IsMPG123Present()) return false;
 
 	Reader = reader;
 
     {
         MPG123 = mpg123_new(NULL, NULL);
+        mpg123_param(MPG123, MPG123_INDEX_SIZE, -INDEX_GROW_STEP, 0);
         if(mpg123_replace_reader_handle(MPG123, file_read, file_lseek, NULL) == MPG123_OK &&
-           mpg123_open_handle(MPG123, this) == MPG123_OK)
+           OpenHandle())
         {
             int enc, channels;
             long srate;
@@ -137,7 +153,9 @@ bool MPG123Decoder::open(MusicIO::FileInterface *reader)
                    mpg123_format_none(MPG123) == MPG123_OK &&
                    mpg123_format(MPG123, srate, channels, MPG123_ENC_SIGNED_16) == MPG123_OK)
                 {
-                    // All OK
+                    // All OK. The scan would wait for all of a stream, mpg123 indexes those as they play.
+                    if (Index.empty() && !reader->mayWait()) BuildIndex();
+                    else mpg123_set_index(MPG123, Index.data(), IndexStep, Index.size());
                     Done = false;
                     return true;
                 }
@@ -152,6 +170,51 @@ bool MPG123Decoder::open(MusicIO::FileInterface *reader)
 	return false;
 }
 
+//==========================================================================
+//
+// MPG123Decoder :: OpenHandle
+//
+// mpg123 reads the last 128 bytes of seekable files when it opens them, to
+// look for an ID3v1 tag. For data that is still arriving that would wait for
+// all of it, so those seeks are only pretended and find zeros. A tag that is
+// there gets skipped when playback reaches it.
+//
+//==========================================================================
+
+bool MPG123Decoder::OpenHandle()
+{
+	PretendEnd = Reader->mayWait();
+	bool ok = mpg123_open_handle(MPG123, this) == MPG123_OK;
+	PretendEnd = AtEnd = false;
+	return ok;
+}
+
+//==========================================================================
+//
+// MPG123Decoder :: BuildIndex
+//
+// Parses all frame headers once. Without this mpg123 only knows the frames
+// it has already played and every seek past them scans forward through the
+// file, which is what a looping song does each time it wraps to its loop
+// start. The scan also yields the exact length. A failed scan (e.g. on an
+// unseekable reader) leaves mpg123 to build its index on the fly as before.
+//
+//==========================================================================
+
+bool MPG123Decoder::BuildIndex()
+{
+	if (mpg123_scan(MPG123) != MPG123_OK) return false;
+
+	off_t *offsets = nullptr;
+	off_t step = 0;
+	size_t fill = 0;
+	if (mpg123_index(MPG123, &offsets, &step, &fill) != MPG123_OK || offsets == nullptr || fill == 0) return false;
+	Index.assign(offsets, offsets + fill);
+	IndexStep = step;
+	ScannedLength = mpg123_length(MPG123);
+	return true;
+}
+
 void MPG123Decoder::getInfo(int *samplerate, ChannelConfig *chans, SampleType *type)
 {
     int enc = 0, channels = 0;
@@ -231,8 +294,15 @@ size_t MPG123Decoder::getSampleOffset()
 
 size_t MPG123Decoder::getSampleLength()
 {
-    off_t len = mpg123_length(MPG123);
+    off_t len = ScannedLength >= 0 ? ScannedLength : mpg123_length(MPG123);
     return (len > 0) ? len : 0;
 }
 
+#else
+
+bool IsMPG123Present()
+{
+	return false;
+}
+
 #endif
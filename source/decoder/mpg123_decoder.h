@@ -3,6 +3,8 @@
 
 #include "zmusic/sounddecoder.h"
 
+bool IsMPG123Present();
+
 #ifdef HAVE_MPG123
 
 #ifdef _MSC_VER
@@ -10,6 +12,8 @@
 typedef ptrdiff_t ssize_t;
 #endif
 
+#include <vector>
+
 #ifndef DYN_MPG123
 #include "mpg123.h"
 #else
@@ -40,6 +44,19 @@ private:
     bool Done = false;
 	MusicIO::FileInterface* Reader = nullptr;
 
+	// The full frame index from the scan at open. It survives the restarts in seek
+	// so that a loop back to Loop_Start never has to parse the file from the beginning.
+	std::vector<off_t> Index;
+	off_t IndexStep = 0;
+	off_t ScannedLength = -1;
+
+	// Only while a reader that may wait opens, see OpenHandle.
+	bool PretendEnd = false;
+	bool AtEnd = false;
+
+	bool OpenHandle();
+	bool BuildIndex();
+
 	static off_t file_lseek(void *handle, off_t offset, int whence);
     static ssize_t file_read(void *handle, void *buffer, size_t bytes);
 };
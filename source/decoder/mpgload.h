@@ -17,6 +17,10 @@ DEFINE_ENTRY(off_t (*)(mpg123_handle *mh, off_t sampleoff, int whence), mpg123_s
 DEFINE_ENTRY(int (*)(mpg123_handle *mh, long rate, int channels, int encodings), mpg123_format)
 DEFINE_ENTRY(off_t (*)(mpg123_handle *mh), mpg123_tell)
 DEFINE_ENTRY(off_t (*)(mpg123_handle *mh), mpg123_length)
+DEFINE_ENTRY(int (*)(mpg123_handle *mh, enum mpg123_parms type, long value, double fvalue), mpg123_param)
+DEFINE_ENTRY(int (*)(mpg123_handle *mh), mpg123_scan)
+DEFINE_ENTRY(int (*)(mpg123_handle *mh, off_t **offsets, off_t *step, size_t *fill), mpg123_index)
+DEFINE_ENTRY(int (*)(mpg123_handle *mh, off_t *offsets, off_t step, size_t fill), mpg123_set_index)
 
 #undef DEFINE_ENTRY
 
@@ -34,6 +38,10 @@ DEFINE_ENTRY(off_t (*)(mpg123_handle *mh), mpg123_length)
 #define mpg123_tell p_mpg123_tell
 #define mpg123_format p_mpg123_format
 #define mpg123_length p_mpg123_length
+#define mpg123_param p_mpg123_param
+#define mpg123_scan p_mpg123_scan
+#define mpg123_index p_mpg123_index
+#define mpg123_set_index p_mpg123_set_index
 #endif
 
 #endif
@@ -32,6 +32,7 @@
 */
 
 #include <algorithm>
+#include <mutex>
 #include "sndfile_decoder.h"
 #include "loader/i_module.h"
 
@@ -55,9 +56,12 @@ extern "C" int IsSndFilePresent()
 #if !defined DYN_SNDFILE
 	return true;
 #else
+	static std::mutex lock;
 	static bool cached_result = false;
 	static bool done = false;
 
+	// ZMusic_PreloadCodecs may be doing this on another thread.
+	std::lock_guard<std::mutex> guard(lock);
 	if (!done)
 	{
 		done = true;
@@ -145,12 +149,27 @@ void SndFileDecoder::getInfo(int *samplerate, ChannelConfig *chans, SampleType *
     else
         *chans = ChannelConfig_Mono;
 
-    *type = SampleType_Int16;
+    *type = OutputType;
+}
+
+bool SndFileDecoder::setSampleType(SampleType type)
+{
+    if(type != SampleType_Int16 && type != SampleType_Float32)
+        return false;
+    OutputType = type;
+    return true;
 }
 
 size_t SndFileDecoder::read(char *buffer, size_t bytes)
 {
-    short *out = (short*)buffer;
+    if(OutputType == SampleType_Float32)
+    {
+        size_t frames = bytes / SndInfo.channels / 4;
+        size_t got = (size_t)sf_readf_float(SndFile, (float*)buffer, frames);
+        return got * SndInfo.channels * 4;
+    }
+
+    char *out = buffer;
     size_t frames = bytes / SndInfo.channels / 2;
     size_t total = 0;
 
@@ -158,19 +177,28 @@ size_t SndFileDecoder::read(char *buffer, size_t bytes)
     // to the 16-bit shorts we use, which causes some PCM samples to overflow
     // and wrap, creating static. So instead, read the samples as floats and
     // convert to short ourselves.
-    // Use a loop to convert a handful of samples at a time, avoiding a heap
-    // allocation for temporary storage. 64 at a time works, though maybe it
-    // could be more.
+    // Floats take twice the room, so half of what is left gets decoded into
+    // the rest of the buffer and converted in place. Going forward this never
+    // overwrites a float that is still needed. Only the last frame needs a
+    // buffer of its own.
     while(total < frames)
     {
-        size_t todo = std::min<size_t>(frames-total, 64/SndInfo.channels);
-        float tmp[64];
+        float last[2];
+        size_t todo = (frames - total) / 2;
+        char *in = todo > 0 ? out : (char*)last;
+        if(todo == 0) todo = 1;
 
-        size_t got = (size_t)sf_readf_float(SndFile, tmp, todo);
+        size_t got = (size_t)sf_readf_float(SndFile, (float*)in, todo);
         if(got < todo) frames = total + got;
 
         for(size_t i = 0;i < got*SndInfo.channels;i++)
-            *out++ = (short)std::max(std::min(tmp[i] * 32767.f, 32767.f), -32768.f);
+        {
+            float v;
+            memcpy(&v, in + i*4, 4);
+            short s = (short)std::max(std::min(v * 32767.f, 32767.f), -32768.f);
+            memcpy(out, &s, 2);
+            out += 2;
+        }
         total += got;
     }
     return total * SndInfo.channels * 2;
@@ -181,7 +209,7 @@ std::vector<uint8_t> SndFileDecoder::readAll()
     if(SndInfo.frames <= 0)
         return SoundDecoder::readAll();
 
-    int framesize = 2 * SndInfo.channels;
+    int framesize = ZMusic_SampleTypeSize(OutputType) * SndInfo.channels;
 	std::vector<uint8_t> output;
 
     output.resize((unsigned)(SndInfo.frames * framesize));
@@ -209,6 +237,85 @@ size_t SndFileDecoder::getSampleLength()
     return (size_t)((SndInfo.frames > 0) ? SndInfo.frames : 0);
 }
 
+//==========================================================================
+//
+// FLAC writer
+//
+//==========================================================================
+
+struct SndFileWriter
+{
+	FILE *File;
+	SNDFILE *SndFile;
+};
+
+static sf_count_t writer_get_filelen(void *user_data)
+{
+	FILE *f = reinterpret_cast<SndFileWriter*>(user_data)->File;
+	long pos = ftell(f);
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, pos, SEEK_SET);
+	return len;
+}
+
+static sf_count_t writer_seek(sf_count_t offset, int whence, void *user_data)
+{
+	FILE *f = reinterpret_cast<SndFileWriter*>(user_data)->File;
+	if (fseek(f, (long)offset, whence) != 0)
+		return -1;
+	return ftell(f);
+}
+
+static sf_count_t writer_read(void *ptr, sf_count_t count, void *user_data)
+{
+	return fread(ptr, 1, (size_t)count, reinterpret_cast<SndFileWriter*>(user_data)->File);
+}
+
+static sf_count_t writer_write(const void *ptr, sf_count_t count, void *user_data)
+{
+	return fwrite(ptr, 1, (size_t)count, reinterpret_cast<SndFileWriter*>(user_data)->File);
+}
+
+static sf_count_t writer_tell(void *user_data)
+{
+	return ftell(reinterpret_cast<SndFileWriter*>(user_data)->File);
+}
+
+SndFileWriter *SndFile_OpenFLACWriter(FILE *file, int samplerate, int channels)
+{
+	if (!IsSndFilePresent()) return nullptr;
+
+	SF_VIRTUAL_IO sfio = { writer_get_filelen, writer_seek, writer_read, writer_write, writer_tell };
+	SF_INFO info = {};
+	info.samplerate = samplerate;
+	info.channels = channels;
+	info.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+
+	auto writer = new SndFileWriter{ file, nullptr };
+	writer->SndFile = sf_open_virtual(&sfio, SFM_WRITE, &info, writer);
+	if (writer->SndFile == nullptr)
+	{
+		delete writer;
+		return nullptr;
+	}
+	// Synths may overshoot, which must not wrap around.
+	sf_command(writer->SndFile, SFC_SET_CLIPPING, nullptr, SF_TRUE);
+	return writer;
+}
+
+bool SndFile_WriteFloat(SndFileWriter *writer, const float *data, size_t frames)
+{
+	return sf_writef_float(writer->SndFile, data, (sf_count_t)frames) == (sf_count_t)frames;
+}
+
+bool SndFile_CloseWriter(SndFileWriter *writer)
+{
+	bool res = sf_close(writer->SndFile) == 0;
+	delete writer;
+	return res;
+}
+
 // band-aid for FluidSynth, which is C, not C++ and cannot use the module interface.
 #ifdef DYN_SNDFILE
 
@@ -239,6 +346,21 @@ extern "C" int sf_close(SNDFILE * sndfile)
 
 #else // in case someone decided to build without sndfile support
 
+SndFileWriter *SndFile_OpenFLACWriter(FILE *file, int samplerate, int channels)
+{
+    return nullptr;
+}
+
+bool SndFile_WriteFloat(SndFileWriter *writer, const float *data, size_t frames)
+{
+    return false;
+}
+
+bool SndFile_CloseWriter(SndFileWriter *writer)
+{
+    return false;
+}
+
 extern "C" int IsSndFilePresent()
 {
     return false;
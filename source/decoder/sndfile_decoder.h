@@ -3,6 +3,15 @@
 
 #include "zmusic/sounddecoder.h"
 
+extern "C" int IsSndFilePresent();
+
+// Writes 16 bit FLAC to an open file, for the wave writer. Returns nullptr without libsndfile.
+// Closing the writer finishes the file but leaves closing it to the caller.
+struct SndFileWriter;
+SndFileWriter *SndFile_OpenFLACWriter(FILE *file, int samplerate, int channels);
+bool SndFile_WriteFloat(SndFileWriter *writer, const float *data, size_t frames);
+bool SndFile_CloseWriter(SndFileWriter *writer);
+
 #ifdef HAVE_SNDFILE
 
 #ifndef DYN_SNDFILE
@@ -20,6 +29,7 @@ struct SndFileDecoder : public SoundDecoder
     virtual bool seek(size_t ms_offset, bool ms, bool mayrestart) override;
 	virtual size_t getSampleOffset() override;
     virtual size_t getSampleLength() override;
+    virtual bool setSampleType(SampleType type) override;
 
     SndFileDecoder() = default;
     // Make non-copyable
@@ -34,6 +44,7 @@ protected:
 private:
     SNDFILE *SndFile = nullptr;
     SF_INFO SndInfo;
+	SampleType OutputType = SampleType_Int16;
 	MusicIO::FileInterface* Reader = nullptr;
 
     static sf_count_t file_get_filelen(void *user_data);
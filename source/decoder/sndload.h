@@ -12,6 +12,8 @@ DEFINE_ENTRY(SNDFILE* (*)(SF_VIRTUAL_IO *sfvirtual, int mode, SF_INFO *sfinfo, v
 DEFINE_ENTRY(sf_count_t (*)(SNDFILE *sndfile, float *ptr, sf_count_t frames), sf_readf_float)
 DEFINE_ENTRY(sf_count_t(*)(SNDFILE* sndfile, short* ptr, sf_count_t frames), sf_readf_short)
 DEFINE_ENTRY(sf_count_t (*)(SNDFILE *sndfile, sf_count_t frames, int whence), sf_seek)
+DEFINE_ENTRY(sf_count_t (*)(SNDFILE *sndfile, const float *ptr, sf_count_t frames), sf_writef_float)
+DEFINE_ENTRY(int (*)(SNDFILE *sndfile, int command, void *data, int datasize), sf_command)
 #undef DEFINE_ENTRY
 
 #ifndef IN_IDE_PARSER
@@ -19,6 +21,8 @@ DEFINE_ENTRY(sf_count_t (*)(SNDFILE *sndfile, sf_count_t frames, int whence), sf
 #define sf_open_virtual p_sf_open_virtual
 #define sf_readf_float p_sf_readf_float
 #define sf_seek p_sf_seek
+#define sf_writef_float p_sf_writef_float
+#define sf_command p_sf_command
 #endif
 
 #endif
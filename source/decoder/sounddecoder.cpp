@@ -33,34 +33,73 @@
 */
 
 
+#include <algorithm>
+#include <mutex>
 #include "zmusic/zmusic_internal.h"
 #include "sndfile_decoder.h"
 #include "mpg123_decoder.h"
+#include "wav_decoder.h"
 
-SoundDecoder *SoundDecoder::CreateDecoder(MusicIO::FileInterface *reader)
-{
-    SoundDecoder *decoder = NULL;
-    auto pos = reader->tell();
+//==========================================================================
+//
+// The decoder registry
+//
+// The built-in decoders that need no libraries come first, so the files
+// they handle never pay for loading and probing libsndfile.
+//
+//==========================================================================
 
-#ifdef HAVE_SNDFILE
-		decoder = new SndFileDecoder;
-		if (decoder->open(reader))
-			return decoder;
-		reader->seek(pos, SEEK_SET);
+static std::mutex RegistryLock;
 
-		delete decoder;
-		decoder = NULL;
+static std::vector<SoundDecoderFactory>& Factories()
+{
+	static std::vector<SoundDecoderFactory> factories = []
+	{
+		std::vector<SoundDecoderFactory> list;
+		list.push_back({ "WAV", 200, WavDecoder::probe, [] () -> SoundDecoder* { return new WavDecoder; } });
+#ifdef HAVE_SNDFILE
+		list.push_back({ "SndFile", 100, nullptr, [] () -> SoundDecoder* { return new SndFileDecoder; } });
 #endif
 #ifdef HAVE_MPG123
-		decoder = new MPG123Decoder;
+		list.push_back({ "MPG123", 50, nullptr, [] () -> SoundDecoder* { return new MPG123Decoder; } });
+#endif
+		return list;
+	}();
+	return factories;
+}
+
+void SoundDecoder::Register(const SoundDecoderFactory& factory)
+{
+	std::lock_guard<std::mutex> lock(RegistryLock);
+	auto& list = Factories();
+	list.erase(std::remove_if(list.begin(), list.end(), [&](const SoundDecoderFactory& f) { return !strcmp(f.Name, factory.Name); }), list.end());
+	// stable, so that decoders of the same priority keep the order they were added in.
+	auto it = std::upper_bound(list.begin(), list.end(), factory, [](const SoundDecoderFactory& a, const SoundDecoderFactory& b) { return a.Priority > b.Priority; });
+	list.insert(it, factory);
+}
+
+SoundDecoder *SoundDecoder::CreateDecoder(MusicIO::FileInterface *reader)
+{
+	auto pos = reader->tell();
+	uint8_t header[64];
+	size_t headerlen = (size_t)std::max<long>(reader->read(header, sizeof(header)), 0);
+	reader->seek(pos, SEEK_SET);
+
+	std::vector<SoundDecoderFactory> list;
+	{
+		std::lock_guard<std::mutex> lock(RegistryLock);
+		list = Factories();
+	}
+	for (auto& factory : list)
+	{
+		if (factory.Probe && !factory.Probe(header, headerlen)) continue;
+		SoundDecoder* decoder = factory.Create();
 		if (decoder->open(reader))
 			return decoder;
 		reader->seek(pos, SEEK_SET);
-
 		delete decoder;
-		decoder = NULL;
-#endif
-    return decoder;
+	}
+	return nullptr;
 }
 
 
@@ -81,6 +120,41 @@ std::vector<uint8_t> SoundDecoder::readAll()
     return output;
 }
 
+//==========================================================================
+//
+// SoundDecoder :: readLooped
+//
+// Default implementation, for decoders that can only read and seek.
+//
+//==========================================================================
+
+size_t SoundDecoder::readLooped(char *buffer, size_t bytes, size_t loopstart, size_t loopend)
+{
+	int srate;
+	ChannelConfig chans;
+	SampleType type;
+	getInfo(&srate, &chans, &type);
+	const size_t framesize = ZMusic_ChannelCount(chans) * ZMusic_SampleTypeSize(type);
+
+	size_t total = 0;
+	bool seeked = false;
+	while (total < bytes)
+	{
+		size_t pos = getSampleOffset();
+		// libmpg123 will not read the full requested length for the last block in the file.
+		size_t want = pos < loopend ? std::min(bytes - total, (loopend - pos) * framesize) : 0;
+		size_t got = want > 0 ? read(buffer + total, want) : 0;
+		total += got;
+		if (got > 0) seeked = false;
+		if (got == want && want > 0) continue;
+
+		// At the loop end or the end of the file, unless the seek did not get anywhere.
+		if (seeked || !seek(loopstart, false, true)) break;
+		seeked = true;
+	}
+	return total;
+}
+
 //==========================================================================
 //
 // other callbacks
@@ -156,6 +230,18 @@ short* dumb_decode_vorbis(int outlen, const void* oggstream, int sizebytes)
 	return samples;
 }
 
+DLL_EXPORT zmusic_bool ZMusic_PreloadCodecs()
+{
+	bool ok = true;
+#ifdef HAVE_SNDFILE
+	if (!IsSndFilePresent()) ok = false;
+#endif
+#ifdef HAVE_MPG123
+	if (!IsMPG123Present()) ok = false;
+#endif
+	return ok;
+}
+
 DLL_EXPORT struct SoundDecoder* CreateDecoder(const uint8_t* data, size_t size, zmusic_bool isstatic)
 {
 	MusicIO::FileInterface* reader;
@@ -0,0 +1,200 @@
+/*
+** wav_decoder.cpp
+** Built-in decoder for uncompressed WAV files
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <algorithm>
+#include "zmusic/zmusic_internal.h"
+#include "wav_decoder.h"
+
+enum
+{
+	WAVE_FORMAT_PCM = 1,
+	WAVE_FORMAT_IEEE_FLOAT = 3,
+	WAVE_FORMAT_EXTENSIBLE = 0xfffe,
+};
+
+static uint32_t GetLE32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+static uint16_t GetLE16(const uint8_t* p)
+{
+	return uint16_t(p[0] | (p[1] << 8));
+}
+
+//==========================================================================
+//
+// WavDecoder :: probe
+//
+//==========================================================================
+
+bool WavDecoder::probe(const uint8_t* header, size_t length)
+{
+	return length >= 12 && !memcmp(header, "RIFF", 4) && !memcmp(header + 8, "WAVE", 4);
+}
+
+WavDecoder::~WavDecoder()
+{
+	if (Reader) Reader->close();
+	Reader = nullptr;
+}
+
+//==========================================================================
+//
+// WavDecoder :: open
+//
+// Everything libsndfile would have to convert in a way this doesn't know,
+// like compressed formats or more than two channels, is left to it.
+//
+//==========================================================================
+
+bool WavDecoder::open(MusicIO::FileInterface* reader)
+{
+	uint8_t header[12];
+	if (reader->read(header, 12) != 12 || !probe(header, 12)) return false;
+
+	long filelength = reader->filelength();
+	bool havefmt = false;
+	uint8_t chunk[8];
+	while (reader->read(chunk, 8) == 8)
+	{
+		uint32_t size = GetLE32(chunk + 4);
+		long start = reader->tell();
+		if (!memcmp(chunk, "fmt ", 4))
+		{
+			uint8_t fmt[40] = {};
+			if (size < 16 || reader->read(fmt, (int32_t)std::min<uint32_t>(size, sizeof(fmt))) < 16) return false;
+			int tag = GetLE16(fmt);
+			Channels = GetLE16(fmt + 2);
+			SampleRate = (int)GetLE32(fmt + 4);
+			Bits = GetLE16(fmt + 14);
+			// The first two bytes of the subformat GUID are the format tag.
+			if (tag == WAVE_FORMAT_EXTENSIBLE && size >= 26) tag = GetLE16(fmt + 24);
+			if (tag == WAVE_FORMAT_PCM) IsFloat = false;
+			else if (tag == WAVE_FORMAT_IEEE_FLOAT && Bits == 32) IsFloat = true;
+			else return false;
+			if ((Channels != 1 && Channels != 2) || SampleRate <= 0 || (Bits != 8 && Bits != 16 && Bits != 24 && Bits != 32)) return false;
+			havefmt = true;
+		}
+		else if (!memcmp(chunk, "data", 4))
+		{
+			if (!havefmt) return false;
+			size = (uint32_t)std::min<long>(size, filelength - start);
+			DataStart = start;
+			Frames = size / FileFrameSize();
+			Pos = 0;
+			Reader = reader;
+			const uint8_t* mem = reader->memoryData();
+			if (mem) Data = mem + DataStart;
+			return Frames > 0;
+		}
+		// Chunks are padded to an even size.
+		if (reader->seek(start + long(size) + (size & 1), SEEK_SET) != 0) break;
+	}
+	return false;
+}
+
+void WavDecoder::getInfo(int* samplerate, ChannelConfig* chans, SampleType* type)
+{
+	*samplerate = SampleRate;
+	*chans = Channels == 2 ? ChannelConfig_Stereo : ChannelConfig_Mono;
+	*type = Bits == 8 ? SampleType_UInt8 : Bits == 16 ? SampleType_Int16 : SampleType_Float32;
+}
+
+//==========================================================================
+//
+// WavDecoder :: read
+//
+// 8 and 16 bit samples are passed through, everything else is converted
+// to float. The files are little endian, like the hosts this gets built for.
+//
+//==========================================================================
+
+size_t WavDecoder::read(char* buffer, size_t bytes)
+{
+	size_t outsize = Bits <= 16 ? Bits / 8 : 4;
+	size_t frames = std::min(bytes / (outsize * Channels), Frames - Pos);
+	if (frames == 0) return 0;
+
+	size_t insize = frames * FileFrameSize();
+	const uint8_t* src;
+	if (Data != nullptr)
+	{
+		src = Data + Pos * FileFrameSize();
+	}
+	else
+	{
+		if (Reader->seek(DataStart + long(Pos * FileFrameSize()), SEEK_SET) != 0) return 0;
+		uint8_t* dest = (Bits <= 16 || IsFloat) ? (uint8_t*)buffer : (Raw.resize(insize), Raw.data());
+		insize = (size_t)std::max<long>(Reader->read(dest, (int32_t)insize), 0);
+		frames = insize / FileFrameSize();
+		src = dest;
+	}
+	Pos += frames;
+
+	size_t samples = frames * Channels;
+	if (Bits <= 16 || IsFloat)
+	{
+		if (src != (const uint8_t*)buffer) memcpy(buffer, src, samples * outsize);
+	}
+	else
+	{
+		float* out = (float*)buffer;
+		int step = Bits / 8;
+		for (size_t i = 0; i < samples; i++, src += step)
+		{
+			// Assemble the sample in the top bits, so both widths scale the same.
+			int32_t v = step == 3 ? int32_t((src[0] << 8) | (src[1] << 16) | (uint32_t(src[2]) << 24)) : int32_t(GetLE32(src));
+			out[i] = v * (1.f / 2147483648.f);
+		}
+	}
+	return samples * outsize;
+}
+
+bool WavDecoder::seek(size_t ms_offset, bool ms, bool mayrestart)
+{
+	size_t smp_offset = ms ? (size_t)((double)ms_offset / 1000. * SampleRate) : ms_offset;
+	Pos = std::min(smp_offset, Frames);
+	return true;
+}
+
+size_t WavDecoder::getSampleOffset()
+{
+	return Pos;
+}
+
+size_t WavDecoder::getSampleLength()
+{
+	return Frames;
+}
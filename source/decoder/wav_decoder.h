@@ -0,0 +1,44 @@
+#ifndef WAV_DECODER_H
+#define WAV_DECODER_H
+
+#include "zmusic/sounddecoder.h"
+
+// A decoder for uncompressed RIFF WAVE files that needs no library. With a
+// reader that holds the file in memory it reads the samples right from there.
+struct WavDecoder : public SoundDecoder
+{
+	static bool probe(const uint8_t* header, size_t length);
+
+	virtual void getInfo(int* samplerate, ChannelConfig* chans, SampleType* type) override;
+
+	virtual size_t read(char* buffer, size_t bytes) override;
+	virtual bool seek(size_t ms_offset, bool ms, bool mayrestart) override;
+	virtual size_t getSampleOffset() override;
+	virtual size_t getSampleLength() override;
+
+	WavDecoder() = default;
+	// Make non-copyable
+	WavDecoder(const WavDecoder& rhs) = delete;
+	WavDecoder& operator=(const WavDecoder& rhs) = delete;
+
+	virtual ~WavDecoder();
+
+protected:
+	virtual bool open(MusicIO::FileInterface* reader) override;
+
+private:
+	MusicIO::FileInterface* Reader = nullptr;
+	const uint8_t* Data = nullptr;	// the sample data if the reader has the file in memory.
+	long DataStart = 0;
+	size_t Frames = 0;
+	size_t Pos = 0;
+	int SampleRate = 0;
+	int Channels = 0;
+	int Bits = 0;
+	bool IsFloat = false;
+	std::vector<uint8_t> Raw;	// for 24 and 32 bit integers, which get converted to float.
+
+	size_t FileFrameSize() const { return size_t(Channels) * (Bits / 8); }
+};
+
+#endif /* WAV_DECODER_H */
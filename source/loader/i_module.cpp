@@ -31,6 +31,10 @@
 **
 */
 
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <mutex>
 #include "i_module.h"
 
 #ifdef _WIN32
@@ -48,25 +52,88 @@
 using HMODULE = void*;
 #endif
 
-bool FModule::Load(std::initializer_list<const char*> libnames)
+// The library cache remembers which library each module got loaded from,
+// so that the next run can try that one before searching for it.
+static std::mutex cache_lock;
+static std::string cache_file;
+static std::map<std::string, std::string> cache_entries;
+static bool cache_read = false;
+
+static void ReadLibraryCache()
 {
-	for(auto lib : libnames)
+	cache_read = true;
+	cache_entries.clear();
+	FILE *f = cache_file.empty() ? nullptr : fopen(cache_file.c_str(), "r");
+	if (!f) return;
+	char line[1024];
+	while (fgets(line, sizeof(line), f))
 	{
-		if(!Open(lib))
-			continue;
+		line[strcspn(line, "\r\n")] = 0;
+		char *eq = strchr(line, '=');
+		if (eq && eq[1]) cache_entries[std::string(line, eq)] = eq + 1;
+	}
+	fclose(f);
+}
+
+static std::string GetCachedLibrary(const char *module)
+{
+	std::lock_guard<std::mutex> lock(cache_lock);
+	if (!cache_read) ReadLibraryCache();
+	auto it = cache_entries.find(module);
+	return it == cache_entries.end() ? std::string() : it->second;
+}
+
+static void SetCachedLibrary(const char *module, const char *lib)
+{
+	std::lock_guard<std::mutex> lock(cache_lock);
+	if (cache_file.empty()) return;
+	if (!cache_read) ReadLibraryCache();
+	auto &entry = cache_entries[module];
+	if (entry == lib) return;
+	entry = lib;
+	FILE *f = fopen(cache_file.c_str(), "w");
+	if (!f) return;
+	for (auto &e : cache_entries) fprintf(f, "%s=%s\n", e.first.c_str(), e.second.c_str());
+	fclose(f);
+}
+
+void FModule_SetLibraryCache(const char* filename)
+{
+	std::lock_guard<std::mutex> lock(cache_lock);
+	cache_file = filename;
+	cache_read = false;
+}
 
-		StaticProc *proc;
-		for(proc = reqSymbols;proc;proc = proc->Next)
+bool FModule::TryLoad(const char* lib)
+{
+	if(!Open(lib))
+		return false;
+
+	StaticProc *proc;
+	for(proc = reqSymbols;proc;proc = proc->Next)
+	{
+		if(!(proc->Call = GetSym(proc->Name)) && !proc->Optional)
 		{
-			if(!(proc->Call = GetSym(proc->Name)) && !proc->Optional)
-			{
-				Unload();
-				break;
-			}
+			Unload();
+			break;
 		}
+	}
+	return IsLoaded();
+}
+
+bool FModule::Load(std::initializer_list<const char*> libnames)
+{
+	std::string cached = GetCachedLibrary(name);
+	if(!cached.empty() && TryLoad(cached.c_str()))
+		return true;
 
-		if(IsLoaded())
+	for(auto lib : libnames)
+	{
+		if(TryLoad(lib))
+		{
+			SetCachedLibrary(name, lib);
 			return true;
+		}
 	}
 
 	return false;
@@ -89,7 +89,7 @@ class FModule
 
 	void *handle = nullptr;
 
-	// Debugging aid
+	// Debugging aid, and the key for the library cache.
 	const char *name;
 
 	// Since FModule is supposed to be statically allocated it is assumed that
@@ -98,6 +98,7 @@ class FModule
 	StaticProc *reqSymbols;
 
 	bool Open(const char* lib);
+	bool TryLoad(const char* lib);
 	void *GetSym(const char* name);
 
 public:
@@ -231,3 +232,4 @@ public:
 
 void FModule_SetProgDir(const char* progdir);
 const std::string& FModule_GetProgDir();
+void FModule_SetLibraryCache(const char* filename);
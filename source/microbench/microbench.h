@@ -0,0 +1,29 @@
+#pragma once
+
+// What the benchmarks in the units of zmusic-microbench share. The chip
+// emulators of libADLMIDI and libOPNMIDI live in units of their own, as their
+// headers use the same include guard.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+static const double OUTPUT_RATE = 44100;
+
+// Processes one block of the given number of frames. Set up for the largest
+// block size before the first call.
+typedef std::function<void(size_t frames)> BlockFunc;
+
+// Registers a benchmark. 'setup' gets the largest block size it will be run with.
+void Add(std::string name, std::function<BlockFunc(size_t maxframes)> setup);
+
+// Noise that is the same on every run.
+inline float Noise(uint32_t &seed)
+{
+	seed = seed * 1664525 + 1013904223;
+	return int32_t(seed) * (1.f / 2147483648.f);
+}
+
+void AddADLCores();
+void AddOPNCores();
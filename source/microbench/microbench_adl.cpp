@@ -0,0 +1,48 @@
+// The chip emulators of libADLMIDI, at the output rate.
+
+#include <memory>
+#include <vector>
+
+#include "chips/nuked_opl3.h"
+#include "chips/nuked_opl3_v174.h"
+#include "chips/dosbox_opl3.h"
+#include "chips/opal_opl3.h"
+#include "chips/java_opl3.h"
+#include "microbench.h"
+
+void AddADLCores()
+{
+	static const struct { const char *Name; OPLChipBase *(*Create)(); } cores[] =
+	{
+		{ "nuked", []() -> OPLChipBase * { return new NukedOPL3; } },
+		{ "nuked174", []() -> OPLChipBase * { return new NukedOPL3v174; } },
+		{ "dosbox", []() -> OPLChipBase * { return new DosBoxOPL3; } },
+		{ "opal", []() -> OPLChipBase * { return new OpalOPL3; } },
+		{ "java", []() -> OPLChipBase * { return new JavaOPL3; } },
+	};
+
+	for (auto &core : cores)
+	{
+		Add(std::string("adl/") + core.Name, [=](size_t maxframes) -> BlockFunc
+		{
+			std::shared_ptr<OPLChipBase> chip(core.Create());
+			chip->setRate((uint32_t)OUTPUT_RATE);
+			// As libADLMIDI does, so that the chip knows that notes are playing.
+			auto write = [&](uint16_t addr, uint8_t data) { chip->writeReg(addr, data); chip->noteWrite(addr, data); };
+			write(0x105, 0x01);	// OPL3 mode
+			for (int ch = 0; ch < 9; ch++)
+			{
+				const int op = (ch / 3) * 8 + ch % 3;
+				write(0x20 + op, 0x01); write(0x23 + op, 0x01);
+				write(0x40 + op, 0x10); write(0x43 + op, 0x00);
+				write(0x60 + op, 0xf0); write(0x63 + op, 0xf0);
+				write(0x80 + op, 0x07); write(0x83 + op, 0x07);
+				write(0xc0 + ch, 0x31);
+				write(0xa0 + ch, 0x80 + ch * 8);
+				write(0xb0 + ch, 0x31);
+			}
+			auto out = std::make_shared<std::vector<int16_t>>(maxframes * 2);
+			return [=](size_t frames) { chip->generate(out->data(), frames); };
+		});
+	}
+}
@@ -0,0 +1,55 @@
+// The chip emulators of libOPNMIDI, at the output rate.
+
+#include <memory>
+#include <vector>
+
+#include "chips/nuked_opn2.h"
+#include "chips/mame_opn2.h"
+#include "chips/gens_opn2.h"
+#include "chips/mame_opna.h"
+#include "chips/pmdwin_opna.h"
+#include "microbench.h"
+
+void AddOPNCores()
+{
+	static const struct { const char *Name; OPNFamily Family; OPNChipBase *(*Create)(OPNFamily); } cores[] =
+	{
+		{ "nuked", OPNChip_OPN2, [](OPNFamily f) -> OPNChipBase * { return new NukedOPN2(f); } },
+		{ "mame", OPNChip_OPN2, [](OPNFamily f) -> OPNChipBase * { return new MameOPN2(f); } },
+		{ "gens", OPNChip_OPN2, [](OPNFamily f) -> OPNChipBase * { return new GensOPN2(f); } },
+		{ "mame-opna", OPNChip_OPNA, [](OPNFamily f) -> OPNChipBase * { return new MameOPNA(f); } },
+		{ "pmdwin-opna", OPNChip_OPNA, [](OPNFamily f) -> OPNChipBase * { return new PMDWinOPNA(f); } },
+	};
+
+	for (auto &core : cores)
+	{
+		Add(std::string("opn/") + core.Name, [=](size_t maxframes) -> BlockFunc
+		{
+			std::shared_ptr<OPNChipBase> chip(core.Create(core.Family));
+			chip->setRate((uint32_t)OUTPUT_RATE, opn2_getNativeClockRate(core.Family));
+			// As libOPNMIDI does, so that the chip knows that notes are playing.
+			auto write = [&](uint32_t port, uint16_t addr, uint8_t data) { chip->writeReg(port, addr, data); chip->noteWrite(port, addr, data); };
+			if (core.Family == OPNChip_OPNA) write(0, 0x29, 0x80);	// all six channels
+			for (int ch = 0; ch < 6; ch++)
+			{
+				const uint32_t port = ch / 3;
+				const uint16_t c = ch % 3;
+				for (uint16_t op = 0; op < 16; op += 4)
+				{
+					write(port, 0x30 + op + c, 0x01);
+					write(port, 0x40 + op + c, op == 12 ? 0x00 : 0x20);
+					write(port, 0x50 + op + c, 0x1f);
+					write(port, 0x60 + op + c, 0x00);
+					write(port, 0x80 + op + c, 0x0f);
+				}
+				write(port, 0xb0 + c, 0x04);
+				write(port, 0xb4 + c, 0xc0);
+				write(port, 0xa4 + c, 0x22);
+				write(port, 0xa0 + c, uint8_t(0x69 + ch * 8));
+				write(0, 0x28, uint8_t(0xf0 | (port << 2) | c));
+			}
+			auto out = std::make_shared<std::vector<int16_t>>(maxframes * 2);
+			return [=](size_t frames) { chip->generate(out->data(), frames); };
+		});
+	}
+}
@@ -0,0 +1,496 @@
+// Times the DSP kernels of the library one by one, over a range of block
+// sizes and with every instruction set version the CPU can run.
+//
+// zmusic-bench measures whole songs through the public API, which tells
+// whether something got slower but not where. This links the library's
+// objects directly so that each hot loop can be timed on its own, with
+// synthetic input and no file I/O, sequencing or locking around it.
+//
+// zmusic-microbench [options]
+//   -f <text>      only run the benchmarks whose name contains this
+//   -b <frames>    comma separated block sizes, default 64,256,1024,4096
+//   -t <seconds>   time spent on each benchmark and block size, default 0.25
+//
+// Every line gives the time per output frame and how many times faster than
+// real time at 44.1 kHz that is. The chip emulators are fed a few held notes,
+// as their cost does not depend much on what they play.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zmusic/zmusic_internal.h"
+#include "zmusic/cpufeatures.h"
+#include "zmusic/resampler.h"
+#include "zmusic/resampler_kernels.h"
+#include "zmusic/sampleconv.h"
+#include "streamsources/streamsource.h"
+#include "oplsynth/opl.h"
+#include "timiditypp/voicefilter.h"
+#include "timidity/timidity.h"
+#include "timidity/common.h"
+#include "timidity/playmidi.h"
+#include "microbench.h"
+
+extern "C"
+{
+#include "internal/resampler.h"
+}
+
+//==========================================================================
+//
+// The list of benchmarks
+//
+//==========================================================================
+
+struct Benchmark
+{
+	std::string Name;
+	std::function<BlockFunc(size_t maxframes)> Setup;
+};
+
+static std::vector<Benchmark> Benchmarks;
+
+void Add(std::string name, std::function<BlockFunc(size_t maxframes)> setup)
+{
+	Benchmarks.push_back({ std::move(name), std::move(setup) });
+}
+
+//==========================================================================
+//
+// Sample format conversion, on stereo blocks
+//
+//==========================================================================
+
+static void AddConversions()
+{
+	Add("convert/int16-float", [](size_t maxframes) -> BlockFunc
+	{
+		auto src = std::make_shared<std::vector<int16_t>>(maxframes * 2);
+		auto dest = std::make_shared<std::vector<float>>(maxframes * 2);
+		uint32_t seed = 1;
+		for (auto &s : *src) s = int16_t(Noise(seed) * 32767);
+		return [=](size_t frames) { ZMusic_ConvertInt16ToFloat(src->data(), dest->data(), frames * 2); };
+	});
+	Add("convert/float-int16", [](size_t maxframes) -> BlockFunc
+	{
+		auto src = std::make_shared<std::vector<float>>(maxframes * 2);
+		auto dest = std::make_shared<std::vector<int16_t>>(maxframes * 2);
+		uint32_t seed = 1;
+		for (auto &s : *src) s = Noise(seed) * 1.25f;	// some of it clipped
+		return [=](size_t frames) { ZMusic_ConvertFloatToInt16(src->data(), dest->data(), frames * 2); };
+	});
+	Add("convert/uint8-float", [](size_t maxframes) -> BlockFunc
+	{
+		auto src = std::make_shared<std::vector<uint8_t>>(maxframes * 2);
+		auto dest = std::make_shared<std::vector<float>>(maxframes * 2);
+		uint32_t seed = 1;
+		for (auto &s : *src) s = uint8_t(seed = seed * 1664525 + 1013904223);
+		return [=](size_t frames) { ZMusic_ConvertUInt8ToFloat(src->data(), dest->data(), frames * 2); };
+	});
+}
+
+//==========================================================================
+//
+// The resampler, its filter loops on their own and as a whole, from 32 kHz
+//
+//==========================================================================
+
+static void AddResampleKernel(const char *isa, ResampleBlockFunc func, int taps)
+{
+	Add(std::string("resampler/kernel-") + isa + "-" + std::to_string(taps), [=](size_t maxframes) -> BlockFunc
+	{
+		const uint64_t step = uint64_t(32000 / OUTPUT_RATE * 4294967296.);
+		auto coeffs = std::make_shared<std::vector<float>>((FResampler::Phases + 1) * taps);
+		auto hist = std::make_shared<std::vector<float>>((size_t)((maxframes * step) >> 32) * 2 + taps * 2 + 2);
+		auto out = std::make_shared<std::vector<float>>(maxframes * 2);
+		uint32_t seed = 1;
+		for (auto &c : *coeffs) c = Noise(seed) / taps;
+		for (auto &h : *hist) h = Noise(seed);
+		return [=](size_t frames)
+		{
+			const float *channels[2] = { hist->data(), hist->data() + hist->size() / 2 };
+			func(channels, 2, coeffs->data(), taps, 0x80000000u, step, out->data(), frames);
+		};
+	});
+}
+
+static void AddResampler()
+{
+	static const char *const qualities[] = { "fast", "good", "best", "highest" };
+
+	for (int taps = 16; taps <= 64; taps += 16)
+	{
+#ifdef ZMUSIC_ISA_AVX2
+		if (ZMusic_CPUFeatures() & CPU_AVX2) AddResampleKernel("avx2", ResampleBlock_AVX2, taps);
+#endif
+		AddResampleKernel("base", ResampleBlock_Base, taps);
+	}
+	for (int quality = RESAMPLE_FAST; quality <= RESAMPLE_HIGHEST; quality++)
+	{
+		Add(std::string("resampler/process-") + qualities[quality - RESAMPLE_FAST], [=](size_t maxframes) -> BlockFunc
+		{
+			auto resampler = std::make_shared<FResampler>();
+			resampler->Setup(32000, OUTPUT_RATE, 2, quality);
+			auto in = std::make_shared<std::vector<float>>((resampler->InputNeeded(maxframes) + 1) * 2);
+			auto out = std::make_shared<std::vector<float>>(maxframes * 2);
+			uint32_t seed = 1;
+			for (auto &s : *in) s = Noise(seed);
+			return [=](size_t frames) { resampler->Process(in->data(), out->data(), frames); };
+		});
+	}
+}
+
+//==========================================================================
+//
+// DUMB's resampler, one mono channel at every quality
+//
+//==========================================================================
+
+static void AddDumbResampler()
+{
+	static const char *const qualities[] = { "zoh", "blep", "linear", "blam", "cubic", "sinc" };
+
+	resampler_init();
+	for (int quality = RESAMPLER_QUALITY_MIN; quality <= RESAMPLER_QUALITY_MAX; quality++)
+	{
+		Add(std::string("dumb/resampler-") + qualities[quality], [=](size_t maxframes) -> BlockFunc
+		{
+			std::shared_ptr<void> resampler(resampler_create(), resampler_delete);
+			resampler_set_quality(resampler.get(), quality);
+			resampler_set_rate(resampler.get(), 32000 / OUTPUT_RATE);
+			auto out = std::make_shared<std::vector<float>>(maxframes);
+			auto seed = std::make_shared<uint32_t>(1);
+			return [=](size_t frames)
+			{
+				void *r = resampler.get();
+				float *dest = out->data();
+				for (size_t i = 0; i < frames; i++)
+				{
+					while (resampler_get_free_count(r) > 0) resampler_write_sample(r, short(Noise(*seed) * 32767));
+					*dest++ = resampler_get_sample_float(r);
+					resampler_remove_sample(r, 0);
+				}
+			};
+		});
+	}
+}
+
+//==========================================================================
+//
+// The chip emulators of the OPL synth, at the chip's own rate
+//
+//==========================================================================
+
+static void AddOPLCores()
+{
+	static const struct { const char *Name; OPLEmul *(*Create)(bool); } cores[] =
+	{
+		{ "mame", YM3812Create }, { "dosbox", DBOPLCreate }, { "java", JavaOPLCreate }, { "nuked", NukedOPL3Create },
+	};
+
+	for (auto &core : cores)
+	{
+		Add(std::string("opl/") + core.Name, [=](size_t maxframes) -> BlockFunc
+		{
+			std::shared_ptr<OPLEmul> chip(core.Create(true));
+			for (int ch = 0; ch < 9; ch++)
+			{
+				const int op = (ch / 3) * 8 + ch % 3;
+				chip->WriteReg(0x20 + op, 0x01); chip->WriteReg(0x23 + op, 0x01);
+				chip->WriteReg(0x40 + op, 0x10); chip->WriteReg(0x43 + op, 0x00);
+				chip->WriteReg(0x60 + op, 0xf0); chip->WriteReg(0x63 + op, 0xf0);
+				chip->WriteReg(0x80 + op, 0x07); chip->WriteReg(0x83 + op, 0x07);
+				chip->WriteReg(0xc0 + ch, 0x30);
+				chip->WriteReg(0xa0 + ch, 0x80 + ch * 8);
+				chip->WriteReg(0xb0 + ch, 0x31);
+			}
+			auto out = std::make_shared<std::vector<float>>(maxframes * 2);
+			return [=](size_t frames)
+			{
+				memset(out->data(), 0, frames * 2 * sizeof(float));
+				chip->Update(out->data(), (int)frames);
+			};
+		});
+	}
+}
+
+//==========================================================================
+//
+// The Timidity++ voice filters, on four voices at once
+//
+//==========================================================================
+
+static void AddTimidityFilter(const char *name, TimidityPlus::VoiceFilterFunc func)
+{
+	using namespace TimidityPlus;
+
+	Add(std::string("timidity/filter-") + name, [=](size_t maxframes) -> BlockFunc
+	{
+		auto data = std::make_shared<std::vector<int32_t>>(maxframes * VOICE_FILTER_LANES);
+		auto lanes = std::make_shared<VoiceFilterLanes>();
+		uint32_t seed = 1;
+		for (auto &s : *data) s = int32_t(Noise(seed) * 32767) * 256;
+		memset(lanes.get(), 0, sizeof(VoiceFilterLanes));
+		for (int l = 0; l < VOICE_FILTER_LANES; l++)
+		{
+			// a cutoff of a few kHz with some resonance, in 8.24 fixed point
+			lanes->f[l] = 0x400000 + l * 0x40000;
+			lanes->q[l] = 0x800000;
+			lanes->p[l] = 0x300000;
+		}
+		// The voices are filtered in place, so every run filters the output
+		// of the one before. That keeps them busy all the same.
+		return [=](size_t frames)
+		{
+			for (int l = 0; l < VOICE_FILTER_LANES; l++)
+			{
+				lanes->data[l] = data->data() + l * maxframes;
+				lanes->count[l] = (int32_t)frames;
+			}
+			func(lanes.get());
+		};
+	});
+}
+
+static void AddTimidityFilters()
+{
+	AddTimidityFilter("chamberlin", TimidityPlus::chamberlin_filter_lanes);
+	AddTimidityFilter("chamberlin-base", TimidityPlus::chamberlin_filter_lanes_base);
+	AddTimidityFilter("moog", TimidityPlus::moog_filter_lanes);
+	AddTimidityFilter("moog-base", TimidityPlus::moog_filter_lanes_base);
+}
+
+//==========================================================================
+//
+// The GUS mixing kernels, on one voice
+//
+// The output ends right at the end of its buffer, followed by a -0 that
+// adding 0 to would turn into +0, so that a kernel that touches anything
+// past the last frame gets caught.
+//
+//==========================================================================
+
+enum EGUSMix { GUSMIX_STEREO, GUSMIX_LEFT, GUSMIX_RIGHT, GUSMIX_MONO };
+
+static void AddGUSMix(const char *name, EGUSMix mode)
+{
+	Add(std::string("gus/mix-") + name, [=](size_t maxframes) -> BlockFunc
+	{
+		const size_t channels = mode == GUSMIX_MONO ? 1 : 2;
+		auto in = std::make_shared<std::vector<float>>(maxframes);
+		auto out = std::make_shared<std::vector<float>>(maxframes * channels + 1);
+		uint32_t seed = 1;
+		for (auto &s : *in) s = Noise(seed);
+		out->back() = -0.f;
+		return [=](size_t frames)
+		{
+			float *lp = out->data() + (maxframes - frames) * channels;
+			switch (mode)
+			{
+			case GUSMIX_STEREO:	Timidity::mix_span_stereo(in->data(), lp, 0.5f, 0.25f, (int)frames); break;
+			case GUSMIX_LEFT:	Timidity::mix_span_single(in->data(), lp, 0.5f, (int)frames); break;
+			case GUSMIX_RIGHT:	Timidity::mix_span_single(in->data(), lp + 1, 0.5f, (int)frames); break;
+			case GUSMIX_MONO:	Timidity::mix_span_mono(in->data(), lp, 0.5f, (int)frames); break;
+			}
+			if (out->back() != 0 || !signbit(out->back()))
+			{
+				fprintf(stderr, "gus/mix-%s wrote past the end of its output at %zu frames\n", name, frames);
+				exit(1);
+			}
+		};
+	});
+}
+
+static void AddGUSMixers()
+{
+	AddGUSMix("stereo", GUSMIX_STEREO);
+	AddGUSMix("left", GUSMIX_LEFT);
+	AddGUSMix("right", GUSMIX_RIGHT);
+	AddGUSMix("mono", GUSMIX_MONO);
+}
+
+//==========================================================================
+//
+// The GUS interpolation kernel, on one voice a little above and a little
+// below the sample's own pitch
+//
+//==========================================================================
+
+static void AddGUSResample(const char *name, double ratio)
+{
+	Add(std::string("gus/resample-") + name, [=](size_t maxframes) -> BlockFunc
+	{
+		const int incr = int(ratio * (1 << FRACTION_BITS));
+		auto in = std::make_shared<std::vector<float>>(size_t(maxframes * ratio) + 2);
+		auto out = std::make_shared<std::vector<float>>(maxframes);
+		uint32_t seed = 1;
+		for (auto &s : *in) s = Noise(seed);
+		return [=](size_t frames)
+		{
+			Timidity::resample_span(out->data(), in->data(), 0, incr, (int)frames);
+		};
+	});
+}
+
+static void AddGUSResamplers()
+{
+	AddGUSResample("up", 1.19);
+	AddGUSResample("down", 0.84);
+}
+
+//==========================================================================
+//
+// The XA ADPCM decoder, on a looping file of noise
+//
+//==========================================================================
+
+static void AddXADecoder()
+{
+	Add("xa/decode", [](size_t maxframes) -> BlockFunc
+	{
+		// A 20 byte header and stereo 37.8 kHz sectors. Only the subheader
+		// bytes at the end of the 48 byte sector header are looked at.
+		const size_t header = 20, sector = 48 + 18 * 128, sectors = 64;
+		auto file = std::make_shared<std::vector<uint8_t>>(header + sector * sectors);
+		uint32_t seed = 1;
+		for (size_t i = 0; i < sectors; i++)
+		{
+			uint8_t *s = file->data() + header + i * sector;
+			for (size_t j = 48; j < sector; j++) s[j] = uint8_t(seed = seed * 1664525 + 1013904223);
+			for (size_t j = 48; j < sector; j += 128)
+			{
+				// Keep the filters and shifts in range, as real encoders do.
+				for (int k = 0; k < 16; k++) s[j + k] = uint8_t((s[j + k] & 0x30) | (4 + (s[j + k] & 7)));
+			}
+			s[46] = 0x64;
+			s[47] = 0x01;
+		}
+		struct Closer { void operator()(MusicIO::FileInterface *f) { f->close(); } };
+		std::shared_ptr<MusicIO::FileInterface> reader(new MusicIO::MemoryReader(file->data(), (long)file->size()), Closer());
+		std::shared_ptr<StreamSource> song(XA_OpenSong(reader.get(), 0));
+		song->SetPlayMode(true);
+		song->Start();
+		auto out = std::make_shared<std::vector<float>>(maxframes * 2);
+		return [=](size_t frames) { (void)file; (void)reader; song->GetData(out->data(), frames * 8); };
+	});
+}
+
+//==========================================================================
+//
+// Runs one benchmark at one block size
+//
+//==========================================================================
+
+static void Run(const Benchmark &bench, const std::vector<size_t> &blocks, double seconds)
+{
+	size_t maxframes = 0;
+	for (auto b : blocks) if (b > maxframes) maxframes = b;
+
+	for (auto frames : blocks)
+	{
+		// A fresh setup for every block size, so that none runs on state the
+		// previous one left, like a resampler's filled history.
+		auto block = bench.Setup(maxframes);
+		for (int i = 0; i < 4; i++) block(frames);
+
+		using clock = std::chrono::steady_clock;
+		const auto start = clock::now();
+		const auto end = start + std::chrono::duration<double>(seconds);
+		size_t total = 0;
+		auto now = start;
+		do
+		{
+			for (int i = 0; i < 16; i++) block(frames);
+			total += frames * 16;
+			now = clock::now();
+		}
+		while (now < end);
+
+		const double elapsed = std::chrono::duration<double>(now - start).count();
+		const double perframe = elapsed / total;
+		printf("%-32s %6zu  %10.2f ns/frame  %10.1fx\n", bench.Name.c_str(), frames, perframe * 1e9, 1 / (perframe * OUTPUT_RATE));
+		fflush(stdout);
+	}
+}
+
+static void PrintFeatures()
+{
+	static const struct { uint32_t Feature; const char *Name; } names[] =
+	{
+		{ CPU_SSE2, "SSE2" }, { CPU_SSE41, "SSE4.1" }, { CPU_AVX2, "AVX2" }, { CPU_AVX512, "AVX-512" }, { CPU_NEON, "NEON" }, { CPU_SIMD128, "SIMD128" },
+	};
+	const uint32_t features = ZMusic_CPUFeatures();
+	printf("CPU features:");
+	for (auto &n : names) if (features & n.Feature) printf(" %s", n.Name);
+	printf(features == 0 ? " none\n\n" : "\n\n");
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: zmusic-microbench [-f filter] [-b blocksizes] [-t seconds]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	std::string filter;
+	std::vector<size_t> blocks;
+	double seconds = 0.25;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc || argv[i][0] != '-' || argv[i][2] != 0) Usage();
+		const char *arg = argv[++i];
+		switch (argv[i - 1][1])
+		{
+		case 'f':
+			filter = arg;
+			break;
+
+		case 'b':
+			for (const char *p = arg; *p != 0; )
+			{
+				char *end;
+				long frames = strtol(p, &end, 10);
+				if (end == p || frames <= 0) Usage();
+				blocks.push_back((size_t)frames);
+				p = *end == ',' ? end + 1 : end;
+			}
+			break;
+
+		case 't':
+			seconds = atof(arg);
+			if (seconds <= 0) Usage();
+			break;
+
+		default:
+			Usage();
+		}
+	}
+	if (blocks.empty()) blocks = { 64, 256, 1024, 4096 };
+
+	AddConversions();
+	AddResampler();
+	AddDumbResampler();
+	AddOPLCores();
+	AddADLCores();
+	AddOPNCores();
+	AddTimidityFilters();
+	AddGUSMixers();
+	AddGUSResamplers();
+	AddXADecoder();
+
+	PrintFeatures();
+	for (auto &bench : Benchmarks)
+	{
+		if (filter.empty() || bench.Name.find(filter) != std::string::npos) Run(bench, blocks, seconds);
+	}
+	return 0;
+}
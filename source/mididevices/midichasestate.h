@@ -0,0 +1,164 @@
+#pragma once
+
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+#include "zmusic/mididefs.h"
+#include "zmusic/mus2midi.h"
+#include "mididevice.h"
+
+//==========================================================================
+//
+// MIDIChaseState
+//
+// Collects the state a seek or a device change has to restore: everything
+// that persists on a channel after the event that set it. Notes are
+// deliberately dropped.
+//
+//==========================================================================
+
+class MIDIChaseState
+{
+	struct Channel
+	{
+		int8_t Controllers[128];
+		int8_t Program = -1;
+		int8_t Pressure = -1;
+		int16_t PitchBend = -1;
+		int Param = -1;		// selected (N)RPN, NRPNs are offset by 1 << 14.
+		std::map<int, std::pair<int8_t, int8_t>> Params;
+
+		Channel() { memset(Controllers, -1, sizeof(Controllers)); }
+
+		bool operator==(const Channel &other) const
+		{
+			return memcmp(Controllers, other.Controllers, sizeof(Controllers)) == 0 && Program == other.Program &&
+				Pressure == other.Pressure && PitchBend == other.PitchBend && Param == other.Param && Params == other.Params;
+		}
+	};
+
+	Channel Channels[16];
+	std::vector<std::vector<uint8_t>> LongEvents;
+
+	static bool IsStateController(int ctrl)
+	{
+		// Data entry and parameter selection are kept per parameter, channel mode messages are not state.
+		return ctrl != 6 && ctrl != 38 && (ctrl < 96 || ctrl > 101) && ctrl < 120;
+	}
+
+public:
+	bool operator==(const MIDIChaseState &other) const
+	{
+		return std::equal(Channels, Channels + 16, other.Channels) && LongEvents == other.LongEvents;
+	}
+
+	void AddEvent(const uint32_t *event)
+	{
+		if (MEVENT_EVENTTYPE(event[2]) == MEVENT_LONGMSG)
+		{
+			auto data = (const uint8_t *)&event[3];
+			size_t len = MEVENT_EVENTPARM(event[2]);
+			// Only the last of identical messages is kept, or songs that repeat one would let the list
+			// grow for as long as they play.
+			auto same = std::find_if(LongEvents.begin(), LongEvents.end(),
+				[=](const std::vector<uint8_t> &msg) { return msg.size() == len && memcmp(msg.data(), data, len) == 0; });
+			if (same != LongEvents.end()) LongEvents.erase(same);
+			LongEvents.emplace_back(data, data + len);
+			return;
+		}
+		if (MEVENT_EVENTTYPE(event[2]) != 0) return;
+
+		auto &chan = Channels[event[2] & 15];
+		int command = event[2] & 0xf0;
+		int parm1 = (event[2] >> 8) & 0x7f;
+		int parm2 = (event[2] >> 16) & 0x7f;
+
+		switch (command)
+		{
+		case MIDI_CTRLCHANGE:
+			if (parm1 == 121)
+			{
+				memset(chan.Controllers, -1, sizeof(chan.Controllers));
+				chan.PitchBend = chan.Pressure = -1;
+			}
+			else if (parm1 == 101 || parm1 == 100)
+			{
+				chan.Controllers[parm1] = parm2;
+				chan.Controllers[99] = chan.Controllers[98] = -1;
+				chan.Param = (std::max<int>(chan.Controllers[101], 0) << 7) | std::max<int>(chan.Controllers[100], 0);
+			}
+			else if (parm1 == 99 || parm1 == 98)
+			{
+				chan.Controllers[parm1] = parm2;
+				chan.Controllers[101] = chan.Controllers[100] = -1;
+				chan.Param = (1 << 14) | (std::max<int>(chan.Controllers[99], 0) << 7) | std::max<int>(chan.Controllers[98], 0);
+			}
+			else if ((parm1 == 6 || parm1 == 38) && chan.Param >= 0 && chan.Param != 0x3fff)
+			{
+				auto &value = chan.Params.emplace(chan.Param, std::make_pair(int8_t(-1), int8_t(-1))).first->second;
+				(parm1 == 6 ? value.first : value.second) = parm2;
+			}
+			else if (IsStateController(parm1))
+			{
+				chan.Controllers[parm1] = parm2;
+			}
+			break;
+
+		case MIDI_PRGMCHANGE:
+			chan.Program = parm1;
+			break;
+
+		case MIDI_CHANPRESS:
+			chan.Pressure = parm1;
+			break;
+
+		case MIDI_PITCHBEND:
+			chan.PitchBend = parm1 | (parm2 << 7);
+			break;
+		}
+	}
+
+	void Apply(SoftSynthMIDIDevice *device)
+	{
+		for (auto &data : LongEvents)
+		{
+			device->SendLongEventNow(data.data(), (int)data.size());
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			auto &chan = Channels[i];
+			device->SendEventNow(MIDI_CTRLCHANGE | i, 120, 0);	// All sound off
+			device->SendEventNow(MIDI_CTRLCHANGE | i, 121, 0);	// Reset controllers
+
+			// Bank select only takes effect with the following program change.
+			if (chan.Controllers[0] >= 0) device->SendEventNow(MIDI_CTRLCHANGE | i, 0, chan.Controllers[0]);
+			if (chan.Controllers[32] >= 0) device->SendEventNow(MIDI_CTRLCHANGE | i, 32, chan.Controllers[32]);
+			device->SendEventNow(MIDI_PRGMCHANGE | i, std::max<int>(chan.Program, 0), 0);
+
+			for (int c = 1; c < 128; c++)
+			{
+				if (c != 32 && chan.Controllers[c] >= 0 && IsStateController(c))
+				{
+					device->SendEventNow(MIDI_CTRLCHANGE | i, c, chan.Controllers[c]);
+				}
+			}
+			for (auto &param : chan.Params)
+			{
+				bool nrpn = param.first >= (1 << 14);
+				device->SendEventNow(MIDI_CTRLCHANGE | i, nrpn ? 99 : 101, (param.first >> 7) & 127);
+				device->SendEventNow(MIDI_CTRLCHANGE | i, nrpn ? 98 : 100, param.first & 127);
+				if (param.second.first >= 0) device->SendEventNow(MIDI_CTRLCHANGE | i, 6, param.second.first);
+				if (param.second.second >= 0) device->SendEventNow(MIDI_CTRLCHANGE | i, 38, param.second.second);
+			}
+			// Leave the parameter selection the way the song had it.
+			for (int c = 98; c <= 101; c++)
+			{
+				device->SendEventNow(MIDI_CTRLCHANGE | i, c, chan.Controllers[c] >= 0 ? chan.Controllers[c] : 127);
+			}
+			if (chan.Pressure >= 0) device->SendEventNow(MIDI_CHANPRESS | i, chan.Pressure, 0);
+			if (chan.PitchBend >= 0) device->SendEventNow(MIDI_PITCHBEND | i, chan.PitchBend & 127, chan.PitchBend >> 7);
+		}
+	}
+};
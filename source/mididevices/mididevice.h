@@ -1,10 +1,18 @@
 #pragma once
 
+#include <memory>
 #include <mutex>
 #include "zmusic/midiconfig.h"
 #include "zmusic/mididefs.h"
+#include "zmusic/allocator.h"
+#include "zmusic/wavefile.h"
+#include "zmusic/resampler.h"
+#include "midimeter.h"
 
 typedef void(*MidiCallback)(void *);
+class MIDIChaseState;
+class MIDILayerDevice;
+class MIDILoopCache;
 
 // A device that provides a WinMM-like MIDI streaming interface -------------
 
@@ -17,7 +25,7 @@ struct MidiHeader
 	MidiHeader *lpNext;
 };
 
-class MIDIDevice
+class MIDIDevice : public FMusicAllocated
 {
 public:
 	MIDIDevice() = default;
@@ -45,12 +53,14 @@ public:
 	virtual void InitPlayback();
 	virtual bool Update();
 	virtual void PrecacheInstruments(const uint16_t *instruments, int count);
-	virtual void ChangeSettingInt(const char *setting, int value);
-	virtual void ChangeSettingNum(const char *setting, double value);
-	virtual void ChangeSettingString(const char *setting, const char *value);
+	virtual bool CanPrecacheWhilePlaying() const { return false; }	// if PrecacheInstruments may run on another thread while the device plays.
+	virtual void ChangeSettingInt(ESongSetting setting, int value);
+	virtual void ChangeSettingNum(ESongSetting setting, double value);
 	virtual std::string GetStats();
 	virtual int GetDeviceType() const { return MDEV_DEFAULT; }
 	virtual bool CanHandleSysex() const { return true; }
+	virtual int GetDefaultBuffers() const { return 2; }	// event buffers kept queued unless ZMusic_SetMIDIBuffering says otherwise.
+	virtual bool ReloadSoundFonts(const char *args) { return false; }	// exchanges the instruments of the open device, false if it can't.
 	virtual SoundStreamInfoEx GetStreamInfoEx() const;
 
 protected:
@@ -60,6 +70,17 @@ protected:
 
 // Base class for software synthesizer MIDI output devices ------------------
 
+// A short message as handed to SoftSynthMIDIDevice::HandleEvents. Events that
+// get sent ahead of their time, see MinRenderBlock, are due Offset frames into
+// the next ComputeOutput call. All others have 0.
+struct MidiShortEvent
+{
+	uint32_t Offset;
+	uint8_t Status;
+	uint8_t Parm1;
+	uint8_t Parm2;
+};
+
 class SoftSynthMIDIDevice : public MIDIDevice
 {
 	friend class MIDIWaveWriter;
@@ -80,8 +101,112 @@ public:
 
 	virtual int Open() override;
 	virtual bool ServiceStream(void* buff, int numbytes);
-	int GetSampleRate() const { return SampleRate; }
+	int GetSampleRate() const { return SampleRate; }	// the rate the synth renders at.
+	bool IsMono() const { return isMono; }
+	int GetOutputRate() const { return OutputRate; }
+
+	// Reduced-rate rendering: the synth keeps rendering at its own rate and
+	// Render upsamples that to 'rate', which is what the stream plays at.
+	// Not for devices with stems or shared effects, whose extra buffers
+	// would not match the output.
+	void SetOutputRate(int rate);
+	bool IsResampling() const { return OutputRate != SampleRate; }
+	bool Render(void *buff, int numbytes);
 	SoundStreamInfoEx GetStreamInfoEx() const override;
+	virtual int GetActiveVoices() { return -1; }
+
+	// For seeking: drops all queued event buffers and applies state events right away.
+	void ResetStream() { Events = EventsTail = nullptr; Position = 0; NextTickIn = 0; Meter.Reset(); DropLoopCache(); }
+	void DelayNextTick(double ticks) { NextTickIn += SamplesPerTick * ticks; Meter.Tick += ticks; }
+	// Followed by seeks right after ResetStream, for what the stream played before the new position.
+	void SetMeter(const MIDIMeter &meter) { Meter = meter; }
+
+	// Song position: the tick the output has got to so far, see MIDIMeter, and how many ticks
+	// go by in one frame at the output rate. Only for the thread servicing the stream.
+	double GetSongTick() const { return Events == nullptr ? Meter.Tick : std::max(Meter.Tick - NextTickIn / SamplesPerTick, 0.); }
+	double GetTicksPerFrame() const { return double(SampleRate) / OutputRate / SamplesPerTick; }
+	const MIDIMeter &GetMeter() const { return Meter; }
+	double GetDivision() const { return Division; }
+	double GetTempo() const { return Tempo; }
+	void SendEventNow(int status, int parm1, int parm2) { TrackEvent(status, parm1, parm2); HandleEvent(status, parm1, parm2); }
+	void SendLongEventNow(const uint8_t *data, int len) { HandleLongEvent(data, len); }
+
+	// For the device pool: leaves the device the way it was created, with its instruments
+	// still loaded, to be opened again by another song.
+	void Recycle();
+
+	// For device changes: everything played from the stream is recorded in 'state' as well,
+	// and TakeStream continues where 'old' is, leaving it without any events.
+	void SetStateRecorder(MIDIChaseState *state) { PlayedState = state; }
+	void TakeStream(SoftSynthMIDIDevice *old);
+	// For clones: continues the stream 'other' is playing from copies of its event buffers, and strikes
+	// the notes it holds anew. 'buffers' are the headers of other's streamer, 'copies' this one's.
+	void CopyStream(const SoftSynthMIDIDevice *other, const MidiHeader *buffers, MidiHeader *copies);
+	bool IsFadedOut() const { return Gain == 0 && GainFadeFrames == 0; }
+
+	// Output gain, reached by a linear ramp over fade_ms. Only to be called by the thread servicing the stream.
+	void SetGain(float gain, int fade_ms);
+
+	// While virtual the stream advances as usual, but its events only go into the state recorder
+	// and nothing gets synthesized. Coming back restores the recorded state on the synth, without
+	// the notes that were started in between. Needs a state recorder and no layers.
+	bool SetVirtual(bool on);
+	bool IsVirtual() const { return Virtual; }
+
+	// Loop cache: keeps up to maxframes of one pass of a looping song, as marked by
+	// MARKER_RESTART, and plays the following passes from it, see MIDILoopCache.
+	// Nothing gets sent to the synth while it does. Needs a state recorder, and
+	// is dropped for layers and live events. 0 turns it off.
+	void SetLoopCache(size_t maxframes);
+	bool HasLoopCache() const { return LoopCache != nullptr; }
+	// Throws away what was kept, for anything that makes the next pass differ.
+	void DropLoopCache();
+
+	// Shared effects: the device leaves its reverb and chorus to the caller and
+	// provides the mono sends of the last ServiceStream call instead, reverb
+	// followed by chorus, each one buffer long. Returns false if unsupported.
+	virtual bool SetExternalEffects(bool on) { return false; }
+	virtual const float *GetEffectSends() { return nullptr; }
+
+	// Stems: the output of the last ServiceStream call split up by MIDI channel,
+	// with channelstems[16] saying which of the numstems stereo stems every
+	// channel goes to. They are planar, one buffer per side of every stem,
+	// followed by one more stem with reverb and chorus. 0 stems turns it off.
+	// Returns false if the device cannot do it, or not as it was created.
+	virtual bool SetStems(int numstems, const uint8_t *channelstems) { return false; }
+	virtual const float *GetStems(int &frames) { return nullptr; }
+
+	// Layers: other songs playing on this synth, each on 16 channels of its own
+	// above the song's, see MIDILayerDevice. Devices that have the channels for
+	// them say how many they can take, and take channel messages for any of
+	// their channels through HandleChannelEvent.
+	virtual int GetMaxLayers() const { return 0; }
+	virtual void HandleChannelEvent(int channel, int command, int parm1, int parm2) {}
+	void AddLayer(MIDILayerDevice *layer) { Layers.push_back(layer); }
+	void RemoveLayer(MIDILayerDevice *layer);
+
+	// Live input: an event, laid out as in a MidiHeader, that ServiceStream plays 'offset'
+	// frames at the output rate into the next buffer, or a later one if it is shorter.
+	// Only to be called by the thread servicing the stream.
+	void QueueLiveEvent(uint32_t offset, const uint32_t *event, int words);
+
+	// Channel activity: the voices of each of the song's 16 channels and the level of
+	// the loudest, as the thread servicing the stream finds them after a block. The
+	// default counts held notes and estimates their level from the velocity and the
+	// channel's volume and expression. Devices that can look at their voices do so.
+	virtual void GetChannelActivity(int *voices, float *levels);
+	int GetChannelProgram(int channel) const { return ChannelPrograms[channel]; }
+
+	// How many steps the CPU budget governor has currently lowered the quality by.
+	int GetQualityLevel() const { return QualityLevel; }
+
+	// Returns and clears the event and render call counts since the last call.
+	void TakeStats(uint32_t &events, uint32_t &fragments)
+	{
+		events = EventsPlayed;
+		fragments = Fragments;
+		EventsPlayed = Fragments = 0;
+	}
 
 protected:
 	double Tempo;
@@ -89,15 +214,81 @@ protected:
 	double SamplesPerTick;
 	double NextTickIn;
 	MidiHeader *Events;
+	MidiHeader *EventsTail;	// only valid while Events is not null.
 	bool Started;
-	bool isMono = false; // only relevant for OPL.
+	bool isMono = false; // ComputeOutput writes one channel. Set by OPL for its mono chips, and by the synths that can render mono for zmusic_snd_mono.
 	bool isOpen = false;
 	uint32_t Position;
 	int SampleRate;
+	int OutputRate;
+	FResampler Resampler;	// only set up while IsResampling.
+	TMusicVector<float> RenderBuffer;	// the synth's output before it gets resampled.
 	int StreamBlockSize = 2;
+	int MinRenderBlock = 0;	// if non-zero, events get sent this many samples early at most so that output is rendered in blocks at least this large.
+	uint32_t EventsPlayed = 0;
+	uint32_t Fragments = 0;
+	float Gain = 1.f;
+	float TargetGain = 1.f;
+	int GainFadeFrames = 0;
+	MIDIChaseState *PlayedState = nullptr;
+	bool PlayOut = false;	// renders without any events left, see TakeStream.
+	bool Virtual = false;
+	std::vector<MIDILayerDevice *> Layers;
+	struct LiveEvent { uint32_t Offset; uint32_t Start; };	// Start is where the event is in LiveData.
+	std::vector<LiveEvent> LiveEvents;	// in the order they are due.
+	std::vector<uint32_t> LiveData;
+	MidiShortEvent Batch[MAX_MIDI_EVENTS];	// collected by PlayTick for HandleEvents
+	int BatchCount = 0;
+	uint32_t TickOffset = 0;	// of the tick PlayTick is playing
+	uint64_t SynthFrames = 0;	// rendered so far, for the loop cache.
+	MIDIMeter Meter;	// Tick is that of the next event, NextTickIn away.
+	std::unique_ptr<MIDILoopCache> LoopCache;
+
+	// Followed by TrackEvent for GetChannelActivity, also while virtual.
+	uint8_t HeldNotes[16][128];	// the velocity of every note, 0 if not held.
+	uint8_t ChannelPrograms[16];
+	uint8_t ChannelVolumes[16];
+	uint8_t ChannelExpressions[16];
+
+	// CPU budget governor, see UpdateGovernor.
+	int QualityLevel = 0;
+	int MaxQualityLevel = 0;	// devices that implement SetQualityLevel set this to the number of steps they have.
+	double RenderLoad = -1;
+	double LowLoadTime = 0;
+	double GovernorHold = 0;
 
 	virtual void CalcTickRate();
 	int PlayTick();
+	void PlayLiveEvent(const uint32_t *event);
+	void TrackEvent(int status, int parm1, int parm2);
+	void ResetTracking();
+	bool RenderLayers(void *buff, int numbytes);
+	bool RenderEvents(void *buff, int numbytes);
+	void Synthesize(float *buffer, int len);
+	void ApplyGain(float *samples, int count);
+	static void RampGain(float *samples, int frames, int channels, float &gain, float target, int &fadeframes);
+	void UpdateGovernor(double rendertime, double audiotime);
+
+	// For the "auto" emulator setting: the time ComputeOutput takes for a second
+	// of a chord, in seconds, see ZMusic_SelectEmulator.
+	double MeasureRenderTime();
+	// Brings a synth that reset itself back to the song's controllers and programs.
+	void RestoreChannels();
+
+	// Level 0 is the configured quality, every step above trades quality for render time.
+	virtual void SetQualityLevel(int level) {}
+
+	// Silences the synth and resets every channel, see Recycle. The default does it with MIDI messages.
+	virtual void ResetRenderer();
+
+	// The short messages of a tick, or of every tick sent ahead at once, in
+	// one call. The default sends them through HandleEvent one by one.
+	virtual void HandleEvents(const MidiShortEvent *events, int count);
+	void FlushEvents()
+	{
+		if (BatchCount > 0) HandleEvents(Batch, BatchCount);
+		BatchCount = 0;
+	}
 
 	virtual int OpenRenderer() = 0;
 	virtual void HandleEvent(int status, int parm1, int parm2) = 0;
@@ -106,13 +297,48 @@ protected:
 };
 
 
+// A song playing on another software synth ---------------------------------
+//
+// Plays no sound of its own. The host sends the layer's events at the start
+// of every block it renders, which makes their timing as fine as
+// MIDILayerDevice::BLOCK frames. System exclusive messages are left out
+// since they could change the host's own channels.
+
+class MIDILayerDevice : public SoftSynthMIDIDevice
+{
+public:
+	enum { BLOCK = 256 };
+
+	MIDILayerDevice(SoftSynthMIDIDevice *host, int channelbase);
+	~MIDILayerDevice();
+	void SetHost(SoftSynthMIDIDevice *host);
+	SoftSynthMIDIDevice *GetHost() const { return Host; }
+	void Advance(int frames);	// sends what is due within the next 'frames' frames.
+	bool IsIdle() const { return Events == nullptr; }
+
+	int GetDeviceType() const override { return Host->GetDeviceType(); }
+	void PrecacheInstruments(const uint16_t *instruments, int count) override {}	// would replace the host's own.
+
+protected:
+	int OpenRenderer() override { return 0; }
+	void HandleEvent(int status, int parm1, int parm2) override;
+	void HandleLongEvent(const uint8_t *data, int len) override {}
+	void ComputeOutput(float *buffer, int len) override {}
+
+	SoftSynthMIDIDevice *Host;
+	int ChannelBase;
+};
+
+
 // Internal disk writing version of a MIDI device ------------------
+//
+// The song is rendered into one large block while the other gets written
+// by a job, so the synth never waits for the disk unless it is faster.
 
 class MIDIWaveWriter : public SoftSynthMIDIDevice
 {
 public:
 	MIDIWaveWriter(const char *filename, SoftSynthMIDIDevice *devtouse);
-	//~MIDIWaveWriter();
 	bool CloseFile();
 	int Resume() override;
 	int Open() override
@@ -123,6 +349,7 @@ public:
 	int OpenRenderer() override { return playDevice->OpenRenderer();  }
 	void Stop() override;
 	void HandleEvent(int status, int parm1, int parm2) override { playDevice->HandleEvent(status, parm1, parm2);  }
+	void HandleEvents(const MidiShortEvent *events, int count) override { playDevice->HandleEvents(events, count); }
 	void HandleLongEvent(const uint8_t *data, int len) override { playDevice->HandleLongEvent(data, len);  }
 	void ComputeOutput(float *buffer, int len) override { playDevice->ComputeOutput(buffer, len);  }
 	int StreamOutSync(MidiHeader *data) override { return playDevice->StreamOutSync(data); }
@@ -136,15 +363,16 @@ public:
 	void CalcTickRate() override { playDevice->CalcTickRate(); }
 
 protected:
-	FILE *File;
 	SoftSynthMIDIDevice *playDevice;
+	TMusicVector<float> Blocks[2];
+	FWaveFile Wave;		// after Blocks, so that it waits for the last write before they go away.
 };
 
 
 // MIDI devices
 
-MIDIDevice *CreateFluidSynthMIDIDevice(int samplerate, const char *Args);
-MIDIDevice *CreateADLMIDIDevice(const char* args);
+MIDIDevice *CreateFluidSynthMIDIDevice(int samplerate, const char *Args, bool channeloutputs = false);	// the latter is needed for stems.
+MIDIDevice *CreateADLMIDIDevice(const char* args, int samplerate);
 MIDIDevice *CreateOPNMIDIDevice(const char *args);
 MIDIDevice *CreateOplMIDIDevice(const char* Args);
 MIDIDevice *CreateTimidityMIDIDevice(const char* Args, int samplerate);
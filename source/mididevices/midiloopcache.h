@@ -0,0 +1,175 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "midichasestate.h"
+
+//==========================================================================
+//
+// MIDILoopCache
+//
+// Keeps one pass of a looping song's synthesized output, so the passes
+// after it can be played from memory. Every restart of the song is a seam,
+// reported with the frame it falls on, the channel state going into it and
+// the notes held at that moment. The output from one seam to the next is
+// kept once both had the same state and held notes: the synth then starts
+// both passes the same way, with the same tail of the previous one still
+// sounding, and the next pass would come out the same as this one.
+//
+// The output is stored as rendered, before the device's gain.
+//
+//==========================================================================
+
+class MIDILoopCache
+{
+public:
+	enum EMode
+	{
+		Waiting,	// for the next seam to start capturing at.
+		Capturing,
+		Replaying,
+		Disabled,	// the song does not loop the same way, or is too long.
+	};
+
+	MIDILoopCache(int channels, size_t maxframes) : Channels(channels), MaxFrames(maxframes) {}
+
+	EMode GetMode() const { return Mode; }
+	bool IsReplaying() const { return Mode == Replaying; }
+
+	void AddSeam(uint64_t frame, const MIDIChaseState &state, const uint8_t (&heldnotes)[16][128])
+	{
+		if (Mode == Disabled) return;
+		Seams.emplace_back();
+		auto &seam = Seams.back();
+		seam.Frame = frame;
+		seam.State = state;
+		memcpy(seam.HeldNotes, heldnotes, sizeof(seam.HeldNotes));
+	}
+
+	// Passes the seams at 'frame' and returns how many of the next 'count'
+	// frames come before the one after them. Replaying may stop here, in
+	// which case the synth has to be brought back to the stream's state.
+	int Advance(uint64_t frame, int count)
+	{
+		while (!Seams.empty() && Seams.front().Frame <= frame)
+		{
+			Seam seam = std::move(Seams.front());
+			Seams.pop_front();
+			PassSeam(seam);
+		}
+		if (!Seams.empty() && Seams.front().Frame < frame + count) count = int(Seams.front().Frame - frame);
+		return count;
+	}
+
+	// The synthesized output of 'count' frames, kept while capturing.
+	void Capture(const float *buffer, int count)
+	{
+		if (Mode != Capturing) return;
+		if (Data.size() / Channels + count > MaxFrames)
+		{
+			Disable();
+			return;
+		}
+		Data.insert(Data.end(), buffer, buffer + count * Channels);
+	}
+
+	// Fills 'count' frames from the kept pass while replaying.
+	void Replay(float *buffer, int count)
+	{
+		const size_t frames = Data.size() / Channels;
+		while (count > 0)
+		{
+			if (Pos >= frames) Pos = 0;	// a pass may come out a frame longer than the kept one.
+			size_t n = std::min<size_t>(count, frames - Pos);
+			memcpy(buffer, &Data[Pos * Channels], n * Channels * sizeof(float));
+			buffer += n * Channels;
+			count -= int(n);
+			Pos += n;
+		}
+	}
+
+	// Throws away the kept output, to capture again from the next seam.
+	void Reset()
+	{
+		Seams.clear();
+		std::vector<float>().swap(Data);
+		Pos = 0;
+		if (Mode != Disabled) Mode = Waiting;
+	}
+
+private:
+	enum { MAX_FAILURES = 3 };
+
+	struct Seam
+	{
+		uint64_t Frame;
+		MIDIChaseState State;
+		uint8_t HeldNotes[16][128];
+	};
+
+	EMode Mode = Waiting;
+	int Channels;
+	size_t MaxFrames;
+	int Failures = 0;
+	std::deque<Seam> Seams;	// reported, but not yet reached by the output.
+	MIDIChaseState StartState;
+	uint8_t StartNotes[16][128];
+	std::vector<float> Data;
+	size_t Pos = 0;
+
+	bool Matches(const Seam &seam) const
+	{
+		return seam.State == StartState && memcmp(seam.HeldNotes, StartNotes, sizeof(StartNotes)) == 0;
+	}
+
+	void StartCapture(const Seam &seam)
+	{
+		Mode = Capturing;
+		StartState = seam.State;
+		memcpy(StartNotes, seam.HeldNotes, sizeof(StartNotes));
+		Data.clear();
+	}
+
+	void PassSeam(const Seam &seam)
+	{
+		switch (Mode)
+		{
+		case Waiting:
+			StartCapture(seam);
+			break;
+
+		case Capturing:
+			if (Matches(seam) && !Data.empty())
+			{
+				Mode = Replaying;
+				Pos = 0;
+			}
+			else if (++Failures >= MAX_FAILURES) Disable();
+			else StartCapture(seam);	// the first passes often still carry state from the song's start.
+			break;
+
+		case Replaying:
+			if (Matches(seam)) Pos = 0;
+			else if (++Failures >= MAX_FAILURES) Disable();
+			else
+			{
+				std::vector<float>().swap(Data);
+				Mode = Waiting;
+			}
+			break;
+
+		case Disabled:
+			break;
+		}
+	}
+
+	void Disable()
+	{
+		Mode = Disabled;
+		Seams.clear();
+		std::vector<float>().swap(Data);
+	}
+};
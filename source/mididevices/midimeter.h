@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include "mididefs.h"
+
+//==========================================================================
+//
+// MIDIMeter
+//
+// Follows the ticks of a stream and its time signatures, so the tick it is
+// at can be told as bar and beat. Until a song sets a time signature it is
+// in 4/4. The ticks count from the start of the song, or from where it last
+// started over.
+//
+//==========================================================================
+
+struct MIDIMeter
+{
+	double Tick = 0;
+	int Numerator = 4;
+	int DenominatorPow = 2;		// the beat is a 2^-DenominatorPow note.
+	double SignatureTick = 0;	// where the time signature took effect,
+	int SignatureBar = 0;		// at the start of this bar.
+
+	void Reset() { *this = MIDIMeter(); }
+
+	double TicksPerBeat(double division) const { return ldexp(division * 4, -DenominatorPow); }
+
+	// For MEVENT_NOP events. A time signature starts a new bar unless it comes right at the start of one.
+	void AddEvent(const uint32_t *event, double division)
+	{
+		if (MEVENT_EVENTTYPE(event[2]) != MEVENT_NOP || (event[2] & 0xff) != MARKER_TIMESIG) return;
+		int numerator = (event[2] >> 8) & 0xff;
+		int denominatorpow = (event[2] >> 16) & 0xff;
+		if (numerator == 0 || denominatorpow > 6) return;
+
+		double bars = (Tick - SignatureTick) / (TicksPerBeat(division) * Numerator);
+		SignatureBar += int(ceil(bars - 1e-6));
+		SignatureTick = Tick;
+		Numerator = numerator;
+		DenominatorPow = denominatorpow;
+	}
+
+	// The bar 'tick' is in and the beat within it, both from 0.
+	void GetBeat(double tick, double division, int &bar, double &beat) const
+	{
+		double beats = std::max(tick - SignatureTick, 0.) / TicksPerBeat(division);
+		int bars = int(beats / Numerator);
+		bar = SignatureBar + bars;
+		beat = beats - double(bars) * Numerator;
+	}
+};
@@ -36,21 +36,29 @@
 
 #include <stdexcept>
 #include <stdlib.h>
+#include <algorithm>
+#include <vector>
 
 #include "zmusic/zmusic_internal.h"
+#include "zmusic/resampler.h"
+#include "zmusic/emulatorselect.h"
 #include "mididevice.h"
+#include "zmusic/profile.h"
 
 #ifdef HAVE_ADL
 #include "adlmidi.h"
 
-ADLConfig adlConfig;
-
 class ADLMIDIDevice : public SoftSynthMIDIDevice
 {
 	struct ADL_MIDIPlayer *Renderer;
 	float OutputGainFactor;
+	bool SharedResampler;
+	FResampler Resampler;
+	std::vector<float> NativeBuffer;
+	std::vector<int> AutoEmulators;	// what the "auto" emulator picks from, the most accurate first.
+	int AutoEmulator = -1;			// the one it picked, each quality level goes one further.
 public:
-	ADLMIDIDevice(const ADLConfig *config);
+	ADLMIDIDevice(const ADLConfig *config, int samplerate);
 	~ADLMIDIDevice();
 	
 	int OpenRenderer() override;
@@ -59,14 +67,22 @@ public:
 protected:
 	
 	void HandleEvent(int status, int parm1, int parm2) override;
+	void HandleEvents(const MidiShortEvent *events, int count) override;
 	void HandleLongEvent(const uint8_t *data, int len) override;
 	void ComputeOutput(float *buffer, int len) override;
+	void SetQualityLevel(int level) override;
 	
 private:
 	int LoadCustomBank(const ADLConfig *config);
+	void SelectEmulator(const ADLConfig *config);
 };
 
 
+enum
+{
+	ADL_NATIVE_RATE = 49716,	// OPLChipBase::nativeRate
+};
+
 enum
 {
 	ME_NOTEOFF = 0x80,
@@ -84,14 +100,19 @@ enum
 //
 //==========================================================================
 
-ADLMIDIDevice::ADLMIDIDevice(const ADLConfig *config)
-	:SoftSynthMIDIDevice(44100)
+ADLMIDIDevice::ADLMIDIDevice(const ADLConfig *config, int samplerate)
+	:SoftSynthMIDIDevice(samplerate <= 0 ? 44100 : samplerate, 11025, 65535)
 {
-	Renderer = adl_init(44100);	// todo: make it configurable
+	// With the shared resampler libADLMIDI gets asked for the chips' own rate,
+	// so it only sums them up, and the mix is converted once here.
+	SharedResampler = config->adl_shared_resampler && !config->adl_run_at_pcm_rate;
+	Renderer = adl_init(SharedResampler ? ADL_NATIVE_RATE : SampleRate);
+	if (SharedResampler) Resampler.Setup(ADL_NATIVE_RATE, SampleRate);
 	OutputGainFactor = 3.5f;
+	MinRenderBlock = 64;
 	if (Renderer != nullptr)
 	{
-		adl_switchEmulator(Renderer, config->adl_emulator_id);
+		if (config->adl_emulator_id != EMULATOR_AUTO) adl_switchEmulator(Renderer, config->adl_emulator_id);
 		adl_setRunAtPcmRate(Renderer, config->adl_run_at_pcm_rate);
 		if (!LoadCustomBank(config))
 			adl_setBank(Renderer, config->adl_bank);
@@ -126,10 +147,58 @@ ADLMIDIDevice::ADLMIDIDevice(const ADLConfig *config)
 			OutputGainFactor = 3.8f;
 			break;
 		}
+		if (config->adl_emulator_id == EMULATOR_AUTO) SelectEmulator(config);
 	}
 	else throw std::runtime_error("Failed to create ADL MIDI renderer.");
 }
 
+//==========================================================================
+//
+// ADLMIDIDevice :: SelectEmulator
+//
+// For the "auto" emulator. The governor can step down to the faster ones
+// while playing if zmusic_snd_midicpubudget is set.
+//
+//==========================================================================
+
+void ADLMIDIDevice::SelectEmulator(const ADLConfig *config)
+{
+	static const int emulators[] = { ADLMIDI_EMU_NUKED, ADLMIDI_EMU_NUKED_174, ADLMIDI_EMU_DOSBOX, ADLMIDI_EMU_OPAL, ADLMIDI_EMU_JAVA };
+	for (int emu : emulators)
+	{
+		// Not every build has all of them.
+		if (adl_switchEmulator(Renderer, emu) == 0) AutoEmulators.push_back(emu);
+	}
+	if (AutoEmulators.empty()) return;
+
+	std::string key = "adl/" + std::to_string(adl_getNumChips(Renderer)) + "/" + std::to_string(SampleRate) + "/" +
+		std::to_string(config->adl_run_at_pcm_rate) + "/" + std::to_string(SharedResampler);
+	AutoEmulator = ZMusic_SelectEmulator(key, (int)AutoEmulators.size(), [=](int i)
+	{
+		adl_switchEmulator(Renderer, AutoEmulators[i]);
+		return MeasureRenderTime();
+	});
+	adl_switchEmulator(Renderer, AutoEmulators[AutoEmulator]);
+	if (SharedResampler) Resampler.Reset();
+	MaxQualityLevel = (int)AutoEmulators.size() - 1 - AutoEmulator;
+}
+
+//==========================================================================
+//
+// ADLMIDIDevice :: SetQualityLevel
+//
+// Switching the emulator resets the chips, which cuts off the notes that
+// are playing.
+//
+//==========================================================================
+
+void ADLMIDIDevice::SetQualityLevel(int level)
+{
+	if (AutoEmulator < 0) return;
+	adl_switchEmulator(Renderer, AutoEmulators[AutoEmulator + level]);
+	RestoreChannels();
+}
+
 //==========================================================================
 //
 // ADLMIDIDevice Destructor
@@ -156,6 +225,7 @@ ADLMIDIDevice::~ADLMIDIDevice()
 
 int ADLMIDIDevice::LoadCustomBank(const ADLConfig *config)
 {
+	ZMUSIC_PROFILE_ZONE("LoadInstruments");
 	const char *bankfile = config->adl_custom_bank.c_str();
 	if(!config->adl_use_custom_bank)
 		return 0;
@@ -222,6 +292,20 @@ void ADLMIDIDevice::HandleEvent(int status, int parm1, int parm2)
 	}
 }
 
+//==========================================================================
+//
+// ADLMIDIDevice :: HandleEvents
+//
+//==========================================================================
+
+void ADLMIDIDevice::HandleEvents(const MidiShortEvent *events, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		ADLMIDIDevice::HandleEvent(events[i].Status, events[i].Parm1, events[i].Parm2);
+	}
+}
+
 //==========================================================================
 //
 // ADLMIDIDevice :: HandleLongEvent
@@ -248,9 +332,26 @@ static const ADLMIDI_AudioFormat audio_output_format =
 
 void ADLMIDIDevice::ComputeOutput(float *buffer, int len)
 {
-	ADL_UInt8* left = reinterpret_cast<ADL_UInt8*>(buffer);
-	ADL_UInt8* right = reinterpret_cast<ADL_UInt8*>(buffer + 1);
-	auto result = adl_generateFormat(Renderer, len * 2, left, right, &audio_output_format);
+	ZMUSIC_PROFILE_ZONE("ComputeOutput");
+	int result;
+	if (SharedResampler)
+	{
+		size_t frames = Resampler.InputNeeded(len);
+		NativeBuffer.resize(frames * 2);
+		ADL_UInt8* left = reinterpret_cast<ADL_UInt8*>(NativeBuffer.data());
+		ADL_UInt8* right = reinterpret_cast<ADL_UInt8*>(NativeBuffer.data() + 1);
+		int native = frames == 0 ? 0 : adl_generateFormat(Renderer, (int)frames * 2, left, right, &audio_output_format);
+		if (native < 0) native = 0;
+		std::fill(NativeBuffer.begin() + native, NativeBuffer.end(), 0.f);
+		Resampler.Process(NativeBuffer.data(), buffer, len);
+		result = len * 2;
+	}
+	else
+	{
+		ADL_UInt8* left = reinterpret_cast<ADL_UInt8*>(buffer);
+		ADL_UInt8* right = reinterpret_cast<ADL_UInt8*>(buffer + 1);
+		result = adl_generateFormat(Renderer, len * 2, left, right, &audio_output_format);
+	}
 	for(int i=0; i < result; i++)
 	{
 		buffer[i] *= OutputGainFactor;
@@ -263,9 +364,7 @@ void ADLMIDIDevice::ComputeOutput(float *buffer, int len)
 //
 //==========================================================================
 
-extern ADLConfig adlConfig;
-
-MIDIDevice *CreateADLMIDIDevice(const char *Args)
+MIDIDevice *CreateADLMIDIDevice(const char *Args, int samplerate)
 {
 	ADLConfig config = adlConfig;
 
@@ -301,7 +400,7 @@ MIDIDevice *CreateADLMIDIDevice(const char *Args)
 			}
 		}
 	}
-	return new ADLMIDIDevice(&config);
+	return new ADLMIDIDevice(&config, samplerate);
 }
 
 DLL_EXPORT int ZMusic_GetADLBanks(const char* const** pNames)
@@ -311,7 +410,7 @@ DLL_EXPORT int ZMusic_GetADLBanks(const char* const** pNames)
 }
 
 #else
-MIDIDevice* CreateADLMIDIDevice(const char* Args)
+MIDIDevice* CreateADLMIDIDevice(const char* Args, int samplerate)
 {
 	throw std::runtime_error("ADL device not supported in this configuration");
 }
@@ -41,6 +41,7 @@
 #include "mididevice.h"
 #include "zmusic/m_swap.h"
 #include "zmusic/mus2midi.h"
+#include "zmusic/jobs.h"
 #include "zmusic_internal.h"
 
 #include "music_alsa_state.h"
@@ -108,6 +109,7 @@ protected:
 	AlsaSequencer &sequencer;
 
 	MidiHeader *Events = nullptr;
+	MidiHeader *EventsTail = nullptr;	// only valid while Events is not null.
 	bool Started = false;
 	uint32_t Position = 0;
 
@@ -345,8 +347,11 @@ bool AlsaMIDIDevice::WaitForExit(std::chrono::microseconds usec, snd_seq_queue_s
  * Pumps events from the input to the output in a worker thread.
  * It tries to keep the amount of events (time-wise) in the ALSA sequencer queue to be between 40 and 80ms by sleeping where necessary.
  * This means Alsa can play them safely without running out of things to do, and we have good control over the events themselves (volume, pause, etc.).
+ * Everything that is due within that window is handed to the sequencer in one batch with a single drain, and the thread then sleeps until
+ * the queue has played far enough into it, instead of waking up and flushing once for every event.
  */
 void AlsaMIDIDevice::PumpEvents() {
+	FThreadScope scope(THREAD_MIDIOUT, "ZMusic ALSA MIDI");
 	const std::chrono::microseconds pump_step(40000);
 
 	// TODO: fill in error handling throughout this.
@@ -361,51 +366,59 @@ void AlsaMIDIDevice::PumpEvents() {
 
 	int buffer_ticks = 0;
 	EventState event;
+	bool pending = false;	// 'event' has been pulled but not sent yet. Pulling it again would lose tempo changes.
 
 	snd_seq_queue_status_t *status;
 	snd_seq_queue_status_malloc(&status);
+	snd_seq_get_queue_status(sequencer.handle, QueueId, status);
 
 	while (true) {
-		auto type = PullEvent(event);
+		int queue_tick = snd_seq_queue_status_get_tick_time(status);
 		// if we reach the end of events, await our doom at a steady rate while looking for more events
-		if(type == EventType::Null) {
-			if(WaitForExit(pump_step, status)) {
-				break;
+		auto wait = pump_step;
+		int sent = 0;
+
+		while (true) {
+			if (!pending) {
+				if (PullEvent(event) == EventType::Null) {
+					break;
+				}
+				pending = true;
 			}
-			continue;
-		}
 
-		// Figure out if we should sleep (the event is too far in the future for us to care), and for how long
-		int next_event_tick = buffer_ticks + event.ticks;
-		int queue_tick = snd_seq_queue_status_get_tick_time(status);
-		int tick_delta = next_event_tick - queue_tick;
-		auto usecs = std::chrono::microseconds(tick_delta * Tempo / TimeDiv);
-		auto schedule_time = std::max(std::chrono::microseconds(0), usecs - pump_step);
-		if(schedule_time >= pump_step) {
-			if(WaitForExit(schedule_time, status)) {
+			// Figure out if the batch is complete (the event is too far in the future for us to care), and how long to sleep then
+			int next_event_tick = buffer_ticks + event.ticks;
+			int tick_delta = next_event_tick - queue_tick;
+			auto usecs = std::chrono::microseconds(int64_t(tick_delta) * Tempo / TimeDiv);
+			if (usecs >= pump_step * 2) {
+				wait = usecs - pump_step;
 				break;
 			}
-			continue;
-		}
-		if (tick_delta < 0) {
-			ZMusic_Printf(ZMUSIC_MSG_ERROR, "Alsa sequencer underrun: %d ticks!\n", tick_delta);
-		}
+			if (tick_delta < 0) {
+				ZMusic_Printf(ZMUSIC_MSG_ERROR, "Alsa sequencer underrun: %d ticks!\n", tick_delta);
+			}
 
-		// We found an event worthy of sending to the sequencer
-		snd_seq_ev_set_source(&event.data, PortId);
-		snd_seq_ev_set_subs(&event.data);
-		snd_seq_ev_schedule_tick(&event.data, QueueId, false, buffer_ticks + event.ticks);
-		int result = snd_seq_event_output(sequencer.handle, &event.data);
-		if(result < 0) {
-			ZMusic_Printf(ZMUSIC_MSG_ERROR, "Alsa sequencer did not accept event: error %d!\n", result);
-			if(WaitForExit(pump_step, status)) {
+			// We found an event worthy of sending to the sequencer. This only goes to the output buffer, which gets flushed by itself when it is full.
+			snd_seq_ev_set_source(&event.data, PortId);
+			snd_seq_ev_set_subs(&event.data);
+			snd_seq_ev_schedule_tick(&event.data, QueueId, false, next_event_tick);
+			int result = snd_seq_event_output(sequencer.handle, &event.data);
+			if(result < 0) {
+				ZMusic_Printf(ZMUSIC_MSG_ERROR, "Alsa sequencer did not accept event: error %d!\n", result);
 				break;
 			}
-			continue;
+			buffer_ticks = next_event_tick;
+			Position += event.size_of;
+			pending = false;
+			sent++;
+		}
+
+		if (sent > 0) {
+			snd_seq_drain_output(sequencer.handle);
+		}
+		if(WaitForExit(wait, status)) {
+			break;
 		}
-		buffer_ticks += event.ticks;
-		Position += event.size_of;
-		snd_seq_drain_output(sequencer.handle);
 	}
 
 	snd_seq_queue_status_free(status);
@@ -470,12 +483,9 @@ int AlsaMIDIDevice::StreamOut(MidiHeader *header)
 	}
 	else
 	{
-		MidiHeader **p;
-
-		for (p = &Events; *p != NULL; p = &(*p)->lpNext)
-		{ }
-		*p = header;
+		EventsTail->lpNext = header;
 	}
+	EventsTail = header;
 	return 0;
 }
 
@@ -135,7 +135,7 @@ bool MIDIDevice::Update()
 //
 //==========================================================================
 
-void MIDIDevice::ChangeSettingInt(const char *setting, int value)
+void MIDIDevice::ChangeSettingInt(ESongSetting setting, int value)
 {
 }
 
@@ -145,17 +145,7 @@ void MIDIDevice::ChangeSettingInt(const char *setting, int value)
 //
 //==========================================================================
 
-void MIDIDevice::ChangeSettingNum(const char *setting, double value)
-{
-}
-
-//==========================================================================
-//
-// MIDIDevice :: ChangeSettingString
-//
-//==========================================================================
-
-void MIDIDevice::ChangeSettingString(const char *setting, const char *value)
+void MIDIDevice::ChangeSettingNum(ESongSetting setting, double value)
 {
 }
 
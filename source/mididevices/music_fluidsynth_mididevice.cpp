@@ -34,42 +34,85 @@
 
 // HEADER FILES ------------------------------------------------------------
 
+#include <algorithm>
 #include <mutex>
 #include <stdexcept>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include "zmusic/zmusic_internal.h"
 #include "mididevice.h"
 #include "zmusic/mus2midi.h"
+#include "zmusic/jobs.h"
+#include "zmusic/profile.h"
 #include "loader/i_module.h"
 
 // FluidSynth implementation of a MIDI device -------------------------------
 
-FluidConfig fluidConfig;
-
 #include "../thirdparty/fluidsynth/include/fluidsynth.h"
 
 class FluidSynthMIDIDevice : public SoftSynthMIDIDevice
 {
 public:
-	FluidSynthMIDIDevice(int samplerate, std::vector<std::string> &config);
+	FluidSynthMIDIDevice(int samplerate, std::vector<std::string> &config, bool channeloutputs);
 	~FluidSynthMIDIDevice();
 	
 	int OpenRenderer() override;
 	std::string GetStats() override;
-	void ChangeSettingInt(const char *setting, int value) override;
-	void ChangeSettingNum(const char *setting, double value) override;
-	void ChangeSettingString(const char *setting, const char *value) override;
+	int GetActiveVoices() override { return FluidSynth ? fluid_synth_get_active_voice_count(FluidSynth) : -1; }
+	void GetChannelActivity(int *voices, float *levels) override
+	{
+		if (FluidSynth) fluid_synth_get_channel_activity(FluidSynth, 16, voices, levels);
+		else SoftSynthMIDIDevice::GetChannelActivity(voices, levels);
+	}
+	void ChangeSettingInt(ESongSetting setting, int value) override;
+	void ChangeSettingNum(ESongSetting setting, double value) override;
 	int GetDeviceType() const override { return MDEV_FLUIDSYNTH; }
+	void PrecacheInstruments(const uint16_t *instruments, int count) override;
+	bool CanPrecacheWhilePlaying() const override { return DynamicSamples; }	// otherwise a program change loads the samples on the stream's thread anyway
+	bool ServiceStream(void *buff, int numbytes) override;
+	bool SetExternalEffects(bool on) override;
+	const float *GetEffectSends() override { return ExternalEffects ? Sends.data() : nullptr; }
+	bool SetStems(int numstems, const uint8_t *channelstems) override;
+	int GetMaxLayers() const override { return MAX_MIDI_LAYERS; }
+	void HandleChannelEvent(int channel, int command, int parm1, int parm2) override;
+	const float *GetStems(int &frames) override { frames = StemFrames; return NumStems > 0 ? Stems.data() : nullptr; }
+	bool ReloadSoundFonts(const char *args) override;
 	
 protected:
 	void HandleEvent(int status, int parm1, int parm2) override;
+	void HandleEvents(const MidiShortEvent *events, int count) override;
 	void HandleLongEvent(const uint8_t *data, int len) override;
 	void ComputeOutput(float *buffer, int len) override;
+	void SetQualityLevel(int level) override;
+	void ResetRenderer() override;
 	int LoadPatchSets(const std::vector<std::string>& config);
+	static fluid_preset_t *FindPreset(fluid_synth_t *synth, int bank, int program, bool drum);
+	static int PinPresets(fluid_synth_t *synth, const std::vector<uint16_t> &instruments);
 	
 	fluid_settings_t *FluidSettings;
 	fluid_synth_t *FluidSynth;
+	bool DynamicSamples;
+	bool FloatSamples;
+	std::vector<std::string> PatchSets;	// as requested, not only those that loaded
+	std::vector<uint16_t> Precached;	// pinned again when the soundfonts change
+
+	// With external effects the output is rendered planar, and the sends
+	// are collected for the whole ServiceStream call.
+	bool ExternalEffects = false;
+	std::vector<float> Sends;
+	std::vector<float> Planar;
+	int SendFrames = 0;
+	int SendPos = 0;
+
+	// With channel outputs every MIDI channel is rendered to an audio group
+	// of its own, which is what the stems get collected from.
+	bool ChannelOutputs;
+	int NumStems = 0;
+	uint8_t ChannelStems[16] = {};
+	std::vector<float> Stems;
+	int StemFrames = 0;
+	int StemPos = 0;
 
 	// Possible results returned by fluid_settings_...() functions
 	// Initial values are for FluidSynth 2.x
@@ -88,6 +131,8 @@ const char *BaseFileSearch(const char *file, const char *ext, bool lookfirstinpr
 
 // PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
 
+void Fluid_SetupConfig(const char* patches, std::vector<std::string> &patch_paths, bool systemfallback);
+
 // PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
 
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
@@ -98,16 +143,110 @@ const char *BaseFileSearch(const char *file, const char *ext, bool lookfirstinpr
 
 // CODE --------------------------------------------------------------------
 
+//==========================================================================
+//
+// Soundfont cache
+//
+// FluidSynth's sample cache already shares the sample data of a file
+// between all synths that load it, keyed by path and modification time,
+// but only for as long as one of them still has it loaded. To make that
+// survive song changes an idle synth holds on to the soundfonts the last
+// device was created with. Devices loading the same files only need to
+// parse the preset headers then.
+//
+//==========================================================================
+
+struct CachedSoundFont
+{
+	std::string Path;
+	time_t ModTime;
+	int ID;
+};
+
+static std::mutex SoundFontCacheLock;
+static fluid_settings_t *SoundFontCacheSettings;
+static fluid_synth_t *SoundFontCacheSynth;
+static std::vector<CachedSoundFont> SoundFontCache;
+
+static time_t GetModTime(const std::string &path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+static void HoldSoundFonts(const std::vector<std::string> &files)
+{
+	std::lock_guard<std::mutex> lock(SoundFontCacheLock);
+	if (!fluidConfig.fluid_cachesoundfonts) return;
+
+	bool same = files.size() == SoundFontCache.size();
+	for (size_t i = 0; same && i < files.size(); i++)
+	{
+		same = files[i] == SoundFontCache[i].Path && GetModTime(files[i]) == SoundFontCache[i].ModTime;
+	}
+	if (same) return;
+
+	if (SoundFontCacheSynth == nullptr)
+	{
+		SoundFontCacheSettings = new_fluid_settings();
+		if (SoundFontCacheSettings == nullptr) return;
+		fluid_settings_setint(SoundFontCacheSettings, "synth.polyphony", 1);
+		fluid_settings_setint(SoundFontCacheSettings, "synth.reverb.active", 0);
+		fluid_settings_setint(SoundFontCacheSettings, "synth.chorus.active", 0);
+		SoundFontCacheSynth = new_fluid_synth(SoundFontCacheSettings);
+		if (SoundFontCacheSynth == nullptr)
+		{
+			delete_fluid_settings(SoundFontCacheSettings);
+			SoundFontCacheSettings = nullptr;
+			return;
+		}
+	}
+	// Load the new set before letting go of the old one so that files both have in common stay cached.
+	std::vector<CachedSoundFont> fonts;
+	for (auto &file : files)
+	{
+		int id = fluid_synth_sfload(SoundFontCacheSynth, file.c_str(), false);
+		if (id != FLUID_FAILED) fonts.push_back({ file, GetModTime(file), id });
+	}
+	for (auto &font : SoundFontCache)
+	{
+		fluid_synth_sfunload(SoundFontCacheSynth, font.ID, false);
+	}
+	SoundFontCache = std::move(fonts);
+}
+
+void Fluid_ReleaseSoundFontCache()
+{
+	std::lock_guard<std::mutex> lock(SoundFontCacheLock);
+	SoundFontCache.clear();
+	if (SoundFontCacheSynth != nullptr)
+	{
+		delete_fluid_synth(SoundFontCacheSynth);
+		delete_fluid_settings(SoundFontCacheSettings);
+		SoundFontCacheSynth = nullptr;
+		SoundFontCacheSettings = nullptr;
+	}
+}
+
 //==========================================================================
 //
 // FluidSynthMIDIDevice Constructor
 //
 //==========================================================================
 
-FluidSynthMIDIDevice::FluidSynthMIDIDevice(int samplerate, std::vector<std::string> &config)
+FluidSynthMIDIDevice::FluidSynthMIDIDevice(int samplerate, std::vector<std::string> &config, bool channeloutputs)
 	: SoftSynthMIDIDevice(samplerate <= 0? fluidConfig.fluid_samplerate : samplerate, 22050, 96000)
 {
 	StreamBlockSize = 4;
+	ChannelOutputs = channeloutputs;
+	isMono = miscConfig.snd_mono && !ChannelOutputs;
+
+	// FluidSynth only processes events at its internal 64 sample boundary anyway.
+	// With more than one thread every render call hands the voices to the mixer
+	// threads and waits for them, which only pays off if the call spans many blocks.
+	int block = fluidConfig.fluid_renderblock > 0 ? fluidConfig.fluid_renderblock : fluidConfig.fluid_threads > 1 ? 512 : 64;
+	MinRenderBlock = std::min(std::max((block + 63) & ~63, 64), 8192);
+	MaxQualityLevel = 4;
 
 	FluidSynth = NULL;
 	FluidSettings = NULL;
@@ -122,7 +261,23 @@ FluidSynthMIDIDevice::FluidSynthMIDIDevice(int samplerate, std::vector<std::stri
 	fluid_settings_setint(FluidSettings, "synth.reverb.active", fluidConfig.fluid_reverb);
 	fluid_settings_setint(FluidSettings, "synth.chorus.active", fluidConfig.fluid_chorus);
 	fluid_settings_setint(FluidSettings, "synth.polyphony", fluidConfig.fluid_voices);
-	fluid_settings_setint(FluidSettings, "synth.cpu-cores", fluidConfig.fluid_threads);
+	// FluidSynth's render threads are its own, they are only kept from outnumbering the job threads.
+	fluid_settings_setint(FluidSettings, "synth.cpu-cores", std::min<int>(fluidConfig.fluid_threads, (int)ZMusic_JobThreads()));
+	DynamicSamples = fluidConfig.fluid_dynamicsamples;
+	fluid_settings_setint(FluidSettings, "synth.dynamic-sample-loading", DynamicSamples);
+	FloatSamples = fluidConfig.fluid_floatsamples;
+	fluid_settings_setint(FluidSettings, "synth.float-samples", FloatSamples);
+	int decodethreads = fluidConfig.fluid_decodethreads > 0 ? fluidConfig.fluid_decodethreads : (int)ZMusic_JobThreads();
+	fluid_settings_setint(FluidSettings, "synth.sample-decode-threads", std::min(std::max(decodethreads, 1), 64));
+	fluid_settings_setstr(FluidSettings, "synth.decoded-sample-cache", fluidConfig.fluid_samplecache.c_str());
+	// Layers get the channels above the first 16.
+	fluid_settings_setint(FluidSettings, "synth.midi-channels", 16 * (1 + MAX_MIDI_LAYERS));
+	if (ChannelOutputs)
+	{
+		// Voices go to the audio group of their channel modulo the group count, so layers end up in the stems of the song's channels.
+		fluid_settings_setint(FluidSettings, "synth.audio-groups", 16);
+		fluid_settings_setint(FluidSettings, "synth.audio-channels", 16);
+	}
 	FluidSynth = new_fluid_synth(FluidSettings);
 	if (FluidSynth == NULL)
 	{
@@ -130,6 +285,11 @@ FluidSynthMIDIDevice::FluidSynthMIDIDevice(int samplerate, std::vector<std::stri
 		throw std::runtime_error("Failed to create FluidSynth.\n");
 	}
 	fluid_synth_set_interp_method(FluidSynth, -1, fluidConfig.fluid_interp);
+	// Channel 10 of every layer plays drums, like the song's. Their presets get picked when the first soundfont loads.
+	for (int i = 1; i <= MAX_MIDI_LAYERS; i++)
+	{
+		fluid_synth_set_channel_type(FluidSynth, i * 16 + 9, CHANNEL_TYPE_DRUM);
+	}
 	fluid_synth_set_reverb(FluidSynth, fluidConfig.fluid_reverb_roomsize, fluidConfig.fluid_reverb_damping,
 		fluidConfig.fluid_reverb_width, fluidConfig.fluid_reverb_level);
 	fluid_synth_set_chorus(FluidSynth, fluidConfig.fluid_chorus_voices, fluidConfig.fluid_chorus_level,
@@ -170,6 +330,91 @@ FluidSynthMIDIDevice::~FluidSynthMIDIDevice()
 	}
 }
 
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: FindPreset
+//
+// Looks up a preset the same way a program change would, including
+// FluidSynth's substitutions for missing presets.
+//
+//==========================================================================
+
+fluid_preset_t *FluidSynthMIDIDevice::FindPreset(fluid_synth_t *synth, int bank, int program, bool drum)
+{
+	// Fonts loaded later take precedence, and those are at the start of the stack.
+	auto find = [=](int bank, int program) -> fluid_preset_t *
+	{
+		int numfonts = fluid_synth_sfcount(synth);
+		for (int i = 0; i < numfonts; ++i)
+		{
+			fluid_sfont_t *sfont = fluid_synth_get_sfont(synth, i);
+			fluid_preset_t *preset = sfont != nullptr ? fluid_sfont_get_preset(sfont, bank, program) : nullptr;
+			if (preset != nullptr) return preset;
+		}
+		return nullptr;
+	};
+
+	fluid_preset_t *preset = find(bank, program);
+	if (preset == nullptr)
+	{
+		if (drum) preset = find(bank, 0);
+		else if ((preset = find(0, program)) == nullptr) preset = find(0, 0);
+	}
+	return preset;
+}
+
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: PrecacheInstruments
+//
+// With dynamic sample loading FluidSynth only reads a preset's samples
+// when a channel selects it, which would stall the render thread in the
+// middle of the song, and for SF3 files decompress them there as well.
+// Pinning the presets the song is known to use loads them up front,
+// everything else in the soundfont is never read. With float samples
+// pinning also converts the samples of these presets to float.
+//
+//==========================================================================
+
+void FluidSynthMIDIDevice::PrecacheInstruments(const uint16_t *instruments, int count)
+{
+	if (!DynamicSamples && !FloatSamples) return;
+
+	Precached.assign(instruments, instruments + count);
+	int pinned = PinPresets(FluidSynth, Precached);
+	ZMusic_Printf(ZMUSIC_MSG_DEBUG, "Pinned %d presets.\n", pinned);
+}
+
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: PinPresets										static
+//
+//==========================================================================
+
+int FluidSynthMIDIDevice::PinPresets(fluid_synth_t *synth, const std::vector<uint16_t> &instruments)
+{
+	std::vector<fluid_preset_t *> pinned;
+	for (auto instrument : instruments)
+	{
+		fluid_preset_t *preset;
+		if (instrument & (1 << 14))
+		{ // For drums the entry holds the key. The kit is the bank number and lives in bank 128 in SF2 files.
+			preset = FindPreset(synth, 128, (instrument >> 7) & 127, true);
+		}
+		else
+		{
+			preset = FindPreset(synth, (instrument >> 7) & 127, instrument & 127, false);
+		}
+		// With multiple banks in use many entries end up substituted with the same preset.
+		if (preset == nullptr || std::find(pinned.begin(), pinned.end(), preset) != pinned.end()) continue;
+
+		pinned.push_back(preset);
+		fluid_synth_pin_preset(synth, fluid_sfont_get_id(fluid_preset_get_sfont(preset)),
+			fluid_preset_get_banknum(preset), fluid_preset_get_num(preset));
+	}
+	return (int)pinned.size();
+}
+
 //==========================================================================
 //
 // FluidSynthMIDIDevice :: Open
@@ -185,19 +430,60 @@ int FluidSynthMIDIDevice::OpenRenderer()
 	return 0;
 }
 
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: ResetRenderer
+//
+// A system reset also covers the layers' channels and clears what the reverb
+// and chorus still hold, but makes channel 10 of every layer melodic again.
+//
+//==========================================================================
+
+void FluidSynthMIDIDevice::ResetRenderer()
+{
+	fluid_synth_system_reset(FluidSynth);
+	for (int i = 1; i <= MAX_MIDI_LAYERS; i++)
+	{
+		fluid_synth_set_channel_type(FluidSynth, i * 16 + 9, CHANNEL_TYPE_DRUM);
+		fluid_synth_program_change(FluidSynth, i * 16 + 9, 0);
+	}
+}
+
 //==========================================================================
 //
 // FluidSynthMIDIDevice :: HandleEvent
 //
+//==========================================================================
+
+void FluidSynthMIDIDevice::HandleEvent(int status, int parm1, int parm2)
+{
+	HandleChannelEvent(status & 0x0F, status & 0xF0, parm1, parm2);
+}
+
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: HandleEvents
+//
+//==========================================================================
+
+void FluidSynthMIDIDevice::HandleEvents(const MidiShortEvent *events, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		FluidSynthMIDIDevice::HandleChannelEvent(events[i].Status & 0x0F, events[i].Status & 0xF0, events[i].Parm1, events[i].Parm2);
+	}
+}
+
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: HandleChannelEvent
+//
 // Translates a MIDI event into FluidSynth calls.
 //
 //==========================================================================
 
-void FluidSynthMIDIDevice::HandleEvent(int status, int parm1, int parm2)
+void FluidSynthMIDIDevice::HandleChannelEvent(int channel, int command, int parm1, int parm2)
 {
-	int command = status & 0xF0;
-	int channel = status & 0x0F;
-	
 	switch (command)
 	{
 	case MIDI_NOTEOFF:
@@ -254,9 +540,173 @@ void FluidSynthMIDIDevice::HandleLongEvent(const uint8_t *data, int len)
 
 void FluidSynthMIDIDevice::ComputeOutput(float *buffer, int len)
 {
-	fluid_synth_write_float(FluidSynth, len,
-		buffer, 0, 2,
-		buffer, 1, 2);
+	ZMUSIC_PROFILE_ZONE("ComputeOutput");
+	if (isMono)
+	{
+		// With one output buffer fluid_synth_process mixes both sides of the dry
+		// signal and of the effects into it, so only the halving is left.
+		memset(buffer, 0, len * sizeof(float));
+		fluid_synth_process(FluidSynth, len, 1, &buffer, 1, &buffer);
+		for (int i = 0; i < len; i++) buffer[i] *= 0.5f;
+		return;
+	}
+	if (!ExternalEffects && !ChannelOutputs)
+	{
+		fluid_synth_write_float(FluidSynth, len,
+			buffer, 0, 2,
+			buffer, 1, 2);
+		return;
+	}
+
+	// fluid_synth_process mixes into its output, so everything has to start out silent.
+	// Unlike fluid_synth_write_float it leaves reverb and chorus in the effect buffers.
+	const int nout = ChannelOutputs ? 32 : 2;
+	Planar.assign(len * (nout + 4), 0.f);
+	float *dry[32];
+	for (int i = 0; i < nout; i++) dry[i] = &Planar[len * i];
+	float *fx[4] = { &Planar[len * nout], &Planar[len * (nout + 1)], &Planar[len * (nout + 2)], &Planar[len * (nout + 3)] };
+	fluid_synth_process(FluidSynth, len, 4, fx, nout, dry);
+
+	for (int i = 0; i < len; i++)
+	{
+		buffer[i * 2] = dry[0][i];
+		buffer[i * 2 + 1] = dry[1][i];
+	}
+	for (int c = 2; c < nout; c += 2)
+	{
+		for (int i = 0; i < len; i++)
+		{
+			buffer[i * 2] += dry[c][i];
+			buffer[i * 2 + 1] += dry[c + 1][i];
+		}
+	}
+	if (!ExternalEffects)
+	{
+		for (int i = 0; i < len; i++)
+		{
+			buffer[i * 2] += fx[0][i] + fx[2][i];
+			buffer[i * 2 + 1] += fx[1][i] + fx[3][i];
+		}
+	}
+
+	int count = std::min(len, StemFrames - StemPos);
+	if (NumStems > 0 && count > 0)
+	{
+		for (int c = 0; c < 16; c++)
+		{
+			float *left = &Stems[ChannelStems[c] * 2 * StemFrames + StemPos];
+			float *right = left + StemFrames;
+			for (int i = 0; i < count; i++)
+			{
+				left[i] += dry[c * 2][i];
+				right[i] += dry[c * 2 + 1][i];
+			}
+		}
+		if (!ExternalEffects)
+		{
+			float *left = &Stems[NumStems * 2 * StemFrames + StemPos];
+			float *right = left + StemFrames;
+			for (int i = 0; i < count; i++)
+			{
+				left[i] += fx[0][i] + fx[2][i];
+				right[i] += fx[1][i] + fx[3][i];
+			}
+		}
+		StemPos += count;
+	}
+
+	if (!ExternalEffects) return;
+
+	// The sends are mono and end up in the left channel of each effect.
+	count = std::min(len, SendFrames - SendPos);
+	if (count > 0)
+	{
+		memcpy(&Sends[SendPos], fx[0], count * sizeof(float));
+		memcpy(&Sends[SendFrames + SendPos], fx[2], count * sizeof(float));
+		SendPos += count;
+	}
+}
+
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: ServiceStream
+//
+// The sends and stems need the same gain as the mixed output, so the ramp
+// gets repeated on them from the state it had before the call.
+//
+//==========================================================================
+
+bool FluidSynthMIDIDevice::ServiceStream(void *buff, int numbytes)
+{
+	if (!ExternalEffects && NumStems == 0) return SoftSynthMIDIDevice::ServiceStream(buff, numbytes);
+
+	int frames = numbytes / (sizeof(float) * 2);
+	if (ExternalEffects)
+	{
+		SendFrames = frames;
+		SendPos = 0;
+		Sends.assign(SendFrames * 2, 0.f);
+	}
+	if (NumStems > 0)
+	{
+		StemFrames = frames;
+		StemPos = 0;
+		Stems.assign(StemFrames * (NumStems + 1) * 2, 0.f);
+	}
+
+	float gain = Gain;
+	int fadeframes = GainFadeFrames;
+	bool res = SoftSynthMIDIDevice::ServiceStream(buff, numbytes);
+	if (ExternalEffects)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			float g = gain;
+			int f = fadeframes;
+			RampGain(&Sends[i * SendFrames], SendFrames, 1, g, TargetGain, f);
+		}
+	}
+	if (NumStems > 0)
+	{
+		for (int i = 0; i < (NumStems + 1) * 2; i++)
+		{
+			float g = gain;
+			int f = fadeframes;
+			RampGain(&Stems[i * StemFrames], StemFrames, 1, g, TargetGain, f);
+		}
+	}
+	return res;
+}
+
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: SetExternalEffects
+//
+//==========================================================================
+
+bool FluidSynthMIDIDevice::SetExternalEffects(bool on)
+{
+	if (FluidSynth == nullptr || (on && isMono)) return false;
+	fluid_synth_set_fx_external(FluidSynth, on);
+	ExternalEffects = on;
+	return true;
+}
+
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: SetStems
+//
+// Needs a synth that was created with channel outputs, which cannot be
+// turned on later.
+//
+//==========================================================================
+
+bool FluidSynthMIDIDevice::SetStems(int numstems, const uint8_t *channelstems)
+{
+	if (numstems > 0 && !ChannelOutputs) return false;
+	NumStems = numstems;
+	if (numstems > 0) memcpy(ChannelStems, channelstems, sizeof(ChannelStems));
+	return true;
 }
 
 //==========================================================================
@@ -267,117 +717,192 @@ void FluidSynthMIDIDevice::ComputeOutput(float *buffer, int len)
 
 int FluidSynthMIDIDevice::LoadPatchSets(const std::vector<std::string> &config)
 {
-	int count = 0;
+	ZMUSIC_PROFILE_ZONE("LoadInstruments");
+	std::vector<std::string> loaded;
+	PatchSets = config;
 	for (auto& file : config)
 	{
-		if (FLUID_FAILED != fluid_synth_sfload(FluidSynth, file.c_str(), count == 0))
+		if (FLUID_FAILED != fluid_synth_sfload(FluidSynth, file.c_str(), loaded.empty()))
 		{
 			ZMusic_Printf(ZMUSIC_MSG_DEBUG, "Loaded patch set %s.\n", file.c_str());
-			count++;
+			loaded.push_back(file);
 		}
 		else
 		{
 			ZMusic_Printf(ZMUSIC_MSG_ERROR, "Failed to load patch set %s.\n", file.c_str());
 		}
 	}
-	return count;
+	// With dynamic sample loading there is no sample data the cache could hold on to.
+	if (!loaded.empty() && !DynamicSamples) HoldSoundFonts(loaded);
+	return (int)loaded.size();
 }
 
 //==========================================================================
 //
-// FluidSynthMIDIDevice :: ChangeSettingInt
+// FluidSynthMIDIDevice :: ReloadSoundFonts
 //
-// Changes an integer setting.
+// Exchanges the soundfonts while the synth keeps playing. The new set is
+// loaded into a synth of its own first, which puts the sample data into
+// FluidSynth's sample cache without holding the playing synth's lock, so
+// that loading them there only has to parse the preset headers. Voices
+// still playing a sample of the old set keep it alive until they end.
 //
 //==========================================================================
 
-void FluidSynthMIDIDevice::ChangeSettingInt(const char *setting, int value)
+bool FluidSynthMIDIDevice::ReloadSoundFonts(const char *args)
 {
-	if (FluidSynth == nullptr || FluidSettings == nullptr || strncmp(setting, "fluidsynth.", 11))
+	std::vector<std::string> config;
+	Fluid_SetupConfig(args, config, true);
+	if (config == PatchSets) return true;
+
+	fluid_settings_t *loadsettings = new_fluid_settings();
+	if (loadsettings == nullptr) return false;
+	fluid_settings_setint(loadsettings, "synth.polyphony", 1);
+	fluid_settings_setint(loadsettings, "synth.reverb.active", 0);
+	fluid_settings_setint(loadsettings, "synth.chorus.active", 0);
+	fluid_settings_setint(loadsettings, "synth.dynamic-sample-loading", DynamicSamples);
+	int decodethreads = 1;
+	fluid_settings_getint(FluidSettings, "synth.sample-decode-threads", &decodethreads);
+	fluid_settings_setint(loadsettings, "synth.sample-decode-threads", decodethreads);
+	fluid_settings_setstr(loadsettings, "synth.decoded-sample-cache", fluidConfig.fluid_samplecache.c_str());
+	fluid_synth_t *loadsynth = new_fluid_synth(loadsettings);
+	if (loadsynth == nullptr)
 	{
-		return;
+		delete_fluid_settings(loadsettings);
+		return false;
 	}
-	setting += 11;
+	for (auto &file : config)
+	{
+		fluid_synth_sfload(loadsynth, file.c_str(), false);
+	}
+	// With dynamic sample loading only the pinned presets have their samples read.
+	if (DynamicSamples) PinPresets(loadsynth, Precached);
 
-	if (strcmp(setting, "synth.interpolation") == 0)
+	std::vector<int> oldfonts;
+	for (int i = 0, count = fluid_synth_sfcount(FluidSynth); i < count; i++)
 	{
-		if (FLUID_OK != fluid_synth_set_interp_method(FluidSynth, -1, value))
-		{
-			ZMusic_Printf(ZMUSIC_MSG_ERROR, "Setting interpolation method %d failed.\n", value);
-		}
+		oldfonts.push_back(fluid_sfont_get_id(fluid_synth_get_sfont(FluidSynth, i)));
 	}
-	else if (strcmp(setting, "synth.polyphony") == 0)
+	auto oldconfig = PatchSets;
+	bool res = LoadPatchSets(config) > 0;
+	if (res)
 	{
-		if (FLUID_OK != fluid_synth_set_polyphony(FluidSynth, value))
+		for (auto id : oldfonts)
 		{
-			ZMusic_Printf(ZMUSIC_MSG_ERROR, "Setting polyphony to %d failed.\n", value);
+			fluid_synth_sfunload(FluidSynth, id, true);
 		}
+		if (DynamicSamples || FloatSamples) PinPresets(FluidSynth, Precached);
 	}
-	else if (FluidSettingsResultFailed == fluid_settings_setint(FluidSettings, setting, value))
+	else
 	{
-		ZMusic_Printf(ZMUSIC_MSG_ERROR, "Failed to set %s to %d.\n", setting, value);
-	}
-	// fluid_settings_setint succeeded; update these settings in the running synth, too
-	else if (strcmp(setting, "synth.reverb.active") == 0)
-	{
-		fluid_synth_set_reverb_on(FluidSynth, value);
-	}
-	else if (strcmp(setting, "synth.chorus.active") == 0)
-	{
-		fluid_synth_set_chorus_on(FluidSynth, value);
+		PatchSets = oldconfig;
 	}
+	delete_fluid_synth(loadsynth);
+	delete_fluid_settings(loadsettings);
+	return res;
 }
 
 //==========================================================================
 //
-// FluidSynthMIDIDevice :: ChangeSettingNum
+// FluidSynthMIDIDevice :: SetQualityLevel
 //
-// Changes a numeric setting.
+// Every level takes away a quarter of the configured polyphony, down to
+// a quarter of it. From level 2 on the interpolation is limited to 4th
+// order, from level 3 on to linear.
+//
+//==========================================================================
+
+void FluidSynthMIDIDevice::SetQualityLevel(int level)
+{
+	static const int polyscale[] = { 4, 3, 2, 2, 1 };
+	level = std::min(std::max(level, 0), 4);
+
+	int voices = std::max(fluidConfig.fluid_voices * polyscale[level] / 4, std::min(fluidConfig.fluid_voices, 16));
+	int interp = fluidConfig.fluid_interp;
+	if (level >= 3) interp = std::min(interp, (int)FLUID_INTERP_LINEAR);
+	else if (level >= 2) interp = std::min(interp, (int)FLUID_INTERP_4THORDER);
+
+	ChangeSettingInt(SETTING_FLUID_POLYPHONY, voices);
+	ChangeSettingInt(SETTING_FLUID_INTERPOLATION, interp);
+	ZMusic_Printf(ZMUSIC_MSG_DEBUG, "FluidSynth quality level %d: %d voices, interpolation %d\n", level, voices, interp);
+}
+
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: ChangeSettingInt
+//
+// Changes an integer setting. These go straight to the synth, the
+// settings object is only read when it gets created.
 //
 //==========================================================================
 
-void FluidSynthMIDIDevice::ChangeSettingNum(const char *setting, double value)
+void FluidSynthMIDIDevice::ChangeSettingInt(ESongSetting setting, int value)
 {
-	if (FluidSynth == nullptr || FluidSettings == nullptr || strncmp(setting, "fluidsynth.", 11))
+	if (FluidSynth == nullptr)
 	{
 		return;
 	}
-	setting += 11;
 
-	if (strcmp(setting, "z.reverb") == 0)
+	switch (setting)
 	{
-		fluid_synth_set_reverb(FluidSynth, fluidConfig.fluid_reverb_roomsize, fluidConfig.fluid_reverb_damping, fluidConfig.fluid_reverb_width, fluidConfig.fluid_reverb_level);
-	}
-	else if (strcmp(setting, "z.chorus") == 0)
-	{
-		fluid_synth_set_chorus(FluidSynth, fluidConfig.fluid_chorus_voices, fluidConfig.fluid_chorus_level, fluidConfig.fluid_chorus_speed, fluidConfig.fluid_chorus_depth, fluidConfig.fluid_chorus_type);
-	}
-	else if (FluidSettingsResultFailed == fluid_settings_setnum(FluidSettings, setting, value))
-	{
-		ZMusic_Printf(ZMUSIC_MSG_ERROR, "Failed to set %s to %g.\n", setting, value);
-	}
+	case SETTING_FLUID_INTERPOLATION:
+		if (FLUID_OK != fluid_synth_set_interp_method(FluidSynth, -1, value))
+		{
+			ZMusic_Printf(ZMUSIC_MSG_ERROR, "Setting interpolation method %d failed.\n", value);
+		}
+		break;
 
+	case SETTING_FLUID_POLYPHONY:
+		if (FLUID_OK != fluid_synth_set_polyphony(FluidSynth, value))
+		{
+			ZMusic_Printf(ZMUSIC_MSG_ERROR, "Setting polyphony to %d failed.\n", value);
+		}
+		break;
+
+	case SETTING_FLUID_REVERB_ACTIVE:
+		fluid_synth_set_reverb_on(FluidSynth, value);
+		break;
+
+	case SETTING_FLUID_CHORUS_ACTIVE:
+		fluid_synth_set_chorus_on(FluidSynth, value);
+		break;
+
+	default:
+		break;
+	}
 }
 
 //==========================================================================
 //
-// FluidSynthMIDIDevice :: ChangeSettingString
+// FluidSynthMIDIDevice :: ChangeSettingNum
 //
-// Changes a string setting.
+// Changes a numeric setting.
 //
 //==========================================================================
 
-void FluidSynthMIDIDevice::ChangeSettingString(const char *setting, const char *value)
+void FluidSynthMIDIDevice::ChangeSettingNum(ESongSetting setting, double value)
 {
-	if (FluidSynth == nullptr || FluidSettings == nullptr || strncmp(setting, "fluidsynth.", 11))
+	if (FluidSynth == nullptr)
 	{
 		return;
 	}
-	setting += 11;
 
-	if (FluidSettingsResultFailed == fluid_settings_setstr(FluidSettings, setting, value))
+	switch (setting)
 	{
-		ZMusic_Printf(ZMUSIC_MSG_ERROR, "Failed to set %s to %s.\n", setting, value);
+	case SETTING_FLUID_GAIN:
+		fluid_synth_set_gain(FluidSynth, (float)value);
+		break;
+
+	case SETTING_FLUID_REVERB:
+		fluid_synth_set_reverb(FluidSynth, fluidConfig.fluid_reverb_roomsize, fluidConfig.fluid_reverb_damping, fluidConfig.fluid_reverb_width, fluidConfig.fluid_reverb_level);
+		break;
+
+	case SETTING_FLUID_CHORUS:
+		fluid_synth_set_chorus(FluidSynth, fluidConfig.fluid_chorus_voices, fluidConfig.fluid_chorus_level, fluidConfig.fluid_chorus_speed, fluidConfig.fluid_chorus_depth, fluidConfig.fluid_chorus_type);
+		break;
+
+	default:
+		break;
 	}
 }
 
@@ -402,9 +927,9 @@ std::string FluidSynthMIDIDevice::GetStats()
 	fluid_settings_getint(FluidSettings, "synth.reverb.active", &reverb);
 	fluid_settings_getint(FluidSettings, "synth.polyphony", &maxpoly);
 
-	char out[100];
-	snprintf(out, 100,"Voices: %3d/%3d(%3d) %6.2f%% CPU   Reverb: %3s Chorus: %3s",
-		voices, polyphony, maxpoly, load, reverb ? "yes" : "no", chorus ? "yes" : "no");
+	char out[120];
+	snprintf(out, 120,"Voices: %3d/%3d(%3d) %6.2f%% CPU   Reverb: %3s Chorus: %3s   Quality: -%d",
+		voices, polyphony, maxpoly, load, reverb ? "yes" : "no", chorus ? "yes" : "no", QualityLevel);
 	return out;
 }
 
@@ -515,10 +1040,153 @@ void Fluid_SetupConfig(const char* patches, std::vector<std::string> &patch_path
 //
 //==========================================================================
 
-MIDIDevice *CreateFluidSynthMIDIDevice(int samplerate, const char *Args)
+MIDIDevice *CreateFluidSynthMIDIDevice(int samplerate, const char *Args, bool channeloutputs)
 {
 	std::vector<std::string> fluid_patchset;
 
 	Fluid_SetupConfig(Args, fluid_patchset, true);
-	return new FluidSynthMIDIDevice(samplerate, fluid_patchset);
+	return new FluidSynthMIDIDevice(samplerate, fluid_patchset, channeloutputs);
+}
+
+//==========================================================================
+//
+// Shared effects bus
+//
+// Runs the summed effect sends of several FluidSynth devices through one
+// reverb and chorus. It uses a synth of its own that never plays a voice
+// and is set up like the devices, so the effects sound the same. The
+// effects work on whole 64 sample blocks, so the wet signal lags the dry
+// one by one block.
+//
+//==========================================================================
+
+class FluidEffectsBus
+{
+public:
+	FluidEffectsBus(int samplerate);
+	~FluidEffectsBus();
+	void Process(const float *reverb, const float *chorus, float *out, int frames);
+
+private:
+	void UpdateSettings();
+
+	fluid_settings_t *Settings = nullptr;
+	fluid_synth_t *Synth = nullptr;
+	float InReverb[64] = {}, InChorus[64] = {};
+	float OutLeft[64] = {}, OutRight[64] = {};
+	int Pos = 0;
+	FluidConfig Current;
+};
+
+FluidEffectsBus::FluidEffectsBus(int samplerate)
+{
+	Settings = new_fluid_settings();
+	if (Settings == nullptr) throw std::runtime_error("Failed to create FluidSettings.\n");
+	fluid_settings_setnum(Settings, "synth.sample-rate", samplerate);
+	fluid_settings_setint(Settings, "synth.polyphony", 1);
+	fluid_settings_setint(Settings, "synth.reverb.active", fluidConfig.fluid_reverb);
+	fluid_settings_setint(Settings, "synth.chorus.active", fluidConfig.fluid_chorus);
+	Synth = new_fluid_synth(Settings);
+	if (Synth == nullptr)
+	{
+		delete_fluid_settings(Settings);
+		throw std::runtime_error("Failed to create FluidSynth.\n");
+	}
+	Current.fluid_reverb = -1;	// force an update
+	UpdateSettings();
+}
+
+FluidEffectsBus::~FluidEffectsBus()
+{
+	delete_fluid_synth(Synth);
+	delete_fluid_settings(Settings);
+}
+
+//==========================================================================
+//
+// FluidEffectsBus :: UpdateSettings
+//
+// The devices pick up changes through ChangeSettingNum/Int. The bus is not
+// part of any song, so it follows the configuration on its own.
+//
+//==========================================================================
+
+void FluidEffectsBus::UpdateSettings()
+{
+	auto &c = fluidConfig;
+	if (c.fluid_reverb != Current.fluid_reverb || c.fluid_chorus != Current.fluid_chorus)
+	{
+		fluid_synth_reverb_on(Synth, -1, c.fluid_reverb);
+		fluid_synth_chorus_on(Synth, -1, c.fluid_chorus);
+	}
+	if (c.fluid_reverb != Current.fluid_reverb || c.fluid_reverb_roomsize != Current.fluid_reverb_roomsize ||
+		c.fluid_reverb_damping != Current.fluid_reverb_damping || c.fluid_reverb_width != Current.fluid_reverb_width ||
+		c.fluid_reverb_level != Current.fluid_reverb_level)
+	{
+		fluid_synth_set_reverb_group_roomsize(Synth, -1, c.fluid_reverb_roomsize);
+		fluid_synth_set_reverb_group_damp(Synth, -1, c.fluid_reverb_damping);
+		fluid_synth_set_reverb_group_width(Synth, -1, c.fluid_reverb_width);
+		fluid_synth_set_reverb_group_level(Synth, -1, c.fluid_reverb_level);
+	}
+	if (c.fluid_reverb != Current.fluid_reverb || c.fluid_chorus_voices != Current.fluid_chorus_voices ||
+		c.fluid_chorus_level != Current.fluid_chorus_level || c.fluid_chorus_speed != Current.fluid_chorus_speed ||
+		c.fluid_chorus_depth != Current.fluid_chorus_depth || c.fluid_chorus_type != Current.fluid_chorus_type)
+	{
+		fluid_synth_set_chorus_group_nr(Synth, -1, c.fluid_chorus_voices);
+		fluid_synth_set_chorus_group_level(Synth, -1, c.fluid_chorus_level);
+		fluid_synth_set_chorus_group_speed(Synth, -1, c.fluid_chorus_speed);
+		fluid_synth_set_chorus_group_depth(Synth, -1, c.fluid_chorus_depth);
+		fluid_synth_set_chorus_group_type(Synth, -1, c.fluid_chorus_type);
+	}
+	Current = c;
+}
+
+//==========================================================================
+//
+// FluidEffectsBus :: Process
+//
+// Mixes the effects output into interleaved stereo 'out'.
+//
+//==========================================================================
+
+void FluidEffectsBus::Process(const float *reverb, const float *chorus, float *out, int frames)
+{
+	UpdateSettings();
+	for (int i = 0; i < frames; i++)
+	{
+		InReverb[Pos] = reverb[i];
+		InChorus[Pos] = chorus[i];
+		out[i * 2] += OutLeft[Pos];
+		out[i * 2 + 1] += OutRight[Pos];
+		if (++Pos == 64)
+		{
+			memset(OutLeft, 0, sizeof(OutLeft));
+			memset(OutRight, 0, sizeof(OutRight));
+			fluid_synth_process_fx(Synth, 64, InReverb, InChorus, OutLeft, OutRight);
+			Pos = 0;
+		}
+	}
+}
+
+FluidEffectsBus *Fluid_CreateEffectsBus(int samplerate)
+{
+	try
+	{
+		return new FluidEffectsBus(samplerate);
+	}
+	catch (const std::exception &ex)
+	{
+		ZMusic_Printf(ZMUSIC_MSG_ERROR, "%s", ex.what());
+		return nullptr;
+	}
+}
+
+void Fluid_DestroyEffectsBus(FluidEffectsBus *bus)
+{
+	delete bus;
+}
+
+void Fluid_ProcessEffectsBus(FluidEffectsBus *bus, const float *reverb, const float *chorus, float *out, int frames)
+{
+	bus->Process(reverb, chorus, out, frames);
 }
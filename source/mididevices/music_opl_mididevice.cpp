@@ -39,6 +39,7 @@
 #include "zmusic/zmusic_internal.h"
 #include "mididevice.h"
 #include "zmusic/mus2midi.h"
+#include "zmusic/profile.h"
 
 #ifdef HAVE_OPL
 #include "oplsynth/opl.h"
@@ -56,8 +57,6 @@
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
-OPLConfig oplConfig;
-
 // OPL implementation of a MIDI output device -------------------------------
 
 class OPLMIDIDevice : public SoftSynthMIDIDevice, protected OPLmusicBlock
@@ -73,6 +72,7 @@ protected:
 	void CalcTickRate() override;
 	int PlayTick() override;
 	void HandleEvent(int status, int parm1, int parm2) override;
+	void HandleEvents(const MidiShortEvent *events, int count) override;
 	void HandleLongEvent(const uint8_t *data, int len) override;
 	void ComputeOutput(float *buffer, int len) override;
 	bool ServiceStream(void *buff, int numbytes) override;
@@ -91,7 +91,7 @@ protected:
 //==========================================================================
 
 OPLMIDIDevice::OPLMIDIDevice(int core)
-	: SoftSynthMIDIDevice((int)OPL_SAMPLE_RATE), OPLmusicBlock(core, oplConfig.numchips)
+	: SoftSynthMIDIDevice((int)OPL_SAMPLE_RATE), OPLmusicBlock(core, oplConfig.numchips, oplConfig.threads)
 {
 	FullPan = oplConfig.fullpan;
 	memcpy(OPLinstruments, oplConfig.OPLinstruments, sizeof(OPLinstruments));
@@ -254,6 +254,20 @@ void OPLMIDIDevice::HandleEvent(int status, int parm1, int parm2)
 	}
 }
 
+//==========================================================================
+//
+// OPLMIDIDevice :: HandleEvents
+//
+//==========================================================================
+
+void OPLMIDIDevice::HandleEvents(const MidiShortEvent *events, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		OPLMIDIDevice::HandleEvent(events[i].Status, events[i].Parm1, events[i].Parm2);
+	}
+}
+
 //==========================================================================
 //
 // OPLMIDIDevice :: HandleLongEvent
@@ -274,6 +288,7 @@ void OPLMIDIDevice::HandleLongEvent(const uint8_t *data, int len)
 
 void OPLMIDIDevice::ComputeOutput(float *buffer, int len)
 {
+	ZMUSIC_PROFILE_ZONE("ComputeOutput");
 }
 
 //==========================================================================
@@ -284,7 +299,9 @@ void OPLMIDIDevice::ComputeOutput(float *buffer, int len)
 
 bool OPLMIDIDevice::ServiceStream(void *buff, int numbytes)
 {
-	return OPLmusicBlock::ServiceStream(buff, numbytes);
+	bool res = OPLmusicBlock::ServiceStream(buff, numbytes);
+	ApplyGain((float *)buff, numbytes / sizeof(float));
+	return res;
 }
 
 //==========================================================================
@@ -37,15 +37,20 @@
 #include <stdexcept>
 #include "mididevice.h"
 #include "zmusic/zmusic_internal.h"
+#include "zmusic/parallel.h"
+#include "zmusic/profile.h"
+#include "zmusic/emulatorselect.h"
 
 #ifdef HAVE_OPN
 #include "opnmidi.h"
-
-OpnConfig opnConfig;
+#include <miniz.h>
 
 class OPNMIDIDevice : public SoftSynthMIDIDevice
 {
 	struct OPN2_MIDIPlayer *Renderer;
+	FWorkerGroup ChipThreads;
+	std::vector<int> AutoEmulators;	// what the "auto" emulator picks from, the most accurate first.
+	int AutoEmulator = -1;			// the one it picked, each quality level goes one further.
 public:
 	OPNMIDIDevice(const OpnConfig *config);
 	~OPNMIDIDevice();
@@ -56,11 +61,14 @@ public:
 	
 protected:
 	void HandleEvent(int status, int parm1, int parm2) override;
+	void HandleEvents(const MidiShortEvent *events, int count) override;
 	void HandleLongEvent(const uint8_t *data, int len) override;
 	void ComputeOutput(float *buffer, int len) override;
+	void SetQualityLevel(int level) override;
 	
 private:
 	int LoadCustomBank(const OpnConfig *config);
+	void SelectEmulator(const OpnConfig *config);
 };
 
 
@@ -78,30 +86,67 @@ enum
 
 //==========================================================================
 //
-// OPNMIDIDevice Constructor
+// Lets libOPNMIDI render its chips on the device's worker threads.
+//
+//==========================================================================
+
+static void RunChipJobs(void *context, size_t count, void (*job)(void *, size_t), void *jobcontext)
+{
+	auto work = [=](size_t i) { job(jobcontext, i); };
+	static_cast<FWorkerGroup *>(context)->Run(count, work);
+}
+
+//==========================================================================
+//
+// The embedded bank is only inflated while a device loads it.
+// libOPNMIDI converts it into its own instruments and caches those.
 //
 //==========================================================================
 #include "data/xg.h"
 
+static int LoadDefaultBank(OPN2_MIDIPlayer *renderer)
+{
+	std::vector<uint8_t> bank(xg_default_size);
+	mz_ulong length = xg_default_size;
+	if (mz_uncompress(bank.data(), &length, xg_default_z, sizeof(xg_default_z)) != MZ_OK) return -1;
+	return opn2_openBankData(renderer, bank.data(), (long)length);
+}
+
+//==========================================================================
+//
+// OPNMIDIDevice Constructor
+//
+//==========================================================================
+
 OPNMIDIDevice::OPNMIDIDevice(const OpnConfig *config)
 	:SoftSynthMIDIDevice(44100)
 {
 	Renderer = opn2_init(44100);	// todo: make it configurable
+	MinRenderBlock = 64;
 	if (Renderer != nullptr)
 	{
 		if (!LoadCustomBank(config))
 		{
 			if(config->default_bank.size() == 0)
 			{
-				opn2_openBankData(Renderer, xg_default, sizeof(xg_default));
+				LoadDefaultBank(Renderer);
 			}
 			else opn2_openBankData(Renderer, config->default_bank.data(), (long)config->default_bank.size());
 		}
 
-		opn2_switchEmulator(Renderer, (int)config->opn_emulator_id);
+		if (config->opn_emulator_id != EMULATOR_AUTO) opn2_switchEmulator(Renderer, (int)config->opn_emulator_id);
 		opn2_setRunAtPcmRate(Renderer, (int)config->opn_run_at_pcm_rate);
 		opn2_setNumChips(Renderer, config->opn_chips_count);
 		opn2_setSoftPanEnabled(Renderer, (int)config->opn_fullpan);
+
+		int threads = config->opn_threads;
+		if (threads <= 0) threads = (int)ZMusic_JobThreads();
+		if (threads > opn2_getNumChips(Renderer)) threads = opn2_getNumChips(Renderer);
+		if (threads > 1 && ChipThreads.Start(threads) > 1)
+		{
+			opn2_setParallelFor(Renderer, RunChipJobs, &ChipThreads);
+		}
+		if (config->opn_emulator_id == EMULATOR_AUTO) SelectEmulator(config);
 	}
 	else
 	{
@@ -109,6 +154,53 @@ OPNMIDIDevice::OPNMIDIDevice(const OpnConfig *config)
 	}
 }
 
+//==========================================================================
+//
+// OPNMIDIDevice :: SelectEmulator
+//
+// For the "auto" emulator, which only picks from the YM2612 ones, since the
+// OPNA cores emulate a different chip. The governor can step down to the
+// faster ones while playing if zmusic_snd_midicpubudget is set.
+//
+//==========================================================================
+
+void OPNMIDIDevice::SelectEmulator(const OpnConfig *config)
+{
+	static const int emulators[] = { OPNMIDI_EMU_NUKED, OPNMIDI_EMU_GX, OPNMIDI_EMU_MAME, OPNMIDI_EMU_GENS };
+	for (int emu : emulators)
+	{
+		// Not every build has all of them.
+		if (opn2_switchEmulator(Renderer, emu) == 0) AutoEmulators.push_back(emu);
+	}
+	if (AutoEmulators.empty()) return;
+
+	std::string key = "opn/" + std::to_string(opn2_getNumChips(Renderer)) + "/" + std::to_string(ChipThreads.Size()) + "/" +
+		std::to_string(config->opn_run_at_pcm_rate);
+	AutoEmulator = ZMusic_SelectEmulator(key, (int)AutoEmulators.size(), [=](int i)
+	{
+		opn2_switchEmulator(Renderer, AutoEmulators[i]);
+		return MeasureRenderTime();
+	});
+	opn2_switchEmulator(Renderer, AutoEmulators[AutoEmulator]);
+	MaxQualityLevel = (int)AutoEmulators.size() - 1 - AutoEmulator;
+}
+
+//==========================================================================
+//
+// OPNMIDIDevice :: SetQualityLevel
+//
+// Switching the emulator resets the chips, which cuts off the notes that
+// are playing.
+//
+//==========================================================================
+
+void OPNMIDIDevice::SetQualityLevel(int level)
+{
+	if (AutoEmulator < 0) return;
+	opn2_switchEmulator(Renderer, AutoEmulators[AutoEmulator + level]);
+	RestoreChannels();
+}
+
 //==========================================================================
 //
 // OPNMIDIDevice Destructor
@@ -136,6 +228,7 @@ OPNMIDIDevice::~OPNMIDIDevice()
 
 int OPNMIDIDevice::LoadCustomBank(const OpnConfig *config)
 {
+	ZMUSIC_PROFILE_ZONE("LoadInstruments");
 	const char *bankfile = config->opn_custom_bank.c_str();
 	if(!config->opn_use_custom_bank)
 		return 0;
@@ -201,6 +294,20 @@ void OPNMIDIDevice::HandleEvent(int status, int parm1, int parm2)
 	}
 }
 
+//==========================================================================
+//
+// OPNMIDIDevice :: HandleEvents
+//
+//==========================================================================
+
+void OPNMIDIDevice::HandleEvents(const MidiShortEvent *events, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		OPNMIDIDevice::HandleEvent(events[i].Status, events[i].Parm1, events[i].Parm2);
+	}
+}
+
 //==========================================================================
 //
 // OPNMIDIDevice :: HandleLongEvent
@@ -227,6 +334,7 @@ static const OPNMIDI_AudioFormat audio_output_format =
 
 void OPNMIDIDevice::ComputeOutput(float *buffer, int len)
 {
+	ZMUSIC_PROFILE_ZONE("ComputeOutput");
 	OPN2_UInt8* left = reinterpret_cast<OPN2_UInt8*>(buffer);
 	OPN2_UInt8* right = reinterpret_cast<OPN2_UInt8*>(buffer + 1);
 	opn2_generateFormat(Renderer, len * 2, left, right, &audio_output_format);
@@ -37,7 +37,13 @@
 #include <mutex>
 #include <algorithm>
 #include <assert.h>
+#include <string.h>
+#include <chrono>
 #include "mididevice.h"
+#include "midichasestate.h"
+#include "midiloopcache.h"
+#include "zmusic/mus2midi.h"
+#include "zmusic/profile.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -69,10 +75,12 @@ SoftSynthMIDIDevice::SoftSynthMIDIDevice(int samplerate, int minrate, int maxrat
 {
 	Tempo = 0;
 	Division = 0;
-	Events = NULL;
+	Events = EventsTail = NULL;
 	Started = false;
 	SampleRate = samplerate;
 	if (SampleRate < minrate || SampleRate > maxrate) SampleRate = 44100;
+	OutputRate = SampleRate;
+	ResetTracking();
 }
 
 //==========================================================================
@@ -94,12 +102,12 @@ SoftSynthMIDIDevice::~SoftSynthMIDIDevice()
 
 SoundStreamInfoEx SoftSynthMIDIDevice::GetStreamInfoEx() const
 {
-	int chunksize = (SampleRate / StreamBlockSize) * 4;
+	int chunksize = (OutputRate / StreamBlockSize) * 4;
 	if (!isMono)
 	{
 		chunksize *= 2;
 	}
-	return { chunksize, SampleRate, SampleType_Float32,
+	return { chunksize, OutputRate, SampleType_Float32,
 		isMono ? ChannelConfig_Mono : ChannelConfig_Stereo };
 }
 
@@ -244,16 +252,14 @@ int SoftSynthMIDIDevice::StreamOut(MidiHeader *header)
 	{
 		Events = header;
 		NextTickIn = SamplesPerTick * *(uint32_t *)header->lpData;
+		Meter.Tick += *(uint32_t *)header->lpData;
 		Position = 0;
 	}
 	else
 	{
-		MidiHeader **p;
-
-		for (p = &Events; *p != NULL; p = &(*p)->lpNext)
-		{ }
-		*p = header;
+		EventsTail->lpNext = header;
 	}
+	EventsTail = header;
 	return 0;
 }
 
@@ -280,25 +286,41 @@ bool SoftSynthMIDIDevice::Pause(bool paused)
 
 int SoftSynthMIDIDevice::PlayTick()
 {
+	ZMUSIC_PROFILE_ZONE("PlayTick");
 	uint32_t delay = 0;
+	const bool synth = !Virtual && (LoopCache == nullptr || !LoopCache->IsReplaying());
 
 	while (delay == 0 && Events != NULL)
 	{
 		uint32_t *event = (uint32_t *)(Events->lpData + Position);
+		EventsPlayed++;
 		if (MEVENT_EVENTTYPE(event[2]) == MEVENT_TEMPO)
 		{
-			SetTempo(MEVENT_EVENTPARM(event[2]));
+			// Only the tick rate depends on it, so the collected events can wait.
+			Tempo = MEVENT_EVENTPARM(event[2]);
+			CalcTickRate();
 		}
 		else if (MEVENT_EVENTTYPE(event[2]) == MEVENT_LONGMSG)
 		{
-			HandleLongEvent((uint8_t *)&event[3], MEVENT_EVENTPARM(event[2]));
+			if (synth)
+			{
+				FlushEvents();
+				HandleLongEvent((uint8_t *)&event[3], MEVENT_EVENTPARM(event[2]));
+			}
+			if (PlayedState != nullptr) PlayedState->AddEvent(event);
 		}
 		else if (MEVENT_EVENTTYPE(event[2]) == 0)
 		{ // Short MIDI event
 			int status = event[2] & 0xff;
 			int parm1 = (event[2] >> 8) & 0x7f;
 			int parm2 = (event[2] >> 16) & 0x7f;
-			HandleEvent(status, parm1, parm2);
+			if (synth)
+			{
+				if (BatchCount == MAX_MIDI_EVENTS) FlushEvents();
+				Batch[BatchCount++] = { TickOffset, uint8_t(status), uint8_t(parm1), uint8_t(parm2) };
+			}
+			TrackEvent(status, parm1, parm2);
+			if (PlayedState != nullptr) PlayedState->AddEvent(event);
 
 #if 0
 			if (synth_watch)
@@ -324,6 +346,16 @@ int SoftSynthMIDIDevice::PlayTick()
 			}
 #endif
 		}
+		else if (event[2] == ((MEVENT_NOP << 24) | MARKER_RESTART))
+		{
+			// The state going into the restart, before the stop notes and controller resets that come with it.
+			if (LoopCache != nullptr && !Virtual) LoopCache->AddSeam(SynthFrames + TickOffset, *PlayedState, HeldNotes);
+			Meter.Reset();
+		}
+		else if (MEVENT_EVENTTYPE(event[2]) == MEVENT_NOP)
+		{
+			Meter.AddEvent(event, Division);
+		}
 
 		// Advance to next event.
 		if (event[2] < 0x80000000)
@@ -350,27 +382,369 @@ int SoftSynthMIDIDevice::PlayTick()
 		if (Events == NULL)
 		{ // No more events. Just return something to keep the song playing
 		  // while we wait for more to be submitted.
+			FlushEvents();
 			return int(Division);
 		}
 
 		delay = *(uint32_t *)(Events->lpData + Position);
+		Meter.Tick += delay;
 	}
+	FlushEvents();
 	return delay;
 }
 
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: HandleEvents
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::HandleEvents(const MidiShortEvent *events, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		HandleEvent(events[i].Status, events[i].Parm1, events[i].Parm2);
+	}
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: QueueLiveEvent
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::QueueLiveEvent(uint32_t offset, const uint32_t *event, int words)
+{
+	if (IsResampling()) offset = uint32_t(uint64_t(offset) * SampleRate / OutputRate);
+	LiveEvent ev = { offset, uint32_t(LiveData.size()) };
+	LiveData.insert(LiveData.end(), event, event + words);
+	auto pos = std::upper_bound(LiveEvents.begin(), LiveEvents.end(), offset,
+		[](uint32_t offset, const LiveEvent &ev) { return offset < ev.Offset; });
+	LiveEvents.insert(pos, ev);
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: PlayLiveEvent
+//
+// Like PlayTick does with the events of the song.
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::PlayLiveEvent(const uint32_t *event)
+{
+	DropLoopCache();
+	EventsPlayed++;
+	if (MEVENT_EVENTTYPE(event[2]) != MEVENT_LONGMSG)
+	{
+		TrackEvent(event[2] & 0xff, (event[2] >> 8) & 0x7f, (event[2] >> 16) & 0x7f);
+	}
+	if (!Virtual)
+	{
+		if (MEVENT_EVENTTYPE(event[2]) == MEVENT_LONGMSG)
+		{
+			HandleLongEvent((const uint8_t *)&event[3], MEVENT_EVENTPARM(event[2]));
+		}
+		else
+		{
+			HandleEvent(event[2] & 0xff, (event[2] >> 8) & 0x7f, (event[2] >> 16) & 0x7f);
+		}
+	}
+	if (PlayedState != nullptr) PlayedState->AddEvent(event);
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: TrackEvent
+//
+// Follows what the song's own channels play, for GetChannelActivity.
+// Notes end with their note off, sustained or not.
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::TrackEvent(int status, int parm1, int parm2)
+{
+	int chan = status & 15;
+	switch (status & 0xF0)
+	{
+	case MIDI_NOTEON:
+		HeldNotes[chan][parm1] = uint8_t(parm2);
+		break;
+
+	case MIDI_NOTEOFF:
+		HeldNotes[chan][parm1] = 0;
+		break;
+
+	case MIDI_PRGMCHANGE:
+		ChannelPrograms[chan] = uint8_t(parm1);
+		break;
+
+	case MIDI_CTRLCHANGE:
+		if (parm1 == 7) ChannelVolumes[chan] = uint8_t(parm2);
+		else if (parm1 == 11) ChannelExpressions[chan] = uint8_t(parm2);
+		else if (parm1 == 121) ChannelExpressions[chan] = 127;	// reset all controllers
+		else if (parm1 == 120 || parm1 == 123) memset(HeldNotes[chan], 0, sizeof(HeldNotes[chan]));	// all sound off, all notes off
+		break;
+	}
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: ResetTracking
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::ResetTracking()
+{
+	memset(HeldNotes, 0, sizeof(HeldNotes));
+	memset(ChannelPrograms, 0, sizeof(ChannelPrograms));
+	memset(ChannelVolumes, 100, sizeof(ChannelVolumes));
+	memset(ChannelExpressions, 127, sizeof(ChannelExpressions));
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: GetChannelActivity
+//
+// The level follows the General MIDI recommendation of 40 log10(x / 127)
+// dB for velocity, volume and expression alike, which makes each of them
+// a square.
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::GetChannelActivity(int *voices, float *levels)
+{
+	for (int chan = 0; chan < 16; chan++)
+	{
+		int count = 0, velocity = 0;
+		for (int note = 0; note < 128; note++)
+		{
+			int vel = HeldNotes[chan][note];
+			if (vel > 0)
+			{
+				count++;
+				velocity = std::max(velocity, vel);
+			}
+		}
+		float level = velocity * ChannelVolumes[chan] * ChannelExpressions[chan] / (127.f * 127.f * 127.f);
+		voices[chan] = count;
+		levels[chan] = level * level;
+	}
+}
+
 //==========================================================================
 //
 // SoftSynthMIDIDevice :: ServiceStream
 //
+// With live events the buffer gets split up at every frame one is due at.
+//
 //==========================================================================
 
 bool SoftSynthMIDIDevice::ServiceStream (void *buff, int numbytes)
+{
+	if (LiveEvents.empty()) return RenderLayers(buff, numbytes);
+
+	const int framebytes = (isMono ? 1 : 2) * sizeof(float);
+	const uint32_t frames = numbytes / framebytes;
+	uint32_t pos = 0;
+	size_t next = 0;
+	bool res = true;
+	while (pos < frames)
+	{
+		for (; next < LiveEvents.size() && LiveEvents[next].Offset <= pos; next++)
+		{
+			PlayLiveEvent(&LiveData[LiveEvents[next].Start]);
+		}
+		uint32_t end = next < LiveEvents.size() ? std::min(LiveEvents[next].Offset, frames) : frames;
+		if (!RenderLayers((uint8_t *)buff + pos * framebytes, (end - pos) * framebytes)) res = false;
+		pos = end;
+	}
+	LiveEvents.erase(LiveEvents.begin(), LiveEvents.begin() + next);
+	for (auto &ev : LiveEvents) ev.Offset -= frames;
+	if (LiveEvents.empty()) LiveData.clear();
+	return res;
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: RenderLayers
+//
+// With layers the buffer gets rendered in blocks, with the events the
+// layers have due within a block sent before it.
+//
+//==========================================================================
+
+bool SoftSynthMIDIDevice::RenderLayers (void *buff, int numbytes)
+{
+	if (Layers.empty()) return RenderEvents(buff, numbytes);
+
+	const int framebytes = (isMono ? 1 : 2) * sizeof(float);
+	const int blockbytes = MIDILayerDevice::BLOCK * framebytes;
+	bool res = true;
+	for (int pos = 0; pos < numbytes; pos += blockbytes)
+	{
+		int bytes = std::min(blockbytes, numbytes - pos);
+		for (auto layer : Layers) layer->Advance(bytes / framebytes);
+		if (!RenderEvents((uint8_t *)buff + pos, bytes)) res = false;
+	}
+	return res;
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: SetOutputRate
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::SetOutputRate(int rate)
+{
+	OutputRate = rate;
+	if (IsResampling())
+	{
+		int quality = miscConfig.snd_resamplequality > 0 ? miscConfig.snd_resamplequality : RESAMPLE_BEST;
+		Resampler.Setup(SampleRate, OutputRate, isMono ? 1 : 2, quality);
+	}
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: Render
+//
+// Fills numbytes of the stream at the output rate. The synth renders as
+// many frames at its own rate as the resampler needs for them, so that the
+// events keep their timing in the synth's frames.
+//
+//==========================================================================
+
+bool SoftSynthMIDIDevice::Render(void *buff, int numbytes)
+{
+	if (!IsResampling()) return ServiceStream(buff, numbytes);
+
+	const int channels = isMono ? 1 : 2;
+	size_t outframes = numbytes / (sizeof(float) * channels);
+	size_t inframes = Resampler.InputNeeded(outframes);
+	RenderBuffer.resize(inframes * channels);
+	bool res = true;
+	if (inframes > 0) res = ServiceStream(RenderBuffer.data(), int(inframes * channels * sizeof(float)));
+	Resampler.Process(RenderBuffer.data(), (float *)buff, outframes);
+	return res;
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: SetVirtual
+//
+//==========================================================================
+
+bool SoftSynthMIDIDevice::SetVirtual(bool on)
+{
+	if (on == Virtual) return true;
+	if (PlayedState == nullptr || !Layers.empty()) return false;
+	DropLoopCache();
+	if (on)
+	{
+		FlushEvents();
+	}
+	else
+	{
+		// Also silences the voices that were left hanging when the synth stopped.
+		PlayedState->Apply(this);
+	}
+	Virtual = on;
+	return true;
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: SetLoopCache
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::SetLoopCache(size_t maxframes)
+{
+	DropLoopCache();
+	if (maxframes > 0 && PlayedState != nullptr) LoopCache.reset(new MIDILoopCache(isMono ? 1 : 2, maxframes));
+	else LoopCache.reset();
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: DropLoopCache
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::DropLoopCache()
+{
+	if (LoopCache == nullptr) return;
+	if (LoopCache->IsReplaying() && !Virtual)
+	{
+		// The synth got none of the events since the replay started. Like coming
+		// back from being virtual, this also silences what it had left hanging.
+		PlayedState->Apply(this);
+	}
+	LoopCache->Reset();
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: Synthesize
+//
+// With a loop cache the block gets split at every seam, and is either
+// synthesized and captured or filled from the kept pass.
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::Synthesize(float *buffer, int len)
+{
+	if (LoopCache != nullptr && !Virtual && Layers.empty())
+	{
+		const int channels = isMono ? 1 : 2;
+		while (len > 0)
+		{
+			const bool replaying = LoopCache->IsReplaying();
+			int count = LoopCache->Advance(SynthFrames, len);
+			if (replaying && !LoopCache->IsReplaying())
+			{
+				PlayedState->Apply(this);	// the pass did not start as the kept one did.
+			}
+			if (LoopCache->IsReplaying())
+			{
+				LoopCache->Replay(buffer, count);
+			}
+			else
+			{
+				ComputeOutput(buffer, count);
+				LoopCache->Capture(buffer, count);
+			}
+			buffer += count * channels;
+			len -= count;
+			SynthFrames += count;
+		}
+		return;
+	}
+	// The layers' events go to the same synth, and would be missing from a replay.
+	if (!Layers.empty()) DropLoopCache();
+	if (!Virtual) ComputeOutput(buffer, len);
+	SynthFrames += len;
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: RenderEvents
+//
+//==========================================================================
+
+bool SoftSynthMIDIDevice::RenderEvents (void *buff, int numbytes)
 {
 	float *samples = (float *)buff;
 	float *samples1;
-	int numsamples = numbytes / sizeof(float) / 2;
+	const int channels = isMono ? 1 : 2;
+	int numsamples = numbytes / sizeof(float) / channels;
 	bool res = true;
 
+	const bool govern = MaxQualityLevel > 0 && miscConfig.snd_midicpubudget > 0;
+	const auto start = govern ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
 	samples1 = samples;
 	memset(buff, 0, numbytes);
 
@@ -380,14 +754,48 @@ bool SoftSynthMIDIDevice::ServiceStream (void *buff, int numbytes)
 		int tick_in = int(NextTickIn);
 		int samplesleft = std::min(numsamples, tick_in);
 
+		if (MinRenderBlock > 0 && samplesleft < MinRenderBlock && samplesleft < numsamples)
+		{
+			// Send everything that is due within the next block right away and render
+			// the block in one go instead of splitting it at every tick.
+			int block = std::min(numsamples, MinRenderBlock);
+			bool done = false;
+			while (NextTickIn < block && Events != NULL)
+			{
+				TickOffset = uint32_t(std::max(NextTickIn, 0.));
+				int next = PlayTick();
+				if (next == 0)
+				{
+					done = true;
+					break;
+				}
+				NextTickIn += SamplesPerTick * next;
+			}
+			TickOffset = 0;
+			if (done)
+			{ // end of song
+				Synthesize(samples1, numsamples);
+				Fragments++;
+				res = false;
+				break;
+			}
+			Synthesize(samples1, block);
+			Fragments++;
+			NextTickIn -= block;
+			numsamples -= block;
+			samples1 += block * channels;
+			continue;
+		}
+
 		if (samplesleft > 0)
 		{
-			ComputeOutput(samples1, samplesleft);
+			Synthesize(samples1, samplesleft);
+			Fragments++;
 			assert(NextTickIn == ticky);
 			NextTickIn -= samplesleft;
 			assert(NextTickIn >= 0);
 			numsamples -= samplesleft;
-			samples1 += samplesleft * 2;
+			samples1 += samplesleft * channels;
 		}
 		
 		if (NextTickIn < 1)
@@ -398,7 +806,8 @@ bool SoftSynthMIDIDevice::ServiceStream (void *buff, int numbytes)
 			{ // end of song
 				if (numsamples > 0)
 				{
-					ComputeOutput(samples1, numsamples);
+					Synthesize(samples1, numsamples);
+					Fragments++;
 				}
 				res = false;
 				break;
@@ -410,6 +819,19 @@ bool SoftSynthMIDIDevice::ServiceStream (void *buff, int numbytes)
 			}
 		}
 	}
+	if (PlayOut && Events == NULL && numsamples > 0)
+	{
+		Synthesize(samples1, numsamples);
+		Fragments++;
+	}
+
+	ApplyGain(samples, numbytes / sizeof(float));
+
+	if (govern)
+	{
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		UpdateGovernor(elapsed.count(), double(numbytes / sizeof(float) / channels) / SampleRate);
+	}
 
 	if (Events == NULL)
 	{
@@ -417,3 +839,338 @@ bool SoftSynthMIDIDevice::ServiceStream (void *buff, int numbytes)
 	}
 	return res;
 }
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: UpdateGovernor
+//
+// Keeps the render time below snd_midicpubudget percent of the audio's
+// duration. The quality drops one step whenever the smoothed load goes
+// over the budget, at most every quarter second. It is only raised again
+// after the load stayed below 60% of the budget for two seconds, so that
+// it does not flip back and forth around the limit.
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::UpdateGovernor(double rendertime, double audiotime)
+{
+	if (audiotime <= 0) return;
+
+	double load = rendertime / audiotime;
+	RenderLoad = RenderLoad < 0 ? load : RenderLoad * 0.8 + load * 0.2;
+	GovernorHold -= audiotime;
+
+	double budget = miscConfig.snd_midicpubudget / 100.;
+	if (RenderLoad > budget)
+	{
+		LowLoadTime = 0;
+		if (QualityLevel < MaxQualityLevel && GovernorHold <= 0)
+		{
+			SetQualityLevel(++QualityLevel);
+			GovernorHold = 0.25;
+		}
+	}
+	else if (RenderLoad < budget * 0.6 && QualityLevel > 0)
+	{
+		LowLoadTime += audiotime;
+		if (LowLoadTime >= 2)
+		{
+			SetQualityLevel(--QualityLevel);
+			LowLoadTime = 0;
+			GovernorHold = 0.25;
+		}
+	}
+	else
+	{
+		LowLoadTime = 0;
+	}
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: MeasureRenderTime
+//
+// Holds a note on each of the first eight channels and renders a twentieth
+// of a second. The notes are silenced again, but anything else the synth
+// keeps, like a resampler's history, is for the caller to reset.
+//
+//==========================================================================
+
+double SoftSynthMIDIDevice::MeasureRenderTime()
+{
+	const int channels = isMono ? 1 : 2;
+	const int block = 512;
+	const int blocks = std::max(SampleRate / 20 / block, 1);
+	std::vector<float> buffer(block * channels);
+
+	for (int i = 0; i < 8; i++) HandleEvent(MIDI_NOTEON | i, 48 + i * 4, 100);
+	ComputeOutput(buffer.data(), block);	// so that nothing gets set up during the measurement.
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < blocks; i++) ComputeOutput(buffer.data(), block);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	for (int i = 0; i < 8; i++) HandleEvent(MIDI_CTRLCHANGE | i, 120, 0);
+
+	return elapsed.count() * SampleRate / (double(blocks) * block);
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: RestoreChannels
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::RestoreChannels()
+{
+	if (PlayedState != nullptr) PlayedState->Apply(this);
+	else ResetRenderer();
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: TakeStream
+//
+// Both devices must be open and run at the same sample rate. The event
+// buffers belong to the streamer, so only the pointers need to change
+// hands. The old device keeps rendering what is still sounding.
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::TakeStream(SoftSynthMIDIDevice *old)
+{
+	Events = old->Events;
+	EventsTail = old->EventsTail;
+	Position = old->Position;
+	// Both play at the same output rate, but one of them may render at a reduced one.
+	const double ratio = double(SampleRate) / old->SampleRate;
+	NextTickIn = old->NextTickIn * ratio;
+	Tempo = old->Tempo;
+	Division = old->Division;
+	Meter = old->Meter;
+	Started = old->Started;
+	Gain = old->Gain;
+	TargetGain = old->TargetGain;
+	GainFadeFrames = int(old->GainFadeFrames * ratio);
+	CalcTickRate();
+	LiveEvents.swap(old->LiveEvents);
+	LiveData.swap(old->LiveData);
+	for (auto &ev : LiveEvents) ev.Offset = uint32_t(ev.Offset * ratio);
+	old->ResetStream();
+	old->SetLoopCache(0);
+	old->PlayOut = true;
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: CopyStream
+//
+// The copies hold the same events as the buffers they were made from, so
+// they only need to be linked up in the same order. The channel state has
+// to be applied before this, or the notes would start with the wrong
+// instruments.
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::CopyStream(const SoftSynthMIDIDevice *other, const MidiHeader *buffers, MidiHeader *copies)
+{
+	Events = EventsTail = nullptr;
+	for (auto header = other->Events; header != nullptr; header = header->lpNext)
+	{
+		auto copy = &copies[header - buffers];
+		copy->lpNext = nullptr;
+		if (Events == nullptr) Events = copy;
+		else EventsTail->lpNext = copy;
+		EventsTail = copy;
+	}
+	Position = other->Position;
+	const double ratio = double(SampleRate) / other->SampleRate;
+	NextTickIn = other->NextTickIn * ratio;
+	Tempo = other->Tempo;
+	Division = other->Division;
+	Meter = other->Meter;
+	Started = other->Started;
+	CalcTickRate();
+	for (int chan = 0; chan < 16; chan++)
+	{
+		for (int note = 0; note < 128; note++)
+		{
+			if (other->HeldNotes[chan][note] != 0) SendEventNow(MIDI_NOTEON | chan, note, other->HeldNotes[chan][note]);
+		}
+	}
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: Recycle
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::Recycle()
+{
+	LoopCache.reset();	// first, the state recorder may be gone already.
+	ResetStream();
+	BatchCount = 0;
+	TickOffset = 0;
+	SynthFrames = 0;
+	PlayedState = nullptr;
+	PlayOut = false;
+	Virtual = false;
+	Layers.clear();
+	LiveEvents.clear();
+	LiveData.clear();
+	ResetTracking();
+	Gain = TargetGain = 1.f;
+	GainFadeFrames = 0;
+	EventsPlayed = Fragments = 0;
+	SetExternalEffects(false);
+	SetStems(0, nullptr);
+	if (QualityLevel != 0) SetQualityLevel(0);
+	QualityLevel = 0;
+	RenderLoad = -1;
+	LowLoadTime = GovernorHold = 0;
+	if (IsResampling()) Resampler.Reset();
+	ResetRenderer();
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: ResetRenderer
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::ResetRenderer()
+{
+	MIDIChaseState().Apply(this);
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: SetGain
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::SetGain(float gain, int fade_ms)
+{
+	TargetGain = gain;
+	GainFadeFrames = std::max(0, int(int64_t(fade_ms) * SampleRate / 1000));
+	if (GainFadeFrames == 0) Gain = gain;
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: ApplyGain
+//
+// Done on the finished output so that it works the same for all synths
+// and does not go through their controller handling.
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::ApplyGain(float *samples, int count)
+{
+	const int channels = isMono ? 1 : 2;
+	RampGain(samples, count / channels, channels, Gain, TargetGain, GainFadeFrames);
+}
+
+void SoftSynthMIDIDevice::RampGain(float *samples, int frames, int channels, float &gain, float target, int &fadeframes)
+{
+	int count = frames * channels;
+	if (fadeframes > 0)
+	{
+		int fadelen = std::min(fadeframes, frames);
+		float step = (target - gain) / fadeframes;
+		float g = gain;
+		for (int i = 0; i < fadelen; i++)
+		{
+			g += step;
+			for (int c = 0; c < channels; c++) samples[i * channels + c] *= g;
+		}
+		fadeframes -= fadelen;
+		gain = fadeframes == 0 ? target : g;
+		samples += fadelen * channels;
+		count -= fadelen * channels;
+	}
+	if (gain != 1.f)
+	{
+		const float g = gain;
+		for (int i = 0; i < count; i++) samples[i] *= g;
+	}
+}
+
+//==========================================================================
+//
+// SoftSynthMIDIDevice :: RemoveLayer
+//
+//==========================================================================
+
+void SoftSynthMIDIDevice::RemoveLayer(MIDILayerDevice *layer)
+{
+	Layers.erase(std::remove(Layers.begin(), Layers.end(), layer), Layers.end());
+}
+
+//==========================================================================
+//
+// MIDILayerDevice Constructor
+//
+//==========================================================================
+
+MIDILayerDevice::MIDILayerDevice(SoftSynthMIDIDevice *host, int channelbase)
+	: SoftSynthMIDIDevice(host->GetSampleRate())
+{
+	Host = host;
+	ChannelBase = channelbase;
+	Host->AddLayer(this);
+}
+
+//==========================================================================
+//
+// MIDILayerDevice Destructor
+//
+//==========================================================================
+
+MIDILayerDevice::~MIDILayerDevice()
+{
+	Host->RemoveLayer(this);
+}
+
+//==========================================================================
+//
+// MIDILayerDevice :: SetHost
+//
+// For device changes. The caller restores the layer's channel state on
+// the new host.
+//
+//==========================================================================
+
+void MIDILayerDevice::SetHost(SoftSynthMIDIDevice *host)
+{
+	Host->RemoveLayer(this);
+	Host = host;
+	Host->AddLayer(this);
+}
+
+//==========================================================================
+//
+// MIDILayerDevice :: Advance
+//
+//==========================================================================
+
+void MIDILayerDevice::Advance(int frames)
+{
+	while (Events != nullptr && NextTickIn < frames)
+	{
+		int next = PlayTick();
+		if (next == 0) return;	// end of song
+		NextTickIn += SamplesPerTick * next;
+	}
+	if (Events != nullptr) NextTickIn -= frames;
+}
+
+//==========================================================================
+//
+// MIDILayerDevice :: HandleEvent
+//
+//==========================================================================
+
+void MIDILayerDevice::HandleEvent(int status, int parm1, int parm2)
+{
+	Host->HandleChannelEvent(ChannelBase + (status & 0x0F), status & 0xF0, parm1, parm2);
+}
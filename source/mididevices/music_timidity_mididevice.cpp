@@ -34,10 +34,15 @@
 
 // HEADER FILES ------------------------------------------------------------
 
+#include <algorithm>
 #include <stdexcept>
 #include <stdlib.h>
+#include <map>
+#include <memory>
+#include <mutex>
 #include "mididevice.h"
 #include "zmusic/zmusic_internal.h"
+#include "zmusic/profile.h"
 
 #ifdef HAVE_GUS
 
@@ -60,7 +65,10 @@
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
-GUSConfig gusConfig;
+// Every loaded instrument set, by the settings it was loaded with. Devices
+// with the same settings share one set, which is released with the last of them.
+static std::mutex GUSInstrumentLock;
+static std::map<std::string, std::weak_ptr<Timidity::Instruments>> GUSInstrumentCache;
 
 //==========================================================================
 //
@@ -72,19 +80,24 @@ namespace Timidity { struct Renderer; }
 
 class TimidityMIDIDevice : public SoftSynthMIDIDevice
 {
-	void LoadInstruments();
+	std::shared_ptr<Timidity::Instruments> instruments;
 public:
-	TimidityMIDIDevice(int samplerate);
+	TimidityMIDIDevice(int samplerate, std::shared_ptr<Timidity::Instruments> instruments);
 	~TimidityMIDIDevice();
 	
 	int OpenRenderer() override;
 	void PrecacheInstruments(const uint16_t *instruments, int count) override;
+	bool CanPrecacheWhilePlaying() const override { return true; }	// notes of instruments still being loaded are skipped
 	int GetDeviceType() const override { return MDEV_GUS; }
+	int GetActiveVoices() override;
+	void GetChannelActivity(int *voices, float *levels) override;
+	void ChangeSettingNum(ESongSetting setting, double value) override;
 	
 protected:
 	Timidity::Renderer *Renderer;
 	
 	void HandleEvent(int status, int parm1, int parm2) override;
+	void HandleEvents(const MidiShortEvent *events, int count) override;
 	void HandleLongEvent(const uint8_t *data, int len) override;
 	void ComputeOutput(float *buffer, int len) override;
 };
@@ -92,70 +105,20 @@ protected:
 
 // CODE --------------------------------------------------------------------
 
-
-void TimidityMIDIDevice::LoadInstruments()
-{
-	if (gusConfig.reader)
-	{
-		// Check if we got some GUS data before using it.
-		std::string ultradir;
-		const char *ret = getenv("ULTRADIR");
-		if (ret) ultradir = std::string(ret);
-		// The GUS put its patches in %ULTRADIR%/MIDI so we can try that
-		if (ultradir.length())
-		{
-			ultradir += "/midi";
-			gusConfig.reader->add_search_path(ultradir.c_str());
-		}
-		// Load DMXGUS lump and patches from gus_patchdir
-		if (gusConfig.gus_patchdir.length() != 0) gusConfig.reader->add_search_path(gusConfig.gus_patchdir.c_str());
-		
-		gusConfig.instruments.reset(new Timidity::Instruments(gusConfig.reader));
-		gusConfig.loadedConfig = gusConfig.readerName;
-	}
-
-	if (gusConfig.instruments == nullptr)
-	{
-		throw std::runtime_error("No instruments set for GUS device");
-	}
-
-	if (gusConfig.gus_dmxgus && gusConfig.dmxgus.size())
-	{
-		bool success = gusConfig.instruments->LoadDMXGUS(gusConfig.gus_memsize, (const char*)gusConfig.dmxgus.data(), gusConfig.dmxgus.size()) >= 0;
-		gusConfig.reader = nullptr;
-
-		if (!success)
-		{
-			gusConfig.instruments.reset();
-			gusConfig.loadedConfig = "";
-			throw std::runtime_error("Unable to initialize DMXGUS for GUS MIDI device");
-		}
-	}
-	else
-	{
-		bool err = gusConfig.instruments->LoadConfig() < 0;
-		gusConfig.reader = nullptr;
-		
-		if (err)
-		{
-			gusConfig.instruments.reset();
-			gusConfig.loadedConfig = "";
-			throw std::runtime_error("Unable to initialize instruments for GUS MIDI device");
-		}
-	}
-}
-
 //==========================================================================
 //
 // TimidityMIDIDevice Constructor
 //
 //==========================================================================
 
-TimidityMIDIDevice::TimidityMIDIDevice(int samplerate)
-	: SoftSynthMIDIDevice(samplerate, 11025, 65535)
+TimidityMIDIDevice::TimidityMIDIDevice(int samplerate, std::shared_ptr<Timidity::Instruments> instr)
+	: SoftSynthMIDIDevice(samplerate, 11025, 65535), instruments(std::move(instr))
 {
-	LoadInstruments();
-	Renderer = new Timidity::Renderer((float)SampleRate, gusConfig.midi_voices, gusConfig.instruments.get());
+	// The renderer may load its default instrument.
+	std::lock_guard<std::mutex> lock(instruments->LoadLock);
+	Renderer = ZMusic_New<Timidity::Renderer>((float)SampleRate, gusConfig.midi_voices, instruments.get());
+	Renderer->mono = isMono = miscConfig.snd_mono;
+	Renderer->voice_floor = VoiceFloorLevel(gusConfig.voice_floor);
 }
 
 //==========================================================================
@@ -169,7 +132,7 @@ TimidityMIDIDevice::~TimidityMIDIDevice()
 	Close();
 	if (Renderer != nullptr)
 	{
-		delete Renderer;
+		ZMusic_Delete(Renderer);
 	}
 }
 
@@ -187,6 +150,59 @@ int TimidityMIDIDevice::OpenRenderer()
 	return 0;
 }
 
+//==========================================================================
+//
+// TimidityMIDIDevice :: GetActiveVoices
+//
+//==========================================================================
+
+int TimidityMIDIDevice::GetActiveVoices()
+{
+	if (Renderer == nullptr) return -1;
+	int count = 0;
+	for (int i = 0; i < Renderer->voices; ++i)
+	{
+		if (Renderer->voice[i].status & Timidity::VOICE_RUNNING) count++;
+	}
+	return count;
+}
+
+//==========================================================================
+//
+// TimidityMIDIDevice :: GetChannelActivity
+//
+// The mix levels are what the voices get mixed with, envelope included.
+//
+//==========================================================================
+
+void TimidityMIDIDevice::GetChannelActivity(int *voices, float *levels)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		voices[i] = 0;
+		levels[i] = 0;
+	}
+	for (int i = 0; i < Renderer->voices; ++i)
+	{
+		const Timidity::Voice &v = Renderer->voice[i];
+		if (!(v.status & Timidity::VOICE_RUNNING) || v.channel >= 16) continue;
+		voices[v.channel]++;
+		levels[v.channel] = std::max(levels[v.channel], std::max(v.left_mix, v.right_mix));
+	}
+}
+
+//==========================================================================
+//
+// TimidityMIDIDevice :: ChangeSettingNum
+//
+//==========================================================================
+
+void TimidityMIDIDevice::ChangeSettingNum(ESongSetting setting, double value)
+{
+	if (setting == SETTING_GUS_VOICE_FLOOR)
+		Renderer->voice_floor = VoiceFloorLevel((float)value);
+}
+
 //==========================================================================
 //
 // TimidityMIDIDevice :: PrecacheInstruments
@@ -198,11 +214,13 @@ int TimidityMIDIDevice::OpenRenderer()
 //
 //==========================================================================
 
-void TimidityMIDIDevice::PrecacheInstruments(const uint16_t *instruments, int count)
+void TimidityMIDIDevice::PrecacheInstruments(const uint16_t *instrumentlist, int count)
 {
+	ZMUSIC_PROFILE_ZONE("LoadInstruments");
+	std::lock_guard<std::mutex> lock(instruments->LoadLock);
 	for (int i = 0; i < count; ++i)
 	{
-		Renderer->MarkInstrument((instruments[i] >> 7) & 127, instruments[i] >> 14, instruments[i] & 127);
+		Renderer->MarkInstrument((instrumentlist[i] >> 7) & 127, instrumentlist[i] >> 14, instrumentlist[i] & 127);
 	}
 	Renderer->load_missing_instruments();
 }
@@ -218,6 +236,20 @@ void TimidityMIDIDevice::HandleEvent(int status, int parm1, int parm2)
 	Renderer->HandleEvent(status, parm1, parm2);
 }
 
+//==========================================================================
+//
+// TimidityMIDIDevice :: HandleEvents
+//
+//==========================================================================
+
+void TimidityMIDIDevice::HandleEvents(const MidiShortEvent *events, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		Renderer->HandleEvent(events[i].Status, events[i].Parm1, events[i].Parm2);
+	}
+}
+
 //==========================================================================
 //
 // TimidityMIDIDevice :: HandleLongEvent
@@ -237,6 +269,7 @@ void TimidityMIDIDevice::HandleLongEvent(const uint8_t *data, int len)
 
 void TimidityMIDIDevice::ComputeOutput(float *buffer, int len)
 {
+	ZMUSIC_PROFILE_ZONE("ComputeOutput");
 	Renderer->ComputeOutput(buffer, len);
 	for (int i = 0; i < len * 2; i++) buffer[i] *= 0.7f;
 }
@@ -249,17 +282,12 @@ void TimidityMIDIDevice::ComputeOutput(float *buffer, int len)
 
 //==========================================================================
 //
-// Sets up the date to load the instruments for the GUS device.
-// The actual instrument loader is part of the device.
+// Opens the reader for a GUS instrument set.
 //
 //==========================================================================
 
-bool GUS_SetupConfig(const char* args)
+static MusicIO::SoundFontReaderInterface *GUS_OpenReader(const char* args)
 {
-	if (*args == 0) args = gusConfig.gus_config.c_str();
-	if (gusConfig.gus_dmxgus && *args == 0) args = "DMXGUS";
-	//if (stricmp(gusConfig.loadedConfig.c_str(), args) == 0) return false; // aleady loaded
-
 	MusicIO::SoundFontReaderInterface* reader = MusicIO::ClientOpenSoundFont(args, SF_GUS);
 	if (!reader && MusicIO::fileExists(args))
 	{
@@ -287,16 +315,90 @@ bool GUS_SetupConfig(const char* args)
 		snprintf(error, 80, "GUS: %s: Unable to load sound font\n", args);
 		throw std::runtime_error(error);
 	}
-	gusConfig.reader = reader;
-	gusConfig.readerName = args;
-	return true;
+	return reader;
 }
 
-#
+//==========================================================================
+//
+// Returns the instrument set for the given config, loading it if no
+// device uses it yet. Loaded instruments depend on the output rate, so
+// that is part of what identifies a set, as are the DMXGUS lump's
+// contents and the settings that go with it.
+//
+//==========================================================================
+
+static std::shared_ptr<Timidity::Instruments> GUS_GetInstruments(const char* args, int samplerate)
+{
+	if (*args == 0) args = gusConfig.gus_config.c_str();
+	if (gusConfig.gus_dmxgus && *args == 0) args = "DMXGUS";
+	bool dmxgus = gusConfig.gus_dmxgus && gusConfig.dmxgus.size();
+
+	std::string key = std::string(args) + '\n' + std::to_string(samplerate);
+	if (dmxgus)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;	// FNV-1a
+		for (auto c : gusConfig.dmxgus) hash = (hash ^ c) * 0x100000001b3ull;
+		key += '\n' + gusConfig.gus_patchdir + '\n' + std::to_string(gusConfig.gus_memsize) + '\n' + std::to_string(hash);
+	}
+
+	std::lock_guard<std::mutex> lock(GUSInstrumentLock);
+	auto instruments = GUSInstrumentCache[key].lock();
+	if (instruments == nullptr)
+	{
+		auto reader = GUS_OpenReader(args);
+
+		// Check if we got some GUS data before using it.
+		std::string ultradir;
+		const char *ret = getenv("ULTRADIR");
+		if (ret) ultradir = std::string(ret);
+		// The GUS put its patches in %ULTRADIR%/MIDI so we can try that
+		if (ultradir.length())
+		{
+			ultradir += "/midi";
+			reader->add_search_path(ultradir.c_str());
+		}
+		// Load DMXGUS lump and patches from gus_patchdir
+		if (gusConfig.gus_patchdir.length() != 0) reader->add_search_path(gusConfig.gus_patchdir.c_str());
+
+		instruments = std::make_shared<Timidity::Instruments>(reader);
+		if (dmxgus)
+		{
+			if (instruments->LoadDMXGUS(gusConfig.gus_memsize, (const char*)gusConfig.dmxgus.data(), gusConfig.dmxgus.size()) < 0)
+			{
+				throw std::runtime_error("Unable to initialize DMXGUS for GUS MIDI device");
+			}
+		}
+		else if (instruments->LoadConfig() < 0)
+		{
+			throw std::runtime_error("Unable to initialize instruments for GUS MIDI device");
+		}
+		GUSInstrumentCache[key] = instruments;
+	}
+	{
+		// Patches are loaded on demand, so this may still change for a set that is already in use.
+		std::lock_guard<std::mutex> loadlock(instruments->LoadLock);
+		instruments->sample_cache_dir = gusConfig.gus_samplecache;
+	}
+
+	// Drop the entries of sets that are gone.
+	for (auto it = GUSInstrumentCache.begin(); it != GUSInstrumentCache.end();)
+	{
+		if (it->second.expired()) it = GUSInstrumentCache.erase(it);
+		else ++it;
+	}
+	gusConfig.instruments = instruments;
+	return instruments;
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 MIDIDevice* CreateTimidityMIDIDevice(const char* Args, int samplerate)
 {
-	GUS_SetupConfig(Args);
-	return new TimidityMIDIDevice(samplerate);
+	return new TimidityMIDIDevice(samplerate, GUS_GetInstruments(Args, samplerate));
 }
 
 #else
@@ -33,8 +33,12 @@
 */
 
 #include <stdexcept>
+#include <mutex>
+#include <map>
+#include <sys/stat.h>
 #include "mididevice.h"
 #include "zmusic/zmusic_internal.h"
+#include "zmusic/profile.h"
 
 #ifdef HAVE_TIMIDITY
 
@@ -43,8 +47,6 @@
 #include "timiditypp/playmidi.h"
 
 
-TimidityConfig timidityConfig;
-
 class TimidityPPMIDIDevice : public SoftSynthMIDIDevice
 {
 	std::shared_ptr<TimidityPlus::Instruments> instruments;
@@ -63,11 +65,116 @@ protected:
 	TimidityPlus::Player *Renderer;
 
 	void HandleEvent(int status, int parm1, int parm2) override;
+	void HandleEvents(const MidiShortEvent *events, int count) override;
 	void HandleLongEvent(const uint8_t *data, int len) override;
 	void ComputeOutput(float *buffer, int len) override;
+	void ChangeSettingInt(ESongSetting setting, int value) override;
 	void LoadInstruments();
 };
 
+//==========================================================================
+//
+// The players have their own state and settings, but the output rate is
+// still kept in globals that all of them use. So the devices that exist at
+// the same time have to agree on it.
+//
+//==========================================================================
+
+static std::mutex PlaybackRateLock;
+static int PlaybackRateUsers;
+
+static void AcquirePlaybackRate(int samplerate)
+{
+	std::lock_guard<std::mutex> lock(PlaybackRateLock);
+	if (PlaybackRateUsers > 0 && TimidityPlus::playback_rate != samplerate)
+	{
+		throw std::runtime_error("Timidity++ devices that play at the same time must use the same sample rate");
+	}
+	TimidityPlus::set_playback_rate(samplerate);
+	PlaybackRateUsers++;
+}
+
+static void ReleasePlaybackRate()
+{
+	std::lock_guard<std::mutex> lock(PlaybackRateLock);
+	PlaybackRateUsers--;
+}
+
+//==========================================================================
+//
+// Instrument sets that were loaded before, by the config they were loaded
+// for. A set stays usable while any config or device holds it, and is
+// handed out again as long as none of the config files and sound fonts it
+// was read from have changed since, so reopening the device skips parsing
+// the config again. Sets with files that are not on the file system, like
+// those from the client's reader or inside archives, cannot be checked and
+// are never cached.
+//
+//==========================================================================
+
+struct CachedInstrumentSet
+{
+	std::weak_ptr<TimidityPlus::Instruments> Instruments;
+	std::vector<std::pair<std::string, time_t>> Files;
+};
+
+static std::mutex InstrumentCacheLock;
+static std::map<std::string, CachedInstrumentSet> InstrumentCache;
+
+static bool GetModTime(const std::string &path, time_t &modtime)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_wstat64(MusicIO::wideString(path.c_str()).c_str(), &st) != 0) return false;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return false;
+#endif
+	modtime = st.st_mtime;
+	return true;
+}
+
+static void CacheInstruments(const std::string &name, const std::shared_ptr<TimidityPlus::Instruments> &instruments)
+{
+	std::lock_guard<std::mutex> lock(InstrumentCacheLock);
+	CachedInstrumentSet entry;
+	entry.Instruments = instruments;
+	for (auto &file : instruments->loadedFiles())
+	{
+		time_t modtime;
+		if (!GetModTime(file, modtime))
+		{
+			InstrumentCache.erase(name);
+			return;
+		}
+		entry.Files.emplace_back(file, modtime);
+	}
+	InstrumentCache[name] = std::move(entry);
+
+	// Drop the entries of sets that are gone.
+	for (auto it = InstrumentCache.begin(); it != InstrumentCache.end();)
+	{
+		if (it->second.Instruments.expired()) it = InstrumentCache.erase(it);
+		else ++it;
+	}
+}
+
+static std::shared_ptr<TimidityPlus::Instruments> FindCachedInstruments(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(InstrumentCacheLock);
+	auto it = InstrumentCache.find(name);
+	if (it == InstrumentCache.end()) return nullptr;
+	auto instruments = it->second.Instruments.lock();
+	for (auto &file : it->second.Files)
+	{
+		if (instruments == nullptr) break;
+		time_t modtime;
+		if (!GetModTime(file.first, modtime) || modtime != file.second) instruments = nullptr;
+	}
+	if (instruments == nullptr) InstrumentCache.erase(it);
+	return instruments;
+}
+
 //==========================================================================
 //
 //
@@ -76,6 +183,7 @@ protected:
 
 void TimidityPPMIDIDevice::LoadInstruments()
 {
+	ZMUSIC_PROFILE_ZONE("LoadInstruments");
 	if (timidityConfig.reader)
 	{
 		timidityConfig.loadedConfig = timidityConfig.readerName;
@@ -89,6 +197,7 @@ void TimidityPPMIDIDevice::LoadInstruments()
 			timidityConfig.loadedConfig = "";
 			throw std::runtime_error("Unable to initialize instruments for Timidity++ MIDI device");
 		}
+		if (!timidityConfig.readerIsClient) CacheInstruments(timidityConfig.loadedConfig, timidityConfig.instruments);
 	}
 	else if (timidityConfig.instruments == nullptr)
 	{
@@ -106,9 +215,17 @@ void TimidityPPMIDIDevice::LoadInstruments()
 TimidityPPMIDIDevice::TimidityPPMIDIDevice(int samplerate) 
 	:SoftSynthMIDIDevice(samplerate, 4000, 65000)
 {
-	TimidityPlus::set_playback_rate(SampleRate);
-	LoadInstruments();
-	Renderer = new TimidityPlus::Player(instruments.get());
+	AcquirePlaybackRate(SampleRate);
+	try
+	{
+		LoadInstruments();
+		Renderer = ZMusic_New<TimidityPlus::Player>(instruments.get());
+	}
+	catch (...)
+	{
+		ReleasePlaybackRate();
+		throw;
+	}
 }
 
 //==========================================================================
@@ -122,8 +239,9 @@ TimidityPPMIDIDevice::~TimidityPPMIDIDevice ()
 	Close();
 	if (Renderer != nullptr)
 	{
-		delete Renderer;
+		ZMusic_Delete(Renderer);
 	}
+	ReleasePlaybackRate();
 }
 
 //==========================================================================
@@ -153,6 +271,8 @@ void TimidityPPMIDIDevice::PrecacheInstruments(const uint16_t *instrumentlist, i
 {
 	if (instruments != nullptr)
 		instruments->PrecacheInstruments(instrumentlist, count);
+	if (Renderer != nullptr)
+		Renderer->precache_notes(instrumentlist, count);
 }
 
 //==========================================================================
@@ -167,6 +287,21 @@ void TimidityPPMIDIDevice::HandleEvent(int status, int parm1, int parm2)
 		Renderer->send_event(status, parm1, parm2);
 }
 
+//==========================================================================
+//
+// TimidityPPMIDIDevice :: HandleEvents
+//
+//==========================================================================
+
+void TimidityPPMIDIDevice::HandleEvents(const MidiShortEvent *events, int count)
+{
+	if (Renderer == nullptr) return;
+	for (int i = 0; i < count; i++)
+	{
+		Renderer->send_event(events[i].Status, events[i].Parm1, events[i].Parm2);
+	}
+}
+
 //==========================================================================
 //
 // TimidityPPMIDIDevice :: HandleLongEvent
@@ -187,10 +322,26 @@ void TimidityPPMIDIDevice::HandleLongEvent(const uint8_t *data, int len)
 
 void TimidityPPMIDIDevice::ComputeOutput(float *buffer, int len)
 {
+	ZMUSIC_PROFILE_ZONE("ComputeOutput");
 	if (Renderer != nullptr)
 		Renderer->compute_data(buffer, len);
 }
 
+//==========================================================================
+//
+// TimidityPPMIDIDevice :: ChangeSettingInt
+//
+// Called on the render thread, so the player's settings can be
+// replaced without any locking on its side.
+//
+//==========================================================================
+
+void TimidityPPMIDIDevice::ChangeSettingInt(ESongSetting setting, int value)
+{
+	if (setting == SETTING_TIMIDITY_SETTINGS && Renderer != nullptr)
+		Renderer->settings = TimidityPlus::GetDefaultSettings();
+}
+
 //==========================================================================
 //
 //
@@ -202,7 +353,18 @@ bool Timidity_SetupConfig(const char* args)
 	if (*args == 0) args = timidityConfig.timidity_config.c_str();
 	if (stricmp(timidityConfig.loadedConfig.c_str(), args) == 0) return false; // aleady loaded
 
+	auto cached = FindCachedInstruments(args);
+	if (cached != nullptr)
+	{
+		if (timidityConfig.reader) timidityConfig.reader->close();
+		timidityConfig.reader = nullptr;
+		timidityConfig.instruments = cached;
+		timidityConfig.loadedConfig = args;
+		return true;
+	}
+
 	MusicIO::SoundFontReaderInterface* reader = MusicIO::ClientOpenSoundFont(args, SF_GUS | SF_SF2);
+	bool isclient = reader != nullptr;
 	if (!reader && MusicIO::fileExists(args))
 	{
 		auto f = MusicIO::utf8_fopen(args, "rb");
@@ -226,6 +388,7 @@ bool Timidity_SetupConfig(const char* args)
 	}
 	timidityConfig.reader = reader;
 	timidityConfig.readerName = args;
+	timidityConfig.readerIsClient = isclient;
 	return true;
 }
 
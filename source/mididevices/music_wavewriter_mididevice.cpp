@@ -36,34 +36,17 @@
 // HEADER FILES ------------------------------------------------------------
 
 #include "mididevice.h"
-#include "zmusic/m_swap.h"
-#include "fileio.h"
-#include <stdexcept>
-#include <errno.h>
 
 // MACROS ------------------------------------------------------------------
 
-// TYPES -------------------------------------------------------------------
-
-struct FmtChunk
+enum
 {
-	//uint32_t ChunkID;
-	uint32_t ChunkLen;
-	uint16_t  FormatTag;
-	uint16_t  Channels;
-	uint32_t SamplesPerSec;
-	uint32_t AvgBytesPerSec;
-	uint16_t  BlockAlign;
-	uint16_t  BitsPerSample;
-	uint16_t  ExtensionSize;
-	uint16_t  ValidBitsPerSample;
-	uint32_t ChannelMask;
-	uint32_t SubFormatA;
-	uint16_t  SubFormatB;
-	uint16_t  SubFormatC;
-	uint8_t  SubFormatD[8];
+	RENDER_CHUNK = 4096,			// floats per ServiceStream call, as much as the synths were always asked for.
+	WRITE_BLOCK = 256 * 1024,		// floats per block handed to the writing job, 1 MB.
 };
 
+// TYPES -------------------------------------------------------------------
+
 // EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
 
 // PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
@@ -87,85 +70,22 @@ struct FmtChunk
 MIDIWaveWriter::MIDIWaveWriter(const char *filename, SoftSynthMIDIDevice *playdevice)
 	: SoftSynthMIDIDevice(playdevice->GetSampleRate())
 {
-	File = MusicIO::utf8_fopen(filename, "wb");
 	playDevice = playdevice;
-	if (File != nullptr)
-	{ // Write wave header
-		FmtChunk fmt;
-
-		if (fwrite("RIFF\0\0\0\0WAVEfmt ", 1, 16, File) != 16) goto fail;
-
-		playDevice->CalcTickRate();
-		fmt.ChunkLen = LittleLong(uint32_t(sizeof(fmt) - 4));
-		fmt.FormatTag = LittleShort((uint16_t)0xFFFE);		// WAVE_FORMAT_EXTENSIBLE
-		fmt.Channels = LittleShort((uint16_t)2);
-		fmt.SamplesPerSec = LittleLong(SampleRate);
-		fmt.AvgBytesPerSec = LittleLong(SampleRate * 8);
-		fmt.BlockAlign = LittleShort((uint16_t)8);
-		fmt.BitsPerSample = LittleShort((uint16_t)32);
-		fmt.ExtensionSize = LittleShort((uint16_t)(2 + 4 + 16));
-		fmt.ValidBitsPerSample = LittleShort((uint16_t)32);
-		fmt.ChannelMask = LittleLong(3);
-		fmt.SubFormatA = LittleLong(0x00000003);	// Set subformat to KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
-		fmt.SubFormatB = 0x0000;
-		fmt.SubFormatC = LittleShort((uint16_t)0x0010);
-		fmt.SubFormatD[0] = 0x80;
-		fmt.SubFormatD[1] = 0x00;
-		fmt.SubFormatD[2] = 0x00;
-		fmt.SubFormatD[3] = 0xaa;
-		fmt.SubFormatD[4] = 0x00;
-		fmt.SubFormatD[5] = 0x38;
-		fmt.SubFormatD[6] = 0x9b;
-		fmt.SubFormatD[7] = 0x71;
-		if (sizeof(fmt) != fwrite(&fmt, 1, sizeof(fmt), File)) goto fail;
-
-		if (fwrite("data\0\0\0\0", 1, 8, File) != 8) goto fail;
-
-		return;
-	fail:
-		char buffer[80];
-		fclose(File);
-		File = nullptr;
-		snprintf(buffer, 80, "Failed to write %s: %s\n", filename, strerror(errno));
-		throw std::runtime_error(buffer);
-	}
+	MinRenderBlock = playdevice->MinRenderBlock;
+	isMono = playdevice->isMono;
+	playDevice->CalcTickRate();
+	Wave.Open(filename, miscConfig.snd_dumpformat, SampleRate, isMono ? 1 : 2);
 }
 
 //==========================================================================
 //
-// MIDIWaveWriter Destructor
+// MIDIWaveWriter :: CloseFile
 //
 //==========================================================================
 
 bool MIDIWaveWriter::CloseFile()
 {
-	if (File != nullptr)
-	{
-		auto pos = ftell(File);
-		uint32_t size;
-
-		// data chunk size
-		size = LittleLong(uint32_t(pos - 8));
-		if (0 == fseek(File, 4, SEEK_SET))
-		{
-			if (4 == fwrite(&size, 1, 4, File))
-			{
-				size = LittleLong(uint32_t(pos - 12 - sizeof(FmtChunk) - 8));
-				if (0 == fseek(File, 4 + sizeof(FmtChunk) + 8, SEEK_CUR))
-				{
-					if (4 == fwrite(&size, 1, 4, File))
-					{
-						fclose(File);
-						File = nullptr;
-						return true;
-					}
-				}
-			}
-		}
-		fclose(File);
-		File = nullptr;
-	}
-	return false;
+	return Wave.Close();
 }
 
 //==========================================================================
@@ -176,19 +96,30 @@ bool MIDIWaveWriter::CloseFile()
 
 int MIDIWaveWriter::Resume()
 {
-	float writebuffer[4096];
+	int current = 0;
+	size_t filled = 0;
 
-	while (ServiceStream(writebuffer, sizeof(writebuffer)))
+	Blocks[0].resize(WRITE_BLOCK);
+	Blocks[1].resize(WRITE_BLOCK);
+	for (;;)
 	{
-		if (fwrite(writebuffer, 1, sizeof(writebuffer), File) != sizeof(writebuffer))
+		if (!ServiceStream(&Blocks[current][filled], RENDER_CHUNK * sizeof(float)))
 		{
-			fclose(File);
-			File = nullptr;
-			char buffer[80];
-			snprintf(buffer, 80, "Could not write entire wave file: %s\n", strerror(errno));
-			throw std::runtime_error(buffer);
+			break;
 		}
+		filled += RENDER_CHUNK;
+		if (filled == WRITE_BLOCK)
+		{
+			Wave.Write(Blocks[current].data(), filled);
+			current ^= 1;
+			filled = 0;
+		}
+	}
+	if (filled > 0)
+	{
+		Wave.Write(Blocks[current].data(), filled);
 	}
+	Wave.Finish();
 	return 0;
 }
 
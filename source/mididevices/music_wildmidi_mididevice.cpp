@@ -37,6 +37,7 @@
 #include <stdexcept>
 #include "mididevice.h"
 #include "zmusic/zmusic_internal.h"
+#include "zmusic/profile.h"
 
 #ifdef HAVE_WILDMIDI
 
@@ -46,8 +47,6 @@
 
 // TYPES -------------------------------------------------------------------
 
-WildMidiConfig wildMidiConfig;
-
 // WildMidi implementation of a MIDI device ---------------------------------
 
 class WildMIDIDevice : public SoftSynthMIDIDevice
@@ -59,6 +58,7 @@ public:
 	int OpenRenderer() override;
 	void PrecacheInstruments(const uint16_t *instruments, int count) override;
 	std::string GetStats() override;
+	int GetActiveVoices() override { return Renderer ? Renderer->GetVoiceCount() : -1; }
 	int GetDeviceType() const override { return MDEV_WILDMIDI; }
 	
 protected:
@@ -66,9 +66,11 @@ protected:
 	std::shared_ptr<WildMidi::Instruments> instruments;
 	
 	void HandleEvent(int status, int parm1, int parm2) override;
+	void HandleEvents(const MidiShortEvent *events, int count) override;
 	void HandleLongEvent(const uint8_t *data, int len) override;
 	void ComputeOutput(float *buffer, int len) override;
-	void ChangeSettingInt(const char *opt, int set) override;
+	void ChangeSettingInt(ESongSetting setting, int set) override;
+	void ChangeSettingNum(ESongSetting setting, double value) override;
 	void LoadInstruments();
 
 };
@@ -84,6 +86,7 @@ protected:
 
 void WildMIDIDevice::LoadInstruments()
 {
+	ZMUSIC_PROFILE_ZONE("LoadInstruments");
 	if (wildMidiConfig.reader)
 	{
 		wildMidiConfig.loadedConfig = wildMidiConfig.readerName;
@@ -101,6 +104,7 @@ void WildMIDIDevice::LoadInstruments()
 		wildMidiConfig.loadedConfig = "";
 		throw std::runtime_error("Unable to initialize instruments for WildMidi device");
 	}
+	instruments->SetPatchCache(wildMidiConfig.patch_cache * 1024ul);
 }
 
 //==========================================================================
@@ -113,13 +117,15 @@ WildMIDIDevice::WildMIDIDevice(int samplerate)
 	:SoftSynthMIDIDevice(samplerate, 11025, 65535)
 {
 	Renderer = NULL;
+	MinRenderBlock = 64;
 	LoadInstruments();
 
-	Renderer = new WildMidi::Renderer(instruments.get());
+	Renderer = ZMusic_New<WildMidi::Renderer>(instruments.get());
 	int flags = 0;
 	if (wildMidiConfig.enhanced_resampling) flags |= WildMidi::WM_MO_ENHANCED_RESAMPLING;
 	if (wildMidiConfig.reverb) flags |= WildMidi::WM_MO_REVERB;
 	Renderer->SetOption(WildMidi::WM_MO_ENHANCED_RESAMPLING | WildMidi::WM_MO_REVERB, flags);
+	Renderer->SetVoiceFloor(VoiceFloorLevel(wildMidiConfig.voice_floor));
 }
 
 //==========================================================================
@@ -133,7 +139,7 @@ WildMIDIDevice::~WildMIDIDevice()
 	Close();
 	if (Renderer != NULL)
 	{
-		delete Renderer;
+		ZMusic_Delete(Renderer);
 	}
 }
 
@@ -163,10 +169,7 @@ int WildMIDIDevice::OpenRenderer()
 
 void WildMIDIDevice::PrecacheInstruments(const uint16_t *instruments, int count)
 {
-	for (int i = 0; i < count; ++i)
-	{
-		Renderer->LoadInstrument((instruments[i] >> 7) & 127, instruments[i] >> 14, instruments[i] & 127);
-	}
+	Renderer->LoadInstruments(instruments, count);
 }
 
 
@@ -181,6 +184,20 @@ void WildMIDIDevice::HandleEvent(int status, int parm1, int parm2)
 	Renderer->ShortEvent(status, parm1, parm2);
 }
 
+//==========================================================================
+//
+// WildMIDIDevice :: HandleEvents
+//
+//==========================================================================
+
+void WildMIDIDevice::HandleEvents(const MidiShortEvent *events, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		Renderer->ShortEvent(events[i].Status, events[i].Parm1, events[i].Parm2);
+	}
+}
+
 //==========================================================================
 //
 // WildMIDIDevice :: HandleLongEvent
@@ -200,6 +217,7 @@ void WildMIDIDevice::HandleLongEvent(const uint8_t *data, int len)
 
 void WildMIDIDevice::ComputeOutput(float *buffer, int len)
 {
+	ZMUSIC_PROFILE_ZONE("ComputeOutput");
 	Renderer->ComputeOutput(buffer, len);
 }
 
@@ -222,16 +240,28 @@ std::string WildMIDIDevice::GetStats()
 //
 //==========================================================================
 
-void WildMIDIDevice::ChangeSettingInt(const char *opt, int set)
+void WildMIDIDevice::ChangeSettingInt(ESongSetting setting, int set)
 {
 	int option;
-	if (!stricmp(opt, "wildmidi.reverb")) option = WildMidi::WM_MO_REVERB;
-	else if (!stricmp(opt, "wildmidi.resampling")) option = WildMidi::WM_MO_ENHANCED_RESAMPLING;
+	if (setting == SETTING_WILDMIDI_REVERB) option = WildMidi::WM_MO_REVERB;
+	else if (setting == SETTING_WILDMIDI_RESAMPLING) option = WildMidi::WM_MO_ENHANCED_RESAMPLING;
 	else return;
 	int setit = option * int(set);
 	Renderer->SetOption(option, setit);
 }
 
+//==========================================================================
+//
+// WildMIDIDevice :: ChangeSettingNum
+//
+//==========================================================================
+
+void WildMIDIDevice::ChangeSettingNum(ESongSetting setting, double value)
+{
+	if (setting == SETTING_WILDMIDI_VOICE_FLOOR)
+		Renderer->SetVoiceFloor(VoiceFloorLevel((float)value));
+}
+
 //==========================================================================
 //
 //
@@ -274,9 +304,26 @@ MIDIDevice *CreateWildMIDIDevice(const char *Args, int samplerate)
 	return new WildMIDIDevice(samplerate);
 }
 
+//==========================================================================
+//
+// Frees the patches kept for later songs. Returns the bytes freed.
+//
+//==========================================================================
+
+size_t WildMidi_ReleaseUnusedPatches()
+{
+	if (wildMidiConfig.instruments == nullptr) return 0;
+	return wildMidiConfig.instruments->ReleaseUnusedPatches();
+}
+
 #else
 MIDIDevice* CreateWildMIDIDevice(const char* Args, int samplerate)
 {
 	throw std::runtime_error("WildMidi device not supported in this configuration");
 }
+
+size_t WildMidi_ReleaseUnusedPatches()
+{
+	return 0;
+}
 #endif
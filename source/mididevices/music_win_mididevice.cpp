@@ -47,6 +47,7 @@
 #include "mididevice.h"
 #include "zmusic/m_swap.h"
 #include "zmusic/mus2midi.h"
+#include "zmusic/jobs.h"
 
 #ifndef __GNUC__
 #include <mmdeviceapi.h>
@@ -90,6 +91,11 @@ public:
 	bool Update() override;
 	void PrecacheInstruments(const uint16_t *instruments, int count);
 	DWORD PlayerLoop();
+	int GetDefaultBuffers() const override
+	{
+		// Enough queued up for the refills to ride out a hitch of the thread doing them.
+		return 4;
+	}
 	bool CanHandleSysex() const override
 	{
 		// No Sysex for GS synth.
@@ -103,12 +109,11 @@ public:
 	HMIDISTRM MidiOut;
 	UINT DeviceID;
 	DWORD SavedVolume;
-	MIDIHDR WinMidiHeaders[2];
-	int HeaderIndex;
+	MIDIHDR WinMidiHeaders[MAX_MIDI_BUFFERS];
 	bool VolumeWorks;
 	bool Precache;
 
-	HANDLE BufferDoneEvent;
+	HANDLE BufferDoneEvent;		// a semaphore, counting the buffers that finished and still need a refill.
 	HANDLE ExitEvent;
 	HANDLE PlayerThread;
 
@@ -129,11 +134,10 @@ WinMIDIDevice::WinMIDIDevice(int dev_id, bool precache)
 {
 	DeviceID = std::max<DWORD>(dev_id, 0);
 	MidiOut = 0;
-	HeaderIndex = 0;
 	Precache = precache;
 	memset(WinMidiHeaders, 0, sizeof(WinMidiHeaders));
 
-	BufferDoneEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	BufferDoneEvent = CreateSemaphore(nullptr, 0, MAX_MIDI_BUFFERS, nullptr);
 	if (BufferDoneEvent == nullptr)
 	{
 		throw std::runtime_error("Could not create buffer done event for MIDI playback");
@@ -283,6 +287,7 @@ int WinMIDIDevice::SetTimeDiv(int timediv)
 
 DWORD WINAPI PlayerProc(LPVOID lpParameter)
 {
+	FThreadScope scope(THREAD_MIDIOUT, "ZMusic MIDI out");
 	return ((WinMIDIDevice *)lpParameter)->PlayerLoop();
 }
 
@@ -317,7 +322,7 @@ int WinMIDIDevice::Resume()
 void WinMIDIDevice::InitPlayback()
 {
 	ResetEvent(ExitEvent);
-	ResetEvent(BufferDoneEvent);
+	while (WaitForSingleObject(BufferDoneEvent, 0) == WAIT_OBJECT_0) {}
 }
 
 //==========================================================================
@@ -363,6 +368,7 @@ DWORD WinMIDIDevice::PlayerLoop()
 		switch (WaitForMultipleObjects(2, events, FALSE, INFINITE))
 		{
 		case WAIT_OBJECT_0:
+			// One refill for every buffer that finished, even if several finished before this thread got to run.
 			if (Callback != nullptr) Callback(CallbackData);
 			break;
 
@@ -486,7 +492,7 @@ bool WinMIDIDevice::Pause(bool paused)
 int WinMIDIDevice::StreamOut(MidiHeader *header)
 {
 	auto syshdr = (MIDIHDR*)header->lpNext;
-	assert(syshdr == &WinMidiHeaders[0] || syshdr == &WinMidiHeaders[1]);
+	assert(syshdr >= &WinMidiHeaders[0] && syshdr < &WinMidiHeaders[MAX_MIDI_BUFFERS]);
 	return midiStreamOut(MidiOut, syshdr, sizeof(MIDIHDR));
 }
 
@@ -509,10 +515,18 @@ int WinMIDIDevice::StreamOutSync(MidiHeader *header)
 
 int WinMIDIDevice::PrepareHeader(MidiHeader *header)
 {
-	// This code depends on the driving implementation only having two buffers that get passed alternatingly.
-	// If there were more buffers this would require more intelligent handling.
+	// The streamer never has more than MAX_MIDI_BUFFERS headers prepared at once, so there is always a free one.
 	assert(header->lpNext == nullptr);
-	MIDIHDR *syshdr = &WinMidiHeaders[HeaderIndex ^= 1];
+	MIDIHDR *syshdr = nullptr;
+	for (auto &hdr : WinMidiHeaders)
+	{
+		if (!(hdr.dwFlags & MHDR_PREPARED))
+		{
+			syshdr = &hdr;
+			break;
+		}
+	}
+	if (syshdr == nullptr) return MMSYSERR_NOMEM;
 	memset(syshdr, 0, sizeof(MIDIHDR));
 	syshdr->lpData = (LPSTR)header->lpData;
 	syshdr->dwBufferLength = header->dwBufferLength;
@@ -533,7 +547,7 @@ int WinMIDIDevice::UnprepareHeader(MidiHeader *header)
 	auto syshdr = (MIDIHDR*)header->lpNext;
 	if (syshdr != nullptr)
 	{
-		assert(syshdr == &WinMidiHeaders[0] || syshdr == &WinMidiHeaders[1]);
+		assert(syshdr >= &WinMidiHeaders[0] && syshdr < &WinMidiHeaders[MAX_MIDI_BUFFERS]);
 		header->lpNext = nullptr;
 		return midiOutUnprepareHeader((HMIDIOUT)MidiOut, syshdr, sizeof(MIDIHDR));
 	}
@@ -639,7 +653,8 @@ void CALLBACK WinMIDIDevice::CallbackFunc(HMIDIOUT hOut, UINT uMsg, DWORD_PTR dw
 	WinMIDIDevice *self = (WinMIDIDevice *)dwInstance;
 	if (uMsg == MOM_DONE)
 	{
-		SetEvent(self->BufferDoneEvent);
+		// Nothing else happens on the driver's thread, the refill is up to PlayerLoop.
+		ReleaseSemaphore(self->BufferDoneEvent, 1, nullptr);
 	}
 }
 
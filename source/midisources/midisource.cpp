@@ -62,6 +62,29 @@ void MIDISource::SetTempo(int new_tempo)
 }
 
 
+//==========================================================================
+//
+// MIDISource :: AdoptData
+//
+// Takes a reference to the song data if it comes with an owner, otherwise
+// makes a private copy. Either way the returned pointer remains valid for
+// the lifetime of the source.
+//
+//==========================================================================
+
+const uint8_t *MIDISource::AdoptData(const uint8_t *data, size_t len, std::shared_ptr<const uint8_t> owner)
+{
+	if (owner == nullptr)
+	{
+		auto copy = new uint8_t[len];
+		memcpy(copy, data, len);
+		owner.reset(copy, std::default_delete<uint8_t[]>());
+		data = copy;
+	}
+	SongData = std::move(owner);
+	return data;
+}
+
 //==========================================================================
 //
 // MIDISource :: ClampLoopCount
@@ -115,66 +138,86 @@ int MIDISource::VolumeControllerChange(int channel, int volume)
 
 //==========================================================================
 //
-// MIDISource :: Precache
+// MIDIUsageCollector :: AddEvent
 //
-// Generates a list of instruments this song uses and passes them to the
-// MIDI device for precaching. The default implementation here pretends to
-// play the song and watches for program change events on normal channels
-// and note on events on channel 10.
+//==========================================================================
+
+void MIDIUsageCollector::AddEvent(uint32_t ticks, uint32_t event)
+{
+	Time += double(ticks) * Tempo / Division;
+	if (MEVENT_EVENTTYPE(event) == MEVENT_TEMPO)
+	{
+		Tempo = MEVENT_EVENTPARM(event);
+		return;
+	}
+	if (MEVENT_EVENTTYPE(event) != 0) return;
+
+	int command = event & 0xF0;
+	int channel = event & 0x0F;
+	int data1 = (event >> 8) & 0x7f;
+	int data2 = (event >> 16) & 0x7f;
+	int packed;
+
+	if (command == MIDI_CTRLCHANGE && data1 == 0)
+	{
+		Banks[channel] = data2;
+		return;
+	}
+	else if (command == MIDI_PRGMCHANGE)
+	{
+		Programs[channel] = data1;
+		ActiveBanks[channel] = Banks[channel];
+		return;
+	}
+	else if (command != MIDI_NOTEON || data2 == 0)
+	{
+		return;
+	}
+	else if (channel == 9)
+	{ // For drums the entry holds the key, and the kit as bank.
+		packed = data1 | (Programs[9] << 7) | (1 << 14);
+	}
+	else
+	{
+		packed = Programs[channel] | (ActiveBanks[channel] << 7);
+	}
+	if (!Found[packed])
+	{
+		Found[packed] = true;
+		Usage.Instruments.push_back((uint16_t)packed);
+		Usage.FirstUse.push_back(uint32_t(Time / 1000));
+	}
+}
+
+//==========================================================================
+//
+// MIDISource :: PrecacheData
+//
+// Generates a list of instruments this song uses for the MIDI device to
+// precache. The default implementation here pretends to play the song
+// and watches which instruments get to play notes, and when.
 //
 //==========================================================================
 
-std::vector<uint16_t> MIDISource::PrecacheData()
+MIDIInstrumentUsage MIDISource::PrecacheData()
 {
-	uint32_t Events[2][MAX_MIDI_EVENTS*3];
-	uint8_t found_instruments[256] = { 0, };
-	uint8_t found_banks[256] = { 0, };
-	bool multiple_banks = false;
-	
+	uint32_t Events[MAX_MIDI_EVENTS*3];
+
 	LoopLimit = 1;
 	DoRestart();
-	found_banks[0] = true;		// Bank 0 is always used.
-	found_banks[128] = true;
+	MIDIUsageCollector usage(Division, Tempo);
 	
 	// Simulate playback to pick out used instruments.
 	while (!CheckDone())
 	{
-		uint32_t *event_end = MakeEvents(Events[0], &Events[0][MAX_MIDI_EVENTS*3], 1000000*600);
-		for (uint32_t *event = Events[0]; event < event_end; )
+		uint32_t *event_end = MakeEvents(Events, &Events[MAX_MIDI_EVENTS*3], 1000000*600);
+		if (event_end == Events)
 		{
-			if (MEVENT_EVENTTYPE(event[2]) == 0)
-			{
-				int command = (event[2] & 0x70);
-				int channel = (event[2] & 0x0f);
-				int data1 = (event[2] >> 8) & 0x7f;
-				int data2 = (event[2] >> 16) & 0x7f;
-				
-				if (channel != 9 && command == (MIDI_PRGMCHANGE & 0x70))
-				{
-					found_instruments[data1] = true;
-				}
-				else if (channel == 9 && command == (MIDI_PRGMCHANGE & 0x70) && data1 != 0)
-				{ // On a percussion channel, program change also serves as bank select.
-					multiple_banks = true;
-					found_banks[data1 | 128] = true;
-				}
-				else if (channel == 9 && command == (MIDI_NOTEON & 0x70) && data2 != 0)
-				{
-					found_instruments[data1 | 128] = true;
-				}
-				else if (command == (MIDI_CTRLCHANGE & 0x70) && data1 == 0 && data2 != 0)
-				{
-					multiple_banks = true;
-					if (channel == 9)
-					{
-						found_banks[data2 | 128] = true;
-					}
-					else
-					{
-						found_banks[data2] = true;
-					}
-				}
-			}
+			break;
+		}
+		for (uint32_t *event = Events; event < event_end; )
+		{
+			usage.AddEvent(event[0], event[2]);
 			// Advance to next event
 			if (event[2] < 0x80000000)
 			{ // short message
@@ -187,34 +230,26 @@ std::vector<uint16_t> MIDISource::PrecacheData()
 		}
 	}
 	DoRestart();
-	
-	// Now pack everything into a contiguous region for the PrecacheInstruments call().
-	std::vector<uint16_t> packed;
-	
-	for (int i = 0; i < 256; ++i)
+	return std::move(usage.Usage);
+}
+
+//==========================================================================
+//
+// MIDISource :: GetInstrumentUsage
+//
+// Restarting a song or changing its device does not change what it plays,
+// so the walk through the song is only done once.
+//
+//==========================================================================
+
+const MIDIInstrumentUsage &MIDISource::GetInstrumentUsage()
+{
+	if (!UsageValid)
 	{
-		if (found_instruments[i])
-		{
-			uint16_t packnum = (i & 127) | ((i & 128) << 7);
-			if (!multiple_banks)
-			{
-				packed.push_back(packnum);
-			}
-			else
-			{ // In order to avoid having to multiplex tracks in a type 1 file,
-				// precache every used instrument in every used bank, even if not
-				// all combinations are actually used.
-				for (int j = 0; j < 128; ++j)
-				{
-					if (found_banks[j + (i & 128)])
-					{
-						packed.push_back(packnum | (j << 7));
-					}
-				}
-			}
-		}
+		Usage = PrecacheData();
+		UsageValid = true;
 	}
-	return packed;
+	return Usage;
 }
 
 //==========================================================================
@@ -243,6 +278,155 @@ bool MIDISource::SetMIDISubsong(int subsong)
 	return subsong == 0;
 }
 
+//==========================================================================
+//
+// MIDISource :: GetTiming
+//
+// Returns the song's length and loop region in milliseconds. Songs without
+// an infinite loop restart from the beginning, so their loop region is the
+// whole song.
+//
+//==========================================================================
+
+bool MIDISource::GetTiming(int &length, int &loopstart, int &loopend)
+{
+	if (!TimingValid)
+	{
+		if (!CalcTiming(TimingLength, TimingLoopStart, TimingLoopEnd))
+		{
+			return false;
+		}
+		TimingValid = true;
+	}
+	length = TimingLength;
+	loopstart = TimingLoopStart;
+	loopend = TimingLoopEnd;
+	return true;
+}
+
+//==========================================================================
+//
+// MIDISource :: StartTiming
+//
+//==========================================================================
+
+MIDISource *MIDISource::StartTiming(int &epoch)
+{
+	if (TimingValid)
+	{
+		return nullptr;
+	}
+	epoch = TimingEpoch;
+	return Clone();
+}
+
+//==========================================================================
+//
+// MIDISource :: SetTiming
+//
+//==========================================================================
+
+void MIDISource::SetTiming(int epoch, int length, int loopstart, int loopend)
+{
+	if (epoch == TimingEpoch)
+	{
+		TimingLength = length;
+		TimingLoopStart = loopstart;
+		TimingLoopEnd = loopend;
+		TimingValid = true;
+	}
+}
+
+//==========================================================================
+//
+// MIDISource :: CalcTiming
+//
+//==========================================================================
+
+bool MIDISource::CalcTiming(int &length, int &loopstart, int &loopend)
+{
+	std::unique_ptr<MIDISource> walker(Clone());
+	return walker != nullptr && WalkTiming(walker.get(), length, loopstart, loopend);
+}
+
+//==========================================================================
+//
+// MIDISource :: WalkTiming											static
+//
+// Walks a copy of the song with the tempo map but without rendering it.
+// The copy gets restarted before use, so this also works while the song
+// itself is playing, and it does not touch the song.
+//
+//==========================================================================
+
+bool MIDISource::WalkTiming(MIDISource *walker, int &length, int &loopstart, int &loopend)
+{
+	const double MAX_SONG_TIME = 86400. * 1000000;	// Anything longer than a day is broken.
+	const int Division = walker->Division;
+
+	walker->setTempoCallback([](int tempo) { return true; });
+	walker->MarkLoops = true;
+	walker->skipSysex = true;
+	walker->CheckCaps(MIDIDEV_MIDIPORT);
+	walker->StartPlayback(false, 0);
+	walker->DoRestart();
+
+	uint32_t buffer[MAX_MIDI_EVENTS * 3];
+	double now = 0, tempo = walker->Tempo;
+	double markedstart = 0, loopbegin = 0, loopfinish = -1;
+
+	while (!walker->CheckDone())
+	{
+		uint32_t *event_end = walker->MakeEvents(buffer, &buffer[MAX_MIDI_EVENTS * 3], 1000000 * 600);
+		if (event_end == buffer)
+		{
+			break;
+		}
+		for (uint32_t *event = buffer; event < event_end; )
+		{
+			now += event[0] * tempo / Division;
+			if (MEVENT_EVENTTYPE(event[2]) == MEVENT_TEMPO)
+			{
+				tempo = MEVENT_EVENTPARM(event[2]);
+			}
+			else if (event[2] == ((MEVENT_NOP << 24) | MARKER_LOOPSTART))
+			{
+				markedstart = now;
+			}
+			else if (event[2] == ((MEVENT_NOP << 24) | MARKER_LOOPEND) && loopfinish < 0)
+			{
+				loopbegin = markedstart;
+				loopfinish = now;
+			}
+
+			if (MEVENT_EVENTTYPE(event[2]) == MEVENT_LONGMSG)
+			{
+				event += 3 + ((MEVENT_EVENTPARM(event[2]) + 3) >> 2);
+			}
+			else
+			{
+				event += 3;
+			}
+		}
+		if (now > MAX_SONG_TIME)
+		{
+			return false;
+		}
+	}
+	length = int(now / 1000 + 0.5);
+	if (loopfinish >= 0)
+	{
+		loopstart = int(loopbegin / 1000 + 0.5);
+		loopend = int(loopfinish / 1000 + 0.5);
+	}
+	else
+	{
+		loopstart = 0;
+		loopend = length;
+	}
+	return true;
+}
+
 //==========================================================================
 //
 // WriteVarLen
@@ -275,16 +459,93 @@ static void WriteVarLen (std::vector<uint8_t> &file, uint32_t value)
 
 //==========================================================================
 //
-// MIDIStreamer :: CreateSMF
+// SMF writers for in-memory export and for measuring the file size
+//
+//==========================================================================
+
+class SMFVectorWriter : public SMFWriter
+{
+	std::vector<uint8_t> &File;
+
+public:
+	SMFVectorWriter(std::vector<uint8_t> &file) : File(file) {}
+
+	bool Write(const uint8_t *data, size_t len) override
+	{
+		File.insert(File.end(), data, data + len);
+		return true;
+	}
+
+	bool CanPatch() const override { return true; }
+
+	bool Patch(size_t offset, const uint8_t *data, size_t len) override
+	{
+		if (offset + len > File.size()) return false;
+		memcpy(&File[offset], data, len);
+		return true;
+	}
+};
+
+class SMFCountingWriter : public SMFWriter
+{
+public:
+	bool Write(const uint8_t *data, size_t len) override { return true; }
+};
+
+//==========================================================================
+//
+// MIDISource :: CreateSMF
 //
 // Simulates playback to create a Standard MIDI File.
 //
 //==========================================================================
 
 void MIDISource::CreateSMF(std::vector<uint8_t> &file, int looplimit)
+{
+	SMFVectorWriter writer(file);
+	file.clear();
+	CreateSMF(writer, looplimit);
+}
+
+bool MIDISource::CreateSMF(SMFWriter &writer, int looplimit)
+{
+	uint32_t tracklen = 0;
+	size_t filelen;
+
+	if (!writer.CanPatch())
+	{
+		// The track length has to be known before anything gets written.
+		SMFCountingWriter counter;
+		WriteSMFTrack(counter, looplimit, 0, filelen);
+		tracklen = uint32_t(filelen - 22);
+	}
+	if (!WriteSMFTrack(writer, looplimit, tracklen, filelen))
+	{
+		return false;
+	}
+	if (writer.CanPatch())
+	{
+		tracklen = uint32_t(filelen - 22);
+		const uint8_t len[4] = { uint8_t(tracklen >> 24), uint8_t(tracklen >> 16), uint8_t(tracklen >> 8), uint8_t(tracklen) };
+		return writer.Patch(18, len, 4);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// MIDISource :: WriteSMFTrack
+//
+// Generates the file and passes it on to the writer whenever a chunk's
+// worth of data has come together.
+//
+//==========================================================================
+
+bool MIDISource::WriteSMFTrack(SMFWriter &writer, int looplimit, uint32_t tracklen, size_t &filelen)
 {
 	const int EXPORT_LOOP_LIMIT =	30;		// Maximum number of times to loop when exporting a MIDI file.
 	// (for songs with loop controller events)
+	const size_t EXPORT_CHUNK_SIZE = 65536;
 
 	static const uint8_t StaticMIDIhead[] =
 	{
@@ -297,10 +558,15 @@ void MIDISource::CreateSMF(std::vector<uint8_t> &file, int looplimit)
 		0, 255, 81, 3, 0, 0, 0
 	};
 
-	uint32_t Events[2][MAX_MIDI_EVENTS*3];
+	uint32_t Events[MAX_MIDI_EVENTS*3];
 	uint32_t delay = 0;
 	uint8_t running_status = 255;
-	
+	std::vector<uint8_t> file;
+	bool success = true;
+
+	filelen = 0;
+	file.reserve(EXPORT_CHUNK_SIZE + MAX_MIDI_EVENTS * 16);
+
 	// Always create songs aimed at GM devices.
 	CheckCaps(MIDIDEV_MIDIPORT);
 	LoopLimit = looplimit <= 0 ? EXPORT_LOOP_LIMIT : looplimit;
@@ -311,14 +577,18 @@ void MIDISource::CreateSMF(std::vector<uint8_t> &file, int looplimit)
 	memcpy(file.data(), StaticMIDIhead, sizeof(StaticMIDIhead));
 	file[12] = Division >> 8;
 	file[13] = Division & 0xFF;
+	file[18] = uint8_t(tracklen >> 24);
+	file[19] = uint8_t(tracklen >> 16);
+	file[20] = uint8_t(tracklen >> 8);
+	file[21] = uint8_t(tracklen & 255);
 	file[26] = InitialTempo >> 16;
 	file[27] = InitialTempo >> 8;
 	file[28] = InitialTempo;
 	
-	while (!CheckDone())
+	while (success && !CheckDone())
 	{
-		uint32_t *event_end = MakeEvents(Events[0], &Events[0][MAX_MIDI_EVENTS*3], 1000000*600);
-		for (uint32_t *event = Events[0]; event < event_end; )
+		uint32_t *event_end = MakeEvents(Events, &Events[MAX_MIDI_EVENTS*3], 1000000*600);
+		for (uint32_t *event = Events; event < event_end; )
 		{
 			delay += event[0];
 			if (MEVENT_EVENTTYPE(event[2]) == MEVENT_TEMPO)
@@ -385,22 +655,27 @@ void MIDISource::CreateSMF(std::vector<uint8_t> &file, int looplimit)
 				event += 3 + ((MEVENT_EVENTPARM(event[2]) + 3) >> 2);
 			}
 		}
+		if (file.size() >= EXPORT_CHUNK_SIZE)
+		{
+			success = writer.Write(file.data(), file.size());
+			filelen += file.size();
+			file.clear();
+		}
 	}
 	
-	// End track
-	WriteVarLen(file, delay);
-	file.push_back(MIDI_META);
-	file.push_back(MIDI_META_EOT);
-	file.push_back(0);
-	
-	// Fill in track length
-	uint32_t len = (uint32_t)file.size() - 22;
-	file[18] = uint8_t(len >> 24);
-	file[19] = uint8_t(len >> 16);
-	file[20] = uint8_t(len >> 8);
-	file[21] = uint8_t(len & 255);
+	if (success)
+	{
+		// End track
+		WriteVarLen(file, delay);
+		file.push_back(MIDI_META);
+		file.push_back(MIDI_META_EOT);
+		file.push_back(0);
+		success = writer.Write(file.data(), file.size());
+		filelen += file.size();
+	}
 	
 	LoopLimit = 0;
+	return success;
 }
 
 
@@ -472,9 +747,11 @@ DLL_EXPORT EMIDIType ZMusic_IdentifyMIDIType(uint32_t *id, int size)
 //
 // create a source based on MIDI file type
 //
+// If 'owner' is set the source references the data instead of copying it.
+//
 //==========================================================================
 
-DLL_EXPORT ZMusic_MidiSource ZMusic_CreateMIDISource(const uint8_t *data, size_t length, EMIDIType miditype)
+MIDISource *ZMusic_CreateMIDISourceShared(const uint8_t *data, size_t length, EMIDIType miditype, std::shared_ptr<const uint8_t> owner)
 {
 	try
 	{
@@ -482,23 +759,23 @@ DLL_EXPORT ZMusic_MidiSource ZMusic_CreateMIDISource(const uint8_t *data, size_t
 		switch (miditype)
 		{
 		case MIDI_MUS:
-			source = new MUSSong2(data, length);
+			source = new MUSSong2(data, length, std::move(owner));
 			break;
 
 		case MIDI_MIDI:
-			source = new MIDISong2(data, length);
+			source = new MIDISong2(data, length, std::move(owner));
 			break;
 
 		case MIDI_HMI:
-			source = new HMISong(data, length);
+			source = new HMISong(data, length, std::move(owner));
 			break;
 
 		case MIDI_XMI:
-			source = new XMISong(data, length);
+			source = new XMISong(data, length, std::move(owner));
 			break;
 		
 		case MIDI_MIDS:
-			source = new MIDSSong(data, length);
+			source = new MIDSSong(data, length, std::move(owner));
 			break;
 
 		default:
@@ -514,3 +791,8 @@ DLL_EXPORT ZMusic_MidiSource ZMusic_CreateMIDISource(const uint8_t *data, size_t
 		return nullptr;
 	}
 }
+
+DLL_EXPORT ZMusic_MidiSource ZMusic_CreateMIDISource(const uint8_t *data, size_t length, EMIDIType miditype)
+{
+	return ZMusic_CreateMIDISourceShared(data, length, miditype, nullptr);
+}
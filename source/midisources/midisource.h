@@ -11,18 +11,62 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdint.h>
+#include <bitset>
 #include <functional>
+#include <memory>
+#include <utility>
 #include <vector>
 #include "zmusic/mus2midi.h"
 #include "zmusic/mididefs.h"
+#include "zmusic/allocator.h"
 
 extern char MIDI_EventLengths[7];
 extern char MIDI_CommonLengths[15];
 
+// Destination for MIDISource::CreateSMF. The file is handed over in pieces as
+// it gets generated, so it never has to be held in memory as a whole.
+class SMFWriter
+{
+public:
+	virtual ~SMFWriter() = default;
+	virtual bool Write(const uint8_t *data, size_t len) = 0;
+	// Overwrites data that has already been written. Writers that cannot do this
+	// return false from CanPatch and get the song generated twice instead, once
+	// to measure it and once to write it.
+	virtual bool CanPatch() const { return false; }
+	virtual bool Patch(size_t offset, const uint8_t *data, size_t len) { return false; }
+};
+
+// The instruments a song plays, for MIDIDevice::PrecacheInstruments.
+struct MIDIInstrumentUsage
+{
+	std::vector<uint16_t> Instruments;	// packed as PrecacheInstruments takes them, in order of first use
+	std::vector<uint32_t> FirstUse;		// ms into the song for every instrument, so this is sorted as well
+};
+
+// Collects the instruments a song plays from its events. Only instruments
+// that play notes count, with the bank they were selected from, so every
+// used combination is found without listing unused ones.
+class MIDIUsageCollector
+{
+public:
+	MIDIUsageCollector(int division, int tempo) : Division(division), Tempo(tempo) {}
+	void AddEvent(uint32_t ticks, uint32_t event);	// ticks since the previous event
+	MIDIInstrumentUsage Usage;
+
+private:
+	int Division;
+	int Tempo;
+	double Time = 0;			// in microseconds
+	uint8_t Banks[16] = {};		// set by controller 0, latched by the next program change
+	uint8_t ActiveBanks[16] = {};
+	uint8_t Programs[16] = {};	// on channel 10 this is the drum kit
+	std::bitset<1 << 15> Found;
+};
 
 // base class for the different MIDI sources --------------------------------------
 
-class MIDISource
+class MIDISource : public FMusicAllocated
 {
 	int Volume = 0xffff;
 	int LoopLimit = 0;
@@ -32,6 +76,13 @@ protected:
 
 	bool isLooping = false;
 	bool skipSysex = false;
+	bool EndlessLoop = false;	// set when an infinite loop got skipped because the song was not looping
+	bool MarkLoops = false;		// emit MARKER_LOOPSTART/MARKER_LOOPEND for infinite loops
+	bool TimingValid = false;	// the cached timing needs to be reset whenever the subsong changes, see InvalidateTiming
+	int TimingLength, TimingLoopStart, TimingLoopEnd;
+	int TimingEpoch = 0;		// counts the resets, so that a walk made for an older subsong gets ignored
+	bool UsageValid = false;	// the same goes for the cached instrument usage
+	MIDIInstrumentUsage Usage;
 	int Division = 0;
 	int Tempo = 500000;
 	int InitialTempo = 500000;
@@ -40,6 +91,14 @@ protected:
 	int VolumeControllerChange(int channel, int volume);
 	void SetTempo(int new_tempo);
 	int ClampLoopCount(int loopcount);
+	bool WriteSMFTrack(SMFWriter &writer, int looplimit, uint32_t tracklen, size_t &filelen);
+
+	// The song data is never written to so it can be borrowed from a file mapping
+	// or another reader's buffer. 'owner' keeps it alive, without one it gets copied.
+	std::shared_ptr<const uint8_t> SongData;
+	const uint8_t *AdoptData(const uint8_t *data, size_t len, std::shared_ptr<const uint8_t> owner);
+	virtual bool CalcTiming(int &length, int &loopstart, int &loopend);
+	void InvalidateTiming() { TimingValid = false; TimingEpoch++; }
 
 	
 public:
@@ -51,9 +110,17 @@ public:
 	virtual void DoInitialSetup() = 0;
 	virtual void DoRestart() = 0;
 	virtual bool CheckDone() = 0;
-	virtual std::vector<uint16_t> PrecacheData();
+	virtual MIDIInstrumentUsage PrecacheData();
 	virtual bool SetMIDISubsong(int subsong);
+	virtual int GetSubsongCount() const { return 1; }
 	virtual uint32_t *MakeEvents(uint32_t *events, uint32_t *max_event_p, uint32_t max_time) = 0;
+	// If the song is dense enough to be played from larger event buffers. Only valid once
+	// the instrument usage has been collected.
+	virtual bool IsHighDensity() const { return false; }
+
+	// Returns a copy sharing the song data, or nullptr if the source cannot be copied.
+	// The copy carries over the playback state, so it continues where this source is.
+	virtual MIDISource *Clone() const { return nullptr; }
 	
 	void StartPlayback(bool looped = true, int looplimit = 0)
 	{
@@ -63,8 +130,10 @@ public:
 	}
 
 	void SkipSysex() { skipSysex = true; }
+	void SetLooping(bool looped) { isLooping = looped; }
 	
 	bool isValid() const { return Division > 0; }
+	bool hasEndlessLoop() const { return EndlessLoop; }
 	int getDivision() const { return Division; }
 	int getInitialTempo() const { return InitialTempo; }
 	int getTempo() const { return Tempo; }
@@ -77,6 +146,16 @@ public:
 	}
 	
 	void CreateSMF(std::vector<uint8_t> &file, int looplimit);
+	bool CreateSMF(SMFWriter &writer, int looplimit);
+	bool GetTiming(int &length, int &loopstart, int &loopend);
+	// GetTiming in steps, for callers that must not hold the song's lock during the walk.
+	// StartTiming returns a copy to pass to WalkTiming, or nullptr if GetTiming can answer
+	// without a walk. SetTiming caches the result unless the subsong changed in between.
+	virtual MIDISource *StartTiming(int &epoch);
+	static bool WalkTiming(MIDISource *walker, int &length, int &loopstart, int &loopend);
+	virtual void SetTiming(int epoch, int length, int loopstart, int loopend);
+	// PrecacheData, but only collected once per subsong.
+	const MIDIInstrumentUsage &GetInstrumentUsage();
 
 };
 
@@ -85,29 +164,110 @@ public:
 class MUSSong2 : public MIDISource
 {
 public:
-	MUSSong2(const uint8_t *data, size_t len);
+	MUSSong2(const uint8_t* data, size_t len, std::shared_ptr<const uint8_t> owner = nullptr);
+	MIDISource *Clone() const override;
 	
 protected:
 	void DoInitialSetup() override;
 	void DoRestart() override;
 	bool CheckDone() override;
-	std::vector<uint16_t> PrecacheData() override;
+	MIDIInstrumentUsage PrecacheData() override;
 	uint32_t *MakeEvents(uint32_t *events, uint32_t *max_events_p, uint32_t max_time) override;
 	
 private:
-	std::vector<uint8_t> MusData;
-	uint8_t* MusBuffer;
+	const uint8_t* MusData = nullptr;
+	const uint8_t* MusBuffer;
 	uint8_t LastVelocity[16];
 	size_t MusP, MaxMusP;
 };
 
+// Orders the tracks of a multi-track song by the time until their next event,
+// so that finding the next track to play does not have to look at all of them.
+// Ties go to the lower track number, the same as a linear scan would pick.
+// Since time advances equally for every playing track, only the track that
+// was just played needs to be updated before the next query.
+class TrackQueue
+{
+public:
+	void Reset(int numtracks)
+	{
+		Heap.clear();
+		Pos.assign(numtracks, -1);
+	}
+
+	int Top() const { return Heap.empty() ? -1 : Heap[0]; }
+
+	// Inserts, repositions or removes a track after its delay changed.
+	template<class T> void Update(const T *tracks, int track, bool playing)
+	{
+		int pos = Pos[track];
+		if (!playing)
+		{
+			if (pos >= 0)
+			{
+				int last = Heap.back();
+				Heap.pop_back();
+				Pos[track] = -1;
+				if (last != track)
+				{
+					Heap[pos] = last;
+					Pos[last] = pos;
+					Sift(tracks, pos);
+				}
+			}
+			return;
+		}
+		if (pos < 0)
+		{
+			pos = (int)Heap.size();
+			Heap.push_back(track);
+			Pos[track] = pos;
+		}
+		Sift(tracks, pos);
+	}
+
+private:
+	template<class T> static bool Less(const T *tracks, int a, int b)
+	{
+		return tracks[a].Delay < tracks[b].Delay || (tracks[a].Delay == tracks[b].Delay && a < b);
+	}
+
+	void Swap(int i, int j)
+	{
+		std::swap(Heap[i], Heap[j]);
+		Pos[Heap[i]] = i;
+		Pos[Heap[j]] = j;
+	}
+
+	template<class T> void Sift(const T *tracks, int i)
+	{
+		while (i > 0 && Less(tracks, Heap[i], Heap[(i - 1) / 2]))
+		{
+			Swap(i, (i - 1) / 2);
+			i = (i - 1) / 2;
+		}
+		for (;;)
+		{
+			int smallest = i, l = i * 2 + 1, r = l + 1;
+			if (l < (int)Heap.size() && Less(tracks, Heap[l], Heap[smallest])) smallest = l;
+			if (r < (int)Heap.size() && Less(tracks, Heap[r], Heap[smallest])) smallest = r;
+			if (smallest == i) break;
+			Swap(i, smallest);
+			i = smallest;
+		}
+	}
+
+	std::vector<int> Heap;	// track numbers
+	std::vector<int> Pos;	// heap position of each track, -1 if not playing
+};
 
 // MIDI file played with a MIDI stream --------------------------------------
 
 class MIDISong2 : public MIDISource
 {
 public:
-	MIDISong2(const uint8_t* data, size_t len);
+	MIDISong2(const uint8_t* data, size_t len, std::shared_ptr<const uint8_t> owner = nullptr);
+	MIDISource *Clone() const override;
 	
 protected:
 	void CheckCaps(int tech) override;
@@ -124,13 +284,17 @@ private:
 	void ProcessInitialMetaEvents ();
 	uint32_t *SendCommand (uint32_t *event, TrackInfo *track, uint32_t delay, ptrdiff_t room, bool &sysex_noroom);
 	TrackInfo *FindNextDue ();
+	void RebuildTrackOrder ();
 	
-	std::vector<uint8_t> MusHeader;
+	const uint8_t* MusHeader = nullptr;
+	size_t MusLength = 0;
 	std::vector<TrackInfo> Tracks;
-	TrackInfo *TrackDue;
+	TrackInfo *TrackDue = nullptr;
 	int NumTracks;
 	int Format;
 	uint16_t DesignationMask;
+	TrackQueue TrackOrder;
+	bool TrackOrderValid = false;
 };
 
 // HMI file played with a MIDI stream ---------------------------------------
@@ -159,7 +323,8 @@ protected:
 class HMISong : public MIDISource
 {
 public:
-	HMISong(const uint8_t* data, size_t len);
+	HMISong(const uint8_t* data, size_t len, std::shared_ptr<const uint8_t> owner = nullptr);
+	MIDISource *Clone() const override;
 	
 protected:
 	
@@ -179,17 +344,20 @@ private:
 	void ProcessInitialMetaEvents ();
 	uint32_t *SendCommand (uint32_t *event, TrackInfo *track, uint32_t delay, ptrdiff_t room, bool &sysex_noroom);
 	TrackInfo *FindNextDue ();
+	void RebuildTrackOrder ();
 	
 	static uint32_t ReadVarLenHMI(TrackInfo *);
 	static uint32_t ReadVarLenHMP(TrackInfo *);
 	
-	std::vector<uint8_t> MusHeader;
+	const uint8_t* MusHeader = nullptr;
 	int NumTracks;
 	std::vector<TrackInfo> Tracks;
-	TrackInfo *TrackDue;
-	TrackInfo *FakeTrack;
+	TrackInfo *TrackDue = nullptr;
+	TrackInfo *FakeTrack = nullptr;
 	uint32_t (*ReadVarLen)(TrackInfo *);
 	NoteOffQueue NoteOffs;
+	TrackQueue TrackOrder;
+	bool TrackOrderValid = false;
 };
 
 // XMI file played with a MIDI stream ---------------------------------------
@@ -197,7 +365,9 @@ private:
 class XMISong : public MIDISource
 {
 public:
-	XMISong(const uint8_t* data, size_t len);
+	XMISong(const uint8_t* data, size_t len, std::shared_ptr<const uint8_t> owner = nullptr);
+	MIDISource *Clone() const override;
+	int GetSubsongCount() const override { return NumSongs; }
 	
 protected:
 	bool SetMIDISubsong(int subsong) override;
@@ -218,10 +388,11 @@ private:
 	uint32_t *SendCommand (uint32_t *event, EventSource track, uint32_t delay, ptrdiff_t room, bool &sysex_noroom);
 	EventSource FindNextDue();
 	
-	std::vector<uint8_t> MusHeader;
+	const uint8_t* MusHeader = nullptr;
+	size_t MusLength = 0;
 	int NumSongs;
 	std::vector<TrackInfo> Songs;
-	TrackInfo *CurrSong;
+	TrackInfo *CurrSong = nullptr;
 	NoteOffQueue NoteOffs;
 	EventSource EventDue;
 };
@@ -231,7 +402,8 @@ private:
 class MIDSSong : public MIDISource
 {
 public:
-	MIDSSong(const uint8_t* data, size_t len);
+	MIDSSong(const uint8_t* data, size_t len, std::shared_ptr<const uint8_t> owner = nullptr);
+	MIDISource *Clone() const override;
 
 protected:
 	void DoInitialSetup() override;
@@ -247,4 +419,59 @@ private:
 	void ProcessInitialTempoEvents();
 };
 
+// Plays another source from a flat event list that gets compiled in a single pass.
+// Not suitable for MUS, whose output depends on state that survives a restart.
+// With a density limit, wherever the song starts more notes per second than
+// that, the ones that would hardly be heard get left out, see Compile.
+
+class CompiledMIDISource : public MIDISource
+{
+public:
+	CompiledMIDISource(MIDISource *source, int densitylimit = 0);
+	void CompileFor(int tech);
+	int GetSubsongCount() const override { return Source->GetSubsongCount(); }
+	bool IsHighDensity() const override { return Dense && !Direct; }
+
+protected:
+	void CheckCaps(int tech) override;
+	void DoInitialSetup() override;
+	void DoRestart() override;
+	bool CheckDone() override;
+	MIDIInstrumentUsage PrecacheData() override;
+	bool SetMIDISubsong(int subsong) override;
+	uint32_t *MakeEvents(uint32_t *events, uint32_t *max_events_p, uint32_t max_time) override;
+	bool CalcTiming(int &length, int &loopstart, int &loopend) override;
+
+public:
+	MIDISource *StartTiming(int &epoch) override { return TimingValid ? nullptr : Source->StartTiming(epoch); }
+	void SetTiming(int epoch, int length, int loopstart, int loopend) override { Source->SetTiming(epoch, length, loopstart, loopend); }
+
+private:
+	struct TimelineEvent
+	{
+		uint32_t Tick;		// absolute
+		uint32_t Event;		// as written by the source
+	};
+
+	bool Compile();
+	void CullShortNotes(const std::vector<bool> &dense);
+	void TrackEvent(uint32_t *event);
+
+	std::unique_ptr<MIDISource> Source;
+	std::vector<TimelineEvent> Timeline;
+	std::vector<uint32_t> LongMessages;	// the data of every MEVENT_LONGMSG, in the order they are played
+	size_t Position = 0;
+	size_t LongPosition = 0;
+	uint32_t LastTick = 0;
+	int DensityLimit;	// note-ons per second, 0 for none
+	bool Dense = false;	// the limit was exceeded somewhere
+	int CompiledTech = -1;
+	int CompiledTempo = 500000;
+	bool RestartSetsTempo = false;
+	bool Compiling = false;
+	bool Compiled = false;
+	bool CompileFailed = false;
+	bool Direct = false;	// the timeline cannot represent this playback, so the source plays directly
+};
+
 #endif /* midisources_h */
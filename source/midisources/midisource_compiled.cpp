@@ -0,0 +1,542 @@
+/*
+** midisource_compiled.cpp
+** Plays a MIDI source from a precompiled, time sorted event list.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <deque>
+#include "midisource.h"
+
+// Songs whose unrolled loops would exceed this are played directly.
+static const size_t MAX_TIMELINE_EVENTS = 1 << 22;
+
+// Where a song exceeds its density limit, notes are left out if they are
+// quieter than this, shorter than this, start on a key that already started
+// in the same tick, or would go beyond this many notes sounding at once.
+static const int DENSE_MIN_VELOCITY = 12;
+static const double DENSE_MIN_DURATION = 5000;	// microseconds
+static const int DENSE_MAX_NOTES = 256;
+static const double DENSE_WINDOW = 1000000;		// microseconds the note-ons get counted over
+
+// Follows the song's time and decides which notes the timeline leaves out
+// while it gets compiled. Every note that is left out also loses a note-off
+// for its key, so that the ones that are kept end where they did.
+
+class FDensityFilter
+{
+public:
+	FDensityFilter(int limit, int division, int tempo) : Limit(limit), Division(division), Tempo(tempo)
+	{
+		memset(Held, 0, sizeof(Held));
+		memset(Dropped, 0, sizeof(Dropped));
+		memset(LastStart, 0xff, sizeof(LastStart));
+	}
+
+	// Returns false if the event is to be left out. 'dense' tells if it is a note-on
+	// in a part of the song that exceeds the limit.
+	bool Keep(uint32_t ticks, uint32_t tick, uint32_t event, bool &dense);
+	double Time = 0;	// of the last event, in microseconds
+
+private:
+	int Limit;
+	int Division;
+	int Tempo;
+	int Sounding = 0;
+	uint16_t Held[16][128];		// notes kept and not yet ended
+	uint16_t Dropped[16][128];	// notes left out whose note-off has not come yet
+	uint32_t LastStart[16][128];	// tick of the last note-on kept
+	std::deque<double> Starts;	// times of the note-ons within DENSE_WINDOW
+};
+
+bool FDensityFilter::Keep(uint32_t ticks, uint32_t tick, uint32_t event, bool &dense)
+{
+	dense = false;
+	Time += double(ticks) * Tempo / Division;
+	if (MEVENT_EVENTTYPE(event) == MEVENT_TEMPO)
+	{
+		Tempo = MEVENT_EVENTPARM(event);
+		return true;
+	}
+	if (MEVENT_EVENTTYPE(event) != 0)
+	{
+		return true;
+	}
+	int status = event & 0xF0, chan = event & 15, key = (event >> 8) & 0x7F, velocity = (event >> 16) & 0x7F;
+	if (status == MIDI_NOTEON && velocity > 0)
+	{
+		while (!Starts.empty() && Starts.front() <= Time - DENSE_WINDOW) Starts.pop_front();
+		Starts.push_back(Time);
+		if ((int)Starts.size() > Limit)
+		{
+			dense = true;
+			if (velocity < DENSE_MIN_VELOCITY || LastStart[chan][key] == tick || Sounding >= DENSE_MAX_NOTES)
+			{
+				Dropped[chan][key]++;
+				return false;
+			}
+		}
+		Held[chan][key]++;
+		Sounding++;
+		LastStart[chan][key] = tick;
+	}
+	else if (status == MIDI_NOTEOFF || status == MIDI_NOTEON)
+	{
+		if (Dropped[chan][key] > 0)
+		{
+			Dropped[chan][key]--;
+			return false;
+		}
+		if (Held[chan][key] > 0)
+		{
+			Held[chan][key]--;
+			Sounding--;
+		}
+	}
+	else if (status == MIDI_CTRLCHANGE && (key == 120 || key == 123))
+	{
+		// All sound off, all notes off
+		for (int i = 0; i < 128; i++)
+		{
+			Sounding -= Held[chan][i];
+			Held[chan][i] = Dropped[chan][i] = 0;
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// CompiledMIDISource Constructor
+//
+// Takes ownership of the source. The timeline gets compiled by CompileFor
+// or otherwise when playback starts, because the events depend on the
+// device's capabilities.
+//
+//==========================================================================
+
+CompiledMIDISource::CompiledMIDISource(MIDISource *source, int densitylimit)
+	: Source(source), DensityLimit(densitylimit)
+{
+	Division = source->getDivision();
+	Tempo = source->getTempo();
+	InitialTempo = source->getInitialTempo();
+	// While compiling, the tempo set by the song's initial meta events is only recorded
+	// and gets passed on to the player by DoRestart, like the source would do.
+	Source->setTempoCallback([this](int tempo)
+	{
+		if (Compiling)
+		{
+			RestartSetsTempo = true;
+			CompiledTempo = tempo;
+		}
+		else SetTempo(tempo);
+		return true;
+	});
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: CompileFor
+//
+// Compiles the timeline while the song gets loaded, for the technology
+// the device is expected to have. If the one that gets opened reports
+// another, CheckCaps makes it get compiled again. Sysex messages are
+// always kept, since it is only known at playback if the device can
+// handle them.
+//
+//==========================================================================
+
+void CompiledMIDISource::CompileFor(int tech)
+{
+	Source->CheckCaps(tech);
+	CompiledTech = tech;
+	Compiled = true;
+	CompileFailed = !Compile();
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: CheckCaps
+//
+//==========================================================================
+
+void CompiledMIDISource::CheckCaps(int tech)
+{
+	Source->CheckCaps(tech);
+	if (tech != CompiledTech)
+	{
+		CompiledTech = tech;
+		Compiled = false;
+	}
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: DoInitialSetup
+//
+//==========================================================================
+
+void CompiledMIDISource::DoInitialSetup()
+{
+	Source->DoInitialSetup();
+	for (int i = 0; i < 16; ++i)
+	{
+		ChannelVolumes[i] = Source->getChannelVolume(i);
+	}
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: PrecacheData
+//
+// The timeline has everything the song plays in order, so there is no
+// need to play the source through a second time. Compiling it here
+// instead of at the first restart makes no difference since the device's
+// capabilities are known by the time the instruments get precached.
+//
+//==========================================================================
+
+MIDIInstrumentUsage CompiledMIDISource::PrecacheData()
+{
+	if (!Compiled)
+	{
+		Compiled = true;
+		CompileFailed = !Compile();
+	}
+	if (CompileFailed)
+	{
+		return Source->PrecacheData();
+	}
+	MIDIUsageCollector usage(Division, RestartSetsTempo ? CompiledTempo : InitialTempo);
+	uint32_t tick = 0;
+	for (auto &ev : Timeline)
+	{
+		usage.AddEvent(ev.Tick - tick, ev.Event);
+		tick = ev.Tick;
+	}
+	return std::move(usage.Usage);
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: SetMIDISubsong
+//
+//==========================================================================
+
+bool CompiledMIDISource::SetMIDISubsong(int subsong)
+{
+	if (!Source->SetMIDISubsong(subsong))
+	{
+		return false;
+	}
+	Compiled = false;
+	InvalidateTiming();
+	UsageValid = false;
+	return true;
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: CalcTiming
+//
+//==========================================================================
+
+bool CompiledMIDISource::CalcTiming(int &length, int &loopstart, int &loopend)
+{
+	return Source->GetTiming(length, loopstart, loopend);
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: Compile
+//
+// Plays the source once without looping and records every event with
+// its absolute time. Finite loops get unrolled. With a density limit,
+// the notes that are left out never make it into the timeline, so that
+// songs with millions of them still fit.
+//
+//==========================================================================
+
+bool CompiledMIDISource::Compile()
+{
+	uint32_t buffer[MAX_MIDI_EVENTS * 3];
+	uint32_t tick = 0;
+
+	Timeline.clear();
+	LongMessages.clear();
+	Dense = false;
+	if (skipSysex) Source->SkipSysex();
+	Source->StartPlayback(false);
+	RestartSetsTempo = false;
+	Compiling = true;
+	Source->DoRestart();
+	Compiling = false;
+
+	std::unique_ptr<FDensityFilter> filter;
+	std::vector<bool> dense;	// for every event in the timeline, if it is a note-on in a dense part
+	if (DensityLimit > 0)
+	{
+		filter.reset(new FDensityFilter(DensityLimit, Division, RestartSetsTempo ? CompiledTempo : InitialTempo));
+	}
+
+	while (!Source->CheckDone())
+	{
+		uint32_t *event_end = Source->MakeEvents(buffer, &buffer[MAX_MIDI_EVENTS * 3], 1000000 * 600);
+		if (event_end == buffer)
+		{
+			break;
+		}
+		for (uint32_t *event = buffer; event < event_end; )
+		{
+			tick += event[0];
+			uint32_t words = MEVENT_EVENTTYPE(event[2]) == MEVENT_LONGMSG ? (MEVENT_EVENTPARM(event[2]) + 3) >> 2 : 0;
+			bool densenote = false;
+			if (filter == nullptr || filter->Keep(event[0], tick, event[2], densenote))
+			{
+				Timeline.push_back({ tick, event[2] });
+				LongMessages.insert(LongMessages.end(), event + 3, event + 3 + words);
+				if (filter != nullptr) dense.push_back(densenote);
+			}
+			Dense |= densenote;
+			event += 3 + words;
+		}
+		if (Timeline.size() > MAX_TIMELINE_EVENTS)
+		{
+			Timeline.clear();
+			LongMessages.clear();
+			return false;
+		}
+	}
+	if (Dense)
+	{
+		CullShortNotes(dense);
+	}
+	Timeline.shrink_to_fit();
+	LongMessages.shrink_to_fit();
+	return true;
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: CullShortNotes
+//
+// How long a note lasts is only known once its note-off has been compiled,
+// so the notes of the dense parts that are too short for their attack to
+// be heard get removed afterwards, together with their note-offs.
+//
+//==========================================================================
+
+void CompiledMIDISource::CullShortNotes(const std::vector<bool> &dense)
+{
+	std::vector<bool> remove(Timeline.size());
+	std::vector<std::vector<std::pair<uint32_t, double>>> pending(16 * 128);	// note-ons of every key in the order they started
+	double time = 0;
+	int tempo = RestartSetsTempo ? CompiledTempo : InitialTempo;
+	uint32_t tick = 0;
+
+	for (size_t i = 0; i < Timeline.size(); i++)
+	{
+		uint32_t ev = Timeline[i].Event;
+		time += double(Timeline[i].Tick - tick) * tempo / Division;
+		tick = Timeline[i].Tick;
+		if (MEVENT_EVENTTYPE(ev) == MEVENT_TEMPO)
+		{
+			tempo = MEVENT_EVENTPARM(ev);
+			continue;
+		}
+		if (MEVENT_EVENTTYPE(ev) != 0)
+		{
+			continue;
+		}
+		int status = ev & 0xF0, chan = ev & 15, key = (ev >> 8) & 0x7F, velocity = (ev >> 16) & 0x7F;
+		auto &notes = pending[chan * 128 + key];
+		if (status == MIDI_NOTEON && velocity > 0)
+		{
+			notes.push_back({ uint32_t(i), time });
+		}
+		else if ((status == MIDI_NOTEOFF || status == MIDI_NOTEON) && !notes.empty())
+		{
+			auto start = notes.front();
+			notes.erase(notes.begin());
+			if (dense[start.first] && time - start.second < DENSE_MIN_DURATION)
+			{
+				remove[start.first] = remove[i] = true;
+			}
+		}
+		else if (status == MIDI_CTRLCHANGE && (key == 120 || key == 123))
+		{
+			for (int k = 0; k < 128; k++) pending[chan * 128 + k].clear();
+		}
+	}
+
+	// The last event says when the song ends, so it stays as a NOP.
+	if (!Timeline.empty() && remove.back())
+	{
+		Timeline.back().Event = MEVENT_NOP << 24;
+		remove.back() = false;
+	}
+	size_t out = 0;
+	for (size_t i = 0; i < Timeline.size(); i++)
+	{
+		if (!remove[i]) Timeline[out++] = Timeline[i];
+	}
+	Timeline.resize(out);
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: DoRestart
+//
+//==========================================================================
+
+void CompiledMIDISource::DoRestart()
+{
+	if (!Compiled)
+	{
+		Compiled = true;
+		CompileFailed = !Compile();
+	}
+
+	// The timeline ends where an infinite loop would start over.
+	Direct = CompileFailed || (isLooping && Source->hasEndlessLoop());
+	if (Direct)
+	{
+		if (skipSysex) Source->SkipSysex();
+		Source->StartPlayback(isLooping);
+		Source->DoRestart();
+	}
+	else
+	{
+		Position = 0;
+		LongPosition = 0;
+		LastTick = 0;
+		if (RestartSetsTempo) SetTempo(CompiledTempo);
+	}
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: CheckDone
+//
+//==========================================================================
+
+bool CompiledMIDISource::CheckDone()
+{
+	return Direct ? Source->CheckDone() : Position >= Timeline.size();
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: TrackEvent
+//
+// Keeps the tempo and channel volumes up to date for an event that is
+// about to be played. The volume gets applied here and not while compiling
+// because it can change during playback.
+//
+//==========================================================================
+
+void CompiledMIDISource::TrackEvent(uint32_t *event)
+{
+	uint32_t ev = event[2];
+	if (MEVENT_EVENTTYPE(ev) == MEVENT_TEMPO)
+	{
+		Tempo = MEVENT_EVENTPARM(ev);
+	}
+	else if (MEVENT_EVENTTYPE(ev) == 0 && (ev & 0xF0) == MIDI_CTRLCHANGE && ((ev >> 8) & 0x7F) == 7)
+	{
+		event[2] = (ev & 0xFFFF) | (VolumeControllerChange(ev & 15, (ev >> 16) & 0x7F) << 16);
+	}
+}
+
+//==========================================================================
+//
+// CompiledMIDISource :: MakeEvents
+//
+// Copies events from the timeline until either the buffer is full or
+// max_time has passed.
+//
+//==========================================================================
+
+uint32_t *CompiledMIDISource::MakeEvents(uint32_t *events, uint32_t *max_event_p, uint32_t max_time)
+{
+	if (Direct)
+	{
+		uint32_t *start = events;
+		events = Source->MakeEvents(events, max_event_p, max_time);
+		for (uint32_t *event = start; event < events; )
+		{
+			TrackEvent(event);
+			event += MEVENT_EVENTTYPE(event[2]) == MEVENT_LONGMSG ? 3 + ((MEVENT_EVENTPARM(event[2]) + 3) >> 2) : 3;
+		}
+		return events;
+	}
+
+	uint32_t tot_time = 0;
+	while (Position < Timeline.size())
+	{
+		const TimelineEvent &ev = Timeline[Position];
+		uint32_t delay = ev.Tick - LastTick;
+		// Like the sources, never stop in the middle of a tick.
+		if (delay != 0 && tot_time > max_time)
+		{
+			break;
+		}
+		uint32_t words = MEVENT_EVENTTYPE(ev.Event) == MEVENT_LONGMSG ? (MEVENT_EVENTPARM(ev.Event) + 3) >> 2 : 0;
+		if (events + 3 + words > max_event_p)
+		{
+			break;
+		}
+		tot_time += delay * Tempo / Division;
+		events[0] = delay;
+		events[1] = 0;
+		events[2] = ev.Event;
+		if (words > 0 && skipSysex)
+		{
+			// Compiled before the device turned out to not handle them.
+			events[2] = MEVENT_NOP << 24;
+			LongPosition += words;
+			words = 0;
+		}
+		else if (words > 0)
+		{
+			memcpy(&events[3], &LongMessages[LongPosition], words * sizeof(uint32_t));
+			LongPosition += words;
+		}
+		else
+		{
+			TrackEvent(events);
+		}
+		events += 3 + words;
+		LastTick = ev.Tick;
+		Position++;
+	}
+	return events;
+}
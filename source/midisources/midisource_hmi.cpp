@@ -125,27 +125,40 @@ struct HMISong::TrackInfo
 //
 //==========================================================================
 
-HMISong::HMISong (const uint8_t *data, size_t len)
+HMISong::HMISong (const uint8_t *data, size_t len, std::shared_ptr<const uint8_t> owner)
 {
 	if (len < 0x100)
 	{ // Way too small to be HMI.
 		return;
 	}
-	MusHeader.resize(len);
-	memcpy(MusHeader.data(), data, len);
+	MusHeader = AdoptData(data, len, std::move(owner));
 	NumTracks = 0;
 
 	// Do some validation of the MIDI file
-	if (memcmp(&MusHeader[0], HMI_SONG_MAGIC, sizeof(HMI_SONG_MAGIC)) == 0)
+	if (memcmp(MusHeader, HMI_SONG_MAGIC, sizeof(HMI_SONG_MAGIC)) == 0)
 	{
 		SetupForHMI((int)len);
 	}
-	else if (memcmp(&MusHeader[0], "HMIMIDIP", 8) == 0)
+	else if (memcmp(MusHeader, "HMIMIDIP", 8) == 0)
 	{
 		SetupForHMP((int)len);
 	}
 }
 
+//==========================================================================
+//
+// HMISong :: Clone
+//
+//==========================================================================
+
+MIDISource *HMISong::Clone() const
+{
+	auto song = new HMISong(*this);
+	if (TrackDue) song->TrackDue = song->Tracks.data() + (TrackDue - Tracks.data());
+	if (FakeTrack) song->FakeTrack = song->Tracks.data() + (FakeTrack - Tracks.data());
+	return song;
+}
+
 //==========================================================================
 //
 // HMISong :: SetupForHMI
@@ -156,7 +169,7 @@ void HMISong::SetupForHMI(int len)
 {
 	int i, p;
 
-	auto MusPtr = &MusHeader[0];
+	auto MusPtr = MusHeader;
 
 	ReadVarLen = ReadVarLenHMI;
 	NumTracks = GetShort(MusPtr + HMI_TRACK_COUNT_OFFSET);
@@ -249,7 +262,7 @@ void HMISong::SetupForHMP(int len)
 	int track_data;
 	int i, p;
 
-	auto MusPtr = &MusHeader[0];
+	auto MusPtr = MusHeader;
 
 	ReadVarLen = ReadVarLenHMP;
 	if (MusPtr[8] == 0)
@@ -399,6 +412,7 @@ void HMISong::CheckCaps(int tech)
 			}
 		}
 	}
+	TrackOrderValid = false;
 }
 
 
@@ -447,6 +461,7 @@ void HMISong :: DoRestart()
 	}
 	Tracks[i].Delay = 0;	// for the FakeTrack
 	Tracks[i].Enabled = true;
+	TrackOrderValid = false;
 	TrackDue = Tracks.data();
 	TrackDue = FindNextDue();
 }
@@ -952,7 +967,7 @@ void NoteOffQueue::Heapify()
 //
 // HMISong :: FindNextDue
 //
-// Scans every track for the next event to play. Returns nullptr if all events
+// Finds the track with the next event to play. Returns nullptr if all events
 // have been consumed.
 //
 //==========================================================================
@@ -975,16 +990,17 @@ HMISong::TrackInfo *HMISong::FindNextDue ()
 	}
 
 	// Check regular tracks.
-	track = nullptr;
-	best = 0xFFFFFFFF;
-	for (i = 0; i < NumTracks; ++i)
+	if (!TrackOrderValid)
 	{
-		if (Tracks[i].Enabled && !Tracks[i].Finished && Tracks[i].Delay < best)
-		{
-			best = Tracks[i].Delay;
-			track = &Tracks[i];
-		}
+		RebuildTrackOrder();
+	}
+	else if (TrackDue != FakeTrack)
+	{
+		TrackOrder.Update(Tracks.data(), int(TrackDue - Tracks.data()), TrackDue->Enabled && !TrackDue->Finished);
 	}
+	i = TrackOrder.Top();
+	track = i < 0 ? nullptr : &Tracks[i];
+	best = track ? track->Delay : 0xFFFFFFFF;
 	// Check automatic note-offs.
 	if (NoteOffs.size() != 0 && NoteOffs[0].Delay <= best)
 	{
@@ -994,3 +1010,21 @@ HMISong::TrackInfo *HMISong::FindNextDue ()
 	return track;
 }
 
+//==========================================================================
+//
+// HMISong :: RebuildTrackOrder
+//
+// Needed after anything other than the track just played changed its delay.
+//
+//==========================================================================
+
+void HMISong::RebuildTrackOrder()
+{
+	TrackOrder.Reset(NumTracks);
+	for (int i = 0; i < NumTracks; ++i)
+	{
+		TrackOrder.Update(Tracks.data(), i, Tracks[i].Enabled && !Tracks[i].Finished);
+	}
+	TrackOrderValid = true;
+}
+
@@ -64,7 +64,7 @@
 //
 //==========================================================================
 
-MIDSSong::MIDSSong(const uint8_t* data, size_t len)
+MIDSSong::MIDSSong(const uint8_t* data, size_t len, std::shared_ptr<const uint8_t> owner)
 {
     if (len <= 52)
         return;
@@ -107,6 +107,17 @@ MIDSSong::MIDSSong(const uint8_t* data, size_t len)
     }
 }
 
+//==========================================================================
+//
+// MIDSSong :: Clone
+//
+//==========================================================================
+
+MIDISource *MIDSSong::Clone() const
+{
+	return new MIDSSong(*this);
+}
+
 //==========================================================================
 //
 // MIDSSong :: DoInitialSetup
@@ -53,7 +53,7 @@ int MUSHeaderSearch(const uint8_t *head, int len);
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
-static const uint8_t CtrlTranslate[15] =
+static constexpr uint8_t CtrlTranslate[15] =
 {
 	0,	// program change
 	0,	// bank select
@@ -72,6 +72,12 @@ static const uint8_t CtrlTranslate[15] =
 	121, // reset all controllers
 };
 
+// MUS channel 15 is percussion, which MIDI has on channel 9.
+static constexpr uint8_t ChannelTranslate[16] =
+{
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 15, 9
+};
+
 // PUBLIC DATA DEFINITIONS -------------------------------------------------
 
 // CODE --------------------------------------------------------------------
@@ -85,7 +91,7 @@ static const uint8_t CtrlTranslate[15] =
 //
 //==========================================================================
 
-MUSSong2::MUSSong2 (const uint8_t *data, size_t len)
+MUSSong2::MUSSong2 (const uint8_t *data, size_t len, std::shared_ptr<const uint8_t> owner)
 {
 	int start;
 
@@ -106,9 +112,8 @@ MUSSong2::MUSSong2 (const uint8_t *data, size_t len)
 	{ // It's too short.
 		return;
 	}
-	MusData.resize(len);
-	memcpy(MusData.data(), data, len);
-	auto MusHeader = (MUSHeader*)MusData.data();
+	MusData = AdoptData(data, len, std::move(owner));
+	auto MusHeader = (const MUSHeader*)MusData;
 
 	// Do some validation of the MUS file.
 	if (LittleShort(MusHeader->NumChans) > 15)
@@ -116,12 +121,23 @@ MUSSong2::MUSSong2 (const uint8_t *data, size_t len)
 		return;
 	}
 
-	MusBuffer = MusData.data() + LittleShort(MusHeader->SongStart);
+	MusBuffer = MusData + LittleShort(MusHeader->SongStart);
 	MaxMusP = std::min<int>(LittleShort(MusHeader->SongLen), int(len) - LittleShort(MusHeader->SongStart));
 	Division = 140;
 	Tempo = InitialTempo = 1000000;
 }
 
+//==========================================================================
+//
+// MUSSong2 :: Clone
+//
+//==========================================================================
+
+MIDISource *MUSSong2::Clone() const
+{
+	return new MUSSong2(*this);
+}
+
 //==========================================================================
 //
 // MUSSong2 :: DoInitialSetup
@@ -168,14 +184,16 @@ bool MUSSong2::CheckDone()
 // MUSSong2 :: Precache
 //
 // MUS songs contain information in their header for exactly this purpose.
+// It doesn't say when they get used, so all of them count from the start.
 //
 //==========================================================================
 
-std::vector<uint16_t> MUSSong2::PrecacheData()
+MIDIInstrumentUsage MUSSong2::PrecacheData()
 {
-	auto MusHeader = (MUSHeader*)MusData.data();
-	std::vector<uint16_t> work;
-	const uint8_t *used = MusData.data() + sizeof(MUSHeader) / sizeof(uint8_t);
+	auto MusHeader = (const MUSHeader*)MusData;
+	MIDIInstrumentUsage usage;
+	std::vector<uint16_t> &work = usage.Instruments;
+	const uint8_t *used = MusData + sizeof(MUSHeader) / sizeof(uint8_t);
 	int i, k;
 
 	int numinstr = LittleShort(MusHeader->NumInstruments);
@@ -213,7 +231,8 @@ std::vector<uint16_t> MUSSong2::PrecacheData()
 			work.push_back(val);
 		}
 	}
-	return work;
+	usage.FirstUse.assign(work.size(), 0);
+	return usage;
 }
 
 //==========================================================================
@@ -229,32 +248,25 @@ uint32_t *MUSSong2::MakeEvents(uint32_t *events, uint32_t *max_event_p, uint32_t
 {
 	uint32_t tot_time = 0;
 	uint32_t time = 0;
-	auto MusHeader = (MUSHeader*)MusData.data();
+	auto MusHeader = (const MUSHeader*)MusData;
+	// Work on local copies so that the compiler can keep them in registers.
+	// The byte writes to LastVelocity would force it to reload the members.
+	const uint8_t *buffer = MusBuffer;
+	size_t p = MusP;
 
 	max_time = max_time * Division / Tempo;
 
-	while (events < max_event_p && tot_time <= max_time)
+	while (events < max_event_p && tot_time <= max_time && p < MaxMusP)
 	{
 		uint8_t mid1, mid2;
-		uint8_t channel;
 		uint8_t t = 0, status;
-		uint8_t event = MusBuffer[MusP++];
+		uint8_t event = buffer[p++];
 		
 		if ((event & 0x70) != MUS_SCOREEND)
 		{
-			t = MusBuffer[MusP++];
-		}
-		channel = event & 15;
-
-		// Map MUS channels to MIDI channels
-		if (channel == 15)
-		{
-			channel = 9;
-		}
-		else if (channel >= 9)
-		{
-			channel = channel + 1;
+			t = buffer[p++];
 		}
+		uint8_t channel = ChannelTranslate[event & 15];
 
 		status = channel;
 
@@ -271,7 +283,7 @@ uint32_t *MUSSong2::MakeEvents(uint32_t *events, uint32_t *max_event_p, uint32_t
 			mid1 = t & 127;
 			if (t & 128)
 			{
-				LastVelocity[channel] = MusBuffer[MusP++];
+				LastVelocity[channel] = buffer[p++];
 			}
 			mid2 = LastVelocity[channel];
 			break;
@@ -292,14 +304,14 @@ uint32_t *MUSSong2::MakeEvents(uint32_t *events, uint32_t *max_event_p, uint32_t
 			if (t == 0)
 			{ // program change
 				status |= MIDI_PRGMCHANGE;
-				mid1 = MusBuffer[MusP++];
+				mid1 = buffer[p++];
 				mid2 = 0;
 			}
 			else
 			{
 				status |= MIDI_CTRLCHANGE;
 				mid1 = CtrlTranslate[t];
-				mid2 = MusBuffer[MusP++];
+				mid2 = buffer[p++];
 				if (mid1 == 7)
 				{ // Clamp volume to 127, since DMX apparently allows 8-bit volumes.
 				  // Fix courtesy of Gez, courtesy of Ben Ryves.
@@ -310,7 +322,7 @@ uint32_t *MUSSong2::MakeEvents(uint32_t *events, uint32_t *max_event_p, uint32_t
 			
 		case MUS_SCOREEND:
 		default:
-			MusP = MaxMusP;
+			p = MaxMusP;
 			goto end;
 		}
 
@@ -324,7 +336,7 @@ uint32_t *MUSSong2::MakeEvents(uint32_t *events, uint32_t *max_event_p, uint32_t
 		{
 			do
 			{
-				t = MusBuffer[MusP++];
+				t = buffer[p++];
 				time = (time << 7) | (t & 127);
 			}
 			while (t & 128);
@@ -332,6 +344,7 @@ uint32_t *MUSSong2::MakeEvents(uint32_t *events, uint32_t *max_event_p, uint32_t
 		tot_time += time;
 	}
 end:
+	MusP = p;
 	if (time != 0)
 	{
 		events[0] = time;			// dwDeltaTime
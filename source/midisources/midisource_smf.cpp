@@ -96,14 +96,14 @@ struct MIDISong2::TrackInfo
 //
 //==========================================================================
 
-MIDISong2::MIDISong2 (const uint8_t* data, size_t len)
-: MusHeader(0), Tracks(0)
+MIDISong2::MIDISong2 (const uint8_t* data, size_t len, std::shared_ptr<const uint8_t> owner)
+: Tracks(0)
 {
 	unsigned p;
 	int i;
 
-	MusHeader.resize(len);
-	memcpy(MusHeader.data(), data, len);
+	MusHeader = AdoptData(data, len, std::move(owner));
+	MusLength = len;
 
 	// Do some validation of the MIDI file
 	if (MusHeader[4] != 0 || MusHeader[5] != 0 || MusHeader[6] != 0 || MusHeader[7] != 6)
@@ -133,7 +133,7 @@ MIDISong2::MIDISong2 (const uint8_t* data, size_t len)
 	Tracks.resize(NumTracks);
 
 	// Gather information about each track
-	for (i = 0, p = 14; i < NumTracks && p < MusHeader.size() + 8; ++i)
+	for (i = 0, p = 14; i < NumTracks && p < MusLength + 8; ++i)
 	{
 		uint32_t chunkLen =
 			(MusHeader[p+4]<<24) |
@@ -141,9 +141,9 @@ MIDISong2::MIDISong2 (const uint8_t* data, size_t len)
 			(MusHeader[p+6]<<8)  |
 			(MusHeader[p+7]);
 
-		if (chunkLen + p + 8 > MusHeader.size())
+		if (chunkLen + p + 8 > MusLength)
 		{ // Track too long, so truncate it
-			chunkLen = (uint32_t)MusHeader.size() - p - 8;
+			chunkLen = (uint32_t)MusLength - p - 8;
 		}
 
 		if (MusHeader[p+0] == 'M' &&
@@ -169,6 +169,19 @@ MIDISong2::MIDISong2 (const uint8_t* data, size_t len)
 	}
 }
 
+//==========================================================================
+//
+// MIDISong2 :: Clone
+//
+//==========================================================================
+
+MIDISource *MIDISong2::Clone() const
+{
+	auto song = new MIDISong2(*this);
+	if (TrackDue) song->TrackDue = song->Tracks.data() + (TrackDue - Tracks.data());
+	return song;
+}
+
 //==========================================================================
 //
 // MIDISong2 :: CheckCaps
@@ -255,6 +268,7 @@ void MIDISong2 :: DoRestart()
 	{
 		Tracks[i].Delay = Tracks[i].ReadVarLen();
 	}
+	TrackOrderValid = false;
 	TrackDue = Tracks.data();
 	TrackDue = FindNextDue();
 }
@@ -502,6 +516,10 @@ uint32_t *MIDISong2::SendCommand (uint32_t *events, TrackInfo *track, uint32_t d
 						track->LoopDelay = 0;
 						track->LoopCount = loopcount == 0 ? 0 : loopcount - 1;
 						track->LoopFinished = track->Finished;
+						if (MarkLoops && loopcount == 0)
+						{
+							events[2] = (MEVENT_NOP << 24) | MARKER_LOOPSTART;
+						}
 					}
 				}
 				event = MIDI_META;
@@ -513,6 +531,8 @@ uint32_t *MIDISong2::SendCommand (uint32_t *events, TrackInfo *track, uint32_t d
 					if (track->LoopCount == 0 && !isLooping)
 					{
 						track->Finished = true;
+						EndlessLoop = true;
+						if (MarkLoops) events[2] = (MEVENT_NOP << 24) | MARKER_LOOPEND;
 					}
 					else
 					{
@@ -540,6 +560,10 @@ uint32_t *MIDISong2::SendCommand (uint32_t *events, TrackInfo *track, uint32_t d
 							Tracks[i].LoopCount = loopcount == 0 ? 0 : loopcount - 1;
 							Tracks[i].LoopFinished = Tracks[i].Finished;
 						}
+						if (MarkLoops && loopcount == 0)
+						{
+							events[2] = (MEVENT_NOP << 24) | MARKER_LOOPSTART;
+						}
 					}
 				}
 				event = MIDI_META;
@@ -555,6 +579,8 @@ uint32_t *MIDISong2::SendCommand (uint32_t *events, TrackInfo *track, uint32_t d
 							if (Tracks[i].LoopCount == 0 && !isLooping)
 							{
 								Tracks[i].Finished = true;
+								EndlessLoop = true;
+								if (MarkLoops) events[2] = (MEVENT_NOP << 24) | MARKER_LOOPEND;
 							}
 							else
 							{
@@ -568,6 +594,7 @@ uint32_t *MIDISong2::SendCommand (uint32_t *events, TrackInfo *track, uint32_t d
 							}
 						}
 					}
+					TrackOrderValid = false;
 				}
 				event = MIDI_META;
 				break;
@@ -641,6 +668,15 @@ uint32_t *MIDISong2::SendCommand (uint32_t *events, TrackInfo *track, uint32_t d
 					events[1] = 0;
 					events[2] = (MEVENT_TEMPO << 24) | Tempo;
 					break;
+
+				case MIDI_META_TIMESIG:
+					if (len >= 2)
+					{
+						events[0] = delay;
+						events[1] = 0;
+						events[2] = (MEVENT_NOP << 24) | MARKER_TIMESIG | (track->TrackBegin[track->TrackP] << 8) | (track->TrackBegin[track->TrackP + 1] << 16);
+					}
+					break;
 				}
 				track->TrackP += len;
 				if (track->TrackP == track->MaxTrackP)
@@ -659,7 +695,7 @@ uint32_t *MIDISong2::SendCommand (uint32_t *events, TrackInfo *track, uint32_t d
 		track->Delay = track->ReadVarLen();
 	}
 	// Advance events pointer unless this is a non-delaying NOP.
-	if (events[0] != 0 || MEVENT_EVENTTYPE(events[2]) != MEVENT_NOP)
+	if (events[0] != 0 || events[2] != (MEVENT_NOP << 24))
 	{
 		if (MEVENT_EVENTTYPE(events[2]) == MEVENT_LONGMSG)
 		{
@@ -749,7 +785,7 @@ uint32_t MIDISong2::TrackInfo::ReadVarLen ()
 //
 // MIDISong2 :: FindNextDue
 //
-// Scans every track for the next event to play. Returns nullptr if all events
+// Finds the track with the next event to play. Returns nullptr if all events
 // have been consumed.
 //
 //==========================================================================
@@ -757,7 +793,6 @@ uint32_t MIDISong2::TrackInfo::ReadVarLen ()
 MIDISong2::TrackInfo *MIDISong2::FindNextDue ()
 {
 	TrackInfo *track;
-	uint32_t best;
 	int i;
 
 	// Give precedence to whichever track last had events taken from it.
@@ -772,20 +807,16 @@ MIDISong2::TrackInfo *MIDISong2::FindNextDue ()
 		return Tracks[0].Finished ? nullptr : Tracks.data();
 		
 	case 1:
-		track = nullptr;
-		best = 0xFFFFFFFF;
-		for (i = 0; i < NumTracks; ++i)
+		if (!TrackOrderValid)
 		{
-			if (!Tracks[i].Finished)
-			{
-				if (Tracks[i].Delay < best)
-				{
-					best = Tracks[i].Delay;
-					track = &Tracks[i];
-				}
-			}
+			RebuildTrackOrder();
+		}
+		else
+		{
+			TrackOrder.Update(Tracks.data(), int(TrackDue - Tracks.data()), !TrackDue->Finished);
 		}
-		return track;
+		i = TrackOrder.Top();
+		return i < 0 ? nullptr : &Tracks[i];
 
 	case 2:
 		track = TrackDue;
@@ -798,4 +829,22 @@ MIDISong2::TrackInfo *MIDISong2::FindNextDue ()
 	return nullptr;
 }
 
+//==========================================================================
+//
+// MIDISong2 :: RebuildTrackOrder
+//
+// Needed after anything other than the track just played changed its delay.
+//
+//==========================================================================
+
+void MIDISong2::RebuildTrackOrder()
+{
+	TrackOrder.Reset(NumTracks);
+	for (int i = 0; i < NumTracks; ++i)
+	{
+		TrackOrder.Update(Tracks.data(), i, !Tracks[i].Finished);
+	}
+	TrackOrderValid = true;
+}
+
 
@@ -103,14 +103,14 @@ struct XMISong::TrackInfo
 //
 //==========================================================================
 
-XMISong::XMISong (const uint8_t* data, size_t len)
-: MusHeader(0), Songs(0)
+XMISong::XMISong (const uint8_t* data, size_t len, std::shared_ptr<const uint8_t> owner)
+: Songs(0)
 {
-	MusHeader.resize(len);
-	memcpy(MusHeader.data(), data, len);
+	MusHeader = AdoptData(data, len, std::move(owner));
+	MusLength = len;
 
 	// Find all the songs in this file.
-	NumSongs = FindXMIDforms(&MusHeader[0], (int)MusHeader.size(), nullptr);
+	NumSongs = FindXMIDforms(MusHeader, (int)MusLength, nullptr);
 	if (NumSongs == 0)
 	{
 		return;
@@ -128,11 +128,24 @@ XMISong::XMISong (const uint8_t* data, size_t len)
 
 	Songs.resize(NumSongs);
 	memset(Songs.data(), 0, sizeof(Songs[0]) * NumSongs);
-	FindXMIDforms(&MusHeader[0], (int)MusHeader.size(), Songs.data());
+	FindXMIDforms(MusHeader, (int)MusLength, Songs.data());
 	CurrSong = Songs.data();
 	//DPrintf(DMSG_SPAMMY, "XMI song count: %d\n", NumSongs);
 }
 
+//==========================================================================
+//
+// XMISong :: Clone
+//
+//==========================================================================
+
+MIDISource *XMISong::Clone() const
+{
+	auto song = new XMISong(*this);
+	if (CurrSong) song->CurrSong = song->Songs.data() + (CurrSong - Songs.data());
+	return song;
+}
+
 //==========================================================================
 //
 // XMISong :: FindXMIDforms
@@ -221,6 +234,8 @@ bool XMISong::SetMIDISubsong(int subsong)
 		return false;
 	}
 	CurrSong = &Songs[subsong];
+	InvalidateTiming();
+	UsageValid = false;
 	return true;
 }
 
@@ -442,6 +457,10 @@ uint32_t *XMISong::SendCommand (uint32_t *events, EventSource due, uint32_t dela
 					track->ForLoops[track->ForDepth].LoopBegin = track->EventP;
 					track->ForLoops[track->ForDepth].LoopCount = ClampLoopCount(data2);
 					track->ForLoops[track->ForDepth].LoopFinished = track->Finished;
+					if (MarkLoops && track->ForLoops[track->ForDepth].LoopCount == 0)
+					{
+						events[2] = (MEVENT_NOP << 24) | MARKER_LOOPSTART;
+					}
 				}
 				track->ForDepth++;
 				event = MIDI_META;
@@ -455,6 +474,11 @@ uint32_t *XMISong::SendCommand (uint32_t *events, EventSource due, uint32_t dela
 					{
 						if (data2 < 64 || (track->ForLoops[depth].LoopCount == 0 && !isLooping))
 						{ // throw away this loop.
+							if (data2 >= 64)
+							{
+								EndlessLoop = true;
+								if (MarkLoops) events[2] = (MEVENT_NOP << 24) | MARKER_LOOPEND;
+							}
 							track->ForLoops[depth].LoopCount = 1;
 						}
 						// A loop count of 0 loops forever.
@@ -559,7 +583,7 @@ uint32_t *XMISong::SendCommand (uint32_t *events, EventSource due, uint32_t dela
 		track->Delay = track->ReadDelay();
 	}
 	// Advance events pointer unless this is a non-delaying NOP.
-	if (events[0] != 0 || MEVENT_EVENTTYPE(events[2]) != MEVENT_NOP)
+	if (events[0] != 0 || events[2] != (MEVENT_NOP << 24))
 	{
 		if (MEVENT_EVENTTYPE(events[2]) == MEVENT_LONGMSG)
 		{
@@ -35,13 +35,22 @@
 // HEADER FILES ------------------------------------------------------------
 
 #include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <assert.h>
+#include <math.h>
 #include "zmusic/zmusic_internal.h"
 #include "zmusic/musinfo.h"
 #include "mididevices/mididevice.h"
+#include "mididevices/midichasestate.h"
 #include "midisources/midisource.h"
+#include "zmusic/profile.h"
+#include "zmusic/jobs.h"
+#include "zmusic/ringbuffer.h"
 #include "critsec.h"
 
 #ifdef HAVE_SYSTEM_MIDI
@@ -54,15 +63,58 @@
 
 enum
 {
-	MAX_TIME	= (1000000/10)	// Send out 1/10 of a sec of events at a time.
+	MAX_TIME	= (1000000/10),	// Send out 1/10 of a sec of events at a time.
+	OFFLINE_TIME	= 1000000,	// Nobody can interact with an offline render so it can batch a lot more.
+	MIN_BUFFER_TIME	= 1000,
+	MAX_BUFFER_TIME	= 10000000,
+	SEEK_SNAPSHOT_TIME	= 10000000,	// Seeking keeps a snapshot of the song's state every 10 seconds.
+	DENSE_BUFFER_EVENTS	= 1024,	// events per buffer for songs with CompiledMIDISource's density limit exceeded.
+	SWAP_FADE_TIME	= 50,	// ms the replaced device fades out over after a device change.
+	PAUSE_SLEEP_TIME	= 500	// ms a paused song has to stay silent for before its synth stops being rendered.
 };
 
+// Quieter than the least significant bit of 16 bit output.
+static const float PAUSE_SILENCE = 1.f / 32768;
+
 // PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
 
+static void DeleteDeviceLater(MIDIDevice *dev);
+
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
+// A point a seek can resume from without walking the song from its start.
+
+struct MIDISeekSnapshot
+{
+	double Time;	// microseconds
+	double Tempo;
+	MIDIChaseState Chase;
+	MIDIMeter Meter;
+	std::unique_ptr<MIDISource> Source;	// the song's state at that time, never played itself
+};
+
+// What a device was created for. A pooled device can only stand in for a new
+// one if all of it is the same, see zmusic_snd_devicepool.
+struct MIDIDeviceKey
+{
+	EMidiDevice Type = MDEV_DEFAULT;	// MDEV_DEFAULT for devices that cannot be pooled.
+	std::string Args;
+	int SampleRate = 0;
+	bool Stems = false;
+	ZMusicConfigSet *Config = nullptr;
+	unsigned Generation = 0;	// of Config, which changes with every setting.
+
+	bool operator==(const MIDIDeviceKey &other) const
+	{
+		return Type == other.Type && Args == other.Args && SampleRate == other.SampleRate && Stems == other.Stems &&
+			Config == other.Config && Generation == other.Generation;
+	}
+};
+
+static void MIDI_PoolDevice(const MIDIDeviceKey &key, MIDIDevice *dev);
+
 // Base class for streaming MUS and MIDI files ------------------------------
 
 class MIDIStreamer : public MusInfo
@@ -80,25 +132,51 @@ public:
 	bool IsMIDI() const override;
 	bool IsValid() const override;
 	bool SetSubsong(int subsong) override;
+	int GetSubsongCount() override { return source->GetSubsongCount(); }
+	bool SetPosition(unsigned int ms) override;
+	MusInfo *Clone() override;
 	void Update() override;
 	std::string GetStats() override;
-	void ChangeSettingInt(const char* setting, int value) override;
-	void ChangeSettingNum(const char* setting, double value) override;
-	void ChangeSettingString(const char* setting, const char* value) override;
+	void ChangeSettingInt(ESongSetting setting, int value) override;
+	void ChangeSettingNum(ESongSetting setting, double value) override;
 	int ServiceEvent();
 	void SetMIDISource(MIDISource* _source);
 	bool ServiceStream(void* buff, int len) override;
 	SoundStreamInfoEx GetStreamInfoEx() const override;
+	bool SetOfflineMode(bool on, int flags) override;
+	bool SetEventBuffering(int numbuffers, int buffertime) override;
+	bool SetGain(float gain, int fade_ms) override;
+	bool SetExternalEffects(bool on) override;
+	const float *GetEffectSends() override;
+	bool SetStems(int numstems, const uint8_t *channelstems) override;
+	const float *GetStems(int &numstems, int &frames) override;
+	int AddLayer(MIDISource *layersource, bool looping) override;
+	bool RemoveLayer(int layer) override;
+	bool IsLayerPlaying(int layer) override;
+	bool GetTiming(int &length, int &loopstart, int &loopend) override { return source->GetTiming(length, loopstart, loopend); }
+	MIDISource *StartTiming(int &epoch) override { return source->StartTiming(epoch); }
+	void SetTiming(int epoch, int length, int loopstart, int loopend) override { source->SetTiming(epoch, length, loopstart, loopend); }
+	std::vector<uint16_t> GetInstruments() override { return source->GetInstrumentUsage().Instruments; }
+	void Prepare() override;
+	void Prefetch() override;
+	bool ReloadSoundFonts() override;
+	bool SwapDevice() override;
+	bool SetVirtual(bool on) override;
+	bool SendMidiEvents(const ZMusicMidiEvent *events, int count, uint32_t offset) override;
+	bool GetChannelActivity(ZMusicChannelActivity *channels) override;
+	bool GetPosition(ZMusicPosition &pos, double &ticksperframe) override;
 
 	int GetDeviceType() const override;
 
-	bool DumpWave(const char* filename, int subsong, int samplerate);
+	bool DumpWave(const char* filename, int subsong, int samplerate, FCriticalSection *setuplock = nullptr);
+	static EMidiDevice SelectMIDIDevice(EMidiDevice devtype);
 
 
 protected:
 	MIDIStreamer(const char* dumpname, EMidiDevice type);
 
 	void OutputVolume(uint32_t volume);
+	bool TakeGain();
 	int FillBuffer(int buffer_num, int max_events, uint32_t max_time);
 	int FillStopBuffer(int buffer_num);
 	uint32_t* WriteStopNotes(uint32_t* events);
@@ -107,12 +185,23 @@ protected:
 	void Precache();
 	void StartPlayback();
 	bool InitPlayback();
+	void UnprepareBuffers();
+	void FinishSwap();
+	void CancelSwap();
+	void PlayLayer(SoftSynthMIDIDevice *host, int channelbase, bool looping);
+	void StopLayers();
+	void TakeLiveInput(SoftSynthMIDIDevice *device);
+	void StoreActivity(SoftSynthMIDIDevice *device);
+	void SetupLoopCache(SoftSynthMIDIDevice *device);
+	bool CanSleep();
+	uint32_t *EventBuffer(int buffer_num) { return &Events[buffer_num * BufferEvents * 3]; }
 
 	//void SetMidiSynth(MIDIDevice *synth);
 
 
-	static EMidiDevice SelectMIDIDevice(EMidiDevice devtype);
-	MIDIDevice* CreateMIDIDevice(EMidiDevice devtype, int samplerate);
+	MIDIDevice* CreateMIDIDevice(EMidiDevice devtype, int samplerate, bool fullrate = false);
+	MIDIDeviceKey GetDeviceKey(EMidiDevice devtype, int samplerate) const;
+	MIDIDevice *ObtainMIDIDevice(const MIDIDeviceKey &key);
 
 	static void Callback(void* userdata);
 
@@ -124,10 +213,17 @@ protected:
 	};
 
 	std::unique_ptr<MIDIDevice> MIDI;
-	uint32_t Events[2][MAX_MIDI_EVENTS * 3];
-	MidiHeader Buffer[2];
+	MIDIDeviceKey DeviceKey;	// of MIDI, if it may go to the device pool after the song.
+	std::unique_ptr<MIDIDevice> PreparedDevice;
+	MIDIDeviceKey PreparedKey;
+	std::vector<uint32_t> Events;
+	std::vector<MidiHeader> Buffer;
+	int NumBuffers = 2;
+	int BufferEvents = MAX_MIDI_EVENTS;	// room in each buffer, set by StartPlayback.
+	int PendingNumBuffers = 0;	// takes effect at the next StartPlayback. 0 uses the device's default.
 	int BufferNum;
 	int EndQueued;
+	int DrainBuffers;	// buffers still to play out after the song end before EndQueued gets set, -1 if not at the end yet.
 	bool VolumeChanged;
 	bool Restarting;
 	bool InitialPlayback;
@@ -136,8 +232,62 @@ protected:
 	EMidiDevice DeviceType;
 	bool CallbackIsThreaded;
 	int LoopLimit;
+	uint32_t BufferTime = MAX_TIME;
+	uint32_t StreamBufferTime = MAX_TIME;	// what BufferTime gets reset to after an offline render.
+	bool OfflineLooping = false;
+	bool OfflineRender = false;
 	std::string Args;
 	std::unique_ptr<MIDISource> source;
+
+	// Written by SetGain without locking and taken over by whichever thread feeds the device.
+	std::atomic<float> PendingGain{ 1.f };
+	std::atomic<int> PendingGainFade{ 0 };
+	std::atomic<uint32_t> GainSerial{ 0 };
+	uint32_t AppliedGainSerial = 0;
+
+	// Written by SendMidiEvents and passed on to the device by ServiceStream. Every call
+	// writes one block of records, each made of the frame the event is due at, its size
+	// in words and the event as it would be in a MidiHeader.
+	enum { LIVE_INPUT_SIZE = 32 * 1024 };
+	FRingBuffer LiveInput;
+	std::mutex LiveInputLock;	// only taken by the senders.
+	std::atomic<bool> TakesLiveInput{ false };	// while a software synth plays.
+	std::vector<uint32_t> LiveEvent;
+
+	// Stored by ServiceStream for GetChannelActivity, once that asked for them.
+	struct ChannelActivity
+	{
+		std::atomic<int> Voices{ 0 };
+		std::atomic<float> Level{ 0.f };
+		std::atomic<int> Program{ 0 };
+	};
+	ChannelActivity Activity[16];
+	std::atomic<bool> ActivityWanted{ false };
+	bool ExternalEffects = false;	// kept across device changes
+	int NumStems = 0;				// "
+	uint8_t ChannelStems[16] = {};
+	float Gain = 1.f;
+	int GainFade = 0;
+	int PausedSilence = 0;	// frames the device has stayed silent for while paused, see ServiceStream.
+	unsigned LoopCacheGeneration = 0;	// of Config when the loop cache last started over.
+
+	// Built up by the seeks themselves, so songs that never seek don't pay for it.
+	std::vector<MIDISeekSnapshot> SeekIndex;
+	bool SeekIndexLooping = false;
+
+	// Device changes, see SwapDevice. The job only touches SwapResult.
+	MIDIChaseState Played;	// recorded by the device while it plays
+	std::vector<uint16_t> Instruments;	// what StartPlayback precached
+	FJob PrecacheJob;	// loads the instruments StartPlayback left for later, see zmusic_snd_midiquickstart
+	FJob SwapJob;
+	std::mutex SwapLock;
+	std::unique_ptr<MIDIDevice> SwapResult;
+	std::atomic<bool> SwapPending{ false };
+	std::unique_ptr<MIDIDevice> FadingDevice;
+	std::vector<float> FadeBuffer;
+
+	// Other songs on this song's synth, see AddLayer. Slot i plays on channels 16*(i+1) and up.
+	std::unique_ptr<MIDIStreamer> Layers[MAX_MIDI_LAYERS];
 };
 
 
@@ -153,9 +303,10 @@ protected:
 
 MIDIStreamer::MIDIStreamer(EMidiDevice type, const char *args)
 :
-  DeviceType(type), Args(args)
+  Events(2 * MAX_MIDI_EVENTS * 3), Buffer(2), DeviceType(type), Args(args)
 {
-	memset(Buffer, 0, sizeof(Buffer));
+	LiveInput.Resize(LIVE_INPUT_SIZE);
+	LiveEvent.resize(LIVE_INPUT_SIZE / 4);
 }
 
 //==========================================================================
@@ -167,6 +318,7 @@ MIDIStreamer::MIDIStreamer(EMidiDevice type, const char *args)
 MIDIStreamer::~MIDIStreamer()
 {
 	Stop();
+	if (PreparedDevice != nullptr) MIDI_PoolDevice(PreparedKey, PreparedDevice.release());
 }
 
 //==========================================================================
@@ -243,6 +395,12 @@ EMidiDevice MIDIStreamer::SelectMIDIDevice(EMidiDevice device)
 	}
 }
 
+// For the render cache, which needs the device before the song creates it.
+EMidiDevice MIDI_SelectDevice(EMidiDevice device)
+{
+	return MIDIStreamer::SelectMIDIDevice(device);
+}
+
 //==========================================================================
 //
 // MIDIStreamer :: CreateMIDIDevice
@@ -251,10 +409,24 @@ EMidiDevice MIDIStreamer::SelectMIDIDevice(EMidiDevice device)
 
 static EMidiDevice lastRequestedDevice, lastSelectedDevice;
 
-MIDIDevice *MIDIStreamer::CreateMIDIDevice(EMidiDevice devtype, int samplerate)
+// The synths that render at whatever rate they are given, which can then be
+// lower than the output rate, see zmusic_snd_midirenderrate.
+static bool CanRenderReduced(int devtype)
+{
+	return devtype == MDEV_GUS || devtype == MDEV_ADL || devtype == MDEV_FLUIDSYNTH || devtype == MDEV_TIMIDITY || devtype == MDEV_WILDMIDI;
+}
+
+MIDIDevice *MIDIStreamer::CreateMIDIDevice(EMidiDevice devtype, int samplerate, bool fullrate)
 {
 	bool checked[MDEV_COUNT] = { false };
 
+	// Stems and shared effects have buffers of their own that would not match the resampled output.
+	int renderrate = samplerate;
+	if (!fullrate && NumStems == 0 && !ExternalEffects && miscConfig.snd_midirenderrate > 0 && miscConfig.snd_midirenderrate < samplerate)
+	{
+		renderrate = miscConfig.snd_midirenderrate;
+	}
+
 	MIDIDevice *dev = nullptr;
 	if (devtype == MDEV_SNDSYS) devtype = MDEV_FLUIDSYNTH;
 	EMidiDevice requestedDevice = devtype, selectedDevice;
@@ -266,11 +438,11 @@ MIDIDevice *MIDIStreamer::CreateMIDIDevice(EMidiDevice devtype, int samplerate)
 			switch (devtype)
 			{
 			case MDEV_GUS:
-				dev = CreateTimidityMIDIDevice(Args.c_str(), samplerate);
+				dev = CreateTimidityMIDIDevice(Args.c_str(), renderrate);
 				break;
 
 			case MDEV_ADL:
-				dev = CreateADLMIDIDevice(Args.c_str());
+				dev = CreateADLMIDIDevice(Args.c_str(), renderrate);
 				break;
 
 			case MDEV_OPN:
@@ -290,7 +462,7 @@ MIDIDevice *MIDIStreamer::CreateMIDIDevice(EMidiDevice devtype, int samplerate)
 				// Intentional fall-through for systems without standard midi support
 
 			case MDEV_FLUIDSYNTH:
-				dev = CreateFluidSynthMIDIDevice(samplerate, Args.c_str());
+				dev = CreateFluidSynthMIDIDevice(renderrate, Args.c_str(), NumStems > 0);
 				break;
 
 			case MDEV_OPL:
@@ -298,11 +470,11 @@ MIDIDevice *MIDIStreamer::CreateMIDIDevice(EMidiDevice devtype, int samplerate)
 				break;
 
 			case MDEV_TIMIDITY:
-				dev = CreateTimidityPPMIDIDevice(Args.c_str(), samplerate);
+				dev = CreateTimidityPPMIDIDevice(Args.c_str(), renderrate);
 				break;
 
 			case MDEV_WILDMIDI:
-				dev = CreateWildMIDIDevice(Args.c_str(), samplerate);
+				dev = CreateWildMIDIDevice(Args.c_str(), renderrate);
 				break;
 
 			default:
@@ -351,6 +523,10 @@ MIDIDevice *MIDIStreamer::CreateMIDIDevice(EMidiDevice devtype, int samplerate)
 		lastSelectedDevice = selectedDevice;
 		ZMusic_Printf(ZMUSIC_MSG_ERROR, "Unable to create %s MIDI device. Falling back to %s\n", devnames[requestedDevice], devnames[selectedDevice]);
 	}
+	if (renderrate != samplerate && CanRenderReduced(dev->GetDeviceType()))
+	{
+		static_cast<SoftSynthMIDIDevice*>(dev)->SetOutputRate(samplerate);
+	}
 	return dev;
 }
 
@@ -370,17 +546,194 @@ void MIDIStreamer::Play(bool looping, int subsong)
 	m_Looping = looping;
 	source->SetMIDISubsong(subsong);
 	devtype = SelectMIDIDevice(DeviceType);
-	MIDI.reset(CreateMIDIDevice(devtype, miscConfig.snd_outputrate));
+	DeviceKey = GetDeviceKey(devtype, miscConfig.snd_outputrate);
+	if (PreparedDevice && PreparedKey == DeviceKey)
+	{
+		MIDI = std::move(PreparedDevice);
+	}
+	else
+	{
+		if (PreparedDevice) MIDI_PoolDevice(PreparedKey, PreparedDevice.release());
+		MIDI.reset(ObtainMIDIDevice(DeviceKey));
+	}
 	InitPlayback();
 }
 
+//==========================================================================
+//
+// MIDIStreamer :: Prepare
+//
+// Creating the device is what takes time since this is where the synths
+// load their instruments. Play will pick it up if the configuration has
+// not changed in between.
+//
+//==========================================================================
+
+void MIDIStreamer::Prepare()
+{
+	if (source == nullptr || MIDI != nullptr) return;
+	PreparedKey = GetDeviceKey(SelectMIDIDevice(DeviceType), miscConfig.snd_outputrate);
+	PreparedDevice.reset(ObtainMIDIDevice(PreparedKey));
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: Prefetch
+//
+// Also runs the instrument prepass and loads what it found, which for a
+// song that is about to be closed is left to the device pool and the
+// synths' own caches.
+//
+//==========================================================================
+
+void MIDIStreamer::Prefetch()
+{
+	Prepare();
+	if (PreparedDevice == nullptr || PreparedDevice->GetTechnology() != MIDIDEV_SWSYNTH) return;
+	const MIDIInstrumentUsage &usage = source->GetInstrumentUsage();
+	PreparedDevice->PrecacheInstruments(usage.Instruments.data(), (int)usage.Instruments.size());
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: GetDeviceKey
+//
+//==========================================================================
+
+MIDIDeviceKey MIDIStreamer::GetDeviceKey(EMidiDevice devtype, int samplerate) const
+{
+	MIDIDeviceKey key;
+	key.Type = devtype;
+	key.Args = Args;
+	key.SampleRate = samplerate;
+	key.Stems = NumStems > 0;
+	key.Config = CurrentConfig;
+	key.Generation = CurrentConfig->Generation;
+	return key;
+}
+
+//==========================================================================
+//
+// Device pool
+//
+// Stopped songs leave their software synth here, with its instruments still
+// loaded, so that the next song that would create the same device can take
+// it over instead. zmusic_snd_devicepool says how many are kept, the ones
+// unused for the longest go first.
+//
+//==========================================================================
+
+struct FPooledDevice
+{
+	MIDIDeviceKey Key;
+	MIDIDevice *Device;	// like the sound font cache, whatever is left at exit is not torn down.
+};
+
+static std::mutex DevicePoolLock;
+static std::vector<FPooledDevice> DevicePool;	// oldest first
+
+static void MIDI_PoolDevice(const MIDIDeviceKey &key, MIDIDevice *dev)
+{
+	if (key.Type == MDEV_DEFAULT || key.Generation != key.Config->Generation ||
+		GlobalConfig.misc.snd_devicepool <= 0 || dev->GetTechnology() != MIDIDEV_SWSYNTH)
+	{
+		delete dev;
+		return;
+	}
+	static_cast<SoftSynthMIDIDevice*>(dev)->Recycle();
+	std::lock_guard<std::mutex> lock(DevicePoolLock);
+	DevicePool.push_back({ key, dev });
+	while (DevicePool.size() > (size_t)GlobalConfig.misc.snd_devicepool)
+	{
+		DeleteDeviceLater(DevicePool.front().Device);
+		DevicePool.erase(DevicePool.begin());
+	}
+}
+
+// Without a match the pooled devices of the same type get deleted right away.
+// Mostly their settings are outdated, and some synths, like Timidity++, cannot
+// have devices with different settings at the same time.
+static MIDIDevice *MIDI_TakePooledDevice(const MIDIDeviceKey &key)
+{
+	std::vector<MIDIDevice *> outdated;
+	{
+		std::lock_guard<std::mutex> lock(DevicePoolLock);
+		for (size_t i = DevicePool.size(); i-- > 0; )
+		{
+			if (DevicePool[i].Key == key)
+			{
+				auto dev = DevicePool[i].Device;
+				DevicePool.erase(DevicePool.begin() + i);
+				return dev;
+			}
+		}
+		for (size_t i = DevicePool.size(); i-- > 0; )
+		{
+			if (DevicePool[i].Key.Type == key.Type)
+			{
+				outdated.push_back(DevicePool[i].Device);
+				DevicePool.erase(DevicePool.begin() + i);
+			}
+		}
+	}
+	for (auto dev : outdated) delete dev;
+	return nullptr;
+}
+
+// Frees the pooled devices of one context, or all of them for nullptr, as
+// well as those whose settings have changed since they were created.
+void MIDI_ReleaseDevicePool(ZMusicConfigSet *config)
+{
+	std::lock_guard<std::mutex> lock(DevicePoolLock);
+	auto stale = [=](const FPooledDevice &entry)
+	{
+		return config == nullptr || entry.Key.Config == config || entry.Key.Generation != entry.Key.Config->Generation;
+	};
+	for (auto &entry : DevicePool)
+	{
+		if (stale(entry)) DeleteDeviceLater(entry.Device);
+	}
+	DevicePool.erase(std::remove_if(DevicePool.begin(), DevicePool.end(), stale), DevicePool.end());
+}
+
+// Deletes all pooled devices on the calling thread, for ZMusic_TrimMemory.
+void MIDI_EmptyDevicePool()
+{
+	std::vector<FPooledDevice> pool;
+	{
+		std::lock_guard<std::mutex> lock(DevicePoolLock);
+		pool.swap(DevicePool);
+	}
+	for (auto &entry : pool)
+	{
+		entry.Device->Close();
+		delete entry.Device;
+	}
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: ObtainMIDIDevice
+//
+//==========================================================================
+
+MIDIDevice *MIDIStreamer::ObtainMIDIDevice(const MIDIDeviceKey &key)
+{
+	auto dev = MIDI_TakePooledDevice(key);
+	if (dev != nullptr) return dev;
+	return CreateMIDIDevice(key.Type, key.SampleRate);
+}
+
 //==========================================================================
 //
 // MIDIStreamer :: DumpWave
 //
+// When several songs get dumped at once, setuplock serializes the device
+// setup, which works on the global configuration.
+//
 //==========================================================================
 
-bool MIDIStreamer::DumpWave(const char *filename, int subsong, int samplerate)
+bool MIDIStreamer::DumpWave(const char *filename, int subsong, int samplerate, FCriticalSection *setuplock)
 {
 	m_Looping = false;
 	if (source == nullptr) return false;	// We have nothing to play so abort.
@@ -392,7 +745,15 @@ bool MIDIStreamer::DumpWave(const char *filename, int subsong, int samplerate)
 	{
 		throw std::runtime_error("System MIDI device is not supported");
 	}
-	auto iMIDI = CreateMIDIDevice(devtype, samplerate);
+	std::unique_lock<FCriticalSection> lock;
+	if (setuplock) lock = std::unique_lock<FCriticalSection>(*setuplock);
+	auto iMIDI = CreateMIDIDevice(devtype, samplerate, true);
+	// These synths share one instrument set which gets filled in while playing,
+	// so their songs cannot be rendered side by side.
+	if (lock && devtype != MDEV_GUS && devtype != MDEV_TIMIDITY && devtype != MDEV_WILDMIDI)
+	{
+		lock.unlock();
+	}
 	auto writer = new MIDIWaveWriter(filename, static_cast<SoftSynthMIDIDevice*>(iMIDI));
 	MIDI.reset(writer);
 	bool res = InitPlayback();
@@ -415,7 +776,9 @@ bool MIDIStreamer::InitPlayback()
 {
 	m_Status = STATE_Stopped;
 	EndQueued = 0;
+	DrainBuffers = -1;
 	VolumeChanged = false;
+	SeekIndex.clear();	// the song's events depend on the device.
 	Restarting = true;
 	InitialPlayback = true;
 	if (MIDI) MIDI->SetCallback(Callback, this);
@@ -427,6 +790,28 @@ bool MIDIStreamer::InitPlayback()
 
 	source->CheckCaps(MIDI->GetTechnology());
 	if (!MIDI->CanHandleSysex()) source->SkipSysex();
+	if (ExternalEffects && MIDI->GetTechnology() == MIDIDEV_SWSYNTH)
+	{
+		static_cast<SoftSynthMIDIDevice*>(MIDI.get())->SetExternalEffects(true);
+	}
+	if (NumStems > 0 && MIDI->GetTechnology() == MIDIDEV_SWSYNTH)
+	{
+		static_cast<SoftSynthMIDIDevice*>(MIDI.get())->SetStems(NumStems, ChannelStems);
+	}
+	Played = MIDIChaseState();
+	if (MIDI->GetTechnology() == MIDIDEV_SWSYNTH)
+	{
+		static_cast<SoftSynthMIDIDevice*>(MIDI.get())->SetStateRecorder(&Played);
+		SetupLoopCache(static_cast<SoftSynthMIDIDevice*>(MIDI.get()));
+		LiveInput.SkipTo(LiveInput.GetWritePos());	// whatever was sent to the last playback.
+		for (auto &chan : Activity)
+		{
+			chan.Voices.store(0, std::memory_order_relaxed);
+			chan.Level.store(0.f, std::memory_order_relaxed);
+			chan.Program.store(0, std::memory_order_relaxed);
+		}
+		TakesLiveInput.store(true, std::memory_order_release);
+	}
 
 	StartPlayback();
 	if (MIDI == nullptr)
@@ -461,8 +846,27 @@ SoundStreamInfoEx MIDIStreamer::GetStreamInfoEx() const
 
 void MIDIStreamer::StartPlayback()
 {
-	auto data = source->PrecacheData();
-	MIDI->PrecacheInstruments(data.data(), (int)data.size());
+	PrecacheJob.Wait();
+	const MIDIInstrumentUsage &usage = source->GetInstrumentUsage();
+	Instruments = usage.Instruments;
+
+	// Quick start only loads what the song's first seconds need, the rest is left to a job.
+	size_t early = Instruments.size();
+	if (miscConfig.snd_midiquickstart > 0 && MIDI->CanPrecacheWhilePlaying())
+	{
+		uint32_t limit = miscConfig.snd_midiquickstart * 1000;
+		early = std::lower_bound(usage.FirstUse.begin(), usage.FirstUse.end(), limit) - usage.FirstUse.begin();
+	}
+	MIDI->PrecacheInstruments(Instruments.data(), (int)early);
+	if (early < Instruments.size())
+	{
+		auto device = MIDI.get();
+		PrecacheJob.Start(JOB_BACKGROUND, [=]()
+		{
+			// Everything again, since devices keep only the last list to pin it anew when needed.
+			device->PrecacheInstruments(Instruments.data(), (int)Instruments.size());
+		});
+	}
 	source->StartPlayback(m_Looping);
 	
 	// Set time division and tempo.
@@ -472,29 +876,51 @@ void MIDIStreamer::StartPlayback()
 		throw std::runtime_error("Setting MIDI stream speed failed");
 	}
 
+	TakeGain();
+	if (!MIDI->FakeVolume())
+	{
+		static_cast<SoftSynthMIDIDevice*>(MIDI.get())->SetGain(Gain, 0);
+	}
 	MusicVolumeChanged();	// set volume to current music's properties
 	OutputVolume(Volume);
 
 	MIDI->InitPlayback();
 
+	// The buffers can only be resized while none of them is queued.
+	NumBuffers = PendingNumBuffers > 0 ? PendingNumBuffers : MIDI->GetDefaultBuffers();
+	BufferEvents = source->IsHighDensity() ? int(DENSE_BUFFER_EVENTS) : int(MAX_MIDI_EVENTS);
+	Events.resize(NumBuffers * BufferEvents * 3);
+	Buffer.assign(NumBuffers, MidiHeader{});
+
 	// Fill the initial buffers for the song.
 	BufferNum = 0;
 	do
 	{
-		int res = FillBuffer(BufferNum, MAX_MIDI_EVENTS, MAX_TIME);
+		int res = FillBuffer(BufferNum, BufferEvents, BufferTime);
 		if (res == SONG_MORE)
 		{
 			if (0 != MIDI->StreamOutSync(&Buffer[BufferNum]))
 			{
 				throw std::runtime_error("Initial midiStreamOut failed");
 			}
-			BufferNum ^= 1;
+			BufferNum = (BufferNum + 1) % NumBuffers;
 		}
 		else if (res == SONG_DONE)
 		{
-			// Do not play super short songs that can't fill the initial two buffers.
-			Stop();
-			return;
+			if (BufferNum < 2)
+			{
+				// Do not play super short songs that can't fill the initial two buffers.
+				Stop();
+				return;
+			}
+			if (m_Looping)
+			{
+				Restarting = true;
+				continue;
+			}
+			// Whatever did fit gets played before ServiceEvent appends the stop buffer.
+			DrainBuffers = BufferNum - 1;
+			break;
 		}
 		else
 		{
@@ -505,6 +931,20 @@ void MIDIStreamer::StartPlayback()
 	while (BufferNum != 0);
 }
 
+//==========================================================================
+//
+// MIDIStreamer :: UnprepareBuffers
+//
+//==========================================================================
+
+void MIDIStreamer::UnprepareBuffers()
+{
+	for (auto &header : Buffer)
+	{
+		MIDI->UnprepareHeader(&header);
+	}
+}
+
 //==========================================================================
 //
 // MIDIStreamer :: Pause
@@ -512,6 +952,8 @@ void MIDIStreamer::StartPlayback()
 // "Pauses" the song by setting it to zero volume and filling subsequent
 // buffers with NOPs until the song is unpaused. A MIDI device that
 // supports real pauses will return true from its Pause() method.
+// Software synths keep playing out what was sounding, and once that has
+// died away ServiceStream stops rendering them until the song is resumed.
 //
 //==========================================================================
 
@@ -559,17 +1001,21 @@ void MIDIStreamer::Resume()
 void MIDIStreamer::Stop()
 {
 	EndQueued = 4;
+	TakesLiveInput.store(false, std::memory_order_relaxed);
+	CancelSwap();
+	StopLayers();
+	PrecacheJob.Wait();
 
 	if (MIDI != NULL && MIDI->IsOpen())
 	{
 		MIDI->Stop();
-		MIDI->UnprepareHeader(&Buffer[0]);
-		MIDI->UnprepareHeader(&Buffer[1]);
+		UnprepareBuffers();
 		MIDI->Close();
 	}
 	if (MIDI != nullptr)
 	{
-		MIDI.reset();
+		MIDI_PoolDevice(DeviceKey, MIDI.release());
+		DeviceKey = {};
 	}
 	m_Status = STATE_Stopped;
 }
@@ -610,6 +1056,7 @@ void MIDIStreamer::MusicVolumeChanged()
 	{
 		float realvolume = miscConfig.snd_musicvolume * miscConfig.relative_volume * miscConfig.snd_mastervolume;
 		if (realvolume < 0 || realvolume > 1) realvolume = 1;
+		realvolume = std::min(realvolume * Gain, 1.f);
 		Volume = (uint32_t)(realvolume * 65535.f);
 	}
 	else
@@ -629,8 +1076,9 @@ void MIDIStreamer::MusicVolumeChanged()
 //
 //==========================================================================
 
-void MIDIStreamer::ChangeSettingInt(const char *setting, int value)
+void MIDIStreamer::ChangeSettingInt(ESongSetting setting, int value)
 {
+	std::lock_guard<FCriticalSection> lock(CritSec);	// a device change may replace MIDI.
 	if (MIDI != NULL)
 	{
 		MIDI->ChangeSettingInt(setting, value);
@@ -643,28 +1091,15 @@ void MIDIStreamer::ChangeSettingInt(const char *setting, int value)
 //
 //==========================================================================
 
-void MIDIStreamer::ChangeSettingNum(const char *setting, double value)
+void MIDIStreamer::ChangeSettingNum(ESongSetting setting, double value)
 {
+	std::lock_guard<FCriticalSection> lock(CritSec);	// a device change may replace MIDI.
 	if (MIDI != NULL)
 	{
 		MIDI->ChangeSettingNum(setting, value);
 	}
 }
 
-//==========================================================================
-//
-// MIDIDeviceStreamer :: ChangeSettingString
-//
-//==========================================================================
-
-void MIDIStreamer::ChangeSettingString(const char *setting, const char *value)
-{
-	if (MIDI != NULL)
-	{
-		MIDI->ChangeSettingString(setting, value);
-	}
-}
-
 
 //==========================================================================
 //
@@ -685,138 +1120,516 @@ void MIDIStreamer::OutputVolume (uint32_t volume)
 
 //==========================================================================
 //
-// MIDIStreamer :: Callback											Static
+// MIDIStreamer :: SetGain
+//
+// Software synths ramp to the new gain on their output. Devices that
+// fake their volume get it folded into the channel volume controllers
+// with the next buffer, without a ramp.
 //
 //==========================================================================
 
-void MIDIStreamer::Callback(void *userdata)
+bool MIDIStreamer::SetGain(float gain, int fade_ms)
 {
-	MIDIStreamer *self = (MIDIStreamer *)userdata;
-
-	if (self->EndQueued >= 4)
-	{
-		return;
-	}
-	self->ServiceEvent();
+	PendingGainFade.store(fade_ms, std::memory_order_relaxed);
+	PendingGain.store(gain, std::memory_order_relaxed);
+	GainSerial.fetch_add(1, std::memory_order_release);
+	return true;
 }
 
 //==========================================================================
 //
-// MIDIStreamer :: Update
+// MIDIStreamer :: SetVirtual
 //
-// Called periodically to see if the player thread is still alive. If it
-// isn't, stop playback now.
+// Only software synths can do this, since a hardware device plays in real
+// time no matter what.
 //
 //==========================================================================
 
-void MIDIStreamer::Update()
+bool MIDIStreamer::SetVirtual(bool on)
 {
-	if (MIDI != nullptr && !MIDI->Update())
-	{
-		std::lock_guard<FCriticalSection> lock(CritSec);
-		Stop();
-	}
+	if (!MIDI || MIDI->GetTechnology() != MIDIDEV_SWSYNTH) return false;
+	return static_cast<SoftSynthMIDIDevice*>(MIDI.get())->SetVirtual(on);
 }
 
 //==========================================================================
 //
-// MIDIStreamer :: ServiceEvent
+// MIDIStreamer :: SendMidiEvents
 //
-// Fills the buffer that just finished playing with new events and appends
-// it to the MIDI stream queue. Stops the song if playback is over. Returns
-// non-zero if a problem occured and playback should stop.
+// The records for all events are put together first, so that the stream
+// gets either all of them or none.
 //
 //==========================================================================
 
-int MIDIStreamer::ServiceEvent()
+bool MIDIStreamer::SendMidiEvents(const ZMusicMidiEvent *events, int count, uint32_t offset)
 {
-	int res;
+	if (!TakesLiveInput.load(std::memory_order_acquire)) return false;
 
-	if (EndQueued == 2)
-	{
-		return 0;
-	}
-	if (0 != (res = MIDI->UnprepareHeader(&Buffer[BufferNum])))
+	std::vector<uint32_t> records;
+	records.reserve(count * 5);
+	for (int i = 0; i < count; i++)
 	{
-		return res;
-	}
-fill:
-	if (EndQueued == 1)
-	{
-		res = FillStopBuffer(BufferNum);
-		if ((res & 3) != SONG_ERROR)
-		{
-			EndQueued = 2;
-		}
-	}
-	else
-	{
-		res = FillBuffer(BufferNum, MAX_MIDI_EVENTS, MAX_TIME);
-	}
-	switch (res & 3)
-	{
-	case SONG_MORE:
-		res = MIDI->StreamOut(&Buffer[BufferNum]);
-		if (res != 0)
+		const uint8_t *data = events[i].data;
+		uint32_t len = events[i].length;
+		records.push_back(offset + events[i].offset);
+		if (data[0] == MIDI_SYSEX)
 		{
-			return res;
+			uint32_t words = 3 + (len + 3) / 4;
+			records.push_back(words);
+			size_t pos = records.size();
+			records.resize(pos + words);
+			records[pos + 2] = (MEVENT_LONGMSG << 24) | len;
+			memcpy(&records[pos + 3], data, len);
 		}
 		else
 		{
-			BufferNum ^= 1;
-		}
-		break;
-
-	case SONG_DONE:
-		if (m_Looping)
-		{
-			Restarting = true;
-			goto fill;
+			uint32_t msg = data[0];
+			if (len > 1) msg |= data[1] << 8;
+			if (len > 2) msg |= data[2] << 16;
+			records.insert(records.end(), { 3, 0, 0, msg });
 		}
-		EndQueued = 1;
-		break;
-
-	default:
-		return res >> 2;
 	}
-	return 0;
+
+	std::lock_guard<std::mutex> lock(LiveInputLock);
+	size_t bytes = records.size() * sizeof(uint32_t);
+	if (LiveInput.WriteAvailable() < bytes) return false;
+	LiveInput.Write(records.data(), bytes);
+	return true;
 }
 
 //==========================================================================
 //
-// MIDIStreamer :: FillBuffer
-//
-// Copies MIDI events from the MIDI file and puts them into a MIDI stream
-// buffer. Filling the buffer stops when the song end is encountered, the
-// buffer space is used up, or the maximum time for a buffer is hit.
+// MIDIStreamer :: TakeLiveInput
 //
-// Can return:
-// - SONG_MORE if the buffer was prepared with data.
-// - SONG_DONE if the song's end was reached.
-//             The buffer will never have data in this case.
-// - SONG_ERROR if there was a problem preparing the buffer.
+// Hands the events sent since the last block over to the device, which
+// plays them at their frame from the start of the block it renders next.
 //
 //==========================================================================
 
-int MIDIStreamer::FillBuffer(int buffer_num, int max_events, uint32_t max_time)
+void MIDIStreamer::TakeLiveInput(SoftSynthMIDIDevice *device)
 {
-	if (!Restarting && source->CheckDone())
+	uint32_t header[2];
+	while (LiveInput.ReadAvailable() >= sizeof(header))
 	{
-		return SONG_DONE;
+		LiveInput.Read(header, sizeof(header));
+		LiveInput.Read(LiveEvent.data(), header[1] * sizeof(uint32_t));
+		device->QueueLiveEvent(header[0], LiveEvent.data(), header[1]);
 	}
+}
 
-	int i;
-	uint32_t *events = Events[buffer_num], *max_event_p;
-
-
-	// The final event is for a NOP to hold the delay from the last event.
-	max_event_p = events + (max_events - 1) * 3;
+//==========================================================================
+//
+// MIDIStreamer :: GetChannelActivity
+//
+//==========================================================================
 
-	if (InitialPlayback)
+bool MIDIStreamer::GetChannelActivity(ZMusicChannelActivity *channels)
+{
+	if (!TakesLiveInput.load(std::memory_order_acquire)) return false;
+	ActivityWanted.store(true, std::memory_order_relaxed);
+	for (int i = 0; i < 16; i++)
 	{
-		InitialPlayback = false;
-		// Send the GM System Enable SysEx message.
-		events[0] = 0;								// dwDeltaTime
+		channels[i].voices = Activity[i].Voices.load(std::memory_order_relaxed);
+		channels[i].level = Activity[i].Level.load(std::memory_order_relaxed);
+		channels[i].program = Activity[i].Program.load(std::memory_order_relaxed);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: GetPosition
+//
+// The device follows the ticks as it plays them, so this is where the
+// output is, not where the source has got to with filling the buffers.
+//
+//==========================================================================
+
+bool MIDIStreamer::GetPosition(ZMusicPosition &pos, double &ticksperframe)
+{
+	if (!MIDI || MIDI->GetTechnology() != MIDIDEV_SWSYNTH || m_Status == STATE_Stopped) return false;
+	auto device = static_cast<SoftSynthMIDIDevice*>(MIDI.get());
+	const MIDIMeter &meter = device->GetMeter();
+	const double division = device->GetDivision();
+	pos.tick = device->GetSongTick();
+	pos.ticksPerBeat = meter.TicksPerBeat(division);
+	pos.tempo = 60000000. / device->GetTempo() * division / pos.ticksPerBeat;
+	pos.beatsPerBar = meter.Numerator;
+	meter.GetBeat(pos.tick, division, pos.bar, pos.beat);
+	pos.order = pos.row = -1;
+	ticksperframe = device->GetTicksPerFrame();
+	return true;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: CanSleep
+//
+// If the device may stop being rendered while the song is paused. Not if
+// anything else plays on it or something outside of the stream still
+// wants its output.
+//
+//==========================================================================
+
+bool MIDIStreamer::CanSleep()
+{
+	if (FadingDevice != nullptr || LiveInput.ReadAvailable() > 0 || ExternalEffects || NumStems > 0)
+	{
+		return false;
+	}
+	for (auto &layer : Layers)
+	{
+		if (layer != nullptr) return false;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: StoreActivity
+//
+// Only after the block has been rendered, so that the device reports the
+// voices as they are at its end.
+//
+//==========================================================================
+
+void MIDIStreamer::StoreActivity(SoftSynthMIDIDevice *device)
+{
+	int voices[16];
+	float levels[16];
+	device->GetChannelActivity(voices, levels);
+	for (int i = 0; i < 16; i++)
+	{
+		Activity[i].Voices.store(voices[i], std::memory_order_relaxed);
+		Activity[i].Level.store(std::min(levels[i], 1.f), std::memory_order_relaxed);
+		Activity[i].Program.store(device->GetChannelProgram(i), std::memory_order_relaxed);
+	}
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: SetExternalEffects
+//
+//==========================================================================
+
+bool MIDIStreamer::SetExternalEffects(bool on)
+{
+	if (MIDI == nullptr || MIDI->GetTechnology() != MIDIDEV_SWSYNTH) return false;
+	if (on && static_cast<SoftSynthMIDIDevice*>(MIDI.get())->IsResampling()) return false;
+	bool res = static_cast<SoftSynthMIDIDevice*>(MIDI.get())->SetExternalEffects(on);
+	ExternalEffects = on && res;
+	return res;
+}
+
+const float *MIDIStreamer::GetEffectSends()
+{
+	if (!ExternalEffects || MIDI == nullptr) return nullptr;
+	return static_cast<SoftSynthMIDIDevice*>(MIDI.get())->GetEffectSends();
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: SetStems
+//
+// The device has to be created for stems, so a playing song that cannot
+// switch them on right away gets a new one, see SwapDevice. Otherwise they
+// take effect with the next device the song creates.
+//
+//==========================================================================
+
+bool MIDIStreamer::SetStems(int numstems, const uint8_t *channelstems)
+{
+	// Only FluidSynth can render its channels separately.
+	auto devtype = MIDI != nullptr ? (EMidiDevice)MIDI->GetDeviceType() : SelectMIDIDevice(DeviceType);
+	if (numstems > 0 && devtype != MDEV_FLUIDSYNTH && devtype != MDEV_SNDSYS) return false;
+	NumStems = numstems;
+	if (numstems > 0) memcpy(ChannelStems, channelstems, sizeof(ChannelStems));
+	if (MIDI == nullptr || MIDI->GetTechnology() != MIDIDEV_SWSYNTH) return true;
+	// A device rendering at a reduced rate gets replaced by one at the output rate.
+	// A mono one cannot be, since a stereo device would not fit the stream.
+	auto device = static_cast<SoftSynthMIDIDevice*>(MIDI.get());
+	if (numstems > 0 && device->IsMono())
+	{
+		NumStems = 0;
+		return false;
+	}
+	if ((numstems == 0 || !device->IsResampling()) && device->SetStems(numstems, ChannelStems)) return true;
+	if (SwapDevice()) return true;
+	NumStems = 0;
+	return false;
+}
+
+const float *MIDIStreamer::GetStems(int &numstems, int &frames)
+{
+	numstems = NumStems;
+	if (NumStems == 0 || MIDI == nullptr) return nullptr;
+	return static_cast<SoftSynthMIDIDevice*>(MIDI.get())->GetStems(frames);
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: AddLayer
+//
+// Plays another song on this song's synth, on channels of its own, for
+// music that is made up of several MIDI files on top of each other. The
+// layer takes over the source, unless it cannot be started. Returns the
+// layer's number, starting at 1. CritSec must be held.
+//
+//==========================================================================
+
+int MIDIStreamer::AddLayer(MIDISource *layersource, bool looping)
+{
+	if (MIDI == nullptr || m_Status == STATE_Stopped || MIDI->GetTechnology() != MIDIDEV_SWSYNTH)
+	{
+		throw std::runtime_error("Layers need a song that is playing on a software synth");
+	}
+	auto host = static_cast<SoftSynthMIDIDevice*>(MIDI.get());
+	host->SetVirtual(false);	// layers cannot follow a virtual host.
+	int slot = 0;
+	while (slot < host->GetMaxLayers() && Layers[slot] != nullptr) slot++;
+	if (slot >= host->GetMaxLayers())
+	{
+		throw std::runtime_error(host->GetMaxLayers() > 0 ? "No more layers can be added to this song" : "The song's synth cannot play layers");
+	}
+
+	std::unique_ptr<MIDIStreamer> layer(new MIDIStreamer(DeviceType, Args.c_str()));
+	layer->SetMIDISource(layersource);
+	try
+	{
+		layer->PlayLayer(host, (slot + 1) * 16, looping);
+	}
+	catch (...)
+	{
+		layer->Stop();
+		layer->source.release();	// still the caller's
+		throw;
+	}
+	Layers[slot] = std::move(layer);
+	return slot + 1;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: PlayLayer
+//
+//==========================================================================
+
+void MIDIStreamer::PlayLayer(SoftSynthMIDIDevice *host, int channelbase, bool looping)
+{
+	m_Looping = looping;
+	source->SetMIDISubsong(0);
+	MIDI.reset(new MIDILayerDevice(host, channelbase));
+	InitPlayback();
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: RemoveLayer
+//
+// Silences the layer's channels right away. CritSec must be held.
+//
+//==========================================================================
+
+bool MIDIStreamer::RemoveLayer(int layer)
+{
+	if (layer < 1 || layer > MAX_MIDI_LAYERS || Layers[layer - 1] == nullptr) return false;
+	auto &song = Layers[layer - 1];
+	if (song->MIDI != nullptr)
+	{
+		auto layerdev = static_cast<SoftSynthMIDIDevice*>(song->MIDI.get());
+		for (int i = 0; i < 16; i++)
+		{
+			layerdev->SendEventNow(MIDI_CTRLCHANGE | i, 120, 0);	// all sound off
+			layerdev->SendEventNow(MIDI_CTRLCHANGE | i, 121, 0);	// reset controllers
+		}
+	}
+	song.reset();
+	return true;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: IsLayerPlaying
+//
+// False once a layer that doesn't loop has played all its events.
+//
+//==========================================================================
+
+bool MIDIStreamer::IsLayerPlaying(int layer)
+{
+	if (layer < 1 || layer > MAX_MIDI_LAYERS || Layers[layer - 1] == nullptr) return false;
+	auto &song = Layers[layer - 1];
+	if (song->m_Status == STATE_Stopped || song->MIDI == nullptr) return false;
+	return song->EndQueued < 2 || !static_cast<MIDILayerDevice*>(song->MIDI.get())->IsIdle();
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: StopLayers
+//
+//==========================================================================
+
+void MIDIStreamer::StopLayers()
+{
+	for (int i = 1; i <= MAX_MIDI_LAYERS; i++) RemoveLayer(i);
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: TakeGain
+//
+// Returns true if SetGain was called since the last time.
+//
+//==========================================================================
+
+bool MIDIStreamer::TakeGain()
+{
+	uint32_t serial = GainSerial.load(std::memory_order_acquire);
+	if (serial == AppliedGainSerial) return false;
+	AppliedGainSerial = serial;
+	Gain = PendingGain.load(std::memory_order_relaxed);
+	GainFade = PendingGainFade.load(std::memory_order_relaxed);
+	return true;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: Callback											Static
+//
+//==========================================================================
+
+void MIDIStreamer::Callback(void *userdata)
+{
+	MIDIStreamer *self = (MIDIStreamer *)userdata;
+
+	if (self->EndQueued >= 4)
+	{
+		return;
+	}
+	self->ServiceEvent();
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: Update
+//
+// Called periodically to see if the player thread is still alive. If it
+// isn't, stop playback now.
+//
+//==========================================================================
+
+void MIDIStreamer::Update()
+{
+	if (MIDI != nullptr && !MIDI->Update())
+	{
+		std::lock_guard<FCriticalSection> lock(CritSec);
+		Stop();
+	}
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: ServiceEvent
+//
+// Fills the buffer that just finished playing with new events and appends
+// it to the MIDI stream queue. Stops the song if playback is over. Returns
+// non-zero if a problem occured and playback should stop.
+//
+//==========================================================================
+
+int MIDIStreamer::ServiceEvent()
+{
+	int res;
+
+	if (EndQueued == 2)
+	{
+		return 0;
+	}
+	if (0 != (res = MIDI->UnprepareHeader(&Buffer[BufferNum])))
+	{
+		return res;
+	}
+fill:
+	if (EndQueued == 1)
+	{
+		res = FillStopBuffer(BufferNum);
+		if ((res & 3) != SONG_ERROR)
+		{
+			EndQueued = 2;
+		}
+	}
+	else
+	{
+		res = FillBuffer(BufferNum, BufferEvents, BufferTime);
+	}
+	switch (res & 3)
+	{
+	case SONG_MORE:
+		res = MIDI->StreamOut(&Buffer[BufferNum]);
+		if (res != 0)
+		{
+			return res;
+		}
+		else
+		{
+			BufferNum = (BufferNum + 1) % NumBuffers;
+		}
+		break;
+
+	case SONG_DONE:
+		if (m_Looping)
+		{
+			Restarting = true;
+			goto fill;
+		}
+		// With more than two buffers the ones still queued need to play out first.
+		if (DrainBuffers < 0) DrainBuffers = NumBuffers - 1;
+		if (--DrainBuffers > 0) break;
+		EndQueued = 1;
+		break;
+
+	default:
+		return res >> 2;
+	}
+	return 0;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: FillBuffer
+//
+// Copies MIDI events from the MIDI file and puts them into a MIDI stream
+// buffer. Filling the buffer stops when the song end is encountered, the
+// buffer space is used up, or the maximum time for a buffer is hit.
+//
+// Can return:
+// - SONG_MORE if the buffer was prepared with data.
+// - SONG_DONE if the song's end was reached.
+//             The buffer will never have data in this case.
+// - SONG_ERROR if there was a problem preparing the buffer.
+//
+//==========================================================================
+
+int MIDIStreamer::FillBuffer(int buffer_num, int max_events, uint32_t max_time)
+{
+	ZMUSIC_PROFILE_ZONE("FillBuffer");
+	const bool initial = InitialPlayback;
+	if (!Restarting && source->CheckDone())
+	{
+		return SONG_DONE;
+	}
+
+	int i;
+	uint32_t *events = EventBuffer(buffer_num), *max_event_p;
+
+
+	// The final event is for a NOP to hold the delay from the last event.
+	max_event_p = events + (max_events - 1) * 3;
+
+	if (InitialPlayback)
+	{
+		InitialPlayback = false;
+		// Send the GM System Enable SysEx message.
+		events[0] = 0;								// dwDeltaTime
 		events[1] = 0;								// dwStreamID
 		events[2] = (MEVENT_LONGMSG << 24) | 6;		// dwEvent
 		events[3] = MAKE_ID(0xf0, 0x7e, 0x7f, 0x09);	// dwParms[0]
@@ -842,6 +1655,11 @@ int MIDIStreamer::FillBuffer(int buffer_num, int max_events, uint32_t max_time)
 		source->DoInitialSetup();
 	}
 
+	if (MIDI->FakeVolume() && TakeGain())
+	{
+		MusicVolumeChanged();
+	}
+
 	// If the volume has changed, stick those events at the start of this buffer.
 	if (VolumeChanged && (m_Status != STATE_Paused || NewVolume == 0))
 	{
@@ -871,6 +1689,14 @@ int MIDIStreamer::FillBuffer(int buffer_num, int max_events, uint32_t max_time)
 		if (Restarting)
 		{
 			Restarting = false;
+			if (!initial && MIDI->GetTechnology() == MIDIDEV_SWSYNTH)
+			{
+				// Where one pass of the song ends and the next begins, for the loop cache and the song position.
+				events[0] = 0;
+				events[1] = 0;
+				events[2] = (MEVENT_NOP << 24) | MARKER_RESTART;
+				events += 3;
+			}
 			// Reset the tempo to the inital value.
 			events[0] = 0;									// dwDeltaTime
 			events[1] = 0;									// dwStreamID
@@ -883,7 +1709,7 @@ int MIDIStreamer::FillBuffer(int buffer_num, int max_events, uint32_t max_time)
 		events = source->MakeEvents(events, max_event_p, max_time);
 	}
 	memset(&Buffer[buffer_num], 0, sizeof(MidiHeader));
-	Buffer[buffer_num].lpData = (uint8_t *)Events[buffer_num];
+	Buffer[buffer_num].lpData = (uint8_t *)EventBuffer(buffer_num);
 	Buffer[buffer_num].dwBufferLength = uint32_t((uint8_t *)events - Buffer[buffer_num].lpData);
 	Buffer[buffer_num].dwBytesRecorded = Buffer[buffer_num].dwBufferLength;
 	if (0 != (i = MIDI->PrepareHeader(&Buffer[buffer_num])))
@@ -903,7 +1729,7 @@ int MIDIStreamer::FillBuffer(int buffer_num, int max_events, uint32_t max_time)
 
 int MIDIStreamer::FillStopBuffer(int buffer_num)
 {
-	uint32_t *events = Events[buffer_num];
+	uint32_t *events = EventBuffer(buffer_num);
 	int i;
 
 	events = WriteStopNotes(events);
@@ -915,7 +1741,7 @@ int MIDIStreamer::FillStopBuffer(int buffer_num)
 	events += 3;
 
 	memset(&Buffer[buffer_num], 0, sizeof(MidiHeader));
-	Buffer[buffer_num].lpData = (uint8_t*)Events[buffer_num];
+	Buffer[buffer_num].lpData = (uint8_t*)EventBuffer(buffer_num);
 	Buffer[buffer_num].dwBufferLength = uint32_t((uint8_t*)events - Buffer[buffer_num].lpData);
 	Buffer[buffer_num].dwBytesRecorded = Buffer[buffer_num].dwBufferLength;
 	if (0 != (i = MIDI->PrepareHeader(&Buffer[buffer_num])))
@@ -1002,6 +1828,35 @@ bool MIDIStreamer::SetSubsong(int subsong)
 	return false;
 }
 
+//==========================================================================
+//
+// DeleteDeviceLater
+//
+// Tearing down a synth can take a while, which the thread servicing the
+// stream cannot afford.
+//
+//==========================================================================
+
+static void DeleteDeviceLater(MIDIDevice *dev)
+{
+	ZMusic_SubmitJob(JOB_BACKGROUND, [=]() { dev->Close(); delete dev; });
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: SetupLoopCache
+//
+// Gives a looping song's device a loop cache of zmusic_snd_midiloopcache.
+//
+//==========================================================================
+
+void MIDIStreamer::SetupLoopCache(SoftSynthMIDIDevice *device)
+{
+	const size_t framebytes = (device->IsMono() ? 1 : 2) * sizeof(float);
+	device->SetLoopCache(m_Looping ? size_t(miscConfig.snd_midiloopcache) * 1024 / framebytes : 0);
+	LoopCacheGeneration = Config->Generation;
+}
+
 //==========================================================================
 //
 // MIDIStreamer :: FillStream
@@ -1010,8 +1865,532 @@ bool MIDIStreamer::SetSubsong(int subsong)
 
 bool MIDIStreamer::ServiceStream(void* buff, int len)
 {
+	if (SwapPending.load(std::memory_order_acquire)) FinishSwap();
 	if (!MIDI) return false;
-	return static_cast<SoftSynthMIDIDevice*>(MIDI.get())->ServiceStream(buff, len);
+	auto device = static_cast<SoftSynthMIDIDevice*>(MIDI.get());
+	if (TakeGain())
+	{
+		device->SetGain(Gain, GainFade);
+	}
+	const bool paused = m_Status.load(std::memory_order_relaxed) == STATE_Paused;
+	if (paused && PausedSilence >= device->GetOutputRate() / 1000 * PAUSE_SLEEP_TIME && CanSleep())
+	{
+		// Nothing can make a sound before the song gets resumed, so the device stays as it is until then.
+		memset(buff, 0, len);
+		return true;
+	}
+	if (LiveInput.ReadAvailable() > 0) TakeLiveInput(device);
+	if (device->HasLoopCache() && (paused || FadingDevice != nullptr || NumStems > 0 || ExternalEffects || Config->Generation != LoopCacheGeneration))
+	{
+		// The passes to come may sound different from the kept one, or it would not be heard as it is.
+		device->DropLoopCache();
+		LoopCacheGeneration = Config->Generation;
+	}
+	bool res = device->Render(buff, len);
+
+	if (FadingDevice != nullptr)
+	{
+		auto fading = static_cast<SoftSynthMIDIDevice*>(FadingDevice.get());
+		FadeBuffer.resize(len / sizeof(float));
+		fading->Render(FadeBuffer.data(), len);
+		float *out = (float *)buff;
+		for (size_t i = 0; i < FadeBuffer.size(); i++) out[i] += FadeBuffer[i];
+		if (fading->IsFadedOut()) DeleteDeviceLater(FadingDevice.release());
+	}
+
+	if (ActivityWanted.load(std::memory_order_relaxed)) StoreActivity(device);
+
+	if (paused)
+	{
+		const float *samples = (const float *)buff;
+		const size_t count = len / sizeof(float);
+		size_t i = 0;
+		while (i < count && fabsf(samples[i]) < PAUSE_SILENCE) i++;
+		PausedSilence = i < count ? 0 : PausedSilence + int(count / (device->IsMono() ? 1 : 2));
+	}
+	else
+	{
+		PausedSilence = 0;
+	}
+
+	uint32_t events, fragments;
+	device->TakeStats(events, fragments);
+	Perf.AddDeviceStats(events, fragments, device->GetActiveVoices(), device->GetQualityLevel());
+	return res;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: ReloadSoundFonts
+//
+// Without a device change in flight only the client's thread replaces
+// MIDI, so the device can be used without holding up the stream.
+//
+//==========================================================================
+
+bool MIDIStreamer::ReloadSoundFonts()
+{
+	if (!MIDI || SwapJob.Pending()) return false;
+	PrecacheJob.Wait();
+	return MIDI->ReloadSoundFonts(Args.c_str());
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: SwapDevice
+//
+// Creates a new device with the current configuration in a background job
+// while the old one keeps playing. Once it is ready the stream takes it
+// over at the next ServiceStream call: the queued events move over, the
+// channel state played so far gets restored, and the old device fades out
+// whatever it still had sounding. Only software synths can do this, and
+// the sample rate stays what it was since the stream's format is fixed.
+//
+//==========================================================================
+
+bool MIDIStreamer::SwapDevice()
+{
+	EMidiDevice devtype;
+	int samplerate;
+	std::vector<uint16_t> precache;
+	{
+		std::lock_guard<FCriticalSection> lock(CritSec);
+		if (!MIDI || !source || m_Status == STATE_Stopped || MIDI->GetTechnology() != MIDIDEV_SWSYNTH || MIDI->GetStreamInfoEx().mBufferSize <= 0) return false;
+		devtype = (EMidiDevice)MIDI->GetDeviceType();
+		samplerate = static_cast<SoftSynthMIDIDevice*>(MIDI.get())->GetOutputRate();
+		precache = Instruments;
+	}
+
+	// A change made while the last one is still being prepared supersedes it.
+	// The old device must be done loading before the stream may let go of it.
+	SwapJob.Wait();
+	PrecacheJob.Wait();
+	{
+		// FinishSwap may be taking the last result on the stream's thread.
+		std::lock_guard<std::mutex> lock(SwapLock);
+		SwapResult.reset();
+		SwapPending.store(false, std::memory_order_relaxed);
+	}
+
+	SwapJob.Start(JOB_BACKGROUND, [=]()
+	{
+		std::unique_ptr<MIDIDevice> dev;
+		try
+		{
+			dev.reset(CreateMIDIDevice(devtype, samplerate));
+			// If it fell back to another synth the song is better off with the one it has.
+			if (dev->GetDeviceType() != devtype) dev.reset();
+			else dev->PrecacheInstruments(precache.data(), (int)precache.size());
+		}
+		catch (const std::exception &)
+		{
+			dev.reset();
+		}
+		std::lock_guard<std::mutex> lock(SwapLock);
+		SwapResult = std::move(dev);
+		SwapPending.store(SwapResult != nullptr, std::memory_order_release);
+	});
+	return true;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: FinishSwap
+//
+// Called by the thread servicing the stream with CritSec held.
+//
+//==========================================================================
+
+void MIDIStreamer::FinishSwap()
+{
+	std::unique_ptr<MIDIDevice> dev;
+	{
+		std::lock_guard<std::mutex> lock(SwapLock);
+		dev = std::move(SwapResult);
+		SwapPending.store(false, std::memory_order_relaxed);
+	}
+	if (dev == nullptr) return;
+
+	// A device that cannot be used goes away like the replaced ones, not on this thread.
+	if (MIDI == nullptr)
+	{
+		DeleteDeviceLater(dev.release());
+		return;
+	}
+	dev->SetCallback(Callback, this);
+	auto newdev = static_cast<SoftSynthMIDIDevice*>(dev.get());
+	auto olddev = static_cast<SoftSynthMIDIDevice*>(MIDI.get());
+	// zmusic_snd_mono may have changed since the stream was started.
+	if (0 != dev->Open() || newdev->IsMono() != olddev->IsMono())
+	{
+		DeleteDeviceLater(dev.release());
+		return;
+	}
+	if (ExternalEffects) ExternalEffects = newdev->SetExternalEffects(true);
+	if (NumStems > 0) newdev->SetStems(NumStems, ChannelStems);
+	Played.Apply(newdev);
+	for (auto &layer : Layers)
+	{
+		if (layer == nullptr || layer->MIDI == nullptr) continue;
+		auto layerdev = static_cast<MIDILayerDevice*>(layer->MIDI.get());
+		layerdev->SetHost(newdev);
+		layer->Played.Apply(layerdev);
+	}
+	newdev->TakeStream(olddev);
+	newdev->SetStateRecorder(&Played);
+	olddev->SetStateRecorder(nullptr);
+	SetupLoopCache(newdev);
+	if (olddev->IsVirtual()) newdev->SetVirtual(true);
+	olddev->SetGain(0, SWAP_FADE_TIME);
+
+	if (FadingDevice != nullptr) DeleteDeviceLater(FadingDevice.release());
+	FadingDevice = std::move(MIDI);
+	MIDI = std::move(dev);
+	DeviceKey = {};	// it may have been created for other settings.
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: CancelSwap
+//
+//==========================================================================
+
+void MIDIStreamer::CancelSwap()
+{
+	SwapJob.Wait();
+	{
+		std::lock_guard<std::mutex> lock(SwapLock);
+		SwapResult.reset();
+		SwapPending.store(false, std::memory_order_relaxed);
+	}
+	if (FadingDevice != nullptr)
+	{
+		FadingDevice->Close();
+		FadingDevice.reset();
+	}
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: SetPosition
+//
+// Runs the source up to the target time without rendering anything, then
+// restores the channel state on the synth and resumes streaming from the
+// first event past the target. The walk starts at the closest snapshot
+// recorded by an earlier seek.
+//
+//==========================================================================
+
+bool MIDIStreamer::SetPosition(unsigned int ms)
+{
+	if (!MIDI || !source || m_Status != STATE_Playing || MIDI->GetStreamInfoEx().mBufferSize <= 0) return false;
+	auto device = static_cast<SoftSynthMIDIDevice*>(MIDI.get());
+
+	MIDIChaseState chase;
+	MIDIMeter meter;
+	uint32_t scratch[MAX_MIDI_EVENTS * 3];
+	uint32_t *tail = nullptr, *tail_end = nullptr;
+	double tail_fraction = 0;
+	const double division = source->getDivision();
+	double target = ms * 1000.;
+	double now = 0;
+	double tempo = source->getInitialTempo();
+	bool wrapped = false;
+
+	if (SeekIndexLooping != m_Looping)
+	{
+		SeekIndex.clear();
+		SeekIndexLooping = m_Looping;
+	}
+
+	// Resume from the last snapshot before the target if there is one. Targets past the end of a
+	// looping song still need the whole first pass because the chased state carries over into the next.
+	auto snapshot = std::upper_bound(SeekIndex.begin(), SeekIndex.end(), target,
+		[](double time, const MIDISeekSnapshot &snap) { return time < snap.Time; });
+	MIDISource *restored = snapshot == SeekIndex.begin() ? nullptr : std::prev(snapshot)->Source->Clone();
+	if (restored != nullptr)
+	{
+		--snapshot;
+		now = snapshot->Time;
+		tempo = snapshot->Tempo;
+		chase = snapshot->Chase;
+		meter = snapshot->Meter;
+		SetMIDISource(restored);
+		source->setVolume(Volume);
+	}
+	else
+	{
+		source->StartPlayback(m_Looping);
+		source->DoRestart();
+	}
+	while (tail == nullptr)
+	{
+		if (source->CheckDone())
+		{
+			if (!m_Looping || now == 0) break;
+			// Don't walk the song over and over for targets beyond its length.
+			if (!wrapped)
+			{
+				target = now + fmod(target - now, now);
+				wrapped = true;
+			}
+			tempo = source->getInitialTempo();
+			meter.Reset();
+			source->DoRestart();
+			continue;
+		}
+		uint32_t *end = source->MakeEvents(scratch, &scratch[MAX_MIDI_EVENTS * 3], 1000000 * 600);
+		for (uint32_t *event = scratch; event < end; )
+		{
+			double evtime = now + event[0] * tempo / division;
+			if (evtime > target)
+			{
+				double ticks = (evtime - target) * division / tempo;
+				event[0] = uint32_t(ticks);
+				tail_fraction = ticks - event[0];	// the device can take care of the part below one tick.
+				meter.Tick += (target - now) * division / tempo;
+				tail = event;
+				tail_end = end;
+				break;
+			}
+			now = evtime;
+			meter.Tick += event[0];
+			if (MEVENT_EVENTTYPE(event[2]) == MEVENT_TEMPO) tempo = MEVENT_EVENTPARM(event[2]);
+			else if (MEVENT_EVENTTYPE(event[2]) == MEVENT_NOP) meter.AddEvent(event, division);
+			else chase.AddEvent(event);
+
+			// Advance to next event
+			if (event[2] < 0x80000000) event += 3;
+			else event += 3 + ((MEVENT_EVENTPARM(event[2]) + 3) >> 2);
+		}
+
+		// Only the first pass is recorded, and only between two batches, where the source can be copied.
+		if (tail == nullptr && !wrapped && now >= (SeekIndex.empty() ? 0 : SeekIndex.back().Time) + SEEK_SNAPSHOT_TIME)
+		{
+			MIDISource *copy = source->Clone();
+			if (copy != nullptr)
+			{
+				SeekIndex.push_back({ now, tempo, chase, meter, std::unique_ptr<MIDISource>(copy) });
+			}
+		}
+	}
+
+	// Throw away everything that was queued for the old position.
+	device->ResetStream();
+	device->SetMeter(meter);
+	UnprepareBuffers();
+	MIDI->SetTempo(int(tempo));
+	chase.Apply(device);
+	Played = chase;
+	Restarting = false;
+	EndQueued = 0;
+	DrainBuffers = -1;
+
+	if (tail == nullptr)
+	{
+		// Past the end of a song that does not loop.
+		if ((FillStopBuffer(0) & 3) != SONG_MORE || 0 != MIDI->StreamOut(&Buffer[0])) return false;
+		EndQueued = 2;
+		BufferNum = 1;
+		return true;
+	}
+
+	memcpy(EventBuffer(0), tail, (tail_end - tail) * sizeof(uint32_t));
+	memset(&Buffer[0], 0, sizeof(MidiHeader));
+	Buffer[0].lpData = (uint8_t *)EventBuffer(0);
+	Buffer[0].dwBufferLength = uint32_t((tail_end - tail) * sizeof(uint32_t));
+	Buffer[0].dwBytesRecorded = Buffer[0].dwBufferLength;
+	if (0 != MIDI->PrepareHeader(&Buffer[0]) || 0 != MIDI->StreamOut(&Buffer[0])) return false;
+	device->DelayNextTick(tail_fraction);
+
+	// The remaining buffers get filled the same way they would be during playback.
+	BufferNum = 1 % NumBuffers;
+	while (BufferNum != 0)
+	{
+		int res = FillBuffer(BufferNum, BufferEvents, BufferTime);
+		if ((res & 3) == SONG_MORE)
+		{
+			if (0 != MIDI->StreamOut(&Buffer[BufferNum])) return false;
+			BufferNum = (BufferNum + 1) % NumBuffers;
+		}
+		else if ((res & 3) == SONG_DONE)
+		{
+			if (m_Looping)
+			{
+				Restarting = true;
+				continue;
+			}
+			DrainBuffers = BufferNum - 1;
+			if (DrainBuffers == 0) EndQueued = 1;
+			break;
+		}
+		else return false;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: Clone
+//
+// The copy continues from where the synth is: it gets a copy of the source,
+// which is as far as the queued buffers reach, copies of those buffers and
+// a device of its own with the channel state played so far and the notes
+// still held. The song data and the instruments are shared. Layers, stems
+// and shared effects stay with this song.
+//
+// The new device is created, opened and loaded without CritSec, since that
+// can take long enough for the stream to notice. The lock is only held to
+// look at the song and to copy its state over.
+//
+//==========================================================================
+
+MusInfo *MIDIStreamer::Clone()
+{
+	EMidiDevice devtype;
+	int samplerate;
+	std::unique_ptr<MIDIStreamer> clone(new MIDIStreamer(DeviceType, Args.c_str()));
+	{
+		FSongLock lock(this);
+		if (!MIDI || !source || m_Status == STATE_Stopped || OfflineRender || MIDI->GetTechnology() != MIDIDEV_SWSYNTH || MIDI->GetStreamInfoEx().mBufferSize <= 0)
+		{
+			throw std::runtime_error("Only MIDI songs playing on a software synth can be cloned");
+		}
+		devtype = (EMidiDevice)MIDI->GetDeviceType();
+		samplerate = static_cast<SoftSynthMIDIDevice*>(MIDI.get())->GetOutputRate();
+		clone->Instruments = Instruments;
+	}
+
+	clone->DeviceKey = clone->GetDeviceKey(devtype, samplerate);
+	clone->MIDI.reset(clone->ObtainMIDIDevice(clone->DeviceKey));
+	if (clone->MIDI->GetDeviceType() != devtype)
+	{
+		throw std::runtime_error("Could not create another device of the song's type");
+	}
+	auto dev = static_cast<SoftSynthMIDIDevice*>(clone->MIDI.get());
+	dev->SetCallback(Callback, clone.get());
+	if (0 != dev->Open())
+	{
+		throw std::runtime_error("Could not open MIDI out device");
+	}
+	dev->PrecacheInstruments(clone->Instruments.data(), (int)clone->Instruments.size());
+
+	FSongLock lock(this);
+	// The song may have been stopped or given another device in the meantime.
+	if (!MIDI || !source || m_Status == STATE_Stopped || OfflineRender || MIDI->GetDeviceType() != devtype ||
+		MIDI->GetTechnology() != MIDIDEV_SWSYNTH || static_cast<SoftSynthMIDIDevice*>(MIDI.get())->GetOutputRate() != samplerate)
+	{
+		throw std::runtime_error("The song changed while it was being cloned");
+	}
+	std::unique_ptr<MIDISource> copy(source->Clone());
+	if (copy == nullptr)
+	{
+		throw std::runtime_error("The song's MIDI format cannot be cloned");
+	}
+	auto olddev = static_cast<SoftSynthMIDIDevice*>(MIDI.get());
+
+	clone->MIDIType = MIDIType;
+	clone->SetMIDISource(copy.release());
+	clone->m_Looping = m_Looping.load();
+	clone->LoopLimit = LoopLimit;
+	clone->PendingNumBuffers = PendingNumBuffers;
+	clone->BufferTime = clone->StreamBufferTime = StreamBufferTime;
+	clone->source->CheckCaps(dev->GetTechnology());
+	if (!dev->CanHandleSysex()) clone->source->SkipSysex();
+	if (clone->Instruments != Instruments)
+	{
+		// The song started over with other instruments while the clone's were loading.
+		clone->Instruments = Instruments;
+		dev->PrecacheInstruments(Instruments.data(), (int)Instruments.size());
+	}
+
+	clone->Gain = Gain;
+	dev->SetGain(Gain, 0);
+	clone->MusicVolumeChanged();
+	clone->OutputVolume(clone->Volume);
+
+	// The copied buffers are the same as ours, only with their data in the clone.
+	clone->NumBuffers = NumBuffers;
+	clone->BufferEvents = BufferEvents;
+	clone->Events = Events;
+	clone->Buffer = Buffer;
+	for (int i = 0; i < NumBuffers; i++)
+	{
+		if (Buffer[i].lpData != nullptr) clone->Buffer[i].lpData = (uint8_t *)clone->EventBuffer(i);
+	}
+	clone->BufferNum = BufferNum;
+	clone->EndQueued = EndQueued;
+	clone->DrainBuffers = DrainBuffers;
+	clone->Restarting = Restarting;
+	clone->InitialPlayback = InitialPlayback;
+	clone->VolumeChanged = false;
+
+	clone->Played = Played;
+	clone->Played.Apply(dev);
+	dev->CopyStream(olddev, Buffer.data(), clone->Buffer.data());
+	dev->SetStateRecorder(&clone->Played);
+	clone->SetupLoopCache(dev);
+	clone->TakesLiveInput.store(true, std::memory_order_release);
+
+	if (0 != dev->Resume())
+	{
+		throw std::runtime_error("Starting MIDI playback failed");
+	}
+	clone->m_Status = STATE_Playing;
+	return clone.release();
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: SetOfflineMode
+//
+// Lets every event buffer cover a lot more time so the device can render
+// in far larger blocks, and optionally disables looping for the duration.
+//
+//==========================================================================
+
+bool MIDIStreamer::SetOfflineMode(bool on, int flags)
+{
+	if (!MIDI || MIDI->GetStreamInfoEx().mBufferSize <= 0) return false;
+	if (on)
+	{
+		PrecacheJob.Wait();	// rendering would outrun the loading
+		OfflineLooping = m_Looping;
+		OfflineRender = true;
+		BufferTime = std::max<uint32_t>(OFFLINE_TIME, StreamBufferTime);
+		if (flags & ZMUSIC_RENDER_STOPATLOOP)
+		{
+			m_Looping = false;
+			source->SetLooping(false);
+		}
+	}
+	else
+	{
+		OfflineRender = false;
+		BufferTime = StreamBufferTime;
+		m_Looping = OfflineLooping;
+		source->SetLooping(m_Looping);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// MIDIStreamer :: SetEventBuffering
+//
+// A new buffer count is picked up the next time playback starts, the time
+// each buffer covers applies to the next one being filled.
+//
+//==========================================================================
+
+bool MIDIStreamer::SetEventBuffering(int numbuffers, int buffertime)
+{
+	if (numbuffers < 2 || numbuffers > MAX_MIDI_BUFFERS) return false;
+	if (buffertime < MIN_BUFFER_TIME || buffertime > MAX_BUFFER_TIME) return false;
+	PendingNumBuffers = numbuffers;
+	StreamBufferTime = buffertime;
+	if (!OfflineRender) BufferTime = buffertime;
+	return true;
 }
 
 //==========================================================================
@@ -1027,13 +2406,18 @@ MusInfo* CreateMIDIStreamer(MIDISource *source, EMidiDevice devtype, const char*
 	return me;
 }
 
+bool ZMusic_MIDIDumpWaveInternal(MIDISource *source, EMidiDevice devtype, const char *devarg, const char *outname, int subsong, int samplerate, FCriticalSection *setuplock)
+{
+	MIDIStreamer me(devtype, devarg ? devarg : "");
+	me.SetMIDISource(source);
+	return me.DumpWave(outname, subsong, samplerate, setuplock);
+}
+
 DLL_EXPORT zmusic_bool ZMusic_MIDIDumpWave(ZMusic_MidiSource source, EMidiDevice devtype, const char *devarg, const char *outname, int subsong, int samplerate)
 {
 	try
 	{
-		MIDIStreamer me(devtype, devarg ? devarg : "");
-		me.SetMIDISource(source);
-		me.DumpWave(outname, subsong, samplerate);
+		ZMusic_MIDIDumpWaveInternal(source, devtype, devarg, outname, subsong, samplerate, nullptr);
 		return true;
 	}
 	catch (const std::exception & ex)
@@ -32,8 +32,12 @@
 **---------------------------------------------------------------------------
 */
 
+#include <algorithm>
 #include "zmusic/musinfo.h"
 #include "zmusic/zmusic_internal.h"
+#include "zmusic/resampler.h"
+#include "zmusic/sampleconv.h"
+#include "zmusic/allocator.h"
 #include "streamsources/streamsource.h"
 
 class StreamSong : public MusInfo
@@ -49,17 +53,37 @@ public:
 	bool IsValid () const override { return m_Source != nullptr; }
 	bool SetPosition (unsigned int pos) override;
 	bool SetSubsong (int subsong) override;
+	int GetSubsongCount() override { return m_Source->GetSubsongCount(); }
+	bool PrepareSubsong(int subsong, int crossfade_ms) override { return m_Source->PrepareSubsong(subsong, crossfade_ms); }
 	std::string GetStats() override;
-	void ChangeSettingInt(const char *name, int value) override { if (m_Source) m_Source->ChangeSettingInt(name, value); }
-	void ChangeSettingNum(const char *name, double value) override { if (m_Source) m_Source->ChangeSettingNum(name, value); }
-	void ChangeSettingString(const char *name, const char *value) override { if(m_Source) m_Source->ChangeSettingString(name, value); }
+	void ChangeSettingInt(ESongSetting setting, int value) override { if (m_Source) m_Source->ChangeSettingInt(setting, value); }
+	void ChangeSettingNum(ESongSetting setting, double value) override { if (m_Source) m_Source->ChangeSettingNum(setting, value); }
 	bool ServiceStream(void* buff, int len) override;
-	SoundStreamInfoEx GetStreamInfoEx() const override { return m_Source->GetFormatEx(); }
+	SoundStreamInfoEx GetStreamInfoEx() const override;
+	bool SetSampleType(SampleType type) override;
+	bool SetOfflineMode(bool on, int flags) override;
+	bool GetTiming(int &length, int &loopstart, int &loopend) override { return m_Source->GetTiming(length, loopstart, loopend); }
+	bool GetPosition(ZMusicPosition &pos, double &ticksperframe) override;
+	bool SetVirtual(bool on) override;
 
 	
 protected:
 	
 	StreamSource *m_Source = nullptr;
+	size_t SilentFrames = 0;	// since the last sample above miscConfig.snd_silencelevel
+	bool Virtual = false;
+
+	// Only there while the source plays at a rate other than OutputRate.
+	FResampler *Resampler = nullptr;
+	int ResampleQuality;
+	int OutputRate;
+	int NativeRate = 0;
+	TMusicVector<uint8_t> NativeData;
+	TMusicVector<float> NativeFloat;
+
+	void SetupResampler();
+	bool GetResampledData(void *buff, int len);
+	bool CheckSilence(const void *buff, int len);
 };
 
 
@@ -68,6 +92,7 @@ void StreamSong::Play (bool looping, int subsong)
 {
 	m_Status = STATE_Stopped;
 	m_Looping = looping;
+	SilentFrames = 0;
 
 	if (m_Source != nullptr)
 	{
@@ -76,6 +101,7 @@ void StreamSong::Play (bool looping, int subsong)
 		if (m_Source->Start())
 		{
 			m_Status = STATE_Playing;
+			SetupResampler();
 		}
 	}
 }
@@ -103,11 +129,76 @@ StreamSong::~StreamSong ()
 		delete m_Source;
 		m_Source = nullptr;
 	}
+	delete Resampler;
 }
 
 StreamSong::StreamSong (StreamSource *source)
 {
 	m_Source = source;
+	ResampleQuality = miscConfig.snd_resamplequality;
+	OutputRate = miscConfig.snd_outputrate;
+	if (m_Source != nullptr) SetupResampler();
+}
+
+//
+// StreamSong :: SetupResampler
+//
+// Puts the resampler between the source and the client if the source's rate
+// is not the output rate, and takes it out again otherwise. Without it the
+// source's data is handed out untouched.
+
+void StreamSong::SetupResampler()
+{
+	SoundStreamInfoEx fmt = m_Source->GetFormatEx();
+	int channels = ZMusic_ChannelCount(fmt.mChannelConfig);
+	if (ResampleQuality <= 0 || OutputRate <= 0 || fmt.mSampleRate <= 0 || fmt.mSampleRate == OutputRate ||
+		channels <= 0 || channels > FResampler::MaxChannels || ZMusic_SampleTypeSize(fmt.mSampleType) == 0)
+	{
+		delete Resampler;
+		Resampler = nullptr;
+		return;
+	}
+	if (Resampler == nullptr) Resampler = new FResampler;
+	if (NativeRate != fmt.mSampleRate || Resampler->Channels() != channels)
+	{
+		NativeRate = fmt.mSampleRate;
+		Resampler->Setup(NativeRate, OutputRate, channels, ResampleQuality);
+	}
+	else
+	{
+		Resampler->Reset();
+	}
+}
+
+//
+// StreamSong :: GetStreamInfoEx
+//
+// Resampled songs are float at the output rate, with a buffer that lasts as
+// long as the source's.
+
+SoundStreamInfoEx StreamSong::GetStreamInfoEx() const
+{
+	SoundStreamInfoEx fmt = m_Source->GetFormatEx();
+	if (Resampler != nullptr)
+	{
+		int channels = Resampler->Channels();
+		int framesize = channels * ZMusic_SampleTypeSize(fmt.mSampleType);
+		if (fmt.mBufferSize > 0)
+		{
+			int64_t frames = int64_t(fmt.mBufferSize / framesize) * OutputRate / NativeRate;
+			fmt.mBufferSize = int(std::max<int64_t>(frames, 1) * channels * sizeof(float));
+		}
+		fmt.mSampleRate = OutputRate;
+		fmt.mSampleType = SampleType_Float32;
+	}
+	return fmt;
+}
+
+bool StreamSong::SetSampleType(SampleType type)
+{
+	// The resampler always produces float, whatever the source does.
+	if (Resampler != nullptr) return type == SampleType_Float32;
+	return m_Source->SetSampleType(type);
 }
 
 bool StreamSong::IsPlaying ()
@@ -128,6 +219,8 @@ bool StreamSong::SetPosition(unsigned int pos)
 {
 	if (m_Source != nullptr)
 	{
+		SilentFrames = 0;
+		if (Resampler != nullptr) Resampler->Reset();
 		return m_Source->SetPosition(pos);
 	}
 	else
@@ -138,9 +231,18 @@ bool StreamSong::SetPosition(unsigned int pos)
 
 bool StreamSong::SetSubsong(int subsong)
 {
+	SilentFrames = 0;
+	if (Resampler != nullptr) Resampler->Reset();
 	return m_Source->SetSubsong(subsong);
 }
 
+bool StreamSong::GetPosition(ZMusicPosition &pos, double &ticksperframe)
+{
+	if (!m_Source || m_Status == STATE_Stopped || !m_Source->GetPosition(pos, ticksperframe)) return false;
+	if (Resampler != nullptr) ticksperframe *= double(NativeRate) / OutputRate;
+	return true;
+}
+
 std::string StreamSong::GetStats()
 {
 	std::string s1, s2;
@@ -148,6 +250,12 @@ std::string StreamSong::GetStats()
 	{
 		auto stat = m_Source->GetStats();
 		s2 = stat.c_str();
+		if (Resampler != nullptr)
+		{
+			char buf[64];
+			snprintf(buf, sizeof(buf), "Resampled from %d to %d Hz", NativeRate, OutputRate);
+			s1 = buf;
+		}
 	}
 	if (s1.empty() && s2.empty()) return "No song loaded\n";
 	if (s1.empty()) return s2;
@@ -155,9 +263,141 @@ std::string StreamSong::GetStats()
 	return s1 + "\n" + s2;
 }
 
+//
+// StreamSong :: CheckSilence
+//
+// Returns true once the output has stayed below snd_silencelevel for
+// snd_silencetimeout ms. Only the silent run at the end of the buffer
+// matters, so it is searched backwards and stops at the first loud sample.
+
+template<class T> static size_t TrailingSilence(const T *samples, size_t count, int channels, T level, T center)
+{
+	size_t i = count;
+	while (i > 0)
+	{
+		T s = samples[i - 1];
+		if (s - center > level || center - s > level) break;
+		i--;
+	}
+	return (count - i) / channels;
+}
+
+bool StreamSong::CheckSilence(const void *buff, int len)
+{
+	if (miscConfig.snd_silencetimeout <= 0) return false;
+
+	SoundStreamInfoEx fmt = GetStreamInfoEx();
+	int channels = ZMusic_ChannelCount(fmt.mChannelConfig);
+	int samplesize = ZMusic_SampleTypeSize(fmt.mSampleType);
+	if (channels <= 0 || samplesize <= 0 || fmt.mSampleRate <= 0) return false;
+
+	size_t count = len / samplesize;
+	size_t frames = count / channels;
+	float level = miscConfig.snd_silencelevel;
+	size_t silent;
+	switch (fmt.mSampleType)
+	{
+	case SampleType_Float32:
+		silent = TrailingSilence((const float *)buff, count, channels, level, 0.f);
+		break;
+	case SampleType_Int16:
+		silent = TrailingSilence((const int16_t *)buff, count, channels, int16_t(std::min(level * 32768, 32767.f)), int16_t(0));
+		break;
+	case SampleType_UInt8:
+		silent = TrailingSilence((const uint8_t *)buff, count, channels, uint8_t(std::min(level * 128, 127.f)), uint8_t(128));
+		break;
+	default:
+		return false;
+	}
+	SilentFrames = silent < frames ? silent : SilentFrames + frames;
+	return SilentFrames >= size_t(miscConfig.snd_silencetimeout) * fmt.mSampleRate / 1000;
+}
+
+//
+// StreamSong :: GetResampledData
+//
+// Reads as much of the source as the resampler needs for 'len' bytes of
+// output and converts it to float on the way.
+
+bool StreamSong::GetResampledData(void *buff, int len)
+{
+	SoundStreamInfoEx fmt = m_Source->GetFormatEx();
+	int channels = Resampler->Channels();
+	int samplesize = ZMusic_SampleTypeSize(fmt.mSampleType);
+	size_t outframes = len / (channels * sizeof(float));
+	size_t count = Resampler->InputNeeded(outframes) * channels;
+
+	NativeData.resize(count * samplesize);
+	if (count > 0 && !m_Source->GetData(NativeData.data(), int(count * samplesize))) return false;
+
+	const float *in = (const float *)NativeData.data();
+	if (fmt.mSampleType != SampleType_Float32)
+	{
+		NativeFloat.resize(count);
+		if (fmt.mSampleType == SampleType_Int16) ZMusic_ConvertInt16ToFloat((const int16_t *)NativeData.data(), NativeFloat.data(), count);
+		else ZMusic_ConvertUInt8ToFloat(NativeData.data(), NativeFloat.data(), count);
+		in = NativeFloat.data();
+	}
+	Resampler->Process(in, (float *)buff, outframes);
+	return true;
+}
+
+//
+// StreamSong :: SetVirtual
+//
+// Only sources that can skip cheaply do this, rendering into nowhere
+// would not save anything.
+//
+
+bool StreamSong::SetVirtual(bool on)
+{
+	if (on == Virtual) return true;
+	if (on && !m_Source->CanSkip()) return false;
+	Virtual = on;
+	SilentFrames = 0;
+	if (Resampler != nullptr) Resampler->Reset();
+	return true;
+}
+
+//
+// StreamSong :: ServiceStream
+//
+// A paused song is served silence without running the source. So is one that
+// ended in silence, which is cut short instead of being played out.
+
 bool StreamSong::ServiceStream (void *buff, int len)
 {
-	bool written = m_Source->GetData(buff, len);
+	if (m_Status == STATE_Paused)
+	{
+		SoundStreamInfoEx fmt = GetStreamInfoEx();
+		memset((char*)buff, fmt.mSampleType == SampleType_UInt8 ? 0x80 : 0, len);
+		return true;
+	}
+	if (Virtual)
+	{
+		SoundStreamInfoEx fmt = GetStreamInfoEx();
+		int framesize = ZMusic_SampleTypeSize(fmt.mSampleType) * ZMusic_ChannelCount(fmt.mChannelConfig);
+		size_t frames = framesize > 0 ? len / framesize : 0;
+		if (Resampler != nullptr) frames = size_t(double(frames) * NativeRate / OutputRate + 0.5);
+		memset((char*)buff, fmt.mSampleType == SampleType_UInt8 ? 0x80 : 0, len);
+		if (!m_Source->Skip(frames))
+		{
+			m_Status = STATE_Stopped;
+			return false;
+		}
+		return true;
+	}
+	bool written = Resampler != nullptr ? GetResampledData(buff, len) : m_Source->GetData(buff, len);
+	// Silence the decoder put in because it fell behind is not the song's.
+	uint32_t starved = m_Source->TakeUnderruns();
+	if (starved > 0) Perf.AddStarved(starved);
+	else if (written && CheckSilence(buff, len))
+	{
+		// A looping song starts over, if the source can seek.
+		SilentFrames = 0;
+		if (Resampler != nullptr) Resampler->Reset();
+		written = m_Looping && m_Source->SetPosition(0);
+	}
 	if (!written)
 	{
 		m_Status = STATE_Stopped;
@@ -167,6 +407,16 @@ bool StreamSong::ServiceStream (void *buff, int len)
 	return true;
 }
 
+bool StreamSong::SetOfflineMode(bool on, int flags)
+{
+	// Stream sources do not pace themselves so the only thing to do here is the loop handling.
+	if (flags & ZMUSIC_RENDER_STOPATLOOP)
+	{
+		m_Source->SetPlayMode(on ? false : m_Looping.load());
+	}
+	return true;
+}
+
 MusInfo *OpenStreamSong(StreamSource *source)
 {
 	auto song = new StreamSong(source);
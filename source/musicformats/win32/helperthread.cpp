@@ -36,6 +36,7 @@
 */
 
 #include "helperthread.h"
+#include "zmusic/jobs.h"
 
 //==========================================================================
 //
@@ -228,6 +229,8 @@ DWORD FHelperThread::SendMessage (DWORD method,
 
 DWORD WINAPI FHelperThread::ThreadLaunch (LPVOID me)
 {
+	// ThreadLoop never returns, it ends the thread itself.
+	ZMusic_ThreadBegin(THREAD_STREAM, "ZMusic CD audio");
 	return ((FHelperThread *)me)->ThreadLoop ();
 }
 
@@ -241,6 +244,7 @@ DWORD FHelperThread::ThreadLoop ()
 {
 	if (!Init ())
 	{
+		ZMusic_ThreadEnd(THREAD_STREAM);
 		ExitThread (0);
 	}
 	else
@@ -256,6 +260,7 @@ DWORD FHelperThread::ThreadLoop ()
 		case WAIT_OBJECT_0+1:
 			// We should quit now.
 			Deinit ();
+			ZMusic_ThreadEnd(THREAD_STREAM);
 			ExitThread (0);
 			break;
 
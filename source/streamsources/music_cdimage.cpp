@@ -0,0 +1,626 @@
+/*
+** music_cdimage.cpp
+** Streams the audio tracks of a CUE sheet and its BIN or WAVE files.
+**
+**---------------------------------------------------------------------------
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** Unlike the MCI based CD player this works the same on every platform.
+** The image is read on a thread of its own in large sequential chunks,
+** zmusic_snd_cdprefetch ahead of playback, so images on slow drives or
+** network shares don't stall the audio callback.
+**
+*/
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <condition_variable>
+#include "streamsource.h"
+#include "fileio.h"
+#include "zmusic/ringbuffer.h"
+#include "zmusic/jobs.h"
+
+// MACROS ------------------------------------------------------------------
+
+enum
+{
+	CD_SECTOR_SIZE = 2352,				// one sector of Red Book audio, 588 stereo frames
+	CD_FRAMES_PER_SECOND = 75,			// sectors per second, the 'ff' part of a CUE time
+	CD_SAMPLE_RATE = 44100,
+	CD_FRAME_SIZE = 4,
+	CD_READ_SECTORS = 32,				// how much a single read fetches
+};
+
+// TYPES -------------------------------------------------------------------
+
+struct CDImageFile
+{
+	MusicIO::FileInterface *Reader = nullptr;
+	bool Swap = false;		// the samples are not in the host's byte order.
+};
+
+// A stretch of audio in one of the files, in bytes.
+struct CDImageSegment
+{
+	int File;
+	int Track;
+	long Start;
+	long End;
+};
+
+class CDImageSong : public StreamSource
+{
+public:
+	CDImageSong(std::vector<CDImageFile> &&files, std::vector<CDImageSegment> &&segments);
+	~CDImageSong();
+	void SetPlayMode(bool looping) override;
+	bool Start() override;
+	bool SetPosition(unsigned position) override;
+	bool GetData(void *buffer, size_t len) override;
+	SoundStreamInfoEx GetFormatEx() override;
+	bool GetTiming(int &length, int &loopstart, int &loopend) override;
+	std::string GetStats() override;
+	uint32_t TakeUnderruns() override;
+
+protected:
+	void StartReader();
+	void StopReader();
+	bool ReadChunk();
+	void RunReader();
+
+	std::vector<CDImageFile> Files;
+	std::vector<CDImageSegment> Segments;
+	size_t TotalBytes = 0;
+
+	// Only touched by the reader thread while it runs.
+	size_t Segment = 0;
+	long Offset = 0;
+	TMusicVector<uint8_t> Chunk;
+
+	FRingBuffer Ring;
+	std::thread ReadThread;
+	std::mutex WakeLock;
+	std::condition_variable Wake;
+	bool Exit = false;
+	std::atomic<bool> Looping{ true };
+	std::atomic<bool> Ended{ false };
+	std::atomic<size_t> Played{ 0 };		// bytes into the song, for the stats.
+	std::atomic<unsigned> Underruns{ 0 };
+	unsigned ReportedUnderruns = 0;	// only touched by the thread calling GetData.
+};
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// CDImageSong - Constructor
+//
+//==========================================================================
+
+CDImageSong::CDImageSong(std::vector<CDImageFile> &&files, std::vector<CDImageSegment> &&segments)
+	: StreamSource(CD_SAMPLE_RATE), Files(std::move(files)), Segments(std::move(segments))
+{
+	for (auto &seg : Segments) TotalBytes += seg.End - seg.Start;
+	Chunk.resize(CD_READ_SECTORS * CD_SECTOR_SIZE);
+	size_t ahead = size_t(CD_SAMPLE_RATE) * CD_FRAME_SIZE / 1000 * miscConfig.snd_cdprefetch;
+	Ring.Resize(std::max(ahead, Chunk.size() * 4));
+	if (!Segments.empty()) Offset = Segments[0].Start;
+}
+
+//==========================================================================
+//
+// CDImageSong - Destructor
+//
+//==========================================================================
+
+CDImageSong::~CDImageSong()
+{
+	StopReader();
+	for (auto &file : Files)
+	{
+		if (file.Reader) file.Reader->close();
+	}
+}
+
+//==========================================================================
+//
+// CDImageSong :: SetPlayMode
+//
+//==========================================================================
+
+void CDImageSong::SetPlayMode(bool looping)
+{
+	m_Looping = looping;
+	Looping.store(looping, std::memory_order_relaxed);
+}
+
+//==========================================================================
+//
+// CDImageSong :: Start
+//
+// The first chunk is read right here, so the song does not begin with
+// an underrun.
+//
+//==========================================================================
+
+bool CDImageSong::Start()
+{
+	if (!ReadThread.joinable())
+	{
+		if (Ring.ReadAvailable() == 0) ReadChunk();
+		StartReader();
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// CDImageSong :: StartReader / StopReader
+//
+//==========================================================================
+
+void CDImageSong::StartReader()
+{
+	Exit = false;
+	ReadThread = std::thread(&CDImageSong::RunReader, this);
+}
+
+void CDImageSong::StopReader()
+{
+	if (ReadThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(WakeLock);
+			Exit = true;
+		}
+		Wake.notify_one();
+		ReadThread.join();
+	}
+}
+
+//==========================================================================
+//
+// CDImageSong :: SetPosition
+//
+// The reader gets stopped for this so that nothing it has read from the
+// old position can end up in the ring after it has been emptied.
+//
+//==========================================================================
+
+bool CDImageSong::SetPosition(unsigned ms)
+{
+	size_t target = size_t(uint64_t(ms) * CD_SAMPLE_RATE / 1000) * CD_FRAME_SIZE;
+	if (target >= TotalBytes) return false;
+
+	bool running = ReadThread.joinable();
+	StopReader();
+	Ring.Resize(Ring.Capacity());
+	Ended.store(false, std::memory_order_relaxed);
+	Played.store(target, std::memory_order_relaxed);
+	for (Segment = 0; target >= size_t(Segments[Segment].End - Segments[Segment].Start); Segment++)
+	{
+		target -= Segments[Segment].End - Segments[Segment].Start;
+	}
+	Offset = Segments[Segment].Start + long(target);
+	if (running) StartReader();
+	return true;
+}
+
+//==========================================================================
+//
+// CDImageSong :: ReadChunk
+//
+// Reads up to one chunk from the current position into the ring. Returns
+// false once the end has been reached and the song does not loop.
+//
+//==========================================================================
+
+bool CDImageSong::ReadChunk()
+{
+	if (Segment >= Segments.size()) return false;
+
+	auto &seg = Segments[Segment];
+	auto &file = Files[seg.File];
+	long want = std::min<long>(long(Chunk.size()), seg.End - Offset);
+	long got = 0;
+	if (file.Reader->seek(Offset, SEEK_SET) == 0)
+	{
+		got = file.Reader->read(Chunk.data(), want);
+		if (got < 0) got = 0;
+	}
+	got &= ~(CD_FRAME_SIZE - 1);
+	if (file.Swap)
+	{
+		for (long i = 0; i < got; i += 2) std::swap(Chunk[i], Chunk[i + 1]);
+	}
+	Ring.Write(Chunk.data(), got);
+
+	// A read error or a truncated file ends the segment early.
+	Offset += got;
+	if (got < want || Offset >= seg.End)
+	{
+		if (++Segment == Segments.size())
+		{
+			if (!Looping.load(std::memory_order_relaxed)) return false;
+			Segment = 0;
+		}
+		Offset = Segments[Segment].Start;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// CDImageSong :: RunReader
+//
+// Runs on the read thread and keeps the ring topped up.
+//
+//==========================================================================
+
+void CDImageSong::RunReader()
+{
+	FThreadScope scope(THREAD_STREAM, "ZMusic CD image reader");
+	for (;;)
+	{
+		bool busy = false;
+		if (!Ended.load(std::memory_order_relaxed) && Ring.WriteAvailable() >= Chunk.size())
+		{
+			if (!ReadChunk()) Ended.store(true, std::memory_order_release);
+			busy = true;
+		}
+
+		std::unique_lock<std::mutex> lock(WakeLock);
+		if (Exit) return;
+		// GetData wakes this up without taking the lock, so don't rely on it alone.
+		if (!busy) Wake.wait_for(lock, std::chrono::milliseconds(10));
+		if (Exit) return;
+	}
+}
+
+//==========================================================================
+//
+// CDImageSong :: GetData
+//
+// If the reader has fallen behind the rest is filled with silence instead
+// of waiting for the drive.
+//
+//==========================================================================
+
+bool CDImageSong::GetData(void *vbuff, size_t len)
+{
+	bool ended = Ended.load(std::memory_order_acquire);
+	size_t got = Ring.Read(vbuff, len);
+	Wake.notify_one();
+	memset((char*)vbuff + got, 0, len - got);
+	if (got < len && !ended) Underruns.fetch_add(1, std::memory_order_relaxed);
+	if (TotalBytes > 0) Played.store((Played.load(std::memory_order_relaxed) + got) % TotalBytes, std::memory_order_relaxed);
+	return got > 0 || !ended;
+}
+
+//==========================================================================
+//
+// CDImageSong :: TakeUnderruns
+//
+//==========================================================================
+
+uint32_t CDImageSong::TakeUnderruns()
+{
+	unsigned underruns = Underruns.load(std::memory_order_relaxed);
+	uint32_t taken = underruns - ReportedUnderruns;
+	ReportedUnderruns = underruns;
+	return taken;
+}
+
+//==========================================================================
+//
+// CDImageSong :: GetFormatEx
+//
+//==========================================================================
+
+SoundStreamInfoEx CDImageSong::GetFormatEx()
+{
+	return { 64 * 1024, CD_SAMPLE_RATE, SampleType_Int16, ChannelConfig_Stereo };
+}
+
+//==========================================================================
+//
+// CDImageSong :: GetTiming
+//
+//==========================================================================
+
+bool CDImageSong::GetTiming(int &length, int &loopstart, int &loopend)
+{
+	length = int(uint64_t(TotalBytes / CD_FRAME_SIZE) * 1000 / CD_SAMPLE_RATE);
+	loopstart = 0;
+	loopend = length;
+	return true;
+}
+
+//==========================================================================
+//
+// CDImageSong :: GetStats
+//
+//==========================================================================
+
+std::string CDImageSong::GetStats()
+{
+	char out[120];
+	// Reading the segment from here would race with the reader, so work it out from what has been played.
+	size_t pos = Played.load(std::memory_order_relaxed);
+	int track = Segments[0].Track;
+	for (auto &seg : Segments)
+	{
+		track = seg.Track;
+		if (pos < size_t(seg.End - seg.Start)) break;
+		pos -= seg.End - seg.Start;
+	}
+	int time = int(pos / CD_FRAME_SIZE / CD_SAMPLE_RATE);
+	snprintf(out, 120, "CD image track %d  Time: %02d:%02d  Prefetched: %d ms  Underruns: %u",
+		track, time / 60, time % 60,
+		int(uint64_t(Ring.ReadAvailable() / CD_FRAME_SIZE) * 1000 / CD_SAMPLE_RATE),
+		Underruns.load(std::memory_order_relaxed));
+	return out;
+}
+
+//==========================================================================
+//
+// CUE sheet parsing
+//
+//==========================================================================
+
+struct CueTrack
+{
+	int Number;
+	bool Audio;
+	int SectorSize;
+	int FirstIndex = -1;	// INDEX 00 if there is one, else INDEX 01, in sectors.
+	int Index1 = -1;
+};
+
+struct CueFile
+{
+	std::string Name;
+	std::string Type;
+	std::vector<CueTrack> Tracks;
+};
+
+static const char *CueToken(const char *p, std::string &tok)
+{
+	tok.clear();
+	while (*p == ' ' || *p == '\t') p++;
+	if (*p == '"')
+	{
+		for (p++; *p && *p != '"'; p++) tok += *p;
+		if (*p == '"') p++;
+	}
+	else
+	{
+		for (; *p && *p != ' ' && *p != '\t'; p++) tok += *p;
+	}
+	return p;
+}
+
+static bool CueIs(const std::string &tok, const char *cmd)
+{
+	if (tok.size() != strlen(cmd)) return false;
+	for (size_t i = 0; i < tok.size(); i++)
+	{
+		if (toupper((unsigned char)tok[i]) != cmd[i]) return false;
+	}
+	return true;
+}
+
+static int CueTime(const std::string &tok)
+{
+	int mm, ss, ff;
+	if (sscanf(tok.c_str(), "%d:%d:%d", &mm, &ss, &ff) != 3) return -1;
+	return (mm * 60 + ss) * CD_FRAMES_PER_SECOND + ff;
+}
+
+static bool ParseCue(MusicIO::FileInterface *reader, std::vector<CueFile> &files)
+{
+	char line[1024];
+	std::string cmd, tok;
+	while (reader->gets(line, sizeof(line)))
+	{
+		line[strcspn(line, "\r\n")] = 0;
+		const char *p = line;
+		if (!memcmp(p, "\xEF\xBB\xBF", 3)) p += 3;	// UTF-8 BOM
+		p = CueToken(p, cmd);
+		if (CueIs(cmd, "FILE"))
+		{
+			files.emplace_back();
+			p = CueToken(p, files.back().Name);
+			CueToken(p, tok);
+			for (auto &c : tok) c = (char)toupper((unsigned char)c);
+			files.back().Type = tok;
+		}
+		else if (CueIs(cmd, "TRACK"))
+		{
+			if (files.empty()) return false;
+			CueTrack track;
+			p = CueToken(p, tok);
+			track.Number = atoi(tok.c_str());
+			CueToken(p, tok);
+			track.Audio = CueIs(tok, "AUDIO");
+			// MODE1/2048, MODE2/2336 and so on give the size of their sectors. CDG carries subcode and can't be played as it is.
+			auto slash = tok.find('/');
+			track.SectorSize = slash != std::string::npos ? atoi(tok.c_str() + slash + 1) : CueIs(tok, "CDG") ? 2448 : CD_SECTOR_SIZE;
+			if (track.SectorSize <= 0) return false;
+			files.back().Tracks.push_back(track);
+		}
+		else if (CueIs(cmd, "INDEX"))
+		{
+			if (files.empty() || files.back().Tracks.empty()) return false;
+			auto &track = files.back().Tracks.back();
+			p = CueToken(p, tok);
+			int index = atoi(tok.c_str());
+			CueToken(p, tok);
+			int time = CueTime(tok);
+			if (time < 0) return false;
+			if (track.FirstIndex < 0) track.FirstIndex = time;
+			if (index == 1) track.Index1 = time;
+		}
+	}
+	return !files.empty();
+}
+
+//==========================================================================
+//
+// OpenImageFile
+//
+// Opens one of the files named by the sheet and finds where its samples
+// start. WAVE files must hold CD audio as it is.
+//
+//==========================================================================
+
+static bool OpenImageFile(const std::string &path, const std::string &type, CDImageFile &out, long &start, long &end)
+{
+	auto f = MusicIO::utf8_fopen(path.c_str(), "rb");
+	if (!f) return false;
+	auto reader = new MusicIO::StdioFileReader;
+	reader->f = f;
+	out.Reader = reader;
+
+	const uint16_t one = 1;
+	bool bigendianhost = *(const uint8_t *)&one == 0;
+	start = 0;
+	end = reader->filelength();
+
+	if (type == "BINARY" || type == "MOTOROLA")
+	{
+		out.Swap = bigendianhost != (type == "MOTOROLA");
+		return true;
+	}
+	if (type != "WAVE") return false;
+
+	uint8_t head[12];
+	if (reader->read(head, 12) != 12 || memcmp(head, "RIFF", 4) || memcmp(head + 8, "WAVE", 4)) return false;
+	bool gotfmt = false;
+	for (;;)
+	{
+		uint8_t chunk[16];
+		if (reader->read(chunk, 8) != 8) return false;
+		long size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | (long(chunk[7]) << 24);
+		long pos = reader->tell();
+		if (!memcmp(chunk, "fmt ", 4))
+		{
+			if (size < 16 || reader->read(chunk, 16) != 16) return false;
+			int format = chunk[0] | (chunk[1] << 8);
+			int channels = chunk[2] | (chunk[3] << 8);
+			long rate = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | (long(chunk[7]) << 24);
+			int bits = chunk[14] | (chunk[15] << 8);
+			if (format != 1 || channels != 2 || rate != CD_SAMPLE_RATE || bits != 16) return false;
+			gotfmt = true;
+		}
+		else if (!memcmp(chunk, "data", 4))
+		{
+			if (!gotfmt) return false;
+			start = pos;
+			end = std::min(end, pos + size);
+			out.Swap = bigendianhost;
+			return true;
+		}
+		if (reader->seek(pos + size + (size & 1), SEEK_SET) != 0) return false;
+	}
+}
+
+//==========================================================================
+//
+// CDImage_OpenSong
+//
+// Plays one track of the sheet, or all its audio tracks in a row for
+// track 0. Files are looked up next to the sheet.
+//
+//==========================================================================
+
+StreamSource *CDImage_OpenSong(const char *cuefile, int track)
+{
+	auto f = MusicIO::utf8_fopen(cuefile, "rb");
+	if (!f) return nullptr;
+	MusicIO::StdioFileReader cue;
+	cue.f = f;
+	std::vector<CueFile> sheet;
+	if (!ParseCue(&cue, sheet)) return nullptr;
+
+	std::string dir = cuefile;
+	auto slash = dir.find_last_of("/\\");
+	dir.resize(slash == std::string::npos ? 0 : slash + 1);
+
+	std::vector<CDImageFile> files;
+	std::vector<CDImageSegment> segments;
+	for (auto &cf : sheet)
+	{
+		bool wanted = false;
+		for (auto &t : cf.Tracks) wanted |= t.Audio && (track == 0 || t.Number == track);
+		if (!wanted) continue;
+
+		CDImageFile file;
+		long datastart, dataend;
+		bool absolute = !cf.Name.empty() && (cf.Name[0] == '/' || cf.Name[0] == '\\' || (cf.Name.size() > 1 && cf.Name[1] == ':'));
+		if (!OpenImageFile(absolute ? cf.Name : dir + cf.Name, cf.Type, file, datastart, dataend))
+		{
+			if (file.Reader) file.Reader->close();
+			for (auto &fl : files) fl.Reader->close();
+			return nullptr;
+		}
+
+		// Positions in the sheet are in sectors, whose size depends on the track,
+		// so the byte offsets are summed up track by track.
+		long pos = datastart;
+		for (size_t i = 0; i < cf.Tracks.size(); i++)
+		{
+			auto &t = cf.Tracks[i];
+			if (t.FirstIndex < 0) break;
+			if (i == 0) pos += long(t.FirstIndex) * t.SectorSize;
+			long next = dataend;
+			if (i + 1 < cf.Tracks.size() && cf.Tracks[i + 1].FirstIndex >= t.FirstIndex)
+			{
+				next = std::min(dataend, pos + long(cf.Tracks[i + 1].FirstIndex - t.FirstIndex) * t.SectorSize);
+			}
+			if (t.Audio && t.Index1 >= t.FirstIndex && (track == 0 || t.Number == track))
+			{
+				long start = pos + long(t.Index1 - t.FirstIndex) * t.SectorSize;
+				if (start < next) segments.push_back({ int(files.size()), t.Number, start, next });
+			}
+			pos = next;
+		}
+		files.push_back(file);
+	}
+	if (segments.empty())
+	{
+		for (auto &fl : files) fl.Reader->close();
+		return nullptr;
+	}
+	return new CDImageSong(std::move(files), std::move(segments));
+}
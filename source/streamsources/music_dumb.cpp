@@ -36,8 +36,13 @@
 // HEADER FILES ------------------------------------------------------------
 
 #include <math.h>
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <stdint.h>
 #include "streamsource.h"
 
@@ -48,25 +53,29 @@
 #include "zmusic/m_swap.h"
 #include "zmusic/mididefs.h"
 #include "zmusic/midiconfig.h"
+#include "zmusic/parallel.h"
+#include "zmusic/songcache.h"
 #include "fileio.h"
 
 // MACROS ------------------------------------------------------------------
 
 // TYPES -------------------------------------------------------------------
 
-DumbConfig dumbConfig;
+struct FDumbModule;
 
 class DumbSong : public StreamSource
 {
 public:
-	DumbSong(DUH *myduh, int samplerate);
+	DumbSong(std::shared_ptr<FDumbModule> module, int samplerate);
 	~DumbSong();
-	//bool SetPosition(int ms);
+	bool SetPosition(unsigned ms) override;
 	bool SetSubsong(int subsong) override;
 	bool Start() override;
 	SoundStreamInfoEx GetFormatEx() override;
-	void ChangeSettingNum(const char* setting, double val) override;
+	bool SetSampleType(SampleType type) override;
+	void ChangeSettingNum(ESongSetting setting, double val) override;
 	std::string GetStats() override;
+	bool GetPosition(ZMusicPosition &pos, double &ticksperframe) override;
 
 	std::string Codec;
 	std::string TrackerVersion;
@@ -84,12 +93,18 @@ protected:
 	bool eof;
 	bool started = false;
 	size_t written;
+	std::shared_ptr<FDumbModule> Module;
 	DUH *duh;
 	DUH_SIGRENDERER *sr;
+	SampleType OutputType = SampleType_Float32;
+	TMusicVector<int> int32_buffer;	// for Int16 output which is too small to be rendered into in place.
+	FWorkerGroup MixThreads;
 
+	void StartIndex(bool replace);
 	bool open2(long pos);
+	static void RunMixJobs(void *context, int count, void (*job)(void *, int), void *jobcontext);
 	long render(double volume, double delta, long samples, sample_t **buffer);
-	int decode_run(void *buffer, unsigned int size);
+	int decode_run(void *buffer, unsigned int size, float floatscale);
 	bool GetData(void *buffer, size_t len) override;
 
 };
@@ -464,91 +479,36 @@ static bool ReadIT(const uint8_t * ptr, unsigned size, DumbSong *info, bool meta
 
 //==========================================================================
 //
-// DUMB memory file system
+// DUMB memory file
+//
+// The module gets loaded from one block of memory, which DUMB reads
+// directly instead of calling a file system for every byte.
 //
 //==========================================================================
 
 typedef struct tdumbfile_mem_status
 {
 	const uint8_t *ptr;
-	unsigned int offset, size;
+	unsigned int size;
+	bool owned;	// ptr was allocated by dumb_read_allfile.
 } dumbfile_mem_status;
 
-static int DUMBCALLBACK dumbfile_mem_skip(void *f, long n)
-{
-	dumbfile_mem_status * s = (dumbfile_mem_status *) f;
-	s->offset += n;
-	if (s->offset > s->size)
-	{
-		s->offset = s->size;
-		return 1;
-	}
-	return 0;
-}
-
-static int DUMBCALLBACK dumbfile_mem_getc(void *f)
-{
-	dumbfile_mem_status * s = (dumbfile_mem_status *) f;
-	if (s->offset < s->size)
-	{
-		return *(s->ptr + s->offset++);
-	}
-	return -1;
-}
-
-static int32 DUMBCALLBACK dumbfile_mem_getnc(char *ptr, int32 n, void *f)
-{
-	dumbfile_mem_status * s = (dumbfile_mem_status *) f;
-	long max = s->size - s->offset;
-	if (max > n) max = n;
-	if (max)
-	{
-		memcpy(ptr, s->ptr + s->offset, max);
-		s->offset += max;
-	}
-	return max;
-}
-
-static int DUMBCALLBACK dumbfile_mem_seek(void *f, long n)
-{
-	dumbfile_mem_status * s = (dumbfile_mem_status *) f;
-	s->offset = n;
-	if (s->offset > s->size)
-	{
-		s->offset = s->size;
-		return 1;
-	}
-	return 0;
-}
-
-static long DUMBCALLBACK dumbfile_mem_get_size(void *f)
-{
-	dumbfile_mem_status * s = (dumbfile_mem_status *) f;
-	return s->size;
-}
-
-static DUMBFILE_SYSTEM mem_dfs = {
-	NULL, // open
-	&dumbfile_mem_skip,
-	&dumbfile_mem_getc,
-	&dumbfile_mem_getnc,
-	NULL, // close
-	&dumbfile_mem_seek,
-	&dumbfile_mem_get_size
-};
-
 //==========================================================================
 //
 // dumb_read_allfile
 //
+// Files that are already in memory are used from there, the rest gets
+// read into a buffer.
+//
 //==========================================================================
 
 DUMBFILE *dumb_read_allfile(dumbfile_mem_status *filestate, uint8_t *start, MusicIO::FileInterface *reader, int lenhave, int lenfull)
 {
 	filestate->size = lenfull;
-	filestate->offset = 0;
 	if (lenhave >= lenfull)
 		filestate->ptr = (uint8_t *)start;
+	else if (reader->memoryData() != nullptr)
+		filestate->ptr = reader->memoryData() + reader->tell() - lenhave;
     else
     {
         uint8_t *mem = new uint8_t[lenfull];
@@ -559,8 +519,70 @@ DUMBFILE *dumb_read_allfile(dumbfile_mem_status *filestate, uint8_t *start, Musi
             return NULL;
         }
         filestate->ptr = mem;
+        filestate->owned = true;
     }
-    return dumbfile_open_ex(filestate, &mem_dfs);
+    return dumbfile_open_memory((const char *)filestate->ptr, lenfull);
+}
+
+//==========================================================================
+//
+// AutoChipSteps
+//
+// Checks that no value differs from the one 'stride' before it by more
+// than the threshold. Done in blocks with the maximum taken over each, so
+// the compiler can vectorize it and long samples still stop soon after the
+// first big step.
+//
+//==========================================================================
+
+template<class T> static bool AutoChipSteps(const T *data, int stride, int end, int threshold)
+{
+	for (int k = stride; k < end; )
+	{
+		int blockend = std::min(end, k + 256);
+		int maxstep = 0;
+		for (; k < blockend; k++)
+		{
+			maxstep = std::max(maxstep, abs(int(data[k]) - int(data[k - stride])));
+		}
+		if (maxstep > threshold) return false;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// IsChipSample
+//
+// True for samples whose loops join with a jump or whose waveform has one
+// anywhere, which is what chip-style square and saw waves look like.
+//
+//==========================================================================
+
+template<class T> static bool IsChipSample(const IT_SAMPLE *sample, int channels, int threshold)
+{
+	const T *data = (const T *)sample->data;
+	auto seam = [=](int start, int end)
+	{
+		start *= channels;
+		end *= channels;
+		for (int c = 0; c < channels; c++)
+		{
+			if (abs(int(data[start + c]) - int(data[end - channels + c])) > threshold) return true;
+		}
+		return false;
+	};
+	if ((sample->flags & (IT_SAMPLE_LOOP|IT_SAMPLE_PINGPONG_LOOP)) == IT_SAMPLE_LOOP && seam(sample->loop_start, sample->loop_end))
+	{
+		return true;
+	}
+	if ((sample->flags & (IT_SAMPLE_SUS_LOOP|IT_SAMPLE_PINGPONG_SUS_LOOP)) == IT_SAMPLE_SUS_LOOP && seam(sample->sus_loop_start, sample->sus_loop_end))
+	{
+		return true;
+	}
+	int l = (sample->flags & IT_SAMPLE_LOOP ? sample->loop_end : sample->length) * channels;
+	// Interleaved stereo compares each channel with its previous value, so both are checked in one pass.
+	return !AutoChipSteps(data, channels, l, threshold);
 }
 
 //==========================================================================
@@ -568,16 +590,27 @@ DUMBFILE *dumb_read_allfile(dumbfile_mem_status *filestate, uint8_t *start, Musi
 // MOD_SetAutoChip
 //
 // Disables interpolation for short samples that meet criteria set by
-// the cvars referenced at the top of this function.
+// the cvars referenced in FAutoChipLimits. Runs in the module's AutoChipJob,
+// so the limits are read on the opening thread.
 //
 //==========================================================================
 
-static void MOD_SetAutoChip(DUH *duh)
+struct FAutoChipLimits
 {
 	int size_force = dumbConfig.mod_autochip_size_force;
 	int size_scan = dumbConfig.mod_autochip_size_scan;
 	int scan_threshold_8 = ((dumbConfig.mod_autochip_scan_threshold * 0x100) + 50) / 100;
 	int scan_threshold_16 = ((dumbConfig.mod_autochip_scan_threshold * 0x10000) + 50) / 100;
+
+	bool operator==(const FAutoChipLimits &other) const
+	{
+		return size_force == other.size_force && size_scan == other.size_scan &&
+			scan_threshold_8 == other.scan_threshold_8 && scan_threshold_16 == other.scan_threshold_16;
+	}
+};
+
+static void MOD_SetAutoChip(DUH *duh, const FAutoChipLimits &limits)
+{
 	DUMB_IT_SIGDATA * itsd = duh_get_it_sigdata(duh);
 
 	if (itsd)
@@ -588,170 +621,262 @@ static void MOD_SetAutoChip(DUH *duh)
 			if (sample->flags & IT_SAMPLE_EXISTS)
 			{
 				int channels = sample->flags & IT_SAMPLE_STEREO ? 2 : 1;
-				if (sample->length < size_force) sample->max_resampling_quality = 0;
-				else if (sample->length < size_scan)
+				if (sample->length < limits.size_force) sample->max_resampling_quality = 0;
+				else if (sample->length < limits.size_scan)
 				{
-					if ((sample->flags & (IT_SAMPLE_LOOP|IT_SAMPLE_PINGPONG_LOOP)) == IT_SAMPLE_LOOP)
-					{
-						int loop_start = sample->loop_start * channels;
-						int loop_end = sample->loop_end * channels;
-						int s1, s2;
-						if (sample->flags & IT_SAMPLE_16BIT)
-						{
-							s1 = ((signed short *)sample->data)[loop_start];
-							s2 = ((signed short *)sample->data)[loop_end - channels];
-							if (abs(s1 - s2) > scan_threshold_16)
-							{
-								sample->max_resampling_quality = 0;
-								continue;
-							}
-							if (channels == 2)
-							{
-								s1 = ((signed short *)sample->data)[loop_start + 1];
-								s2 = ((signed short *)sample->data)[loop_end - 1];
-								if (abs(s1 - s2) > scan_threshold_16)
-								{
-									sample->max_resampling_quality = 0;
-									continue;
-								}
-							}
-						}
-						else
-						{
-							s1 = ((signed char *)sample->data)[loop_start];
-							s2 = ((signed char *)sample->data)[loop_end - channels];
-							if (abs(s1 - s2) > scan_threshold_8)
-							{
-								sample->max_resampling_quality = 0;
-								continue;
-							}
-							if (channels == 2)
-							{
-								s1 = ((signed char *)sample->data)[loop_start + 1];
-								s2 = ((signed char *)sample->data)[loop_end - 1];
-								if (abs(s1 - s2) > scan_threshold_8)
-								{
-									sample->max_resampling_quality = 0;
-									continue;
-								}
-							}
-						}
-					}
-					if ((sample->flags & (IT_SAMPLE_SUS_LOOP|IT_SAMPLE_PINGPONG_SUS_LOOP)) == IT_SAMPLE_SUS_LOOP)
-					{
-						int sus_loop_start = sample->sus_loop_start * channels;
-						int sus_loop_end = sample->sus_loop_end * channels;
-						int s1, s2;
-						if (sample->flags & IT_SAMPLE_16BIT)
-						{
-							s1 = ((signed short *)sample->data)[sus_loop_start];
-							s2 = ((signed short *)sample->data)[sus_loop_end - channels];
-							if (abs(s1 - s2) > scan_threshold_16)
-							{
-								sample->max_resampling_quality = 0;
-								continue;
-							}
-							if (channels == 2)
-							{
-								s1 = ((signed short *)sample->data)[sus_loop_start + 1];
-								s2 = ((signed short *)sample->data)[sus_loop_end - 1];
-								if (abs(s1 - s2) > scan_threshold_16)
-								{
-									sample->max_resampling_quality = 0;
-									continue;
-								}
-							}
-						}
-						else
-						{
-							s1 = ((signed char *)sample->data)[sus_loop_start];
-							s2 = ((signed char *)sample->data)[sus_loop_end - channels];
-							if (abs(s1 - s2) > scan_threshold_8)
-							{
-								sample->max_resampling_quality = 0;
-								continue;
-							}
-							if (channels == 2)
-							{
-								s1 = ((signed char *)sample->data)[sus_loop_start + 1];
-								s2 = ((signed char *)sample->data)[sus_loop_end - 1];
-								if (abs(s1 - s2) > scan_threshold_8)
-								{
-									sample->max_resampling_quality = 0;
-									continue;
-								}
-							}
-						}
-					}
-
-					int k, l = sample->length * channels;
-					if (sample->flags & IT_SAMPLE_LOOP) l = sample->loop_end * channels;
-					if (sample->flags & IT_SAMPLE_16BIT)
-					{
-						for (k = channels; k < l; k += channels)
-						{
-							if (abs(((signed short *)sample->data)[k - channels] - ((signed short *)sample->data)[k]) > scan_threshold_16)
-							{
-								break;
-							}
-						}
-						if (k < l)
-						{
-							sample->max_resampling_quality = 0;
-							continue;
-						}
-						if (channels == 2)
-						{
-							for (k = 2 + 1; k < l; k += 2)
-							{
-								if (abs(((signed short *)sample->data)[k - 2] - ((signed short *)sample->data)[k]) > scan_threshold_16)
-								{
-									break;
-								}
-							}
-						}
-						if (k < l)
-						{
-							sample->max_resampling_quality = 0;
-							continue;
-						}
-					}
-					else
-					{
-						for (k = channels; k < l; k += channels)
-						{
-							if (abs(((signed char *)sample->data)[k - channels] - ((signed char *)sample->data)[k]) > scan_threshold_8)
-							{
-								break;
-							}
-						}
-						if (k < l)
-						{
-							sample->max_resampling_quality = 0;
-							continue;
-						}
-						if (channels == 2)
-						{
-							for (k = 2 + 1; k < l; k += 2)
-							{
-								if (abs(((signed char *)sample->data)[k - 2] - ((signed char *)sample->data)[k]) > scan_threshold_8)
-								{
-									break;
-								}
-							}
-						}
-						if (k < l)
-						{
-							sample->max_resampling_quality = 0;
-							continue;
-						}
-					}
+					bool chip = sample->flags & IT_SAMPLE_16BIT ?
+						IsChipSample<signed short>(sample, channels, limits.scan_threshold_16) :
+						IsChipSample<signed char>(sample, channels, limits.scan_threshold_8);
+					if (chip) sample->max_resampling_quality = 0;
 				}
 			}
 		}
 	}
 }
 
+//==========================================================================
+//
+// RunLoadJobs
+//
+// Lets DUMB decompress IT samples on the shared worker threads.
+//
+//==========================================================================
+
+static void RunLoadJobs(void *, int count, void (*job)(void *, int), void *jobcontext)
+{
+	ZMusic_ParallelFor(count, [=](size_t i) { job(jobcontext, (int)i); });
+}
+
+//==========================================================================
+//
+// FDumbModule
+//
+// A loaded module. Songs that play the same file with the same autochip
+// settings share it, and each only has its own renderer. Rendering does
+// not change the DUH, apart from the checkpoints, which belong to the
+// module and are only replaced while one song plays it.
+//
+//==========================================================================
+
+struct FDumbModuleKey
+{
+	std::shared_ptr<const uint8_t> Data;	// null if the module is not shared
+	size_t Length = 0;
+	uint64_t Hash = 0;
+	bool AutoChip = false;
+	FAutoChipLimits Limits;
+
+	bool operator==(const FDumbModuleKey &other) const
+	{
+		return Length == other.Length && AutoChip == other.AutoChip && (!AutoChip || Limits == other.Limits) &&
+			memcmp(Data.get(), other.Data.get(), Length) == 0;
+	}
+};
+
+struct FDumbModule
+{
+	DUH *duh;
+	bool is_dos;
+	FDumbModuleKey Key;
+
+	FDumbModule(DUH *myduh, bool dos) : duh(myduh), is_dos(dos) {}
+	~FDumbModule();
+	void StartAutoChip(const FAutoChipLimits &limits);
+	void WaitAutoChip();
+	void StartIndex(int order, bool replace);
+	DUH_SIGRENDERER *StartRenderer(int order, long pos);
+
+private:
+	// The jobs are started and waited for by all songs playing the module.
+	std::mutex Lock;
+	FJob AutoChipJob;	// MOD_SetAutoChip, which has to be done before anything gets rendered.
+
+	// DUMB's checkpoints, a copy of the renderer every 30 seconds into the
+	// song from IndexOrder on, get recorded by a scan that does not mix on a
+	// background job. With them a position is reached by rendering from the
+	// one before it instead of from the start. The job writes to the module's
+	// sigdata, so nothing may use them before IndexReady is set.
+	FJob IndexJob;
+	std::atomic<bool> IndexReady{ false };
+	int IndexOrder = 0;
+};
+
+// Only weak references, a module is gone once the last song playing it is.
+static std::mutex ModuleCacheLock;
+static std::unordered_multimap<uint64_t, std::weak_ptr<FDumbModule>> ModuleCache;
+
+//==========================================================================
+//
+// FDumbModule destructor
+//
+//==========================================================================
+
+FDumbModule::~FDumbModule()
+{
+	AutoChipJob.Wait();
+	IndexJob.Wait();
+	unload_duh(duh);
+
+	if (Key.Data != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(ModuleCacheLock);
+		auto range = ModuleCache.equal_range(Key.Hash);
+		for (auto it = range.first; it != range.second; )
+		{
+			if (it->second.expired()) it = ModuleCache.erase(it);
+			else ++it;
+		}
+	}
+}
+
+//==========================================================================
+//
+// FDumbModule :: StartAutoChip
+//
+// The scan looks at every short sample, which is left to a background job
+// that only holds up the song if it is started right away.
+//
+//==========================================================================
+
+void FDumbModule::StartAutoChip(const FAutoChipLimits &limits)
+{
+	DUH *song = duh;
+	AutoChipJob.Start(JOB_BACKGROUND, [song, limits]() { MOD_SetAutoChip(song, limits); });
+}
+
+void FDumbModule::WaitAutoChip()
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	AutoChipJob.Wait();
+}
+
+//==========================================================================
+//
+// FDumbModule :: StartIndex
+//
+// Records the checkpoints for 'order', unless a scan has already been
+// started. With 'replace' a finished one for another order gets replaced.
+//
+//==========================================================================
+
+void FDumbModule::StartIndex(int order, bool replace)
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	if (IndexJob.Pending() && (!replace || IndexOrder == order || !IndexReady.load(std::memory_order_acquire)))
+	{
+		return;
+	}
+	IndexJob.Wait();
+	IndexReady.store(false, std::memory_order_relaxed);
+	IndexOrder = order;
+	DUMB_IT_SIGDATA *itsd = duh_get_it_sigdata(duh);
+	if (itsd == nullptr) return;
+	IndexJob.Start(JOB_BACKGROUND, [this, itsd, order]()
+	{
+		dumb_it_build_checkpoints(itsd, order);
+		IndexReady.store(true, std::memory_order_release);
+	});
+}
+
+//==========================================================================
+//
+// FDumbModule :: StartRenderer
+//
+//==========================================================================
+
+DUH_SIGRENDERER *FDumbModule::StartRenderer(int order, long pos)
+{
+	{
+		// duh_start_sigrenderer starts from the nearest checkpoint, but only knows those of one order.
+		// The lock keeps them from being replaced while it copies one.
+		std::lock_guard<std::mutex> lock(Lock);
+		if (order == IndexOrder && IndexReady.load(std::memory_order_acquire))
+		{
+			return duh_start_sigrenderer(duh, 0, 2, pos);
+		}
+	}
+	DUH_SIGRENDERER *sr = dumb_it_start_at_order(duh, 2, order);
+	if (sr && pos) duh_sigrenderer_generate_samples(sr, 0, 1, pos, 0);
+	return sr;
+}
+
+//==========================================================================
+//
+// IsShareable
+//
+// The ProTracker invert loop effect (EFx) changes the sample data while
+// the module plays, so a module that uses it cannot be shared.
+//
+//==========================================================================
+
+static bool IsShareable(DUH *duh)
+{
+	DUMB_IT_SIGDATA *itsd = duh_get_it_sigdata(duh);
+	if (itsd == nullptr) return false;
+	if ((itsd->flags & (IT_WAS_AN_XM | IT_WAS_A_MOD)) != (IT_WAS_AN_XM | IT_WAS_A_MOD)) return true;
+
+	for (int i = 0; i < itsd->n_patterns; i++)
+	{
+		const IT_PATTERN *pattern = &itsd->pattern[i];
+		for (int j = 0; j < pattern->n_entries; j++)
+		{
+			const IT_ENTRY *entry = &pattern->entry[j];
+			if (!IT_IS_END_ROW(entry) && (entry->mask & IT_ENTRY_EFFECT) &&
+				entry->effect == IT_S && (entry->effectvalue >> 4) == IT_S_SET_MIDI_MACRO)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// FindModule
+//
+// Returns the loaded module for the reader's content, or null. 'key' is
+// set up for AddModule, unless the reader does not hold its content in
+// memory.
+//
+//==========================================================================
+
+static std::shared_ptr<FDumbModule> FindModule(MusicIO::FileInterface *reader, FDumbModuleKey &key)
+{
+	key.AutoChip = dumbConfig.mod_autochip;
+
+	// Hashing is done without the lock, the content may be large.
+	auto data = reader->shareData();
+	if (data == nullptr) return nullptr;
+	key.Length = reader->filelength();
+	key.Hash = SongCache_HashData(data.get(), key.Length);
+	key.Data = std::move(data);
+
+	std::lock_guard<std::mutex> lock(ModuleCacheLock);
+	auto range = ModuleCache.equal_range(key.Hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		auto module = it->second.lock();
+		if (module != nullptr && module->Key == key) return module;
+	}
+	return nullptr;
+}
+
+//==========================================================================
+//
+// AddModule
+//
+//==========================================================================
+
+static void AddModule(const std::shared_ptr<FDumbModule> &module, FDumbModuleKey &key)
+{
+	if (key.Data == nullptr || !IsShareable(module->duh)) return;
+
+	module->Key = std::move(key);
+	std::lock_guard<std::mutex> lock(ModuleCacheLock);
+	ModuleCache.emplace(module->Key.Hash, module);
+}
+
 //==========================================================================
 //
 // MOD_OpenSong
@@ -760,6 +885,9 @@ static void MOD_SetAutoChip(DUH *duh)
 
 StreamSource* MOD_OpenSong(MusicIO::FileInterface *reader, int samplerate)
 {
+	static bool hooked = (dumb_it_set_load_parallel_for(&RunLoadJobs, nullptr), true);
+	(void)hooked;
+
 	DUH *duh = 0;
 	int headsize;
 	union
@@ -778,7 +906,7 @@ StreamSource* MOD_OpenSong(MusicIO::FileInterface *reader, int samplerate)
     int size = (int)reader->filelength();
 
 	filestate.ptr = start;
-	filestate.offset = 0;
+	filestate.owned = false;
 	headsize = MIN((int)sizeof(start), size);
 
     if (headsize != reader->read(start, headsize))
@@ -786,6 +914,17 @@ StreamSource* MOD_OpenSong(MusicIO::FileInterface *reader, int samplerate)
         return NULL;
     }
 
+	// A module that is already playing is shared instead of being loaded again.
+	FDumbModuleKey key;
+	auto module = FindModule(reader, key);
+	if (module != nullptr)
+	{
+		state = new DumbSong(module, samplerate);
+		if (size >= 4 && dstart[0] == MAKE_ID('I','M','P','M')) ReadIT(module->Key.Data.get(), size, state, false);
+		else ReadDUH(module->duh, state, false, module->is_dos);
+		return state;
+	}
+
 	if (size >= 4 && dstart[0] == MAKE_ID('I','M','P','M'))
 	{
 		is_it = true;
@@ -901,7 +1040,7 @@ StreamSource* MOD_OpenSong(MusicIO::FileInterface *reader, int samplerate)
 	if ( ! duh )
 	{
 		is_dos = false;
-		if (filestate.ptr == (uint8_t *)start)
+		if (f == NULL)
 		{
 			if (!(f = dumb_read_allfile(&filestate, start, reader, headsize, size)))
 			{
@@ -911,7 +1050,7 @@ StreamSource* MOD_OpenSong(MusicIO::FileInterface *reader, int samplerate)
 		}
 		else
 		{
-			filestate.offset = 0;
+			dumbfile_seek(f, 0, DFS_SEEK_SET);
 		}
 		// No way to get the filename, so we can't check for a .mod extension, and
 		// therefore, trying to load an old 15-instrument SoundTracker module is not
@@ -927,11 +1066,13 @@ StreamSource* MOD_OpenSong(MusicIO::FileInterface *reader, int samplerate)
 	}
 	if ( duh )
 	{
-		if (dumbConfig.mod_autochip)
+		module = std::make_shared<FDumbModule>(duh, is_dos);
+		if (key.AutoChip)
 		{
-			MOD_SetAutoChip(duh);
+			module->StartAutoChip(key.Limits);
 		}
-		state = new DumbSong(duh, samplerate);
+		AddModule(module, key);
+		state = new DumbSong(module, samplerate);
 
 		if (is_it) ReadIT(filestate.ptr, size, state, false);
 		else ReadDUH(duh, state, false, is_dos);
@@ -941,7 +1082,7 @@ StreamSource* MOD_OpenSong(MusicIO::FileInterface *reader, int samplerate)
 		// Reposition file pointer for other codecs to do their checks.
         reader->seek(fpos, SEEK_SET);
 	}
-	if (filestate.ptr != (uint8_t *)start)
+	if (filestate.owned)
 	{
 		delete[] const_cast<uint8_t *>(filestate.ptr);
 	}
@@ -961,10 +1102,16 @@ bool DumbSong::GetData(void *buffer, size_t sizebytes)
 		memset(buffer, 0, sizebytes);
 		return false;
 	}
-	
-	while (sizebytes > 0)
+
+	const bool int16 = OutputType == SampleType_Int16;
+	const size_t framesize = int16 ? 4 : 8;
+	if (int16 && int32_buffer.size() < sizebytes / 2) int32_buffer.resize(sizebytes / 2);
+
+	while (sizebytes >= framesize)
 	{
-		int written = decode_run(buffer, (unsigned)sizebytes / 8);
+		int *render = int16 ? int32_buffer.data() : (int *)buffer;
+		// For float output DUMB converts the samples itself, in its last pass over the buffer.
+		int written = decode_run(render, unsigned(sizebytes / framesize), int16 ? 0.f : MasterVolume / (float)(1 << 24));
 		if (written < 0)
 		{
 			return false;
@@ -974,16 +1121,19 @@ bool DumbSong::GetData(void *buffer, size_t sizebytes)
 			memset(buffer, 0, sizebytes);
 			return true;
 		}
-		else
+		else if (int16)
 		{
-			// Convert to float
+			// 8.24 fixed point to 16 bit, scaled by the master volume.
+			const float scale = MasterVolume / (float)(1 << 9);
 			for (int i = 0; i < written * 2; ++i)
 			{
-				((float *)buffer)[i] = (((int *)buffer)[i] / (float)(1 << 24)) * MasterVolume;
+				float v = render[i] * scale;
+				v = v < -32768.f ? -32768.f : v > 32767.f ? 32767.f : v;
+				((int16_t *)buffer)[i] = (int16_t)v;
 			}
 		}
-		buffer = (uint8_t *)buffer + written * 8;
-		sizebytes -= written * 8;
+		buffer = (uint8_t *)buffer + written * framesize;
+		sizebytes -= written * framesize;
 	}
 	return true;
 }
@@ -994,9 +1144,9 @@ bool DumbSong::GetData(void *buffer, size_t sizebytes)
 //
 //==========================================================================
 
-void DumbSong::ChangeSettingNum(const char* setting, double val)
+void DumbSong::ChangeSettingNum(ESongSetting setting, double val)
 {
-	if (!stricmp(setting, "dumb.mastervolume"))
+	if (setting == SETTING_DUMB_MASTERVOLUME)
 		MasterVolume = (float)val;
 }
 
@@ -1006,9 +1156,10 @@ void DumbSong::ChangeSettingNum(const char* setting, double val)
 //
 //==========================================================================
 
-DumbSong::DumbSong(DUH* myduh, int samplerate)
+DumbSong::DumbSong(std::shared_ptr<FDumbModule> module, int samplerate)
 {
-	duh = myduh;
+	Module = std::move(module);
+	duh = Module->duh;
 	sr = NULL;
 	eof = false;
 	interp = dumbConfig.mod_interp;
@@ -1026,6 +1177,10 @@ DumbSong::DumbSong(DUH* myduh, int samplerate)
 		srate = samplerate;
 	}
 	delta = 65536.0 / srate;
+
+	int threads = dumbConfig.mod_threads;
+	if (threads <= 0) threads = (int)ZMusic_JobThreads();
+	if (threads > 1) MixThreads.Start(threads);
 }
 
 //==========================================================================
@@ -1037,7 +1192,6 @@ DumbSong::DumbSong(DUH* myduh, int samplerate)
 DumbSong::~DumbSong()
 {
 	if (sr) duh_end_sigrenderer(sr);
-	if (duh) unload_duh(duh);
 }
 
 //==========================================================================
@@ -1048,7 +1202,23 @@ DumbSong::~DumbSong()
 
 SoundStreamInfoEx DumbSong::GetFormatEx()
 {
-	return { 32*1024, srate, SampleType_Float32, ChannelConfig_Stereo };
+	return { OutputType == SampleType_Int16 ? 16*1024 : 32*1024, srate, OutputType, ChannelConfig_Stereo };
+}
+
+//==========================================================================
+//
+// DumbSong SetSampleType
+//
+// DUMB renders 8.24 fixed point so 16 bit output can be produced directly
+// without going through float first.
+//
+//==========================================================================
+
+bool DumbSong::SetSampleType(SampleType type)
+{
+	if (type != SampleType_Float32 && type != SampleType_Int16) return false;
+	OutputType = type;
+	return true;
 }
 
 //==========================================================================
@@ -1059,10 +1229,52 @@ SoundStreamInfoEx DumbSong::GetFormatEx()
 
 bool DumbSong::Start()
 {
+	Module->WaitAutoChip();
 	started = open2(0);
+	if (started) StartIndex(false);
 	return started;
 }
 
+//==========================================================================
+//
+// DumbSong :: StartIndex
+//
+// The checkpoints of a shared module are left to the order they were
+// recorded for, or the songs would keep replacing each other's.
+//
+//==========================================================================
+
+void DumbSong::StartIndex(bool replace)
+{
+	Module->StartIndex(start_order, replace && Module.use_count() == 1);
+}
+
+//==========================================================================
+//
+// DumbSong :: SetPosition
+//
+//==========================================================================
+
+bool DumbSong::SetPosition(unsigned ms)
+{
+	if (!started)
+	{
+		return false;
+	}
+	DUH_SIGRENDERER *oldsr = sr;
+	sr = NULL;
+	if (!open2(long(int64_t(ms) * 65536 / 1000)))
+	{
+		sr = oldsr;
+		return false;
+	}
+	duh_end_sigrenderer(oldsr);
+	eof = false;
+	// A subsong change during the scan could not replace its checkpoints yet.
+	StartIndex(true);
+	return true;
+}
+
 //==========================================================================
 //
 // DumbSong :: SetSubsong
@@ -1089,6 +1301,7 @@ bool DumbSong::SetSubsong(int order)
 		return false;
 	}
 	duh_end_sigrenderer(oldsr);
+	StartIndex(true);
 	return true;
 }
 
@@ -1100,15 +1313,7 @@ bool DumbSong::SetSubsong(int order)
 
 bool DumbSong::open2(long pos)
 {
-	if (start_order != 0)
-	{
-		sr = dumb_it_start_at_order(duh, 2, start_order);
-		if (sr && pos) duh_sigrenderer_generate_samples(sr, 0, 1, pos, 0);
-	}
-	else
-	{
-		sr = duh_start_sigrenderer(duh, 0, 2, pos);
-	}
+	sr = Module->StartRenderer(start_order, pos);
 	if (!sr)
 	{
 		return false;
@@ -1123,9 +1328,27 @@ bool DumbSong::open2(long pos)
 	}
 	dumb_it_set_xm_speed_zero_callback(itsr, &dumb_it_callback_terminate, NULL);
 	dumb_it_set_global_volume_zero_callback(itsr, &dumb_it_callback_terminate, NULL);
+	if (MixThreads.Size() > 1)
+	{
+		dumb_it_set_parallel_for(itsr, &RunMixJobs, &MixThreads, MixThreads.Size());
+	}
 	return true;
 }
 
+//==========================================================================
+//
+// DumbSong :: RunMixJobs												static
+//
+// Lets DUMB mix the voices on the song's worker threads.
+//
+//==========================================================================
+
+void DumbSong::RunMixJobs(void *context, int count, void (*job)(void *, int), void *jobcontext)
+{
+	auto work = [=](size_t i) { job(jobcontext, (int)i); };
+	static_cast<FWorkerGroup *>(context)->Run(count, work);
+}
+
 //==========================================================================
 //
 // DumbSong :: render
@@ -1160,11 +1383,12 @@ long DumbSong::render(double volume, double delta, long samples, sample_t **buff
 // DumbSong :: decode_run
 //
 // Given a buffer of 32-bit PCM stereo pairs and a size specified in
-// samples, returns the number of samples written to the buffer.
+// samples, returns the number of samples written to the buffer. With a
+// floatscale other than 0 the buffer receives floats scaled by it instead.
 //
 //==========================================================================
 
-int DumbSong::decode_run(void *buffer, unsigned int size)
+int DumbSong::decode_run(void *buffer, unsigned int size, float floatscale)
 {
 	if (eof) return 0;
 
@@ -1177,6 +1401,8 @@ int DumbSong::decode_run(void *buffer, unsigned int size)
 	int written = 0;
 
 retry:
+	// Set every time because render may have had to start a new renderer for looping.
+	dumb_it_set_float_output(duh_get_it_sigrenderer(sr), floatscale);
 	dumb_silence(buf[0], size * 2);
 	written = render(1, delta, samples, buf);
 
@@ -1187,6 +1413,32 @@ retry:
 	return written;
 }
 
+//==========================================================================
+//
+// DumbSong :: GetPosition
+//
+// Modules have no beats, so four rows are taken as one and the orders as
+// bars. A tick lasts 2.5 / tempo seconds.
+//
+//==========================================================================
+
+bool DumbSong::GetPosition(ZMusicPosition &pos, double &ticksperframe)
+{
+	DUMB_IT_SIGRENDERER *itsr = started && sr != nullptr ? duh_get_it_sigrenderer(sr) : nullptr;
+	if (itsr == nullptr || itsr->order < 0 || itsr->speed <= 0 || itsr->tempo <= 0) return false;
+
+	pos.order = itsr->order;
+	pos.row = itsr->row;
+	pos.tick = itsr->row + double(std::max(0, std::min(itsr->speed - itsr->tick, itsr->speed - 1))) / itsr->speed;
+	pos.ticksPerBeat = 4;
+	pos.tempo = 6. * itsr->tempo / itsr->speed;
+	pos.bar = itsr->order;
+	pos.beatsPerBar = (itsr->n_rows + 3) / 4;
+	pos.beat = pos.tick / 4;
+	ticksperframe = itsr->tempo / (2.5 * itsr->speed * srate);
+	return true;
+}
+
 //==========================================================================
 //
 // DumbSong :: GetStats
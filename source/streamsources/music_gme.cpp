@@ -37,29 +37,67 @@
 // Uncomment if you are using the DLL version of GME.
 //#define GME_DLL
 
+#include <math.h>
 #include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <stdexcept>
+#include <vector>
 
 #include "streamsource.h"
 #include <gme/gme.h>
 #include "fileio.h"
+#include "zmusic/jobs.h"
 
 // MACROS ------------------------------------------------------------------
 
+enum
+{
+	SEEK_SNAPSHOT_TIME = 10000,	// The seek index keeps the emulator's state every 10 seconds.
+	PREPARE_TIME = 500,	// ms of a prepared track that get rendered ahead.
+};
+
 // TYPES -------------------------------------------------------------------
 
+struct GMESeekSnapshot
+{
+	long Time;
+	std::vector<uint8_t> State;
+};
+
+// The FM chip settings, which need to be set before a file is loaded.
+// Every emulator of a song gets the ones it was opened with.
+struct GMEFMOptions
+{
+	int YM2612Core = miscConfig.gme_ym2612_core;
+	int NativeRate = miscConfig.gme_fm_native_rate;
+};
+
+struct GMEPreparedTrack
+{
+	Music_Emu *Emu = nullptr;
+	gme_info_t *Info = nullptr;
+	int Track = -1;
+	TMusicVector<short> Samples;	// the first PREPARE_TIME ms of the track.
+};
+
 class GMESong : public StreamSource
 {
 public:
-	GMESong(Music_Emu *emu, int sample_rate);
+	GMESong(Music_Emu *emu, int sample_rate, std::vector<uint8_t> &&song, const GMEFMOptions &fm);
 	~GMESong();
 	bool SetSubsong(int subsong) override;
+	int GetSubsongCount() override { return gme_track_count(Emu); }
 	bool Start() override;
-	void ChangeSettingNum(const char *name, double val) override;
+	bool SetPosition(unsigned ms) override;
+	bool PrepareSubsong(int subsong, int crossfade_ms) override;
+	void ChangeSettingNum(ESongSetting setting, double val) override;
 	std::string GetStats() override;
 	bool GetData(void *buffer, size_t len) override;
 	SoundStreamInfoEx GetFormatEx() override;
+	bool GetTiming(int &length, int &loopstart, int &loopend) override;
+	bool CanSkip() override { return true; }
+	bool Skip(size_t frames) override;
 
 protected:
 	Music_Emu *Emu;
@@ -68,9 +106,41 @@ protected:
 	int CurrTrack;
 	bool started = false;
 
+	// Kept for the emulators that run next to the playing one.
+	std::vector<uint8_t> SongData;
+	GMEFMOptions FMOptions;
+
+	// Emulators that can save their state get a seek index, which a second
+	// emulator playing the track in the background fills.
+	std::vector<GMESeekSnapshot> SeekIndex;
+	std::mutex IndexLock;
+	FJob ScanJob;
+	std::atomic<bool> StopScan{ false };
+	int IndexTrack = -1;
+
+	// PrepareSubsong starts the next track in a background job. SetSubsong
+	// switches to it and lets the old emulator fade out over FadeTotal frames.
+	GMEPreparedTrack Next;
+	FJob PrepareJob;
+	int NextCrossfade = 0;
+	TMusicVector<short> Pending;	// what is left of the prepared part of the current track.
+	size_t PendingPos = 0;
+	Music_Emu *FadeEmu = nullptr;
+	TMusicVector<short> FadeBuffer;
+	int FadeTotal = 0, FadeLeft = 0;
+
 	bool StartTrack(int track, bool getcritsec=true);
 	bool GetTrackInfo();
-	int CalcSongLength();
+	void StartScan(int track);
+	void StopScanning();
+	void ScanTrack(gme_type_t type, int track, long length);
+	void PrepareTrack(gme_type_t type, int track, bool looping);
+	void FinishPrepare();
+	void SwitchToPrepared();
+	gme_err_t Render(short *out, int count);
+	void MixFade(short *out, int count);
+	Music_Emu *NewEmu(gme_type_t type);
+	static int CalcSongLength(const gme_info_t *info);
 };
 
 // EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
@@ -79,6 +149,9 @@ protected:
 
 // PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
 
+static Music_Emu *GME_NewEmu(gme_type_t type, int sample_rate, const GMEFMOptions &fm);
+static void GME_SetupEmu(Music_Emu *emu);
+
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
 
 // PUBLIC DATA DEFINITIONS -------------------------------------------------
@@ -110,15 +183,16 @@ StreamSource *GME_OpenSong(MusicIO::FileInterface *reader, const char *fmt, int
 {
 	gme_type_t type;
 	gme_err_t err;
-	uint8_t *song;
+	std::vector<uint8_t> song;
 	Music_Emu *emu;
+	GMEFMOptions fm;
 	
 	type = gme_identify_extension(fmt);
 	if (type == NULL)
 	{
 		return NULL;
 	}
-	emu = gme_new_emu(type, sample_rate);
+	emu = GME_NewEmu(type, sample_rate, fm);
 	if (emu == nullptr)
 	{
 		return nullptr;
@@ -127,31 +201,73 @@ StreamSource *GME_OpenSong(MusicIO::FileInterface *reader, const char *fmt, int
     auto fpos = reader->tell();
 	auto len = reader->filelength();
 
-	song = new uint8_t[len];
-    if (reader->read(song, len) != len)
-    {
-        delete[] song;
-        gme_delete(emu);
-        reader->seek(fpos, SEEK_SET);
-        return nullptr;
-    }
+	// GME copies the data while loading so memory based readers need no extra buffer.
+	auto shared = reader->shareData();
+	if (shared != nullptr)
+	{
+		err = gme_load_data(emu, shared.get() + fpos, (long)(len - fpos));
+		if (err == nullptr)
+		{
+			song.assign(shared.get() + fpos, shared.get() + len);
+		}
+	}
+	else
+	{
+		song.resize(len);
+		if (reader->read(song.data(), len) != len)
+		{
+			gme_delete(emu);
+			reader->seek(fpos, SEEK_SET);
+			return nullptr;
+		}
 
-	err = gme_load_data(emu, song, (long)len);
-    delete[] song;
+		err = gme_load_data(emu, song.data(), (long)len);
+	}
 
 	if (err != nullptr)
 	{
 		gme_delete(emu);
 		throw std::runtime_error(err);
 	}
+	GME_SetupEmu(emu);
+	return new GMESong(emu, sample_rate, std::move(song), fm);
+}
+
+//==========================================================================
+//
+// GME_NewEmu
+//
+//==========================================================================
+
+static Music_Emu *GME_NewEmu(gme_type_t type, int sample_rate, const GMEFMOptions &fm)
+{
+	Music_Emu *emu = gme_new_emu(type, sample_rate);
+	if (emu != nullptr && gme_set_fm_options(emu, fm.YM2612Core, fm.NativeRate) != nullptr)
+	{
+		gme_delete(emu);
+		return nullptr;
+	}
+	return emu;
+}
+
+//==========================================================================
+//
+// GME_SetupEmu
+//
+// The settings every emulator of a song gets.
+//
+//==========================================================================
+
+static void GME_SetupEmu(Music_Emu *emu)
+{
 	gme_set_stereo_depth(emu, std::min(std::max(miscConfig.gme_stereodepth, 0.f), 1.f));
 	gme_set_fade(emu, -1); // Enable infinite loop
+	// StreamSong checks the output for silence itself, which saves GME from emulating ahead to look for it.
+	gme_ignore_silence(emu, miscConfig.snd_silencetimeout > 0);
 
 #if GME_VERSION >= 0x602
 	gme_set_autoload_playback_limit(emu, 0);
 #endif // GME_VERSION >= 0x602
-
-	return new GMESong(emu, sample_rate);
 }
 
 //==========================================================================
@@ -160,7 +276,8 @@ StreamSource *GME_OpenSong(MusicIO::FileInterface *reader, const char *fmt, int
 //
 //==========================================================================
 
-GMESong::GMESong(Music_Emu *emu, int sample_rate)
+GMESong::GMESong(Music_Emu *emu, int sample_rate, std::vector<uint8_t> &&song, const GMEFMOptions &fm)
+	: SongData(std::move(song)), FMOptions(fm)
 {
 	Emu = emu;
 	SampleRate = sample_rate;
@@ -182,6 +299,17 @@ SoundStreamInfoEx GMESong::GetFormatEx()
 
 GMESong::~GMESong()
 {
+	StopScanning();
+	FinishPrepare();
+	if (Next.Emu != nullptr)
+	{
+		gme_free_info(Next.Info);
+		gme_delete(Next.Emu);
+	}
+	if (FadeEmu != nullptr)
+	{
+		gme_delete(FadeEmu);
+	}
 	if (TrackInfo != NULL)
 	{
 		gme_free_info(TrackInfo);
@@ -199,9 +327,9 @@ GMESong::~GMESong()
 //
 //==========================================================================
 
-void GMESong::ChangeSettingNum(const char *name, double val)
+void GMESong::ChangeSettingNum(ESongSetting setting, double val)
 {
-	if (Emu != nullptr && !stricmp(name, "gme.stereodepth"))
+	if (Emu != nullptr && setting == SETTING_GME_STEREODEPTH)
 	{
 		gme_set_stereo_depth(Emu, std::min(std::max(0., val), 1.));
 	}
@@ -236,6 +364,12 @@ bool GMESong::SetSubsong(int track)
 		CurrTrack = track;
 		return true;
 	}
+	FinishPrepare();
+	if (Next.Emu != nullptr && Next.Track == track)
+	{
+		SwitchToPrepared();
+		return true;
+	}
 	return StartTrack(track);
 }
 
@@ -266,14 +400,266 @@ bool GMESong::StartTrack(int track, bool getcritsec)
 	}
 	CurrTrack = track;
 	started = true;
+	Pending.clear();
 	GetTrackInfo();
 	if (!m_Looping)
 	{
-		gme_set_fade(Emu, CalcSongLength());
+		gme_set_fade(Emu, CalcSongLength(TrackInfo));
+	}
+	if (track != IndexTrack)
+	{
+		StartScan(track);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// GMESong :: StartScan
+//
+// Throws the old track's seek index away and starts building one for the
+// new track, if the emulator can save its state.
+//
+//==========================================================================
+
+void GMESong::StartScan(int track)
+{
+	StopScanning();
+	SeekIndex.clear();
+	IndexTrack = track;
+	if (gme_state_size(Emu) > 0)
+	{
+		StopScan.store(false, std::memory_order_relaxed);
+		gme_type_t type = gme_type(Emu);
+		long length = (long)CalcSongLength(TrackInfo);
+		ScanJob.Start(JOB_BACKGROUND, [=]() { ScanTrack(type, track, length); });
+	}
+}
+
+//==========================================================================
+//
+// GMESong :: StopScanning
+//
+//==========================================================================
+
+void GMESong::StopScanning()
+{
+	if (ScanJob.Pending())
+	{
+		StopScan.store(true, std::memory_order_relaxed);
+		ScanJob.Wait();
+	}
+}
+
+//==========================================================================
+//
+// GMESong :: ScanTrack
+//
+// Runs in the scan job. Plays the track on an emulator of its own up to
+// its length and records a snapshot every SEEK_SNAPSHOT_TIME.
+//
+//==========================================================================
+
+void GMESong::ScanTrack(gme_type_t type, int track, long length)
+{
+	Music_Emu *scan = NewEmu(type);
+	if (scan == nullptr)
+	{
+		return;
+	}
+	if (gme_start_track(scan, track) == nullptr)
+	{
+		for (long time = SEEK_SNAPSHOT_TIME; time < length && !StopScan.load(std::memory_order_relaxed); time += SEEK_SNAPSHOT_TIME)
+		{
+			if (gme_seek(scan, time) != nullptr || gme_track_ended(scan))
+			{
+				break;
+			}
+			GMESeekSnapshot snapshot = { gme_tell(scan), std::vector<uint8_t>(gme_state_size(scan)) };
+			gme_save_state(scan, snapshot.State.data());
+
+			std::lock_guard<std::mutex> lock(IndexLock);
+			SeekIndex.push_back(std::move(snapshot));
+		}
+	}
+	gme_delete(scan);
+}
+
+//==========================================================================
+//
+// GMESong :: SetPosition
+//
+// Without a snapshot GME has to emulate all the way from the start of the
+// track. With one, only the time past the closest snapshot before the
+// target is emulated.
+//
+//==========================================================================
+
+bool GMESong::SetPosition(unsigned ms)
+{
+	if (!started)
+	{
+		return false;
+	}
+
+	long target = (long)ms;
+	long now = gme_tell(Emu);
+	{
+		std::lock_guard<std::mutex> lock(IndexLock);
+		auto snapshot = std::upper_bound(SeekIndex.begin(), SeekIndex.end(), target,
+			[](long time, const GMESeekSnapshot &snap) { return time < snap.Time; });
+		// Going forward from the current position may still be shorter.
+		if (snapshot != SeekIndex.begin() && (std::prev(snapshot)->Time > now || target < now))
+		{
+			gme_load_state(Emu, std::prev(snapshot)->State.data());
+		}
+	}
+	Pending.clear();
+	return gme_seek(Emu, target) == nullptr;
+}
+
+//==========================================================================
+//
+// GMESong :: NewEmu
+//
+// Another emulator for the song, set up like the playing one.
+//
+//==========================================================================
+
+Music_Emu *GMESong::NewEmu(gme_type_t type)
+{
+	Music_Emu *emu = GME_NewEmu(type, SampleRate, FMOptions);
+	if (emu != nullptr)
+	{
+		if (gme_load_data(emu, SongData.data(), (long)SongData.size()) != nullptr)
+		{
+			gme_delete(emu);
+			return nullptr;
+		}
+		GME_SetupEmu(emu);
+	}
+	return emu;
+}
+
+//==========================================================================
+//
+// GMESong :: PrepareSubsong
+//
+// Starts the track on a second emulator in the background and renders its
+// beginning, so that switching to it with SetSubsong needs no emulation.
+// Track infos, including the lengths of NSFe and M3U playlists, are read
+// on the worker as well.
+//
+//==========================================================================
+
+bool GMESong::PrepareSubsong(int track, int crossfade_ms)
+{
+	if (!started || SongData.empty() || track == CurrTrack)
+	{
+		return false;
 	}
+	FinishPrepare();
+	if (Next.Emu != nullptr)
+	{
+		gme_free_info(Next.Info);
+		gme_delete(Next.Emu);
+		Next = {};
+	}
+	Next.Track = track;
+	NextCrossfade = std::max(crossfade_ms, 0);
+	gme_type_t type = gme_type(Emu);
+	bool looping = m_Looping;
+	PrepareJob.Start(JOB_BACKGROUND, [=]() { PrepareTrack(type, track, looping); });
 	return true;
 }
 
+//==========================================================================
+//
+// GMESong :: PrepareTrack
+//
+// Runs in the prepare job and only touches Next.
+//
+//==========================================================================
+
+void GMESong::PrepareTrack(gme_type_t type, int track, bool looping)
+{
+	Music_Emu *emu = NewEmu(type);
+	if (emu == nullptr)
+	{
+		return;
+	}
+	if (gme_start_track(emu, track) != nullptr)
+	{
+		gme_delete(emu);
+		return;
+	}
+	gme_track_info(emu, &Next.Info, track);
+	if (!looping)
+	{
+		gme_set_fade(emu, CalcSongLength(Next.Info));
+	}
+	Next.Samples.resize(size_t(SampleRate) * PREPARE_TIME / 1000 * 2);
+	if (gme_play(emu, int(Next.Samples.size()), Next.Samples.data()) != nullptr)
+	{
+		gme_free_info(Next.Info);
+		gme_delete(emu);
+		Next.Info = nullptr;
+		return;
+	}
+	Next.Emu = emu;
+}
+
+//==========================================================================
+//
+// GMESong :: FinishPrepare
+//
+//==========================================================================
+
+void GMESong::FinishPrepare()
+{
+	PrepareJob.Wait();
+}
+
+//==========================================================================
+//
+// GMESong :: SwitchToPrepared
+//
+// Makes the prepared emulator the playing one. The old one keeps playing
+// for the crossfade, if there is one.
+//
+//==========================================================================
+
+void GMESong::SwitchToPrepared()
+{
+	if (FadeEmu != nullptr)
+	{
+		gme_delete(FadeEmu);
+		FadeEmu = nullptr;
+	}
+	FadeTotal = FadeLeft = int(int64_t(NextCrossfade) * SampleRate / 1000);
+	if (FadeTotal > 0 && !gme_track_ended(Emu))
+	{
+		FadeEmu = Emu;
+	}
+	else
+	{
+		gme_delete(Emu);
+		FadeLeft = 0;
+	}
+
+	if (TrackInfo != NULL)
+	{
+		gme_free_info(TrackInfo);
+	}
+	Emu = Next.Emu;
+	TrackInfo = Next.Info;
+	CurrTrack = Next.Track;
+	Pending = std::move(Next.Samples);
+	PendingPos = 0;
+	Next = {};
+	StartScan(CurrTrack);
+}
+
 //==========================================================================
 //
 // GMESong :: GetStats
@@ -330,23 +716,61 @@ bool GMESong::GetTrackInfo()
 //
 //==========================================================================
 
-int GMESong::CalcSongLength()
+int GMESong::CalcSongLength(const gme_info_t *info)
 {
-	if (TrackInfo == NULL)
+	if (info == NULL)
 	{
 		return 150000;
 	}
-	if (TrackInfo->length > 0)
+	if (info->length > 0)
 	{
-		return TrackInfo->length;
+		return info->length;
 	}
-	if (TrackInfo->loop_length > 0)
+	if (info->loop_length > 0)
 	{
-		return TrackInfo->intro_length + TrackInfo->loop_length * 2;
+		return info->intro_length + info->loop_length * 2;
 	}
 	return 150000;
 }
 
+//==========================================================================
+//
+// GMESong :: GetTiming
+//
+// The length is what gets played before fading out when not looping.
+// Tracks whose file does not tell have no known length, the default
+// CalcSongLength uses for them is made up.
+//
+//==========================================================================
+
+bool GMESong::GetTiming(int &length, int &loopstart, int &loopend)
+{
+	gme_info_t *info;
+
+	if (gme_track_info(Emu, &info, CurrTrack) != NULL)
+	{
+		return false;
+	}
+	if (info->length <= 0 && info->loop_length <= 0)
+	{
+		gme_free_info(info);
+		return false;
+	}
+	length = CalcSongLength(info);
+	if (info->loop_length > 0)
+	{
+		loopstart = std::max(info->intro_length, 0);
+		loopend = loopstart + info->loop_length;
+	}
+	else
+	{
+		loopstart = 0;
+		loopend = length;
+	}
+	gme_free_info(info);
+	return true;
+}
+
 //==========================================================================
 //
 // GMESong :: Read													STATIC
@@ -357,7 +781,7 @@ bool GMESong::GetData(void *buffer, size_t len)
 {
 	gme_err_t err;
 
-	if (gme_track_ended(Emu))
+	if (PendingPos >= Pending.size() && gme_track_ended(Emu))
 	{
 		if (m_Looping)
 		{
@@ -369,6 +793,114 @@ bool GMESong::GetData(void *buffer, size_t len)
 			return false;
 		}
 	}
-	err = gme_play(Emu, int(len >> 1), (short *)buffer);
+	err = Render((short *)buffer, int(len >> 1));
+	MixFade((short *)buffer, int(len >> 1));
 	return (err == NULL);
 }
+
+//==========================================================================
+//
+// GMESong :: Skip
+//
+// The emulators mute all their voices for skipping, which leaves only the
+// CPU emulation to run. A crossfade in progress is of no use to anyone.
+//
+//==========================================================================
+
+bool GMESong::Skip(size_t frames)
+{
+	if (PendingPos >= Pending.size() && gme_track_ended(Emu))
+	{
+		if (!m_Looping) return false;
+		StartTrack(CurrTrack, false);
+	}
+	if (FadeEmu != nullptr)
+	{
+		gme_delete(FadeEmu);
+		FadeEmu = nullptr;
+		FadeLeft = 0;
+	}
+	size_t count = frames * 2;
+	if (PendingPos < Pending.size())
+	{
+		size_t n = std::min(count, Pending.size() - PendingPos);
+		PendingPos += n;
+		count -= n;
+		if (PendingPos >= Pending.size())
+		{
+			Pending.clear();
+			Pending.shrink_to_fit();
+		}
+	}
+	return count == 0 || gme_seek_samples(Emu, gme_tell_samples(Emu) + int(count)) == nullptr;
+}
+
+//==========================================================================
+//
+// GMESong :: Render
+//
+// Hands out what was prepared of the track before emulating any further.
+//
+//==========================================================================
+
+gme_err_t GMESong::Render(short *out, int count)
+{
+	if (PendingPos < Pending.size())
+	{
+		int n = (int)std::min<size_t>(count, Pending.size() - PendingPos);
+		memcpy(out, &Pending[PendingPos], n * sizeof(short));
+		PendingPos += n;
+		out += n;
+		count -= n;
+		if (PendingPos >= Pending.size())
+		{
+			Pending.clear();
+			Pending.shrink_to_fit();
+		}
+	}
+	return count > 0 ? gme_play(Emu, count, out) : nullptr;
+}
+
+//==========================================================================
+//
+// GMESong :: MixFade
+//
+// Mixes the track that was switched away from into the output with an
+// equal-power crossfade.
+//
+//==========================================================================
+
+void GMESong::MixFade(short *out, int count)
+{
+	if (FadeEmu == nullptr)
+	{
+		return;
+	}
+	const double quarter = 1.5707963267948966;	// pi / 2
+	int frames = std::min(FadeLeft, count / 2);
+	FadeBuffer.resize(frames * 2);
+	if (gme_play(FadeEmu, frames * 2, FadeBuffer.data()) == nullptr)
+	{
+		int done = FadeTotal - FadeLeft;
+		for (int i = 0; i < frames; i++)
+		{
+			double angle = (done + i) * quarter / FadeTotal;
+			double in = sin(angle), fade = cos(angle);
+			for (int c = 0; c < 2; c++)
+			{
+				int s = int(out[i * 2 + c] * in + FadeBuffer[i * 2 + c] * fade);
+				out[i * 2 + c] = (short)std::min(std::max(s, -32768), 32767);
+			}
+		}
+		FadeLeft -= frames;
+	}
+	else
+	{
+		FadeLeft = 0;
+	}
+	if (FadeLeft <= 0)
+	{
+		gme_delete(FadeEmu);
+		FadeEmu = nullptr;
+	}
+}
@@ -36,30 +36,132 @@
 
 #include <mutex>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "zmusic_internal.h"
 #include "streamsource.h"
 #include "zmusic/sounddecoder.h"
+#include "zmusic/ringbuffer.h"
+#include "zmusic/songcache.h"
+#include "zmusic/profile.h"
+#include "zmusic/jobs.h"
 
 // MACROS ------------------------------------------------------------------
 
+enum
+{
+	DECODE_CHUNK_FRAMES = 4096,	// the decode thread reads this much at a time.
+};
+
 // TYPES -------------------------------------------------------------------
 
+// A file decoded into memory, shared by all songs playing it.
+struct PCMCacheEntry
+{
+	std::shared_ptr<const uint8_t> Data;	// the file, null for entries that can't be shared.
+	size_t Length = 0;
+	uint64_t Hash = 0;
+	std::vector<uint8_t> PCM;
+	std::atomic<bool> Complete{ false };	// PCM may only be read once this is set.
+	std::atomic<bool> Abort{ false };
+	size_t Accounted = 0;
+
+	~PCMCacheEntry()
+	{
+		ZMusic_AccountMemory(ZMUSIC_MEM_SAMPLES, -(ptrdiff_t)Accounted);
+	}
+
+	// Hands the finished PCM to the songs waiting for it.
+	void Finish()
+	{
+		Accounted = PCM.capacity();
+		ZMusic_AccountMemory(ZMUSIC_MEM_SAMPLES, Accounted);
+		Complete.store(true, std::memory_order_release);
+	}
+};
+
 class SndFileSong : public StreamSource
 {
 public:
-	SndFileSong(SoundDecoder *decoder, uint32_t loop_start, uint32_t loop_end, bool startass, bool endass);
+	SndFileSong(SoundDecoder *decoder, uint32_t loop_start, uint32_t loop_end, bool startass, bool endass, std::shared_ptr<const uint8_t> data, size_t length, MusicIO::FileInterface *stream);
 	~SndFileSong();
+	void SetPlayMode(bool looping) override;
+	bool Start() override;
 	std::string GetStats() override;
 	SoundStreamInfoEx GetFormatEx() override;
+	bool SetSampleType(SampleType type) override;
 	bool GetData(void *buffer, size_t len) override;
+	bool GetTiming(int &length, int &loopstart, int &loopend) override;
+	uint32_t TakeUnderruns() override;
 	
 protected:
 	SoundDecoder *Decoder;
 	unsigned int FrameSize;
+	// The decoder may be busy on the decode thread, so its format is read once up front.
+	int SampleRate;
+	ChannelConfig Channels;
+	SampleType Type;
+	size_t SampleLength;
 
 	uint32_t Loop_Start;
 	uint32_t Loop_End;
 
+	// With miscConfig.snd_decodeahead set, a thread keeps that much decoded
+	// ahead of GetData and is the only one to touch the decoder.
+	FRingBuffer Ring;
+	TMusicVector<uint8_t> Scratch;
+	std::thread DecodeThread;
+	std::mutex WakeLock;
+	std::condition_variable Wake;
+	bool Exit = false;
+	std::atomic<bool> Looping{ true };
+	std::atomic<bool> Ended{ false };
+	std::atomic<size_t> DecoderPos{ 0 };
+	std::atomic<uint32_t> Underruns{ 0 };
+	uint32_t ReportedUnderruns = 0;	// only touched by GetData's thread.
+	bool Filled = false;	// the ring has been full once, so running short after that is an underrun.
+
+	// The decoder's reader if its data is still arriving. Such songs always
+	// decode ahead and play silence while the ring fills up, at the start and
+	// whenever they ran short, instead of stuttering along with the download.
+	MusicIO::FileInterface *Stream = nullptr;
+	bool Buffering = false;
+
+	// Songs below miscConfig.snd_pcmcache switch over to playing from memory
+	// once the file has been decoded. Cursor is the position in there.
+	std::shared_ptr<PCMCacheEntry> Cached;
+	FJob CacheJob;	// only in the song that started decoding the file.
+	bool FromMemory = false;
+	size_t Cursor = 0;
+	size_t MemFrames = 0;
+
+	// With miscConfig.snd_dualloop a second decoder waits at the loop start,
+	// less the crossfade, while the first one plays up to the loop end. The
+	// seeks are done on PrimeThread, so a loop is just a swap of the two.
+	std::shared_ptr<const uint8_t> FileData;	// the spare decoder reads from this.
+	SoundDecoder *Spare = nullptr;
+	std::thread PrimeThread;
+	std::mutex PrimeLock;
+	std::condition_variable PrimeWake;
+	bool PrimeRequest = false;
+	bool PrimeExit = false;
+	std::atomic<bool> Primed{ false };	// Spare may only be touched by the decoding thread while this is set.
+	size_t FadeFrames = 0;
+	TMusicVector<uint8_t> Splice;	// the crossfaded frames, played before the new decoder's own.
+	TMusicVector<uint8_t> FadeIn;
+	size_t SplicePos = 0;
+
+	bool Decode(void *buffer, size_t len, size_t &filled);
+	bool ReadMemory(char *buffer, size_t len, size_t &filled);
+	size_t Position();
+	void RunDecoder();
+	bool DecodeLoop(char *buffer, size_t len);
+	void SpliceLoop();
+	void RunPrimer();
 	int CalcSongLength();
 };
 
@@ -75,6 +177,9 @@ protected:
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
+static std::mutex PCMCacheLock;
+static std::unordered_multimap<uint64_t, std::weak_ptr<PCMCacheEntry>> PCMCache;	// entries go away with the last song using them.
+
 // CODE --------------------------------------------------------------------
 
 //==========================================================================
@@ -382,6 +487,71 @@ static void FindOggComments(MusicIO::FileInterface *fr, uint32_t *loop_start, zm
 	}
 }
 
+//==========================================================================
+//
+// ReadAheadReader
+//
+// The tag scan makes lots of tiny reads and skips. For files that are not
+// in memory it goes through this, so that they cost a single read of the
+// file's start instead of one call into the reader each.
+//
+//==========================================================================
+
+struct ReadAheadReader : public MusicIO::FileInterface
+{
+	enum { BlockSize = 65536 };
+
+	MusicIO::FileInterface *mReader;
+	std::vector<uint8_t> mBuffer;
+	long mBufferStart;
+	long mPos;
+
+	ReadAheadReader(MusicIO::FileInterface *reader)
+		: mReader(reader), mBufferStart(reader->tell()), mPos(mBufferStart)
+	{
+	}
+	char* gets(char* buff, int n) override
+	{
+		return nullptr;
+	}
+	long read(void* buff, int32_t size) override
+	{
+		if (size <= 0) return 0;
+		if (mPos < mBufferStart || mPos + size > mBufferStart + (long)mBuffer.size())
+		{
+			if (mReader->seek(mPos, SEEK_SET) != 0) return 0;
+			mBuffer.resize(std::max<size_t>(size, BlockSize));
+			long got = mReader->read(mBuffer.data(), (int32_t)mBuffer.size());
+			mBuffer.resize(std::max(got, 0L));
+			mBufferStart = mPos;
+		}
+		long len = std::min<long>(size, mBufferStart + (long)mBuffer.size() - mPos);
+		memcpy(buff, mBuffer.data() + (mPos - mBufferStart), len);
+		mPos += len;
+		return len;
+	}
+	long seek(long offset, int whence) override
+	{
+		switch (whence)
+		{
+		case SEEK_CUR:
+			offset += mPos;
+			break;
+
+		case SEEK_END:
+			offset += mReader->filelength();
+			break;
+		}
+		if (offset < 0 || offset > mReader->filelength()) return -1;
+		mPos = offset;
+		return 0;
+	}
+	long tell() override
+	{
+		return mPos;
+	}
+};
+
 void FindLoopTags(MusicIO::FileInterface *fr, uint32_t *start, zmusic_bool *startass, uint32_t *end, zmusic_bool *endass)
 {
 	uint8_t signature[4];
@@ -412,12 +582,103 @@ StreamSource *SndFile_OpenSong(MusicIO::FileInterface *fr)
 
 	uint32_t loop_start = 0, loop_end = ~0u;
 	zmusic_bool startass = false, endass = false;
-	FindLoopTags(fr, &loop_start, &startass, &loop_end, &endass);
+	if (fr->memoryData() != nullptr)
+	{
+		FindLoopTags(fr, &loop_start, &startass, &loop_end, &endass);
+	}
+	else
+	{
+		ReadAheadReader tagreader(fr);
+		FindLoopTags(&tagreader, &loop_start, &startass, &loop_end, &endass);
+	}
 
 	fr->seek(0, SEEK_SET);
+	return SndFile_OpenSong(fr, loop_start, loop_end, startass, endass);
+}
+
+StreamSource *SndFile_OpenSong(MusicIO::FileInterface *fr, uint32_t loop_start, uint32_t loop_end, bool startass, bool endass)
+{
+	auto data = fr->shareData();
+	size_t length = fr->filelength();
 	auto decoder = SoundDecoder::CreateDecoder(fr);
 	if (decoder == nullptr) return nullptr;	// If this fails the file reader has not been taken over and the caller needs to clean up. This is to allow further analysis of the passed file.
-	return new SndFileSong(decoder, loop_start, loop_end, startass, endass);
+	return new SndFileSong(decoder, loop_start, loop_end, startass, endass, std::move(data), length, fr->mayWait() ? fr : nullptr);
+}
+
+//==========================================================================
+//
+// PCMCache_Find
+//
+// Returns the entry for the file, which the caller has to decode if
+// 'created' is set.
+//
+//==========================================================================
+
+static std::shared_ptr<PCMCacheEntry> PCMCache_Find(std::shared_ptr<const uint8_t> data, size_t length, bool &created)
+{
+	uint64_t hash = SongCache_HashData(data.get(), length);
+
+	std::lock_guard<std::mutex> lock(PCMCacheLock);
+	auto range = PCMCache.equal_range(hash);
+	for (auto it = range.first; it != range.second; )
+	{
+		auto entry = it->second.lock();
+		if (entry == nullptr)
+		{
+			it = PCMCache.erase(it);
+			continue;
+		}
+		if (entry->Length == length && !entry->Abort.load(std::memory_order_relaxed) && memcmp(entry->Data.get(), data.get(), length) == 0)
+		{
+			created = false;
+			return entry;
+		}
+		++it;
+	}
+	auto entry = std::make_shared<PCMCacheEntry>();
+	entry->Data = std::move(data);
+	entry->Length = length;
+	entry->Hash = hash;
+	PCMCache.emplace(hash, entry);
+	created = true;
+	return entry;
+}
+
+//==========================================================================
+//
+// PCMCache_Decode
+//
+// Runs in the creating song's CacheJob, with a decoder of its own so
+// the song can keep streaming until this is done. Reads in pieces so that
+// the song can stop it if nobody else is waiting for the result.
+//
+//==========================================================================
+
+static void PCMCache_Decode(PCMCacheEntry *entry, size_t expected)
+{
+	auto reader = new MusicIO::MemoryReader(entry->Data.get(), (long)entry->Length);
+	auto decoder = SoundDecoder::CreateDecoder(reader);
+	if (decoder == nullptr)
+	{
+		reader->close();
+		return;
+	}
+	std::vector<uint8_t> &pcm = entry->PCM;
+	pcm.reserve(expected);
+	size_t total = 0;
+	while (!entry->Abort.load(std::memory_order_relaxed))
+	{
+		pcm.resize(total + 65536);
+		size_t got = decoder->read((char*)pcm.data() + total, 65536);
+		total += got;
+		if (got == 0) break;
+	}
+	pcm.resize(total);
+	delete decoder;
+	if (!entry->Abort.load(std::memory_order_relaxed))
+	{
+		entry->Finish();
+	}
 }
 
 //==========================================================================
@@ -431,7 +692,7 @@ static int32_t Scale(int32_t a, int32_t b, int32_t c)
 	return (int32_t)(((int64_t)a * b) / c);
 }
 
-SndFileSong::SndFileSong(SoundDecoder *decoder, uint32_t loop_start, uint32_t loop_end, bool startass, bool endass)
+SndFileSong::SndFileSong(SoundDecoder *decoder, uint32_t loop_start, uint32_t loop_end, bool startass, bool endass, std::shared_ptr<const uint8_t> data, size_t length, MusicIO::FileInterface *stream)
 {
 	ChannelConfig chanconf;
 	SampleType stype;
@@ -447,16 +708,221 @@ SndFileSong::SndFileSong(SoundDecoder *decoder, uint32_t loop_start, uint32_t lo
 	Loop_End = sampleLength == 0 ? loop_end : std::min<uint32_t>(loop_end, sampleLength);
 	Decoder = decoder;
 	FrameSize = ZMusic_ChannelCount(chanconf) * ZMusic_SampleTypeSize(stype);
+	SampleRate = srate;
+	Channels = chanconf;
+	Type = stype;
+	SampleLength = decoder->getSampleLength();
+	Stream = stream;
+	Buffering = stream != nullptr;
+
+	if (miscConfig.snd_dualloop && data != nullptr && Loop_Start < Loop_End)
+	{
+		auto reader = new MusicIO::MemoryReader(data.get(), (long)length);
+		Spare = SoundDecoder::CreateDecoder(reader);
+		if (Spare == nullptr)
+		{
+			reader->close();
+		}
+		else
+		{
+			int srate2;
+			Spare->getInfo(&srate2, &chanconf, &stype);
+			if (srate2 != SampleRate || chanconf != Channels || stype != Type)
+			{
+				delete Spare;
+				Spare = nullptr;
+			}
+			else
+			{
+				FileData = data;
+				// The crossfade needs as much before the loop start as it takes from the loop's end.
+				if (Type == SampleType_Int16 || Type == SampleType_Float32)
+				{
+					FadeFrames = size_t(Scale(miscConfig.snd_loopcrossfade, SampleRate, 1000));
+					FadeFrames = std::min<size_t>({ FadeFrames, Loop_Start, (Loop_End - Loop_Start) / 2 });
+				}
+			}
+		}
+	}
+
+	// Decoding into memory right here would wait for all of a stream.
+	if (miscConfig.snd_pcmcache > 0 && Stream == nullptr && SampleLength > 0 && SampleLength * FrameSize <= size_t(miscConfig.snd_pcmcache) * 1024)
+	{
+		if (data != nullptr)
+		{
+			bool created;
+			Cached = PCMCache_Find(std::move(data), length, created);
+			if (created)
+			{
+				PCMCacheEntry *entry = Cached.get();
+				size_t expected = SampleLength * FrameSize;
+				CacheJob.Start(JOB_BACKGROUND, [=]() { PCMCache_Decode(entry, expected); });
+			}
+		}
+		else
+		{
+			// Without the file's data there is no second decoder, so this one does it right here.
+			Cached = std::make_shared<PCMCacheEntry>();
+			Cached->PCM = Decoder->readAll();
+			Decoder->seek(0, false, false);
+			Cached->Finish();
+		}
+	}
+}
+
+//==========================================================================
+//
+// SndFileSong :: SetPlayMode
+//
+//==========================================================================
+
+void SndFileSong::SetPlayMode(bool looping)
+{
+	m_Looping = looping;
+	Looping.store(looping, std::memory_order_relaxed);
+}
+
+//==========================================================================
+//
+// SndFileSong :: Start
+//
+// Starts the decode thread, unless decoding ahead is turned off. Streams
+// need it anyway, their decoder may have to wait for the data.
+//
+//==========================================================================
+
+bool SndFileSong::Start()
+{
+	if (Spare != nullptr && !PrimeThread.joinable())
+	{
+		PrimeRequest = true;
+		PrimeThread = std::thread(&SndFileSong::RunPrimer, this);
+	}
+
+	// Nothing to decode ahead if the song already plays from memory.
+	bool inmemory = Cached != nullptr && Cached->Complete.load(std::memory_order_acquire);
+	int ahead = Stream != nullptr ? std::max(miscConfig.snd_decodeahead, 1000) : miscConfig.snd_decodeahead;
+	if (!DecodeThread.joinable() && !inmemory && ahead > 0 && SampleRate > 0)
+	{
+		size_t frames = std::max<size_t>(size_t(SampleRate) * std::min(ahead, 10000) / 1000, DECODE_CHUNK_FRAMES * 2);
+		Ring.Resize(frames * FrameSize);
+		Scratch.resize(DECODE_CHUNK_FRAMES * FrameSize);
+		DecodeThread = std::thread(&SndFileSong::RunDecoder, this);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// SndFileSong :: RunDecoder
+//
+// Runs on the decode thread. Loops are handled here as well, so GetData
+// never has to wait for a seek.
+//
+//==========================================================================
+
+void SndFileSong::RunDecoder()
+{
+	FThreadScope scope(THREAD_STREAM, "ZMusic decoder");
+	for (;;)
+	{
+		bool decoded = false;
+		if (!Ended.load(std::memory_order_relaxed) && Ring.WriteAvailable() >= Scratch.size())
+		{
+			size_t filled;
+			bool more = Decode(Scratch.data(), Scratch.size(), filled);
+			Ring.Write(Scratch.data(), more ? filled : 0);
+			if (!more || filled < Scratch.size())
+			{
+				Ended.store(true, std::memory_order_release);
+			}
+			DecoderPos.store(Position(), std::memory_order_relaxed);
+			decoded = true;
+		}
+
+		std::unique_lock<std::mutex> lock(WakeLock);
+		if (Exit) return;
+		// GetData wakes this up without taking the lock, so don't rely on it alone.
+		if (!decoded) Wake.wait_for(lock, std::chrono::milliseconds(10));
+		if (Exit) return;
+	}
+}
+
+//==========================================================================
+//
+// SndFileSong :: RunPrimer
+//
+// Runs on the prime thread and positions the spare decoder whenever a loop
+// has put the previous main decoder there.
+//
+//==========================================================================
+
+void SndFileSong::RunPrimer()
+{
+	FThreadScope scope(THREAD_STREAM, "ZMusic primer");
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(PrimeLock);
+			PrimeWake.wait(lock, [this] { return PrimeRequest || PrimeExit; });
+			if (PrimeExit) return;
+			PrimeRequest = false;
+		}
+		size_t target = Loop_Start - FadeFrames;
+		// A decoder that can't land exactly on the target would break the splice, so such songs keep seeking in place.
+		bool ok = Spare->seek(target, false, true) && Spare->getSampleOffset() == target;
+		Primed.store(ok, std::memory_order_release);
+	}
+}
+
+//==========================================================================
+//
+// SndFileSong :: GetTiming
+//
+//==========================================================================
+
+bool SndFileSong::GetTiming(int &length, int &loopstart, int &loopend)
+{
+	int srate = SampleRate;
+	uint64_t sampleLength = SampleLength;
+	if (sampleLength == 0 || srate <= 0)
+	{ // Streams of unknown length, like most MP3s without a header.
+		return false;
+	}
+	length = int(sampleLength * 1000 / srate);
+	loopstart = int(std::min<uint64_t>(Loop_Start, sampleLength) * 1000 / srate);
+	loopend = int(uint64_t(Loop_End) * 1000 / srate);
+	return true;
 }
 
 SoundStreamInfoEx SndFileSong::GetFormatEx()
 {
-	ChannelConfig chanconf;
-	SampleType stype;
-	int srate;
+	return { 64/*snd_streambuffersize*/ * 1024, SampleRate, Type, Channels };
+}
 
-	Decoder->getInfo(&srate, &chanconf, &stype);
-	return { 64/*snd_streambuffersize*/ * 1024, srate, stype, chanconf };
+//==========================================================================
+//
+// SndFileSong :: SetSampleType
+//
+// Lets the decoders produce the stream's format themselves. Not possible
+// once other threads use them or decoded data has been kept in the old one.
+//
+//==========================================================================
+
+bool SndFileSong::SetSampleType(SampleType type)
+{
+	if (type == Type) return true;
+	if (DecodeThread.joinable() || PrimeThread.joinable() || Cached != nullptr) return false;
+	if (!Decoder->setSampleType(type)) return false;
+	if (Spare != nullptr && !Spare->setSampleType(type))
+	{
+		delete Spare;
+		Spare = nullptr;
+		FileData.reset();
+	}
+	Type = type;
+	FrameSize = ZMusic_ChannelCount(Channels) * ZMusic_SampleTypeSize(Type);
+	return true;
 }
 
 //==========================================================================
@@ -467,6 +933,36 @@ SoundStreamInfoEx SndFileSong::GetFormatEx()
 
 SndFileSong::~SndFileSong()
 {
+	if (DecodeThread.joinable())
+	{
+		// Otherwise the thread might still be waiting for the stream's data.
+		if (Stream != nullptr) Stream->cancel();
+		{
+			std::lock_guard<std::mutex> lock(WakeLock);
+			Exit = true;
+		}
+		Wake.notify_one();
+		DecodeThread.join();
+	}
+	if (PrimeThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(PrimeLock);
+			PrimeExit = true;
+		}
+		PrimeWake.notify_one();
+		PrimeThread.join();
+	}
+	if (Spare != nullptr)
+	{
+		delete Spare;
+	}
+	if (CacheJob.Pending())
+	{
+		// Others sharing the entry still want it finished.
+		if (Cached.use_count() == 1) Cached->Abort.store(true, std::memory_order_relaxed);
+		CacheJob.Wait();
+	}
 	if (Decoder != nullptr)
 	{
 		delete Decoder;
@@ -483,36 +979,114 @@ std::string SndFileSong::GetStats()
 {
 	char out[80];
 	
-	ChannelConfig chanconf;
-	SampleType stype;
-	int srate;
-	Decoder->getInfo(&srate, &chanconf, &stype);
-	
-	size_t SamplePos = Decoder->getSampleOffset();
-	int time = int (SamplePos / srate);
+	int srate = SampleRate;
+	size_t SamplePos;
+	if (DecodeThread.joinable())
+	{
+		// Where the decoder is, minus what has not been played yet. Slightly off right after a loop.
+		size_t ahead = Ring.ReadAvailable() / FrameSize;
+		SamplePos = DecoderPos.load(std::memory_order_relaxed);
+		SamplePos = SamplePos > ahead ? SamplePos - ahead : 0;
+	}
+	else
+	{
+		SamplePos = Position();
+	}
+	int time = srate > 0 ? int (SamplePos / srate) : 0;
 	
 	snprintf(out, 80,
-		"Track: %s, %dHz  Time: %02d:%02d",
-		ZMusic_ChannelConfigName(chanconf), srate,
+		"Track: %s, %dHz  Time: %02d:%02d  Underruns: %u",
+		ZMusic_ChannelConfigName(Channels), srate,
 		time/60,
-		time % 60);
+		time % 60,
+		Underruns.load(std::memory_order_relaxed));
 	return out;
 }
 
 //==========================================================================
 //
-// SndFileSong :: Read													STATIC
+// SndFileSong :: GetData
+//
+// Takes the data from the decode thread if there is one. If it has fallen
+// behind, the rest is filled with silence instead of waiting.
 //
 //==========================================================================
 
 bool SndFileSong::GetData(void *vbuff, size_t len)
 {
+	if (!DecodeThread.joinable())
+	{
+		size_t filled;
+		return Decode(vbuff, len, filled);
+	}
+	bool ended = Ended.load(std::memory_order_acquire);
+	bool full = Ring.WriteAvailable() < Scratch.size();
+	if (full) Filled = true;
+	if (Buffering && !full && !ended)
+	{
+		if (Filled) Underruns.fetch_add(1, std::memory_order_relaxed);
+		Wake.notify_one();
+		memset(vbuff, 0, len);
+		return true;
+	}
+	Buffering = false;
+	size_t got = Ring.Read(vbuff, len);
+	Wake.notify_one();
+	memset((char*)vbuff + got, 0, len - got);
+	if (got < len && Filled && !Ended.load(std::memory_order_acquire))
+	{
+		Underruns.fetch_add(1, std::memory_order_relaxed);
+		Buffering = Stream != nullptr;
+	}
+	return got > 0 || !ended;
+}
+
+//==========================================================================
+//
+// SndFileSong :: TakeUnderruns
+//
+//==========================================================================
+
+uint32_t SndFileSong::TakeUnderruns()
+{
+	uint32_t underruns = Underruns.load(std::memory_order_relaxed);
+	uint32_t taken = underruns - ReportedUnderruns;
+	ReportedUnderruns = underruns;
+	return taken;
+}
+
+//==========================================================================
+//
+// SndFileSong :: Decode
+//
+
+// 'filled' is set to how much was decoded before the end of a song that
+// does not loop. The rest of the buffer is silence.
+//
+//==========================================================================
+
+bool SndFileSong::Decode(void *vbuff, size_t len, size_t &filled)
+{
+	ZMUSIC_PROFILE_ZONE("DecoderRead");
 	char *buff = (char*)vbuff;
 	
+	// A pending splice is after the decoder's position, so that has to be played first.
+	if (!FromMemory && Cached != nullptr && SplicePos >= Splice.size() && Cached->Complete.load(std::memory_order_acquire))
+	{
+		FromMemory = true;
+		MemFrames = Cached->PCM.size() / FrameSize;
+		Cursor = std::min(Decoder->getSampleOffset(), MemFrames);
+	}
+	if (FromMemory)
+	{
+		return ReadMemory(buff, len, filled);
+	}
+
+	filled = len;
 	size_t currentpos = Decoder->getSampleOffset();
 	size_t framestoread = len / FrameSize;
 	bool err = false;
-	if (!m_Looping)
+	if (!Looping.load(std::memory_order_relaxed))
 	{
 		size_t maxpos = Decoder->getSampleLength();
 		if (currentpos == maxpos)
@@ -524,6 +1098,7 @@ bool SndFileSong::GetData(void *vbuff, size_t len)
 		{
 			size_t got = Decoder->read(buff, (maxpos - currentpos) * FrameSize);
 			memset(buff + got, 0, len - got);
+			filled = got;
 		}
 		else
 		{
@@ -531,38 +1106,170 @@ bool SndFileSong::GetData(void *vbuff, size_t len)
 			err = (got != len);
 		}
 	}
+	else if (Spare != nullptr)
+	{
+		return DecodeLoop(buff, len);
+	}
 	else
 	{
-		// This looks a bit more complicated than necessary because libmpg123 will not read the full requested length for the last block in the file.
-		if (currentpos + framestoread > Loop_End)
+		return Decoder->readLooped(buff, len, Loop_Start, Loop_End) == len;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// SndFileSong :: DecodeLoop
+//
+// The looping part of Decode with a spare decoder. When that is not ready
+// in time, e.g. for loops that are shorter than a seek, this seeks in
+// place like Decode does without one.
+//
+//==========================================================================
+
+bool SndFileSong::DecodeLoop(char *buff, size_t len)
+{
+	bool seeked = false;
+	while (len > 0)
+	{
+		if (SplicePos < Splice.size())
 		{
-			// Loop can be very short, make sure the current position doesn't exceed it
-			if (currentpos < Loop_End)
-			{
-				size_t endblock = (Loop_End - currentpos) * FrameSize;
-				size_t endlen = Decoder->read(buff, endblock);
+			size_t n = std::min(len, Splice.size() - SplicePos);
+			memcpy(buff, Splice.data() + SplicePos, n);
+			SplicePos += n;
+			buff += n;
+			len -= n;
+			continue;
+		}
 
-				// Even if zero bytes was read give it a chance to start from the beginning
-				buff += endlen;
-				len -= endlen;
-			}
+		size_t pos = Decoder->getSampleOffset();
+		bool primed = Primed.load(std::memory_order_acquire) && pos + FadeFrames <= Loop_End;
+		size_t splice = primed ? Loop_End - FadeFrames : Loop_End;
+		if (pos < splice)
+		{
+			size_t want = std::min(len, (splice - pos) * FrameSize);
+			size_t got = Decoder->read(buff, want);
+			buff += got;
+			len -= got;
+			if (got > 0) seeked = false;
+			if (got == want) continue;
+			// The file ended before the loop did. There is nothing to crossfade then.
+			if (seeked) return false;
+		}
+		else if (primed)
+		{
+			SpliceLoop();
+			continue;
+		}
+		else if (seeked)
+		{
+			return false;	// the seek did not get anywhere.
+		}
+		Decoder->seek(Loop_Start, false, true);
+		seeked = true;
+	}
+	return true;
+}
 
-			Decoder->seek(Loop_Start, false, true);
+//==========================================================================
+//
+// SndFileSong :: SpliceLoop
+//
+// Makes the spare decoder the main one at exactly the loop start. The
+// frames before that are crossfaded with the end of the loop.
+//
+//==========================================================================
+
+template<class T> static void CrossfadeFrames(T *out, const T *in, size_t frames, int channels)
+{
+	for (size_t i = 0; i < frames; i++)
+	{
+		float t = (i + 0.5f) / frames;
+		for (int c = 0; c < channels; c++, out++, in++)
+		{
+			*out = T(*out * (1 - t) + *in * t);
 		}
-		while (len > 0)
+	}
+}
+
+void SndFileSong::SpliceLoop()
+{
+	size_t bytes = FadeFrames * FrameSize;
+	Splice.resize(bytes);
+	SplicePos = 0;
+	if (bytes > 0)
+	{
+		FadeIn.resize(bytes);
+		size_t got = Decoder->read((char*)Splice.data(), bytes);
+		memset(Splice.data() + got, 0, bytes - got);
+		got = Spare->read((char*)FadeIn.data(), bytes);
+		memset(FadeIn.data() + got, 0, bytes - got);
+		if (Type == SampleType_Int16) CrossfadeFrames((int16_t*)Splice.data(), (const int16_t*)FadeIn.data(), FadeFrames, ZMusic_ChannelCount(Channels));
+		else CrossfadeFrames((float*)Splice.data(), (const float*)FadeIn.data(), FadeFrames, ZMusic_ChannelCount(Channels));
+	}
+	std::swap(Decoder, Spare);
+	{
+		std::lock_guard<std::mutex> lock(PrimeLock);
+		Primed.store(false, std::memory_order_relaxed);
+		PrimeRequest = true;
+	}
+	PrimeWake.notify_one();
+}
+
+//==========================================================================
+//
+// SndFileSong :: ReadMemory
+//
+// Decode for a song that got decoded into memory.
+//
+//==========================================================================
+
+bool SndFileSong::ReadMemory(char *buff, size_t len, size_t &filled)
+{
+	const uint8_t *pcm = Cached->PCM.data();
+	size_t frames = len / FrameSize;
+	if (!Looping.load(std::memory_order_relaxed))
+	{
+		if (Cursor >= MemFrames)
 		{
-			size_t readlen = Decoder->read(buff, len);
-			if (readlen == 0)
-			{
-				return false;
-			}
-			buff += readlen;
-			len -= readlen;
-			if (len > 0)
-			{
-				Decoder->seek(Loop_Start, false, true);
-			}
+			memset(buff, 0, len);
+			filled = 0;
+			return false;
 		}
+		size_t n = std::min(frames, MemFrames - Cursor);
+		memcpy(buff, pcm + Cursor * FrameSize, n * FrameSize);
+		memset(buff + n * FrameSize, 0, len - n * FrameSize);
+		Cursor += n;
+		filled = n * FrameSize;
+		return true;
 	}
+
+	size_t loopend = std::min<size_t>(Loop_End, MemFrames);
+	size_t loopstart = Loop_Start < loopend ? Loop_Start : 0;
+	if (loopend == 0)
+	{
+		return false;
+	}
+	while (frames > 0)
+	{
+		if (Cursor >= loopend) Cursor = loopstart;
+		size_t n = std::min(frames, loopend - Cursor);
+		memcpy(buff, pcm + Cursor * FrameSize, n * FrameSize);
+		buff += n * FrameSize;
+		Cursor += n;
+		frames -= n;
+	}
+	filled = len;
 	return true;
 }
+
+//==========================================================================
+//
+// SndFileSong :: Position
+//
+//==========================================================================
+
+size_t SndFileSong::Position()
+{
+	return FromMemory ? Cursor : Decoder->getSampleOffset();
+}
@@ -35,6 +35,8 @@
 #include <math.h>
 #include <mutex>
 #include <string>
+#include <atomic>
+#include <algorithm>
 #include <stdint.h>
 #include <limits.h>
 #include "streamsource.h"
@@ -45,8 +47,7 @@
 #include "zmusic/mididefs.h"
 #include "zmusic/midiconfig.h"
 #include "fileio.h"
-
-extern DumbConfig dumbConfig;
+#include "zmusic/parallel.h"
 
 static unsigned long xmp_read(void *dest, unsigned long len, unsigned long nmemb, void *priv)
 {
@@ -81,15 +82,27 @@ private:
 	int samplerate = 44100;
 	int subsong = 0;
 
-	// libxmp can't output in float.
-	std::vector<int16_t> int16_buffer;
+	SampleType OutputType = SampleType_Float32;
+
+	// The song is loaded without scanning it so that opening returns right away.
+	// The scan runs here and has to be finished before the song can start.
+	FJob ScanJob;
+	std::atomic<bool> Scanned{ false };
+
+	bool Mono;	// zmusic_snd_mono, libxmp mixes every voice into one channel.
+
+	int XMPFormat() const { return (OutputType == SampleType_Float32 ? XMP_FORMAT_FLOAT : 0) | (Mono ? XMP_FORMAT_MONO : 0); }
 
 public:
 	XMPSong(xmp_context ctx, int samplerate);
 	~XMPSong();
 	bool SetSubsong(int subsong) override;
+	bool SetPosition(unsigned position) override;
 	bool Start() override;
 	SoundStreamInfoEx GetFormatEx() override;
+	bool SetSampleType(SampleType type) override;
+	bool GetTiming(int &length, int &loopstart, int &loopend) override;
+	bool GetPosition(ZMusicPosition &pos, double &ticksperframe) override;
 
 protected:
 	bool GetData(void *buffer, size_t len) override;
@@ -99,21 +112,38 @@ XMPSong::XMPSong(xmp_context ctx, int rate)
 {
 	context = ctx;
 	samplerate = (dumbConfig.mod_samplerate != 0) ? dumbConfig.mod_samplerate : rate;
+	Mono = miscConfig.snd_mono;
 	xmp_set_player(context, XMP_PLAYER_VOLUME, 100);
 	xmp_set_player(context, XMP_PLAYER_INTERP, dumbConfig.mod_interp);
 
-	int16_buffer.reserve(16 * 1024);
+	auto scan = [this]()
+	{
+		xmp_scan_module(context);
+		Scanned.store(true, std::memory_order_release);
+	};
+	ScanJob.Start(JOB_BACKGROUND, scan);
 }
 
 XMPSong::~XMPSong()
 {
+	ScanJob.Wait();
 	xmp_end_player(context);
 	xmp_free_context(context);
 }
 
 SoundStreamInfoEx XMPSong::GetFormatEx()
 {
-	return { 32 * 1024, samplerate, SampleType_Float32, ChannelConfig_Stereo };
+	return { OutputType == SampleType_Int16 ? 16 * 1024 : 32 * 1024, samplerate, OutputType, Mono ? ChannelConfig_Mono : ChannelConfig_Stereo };
+}
+
+bool XMPSong::SetSampleType(SampleType type)
+{
+	if (type != SampleType_Float32 && type != SampleType_Int16) return false;
+	OutputType = type;
+	// The format is negotiated after the song has been started.
+	if (xmp_get_player(context, XMP_PLAYER_STATE) >= XMP_STATE_PLAYING)
+		xmp_set_player(context, XMP_PLAYER_FORMAT, XMPFormat());
+	return true;
 }
 
 bool XMPSong::SetSubsong(int subsong)
@@ -124,22 +154,109 @@ bool XMPSong::SetSubsong(int subsong)
 	return true;
 }
 
-bool XMPSong::GetData(void *buffer, size_t len)
+// libxmp can only seek to the start of an order, the rest of the way is played and thrown away.
+bool XMPSong::SetPosition(unsigned ms)
 {
-	if ((len / 4) > int16_buffer.size())
-		int16_buffer.resize(len / 4);
+	if (xmp_get_player(context, XMP_PLAYER_STATE) < XMP_STATE_PLAYING)
+		return false;
 
-	int ret = xmp_play_buffer(context, (void*)int16_buffer.data(), len / 2, m_Looping? INT_MAX : 0);
-	xmp_set_player(context, XMP_PLAYER_INTERP, dumbConfig.mod_interp);
+	xmp_frame_info fi;
+	xmp_get_frame_info(context, &fi);
+	int target = (int)std::min<unsigned>(ms, (unsigned)std::max(fi.total_time, 0));
 
-	if (ret >= 0)
+	xmp_seek_time(context, target);
+	xmp_play_buffer(context, nullptr, 0, 0);	// drops what is left of the current frame
+	if (xmp_play_frame(context) < 0)
+		return false;
+	xmp_get_frame_info(context, &fi);
+	while (fi.time < target)
+	{
+		int last = fi.time;
+		if (xmp_play_frame(context) < 0)
+			return false;
+		xmp_get_frame_info(context, &fi);
+		if (fi.time < last) break;	// looped back, the target was past the end of the sequence
+	}
+	return true;
+}
+
+// Not available until the scan has finished.
+bool XMPSong::GetTiming(int &length, int &loopstart, int &loopend)
+{
+	if (!Scanned.load(std::memory_order_acquire))
+		return false;
+
+	if (xmp_get_player(context, XMP_PLAYER_STATE) >= XMP_STATE_PLAYING)
+	{
+		xmp_frame_info fi;
+		xmp_get_frame_info(context, &fi);
+		length = fi.total_time;
+	}
+	else
+	{
+		xmp_module_info mi;
+		xmp_get_module_info(context, &mi);
+		if (mi.num_sequences <= 0)
+			return false;
+		length = mi.seq_data[0].duration;
+	}
+	if (length <= 0)
+		return false;
+	loopstart = 0;
+	loopend = length;
+	return true;
+}
+
+// Modules have no beats, so four rows are taken as one and the orders as bars.
+bool XMPSong::GetPosition(ZMusicPosition &pos, double &ticksperframe)
+{
+	if (xmp_get_player(context, XMP_PLAYER_STATE) < XMP_STATE_PLAYING)
+		return false;
+
+	xmp_frame_info fi;
+	xmp_get_frame_info(context, &fi);
+	if (fi.speed <= 0 || fi.frame_time <= 0)
+		return false;
+	pos.order = fi.pos;
+	pos.row = fi.row;
+	pos.tick = fi.row + double(fi.frame) / fi.speed;
+	pos.ticksPerBeat = 4;
+	pos.tempo = 6. * fi.bpm / fi.speed;
+	pos.bar = fi.pos;
+	pos.beatsPerBar = (fi.num_rows + 3) / 4;
+	pos.beat = pos.tick / 4;
+	ticksperframe = 1000000. / (double(fi.frame_time) * fi.speed * samplerate);
+	return true;
+}
+
+bool XMPSong::GetData(void *buffer, size_t len)
+{
+	const float volume = dumbConfig.mod_dumb_mastervolume;
+
+	// Both formats are rendered natively and only need touching if the volume is not neutral.
+	int ret = xmp_play_buffer(context, buffer, (int)len, m_Looping? INT_MAX : 0);
+	if (ret >= 0 && volume != 1.f)
 	{
-		float* soundbuffer = (float*)buffer;
-		for (unsigned int i = 0; i < len / 4; i++)
+		if (OutputType == SampleType_Int16)
 		{
-			soundbuffer[i] = ((int16_buffer[i] < 0.) ? (int16_buffer[i] / 32768.) : (int16_buffer[i] / 32767.)) * dumbConfig.mod_dumb_mastervolume;
+			int16_t* soundbuffer = (int16_t*)buffer;
+			for (unsigned int i = 0; i < len / 2; i++)
+			{
+				float v = soundbuffer[i] * volume;
+				v = v < -32768.f ? -32768.f : v > 32767.f ? 32767.f : v;
+				soundbuffer[i] = (int16_t)v;
+			}
+		}
+		else
+		{
+			float* soundbuffer = (float*)buffer;
+			for (unsigned int i = 0; i < len / 4; i++)
+			{
+				soundbuffer[i] *= volume;
+			}
 		}
 	}
+	xmp_set_player(context, XMP_PLAYER_INTERP, dumbConfig.mod_interp);
 
 	if (ret < 0 && m_Looping)
 	{
@@ -153,16 +270,28 @@ bool XMPSong::GetData(void *buffer, size_t len)
 
 bool XMPSong::Start()
 {
-	int ret = xmp_start_player(context, samplerate, 0);
+	ScanJob.Wait();
+	int ret = xmp_start_player(context, samplerate, XMPFormat());
 	if (ret >= 0)
 		xmp_set_position(context, subsong);
 	return ret >= 0;
 }
 
+//==========================================================================
+//
+// Lets libxmp decompress samples on the shared worker threads.
+//
+//==========================================================================
+
+static void RunLoadJobs(void *, int count, void (*job)(void *, int), void *jobcontext)
+{
+	ZMusic_ParallelFor(count, [=](size_t i) { job(jobcontext, (int)i); });
+}
+
 StreamSource* XMP_OpenSong(MusicIO::FileInterface* reader, int samplerate)
 {
-	if (xmp_test_module_from_callbacks((void*)reader, callbacks, nullptr) < 0)
-		return nullptr;
+	static bool hooked = (xmp_set_load_parallel_for(&RunLoadJobs, nullptr), true);
+	(void)hooked;
 
 	xmp_context ctx = xmp_create_context();
 	if (!ctx)
@@ -170,8 +299,18 @@ StreamSource* XMP_OpenSong(MusicIO::FileInterface* reader, int samplerate)
 
 	reader->seek(0, SEEK_SET);
 
-	if (xmp_load_module_from_callbacks(ctx, (void*)reader, callbacks) < 0)
+	// Loading runs the loaders' test functions until one accepts the file, so
+	// testing it separately first would only run them twice for every module.
+	// Files that are in memory are loaded from there, so that the tests look
+	// at the data directly instead of seeking and reading through callbacks.
+	xmp_set_player(ctx, XMP_PLAYER_SMPCTL, XMP_SMPCTL_NOSCAN);
+	auto data = reader->memoryData();
+	int result = data != nullptr ?
+		xmp_load_module_from_memory(ctx, data, reader->filelength()) :
+		xmp_load_module_from_callbacks(ctx, (void*)reader, callbacks);
+	if (result < 0)
 	{
+		xmp_free_context(ctx);
 		return nullptr;
 	}
 
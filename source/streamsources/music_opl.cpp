@@ -55,7 +55,8 @@ public:
 	OPLMUSSong (MusicIO::FileInterface *reader, OPLConfig *config);
 	~OPLMUSSong ();
 	bool Start() override;
-	void ChangeSettingInt(const char *name, int value) override;
+	bool SetPosition(unsigned position) override;
+	void ChangeSettingInt(ESongSetting setting, int value) override;
 	SoundStreamInfoEx GetFormatEx() override;
 
 protected:
@@ -80,13 +81,13 @@ OPLMUSSong::OPLMUSSong(MusicIO::FileInterface* reader, OPLConfig* config)
 	reader->seek(0, SEEK_SET);
 	std::vector<uint8_t> data(fs);
 	reader->read(data.data(), (int)data.size());
-	Music = new OPLmusicFile(data.data(), data.size(), config->core, config->numchips, error);
+	Music = new OPLmusicFile(data.data(), data.size(), config->core, config->numchips, config->threads, error);
 	if (error)
 	{
 		delete Music;
 		throw std::runtime_error(error);
 	}
-	current_opl_core = config->core;
+	current_opl_core = Music->GetCore();
 }
 
 //==========================================================================
@@ -122,9 +123,9 @@ OPLMUSSong::~OPLMUSSong ()
 //
 //==========================================================================
 
-void OPLMUSSong::ChangeSettingInt(const char * name, int val)
+void OPLMUSSong::ChangeSettingInt(ESongSetting setting, int val)
 {
-	if (!strcmp(name, "opl.numchips"))
+	if (setting == SETTING_OPL_NUMCHIPS)
 		Music->ResetChips (val);
 }
 
@@ -147,6 +148,17 @@ bool OPLMUSSong::Start()
 //
 //==========================================================================
 
+bool OPLMUSSong::SetPosition(unsigned position)
+{
+	return Music->Seek(position * (OPL_SAMPLE_RATE / 1000));
+}
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
 bool OPLMUSSong::GetData(void *buffer, size_t len)
 {
 	return Music->ServiceStream(buffer, int(len)) ? len : 0;
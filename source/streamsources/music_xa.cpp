@@ -1,6 +1,7 @@
 #include <algorithm>
 #include "streamsource.h"
 #include "fileio.h"
+#include "zmusic/resampler.h"
 
 /**
  * PlayStation XA (ADPCM) source support for MultiVoc
@@ -26,7 +27,6 @@ kSamplesStereo	= (kNumOfSGs*kNumOfSamples/2),
 XA_DATA_START   = (0x44-48)
 };
 
-inline float constexpr DblToPCMF(double dt) { return float(dt) * (1.f/32768.f); }
 
 typedef struct {
    MusicIO::FileInterface *reader;
@@ -36,8 +36,8 @@ typedef struct {
    bool blockIs18K;
    bool finished;
 
-   double t1, t2;
-   double t1_x, t2_x;
+   float t1, t2;
+   float t1_x, t2_x;
 
    float block[kBufSize];
 } xa_data;
@@ -49,124 +49,84 @@ typedef struct XASector {
     SoundGroup SoundGroups[18];
 } XASector;
 
-static double K0[4] = {
-    0.0,
-    0.9375,
-    1.796875,
-    1.53125
+static const float K0[4] = {
+    0.0f,
+    0.9375f,
+    1.796875f,
+    1.53125f
 };
-static double K1[4] = {
-    0.0,
-    0.0,
-    -0.8125,
-    -0.859375
+static const float K1[4] = {
+    0.0f,
+    0.0f,
+    -0.8125f,
+    -0.859375f
 };
 
+//==========================================================================
+//
+// Decodes the 28 samples of one unit into every 'stride'th float of 'out'.
+//
+// The nibbles get unpacked and scaled in a separate pass that has no
+// dependencies between samples, so the compiler can vectorize it. Only
+// the filter itself has to go one sample at a time. Everything is single
+// precision, which is still far more than the 16 bit source needs.
+//
+//==========================================================================
 
-
-static int8_t getSoundData(int8_t *buf, int32_t unit, int32_t sample)
+static void decodeUnit(const int8_t *sg, int32_t unit, float *out, int stride, float &t1, float &t2)
 {
-    int8_t ret;
-    int8_t *p;
-    int32_t offset, shift;
-
-    p = buf;
-    shift = (unit%2) * 4;
-
-    offset = 16 + (unit / 2) + (sample * 4);
-    p += offset;
-
-    ret = (*p >> shift) & 0x0F;
-
-    if (ret > 7) {
-        ret -= 16;
+    const uint8_t *p = (const uint8_t*)sg + 16 + (unit / 2);
+    const int up = (unit & 1) ? 0 : 4;	// moves the nibble to the top for sign extension.
+    const int range = sg[4 + unit] & 0x0F;
+    const int filt = (sg[4 + unit] >> 4) & 0x03;
+    // The hardware treats the undefined ranges 13-15 like 9.
+    const float scale = float(1 << (12 - (range > 12 ? 9 : range))) * (1.f / 16.f);
+
+    float samples[28];
+    for (int i = 0; i < 28; i++)
+    {
+        samples[i] = float(int8_t((p[i * 4] << up) & 0xF0)) * scale;
     }
-    return ret;
-}
 
-static int8_t getFilter(const int8_t *buf, int32_t unit)
-{
-    return (*(buf + 4 + unit) >> 4) & 0x03;
-}
-
-
-static int8_t getRange(const int8_t *buf, int32_t unit)
-{
-    return *(buf + 4 + unit) & 0x0F;
+    const float k0 = K0[filt], k1 = K1[filt];
+    float s1 = t1, s2 = t2;
+    for (int i = 0; i < 28; i++)
+    {
+        float v = samples[i] + s1 * k0 + s2 * k1;
+        s2 = s1;
+        s1 = v;
+        out[i * stride] = v * (1.f / 32768.f);
+    }
+    t1 = s1;
+    t2 = s2;
 }
 
-
 static void decodeSoundSectMono(XASector *ssct, xa_data * xad)
 {
-    size_t count = 0;
-    int8_t snddat, filt, range;
-    int32_t unit, sample;
-    int32_t sndgrp;
-    double tmp2, tmp3, tmp4, tmp5;
-    auto &decodeBuf = xad->block;
-
-    for (sndgrp = 0; sndgrp < kNumOfSGs; sndgrp++)
+    float *decodeBuf = xad->block;
+
+    for (int32_t sndgrp = 0; sndgrp < kNumOfSGs; sndgrp++)
     {
-        for (unit = 0; unit < 8; unit++)
+        for (int32_t unit = 0; unit < 8; unit++)
         {
-            range = getRange(ssct->SoundGroups[sndgrp], unit);
-            filt = getFilter(ssct->SoundGroups[sndgrp], unit);
-            for (sample = 0; sample < 28; sample++)
-            {
-                snddat = getSoundData(ssct->SoundGroups[sndgrp], unit, sample);
-                tmp2 = (double)(1 << (12 - range));
-                tmp3 = (double)snddat * tmp2;
-                tmp4 = xad->t1 * K0[filt];
-                tmp5 = xad->t2 * K1[filt];
-                xad->t2 = xad->t1;
-                xad->t1 = tmp3 + tmp4 + tmp5;
-                decodeBuf[count++] = DblToPCMF(xad->t1);
-            }
+            decodeUnit(ssct->SoundGroups[sndgrp], unit, decodeBuf, 1, xad->t1, xad->t2);
+            decodeBuf += 28;
         }
     }
 }
 
 static void decodeSoundSectStereo(XASector *ssct, xa_data * xad)
 {
-    size_t count = 0;
-    int8_t snddat, filt, range;
-    int8_t filt1, range1;
-    int32_t unit, sample;
-    int32_t sndgrp;
-    double tmp2, tmp3, tmp4, tmp5;
-    auto &decodeBuf = xad->block;
-
-    for (sndgrp = 0; sndgrp < kNumOfSGs; sndgrp++)
+    float *decodeBuf = xad->block;
+
+    for (int32_t sndgrp = 0; sndgrp < kNumOfSGs; sndgrp++)
     {
-        for (unit = 0; unit < 8; unit+= 2)
+        for (int32_t unit = 0; unit < 8; unit += 2)
         {
-            range = getRange(ssct->SoundGroups[sndgrp], unit);
-            filt = getFilter(ssct->SoundGroups[sndgrp], unit);
-            range1 = getRange(ssct->SoundGroups[sndgrp], unit+1);
-            filt1 = getFilter(ssct->SoundGroups[sndgrp], unit+1);
-
-            for (sample = 0; sample < 28; sample++)
-            {
-                // Channel 1
-                snddat = getSoundData(ssct->SoundGroups[sndgrp], unit, sample);
-                tmp2 = (double)(1 << (12 - range));
-                tmp3 = (double)snddat * tmp2;
-                tmp4 = xad->t1 * K0[filt];
-                tmp5 = xad->t2 * K1[filt];
-                xad->t2 = xad->t1;
-                xad->t1 = tmp3 + tmp4 + tmp5;
-                decodeBuf[count++] = DblToPCMF(xad->t1);
-
-                // Channel 2
-                snddat = getSoundData(ssct->SoundGroups[sndgrp], unit+1, sample);
-                tmp2 = (double)(1 << (12 - range1));
-                tmp3 = (double)snddat * tmp2;
-                tmp4 = xad->t1_x * K0[filt1];
-                tmp5 = xad->t2_x * K1[filt1];
-                xad->t2_x = xad->t1_x;
-                xad->t1_x = tmp3 + tmp4 + tmp5;
-                decodeBuf[count++] = DblToPCMF(xad->t1_x);
-            }
+            // The even units are the left channel, the odd ones the right one.
+            decodeUnit(ssct->SoundGroups[sndgrp], unit, decodeBuf, 2, xad->t1, xad->t2);
+            decodeUnit(ssct->SoundGroups[sndgrp], unit + 1, decodeBuf + 1, 2, xad->t1_x, xad->t2_x);
+            decodeBuf += 56;
         }
     }
 }
@@ -234,13 +194,18 @@ static void getNextXABlock(xa_data *xad, bool looping )
 class XASong : public StreamSource
 {
 public:
-	XASong(MusicIO::FileInterface *readr);
+	XASong(MusicIO::FileInterface *readr, int outrate);
 	SoundStreamInfoEx GetFormatEx() override;
 	bool Start() override;
 	bool GetData(void *buffer, size_t len) override;
 
 protected:
 	xa_data xad;
+	int OutputRate;	// 0 if the host resamples.
+	FResampler Resampler;
+	TMusicVector<float> Native;
+
+	bool GetNativeData(float *dest, size_t len);
 };
 
 //==========================================================================
@@ -249,7 +214,7 @@ protected:
 //
 //==========================================================================
 
-XASong::XASong(MusicIO::FileInterface * reader)
+XASong::XASong(MusicIO::FileInterface * reader, int outrate)
 {
 	reader->seek(0, SEEK_END);
 	xad.length = reader->tell();
@@ -258,11 +223,15 @@ XASong::XASong(MusicIO::FileInterface * reader)
 	xad.t1 = xad.t2 = xad.t1_x = xad.t2_x = 0;
 
 	getNextXABlock(&xad, false);
+
+	// The rate is taken from the first sector. It is not supposed to change within a file.
+	OutputRate = outrate;
+	if (OutputRate > 0) Resampler.Setup(xad.blockIs18K ? 18900 : 37800, OutputRate);
 }
 
 SoundStreamInfoEx XASong::GetFormatEx()
 {
-	auto SampleRate = xad.blockIs18K? 18900 : 37800;
+	auto SampleRate = OutputRate > 0 ? OutputRate : xad.blockIs18K? 18900 : 37800;
 	return { 64*1024, SampleRate, SampleType_Float32, ChannelConfig_Stereo };
 }
 
@@ -285,13 +254,34 @@ bool XASong::Start()
 
 //==========================================================================
 //
-// XASong :: Read
+// XASong :: GetData
 //
 //==========================================================================
 
 bool XASong::GetData(void *vbuff, size_t len)
 {
-	float *dest = (float*)vbuff;
+	if (OutputRate <= 0)
+	{
+		return GetNativeData((float*)vbuff, len);
+	}
+	size_t frames = len / 8;
+	size_t needed = Resampler.InputNeeded(frames);
+	Native.resize(needed * 2);
+	bool res = GetNativeData(Native.data(), needed * 8);
+	Resampler.Process(Native.data(), (float*)vbuff, frames);
+	return res;
+}
+
+//==========================================================================
+//
+// XASong :: GetNativeData
+//
+// Stereo at the rate the file was recorded at.
+//
+//==========================================================================
+
+bool XASong::GetNativeData(float *dest, size_t len)
+{
 	while (len > 0)
 	{
 		auto ptr = xad.committed;
@@ -347,8 +337,8 @@ bool XASong::GetData(void *vbuff, size_t len)
 //
 //==========================================================================
 
-StreamSource *XA_OpenSong(MusicIO::FileInterface *reader)
+StreamSource *XA_OpenSong(MusicIO::FileInterface *reader, int outrate)
 {
-	return new XASong(reader);
+	return new XASong(reader, outrate);
 }
 
@@ -5,8 +5,9 @@
 #include <stdlib.h>
 #include "zmusic/mididefs.h"	// for StreamSourceInfo
 #include "zmusic/midiconfig.h"
+#include "zmusic/allocator.h"
 
-class StreamSource
+class StreamSource : public FMusicAllocated
 {
 protected:
 	bool m_Looping = true;
@@ -20,12 +21,19 @@ public:
 	virtual bool Start() { return true; }
 	virtual bool SetPosition(unsigned position) { return false; }
 	virtual bool SetSubsong(int subsong) { return false; }
+	virtual int GetSubsongCount() { return 1; }
+	virtual bool PrepareSubsong(int subsong, int crossfade_ms) { return false; }	// gets the subsong ready for SetSubsong in the background.
 	virtual bool GetData(void *buffer, size_t len) = 0;
 	virtual SoundStreamInfoEx GetFormatEx() = 0;
+	virtual bool SetSampleType(SampleType type) { return false; }	// only for sources that can render other formats without converting.
 	virtual std::string GetStats() { return ""; }
-	virtual void ChangeSettingInt(const char *name, int value) {  }
-	virtual void ChangeSettingNum(const char *name, double value) {  }
-	virtual void ChangeSettingString(const char *name, const char *value) {  }
+	virtual bool GetTiming(int &length, int &loopstart, int &loopend) { return false; }	// all in milliseconds.
+	virtual bool GetPosition(ZMusicPosition &pos, double &ticksperframe) { return false; }	// after GetData, see MusInfo::GetPosition. Frames are at the source's own rate.
+	virtual bool CanSkip() { return false; }
+	virtual bool Skip(size_t frames) { return true; }	// advances like GetData without any output. False at the end of the song.
+	virtual uint32_t TakeUnderruns() { return 0; }	// GetData calls since the last one that could not fill their buffer in time. Called right after GetData.
+	virtual void ChangeSettingInt(ESongSetting setting, int value) {  }
+	virtual void ChangeSettingNum(ESongSetting setting, double value) {  }
 
 protected:
 	StreamSource() = default;
@@ -36,5 +44,8 @@ StreamSource *MOD_OpenSong(MusicIO::FileInterface* reader, int samplerate);
 StreamSource *XMP_OpenSong(MusicIO::FileInterface* reader, int samplerate);
 StreamSource* GME_OpenSong(MusicIO::FileInterface* reader, const char* fmt, int sample_rate);
 StreamSource *SndFile_OpenSong(MusicIO::FileInterface* fr);
-StreamSource* XA_OpenSong(MusicIO::FileInterface* reader);
+// With the loop given instead of read from tags, in milliseconds or, with startass and endass, in frames.
+StreamSource *SndFile_OpenSong(MusicIO::FileInterface* fr, uint32_t loop_start, uint32_t loop_end, bool startass, bool endass);
+StreamSource* XA_OpenSong(MusicIO::FileInterface* reader, int outrate);	// outrate 0 plays at the file's own rate.
+StreamSource* CDImage_OpenSong(const char* cuefile, int track);
 StreamSource* OPL_OpenSong(MusicIO::FileInterface* reader, OPLConfig *config);
@@ -0,0 +1,99 @@
+/*
+** zembed.cpp
+** Build tool that compresses a data file with zlib into a C header, for
+** data that gets embedded in the library but is only needed now and then.
+**
+**   zembed <input> <name> <output>
+**
+** The header defines <name>_size, the length of the data, and <name>_z,
+** the compressed data, as static constants.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <miniz.h>
+
+int main(int argc, char **argv)
+{
+	if (argc != 4)
+	{
+		fprintf(stderr, "Usage: zembed <input> <name> <output>\n");
+		return 1;
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (f == nullptr)
+	{
+		fprintf(stderr, "zembed: cannot open %s\n", argv[1]);
+		return 1;
+	}
+	std::vector<unsigned char> data;
+	unsigned char buffer[65536];
+	size_t len;
+	while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + len);
+	fclose(f);
+
+	mz_ulong packedlen = mz_compressBound((mz_ulong)data.size());
+	std::vector<unsigned char> packed(packedlen);
+	if (mz_compress2(packed.data(), &packedlen, data.data(), (mz_ulong)data.size(), MZ_UBER_COMPRESSION) != MZ_OK)
+	{
+		fprintf(stderr, "zembed: cannot compress %s\n", argv[1]);
+		return 1;
+	}
+
+	const char *source = argv[1];
+	for (const char *p = source; *p; p++)
+	{
+		if (*p == '/' || *p == '\\') source = p + 1;
+	}
+	f = fopen(argv[3], "w");
+	if (f == nullptr)
+	{
+		fprintf(stderr, "zembed: cannot create %s\n", argv[3]);
+		return 1;
+	}
+	fprintf(f, "/* Generated by zmusic's zembed from %s at build time. Don't edit it, edit %s instead. */\n\n", source, source);
+	fprintf(f, "static const unsigned long %s_size = %lu;\n\n", argv[2], (unsigned long)data.size());
+	fprintf(f, "static const unsigned char %s_z[] =\n{", argv[2]);
+	for (mz_ulong i = 0; i < packedlen; i++)
+	{
+		fprintf(f, "%s0x%02x,", i % 12 == 0 ? "\n\t" : " ", packed[i]);
+	}
+	fprintf(f, "\n};\n");
+	if (fclose(f) != 0)
+	{
+		fprintf(stderr, "zembed: cannot write %s\n", argv[3]);
+		return 1;
+	}
+	return 0;
+}
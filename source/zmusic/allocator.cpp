@@ -0,0 +1,354 @@
+/*
+** allocator.cpp
+** Song memory through the client's allocator, and per-song arenas.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** Every block is preceded by a header saying where it came from, so it can
+** always be freed the right way, even if the client's allocator has been
+** changed since.
+**
+** An arena takes 64 KB blocks from the allocator and carves the objects of
+** its song from them. Freed objects are kept for reuse by objects of the
+** same size, which is what a restarted song asks for again. The blocks go
+** back once the song and every object from the arena is gone.
+**
+** Whatever gets allocated while an arena is current is counted for its
+** song, in the category it was allocated for. Memory the synths manage on
+** their own is reported to the global figures with ZMusic_AccountMemory.
+**
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <mutex>
+#include <atomic>
+#include "allocator.h"
+#include "musinfo.h"
+#include "midiconfig.h"
+#include "rtcheck.h"
+
+enum
+{
+	MEM_ALIGN = 16,
+	MEM_HEADER = 48,				// room for FBlockHeader, keeping the block aligned.
+	ARENA_BLOCK = 64 * 1024,
+	ARENA_LARGEST = 8 * 1024,		// anything larger comes from the allocator directly.
+};
+
+struct FBlockHeader
+{
+	FMusicArena *Arena;				// the block is counted for this arena's song. May be nullptr.
+	void *Raw;						// or nullptr for a slot of the arena.
+	void (*FreeFunc)(void *);
+	size_t Size;					// as asked for.
+	int Category;
+};
+static_assert(sizeof(FBlockHeader) <= MEM_HEADER, "block header too large");
+
+static thread_local FMusicArena *CurrentArena;
+static std::atomic<size_t> MemoryUsage[ZMUSIC_MEM_COUNT];
+
+static size_t AlignUp(size_t v)
+{
+	return (v + MEM_ALIGN - 1) & ~size_t(MEM_ALIGN - 1);
+}
+
+static FBlockHeader *HeaderOf(void *ptr)
+{
+	return (FBlockHeader *)ptr - 1;
+}
+
+static void *RawAlloc(size_t size, void (*&freefunc)(void *))
+{
+	// Both are read once, so that a block is always freed by the same allocator that made it.
+	auto alloc = musicCallbacks.Alloc;
+	auto dealloc = musicCallbacks.Free;
+	void *mem;
+	if (alloc != nullptr && dealloc != nullptr)
+	{
+		mem = alloc(size);
+		freefunc = dealloc;
+	}
+	else
+	{
+		mem = malloc(size);
+		freefunc = free;
+	}
+	if (mem == nullptr) throw std::bad_alloc();
+	return mem;
+}
+
+//==========================================================================
+//
+// FMusicArena
+//
+//==========================================================================
+
+class FMusicArena
+{
+	struct Block
+	{
+		Block *Next;
+		void *Raw;
+		void (*FreeFunc)(void *);
+	};
+	struct FreeSlot
+	{
+		FreeSlot *Next;
+		size_t Size;
+	};
+
+	std::mutex Lock;
+	Block *Blocks = nullptr;
+	uint8_t *Cursor = nullptr;
+	uint8_t *Limit = nullptr;
+	FreeSlot *FreeSlots = nullptr;
+	std::atomic<int> Refs{ 1 };		// one for every allocation plus the owner's.
+
+public:
+	std::atomic<size_t> Usage[ZMUSIC_MEM_COUNT] = {};
+
+	~FMusicArena()
+	{
+		while (Blocks != nullptr)
+		{
+			Block *next = Blocks->Next;
+			Blocks->FreeFunc(Blocks->Raw);
+			Blocks = next;
+		}
+	}
+
+	// 'size' is that of the whole slot, header included.
+	void *Allocate(size_t size)
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		for (FreeSlot **p = &FreeSlots; *p != nullptr; p = &(*p)->Next)
+		{
+			if ((*p)->Size == size)
+			{
+				FreeSlot *slot = *p;
+				*p = slot->Next;
+				Refs.fetch_add(1, std::memory_order_relaxed);
+				return slot;
+			}
+		}
+		if (size_t(Limit - Cursor) < size)
+		{
+			void (*freefunc)(void *);
+			void *raw = RawAlloc(ARENA_BLOCK, freefunc);
+			Block *block = (Block *)raw;
+			block->Next = Blocks;
+			block->Raw = raw;
+			block->FreeFunc = freefunc;
+			Blocks = block;
+			// Whatever was left of the previous block is lost, but that is less than the largest slot.
+			Cursor = (uint8_t *)raw + AlignUp(sizeof(Block));
+			Limit = (uint8_t *)raw + ARENA_BLOCK;
+		}
+		void *slot = Cursor;
+		Cursor += size;
+		Refs.fetch_add(1, std::memory_order_relaxed);
+		return slot;
+	}
+
+	void Free(void *slot, size_t size)
+	{
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			FreeSlot *fs = (FreeSlot *)slot;
+			fs->Size = size;
+			fs->Next = FreeSlots;
+			FreeSlots = fs;
+		}
+		Release();
+	}
+
+	void AddRef()
+	{
+		Refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void Release()
+	{
+		if (Refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			ZMusic_Delete(this);
+		}
+	}
+};
+
+//==========================================================================
+//
+// ZMusic_AccountMemory
+//
+//==========================================================================
+
+void ZMusic_AccountMemory(int category, ptrdiff_t bytes)
+{
+	MemoryUsage[category].fetch_add(size_t(bytes), std::memory_order_relaxed);
+}
+
+void ZMusic_AccountSamples(ptrdiff_t bytes)
+{
+	ZMusic_AccountMemory(ZMUSIC_MEM_SAMPLES, bytes);
+}
+
+void ZMusic_AccountInstruments(ptrdiff_t bytes)
+{
+	ZMusic_AccountMemory(ZMUSIC_MEM_INSTRUMENTS, bytes);
+}
+
+//==========================================================================
+//
+// ZMusic_Malloc
+//
+//==========================================================================
+
+// 'slot' allows the block to be carved from the owner's arena.
+static void *Allocate(FMusicArena *owner, size_t size, int category, bool slot)
+{
+	void *ptr, *raw = nullptr;
+	void (*freefunc)(void *) = nullptr;
+	if (slot && owner != nullptr && size <= ARENA_LARGEST)
+	{
+		ptr = (uint8_t *)owner->Allocate(MEM_HEADER + AlignUp(size)) + MEM_HEADER;
+	}
+	else
+	{
+		raw = RawAlloc(size + MEM_HEADER + MEM_ALIGN, freefunc);
+		// The client's allocator need not align any better than to pointers.
+		ptr = (void *)((uintptr_t(raw) + MEM_HEADER + MEM_ALIGN - 1) & ~uintptr_t(MEM_ALIGN - 1));
+		// Keeps the arena alive until this block is freed, so the song's figures can still be updated.
+		if (owner != nullptr) owner->AddRef();
+	}
+	*HeaderOf(ptr) = { owner, raw, freefunc, size, category };
+	MemoryUsage[category].fetch_add(size, std::memory_order_relaxed);
+	if (owner != nullptr) owner->Usage[category].fetch_add(size, std::memory_order_relaxed);
+	return ptr;
+}
+
+void *ZMusic_Malloc(size_t size, int category, bool arena)
+{
+	ZMUSIC_RT_CHECK(RTV_ALLOC, "ZMusic_Malloc");
+	return Allocate(CurrentArena, size, category, arena);
+}
+
+//==========================================================================
+//
+// ZMusic_Free
+//
+//==========================================================================
+
+void ZMusic_Free(void *ptr)
+{
+	if (ptr == nullptr) return;
+	ZMUSIC_RT_CHECK(RTV_ALLOC, "ZMusic_Free");
+	FBlockHeader header = *HeaderOf(ptr);
+	MemoryUsage[header.Category].fetch_sub(header.Size, std::memory_order_relaxed);
+	if (header.Arena != nullptr)
+	{
+		header.Arena->Usage[header.Category].fetch_sub(header.Size, std::memory_order_relaxed);
+	}
+	if (header.Raw == nullptr)
+	{
+		header.Arena->Free((uint8_t *)ptr - MEM_HEADER, MEM_HEADER + AlignUp(header.Size));
+	}
+	else
+	{
+		header.FreeFunc(header.Raw);
+		if (header.Arena != nullptr) header.Arena->Release();
+	}
+}
+
+//==========================================================================
+//
+// ZMusic_GetMemoryUsage
+//
+//==========================================================================
+
+DLL_EXPORT void ZMusic_GetMemoryUsage(MusInfo *song, ZMusicMemoryUsage *usage)
+{
+	if (usage == nullptr) return;
+	*usage = {};
+	std::atomic<size_t> *counters = MemoryUsage;
+	if (song != nullptr)
+	{
+		if (song->Arena == nullptr) return;
+		counters = song->Arena->Usage;
+	}
+	for (int i = 0; i < ZMUSIC_MEM_COUNT; i++)
+	{
+		usage->mCategory[i] = counters[i].load(std::memory_order_relaxed);
+		usage->mTotal += usage->mCategory[i];
+	}
+}
+
+//==========================================================================
+//
+// FMusicArenaScope
+//
+//==========================================================================
+
+FMusicArenaScope::FMusicArenaScope()
+{
+	// Not counted for the song whose arena may be current, the new one belongs to nobody yet.
+	Arena = new(Allocate(nullptr, sizeof(FMusicArena), ZMUSIC_MEM_OBJECTS, false)) FMusicArena;
+	Previous = CurrentArena;
+	Owner = true;
+	CurrentArena = Arena;
+}
+
+FMusicArenaScope::FMusicArenaScope(MusInfo *song)
+{
+	Arena = song != nullptr ? song->Arena : nullptr;
+	Previous = CurrentArena;
+	Owner = false;
+	CurrentArena = Arena;
+}
+
+FMusicArenaScope::~FMusicArenaScope()
+{
+	CurrentArena = Previous;
+	if (Owner) Arena->Release();
+}
+
+void FMusicArenaScope::Adopt(MusInfo *song)
+{
+	if (song != nullptr && Owner)
+	{
+		song->Arena = Arena;
+		Owner = false;
+	}
+}
+
+void ZMusic_ReleaseArena(FMusicArena *arena)
+{
+	if (arena != nullptr) arena->Release();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// Memory for songs, through the client's allocator if it installed one.
+//
+// Objects derived from FMusicAllocated and those made with ZMusic_New are
+// taken from the current thread's arena while a song is being opened or
+// started. An arena belongs to one song and hands all of its memory back at
+// once after the song and everything made for it is gone. Buffers that
+// grow during playback use TMusicVector, which bypasses the arena.
+//
+// All of it is counted for ZMusic_GetMemoryUsage, in the category it is
+// allocated for, and for the song whose arena is current.
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include <utility>
+#include "zmusic_internal.h"
+
+class MusInfo;
+class FMusicArena;
+
+// 'category' is one of EZMusicMemoryCategory. 'arena' allows the current arena to be used.
+void *ZMusic_Malloc(size_t size, int category, bool arena = false);
+void ZMusic_Free(void *ptr);
+
+// For memory not taken from ZMusic_Malloc. See also memusage.h.
+void ZMusic_AccountMemory(int category, ptrdiff_t bytes);
+
+template<class T, class... Args>
+T *ZMusic_New(Args&&... args)
+{
+	void *mem = ZMusic_Malloc(sizeof(T), ZMUSIC_MEM_OBJECTS, true);
+	try
+	{
+		return new(mem) T(std::forward<Args>(args)...);
+	}
+	catch (...)
+	{
+		ZMusic_Free(mem);
+		throw;
+	}
+}
+
+template<class T>
+void ZMusic_Delete(T *obj)
+{
+	if (obj == nullptr) return;
+	obj->~T();
+	ZMusic_Free(obj);
+}
+
+struct FMusicAllocated
+{
+	static void *operator new(size_t size) { return ZMusic_Malloc(size, ZMUSIC_MEM_OBJECTS, true); }
+	static void operator delete(void *ptr) { ZMusic_Free(ptr); }
+};
+
+template<class T>
+struct FMusicAllocator
+{
+	typedef T value_type;
+
+	FMusicAllocator() = default;
+	template<class U> FMusicAllocator(const FMusicAllocator<U> &) {}
+
+	T *allocate(size_t n) { return (T *)ZMusic_Malloc(n * sizeof(T), ZMUSIC_MEM_BUFFERS); }
+	void deallocate(T *p, size_t) { ZMusic_Free(p); }
+
+	template<class U> bool operator==(const FMusicAllocator<U> &) const { return true; }
+	template<class U> bool operator!=(const FMusicAllocator<U> &) const { return false; }
+};
+
+template<class T> using TMusicVector = std::vector<T, FMusicAllocator<T>>;
+
+// Makes a new arena current for the lifetime of the scope. A song that
+// got opened in the meantime gets handed the arena with Adopt, anything
+// else hands it back when the scope ends and the objects have been freed.
+class FMusicArenaScope
+{
+public:
+	FMusicArenaScope();
+	// Makes the song's arena current again, for ZMusic_Start and the like.
+	explicit FMusicArenaScope(MusInfo *song);
+	~FMusicArenaScope();
+	void Adopt(MusInfo *song);
+
+	FMusicArenaScope(const FMusicArenaScope &) = delete;
+	FMusicArenaScope &operator=(const FMusicArenaScope &) = delete;
+
+private:
+	FMusicArena *Arena;
+	FMusicArena *Previous;
+	bool Owner;
+};
+
+// Called by MusInfo's destructor. The arena goes away once everything taken from it has been freed.
+void ZMusic_ReleaseArena(FMusicArena *arena);
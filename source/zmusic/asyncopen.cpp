@@ -0,0 +1,383 @@
+/*
+** asyncopen.cpp
+** Opens songs on a worker thread so that the client never has to wait for
+** file parsing and synth setup, and prefetches the ones it will play next.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "zmusic_internal.h"
+#include "midiconfig.h"
+#include "jobs.h"
+#include "musinfo.h"
+#include "fileio.h"
+
+MusInfo *ZMusic_OpenSongInternal(MusicIO::FileInterface *reader, EMidiDevice device, const char *Args);
+
+//==========================================================================
+//
+// One pending open. The worker and the client each hold a reference so
+// that either side can let go first.
+//
+//==========================================================================
+
+class AsyncSongOpen
+{
+public:
+	MusicIO::FileInterface *Reader;
+	EMidiDevice Device;
+	std::string Args;
+	ZMusicAsyncOpenCallback Callback;
+	void *UserData;
+	ZMusicConfigSet *Config = CurrentConfig;	// the queueing thread's, which the song will belong to.
+	bool Prefetch = false;	// only warms the caches, there is no client handle.
+
+	MusInfo *Song = nullptr;
+	std::string Error;
+	bool Done = false;
+	bool Cancelled = false;
+	std::mutex Lock;
+	std::condition_variable DoneCond;
+
+	AsyncSongOpen(MusicIO::FileInterface *reader, EMidiDevice device, const char *args, ZMusicAsyncOpenCallback callback, void *userdata)
+		: Reader(reader), Device(device), Args(args ? args : ""), Callback(callback), UserData(userdata) {}
+
+	void Release()
+	{
+		if (--RefCount == 0) delete this;
+	}
+
+	void Run();
+	void RunPrefetch();
+
+private:
+	~AsyncSongOpen()
+	{
+		if (Reader) Reader->close();
+	}
+
+	std::atomic<int> RefCount{ 2 };
+};
+
+//==========================================================================
+//
+// The worker is a background job that only exists while there is something
+// to do. Requests are processed one at a time since device setup modifies
+// global state.
+//
+//==========================================================================
+
+static std::mutex QueueLock;
+static std::deque<AsyncSongOpen *> Queue;
+static bool WorkerRunning;
+
+static void AsyncWorker()
+{
+	std::unique_lock<std::mutex> lock(QueueLock);
+	while (!Queue.empty())
+	{
+		auto job = Queue.front();
+		Queue.pop_front();
+		lock.unlock();
+		if (job->Prefetch) job->RunPrefetch();
+		else job->Run();
+		job->Release();
+		lock.lock();
+	}
+	WorkerRunning = false;
+}
+
+static void StartWorker()
+{
+	if (!WorkerRunning)
+	{
+		WorkerRunning = true;
+		ZMusic_SubmitJob(JOB_BACKGROUND, AsyncWorker);
+	}
+}
+
+// Songs the client waits for go ahead of the prefetches.
+static AsyncSongOpen *QueueOpen(MusicIO::FileInterface *reader, EMidiDevice device, const char *args, ZMusicAsyncOpenCallback callback, void *userdata)
+{
+	auto job = new AsyncSongOpen(reader, device, args, callback, userdata);
+	std::lock_guard<std::mutex> lock(QueueLock);
+	auto it = std::find_if(Queue.begin(), Queue.end(), [](AsyncSongOpen *queued) { return queued->Prefetch; });
+	Queue.insert(it, job);
+	StartWorker();
+	return job;
+}
+
+static void QueuePrefetch(MusicIO::FileInterface *reader, EMidiDevice device, const char *args)
+{
+	auto job = new AsyncSongOpen(reader, device, args, nullptr, nullptr);
+	job->Prefetch = true;
+	job->Release();	// there is no client to hold the other reference.
+	std::lock_guard<std::mutex> lock(QueueLock);
+	Queue.push_back(job);
+	StartWorker();
+}
+
+//==========================================================================
+//
+// AsyncSongOpen :: Run
+//
+// A cancellation cannot interrupt the open itself, it is only checked
+// before starting and the result gets thrown away afterward.
+//
+//==========================================================================
+
+void AsyncSongOpen::Run()
+{
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		if (Cancelled) return;
+	}
+
+	FConfigScope config(Config);
+	auto reader = Reader;
+	Reader = nullptr;	// ZMusic_OpenSongInternal always takes over the reader.
+	MusInfo *song = ZMusic_OpenSongInternal(reader, Device, Args.c_str());
+	if (song == nullptr)
+	{
+		Error = ZMusic_GetLastError();
+	}
+	else
+	{
+		try
+		{
+			FMusicArenaScope arena(song);
+			song->Prepare();
+		}
+		catch (const std::exception &ex)
+		{
+			Error = ex.what();
+			delete song;
+			song = nullptr;
+		}
+	}
+
+	bool cancelled;
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		cancelled = Cancelled;
+		if (cancelled) delete song;
+		else Song = song;
+		Done = true;
+		DoneCond.notify_all();
+	}
+	if (!cancelled && Callback) Callback(this, UserData);
+}
+
+//==========================================================================
+//
+// AsyncSongOpen :: RunPrefetch
+//
+// Opens the song like Run, which leaves it in the song cache, and loads the
+// instruments it plays into a device of its own. Closing it right after
+// leaves that device in the device pool, where ZMusic_Start will find it if
+// the configuration is still the same, and the instruments in the synths'
+// shared caches either way. Nothing is done while the library is over
+// zmusic_snd_memorybudget, since that would only push out what is in use.
+//
+//==========================================================================
+
+static bool OverMemoryBudget()
+{
+	if (GlobalConfig.misc.snd_memorybudget <= 0) return false;
+	ZMusicMemoryUsage usage;
+	ZMusic_GetMemoryUsage(nullptr, &usage);
+	return usage.mTotal >= size_t(GlobalConfig.misc.snd_memorybudget) * 1024;
+}
+
+void AsyncSongOpen::RunPrefetch()
+{
+	if (OverMemoryBudget()) return;
+
+	FConfigScope config(Config);
+	auto reader = Reader;
+	Reader = nullptr;
+	MusInfo *song = ZMusic_OpenSongInternal(reader, Device, Args.c_str());
+	if (song == nullptr) return;
+	try
+	{
+		FMusicArenaScope arena(song);
+		song->Prefetch();
+	}
+	catch (const std::exception &)
+	{
+		// Playing it will report the same error.
+	}
+	delete song;
+	ZMusic_CheckMemoryBudget();
+}
+
+//==========================================================================
+//
+// Public interface
+//
+//==========================================================================
+
+DLL_EXPORT AsyncSongOpen *ZMusic_OpenSongAsync(ZMusicCustomReader *reader, EMidiDevice device, const char *Args, ZMusicAsyncOpenCallback callback, void *userdata)
+{
+	if (!reader)
+	{
+		SetError("No reader protocol specified");
+		return nullptr;
+	}
+	return QueueOpen(new CustomFileReader(reader), device, Args, callback, userdata);
+}
+
+DLL_EXPORT AsyncSongOpen *ZMusic_OpenSongFileAsync(const char *filename, EMidiDevice device, const char *Args, ZMusicAsyncOpenCallback callback, void *userdata)
+{
+	MusicIO::FileInterface *fr = MusicIO::OpenMappedFile(filename);
+	if (!fr)
+	{
+		auto f = MusicIO::utf8_fopen(filename, "rb");
+		if (!f)
+		{
+			SetError("File not found");
+			return nullptr;
+		}
+		auto sfr = new MusicIO::StdioFileReader;
+		sfr->f = f;
+		fr = sfr;
+	}
+	return QueueOpen(fr, device, Args, callback, userdata);
+}
+
+DLL_EXPORT AsyncSongOpen *ZMusic_OpenSongMemAsync(const void *mem, size_t size, EMidiDevice device, const char *Args, ZMusicAsyncOpenCallback callback, void *userdata)
+{
+	if (!mem || !size)
+	{
+		SetError("Invalid data");
+		return nullptr;
+	}
+	// The data is copied right away so the client may free it as soon as this returns.
+	return QueueOpen(new MusicIO::VectorReader((uint8_t *)mem, (long)size), device, Args, callback, userdata);
+}
+
+DLL_EXPORT AsyncSongOpen *ZMusic_OpenSongStreamAsync(ZMusicStreamReader *reader, EMidiDevice device, const char *Args, ZMusicAsyncOpenCallback callback, void *userdata)
+{
+	if (!reader || !reader->read || !reader->close)
+	{
+		SetError("No reader protocol specified");
+		return nullptr;
+	}
+	return QueueOpen(OpenStreamReader(reader, size_t(miscConfig.snd_streamprebuffer) * 1024), device, Args, callback, userdata);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_PrefetchSongFile(const char *filename, EMidiDevice device, const char *Args)
+{
+	MusicIO::FileInterface *fr = MusicIO::OpenMappedFile(filename);
+	if (!fr)
+	{
+		auto f = MusicIO::utf8_fopen(filename, "rb");
+		if (!f)
+		{
+			SetError("File not found");
+			return false;
+		}
+		auto sfr = new MusicIO::StdioFileReader;
+		sfr->f = f;
+		fr = sfr;
+	}
+	QueuePrefetch(fr, device, Args);
+	return true;
+}
+
+DLL_EXPORT zmusic_bool ZMusic_PrefetchSongMem(const void *mem, size_t size, EMidiDevice device, const char *Args)
+{
+	if (!mem || !size)
+	{
+		SetError("Invalid data");
+		return false;
+	}
+	QueuePrefetch(new MusicIO::VectorReader((uint8_t *)mem, (long)size), device, Args);
+	return true;
+}
+
+DLL_EXPORT void ZMusic_CancelPrefetch()
+{
+	std::vector<AsyncSongOpen *> dropped;
+	{
+		std::lock_guard<std::mutex> lock(QueueLock);
+		for (auto it = Queue.begin(); it != Queue.end(); )
+		{
+			if ((*it)->Prefetch)
+			{
+				dropped.push_back(*it);
+				it = Queue.erase(it);
+			}
+			else ++it;
+		}
+	}
+	for (auto job : dropped) job->Release();
+}
+
+DLL_EXPORT zmusic_bool ZMusic_IsAsyncOpenDone(AsyncSongOpen *handle)
+{
+	if (!handle) return true;
+	std::lock_guard<std::mutex> lock(handle->Lock);
+	return handle->Done;
+}
+
+DLL_EXPORT MusInfo *ZMusic_FinishOpenAsync(AsyncSongOpen *handle)
+{
+	if (!handle) return nullptr;
+	MusInfo *song;
+	{
+		std::unique_lock<std::mutex> lock(handle->Lock);
+		handle->DoneCond.wait(lock, [=] { return handle->Done; });
+		song = handle->Song;
+		handle->Song = nullptr;
+		if (!song) SetError(handle->Error.c_str());
+	}
+	handle->Release();
+	return song;
+}
+
+DLL_EXPORT void ZMusic_CancelOpenAsync(AsyncSongOpen *handle)
+{
+	if (!handle) return;
+	{
+		std::lock_guard<std::mutex> lock(handle->Lock);
+		handle->Cancelled = true;
+		delete handle->Song;
+		handle->Song = nullptr;
+	}
+	handle->Release();
+}
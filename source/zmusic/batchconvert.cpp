@@ -0,0 +1,162 @@
+/*
+** batchconvert.cpp
+** Converts lists of MIDI songs to Standard MIDI Files or wave files on a
+** pool of worker threads.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <string.h>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "zmusic_internal.h"
+#include "jobs.h"
+#include "critsec.h"
+#include "midisources/midisource.h"
+
+bool ZMusic_MIDIDumpWaveInternal(MIDISource *source, EMidiDevice devtype, const char *devarg, const char *outname, int subsong, int samplerate, FCriticalSection *setuplock);
+
+struct BatchSettings
+{
+	EZMusicConvertType Type;
+	EMidiDevice Device;
+	const char *DevArg;
+	int SampleRate;
+	int LoopLimit;
+	FCriticalSection SetupLock;
+};
+
+//==========================================================================
+//
+// RunJob
+//
+// Everything here reports errors through the per-thread error message,
+// which gets copied into the job before the next one overwrites it.
+//
+//==========================================================================
+
+static bool RunJob(ZMusicConvertJob &job, BatchSettings &settings)
+{
+	if (!job.data || !job.outname)
+	{
+		SetError("Invalid conversion job");
+		return false;
+	}
+
+	uint32_t id[8] = {};
+	int idsize = job.length < sizeof(id) ? (int)job.length : (int)sizeof(id);
+	memcpy(id, job.data, idsize);
+	auto miditype = ZMusic_IdentifyMIDIType(id, idsize);
+	if (miditype == MIDI_NOTMIDI)
+	{
+		SetError("Unable to identify MIDI data");
+		return false;
+	}
+	auto source = (MIDISource*)ZMusic_CreateMIDISource(job.data, job.length, miditype);
+	if (source == nullptr) return false;
+
+	if (settings.Type == ZMUSIC_CONVERT_SMF)
+	{
+		bool success = ZMusic_WriteSMF(source, job.outname, settings.LoopLimit);
+		delete source;
+		return success;
+	}
+	try
+	{
+		// The streamer takes ownership of the source.
+		return ZMusic_MIDIDumpWaveInternal(source, settings.Device, settings.DevArg, job.outname, job.subsong, settings.SampleRate, &settings.SetupLock);
+	}
+	catch (const std::exception &ex)
+	{
+		SetError(ex.what());
+		return false;
+	}
+}
+
+//==========================================================================
+//
+// ZMusic_ConvertMIDIBatch
+//
+// Jobs are handed out one at a time so that a few long songs do not hold
+// up the rest. Synths that load their instruments once share them between
+// the workers through the global configuration.
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_ConvertMIDIBatch(ZMusicConvertJob* jobs, int count, EZMusicConvertType type, EMidiDevice devtype, const char* devarg, int samplerate, int looplimit, int numthreads)
+{
+	if (!jobs || count < 0 || (type != ZMUSIC_CONVERT_SMF && type != ZMUSIC_CONVERT_WAV))
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+
+	BatchSettings settings;
+	settings.Type = type;
+	settings.Device = devtype;
+	settings.DevArg = devarg;
+	settings.SampleRate = samplerate;
+	settings.LoopLimit = looplimit;
+
+	std::atomic<int> next{ 0 };
+	std::atomic<int> failed{ 0 };
+	auto work = [&]()
+	{
+		for (int i; (i = next++) < count; )
+		{
+			auto &job = jobs[i];
+			job.success = RunJob(job, settings);
+			if (job.success)
+			{
+				job.error[0] = 0;
+			}
+			else
+			{
+				strncpy(job.error, ZMusic_GetLastError(), sizeof(job.error) - 1);
+				job.error[sizeof(job.error) - 1] = 0;
+				failed++;
+			}
+		}
+	};
+
+	// Every worker runs the loop, the caller's thread is one of them.
+	if (numthreads <= 0 || numthreads > count) numthreads = count;
+	ZMusic_RunParallel(JOB_OFFLINE, numthreads, numthreads, [](void *context, size_t) { (*(decltype(work) *)context)(); }, &work);
+
+	if (failed > 0)
+	{
+		std::string msg = std::to_string(failed.load()) + " of " + std::to_string(count) + " songs could not be converted";
+		SetError(msg.c_str());
+		return false;
+	}
+	return true;
+}
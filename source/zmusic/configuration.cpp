@@ -43,6 +43,10 @@
 #include "zmusic_internal.h"
 #include "musinfo.h"
 #include "midiconfig.h"
+#include "songcache.h"
+#include "trace.h"
+#include "emulatorselect.h"
+#include "loader/i_module.h"
 #include "mididevices/music_alsa_state.h"
 
 #ifdef HAVE_TIMIDITY
@@ -53,19 +57,16 @@
 #include "oplsynth/oplio.h"
 #endif
 
-struct Dummy
-{
-	void ChangeSettingInt(const char*, int) {}
-	void ChangeSettingNum(const char*, double) {}
-	void ChangeSettingString(const char*, const char*) {}
-};
-
 #define devType() ((currSong)? (currSong)->GetDeviceType() : MDEV_DEFAULT)
 
 
-MiscConfig miscConfig;
+ZMusicConfigSet GlobalConfig;
+thread_local ZMusicConfigSet *CurrentConfig = &GlobalConfig;
 ZMusicCallbacks musicCallbacks;
 
+void MIDI_ReleaseDevicePool(ZMusicConfigSet *config);
+void MIDI_EmptyDevicePool();
+
 class SoundFontWrapperInterface : public MusicIO::SoundFontReaderInterface
 {
 	void* handle;
@@ -111,6 +112,10 @@ namespace MusicIO {
 
 void ZMusic_Print(int type, const char* msg, va_list args)
 {
+	ZMUSIC_RT_CHECK(RTV_PRINT, msg);
+	// Instrument loading may print from worker threads.
+	static FCriticalSection PrintLock;
+	std::lock_guard<FCriticalSection> lock(PrintLock);
 	static char printbuf[4096];
 	vsnprintf(printbuf, 4096, msg, args);
 	if (musicCallbacks.MessageFunc)
@@ -128,12 +133,77 @@ void ZMusic_Printf(int type, const char* msg, ...)
 	va_end(ap);
 }
 
+//==========================================================================
+//
+// Contexts
+//
+// A new context starts as a copy of the global configuration. The sound
+// font readers that are waiting to be loaded belong to the context they
+// were set for, so the copy does not get them, nor the instruments they
+// were to replace.
+//
+//==========================================================================
+
+ZMusicConfigSet *ZMusic_CopyConfig(const ZMusicConfigSet &from)
+{
+	auto ctx = new ZMusicConfigSet(from);
+	ctx->timidity.reader = nullptr;
+	ctx->wildMidi.reader = nullptr;
+	if (from.timidity.reader != nullptr)
+	{
+		ctx->timidity.loadedConfig.clear();
+		ctx->timidity.instruments.reset();
+	}
+	if (from.wildMidi.reader != nullptr)
+	{
+		ctx->wildMidi.loadedConfig.clear();
+		ctx->wildMidi.instruments.reset();
+	}
+	return ctx;
+}
+
+DLL_EXPORT ZMusic_Context ZMusic_CreateContext()
+{
+	return ZMusic_CopyConfig(GlobalConfig);
+}
+
+DLL_EXPORT void ZMusic_DestroyContext(ZMusic_Context ctx)
+{
+	if (ctx == nullptr || ctx == &GlobalConfig) return;
+	if (CurrentConfig == ctx) CurrentConfig = &GlobalConfig;
+	MIDI_ReleaseDevicePool(ctx);
+	for (auto reader : { ctx->timidity.reader, ctx->wildMidi.reader })
+	{
+		if (reader != nullptr) reader->close();
+	}
+	delete ctx;
+}
+
+DLL_EXPORT ZMusic_Context ZMusic_SetThreadContext(ZMusic_Context ctx)
+{
+	ZMusic_Context previous = CurrentConfig == &GlobalConfig ? nullptr : CurrentConfig;
+	CurrentConfig = ctx != nullptr ? ctx : &GlobalConfig;
+	return previous;
+}
+
 DLL_EXPORT void ZMusic_SetCallbacks(const ZMusicCallbacks* cb)
 {
 	musicCallbacks = *cb;
 	// If not all these are set the sound font interface is not usable.
 	if (!cb->SF_AddToSearchPath || !cb->SF_OpenFile || !cb->SF_Close)
 		musicCallbacks.OpenSoundFont = nullptr;
+	// Zones must always be closed again.
+	if (!cb->ProfileBegin || !cb->ProfileEnd)
+	{
+		musicCallbacks.ProfileBegin = nullptr;
+		musicCallbacks.ProfileEnd = nullptr;
+	}
+	if (!cb->Alloc || !cb->Free)
+	{
+		musicCallbacks.Alloc = nullptr;
+		musicCallbacks.Free = nullptr;
+	}
+	if (!cb->ThreadStart) musicCallbacks.ThreadEnd = nullptr;
 }
 
 DLL_EXPORT void ZMusic_SetGenMidi(const uint8_t* data)
@@ -149,6 +219,7 @@ DLL_EXPORT void ZMusic_SetWgOpn(const void* data, unsigned len)
 #ifdef HAVE_OPN
 	opnConfig.default_bank.resize(len);
 	memcpy(opnConfig.default_bank.data(), data, len);
+	CurrentConfig->Generation++;
 #endif
 }
 
@@ -157,6 +228,7 @@ DLL_EXPORT void ZMusic_SetDmxGus(const void* data, unsigned len)
 #ifdef HAVE_GUS
 	gusConfig.dmxgus.resize(len);
 	memcpy(gusConfig.dmxgus.data(), data, len);
+	CurrentConfig->Generation++;
 #endif
 }
 
@@ -255,7 +327,67 @@ DLL_EXPORT const ZMusicMidiOutDevice* ZMusic_GetMidiDevices(int* pAmount)
 	return devlist.devices.data();
 }
 
+void Fluid_ReleaseSoundFontCache();
+size_t WildMidi_ReleaseUnusedPatches();
+
+//==========================================================================
+//
+// Frees cached data until the library's memory fits zmusic_snd_memorybudget,
+// cheapest to reload first. Memory of playing songs is left alone.
+//
+//==========================================================================
+
+void ZMusic_CheckMemoryBudget()
+{
+	if (GlobalConfig.misc.snd_memorybudget <= 0) return;
+	size_t budget = size_t(GlobalConfig.misc.snd_memorybudget) * 1024;
+	auto over = [=]()
+	{
+		ZMusicMemoryUsage usage;
+		ZMusic_GetMemoryUsage(nullptr, &usage);
+		return usage.mTotal > budget ? usage.mTotal - budget : 0;
+	};
+
+	size_t excess = over();
+	if (excess == 0) return;
+	SongCache_Shrink(excess);
+	if (over() == 0) return;
+	// The pooled devices keep instruments loaded that the caches below would otherwise let go of.
+	MIDI_ReleaseDevicePool(nullptr);
+	WildMidi_ReleaseUnusedPatches();
+	if (over() == 0) return;
+	// Not part of the figures, but the last cache there is to give up.
+	Fluid_ReleaseSoundFontCache();
+}
+
+//==========================================================================
+//
+// ZMusic_TrimMemory
+//
+// The same as the memory budget, only as far as the level says, however
+// little memory is in use. The pooled devices get deleted right here instead
+// of by a job, so that what they held counts for the result.
+//
+//==========================================================================
 
+DLL_EXPORT size_t ZMusic_TrimMemory(int level)
+{
+	ZMusicMemoryUsage before, after;
+	ZMusic_GetMemoryUsage(nullptr, &before);
+	MIDI_EmptyDevicePool();
+	WildMidi_ReleaseUnusedPatches();
+	if (level >= ZMUSIC_TRIM_CACHES)
+	{
+		SongCache_Shrink(SIZE_MAX);
+	}
+	if (level >= ZMUSIC_TRIM_ALL)
+	{
+		gusConfig.instruments.reset();	// the set stays loaded as long as a device uses it.
+		Fluid_ReleaseSoundFontCache();
+	}
+	ZMusic_GetMemoryUsage(nullptr, &after);
+	return before.mTotal > after.mTotal ? before.mTotal - after.mTotal : 0;
+}
 
 template<class valtype>
 void ChangeAndReturn(valtype &variable, valtype value, valtype *realv)
@@ -264,6 +396,72 @@ void ChangeAndReturn(valtype &variable, valtype value, valtype *realv)
 	if (realv) *realv = value;
 }
 
+//==========================================================================
+//
+// PostSetting
+//
+// Hands a changed setting to the playing song. While ZMusic_ApplySettings
+// runs, the changes get collected instead, so that the song only sees each
+// one once, e.g. one reverb update for all four reverb parameters.
+//
+//==========================================================================
+
+struct FSettingBatch
+{
+	enum { Size = 16 };	// more than there are ESongSettings.
+
+	MusInfo *Song;
+	int Count = 0;
+	FSongCommand Commands[Size];
+
+	FSettingBatch(MusInfo *song);
+	~FSettingBatch();
+	void Post();
+};
+
+static thread_local FSettingBatch *CurrentBatch;
+
+FSettingBatch::FSettingBatch(MusInfo *song) : Song(song)
+{
+	CurrentBatch = this;
+}
+
+FSettingBatch::~FSettingBatch()
+{
+	CurrentBatch = nullptr;
+}
+
+void FSettingBatch::Post()
+{
+	CurrentBatch = nullptr;
+	for (int i = 0; i < Count; i++) Song->PostCommand(Commands[i]);
+	Count = 0;
+}
+
+static void PostSetting(MusInfo *song, const FSongCommand &cmd)
+{
+	if (song == nullptr) return;
+
+	FSettingBatch *batch = CurrentBatch;
+	if (batch != nullptr && batch->Song == song)
+	{
+		for (int i = 0; i < batch->Count; i++)
+		{
+			if (batch->Commands[i].Type == cmd.Type && batch->Commands[i].Setting == cmd.Setting)
+			{
+				batch->Commands[i] = cmd;
+				return;
+			}
+		}
+		if (batch->Count < FSettingBatch::Size)
+		{
+			batch->Commands[batch->Count++] = cmd;
+			return;
+		}
+	}
+	song->PostCommand(cmd);
+}
+
 #define FLUID_CHORUS_MOD_SINE		0
 #define FLUID_CHORUS_MOD_TRIANGLE	1
 #define FLUID_CHORUS_DEFAULT_TYPE FLUID_CHORUS_MOD_SINE
@@ -272,18 +470,19 @@ void ChangeAndReturn(valtype &variable, valtype value, valtype *realv)
 
 //==========================================================================
 //
-// Timidity++ uses a static global set of configuration variables.
-// THese can be changed live while the synth is playing but need synchronization.
-//
-// Currently the synth is not reentrant due to this and a handful
-// of other global variables.
+// Every Timidity++ player has its own copy of the settings, which it
+// takes from the defaults when it gets created. A playing song gets told
+// to copy them again, which happens on its render thread.
 //
 //==========================================================================
 
-template<class T> void ChangeVarSync(T& var, T value)
+template<class T> void ChangeVarSync(MusInfo *song, T TimidityPlus::PlayerSettings::*var, T value)
 {
-	std::lock_guard<FCriticalSection> lock(TimidityPlus::ConfigMutex);
-	var = value;
+	{
+		std::lock_guard<FCriticalSection> lock(TimidityPlus::ConfigMutex);
+		TimidityPlus::default_settings.*var = value;
+	}
+	PostSetting(song, { FSongCommand::SettingInt, SETTING_TIMIDITY_SETTINGS, 0 });
 }
 
 //==========================================================================
@@ -306,7 +505,7 @@ template<class T> void ChangeVarSync(T& var, T value)
 static int local_timidity_reverb_level;
 static int local_timidity_reverb;
 
-static void TimidityPlus_SetReverb()
+static void TimidityPlus_SetReverb(MusInfo *song)
 {
 	int value = 0;
 	int mode = local_timidity_reverb;
@@ -314,7 +513,7 @@ static void TimidityPlus_SetReverb()
 
 	if (mode == 0 || level == 0) value = mode;
 	else value = (mode - 1) * -128 - level;
-	ChangeVarSync(TimidityPlus::timidity_reverb, value);
+	ChangeVarSync(song, &TimidityPlus::PlayerSettings::timidity_reverb, value);
 }
 #endif
 
@@ -327,6 +526,9 @@ static void TimidityPlus_SetReverb()
 
 DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSong, int value, int *pRealValue)
 {
+	FTraceCall trace(TRACE_SETTINGINT, currSong);
+	trace.Unsigned(key).Signed(value);
+	CurrentConfig->Generation++;
 	switch (key)
 	{
 		default:
@@ -360,18 +562,20 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 		case zmusic_adl_volume_model: 
 			ChangeAndReturn(adlConfig.adl_volume_model, value, pRealValue);
 			return devType() == MDEV_ADL;
+
+		case zmusic_adl_shared_resampler:
+			ChangeAndReturn(adlConfig.adl_shared_resampler, value, pRealValue);
+			return devType() == MDEV_ADL;
 #endif
 
 		case zmusic_fluid_reverb: 
-			if (currSong != NULL)
-				currSong->ChangeSettingInt("fluidsynth.synth.reverb.active", value);
+			PostSetting(currSong, { FSongCommand::SettingInt, SETTING_FLUID_REVERB_ACTIVE, value });
 
 			ChangeAndReturn(fluidConfig.fluid_reverb, value, pRealValue);
 			return false;
 
 		case zmusic_fluid_chorus: 
-			if (currSong != NULL)
-				currSong->ChangeSettingInt("fluidsynth.synth.chorus.active", value);
+			PostSetting(currSong, { FSongCommand::SettingInt, SETTING_FLUID_CHORUS_ACTIVE, value });
 
 			ChangeAndReturn(fluidConfig.fluid_chorus, value, pRealValue);
 			return false;
@@ -382,8 +586,7 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 			else if (value > 4096)
 				value = 4096;
 		
-			if (currSong != NULL)
-				currSong->ChangeSettingInt("fluidsynth.synth.polyphony", value);
+			PostSetting(currSong, { FSongCommand::SettingInt, SETTING_FLUID_POLYPHONY, value });
 
 			ChangeAndReturn(fluidConfig.fluid_voices, value, pRealValue);
 			return false;
@@ -404,8 +607,7 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 			else if (value == 6 || value > 7)
 				value = 7;
 
-			if (currSong != NULL)
-				currSong->ChangeSettingInt("fluidsynth.synth.interpolation", value);
+			PostSetting(currSong, { FSongCommand::SettingInt, SETTING_FLUID_INTERPOLATION, value });
 
 			ChangeAndReturn(fluidConfig.fluid_interp, value, pRealValue);
 			return false;
@@ -424,6 +626,7 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 				value = 256;
 
 			ChangeAndReturn(fluidConfig.fluid_threads, value, pRealValue);
+			if (devType() == MDEV_FLUIDSYNTH) currSong->SwapDevice();
 			return false;
 			
 		case zmusic_fluid_chorus_voices:
@@ -432,20 +635,16 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 			else if (value > 99)
 				value = 99;
 
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.z.chorus", value);
-
 			ChangeAndReturn(fluidConfig.fluid_chorus_voices, value, pRealValue);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_CHORUS, 0, double(value) });
 			return false;
 			
 		case zmusic_fluid_chorus_type:
 			if (value != FLUID_CHORUS_MOD_SINE && value != FLUID_CHORUS_MOD_TRIANGLE)
 				value = FLUID_CHORUS_DEFAULT_TYPE;
 	
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.z.chorus", value); // Uses float to simplify the checking code in the renderer.
-
 			ChangeAndReturn(fluidConfig.fluid_chorus_type, value, pRealValue);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_CHORUS, 0, double(value) }); // Uses float to simplify the checking code in the renderer.
 			return false;
 			
 #ifdef HAVE_OPL
@@ -455,14 +654,13 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 			else if (value > MAXOPL2CHIPS)
 				value = MAXOPL2CHIPS;
 
-			if (currSong != NULL)
-				currSong->ChangeSettingInt("opl.numchips", value);
+			PostSetting(currSong, { FSongCommand::SettingInt, SETTING_OPL_NUMCHIPS, value });
 
 			ChangeAndReturn(oplConfig.numchips, value, pRealValue);
 			return false;
 
 		case zmusic_opl_core:
-			if (value < 0) value = 0;
+			if (value < EMULATOR_AUTO) value = EMULATOR_AUTO;
 			else if (value > 3) value = 3;
 			ChangeAndReturn(oplConfig.core, value, pRealValue);
 			return devType() == MDEV_OPL;
@@ -470,6 +668,11 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 		case zmusic_opl_fullpan:
 			ChangeAndReturn(oplConfig.fullpan, value, pRealValue);
 			return false;
+
+		case zmusic_opl_threads:
+			if (value < 0) value = 0;
+			ChangeAndReturn(oplConfig.threads, value, pRealValue);
+			return false;
 #endif
 #ifdef HAVE_OPN
 		case zmusic_opn_chips_count:
@@ -491,6 +694,11 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 		case zmusic_opn_use_custom_bank:
 			ChangeAndReturn(opnConfig.opn_use_custom_bank, value, pRealValue);
 			return devType() == MDEV_OPN;
+
+		case zmusic_opn_threads:
+			if (value < 0) value = 0;
+			ChangeAndReturn(opnConfig.opn_threads, value, pRealValue);
+			return false;
 #endif
 #ifdef HAVE_GUS
 		case zmusic_gus_dmxgus:
@@ -507,95 +715,116 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 #endif
 #ifdef HAVE_TIMIDITY
 		case zmusic_timidity_modulation_wheel:
-			ChangeVarSync(TimidityPlus::timidity_modulation_wheel, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_modulation_wheel, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_portamento:
-			ChangeVarSync(TimidityPlus::timidity_portamento, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_portamento, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_reverb:
 			if (value < 0 || value > 4) value = 0;
 			local_timidity_reverb = value;
-			TimidityPlus_SetReverb();
+			TimidityPlus_SetReverb(currSong);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_reverb_level:
 			if (value < 0 || value > 127) value = 0;
 			local_timidity_reverb_level = value;
-			TimidityPlus_SetReverb();
+			TimidityPlus_SetReverb(currSong);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_chorus:
-			ChangeVarSync(TimidityPlus::timidity_chorus, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_chorus, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_surround_chorus:
-			ChangeVarSync(TimidityPlus::timidity_surround_chorus, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_surround_chorus, value);
 			if (pRealValue) *pRealValue = value;
 			return devType() == MDEV_TIMIDITY;
 
 		case zmusic_timidity_channel_pressure:
-			ChangeVarSync(TimidityPlus::timidity_channel_pressure, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_channel_pressure, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_lpf_def:
-			ChangeVarSync(TimidityPlus::timidity_lpf_def, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_lpf_def, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_temper_control:
-			ChangeVarSync(TimidityPlus::timidity_temper_control, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_temper_control, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_modulation_envelope:
-			ChangeVarSync(TimidityPlus::timidity_modulation_envelope, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_modulation_envelope, value);
 			if (pRealValue) *pRealValue = value;
 			return devType() == MDEV_TIMIDITY;
 
 		case zmusic_timidity_overlap_voice_allow:
-			ChangeVarSync(TimidityPlus::timidity_overlap_voice_allow, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_overlap_voice_allow, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_drum_effect:
-			ChangeVarSync(TimidityPlus::timidity_drum_effect, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_drum_effect, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_pan_delay:
-			ChangeVarSync(TimidityPlus::timidity_pan_delay, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_pan_delay, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_key_adjust:
 			if (value < -24) value = -24;
 			else if (value > 24) value = 24;
-			ChangeVarSync(TimidityPlus::timidity_key_adjust, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_key_adjust, value);
+			if (pRealValue) *pRealValue = value;
+			return false;
+
+		case zmusic_timidity_resample_cache:
+			if (value < 0) value = 0;
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_resample_cache, value);
+			if (pRealValue) *pRealValue = value;
+			return false;
+
+		case zmusic_timidity_threads:
+			if (value < 0) value = 0;
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_threads, value);
+			if (pRealValue) *pRealValue = value;
+			return false;
+
+		case zmusic_timidity_pre_resample:
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_pre_resample, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 #endif
 #ifdef HAVE_WILDMIDI
 		case zmusic_wildmidi_reverb:
-			if (currSong != NULL)
-				currSong->ChangeSettingInt("wildmidi.reverb", value);
+			PostSetting(currSong, { FSongCommand::SettingInt, SETTING_WILDMIDI_REVERB, value });
 			wildMidiConfig.reverb = value;
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_wildmidi_enhanced_resampling:
-			if (currSong != NULL)
-				currSong->ChangeSettingInt("wildmidi.resampling", value);
+			PostSetting(currSong, { FSongCommand::SettingInt, SETTING_WILDMIDI_RESAMPLING, value });
 			wildMidiConfig.enhanced_resampling = value;
 			if (pRealValue) *pRealValue = value;
 			return false;
+
+		case zmusic_wildmidi_patch_cache:
+			if (value < 0) value = 0;
+			wildMidiConfig.patch_cache = value;
+			if (pRealValue) *pRealValue = value;
+			return false;
 #endif
 		case zmusic_snd_midiprecache:
 			ChangeAndReturn(miscConfig.snd_midiprecache, value, pRealValue);
@@ -641,6 +870,11 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 			ChangeAndReturn(dumbConfig.mod_autochip_scan_threshold, value, pRealValue);
 			return false;
 
+		case zmusic_mod_threads:
+			if (value < 0) value = 0;
+			ChangeAndReturn(dumbConfig.mod_threads, value, pRealValue);
+			return false;
+
 		case zmusic_snd_mididevice:
 		{
 			bool change = miscConfig.snd_mididevice != value;
@@ -656,12 +890,190 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingInt(EIntConfigKey key, MusInfo *currSon
 			dumbConfig.mod_preferred_player = value;
 			return false;
 
+		case zmusic_snd_midiprecompile:
+			ChangeAndReturn(miscConfig.snd_midiprecompile, value, pRealValue);
+			return false;
+
+		case zmusic_fluid_cachesoundfonts:
+			if (!value) Fluid_ReleaseSoundFontCache();
+			ChangeAndReturn(fluidConfig.fluid_cachesoundfonts, value, pRealValue);
+			return false;
+
+		case zmusic_fluid_dynamicsamples:
+			ChangeAndReturn(fluidConfig.fluid_dynamicsamples, value, pRealValue);
+			if (devType() == MDEV_FLUIDSYNTH) currSong->SwapDevice();
+			return false;
+
+		case zmusic_fluid_floatsamples:
+			ChangeAndReturn(fluidConfig.fluid_floatsamples, value, pRealValue);
+			if (devType() == MDEV_FLUIDSYNTH) currSong->SwapDevice();
+			return false;
+
+		case zmusic_fluid_renderblock:
+			if (value < 0)
+				value = 0;
+			else if (value > 8192)
+				value = 8192;
+
+			ChangeAndReturn(fluidConfig.fluid_renderblock, value, pRealValue);
+			if (devType() == MDEV_FLUIDSYNTH) currSong->SwapDevice();
+			return false;
+
+		case zmusic_fluid_decodethreads:
+			if (value < 0)
+				value = 0;
+			else if (value > 64)
+				value = 64;
+
+			ChangeAndReturn(fluidConfig.fluid_decodethreads, value, pRealValue);
+			return false;
+
+		case zmusic_snd_midicpubudget:
+			if (value < 0)
+				value = 0;
+			else if (value > 100)
+				value = 100;
+
+			ChangeAndReturn(miscConfig.snd_midicpubudget, value, pRealValue);
+			return false;
+
+		case zmusic_snd_silencetimeout:
+			if (value < 0) value = 0;
+			ChangeAndReturn(miscConfig.snd_silencetimeout, value, pRealValue);
+			return false;
+
+		case zmusic_snd_pcmcache:
+			if (value < 0) value = 0;
+			ChangeAndReturn(miscConfig.snd_pcmcache, value, pRealValue);
+			return false;
+
+		case zmusic_snd_decodeahead:
+			if (value < 0) value = 0;
+			else if (value > 10000) value = 10000;
+			ChangeAndReturn(miscConfig.snd_decodeahead, value, pRealValue);
+			return false;
+
+		case zmusic_snd_dualloop:
+			ChangeAndReturn(miscConfig.snd_dualloop, value, pRealValue);
+			return false;
+
+		case zmusic_snd_loopcrossfade:
+			if (value < 0) value = 0;
+			else if (value > 1000) value = 1000;
+			ChangeAndReturn(miscConfig.snd_loopcrossfade, value, pRealValue);
+			return false;
+
+		case zmusic_snd_xaresample:
+			ChangeAndReturn(miscConfig.snd_xaresample, value, pRealValue);
+			return false;
+
+		case zmusic_snd_prerenderthreads:
+			if (value < 0) value = 0;
+			ChangeAndReturn(GlobalConfig.misc.snd_prerenderthreads, value, pRealValue);
+			return false;
+
+		case zmusic_snd_cdprefetch:
+			if (value < 0) value = 0;
+			else if (value > 30000) value = 30000;
+			ChangeAndReturn(miscConfig.snd_cdprefetch, value, pRealValue);
+			return false;
+
+		case zmusic_snd_memorybudget:
+			if (value < 0) value = 0;
+			ChangeAndReturn(GlobalConfig.misc.snd_memorybudget, value, pRealValue);
+			ZMusic_CheckMemoryBudget();
+			return false;
+
+		case zmusic_snd_jobthreads:
+			if (value < 0) value = 0;
+			else if (value > 256) value = 256;
+			ChangeAndReturn(GlobalConfig.misc.snd_jobthreads, value, pRealValue);
+			return false;
+
+		case zmusic_snd_resamplequality:
+			if (value < 0) value = 0;
+			else if (value > 4) value = 4;
+			ChangeAndReturn(miscConfig.snd_resamplequality, value, pRealValue);
+			return false;
+
+		case zmusic_snd_renderquantum:
+			if (value < 0) value = 0;
+			else if (value > 8192) value = 8192;
+			ChangeAndReturn(miscConfig.snd_renderquantum, value, pRealValue);
+			return false;
+
+		case zmusic_snd_dumpformat:
+			if (value < 0) value = 0;
+			else if (value > 2) value = 2;
+			ChangeAndReturn(miscConfig.snd_dumpformat, value, pRealValue);
+			return false;
+
+		case zmusic_snd_midiquickstart:
+			if (value < 0) value = 0;
+			else if (value > 60) value = 60;
+			ChangeAndReturn(miscConfig.snd_midiquickstart, value, pRealValue);
+			return false;
+
+		case zmusic_snd_midirenderrate:
+			if (value < 0) value = 0;
+			else if (value > 0 && value < 11025) value = 11025;
+			ChangeAndReturn(miscConfig.snd_midirenderrate, value, pRealValue);
+			switch (devType())
+			{
+			case MDEV_FLUIDSYNTH: case MDEV_TIMIDITY: case MDEV_WILDMIDI: case MDEV_GUS: case MDEV_ADL:
+				currSong->SwapDevice();
+				break;
+			default:
+				break;
+			}
+			return false;
+
+		case zmusic_snd_mono:
+			ChangeAndReturn(miscConfig.snd_mono, value, pRealValue);
+			return false;
+
+		case zmusic_snd_devicepool:
+			if (value < 0) value = 0;
+			else if (value > 16) value = 16;
+			ChangeAndReturn(GlobalConfig.misc.snd_devicepool, value, pRealValue);
+			MIDI_ReleaseDevicePool(nullptr);
+			return false;
+
+		case zmusic_snd_streamprebuffer:
+			if (value < 0) value = 0;
+			else if (value > 65536) value = 65536;
+			ChangeAndReturn(miscConfig.snd_streamprebuffer, value, pRealValue);
+			return false;
+
+		case zmusic_snd_midiloopcache:
+			if (value < 0) value = 0;
+			else if (value > 1048576) value = 1048576;
+			ChangeAndReturn(miscConfig.snd_midiloopcache, value, pRealValue);
+			return false;
+
+		case zmusic_gme_ym2612_core:
+			if (value < 0 || value > 3) value = 0;
+			ChangeAndReturn(miscConfig.gme_ym2612_core, value, pRealValue);
+			return false;
+
+		case zmusic_gme_fm_native_rate:
+			ChangeAndReturn(miscConfig.gme_fm_native_rate, value, pRealValue);
+			return false;
+
+		case zmusic_snd_mididensity:
+			if (value < 0) value = 0;
+			ChangeAndReturn(miscConfig.snd_mididensity, value, pRealValue);
+			return false;
+
 	}
 	return false;
 }
 
 DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* currSong, float value, float *pRealValue)
 {
+	FTraceCall trace(TRACE_SETTINGFLOAT, currSong);
+	trace.Unsigned(key).Float(value);
+	if (key != zmusic_snd_musicvolume && key != zmusic_relative_volume && key != zmusic_snd_mastervolume) CurrentConfig->Generation++;
 	switch (key)
 	{
 		default:
@@ -673,8 +1085,7 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 			else if (value > 10)
 				value = 10;
 		
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.synth.gain", value);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_GAIN, 0, value });
 		
 			ChangeAndReturn(fluidConfig.fluid_gain, value, pRealValue);
 			return false;
@@ -685,10 +1096,8 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 			else if (value > 1.0f)
 				value = 1.0f;
 
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.z.reverb", value);
-
 			ChangeAndReturn(fluidConfig.fluid_reverb_roomsize, value, pRealValue);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_REVERB, 0, value });
 			return false;
 
 		case zmusic_fluid_reverb_damping:
@@ -697,10 +1106,8 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 			else if (value > 1)
 				value = 1;
 
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.z.reverb", value);
-
 			ChangeAndReturn(fluidConfig.fluid_reverb_damping, value, pRealValue);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_REVERB, 0, value });
 			return false;
 
 		case zmusic_fluid_reverb_width:
@@ -709,10 +1116,8 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 			else if (value > 100)
 				value = 100;
 
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.z.reverb", value);
-
 			ChangeAndReturn(fluidConfig.fluid_reverb_width, value, pRealValue);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_REVERB, 0, value });
 			return false;
 
 		case zmusic_fluid_reverb_level:
@@ -721,10 +1126,8 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 			else if (value > 1)
 				value = 1;
 		
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.z.reverb", value);
-
 			ChangeAndReturn(fluidConfig.fluid_reverb_level, value, pRealValue);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_REVERB, 0, value });
 			return false;
 
 		case zmusic_fluid_chorus_level:
@@ -733,10 +1136,8 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 			else if (value > 1)
 				value = 1;
 
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.z.chorus", value);
-
 			ChangeAndReturn(fluidConfig.fluid_chorus_level, value, pRealValue);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_CHORUS, 0, value });
 			return false;
 
 		case zmusic_fluid_chorus_speed:
@@ -745,10 +1146,8 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 			else if (value > 5)
 				value = 5;
 
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.z.chorus", value);
-
 			ChangeAndReturn(fluidConfig.fluid_chorus_speed, value, pRealValue);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_CHORUS, 0, value });
 			return false;
 
 		// depth is in ms and actual maximum depends on the sample rate
@@ -758,17 +1157,15 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 			else if (value > 256)
 				value = 256;
 
-			if (currSong != NULL)
-				currSong->ChangeSettingNum("fluidsynth.z.chorus", value);
-
 			ChangeAndReturn(fluidConfig.fluid_chorus_depth, value, pRealValue);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_FLUID_CHORUS, 0, value });
 			return false;
 
 #ifdef HAVE_TIMIDITY
 		case zmusic_timidity_drum_power:
 			if (value < 0) value = 0;
 			else if (value > MAX_AMPLIFICATION / 100.f) value = MAX_AMPLIFICATION / 100.f;
-			ChangeVarSync(TimidityPlus::timidity_drum_power, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_drum_power, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
@@ -776,25 +1173,45 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 		case zmusic_timidity_tempo_adjust:
 			if (value < 0.25) value = 0.25;
 			else if (value > 10) value = 10;
-			ChangeVarSync(TimidityPlus::timidity_tempo_adjust, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_tempo_adjust, value);
 			if (pRealValue) *pRealValue = value;
 			return false;
 
 		case zmusic_timidity_min_sustain_time:
 			if (value < 0) value = 0;
-			ChangeVarSync(TimidityPlus::min_sustain_time, value);
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::min_sustain_time, value);
+			if (pRealValue) *pRealValue = value;
+			return false;
+
+		case zmusic_timidity_voice_floor:
+			if (value > 0) value = 0;
+			ChangeVarSync(currSong, &TimidityPlus::PlayerSettings::timidity_voice_floor, VoiceFloorLevel(value));
 			if (pRealValue) *pRealValue = value;
 			return false;
 #endif
+#ifdef HAVE_GUS
+		case zmusic_gus_voice_floor:
+			if (value > 0) value = 0;
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_GUS_VOICE_FLOOR, 0, value });
+			ChangeAndReturn(gusConfig.voice_floor, value, pRealValue);
+			return false;
+#endif
+#ifdef HAVE_WILDMIDI
+		case zmusic_wildmidi_voice_floor:
+			if (value > 0) value = 0;
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_WILDMIDI_VOICE_FLOOR, 0, value });
+			ChangeAndReturn(wildMidiConfig.voice_floor, value, pRealValue);
+			return false;
+#endif
 
 		case zmusic_gme_stereodepth:
-			if (currSong != nullptr)
-				currSong->ChangeSettingNum("GME.stereodepth", value);
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_GME_STEREODEPTH, 0, value });
 			ChangeAndReturn(miscConfig.gme_stereodepth, value, pRealValue);
 			return false;
 
 		case zmusic_mod_dumb_mastervolume:
 			if (value < 0) value = 0;
+			PostSetting(currSong, { FSongCommand::SettingNum, SETTING_DUMB_MASTERVOLUME, 0, value });
 			ChangeAndReturn(dumbConfig.mod_dumb_mastervolume, value, pRealValue);
 			return false;
 
@@ -810,12 +1227,20 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingFloat(EFloatConfigKey key, MusInfo* cur
 			miscConfig.snd_mastervolume = value;
 			return false;
 
+		case zmusic_snd_silencelevel:
+			if (value < 0) value = 0;
+			ChangeAndReturn(miscConfig.snd_silencelevel, value, pRealValue);
+			return false;
+
 	}
 	return false;
 }
 
 DLL_EXPORT zmusic_bool ChangeMusicSettingString(EStringConfigKey key, MusInfo* currSong, const char *value)
 {
+	FTraceCall trace(TRACE_SETTINGSTRING, currSong);
+	trace.Unsigned(key).String(value);
+	CurrentConfig->Generation++;
 	switch (key)
 	{
 		default:
@@ -835,7 +1260,9 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingString(EStringConfigKey key, MusInfo* c
 #ifdef HAVE_TIMIDITY
 			if (timidityConfig.timidity_config.empty()) timidityConfig.timidity_config = value; // Also use for Timidity++ if nothing has been set.
 #endif
-			return devType() == MDEV_FLUIDSYNTH;
+			// The soundfonts can be exchanged on the playing synth, failing that the device gets replaced in the background.
+			if (devType() != MDEV_FLUIDSYNTH) return false;
+			return !currSong->ReloadSoundFonts() && !currSong->SwapDevice();
 
 #ifdef HAVE_OPN
 		case zmusic_opn_custom_bank: 
@@ -861,11 +1288,57 @@ DLL_EXPORT zmusic_bool ChangeMusicSettingString(EStringConfigKey key, MusInfo* c
 		case zmusic_wildmidi_config:
 			wildMidiConfig.config = value;
 			return devType() == MDEV_WILDMIDI;
+#endif
+		case zmusic_fluid_samplecache:
+			fluidConfig.fluid_samplecache = value;
+			return false; // only used when loading soundfonts.
+
+		case zmusic_snd_codeccache:
+			FModule_SetLibraryCache(value);
+			return false; // only used when loading the libraries.
+
+		case zmusic_snd_rendercache:
+			miscConfig.snd_rendercache = value;
+			return false; // only used when opening songs.
+#ifdef HAVE_GUS
+		case zmusic_gus_samplecache:
+			gusConfig.gus_samplecache = value;
+			return false; // only used when loading patches.
 #endif
 	}
 	return false;
 }
 
+//==========================================================================
+//
+// ZMusic_ApplySettings
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_ApplySettings(MusInfo* song, const ZMusicSettingChange* changes, int count)
+{
+	if (changes == nullptr && count > 0)
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+
+	bool restart = false;
+	FSettingBatch batch(song);
+	for (int i = 0; i < count; i++)
+	{
+		const ZMusicSettingChange &change = changes[i];
+		if (change.key < zmusic_fluid_gain)
+			restart |= !!ChangeMusicSettingInt(EIntConfigKey(change.key), song, change.intValue, nullptr);
+		else if (change.key < zmusic_adl_custom_bank)
+			restart |= !!ChangeMusicSettingFloat(EFloatConfigKey(change.key), song, change.floatValue, nullptr);
+		else if (change.stringValue != nullptr)
+			restart |= !!ChangeMusicSettingString(EStringConfigKey(change.key), song, change.stringValue);
+	}
+	batch.Post();
+	return restart;
+}
+
 static ZMusicConfigurationSetting config[] = {
 #ifdef HAVE_ADL
 	{"zmusic_adl_chips_count", zmusic_adl_chips_count, ZMUSIC_VAR_INT, 5},
@@ -875,6 +1348,7 @@ static ZMusicConfigurationSetting config[] = {
 	{"zmusic_adl_bank", zmusic_adl_bank, ZMUSIC_VAR_INT, 14},
 	{"zmusic_adl_use_custom_bank", zmusic_adl_use_custom_bank, ZMUSIC_VAR_BOOL, 0},
 	{"zmusic_adl_volume_model", zmusic_adl_volume_model, ZMUSIC_VAR_INT, 3},
+	{"zmusic_adl_shared_resampler", zmusic_adl_shared_resampler, ZMUSIC_VAR_BOOL, 0},
 	{"zmusic_adl_custom_bank", zmusic_adl_custom_bank, ZMUSIC_VAR_STRING, 0},
 #endif
 	{"zmusic_fluid_reverb", zmusic_fluid_reverb, ZMUSIC_VAR_BOOL, 0},
@@ -894,10 +1368,12 @@ static ZMusicConfigurationSetting config[] = {
 	{"zmusic_fluid_chorus_speed", zmusic_fluid_chorus_speed, ZMUSIC_VAR_FLOAT, 0.3f},
 	{"zmusic_fluid_chorus_depth", zmusic_fluid_chorus_depth, ZMUSIC_VAR_FLOAT, 8},
 	{"zmusic_fluid_lib", zmusic_fluid_lib, ZMUSIC_VAR_STRING, 0},
+	{"zmusic_fluid_samplecache", zmusic_fluid_samplecache, ZMUSIC_VAR_STRING, 0},
 #ifdef HAVE_OPL
 	{"zmusic_opl_numchips", zmusic_opl_numchips, ZMUSIC_VAR_INT, 2},
 	{"zmusic_opl_core", zmusic_opl_core, ZMUSIC_VAR_INT, 0},
 	{"zmusic_opl_fullpan", zmusic_opl_fullpan, ZMUSIC_VAR_BOOL, 1},
+	{"zmusic_opl_threads", zmusic_opl_threads, ZMUSIC_VAR_INT, 1},
 #endif
 #ifdef HAVE_OPN
 	{"zmusic_opn_chips_count", zmusic_opn_chips_count, ZMUSIC_VAR_INT, 8},
@@ -905,15 +1381,20 @@ static ZMusicConfigurationSetting config[] = {
 	{"zmusic_opn_run_at_pcm_rate", zmusic_opn_run_at_pcm_rate, ZMUSIC_VAR_BOOL, 0},
 	{"zmusic_opn_fullpan", zmusic_opn_fullpan, ZMUSIC_VAR_BOOL, 2},
 	{"zmusic_opn_use_custom_bank", zmusic_opn_use_custom_bank, ZMUSIC_VAR_BOOL, 0},
+	{"zmusic_opn_threads", zmusic_opn_threads, ZMUSIC_VAR_INT, 1},
 	{"zmusic_opn_custom_bank", zmusic_opn_custom_bank, ZMUSIC_VAR_STRING, 0},
 #endif
 #ifdef HAVE_GUS
 	{"zmusic_gus_dmxgus", zmusic_gus_dmxgus, ZMUSIC_VAR_BOOL, 0},
 	{"zmusic_gus_midi_voices", zmusic_gus_midi_voices, ZMUSIC_VAR_INT, 32},
 	{"zmusic_gus_memsize", zmusic_gus_memsize, ZMUSIC_VAR_INT, 0},
+	{"zmusic_gus_voice_floor", zmusic_gus_voice_floor, ZMUSIC_VAR_FLOAT, 0},
 	{"zmusic_gus_config", zmusic_gus_config, ZMUSIC_VAR_STRING, 0},
 	{"zmusic_gus_patchdir", zmusic_gus_patchdir, ZMUSIC_VAR_STRING, 0},
+	{"zmusic_gus_samplecache", zmusic_gus_samplecache, ZMUSIC_VAR_STRING, 0},
+	{"zmusic_snd_codeccache", zmusic_snd_codeccache, ZMUSIC_VAR_STRING, 0},
 #endif
+	{"zmusic_snd_rendercache", zmusic_snd_rendercache, ZMUSIC_VAR_STRING, 0},
 #ifdef HAVE_TIMIDITY
 	{"zmusic_timidity_modulation_wheel", zmusic_timidity_modulation_wheel, ZMUSIC_VAR_BOOL, 1},
 	{"zmusic_timidity_portamento", zmusic_timidity_portamento, ZMUSIC_VAR_BOOL, 0},
@@ -929,14 +1410,20 @@ static ZMusicConfigurationSetting config[] = {
 	{"zmusic_timidity_drum_effect", zmusic_timidity_drum_effect, ZMUSIC_VAR_BOOL, 0},
 	{"zmusic_timidity_pan_delay", zmusic_timidity_pan_delay, ZMUSIC_VAR_BOOL, 0},
 	{"zmusic_timidity_key_adjust", zmusic_timidity_key_adjust, ZMUSIC_VAR_INT, 0},
+	{"zmusic_timidity_resample_cache", zmusic_timidity_resample_cache, ZMUSIC_VAR_INT, 0},
+	{"zmusic_timidity_threads", zmusic_timidity_threads, ZMUSIC_VAR_INT, 1},
+	{"zmusic_timidity_pre_resample", zmusic_timidity_pre_resample, ZMUSIC_VAR_BOOL, 0},
 	{"zmusic_timidity_drum_power", zmusic_timidity_drum_power, ZMUSIC_VAR_FLOAT, 1},
 	{"zmusic_timidity_tempo_adjust", zmusic_timidity_tempo_adjust, ZMUSIC_VAR_FLOAT, 1},
 	{"zmusic_timidity_min_sustain_time", zmusic_timidity_min_sustain_time, ZMUSIC_VAR_FLOAT, 5000},
+	{"zmusic_timidity_voice_floor", zmusic_timidity_voice_floor, ZMUSIC_VAR_FLOAT, 0},
 	{"zmusic_timidity_config", zmusic_timidity_config, ZMUSIC_VAR_STRING, 0},
 #endif
 #ifdef HAVE_WILDMIDI
 	{"zmusic_wildmidi_reverb", zmusic_wildmidi_reverb, ZMUSIC_VAR_BOOL, 0},
 	{"zmusic_wildmidi_enhanced_resampling", zmusic_wildmidi_enhanced_resampling, ZMUSIC_VAR_BOOL, 1},
+	{"zmusic_wildmidi_patch_cache", zmusic_wildmidi_patch_cache, ZMUSIC_VAR_INT, 16384},
+	{"zmusic_wildmidi_voice_floor", zmusic_wildmidi_voice_floor, ZMUSIC_VAR_FLOAT, 0},
 	{"zmusic_wildmidi_config", zmusic_wildmidi_config, ZMUSIC_VAR_STRING, 0},
 #endif
 	{"zmusic_mod_samplerate", zmusic_mod_samplerate, ZMUSIC_VAR_INT, 0},
@@ -947,17 +1434,48 @@ static ZMusicConfigurationSetting config[] = {
 	{"zmusic_mod_autochip_size_scan", zmusic_mod_autochip_size_scan, ZMUSIC_VAR_INT, 500},
 	{"zmusic_mod_autochip_scan_threshold", zmusic_mod_autochip_scan_threshold, ZMUSIC_VAR_INT, 12},
 	{"zmusic_mod_preferred_player", zmusic_mod_preferredplayer, ZMUSIC_VAR_INT, 0},
+	{"zmusic_mod_threads", zmusic_mod_threads, ZMUSIC_VAR_INT, 1},
 	{"zmusic_mod_dumb_mastervolume", zmusic_mod_dumb_mastervolume, ZMUSIC_VAR_FLOAT, 1},
 
 	{"zmusic_gme_stereodepth", zmusic_gme_stereodepth, ZMUSIC_VAR_FLOAT, 0},
+	{"zmusic_gme_ym2612_core", zmusic_gme_ym2612_core, ZMUSIC_VAR_INT, 0},
+	{"zmusic_gme_fm_native_rate", zmusic_gme_fm_native_rate, ZMUSIC_VAR_BOOL, 0},
 
 	{"zmusic_snd_midiprecache", zmusic_snd_midiprecache, ZMUSIC_VAR_BOOL, 1},
+	{"zmusic_snd_midiprecompile", zmusic_snd_midiprecompile, ZMUSIC_VAR_BOOL, 0},
+	{"zmusic_snd_mididensity", zmusic_snd_mididensity, ZMUSIC_VAR_INT, 0},
+	{"zmusic_fluid_cachesoundfonts", zmusic_fluid_cachesoundfonts, ZMUSIC_VAR_BOOL, 1},
+	{"zmusic_fluid_dynamicsamples", zmusic_fluid_dynamicsamples, ZMUSIC_VAR_BOOL, 0},
+	{"zmusic_fluid_renderblock", zmusic_fluid_renderblock, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_midicpubudget", zmusic_snd_midicpubudget, ZMUSIC_VAR_INT, 0},
+	{"zmusic_fluid_decodethreads", zmusic_fluid_decodethreads, ZMUSIC_VAR_INT, 0},
+	{"zmusic_fluid_floatsamples", zmusic_fluid_floatsamples, ZMUSIC_VAR_BOOL, 0},
 	{"zmusic_snd_streambuffersize", zmusic_snd_streambuffersize, ZMUSIC_VAR_INT, 64},
 	{"zmusic_snd_mididevice", zmusic_snd_mididevice, ZMUSIC_VAR_INT, 0},
 	{"zmusic_snd_outputrate", zmusic_snd_outputrate, ZMUSIC_VAR_INT, 44100},
 	{"zmusic_snd_musicvolume", zmusic_snd_musicvolume, ZMUSIC_VAR_FLOAT, 1},
 	{"zmusic_relative_volume", zmusic_relative_volume, ZMUSIC_VAR_FLOAT, 1},
 	{"zmusic_snd_mastervolume", zmusic_snd_mastervolume, ZMUSIC_VAR_FLOAT, 1},
+	{"zmusic_snd_silencetimeout", zmusic_snd_silencetimeout, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_decodeahead", zmusic_snd_decodeahead, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_pcmcache", zmusic_snd_pcmcache, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_dualloop", zmusic_snd_dualloop, ZMUSIC_VAR_BOOL, 0},
+	{"zmusic_snd_loopcrossfade", zmusic_snd_loopcrossfade, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_xaresample", zmusic_snd_xaresample, ZMUSIC_VAR_BOOL, 0},
+	{"zmusic_snd_prerenderthreads", zmusic_snd_prerenderthreads, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_cdprefetch", zmusic_snd_cdprefetch, ZMUSIC_VAR_INT, 2000},
+	{"zmusic_snd_memorybudget", zmusic_snd_memorybudget, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_jobthreads", zmusic_snd_jobthreads, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_resamplequality", zmusic_snd_resamplequality, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_renderquantum", zmusic_snd_renderquantum, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_dumpformat", zmusic_snd_dumpformat, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_midiquickstart", zmusic_snd_midiquickstart, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_midirenderrate", zmusic_snd_midirenderrate, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_mono", zmusic_snd_mono, ZMUSIC_VAR_BOOL, 0},
+	{"zmusic_snd_devicepool", zmusic_snd_devicepool, ZMUSIC_VAR_INT, 0},
+	{"zmusic_snd_streamprebuffer", zmusic_snd_streamprebuffer, ZMUSIC_VAR_INT, 64},
+	{"zmusic_snd_silencelevel", zmusic_snd_silencelevel, ZMUSIC_VAR_FLOAT, 1.f / 32768},
+	{"zmusic_snd_midiloopcache", zmusic_snd_midiloopcache, ZMUSIC_VAR_INT, 0},
 	{}
 };
 
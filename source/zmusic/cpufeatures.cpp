@@ -0,0 +1,128 @@
+/*
+** cpufeatures.cpp
+** Detects the instruction sets the DSP kernels can use.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include "cpufeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPUFEATURES_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef CPUFEATURES_X86
+
+static void CPUID(uint32_t leaf, uint32_t sub, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuidex(r, (int)leaf, (int)sub);
+	for (int i = 0; i < 4; i++) regs[i] = (uint32_t)r[i];
+#else
+	__cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Which register states the OS saves on a task switch.
+static uint64_t XCR0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t lo, hi;
+	__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+#endif
+
+//==========================================================================
+//
+// DetectCPUFeatures
+//
+//==========================================================================
+
+static uint32_t DetectCPUFeatures()
+{
+	uint32_t features = 0;
+#if defined(CPUFEATURES_X86)
+	uint32_t regs[4];
+	CPUID(0, 0, regs);
+	uint32_t maxleaf = regs[0];
+	if (maxleaf < 1) return 0;
+
+	CPUID(1, 0, regs);
+	const uint32_t ecx1 = regs[2];
+	if (regs[3] & (1u << 26)) features |= CPU_SSE2;
+	if (ecx1 & (1u << 19)) features |= CPU_SSE41;
+
+	const bool osxsave = (ecx1 & (1u << 27)) != 0;
+	const bool avx = (ecx1 & (1u << 28)) != 0;
+	const bool fma = (ecx1 & (1u << 12)) != 0;
+	if (osxsave && avx && maxleaf >= 7)
+	{
+		uint64_t xcr0 = XCR0();
+		CPUID(7, 0, regs);
+		const uint32_t ebx7 = regs[1];
+		// XMM and YMM state
+		if ((xcr0 & 0x06) == 0x06 && fma && (ebx7 & (1u << 5)))
+		{
+			features |= CPU_AVX2;
+			// and the opmask and ZMM state
+			const uint32_t avx512 = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31);
+			if ((xcr0 & 0xe6) == 0xe6 && (ebx7 & avx512) == avx512) features |= CPU_AVX512;
+		}
+	}
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+	features |= CPU_NEON;
+#elif defined(__wasm_simd128__)
+	features |= CPU_SIMD128;
+#endif
+	return features;
+}
+
+//==========================================================================
+//
+// ZMusic_CPUFeatures
+//
+//==========================================================================
+
+uint32_t ZMusic_CPUFeatures()
+{
+	static const uint32_t features = DetectCPUFeatures();
+	return features;
+}
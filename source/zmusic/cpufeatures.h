@@ -0,0 +1,78 @@
+#pragma once
+
+// Picks between versions of a kernel for different instruction sets at run
+// time.
+//
+// The library itself is compiled for the baseline of its architecture, SSE2
+// on x86-64 and NEON on ARM64. WebAssembly cannot check at run time, there
+// ZMUSIC_WASM_SIMD decides whether all of it uses SIMD128. A kernel that gains from more gets further
+// versions in translation units of their own, which CMake compiles for that
+// instruction set with add_isa_sources, defining ZMUSIC_ISA_<set> for the
+// rest of the library when it did. Such a unit must not include anything
+// with inline functions or templates the rest of the library also uses: the
+// linker keeps one copy of those, and it may be the one that needs AVX2.
+
+#include <stdint.h>
+#include <atomic>
+#include <initializer_list>
+
+enum ECPUFeature : uint32_t
+{
+	CPU_SSE2 = 1,
+	CPU_SSE41 = 2,
+	CPU_AVX2 = 4,		// and FMA, which every CPU with AVX2 has.
+	CPU_AVX512 = 8,		// F, BW, DQ and VL, which every CPU with AVX-512 but the Xeon Phi has.
+	CPU_NEON = 16,
+	CPU_SIMD128 = 32,	// WebAssembly, only ever set when the library was compiled for it.
+};
+
+// What the CPU can do, as far as the OS allows it. Detected by the first call.
+uint32_t ZMusic_CPUFeatures();
+
+// A kernel's versions, best first, each with the features it needs. The last
+// one must need none. Get returns the first the CPU can run.
+template<class Fn, int MaxVariants = 4>
+class TCPUDispatch
+{
+public:
+	struct Variant
+	{
+		uint32_t Needs;
+		Fn Func;
+	};
+
+	TCPUDispatch(std::initializer_list<Variant> variants)
+	{
+		for (auto &v : variants)
+		{
+			if (Count < MaxVariants) Variants[Count++] = v;
+		}
+	}
+
+	Fn Get() const
+	{
+		Fn func = Selected.load(std::memory_order_relaxed);
+		return func != nullptr ? func : Select();
+	}
+
+private:
+	Fn Select() const
+	{
+		uint32_t features = ZMusic_CPUFeatures();
+		Fn func = Variants[Count - 1].Func;
+		for (int i = 0; i < Count; i++)
+		{
+			if ((Variants[i].Needs & features) == Variants[i].Needs)
+			{
+				func = Variants[i].Func;
+				break;
+			}
+		}
+		Selected.store(func, std::memory_order_relaxed);
+		return func;
+	}
+
+	Variant Variants[MaxVariants];
+	int Count = 0;
+	mutable std::atomic<Fn> Selected{ nullptr };
+};
@@ -1,11 +1,14 @@
 #pragma once
 
+#include "rtcheck.h"
+
 // System independent critical sections without polluting the namespace with the operating system headers.
 class FInternalCriticalSection;
 FInternalCriticalSection *CreateCriticalSection();
 void DeleteCriticalSection(FInternalCriticalSection *c);
 void EnterCriticalSection(FInternalCriticalSection *c);
 void LeaveCriticalSection(FInternalCriticalSection *c);
+bool TryEnterCriticalSection(FInternalCriticalSection *c);
 
 // This is just a convenience wrapper around the function interface adjusted to use std::lock_guard
 class FCriticalSection
@@ -23,9 +26,21 @@ public:
 
 	void lock()
 	{
+#ifdef ZMUSIC_RTCHECK
+		if (ZMusic_RealtimeThread)
+		{
+			if (TryEnterCriticalSection(c)) return;
+			ZMusic_RTViolation(RTV_LOCK, "FCriticalSection::lock");
+		}
+#endif
 		EnterCriticalSection(c);
 	}
 	
+	bool try_lock()
+	{
+		return TryEnterCriticalSection(c);
+	}
+
 	void unlock()
 	{
 		LeaveCriticalSection(c);
@@ -0,0 +1,77 @@
+/*
+** emulatorselect.cpp
+** Picks the FM emulator cores for their "auto" setting.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** A candidate fits if it needs at most half of zmusic_snd_midicpubudget,
+** so that the rest of the song and the measurement's optimism, with its
+** caches warm and nothing else running, still have room. Without a budget
+** it gets a quarter of real time.
+**
+*/
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include "emulatorselect.h"
+#include "midiconfig.h"
+
+enum
+{
+	DefaultBudget = 25,		// percent of real time, if zmusic_snd_midicpubudget is 0.
+};
+
+static std::mutex CostLock;
+static std::map<std::string, std::vector<double>> Costs;	// negative for candidates not measured yet.
+
+//==========================================================================
+//
+// ZMusic_SelectEmulator
+//
+//==========================================================================
+
+int ZMusic_SelectEmulator(const std::string &key, int count, const std::function<double(int)> &measure)
+{
+	if (count <= 1) return 0;
+	int budget = miscConfig.snd_midicpubudget > 0 ? miscConfig.snd_midicpubudget : DefaultBudget;
+	double allowed = budget / 200.;
+
+	// Measuring with the lock held keeps two devices opened at the same time
+	// from slowing down each other's measurements.
+	std::lock_guard<std::mutex> lock(CostLock);
+	auto &costs = Costs[key];
+	costs.resize(count, -1.);
+	for (int i = 0; i < count - 1; i++)
+	{
+		if (costs[i] < 0) costs[i] = measure(i);
+		if (costs[i] <= allowed) return i;
+	}
+	return count - 1;
+}
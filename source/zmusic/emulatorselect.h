@@ -0,0 +1,17 @@
+#pragma once
+
+// The "auto" setting of zmusic_adl_emulator_id, zmusic_opn_emulator_id and
+// zmusic_opl_core, which plays with the most accurate emulator the CPU
+// budget allows.
+
+#include <string>
+#include <functional>
+
+enum { EMULATOR_AUTO = -1 };
+
+// Measures 'count' candidates, the most accurate first, until one fits the
+// budget, and returns its index, or the last one's if none does. 'measure'
+// returns the time a candidate takes to render a second of audio, in seconds.
+// The results are kept for the process under 'key', which has to name the
+// synth and everything else the time depends on, like the number of chips.
+int ZMusic_SelectEmulator(const std::string &key, int count, const std::function<double(int)> &measure);
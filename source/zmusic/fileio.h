@@ -28,6 +28,10 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "rtcheck.h"
 
 #if defined _WIN32 && !defined _WINDOWS_	// only define this if windows.h is not included.
 	// I'd rather not include Windows.h for just this. This header is not supposed to pollute everything it touches.
@@ -69,6 +73,31 @@ public:
 		delete this;
 	}
 
+	// Readers that hold the entire file in memory can give out a reference to it
+	// instead of having the data copied. It remains valid after the reader is closed.
+	virtual std::shared_ptr<const uint8_t> shareData()
+	{
+		return nullptr;
+	}
+
+	// Readers that hold the entire file in memory return it here, so that decoders
+	// can work on it in place. It is only valid as long as the reader is open.
+	virtual const uint8_t* memoryData()
+	{
+		return nullptr;
+	}
+
+	// Readers for data that is still arriving wait for it in read and seek.
+	// Those must only be used off the audio thread, and get cancelled before
+	// whoever is reading is stopped, after which they only return what they have.
+	virtual bool mayWait()
+	{
+		return false;
+	}
+	virtual void cancel()
+	{
+	}
+
 	long filelength()
 	{
 		if (length == -1)
@@ -99,16 +128,19 @@ struct StdioFileReader : public FileInterface
 	char* gets(char* buff, int n) override
 	{
 		if (!f) return nullptr;
+		ZMUSIC_RT_CHECK(RTV_FILEIO, "fgets");
 		return fgets(buff, n, f);
 	}
 	long read(void* buff, int32_t size) override
 	{
 		if (!f) return 0;
+		ZMUSIC_RT_CHECK(RTV_FILEIO, "fread");
 		return (long)fread(buff, 1, size, f);
 	}
 	long seek(long offset, int whence) override
 	{
 		if (!f) return 0;
+		ZMUSIC_RT_CHECK(RTV_FILEIO, "fseek");
 		return fseek(f, offset, whence);
 	}
 	long tell() override
@@ -195,6 +227,10 @@ struct MemoryReader : public FileInterface
 	{
 		return mPos;
 	}
+	const uint8_t* memoryData() override
+	{
+		return mData;
+	}
 protected:
 	MemoryReader() {}
 };
@@ -208,6 +244,7 @@ protected:
 struct VectorReader : public MemoryReader
 {
 	std::vector<uint8_t> mVector;
+	std::shared_ptr<std::vector<uint8_t>> mShared;
 
 	template <class getFunc>
 	VectorReader(getFunc getter)	// read contents to a buffer and return a reader to it
@@ -225,8 +262,17 @@ struct VectorReader : public MemoryReader
 		mLength = (long)size;
 		mPos = 0;
 	}
+	std::shared_ptr<const uint8_t> shareData() override
+	{
+		// Moving the vector keeps its buffer, so mData remains valid.
+		if (!mShared) mShared = std::make_shared<std::vector<uint8_t>>(std::move(mVector));
+		return std::shared_ptr<const uint8_t>(mShared, mShared->data());
+	}
 };
 
+FileInterface* OpenMappedFile(const char* filename);
+FileInterface* OpenGzipReader(FileInterface* reader);	// takes over the reader if it is gzipped data.
+
 
 //==========================================================================
 //
@@ -295,9 +341,19 @@ public:
 class FileSystemSoundFontReader : public SoundFontReaderInterface
 {
 protected:
+	// The entries of a search directory, listed once so that names which
+	// are not in it cost no failed opens. Patch sets look up hundreds of
+	// files, most of them in only one of several directories.
+	struct DirectoryIndex
+	{
+		bool Valid = false;	// the directory could not be listed, so every name needs to be tried.
+		std::unordered_set<std::string> Names;
+	};
+
 	std::vector<std::string> mPaths;
 	std::string mBaseFile;
 	bool mAllowAbsolutePaths;
+	std::unordered_map<std::string, DirectoryIndex> mIndex;
 
 	bool IsAbsPath(const char *name)
 	{
@@ -309,6 +365,9 @@ protected:
 		return 0;
 	}
 
+	bool MayExist(const std::string &path, const char *fn);
+	FileInterface* OpenFile(const std::string &fullname);
+
 public:
 	FileSystemSoundFontReader(const char *configfilename, bool allowabs = false)
 	{
@@ -318,41 +377,8 @@ public:
 		mAllowAbsolutePaths = allowabs;
 	}
 
-	struct FileInterface* open_file(const char* fn) override
-	{
-		FILE *f = nullptr;
-		std::string fullname;
-		if (!fn) 
-		{
-			f = utf8_fopen(mBaseFile.c_str(), "rb");
-			fullname = mBaseFile;
-		}
-		else
-		{
-			if (!IsAbsPath(fn))
-			{
-				for(int i = (int)mPaths.size()-1; i>=0; i--)
-				{
-					fullname = mPaths[i] + fn;
-					f = utf8_fopen(fullname.c_str(), "rb");
-					if (f) break;
-				}
-			}
-			if (!f) f = fopen(fn, "rb");
-		}
-		if (!f) return nullptr;
-		auto tf = new StdioFileReader;
-		tf->f = f;
-		tf->filename = fullname;
-		return tf;
-	}
-	
-	void add_search_path(const char* path) override
-	{
-		std::string p  = path;
-		if (p.back() != '/' && p.back() != '\\') p += '/';	// always let it end with a slash.
-		mPaths.push_back(p);
-	}
+	struct FileInterface* open_file(const char* fn) override;
+	void add_search_path(const char* path) override;
 };
 
 //==========================================================================
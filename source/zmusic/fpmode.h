@@ -0,0 +1,61 @@
+#pragma once
+
+// Flushes denormals to zero while the library renders.
+//
+// Reverb tails, filters and resamplers decay into denormal numbers once
+// the music goes quiet, and on most CPUs every operation on one of those
+// is many times slower than normal. Setting the mode around every render
+// call means that the client does not have to set it on its audio thread,
+// and that it is restored for the client's own code afterward.
+//
+// This has no dependencies, so that it can be used by musinfo.h.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+
+class FDenormalScope
+{
+	unsigned int Previous;
+
+public:
+	FDenormalScope() : Previous(_mm_getcsr())
+	{
+		_mm_setcsr(Previous | 0x8040);	// flush-to-zero and denormals-are-zero.
+	}
+	~FDenormalScope() { _mm_setcsr(Previous); }
+	FDenormalScope(const FDenormalScope &) = delete;
+	FDenormalScope &operator=(const FDenormalScope &) = delete;
+};
+
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+
+#include <stdint.h>
+
+class FDenormalScope
+{
+	uint64_t Previous;
+
+public:
+	FDenormalScope()
+	{
+		__asm__ __volatile__("mrs %0, fpcr" : "=r"(Previous));
+		uint64_t ftz = Previous | (uint64_t(1) << 24);	// FZ, which covers both inputs and outputs.
+		__asm__ __volatile__("msr fpcr, %0" : : "r"(ftz));
+	}
+	~FDenormalScope() { __asm__ __volatile__("msr fpcr, %0" : : "r"(Previous)); }
+	FDenormalScope(const FDenormalScope &) = delete;
+	FDenormalScope &operator=(const FDenormalScope &) = delete;
+};
+
+#else
+
+// x87 and 32-bit ARM have no mode that is worth switching to.
+class FDenormalScope
+{
+public:
+	FDenormalScope() = default;
+	FDenormalScope(const FDenormalScope &) = delete;
+	FDenormalScope &operator=(const FDenormalScope &) = delete;
+};
+
+#endif
@@ -0,0 +1,245 @@
+/*
+** gzipreader.cpp
+** Decompresses gzipped songs as they are being read.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <miniz.h>
+#include <algorithm>
+#include "fileio.h"
+
+namespace MusicIO
+{
+
+enum
+{
+	GZIP_FHCRC = 2,
+	GZIP_FEXTRA = 4,
+	GZIP_FNAME = 8,
+	GZIP_FCOMMENT = 16,
+
+	GZIP_CHUNK = 65536,	// compressed data is read and inflated at least this much at a time.
+};
+
+//==========================================================================
+//
+// A reader for gzipped data which inflates only as far as it has been
+// read. The size is known from the gzip trailer, so the buffer is
+// allocated once and everything inflated so far stays in it, which keeps
+// seeking back, e.g. after probing for the format, free. The compressed
+// data is never copied as a whole.
+//
+//==========================================================================
+
+struct GzipReader : public MemoryReader
+{
+	FileInterface *mSource;
+	std::shared_ptr<uint8_t> mBuffer;
+	std::vector<uint8_t> mInput;	// only for sources that are not in memory.
+	z_stream mStream = {};
+	long mCompPos = 0, mCompEnd = 0;	// the deflate data in mSource.
+	long mInflated = 0;
+	bool mActive = false;
+
+	GzipReader(FileInterface *source) : mSource(source)
+	{
+		mData = nullptr;
+		mLength = 0;
+		mPos = 0;
+	}
+
+	~GzipReader()
+	{
+		if (mActive) inflateEnd(&mStream);
+		if (mSource) mSource->close();
+	}
+
+	bool Open();
+	void Inflate(long upto);
+
+	char* gets(char* strbuf, int len) override
+	{
+		Inflate(mPos + len);
+		return MemoryReader::gets(strbuf, len);
+	}
+	long read(void* buff, int32_t size) override
+	{
+		Inflate(mPos + size);
+		return MemoryReader::read(buff, size);
+	}
+	const uint8_t* memoryData() override
+	{
+		Inflate(mLength);
+		return mData;
+	}
+	std::shared_ptr<const uint8_t> shareData() override
+	{
+		Inflate(mLength);
+		return mBuffer;
+	}
+};
+
+//==========================================================================
+//
+// GzipReader :: Open
+//
+// Parses the header and the trailer.
+//
+//==========================================================================
+
+bool GzipReader::Open()
+{
+	long complen = mSource->filelength();
+	uint8_t header[10];
+	if (complen < 18 || mSource->seek(0, SEEK_SET) != 0 || mSource->read(header, 10) != 10) return false;
+	if (header[0] != 31 || header[1] != 139 || header[2] != 8) return false;
+
+	uint8_t flags = header[3];
+	uint8_t b[4];
+	if (flags & GZIP_FEXTRA)
+	{
+		if (mSource->read(b, 2) != 2 || mSource->seek(b[0] | (b[1] << 8), SEEK_CUR) != 0) return false;
+	}
+	// The name and the comment are zero terminated.
+	for (int field : { GZIP_FNAME, GZIP_FCOMMENT })
+	{
+		if (flags & field)
+		{
+			do
+			{
+				if (mSource->read(b, 1) != 1) return false;
+			} while (b[0] != 0);
+		}
+	}
+	if (flags & GZIP_FHCRC)
+	{
+		if (mSource->seek(2, SEEK_CUR) != 0) return false;
+	}
+	mCompPos = mSource->tell();
+	mCompEnd = complen - 8;
+	if (mCompPos >= mCompEnd) return false;
+
+	// The trailer's size is only modulo 4 GB, but that is far beyond anything that gets played here.
+	if (mSource->seek(-4, SEEK_END) != 0 || mSource->read(b, 4) != 4) return false;
+	uint32_t isize = b[0] | (b[1] << 8) | (b[2] << 16) | (uint32_t(b[3]) << 24);
+	if (isize == 0 || isize > 0x7fffffff) return false;
+
+	mBuffer.reset(new uint8_t[isize], std::default_delete<uint8_t[]>());
+	mData = mBuffer.get();
+	mLength = (long)isize;
+
+	if (inflateInit2(&mStream, -MAX_WBITS) != Z_OK) return false;
+	mActive = true;
+
+	// Memory based sources are inflated from directly.
+	const uint8_t *mem = mSource->memoryData();
+	if (mem != nullptr)
+	{
+		mStream.next_in = (Bytef *)mem + mCompPos;
+		mStream.avail_in = (uInt)(mCompEnd - mCompPos);
+		mCompPos = mCompEnd;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// GzipReader :: Inflate
+//
+// If the stream turns out to be broken, the file gets cut short there.
+//
+//==========================================================================
+
+void GzipReader::Inflate(long upto)
+{
+	upto = std::min(upto, mLength);
+	while (mActive && mInflated < upto)
+	{
+		if (mStream.avail_in == 0 && mCompPos < mCompEnd)
+		{
+			mInput.resize(GZIP_CHUNK);
+			long toread = std::min<long>(GZIP_CHUNK, mCompEnd - mCompPos);
+			long got = mSource->seek(mCompPos, SEEK_SET) == 0 ? mSource->read(mInput.data(), toread) : 0;
+			if (got <= 0) got = 0;
+			mCompPos = got > 0 ? mCompPos + got : mCompEnd;
+			mStream.next_in = mInput.data();
+			mStream.avail_in = (uInt)got;
+		}
+		mStream.next_out = mBuffer.get() + mInflated;
+		mStream.avail_out = (uInt)std::min<long>(mLength - mInflated, std::max<long>(upto - mInflated, GZIP_CHUNK));
+		uInt before = mStream.avail_out;
+		int err = inflate(&mStream, Z_NO_FLUSH);
+		mInflated += long(before - mStream.avail_out);
+		if (err == Z_STREAM_END || mInflated == mLength || (err != Z_OK && err != Z_BUF_ERROR) || (err == Z_BUF_ERROR && mStream.avail_in == 0 && mCompPos >= mCompEnd))
+		{
+			inflateEnd(&mStream);
+			mActive = false;
+		}
+	}
+	if (!mActive && mInflated < mLength)
+	{
+		mLength = mInflated;
+		if (mPos > mLength) mPos = mLength;
+	}
+}
+
+//==========================================================================
+//
+// Takes over the reader if it succeeds.
+//
+//==========================================================================
+
+FileInterface* OpenGzipReader(FileInterface* reader)
+{
+	auto pos = reader->tell();
+	GzipReader *gz = nullptr;
+	try
+	{
+		gz = new GzipReader(reader);
+		if (gz->Open())
+		{
+			gz->filename = reader->filename;
+			return gz;
+		}
+	}
+	catch (const std::bad_alloc &)
+	{
+	}
+	if (gz != nullptr)
+	{
+		gz->mSource = nullptr;
+		delete gz;
+	}
+	reader->seek(pos, SEEK_SET);
+	return nullptr;
+}
+
+}
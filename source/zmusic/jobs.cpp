@@ -0,0 +1,392 @@
+/*
+** jobs.cpp
+** The shared worker threads all jobs of the library run on.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** Background and offline jobs never occupy the last worker, so real-time
+** work that an audio callback is waiting for does not queue up behind
+** loading a sound font. The workers are started with the first job, up to
+** zmusic_snd_jobthreads, and then sleep between jobs until the library
+** gets unloaded.
+**
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include "zmusic_internal.h"
+#include "midiconfig.h"
+#include "jobs.h"
+#include "fpmode.h"
+
+static_assert(int(JOB_REALTIME) == ZMUSIC_JOB_REALTIME && int(JOB_BACKGROUND) == ZMUSIC_JOB_BACKGROUND && int(JOB_OFFLINE) == ZMUSIC_JOB_OFFLINE, "job priorities differ");
+static_assert(int(THREAD_WORKER) == ZMUSIC_THREAD_WORKER && int(THREAD_PRERENDER) == ZMUSIC_THREAD_PRERENDER && int(THREAD_SYNTH) == ZMUSIC_THREAD_SYNTH &&
+	int(THREAD_STREAM) == ZMUSIC_THREAD_STREAM && int(THREAD_MIDIOUT) == ZMUSIC_THREAD_MIDIOUT && int(THREAD_LOADER) == ZMUSIC_THREAD_LOADER, "thread roles differ");
+
+enum
+{
+	NUM_PRIORITIES = JOB_OFFLINE + 1
+};
+
+//==========================================================================
+//
+// FJobPool
+//
+//==========================================================================
+
+class FJobPool
+{
+public:
+	~FJobPool();
+	void Submit(int priority, std::function<void()> &&job);
+
+private:
+	bool Take(std::function<void()> &job, int &priority);
+	void Run(size_t index);
+
+	std::mutex Lock;
+	std::condition_variable Wake;
+	std::deque<std::function<void()>> Queues[NUM_PRIORITIES];
+	std::vector<std::thread> Threads;
+	size_t RunningSlow = 0;		// background and offline jobs being run.
+	bool Quit = false;
+};
+
+static FJobPool JobPool;
+
+FJobPool::~FJobPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		Quit = true;
+	}
+	Wake.notify_all();
+	for (auto &t : Threads) t.join();
+}
+
+//==========================================================================
+//
+// FJobPool :: Submit
+//
+//==========================================================================
+
+void FJobPool::Submit(int priority, std::function<void()> &&job)
+{
+	std::unique_lock<std::mutex> lock(Lock);
+	try
+	{
+		while (Threads.size() < ZMusic_JobThreads())
+		{
+			Threads.emplace_back(&FJobPool::Run, this, Threads.size());
+		}
+	}
+	catch (const std::system_error &)
+	{
+		// Without any thread at all the job has to run right here.
+		if (Threads.empty())
+		{
+			lock.unlock();
+			job();
+			return;
+		}
+	}
+	Queues[priority].push_back(std::move(job));
+	// Not every sleeping worker may take every job, so all of them need to look.
+	Wake.notify_all();
+}
+
+//==========================================================================
+//
+// FJobPool :: Take
+//
+// Lock must be held.
+//
+//==========================================================================
+
+bool FJobPool::Take(std::function<void()> &job, int &priority)
+{
+	size_t slowlimit = std::max<size_t>(std::min(Threads.size(), ZMusic_JobThreads()), 2) - 1;
+	for (priority = JOB_REALTIME; priority < NUM_PRIORITIES; priority++)
+	{
+		if (priority != JOB_REALTIME && RunningSlow >= slowlimit) return false;
+		auto &queue = Queues[priority];
+		if (!queue.empty())
+		{
+			job = std::move(queue.front());
+			queue.pop_front();
+			if (priority != JOB_REALTIME) RunningSlow++;
+			return true;
+		}
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// FJobPool :: Run
+//
+// The worker loop. Workers left over from a larger zmusic_snd_jobthreads
+// stay asleep. At shutdown the jobs still queued are run before the
+// workers quit, so that nothing they hold on to is left behind.
+//
+//==========================================================================
+
+void FJobPool::Run(size_t index)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "ZMusic worker %zu", index);
+	FThreadScope scope(THREAD_WORKER, name);
+
+	std::unique_lock<std::mutex> lock(Lock);
+	for (;;)
+	{
+		std::function<void()> job;
+		int priority;
+		if (index < ZMusic_JobThreads() && Take(job, priority))
+		{
+			lock.unlock();
+			job();
+			job = nullptr;	// whatever it holds on to goes before the next job starts.
+			lock.lock();
+			if (priority != JOB_REALTIME)
+			{
+				RunningSlow--;
+				Wake.notify_all();
+			}
+			continue;
+		}
+		if (Quit) break;
+		Wake.wait(lock);
+	}
+}
+
+//==========================================================================
+//
+// ZMusic_ThreadBegin / ZMusic_ThreadEnd
+//
+// A thread that was started before the client installed its callbacks
+// does not get ThreadEnd without ThreadStart.
+//
+//==========================================================================
+
+static thread_local void (*ThreadEndFunc)(int role);
+
+extern "C" void ZMusic_ThreadBegin(int role, const char *name)
+{
+	auto start = musicCallbacks.ThreadStart;
+	if (start != nullptr)
+	{
+		ThreadEndFunc = musicCallbacks.ThreadEnd;
+		start(role, name);
+	}
+}
+
+extern "C" void ZMusic_ThreadEnd(int role)
+{
+	if (ThreadEndFunc != nullptr) ThreadEndFunc(role);
+	ThreadEndFunc = nullptr;
+}
+
+//==========================================================================
+//
+// ZMusic_JobThreads
+//
+//==========================================================================
+
+size_t ZMusic_JobThreads()
+{
+	if (GlobalConfig.misc.snd_jobthreads > 0) return (size_t)GlobalConfig.misc.snd_jobthreads;
+	return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+//==========================================================================
+//
+// ZMusic_SubmitJob
+//
+//==========================================================================
+
+void ZMusic_SubmitJob(int priority, std::function<void()> job)
+{
+	// The job works with the submitter's context, not whatever the worker had last.
+	if (CurrentConfig != &GlobalConfig)
+	{
+		job = [config = CurrentConfig, job = std::move(job)]()
+		{
+			FConfigScope scope(config);
+			job();
+		};
+	}
+	auto submit = musicCallbacks.SubmitJob;
+	if (submit != nullptr)
+	{
+		auto holder = new std::function<void()>(std::move(job));
+		submit(priority, [](void *context)
+		{
+			auto job = (std::function<void()> *)context;
+			(*job)();
+			delete job;
+		}, holder);
+	}
+	else
+	{
+		JobPool.Submit(priority, std::move(job));
+	}
+}
+
+//==========================================================================
+//
+// FJob
+//
+//==========================================================================
+
+struct FJobState
+{
+	std::mutex Lock;
+	std::condition_variable Done;
+	std::function<void()> Work;
+	enum { QUEUED, RUNNING, FINISHED } Status = QUEUED;
+
+	// Whoever gets here first runs the job, the pool or the one waiting for it.
+	bool Claim()
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		if (Status != QUEUED) return false;
+		Status = RUNNING;
+		return true;
+	}
+
+	void Execute()
+	{
+		Work();
+		Work = nullptr;
+		std::lock_guard<std::mutex> lock(Lock);
+		Status = FINISHED;
+		Done.notify_all();
+	}
+};
+
+void FJob::Start(int priority, std::function<void()> work)
+{
+	State = std::make_shared<FJobState>();
+	State->Work = std::move(work);
+	auto state = State;
+	ZMusic_SubmitJob(priority, [state]()
+	{
+		if (state->Claim()) state->Execute();
+	});
+}
+
+void FJob::Wait()
+{
+	if (State == nullptr) return;
+	if (State->Claim())
+	{
+		State->Execute();
+	}
+	else
+	{
+		std::unique_lock<std::mutex> lock(State->Lock);
+		State->Done.wait(lock, [this]() { return State->Status == FJobState::FINISHED; });
+	}
+	State.reset();
+}
+
+//==========================================================================
+//
+// ZMusic_RunParallel
+//
+// Helpers that only start after the caller has run out of work have
+// nothing to do, so the caller only waits for those that already started.
+// Real-time helpers render for the caller, which flushes denormals while
+// it does, so they do the same on their worker thread.
+//
+//==========================================================================
+
+struct FParallelState
+{
+	std::mutex Lock;
+	std::condition_variable Done;
+	size_t Running = 0;
+	bool Closed = false;
+	std::atomic<size_t> Next{ 0 };
+	size_t Count;
+	void (*Work)(void *, size_t);
+	void *Context;
+
+	void Run()
+	{
+		for (size_t i = Next++; i < Count; i = Next++) Work(Context, i);
+	}
+};
+
+void ZMusic_RunParallel(int priority, size_t count, size_t threads, void (*work)(void *context, size_t i), void *context)
+{
+	threads = std::min(std::min(threads, count), ZMusic_JobThreads());
+	if (threads <= 1)
+	{
+		for (size_t i = 0; i < count; i++) work(context, i);
+		return;
+	}
+
+	auto state = std::make_shared<FParallelState>();
+	state->Count = count;
+	state->Work = work;
+	state->Context = context;
+	for (size_t i = 1; i < threads; i++)
+	{
+		ZMusic_SubmitJob(priority, [state, priority]()
+		{
+			{
+				std::lock_guard<std::mutex> lock(state->Lock);
+				if (state->Closed) return;
+				state->Running++;
+			}
+			if (priority == JOB_REALTIME)
+			{
+				FDenormalScope denormals;
+				state->Run();
+			}
+			else state->Run();
+			std::lock_guard<std::mutex> lock(state->Lock);
+			if (--state->Running == 0) state->Done.notify_all();
+		});
+	}
+	state->Run();
+
+	std::unique_lock<std::mutex> lock(state->Lock);
+	state->Closed = true;
+	state->Done.wait(lock, [&]() { return state->Running == 0; });
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+// The library's shared worker threads. All work that is not tied to a
+// thread of its own goes through here, so that ZMusic never runs more
+// threads than zmusic_snd_jobthreads, or none at all if the client
+// schedules the jobs with ZMusicCallbacks::SubmitJob.
+//
+// Nothing in here waits for a job that has not started yet. If no worker
+// got to it, the waiting thread runs it itself.
+
+#include <stddef.h>
+#include <functional>
+#include <memory>
+
+// The same as EZMusicJobPriority, for code that cannot include zmusic.h.
+enum EJobPriority
+{
+	JOB_REALTIME,		// the audio callback waits for it.
+	JOB_BACKGROUND,		// loading and decoding ahead of playback.
+	JOB_OFFLINE,		// conversions no one is listening to.
+};
+
+// The same as EZMusicThreadRole.
+enum EThreadRole
+{
+	THREAD_WORKER,
+	THREAD_PRERENDER,
+	THREAD_SYNTH,
+	THREAD_STREAM,
+	THREAD_MIDIOUT,
+	THREAD_LOADER,
+};
+
+// Let the client set up a thread the library started, see
+// ZMusicCallbacks::ThreadStart. Called on the thread itself, first thing
+// and last thing. FluidSynth's threads call them directly, everything
+// else uses FThreadScope.
+extern "C" void ZMusic_ThreadBegin(int role, const char *name);
+extern "C" void ZMusic_ThreadEnd(int role);
+
+class FThreadScope
+{
+	int Role;
+
+public:
+	FThreadScope(int role, const char *name) : Role(role) { ZMusic_ThreadBegin(role, name); }
+	~FThreadScope() { ZMusic_ThreadEnd(Role); }
+	FThreadScope(const FThreadScope &) = delete;
+	FThreadScope &operator=(const FThreadScope &) = delete;
+};
+
+// Runs 'job' once, some time later, on any thread.
+void ZMusic_SubmitJob(int priority, std::function<void()> job);
+
+// Calls work(context, i) once for every i in [0, count), using up to 'threads'
+// threads including the caller's. Returns after all calls have finished.
+void ZMusic_RunParallel(int priority, size_t count, size_t threads, void (*work)(void *context, size_t i), void *context);
+
+// The number of threads ZMusic_RunParallel can use at most, including the caller's.
+size_t ZMusic_JobThreads();
+
+struct FJobState;
+
+// A job that can be waited for, in place of a thread that gets joined.
+class FJob
+{
+public:
+	FJob() = default;
+	~FJob() { Wait(); }
+	FJob(const FJob &) = delete;
+	FJob &operator=(const FJob &) = delete;
+
+	// The previous job must have been waited for.
+	void Start(int priority, std::function<void()> work);
+	void Wait();
+	// True between Start and Wait, like a joinable thread.
+	bool Pending() const { return State != nullptr; }
+
+private:
+	std::shared_ptr<FJobState> State;
+};
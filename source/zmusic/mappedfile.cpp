@@ -0,0 +1,160 @@
+/*
+** mappedfile.cpp
+** Memory mapped file access, so that song data can be parsed in place.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <limits.h>
+#include "fileio.h"
+
+namespace MusicIO
+{
+
+//==========================================================================
+//
+// Owns the mapping. Shared between the reader and everything that
+// took a reference to the data through shareData.
+//
+//==========================================================================
+
+struct FileMapping
+{
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE mapping = nullptr;
+#endif
+
+	~FileMapping()
+	{
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+#else
+		if (data) munmap((void*)data, size);
+#endif
+	}
+
+	bool Map(const char *filename)
+	{
+#ifdef _WIN32
+		auto wname = wideString(filename);
+		HANDLE file = CreateFileW(wname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER fsize;
+		if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart <= 0 || fsize.QuadPart > LONG_MAX)
+		{
+			CloseHandle(file);
+			return false;
+		}
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);	// the mapping holds its own reference.
+		if (mapping == nullptr) return false;
+
+		data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		size = (size_t)fsize.QuadPart;
+		return data != nullptr;
+#else
+		int fd = open(filename, O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > LONG_MAX)
+		{
+			::close(fd);
+			return false;
+		}
+		void *mem = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);	// the mapping stays valid.
+		if (mem == MAP_FAILED) return false;
+
+		data = (const uint8_t*)mem;
+		size = (size_t)st.st_size;
+		return true;
+#endif
+	}
+};
+
+//==========================================================================
+//
+// A MemoryReader on top of the mapping
+//
+//==========================================================================
+
+struct MappedFileReader : public MemoryReader
+{
+	std::shared_ptr<FileMapping> mMapping;
+
+	MappedFileReader(std::shared_ptr<FileMapping> &&mapping)
+		: MemoryReader(mapping->data, (long)mapping->size), mMapping(std::move(mapping))
+	{
+	}
+
+	std::shared_ptr<const uint8_t> shareData() override
+	{
+		return std::shared_ptr<const uint8_t>(mMapping, mMapping->data);
+	}
+};
+
+//==========================================================================
+//
+// Returns nullptr if the file cannot be mapped, e.g. because it is empty
+// or not a regular file. The caller should fall back to StdioFileReader then.
+//
+//==========================================================================
+
+FileInterface* OpenMappedFile(const char* filename)
+{
+	try
+	{
+		auto mapping = std::make_shared<FileMapping>();
+		if (!mapping->Map(filename)) return nullptr;
+		auto reader = new MappedFileReader(std::move(mapping));
+		reader->filename = filename;
+		return reader;
+	}
+	catch (const std::bad_alloc &)
+	{
+		return nullptr;
+	}
+}
+
+}
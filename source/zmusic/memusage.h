@@ -0,0 +1,10 @@
+#pragma once
+
+// Memory reporting for code that cannot include zmusic.h, like the synths in
+// thirdparty. Every byte added must be taken away again when it is freed.
+// Both may be called from any thread.
+
+#include <stddef.h>
+
+void ZMusic_AccountSamples(ptrdiff_t bytes);
+void ZMusic_AccountInstruments(ptrdiff_t bytes);
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <math.h>
 #include "zmusic_internal.h"
 #include "fileio.h"
 
@@ -16,6 +17,7 @@ struct ADLConfig
 	int adl_volume_model = 0; // Automatical volume model (by bank properties)
 	int adl_run_at_pcm_rate = 0;
 	int adl_fullpan = 1;
+	int adl_shared_resampler = 0;
 	int adl_use_custom_bank = false;
 	std::string adl_custom_bank;
 };
@@ -40,6 +42,12 @@ struct FluidConfig
 	float fluid_chorus_level = 1.2f;
 	float fluid_chorus_speed = 0.3f;
 	float fluid_chorus_depth = 8;
+	int fluid_cachesoundfonts = true;
+	int fluid_dynamicsamples = false;
+	int fluid_renderblock = 0;
+	int fluid_decodethreads = 0;
+	int fluid_floatsamples = false;
+	std::string fluid_samplecache;
 };
 
 struct OPLConfig
@@ -47,6 +55,7 @@ struct OPLConfig
 	int numchips = 2;
 	int core = 0;
 	int fullpan = true;
+	int threads = 1;
 	int genmidiset = false;
 	uint8_t OPLinstruments[36 * 175]; // it really is 'struct GenMidiInstrument OPLinstruments[GENMIDI_NUM_TOTAL]'; but since this is a public header it cannot pull in a dependency from oplsynth.
 };
@@ -58,6 +67,7 @@ struct OpnConfig
 	int opn_run_at_pcm_rate = false;
 	int opn_fullpan = 1;
 	int opn_use_custom_bank = false;
+	int opn_threads = 1;
 	std::string opn_custom_bank;
 	std::vector<uint8_t> default_bank;
 };
@@ -73,15 +83,15 @@ struct GUSConfig
 	int midi_voices = 32;
 	int gus_memsize = 0;
 	int gus_dmxgus = false;
+	float voice_floor = 0;	// in dB, see zmusic_gus_voice_floor.
 	std::string gus_patchdir;
 	std::string gus_config;
+	std::string gus_samplecache;
 	std::vector<uint8_t> dmxgus;				// can contain the contents of a DMXGUS lump that may be used as the instrument set. In this case gus_patchdir must point to the location of the GUS data and gus_dmxgus must be true.
 	
-	// This is the instrument cache for the GUS synth.
-	MusicIO::SoundFontReaderInterface *reader;
-	std::string readerName;
-	std::string loadedConfig;
-	std::unique_ptr<Timidity::Instruments> instruments;
+	// The last instrument set used by a GUS device, so that it stays loaded between songs.
+	// The devices share their sets through a cache in the device code.
+	std::shared_ptr<Timidity::Instruments> instruments;
 };
 
 namespace TimidityPlus
@@ -94,8 +104,9 @@ struct TimidityConfig
 {
 	std::string timidity_config;
 
-	MusicIO::SoundFontReaderInterface* reader;
+	MusicIO::SoundFontReaderInterface* reader = nullptr;
 	std::string readerName;
+	bool readerIsClient = false;	// the client's reader, whose files cannot be checked for changes
 	std::string loadedConfig;
 	std::shared_ptr<TimidityPlus::Instruments> instruments;	// this is held both by the config and the device
 
@@ -111,15 +122,23 @@ struct WildMidiConfig
 {
 	bool reverb = false;
 	bool enhanced_resampling = true;
+	int patch_cache = 16384;
+	float voice_floor = 0;	// in dB, see zmusic_wildmidi_voice_floor.
 	std::string config;
 
-	MusicIO::SoundFontReaderInterface* reader;
+	MusicIO::SoundFontReaderInterface* reader = nullptr;
 	std::string readerName;
 	std::string loadedConfig;
 	std::shared_ptr<WildMidi::Instruments> instruments;	// this is held both by the config and the device
 
 };
 
+// The level a voice floor given in dB stands for, 1 being full scale. 0 when it is off.
+inline float VoiceFloorLevel(float db)
+{
+	return db < 0 ? powf(10.f, db / 20.f) : 0.f;
+}
+
 struct DumbConfig
 {
 	int  mod_samplerate;
@@ -130,6 +149,7 @@ struct DumbConfig
     int  mod_autochip_size_scan = 500;
     int  mod_autochip_scan_threshold = 12;
 	int  mod_preferred_player = 0;
+	int  mod_threads = 1;
     float mod_dumb_mastervolume = 1;
 };
 
@@ -137,22 +157,74 @@ struct MiscConfig
 {
 	int snd_midiprecache;
 	float gme_stereodepth;
+	int gme_ym2612_core = 0;
+	int gme_fm_native_rate = 0;
 	int snd_streambuffersize = 64;
 	int snd_mididevice;
+	int snd_midiprecompile = 0;
+	int snd_mididensity = 0;
+	int snd_midicpubudget = 0;
 	int snd_outputrate = 44100;
 	float snd_musicvolume = 1.f;
 	float relative_volume = 1.f;
 	float snd_mastervolume = 1.f;
+	int snd_silencetimeout = 0;
+	int snd_decodeahead = 0;
+	int snd_pcmcache = 0;
+	int snd_dualloop = 0;
+	int snd_loopcrossfade = 0;
+	int snd_xaresample = 0;
+	int snd_prerenderthreads = 0;
+	int snd_cdprefetch = 2000;
+	int snd_memorybudget = 0;
+	int snd_jobthreads = 0;
+	int snd_resamplequality = 0;
+	int snd_renderquantum = 0;
+	int snd_dumpformat = 0;
+	int snd_midiquickstart = 0;
+	int snd_midirenderrate = 0;
+	int snd_mono = 0;
+	int snd_devicepool = 0;
+	int snd_streamprebuffer = 64;
+	float snd_silencelevel = 1.f / 32768;
+	int snd_midiloopcache = 0;
+	std::string snd_rendercache;
 };
 
-extern ADLConfig adlConfig;
-extern FluidConfig fluidConfig;
-extern OPLConfig oplConfig;
-extern OpnConfig opnConfig;
-extern GUSConfig gusConfig;
-extern TimidityConfig timidityConfig;
-extern WildMidiConfig wildMidiConfig;
-extern DumbConfig dumbConfig;
-extern MiscConfig miscConfig;
+// Everything a ZMusic_Context holds. The library starts out with GlobalConfig,
+// which also has the settings that only make sense once per process:
+// zmusic_snd_jobthreads, zmusic_snd_prerenderthreads, zmusic_snd_memorybudget
+// and zmusic_snd_devicepool.
+struct ZMusicConfigSet
+{
+	unsigned Generation = 0;	// counts the setting changes, except for the volumes, see the device pool.
+
+	ADLConfig adl;
+	FluidConfig fluid;
+	OPLConfig opl;
+	OpnConfig opn;
+	GUSConfig gus;
+	TimidityConfig timidity;
+	WildMidiConfig wildMidi;
+	DumbConfig dumb;
+	MiscConfig misc;
+};
+
+extern ZMusicConfigSet GlobalConfig;
+
+// A new context with the settings of 'from', for ZMusic_DestroyContext to free.
+ZMusicConfigSet *ZMusic_CopyConfig(const ZMusicConfigSet &from);
+
+// The configuration of the calling thread's context, see FConfigScope.
+#define adlConfig (CurrentConfig->adl)
+#define fluidConfig (CurrentConfig->fluid)
+#define oplConfig (CurrentConfig->opl)
+#define opnConfig (CurrentConfig->opn)
+#define gusConfig (CurrentConfig->gus)
+#define timidityConfig (CurrentConfig->timidity)
+#define wildMidiConfig (CurrentConfig->wildMidi)
+#define dumbConfig (CurrentConfig->dumb)
+#define miscConfig (CurrentConfig->misc)
+
 extern ZMusicCallbacks musicCallbacks;
 
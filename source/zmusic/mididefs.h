@@ -4,7 +4,9 @@
 
 enum
 {
-	MAX_MIDI_EVENTS = 128
+	MAX_MIDI_EVENTS = 128,
+	MAX_MIDI_BUFFERS = 16,	// Upper limit for the number of event buffers a MIDI stream may keep queued.
+	MAX_MIDI_LAYERS = 3		// Songs that can play on another song's synth at the same time, each on 16 channels of its own.
 };
 
 inline constexpr uint8_t MEVENT_EVENTTYPE(uint32_t x) { return ((uint8_t)((x) >> 24)); }
@@ -17,6 +19,39 @@ enum EMidiEvent : uint8_t
 	MEVENT_LONGMSG = 128,
 };
 
+// Parameters for MEVENT_NOP. Sources only write the loop markers while their timing is being
+// measured, MIDIStreamer writes MARKER_RESTART where a looping song starts over on a software synth.
+// MARKER_TIMESIG carries a time signature's numerator in bits 8-15 and the power of 2 of its
+// denominator in bits 16-23, see MIDIMeter.
+enum ELoopMarker
+{
+	MARKER_LOOPSTART = 1,
+	MARKER_LOOPEND = 2,
+	MARKER_RESTART = 3,
+	MARKER_TIMESIG = 4,
+};
+
+// Settings that can change while a song plays. Songs and devices pick out
+// the ones that concern them and ignore the rest.
+enum ESongSetting
+{
+	SETTING_FLUID_REVERB_ACTIVE,	// int
+	SETTING_FLUID_CHORUS_ACTIVE,	// int
+	SETTING_FLUID_POLYPHONY,		// int
+	SETTING_FLUID_INTERPOLATION,	// int
+	SETTING_FLUID_GAIN,				// num
+	SETTING_FLUID_REVERB,			// num, the parameters are taken from fluidConfig.
+	SETTING_FLUID_CHORUS,			// num, the parameters are taken from fluidConfig.
+	SETTING_OPL_NUMCHIPS,			// int
+	SETTING_WILDMIDI_REVERB,		// int
+	SETTING_WILDMIDI_RESAMPLING,	// int
+	SETTING_GME_STEREODEPTH,		// num
+	SETTING_DUMB_MASTERVOLUME,		// num
+	SETTING_TIMIDITY_SETTINGS,		// int, unused. The settings are taken from TimidityPlus::default_settings.
+	SETTING_GUS_VOICE_FLOOR,		// num, in dB.
+	SETTING_WILDMIDI_VOICE_FLOOR,	// num, in dB.
+};
+
 #ifndef MAKE_ID
 #ifndef __BIG_ENDIAN__
 #define MAKE_ID(a,b,c,d)	((uint32_t)((a)|((b)<<8)|((c)<<16)|((d)<<24)))
@@ -0,0 +1,752 @@
+/*
+** mixer.cpp
+** Mixes several music streams into a single output buffer.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "zmusic_internal.h"
+#include "musinfo.h"
+#include "midiconfig.h"
+#include "critsec.h"
+#include "fpmode.h"
+#include "jobs.h"
+
+zmusic_bool ZMusic_FillStream(MusInfo* song, void* buff, int len);
+class FluidEffectsBus;
+FluidEffectsBus *Fluid_CreateEffectsBus(int samplerate);
+void Fluid_DestroyEffectsBus(FluidEffectsBus *bus);
+void Fluid_ProcessEffectsBus(FluidEffectsBus *bus, const float *reverb, const float *chorus, float *out, int frames);
+
+//==========================================================================
+//
+// ConvertToStereo
+//
+// Converts a stream's output to float stereo in place. This runs back to
+// front so that the wider output never overwrites input that has not been
+// read yet.
+//
+//==========================================================================
+
+static void ConvertToStereo(float *out, int frames, const SoundStreamInfoEx &fmt)
+{
+	if (fmt.mSampleType == SampleType_Int16)
+	{
+		auto in = (const int16_t *)out;
+		if (fmt.mChannelConfig == ChannelConfig_Stereo)
+		{
+			for (int i = frames * 2 - 1; i >= 0; i--) out[i] = in[i] * (1.f / 32768.f);
+		}
+		else
+		{
+			for (int i = frames - 1; i >= 0; i--) out[i * 2] = out[i * 2 + 1] = in[i] * (1.f / 32768.f);
+		}
+	}
+	else if (fmt.mChannelConfig == ChannelConfig_Mono)
+	{
+		for (int i = frames - 1; i >= 0; i--) out[i * 2] = out[i * 2 + 1] = out[i];
+	}
+}
+
+//==========================================================================
+//
+// The output format is always interleaved float stereo. Streams must run at
+// the mixer's sample rate since there is no resampler on this path.
+//
+//==========================================================================
+
+class MusicMixer
+{
+	struct Channel
+	{
+		MusInfo *Song;
+		SoundStreamInfoEx Format;
+		float Gain;
+		float TargetGain;
+		int FadeFrames;
+		bool Active;
+		bool ExternalFx;	// reverb and chorus go through the shared bus
+		bool Rendered;	// Active may get cleared while rendering the last block, which still needs to be mixed.
+		bool Replaced = false;	// by a queued stream, leaves the mixer once it is faded out or has ended
+		bool Virtual = false;	// told to the song while its gain is 0
+		uint64_t StartFrame = 0;		// of the mixer's clock, it is not rendered before then
+		MusInfo *Follows = nullptr;		// for queued streams, the one they start after
+		std::vector<float> Preroll;		// float stereo rendered by QueueStream, played before the stream itself
+		size_t PrerollPos = 0;
+	};
+
+	enum { PREROLL_MS = 100 };
+
+public:
+	MusicMixer(int samplerate) : SampleRate(samplerate) {}
+	~MusicMixer();
+
+	bool AddStream(MusInfo *song, float gain, uint64_t startframe = 0);
+	uint64_t GetClock() const { return Clock.load(std::memory_order_relaxed); }
+	bool QueueStream(MusInfo *song, MusInfo *next, float gain, int crossfade_ms);
+	bool RemoveStream(MusInfo *song);
+	bool HasStream(MusInfo *song);
+	bool SetGain(MusInfo *song, float gain, int fade_ms);
+	bool ShareEffects(bool on);
+	bool Fill(float *buff, int len);
+
+private:
+	Channel *FindChannel(MusInfo *song);
+	bool CheckFormat(MusInfo *song, SoundStreamInfoEx &fmt);
+	bool RenderInto(Channel &c, float *out, int frames);
+	void RenderChannel(size_t index);
+	void StartQueued(size_t index, float *buff, int frames);
+	void SetExternalFx(Channel &c, bool on);
+	void Detach(Channel &c);
+
+	int SampleRate;
+	FCriticalSection Lock;
+	std::vector<Channel> Channels;
+	std::vector<Channel> Queued;	// waiting for the streams they follow to end
+
+	// Scratch arena. Every channel gets its own slice of StreamFrames * 2 floats.
+	// SendScratch is laid out the same, with the reverb and chorus sends as planes.
+	std::vector<float> Scratch, SendScratch;
+	int StreamFrames = 0;
+	int BlockFrames = 0;	// of the current Fill call
+	uint64_t BlockStart = 0;	// the clock at its start
+	std::atomic<uint64_t> Clock{ 0 };	// frames Fill was asked for so far
+
+	// Shared effects. The bus outlives the last stream using it so that the tails can ring out.
+	bool SharedEffects = false;
+	FluidEffectsBus *EffectsBus = nullptr;
+	std::vector<float> BusInput;
+};
+
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+MusicMixer::~MusicMixer()
+{
+	for (auto &c : Channels) Detach(c);
+	if (EffectsBus) Fluid_DestroyEffectsBus(EffectsBus);
+}
+
+MusicMixer::Channel *MusicMixer::FindChannel(MusInfo *song)
+{
+	for (auto &c : Channels)
+	{
+		if (c.Song == song) return &c;
+	}
+	return nullptr;
+}
+
+//==========================================================================
+//
+// MusicMixer :: CheckFormat
+//
+//==========================================================================
+
+bool MusicMixer::CheckFormat(MusInfo *song, SoundStreamInfoEx &fmt)
+{
+	bool planar;
+	{
+		std::lock_guard<FCriticalSection> slock(song->CritSec);
+		fmt = song->GetOutputInfoEx();
+		planar = song->OutputConverter.IsPlanar();
+	}
+	if (fmt.mBufferSize <= 0)
+	{
+		SetError("Stream cannot be mixed");
+		return false;
+	}
+	if (fmt.mSampleRate != SampleRate)
+	{
+		SetError("Stream's sample rate does not match the mixer's");
+		return false;
+	}
+	if ((fmt.mSampleType != SampleType_Float32 && fmt.mSampleType != SampleType_Int16) || planar)
+	{
+		SetError("Unsupported sample format for mixing");
+		return false;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// MusicMixer :: AddStream
+//
+//==========================================================================
+
+bool MusicMixer::AddStream(MusInfo *song, float gain, uint64_t startframe)
+{
+	SoundStreamInfoEx fmt;
+	if (!CheckFormat(song, fmt)) return false;
+
+	std::lock_guard<FCriticalSection> lock(Lock);
+	if (FindChannel(song)) return true;
+	Channels.push_back({ song, fmt, gain, gain, 0, true, false, false });
+	Channels.back().StartFrame = startframe;
+	if (SharedEffects) SetExternalFx(Channels.back(), true);
+	return true;
+}
+
+//==========================================================================
+//
+// MusicMixer :: QueueStream
+//
+// Makes 'next' take over from 'song', either right after song ends or
+// with a crossfade that starts right away. The first part of next is
+// rendered here, on the client's thread, so that the mix does not have
+// to pay for whatever a song does when it first gets serviced. Queued
+// streams keep their own effects, the preroll could not provide sends.
+//
+//==========================================================================
+
+bool MusicMixer::QueueStream(MusInfo *song, MusInfo *next, float gain, int crossfade_ms)
+{
+	SoundStreamInfoEx fmt;
+	if (!CheckFormat(next, fmt)) return false;
+
+	int prerollframes;
+	{
+		std::lock_guard<FCriticalSection> lock(Lock);
+		if (FindChannel(song) == nullptr)
+		{
+			SetError("Stream is not in the mixer");
+			return false;
+		}
+		prerollframes = std::max(SampleRate * PREROLL_MS / 1000, StreamFrames);
+	}
+
+	Channel n = { next, fmt, gain, gain, 0, true, false, false };
+	int framesize = ZMusic_SampleTypeSize(fmt.mSampleType) * ZMusic_ChannelCount(fmt.mChannelConfig);
+	n.Preroll.resize(prerollframes * 2);
+	if (!ZMusic_FillStream(next, n.Preroll.data(), prerollframes * framesize))
+	{
+		SetError("Stream has nothing to play");
+		return false;
+	}
+	ConvertToStereo(n.Preroll.data(), prerollframes, fmt);
+
+	std::lock_guard<FCriticalSection> lock(Lock);
+	// Fill must not have to allocate when the stream takes over.
+	Channels.reserve(Channels.size() + Queued.size() + 1);
+	auto c = FindChannel(song);
+	if (c == nullptr || FindChannel(next) != nullptr)
+	{
+		SetError(c == nullptr ? "Stream is not in the mixer" : "Queued stream is already in the mixer");
+		return false;
+	}
+	Queued.erase(std::remove_if(Queued.begin(), Queued.end(), [=](const Channel &q) { return q.Follows == song || q.Song == next; }), Queued.end());
+
+	if (crossfade_ms > 0 || !c->Active)
+	{
+		int fadeframes = std::max(0, int(int64_t(crossfade_ms) * SampleRate / 1000));
+		if (fadeframes > 0)
+		{
+			n.Gain = 0;
+			n.FadeFrames = fadeframes;
+			c->TargetGain = 0;
+			c->FadeFrames = fadeframes;
+			c->Replaced = true;
+		}
+		else
+		{
+			SetExternalFx(*c, false);
+			Channels.erase(Channels.begin() + (c - Channels.data()));	// it has already ended
+		}
+		Channels.push_back(std::move(n));
+	}
+	else
+	{
+		n.Follows = song;
+		Queued.push_back(std::move(n));
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// MusicMixer :: RemoveStream
+//
+//==========================================================================
+
+bool MusicMixer::RemoveStream(MusInfo *song)
+{
+	std::lock_guard<FCriticalSection> lock(Lock);
+	for (auto it = Queued.begin(); it != Queued.end(); ++it)
+	{
+		if (it->Song == song)
+		{
+			Queued.erase(it);
+			return true;
+		}
+	}
+	for (auto it = Channels.begin(); it != Channels.end(); ++it)
+	{
+		if (it->Song == song)
+		{
+			Detach(*it);
+			Channels.erase(it);
+			Queued.erase(std::remove_if(Queued.begin(), Queued.end(), [=](const Channel &q) { return q.Follows == song; }), Queued.end());
+			return true;
+		}
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// MusicMixer :: HasStream
+//
+// False once the mixer has let go of a stream that was replaced by
+// QueueStream, so the client knows when it may close it.
+//
+//==========================================================================
+
+bool MusicMixer::HasStream(MusInfo *song)
+{
+	std::lock_guard<FCriticalSection> lock(Lock);
+	if (FindChannel(song) != nullptr) return true;
+	for (auto &q : Queued)
+	{
+		if (q.Song == song) return true;
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// MusicMixer :: SetGain
+//
+// Ramps linearly from the current gain to the new one.
+//
+//==========================================================================
+
+bool MusicMixer::SetGain(MusInfo *song, float gain, int fade_ms)
+{
+	std::lock_guard<FCriticalSection> lock(Lock);
+	auto c = FindChannel(song);
+	if (!c) return false;
+	c->TargetGain = gain;
+	c->FadeFrames = std::max(0, int(int64_t(fade_ms) * SampleRate / 1000));
+	if (c->FadeFrames == 0) c->Gain = gain;
+	return true;
+}
+
+//==========================================================================
+//
+// MusicMixer :: SetExternalFx
+//
+// Prerendered streams are serviced ahead of time on their own thread, so
+// their sends would not line up with the mixer's blocks. They keep their
+// own effects.
+//
+//==========================================================================
+
+void MusicMixer::SetExternalFx(Channel &c, bool on)
+{
+	if (on == c.ExternalFx) return;
+	if (on && c.Song->Prerender) return;
+	std::lock_guard<FCriticalSection> slock(c.Song->CritSec);
+	bool res = c.Song->SetExternalEffects(on);
+	c.ExternalFx = on && res;
+}
+
+//==========================================================================
+//
+// MusicMixer :: Detach
+//
+// Gives a stream that leaves the mixer back its own effects and sound.
+//
+//==========================================================================
+
+void MusicMixer::Detach(Channel &c)
+{
+	SetExternalFx(c, false);
+	if (c.Virtual) c.Song->PostCommand({ FSongCommand::Virtual, ESongSetting(), 0 });
+	c.Virtual = false;
+}
+
+//==========================================================================
+//
+// MusicMixer :: ShareEffects
+//
+// Runs the reverb and chorus of all FluidSynth streams through one bus
+// instead of one per stream.
+//
+//==========================================================================
+
+bool MusicMixer::ShareEffects(bool on)
+{
+	std::lock_guard<FCriticalSection> lock(Lock);
+	if (on && EffectsBus == nullptr)
+	{
+		EffectsBus = Fluid_CreateEffectsBus(SampleRate);
+		if (EffectsBus == nullptr)
+		{
+			SetError("Unable to create the shared effects");
+			return false;
+		}
+	}
+	SharedEffects = on;
+	for (auto &c : Channels) SetExternalFx(c, on);
+	return true;
+}
+
+//==========================================================================
+//
+// MusicMixer :: RenderInto
+//
+// Renders float stereo, starting with what is left of the preroll.
+// Returns false once the stream has nothing left to play.
+//
+//==========================================================================
+
+bool MusicMixer::RenderInto(Channel &c, float *out, int frames)
+{
+	int preroll = std::min(frames, int((c.Preroll.size() - c.PrerollPos) / 2));
+	int rest = frames - preroll;
+	bool more = true;
+	if (rest > 0)
+	{
+		float *dest = out + preroll * 2;
+		int framesize = ZMusic_SampleTypeSize(c.Format.mSampleType) * ZMusic_ChannelCount(c.Format.mChannelConfig);
+		more = ZMusic_FillStream(c.Song, dest, rest * framesize);
+		ConvertToStereo(dest, rest, c.Format);
+	}
+	if (preroll > 0)
+	{
+		memcpy(out, &c.Preroll[c.PrerollPos], preroll * 2 * sizeof(float));
+		c.PrerollPos += preroll * 2;
+	}
+	return more;
+}
+
+//==========================================================================
+//
+// MusicMixer :: RenderChannel
+//
+// Renders one stream into its scratch slice.
+//
+//==========================================================================
+
+void MusicMixer::RenderChannel(size_t index)
+{
+	auto &c = Channels[index];
+	if (!c.Active) return;
+
+	float *out = &Scratch[index * StreamFrames * 2];
+	int frames = BlockFrames;
+	int wait = 0;	// frames before the stream's start frame
+	if (c.StartFrame > BlockStart)
+	{
+		wait = int(std::min<uint64_t>(c.StartFrame - BlockStart, frames));
+		memset(out, 0, wait * 2 * sizeof(float));
+		if (c.ExternalFx) memset(&SendScratch[index * StreamFrames * 2], 0, frames * 2 * sizeof(float));
+		if (wait == frames) return;
+		out += wait * 2;
+		frames -= wait;
+	}
+
+	// A stream nobody can hear only keeps time. The command gets carried out by the render right below.
+	bool silent = c.Gain == 0 && c.TargetGain == 0 && c.FadeFrames == 0;
+	if (silent != c.Virtual && c.Song->Commands.Push({ FSongCommand::Virtual, ESongSetting(), silent ? 1 : 0 }))
+	{
+		c.Virtual = silent;
+	}
+
+	if (!RenderInto(c, out, frames))
+	{
+		c.Active = false;
+	}
+	if (c.ExternalFx && c.Song->Prerender)
+	{
+		SetExternalFx(c, false);	// prerendering was enabled after the stream was added
+	}
+	if (c.ExternalFx)
+	{
+		// The sends are planar, each plane is as long as the whole block.
+		float *sends = &SendScratch[index * StreamFrames * 2];
+		const float *src = nullptr;
+		{
+			// Like ZMusic_FillStream, a busy song does not hold up the mix.
+			std::unique_lock<FCriticalSection> slock(c.Song->CritSec, std::defer_lock);
+			if (c.Song->LockForOutput(slock)) src = c.Song->GetEffectSends();
+			if (src)
+			{
+				memcpy(sends + wait, src, frames * sizeof(float));
+				memcpy(sends + BlockFrames + wait, src + frames, frames * sizeof(float));
+			}
+		}
+		if (!src)
+		{
+			memset(sends + wait, 0, frames * sizeof(float));
+			memset(sends + BlockFrames + wait, 0, frames * sizeof(float));
+		}
+	}
+}
+
+//==========================================================================
+//
+// MusicMixer :: StartQueued
+//
+// The stream in Channels[index] ended in this block. The one queued after
+// it starts right behind its last audible sample, using the ended
+// stream's scratch slice, which has already been mixed.
+//
+//==========================================================================
+
+void MusicMixer::StartQueued(size_t index, float *buff, int frames)
+{
+	MusInfo *song = Channels[index].Song;
+	float *scratch = &Scratch[index * StreamFrames * 2];
+	const float level = miscConfig.snd_silencelevel;
+	int end = frames;
+	while (end > 0 && fabsf(scratch[end * 2 - 1]) <= level && fabsf(scratch[end * 2 - 2]) <= level) end--;
+
+	for (auto it = Queued.begin(); it != Queued.end(); ++it)
+	{
+		if (it->Follows != song) continue;
+
+		Channel n = std::move(*it);
+		Queued.erase(it);
+		n.Follows = nullptr;
+		Channels[index].Replaced = true;
+		n.Active = RenderInto(n, scratch, frames - end);
+		for (int i = 0; i < (frames - end) * 2; i++)
+		{
+			buff[end * 2 + i] += scratch[i] * n.Gain;
+		}
+		Channels.push_back(std::move(n));	// QueueStream reserved the room for it
+		return;
+	}
+}
+
+//==========================================================================
+//
+// MusicMixer :: Fill
+//
+// Returns false once none of the streams has anything left to play.
+//
+//==========================================================================
+
+bool MusicMixer::Fill(float *buff, int len)
+{
+	int frames = len / (2 * sizeof(float));
+	memset(buff, 0, len);
+
+	std::lock_guard<FCriticalSection> lock(Lock);
+
+	BlockFrames = frames;
+	BlockStart = Clock.load(std::memory_order_relaxed);
+	Clock.store(BlockStart + frames, std::memory_order_relaxed);
+	if (frames > StreamFrames || Scratch.size() < Channels.size() * StreamFrames * 2)
+	{
+		StreamFrames = std::max(frames, StreamFrames);
+		Scratch.resize(Channels.size() * StreamFrames * 2);
+		SendScratch.resize(Channels.size() * StreamFrames * 2);
+	}
+	if (EffectsBus) BusInput.assign(frames * 2, 0.f);
+
+	size_t numactive = 0;
+	for (auto &c : Channels)
+	{
+		c.Rendered = c.Active;
+		if (c.Active) numactive++;
+	}
+	if (numactive == 0)
+	{
+		if (EffectsBus) Fluid_ProcessEffectsBus(EffectsBus, &BusInput[0], &BusInput[frames], buff, frames);
+		return false;
+	}
+
+	// The calling thread takes part in rendering instead of idling.
+	ZMusic_RunParallel(JOB_REALTIME, Channels.size(), numactive, [](void *context, size_t i)
+	{
+		static_cast<MusicMixer *>(context)->RenderChannel(i);
+	}, this);
+
+	// Accumulate with per-stream gain. This is kept as a plain loop over
+	// contiguous floats so that the compiler can vectorize it.
+	for (size_t i = 0; i < Channels.size(); i++)
+	{
+		auto &c = Channels[i];
+		if (!c.Rendered) continue;
+
+		const float *src = &Scratch[i * StreamFrames * 2];
+		const float *sends = c.ExternalFx && EffectsBus ? &SendScratch[i * StreamFrames * 2] : nullptr;
+		int pos = 0;
+
+		if (c.FadeFrames > 0)
+		{
+			int fadelen = std::min(c.FadeFrames, frames);
+			float step = (c.TargetGain - c.Gain) / c.FadeFrames;
+			float g = c.Gain;
+			for (; pos < fadelen; pos++)
+			{
+				buff[pos * 2] += src[pos * 2] * g;
+				buff[pos * 2 + 1] += src[pos * 2 + 1] * g;
+				if (sends)
+				{
+					BusInput[pos] += sends[pos] * g;
+					BusInput[frames + pos] += sends[frames + pos] * g;
+				}
+				g += step;
+			}
+			c.FadeFrames -= fadelen;
+			c.Gain = c.FadeFrames == 0 ? c.TargetGain : g;
+		}
+
+		const float g = c.Gain;
+		if (g != 0)
+		{
+			for (int j = pos * 2; j < frames * 2; j++)
+			{
+				buff[j] += src[j] * g;
+			}
+			if (sends)
+			{
+				for (int j = pos; j < frames; j++)
+				{
+					BusInput[j] += sends[j] * g;
+					BusInput[frames + j] += sends[frames + j] * g;
+				}
+			}
+		}
+	}
+
+	// Queued streams take over from the ones that ended, and crossfaded streams leave once they are silent.
+	size_t count = Channels.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		auto &c = Channels[i];
+		if (c.Rendered && !c.Active && !Queued.empty()) StartQueued(i, buff, frames);
+	}
+	for (size_t i = count; i-- > 0; )
+	{
+		auto &c = Channels[i];
+		if (c.Replaced && (c.FadeFrames == 0 || !c.Active))
+		{
+			Detach(c);
+			Channels.erase(Channels.begin() + i);
+		}
+	}
+	if (EffectsBus) Fluid_ProcessEffectsBus(EffectsBus, &BusInput[0], &BusInput[frames], buff, frames);
+	return true;
+}
+
+//==========================================================================
+//
+// Public interface
+//
+//==========================================================================
+
+DLL_EXPORT MusicMixer *ZMusic_CreateMixer(int samplerate)
+{
+	if (samplerate <= 0)
+	{
+		SetError("Invalid sample rate");
+		return nullptr;
+	}
+	return new MusicMixer(samplerate);
+}
+
+DLL_EXPORT void ZMusic_DestroyMixer(MusicMixer *mixer)
+{
+	delete mixer;
+}
+
+DLL_EXPORT zmusic_bool ZMusic_MixerAddStream(MusicMixer *mixer, MusInfo *song, float gain)
+{
+	if (!mixer || !song) return false;
+	return mixer->AddStream(song, gain);
+}
+
+DLL_EXPORT uint64_t ZMusic_MixerGetClock(MusicMixer *mixer)
+{
+	if (!mixer) return 0;
+	return mixer->GetClock();
+}
+
+DLL_EXPORT zmusic_bool ZMusic_MixerAddStreamAt(MusicMixer *mixer, MusInfo *song, float gain, uint64_t startframe)
+{
+	if (!mixer || !song) return false;
+	return mixer->AddStream(song, gain, startframe);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_MixerRemoveStream(MusicMixer *mixer, MusInfo *song)
+{
+	if (!mixer || !song) return false;
+	return mixer->RemoveStream(song);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_MixerQueueStream(MusicMixer *mixer, MusInfo *song, MusInfo *next, float gain, int crossfade_ms)
+{
+	if (!mixer || !song || !next || song == next || crossfade_ms < 0)
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+	return mixer->QueueStream(song, next, gain, crossfade_ms);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_MixerHasStream(MusicMixer *mixer, MusInfo *song)
+{
+	if (!mixer || !song) return false;
+	return mixer->HasStream(song);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_MixerSetGain(MusicMixer *mixer, MusInfo *song, float gain, int fade_ms)
+{
+	if (!mixer || !song) return false;
+	return mixer->SetGain(song, gain, fade_ms);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_MixerShareEffects(MusicMixer *mixer, zmusic_bool on)
+{
+	if (!mixer) return false;
+	return mixer->ShareEffects(on);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_MixerFill(MusicMixer *mixer, void *buff, int len)
+{
+	if (!mixer) return false;
+	ZMUSIC_RT_SCOPE();
+	FDenormalScope denormals;	// for the shared effects, the streams set their own.
+	return mixer->Fill((float *)buff, len);
+}
@@ -45,6 +45,7 @@
 #define MIDI_SYSEXEND	((uint8_t)0xF7)		 // SysEx end
 #define MIDI_META		((uint8_t)0xFF)		 // Meta event begin
 #define MIDI_META_TEMPO ((uint8_t)0x51)
+#define MIDI_META_TIMESIG ((uint8_t)0x58)
 #define MIDI_META_EOT	((uint8_t)0x2F)		 // End-of-track
 #define MIDI_META_SSPEC	((uint8_t)0x7F)		 // System-specific event
 
@@ -2,17 +2,31 @@
 
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include "mididefs.h"
 #include "zmusic/zmusic_internal.h"
 #include "critsec.h"
+#include "sampleconv.h"
+#include "perfcounters.h"
+#include "profile.h"
+#include "allocator.h"
+#include "renderquantum.h"
+#include "fpmode.h"
+#include "songcommands.h"
+#include "songposition.h"
+
+class StreamPrerenderer;
+class MIDISource;
 
 // The base music class. Everything is derived from this --------------------
 
-class MusInfo
+class MusInfo : public FMusicAllocated
 {
 public:
 	MusInfo() = default;
-	virtual ~MusInfo() {}
+	virtual ~MusInfo() { ZMusic_ReleaseArena(Arena); }
 	virtual void MusicVolumeChanged() {}		// snd_musicvolume changed
 	virtual void Play (bool looping, int subsong) = 0;
 	virtual void Pause () = 0;
@@ -22,23 +36,204 @@ public:
 	virtual bool IsMIDI() const { return false; }
 	virtual bool IsValid () const = 0;
 	virtual bool SetPosition(unsigned int ms) { return false;  }
+	virtual MusInfo *Clone() { return nullptr; }	// a new song playing on from where this one is. Takes CritSec itself, only while it looks at the song. Returns nullptr if unsupported, or throws why not.
 	virtual bool SetSubsong (int subsong) { return false; }
+	virtual int GetSubsongCount() { return 1; }	// of the songs SetSubsong selects, 1 where it picks positions instead.
+	virtual bool PrepareSubsong(int subsong, int crossfade_ms) { return false; }	// lets a later SetSubsong switch without a gap.
 	virtual void Update() {}
 	virtual int GetDeviceType() const { return MDEV_DEFAULT; }	// MDEV_DEFAULT stands in for anything that cannot change playback parameters which needs a restart.
 	virtual std::string GetStats() { return "No stats available for this song"; }
 	virtual MusInfo* GetWaveDumper(const char* filename, int rate) { return nullptr;  }
-	virtual void ChangeSettingInt(const char* setting, int value) {}			// FluidSynth settings
-	virtual void ChangeSettingNum(const char* setting, double value) {}		// "
-	virtual void ChangeSettingString(const char* setting, const char* value) {}	// "
+	virtual void ChangeSettingInt(ESongSetting setting, int value) {}
+	virtual void ChangeSettingNum(ESongSetting setting, double value) {}
 	virtual bool ServiceStream(void *buff, int len) { return false;  }
 	virtual SoundStreamInfoEx GetStreamInfoEx() const = 0;
+	virtual bool SetSampleType(SampleType type) { return false; }	// switches the native output, for songs that can do so without converting.
+	virtual bool SetOfflineMode(bool on, int flags) { return false; }	// for ZMusic_RenderToBuffer. Only streaming songs support it.
+	virtual bool SetEventBuffering(int numbuffers, int buffertime) { return false; }	// MIDI only. buffertime is in microseconds.
+	virtual bool GetTiming(int &length, int &loopstart, int &loopend) { return false; }	// all in milliseconds.
+	virtual MIDISource *StartTiming(int &epoch) { return nullptr; }	// MIDI only, see MIDISource::StartTiming. CritSec must be held.
+	virtual void SetTiming(int epoch, int length, int loopstart, int loopend) {}	// CritSec must be held.
+	virtual std::vector<uint16_t> GetInstruments() { return {}; }	// MIDI only, packed as MIDIDevice::PrecacheInstruments takes them. CritSec must be held.
+	virtual bool SetGain(float gain, int fade_ms) { return false; }	// MIDI only. Lock free, may be called from any thread.
+	virtual void Prepare() {}	// does the expensive parts of Play ahead of time. Called on the async open worker.
+	virtual void Prefetch() { Prepare(); }	// also loads what the song plays into the shared caches. For ZMusic_PrefetchSong.
+	virtual bool SetExternalEffects(bool on) { return false; }	// for the mixer's shared effects. CritSec must be held.
+	virtual const float *GetEffectSends() { return nullptr; }	// reverb and chorus sends of the last ServiceStream call, see SoftSynthMIDIDevice.
+	virtual bool SetStems(int numstems, const uint8_t *channelstems) { return false; }	// MIDI only. CritSec must be held.
+	virtual const float *GetStems(int &numstems, int &frames) { numstems = 0; return nullptr; }	// of the last ServiceStream call, see SoftSynthMIDIDevice.
+	virtual int AddLayer(MIDISource *layersource, bool looping) { return 0; }	// CritSec must be held. Returns the layer, from 1, or throws why not.
+	virtual bool RemoveLayer(int layer) { return false; }	// CritSec must be held.
+	virtual bool IsLayerPlaying(int layer) { return false; }
+	virtual bool ReloadSoundFonts() { return false; }	// exchanges the soundfonts of a playing song after the configuration changed.
+	virtual bool SwapDevice() { return false; }	// recreates the device in the background, the old one keeps playing until the new one takes over.
+	virtual bool SetVirtual(bool on) { return false; }	// keeps time going without synthesizing while nobody can hear the song. CritSec must be held.
+	virtual bool SendMidiEvents(const ZMusicMidiEvent *events, int count, uint32_t offset) { return false; }	// MIDI only. Lock free, may be called from any thread.
+	virtual bool GetChannelActivity(ZMusicChannelActivity *channels) { return false; }	// MIDI only, 16 channels. Lock free, may be called from any thread.
+	virtual bool GetPosition(ZMusicPosition &pos, double &ticksperframe) { return false; }	// the musical part of the position the last block got to, see FSongPosition. CritSec must be held.
+
+	// The format as seen by the client, after OutputConverter has been applied.
+	SoundStreamInfoEx GetOutputInfoEx() const
+	{
+		SoundStreamInfoEx fmt = GetStreamInfoEx();
+		if (OutputConverter.IsActive() && fmt.mBufferSize > 0)
+		{
+			fmt.mBufferSize = fmt.mBufferSize / OutputConverter.SourceFrameSize() * OutputConverter.DestFrameSize();
+			fmt.mSampleType = OutputConverter.GetOutputType();
+		}
+		return fmt;
+	}
+
+	// ServiceStream in the client's format, with denormals flushed. CritSec must be held.
+	// 'produced' gets the number of frames that belong to the song, which is less than
+	// the buffer holds if the song ended in it, see SongFrames.
+	bool ServiceOutput(void *buff, int len, int *produced = nullptr)
+	{
+		ZMUSIC_PROFILE_ZONE("ServiceStream");
+		FConfigScope config(Config);
+		FDenormalScope denormals;
+		uint64_t start = FPerfCounters::Now();
+		LastServiced.store(start, std::memory_order_relaxed);
+		RunCommands();
+		bool res;
+		int songframes;
+		if (!OutputConverter.IsActive())
+		{
+			res = ServiceQuantum(buff, len, songframes);
+		}
+		else
+		{
+			size_t frames = len / OutputConverter.DestFrameSize();
+			void *native = OutputConverter.GetSourceBuffer(frames);
+			res = ServiceQuantum(native, int(frames * OutputConverter.SourceFrameSize()), songframes);
+			OutputConverter.Convert(buff, frames);
+		}
+		uint64_t audio = 0;
+		SoundStreamInfoEx fmt = GetOutputInfoEx();
+		int framesize = ZMusic_SampleTypeSize(fmt.mSampleType) * ZMusic_ChannelCount(fmt.mChannelConfig);
+		if (fmt.mSampleRate > 0 && framesize > 0) audio = uint64_t(len / framesize) * 1000000000 / fmt.mSampleRate;
+		Position.SetFrameSize(framesize);
+		Perf.AddCallback(FPerfCounters::Now() - start, audio);
+		OutputSilence.store(fmt.mSampleType == SampleType_UInt8 ? 0x80 : 0, std::memory_order_relaxed);
+		if (produced != nullptr) *produced = songframes;
+		return res;
+	}
+
+	// For the thread servicing the stream. Waits out the short holds of the other calls, but
+	// gives up while Stop, seeking or a format change has the lock, to output silence instead.
+	bool LockForOutput(std::unique_lock<FCriticalSection> &lock)
+	{
+		while (!lock.try_lock())
+		{
+			if (Rebuilding.load(std::memory_order_acquire) > 0) return false;
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+	// Queues the call for the thread servicing the stream, or makes it right away if there is none. Never waits for the render thread.
+	void PostCommand(const FSongCommand &cmd);
+	// Makes the calls that were posted so far. CritSec must be held.
+	void RunCommands();
+	void RunCommand(const FSongCommand &cmd);
+
+	// ServiceStream through Quantum, in the song's own format.
+	bool ServiceQuantum(void *buff, int len, int &produced)
+	{
+		SoundStreamInfoEx fmt = GetStreamInfoEx();
+		int framesize = ZMusic_SampleTypeSize(fmt.mSampleType) * ZMusic_ChannelCount(fmt.mChannelConfig);
+		uint8_t silence = fmt.mSampleType == SampleType_UInt8 ? 0x80 : 0;
+		// The mixer's effect sends and the stems have to line up with the buffer, so those songs render what they are asked for.
+		int numstems, stemframes;
+		GetStems(numstems, stemframes);
+		if (!Quantum.IsActive() || GetEffectSends() != nullptr || numstems > 0 || framesize <= 0) return RenderBlock(buff, len, framesize, silence, produced);
+		return Quantum.Fill(buff, len, framesize, silence, produced,
+			[=](void *block, int bytes, int &blockproduced) { return RenderBlock(block, bytes, framesize, silence, blockproduced); });
+	}
+
+	// ServiceStream, followed by publishing the position the song got to.
+	bool RenderBlock(void *buff, int len, int framesize, uint8_t silence, int &produced)
+	{
+		bool res = ServiceStream(buff, len);
+		ZMusicPosition pos;
+		double ticksperframe = 0;
+		bool known = GetPosition(pos, ticksperframe);
+		Position.Publish(framesize > 0 ? len / framesize : 0, known ? &pos : nullptr, ticksperframe);
+		produced = framesize > 0 ? len / framesize : 0;
+		if (!res) produced = SongFrames(buff, produced, framesize, silence);
+		return res;
+	}
+
+	// How many frames of the block the song ended in belong to it. The songs fill what
+	// is left after their end with silence, except that a synth may still render the
+	// release of the last notes, so this is up to the last frame that is not silence.
+	static int SongFrames(const void *buff, int frames, int framesize, uint8_t silence)
+	{
+		const uint8_t *bytes = (const uint8_t *)buff;
+		for (; frames > 0; frames--)
+		{
+			const uint8_t *frame = bytes + size_t(frames - 1) * framesize;
+			for (int i = 0; i < framesize; i++)
+			{
+				if (frame[i] != silence) return frames;
+			}
+		}
+		return 0;
+	}
 
 	enum EState
 	{
 		STATE_Stopped,
 		STATE_Playing,
 		STATE_Paused
-	} m_Status = STATE_Stopped;
-	bool m_Looping = false;
+	};
+	// Atomic so that they can be read without CritSec.
+	std::atomic<EState> m_Status{ STATE_Stopped };
+	std::atomic<bool> m_Looping{ false };
 	FCriticalSection CritSec;
+	std::atomic<int> Rebuilding{ 0 };	// holders of CritSec that tear down or rebuild what the renderer uses, see FSongRebuildLock.
+	FSongCommandQueue Commands;
+	std::atomic<uint64_t> LastServiced{ 0 };	// FPerfCounters::Now() of the last ServiceOutput call.
+	std::atomic<uint8_t> OutputSilence{ 0 };	// the byte silence is made of in the client's format.
+	FSampleConverter OutputConverter;
+	FRenderQuantum Quantum;		// set up by ZMusic_Start from zmusic_snd_renderquantum.
+	FPerfCounters Perf;
+	FSongPosition Position;
+	StreamPrerenderer *Prerender = nullptr;	// owned by the public interface which has to shut it down before the song gets destroyed.
+	FMusicArena *Arena = nullptr;	// where the song and what was made for it while opening and starting came from.
+	ZMusicConfigSet *Config = CurrentConfig;	// the context the song was opened in.
+	uint32_t TraceStream = 0;	// its number in the trace, see trace.h.
+	EMIDIType MIDIType = MIDI_NOTMIDI;	// of MIDI songs, as identified when they were opened.
+};
+
+// Takes the song's CritSec and makes the calls that were posted before, so
+// that everything happens in the order the client asked for it, with the
+// configuration of the song's context.
+class FSongLock
+{
+	std::lock_guard<FCriticalSection> Lock;
+	FConfigScope Config;
+
+public:
+	explicit FSongLock(MusInfo *song) : Lock(song->CritSec), Config(song->Config)
+	{
+		song->RunCommands();
+	}
+};
+
+// FSongLock for the calls that make the renderer start over, which the
+// thread servicing the stream does not wait for.
+class FSongRebuildLock
+{
+	struct FCount
+	{
+		MusInfo *Song;
+		explicit FCount(MusInfo *song) : Song(song) { Song->Rebuilding.fetch_add(1, std::memory_order_release); }
+		~FCount() { Song->Rebuilding.fetch_sub(1, std::memory_order_release); }
+	};
+	FCount Count;	// first in and last out, so it is set for as long as the lock is held.
+	FSongLock Lock;
+
+public:
+	explicit FSongRebuildLock(MusInfo *song) : Count(song), Lock(song) {}
 };
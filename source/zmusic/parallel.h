@@ -0,0 +1,50 @@
+#pragma once
+
+// Runs independent jobs on the library's shared worker threads.
+// ZMusic_ParallelFor is for loading work at song start,
+// FWorkerGroup for work that repeats every buffer.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include "jobs.h"
+
+// Calls work(i) once for every i in [0, count). The calling thread takes part
+// and the function returns after all jobs have finished. If no workers are
+// free everything simply runs on the caller.
+template<class Func> void ZMusic_ParallelFor(size_t count, Func work)
+{
+	ZMusic_RunParallel(JOB_BACKGROUND, count, SIZE_MAX, [](void *context, size_t i) { (*(Func *)context)(i); }, &work);
+}
+
+// A share of the worker threads for real-time work, split up among at most
+// the number of threads given to Start.
+class FWorkerGroup
+{
+public:
+	// Returns how many threads Run can use, the caller's included.
+	int Start(int numthreads)
+	{
+		threads = (int)std::min<size_t>(std::max(numthreads, 1), ZMusic_JobThreads());
+		return threads;
+	}
+
+	void Stop()
+	{
+		threads = 1;
+	}
+
+	int Size() const
+	{
+		return threads;
+	}
+
+	// Calls work(i) once for every i in [0, count) and returns when all are done.
+	template<class Func> void Run(size_t count, Func &work)
+	{
+		ZMusic_RunParallel(JOB_REALTIME, count, threads, [](void *context, size_t i) { (*(Func *)context)(i); }, &work);
+	}
+
+private:
+	int threads = 1;
+};
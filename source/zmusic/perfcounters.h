@@ -0,0 +1,100 @@
+#pragma once
+
+// Render statistics for a single song.
+//
+// Only the thread servicing the stream writes to these, so read-modify-write
+// cycles do not need to be atomic. Everything is stored in atomics anyway so
+// that the client can read the counters from any thread without locking.
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include "zmusic_internal.h"
+#include "profile.h"
+
+struct FPerfCounters
+{
+	std::atomic<uint64_t> Callbacks{ 0 };
+	std::atomic<uint64_t> RenderNanos{ 0 };
+	std::atomic<uint64_t> MinNanos{ UINT64_MAX };
+	std::atomic<uint64_t> MaxNanos{ 0 };
+	std::atomic<uint64_t> AudioNanos{ 0 };
+	std::atomic<uint64_t> Events{ 0 };
+	std::atomic<uint64_t> Fragments{ 0 };
+	std::atomic<int> ActiveVoices{ -1 };
+	std::atomic<int> QualityLevel{ 0 };
+	std::atomic<uint64_t> Blocked{ 0 };
+	std::atomic<uint64_t> Starved{ 0 };
+
+	static uint64_t Now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void AddCallback(uint64_t nanos, uint64_t audionanos)
+	{
+		Callbacks.store(Callbacks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		RenderNanos.store(RenderNanos.load(std::memory_order_relaxed) + nanos, std::memory_order_relaxed);
+		AudioNanos.store(AudioNanos.load(std::memory_order_relaxed) + audionanos, std::memory_order_relaxed);
+		if (nanos < MinNanos.load(std::memory_order_relaxed)) MinNanos.store(nanos, std::memory_order_relaxed);
+		if (nanos > MaxNanos.load(std::memory_order_relaxed)) MaxNanos.store(nanos, std::memory_order_relaxed);
+		ZMUSIC_PROFILE_COUNTER("ZMusic render ms", nanos / 1e6);
+	}
+
+	// For callbacks that found the song busy and were served silence.
+	void AddBlocked()
+	{
+		Blocked.store(Blocked.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// For callbacks whose source had not decoded enough in time.
+	void AddStarved(uint32_t count)
+	{
+		Starved.store(Starved.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+	}
+
+	void AddDeviceStats(uint32_t events, uint32_t fragments, int voices, int quality)
+	{
+		Events.store(Events.load(std::memory_order_relaxed) + events, std::memory_order_relaxed);
+		Fragments.store(Fragments.load(std::memory_order_relaxed) + fragments, std::memory_order_relaxed);
+		ActiveVoices.store(voices, std::memory_order_relaxed);
+		QualityLevel.store(quality, std::memory_order_relaxed);
+		ZMUSIC_PROFILE_COUNTER("ZMusic events", events);
+		ZMUSIC_PROFILE_COUNTER("ZMusic active voices", voices);
+		ZMUSIC_PROFILE_COUNTER("ZMusic quality level", quality);
+	}
+
+	void Get(ZMusicPerfCounters *out) const
+	{
+		uint64_t callbacks = Callbacks.load(std::memory_order_relaxed);
+		uint64_t render = RenderNanos.load(std::memory_order_relaxed);
+		uint64_t mintime = MinNanos.load(std::memory_order_relaxed);
+
+		out->mCallbacks = callbacks;
+		out->mEventsProcessed = Events.load(std::memory_order_relaxed);
+		out->mTotalTime = render / 1e9;
+		out->mMinTime = callbacks && mintime != UINT64_MAX ? mintime / 1e6 : 0;
+		out->mAvgTime = callbacks ? render / 1e6 / callbacks : 0;
+		out->mMaxTime = MaxNanos.load(std::memory_order_relaxed) / 1e6;
+		out->mFragmentsPerBuffer = callbacks ? double(Fragments.load(std::memory_order_relaxed)) / callbacks : 0;
+		out->mRealtimeFactor = render ? double(AudioNanos.load(std::memory_order_relaxed)) / render : 0;
+		out->mActiveVoices = ActiveVoices.load(std::memory_order_relaxed);
+		out->mQualityLevel = QualityLevel.load(std::memory_order_relaxed);
+		out->mBlockedCallbacks = Blocked.load(std::memory_order_relaxed);
+		out->mStarvedCallbacks = Starved.load(std::memory_order_relaxed);
+	}
+
+	// Not synchronized with the servicing thread, a callback in flight may survive the reset.
+	void Reset()
+	{
+		Callbacks.store(0, std::memory_order_relaxed);
+		RenderNanos.store(0, std::memory_order_relaxed);
+		MinNanos.store(UINT64_MAX, std::memory_order_relaxed);
+		MaxNanos.store(0, std::memory_order_relaxed);
+		AudioNanos.store(0, std::memory_order_relaxed);
+		Events.store(0, std::memory_order_relaxed);
+		Fragments.store(0, std::memory_order_relaxed);
+		Blocked.store(0, std::memory_order_relaxed);
+		Starved.store(0, std::memory_order_relaxed);
+	}
+};
@@ -0,0 +1,309 @@
+/*
+** prerender.cpp
+** Renders streams ahead of the audio callback on a worker thread.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <algorithm>
+#include <system_error>
+#include "zmusic_internal.h"
+#include "midiconfig.h"
+#include "musinfo.h"
+#include "prerender.h"
+#include "jobs.h"
+
+//==========================================================================
+//
+// FPrerenderPool
+//
+// The worker threads for all prerendered streams. Threads get added as
+// streams get added, up to zmusic_snd_prerenderthreads, and then sleep
+// while there are no streams until the library gets unloaded.
+//
+//==========================================================================
+
+class FPrerenderPool
+{
+public:
+	~FPrerenderPool();
+	bool Add(StreamPrerenderer *stream);
+	void Remove(StreamPrerenderer *stream);
+
+private:
+	void Run();
+
+	std::mutex Lock;
+	std::condition_variable Wake, Released;
+	std::vector<StreamPrerenderer *> Streams;
+	std::vector<std::thread> Threads;
+	bool Quit = false;
+};
+
+static FPrerenderPool PrerenderPool;
+
+FPrerenderPool::~FPrerenderPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		Quit = true;
+	}
+	Wake.notify_all();
+	for (auto &t : Threads) t.join();
+}
+
+//==========================================================================
+//
+// FPrerenderPool :: Add
+//
+// Fails if there is no thread to render the stream on.
+//
+//==========================================================================
+
+bool FPrerenderPool::Add(StreamPrerenderer *stream)
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	Streams.push_back(stream);
+
+	// More threads than streams would only ever sleep.
+	size_t limit = GlobalConfig.misc.snd_prerenderthreads > 0 ? (size_t)GlobalConfig.misc.snd_prerenderthreads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	if (Threads.size() < std::min(limit, Streams.size()))
+	{
+		try
+		{
+			Threads.emplace_back(&FPrerenderPool::Run, this);
+		}
+		catch (const std::system_error &)
+		{
+			// The ones there are will have to do.
+			if (Threads.empty())
+			{
+				Streams.pop_back();
+				return false;
+			}
+		}
+	}
+	Wake.notify_one();
+	return true;
+}
+
+//==========================================================================
+//
+// FPrerenderPool :: Remove
+//
+// Returns once no worker is rendering the stream anymore.
+//
+//==========================================================================
+
+void FPrerenderPool::Remove(StreamPrerenderer *stream)
+{
+	std::unique_lock<std::mutex> lock(Lock);
+	Streams.erase(std::remove(Streams.begin(), Streams.end(), stream), Streams.end());
+	Released.wait(lock, [stream]() { return !stream->Busy; });
+}
+
+//==========================================================================
+//
+// FPrerenderPool :: Run
+//
+// The worker loop. A chunk is the unit of work, so a stream never waits
+// for another one for longer than it takes to render a chunk of that.
+//
+//==========================================================================
+
+void FPrerenderPool::Run()
+{
+	FThreadScope scope(THREAD_PRERENDER, "ZMusic prerender");
+	std::unique_lock<std::mutex> lock(Lock);
+	while (!Quit)
+	{
+		StreamPrerenderer *job = nullptr;
+		size_t leastfilled = SIZE_MAX;
+		auto polltime = std::chrono::microseconds(100000);
+		for (auto stream : Streams)
+		{
+			polltime = std::min(polltime, stream->PollTime);
+			if (stream->Busy || !stream->NeedsWork()) continue;
+			size_t filled = stream->Ring.ReadAvailable() * 1000 / stream->Ring.Capacity();
+			if (filled < leastfilled)
+			{
+				leastfilled = filled;
+				job = stream;
+			}
+		}
+		if (job == nullptr)
+		{
+			if (Streams.empty()) Wake.wait(lock);
+			else Wake.wait_for(lock, polltime);
+			continue;
+		}
+
+		job->Busy = true;
+		lock.unlock();
+		job->RenderChunk();
+		lock.lock();
+		job->Busy = false;
+		Released.notify_all();
+	}
+}
+
+//==========================================================================
+//
+// StreamPrerenderer Constructor
+//
+// The ring is sized from the stream's current format, so this must be
+// created after the song has been started.
+//
+//==========================================================================
+
+StreamPrerenderer::StreamPrerenderer(MusInfo *song, int depth_ms)
+{
+	Song = song;
+
+	SoundStreamInfoEx fmt = song->GetOutputInfoEx();
+	if (fmt.mBufferSize <= 0 || fmt.mSampleRate <= 0) return;
+
+	size_t framesize = ZMusic_SampleTypeSize(fmt.mSampleType) * ZMusic_ChannelCount(fmt.mChannelConfig);
+	if (framesize == 0) return;
+
+	depth_ms = std::max(10, std::min(depth_ms, 10000));
+	size_t frames = (size_t)fmt.mSampleRate * depth_ms / 1000;
+
+	// Render in quarters of the ring so the worker always has room to refill
+	// before the consumer catches up.
+	size_t chunkframes = std::max<size_t>(frames / 4, 1);
+	chunkframes = std::min(chunkframes, std::max<size_t>(fmt.mBufferSize / framesize, 1));
+	ChunkSize = chunkframes * framesize;
+	PollTime = std::chrono::microseconds(std::max<int64_t>(int64_t(chunkframes * 500000 / fmt.mSampleRate), 1000));
+
+	Ring.Resize(std::max(frames * framesize, ChunkSize * 2));
+	Scratch.resize(ChunkSize);
+	if (!PrerenderPool.Add(this)) Ring.Resize(0);
+}
+
+//==========================================================================
+//
+// StreamPrerenderer Destructor
+//
+//==========================================================================
+
+StreamPrerenderer::~StreamPrerenderer()
+{
+	if (IsValid())
+	{
+		PrerenderPool.Remove(this);
+	}
+}
+
+//==========================================================================
+//
+// StreamPrerenderer :: NeedsWork
+//
+// Called by the workers with the pool's lock held.
+//
+//==========================================================================
+
+bool StreamPrerenderer::NeedsWork() const
+{
+	return !Ended.load(std::memory_order_acquire) && Ring.WriteAvailable() >= ChunkSize && Song->m_Status != MusInfo::STATE_Stopped;
+}
+
+//==========================================================================
+//
+// StreamPrerenderer :: RenderChunk
+//
+// The song's lock is only held for the duration of a single chunk so that
+// control calls from the main thread never have to wait longer than that.
+//
+//==========================================================================
+
+void StreamPrerenderer::RenderChunk()
+{
+	std::lock_guard<FCriticalSection> lock(Song->CritSec);
+	// Re-check under the lock, the song may have been stopped in the meantime.
+	if (Song->m_Status != MusInfo::STATE_Stopped)
+	{
+		bool res = Song->ServiceOutput(Scratch.data(), (int)ChunkSize);
+		Ring.Write(Scratch.data(), ChunkSize);
+		if (!res)
+		{
+			EndPos.store(Ring.GetWritePos(), std::memory_order_relaxed);
+			Ended.store(true, std::memory_order_release);
+		}
+	}
+}
+
+//==========================================================================
+//
+// StreamPrerenderer :: Flush
+//
+// The consumer owns the read position, so it is only told where the new
+// data starts and skips ahead the next time it gets called.
+//
+//==========================================================================
+
+void StreamPrerenderer::Flush()
+{
+	FlushPos.store(Ring.GetWritePos(), std::memory_order_relaxed);
+	FlushPending.store(true, std::memory_order_release);
+	Ended.store(false, std::memory_order_release);
+}
+
+//==========================================================================
+//
+// StreamPrerenderer :: Fill
+//
+// Never blocks and never takes a lock. If the worker has fallen behind,
+// the rest of the buffer is filled with silence and an underrun is counted.
+//
+//==========================================================================
+
+bool StreamPrerenderer::Fill(void *buff, int len)
+{
+	if (FlushPending.exchange(false, std::memory_order_acquire))
+	{
+		Ring.SkipTo(FlushPos.load(std::memory_order_relaxed));
+	}
+
+	size_t got = Ring.Read(buff, len);
+	if (got == (size_t)len) return true;
+
+	memset((uint8_t *)buff + got, 0, len - got);
+	if (Ended.load(std::memory_order_acquire) && Ring.GetReadPos() == EndPos.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+	if (Song->m_Status == MusInfo::STATE_Stopped)
+	{
+		return false;
+	}
+	Underruns.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "ringbuffer.h"
+
+class MusInfo;
+
+//==========================================================================
+//
+// Renders a stream ahead of time on a worker thread so that the client's
+// audio callback only has to copy finished data from a ring buffer.
+//
+// The workers are shared by all prerendered streams. Whichever has the
+// least buffered gets the next chunk rendered, so several streams can be
+// rendered on different cores at once.
+//
+//==========================================================================
+
+class StreamPrerenderer
+{
+	friend class FPrerenderPool;
+
+public:
+	StreamPrerenderer(MusInfo *song, int depth_ms);
+	~StreamPrerenderer();
+
+	bool IsValid() const { return Ring.Capacity() > 0; }
+
+	// Consumer side, called from ZMusic_FillStream.
+	bool Fill(void *buff, int len);
+
+	// Throws away everything rendered so far. The song's CritSec must be held.
+	void Flush();
+
+	uint32_t GetUnderruns() const { return Underruns.load(std::memory_order_relaxed); }
+
+private:
+	bool NeedsWork() const;
+	void RenderChunk();
+
+	MusInfo *Song;
+	FRingBuffer Ring;
+	std::vector<uint8_t> Scratch;
+	size_t ChunkSize = 0;
+	std::chrono::microseconds PollTime;
+	bool Busy = false;	// a worker is rendering this one. Guarded by the pool's lock.
+
+	std::atomic<bool> FlushPending{ false };
+	std::atomic<size_t> FlushPos{ 0 };
+	std::atomic<bool> Ended{ false };
+	std::atomic<size_t> EndPos{ 0 };
+	std::atomic<uint32_t> Underruns{ 0 };
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+// Zones and counters for the client's profiler, see ZMusicCallbacks.
+//
+// With no profiler installed a zone costs one load and one branch. Builds
+// with ZMUSIC_NO_PROFILING compile them out entirely.
+
+#include "zmusic_internal.h"
+
+extern ZMusicCallbacks musicCallbacks;
+
+#ifndef ZMUSIC_NO_PROFILING
+
+struct FProfileZone
+{
+	// The end gets looked up at the beginning, so that a profiler installed or removed in between can't unbalance the pair.
+	void (*End)();
+
+	explicit FProfileZone(const char *zone) : End(musicCallbacks.ProfileEnd)
+	{
+		if (End != nullptr) musicCallbacks.ProfileBegin(zone);	// ZMusic_SetCallbacks only ever sets both or none.
+	}
+	~FProfileZone()
+	{
+		if (End != nullptr) End();
+	}
+	FProfileZone(const FProfileZone &) = delete;
+	FProfileZone &operator=(const FProfileZone &) = delete;
+};
+
+#define ZMUSIC_PROFILE_CONCAT2(a, b) a##b
+#define ZMUSIC_PROFILE_CONCAT(a, b) ZMUSIC_PROFILE_CONCAT2(a, b)
+#define ZMUSIC_PROFILE_ZONE(name) FProfileZone ZMUSIC_PROFILE_CONCAT(profilezone_, __LINE__)(name)
+#define ZMUSIC_PROFILE_COUNTER(name, value) do { if (musicCallbacks.ProfileCounter != nullptr) musicCallbacks.ProfileCounter(name, double(value)); } while (0)
+
+#else
+
+#define ZMUSIC_PROFILE_ZONE(name) ((void)0)
+#define ZMUSIC_PROFILE_COUNTER(name, value) ((void)0)
+
+#endif
@@ -0,0 +1,460 @@
+/*
+** rendercache.cpp
+** Keeps FLAC renders of synthesized songs on disk.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** A render is named after the song's data and everything that changes how
+** the song sounds: the synth, its settings and the files those name, with
+** their size and modification time. Anything else a synth might read is
+** not seen, so a directory of renders should be cleared after replacing
+** instrument files in place with ones of the same size and time.
+**
+** Each render comes with a small text file holding its loop, written
+** before the render is renamed into place, so a render that exists is
+** always complete.
+**
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "zmusic_internal.h"
+#include "musinfo.h"
+#include "midiconfig.h"
+#include "jobs.h"
+#include "songcache.h"
+#include "rendercache.h"
+#include "wavefile.h"
+#include "streamsources/streamsource.h"
+#include "decoder/sndfile_decoder.h"
+#ifdef HAVE_TIMIDITY
+#include "timiditypp/timidity.h"
+#endif
+
+MusInfo *OpenStreamSong(StreamSource *source);
+EMidiDevice MIDI_SelectDevice(EMidiDevice device);
+
+enum
+{
+	RENDER_CACHE_VERSION = 1,	// bump when renders of the same settings would come out differently.
+	RENDER_MAX_SECONDS = 30 * 60,	// songs that do not end by then are not kept.
+};
+
+static std::mutex PendingLock;
+static std::set<std::string> Pending;	// renders queued or running, by file name.
+
+//==========================================================================
+//
+// FSettingsHash
+//
+// 64 bit FNV-1a over everything that goes into the render.
+//
+//==========================================================================
+
+struct FSettingsHash
+{
+	uint64_t Hash = 14695981039346656037ull;
+
+	void Add(const void *data, size_t length)
+	{
+		auto p = (const uint8_t *)data;
+		for (size_t i = 0; i < length; i++)
+		{
+			Hash ^= p[i];
+			Hash *= 1099511628211ull;
+		}
+	}
+	void Add(int value) { Add(&value, sizeof(value)); }
+	void Add(float value) { Add(&value, sizeof(value)); }
+	void Add(const std::string &str) { Add(str.c_str(), str.size() + 1); }
+
+	// The name, plus the size and time of the file if there is one by that name.
+	void AddFile(const std::string &name)
+	{
+		Add(name);
+		struct stat st;
+		int64_t info[2] = {};
+		if (!name.empty() && stat(name.c_str(), &st) == 0)
+		{
+			info[0] = (int64_t)st.st_size;
+			info[1] = (int64_t)st.st_mtime;
+		}
+		Add(info, sizeof(info));
+	}
+};
+
+//==========================================================================
+//
+// HashSettings
+//
+// Returns false for songs that cannot be kept, which are those played on
+// a hardware MIDI device. 'device' gets the device a MIDI song will use.
+//
+//==========================================================================
+
+static bool HashSettings(FSettingsHash &hash, ERenderCacheKind kind, EMidiDevice &device, const char *args)
+{
+	hash.Add((int)RENDER_CACHE_VERSION);
+	hash.Add((int)kind);
+	hash.Add(miscConfig.snd_outputrate);
+	hash.Add(miscConfig.snd_mono);
+
+	if (kind == RENDER_MODULE)
+	{
+		hash.Add(dumbConfig.mod_samplerate);
+		hash.Add(dumbConfig.mod_volramp);
+		hash.Add(dumbConfig.mod_interp);
+		hash.Add(dumbConfig.mod_autochip);
+		hash.Add(dumbConfig.mod_autochip_size_force);
+		hash.Add(dumbConfig.mod_autochip_size_scan);
+		hash.Add(dumbConfig.mod_autochip_scan_threshold);
+		hash.Add(dumbConfig.mod_preferred_player);
+		hash.Add(dumbConfig.mod_dumb_mastervolume);
+		return true;
+	}
+	if (kind == RENDER_GME)
+	{
+		hash.Add(miscConfig.gme_stereodepth);
+		hash.Add(miscConfig.gme_ym2612_core);
+		hash.Add(miscConfig.gme_fm_native_rate);
+		return true;
+	}
+
+	device = MIDI_SelectDevice(device);
+#ifndef HAVE_SYSTEM_MIDI
+	if (device == MDEV_STANDARD) device = MDEV_SNDSYS;
+#endif
+	if (device == MDEV_SNDSYS) device = MDEV_FLUIDSYNTH;
+	if (device == MDEV_STANDARD) return false;
+
+	std::string arg = args ? args : "";
+	hash.Add((int)device);
+	hash.AddFile(arg);
+	hash.Add(miscConfig.snd_mididensity);
+	hash.Add(miscConfig.snd_midirenderrate);
+
+	switch (device)
+	{
+	case MDEV_FLUIDSYNTH:
+		hash.AddFile(fluidConfig.fluid_patchset);
+		hash.Add(fluidConfig.fluid_reverb);
+		hash.Add(fluidConfig.fluid_chorus);
+		hash.Add(fluidConfig.fluid_voices);
+		hash.Add(fluidConfig.fluid_interp);
+		hash.Add(fluidConfig.fluid_samplerate);
+		hash.Add(fluidConfig.fluid_chorus_voices);
+		hash.Add(fluidConfig.fluid_chorus_type);
+		hash.Add(fluidConfig.fluid_gain);
+		hash.Add(fluidConfig.fluid_reverb_roomsize);
+		hash.Add(fluidConfig.fluid_reverb_damping);
+		hash.Add(fluidConfig.fluid_reverb_width);
+		hash.Add(fluidConfig.fluid_reverb_level);
+		hash.Add(fluidConfig.fluid_chorus_level);
+		hash.Add(fluidConfig.fluid_chorus_speed);
+		hash.Add(fluidConfig.fluid_chorus_depth);
+		hash.Add(fluidConfig.fluid_floatsamples);
+		break;
+
+#ifdef HAVE_TIMIDITY
+	case MDEV_TIMIDITY:
+	{
+		hash.AddFile(timidityConfig.timidity_config);
+		auto settings = TimidityPlus::GetDefaultSettings();
+		hash.Add(&settings, sizeof(settings));
+		break;
+	}
+#endif
+
+#ifdef HAVE_GUS
+	case MDEV_GUS:
+		hash.Add(gusConfig.midi_voices);
+		hash.Add(gusConfig.gus_memsize);
+		hash.Add(gusConfig.gus_dmxgus);
+		hash.Add(gusConfig.voice_floor);
+		hash.Add(gusConfig.gus_patchdir);
+		hash.AddFile(gusConfig.gus_config);
+		hash.Add(gusConfig.dmxgus.data(), gusConfig.dmxgus.size());
+		break;
+#endif
+
+#ifdef HAVE_OPL
+	case MDEV_OPL:
+		hash.Add(oplConfig.numchips);
+		hash.Add(oplConfig.core);
+		hash.Add(oplConfig.fullpan);
+		hash.Add(oplConfig.genmidiset);
+		hash.Add(oplConfig.OPLinstruments, sizeof(oplConfig.OPLinstruments));
+		break;
+#endif
+
+#ifdef HAVE_ADL
+	case MDEV_ADL:
+		hash.Add(adlConfig.adl_chips_count);
+		hash.Add(adlConfig.adl_emulator_id);
+		hash.Add(adlConfig.adl_bank);
+		hash.Add(adlConfig.adl_volume_model);
+		hash.Add(adlConfig.adl_run_at_pcm_rate);
+		hash.Add(adlConfig.adl_fullpan);
+		hash.Add(adlConfig.adl_use_custom_bank);
+		hash.AddFile(adlConfig.adl_custom_bank);
+		break;
+#endif
+
+#ifdef HAVE_OPN
+	case MDEV_OPN:
+		hash.Add(opnConfig.opn_chips_count);
+		hash.Add(opnConfig.opn_emulator_id);
+		hash.Add(opnConfig.opn_run_at_pcm_rate);
+		hash.Add(opnConfig.opn_fullpan);
+		hash.Add(opnConfig.opn_use_custom_bank);
+		hash.AddFile(opnConfig.opn_custom_bank);
+		hash.Add(opnConfig.default_bank.data(), opnConfig.default_bank.size());
+		break;
+#endif
+
+#ifdef HAVE_WILDMIDI
+	case MDEV_WILDMIDI:
+		hash.Add((int)wildMidiConfig.reverb);
+		hash.Add((int)wildMidiConfig.enhanced_resampling);
+		hash.Add(wildMidiConfig.voice_floor);
+		hash.AddFile(wildMidiConfig.config);
+		break;
+#endif
+
+	default:
+		break;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// ReadLoop
+//
+//==========================================================================
+
+static bool ReadLoop(const std::string &name, uint32_t &loopstart, uint32_t &loopend)
+{
+	FILE *f = MusicIO::utf8_fopen(name.c_str(), "rt");
+	if (f == nullptr) return false;
+	bool ok = fscanf(f, "LOOP_START=%u\nLOOP_END=%u", &loopstart, &loopend) == 2;
+	fclose(f);
+	return ok && loopstart < loopend;
+}
+
+//==========================================================================
+//
+// FRenderJob
+//
+//==========================================================================
+
+struct FRenderJob
+{
+	std::vector<uint8_t> Data;
+	ERenderCacheKind Kind;
+	EMidiDevice Device;	// as requested, passed on to the song.
+	EMidiDevice KeyedDevice;	// the one the name was made for.
+	std::string Args;
+	std::string Name;	// without the extension.
+	ZMusicConfigSet *Config = nullptr;
+
+	~FRenderJob()
+	{
+		ZMusic_DestroyContext(Config);
+		std::lock_guard<std::mutex> lock(PendingLock);
+		Pending.erase(Name);
+	}
+
+	void Run();
+	bool Render(const std::string &flacname, const std::string &loopname);
+};
+
+//==========================================================================
+//
+// FRenderJob :: Render
+//
+// Plays the song once without looping, like the song information does, and
+// writes the output up to where the song ends or its loop does.
+//
+//==========================================================================
+
+bool FRenderJob::Render(const std::string &flacname, const std::string &loopname)
+{
+	std::unique_ptr<MusInfo, void (*)(MusInfo *)> song(ZMusic_OpenSongMem(Data.data(), Data.size(), Device, Args.empty() ? nullptr : Args.c_str()), ZMusic_Close);
+	if (song == nullptr || !ZMusic_Start(song.get(), 0, false)) return false;
+
+	// A MIDI song that fell back to another synth would be kept under the wrong settings.
+	if (Kind == RENDER_MIDI && song->GetDeviceType() != KeyedDevice) return false;
+
+	int loopstart_ms, loopend_ms;
+	bool looped = ZMusic_GetLoopPoints(song.get(), &loopstart_ms, &loopend_ms) && loopstart_ms >= 0 && loopstart_ms < loopend_ms;
+	int length_ms = ZMusic_GetSongLengthMs(song.get());
+
+	if (!ZMusic_SetStreamFormat(song.get(), SampleType_Float32, false) || !song->SetOfflineMode(true, ZMUSIC_RENDER_STOPATLOOP))
+	{
+		return false;
+	}
+	SoundStreamInfoEx fmt = song->GetOutputInfoEx();
+	const int channels = ZMusic_ChannelCount(fmt.mChannelConfig);
+	const size_t rate = fmt.mSampleRate;
+	const size_t blockframes = std::max<size_t>(rate / 10, 1);
+	const size_t limit = RENDER_MAX_SECONDS * rate;
+
+	// Where the song reports its end, the last block is cut there instead of at the block's end.
+	size_t end = limit;
+	if (looped) end = std::min(end, size_t(loopend_ms) * rate / 1000);
+	else if (length_ms > 0) end = std::min(end, size_t(length_ms) * rate / 1000);
+
+	FWaveFile file;
+	file.Open(flacname.c_str(), FWaveFile::FORMAT_FLAC, int(rate), channels);
+
+	// The file writes one block while the next one gets rendered.
+	TMusicVector<float> blocks[2] = { TMusicVector<float>(blockframes * channels), TMusicVector<float>(blockframes * channels) };
+	size_t done = 0;
+	bool more = true;
+	for (int i = 0; more && done < end; i ^= 1)
+	{
+		more = song->ServiceOutput(blocks[i].data(), int(blockframes * channels * sizeof(float)));
+		size_t count = std::min(blockframes, end - done);
+		file.Write(blocks[i].data(), count * channels);
+		done += count;
+	}
+	song->SetOfflineMode(false, ZMUSIC_RENDER_STOPATLOOP);
+	file.Finish();
+	if (!file.Close() || (more && done >= limit) || done == 0) return false;
+
+	uint32_t loopstart = looped ? uint32_t(size_t(loopstart_ms) * rate / 1000) : 0;
+	if (loopstart >= done) loopstart = 0;
+	FILE *f = MusicIO::utf8_fopen(loopname.c_str(), "wt");
+	if (f == nullptr) return false;
+	bool ok = fprintf(f, "LOOP_START=%u\nLOOP_END=%u\n", loopstart, uint32_t(done)) > 0;
+	return fclose(f) == 0 && ok;
+}
+
+//==========================================================================
+//
+// FRenderJob :: Run
+//
+// Renders into temporary files that only get their names once both are
+// complete, the render last.
+//
+//==========================================================================
+
+void FRenderJob::Run()
+{
+	FConfigScope config(Config);
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%p.tmp", (void *)this);
+	std::string flactemp = Name + ".flac" + suffix, looptemp = Name + ".loop" + suffix;
+
+	bool ok = false;
+	try
+	{
+		ok = Render(flactemp, looptemp);
+	}
+	catch (const std::exception &)
+	{
+	}
+	ok = ok && rename(looptemp.c_str(), (Name + ".loop").c_str()) == 0;
+	ok = ok && rename(flactemp.c_str(), (Name + ".flac").c_str()) == 0;
+	if (!ok)
+	{
+		remove(flactemp.c_str());
+		remove(looptemp.c_str());
+	}
+}
+
+//==========================================================================
+//
+// RenderCache_Open
+//
+//==========================================================================
+
+MusInfo *RenderCache_Open(MusInfo *song, ERenderCacheKind kind, const uint8_t *data, size_t length, EMidiDevice device, const char *args)
+{
+	const std::string &dir = miscConfig.snd_rendercache;
+	if (dir.empty() || !IsSndFilePresent() || song->GetSubsongCount() > 1) return song;
+
+	FSettingsHash hash;
+	EMidiDevice keyed = device;
+	if (!HashSettings(hash, kind, keyed, args)) return song;
+
+	char key[64];
+	snprintf(key, sizeof(key), "%016llx-%016llx-%zx", (unsigned long long)SongCache_HashData(data, length), (unsigned long long)hash.Hash, length);
+	std::string name = dir;
+	if (name.back() != '/' && name.back() != '\\') name += '/';
+	name += key;
+
+	uint32_t loopstart, loopend;
+	FILE *f = ReadLoop(name + ".loop", loopstart, loopend) ? MusicIO::utf8_fopen((name + ".flac").c_str(), "rb") : nullptr;
+	if (f != nullptr)
+	{
+		auto reader = new MusicIO::StdioFileReader;
+		reader->f = f;
+		reader->filename = name + ".flac";
+		auto source = SndFile_OpenSong(reader, loopstart, loopend, true, true);
+		if (source == nullptr)
+		{
+			reader->close();
+			return song;
+		}
+		MusInfo *cached = OpenStreamSong(source);
+		if (cached == nullptr || !cached->IsValid())
+		{
+			delete cached;
+			return song;
+		}
+		delete song;
+		return cached;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(PendingLock);
+		if (!Pending.insert(name).second) return song;
+	}
+	auto job = std::make_shared<FRenderJob>();
+	job->Data.assign(data, data + length);
+	job->Kind = kind;
+	job->Device = device;
+	job->KeyedDevice = keyed;
+	job->Args = args ? args : "";
+	job->Name = name;
+	job->Config = ZMusic_CopyConfig(*song->Config);
+	job->Config->misc.snd_rendercache.clear();	// the render itself must not look for one.
+	ZMusic_SubmitJob(JOB_OFFLINE, [job]() { job->Run(); });
+	return song;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// Keeps FLAC renders of synthesized songs in the directory set by
+// zmusic_snd_rendercache, so that songs that were played before can be
+// played from those instead of being synthesized again.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "zmusic_internal.h"
+
+class MusInfo;
+
+enum ERenderCacheKind
+{
+	RENDER_MIDI,
+	RENDER_MODULE,
+	RENDER_GME,
+};
+
+// Called by OpenSong for a song of one of the kinds above that was just opened
+// from 'data'. Returns the song of the cached render, which replaces 'song',
+// or 'song' itself, after queueing its render if there is none yet.
+MusInfo *RenderCache_Open(MusInfo *song, ERenderCacheKind kind, const uint8_t *data, size_t length, EMidiDevice device, const char *args);
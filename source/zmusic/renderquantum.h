@@ -0,0 +1,76 @@
+#pragma once
+
+// Renders a song in blocks of a fixed number of frames, whatever the client
+// asks for, so every ServiceStream call costs about the same. What is left
+// of a block waits for the next request.
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "allocator.h"
+
+class FRenderQuantum
+{
+public:
+	// 0 frames renders straight into the client's buffer again.
+	void Setup(int frames)
+	{
+		Frames = frames > 0 ? frames : 0;
+		Reset();
+	}
+
+	void Reset() { Pos = Avail = 0; Ended = false; }
+	bool IsActive() const { return Frames > 0; }
+
+	// Fills 'len' bytes of 'buff', calling render(block, bytes, produced) for every new block.
+	// Returns false like render does once the song has ended and what the last block
+	// produced has been used up, with the rest filled with 'silence'. 'produced' gets
+	// the frames of 'buff' that belong to the song.
+	template<class F> bool Fill(void *buff, size_t len, int framesize, uint8_t silence, int &produced, F &&render)
+	{
+		if (framesize != FrameSize)
+		{
+			// The format changed, what is left is of no use anymore.
+			FrameSize = framesize;
+			Buffer.resize(size_t(Frames) * FrameSize);
+			Reset();
+		}
+		uint8_t *out = (uint8_t *)buff;
+		while (len > 0)
+		{
+			if (Avail == 0)
+			{
+				if (Ended)
+				{
+					memset(out, silence, len);
+					break;
+				}
+				int blockproduced;
+				Ended = !render(Buffer.data(), int(Buffer.size()), blockproduced);
+				Pos = 0;
+				Avail = Ended ? size_t(blockproduced) * FrameSize : Buffer.size();
+				continue;
+			}
+			size_t n = std::min(len, Avail);
+			memcpy(out, &Buffer[Pos], n);
+			out += n;
+			len -= n;
+			Pos += n;
+			Avail -= n;
+		}
+		produced = int((out - (uint8_t *)buff) / FrameSize);
+		if (Ended && Avail == 0)
+		{
+			Reset();
+			return false;
+		}
+		return true;
+	}
+
+private:
+	TMusicVector<uint8_t> Buffer;
+	int Frames = 0;
+	int FrameSize = 0;
+	size_t Pos = 0, Avail = 0;
+	bool Ended = false;	// the song ended in the block that is left.
+};
@@ -0,0 +1,277 @@
+/*
+** resampler.cpp
+** Polyphase sample rate converter for emulated synths and stream sources.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <math.h>
+#include <algorithm>
+#include "resampler.h"
+#include "resampler_kernels.h"
+#include "cpufeatures.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESAMPLER_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define RESAMPLER_NEON
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#define RESAMPLER_SIMD128
+#include <wasm_simd128.h>
+#endif
+
+//==========================================================================
+//
+// Applies two neighbouring filter phases to the same input
+//
+//==========================================================================
+
+static inline void FilterPair(const float *in, const float *c0, const float *c1, int taps, float &out0, float &out1)
+{
+#if defined(RESAMPLER_SSE2)
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	for (int i = 0; i < taps; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(in + i);
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(x, _mm_loadu_ps(c0 + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(x, _mm_loadu_ps(c1 + i)));
+	}
+	// sum0 and sum1 side by side, then add the halves of each
+	__m128 lo = _mm_unpacklo_ps(sum0, sum1);
+	__m128 hi = _mm_unpackhi_ps(sum0, sum1);
+	__m128 s = _mm_add_ps(lo, hi);
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	out0 = _mm_cvtss_f32(s);
+	out1 = _mm_cvtss_f32(_mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif defined(RESAMPLER_NEON)
+	float32x4_t sum0 = vdupq_n_f32(0);
+	float32x4_t sum1 = vdupq_n_f32(0);
+	for (int i = 0; i < taps; i += 4)
+	{
+		float32x4_t x = vld1q_f32(in + i);
+		sum0 = vmlaq_f32(sum0, x, vld1q_f32(c0 + i));
+		sum1 = vmlaq_f32(sum1, x, vld1q_f32(c1 + i));
+	}
+	float32x2_t s = vpadd_f32(vadd_f32(vget_low_f32(sum0), vget_high_f32(sum0)), vadd_f32(vget_low_f32(sum1), vget_high_f32(sum1)));
+	out0 = vget_lane_f32(s, 0);
+	out1 = vget_lane_f32(s, 1);
+#elif defined(RESAMPLER_SIMD128)
+	v128_t sum0 = wasm_f32x4_splat(0);
+	v128_t sum1 = wasm_f32x4_splat(0);
+	for (int i = 0; i < taps; i += 4)
+	{
+		v128_t x = wasm_v128_load(in + i);
+		sum0 = wasm_f32x4_add(sum0, wasm_f32x4_mul(x, wasm_v128_load(c0 + i)));
+		sum1 = wasm_f32x4_add(sum1, wasm_f32x4_mul(x, wasm_v128_load(c1 + i)));
+	}
+	// The same reduction as the SSE2 version
+	v128_t lo = wasm_i32x4_shuffle(sum0, sum1, 0, 4, 1, 5);
+	v128_t hi = wasm_i32x4_shuffle(sum0, sum1, 2, 6, 3, 7);
+	v128_t s = wasm_f32x4_add(lo, hi);
+	s = wasm_f32x4_add(s, wasm_i32x4_shuffle(s, s, 2, 3, 2, 3));
+	out0 = wasm_f32x4_extract_lane(s, 0);
+	out1 = wasm_f32x4_extract_lane(s, 1);
+#else
+	float sum0 = 0, sum1 = 0;
+	for (int i = 0; i < taps; i++)
+	{
+		sum0 += in[i] * c0[i];
+		sum1 += in[i] * c1[i];
+	}
+	out0 = sum0;
+	out1 = sum1;
+#endif
+}
+
+//==========================================================================
+//
+// The filter loop for the baseline of the architecture
+//
+//==========================================================================
+
+void ResampleBlock_Base(const float *const *hist, int channels, const float *coeffs, int taps, uint64_t pos, uint64_t step, float *out, size_t outframes)
+{
+	for (size_t i = 0; i < outframes; i++)
+	{
+		size_t frame = (size_t)(pos >> 32);
+		uint32_t frac = (uint32_t)pos;
+		const float *c0 = coeffs + (frac >> 24) * taps;
+		float blend = (frac & 0xffffff) * (1.f / 16777216.f);
+
+		for (int c = 0; c < channels; c++)
+		{
+			float s0, s1;
+			FilterPair(hist[c] + frame, c0, c0 + taps, taps, s0, s1);
+			out[i * channels + c] = s0 + (s1 - s0) * blend;
+		}
+		pos += step;
+	}
+}
+
+static const TCPUDispatch<ResampleBlockFunc> ResampleBlock =
+{
+#ifdef ZMUSIC_ISA_AVX2
+	{ CPU_AVX2, ResampleBlock_AVX2 },
+#endif
+	{ 0, ResampleBlock_Base },
+};
+
+//==========================================================================
+//
+// Bessel function for the Kaiser window
+//
+//==========================================================================
+
+static double BesselI0(double x)
+{
+	double sum = 1, term = 1;
+	for (int k = 1; k < 32; k++)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+//==========================================================================
+//
+// FResampler :: Setup
+//
+//==========================================================================
+
+void FResampler::Setup(double inrate, double outrate, int channels, int quality)
+{
+	// Fewer taps need a wider transition band and a weaker window.
+	static const struct { int taps; double beta, cutoff; } filters[] =
+	{
+		{ 16, 5, 0.40 },
+		{ 32, 6, 0.43 },
+		{ 48, 7, 0.45 },
+		{ 64, 8, 0.46 },
+	};
+	const auto &filter = filters[std::clamp(quality, (int)RESAMPLE_FAST, (int)RESAMPLE_HIGHEST) - RESAMPLE_FAST];
+	const double beta = filter.beta;
+	// Leave some room for the transition band below the lower Nyquist frequency.
+	double cutoff = filter.cutoff * std::min(1.0, outrate / inrate);
+
+	Taps = filter.taps;
+	NumChannels = std::clamp(channels, 1, (int)MaxChannels);
+	Step = (uint64_t)(inrate / outrate * 4294967296.0 + 0.5);
+	Coeffs.resize((Phases + 1) * Taps);
+	for (int p = 0; p <= Phases; p++)
+	{
+		float *row = &Coeffs[p * Taps];
+		double sum = 0;
+		for (int t = 0; t < Taps; t++)
+		{
+			// distance from the point between input frames Taps/2 - 1 and Taps/2 that this phase is at
+			double x = t - (Taps / 2 - 1) - (double)p / Phases;
+			double r = x / (Taps / 2);
+			double window = r * r < 1 ? BesselI0(beta * sqrt(1 - r * r)) / BesselI0(beta) : 0;
+			double arg = 3.14159265358979323846 * 2 * cutoff * x;
+			double h = 2 * cutoff * (arg == 0 ? 1 : sin(arg) / arg) * window;
+			row[t] = (float)h;
+			sum += h;
+		}
+		// Every phase passes DC unchanged.
+		for (int t = 0; t < Taps; t++)
+		{
+			row[t] = (float)(row[t] / sum);
+		}
+	}
+	Reset();
+}
+
+//==========================================================================
+//
+// FResampler :: Reset
+//
+//==========================================================================
+
+void FResampler::Reset()
+{
+	// Start with the first input frame in the middle of the filter.
+	for (int c = 0; c < MaxChannels; c++)
+	{
+		History[c].assign(c < NumChannels ? Taps / 2 - 1 : 0, 0.f);
+	}
+	Pos = 0;
+}
+
+//==========================================================================
+//
+// FResampler :: InputNeeded
+//
+//==========================================================================
+
+size_t FResampler::InputNeeded(size_t outframes) const
+{
+	if (outframes == 0) return 0;
+	size_t needed = (size_t)((Pos + (outframes - 1) * Step) >> 32) + Taps;
+	return needed > History[0].size() ? needed - History[0].size() : 0;
+}
+
+//==========================================================================
+//
+// FResampler :: Process
+//
+//==========================================================================
+
+void FResampler::Process(const float *in, float *out, size_t outframes)
+{
+	size_t count = InputNeeded(outframes);
+	size_t start = History[0].size();
+
+	for (int c = 0; c < NumChannels; c++)
+	{
+		auto &hist = History[c];
+		hist.resize(start + count);
+		for (size_t i = 0; i < count; i++)
+		{
+			hist[start + i] = in[i * NumChannels + c];
+		}
+	}
+
+	const float *hist[MaxChannels];
+	for (int c = 0; c < NumChannels; c++) hist[c] = History[c].data();
+	ResampleBlock.Get()(hist, NumChannels, Coeffs.data(), Taps, Pos, Step, out, outframes);
+	Pos += Step * outframes;
+
+	// Drop the frames no later output frame needs anymore.
+	size_t used = std::min((size_t)(Pos >> 32), History[0].size());
+	for (int c = 0; c < NumChannels; c++)
+	{
+		History[c].erase(History[c].begin(), History[c].begin() + used);
+	}
+	Pos -= (uint64_t)used << 32;
+}
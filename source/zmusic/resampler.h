@@ -0,0 +1,50 @@
+#pragma once
+
+// Converts interleaved mono or stereo float audio from one sample rate to
+// another with a polyphase windowed sinc filter.
+//
+// This is the one resampler of the library: synths that emulate hardware at
+// a fixed rate sum all chips at that rate and convert once, and StreamSong
+// converts the output of sources that play at their file's own rate.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// The same as the values of zmusic_snd_resamplequality.
+enum EResampleQuality
+{
+	RESAMPLE_FAST = 1,		// 16 taps
+	RESAMPLE_GOOD,			// 32 taps
+	RESAMPLE_BEST,			// 48 taps
+	RESAMPLE_HIGHEST,		// 64 taps
+};
+
+class FResampler
+{
+public:
+	enum
+	{
+		MaxChannels = 2,
+		Phases = 256,
+	};
+
+	void Setup(double inrate, double outrate, int channels = 2, int quality = RESAMPLE_BEST);
+	void Reset();
+
+	int Channels() const { return NumChannels; }
+
+	// Number of input frames the next Process call needs for 'outframes' output frames.
+	size_t InputNeeded(size_t outframes) const;
+
+	// Reads exactly InputNeeded(outframes) frames from 'in' and writes 'outframes' frames to 'out'.
+	void Process(const float *in, float *out, size_t outframes);
+
+private:
+	std::vector<float> Coeffs;	// (Phases + 1) rows of Taps coefficients
+	std::vector<float> History[MaxChannels];	// input frames not completely used yet
+	int Taps = 48;		// a multiple of 8, for the SIMD kernels
+	int NumChannels = 2;
+	uint64_t Step = 0;	// input frames per output frame, 32.32 fixed point
+	uint64_t Pos = 0;	// position of the next output frame in History
+};
@@ -0,0 +1,72 @@
+/*
+** resampler_avx2.cpp
+** The resampler's filter loop for CPUs with AVX2 and FMA.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** Compiled with AVX2 and FMA enabled, so nothing here may run before
+** ZMusic_CPUFeatures reported CPU_AVX2.
+**
+*/
+
+#include <immintrin.h>
+#include "resampler_kernels.h"
+
+void ResampleBlock_AVX2(const float *const *hist, int channels, const float *coeffs, int taps, uint64_t pos, uint64_t step, float *out, size_t outframes)
+{
+	for (size_t i = 0; i < outframes; i++)
+	{
+		size_t frame = (size_t)(pos >> 32);
+		uint32_t frac = (uint32_t)pos;
+		const float *c0 = coeffs + (frac >> 24) * taps;
+		const float *c1 = c0 + taps;
+		float blend = (frac & 0xffffff) * (1.f / 16777216.f);
+
+		for (int c = 0; c < channels; c++)
+		{
+			const float *in = hist[c] + frame;
+			__m256 sum0 = _mm256_setzero_ps();
+			__m256 sum1 = _mm256_setzero_ps();
+			for (int t = 0; t < taps; t += 8)
+			{
+				__m256 x = _mm256_loadu_ps(in + t);
+				sum0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(c0 + t), sum0);
+				sum1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(c1 + t), sum1);
+			}
+			// Both phases side by side, then add the halves of each.
+			__m256 h = _mm256_hadd_ps(sum0, sum1);
+			__m128 s = _mm_add_ps(_mm256_castps256_ps128(h), _mm256_extractf128_ps(h, 1));
+			s = _mm_hadd_ps(s, s);
+			float s0 = _mm_cvtss_f32(s);
+			float s1 = _mm_cvtss_f32(_mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+			out[i * channels + c] = s0 + (s1 - s0) * blend;
+		}
+		pos += step;
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// The inner loop of FResampler::Process, with a version for each instruction
+// set it was compiled for. See cpufeatures.h for the rules of the units that
+// include this.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Writes 'outframes' interleaved frames of 'channels' channels to 'out'.
+// hist[c] is the input of channel c, pos the 32.32 position of the first
+// output frame in it and step the distance between output frames. coeffs
+// has Phases + 1 rows of 'taps' coefficients, 'taps' being a multiple of 8.
+typedef void (*ResampleBlockFunc)(const float *const *hist, int channels, const float *coeffs, int taps, uint64_t pos, uint64_t step, float *out, size_t outframes);
+
+void ResampleBlock_Base(const float *const *hist, int channels, const float *coeffs, int taps, uint64_t pos, uint64_t step, float *out, size_t outframes);
+void ResampleBlock_AVX2(const float *const *hist, int channels, const float *coeffs, int taps, uint64_t pos, uint64_t step, float *out, size_t outframes);
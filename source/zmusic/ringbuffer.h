@@ -0,0 +1,93 @@
+#pragma once
+
+// Lock-free single-producer/single-consumer byte ring.
+//
+// The producer only ever advances WritePos and the consumer only ever
+// advances ReadPos, so neither side needs a lock. Positions are free running
+// and only reduced modulo the capacity when the buffer is accessed.
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "allocator.h"
+
+class FRingBuffer
+{
+public:
+	// Not thread safe. Must only be called while neither side is active.
+	void Resize(size_t capacity)
+	{
+		Data.resize(capacity);
+		ReadPos.store(0, std::memory_order_relaxed);
+		WritePos.store(0, std::memory_order_relaxed);
+	}
+
+	size_t Capacity() const
+	{
+		return Data.size();
+	}
+
+	size_t ReadAvailable() const
+	{
+		return WritePos.load(std::memory_order_acquire) - ReadPos.load(std::memory_order_relaxed);
+	}
+
+	size_t WriteAvailable() const
+	{
+		return Data.size() - (WritePos.load(std::memory_order_relaxed) - ReadPos.load(std::memory_order_acquire));
+	}
+
+	// Producer side.
+	size_t Write(const void *src, size_t len)
+	{
+		size_t wpos = WritePos.load(std::memory_order_relaxed);
+		len = std::min(len, WriteAvailable());
+		if (len == 0) return 0;
+
+		size_t offset = wpos % Data.size();
+		size_t part = std::min(len, Data.size() - offset);
+		memcpy(&Data[offset], src, part);
+		if (part < len) memcpy(&Data[0], (const uint8_t *)src + part, len - part);
+		WritePos.store(wpos + len, std::memory_order_release);
+		return len;
+	}
+
+	size_t GetWritePos() const
+	{
+		return WritePos.load(std::memory_order_acquire);
+	}
+
+	// Consumer side.
+	size_t Read(void *dest, size_t len)
+	{
+		size_t rpos = ReadPos.load(std::memory_order_relaxed);
+		len = std::min(len, ReadAvailable());
+		if (len == 0) return 0;
+
+		size_t offset = rpos % Data.size();
+		size_t part = std::min(len, Data.size() - offset);
+		memcpy(dest, &Data[offset], part);
+		if (part < len) memcpy((uint8_t *)dest + part, &Data[0], len - part);
+		ReadPos.store(rpos + len, std::memory_order_release);
+		return len;
+	}
+
+	// Consumer side. Discards everything written before 'pos'.
+	void SkipTo(size_t pos)
+	{
+		size_t rpos = ReadPos.load(std::memory_order_relaxed);
+		if (pos - rpos <= ReadAvailable()) ReadPos.store(pos, std::memory_order_release);
+	}
+
+	size_t GetReadPos() const
+	{
+		return ReadPos.load(std::memory_order_acquire);
+	}
+
+private:
+	TMusicVector<uint8_t> Data;
+	std::atomic<size_t> ReadPos{ 0 };
+	std::atomic<size_t> WritePos{ 0 };
+};
@@ -0,0 +1,160 @@
+/*
+** rtcheck.cpp
+** Counts what the render path must not do.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** A violation is counted on every real-time thread, then handed to the
+** client's hook with the mark lifted, since taking a backtrace or logging
+** it is likely to do exactly what is being reported.
+**
+** The global allocation operators get replaced as well, which catches the
+** std containers and the synths. Only threads inside ZMusic_FillStream or
+** ZMusic_MixerFill are ever marked, so everything else passes through.
+**
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#include "rtcheck.h"
+#include "zmusic_internal.h"
+
+extern ZMusicCallbacks musicCallbacks;
+
+static_assert((int)RTV_COUNT == (int)ZMUSIC_RT_COUNT && (int)RTV_PRINT == (int)ZMUSIC_RT_PRINT, "violation kinds out of sync");
+
+#ifdef ZMUSIC_RTCHECK
+
+thread_local bool ZMusic_RealtimeThread;
+static std::atomic<uint64_t> Violations[RTV_COUNT];
+
+//==========================================================================
+//
+// ZMusic_RTViolation
+//
+//==========================================================================
+
+void ZMusic_RTViolation(int kind, const char *what)
+{
+	Violations[kind].fetch_add(1, std::memory_order_relaxed);
+	auto report = musicCallbacks.RTViolation;
+	if (report != nullptr)
+	{
+		ZMusic_RealtimeThread = false;
+		report(kind, what);
+		ZMusic_RealtimeThread = true;
+	}
+}
+
+//==========================================================================
+//
+// Global allocation operators
+//
+//==========================================================================
+
+void *operator new(size_t size)
+{
+	ZMUSIC_RT_CHECK(RTV_ALLOC, "operator new");
+	void *mem = malloc(size > 0 ? size : 1);
+	if (mem == nullptr) throw std::bad_alloc();
+	return mem;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	ZMUSIC_RT_CHECK(RTV_ALLOC, "operator new");
+	return malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept
+{
+	if (ptr != nullptr) ZMUSIC_RT_CHECK(RTV_ALLOC, "operator delete");
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+	operator delete(ptr);
+}
+
+#endif
+
+//==========================================================================
+//
+// ZMusic_GetRTViolations
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_GetRTViolations(ZMusicRTViolations *counts, zmusic_bool reset)
+{
+	if (counts != nullptr) *counts = {};
+#ifdef ZMUSIC_RTCHECK
+	for (int i = 0; i < RTV_COUNT; i++)
+	{
+		uint64_t count = reset ? Violations[i].exchange(0, std::memory_order_relaxed) : Violations[i].load(std::memory_order_relaxed);
+		if (counts != nullptr) counts->mCount[i] = count;
+	}
+	return true;
+#else
+	SetError("This build of ZMusic does not check the render path");
+	return false;
+#endif
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Audit of the render path, for builds with ZMUSIC_RTCHECK.
+//
+// ZMusic_FillStream and ZMusic_MixerFill mark their thread as real-time
+// for the duration of the call. Allocations, contended locks, file reads
+// and messages on such a thread are counted for ZMusic_GetRTViolations and
+// reported to ZMusicCallbacks::RTViolation, where the client can take a
+// backtrace. Without ZMUSIC_RTCHECK all of this compiles to nothing.
+//
+// This has no dependencies, so that fileio.h and critsec.h can use it.
+
+// The same as EZMusicRTViolation, for code that cannot include zmusic.h.
+enum ERTViolation
+{
+	RTV_ALLOC,
+	RTV_LOCK,
+	RTV_FILEIO,
+	RTV_PRINT,
+	RTV_COUNT
+};
+
+#ifdef ZMUSIC_RTCHECK
+
+extern thread_local bool ZMusic_RealtimeThread;
+
+// 'what' says what was done, it need not outlive the call.
+void ZMusic_RTViolation(int kind, const char *what);
+
+struct FRealtimeScope
+{
+	bool Previous;
+
+	FRealtimeScope() : Previous(ZMusic_RealtimeThread) { ZMusic_RealtimeThread = true; }
+	~FRealtimeScope() { ZMusic_RealtimeThread = Previous; }
+	FRealtimeScope(const FRealtimeScope &) = delete;
+	FRealtimeScope &operator=(const FRealtimeScope &) = delete;
+};
+
+#define ZMUSIC_RT_SCOPE() FRealtimeScope rtscope_
+#define ZMUSIC_RT_CHECK(kind, what) do { if (ZMusic_RealtimeThread) ZMusic_RTViolation(kind, what); } while (0)
+
+#else
+
+#define ZMUSIC_RT_SCOPE() ((void)0)
+#define ZMUSIC_RT_CHECK(kind, what) ((void)0)
+
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+
+// Sample format conversion shared by everything that hands data to the client.
+// The loops are kept simple and branch free so that the compiler can vectorize them.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "zmusic_internal.h"
+
+inline int16_t ZMusic_FloatToInt16(float v)
+{
+	v *= 32768.f;
+	v = v < -32768.f ? -32768.f : v > 32767.f ? 32767.f : v;
+	return (int16_t)v;
+}
+
+inline void ZMusic_ConvertInt16ToFloat(const int16_t *src, float *dest, size_t count, float scale = 1.f)
+{
+	scale *= (1.f / 32768.f);
+	for (size_t i = 0; i < count; i++) dest[i] = src[i] * scale;
+}
+
+inline void ZMusic_ConvertFloatToInt16(const float *src, int16_t *dest, size_t count)
+{
+	for (size_t i = 0; i < count; i++) dest[i] = ZMusic_FloatToInt16(src[i]);
+}
+
+inline void ZMusic_ConvertUInt8ToFloat(const uint8_t *src, float *dest, size_t count)
+{
+	for (size_t i = 0; i < count; i++) dest[i] = (src[i] - 128) * (1.f / 128.f);
+}
+
+inline void ZMusic_ConvertUInt8ToInt16(const uint8_t *src, int16_t *dest, size_t count)
+{
+	for (size_t i = 0; i < count; i++) dest[i] = int16_t((src[i] - 128) << 8);
+}
+
+// Splits interleaved stereo into two consecutive planes.
+template<class T> void ZMusic_Deinterleave(const T *src, T *dest, size_t frames)
+{
+	T *left = dest, *right = dest + frames;
+	for (size_t i = 0; i < frames; i++)
+	{
+		left[i] = src[i * 2];
+		right[i] = src[i * 2 + 1];
+	}
+}
+
+//==========================================================================
+//
+// Converts a stream's native output to the format the client asked for.
+//
+//==========================================================================
+
+class FSampleConverter
+{
+public:
+	// Returns false if the conversion is not possible.
+	bool Setup(SampleType from, SampleType to, ChannelConfig chans, bool planar)
+	{
+		if (to == SampleType_UInt8 && from != SampleType_UInt8) return false;
+		From = from;
+		To = to;
+		Channels = ZMusic_ChannelCount(chans);
+		Planar = planar && Channels > 1;
+		Active = From != To || Planar;
+		return true;
+	}
+
+	void Reset() { Active = false; }
+	bool IsActive() const { return Active; }
+	bool IsPlanar() const { return Active && Planar; }
+	SampleType GetOutputType() const { return To; }
+
+	int SourceFrameSize() const { return ZMusic_SampleTypeSize(From) * Channels; }
+	int DestFrameSize() const { return ZMusic_SampleTypeSize(To) * Channels; }
+
+	// Provides a buffer large enough for the native data of 'frames' frames.
+	void *GetSourceBuffer(size_t frames)
+	{
+		size_t size = frames * SourceFrameSize();
+		if (Buffer.size() < size) Buffer.resize(size);
+		return Buffer.data();
+	}
+
+	void Convert(void *dest, size_t frames)
+	{
+		size_t count = frames * Channels;
+		void *out = Planar ? GetPlanarBuffer(count) : dest;
+
+		if (From == To) memcpy(out, Buffer.data(), count * ZMusic_SampleTypeSize(To));
+		else if (From == SampleType_Int16 && To == SampleType_Float32) ZMusic_ConvertInt16ToFloat((const int16_t*)Buffer.data(), (float*)out, count);
+		else if (From == SampleType_Float32 && To == SampleType_Int16) ZMusic_ConvertFloatToInt16((const float*)Buffer.data(), (int16_t*)out, count);
+		else if (From == SampleType_UInt8 && To == SampleType_Float32) ZMusic_ConvertUInt8ToFloat(Buffer.data(), (float*)out, count);
+		else if (From == SampleType_UInt8 && To == SampleType_Int16) ZMusic_ConvertUInt8ToInt16(Buffer.data(), (int16_t*)out, count);
+
+		if (Planar)
+		{
+			switch (To)
+			{
+			case SampleType_Float32: ZMusic_Deinterleave((const float*)out, (float*)dest, frames); break;
+			case SampleType_Int16: ZMusic_Deinterleave((const int16_t*)out, (int16_t*)dest, frames); break;
+			case SampleType_UInt8: ZMusic_Deinterleave((const uint8_t*)out, (uint8_t*)dest, frames); break;
+			}
+		}
+	}
+
+private:
+	void *GetPlanarBuffer(size_t count)
+	{
+		size_t size = count * ZMusic_SampleTypeSize(To);
+		if (PlanarBuffer.size() < size) PlanarBuffer.resize(size);
+		return PlanarBuffer.data();
+	}
+
+	SampleType From = SampleType_Float32, To = SampleType_Float32;
+	int Channels = 2;
+	bool Planar = false;
+	bool Active = false;
+	std::vector<uint8_t> Buffer, PlanarBuffer;
+};
@@ -0,0 +1,206 @@
+/*
+** smfexport.cpp
+** Writes MIDI sources out as Standard MIDI Files, to disk or to a
+** client supplied writer, and converts batches of sources in parallel.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "zmusic_internal.h"
+#include "jobs.h"
+#include "fileio.h"
+#include "midisources/midisource.h"
+
+//==========================================================================
+//
+// Writers
+//
+//==========================================================================
+
+class SMFFileWriter : public SMFWriter
+{
+	FILE *File;
+
+public:
+	SMFFileWriter(FILE *f) : File(f) {}
+
+	bool Write(const uint8_t *data, size_t len) override
+	{
+		return fwrite(data, 1, len, File) == len;
+	}
+
+	bool CanPatch() const override { return true; }
+
+	bool Patch(size_t offset, const uint8_t *data, size_t len) override
+	{
+		if (fseek(File, (long)offset, SEEK_SET) != 0) return false;
+		bool ok = fwrite(data, 1, len, File) == len;
+		return fseek(File, 0, SEEK_END) == 0 && ok;
+	}
+};
+
+class SMFCustomWriter : public SMFWriter
+{
+	ZMusicCustomWriter *Writer;
+
+public:
+	SMFCustomWriter(ZMusicCustomWriter *writer) : Writer(writer) {}
+
+	bool Write(const uint8_t *data, size_t len) override
+	{
+		return Writer->write(Writer, data, (int32_t)len) == (long)len;
+	}
+
+	bool CanPatch() const override { return Writer->seek != nullptr; }
+
+	bool Patch(size_t offset, const uint8_t *data, size_t len) override
+	{
+		if (Writer->seek(Writer, (long)offset, SEEK_SET) < 0) return false;
+		bool ok = Write(data, len);
+		return Writer->seek(Writer, 0, SEEK_END) >= 0 && ok;
+	}
+};
+
+//==========================================================================
+//
+// Exceptions must not get past the API boundary.
+//
+//==========================================================================
+
+static bool WriteSMF(MIDISource *source, SMFWriter &writer, int looplimit)
+{
+	try
+	{
+		if (source->CreateSMF(writer, looplimit)) return true;
+		SetError("Unable to write MIDI file");
+	}
+	catch (const std::exception &ex)
+	{
+		SetError(ex.what());
+	}
+	return false;
+}
+
+static bool WriteSMFFile(MIDISource *source, const char *fn, int looplimit)
+{
+	auto f = MusicIO::utf8_fopen(fn, "wb");
+	if (f == nullptr)
+	{
+		SetError("Unable to open output file");
+		return false;
+	}
+	SMFFileWriter writer(f);
+	bool success = WriteSMF(source, writer, looplimit);
+	if (fclose(f) != 0) success = false;
+	return success;
+}
+
+//==========================================================================
+//
+// ZMusic_WriteSMF / ZMusic_WriteSMFToWriter
+//
+// The file is streamed out while it is generated. The track length gets
+// patched in afterward unless the writer cannot seek.
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_WriteSMF(MIDISource* source, const char *fn, int looplimit)
+{
+	if (!source || !fn) return false;
+	return WriteSMFFile(source, fn, looplimit);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_WriteSMFToWriter(MIDISource* source, ZMusicCustomWriter* writer, int looplimit)
+{
+	if (!writer) return false;
+	bool success = false;
+	if (source)
+	{
+		SMFCustomWriter smfwriter(writer);
+		success = WriteSMF(source, smfwriter, looplimit);
+	}
+	if (writer->close) writer->close(writer);
+	return success;
+}
+
+//==========================================================================
+//
+// Each worker takes the next unconverted source until none are left.
+// Errors are set on the worker's thread, so the message of the first
+// failed file in the list gets passed on to the caller's with the count.
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_WriteSMFBatch(const ZMusic_MidiSource* sources, const char* const* filenames, int count, int looplimit, int numthreads, zmusic_bool* results)
+{
+	if (!sources || !filenames || count < 0) return false;
+
+	std::atomic<int> next{ 0 };
+	std::atomic<int> failed{ 0 };
+	std::mutex errorlock;
+	int firstfailed = count;
+	std::string firsterror;
+	auto work = [&]()
+	{
+		for (int i; (i = next++) < count; )
+		{
+			auto source = (MIDISource*)sources[i];
+			bool success = source && filenames[i] && WriteSMFFile(source, filenames[i], looplimit);
+			if (results) results[i] = success;
+			if (!success)
+			{
+				failed++;
+				std::lock_guard<std::mutex> lock(errorlock);
+				if (i < firstfailed)
+				{
+					firstfailed = i;
+					firsterror = filenames[i] == nullptr ? "missing file name" : std::string(filenames[i]) + ": " + (source ? ZMusic_GetLastError() : "missing source");
+				}
+			}
+		}
+	};
+
+	// Every worker runs the loop, the caller's thread is one of them.
+	if (numthreads <= 0 || numthreads > count) numthreads = count;
+	ZMusic_RunParallel(JOB_OFFLINE, numthreads, numthreads, [](void *context, size_t) { (*(decltype(work) *)context)(); }, &work);
+
+	if (failed > 0)
+	{
+		std::string msg = std::to_string(failed.load()) + " of " + std::to_string(count) + " MIDI files could not be written. " + firsterror;
+		SetError(msg.c_str());
+		return false;
+	}
+	return true;
+}
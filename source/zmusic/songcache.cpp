@@ -0,0 +1,195 @@
+/*
+** songcache.cpp
+** Content addressed LRU cache of parsed MIDI sources.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "zmusic_internal.h"
+#include "songcache.h"
+#include "midisources/midisource.h"
+
+struct SongCacheEntry
+{
+	SongCacheKey Key;
+	std::unique_ptr<MIDISource> Source;
+	size_t Bytes;
+};
+
+static std::mutex CacheLock;
+static std::list<SongCacheEntry> CacheList;	// most recently used first
+static std::unordered_multimap<uint64_t, std::list<SongCacheEntry>::iterator> CacheMap;
+static size_t CacheBytes;
+static size_t CacheLimit;	// 0 disables the cache
+
+//==========================================================================
+//
+// 64 bit FNV-1a. Only used to find candidates, the data is always compared in full.
+//
+//==========================================================================
+
+uint64_t SongCache_HashData(const uint8_t *data, size_t length)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+//==========================================================================
+//
+// Drops the least recently used entries until the cache fits 'limit'.
+// CacheLock must be held.
+//
+//==========================================================================
+
+static void Trim(size_t limit)
+{
+	while (CacheBytes > limit && !CacheList.empty())
+	{
+		auto last = std::prev(CacheList.end());
+		auto range = CacheMap.equal_range(last->Key.Hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second == last)
+			{
+				CacheMap.erase(it);
+				break;
+			}
+		}
+		CacheBytes -= last->Bytes;
+		ZMusic_AccountMemory(ZMUSIC_MEM_SONGDATA, -(ptrdiff_t)last->Bytes);
+		CacheList.erase(last);
+	}
+}
+
+//==========================================================================
+//
+// SongCache_Find
+//
+//==========================================================================
+
+MIDISource *SongCache_Find(std::shared_ptr<const uint8_t> data, size_t length, SongCacheKey &key)
+{
+	if (data == nullptr) return nullptr;
+	{
+		std::lock_guard<std::mutex> lock(CacheLock);
+		if (CacheLimit == 0) return nullptr;
+	}
+
+	// Hashing is done without the lock, the content may be large.
+	key.Length = length;
+	key.Hash = SongCache_HashData(data.get(), key.Length);
+	key.Data = std::move(data);
+
+	std::lock_guard<std::mutex> lock(CacheLock);
+	auto range = CacheMap.equal_range(key.Hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		auto &entry = *it->second;
+		if (entry.Key.Length == key.Length && memcmp(entry.Key.Data.get(), key.Data.get(), key.Length) == 0)
+		{
+			CacheList.splice(CacheList.begin(), CacheList, it->second);
+			key.Data.reset();
+			key.Type = entry.Key.Type;
+			return entry.Source->Clone();
+		}
+	}
+	return nullptr;
+}
+
+//==========================================================================
+//
+// SongCache_Add
+//
+//==========================================================================
+
+void SongCache_Add(SongCacheKey &key, const MIDISource *source, const uint8_t *data, size_t length)
+{
+	if (key.Data == nullptr) return;
+
+	size_t bytes = key.Length + sizeof(SongCacheEntry);
+	if (data != key.Data.get()) bytes += length;
+
+	// The copy outlives the song, so it must not come from the song's arena.
+	FMusicArenaScope noarena(nullptr);
+	std::unique_ptr<MIDISource> copy(source->Clone());
+	if (copy == nullptr) return;
+
+	std::lock_guard<std::mutex> lock(CacheLock);
+	if (bytes > CacheLimit) return;
+
+	// Another thread may have added the same song in the meantime.
+	auto range = CacheMap.equal_range(key.Hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		auto &entry = *it->second;
+		if (entry.Key.Length == key.Length && memcmp(entry.Key.Data.get(), key.Data.get(), key.Length) == 0) return;
+	}
+
+	Trim(CacheLimit - bytes);
+	CacheList.push_front({ std::move(key), std::move(copy), bytes });
+	CacheMap.emplace(CacheList.front().Key.Hash, CacheList.begin());
+	CacheBytes += bytes;
+	ZMusic_AccountMemory(ZMUSIC_MEM_SONGDATA, bytes);
+}
+
+//==========================================================================
+//
+// Drops the least recently used entries until 'bytes' have been freed or
+// the cache is empty. Returns how much was freed.
+//
+//==========================================================================
+
+size_t SongCache_Shrink(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(CacheLock);
+	size_t before = CacheBytes;
+	Trim(before > bytes ? before - bytes : 0);
+	return before - CacheBytes;
+}
+
+//==========================================================================
+//
+// Sets the cache's memory limit in bytes. 0 turns it off and frees everything.
+//
+//==========================================================================
+
+DLL_EXPORT void ZMusic_SetSongCacheSize(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(CacheLock);
+	CacheLimit = bytes;
+	Trim(bytes);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Keeps parsed MIDI sources around so that opening the same data again
+// only has to copy a source's playback state instead of parsing it again.
+
+#include <stdint.h>
+#include <memory>
+#include "zmusic_internal.h"
+
+class MIDISource;
+
+struct SongCacheKey
+{
+	std::shared_ptr<const uint8_t> Data;
+	size_t Length = 0;
+	uint64_t Hash = 0;
+	EMIDIType Type = MIDI_NOTMIDI;
+};
+
+// Returns a fresh copy of the source cached for 'data', the content of the file the song is
+// opened from, and sets key.Type, or nullptr. Only meant for data known to be MIDI, since it
+// gets hashed as a whole. On a miss 'key' is set up for SongCache_Add, unless the cache is
+// off or the data is null because the reader does not hold it in memory.
+MIDISource *SongCache_Find(std::shared_ptr<const uint8_t> data, size_t length, SongCacheKey &key);
+
+// 'data' and 'length' are what the source references, which may differ from the key for compressed songs.
+void SongCache_Add(SongCacheKey &key, const MIDISource *source, const uint8_t *data, size_t length);
+
+// Frees the least recently used songs, for zmusic_snd_memorybudget. Returns the bytes freed.
+size_t SongCache_Shrink(size_t bytes);
+
+// The hash the cache uses, for other caches keyed by file content. Equal hashes still need the data compared.
+uint64_t SongCache_HashData(const uint8_t *data, size_t length);
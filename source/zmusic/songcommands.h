@@ -0,0 +1,85 @@
+#pragma once
+
+// Control calls from the client's threads, queued for the thread that
+// services the stream, which carries them out at the start of its next
+// block. That way neither side waits for the other while a song plays.
+//
+// Any number of threads may post. Only the holder of the song's CritSec
+// takes them out, so there is only ever one consumer.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "mididefs.h"
+
+struct FSongCommand
+{
+	enum EType
+	{
+		Pause,
+		Resume,
+		VolumeChanged,
+		SettingInt,
+		SettingNum,
+		Virtual,		// IntValue is on or off.
+	};
+
+	EType Type;
+	ESongSetting Setting;
+	int IntValue;
+	double NumValue;
+};
+
+class FSongCommandQueue
+{
+	enum { Size = 64 };
+
+	struct Slot
+	{
+		std::atomic<size_t> Seq;	// Pos for a free slot, Pos + 1 for a filled one.
+		FSongCommand Command;
+	};
+
+	Slot Slots[Size];
+	std::atomic<size_t> WritePos{ 0 };
+	std::atomic<size_t> ReadPos{ 0 };
+
+public:
+	FSongCommandQueue()
+	{
+		for (size_t i = 0; i < Size; i++) Slots[i].Seq.store(i, std::memory_order_relaxed);
+	}
+
+	// Returns false if the queue is full.
+	bool Push(const FSongCommand &cmd)
+	{
+		size_t pos = WritePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Slot &slot = Slots[pos % Size];
+			ptrdiff_t diff = (ptrdiff_t)slot.Seq.load(std::memory_order_acquire) - (ptrdiff_t)pos;
+			if (diff == 0)
+			{
+				if (WritePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					slot.Command = cmd;
+					slot.Seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0) return false;
+			else pos = WritePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	bool Pop(FSongCommand &cmd)
+	{
+		size_t pos = ReadPos.load(std::memory_order_relaxed);
+		Slot &slot = Slots[pos % Size];
+		if ((ptrdiff_t)slot.Seq.load(std::memory_order_acquire) - (ptrdiff_t)(pos + 1) < 0) return false;
+		cmd = slot.Command;
+		slot.Seq.store(pos + Size, std::memory_order_release);
+		ReadPos.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+};
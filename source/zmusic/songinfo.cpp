@@ -0,0 +1,642 @@
+/*
+** songinfo.cpp
+** Persistent cache of what songs are like, for music browsers.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** Songs are known by the hash and size of their content, like in the song
+** cache. Songs the cache does not know get analyzed one at a time by a
+** single job, which plays each of them once as fast as it can. Songs
+** with several subsongs get the others played in parallel on all cores
+** to measure their lengths.
+**
+** The file starts with "ZMSINFO" and a version byte, followed by one
+** record for every analyzed song, appended as they are done:
+**   hash and size, 8 bytes each,
+**   state, MIDI type, subsongs, length, loop start and loop end, 4 bytes each,
+**   loudness, a 4 byte float,
+**   the number of instruments, 4 bytes, followed by 2 bytes for each,
+**   the number of subsong lengths, 4 bytes, followed by 4 bytes for each.
+** Everything is little endian. A file that does not end with a complete
+** record gets written anew.
+**
+*/
+
+#include <math.h>
+#include <string.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "zmusic_internal.h"
+#include "musinfo.h"
+#include "midiconfig.h"
+#include "songcache.h"
+#include "fileio.h"
+#include "jobs.h"
+
+enum
+{
+	SONGINFO_VERSION = 2,
+	MAX_ANALYSIS_SECONDS = 20 * 60,		// longer songs only get measured this far.
+	MAX_SUBSONGS = 256,					// songs with more only get this many measured.
+	RECORD_SIZE = 8 + 8 + 6 * 4 + 4 + 4 + 4,	// without the instruments and subsong lengths.
+};
+
+struct FSongInfoEntry
+{
+	ZMusicSongInfo Info;
+	std::vector<uint16_t> Instruments;
+	std::vector<int> SubsongLengths;	// -1 for those that did not end.
+};
+
+// A song waiting for its analysis, with either its data or the file to read it from.
+struct FSongInfoRequest
+{
+	uint64_t Hash;
+	uint64_t Size;
+	std::vector<uint8_t> Data;
+	std::string FileName;
+};
+
+typedef std::pair<uint64_t, uint64_t> FSongInfoKey;
+
+static std::mutex InfoLock;		// for everything below.
+static std::map<FSongInfoKey, FSongInfoEntry> InfoCache;
+static std::deque<FSongInfoRequest> InfoQueue;
+static bool AnalysisRunning;
+static FILE *InfoFile;
+
+//==========================================================================
+//
+// FLoudnessMeter
+//
+// Integrated loudness as ITU-R BS.1770-4 defines it: K-weighted mean
+// square over 400 ms blocks that overlap by 75%, gated at -70 LUFS and
+// then at 10 LU below the loudness of the blocks that are left. The filter
+// coefficients are derived for any sample rate the way libebur128 does.
+//
+//==========================================================================
+
+class FLoudnessMeter
+{
+public:
+	FLoudnessMeter(int rate, int channels);
+	void Add(const float *samples, size_t frames);
+	float Integrated() const;
+
+private:
+	struct FBiquad
+	{
+		double b0, b1, b2, a1, a2;
+	};
+	struct FFilterState
+	{
+		double z1 = 0, z2 = 0;
+	};
+
+	static double Filter(const FBiquad &f, FFilterState &s, double x)
+	{
+		double y = f.b0 * x + s.z1;
+		s.z1 = f.b1 * x - f.a1 * y + s.z2;
+		s.z2 = f.b2 * x - f.a2 * y;
+		return y;
+	}
+
+	FBiquad Shelf, HighPass;
+	std::vector<FFilterState> States;	// two for every channel.
+	int Channels;
+	double Weight;
+	size_t StepFrames;		// 100 ms, a quarter of a block.
+	size_t StepPos = 0;
+	double StepSum = 0;
+	double Steps[4] = {};
+	int NumSteps = 0;
+	std::vector<double> Blocks;	// the mean square of every block.
+};
+
+FLoudnessMeter::FLoudnessMeter(int rate, int channels)
+	: States(channels * 2), Channels(channels)
+{
+	// A mono song is heard on both speakers, so it counts twice.
+	Weight = channels == 1 ? 2. : 1.;
+	StepFrames = std::max(rate / 10, 1);
+
+	double K = tan(3.14159265358979323846 * 1681.974450955533 / rate);
+	double Q = 0.7071752369554196;
+	double Vh = pow(10., 3.999843853973347 / 20.);
+	double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1. + K / Q + K * K;
+	Shelf = { (Vh + Vb * K / Q + K * K) / a0, 2. * (K * K - Vh) / a0, (Vh - Vb * K / Q + K * K) / a0,
+		2. * (K * K - 1.) / a0, (1. - K / Q + K * K) / a0 };
+
+	K = tan(3.14159265358979323846 * 38.13547087602444 / rate);
+	Q = 0.5003270373238773;
+	a0 = 1. + K / Q + K * K;
+	HighPass = { 1., -2., 1., 2. * (K * K - 1.) / a0, (1. - K / Q + K * K) / a0 };
+}
+
+void FLoudnessMeter::Add(const float *samples, size_t frames)
+{
+	for (size_t i = 0; i < frames; i++)
+	{
+		for (int c = 0; c < Channels; c++)
+		{
+			double y = Filter(HighPass, States[c * 2 + 1], Filter(Shelf, States[c * 2], samples[i * Channels + c]));
+			StepSum += y * y;
+		}
+		if (++StepPos == StepFrames)
+		{
+			memmove(&Steps[0], &Steps[1], sizeof(double) * 3);
+			Steps[3] = StepSum * Weight / StepFrames;
+			if (++NumSteps >= 4) Blocks.push_back((Steps[0] + Steps[1] + Steps[2] + Steps[3]) / 4);
+			StepSum = 0;
+			StepPos = 0;
+		}
+	}
+}
+
+float FLoudnessMeter::Integrated() const
+{
+	const double absolutegate = pow(10., (-70. + 0.691) / 10.);
+	double sum = 0;
+	size_t count = 0;
+	for (double block : Blocks)
+	{
+		if (block > absolutegate)
+		{
+			sum += block;
+			count++;
+		}
+	}
+	if (count == 0) return -INFINITY;
+
+	const double relativegate = sum / count * 0.1;	// -10 LU
+	sum = 0;
+	count = 0;
+	for (double block : Blocks)
+	{
+		if (block > absolutegate && block > relativegate)
+		{
+			sum += block;
+			count++;
+		}
+	}
+	if (count == 0) return -INFINITY;
+	return float(-0.691 + 10. * log10(sum / count));
+}
+
+//==========================================================================
+//
+// MeasureSubsong
+//
+// Returns the length the song reports for the subsong, or otherwise where
+// playing it without looping ends. -1 if it did not end within
+// MAX_ANALYSIS_SECONDS or could not be played.
+//
+//==========================================================================
+
+static int MeasureSubsong(const uint8_t *data, size_t size, int subsong)
+{
+	FConfigScope config(&GlobalConfig);
+	std::unique_ptr<MusInfo, void (*)(MusInfo *)> song(ZMusic_OpenSongMem(data, size, MDEV_DEFAULT, nullptr), ZMusic_Close);
+	if (song == nullptr || !ZMusic_Start(song.get(), subsong, false))
+	{
+		return -1;
+	}
+	int length = ZMusic_GetSongLengthMs(song.get());
+	if (length >= 0)
+	{
+		return length;
+	}
+	if (!ZMusic_SetStreamFormat(song.get(), SampleType_Float32, false) || !song->SetOfflineMode(true, ZMUSIC_RENDER_STOPATLOOP))
+	{
+		return -1;
+	}
+	SoundStreamInfoEx fmt = song->GetOutputInfoEx();
+	const int channels = ZMusic_ChannelCount(fmt.mChannelConfig);
+	const size_t blockframes = std::max(fmt.mSampleRate / 10, 1);
+	const size_t limit = size_t(MAX_ANALYSIS_SECONDS) * fmt.mSampleRate;
+	TMusicVector<float> block(blockframes * channels);
+	size_t done = 0;
+	bool more = true;
+	while (more && done < limit)
+	{
+		more = song->ServiceOutput(block.data(), int(blockframes * channels * sizeof(float)));
+		done += blockframes;
+	}
+	song->SetOfflineMode(false, ZMUSIC_RENDER_STOPATLOOP);
+	return more ? -1 : int(done * 1000 / fmt.mSampleRate);
+}
+
+//==========================================================================
+//
+// MeasureSubsongs
+//
+// The first subsong is the one Analyze played, the others are independent
+// of each other and each get a song of their own.
+//
+//==========================================================================
+
+static void MeasureSubsongs(const uint8_t *data, size_t size, FSongInfoEntry &entry)
+{
+	struct FMeasure
+	{
+		const uint8_t *Data;
+		size_t Size;
+		int *Lengths;
+	};
+
+	auto &lengths = entry.SubsongLengths;
+	lengths.assign(std::min<int>(entry.Info.subsongs, MAX_SUBSONGS), -1);
+	lengths[0] = entry.Info.length_ms;
+	FMeasure measure = { data, size, lengths.data() };
+	ZMusic_RunParallel(JOB_OFFLINE, lengths.size() - 1, SIZE_MAX, [](void *context, size_t i)
+	{
+		auto &measure = *(FMeasure *)context;
+		int subsong = int(i) + 1;
+		try
+		{
+			measure.Lengths[subsong] = MeasureSubsong(measure.Data, measure.Size, subsong);
+		}
+		catch (const std::exception &)
+		{
+			measure.Lengths[subsong] = -1;
+		}
+	}, &measure);
+}
+
+//==========================================================================
+//
+// Analyze
+//
+// Takes everything but the length from the song itself. The length comes
+// from where the render ended if the song cannot tell.
+//
+//==========================================================================
+
+static void Analyze(const uint8_t *data, size_t size, FSongInfoEntry &entry)
+{
+	auto &info = entry.Info;
+	FConfigScope config(&GlobalConfig);
+	std::unique_ptr<MusInfo, void (*)(MusInfo *)> song(ZMusic_OpenSongMem(data, size, MDEV_DEFAULT, nullptr), ZMusic_Close);
+	if (song == nullptr)
+	{
+		info.state = ZMUSIC_SONGINFO_FAILED;
+		return;
+	}
+	info.miditype = song->MIDIType;
+	{
+		FSongLock lock(song.get());
+		info.subsongs = song->GetSubsongCount();
+		entry.Instruments = song->GetInstruments();
+		info.numinstruments = int(entry.Instruments.size());
+	}
+	info.length_ms = ZMusic_GetSongLengthMs(song.get());
+	if (!ZMusic_GetLoopPoints(song.get(), &info.loopstart_ms, &info.loopend_ms))
+	{
+		info.loopstart_ms = info.loopend_ms = -1;
+	}
+
+	if (!ZMusic_Start(song.get(), 0, false) || !ZMusic_SetStreamFormat(song.get(), SampleType_Float32, false) ||
+		!song->SetOfflineMode(true, ZMUSIC_RENDER_STOPATLOOP))
+	{
+		info.state = ZMUSIC_SONGINFO_FAILED;
+		return;
+	}
+	SoundStreamInfoEx fmt = song->GetOutputInfoEx();
+	const int channels = ZMusic_ChannelCount(fmt.mChannelConfig);
+	const size_t blockframes = std::max(fmt.mSampleRate / 10, 1);
+	const size_t limit = size_t(MAX_ANALYSIS_SECONDS) * fmt.mSampleRate;
+	TMusicVector<float> block(blockframes * channels);
+	FLoudnessMeter meter(fmt.mSampleRate, channels);
+	size_t done = 0;
+	bool more = true;
+	while (more && done < limit)
+	{
+		more = song->ServiceOutput(block.data(), int(blockframes * channels * sizeof(float)));
+		meter.Add(block.data(), blockframes);
+		done += blockframes;
+	}
+	song->SetOfflineMode(false, ZMUSIC_RENDER_STOPATLOOP);
+	if (info.length_ms < 0 && !more) info.length_ms = int(done * 1000 / fmt.mSampleRate);
+	info.loudness = meter.Integrated();
+	info.state = ZMUSIC_SONGINFO_READY;
+
+	if (info.subsongs > 1)
+	{
+		song.reset();
+		MeasureSubsongs(data, size, entry);
+	}
+}
+
+//==========================================================================
+//
+// file format
+//
+//==========================================================================
+
+static void PutInt(std::vector<uint8_t> &out, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++) out.push_back(uint8_t(value >> (i * 8)));
+}
+
+static uint64_t GetInt(const uint8_t *&p, int bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++) value |= uint64_t(*p++) << (i * 8);
+	return value;
+}
+
+static void WriteEntry(FILE *f, const FSongInfoEntry &entry)
+{
+	auto &info = entry.Info;
+	uint32_t loudness;
+	memcpy(&loudness, &info.loudness, 4);
+	std::vector<uint8_t> record;
+	record.reserve(RECORD_SIZE + entry.Instruments.size() * 2 + entry.SubsongLengths.size() * 4);
+	PutInt(record, info.hash, 8);
+	PutInt(record, info.size, 8);
+	for (int value : { info.state, info.miditype, info.subsongs, info.length_ms, info.loopstart_ms, info.loopend_ms })
+	{
+		PutInt(record, uint32_t(value), 4);
+	}
+	PutInt(record, loudness, 4);
+	PutInt(record, entry.Instruments.size(), 4);
+	for (auto inst : entry.Instruments) PutInt(record, inst, 2);
+	PutInt(record, entry.SubsongLengths.size(), 4);
+	for (int length : entry.SubsongLengths) PutInt(record, uint32_t(length), 4);
+	fwrite(record.data(), 1, record.size(), f);
+	fflush(f);
+}
+
+static const char InfoHeader[8] = { 'Z', 'M', 'S', 'I', 'N', 'F', 'O', SONGINFO_VERSION };
+
+// Returns false if the file is not all complete records. InfoLock must be held.
+static bool LoadEntries(const std::vector<uint8_t> &file)
+{
+	if (file.size() < 8 || memcmp(file.data(), InfoHeader, 8) != 0) return false;
+	const uint8_t *p = file.data() + 8, *end = file.data() + file.size();
+	while (end - p >= RECORD_SIZE)
+	{
+		FSongInfoEntry entry;
+		auto &info = entry.Info;
+		info.hash = GetInt(p, 8);
+		info.size = GetInt(p, 8);
+		for (int *value : { &info.state, &info.miditype, &info.subsongs, &info.length_ms, &info.loopstart_ms, &info.loopend_ms })
+		{
+			*value = int32_t(GetInt(p, 4));
+		}
+		uint32_t loudness = uint32_t(GetInt(p, 4));
+		memcpy(&info.loudness, &loudness, 4);
+		size_t count = size_t(GetInt(p, 4));
+		if ((size_t(end - p) - 4) / 2 < count) return false;	// the subsong count follows.
+		entry.Instruments.resize(count);
+		for (auto &inst : entry.Instruments) inst = uint16_t(GetInt(p, 2));
+		info.numinstruments = int(count);
+		count = size_t(GetInt(p, 4));
+		if (size_t(end - p) / 4 < count) return false;
+		entry.SubsongLengths.resize(count);
+		for (auto &length : entry.SubsongLengths) length = int32_t(GetInt(p, 4));
+		if (info.state != ZMUSIC_SONGINFO_READY && info.state != ZMUSIC_SONGINFO_FAILED) return false;
+		InfoCache[{ info.hash, info.size }] = std::move(entry);
+	}
+	return p == end;
+}
+
+static bool ReadFile(const char *filename, std::vector<uint8_t> &data)
+{
+	FILE *f = MusicIO::utf8_fopen(filename, "rb");
+	if (f == nullptr) return false;
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data.resize(std::max(length, 0L));
+	bool res = length >= 0 && fread(data.data(), 1, data.size(), f) == data.size();
+	fclose(f);
+	return res;
+}
+
+//==========================================================================
+//
+// RunAnalysis
+//
+// The job that works through the queue.
+//
+//==========================================================================
+
+static void RunAnalysis()
+{
+	for (;;)
+	{
+		FSongInfoRequest request;
+		{
+			std::lock_guard<std::mutex> lock(InfoLock);
+			if (InfoQueue.empty())
+			{
+				AnalysisRunning = false;
+				return;
+			}
+			request = std::move(InfoQueue.front());
+			InfoQueue.pop_front();
+		}
+
+		FSongInfoKey key = { request.Hash, request.Size };
+		if (!request.FileName.empty() && (!ReadFile(request.FileName.c_str(), request.Data) ||
+			request.Data.size() != request.Size || SongCache_HashData(request.Data.data(), request.Data.size()) != request.Hash))
+		{
+			// The file changed in the meantime. Whoever asks for it next queues it again.
+			std::lock_guard<std::mutex> lock(InfoLock);
+			InfoCache.erase(key);
+			continue;
+		}
+
+		FSongInfoEntry entry = {};
+		entry.Info.hash = request.Hash;
+		entry.Info.size = request.Size;
+		try
+		{
+			Analyze(request.Data.data(), request.Data.size(), entry);
+		}
+		catch (const std::exception &)
+		{
+			entry.Info.state = ZMUSIC_SONGINFO_FAILED;
+		}
+		if (entry.Info.state != ZMUSIC_SONGINFO_READY)
+		{
+			entry = {};
+			entry.Info.hash = request.Hash;
+			entry.Info.size = request.Size;
+			entry.Info.state = ZMUSIC_SONGINFO_FAILED;
+		}
+
+		std::lock_guard<std::mutex> lock(InfoLock);
+		if (InfoFile != nullptr) WriteEntry(InfoFile, entry);
+		InfoCache[key] = std::move(entry);
+	}
+}
+
+//==========================================================================
+//
+// QueryInfo
+//
+// Without 'mem' and 'filename' songs that are not known yet are left
+// alone, otherwise they get queued with either of them.
+//
+//==========================================================================
+
+static bool QueryInfo(uint64_t hash, uint64_t size, const void *mem, const char *filename, ZMusicSongInfo *info)
+{
+	std::lock_guard<std::mutex> lock(InfoLock);
+	auto it = InfoCache.find({ hash, size });
+	if (it != InfoCache.end())
+	{
+		*info = it->second.Info;
+		return info->state == ZMUSIC_SONGINFO_READY;
+	}
+
+	*info = {};
+	info->hash = hash;
+	info->size = size;
+	if (mem == nullptr && filename == nullptr)
+	{
+		info->state = ZMUSIC_SONGINFO_UNKNOWN;
+		return false;
+	}
+
+	info->state = ZMUSIC_SONGINFO_PENDING;
+	InfoCache[{ hash, size }].Info = *info;
+	FSongInfoRequest request = { hash, size };
+	if (filename != nullptr) request.FileName = filename;
+	else request.Data.assign((const uint8_t *)mem, (const uint8_t *)mem + size);
+	InfoQueue.push_back(std::move(request));
+	if (!AnalysisRunning)
+	{
+		AnalysisRunning = true;
+		ZMusic_SubmitJob(JOB_OFFLINE, RunAnalysis);
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// the API
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_GetSongInfo(const void *mem, size_t size, ZMusicSongInfo *info)
+{
+	if (mem == nullptr || size == 0 || info == nullptr)
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+	return QueryInfo(SongCache_HashData((const uint8_t *)mem, size), size, mem, nullptr, info);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_GetSongInfoFile(const char *filename, ZMusicSongInfo *info)
+{
+	if (filename == nullptr || info == nullptr)
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+	std::vector<uint8_t> data;
+	if (!ReadFile(filename, data) || data.empty())
+	{
+		SetError("Unable to read file");
+		*info = {};
+		return false;
+	}
+	return QueryInfo(SongCache_HashData(data.data(), data.size()), data.size(), nullptr, filename, info);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_GetSongInfoByHash(uint64_t hash, uint64_t size, ZMusicSongInfo *info)
+{
+	if (info == nullptr) return false;
+	return QueryInfo(hash, size, nullptr, nullptr, info);
+}
+
+DLL_EXPORT int ZMusic_GetSongInstruments(uint64_t hash, uint64_t size, uint16_t *instruments, int max)
+{
+	std::lock_guard<std::mutex> lock(InfoLock);
+	auto it = InfoCache.find({ hash, size });
+	if (it == InfoCache.end()) return 0;
+	auto &list = it->second.Instruments;
+	if (instruments != nullptr && max > 0) std::copy_n(list.begin(), std::min<size_t>(max, list.size()), instruments);
+	return int(list.size());
+}
+
+DLL_EXPORT int ZMusic_GetSongSubsongLengths(uint64_t hash, uint64_t size, int *lengths, int max)
+{
+	std::lock_guard<std::mutex> lock(InfoLock);
+	auto it = InfoCache.find({ hash, size });
+	if (it == InfoCache.end()) return 0;
+	auto &list = it->second.SubsongLengths;
+	if (lengths != nullptr && max > 0) std::copy_n(list.begin(), std::min<size_t>(max, list.size()), lengths);
+	return int(list.size());
+}
+
+DLL_EXPORT zmusic_bool ZMusic_SetSongInfoCache(const char *filename)
+{
+	std::lock_guard<std::mutex> lock(InfoLock);
+	if (InfoFile != nullptr)
+	{
+		fclose(InfoFile);
+		InfoFile = nullptr;
+	}
+	if (filename == nullptr) return true;
+
+	// Appending only works if the file already has everything that is in memory.
+	bool rewrite = false;
+	for (auto &pair : InfoCache)
+	{
+		if (pair.second.Info.state != ZMUSIC_SONGINFO_PENDING) rewrite = true;
+	}
+	std::vector<uint8_t> file;
+	if (!ReadFile(filename, file) || !LoadEntries(file)) rewrite = true;
+
+	InfoFile = MusicIO::utf8_fopen(filename, rewrite ? "wb" : "ab");
+	if (InfoFile == nullptr)
+	{
+		SetError("Unable to open song info cache");
+		return false;
+	}
+	if (rewrite)
+	{
+		fwrite(InfoHeader, 1, 8, InfoFile);
+		for (auto &pair : InfoCache)
+		{
+			if (pair.second.Info.state != ZMUSIC_SONGINFO_PENDING) WriteEntry(InfoFile, pair.second);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// Where a song is, for ZMusic_GetPosition.
+//
+// The thread servicing the stream publishes where the song got to after
+// every block it renders. Readers check a sequence count before and after
+// copying it and try again if it changed in between, so any thread can read
+// it without locking. Prerendering and the render quantum render ahead of
+// what gets handed out, so the frames handed out are counted separately and
+// readers take the position back by the difference.
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <algorithm>
+#include "zmusic_internal.h"
+
+class FSongPosition
+{
+public:
+	// For ZMusic_Start.
+	void Reset()
+	{
+		Rendered = 0;
+		Delivered.store(0, std::memory_order_relaxed);
+		Publish(0, nullptr, 0);
+	}
+
+	// After every block that was rendered, with the musical part of the position the song
+	// got to and the ticks it plays per frame, or null for songs that do not know it.
+	void Publish(uint64_t frames, const ZMusicPosition *pos, double ticksperframe)
+	{
+		Snapshot snap;
+		memset(&snap, 0, sizeof(snap));
+		if (pos != nullptr) snap.Pos = *pos;
+		else snap.Pos.order = snap.Pos.row = -1;
+		Rendered += frames;
+		snap.Pos.frames = Rendered;
+		snap.TicksPerFrame = ticksperframe;
+
+		uint64_t words[WORDS] = {};
+		memcpy(words, &snap, sizeof(snap));
+		uint32_t seq = Sequence.load(std::memory_order_relaxed);
+		Sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (int i = 0; i < WORDS; i++) Words[i].store(words[i], std::memory_order_relaxed);
+		Sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	// The output format's frame size, so that the frames handed out can be counted from the bytes.
+	void SetFrameSize(int framesize) { FrameSize.store(framesize, std::memory_order_relaxed); }
+
+	// For the client's thread, after every buffer it was handed.
+	void AddDelivered(size_t bytes)
+	{
+		int framesize = FrameSize.load(std::memory_order_relaxed);
+		if (framesize > 0) Delivered.store(Delivered.load(std::memory_order_relaxed) + bytes / framesize, std::memory_order_relaxed);
+	}
+
+	// Any thread.
+	void Get(ZMusicPosition &pos) const
+	{
+		Snapshot snap;
+		uint64_t words[WORDS];
+		for (;;)
+		{
+			uint32_t seq = Sequence.load(std::memory_order_acquire);
+			if (seq & 1) continue;
+			for (int i = 0; i < WORDS; i++) words[i] = Words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (Sequence.load(std::memory_order_relaxed) == seq) break;
+		}
+		memcpy(&snap, words, sizeof(snap));
+		pos = snap.Pos;
+
+		uint64_t delivered = Delivered.load(std::memory_order_relaxed);
+		if (delivered < pos.frames && pos.ticksPerBeat > 0)
+		{
+			// Only back to the start of the bar, what came before it is not known any more.
+			double back = std::min((pos.frames - delivered) * snap.TicksPerFrame, pos.beat * pos.ticksPerBeat);
+			pos.tick -= back;
+			pos.beat -= back / pos.ticksPerBeat;
+			if (pos.row >= 0) pos.row = int(pos.tick);
+		}
+		pos.frames = std::min(delivered, pos.frames);
+	}
+
+private:
+	struct Snapshot
+	{
+		ZMusicPosition Pos;
+		double TicksPerFrame;
+	};
+	enum { WORDS = (sizeof(Snapshot) + 7) / 8 };
+
+	std::atomic<uint32_t> Sequence{ 0 };
+	std::atomic<uint64_t> Words[WORDS] = {};
+	std::atomic<int> FrameSize{ 0 };
+	std::atomic<uint64_t> Delivered{ 0 };
+	uint64_t Rendered = 0;	// only used by the thread servicing the stream.
+};
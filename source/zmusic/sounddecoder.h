@@ -1,16 +1,36 @@
 #pragma once
 
 #include "zmusic_internal.h"
+#include "allocator.h"
 #include <vector>
 
-struct SoundDecoder
+struct SoundDecoder;
+
+// An entry in the list of decoders CreateDecoder tries. Probe gets the start of
+// the file and lets CreateDecoder skip decoders that would not open it anyway,
+// it may be null for decoders that have to try everything.
+struct SoundDecoderFactory
+{
+	const char* Name;
+	int Priority;	// higher ones get tried first.
+	bool (*Probe)(const uint8_t* header, size_t length);
+	SoundDecoder* (*Create)();
+};
+
+struct SoundDecoder : public FMusicAllocated
 {
 	static SoundDecoder* CreateDecoder(MusicIO::FileInterface* reader);
+	static void Register(const SoundDecoderFactory& factory);	// replaces an existing one of the same name.
 
     virtual void getInfo(int *samplerate, ChannelConfig *chans, SampleType *type) = 0;
 
     virtual size_t read(char *buffer, size_t bytes) = 0;
+    // Reads like read, but goes back to loopstart whenever loopend is reached, in frames.
+    // Less than 'bytes' means the decoder could not get any further.
+    virtual size_t readLooped(char *buffer, size_t bytes, size_t loopstart, size_t loopend);
     virtual std::vector<uint8_t> readAll();
+    // Switches what read produces, for decoders that can do so without converting. getInfo reports the new type.
+    virtual bool setSampleType(SampleType type) { return false; }
     virtual bool seek(size_t ms_offset, bool ms, bool mayrestart) = 0;
     virtual size_t getSampleOffset() = 0;
     virtual size_t getSampleLength() { return 0; }
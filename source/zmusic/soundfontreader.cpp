@@ -0,0 +1,203 @@
+/*
+** soundfontreader.cpp
+** File system lookup for sound font and patch set readers.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#endif
+#include <ctype.h>
+#include "fileio.h"
+
+namespace MusicIO
+{
+
+//==========================================================================
+//
+// FoldName
+//
+// On case insensitive file systems the index must not reject a name that
+// differs in case. Folding too much on a case sensitive one only costs a
+// failed open.
+//
+//==========================================================================
+
+#if defined _WIN32 || defined __APPLE__
+static std::string FoldName(const char *name, size_t len)
+{
+	std::string folded(name, len);
+	for (auto &c : folded)
+	{
+		if ((unsigned char)c < 0x80) c = (char)tolower((unsigned char)c);
+	}
+	return folded;
+}
+#else
+static std::string FoldName(const char *name, size_t len)
+{
+	return std::string(name, len);
+}
+#endif
+
+//==========================================================================
+//
+// ListDirectory
+//
+// Returns false if the directory exists but cannot be listed. A directory
+// that does not exist gets an empty, valid listing.
+//
+//==========================================================================
+
+static bool ListDirectory(const std::string &dir, std::unordered_set<std::string> &names)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAW fd;
+	auto pattern = wideString((dir + "*").c_str());
+	HANDLE h = FindFirstFileW(pattern.c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE)
+	{
+		DWORD err = GetLastError();
+		return err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND;
+	}
+	do
+	{
+		char buffer[MAX_PATH * 3];
+		int len = WideCharToMultiByte(CP_UTF8, 0, fd.cFileName, -1, buffer, sizeof(buffer), nullptr, nullptr);
+		if (len > 1) names.insert(FoldName(buffer, len - 1));
+	} while (FindNextFileW(h, &fd));
+	FindClose(h);
+	return true;
+#else
+	DIR *d = opendir(dir.c_str());
+	if (d == nullptr) return errno == ENOENT || errno == ENOTDIR;
+	while (struct dirent *entry = readdir(d))
+	{
+		names.insert(FoldName(entry->d_name, strlen(entry->d_name)));
+	}
+	closedir(d);
+	return true;
+#endif
+}
+
+//==========================================================================
+//
+// FileSystemSoundFontReader :: MayExist
+//
+// Checks fn against the listing of the directory it would be in. Names
+// with subdirectories get the subdirectory listed.
+//
+//==========================================================================
+
+bool FileSystemSoundFontReader::MayExist(const std::string &path, const char *fn)
+{
+	const char *base = fn;
+	for (const char *p = fn; *p; p++)
+	{
+		if (*p == '/' || *p == '\\') base = p + 1;
+	}
+	if (*base == 0) return true;
+
+	std::string dir = path;
+	dir.append(fn, base - fn);
+	auto it = mIndex.find(dir);
+	if (it == mIndex.end())
+	{
+		it = mIndex.emplace(dir, DirectoryIndex()).first;
+		it->second.Valid = ListDirectory(dir, it->second.Names);
+	}
+	if (!it->second.Valid) return true;
+	return it->second.Names.count(FoldName(base, strlen(base))) > 0;
+}
+
+//==========================================================================
+//
+// FileSystemSoundFontReader :: OpenFile
+//
+// Patches and sound fonts get read in many small pieces, which a mapping
+// serves without a call into the C library for each.
+//
+//==========================================================================
+
+FileInterface* FileSystemSoundFontReader::OpenFile(const std::string &fullname)
+{
+	auto fr = OpenMappedFile(fullname.c_str());
+	if (fr) return fr;
+
+	FILE *f = utf8_fopen(fullname.c_str(), "rb");
+	if (!f) return nullptr;
+	auto tf = new StdioFileReader;
+	tf->f = f;
+	tf->filename = fullname;
+	return tf;
+}
+
+//==========================================================================
+//
+// FileSystemSoundFontReader :: open_file
+//
+//==========================================================================
+
+FileInterface* FileSystemSoundFontReader::open_file(const char* fn)
+{
+	if (!fn) return OpenFile(mBaseFile);
+
+	if (!IsAbsPath(fn))
+	{
+		for (int i = (int)mPaths.size() - 1; i >= 0; i--)
+		{
+			if (!MayExist(mPaths[i], fn)) continue;
+			auto fr = OpenFile(mPaths[i] + fn);
+			if (fr) return fr;
+		}
+	}
+	return OpenFile(fn);
+}
+
+//==========================================================================
+//
+// FileSystemSoundFontReader :: add_search_path
+//
+//==========================================================================
+
+void FileSystemSoundFontReader::add_search_path(const char* path)
+{
+	std::string p = path;
+	if (p.back() != '/' && p.back() != '\\') p += '/';	// always let it end with a slash.
+	mPaths.push_back(p);
+}
+
+}
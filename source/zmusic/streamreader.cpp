@@ -0,0 +1,192 @@
+/*
+** streamreader.cpp
+** Reads songs whose data is still arriving.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include "zmusic_internal.h"
+
+enum
+{
+	READ_CHUNK = 65536,	// what gets asked of the client at a time.
+	POLL_MS = 50,		// how long to wait for a client that does not call 'ready'.
+};
+
+//==========================================================================
+//
+// A reader for a ZMusicStreamReader. Everything the client hands over is
+// kept, so seeking back never has to ask it again, and reads and seeks
+// ahead of that wait for more. Only the reading thread touches the data,
+// 'ready' and cancel may come from anywhere and just wake it up.
+//
+//==========================================================================
+
+struct StreamFileReader : public MusicIO::FileInterface
+{
+	ZMusicStreamReader *mReader;
+	std::vector<uint8_t> mData;
+	long mPos = 0;
+	size_t mPrebuffer;
+	bool mEnded = false;
+
+	std::mutex mLock;
+	std::condition_variable mArrived;
+	bool mSignaled = false;
+	std::atomic<bool> mCancelled{ false };
+
+	StreamFileReader(ZMusicStreamReader *reader, size_t prebuffer)
+		: mReader(reader), mPrebuffer(prebuffer)
+	{
+		reader->ready = &Ready;
+		reader->readyContext = this;
+	}
+
+	static void Ready(void *context)
+	{
+		auto self = (StreamFileReader *)context;
+		{
+			std::lock_guard<std::mutex> lock(self->mLock);
+			self->mSignaled = true;
+		}
+		self->mArrived.notify_all();
+	}
+
+	// Gets data from the client until there are 'want' bytes, the data ended
+	// or the reader got cancelled.
+	bool Fill(size_t want)
+	{
+		size_t wait = std::max(want, mPrebuffer);
+		mPrebuffer = 0;
+		while (mData.size() < wait && !mEnded && !mCancelled.load(std::memory_order_relaxed))
+		{
+			{
+				// Cleared before the read, so a 'ready' right after it is not missed.
+				std::lock_guard<std::mutex> lock(mLock);
+				mSignaled = false;
+			}
+			size_t have = mData.size();
+			mData.resize(have + READ_CHUNK);
+			long got = mReader->read(mReader, mData.data() + have, READ_CHUNK);
+			mData.resize(have + std::min<long>(std::max(got, 0L), READ_CHUNK));
+			if (got == ZMUSIC_READ_WOULDBLOCK)
+			{
+				std::unique_lock<std::mutex> lock(mLock);
+				mArrived.wait_for(lock, std::chrono::milliseconds(POLL_MS), [this] { return mSignaled || mCancelled.load(std::memory_order_relaxed); });
+			}
+			else if (got <= 0)
+			{
+				mEnded = true;
+				length = (long)mData.size();
+			}
+		}
+		return mData.size() >= want;
+	}
+
+	// The total size as the client reports it, or as much as there turned out to be.
+	long Total()
+	{
+		if (length < 0 && mReader->length != nullptr)
+		{
+			long len = mReader->length(mReader);
+			if (len >= 0)
+			{
+				length = len;
+				mData.reserve(len);
+			}
+		}
+		if (length < 0) Fill(SIZE_MAX);
+		return length >= 0 ? length : (long)mData.size();
+	}
+
+	char* gets(char* buff, int n) override
+	{
+		return nullptr;
+	}
+	long read(void* buff, int32_t size) override
+	{
+		ZMUSIC_RT_CHECK(RTV_FILEIO, "ZMusicStreamReader::read");
+		if (size <= 0) return 0;
+		Fill(size_t(mPos) + size);
+		long len = std::min<long>(size, std::max<long>((long)mData.size() - mPos, 0));
+		memcpy(buff, mData.data() + mPos, len);
+		mPos += len;
+		return len;
+	}
+	long seek(long offset, int whence) override
+	{
+		ZMUSIC_RT_CHECK(RTV_FILEIO, "ZMusicStreamReader::seek");
+		switch (whence)
+		{
+		case SEEK_CUR:
+			offset += mPos;
+			break;
+
+		case SEEK_END:
+			offset += Total();
+			break;
+		}
+		if (offset < 0 || !Fill(offset)) return -1;
+		mPos = offset;
+		return 0;
+	}
+	long tell() override
+	{
+		return mPos;
+	}
+	void close() override
+	{
+		mReader->close(mReader);
+		delete this;
+	}
+	bool mayWait() override
+	{
+		return !mEnded;
+	}
+	void cancel() override
+	{
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mCancelled.store(true, std::memory_order_relaxed);
+		}
+		mArrived.notify_all();
+	}
+};
+
+MusicIO::FileInterface *OpenStreamReader(ZMusicStreamReader *reader, size_t prebuffer)
+{
+	return new StreamFileReader(reader, prebuffer);
+}
@@ -0,0 +1,269 @@
+/*
+** trace.cpp
+** Records the calls made to the library for zmusic-replay.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+** Records are collected in memory and written by whichever call other
+** than ZMusic_FillStream finds the buffer getting full, so that the audio
+** thread only waits for the disk if the client never calls anything else.
+** The buffer is reserved up front, so the audio thread does not allocate
+** either. It does take a lock that the other threads only hold to append
+** a record or to swap the buffer out.
+**
+*/
+
+#include <string.h>
+#include <mutex>
+#include <vector>
+#include "trace.h"
+#include "musinfo.h"
+#include "fileio.h"
+
+std::atomic<bool> ZMusic_Tracing{ false };
+
+enum
+{
+	FlushSize = 64 * 1024,			// what the other calls write out.
+	RenderFlushSize = 512 * 1024,	// what the audio thread writes out if nothing else does.
+	ReserveSize = 1024 * 1024,
+};
+
+static FCriticalSection TraceLock;		// for everything below but the file.
+static std::vector<uint8_t> TraceBuffer;
+static uint64_t LastStart;				// FPerfCounters::Now() of the last record.
+static std::atomic<uint32_t> NextStream{ 1 };
+static std::atomic<uint32_t> FirstStream{ 1 };	// the first stream opened while the trace runs.
+static std::atomic<uint32_t> NextThread{ 1 };
+static thread_local uint32_t TraceThread;
+
+static std::mutex FileLock;				// for the file and the spare buffer.
+static FILE *TraceFile;
+static std::vector<uint8_t> SpareBuffer;
+
+//==========================================================================
+//
+// encoding
+//
+//==========================================================================
+
+static void PutUnsigned(std::string &out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out += char((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	out += char(value);
+}
+
+static void PutUnsigned(std::vector<uint8_t> &out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(uint8_t((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(uint8_t(value));
+}
+
+static uint64_t ZigZag(int64_t value)
+{
+	return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+uint64_t ZMusic_TraceHash(const uint8_t *data, size_t size, uint64_t hash)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+//==========================================================================
+//
+// FTraceCall
+//
+//==========================================================================
+
+void FTraceCall::Begin(ETraceRecord type, MusInfo *song)
+{
+	if (type == TRACE_OPEN) song = nullptr;
+	else if (song != nullptr)
+	{
+		if (song->TraceStream >= FirstStream.load(std::memory_order_relaxed)) Stream = song->TraceStream;
+		else if (type < TRACE_SETTINGINT) return;	// opened before the trace started, so the replay has no song for it.
+	}
+	Type = type;
+	Start = FPerfCounters::Now();
+}
+
+void FTraceCall::SetSong(MusInfo *song)
+{
+	if (Type == TRACE_NONE || song == nullptr) return;
+	Stream = song->TraceStream = NextStream.fetch_add(1, std::memory_order_relaxed);
+}
+
+FTraceCall &FTraceCall::Unsigned(uint64_t value)
+{
+	if (Type != TRACE_NONE) PutUnsigned(Args, value);
+	return *this;
+}
+
+FTraceCall &FTraceCall::Signed(int64_t value)
+{
+	if (Type != TRACE_NONE) PutUnsigned(Args, ZigZag(value));
+	return *this;
+}
+
+FTraceCall &FTraceCall::Float(float value)
+{
+	if (Type != TRACE_NONE)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, 4);
+		for (int i = 0; i < 4; i++) Args += char(bits >> (i * 8));
+	}
+	return *this;
+}
+
+FTraceCall &FTraceCall::Hash(uint64_t value)
+{
+	if (Type != TRACE_NONE)
+	{
+		for (int i = 0; i < 8; i++) Args += char(value >> (i * 8));
+	}
+	return *this;
+}
+
+FTraceCall &FTraceCall::String(const char *value)
+{
+	if (Type != TRACE_NONE)
+	{
+		size_t len = value ? strlen(value) : 0;
+		PutUnsigned(Args, len);
+		Args.append(value ? value : "", len);
+	}
+	return *this;
+}
+
+static void FlushTrace();
+
+void FTraceCall::Commit()
+{
+	uint64_t now = FPerfCounters::Now();
+	if (TraceThread == 0) TraceThread = NextThread.fetch_add(1, std::memory_order_relaxed);
+	bool flush;
+	{
+		std::lock_guard<FCriticalSection> lock(TraceLock);
+		if (!ZMusic_Tracing.load(std::memory_order_relaxed)) return;	// stopped meanwhile.
+		TraceBuffer.push_back(Type);
+		int64_t delta = int64_t(Start - LastStart) / 1000;
+		PutUnsigned(TraceBuffer, ZigZag(delta));
+		LastStart += delta * 1000;	// keeps the remainders from adding up.
+		PutUnsigned(TraceBuffer, TraceThread);
+		PutUnsigned(TraceBuffer, Stream);
+		PutUnsigned(TraceBuffer, now - Start);
+		TraceBuffer.insert(TraceBuffer.end(), Args.begin(), Args.end());
+		flush = TraceBuffer.size() >= ((Type == TRACE_FILL || Type == TRACE_RENDER) ? RenderFlushSize : FlushSize);
+	}
+	if (flush) FlushTrace();
+}
+
+//==========================================================================
+//
+// FlushTrace
+//
+//==========================================================================
+
+static void FlushTrace()
+{
+	std::lock_guard<std::mutex> filelock(FileLock);
+	if (TraceFile == nullptr) return;
+	{
+		std::lock_guard<FCriticalSection> lock(TraceLock);
+		std::swap(TraceBuffer, SpareBuffer);
+	}
+	if (!SpareBuffer.empty()) fwrite(SpareBuffer.data(), 1, SpareBuffer.size(), TraceFile);
+	SpareBuffer.clear();
+}
+
+//==========================================================================
+//
+// ZMusic_StartTrace / ZMusic_StopTrace
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_StartTrace(const char *filename)
+{
+	ZMusic_StopTrace();
+	if (filename == nullptr)
+	{
+		SetError("No trace file specified");
+		return false;
+	}
+	FILE *f = MusicIO::utf8_fopen(filename, "wb");
+	if (f == nullptr)
+	{
+		SetError("Unable to create trace file");
+		return false;
+	}
+	static const char header[8] = { 'Z', 'M', 'T', 'R', 'A', 'C', 'E', TRACE_VERSION };
+	fwrite(header, 1, 8, f);
+
+	std::lock_guard<std::mutex> filelock(FileLock);
+	std::lock_guard<FCriticalSection> lock(TraceLock);
+	TraceFile = f;
+	TraceBuffer.clear();
+	TraceBuffer.reserve(ReserveSize);
+	SpareBuffer.clear();
+	SpareBuffer.reserve(ReserveSize);
+	LastStart = FPerfCounters::Now();
+	FirstStream.store(NextStream.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	ZMusic_Tracing.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+DLL_EXPORT void ZMusic_StopTrace()
+{
+	{
+		std::lock_guard<FCriticalSection> lock(TraceLock);
+		if (!ZMusic_Tracing.load(std::memory_order_relaxed)) return;
+		ZMusic_Tracing.store(false, std::memory_order_relaxed);
+	}
+	FlushTrace();
+	std::lock_guard<std::mutex> filelock(FileLock);
+	std::lock_guard<FCriticalSection> lock(TraceLock);
+	fclose(TraceFile);
+	TraceFile = nullptr;
+	std::vector<uint8_t>().swap(TraceBuffer);
+	std::vector<uint8_t>().swap(SpareBuffer);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+
+// Records the public calls made on songs into the trace started by
+// ZMusic_StartTrace, so that samples/zmusic-replay can play them back
+// with the same songs, settings and buffer sizes and time every call.
+//
+// The file starts with "ZMTRACE" and a version byte. Every record after
+// that is made of
+//   the type byte,
+//   the time of the call in microseconds after that of the previous record,
+//     which can be negative when calls on different threads overlap,
+//   the number of the calling thread, counted from 1 in the order they first made a call,
+//   the number of the stream, counted from 1 in the order they were opened, 0 for none,
+//   how long the call took in nanoseconds,
+//   the arguments listed for the type.
+// Integers are LEB128 numbers, signed ones zigzag encoded. Floats are 4
+// bytes and the song hash 8 bytes, little endian. Strings are their
+// length followed by the characters.
+//
+// Songs are only identified by the FNV-1a hash of their data, the trace
+// never contains them.
+
+enum ETraceRecord : uint8_t
+{
+	TRACE_NONE,
+	TRACE_OPEN,				// device, args, song size, song hash, file name without the path. The stream is 0 if it failed.
+	TRACE_CLOSE,
+	TRACE_START,			// subsong, loop
+	TRACE_STOP,
+	TRACE_PAUSE,
+	TRACE_RESUME,
+	TRACE_UPDATE,
+	TRACE_VOLUMECHANGED,
+	TRACE_FILL,				// bytes
+	TRACE_RENDER,			// frames, flags
+	TRACE_SETSUBSONG,		// subsong
+	TRACE_PREPARESUBSONG,	// subsong, crossfade ms
+	TRACE_SETPOSITION,		// ms
+	TRACE_SETGAIN,			// gain, fade ms
+	TRACE_SETVIRTUAL,		// on
+	TRACE_SETFORMAT,		// sample type, planar
+	TRACE_PRERENDER,		// depth ms
+	TRACE_SETBUFFERING,		// number of buffers, buffer ms
+	TRACE_SETTINGINT,		// key, value
+	TRACE_SETTINGFLOAT,		// key, value
+	TRACE_SETTINGSTRING,	// key, value
+};
+
+enum { TRACE_VERSION = 1 };
+
+class MusInfo;
+
+extern std::atomic<bool> ZMusic_Tracing;
+
+// One call. Collects the arguments and writes the record when it goes out
+// of scope. Does nothing unless a trace is running and the song was opened
+// while it was, except for settings, which are always recorded since they
+// also change the context.
+class FTraceCall
+{
+	ETraceRecord Type = TRACE_NONE;
+	uint32_t Stream = 0;
+	uint64_t Start = 0;
+	std::string Args;
+
+	void Begin(ETraceRecord type, MusInfo *song);
+	void Commit();
+
+public:
+	FTraceCall(ETraceRecord type, MusInfo *song)
+	{
+		if (ZMusic_Tracing.load(std::memory_order_relaxed)) Begin(type, song);
+	}
+	~FTraceCall()
+	{
+		if (Type != TRACE_NONE) Commit();
+	}
+	FTraceCall(const FTraceCall &) = delete;
+	FTraceCall &operator=(const FTraceCall &) = delete;
+
+	bool Active() const { return Type != TRACE_NONE; }
+	// For TRACE_OPEN, which only gets its song at the end. Numbers it for the trace.
+	void SetSong(MusInfo *song);
+
+	FTraceCall &Unsigned(uint64_t value);
+	FTraceCall &Signed(int64_t value);
+	FTraceCall &Float(float value);
+	FTraceCall &Hash(uint64_t value);
+	FTraceCall &String(const char *value);
+};
+
+// FNV-1a, which is what the trace identifies songs by.
+uint64_t ZMusic_TraceHash(const uint8_t *data, size_t size, uint64_t hash = 14695981039346656037ull);
@@ -0,0 +1,450 @@
+/*
+** wavedump.cpp
+** Renders songs of any type to wave or FLAC files as fast as possible.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "zmusic_internal.h"
+#include "musinfo.h"
+#include "midiconfig.h"
+#include "jobs.h"
+#include "wavefile.h"
+
+//==========================================================================
+//
+// DumpWave
+//
+// Renders one second per call like ZMusic_RenderToBuffer, into one block
+// while the other is being written. The song gets switched to float
+// output, which the file writer converts as zmusic_snd_dumpformat says.
+//
+//==========================================================================
+
+static bool DumpWave(MusInfo *song, const char *outname, int maxseconds, int loops)
+{
+	if (song->Prerender)
+	{
+		SetError("Cannot dump a prerendered stream");
+		return false;
+	}
+	if (song->m_Status == MusInfo::STATE_Stopped)
+	{
+		SetError("Song must be started before it can be dumped");
+		return false;
+	}
+	if (!ZMusic_SetStreamFormat(song, SampleType_Float32, false)) return false;
+
+	// Without loops the render ends where the song would loop. Otherwise
+	// the length is only known if the song can tell where its loop is.
+	int64_t limit_ms = maxseconds > 0 ? int64_t(maxseconds) * 1000 : -1;
+	int flags = 0;
+	if (!song->m_Looping || loops <= 0)
+	{
+		flags = ZMUSIC_RENDER_STOPATLOOP;
+	}
+	else
+	{
+		int loopstart, loopend;
+		if (ZMusic_GetLoopPoints(song, &loopstart, &loopend) && loopend > loopstart)
+		{
+			int64_t length = loopend + int64_t(loops) * (loopend - loopstart);
+			if (limit_ms < 0 || length < limit_ms) limit_ms = length;
+		}
+		if (limit_ms < 0)
+		{
+			SetError("The length of this song is unknown, so looping it needs a time limit");
+			return false;
+		}
+	}
+
+	SoundStreamInfoEx fmt = song->GetOutputInfoEx();
+	const int channels = ZMusic_ChannelCount(fmt.mChannelConfig);
+	const size_t blockframes = std::max(fmt.mSampleRate, 1);
+	const size_t limit = limit_ms < 0 ? SIZE_MAX : size_t(limit_ms * fmt.mSampleRate / 1000);
+
+	TMusicVector<float> blocks[2];
+	FWaveFile wave;		// after the blocks, so that it waits for the last write before they go away.
+	blocks[0].resize(blockframes * channels);
+	blocks[1].resize(blockframes * channels);
+	wave.Open(outname, miscConfig.snd_dumpformat, fmt.mSampleRate, channels);
+
+	if (!song->SetOfflineMode(true, flags))
+	{
+		SetError("Song cannot be rendered offline");
+		return false;
+	}
+	try
+	{
+		int current = 0;
+		bool more = true;
+		for (size_t done = 0; more && done < limit; done += blockframes)
+		{
+			size_t frames = std::min(blockframes, limit - done);
+			int produced;
+			more = song->ServiceOutput(blocks[current].data(), int(frames * channels * sizeof(float)), &produced);
+			// The block the song ended in is only written up to the end.
+			wave.Write(blocks[current].data(), (more ? frames : produced) * channels);
+			current ^= 1;
+		}
+		wave.Finish();
+	}
+	catch (...)
+	{
+		song->SetOfflineMode(false, flags);
+		throw;
+	}
+	song->SetOfflineMode(false, flags);
+
+	if (!wave.Close())
+	{
+		char buffer[80];
+		snprintf(buffer, 80, "Could not finish writing wave file: %s\n", strerror(errno));
+		SetError(buffer);
+		return false;
+	}
+	return true;
+}
+
+static bool TryDumpWave(MusInfo *song, const char *outname, int maxseconds, int loops)
+{
+	FConfigScope config(song->Config);	// for zmusic_snd_dumpformat.
+	try
+	{
+		return DumpWave(song, outname, maxseconds, loops);
+	}
+	catch (const std::exception &ex)
+	{
+		SetError(ex.what());
+		return false;
+	}
+}
+
+//==========================================================================
+//
+// ZMusic_DumpWave
+//
+// Like ZMusic_RenderToBuffer no locking takes place here, the client
+// guarantees that nothing else services the song while it is dumped.
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_DumpWave(MusInfo* song, const char* outname, int maxseconds, int loops)
+{
+	if (song == nullptr || outname == nullptr)
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+	return TryDumpWave(song, outname, maxseconds, loops);
+}
+
+//==========================================================================
+//
+// ZMusic_DumpWaveBatch
+//
+// Each worker takes the next song until none are left. Errors are set on
+// the worker's thread, so the message of the first failed file in the
+// list gets passed on to the caller's along with the count.
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_DumpWaveBatch(const ZMusic_MusicStream* songs, const char* const* outnames, int count, int maxseconds, int loops, int numthreads, zmusic_bool* results)
+{
+	if (!songs || !outnames || count < 0)
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+
+	std::atomic<int> next{ 0 };
+	std::atomic<int> failed{ 0 };
+	std::mutex errorlock;
+	int firstfailed = count;
+	std::string firsterror;
+	auto work = [&]()
+	{
+		for (int i; (i = next++) < count; )
+		{
+			bool success = songs[i] && outnames[i] && TryDumpWave(songs[i], outnames[i], maxseconds, loops);
+			if (results) results[i] = success;
+			if (!success)
+			{
+				failed++;
+				std::lock_guard<std::mutex> lock(errorlock);
+				if (i < firstfailed)
+				{
+					firstfailed = i;
+					firsterror = outnames[i] == nullptr ? "missing file name" : std::string(outnames[i]) + ": " + (songs[i] ? ZMusic_GetLastError() : "missing stream");
+				}
+			}
+		}
+	};
+
+	// Every worker runs the loop, the caller's thread is one of them.
+	if (numthreads <= 0 || numthreads > count) numthreads = count;
+	ZMusic_RunParallel(JOB_OFFLINE, numthreads, numthreads, [](void *context, size_t) { (*(decltype(work) *)context)(); }, &work);
+
+	if (failed > 0)
+	{
+		std::string msg = std::to_string(failed.load()) + " of " + std::to_string(count) + " songs could not be dumped. " + firsterror;
+		SetError(msg.c_str());
+		return false;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// ZMusic_DumpWaveParallel
+//
+// Cuts one song into segments that are rendered at the same time, each
+// by a copy of the song of its own that seeks to a little before where
+// the segment starts. That pre-roll is thrown away, it only gets the
+// voices, envelopes and reverb to where they would have been, so that
+// a short crossfade is enough to hide what is left of the difference.
+//
+// The segments are rendered in rounds of one per thread and written
+// before the next round starts, which keeps the memory for the samples
+// at one minute per thread.
+//
+// The copies open and start one at a time, since device setup works on
+// the global configuration. GUS, Timidity++ and WildMidi share one
+// instrument set that gets filled in while playing, so songs on those are
+// always rendered in one piece.
+//
+//==========================================================================
+
+enum
+{
+	SEGMENT_MIN_MS = 10000,		// below this the pre-roll costs more than the parallelism gains.
+	SEGMENT_MAX_MS = 60000,
+	SEGMENT_PREROLL_MS = 3000,
+	SEGMENT_CROSSFADE_MS = 20,
+};
+
+struct FDumpSegment
+{
+	int StartMs;
+	size_t Preroll = 0;		// frames to drop.
+	size_t Frames = 0;		// to render after the pre-roll, including the crossfade into the next segment.
+	TMusicVector<float> Data;
+	std::string Error;
+};
+
+struct FParallelDump
+{
+	const void *Mem;
+	size_t Size;
+	EMidiDevice Device;
+	const char *Args;
+	int SampleRate;
+	int Channels;
+	FDumpSegment *Segments;
+	std::mutex *SetupLock;
+};
+
+static bool RenderSegment(const FParallelDump &dump, FDumpSegment &seg)
+{
+	std::unique_ptr<MusInfo, void (*)(MusInfo *)> song(nullptr, ZMusic_Close);
+	{
+		std::lock_guard<std::mutex> lock(*dump.SetupLock);
+		song.reset(ZMusic_OpenSongMem(dump.Mem, dump.Size, dump.Device, dump.Args));
+		if (song == nullptr || !ZMusic_Start(song.get(), 0, false)) return false;
+	}
+
+	int seekms = std::max(seg.StartMs - SEGMENT_PREROLL_MS, 0);
+	if (seekms > 0 && !ZMusic_SetPosition(song.get(), seekms))
+	{
+		SetError("Song cannot seek");
+		return false;
+	}
+	if (!ZMusic_SetStreamFormat(song.get(), SampleType_Float32, false)) return false;
+	SoundStreamInfoEx fmt = song->GetOutputInfoEx();
+	if (fmt.mSampleRate != dump.SampleRate || ZMusic_ChannelCount(fmt.mChannelConfig) != dump.Channels)
+	{
+		SetError("Song changed its output format between copies");
+		return false;
+	}
+
+	int64_t startframe = int64_t(seg.StartMs) * dump.SampleRate / 1000;
+	seg.Preroll = size_t(startframe - int64_t(seekms) * dump.SampleRate / 1000);
+	size_t frames = seg.Preroll + seg.Frames;
+	seg.Data.resize(frames * dump.Channels);
+	// The count is short if the song ended, which makes this the last segment. It is
+	// even 0 if the song ended before the preroll, so only an error tells a failure.
+	SetError("");
+	size_t done = ZMusic_RenderToBuffer(song.get(), seg.Data.data(), frames, ZMUSIC_RENDER_STOPATLOOP);
+	if (done == 0 && frames > 0 && *ZMusic_GetLastError() != 0) return false;
+	seg.Data.resize(std::max(done, seg.Preroll) * dump.Channels);
+	return true;
+}
+
+static bool DumpWaveParallel(const void *mem, size_t size, EMidiDevice device, const char *args, const char *outname, int maxseconds, int numthreads)
+{
+	std::unique_ptr<MusInfo, void (*)(MusInfo *)> song(ZMusic_OpenSongMem(mem, size, device, args), ZMusic_Close);
+	if (song == nullptr || !ZMusic_Start(song.get(), 0, false)) return false;
+
+	int64_t limit_ms = ZMusic_GetSongLengthMs(song.get());
+	if (maxseconds > 0 && (limit_ms <= 0 || limit_ms > int64_t(maxseconds) * 1000)) limit_ms = int64_t(maxseconds) * 1000;
+	size_t threads = numthreads > 0 ? std::min<size_t>(numthreads, ZMusic_JobThreads()) : ZMusic_JobThreads();
+	int64_t segment_ms = limit_ms <= 0 ? 0 : std::min<int64_t>(std::max<int64_t>((limit_ms + threads - 1) / threads, SEGMENT_MIN_MS), SEGMENT_MAX_MS);
+
+	// Songs that are short, of unknown length, cannot seek or play on a synth with shared instruments get rendered in one piece.
+	int devtype = ZMusic_GetDeviceType(song.get());
+	bool shared = ZMusic_IsMIDI(song.get()) && (devtype == MDEV_GUS || devtype == MDEV_TIMIDITY || devtype == MDEV_WILDMIDI);
+	if (shared || threads <= 1 || segment_ms <= 0 || segment_ms >= limit_ms || !ZMusic_SetPosition(song.get(), 0))
+	{
+		return DumpWave(song.get(), outname, maxseconds, 0);
+	}
+	if (!ZMusic_SetStreamFormat(song.get(), SampleType_Float32, false)) return false;
+	SoundStreamInfoEx fmt = song->GetOutputInfoEx();
+	song.reset();
+
+	std::mutex setuplock;
+	FParallelDump dump = { mem, size, device, args, fmt.mSampleRate, ZMusic_ChannelCount(fmt.mChannelConfig), nullptr, &setuplock };
+	const size_t crossfade = size_t(SEGMENT_CROSSFADE_MS) * dump.SampleRate / 1000;
+	const size_t numsegments = size_t((limit_ms + segment_ms - 1) / segment_ms);
+	std::vector<FDumpSegment> segments(std::min(threads, numsegments));
+	TMusicVector<float> tail, blend;
+	size_t tailframes = 0;
+
+	FWaveFile wave;
+	wave.Open(outname, miscConfig.snd_dumpformat, dump.SampleRate, dump.Channels);
+	for (size_t first = 0; first < numsegments; first += segments.size())
+	{
+		size_t count = std::min(segments.size(), numsegments - first);
+		for (size_t i = 0; i < count; i++)
+		{
+			auto &seg = segments[i];
+			int64_t start = int64_t(first + i) * segment_ms;
+			int64_t end = std::min(start + segment_ms, limit_ms);
+			seg.StartMs = int(start);
+			seg.Frames = size_t((end * dump.SampleRate / 1000) - (start * dump.SampleRate / 1000));
+			if (first + i + 1 < numsegments) seg.Frames += crossfade;
+			else if (maxseconds <= 0) seg.Frames += size_t(SEGMENT_PREROLL_MS) * dump.SampleRate / 1000;	// lets the end ring out.
+			seg.Error.clear();
+		}
+		dump.Segments = segments.data();
+		ZMusic_RunParallel(JOB_OFFLINE, count, count, [](void *context, size_t i)
+		{
+			auto &dump = *(FParallelDump *)context;
+			auto &seg = dump.Segments[i];
+			bool success;
+			try
+			{
+				success = RenderSegment(dump, seg);
+			}
+			catch (const std::exception &ex)
+			{
+				SetError(ex.what());
+				success = false;
+			}
+			if (!success) seg.Error = ZMusic_GetLastError();
+		}, &dump);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			auto &seg = segments[i];
+			if (!seg.Error.empty())
+			{
+				std::string msg = "Segment at " + std::to_string(seg.StartMs / 1000) + " s could not be rendered: " + seg.Error;
+				SetError(msg.c_str());
+				return false;
+			}
+			const float *data = seg.Data.data() + seg.Preroll * dump.Channels;
+			size_t frames = seg.Data.size() / dump.Channels - seg.Preroll;
+			bool last = first + i + 1 == numsegments || frames < seg.Frames;
+
+			// Fade from where the previous segment went on rendering into this one.
+			size_t fade = std::min(tailframes, frames);
+			if (fade > 0)
+			{
+				blend.resize(fade * dump.Channels);
+				for (size_t f = 0; f < fade; f++)
+				{
+					float w = (f + 0.5f) / fade;
+					for (int c = 0; c < dump.Channels; c++)
+					{
+						size_t n = f * dump.Channels + c;
+						blend[n] = tail[n] * (1 - w) + data[n] * w;
+					}
+				}
+				wave.Write(blend.data(), fade * dump.Channels);
+			}
+
+			size_t body = last ? frames : std::min(frames, seg.Frames - crossfade);
+			if (body > fade) wave.Write(data + fade * dump.Channels, (body - fade) * dump.Channels);
+			tailframes = frames - body;
+			tail.assign(data + body * dump.Channels, data + frames * dump.Channels);
+			if (last) break;
+		}
+		wave.Finish();	// the segments get rendered into again.
+		if (tailframes == 0) break;	// the song ended early.
+	}
+	wave.Finish();
+
+	if (!wave.Close())
+	{
+		char buffer[80];
+		snprintf(buffer, 80, "Could not finish writing wave file: %s\n", strerror(errno));
+		SetError(buffer);
+		return false;
+	}
+	return true;
+}
+
+DLL_EXPORT zmusic_bool ZMusic_DumpWaveParallel(const void* mem, size_t size, EMidiDevice device, const char* args, const char* outname, int maxseconds, int numthreads)
+{
+	if (mem == nullptr || size == 0 || outname == nullptr)
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+	try
+	{
+		return DumpWaveParallel(mem, size, device, args, outname, maxseconds, numthreads);
+	}
+	catch (const std::exception &ex)
+	{
+		SetError(ex.what());
+		return false;
+	}
+}
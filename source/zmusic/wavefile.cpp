@@ -0,0 +1,252 @@
+/*
+** wavefile.cpp
+** Writes rendered songs to wave or FLAC files.
+**
+**---------------------------------------------------------------------------
+** Copyright 2026 ZMusic contributors
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions
+** are met:
+**
+** 1. Redistributions of source code must retain the above copyright
+**    notice, this list of conditions and the following disclaimer.
+** 2. Redistributions in binary form must reproduce the above copyright
+**    notice, this list of conditions and the following disclaimer in the
+**    documentation and/or other materials provided with the distribution.
+** 3. The name of the author may not be used to endorse or promote products
+**    derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+** OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+** IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+** INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+** NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+** DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+** THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+** THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**---------------------------------------------------------------------------
+**
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <stdexcept>
+#include "wavefile.h"
+#include "m_swap.h"
+#include "fileio.h"
+#include "decoder/sndfile_decoder.h"
+
+struct FmtChunk
+{
+	//uint32_t ChunkID;
+	uint32_t ChunkLen;
+	uint16_t  FormatTag;
+	uint16_t  Channels;
+	uint32_t SamplesPerSec;
+	uint32_t AvgBytesPerSec;
+	uint16_t  BlockAlign;
+	uint16_t  BitsPerSample;
+	uint16_t  ExtensionSize;
+	uint16_t  ValidBitsPerSample;
+	uint32_t ChannelMask;
+	uint32_t SubFormatA;
+	uint16_t  SubFormatB;
+	uint16_t  SubFormatC;
+	uint8_t  SubFormatD[8];
+};
+
+//==========================================================================
+//
+// FWaveFile :: Open
+//
+//==========================================================================
+
+void FWaveFile::Open(const char *filename, int format, int samplerate, int channels)
+{
+	char buffer[80];
+
+	Format = format;
+	Channels = channels;
+	File = MusicIO::utf8_fopen(filename, "wb");
+	if (File == nullptr)
+	{
+		snprintf(buffer, 80, "Could not open %s: %s\n", filename, strerror(errno));
+		throw std::runtime_error(buffer);
+	}
+	if (Format == FORMAT_FLAC)
+	{
+		Flac = SndFile_OpenFLACWriter(File, samplerate, channels);
+		if (Flac == nullptr)
+		{
+			fclose(File);
+			File = nullptr;
+			throw std::runtime_error(IsSndFilePresent() ? "Could not start writing FLAC file\n" : "Writing FLAC files requires libsndfile\n");
+		}
+		return;
+	}
+
+	// Write wave header
+	FmtChunk fmt;
+	const uint16_t bits = Format == FORMAT_PCM16 ? 16 : 32;
+	const uint16_t blockalign = uint16_t(bits / 8 * channels);
+
+	if (fwrite("RIFF\0\0\0\0WAVEfmt ", 1, 16, File) != 16) goto fail;
+
+	fmt.ChunkLen = LittleLong(uint32_t(sizeof(fmt) - 4));
+	fmt.FormatTag = LittleShort((uint16_t)0xFFFE);		// WAVE_FORMAT_EXTENSIBLE
+	fmt.Channels = LittleShort((uint16_t)channels);
+	fmt.SamplesPerSec = LittleLong(samplerate);
+	fmt.AvgBytesPerSec = LittleLong(samplerate * blockalign);
+	fmt.BlockAlign = LittleShort(blockalign);
+	fmt.BitsPerSample = LittleShort(bits);
+	fmt.ExtensionSize = LittleShort((uint16_t)(2 + 4 + 16));
+	fmt.ValidBitsPerSample = LittleShort(bits);
+	fmt.ChannelMask = LittleLong(channels == 1 ? 4 : 3);	// front center or front left and right
+	// Set subformat to KSDATAFORMAT_SUBTYPE_PCM or KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
+	fmt.SubFormatA = LittleLong(Format == FORMAT_PCM16 ? 0x00000001 : 0x00000003);
+	fmt.SubFormatB = 0x0000;
+	fmt.SubFormatC = LittleShort((uint16_t)0x0010);
+	fmt.SubFormatD[0] = 0x80;
+	fmt.SubFormatD[1] = 0x00;
+	fmt.SubFormatD[2] = 0x00;
+	fmt.SubFormatD[3] = 0xaa;
+	fmt.SubFormatD[4] = 0x00;
+	fmt.SubFormatD[5] = 0x38;
+	fmt.SubFormatD[6] = 0x9b;
+	fmt.SubFormatD[7] = 0x71;
+	if (sizeof(fmt) != fwrite(&fmt, 1, sizeof(fmt), File)) goto fail;
+
+	if (fwrite("data\0\0\0\0", 1, 8, File) != 8) goto fail;
+
+	return;
+fail:
+	fclose(File);
+	File = nullptr;
+	snprintf(buffer, 80, "Failed to write %s: %s\n", filename, strerror(errno));
+	throw std::runtime_error(buffer);
+}
+
+//==========================================================================
+//
+// FWaveFile Destructor
+//
+// Only gets to close the file if an error left it open.
+//
+//==========================================================================
+
+FWaveFile::~FWaveFile()
+{
+	WriteJob.Wait();
+	if (Flac != nullptr) SndFile_CloseWriter(Flac);
+	if (File != nullptr) fclose(File);
+}
+
+//==========================================================================
+//
+// FWaveFile :: Write
+//
+//==========================================================================
+
+void FWaveFile::Write(const float *data, size_t count)
+{
+	Finish();
+	WriteJob.Start(JOB_OFFLINE, [=]()
+	{
+		bool ok;
+		if (Flac != nullptr)
+		{
+			ok = SndFile_WriteFloat(Flac, data, count / Channels);
+		}
+		else if (Format == FORMAT_PCM16)
+		{
+			Converted.resize(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				float v = data[i] * 32768.f;
+				Converted[i] = LittleShort((int16_t)(v < -32768.f ? -32768.f : v > 32767.f ? 32767.f : v));
+			}
+			ok = fwrite(Converted.data(), sizeof(int16_t), count, File) == count;
+		}
+		else
+		{
+			ok = fwrite(data, sizeof(float), count, File) == count;
+		}
+		if (!ok)
+		{
+			WriteFailed = true;
+			WriteError = errno;
+		}
+	});
+}
+
+//==========================================================================
+//
+// FWaveFile :: Finish
+//
+//==========================================================================
+
+void FWaveFile::Finish()
+{
+	WriteJob.Wait();
+	if (WriteFailed)
+	{
+		char buffer[80];
+		snprintf(buffer, 80, "Could not write entire wave file: %s\n", strerror(WriteError));
+		throw std::runtime_error(buffer);
+	}
+}
+
+//==========================================================================
+//
+// FWaveFile :: Close
+//
+//==========================================================================
+
+bool FWaveFile::Close()
+{
+	WriteJob.Wait();
+	if (WriteFailed)
+	{
+		errno = WriteError;
+		return false;
+	}
+	if (Flac != nullptr)
+	{
+		bool res = SndFile_CloseWriter(Flac);
+		Flac = nullptr;
+		res = fclose(File) == 0 && res;
+		File = nullptr;
+		return res;
+	}
+	if (File != nullptr)
+	{
+		auto pos = ftell(File);
+		uint32_t size;
+
+		// data chunk size
+		size = LittleLong(uint32_t(pos - 8));
+		if (0 == fseek(File, 4, SEEK_SET))
+		{
+			if (4 == fwrite(&size, 1, 4, File))
+			{
+				size = LittleLong(uint32_t(pos - 12 - sizeof(FmtChunk) - 8));
+				if (0 == fseek(File, 4 + sizeof(FmtChunk) + 8, SEEK_CUR))
+				{
+					if (4 == fwrite(&size, 1, 4, File))
+					{
+						fclose(File);
+						File = nullptr;
+						return true;
+					}
+				}
+			}
+		}
+		fclose(File);
+		File = nullptr;
+	}
+	return false;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include "allocator.h"
+#include "jobs.h"
+
+struct SndFileWriter;
+
+//==========================================================================
+//
+// Writes interleaved float samples to a wave or FLAC file on a job, so
+// that whoever renders them only waits for the disk if it is faster.
+// Used by the MIDI wave writer and ZMusic_DumpWave.
+//
+//==========================================================================
+
+class FWaveFile
+{
+public:
+	// The same as the values of zmusic_snd_dumpformat.
+	enum EFormat
+	{
+		FORMAT_FLOAT,
+		FORMAT_PCM16,
+		FORMAT_FLAC,
+	};
+
+	FWaveFile() = default;
+	~FWaveFile();
+	FWaveFile(const FWaveFile &) = delete;
+	FWaveFile &operator=(const FWaveFile &) = delete;
+
+	// Throws if the file cannot be created.
+	void Open(const char *filename, int format, int samplerate, int channels);
+	bool IsOpen() const { return File != nullptr; }
+
+	// Hands count floats to the writing job, once the previous block is done.
+	// The data must stay untouched until the next Write or Close. Throws if the previous block failed.
+	void Write(const float *data, size_t count);
+	// Throws if the last block failed.
+	void Finish();
+	// Completes the header and closes the file. Returns false with errno set if anything went wrong.
+	bool Close();
+
+private:
+	FILE *File = nullptr;
+	SndFileWriter *Flac = nullptr;
+	int Format = FORMAT_FLOAT;
+	int Channels = 2;
+	TMusicVector<int16_t> Converted;
+	FJob WriteJob;
+	bool WriteFailed = false;	// by the job, read after waiting for it.
+	int WriteError = 0;
+};
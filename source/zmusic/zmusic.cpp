@@ -33,10 +33,10 @@
  **
  */
 
+#include <algorithm>
 #include <stdint.h>
 #include <vector>
 #include <string>
-#include <miniz.h>
 #include "m_swap.h"
 #include "zmusic_internal.h"
 #include "midiconfig.h"
@@ -44,17 +44,16 @@
 #include "streamsources/streamsource.h"
 #include "midisources/midisource.h"
 #include "critsec.h"
+#include "prerender.h"
+#include "songcache.h"
+#include "rendercache.h"
+#include "trace.h"
 
 #define GZIP_ID1		31
 #define GZIP_ID2		139
 #define GZIP_CM			8
 #define GZIP_ID			MAKE_ID(GZIP_ID1,GZIP_ID2,GZIP_CM,0)
 
-#define GZIP_FTEXT		1
-#define GZIP_FHCRC		2
-#define GZIP_FEXTRA		4
-#define GZIP_FNAME		8
-#define GZIP_FCOMMENT	16
 
 class MIDIDevice;
 class OPLmusicFile;
@@ -66,98 +65,233 @@ const char *GME_CheckFormat(uint32_t header);
 MusInfo* CDDA_OpenSong(MusicIO::FileInterface* reader);
 MusInfo* CD_OpenSong(int track, int id);
 MusInfo* CreateMIDIStreamer(MIDISource *source, EMidiDevice devtype, const char* args);
+EMidiDevice MIDI_SelectDevice(EMidiDevice device);
+
+MIDISource *ZMusic_CreateMIDISourceShared(const uint8_t *data, size_t length, EMIDIType miditype, std::shared_ptr<const uint8_t> owner);
 
 //==========================================================================
 //
-// ungzip
-//
-// VGZ files are compressed with gzip, so we need to uncompress them before
-// handing them to GME.
+// create a MIDI player for a source
 //
 //==========================================================================
 
-static bool ungzip(uint8_t *data, int complen, std::vector<uint8_t> &newdata)
+static MusInfo *OpenMIDISong(MIDISource *source, EMIDIType miditype, EMidiDevice device, const char *Args)
 {
-	const uint8_t *max = data + complen - 8;
-	const uint8_t *compstart = data + 10;
-	uint8_t flags = data[3];
-	unsigned isize;
-	z_stream stream;
-	int err;
-	
-	// Find start of compressed data stream
-	if (flags & GZIP_FEXTRA)
-	{
-		compstart += 2 + LittleShort(*(uint16_t *)(data + 10));
-	}
-	if (flags & GZIP_FNAME)
+#ifndef HAVE_SYSTEM_MIDI
+	// some platforms don't support MDEV_STANDARD so map to MDEV_SNDSYS
+	if (device == MDEV_STANDARD)
+		device = MDEV_SNDSYS;
+#endif
+
+	// Multi-track formats spend most of their playback time searching for the next due event.
+	// HMI/HMP and XMI on top of that decode their own delay encodings and XMI keeps a heap
+	// of pending note-offs, so those always get converted to a timeline while loading,
+	// regardless of zmusic_snd_midiprecompile. SMF only gets compiled if requested or if it
+	// may need to be thinned out for its density, and then only once playback starts.
+	if (miditype == MIDI_HMI || miditype == MIDI_XMI)
 	{
-		while (compstart < max && *compstart != 0)
+		auto compiled = new CompiledMIDISource(source, miscConfig.snd_mididensity);
+		source = compiled;
+		switch (MIDI_SelectDevice(device))
 		{
-			compstart++;
+		case MDEV_OPL:		compiled->CompileFor(MIDIDEV_FMSYNTH); break;
+		case MDEV_STANDARD:	compiled->CompileFor(MIDIDEV_MIDIPORT); break;
+		default:			compiled->CompileFor(MIDIDEV_SWSYNTH); break;
 		}
 	}
-	if (flags & GZIP_FCOMMENT)
+	else if ((miscConfig.snd_midiprecompile || miscConfig.snd_mididensity > 0) && miditype == MIDI_MIDI)
 	{
-		while (compstart < max && *compstart != 0)
+		source = new CompiledMIDISource(source, miscConfig.snd_mididensity);
+	}
+	
+	auto song = CreateMIDIStreamer(source, device, Args? Args : "");
+	song->MIDIType = miditype;
+	return song;
+}
+
+//==========================================================================
+//
+// format signatures
+//
+// Anything that is not MIDI, CD audio, raw OPL, XA or game music either
+// goes to a module player or to libsndfile. Those can only find out by
+// trying to load the file, so the first bytes and the file name decide
+// which of them gets the first try. The others still get theirs if it
+// fails, so a wrong guess only costs time.
+//
+//==========================================================================
+
+enum EProbeType
+{
+	PROBE_UNKNOWN,
+	PROBE_MODULE,	// XMP or DUMB
+	PROBE_SNDFILE,	// libsndfile or mpg123
+};
+
+enum
+{
+	PROBE_SIZE = 1084	// up to the 31-instrument MOD signature.
+};
+
+struct FSignature
+{
+	uint16_t Offset;
+	uint8_t Length;
+	char Magic[16];
+	EProbeType Type;
+};
+
+static const FSignature Signatures[] =
+{
+	{ 0, 4, "IMPM", PROBE_MODULE },
+	{ 0, 15, "Extended Module", PROBE_MODULE },
+	{ 44, 4, "SCRM", PROBE_MODULE },
+	{ 44, 4, "PTMF", PROBE_MODULE },
+	{ 0, 3, "MTM", PROBE_MODULE },
+	{ 0, 8, "OKTASONG", PROBE_MODULE },
+	{ 0, 4, "PSM ", PROBE_MODULE },
+	{ 0, 3, "MMD", PROBE_MODULE },
+	{ 0, 4, "DBM0", PROBE_MODULE },
+	{ 1080, 4, "M.K.", PROBE_MODULE },
+	{ 1080, 4, "M!K!", PROBE_MODULE },
+	{ 1080, 4, "FLT4", PROBE_MODULE },
+	{ 1080, 4, "FLT8", PROBE_MODULE },
+	{ 1080, 4, "4CHN", PROBE_MODULE },
+	{ 1080, 4, "6CHN", PROBE_MODULE },
+	{ 1080, 4, "8CHN", PROBE_MODULE },
+	{ 1080, 4, "CD81", PROBE_MODULE },
+	{ 1080, 4, "OCTA", PROBE_MODULE },
+	{ 0, 4, "OggS", PROBE_SNDFILE },
+	{ 0, 4, "fLaC", PROBE_SNDFILE },
+	{ 0, 3, "ID3", PROBE_SNDFILE },
+	{ 0, 4, "RF64", PROBE_SNDFILE },
+	{ 0, 4, ".snd", PROBE_SNDFILE },
+	{ 0, 4, "caff", PROBE_SNDFILE },
+	{ 8, 4, "WAVE", PROBE_SNDFILE },	// RIFF, RIFX
+	{ 8, 4, "AIFF", PROBE_SNDFILE },	// FORM
+	{ 8, 4, "AIFC", PROBE_SNDFILE },	// FORM
+};
+
+static const struct { const char *Ext; EProbeType Type; } Extensions[] =
+{
+	{ "mod", PROBE_MODULE }, { "s3m", PROBE_MODULE }, { "xm", PROBE_MODULE }, { "it", PROBE_MODULE },
+	{ "mtm", PROBE_MODULE }, { "669", PROBE_MODULE }, { "med", PROBE_MODULE }, { "okt", PROBE_MODULE },
+	{ "stm", PROBE_MODULE }, { "ptm", PROBE_MODULE }, { "psm", PROBE_MODULE }, { "umx", PROBE_MODULE },
+	{ "ogg", PROBE_SNDFILE }, { "opus", PROBE_SNDFILE }, { "flac", PROBE_SNDFILE }, { "wav", PROBE_SNDFILE },
+	{ "mp3", PROBE_SNDFILE }, { "mp2", PROBE_SNDFILE }, { "aif", PROBE_SNDFILE }, { "aiff", PROBE_SNDFILE },
+};
+
+static EProbeType ProbeFormat(const uint8_t *header, long headlen, const std::string &filename)
+{
+	for (auto &sig : Signatures)
+	{
+		if (sig.Offset + sig.Length <= headlen && !memcmp(header + sig.Offset, sig.Magic, sig.Length))
 		{
-			compstart++;
+			return sig.Type;
 		}
 	}
-	if (flags & GZIP_FHCRC)
+	// MPEG audio without tags starts with a frame sync.
+	if (header[0] == 0xff && (header[1] & 0xe0) == 0xe0)
 	{
-		compstart += 2;
+		return PROBE_SNDFILE;
 	}
-	if (compstart >= max - 1)
+	auto dot = filename.find_last_of("./\\");
+	if (dot != std::string::npos && filename[dot] == '.')
 	{
-		return false;
+		std::string ext = filename.substr(dot + 1);
+		for (auto &c : ext) c = (char)tolower((unsigned char)c);
+		for (auto &e : Extensions)
+		{
+			if (ext == e.Ext) return e.Type;
+		}
 	}
-	
-	// Decompress
-	isize = LittleLong(*(uint32_t *)(data + complen - 4));
-	newdata.resize(isize);
-	
-	stream.next_in = (Bytef *)compstart;
-	stream.avail_in = (uInt)(max - compstart);
-	stream.next_out = &newdata[0];
-	stream.avail_out = isize;
-	stream.zalloc = (alloc_func)0;
-	stream.zfree = (free_func)0;
-	
-	err = inflateInit2(&stream, -MAX_WBITS);
-	if (err != Z_OK)
+	return PROBE_UNKNOWN;
+}
+
+//==========================================================================
+//
+// Module players read their files completely, possibly more than once
+// while finding out if they can play them, and libsndfile seeks around.
+// Before such trial loads a file that is not already in memory gets read
+// there once and all of them work on that copy. XMP's format tests and
+// DUMB's loaders use it in place.
+//
+//==========================================================================
+
+static MusicIO::FileInterface *BufferFile(MusicIO::FileInterface *reader)
+{
+	if (reader->memoryData() != nullptr) return reader;
+
+	long length = reader->filelength();
+	if (length <= 0) return reader;
+	reader->seek(0, SEEK_SET);
+
+	auto buffered = new MusicIO::VectorReader([=](std::vector<uint8_t> &buffer)
 	{
-		return false;
+		buffer.resize(length);
+		buffer.resize(std::max(0L, reader->read(buffer.data(), (int32_t)length)));
+	});
+	if (buffered->filelength() != length)
+	{
+		buffered->close();
+		reader->seek(0, SEEK_SET);
+		return reader;
 	}
-	err = inflate(&stream, Z_FINISH);
-	if (err != Z_STREAM_END)
+	buffered->filename = reader->filename;
+	reader->close();
+	return buffered;
+}
+
+//==========================================================================
+//
+// module players
+//
+//==========================================================================
+
+static StreamSource *OpenModule(MusicIO::FileInterface *reader)
+{
+	StreamSource *streamsource = nullptr;
+	// give the calling app an option to select between XMP and DUMB.
+	if (dumbConfig.mod_preferred_player != 0)
 	{
-		inflateEnd(&stream);
-		return false;
+		streamsource = MOD_OpenSong(reader, miscConfig.snd_outputrate);
 	}
-	err = inflateEnd(&stream);
-	if (err != Z_OK)
+	if (!streamsource)
 	{
-		return false;
+		reader->seek(0, SEEK_SET);
+		streamsource = XMP_OpenSong(reader, miscConfig.snd_outputrate);
+		if (!streamsource && dumbConfig.mod_preferred_player == 0)
+		{
+			reader->seek(0, SEEK_SET);
+			streamsource = MOD_OpenSong(reader, miscConfig.snd_outputrate);
+		}
 	}
-	return true;
+	reader->seek(0, SEEK_SET);
+	return streamsource;
 }
 
-
 //==========================================================================
 //
 // identify a music lump's type and set up a player for it
 //
 //==========================================================================
 
-static  MusInfo *ZMusic_OpenSongInternal (MusicIO::FileInterface *reader, EMidiDevice device, const char *Args)
+static MusInfo *OpenSong(MusicIO::FileInterface *reader, EMidiDevice device, const char *Args)
 {
 	MusInfo *info = nullptr;
 	StreamSource *streamsource = nullptr;
 	const char *fmt;
-	uint32_t id[32/4];
+	union
+	{
+		uint8_t header[PROBE_SIZE];
+		uint32_t id[PROBE_SIZE / 4];
+	};
+	long headlen;
+	int cachekind = -1;	// an ERenderCacheKind if the song may be played from a render.
+	const uint8_t *songdata = nullptr;
+	size_t songlength = 0;
 	
-	if(reader->read(id, 32) != 32 || reader->seek(-32, SEEK_CUR) != 0)
+	if((headlen = reader->read(header, PROBE_SIZE)) < 32 || reader->seek(-headlen, SEEK_CUR) != 0)
 	{
 		SetError("Unable to read header");
 		reader->close();
@@ -165,45 +299,76 @@ static  MusInfo *ZMusic_OpenSongInternal (MusicIO::FileInterface *reader, EMidiD
 	}
 	try
 	{
+		// The song cache is keyed by the data as it is stored, which for gzipped songs is the
+		// compressed data. Only MIDI songs get looked up, the cache has nothing else and
+		// hashing large streamed songs in full would only slow down opening them.
+		SongCacheKey cachekey;
+		std::shared_ptr<const uint8_t> storeddata;
+		size_t storedlength = 0;
+
 		// Check for gzip compression. Some formats are expected to have players
 		// that can handle it, so it simplifies things if we make all songs
 		// gzippable.
-		if ((id[0] & MAKE_ID(255, 255, 255, 0)) == GZIP_ID)
+		bool gzipped = (id[0] & MAKE_ID(255, 255, 255, 0)) == GZIP_ID;
+		if (gzipped)
 		{
-			// swap out the reader with one that reads the decompressed content.
-			auto zreader = new MusicIO::VectorReader([reader](std::vector<uint8_t>& array)
-													 {
-														 bool res = false;
-														 auto len = reader->filelength();
-														 uint8_t* gzipped = new uint8_t[len];
-														 if (reader->read(gzipped, len) == len)
-														 {
-															 res = ungzip(gzipped, (int)len, array);
-														 }
-														 delete[] gzipped;
-													 });
-			reader->close();
+			storeddata = reader->shareData();
+			storedlength = reader->filelength();
+
+			// swap out the reader with one that decompresses the content as it gets read.
+			auto zreader = MusicIO::OpenGzipReader(reader);
+			if (zreader == nullptr)
+			{
+				SetError("Unable to decompress song");
+				reader->close();
+				return nullptr;
+			}
 			reader = zreader;
 			
 			
-			if (reader->read(id, 32) != 32 || reader->seek(-32, SEEK_CUR) != 0)
+			if ((headlen = reader->read(header, PROBE_SIZE)) < 32 || reader->seek(-headlen, SEEK_CUR) != 0)
 			{
 				reader->close();
 				return nullptr;
 			}
 		}
 		
-		EMIDIType miditype = ZMusic_IdentifyMIDIType(id, sizeof(id));
+		EMIDIType miditype = ZMusic_IdentifyMIDIType(id, 32);
+		MIDISource *cached = nullptr;
 		if (miditype != MIDI_NOTMIDI)
 		{
-			std::vector<uint8_t> data(reader->filelength());
-			if (reader->read(data.data(), (long)data.size()) != (long)data.size())
+			if (!gzipped)
 			{
-				SetError("Failed to read MIDI data");
-				reader->close();
-				return nullptr;
+				storeddata = reader->shareData();
+				storedlength = reader->filelength();
+			}
+			cached = SongCache_Find(std::move(storeddata), storedlength, cachekey);
+		}
+		if (cached != nullptr)
+		{
+			info = OpenMIDISong(cached, cachekey.Type, device, Args);
+			cachekind = RENDER_MIDI;
+			songdata = cachekey.Data.get();
+			songlength = cachekey.Length;
+		}
+		else if (miditype != MIDI_NOTMIDI)
+		{
+			// Memory based readers let the source reference their data directly,
+			// everything else gets read into a buffer the source takes over.
+			auto data = reader->shareData();
+			size_t length = reader->filelength();
+			if (data == nullptr)
+			{
+				auto buffer = new uint8_t[length];
+				data.reset(buffer, std::default_delete<uint8_t[]>());
+				if (reader->read(buffer, (long)length) != (long)length)
+				{
+					SetError("Failed to read MIDI data");
+					reader->close();
+					return nullptr;
+				}
 			}
-			auto source = ZMusic_CreateMIDISource(data.data(), data.size(), miditype);
+			auto source = ZMusic_CreateMIDISourceShared(data.get(), length, miditype, data);
 			if (source == nullptr)
 			{
 				reader->close();
@@ -215,14 +380,12 @@ static  MusInfo *ZMusic_OpenSongInternal (MusicIO::FileInterface *reader, EMidiD
 				delete source;
 				return nullptr;
 			}
-
-#ifndef HAVE_SYSTEM_MIDI
-			// some platforms don't support MDEV_STANDARD so map to MDEV_SNDSYS
-			if (device == MDEV_STANDARD)
-				device = MDEV_SNDSYS;
-#endif
-			
-			info = CreateMIDIStreamer(source, device, Args? Args : "");
+			cachekey.Type = miditype;
+			SongCache_Add(cachekey, source, data.get(), length);
+			info = OpenMIDISong(source, miditype, device, Args);
+			cachekind = RENDER_MIDI;
+			songdata = data.get();	// kept alive by the source.
+			songlength = length;
 		}
 		
 		// Check for CDDA "format"
@@ -248,41 +411,40 @@ static  MusInfo *ZMusic_OpenSongInternal (MusicIO::FileInterface *reader, EMidiD
 #endif
 				if ((id[0] == MAKE_ID('R', 'I', 'F', 'F') && id[2] == MAKE_ID('C', 'D', 'X', 'A')))
 			{
-				streamsource = XA_OpenSong(reader);	// this takes over the reader.
+				streamsource = XA_OpenSong(reader, miscConfig.snd_xaresample ? miscConfig.snd_outputrate : 0);	// this takes over the reader.
 				reader = nullptr;					// We do not own this anymore.
 			}
 			// Check for game music
 			else if ((fmt = GME_CheckFormat(id[0])) != nullptr && fmt[0] != '\0')
 			{
 				streamsource = GME_OpenSong(reader, fmt, miscConfig.snd_outputrate);
+				cachekind = RENDER_GME;
 			}
 			// Check for module formats
 			else if ((id[0] == MAKE_ID('R', 'I', 'F', 'F') && id[2] == MAKE_ID('D', 'S', 'M', 'F')))
 			{
 				streamsource = MOD_OpenSong(reader, miscConfig.snd_outputrate);
+				cachekind = RENDER_MODULE;
 			}
 			else
 			{
-				// give the calling app an option to select between XMP and DUMB.
-				if (dumbConfig.mod_preferred_player != 0)
+				EProbeType probe = ProbeFormat(header, headlen, reader->filename);
+				if (probe == PROBE_SNDFILE)
 				{
-					streamsource = MOD_OpenSong(reader, miscConfig.snd_outputrate);
+					streamsource = SndFile_OpenSong(reader);		// this only takes over the reader if it succeeds. We need to look out for this.
+					if (streamsource != nullptr) reader = nullptr;
 				}
-				if (!streamsource)
+				if (streamsource == nullptr)
 				{
-					reader->seek(0, SEEK_SET);
-					streamsource = XMP_OpenSong(reader, miscConfig.snd_outputrate);
-					if (!streamsource && dumbConfig.mod_preferred_player == 0)
-					{
-						reader->seek(0, SEEK_SET);
-						streamsource = MOD_OpenSong(reader, miscConfig.snd_outputrate);
-					}
+					reader = BufferFile(reader);
+					streamsource = OpenModule(reader);
+					if (streamsource != nullptr) cachekind = RENDER_MODULE;
+				}
+				if (streamsource == nullptr && probe != PROBE_SNDFILE)
+				{
+					streamsource = SndFile_OpenSong(reader);
+					if (streamsource != nullptr) reader = nullptr;
 				}
-			}
-			if (streamsource == nullptr)
-			{
-				streamsource = SndFile_OpenSong(reader);		// this only takes over the reader if it succeeds. We need to look out for this.
-				if (streamsource != nullptr) reader = nullptr;
 			}
 			
 			if (streamsource)
@@ -305,6 +467,23 @@ static  MusInfo *ZMusic_OpenSongInternal (MusicIO::FileInterface *reader, EMidiD
 			SetError("Unable to identify as music");
 			info = nullptr;
 		}
+		if (info && cachekind >= 0 && !miscConfig.snd_rendercache.empty())
+		{
+			// Stream songs leave their data in the reader.
+			std::vector<uint8_t> buffer;
+			if (songdata == nullptr && reader != nullptr)
+			{
+				songlength = reader->filelength();
+				songdata = reader->memoryData();
+				if (songdata == nullptr)
+				{
+					buffer.resize(songlength);
+					reader->seek(0, SEEK_SET);
+					if (reader->read(buffer.data(), (long)songlength) == (long)songlength) songdata = buffer.data();
+				}
+			}
+			if (songdata != nullptr) info = RenderCache_Open(info, (ERenderCacheKind)cachekind, songdata, songlength, device, Args);
+		}
 		if (reader) reader->close();
 		return info;
 	}
@@ -317,16 +496,65 @@ static  MusInfo *ZMusic_OpenSongInternal (MusicIO::FileInterface *reader, EMidiD
 	}
 }
 
+// The trace needs the hash of all the data, which most songs do not read in one go.
+static void TraceSong(FTraceCall &trace, MusicIO::FileInterface *reader, EMidiDevice device, const char *Args)
+{
+	uint64_t hash = ZMusic_TraceHash(nullptr, 0);
+	long size = reader->filelength();
+	if (const uint8_t *data = reader->memoryData())
+	{
+		hash = ZMusic_TraceHash(data, size);
+	}
+	else
+	{
+		long pos = reader->tell();
+		reader->seek(0, SEEK_SET);
+		uint8_t buffer[16384];
+		long len;
+		size = 0;
+		while ((len = reader->read(buffer, sizeof(buffer))) > 0)
+		{
+			hash = ZMusic_TraceHash(buffer, len, hash);
+			size += len;
+		}
+		reader->seek(pos, SEEK_SET);
+	}
+	const char *name = reader->filename.c_str();
+	for (const char *p = name; *p; p++)
+	{
+		if (*p == '/' || *p == '\\' || *p == ':') name = p + 1;
+	}
+	trace.Unsigned(device).String(Args).Unsigned(size).Hash(hash).String(name);
+}
+
+// Everything made for the song while opening it comes from the song's arena.
+MusInfo *ZMusic_OpenSongInternal(MusicIO::FileInterface *reader, EMidiDevice device, const char *Args)
+{
+	FTraceCall trace(TRACE_OPEN, nullptr);
+	if (trace.Active()) TraceSong(trace, reader, device, Args);
+	FMusicArenaScope arena;
+	MusInfo *info = OpenSong(reader, device, Args);
+	arena.Adopt(info);
+	trace.SetSong(info);
+	return info;
+}
+
 DLL_EXPORT ZMusic_MusicStream ZMusic_OpenSongFile(const char* filename, EMidiDevice device, const char* Args)
 {
-	auto f = MusicIO::utf8_fopen(filename, "rb");
-	if (!f)
+	MusicIO::FileInterface *fr = MusicIO::OpenMappedFile(filename);
+	if (!fr)
 	{
-		SetError("File not found");
-		return nullptr;
+		auto f = MusicIO::utf8_fopen(filename, "rb");
+		if (!f)
+		{
+			SetError("File not found");
+			return nullptr;
+		}
+		auto sfr = new MusicIO::StdioFileReader;
+		sfr->f = f;
+		sfr->filename = filename;
+		fr = sfr;
 	}
-	auto fr = new MusicIO::StdioFileReader;
-	fr->f = f;
 	return ZMusic_OpenSongInternal(fr, device, Args);
 }
 
@@ -353,6 +581,17 @@ DLL_EXPORT ZMusic_MusicStream ZMusic_OpenSong(ZMusicCustomReader* reader, EMidiD
 	return ZMusic_OpenSongInternal(cr, device, Args);
 }
 
+DLL_EXPORT ZMusic_MusicStream ZMusic_OpenSongStream(ZMusicStreamReader* reader, EMidiDevice device, const char* Args)
+{
+	if (!reader || !reader->read || !reader->close)
+	{
+		SetError("No reader protocol specified");
+		return nullptr;
+	}
+	auto sr = OpenStreamReader(reader, size_t(miscConfig.snd_streamprebuffer) * 1024);
+	return ZMusic_OpenSongInternal(sr, device, Args);
+}
+
 
 //==========================================================================
 //
@@ -362,6 +601,7 @@ DLL_EXPORT ZMusic_MusicStream ZMusic_OpenSong(ZMusicCustomReader* reader, EMidiD
 
 DLL_EXPORT MusInfo *ZMusic_OpenCDSong (int track, int id)
 {
+	FMusicArenaScope arena;
 	MusInfo *info = CD_OpenSong (track, id);
 	
 	if (info && !info->IsValid ())
@@ -370,10 +610,72 @@ DLL_EXPORT MusInfo *ZMusic_OpenCDSong (int track, int id)
 		info = nullptr;
 		SetError("Unable to open CD Audio");
 	}
-	
+	arena.Adopt(info);
+	return info;
+}
+
+DLL_EXPORT MusInfo *ZMusic_OpenCDImage(const char *cuefile, int track)
+{
+	if (cuefile == nullptr || track < 0)
+	{
+		SetError("Invalid arguments");
+		return nullptr;
+	}
+	FMusicArenaScope arena;
+	auto source = CDImage_OpenSong(cuefile, track);
+	if (source == nullptr)
+	{
+		SetError("Unable to open CD image");
+		return nullptr;
+	}
+	MusInfo *info = OpenStreamSong(source);
+	arena.Adopt(info);
 	return info;
 }
 
+//==========================================================================
+//
+// MusInfo :: PostCommand
+//
+// A thread that serviced the stream within the last 200 ms is taken to
+// come back for the next block soon. Otherwise, or if the queue is full,
+// the call is made right away under the lock, after the others.
+//
+//==========================================================================
+
+void MusInfo::PostCommand(const FSongCommand &cmd)
+{
+	uint64_t last = LastServiced.load(std::memory_order_relaxed);
+	if (last != 0 && FPerfCounters::Now() - last < 200000000 && Commands.Push(cmd)) return;
+	FSongLock lock(this);
+	RunCommand(cmd);
+}
+
+//==========================================================================
+//
+// MusInfo :: RunCommands
+//
+//==========================================================================
+
+void MusInfo::RunCommands()
+{
+	FSongCommand cmd;
+	while (Commands.Pop(cmd)) RunCommand(cmd);
+}
+
+void MusInfo::RunCommand(const FSongCommand &cmd)
+{
+	switch (cmd.Type)
+	{
+	case FSongCommand::Pause:			Pause(); break;
+	case FSongCommand::Resume:			Resume(); break;
+	case FSongCommand::VolumeChanged:	MusicVolumeChanged(); break;
+	case FSongCommand::SettingInt:		ChangeSettingInt(cmd.Setting, cmd.IntValue); break;
+	case FSongCommand::SettingNum:		ChangeSettingNum(cmd.Setting, cmd.NumValue); break;
+	case FSongCommand::Virtual:			SetVirtual(cmd.IntValue != 0); break;
+	}
+}
+
 //==========================================================================
 //
 // streaming callback
@@ -383,8 +685,173 @@ DLL_EXPORT MusInfo *ZMusic_OpenCDSong (int track, int id)
 DLL_EXPORT zmusic_bool ZMusic_FillStream(MusInfo* song, void* buff, int len)
 {
 	if (song == nullptr) return false;
-	std::lock_guard<FCriticalSection> lock(song->CritSec);
-	return song->ServiceStream(buff, len);
+	ZMUSIC_RT_SCOPE();
+	FTraceCall trace(TRACE_FILL, song);
+	trace.Unsigned(len);
+	if (song->Prerender)
+	{
+		bool res = song->Prerender->Fill(buff, len);
+		song->Position.AddDelivered(len);
+		return res;
+	}
+	std::unique_lock<FCriticalSection> lock(song->CritSec, std::defer_lock);
+	if (!song->LockForOutput(lock))
+	{
+		// Another thread is stopping, seeking or reconfiguring the song. Rather than wait for it, this block stays silent.
+		song->Perf.AddBlocked();
+		memset(buff, song->OutputSilence.load(std::memory_order_relaxed), len);
+		return song->m_Status != MusInfo::STATE_Stopped;
+	}
+	bool res = song->ServiceOutput(buff, len);
+	song->Position.AddDelivered(len);
+	return res;
+}
+
+//==========================================================================
+//
+// output format negotiation
+//
+// Songs that can render the requested format natively are switched over,
+// everything else gets converted once right before the data is handed out.
+// Must be called after the song has been started and before prerendering
+// gets enabled.
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_SetStreamFormat(MusInfo* song, SampleType type, zmusic_bool planar)
+{
+	if (song == nullptr) return false;
+	FTraceCall trace(TRACE_SETFORMAT, song);
+	trace.Unsigned(type).Unsigned(!!planar);
+	if (song->Prerender)
+	{
+		SetError("Cannot change the format of a prerendered stream");
+		return false;
+	}
+	FSongRebuildLock lock(song);
+	song->OutputConverter.Reset();
+	song->SetSampleType(type);
+
+	SoundStreamInfoEx fmt = song->GetStreamInfoEx();
+	if (fmt.mBufferSize <= 0)
+	{
+		SetError("Not a streaming song");
+		return false;
+	}
+	if (!song->OutputConverter.Setup(fmt.mSampleType, type, fmt.mChannelConfig, !!planar))
+	{
+		SetError("Unsupported sample format");
+		return false;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// offline rendering
+//
+// No locking takes place here, the client guarantees that nothing else
+// services the song while it is being rendered.
+//
+//==========================================================================
+
+DLL_EXPORT size_t ZMusic_RenderToBuffer(MusInfo* song, void* buff, size_t frames, int flags)
+{
+	if (song == nullptr || buff == nullptr) return 0;
+	FTraceCall trace(TRACE_RENDER, song);
+	trace.Unsigned(frames).Unsigned(flags);
+	if (song->Prerender)
+	{
+		SetError("Cannot render a prerendered stream offline");
+		return 0;
+	}
+	SoundStreamInfoEx fmt = song->GetOutputInfoEx();
+	if (fmt.mBufferSize <= 0 || song->m_Status == MusInfo::STATE_Stopped || !song->SetOfflineMode(true, flags))
+	{
+		SetError("Song cannot be rendered offline");
+		return 0;
+	}
+
+	size_t framesize = ZMusic_SampleTypeSize(fmt.mSampleType) * ZMusic_ChannelCount(fmt.mChannelConfig);
+	size_t blockframes = std::max(fmt.mSampleRate, 1);	// one second per call is as large as any device needs.
+	size_t done = 0;
+	try
+	{
+		while (done < frames)
+		{
+			size_t block = std::min(blockframes, frames - done);
+			int produced;
+			bool more = song->ServiceOutput((uint8_t*)buff + done * framesize, int(block * framesize), &produced);
+			song->Position.AddDelivered(block * framesize);
+			if (!more)
+			{
+				// Only what the song produced before it ended counts, not the silence after it.
+				done += produced;
+				break;
+			}
+			done += block;
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		SetError(ex.what());
+	}
+	song->SetOfflineMode(false, flags);
+	return done;
+}
+
+//==========================================================================
+//
+// prerendering on a worker thread
+//
+// Must be called after the song has been started and while it is not
+// being serviced by ZMusic_FillStream. A depth of 0 disables it again.
+//
+//==========================================================================
+
+DLL_EXPORT zmusic_bool ZMusic_SetPrerender(MusInfo* song, int depth_ms)
+{
+	if (song == nullptr) return false;
+	FTraceCall trace(TRACE_PRERENDER, song);
+	trace.Signed(depth_ms);
+	delete song->Prerender;
+	song->Prerender = nullptr;
+	if (depth_ms <= 0) return true;
+
+	auto prerender = new StreamPrerenderer(song, depth_ms);
+	if (!prerender->IsValid())
+	{
+		delete prerender;
+		SetError("Song cannot be prerendered");
+		return false;
+	}
+	song->Prerender = prerender;
+	return true;
+}
+
+DLL_EXPORT uint32_t ZMusic_GetPrerenderUnderruns(MusInfo* song)
+{
+	if (song == nullptr || song->Prerender == nullptr) return 0;
+	return song->Prerender->GetUnderruns();
+}
+
+//==========================================================================
+//
+// render statistics
+//
+//==========================================================================
+
+DLL_EXPORT void ZMusic_GetPerfCounters(MusInfo* song, ZMusicPerfCounters* counters)
+{
+	if (!counters) return;
+	*counters = {};
+	counters->mActiveVoices = -1;
+	if (song) song->Perf.Get(counters);
+}
+
+DLL_EXPORT void ZMusic_ResetPerfCounters(MusInfo* song)
+{
+	if (song) song->Perf.Reset();
 }
 
 //==========================================================================
@@ -396,9 +863,24 @@ DLL_EXPORT zmusic_bool ZMusic_FillStream(MusInfo* song, void* buff, int len)
 DLL_EXPORT zmusic_bool ZMusic_Start(MusInfo *song, int subsong, zmusic_bool loop)
 {
 	if (!song) return true;	// Starting a null song is not an error! It just won't play anything.
+	FTraceCall trace(TRACE_START, song);
+	trace.Signed(subsong).Unsigned(!!loop);
+	FMusicArenaScope arena(song);
 	try
 	{
-		song->Play(loop, subsong);
+		{
+			FSongRebuildLock lock(song);
+			song->Quantum.Setup(miscConfig.snd_renderquantum);
+			song->Position.Reset();
+		}
+		if (song->Prerender)
+		{
+			FSongRebuildLock lock(song);
+			song->Prerender->Flush();
+			song->Play(loop, subsong);
+		}
+		else song->Play(loop, subsong);
+		ZMusic_CheckMemoryBudget();
 		return true;
 	}
 	catch (const std::exception & ex)
@@ -417,18 +899,21 @@ DLL_EXPORT zmusic_bool ZMusic_Start(MusInfo *song, int subsong, zmusic_bool loop
 DLL_EXPORT void ZMusic_Pause(MusInfo *song)
 {
 	if (!song) return;
-	song->Pause();
+	FTraceCall trace(TRACE_PAUSE, song);
+	song->PostCommand({ FSongCommand::Pause });
 }
 
 DLL_EXPORT void ZMusic_Resume(MusInfo *song)
 {
 	if (!song) return;
-	song->Resume();
+	FTraceCall trace(TRACE_RESUME, song);
+	song->PostCommand({ FSongCommand::Resume });
 }
 
 DLL_EXPORT void ZMusic_Update(MusInfo *song)
 {
 	if (!song) return;
+	FTraceCall trace(TRACE_UPDATE, song);
 	song->Update();
 }
 
@@ -441,17 +926,266 @@ DLL_EXPORT zmusic_bool ZMusic_IsPlaying(MusInfo *song)
 DLL_EXPORT void ZMusic_Stop(MusInfo *song)
 {
 	if (!song) return;
-	std::lock_guard<FCriticalSection> lock(song->CritSec);
+	FTraceCall trace(TRACE_STOP, song);
+	FSongRebuildLock lock(song);
+	if (song->Prerender) song->Prerender->Flush();
 	song->Stop();
 }
 
 DLL_EXPORT zmusic_bool ZMusic_SetSubsong(MusInfo *song, int subsong)
 {
 	if (!song) return false;
-	std::lock_guard<FCriticalSection> lock(song->CritSec);
+	FTraceCall trace(TRACE_SETSUBSONG, song);
+	trace.Signed(subsong);
+	FSongRebuildLock lock(song);
+	if (song->Prerender) song->Prerender->Flush();
 	return song->SetSubsong(subsong);
 }
 
+DLL_EXPORT zmusic_bool ZMusic_PrepareSubsong(MusInfo *song, int subsong, int crossfade_ms)
+{
+	if (!song) return false;
+	FTraceCall trace(TRACE_PREPARESUBSONG, song);
+	trace.Signed(subsong).Signed(crossfade_ms);
+	FSongLock lock(song);
+	if (!song->PrepareSubsong(subsong, crossfade_ms))
+	{
+		SetError("Song cannot prepare this subsong");
+		return false;
+	}
+	return true;
+}
+
+DLL_EXPORT zmusic_bool ZMusic_SetPosition(MusInfo *song, unsigned int ms)
+{
+	if (!song) return false;
+	FTraceCall trace(TRACE_SETPOSITION, song);
+	trace.Unsigned(ms);
+	FSongRebuildLock lock(song);
+	if (song->Prerender) song->Prerender->Flush();
+	try
+	{
+		return song->SetPosition(ms);
+	}
+	catch (const std::exception & ex)
+	{
+		SetError(ex.what());
+		return false;
+	}
+}
+
+DLL_EXPORT ZMusic_MusicStream ZMusic_CloneStream(MusInfo *song)
+{
+	if (!song)
+	{
+		SetError("Invalid arguments");
+		return nullptr;
+	}
+	FMusicArenaScope arena;
+	try
+	{
+		MusInfo *clone;
+		{
+			FConfigScope config(song->Config);
+			clone = song->Clone();
+		}
+		if (clone == nullptr)
+		{
+			SetError("Only MIDI songs can be cloned");
+			return nullptr;
+		}
+		arena.Adopt(clone);
+		clone->Quantum.Setup(song->Config->misc.snd_renderquantum);
+		return clone;
+	}
+	catch (const std::exception &ex)
+	{
+		SetError(ex.what());
+		return nullptr;
+	}
+}
+
+DLL_EXPORT zmusic_bool ZMusic_GetPosition(MusInfo *song, ZMusicPosition *position)
+{
+	if (!song) return false;
+	if (position == nullptr)
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+	// No lock, so that it can be polled while the stream is being serviced.
+	song->Position.Get(*position);
+	return true;
+}
+
+DLL_EXPORT zmusic_bool ZMusic_SetMIDIBuffering(MusInfo *song, int numbuffers, int buffer_ms)
+{
+	if (!song) return false;
+	if (numbuffers < 2 || numbuffers > MAX_MIDI_BUFFERS || buffer_ms < 1 || buffer_ms > 10000)
+	{
+		SetError("Invalid MIDI buffering parameters");
+		return false;
+	}
+	FTraceCall trace(TRACE_SETBUFFERING, song);
+	trace.Signed(numbuffers).Signed(buffer_ms);
+	FSongRebuildLock lock(song);
+	if (!song->SetEventBuffering(numbuffers, buffer_ms * 1000))
+	{
+		SetError("Song does not support MIDI buffering settings");
+		return false;
+	}
+	return true;
+}
+
+DLL_EXPORT zmusic_bool ZMusic_SetMIDIStems(MusInfo *song, int numstems, const uint8_t *channelstems)
+{
+	if (!song) return false;
+	bool valid = numstems >= 0 && numstems <= 16 && (numstems == 0 || channelstems != nullptr);
+	for (int i = 0; valid && numstems > 0 && i < 16; i++)
+	{
+		valid = channelstems[i] < numstems;
+	}
+	if (!valid)
+	{
+		SetError("Invalid MIDI stem parameters");
+		return false;
+	}
+	FSongRebuildLock lock(song);
+	if (!song->SetStems(numstems, channelstems))
+	{
+		SetError("Song does not support stems");
+		return false;
+	}
+	return true;
+}
+
+DLL_EXPORT const float *ZMusic_GetMIDIStems(MusInfo *song, int *numstems, int *frames)
+{
+	int count = 0, length = 0;
+	const float *stems = song && !song->Prerender ? song->GetStems(count, length) : nullptr;
+	if (numstems) *numstems = stems ? count : 0;
+	if (frames) *frames = stems ? length : 0;
+	return stems;
+}
+
+DLL_EXPORT int ZMusic_AddMIDILayer(MusInfo *song, MIDISource *source, zmusic_bool loop)
+{
+	if (!song || !source)
+	{
+		SetError("Invalid arguments");
+		return 0;
+	}
+	try
+	{
+		FSongLock lock(song);
+		int layer = song->AddLayer(source, !!loop);
+		if (layer == 0) SetError("Only MIDI songs can have layers");
+		return layer;
+	}
+	catch (const std::exception &ex)
+	{
+		SetError(ex.what());
+		return 0;
+	}
+}
+
+DLL_EXPORT zmusic_bool ZMusic_RemoveMIDILayer(MusInfo *song, int layer)
+{
+	if (!song) return false;
+	FSongLock lock(song);
+	return song->RemoveLayer(layer);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_IsMIDILayerPlaying(MusInfo *song, int layer)
+{
+	if (!song) return false;
+	FSongLock lock(song);
+	return song->IsLayerPlaying(layer);
+}
+
+DLL_EXPORT zmusic_bool ZMusic_SendMidiEvents(MusInfo *song, const ZMusicMidiEvent *events, int count, uint32_t sampleOffset)
+{
+	if (!song) return false;
+	if (count < 0 || (count > 0 && events == nullptr))
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		const uint8_t *data = events[i].data;
+		uint32_t len = events[i].length;
+		bool valid;
+		if (data == nullptr || len == 0) valid = false;
+		else if (data[0] == 0xF0) valid = len >= 2 && data[len - 1] == 0xF7;
+		else valid = data[0] >= 0x80 && data[0] < 0xF0 && len <= 3;
+		if (!valid)
+		{
+			SetError("Invalid MIDI message");
+			return false;
+		}
+	}
+	if (count == 0) return true;
+	// No lock, so that events can be sent while the stream is being serviced.
+	if (!song->SendMidiEvents(events, count, sampleOffset))
+	{
+		SetError(song->IsMIDI() ? "MIDI input queue is full or the song is not playing on a software synth" : "Only MIDI songs take MIDI events");
+		return false;
+	}
+	return true;
+}
+
+DLL_EXPORT zmusic_bool ZMusic_GetChannelActivity(MusInfo *song, ZMusicChannelActivity *channels)
+{
+	if (!song) return false;
+	if (channels == nullptr)
+	{
+		SetError("Invalid arguments");
+		return false;
+	}
+	// No lock, so that meters can poll it while the stream is being serviced.
+	if (!song->GetChannelActivity(channels))
+	{
+		SetError(song->IsMIDI() ? "The song is not playing on a software synth" : "Only MIDI songs have channel activity");
+		return false;
+	}
+	return true;
+}
+
+DLL_EXPORT zmusic_bool ZMusic_SetGain(MusInfo *song, float gain, int fade_ms)
+{
+	if (!song) return false;
+	if (!(gain >= 0) || fade_ms < 0)
+	{
+		SetError("Invalid gain parameters");
+		return false;
+	}
+	FTraceCall trace(TRACE_SETGAIN, song);
+	trace.Float(gain).Signed(fade_ms);
+	// No lock, so that the client's audio code can drive fades while the stream is being serviced.
+	if (!song->SetGain(gain, fade_ms))
+	{
+		SetError("Song does not support gain control");
+		return false;
+	}
+	return true;
+}
+
+DLL_EXPORT void ZMusic_SetVirtual(MusInfo *song, zmusic_bool on)
+{
+	if (!song) return;
+	FTraceCall trace(TRACE_SETVIRTUAL, song);
+	trace.Unsigned(!!on);
+	song->PostCommand({ FSongCommand::Virtual, ESongSetting(), on ? 1 : 0 });
+}
+
+DLL_EXPORT int ZMusic_GetSubsongCount(MusInfo *song)
+{
+	if (!song) return 0;
+	FSongLock lock(song);
+	return song->GetSubsongCount();
+}
+
 DLL_EXPORT zmusic_bool ZMusic_IsLooping(MusInfo *song)
 {
 	if (!song) return false;
@@ -480,8 +1214,8 @@ DLL_EXPORT void ZMusic_GetStreamInfo(MusInfo *song, SoundStreamInfo *fmt)
 
 	SoundStreamInfoEx fmtex;
 	{
-		std::lock_guard<FCriticalSection> lock(song->CritSec);
-		fmtex = song->GetStreamInfoEx();
+		FSongLock lock(song);
+		fmtex = song->GetOutputInfoEx();
 	}
 	if (fmtex.mSampleRate > 0)
 	{
@@ -496,32 +1230,40 @@ DLL_EXPORT void ZMusic_GetStreamInfo(MusInfo *song, SoundStreamInfo *fmt)
 DLL_EXPORT void ZMusic_GetStreamInfoEx(MusInfo *song, SoundStreamInfoEx *fmt)
 {
 	if (!fmt) return;
-	if (!song) *fmt = {};
-	std::lock_guard<FCriticalSection> lock(song->CritSec);
-	*fmt = song->GetStreamInfoEx();
+	if (!song)
+	{
+		*fmt = {};
+		return;
+	}
+	FSongLock lock(song);
+	*fmt = song->GetOutputInfoEx();
 }
 
 DLL_EXPORT void ZMusic_Close(MusInfo *song)
 {
 	if (!song) return;
+	FTraceCall trace(TRACE_CLOSE, song);
+	delete song->Prerender;	// the worker thread must be gone before the song is.
 	delete song;
+	ZMusic_CheckMemoryBudget();
 }
 
 DLL_EXPORT void ZMusic_VolumeChanged(MusInfo *song)
 {
 	if (!song) return;
-	std::lock_guard<FCriticalSection> lock(song->CritSec);
-	song->MusicVolumeChanged();
+	FTraceCall trace(TRACE_VOLUMECHANGED, song);
+	song->PostCommand({ FSongCommand::VolumeChanged });
 }
 
-static std::string staticErrorMessage;
+static thread_local std::string staticErrorMessage;	// per thread so that songs can be opened on worker threads.
+static thread_local std::string staticStatsMessage;		// separate, so that asking for stats does not lose the last error.
 
 DLL_EXPORT const char *ZMusic_GetStats(MusInfo *song)
 {
 	if (!song) return "";
-	std::lock_guard<FCriticalSection> lock(song->CritSec);
-	staticErrorMessage = song->GetStats();
-	return staticErrorMessage.c_str();
+	FSongLock lock(song);
+	staticStatsMessage = song->GetStats();
+	return staticStatsMessage.c_str();
 }
 
 void SetError(const char* msg)
@@ -534,16 +1276,90 @@ DLL_EXPORT const char* ZMusic_GetLastError()
 	return staticErrorMessage.c_str();
 }
 
-DLL_EXPORT zmusic_bool ZMusic_WriteSMF(MIDISource* source, const char *fn, int looplimit)
+//==========================================================================
+//
+// song length and loop points
+//
+// MIDI sources get walked once without rendering, the result is cached.
+//
+//==========================================================================
+
+static bool GetMIDISourceTiming(MIDISource *source, int &length, int &loopstart, int &loopend)
+{
+	try
+	{
+		if (source->GetTiming(length, loopstart, loopend)) return true;
+		SetError("Unable to determine the length of this song");
+	}
+	catch (const std::exception & ex)
+	{
+		SetError(ex.what());
+	}
+	return false;
+}
+
+// The walk runs on a copy of the source outside the song lock, which the audio
+// thread needs for every block. The lock is only held to make the copy and to
+// publish the result.
+static bool GetSongTiming(MusInfo *song, int &length, int &loopstart, int &loopend)
 {
-	std::vector<uint8_t> midi;
-	bool success;
+	try
+	{
+		std::unique_ptr<MIDISource> walker;
+		int epoch = 0;
+		{
+			FSongLock lock(song);
+			walker.reset(song->StartTiming(epoch));
+			if (walker == nullptr)
+			{
+				if (song->GetTiming(length, loopstart, loopend)) return true;
+				SetError("Unable to determine the length of this song");
+				return false;
+			}
+		}
+		if (MIDISource::WalkTiming(walker.get(), length, loopstart, loopend))
+		{
+			FSongLock lock(song);
+			song->SetTiming(epoch, length, loopstart, loopend);
+			return true;
+		}
+		SetError("Unable to determine the length of this song");
+	}
+	catch (const std::exception & ex)
+	{
+		SetError(ex.what());
+	}
+	return false;
+}
+
+DLL_EXPORT int ZMusic_GetMIDISourceLengthMs(MIDISource *source)
+{
+	int length, loopstart, loopend;
+	if (!source || !GetMIDISourceTiming(source, length, loopstart, loopend)) return -1;
+	return length;
+}
 
-	if (!source) return false;
-	source->CreateSMF(midi, 1);
-	auto f = MusicIO::utf8_fopen(fn, "wt");
-	if (f == nullptr) return false;
-	success = (fwrite(&midi[0], 1, midi.size(), f) == midi.size());
-	fclose(f);
-	return success;
+DLL_EXPORT zmusic_bool ZMusic_GetMIDISourceLoopPoints(MIDISource *source, int *loopstart_ms, int *loopend_ms)
+{
+	int length, loopstart, loopend;
+	if (!source || !GetMIDISourceTiming(source, length, loopstart, loopend)) return false;
+	if (loopstart_ms) *loopstart_ms = loopstart;
+	if (loopend_ms) *loopend_ms = loopend;
+	return true;
+}
+
+DLL_EXPORT int ZMusic_GetSongLengthMs(MusInfo *song)
+{
+	int length, loopstart, loopend;
+	if (!song || !GetSongTiming(song, length, loopstart, loopend)) return -1;
+	return length;
+}
+
+DLL_EXPORT zmusic_bool ZMusic_GetLoopPoints(MusInfo *song, int *loopstart_ms, int *loopend_ms)
+{
+	int length, loopstart, loopend;
+	if (!song || !GetSongTiming(song, length, loopstart, loopend)) return false;
+	if (loopstart_ms) *loopstart_ms = loopstart;
+	if (loopend_ms) *loopend_ms = loopend;
+	return true;
 }
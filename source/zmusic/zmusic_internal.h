@@ -11,6 +11,9 @@
 
 typedef class MIDISource *ZMusic_MidiSource;
 typedef class MusInfo *ZMusic_MusicStream;
+typedef class MusicMixer *ZMusic_Mixer;
+typedef class AsyncSongOpen *ZMusic_AsyncOpen;
+typedef struct ZMusicConfigSet *ZMusic_Context;
 
 // Build two configurations - lite and full.
 // Lite only  uses FluidSynth for MIDI playback and is licensed under the LGPL v2.1
@@ -30,14 +33,37 @@ typedef class MusInfo *ZMusic_MusicStream;
 
 void SetError(const char *text);
 
+// The context whose configuration the library uses on this thread. Never null,
+// ZMusic_SetThreadContext(nullptr) goes back to GlobalConfig.
+extern thread_local ZMusicConfigSet *CurrentConfig;
+
+// Makes the library use another context on this thread until it goes out of scope.
+// Songs, jobs and asynchronous opens use one to keep working with the context they were created in.
+class FConfigScope
+{
+	ZMusicConfigSet *Previous;
+
+public:
+	explicit FConfigScope(ZMusicConfigSet *config) : Previous(CurrentConfig)
+	{
+		if (config != nullptr) CurrentConfig = config;
+	}
+	~FConfigScope() { CurrentConfig = Previous; }
+	FConfigScope(const FConfigScope &) = delete;
+	FConfigScope &operator=(const FConfigScope &) = delete;
+};
+
+// Frees cached data if zmusic_snd_memorybudget is exceeded.
+void ZMusic_CheckMemoryBudget();
+
 struct CustomFileReader : public MusicIO::FileInterface
 {
 	ZMusicCustomReader* cr;
 
 	CustomFileReader(ZMusicCustomReader* zr) : cr(zr) {}
-	virtual char* gets(char* buff, int n) { return cr->gets(cr, buff, n); }
-	virtual long read(void* buff, int32_t size) { return cr->read(cr, buff, size); }
-	virtual long seek(long offset, int whence) { return cr->seek(cr, offset, whence); }
+	virtual char* gets(char* buff, int n) { ZMUSIC_RT_CHECK(RTV_FILEIO, "ZMusicCustomReader::gets"); return cr->gets(cr, buff, n); }
+	virtual long read(void* buff, int32_t size) { ZMUSIC_RT_CHECK(RTV_FILEIO, "ZMusicCustomReader::read"); return cr->read(cr, buff, size); }
+	virtual long seek(long offset, int whence) { ZMUSIC_RT_CHECK(RTV_FILEIO, "ZMusicCustomReader::seek"); return cr->seek(cr, offset, whence); }
 	virtual long tell() { return cr->tell(cr); }
 	virtual void close()
 	{
@@ -47,6 +73,9 @@ struct CustomFileReader : public MusicIO::FileInterface
 
 };
 
+// Takes over the reader. Its first read waits for 'prebuffer' bytes or the end of the data.
+MusicIO::FileInterface *OpenStreamReader(ZMusicStreamReader *reader, size_t prebuffer);
+
 
 void ZMusic_Printf(int type, const char* msg, ...);
 
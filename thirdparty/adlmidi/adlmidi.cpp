@@ -399,6 +399,10 @@ ADLMIDI_EXPORT int adl_loadEmbeddedBank(struct ADL_MIDIPlayer *device, ADL_Bank
     Synth::BankMap::iterator it = Synth::BankMap::iterator::from_ptrs(bank->pointer);
     size_t id = it->first;
 
+    BanksDump::Database db;
+    if(!db.load())
+        return -1;
+
     const BanksDump::BankEntry &bankEntry = g_embeddedBanks[num];
 
     bool ss = (id & Synth::PercussionTag);
@@ -406,8 +410,8 @@ ADLMIDI_EXPORT int adl_loadEmbeddedBank(struct ADL_MIDIPlayer *device, ADL_Bank
 
 //    bank_count_t maxBanks = ss ? bankEntry.banksPercussionCount : bankEntry.banksMelodicCount;
     bank_count_t banksOffset = ss ? bankEntry.banksOffsetPercussive : bankEntry.banksOffsetMelodic;
-    size_t bankIndex = g_embeddedBanksMidiIndex[banksOffset + bankID];
-    const BanksDump::MidiBank &bankData = g_embeddedBanksMidi[bankIndex];
+    size_t bankIndex = db.midiIndex[banksOffset + bankID];
+    const BanksDump::MidiBank &bankData = db.midi[bankIndex];
 
     for (unsigned i = 0; i < 128; ++i)
     {
@@ -417,8 +421,8 @@ ADLMIDI_EXPORT int adl_loadEmbeddedBank(struct ADL_MIDIPlayer *device, ADL_Bank
             it->second.ins[i].flags = OplInstMeta::Flag_NoSound;
             continue;
         }
-        BanksDump::InstrumentEntry instIn = g_embeddedBanksInstruments[instIdx];
-        adlFromInstrument(instIn, it->second.ins[i]);
+        BanksDump::InstrumentEntry instIn = db.instruments[instIdx];
+        adlFromInstrument(db, instIn, it->second.ins[i]);
     }
     return 0;
 #endif
@@ -976,6 +980,10 @@ ADLMIDI_EXPORT void adl_positionSeek(struct ADL_MIDIPlayer *device, double secon
     MidiPlayer *play = GET_MIDI_PLAYER(device);
     assert(play);
     play->realTime_panic();
+#ifndef ADLMIDI_HW_OPL
+    // Let the notes cut by the panic die away instead of fading out at the new position.
+    play->m_synth->advanceChips(play->m_setup.PCM_RATE);
+#endif
     play->m_setup.delay = play->m_sequencer->seek(seconds, play->m_setup.mindelay);
     play->m_setup.carry = 0.0;
 #else
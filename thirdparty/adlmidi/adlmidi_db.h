@@ -84,15 +84,40 @@ struct Operator
     uint8_t  d_40;
 } ATTRIB_PACKED;
 
+/*
+ * The instrument tables of all embedded banks, inflated from
+ * g_embeddedBanksData while a bank gets loaded. They are not kept, since
+ * the loaded banks are cached and a player only ever needs a few of them.
+ * pack_inst_db makes the data at build time from the tables gen_adldata
+ * writes to inst_db.cpp.
+ *
+ * The data is made of packed little endian rows, in this order:
+ *   g_embeddedBanksMidiIndexCount uint16_t indices into the MIDI banks,
+ *   g_embeddedBanksMidiCount MIDI banks: msb, lsb, 128 int16_t instrument indices,
+ *   g_embeddedBanksInstrumentsCount instruments: the members of InstrumentEntry,
+ *   g_embeddedBanksOperatorsCount operators: uint32_t d_E862, uint8_t d_40.
+ */
+struct Database
+{
+    std::vector<size_t> midiIndex;
+    std::vector<MidiBank> midi;
+    std::vector<InstrumentEntry> instruments;
+    std::vector<Operator> operators;
+
+    bool load();
+};
+
 } /* namespace BanksDump */
 
 #ifndef DISABLE_EMBEDDED_BANKS
 extern const char* const g_embeddedBankNames[];
 extern const BanksDump::BankEntry g_embeddedBanks[];
-extern const size_t g_embeddedBanksMidiIndex[];
-extern const BanksDump::MidiBank g_embeddedBanksMidi[];
-extern const BanksDump::InstrumentEntry g_embeddedBanksInstruments[];
-extern const BanksDump::Operator g_embeddedBanksOperators[];
+extern const size_t g_embeddedBanksMidiIndexCount;
+extern const size_t g_embeddedBanksMidiCount;
+extern const size_t g_embeddedBanksInstrumentsCount;
+extern const size_t g_embeddedBanksOperatorsCount;
+extern const size_t g_embeddedBanksDataSize;
+extern const unsigned char g_embeddedBanksData[];
 #endif
 
 #endif // ADLDATA_DB_H
@@ -55,12 +55,26 @@ void cvt_FMIns_to_ADLI(ADL_Instrument &ins, const OplInstMeta &in)
     cvt_FMIns_to_generic(ins, in);
 }
 
+/* FNV-1a of the bank data, the embedded bank the file is loaded over goes into the seed */
+static uint64_t bankCacheKey(const char *data, size_t size, uint32_t bankId)
+{
+    uint64_t hash = 14695981039346656037ULL ^ bankId;
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    hash ^= size;
+    return hash & ~(uint64_t(1) << 63);
+}
+
 bool MIDIplay::LoadBank(FileAndMemReader &fr)
 {
     int err = 0;
     WOPLFile *wopl = NULL;
     char *raw_file_data = NULL;
     size_t  fsize;
+    uint64_t cacheKey;
     if(!fr.isValid())
     {
         errorStringOut = "Custom bank: Invalid data stream!";
@@ -79,6 +93,21 @@ bool MIDIplay::LoadBank(FileAndMemReader &fr)
     }
     fr.read(raw_file_data, 1, fsize);
 
+    Synth &synth = *m_synth;
+
+    // A bank that was already converted only needs to be copied
+    cacheKey = bankCacheKey(raw_file_data, fsize, m_setup.bankId);
+    if(synth.loadCachedBanks(cacheKey))
+    {
+        free(raw_file_data);
+        m_setup.deepTremoloMode = -1;
+        m_setup.deepVibratoMode = -1;
+        m_setup.volumeScaleModel = ADLMIDI_VolumeModel_AUTO;
+        synth.m_embeddedBank = Synth::CustomBankTag;
+        applySetup();
+        return true;
+    }
+
     // Parse bank file from the memory
     wopl = WOPL_LoadBankFromMem((void*)raw_file_data, fsize, &err);
     //Free the buffer no more needed
@@ -110,8 +139,6 @@ bool MIDIplay::LoadBank(FileAndMemReader &fr)
         }
     }
 
-    Synth &synth = *m_synth;
-
     synth.setEmbeddedBank(m_setup.bankId);
 
     synth.m_insBankSetup.scaleModulators = false;
@@ -145,6 +172,7 @@ bool MIDIplay::LoadBank(FileAndMemReader &fr)
     }
 
     synth.m_embeddedBank = Synth::CustomBankTag; // Use dynamic banks!
+    synth.storeCachedBanks(cacheKey);
     //Percussion offset is count of instruments multipled to count of melodic banks
     applySetup();
 
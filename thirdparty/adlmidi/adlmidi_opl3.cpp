@@ -25,6 +25,8 @@
 #include "adlmidi_private.hpp"
 #include <stdlib.h>
 #include <cassert>
+#include <map>
+#include <mutex>
 
 #ifndef DISABLE_EMBEDDED_BANKS
 #include "wopl/wopl_file.h"
@@ -902,9 +904,53 @@ bool OPL3::setupLocked()
             m_musicMode == MODE_RSXX);
 }
 
+/*
+ * Converted bank sets, shared by all players of the process, so that
+ * creating a player or loading the same bank file again only copies them.
+ * Embedded banks use keys with the top bit set, bank files use a hash of their data.
+ */
+struct CachedBankSet
+{
+    OplBankSetup setup;
+    std::vector<std::pair<size_t, OPL3::Bank> > banks;
+};
+
+static std::mutex s_bankCacheLock;
+static std::map<uint64_t, CachedBankSet> s_bankCache;
+
+bool OPL3::loadCachedBanks(uint64_t key)
+{
+    std::lock_guard<std::mutex> lock(s_bankCacheLock);
+    std::map<uint64_t, CachedBankSet>::const_iterator found = s_bankCache.find(key);
+    if(found == s_bankCache.end())
+        return false;
+
+    const CachedBankSet &set = found->second;
+    m_insBanks.clear();
+    m_insBanks.reserve(set.banks.size());
+    for(size_t i = 0; i < set.banks.size(); i++)
+        m_insBanks[set.banks[i].first] = set.banks[i].second;
+    m_insBankSetup = set.setup;
+    return true;
+}
+
+void OPL3::storeCachedBanks(uint64_t key)
+{
+    CachedBankSet set;
+    set.setup = m_insBankSetup;
+    set.banks.reserve(m_insBanks.size());
+    for(BankMap::iterator it = m_insBanks.begin(); it != m_insBanks.end(); ++it)
+        set.banks.push_back(*it);
+
+    std::lock_guard<std::mutex> lock(s_bankCacheLock);
+    s_bankCache[key].banks.swap(set.banks);
+    s_bankCache[key].setup = set.setup;
+}
+
 void OPL3::setEmbeddedBank(uint32_t bank)
 {
 #ifndef DISABLE_EMBEDDED_BANKS
+    const uint64_t cacheKey = (uint64_t(1) << 63) | bank;
     m_embeddedBank = bank;
     //Embedded banks are supports 128:128 GM set only
     m_insBanks.clear();
@@ -912,6 +958,13 @@ void OPL3::setEmbeddedBank(uint32_t bank)
     if(bank >= static_cast<uint32_t>(g_embeddedBanksCount))
         return;
 
+    if(loadCachedBanks(cacheKey))
+        return;
+
+    BanksDump::Database db;
+    if(!db.load())
+        return;
+
     const BanksDump::BankEntry &bankEntry = g_embeddedBanks[m_embeddedBank];
     m_insBankSetup.deepTremolo = ((bankEntry.bankSetup >> 8) & 0x01) != 0;
     m_insBankSetup.deepVibrato = ((bankEntry.bankSetup >> 8) & 0x02) != 0;
@@ -926,8 +979,8 @@ void OPL3::setEmbeddedBank(uint32_t bank)
 
         for(bank_count_t bankID = 0; bankID < maxBanks; bankID++)
         {
-            size_t bankIndex = g_embeddedBanksMidiIndex[banksOffset + bankID];
-            const BanksDump::MidiBank &bankData = g_embeddedBanksMidi[bankIndex];
+            size_t bankIndex = db.midiIndex[banksOffset + bankID];
+            const BanksDump::MidiBank &bankData = db.midi[bankIndex];
             size_t bankMidiIndex = static_cast<size_t>((bankData.msb * 256) + bankData.lsb) + (ss ? static_cast<size_t>(PercussionTag) : 0);
             Bank &bankTarget = m_insBanks[bankMidiIndex];
 
@@ -939,14 +992,15 @@ void OPL3::setEmbeddedBank(uint32_t bank)
                     bankTarget.ins[instId].flags = OplInstMeta::Flag_NoSound;
                     continue;
                 }
-                BanksDump::InstrumentEntry instIn = g_embeddedBanksInstruments[instIndex];
+                BanksDump::InstrumentEntry instIn = db.instruments[instIndex];
                 OplInstMeta &instOut = bankTarget.ins[instId];
 
-                adlFromInstrument(instIn, instOut);
+                adlFromInstrument(db, instIn, instOut);
             }
         }
     }
 
+    storeCachedBanks(cacheKey);
 #else
     ADL_UNUSED(bank);
 #endif
@@ -974,6 +1028,7 @@ void OPL3::writeReg(size_t chip, uint16_t address, uint8_t value)
 #   endif//__WATCOMC__
 
 #else//ADLMIDI_HW_OPL
+    m_chips[chip]->noteWrite(address, value);
     m_chips[chip]->writeReg(address, value);
 #endif
 }
@@ -983,6 +1038,7 @@ void OPL3::writeRegI(size_t chip, uint32_t address, uint32_t value)
 #ifdef ADLMIDI_HW_OPL
     writeReg(chip, static_cast<uint16_t>(address), static_cast<uint8_t>(value));
 #else//ADLMIDI_HW_OPL
+    m_chips[chip]->noteWrite(static_cast<uint16_t>(address), static_cast<uint8_t>(value));
     m_chips[chip]->writeReg(static_cast<uint16_t>(address), static_cast<uint8_t>(value));
 #endif
 }
@@ -1718,6 +1774,12 @@ void OPL3::clearChips()
         m_chips[i].reset(NULL);
     m_chips.clear();
 }
+
+void OPL3::advanceChips(size_t frames)
+{
+    for(size_t i = 0; i < m_chips.size(); i++)
+        m_chips[i]->advance(frames);
+}
 #endif
 
 void OPL3::reset(int emulator, unsigned long PCM_RATE, void *audioTickHandler)
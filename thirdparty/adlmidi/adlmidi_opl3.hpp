@@ -227,6 +227,19 @@ public:
      */
     void setEmbeddedBank(uint32_t bank);
 
+    /**
+     * @brief Replace the current banks with a copy from the process-wide bank cache
+     * @param key Identifier of the bank set
+     * @return true when the bank set was in the cache
+     */
+    bool loadCachedBanks(uint64_t key);
+
+    /**
+     * @brief Store a copy of the current banks in the process-wide bank cache
+     * @param key Identifier of the bank set
+     */
+    void storeCachedBanks(uint64_t key);
+
     /**
      * @brief Write data to OPL3 chip register
      * @param chip Index of emulated chip. In hardware OPL3 builds, this parameter is ignored
@@ -326,6 +339,12 @@ public:
      * @brief Clean up all running emulated chip instances
      */
     void clearChips();
+
+    /**
+     * @brief Run all chips on without output, see OPLChipBase::advance()
+     * @param frames Number of frames at the output rate
+     */
+    void advanceChips(size_t frames);
     #endif
 
     /**
@@ -25,6 +25,7 @@
 #include "adlmidi_opl3.hpp"
 #include "adlmidi_private.hpp"
 #include "wopl/wopl_file.h"
+#include <miniz.h>
 
 
 std::string ADLMIDI_ErrorString;
@@ -94,7 +95,73 @@ int adlCalculateFourOpChannels(MIDIplay *play, bool silent)
 }
 
 #ifndef DISABLE_EMBEDDED_BANKS
-void adlFromInstrument(const BanksDump::InstrumentEntry &instIn, OplInstMeta &instOut)
+namespace
+{
+
+struct DatabaseReader
+{
+    const uint8_t *p;
+
+    uint8_t u8() { return *p++; }
+    int8_t s8() { return static_cast<int8_t>(*p++); }
+    uint16_t u16() { uint16_t v = static_cast<uint16_t>(p[0] | (p[1] << 8)); p += 2; return v; }
+    int16_t s16() { return static_cast<int16_t>(u16()); }
+    uint32_t u32() { uint32_t v = u16(); return v | (static_cast<uint32_t>(u16()) << 16); }
+};
+
+} // namespace
+
+bool BanksDump::Database::load()
+{
+    // The sizes of the rows, see adlmidi_db.h.
+    const size_t size = g_embeddedBanksMidiIndexCount * 2 + g_embeddedBanksMidiCount * (2 + 128 * 2) +
+                        g_embeddedBanksInstrumentsCount * 22 + g_embeddedBanksOperatorsCount * 5;
+    std::vector<uint8_t> data(size);
+    mz_ulong length = static_cast<mz_ulong>(size);
+    if(mz_uncompress(data.data(), &length, g_embeddedBanksData, static_cast<mz_ulong>(g_embeddedBanksDataSize)) != MZ_OK || length != size)
+        return false;
+
+    DatabaseReader rd = { data.data() };
+    midiIndex.resize(g_embeddedBanksMidiIndexCount);
+    for(size_t i = 0; i < midiIndex.size(); i++)
+        midiIndex[i] = rd.u16();
+
+    midi.resize(g_embeddedBanksMidiCount);
+    for(size_t i = 0; i < midi.size(); i++)
+    {
+        midi[i].msb = rd.u8();
+        midi[i].lsb = rd.u8();
+        for(size_t j = 0; j < 128; j++)
+            midi[i].insts[j] = rd.s16();
+    }
+
+    instruments.resize(g_embeddedBanksInstrumentsCount);
+    for(size_t i = 0; i < instruments.size(); i++)
+    {
+        InstrumentEntry &ins = instruments[i];
+        ins.noteOffset1 = rd.s16();
+        ins.noteOffset2 = rd.s16();
+        ins.midiVelocityOffset = rd.s8();
+        ins.percussionKeyNumber = rd.u8();
+        ins.instFlags = rd.u8();
+        ins.secondVoiceDetune = rd.s8();
+        ins.fbConn = rd.u16();
+        ins.delay_on_ms = rd.u16();
+        ins.delay_off_ms = rd.u16();
+        for(size_t j = 0; j < 4; j++)
+            ins.ops[j] = rd.s16();
+    }
+
+    operators.resize(g_embeddedBanksOperatorsCount);
+    for(size_t i = 0; i < operators.size(); i++)
+    {
+        operators[i].d_E862 = rd.u32();
+        operators[i].d_40 = rd.u8();
+    }
+    return true;
+}
+
+void adlFromInstrument(const BanksDump::Database &db, const BanksDump::InstrumentEntry &instIn, OplInstMeta &instOut)
 {
     instOut.voice2_fine_tune = 0.0;
     if(instIn.secondVoiceDetune != 0)
@@ -111,8 +178,8 @@ void adlFromInstrument(const BanksDump::InstrumentEntry &instIn, OplInstMeta &in
     {
         if((instIn.ops[(op * 2) + 0] < 0) || (instIn.ops[(op * 2) + 1] < 0))
             break;
-        const BanksDump::Operator &op1 = g_embeddedBanksOperators[instIn.ops[(op * 2) + 0]];
-        const BanksDump::Operator &op2 = g_embeddedBanksOperators[instIn.ops[(op * 2) + 1]];
+        const BanksDump::Operator &op1 = db.operators[instIn.ops[(op * 2) + 0]];
+        const BanksDump::Operator &op2 = db.operators[instIn.ops[(op * 2) + 1]];
         instOut.op[op].modulator_E862 = op1.d_E862;
         instOut.op[op].modulator_40   = op1.d_40;
         instOut.op[op].carrier_E862 = op2.d_E862;
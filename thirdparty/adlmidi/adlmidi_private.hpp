@@ -228,7 +228,7 @@ extern void adl_audioTickHandler(void *instance, uint32_t chipId, uint32_t rate)
 extern int adlCalculateFourOpChannels(MIDIplay *play, bool silent = false);
 
 #ifndef DISABLE_EMBEDDED_BANKS
-extern void adlFromInstrument(const BanksDump::InstrumentEntry &instIn, OplInstMeta &instOut);
+extern void adlFromInstrument(const BanksDump::Database &db, const BanksDump::InstrumentEntry &instIn, OplInstMeta &instOut);
 #endif
 
 #endif // ADLMIDI_PRIVATE_HPP
@@ -43,9 +43,15 @@ public:
     {
         CHIPTYPE_OPL3 = 0, CHIPTYPE_OPL2 = 1
     };
+    //! Silent output frames without any keyed on channel after which the chip counts as idle
+    enum { idleFrames = 4096 };
 protected:
     uint32_t m_id;
     uint32_t m_rate;
+    //! Keyed on melodic channels (bits 0-17) and rhythm instruments (bits 18-22)
+    uint32_t m_keysOn;
+    //! Silent output frames since the last register write while nothing was keyed on
+    uint32_t m_silentFrames;
 public:
     OPLChipBase();
     virtual ~OPLChipBase();
@@ -53,6 +59,19 @@ public:
     uint32_t chipId() const { return m_id; }
     void setChipId(uint32_t id) { m_id = id; }
 
+    /**
+     * @brief Track key on state for the idle detection, call for every register write
+     * @param addr Register address
+     * @param data Written value
+     */
+    void noteWrite(uint16_t addr, uint8_t data);
+
+    /**
+     * @brief True when the chip has been silent with all keys off since its last register write.
+     * The generate functions then output silence without emulating the chip.
+     */
+    bool isIdle() const { return m_silentFrames >= (uint32_t)idleFrames; }
+
     virtual bool canRunAtPcmRate() const = 0;
     virtual bool isRunningAtPcmRate() const = 0;
     virtual bool setRunningAtPcmRate(bool r) = 0;
@@ -77,6 +96,14 @@ public:
     virtual void generate32(int32_t *output, size_t frames) = 0;
     virtual void generateAndMix32(int32_t *output, size_t frames) = 0;
 
+    /**
+     * @brief Let the chip run on for some time without producing any output,
+     * so released notes fade out the same way they would while playing.
+     * The chip runs at its native rate without the resampler and stops early once it is idle.
+     * @param frames Number of frames at the output rate
+     */
+    virtual void advance(size_t frames) = 0;
+
     virtual const char* emulatorName() = 0;
     virtual ChipType chipType() = 0;
 private:
@@ -106,12 +133,14 @@ public:
     void generateAndMix(int16_t *output, size_t frames) override;
     void generate32(int32_t *output, size_t frames) override;
     void generateAndMix32(int32_t *output, size_t frames) override;
+    void advance(size_t frames) override;
 private:
     bool m_runningAtPcmRate;
 #if defined(ADLMIDI_AUDIO_TICK_HANDLER)
     void *m_audioTickHandlerInstance;
 #endif
     void nativeTick(int16_t *frame);
+    void countSilence(const int32_t *frame);
     void setupResampler(uint32_t rate);
     void resetResampler();
     void resampledGenerate(int32_t *output);
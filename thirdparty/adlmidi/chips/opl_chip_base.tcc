@@ -1,5 +1,6 @@
 #include "opl_chip_base.h"
 #include <cmath>
+#include <cstring>
 
 #if defined(ADLMIDI_ENABLE_HQ_RESAMPLER)
 #include <zita-resampler/vresampler.h>
@@ -21,10 +22,32 @@
 
 inline OPLChipBase::OPLChipBase() :
     m_id(0),
-    m_rate(44100)
+    m_rate(44100),
+    m_keysOn(0),
+    m_silentFrames(0)
 {
 }
 
+inline void OPLChipBase::noteWrite(uint16_t addr, uint8_t data)
+{
+    uint8_t reg = addr & 0xFF;
+    m_silentFrames = 0;
+    if(reg >= 0xB0 && reg <= 0xB8)
+    {
+        uint32_t bit = 1u << (((addr >> 8) & 1) * 9 + (reg - 0xB0));
+        if(data & 0x20)
+            m_keysOn |= bit;
+        else
+            m_keysOn &= ~bit;
+    }
+    else if(addr == 0xBD)
+    {
+        m_keysOn &= 0x3FFFF;
+        if(data & 0x20)
+            m_keysOn |= uint32_t(data & 0x1F) << 18;
+    }
+}
+
 inline OPLChipBase::~OPLChipBase()
 {
 }
@@ -101,17 +124,25 @@ uint32_t OPLChipBaseT<T>::effectiveRate() const
 template <class T>
 void OPLChipBaseT<T>::reset()
 {
+    m_keysOn = 0;
+    m_silentFrames = 0;
     resetResampler();
 }
 
 template <class T>
 void OPLChipBaseT<T>::generate(int16_t *output, size_t frames)
 {
+    if(isIdle())
+    {
+        std::memset(output, 0, frames * 2 * sizeof(int16_t));
+        return;
+    }
     static_cast<T *>(this)->nativePreGenerate();
     for(size_t i = 0; i < frames; ++i)
     {
         int32_t frame[2];
         static_cast<T *>(this)->resampledGenerate(frame);
+        countSilence(frame);
         for (unsigned c = 0; c < 2; ++c) {
             int32_t temp = frame[c];
             temp = (temp > -32768) ? temp : -32768;
@@ -126,11 +157,14 @@ void OPLChipBaseT<T>::generate(int16_t *output, size_t frames)
 template <class T>
 void OPLChipBaseT<T>::generateAndMix(int16_t *output, size_t frames)
 {
+    if(isIdle())
+        return;
     static_cast<T *>(this)->nativePreGenerate();
     for(size_t i = 0; i < frames; ++i)
     {
         int32_t frame[2];
         static_cast<T *>(this)->resampledGenerate(frame);
+        countSilence(frame);
         for (unsigned c = 0; c < 2; ++c) {
             int32_t temp = (int32_t)output[c] + frame[c];
             temp = (temp > -32768) ? temp : -32768;
@@ -145,10 +179,16 @@ void OPLChipBaseT<T>::generateAndMix(int16_t *output, size_t frames)
 template <class T>
 void OPLChipBaseT<T>::generate32(int32_t *output, size_t frames)
 {
+    if(isIdle())
+    {
+        std::memset(output, 0, frames * 2 * sizeof(int32_t));
+        return;
+    }
     static_cast<T *>(this)->nativePreGenerate();
     for(size_t i = 0; i < frames; ++i)
     {
         static_cast<T *>(this)->resampledGenerate(output);
+        countSilence(output);
         output += 2;
     }
     static_cast<T *>(this)->nativePostGenerate();
@@ -157,11 +197,14 @@ void OPLChipBaseT<T>::generate32(int32_t *output, size_t frames)
 template <class T>
 void OPLChipBaseT<T>::generateAndMix32(int32_t *output, size_t frames)
 {
+    if(isIdle())
+        return;
     static_cast<T *>(this)->nativePreGenerate();
     for(size_t i = 0; i < frames; ++i)
     {
         int32_t frame[2];
         static_cast<T *>(this)->resampledGenerate(frame);
+        countSilence(frame);
         output[0] += frame[0];
         output[1] += frame[1];
         output += 2;
@@ -169,6 +212,42 @@ void OPLChipBaseT<T>::generateAndMix32(int32_t *output, size_t frames)
     static_cast<T *>(this)->nativePostGenerate();
 }
 
+template <class T>
+void OPLChipBaseT<T>::advance(size_t frames)
+{
+    if(isIdle())
+        return;
+    uint64_t ticks = m_runningAtPcmRate ? (uint64_t)frames : (uint64_t)frames * nativeRate / m_rate;
+    static_cast<T *>(this)->nativePreGenerate();
+    for(uint64_t i = 0; i < ticks && !isIdle(); ++i)
+    {
+        // Not nativeTick: the audio tick handler must not see this time pass.
+        int16_t in[2];
+        static_cast<T *>(this)->nativeGenerate(in);
+        int32_t frame[2] = { in[0], in[1] };
+        countSilence(frame);
+    }
+    static_cast<T *>(this)->nativePostGenerate();
+    // What the resampler still holds was generated before the skip.
+    resetResampler();
+}
+
+template <class T>
+inline void OPLChipBaseT<T>::countSilence(const int32_t *frame)
+{
+#if !defined(ADLMIDI_AUDIO_TICK_HANDLER) // the tick handler needs every sample to be generated
+    if(m_keysOn == 0 && frame[0] == 0 && frame[1] == 0)
+    {
+        if(m_silentFrames < (uint32_t)idleFrames)
+            ++m_silentFrames;
+    }
+    else
+        m_silentFrames = 0;
+#else
+    (void)frame;
+#endif
+}
+
 template <class T>
 void OPLChipBaseT<T>::nativeTick(int16_t *frame)
 {
@@ -207,7 +286,8 @@ void OPLChipBaseT<T>::resetResampler()
 template <class T>
 void OPLChipBaseT<T>::resampledGenerate(int32_t *output)
 {
-    if(UNLIKELY(m_runningAtPcmRate))
+    // Nothing to convert if the output is wanted at the chip's own rate.
+    if(UNLIKELY(m_runningAtPcmRate || m_rate == (uint32_t)nativeRate))
     {
         int16_t in[2];
         static_cast<T *>(this)->nativeTick(in);
@@ -243,7 +323,8 @@ void OPLChipBaseT<T>::resampledGenerate(int32_t *output)
 template <class T>
 void OPLChipBaseT<T>::resampledGenerate(int32_t *output)
 {
-    if(UNLIKELY(m_runningAtPcmRate))
+    // Nothing to convert if the output is wanted at the chip's own rate.
+    if(UNLIKELY(m_runningAtPcmRate || m_rate == (uint32_t)nativeRate))
     {
         int16_t in[2];
         static_cast<T *>(this)->nativeTick(in);
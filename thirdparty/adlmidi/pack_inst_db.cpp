@@ -0,0 +1,156 @@
+/*
+ * libADLMIDI is a free Software MIDI synthesizer library with OPL3 emulation
+ *
+ * Original ADLMIDI code: Copyright (c) 2010-2014 Joel Yliluoma <bisqwit@iki.fi>
+ * ADLMIDI Library API:   Copyright (c) 2015-2022 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * Library is based on the ADLMIDI, a MIDI player for Linux and Windows with OPL3 emulation:
+ * http://iki.fi/bisqwit/source/adlmidi.html
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Build tool that turns inst_db.cpp, as gen_adldata writes it, into the
+ * inst_db_packed.cpp the library is built with: the bank list and names
+ * stay as they are, the instrument tables become one zlib stream in the
+ * layout described by BanksDump::Database.
+ *
+ *   pack_inst_db <output>
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <miniz.h>
+
+#include "inst_db.cpp"
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+namespace
+{
+struct DatabaseWriter
+{
+    std::vector<uint8_t> data;
+    void u8(unsigned v) { data.push_back(static_cast<uint8_t>(v)); }
+    void u16(unsigned v) { u8(v & 0xff); u8((v >> 8) & 0xff); }
+    void u32(uint32_t v) { u16(v & 0xffff); u16(v >> 16); }
+};
+
+std::string quote(const char *s)
+{
+    std::string out = "\"";
+    for(; *s; s++)
+    {
+        if(*s == '"' || *s == '\\')
+            out += '\\';
+        out += *s;
+    }
+    return out + "\"";
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if(argc != 2)
+    {
+        fprintf(stderr, "Usage: pack_inst_db <output>\n");
+        return 1;
+    }
+
+    DatabaseWriter wr;
+    for(size_t i = 0; i < COUNT(g_embeddedBanksMidiIndex); i++)
+    {
+        if(g_embeddedBanksMidiIndex[i] > 0xffff)
+        {
+            fprintf(stderr, "pack_inst_db: MIDI bank index %u does not fit\n", (unsigned)i);
+            return 1;
+        }
+        wr.u16(static_cast<unsigned>(g_embeddedBanksMidiIndex[i]));
+    }
+    for(size_t i = 0; i < COUNT(g_embeddedBanksMidi); i++)
+    {
+        const BanksDump::MidiBank &bank = g_embeddedBanksMidi[i];
+        wr.u8(bank.msb);
+        wr.u8(bank.lsb);
+        for(size_t j = 0; j < 128; j++)
+            wr.u16(static_cast<uint16_t>(bank.insts[j]));
+    }
+    for(size_t i = 0; i < COUNT(g_embeddedBanksInstruments); i++)
+    {
+        const BanksDump::InstrumentEntry &ins = g_embeddedBanksInstruments[i];
+        wr.u16(static_cast<uint16_t>(ins.noteOffset1));
+        wr.u16(static_cast<uint16_t>(ins.noteOffset2));
+        wr.u8(static_cast<uint8_t>(ins.midiVelocityOffset));
+        wr.u8(ins.percussionKeyNumber);
+        wr.u8(ins.instFlags);
+        wr.u8(static_cast<uint8_t>(ins.secondVoiceDetune));
+        wr.u16(ins.fbConn);
+        wr.u16(ins.delay_on_ms);
+        wr.u16(ins.delay_off_ms);
+        for(size_t j = 0; j < 4; j++)
+            wr.u16(static_cast<uint16_t>(ins.ops[j]));
+    }
+    for(size_t i = 0; i < COUNT(g_embeddedBanksOperators); i++)
+    {
+        wr.u32(g_embeddedBanksOperators[i].d_E862);
+        wr.u8(g_embeddedBanksOperators[i].d_40);
+    }
+
+    mz_ulong packedLen = mz_compressBound(static_cast<mz_ulong>(wr.data.size()));
+    std::vector<uint8_t> packed(packedLen);
+    if(mz_compress2(packed.data(), &packedLen, wr.data.data(), static_cast<mz_ulong>(wr.data.size()), MZ_UBER_COMPRESSION) != MZ_OK)
+    {
+        fprintf(stderr, "pack_inst_db: cannot compress the tables\n");
+        return 1;
+    }
+
+    FILE *f = fopen(argv[1], "w");
+    if(!f)
+    {
+        fprintf(stderr, "pack_inst_db: cannot create %s\n", argv[1]);
+        return 1;
+    }
+    fprintf(f, "/* Generated by pack_inst_db from inst_db.cpp at build time. Don't edit it, see inst_db.cpp. */\n\n");
+    fprintf(f, "#include \"adlmidi_db.h\"\n\n");
+    fprintf(f, "const size_t g_embeddedBanksCount = %u;\n\n", (unsigned)g_embeddedBanksCount);
+    fprintf(f, "const BanksDump::BankEntry g_embeddedBanks[] =\n{\n");
+    for(size_t i = 0; i < g_embeddedBanksCount; i++)
+    {
+        const BanksDump::BankEntry &bank = g_embeddedBanks[i];
+        fprintf(f, "{0x%04X,%u,%u,%s,%u,%u},\n", bank.bankSetup, bank.banksMelodicCount, bank.banksPercussionCount,
+                quote(bank.title).c_str(), bank.banksOffsetMelodic, bank.banksOffsetPercussive);
+    }
+    fprintf(f, "};\n\n");
+    fprintf(f, "#define q(x) g_embeddedBanks[x].title\nconst char* const g_embeddedBankNames[] =\n{\n");
+    for(size_t i = 0; i < g_embeddedBanksCount; i++)
+        fprintf(f, "q(%u),", (unsigned)i);
+    fprintf(f, "\nNULL\n};\n\n");
+    fprintf(f, "const size_t g_embeddedBanksMidiIndexCount = %u;\n", (unsigned)COUNT(g_embeddedBanksMidiIndex));
+    fprintf(f, "const size_t g_embeddedBanksMidiCount = %u;\n", (unsigned)COUNT(g_embeddedBanksMidi));
+    fprintf(f, "const size_t g_embeddedBanksInstrumentsCount = %u;\n", (unsigned)COUNT(g_embeddedBanksInstruments));
+    fprintf(f, "const size_t g_embeddedBanksOperatorsCount = %u;\n\n", (unsigned)COUNT(g_embeddedBanksOperators));
+    fprintf(f, "const size_t g_embeddedBanksDataSize = %u;\n\n", (unsigned)packedLen);
+    fprintf(f, "const unsigned char g_embeddedBanksData[] =\n{");
+    for(mz_ulong i = 0; i < packedLen; i++)
+        fprintf(f, "%s0x%02x,", i % 16 == 0 ? "\n" : "", packed[i]);
+    fprintf(f, "\n};\n");
+    if(fclose(f) != 0)
+    {
+        fprintf(stderr, "pack_inst_db: cannot write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
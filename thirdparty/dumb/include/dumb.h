@@ -401,6 +401,29 @@ enum
 };
         
 void DUMBEXPORT dumb_it_set_ramp_style(DUMB_IT_SIGRENDERER * sigrenderer, int ramp_style);
+
+/* With a scale other than 0 the rendered samples are floats, in place of the
+ * sample_t values and multiplied by the scale. 1.0f / (1 << 24) gives the
+ * usual -1 to 1 range.
+ */
+void DUMBEXPORT dumb_it_set_float_output(DUMB_IT_SIGRENDERER * sigrenderer, float scale);
+
+/* Lets the voices of a module be mixed in up to n_threads jobs at once.
+ * parallel_for must call job(job_data, i) once for every i from 0 to
+ * count - 1 and only return when all of them are done. The output does not
+ * change. A NULL parallel_for or fewer than 2 threads mixes everything on
+ * the calling thread, which is the default.
+ */
+typedef void (*DUMB_PARALLEL_FOR)(void *data, int count, void (*job)(void *job_data, int index), void *job_data);
+
+void DUMBEXPORT dumb_it_set_parallel_for(DUMB_IT_SIGRENDERER * sigrenderer, DUMB_PARALLEL_FOR parallel_for, void * data, int n_threads);
+
+/* Lets the IT loaders decompress samples in parallel. This is global, and
+ * only used for files opened with dumbfile_open_memory, where every job can
+ * read the file on its own. A NULL parallel_for, the default, loads all
+ * samples on the calling thread.
+ */
+void DUMBEXPORT dumb_it_set_load_parallel_for(DUMB_PARALLEL_FOR parallel_for, void * data);
         
 void DUMBEXPORT dumb_it_set_loop_callback(DUMB_IT_SIGRENDERER *sigrenderer, int (DUMBCALLBACK *callback)(void *data), void *data);
 void DUMBEXPORT dumb_it_set_xm_speed_zero_callback(DUMB_IT_SIGRENDERER *sigrenderer, int (DUMBCALLBACK *callback)(void *data), void *data);
@@ -668,6 +691,7 @@ typedef struct DUMB_CLICK_REMOVER DUMB_CLICK_REMOVER;
 
 DUMB_CLICK_REMOVER *DUMBEXPORT dumb_create_click_remover(void);
 void DUMBEXPORT dumb_record_click(DUMB_CLICK_REMOVER *cr, int32 pos, sample_t step);
+void DUMBEXPORT dumb_move_clicks(DUMB_CLICK_REMOVER *dst, DUMB_CLICK_REMOVER *src);
 void DUMBEXPORT dumb_remove_clicks(DUMB_CLICK_REMOVER *cr, sample_t *samples, int32 length, int step, double halflife);
 sample_t DUMBEXPORT dumb_click_remover_get_offset(DUMB_CLICK_REMOVER *cr);
 void DUMBEXPORT dumb_destroy_click_remover(DUMB_CLICK_REMOVER *cr);
@@ -676,6 +700,7 @@ DUMB_CLICK_REMOVER **DUMBEXPORT dumb_create_click_remover_array(int n);
 void DUMBEXPORT dumb_record_click_array(int n, DUMB_CLICK_REMOVER **cr, int32 pos, sample_t *step);
 void DUMBEXPORT dumb_record_click_negative_array(int n, DUMB_CLICK_REMOVER **cr, int32 pos, sample_t *step);
 void DUMBEXPORT dumb_remove_clicks_array(int n, DUMB_CLICK_REMOVER **cr, sample_t **samples, int32 length, double halflife);
+void DUMBEXPORT dumb_remove_clicks_array_float(int n, DUMB_CLICK_REMOVER **cr, sample_t **samples, int32 length, double halflife, float scale);
 void DUMBEXPORT dumb_click_remover_get_offset_array(int n, DUMB_CLICK_REMOVER **cr, sample_t *offset);
 void DUMBEXPORT dumb_destroy_click_remover_array(int n, DUMB_CLICK_REMOVER **cr);
 
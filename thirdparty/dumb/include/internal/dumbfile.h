@@ -8,6 +8,10 @@ struct DUMBFILE
     const DUMBFILE_SYSTEM *dfs;
     void *file;
     long pos;
+    /* Set by dumbfile_open_memory. Such files are read from here directly
+     * instead of through the dfs, which the loaders call once per byte. */
+    const unsigned char *data;
+    long size;
 };
 
 #endif // DUMBFILE_H
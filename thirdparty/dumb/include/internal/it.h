@@ -101,6 +101,7 @@ typedef struct IT_PLAYING IT_PLAYING;
 typedef struct IT_CHANNEL IT_CHANNEL;
 typedef struct IT_CHECKPOINT IT_CHECKPOINT;
 typedef struct IT_CALLBACKS IT_CALLBACKS;
+typedef struct IT_MIX_WORKER IT_MIX_WORKER;
 
 
 
@@ -729,6 +730,16 @@ struct DUMB_IT_SIGRENDERER
 	int gvz_sub_time;
 
     int ramp_style;
+
+	/* When not 0, the output is converted to float and multiplied by this. */
+	float float_scale;
+
+	/* Set by dumb_it_set_parallel_for(). mix_workers has n_mix_threads
+	 * entries and is allocated when it is first needed. */
+	DUMB_PARALLEL_FOR parallel_for;
+	void *parallel_data;
+	int n_mix_threads;
+	IT_MIX_WORKER *mix_workers;
     
 	//int max_output;
 
@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "dumb.h"
 
@@ -65,6 +66,8 @@ DUMBFILE *DUMBEXPORT dumbfile_open(const char *filename)
 	}
 
 	f->pos = 0;
+	f->data = NULL;
+	f->size = 0;
 
 	return f;
 }
@@ -91,6 +94,8 @@ DUMBFILE *DUMBEXPORT dumbfile_open_ex(void *file, const DUMBFILE_SYSTEM *dfs)
 	f->file = file;
 
 	f->pos = 0;
+	f->data = NULL;
+	f->size = 0;
 
 	return f;
 }
@@ -118,7 +123,12 @@ int DUMBEXPORT dumbfile_skip(DUMBFILE *f, long n)
 
 	f->pos += n;
 
-	if (f->dfs->skip) {
+	if (f->data) {
+		if (f->pos > f->size) {
+			f->pos = -1;
+			return -1;
+		}
+	} else if (f->dfs->skip) {
 		rv = (*f->dfs->skip)(f->file, n);
 		if (rv) {
 			f->pos = -1;
@@ -149,6 +159,14 @@ int DUMBEXPORT dumbfile_getc(DUMBFILE *f)
 	if (f->pos < 0)
 		return -1;
 
+	if (f->data) {
+		if (f->pos >= f->size) {
+			f->pos = -1;
+			return -1;
+		}
+		return f->data[f->pos++];
+	}
+
 	rv = (*f->dfs->getc)(f->file);
 
 	if (rv < 0) {
@@ -172,6 +190,16 @@ int DUMBEXPORT dumbfile_igetw(DUMBFILE *f)
 	if (f->pos < 0)
 		return -1;
 
+	if (f->data) {
+		const unsigned char *p = f->data + f->pos;
+		if (f->pos + 2 > f->size) {
+			f->pos = -1;
+			return -1;
+		}
+		f->pos += 2;
+		return p[0] | (p[1] << 8);
+	}
+
 	l = (*f->dfs->getc)(f->file);
 	if (l < 0) {
 		f->pos = -1;
@@ -200,6 +228,16 @@ int DUMBEXPORT dumbfile_mgetw(DUMBFILE *f)
 	if (f->pos < 0)
 		return -1;
 
+	if (f->data) {
+		const unsigned char *p = f->data + f->pos;
+		if (f->pos + 2 > f->size) {
+			f->pos = -1;
+			return -1;
+		}
+		f->pos += 2;
+		return p[1] | (p[0] << 8);
+	}
+
 	h = (*f->dfs->getc)(f->file);
 	if (h < 0) {
 		f->pos = -1;
@@ -228,6 +266,16 @@ int32 DUMBEXPORT dumbfile_igetl(DUMBFILE *f)
 	if (f->pos < 0)
 		return -1;
 
+	if (f->data) {
+		const unsigned char *p = f->data + f->pos;
+		if (f->pos + 4 > f->size) {
+			f->pos = -1;
+			return -1;
+		}
+		f->pos += 4;
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32)p[3] << 24);
+	}
+
 	rv = (*f->dfs->getc)(f->file);
 	if ((sint32)rv < 0) {
 		f->pos = -1;
@@ -271,6 +319,16 @@ int32 DUMBEXPORT dumbfile_mgetl(DUMBFILE *f)
 	if (f->pos < 0)
 		return -1;
 
+	if (f->data) {
+		const unsigned char *p = f->data + f->pos;
+		if (f->pos + 4 > f->size) {
+			f->pos = -1;
+			return -1;
+		}
+		f->pos += 4;
+		return ((uint32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	}
+
 	rv = (*f->dfs->getc)(f->file);
 	if ((sint32)rv < 0) {
 		f->pos = -1;
@@ -348,7 +406,14 @@ int32 DUMBEXPORT dumbfile_getnc(char *ptr, int32 n, DUMBFILE *f)
 	if (f->pos < 0)
 		return -1;
 
-	if (f->dfs->getnc) {
+	if (f->data) {
+		rv = MIN(n, f->size - f->pos);
+		memcpy(ptr, f->data + f->pos, rv);
+		if (rv < n) {
+			f->pos = -1;
+			return rv;
+		}
+	} else if (f->dfs->getnc) {
 		rv = (*f->dfs->getnc)(ptr, n, f->file);
 		if (rv < n) {
 			f->pos = -1;
@@ -377,9 +442,11 @@ int DUMBEXPORT dumbfile_seek(DUMBFILE *f, long n, int origin)
     switch ( origin )
     {
     case DFS_SEEK_CUR: n += f->pos; break;
-    case DFS_SEEK_END: n += (*f->dfs->get_size)(f->file); break;
+    case DFS_SEEK_END: n += dumbfile_get_size(f); break;
     }
     f->pos = n;
+    if (f->data)
+        return n < 0 || n > f->size ? -1 : 0;
     return (*f->dfs->seek)(f->file, n);
 }
 
@@ -387,6 +454,8 @@ int DUMBEXPORT dumbfile_seek(DUMBFILE *f, long n, int origin)
 
 int32 DUMBEXPORT dumbfile_get_size(DUMBFILE *f)
 {
+    if (f->data)
+        return f->size;
     return (*f->dfs->get_size)(f->file);
 }
 
@@ -104,6 +104,37 @@ void DUMBEXPORT dumb_record_click(DUMB_CLICK_REMOVER *cr, int32 pos, sample_t st
 
 
 
+/* Moves all clicks recorded in src over to dst, as if they had been recorded
+ * there. src gets the same number of unused clicks back from dst, so neither
+ * of them has to allocate more the next time.
+ */
+void DUMBEXPORT dumb_move_clicks(DUMB_CLICK_REMOVER *dst, DUMB_CLICK_REMOVER *src)
+{
+	DUMB_CLICK *click;
+
+	if (!dst || !src) return;
+
+	dst->offset += src->offset;
+	src->offset = 0;
+
+	while (src->click) {
+		click = src->click;
+		src->click = click->next;
+		click->next = dst->click;
+		dst->click = click;
+		dst->n_clicks++;
+
+		if (dst->free_clicks) {
+			click = dst->free_clicks;
+			dst->free_clicks = click->next;
+			free_click(src, click);
+		}
+	}
+	src->n_clicks = 0;
+}
+
+
+
 static DUMB_CLICK *dumb_click_mergesort(DUMB_CLICK *click, int n_clicks)
 {
 	int i;
@@ -285,6 +316,91 @@ void DUMBEXPORT dumb_remove_clicks_array(int n, DUMB_CLICK_REMOVER **cr, sample_
 
 
 
+/* Like dumb_remove_clicks(), but the samples are also converted to float in
+ * place and multiplied by 'scale'. Without a click remover only the
+ * conversion is done.
+ */
+static void remove_clicks_float(DUMB_CLICK_REMOVER *cr, sample_t *samples, int32 length, int step, double halflife, float scale)
+{
+	DUMB_CLICK *click;
+	float *out = (float *)samples;
+	int32 pos = 0;
+	int offset;
+	int factor;
+
+	length *= step;
+
+	if (!cr) {
+		for (; pos < length; pos += step)
+			out[pos] = samples[pos] * scale;
+		return;
+	}
+
+	factor = (int)floor(pow(0.5, 1.0/halflife) * (1U << 31));
+
+	click = dumb_click_mergesort(cr->click, cr->n_clicks);
+	cr->click = NULL;
+	cr->n_clicks = 0;
+
+	while (click) {
+		DUMB_CLICK *next = click->next;
+		int end = click->pos * step;
+		ASSERT(end <= length);
+		offset = cr->offset;
+		if (offset < 0) {
+			offset = -offset;
+			while (pos < end) {
+				out[pos] = (samples[pos] - offset) * scale;
+				offset = (int)(((LONG_LONG)(offset << 1) * factor) >> 32);
+				pos += step;
+			}
+			offset = -offset;
+		} else {
+			while (pos < end) {
+				out[pos] = (samples[pos] + offset) * scale;
+				offset = (int)(((LONG_LONG)(offset << 1) * factor) >> 32);
+				pos += step;
+			}
+		}
+		cr->offset = offset - click->step;
+		free_click(cr, click);
+		click = next;
+	}
+
+	offset = cr->offset;
+	if (offset < 0) {
+		offset = -offset;
+		while (pos < length) {
+			out[pos] = (samples[pos] - offset) * scale;
+			offset = (int)((LONG_LONG)(offset << 1) * factor >> 32);
+			pos += step;
+		}
+		offset = -offset;
+	} else {
+		while (pos < length) {
+			out[pos] = (samples[pos] + offset) * scale;
+			offset = (int)((LONG_LONG)(offset << 1) * factor >> 32);
+			pos += step;
+		}
+	}
+	cr->offset = offset;
+}
+
+
+
+void DUMBEXPORT dumb_remove_clicks_array_float(int n, DUMB_CLICK_REMOVER **cr, sample_t **samples, int32 length, double halflife, float scale)
+{
+	int i;
+	for (i = 0; i < n >> 1; i++) {
+		remove_clicks_float(cr ? cr[i << 1] : NULL, samples[i], length, 2, halflife, scale);
+		remove_clicks_float(cr ? cr[(i << 1) + 1] : NULL, samples[i] + 1, length, 2, halflife, scale);
+	}
+	if (n & 1)
+		remove_clicks_float(cr ? cr[i << 1] : NULL, samples[i], length, 1, halflife, scale);
+}
+
+
+
 void DUMBEXPORT dumb_click_remover_get_offset_array(int n, DUMB_CLICK_REMOVER **cr, sample_t *offset)
 {
 	if (cr) {
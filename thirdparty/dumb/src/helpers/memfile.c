@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include "dumb.h"
+#include "internal/dumbfile.h"
 
 
 
@@ -105,6 +106,7 @@ static const DUMBFILE_SYSTEM memfile_dfs = {
 
 DUMBFILE *DUMBEXPORT dumbfile_open_memory(const char *data, int32 size)
 {
+	DUMBFILE *f;
 	MEMFILE *m = malloc(sizeof(*m));
 	if (!m) return NULL;
 
@@ -113,5 +115,10 @@ DUMBFILE *DUMBEXPORT dumbfile_open_memory(const char *data, int32 size)
 	m->left = size;
 	m->size = size;
 
-	return dumbfile_open_ex(m, &memfile_dfs);
+	f = dumbfile_open_ex(m, &memfile_dfs);
+	if (f) {
+		f->data = (const unsigned char *)data;
+		f->size = size;
+	}
+	return f;
 }
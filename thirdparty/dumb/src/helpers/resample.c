@@ -43,6 +43,7 @@
  */
 
 #include <math.h>
+#include <string.h>
 #include "dumb.h"
 
 #include "internal/resampler.h"
@@ -194,6 +195,59 @@ static finline int xs_FloorToInt(double val)
 
 static short cubicA0[1025], cubicA1[1025];
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CUBIC_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define CUBIC_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(CUBIC_SSE2) || defined(CUBIC_NEON)
+/* The four coefficients for each position next to each other, so that the
+ * taps of a run of source samples can be summed with one vector multiply.
+ * This gives exactly the same result as CUBIC.
+ */
+static short cubic4[1024][4];
+
+static inline int cubic_run(const short *x, int subpos)
+{
+	const short *c = cubic4[subpos >> 6];
+#ifdef CUBIC_SSE2
+	__m128i p = _mm_madd_epi16(_mm_loadl_epi64((const __m128i *)x), _mm_loadl_epi64((const __m128i *)c));
+	return _mm_cvtsi128_si32(_mm_add_epi32(p, _mm_srli_epi64(p, 32)));
+#else
+	int32x4_t p = vmull_s16(vld1_s16(x), vld1_s16(c));
+	int32x2_t h = vadd_s32(vget_low_s32(p), vget_high_s32(p));
+	return vget_lane_s32(vpadd_s32(h, h), 0);
+#endif
+}
+
+static inline int cubic_run_8(const signed char *x, int subpos)
+{
+	const short *c = cubic4[subpos >> 6];
+#ifdef CUBIC_SSE2
+	int v;
+	__m128i s, p;
+	memcpy(&v, x, 4);
+	s = _mm_cvtsi32_si128(v);
+	s = _mm_srai_epi16(_mm_unpacklo_epi8(s, s), 8);
+	p = _mm_madd_epi16(s, _mm_loadl_epi64((const __m128i *)c));
+	return _mm_cvtsi128_si32(_mm_add_epi32(p, _mm_srli_epi64(p, 32)));
+#else
+	int v;
+	int16x4_t s;
+	int32x4_t p;
+	int32x2_t h;
+	memcpy(&v, x, 4);
+	s = vget_low_s16(vmovl_s8(vreinterpret_s8_s32(vdup_n_s32(v))));
+	p = vmull_s16(s, vld1_s16(c));
+	h = vadd_s32(vget_low_s32(p), vget_high_s32(p));
+	return vget_lane_s32(vpadd_s32(h, h), 0);
+#endif
+}
+#endif
+
 void _dumb_init_cubic(void)
 {
 	unsigned int t; /* 3*1024*1024*1024 is within range if it's unsigned */
@@ -204,6 +258,14 @@ void _dumb_init_cubic(void)
 		cubicA0[t] = -(int)(  t*t*t >> 17) + (int)(  t*t >> 6) - (int)(t << 3);
 		cubicA1[t] =  (int)(3*t*t*t >> 17) - (int)(5*t*t >> 7) + (int)(1 << 14);
 	}
+#if defined(CUBIC_SSE2) || defined(CUBIC_NEON)
+	for (t = 0; t < 1024; t++) {
+		cubic4[t][0] = cubicA0[t];
+		cubic4[t][1] = cubicA1[t];
+		cubic4[t][2] = cubicA1[1 + (t ^ 1023)];
+		cubic4[t][3] = cubicA0[1 + (t ^ 1023)];
+	}
+#endif
 	resampler_init();
 
 	done = 1;
@@ -260,6 +322,9 @@ void _dumb_init_cubic(void)
 	x1 * cubicA1[subpos >> 6] + \
 	x2 * cubicA1[1 + (subpos >> 6 ^ 1023)] + \
 	x3 * cubicA0[1 + (subpos >> 6 ^ 1023)])
+#if defined(CUBIC_SSE2) || defined(CUBIC_NEON)
+#define CUBIC_RUN(x) cubic_run(x, subpos)
+#endif
 #define CUBICVOL(x, vol) MULSCV((x), ((vol) << 10))
 #define FIR(x) (x)
 #include "resample.inc"
@@ -275,6 +340,9 @@ void _dumb_init_cubic(void)
 	x1 * cubicA1[subpos >> 6] + \
 	x2 * cubicA1[1 + (subpos >> 6 ^ 1023)] + \
 	x3 * cubicA0[1 + (subpos >> 6 ^ 1023)]) << 6)
+#if defined(CUBIC_SSE2) || defined(CUBIC_NEON)
+#define CUBIC_RUN(x) (cubic_run_8(x, subpos) << 6)
+#endif
 #define CUBICVOL(x, vol) MULSCV((x), ((vol) << 12))
 #define FIR(x) (x << 8)
 #include "resample.inc"
@@ -22,6 +22,7 @@
 
 #include "dumb.h"
 #include "internal/it.h"
+#include "internal/dumbfile.h"
 
 #ifndef min
 #define min(a, b) (((a) < (b)) ? (a) : (b))
@@ -732,6 +733,47 @@ static int32 it_read_sample_data(IT_SAMPLE *sample, unsigned char convert, DUMBF
 
 
 
+static DUMB_PARALLEL_FOR load_parallel_for = NULL;
+static void *load_parallel_data = NULL;
+
+void DUMBEXPORT dumb_it_set_load_parallel_for(DUMB_PARALLEL_FOR parallel_for, void * data)
+{
+	load_parallel_for = parallel_for;
+	load_parallel_data = data;
+}
+
+
+
+/* Compressed samples found while loading from memory, which are
+ * decompressed after everything else, each reading its own DUMBFILE.
+ */
+typedef struct IT_SAMPLE_JOB
+{
+	IT_SAMPLE *sample;
+	unsigned char convert;
+	const unsigned char *data;
+	int32 size;
+	int32 offset;
+	int32 end;		/* the file position after the sample */
+	int result;
+} IT_SAMPLE_JOB;
+
+static void it_read_sample_job(void *job_data, int index)
+{
+	IT_SAMPLE_JOB *job = (IT_SAMPLE_JOB *)job_data + index;
+	DUMBFILE *f = dumbfile_open_memory((const char *)job->data, job->size);
+
+	job->result = -1;
+	if (!f)
+		return;
+	if (!dumbfile_seek(f, job->offset, DFS_SEEK_SET))
+		job->result = it_read_sample_data(job->sample, job->convert, f);
+	job->end = dumbfile_pos(f);
+	dumbfile_close(f);
+}
+
+
+
 //#define DETECT_DUPLICATE_CHANNELS
 #ifdef DETECT_DUPLICATE_CHANNELS
 #include <stdio.h>
@@ -949,6 +991,9 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f)
 
 	unsigned char *buffer;
 
+	IT_SAMPLE_JOB *jobs = NULL;
+	int n_jobs = 0, last_job = -1;
+
 	if (dumbfile_mgetl(f) != IT_SIGNATURE)
     {
 		return NULL;
@@ -1202,6 +1247,9 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f)
 		return NULL;
 	}
 
+	if (load_parallel_for && f->data && sigdata->n_samples > 1)
+		jobs = malloc(sigdata->n_samples * sizeof(*jobs));
+
 	for (n = 0; n < n_components; n++) {
 		int32 offset;
 		int m;
@@ -1230,6 +1278,7 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f)
         if (dumbfile_seek(f, component[n].offset, DFS_SEEK_SET)) {
 			free(buffer);
 			free(component);
+			free(jobs);
 			_dumb_it_unload_sigdata(sigdata);
 			return NULL;
 		}
@@ -1245,6 +1294,7 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f)
                     if (dumbfile_getnc((char *)sigdata->song_message, message_length, f) < message_length) {
 						free(buffer);
 						free(component);
+						free(jobs);
 						_dumb_it_unload_sigdata(sigdata);
 						return NULL;
 					}
@@ -1261,6 +1311,7 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f)
 				if (m) {
 					free(buffer);
 					free(component);
+					free(jobs);
 					_dumb_it_unload_sigdata(sigdata);
 					return NULL;
 				}
@@ -1270,6 +1321,7 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f)
 				if (it_read_pattern(&sigdata->pattern[component[n].n], f, buffer)) {
 					free(buffer);
 					free(component);
+					free(jobs);
 					_dumb_it_unload_sigdata(sigdata);
 					return NULL;
 				}
@@ -1279,6 +1331,7 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f)
 				if (it_read_sample_header(&sigdata->sample[component[n].n], &sample_convert[component[n].n], &offset, f)) {
 					free(buffer);
 					free(component);
+					free(jobs);
 					_dumb_it_unload_sigdata(sigdata);
 					return NULL;
 				}
@@ -1306,16 +1359,33 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f)
 		m = component[n].sampfirst;
 
 		while (m >= 0) {
+			IT_SAMPLE *sample = &sigdata->sample[component[m].n];
+
+			if (jobs && (sample->flags & 8) && n_jobs < sigdata->n_samples) {
+				IT_SAMPLE_JOB *job = &jobs[n_jobs];
+				job->sample = sample;
+				job->convert = sample_convert[component[m].n];
+				job->data = f->data;
+				job->size = f->size;
+				job->offset = component[m].offset;
+				last_job = n_jobs++;
+				m = component[m].sampnext;
+				continue;
+			}
+			last_job = -1;
+
             if (dumbfile_seek(f, component[m].offset, DFS_SEEK_SET)) {
 				free(buffer);
 				free(component);
+				free(jobs);
 				_dumb_it_unload_sigdata(sigdata);
 				return NULL;
 			}
 
-			if (it_read_sample_data(&sigdata->sample[component[m].n], sample_convert[component[m].n], f)) {
+			if (it_read_sample_data(sample, sample_convert[component[m].n], f)) {
 				free(buffer);
 				free(component);
+				free(jobs);
 				_dumb_it_unload_sigdata(sigdata);
 				return NULL;
 			}
@@ -1324,6 +1394,28 @@ static sigdata_t *it_load_sigdata(DUMBFILE *f)
 		}
     }
 
+	if (n_jobs) {
+		if (n_jobs > 1)
+			(*load_parallel_for)(load_parallel_data, n_jobs, &it_read_sample_job, jobs);
+		else
+			it_read_sample_job(jobs, 0);
+
+		for (n = 0; n < n_jobs; n++) {
+			if (jobs[n].result) {
+				free(buffer);
+				free(component);
+				free(jobs);
+				_dumb_it_unload_sigdata(sigdata);
+				return NULL;
+			}
+		}
+
+		/* The extensions below are looked for after whatever was read last. */
+		if (last_job >= 0)
+			dumbfile_seek(f, jobs[last_job].end, DFS_SEEK_SET);
+	}
+	free(jobs);
+
     for ( n = 0; n < 10; n++ )
     {
         if ( dumbfile_getc( f ) == 'X' )
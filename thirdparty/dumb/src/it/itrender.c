@@ -345,6 +345,13 @@ static DUMB_IT_SIGRENDERER *dup_sigrenderer(DUMB_IT_SIGRENDERER *src, int n_chan
 	dst->sub_time_left = src->sub_time_left;
 
 	dst->ramp_style = src->ramp_style;
+	dst->float_scale = src->float_scale;
+
+	/* The threads belong to whoever set them up on the original. */
+	dst->parallel_for = NULL;
+	dst->parallel_data = NULL;
+	dst->n_mix_threads = 0;
+	dst->mix_workers = NULL;
 
 	dst->click_remover = NULL;
 
@@ -4636,7 +4643,7 @@ static int apply_pan_envelope(IT_PLAYING *playing)
 /* Note: if a click remover is provided, and store_end_sample is set, then
  * the end point will be computed twice. This situation should not arise.
  */
-static int32 render_playing(DUMB_IT_SIGRENDERER *sigrenderer, IT_PLAYING *playing, double volume, double main_delta, double delta, int32 pos, int32 size, sample_t **samples, int store_end_sample, int *left_to_mix)
+static int32 render_playing(DUMB_IT_SIGRENDERER *sigrenderer, IT_PLAYING *playing, double volume, double main_delta, double delta, int32 pos, int32 size, sample_t **samples, int store_end_sample, int *left_to_mix, DUMB_CLICK_REMOVER **cr)
 {
 	int bits;
 
@@ -4677,11 +4684,11 @@ static int32 render_playing(DUMB_IT_SIGRENDERER *sigrenderer, IT_PLAYING *playin
         lvol.declick_stage = rvol.declick_stage = playing->declick_stage;
 		if (sigrenderer->n_channels >= 2) {
 			if (playing->sample->flags & IT_SAMPLE_STEREO) {
-				if (sigrenderer->click_remover) {
+				if (cr) {
 					sample_t click[2];
 					dumb_resample_get_current_sample_n_2_2(bits, &playing->resampler, &lvol, &rvol, click);
-					dumb_record_click(sigrenderer->click_remover[0], pos, click[0]);
-					dumb_record_click(sigrenderer->click_remover[1], pos, click[1]);
+					dumb_record_click(cr[0], pos, click[0]);
+					dumb_record_click(cr[1], pos, click[1]);
 				}
 				size_rendered = dumb_resample_n_2_2(bits, &playing->resampler, samples[0] + pos*2, size, &lvol, &rvol, delta);
 				if (store_end_sample) {
@@ -4690,18 +4697,18 @@ static int32 render_playing(DUMB_IT_SIGRENDERER *sigrenderer, IT_PLAYING *playin
 					samples[0][(pos + size_rendered) * 2] = click[0];
 					samples[0][(pos + size_rendered) * 2 + 1] = click[1];
 				}
-				if (sigrenderer->click_remover) {
+				if (cr) {
 					sample_t click[2];
 					dumb_resample_get_current_sample_n_2_2(bits, &playing->resampler, &lvol, &rvol, click);
-					dumb_record_click(sigrenderer->click_remover[0], pos + size_rendered, -click[0]);
-					dumb_record_click(sigrenderer->click_remover[1], pos + size_rendered, -click[1]);
+					dumb_record_click(cr[0], pos + size_rendered, -click[0]);
+					dumb_record_click(cr[1], pos + size_rendered, -click[1]);
 				}
 			} else {
-				if (sigrenderer->click_remover) {
+				if (cr) {
 					sample_t click[2];
 					dumb_resample_get_current_sample_n_1_2(bits, &playing->resampler, &lvol, &rvol, click);
-					dumb_record_click(sigrenderer->click_remover[0], pos, click[0]);
-					dumb_record_click(sigrenderer->click_remover[1], pos, click[1]);
+					dumb_record_click(cr[0], pos, click[0]);
+					dumb_record_click(cr[1], pos, click[1]);
 				}
 				size_rendered = dumb_resample_n_1_2(bits, &playing->resampler, samples[0] + pos*2, size, &lvol, &rvol, delta);
 				if (store_end_sample) {
@@ -4710,43 +4717,43 @@ static int32 render_playing(DUMB_IT_SIGRENDERER *sigrenderer, IT_PLAYING *playin
 					samples[0][(pos + size_rendered) * 2] = click[0];
 					samples[0][(pos + size_rendered) * 2 + 1] = click[1];
 				}
-				if (sigrenderer->click_remover) {
+				if (cr) {
 					sample_t click[2];
 					dumb_resample_get_current_sample_n_1_2(bits, &playing->resampler, &lvol, &rvol, click);
-					dumb_record_click(sigrenderer->click_remover[0], pos + size_rendered, -click[0]);
-					dumb_record_click(sigrenderer->click_remover[1], pos + size_rendered, -click[1]);
+					dumb_record_click(cr[0], pos + size_rendered, -click[0]);
+					dumb_record_click(cr[1], pos + size_rendered, -click[1]);
 				}
 			}
 		}
 #if 0	// [RH] Don't need mono output
 		else {
 			if (playing->sample->flags & IT_SAMPLE_STEREO) {
-				if (sigrenderer->click_remover) {
+				if (cr) {
 					sample_t click;
 					dumb_resample_get_current_sample_n_2_1(bits, &playing->resampler, &lvol, &rvol, &click);
-					dumb_record_click(sigrenderer->click_remover[0], pos, click);
+					dumb_record_click(cr[0], pos, click);
 				}
 				size_rendered = dumb_resample_n_2_1(bits, &playing->resampler, samples[0] + pos, size, &lvol, &rvol, delta);
 				if (store_end_sample)
 					dumb_resample_get_current_sample_n_2_1(bits, &playing->resampler, &lvol, &rvol, &samples[0][pos + size_rendered]);
-				if (sigrenderer->click_remover) {
+				if (cr) {
 					sample_t click;
 					dumb_resample_get_current_sample_n_2_1(bits, &playing->resampler, &lvol, &rvol, &click);
-					dumb_record_click(sigrenderer->click_remover[0], pos + size_rendered, -click);
+					dumb_record_click(cr[0], pos + size_rendered, -click);
 				}
 			} else {
-				if (sigrenderer->click_remover) {
+				if (cr) {
 					sample_t click;
 					dumb_resample_get_current_sample_n_1_1(bits, &playing->resampler, &lvol, &click);
-					dumb_record_click(sigrenderer->click_remover[0], pos, click);
+					dumb_record_click(cr[0], pos, click);
 				}
 				size_rendered = dumb_resample_n_1_1(bits, &playing->resampler, samples[0] + pos, size, &lvol, delta);
 				if (store_end_sample)
 					dumb_resample_get_current_sample_n_1_1(bits, &playing->resampler, &lvol, &samples[0][pos + size_rendered]);
-				if (sigrenderer->click_remover) {
+				if (cr) {
 					sample_t click;
 					dumb_resample_get_current_sample_n_1_1(bits, &playing->resampler, &lvol, &click);
-					dumb_record_click(sigrenderer->click_remover[0], pos + size_rendered, -click);
+					dumb_record_click(cr[0], pos + size_rendered, -click);
 				}
 			}
 		}
@@ -4769,6 +4776,8 @@ typedef struct IT_TO_MIX
 {
 	IT_PLAYING *playing;
 	float volume;
+	double note_delta;
+	int left_to_mix; /* The value left_to_mix has when this voice is mixed */
 }
 IT_TO_MIX;
 
@@ -4861,6 +4870,184 @@ static void apply_pitch_modifications(DUMB_IT_SIGDATA *sigdata, IT_PLAYING *play
 
 
 
+static void render_voice(DUMB_IT_SIGRENDERER *sigrenderer, IT_PLAYING *playing, double volume, double delta, double note_delta, int32 pos, int32 size, sample_t **samples, DUMB_CLICK_REMOVER **cr, sample_t ***samples_to_filter, int *left_to_mix)
+{
+	if (volume && (playing->true_filter_cutoff != 127 << IT_ENVELOPE_SHIFT || playing->true_filter_resonance != 0)) {
+		if (!*samples_to_filter) {
+			*samples_to_filter = allocate_sample_buffer(sigrenderer->n_channels, size + 1);
+			if (!*samples_to_filter) {
+				render_playing(sigrenderer, playing, 0, delta, note_delta, pos, size, NULL, 0, left_to_mix, cr);
+				return;
+			}
+		}
+		{
+			int32 size_rendered;
+			sample_t *filter_src = (*samples_to_filter)[0];
+			dumb_silence(filter_src, sigrenderer->n_channels * (size + 1));
+			size_rendered = render_playing(sigrenderer, playing, volume, delta, note_delta, 0, size, *samples_to_filter, 1, left_to_mix, NULL);
+			if (sigrenderer->n_channels == 2) {
+				it_filter(cr ? cr[0] : NULL, &playing->filter_state[0], samples[0 /*output*/], pos, filter_src, size_rendered,
+					2, (int)(65536.0f/delta), playing->true_filter_cutoff, playing->true_filter_resonance);
+				it_filter(cr ? cr[1] : NULL, &playing->filter_state[1], samples[0 /*output*/]+1, pos, filter_src+1, size_rendered,
+					2, (int)(65536.0f/delta), playing->true_filter_cutoff, playing->true_filter_resonance);
+			} else {
+				it_filter(cr ? cr[0] : NULL, &playing->filter_state[0], samples[0 /*output*/], pos, filter_src, size_rendered,
+					1, (int)(65536.0f/delta), playing->true_filter_cutoff, playing->true_filter_resonance);
+			}
+			// FIXME: filtering is not prevented by low left_to_mix!
+			// FIXME: change 'warning' to 'FIXME' everywhere
+		}
+	} else {
+		it_reset_filter_state(&playing->filter_state[0]);
+		it_reset_filter_state(&playing->filter_state[1]);
+		render_playing(sigrenderer, playing, volume, delta, note_delta, pos, size, samples /*&samples[output]*/, 0, left_to_mix, cr);
+	}
+}
+
+
+
+/* Parallel mixing. Job 0 mixes straight into the output like the serial
+ * code does, the others mix into their worker's buffer and record clicks in
+ * the worker's click removers, which are added to the output afterwards.
+ * Everything is summed as integers, so the result does not depend on how
+ * the voices are split up.
+ */
+struct IT_MIX_WORKER
+{
+	sample_t *buffer;
+	int32 buffer_size;
+	DUMB_CLICK_REMOVER *click_remover[2];
+};
+
+typedef struct IT_MIX_JOBS
+{
+	DUMB_IT_SIGRENDERER *sigrenderer;
+	IT_TO_MIX *to_mix;
+	int n_to_mix;
+	int n_jobs;
+	double volume;
+	double delta;
+	int32 pos;
+	int32 size;
+	sample_t **samples;
+}
+IT_MIX_JOBS;
+
+/* Fewer voices than this per job are not worth waking up another thread for. */
+#define IT_MIN_VOICES_PER_JOB 4
+
+
+
+static void free_mix_workers(DUMB_IT_SIGRENDERER *sigrenderer)
+{
+	int i;
+
+	if (!sigrenderer->mix_workers) return;
+
+	for (i = 0; i < sigrenderer->n_mix_threads; i++) {
+		IT_MIX_WORKER *worker = &sigrenderer->mix_workers[i];
+		free(worker->buffer);
+		dumb_destroy_click_remover(worker->click_remover[0]);
+		dumb_destroy_click_remover(worker->click_remover[1]);
+	}
+	free(sigrenderer->mix_workers);
+	sigrenderer->mix_workers = NULL;
+}
+
+
+
+/* Makes sure the first n_jobs workers can mix 'length' samples. Returns 0 if
+ * memory ran out, in which case the voices are mixed serially.
+ */
+static int prepare_mix_workers(DUMB_IT_SIGRENDERER *sigrenderer, int n_jobs, int32 length)
+{
+	int i;
+
+	if (!sigrenderer->mix_workers) {
+		sigrenderer->mix_workers = calloc(sigrenderer->n_mix_threads, sizeof(IT_MIX_WORKER));
+		if (!sigrenderer->mix_workers) return 0;
+	}
+
+	for (i = 1; i < n_jobs; i++) {
+		IT_MIX_WORKER *worker = &sigrenderer->mix_workers[i];
+		if (worker->buffer_size < length) {
+			sample_t *buffer = realloc(worker->buffer, length * 2 * sizeof(sample_t));
+			if (!buffer) return 0;
+			worker->buffer = buffer;
+			worker->buffer_size = length;
+		}
+		if (sigrenderer->click_remover && !worker->click_remover[1]) {
+			if (!worker->click_remover[0]) worker->click_remover[0] = dumb_create_click_remover();
+			if (worker->click_remover[0]) worker->click_remover[1] = dumb_create_click_remover();
+			if (!worker->click_remover[1]) return 0;
+		}
+	}
+	return 1;
+}
+
+
+
+static void mix_job(void *data, int job)
+{
+	IT_MIX_JOBS *jobs = data;
+	DUMB_IT_SIGRENDERER *sigrenderer = jobs->sigrenderer;
+	sample_t **samples = jobs->samples;
+	DUMB_CLICK_REMOVER **cr = sigrenderer->click_remover;
+	sample_t *worker_samples[1];
+	sample_t **samples_to_filter = NULL;
+	int i;
+
+	if (job > 0) {
+		IT_MIX_WORKER *worker = &sigrenderer->mix_workers[job];
+		dumb_silence(worker->buffer + jobs->pos * 2, jobs->size * 2);
+		worker_samples[0] = worker->buffer;
+		samples = worker_samples;
+		if (cr) cr = worker->click_remover;
+	}
+
+	for (i = job; i < jobs->n_to_mix; i += jobs->n_jobs) {
+		IT_TO_MIX *voice = &jobs->to_mix[i];
+		render_voice(sigrenderer, voice->playing, jobs->volume, jobs->delta, voice->note_delta, jobs->pos, jobs->size, samples, cr, &samples_to_filter, &voice->left_to_mix);
+	}
+
+	destroy_sample_buffer(samples_to_filter);
+}
+
+
+
+static void render_parallel(DUMB_IT_SIGRENDERER *sigrenderer, IT_TO_MIX *to_mix, int n_to_mix, int n_jobs, double volume, double delta, int32 pos, int32 size, sample_t **samples)
+{
+	IT_MIX_JOBS jobs;
+	int i;
+
+	jobs.sigrenderer = sigrenderer;
+	jobs.to_mix = to_mix;
+	jobs.n_to_mix = n_to_mix;
+	jobs.n_jobs = n_jobs;
+	jobs.volume = volume;
+	jobs.delta = delta;
+	jobs.pos = pos;
+	jobs.size = size;
+	jobs.samples = samples;
+
+	(*sigrenderer->parallel_for)(sigrenderer->parallel_data, n_jobs, &mix_job, &jobs);
+
+	for (i = 1; i < n_jobs; i++) {
+		IT_MIX_WORKER *worker = &sigrenderer->mix_workers[i];
+		sample_t *dst = samples[0] + pos * 2;
+		sample_t *src = worker->buffer + pos * 2;
+		int32 j;
+		for (j = 0; j < size * 2; j++)
+			dst[j] += src[j];
+		if (sigrenderer->click_remover) {
+			dumb_move_clicks(sigrenderer->click_remover[0], worker->click_remover[0]);
+			dumb_move_clicks(sigrenderer->click_remover[1], worker->click_remover[1]);
+		}
+	}
+}
+
+
+
 static void render_normal(DUMB_IT_SIGRENDERER *sigrenderer, double volume, double delta, int32 pos, int32 size, sample_t **samples)
 {
 	int i;
@@ -4868,6 +5055,7 @@ static void render_normal(DUMB_IT_SIGRENDERER *sigrenderer, double volume, doubl
 	int n_to_mix = 0;
 	IT_TO_MIX to_mix[DUMB_IT_TOTAL_CHANNELS];
 	int left_to_mix = dumb_it_max_to_mix;
+	int n_jobs = 0;
 
 	sample_t **samples_to_filter = NULL;
 
@@ -4892,51 +5080,39 @@ static void render_normal(DUMB_IT_SIGRENDERER *sigrenderer, double volume, doubl
 	if (volume != 0)
 		qsort(to_mix, n_to_mix, sizeof(IT_TO_MIX), &it_to_mix_compare);
 
+	/* This may call rand(), so it is always done here in the same order. */
 	for (i = 0; i < n_to_mix; i++) {
 		IT_PLAYING *playing = to_mix[i].playing;
-		double note_delta = delta * playing->delta;
 		int cutoff = playing->filter_cutoff << IT_ENVELOPE_SHIFT;
 		//int output = min( playing->output, max_output );
 
-		apply_pitch_modifications(sigrenderer->sigdata, playing, &note_delta, &cutoff);
+		to_mix[i].note_delta = delta * playing->delta;
+		apply_pitch_modifications(sigrenderer->sigdata, playing, &to_mix[i].note_delta, &cutoff);
 
 		if (cutoff != 127 << IT_ENVELOPE_SHIFT || playing->filter_resonance != 0) {
 			playing->true_filter_cutoff = cutoff;
 			playing->true_filter_resonance = playing->filter_resonance;
 		}
+	}
 
-		if (volume && (playing->true_filter_cutoff != 127 << IT_ENVELOPE_SHIFT || playing->true_filter_resonance != 0)) {
-			if (!samples_to_filter) {
-				samples_to_filter = allocate_sample_buffer(sigrenderer->n_channels, size + 1);
-				if (!samples_to_filter) {
-					render_playing(sigrenderer, playing, 0, delta, note_delta, pos, size, NULL, 0, &left_to_mix);
-					continue;
-				}
-			}
-			{
-				int32 size_rendered;
-				DUMB_CLICK_REMOVER **cr = sigrenderer->click_remover;
-				dumb_silence(samples_to_filter[0], sigrenderer->n_channels * (size + 1));
-				sigrenderer->click_remover = NULL;
-				size_rendered = render_playing(sigrenderer, playing, volume, delta, note_delta, 0, size, samples_to_filter, 1, &left_to_mix);
-				sigrenderer->click_remover = cr;
-				if (sigrenderer->n_channels == 2) {
-					it_filter(cr ? cr[0] : NULL, &playing->filter_state[0], samples[0 /*output*/], pos, samples_to_filter[0], size_rendered,
-						2, (int)(65536.0f/delta), playing->true_filter_cutoff, playing->true_filter_resonance);
-					it_filter(cr ? cr[1] : NULL, &playing->filter_state[1], samples[0 /*output*/]+1, pos, samples_to_filter[0]+1, size_rendered,
-						2, (int)(65536.0f/delta), playing->true_filter_cutoff, playing->true_filter_resonance);
-				} else {
-					it_filter(cr ? cr[0] : NULL, &playing->filter_state[0], samples[0 /*output*/], pos, samples_to_filter[0], size_rendered,
-						1, (int)(65536.0f/delta), playing->true_filter_cutoff, playing->true_filter_resonance);
-				}
-				// FIXME: filtering is not prevented by low left_to_mix!
-				// FIXME: change 'warning' to 'FIXME' everywhere
-			}
-		} else {
-			it_reset_filter_state(&playing->filter_state[0]);
-			it_reset_filter_state(&playing->filter_state[1]);
-			render_playing(sigrenderer, playing, volume, delta, note_delta, pos, size, samples /*&samples[output]*/, 0, &left_to_mix);
+	if (volume != 0 && samples && sigrenderer->n_channels == 2 && sigrenderer->parallel_for) {
+		n_jobs = n_to_mix / IT_MIN_VOICES_PER_JOB;
+		if (n_jobs > sigrenderer->n_mix_threads)
+			n_jobs = sigrenderer->n_mix_threads;
+		if (n_jobs >= 2 && !prepare_mix_workers(sigrenderer, n_jobs, pos + size))
+			n_jobs = 0;
+	}
+
+	if (n_jobs >= 2) {
+		/* Every voice that is mixed at all uses up one of left_to_mix. */
+		for (i = 0; i < n_to_mix; i++) {
+			to_mix[i].left_to_mix = left_to_mix;
+			if (left_to_mix > 0) left_to_mix--;
 		}
+		render_parallel(sigrenderer, to_mix, n_to_mix, n_jobs, volume, delta, pos, size, samples);
+	} else {
+		for (i = 0; i < n_to_mix; i++)
+			render_voice(sigrenderer, to_mix[i].playing, volume, delta, to_mix[i].note_delta, pos, size, samples, sigrenderer->click_remover, &samples_to_filter, &left_to_mix);
 	}
 
 	destroy_sample_buffer(samples_to_filter);
@@ -5023,7 +5199,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, double volume, dou
 			if (!samples_to_filter) {
 				samples_to_filter = allocate_sample_buffer(sigrenderer->n_channels, size + 1);
 				if (!samples_to_filter) {
-					render_playing(sigrenderer, playing, 0, delta, note_delta, pos, size, NULL, 0, &left_to_mix);
+					render_playing(sigrenderer, playing, 0, delta, note_delta, pos, size, NULL, 0, &left_to_mix, sigrenderer->click_remover);
 					continue;
 				}
 			}
@@ -5032,7 +5208,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, double volume, dou
 				DUMB_CLICK_REMOVER **cr = sigrenderer->click_remover;
 				dumb_silence(samples_to_filter[0], sigrenderer->n_channels * (size + 1));
 				sigrenderer->click_remover = NULL;
-				size_rendered = render_playing(sigrenderer, playing, volume, delta, note_delta, 0, size, samples_to_filter, 1, &left_to_mix);
+				size_rendered = render_playing(sigrenderer, playing, volume, delta, note_delta, 0, size, samples_to_filter, 1, &left_to_mix, NULL);
 				sigrenderer->click_remover = cr;
 				it_filter(cr ? cr[0] : NULL, &playing->filter_state[0], samples[0 /*output*/], pos, samples_to_filter[0], size_rendered,
 					2, (int)(65536.0f/delta), playing->true_filter_cutoff, playing->true_filter_resonance);
@@ -5042,7 +5218,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, double volume, dou
 		} else {
 			it_reset_filter_state(&playing->filter_state[0]);
 			it_reset_filter_state(&playing->filter_state[1]);
-			render_playing(sigrenderer, playing, volume, delta, note_delta, pos, size, samples /*&samples[output]*/, 0, &left_to_mix);
+			render_playing(sigrenderer, playing, volume, delta, note_delta, pos, size, samples /*&samples[output]*/, 0, &left_to_mix, sigrenderer->click_remover);
 		}
 	}
 
@@ -5066,7 +5242,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, double volume, dou
 			if (!samples_to_filter) {
 				samples_to_filter = allocate_sample_buffer(sigrenderer->n_channels, size + 1);
 				if (!samples_to_filter) {
-					render_playing(sigrenderer, playing, 0, delta, note_delta, pos, size, NULL, 0, &left_to_mix);
+					render_playing(sigrenderer, playing, 0, delta, note_delta, pos, size, NULL, 0, &left_to_mix, sigrenderer->click_remover);
 					continue;
 				}
 			}
@@ -5075,7 +5251,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, double volume, dou
 				DUMB_CLICK_REMOVER **cr = sigrenderer->click_remover;
 				dumb_silence(samples_to_filter[0], size + 1);
 				sigrenderer->click_remover = NULL;
-				size_rendered = render_playing(sigrenderer, playing, volume, delta, note_delta, 0, size, samples_to_filter, 1, &left_to_mix);
+				size_rendered = render_playing(sigrenderer, playing, volume, delta, note_delta, 0, size, samples_to_filter, 1, &left_to_mix, NULL);
 				sigrenderer->click_remover = cr;
 				it_filter(cr ? cr[0] : NULL, &playing->filter_state[0], samples[1 /*output*/], pos, samples_to_filter[0], size_rendered,
 					1, (int)(65536.0f/delta), playing->true_filter_cutoff, playing->true_filter_resonance);
@@ -5085,7 +5261,7 @@ static void render_surround(DUMB_IT_SIGRENDERER *sigrenderer, double volume, dou
 		} else {
 			it_reset_filter_state(&playing->filter_state[0]);
 			it_reset_filter_state(&playing->filter_state[1]);
-			render_playing(sigrenderer, playing, volume, delta, note_delta, pos, size, &samples[1], 0, &left_to_mix);
+			render_playing(sigrenderer, playing, volume, delta, note_delta, pos, size, &samples[1], 0, &left_to_mix, sigrenderer->click_remover);
 		}
 	}
 
@@ -5159,6 +5335,11 @@ static DUMB_IT_SIGRENDERER *init_sigrenderer(DUMB_IT_SIGDATA *sigdata, int n_cha
 	sigrenderer->n_channels = n_channels;
 	sigrenderer->resampling_quality = dumb_resampling_quality;
     sigrenderer->ramp_style = DUMB_IT_RAMP_FULL;
+	sigrenderer->float_scale = 0;
+	sigrenderer->parallel_for = NULL;
+	sigrenderer->parallel_data = NULL;
+	sigrenderer->n_mix_threads = 0;
+	sigrenderer->mix_workers = NULL;
 	sigrenderer->globalvolume = sigdata->global_volume;
 	sigrenderer->tempo = sigdata->tempo;
 
@@ -5351,6 +5532,25 @@ void DUMBEXPORT dumb_it_set_ramp_style(DUMB_IT_SIGRENDERER * sigrenderer, int ra
 }
 
 
+void DUMBEXPORT dumb_it_set_float_output(DUMB_IT_SIGRENDERER * sigrenderer, float scale) {
+	if (sigrenderer) {
+		sigrenderer->float_scale = scale;
+	}
+}
+
+void DUMBEXPORT dumb_it_set_parallel_for(DUMB_IT_SIGRENDERER * sigrenderer, DUMB_PARALLEL_FOR parallel_for, void * data, int n_threads) {
+	if (sigrenderer) {
+		free_mix_workers(sigrenderer);
+		if (n_threads < 2) parallel_for = NULL;
+		/* The resampler tables must not be set up by several jobs at once. */
+		if (parallel_for) _dumb_init_cubic();
+		sigrenderer->parallel_for = parallel_for;
+		sigrenderer->parallel_data = parallel_for ? data : NULL;
+		sigrenderer->n_mix_threads = parallel_for ? n_threads : 0;
+	}
+}
+
+
 void DUMBEXPORT dumb_it_set_loop_callback(DUMB_IT_SIGRENDERER *sigrenderer, int (DUMBCALLBACK *callback)(void *data), void *data)
 {
 	if (sigrenderer) {
@@ -5515,6 +5715,8 @@ static int32 it_sigrenderer_get_samples(
 		if (process_tick(sigrenderer)) {
 			sigrenderer->order = -1;
 			sigrenderer->row = -1;
+			if (samples && sigrenderer->float_scale != 0)
+				dumb_remove_clicks_array_float(sigrenderer->n_channels, NULL, samples, pos, 0, sigrenderer->float_scale);
 			return pos;
 		}
 	}
@@ -5527,8 +5729,13 @@ static int32 it_sigrenderer_get_samples(
 	sigrenderer->sub_time_left = (int32)t & 65535;
 	sigrenderer->time_left += (int32)(t >> 16);
 
-	if (samples)
-		dumb_remove_clicks_array(sigrenderer->n_channels, sigrenderer->click_remover, samples, pos, 512.0f / delta);
+	if (samples) {
+		/* The float conversion is done in the click removal pass, which touches every sample anyway. */
+		if (sigrenderer->float_scale != 0)
+			dumb_remove_clicks_array_float(sigrenderer->n_channels, sigrenderer->click_remover, samples, pos, 512.0f / delta, sigrenderer->float_scale);
+		else
+			dumb_remove_clicks_array(sigrenderer->n_channels, sigrenderer->click_remover, samples, pos, 512.0f / delta);
+	}
 
 	return pos;
 }
@@ -5573,6 +5780,8 @@ void _dumb_it_end_sigrenderer(sigrenderer_t *vsigrenderer)
 
 		dumb_destroy_click_remover_array(sigrenderer->n_channels, sigrenderer->click_remover);
 
+		free_mix_workers(sigrenderer);
+
 		if (sigrenderer->callbacks)
 			free(sigrenderer->callbacks);
 
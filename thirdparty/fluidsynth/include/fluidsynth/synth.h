@@ -124,6 +124,8 @@ FLUIDSYNTH_API fluid_voice_t *fluid_synth_alloc_voice(fluid_synth_t *synth,
 FLUIDSYNTH_API void fluid_synth_start_voice(fluid_synth_t *synth, fluid_voice_t *voice);
 FLUIDSYNTH_API void fluid_synth_get_voicelist(fluid_synth_t *synth,
         fluid_voice_t *buf[], int bufsize, int ID);
+FLUIDSYNTH_API void fluid_synth_get_channel_activity(fluid_synth_t *synth,
+        int count, int *voices, float *levels);
 /* @} Voice Control */
 
 
@@ -357,6 +359,10 @@ FLUID_DEPRECATED FLUIDSYNTH_API int fluid_synth_nwrite_float(fluid_synth_t *synt
 FLUIDSYNTH_API int fluid_synth_process(fluid_synth_t *synth, int len,
                                        int nfx, float *fx[],
                                        int nout, float *out[]);
+FLUIDSYNTH_API void fluid_synth_set_fx_external(fluid_synth_t *synth, int on);
+FLUIDSYNTH_API int fluid_synth_process_fx(fluid_synth_t *synth, int len,
+        const float *reverb_in, const float *chorus_in,
+        float *lout, float *rout);
 /* @} Audio Rendering */
 
 
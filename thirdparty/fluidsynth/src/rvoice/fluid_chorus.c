@@ -89,6 +89,7 @@
 
 #include "fluid_chorus.h"
 #include "fluid_sys.h"
+#include "fluid_fx_simd.h"
 
 
 /*-------------------------------------------------------------------------------------
@@ -231,6 +232,10 @@ struct _fluid_chorus_t
 
     /* modulator member */
     modulator mod[MAX_CHORUS]; /* sinus/triangle modulator */
+
+    /* tail silence detection */
+    int quiet_samples; /* silent input samples seen so far */
+    int bypass;        /* the line holds only silence, processing is skipped */
 };
 
 /*-----------------------------------------------------------------------------
@@ -361,18 +366,22 @@ static FLUID_INLINE fluid_real_t get_mod_triang(triang_modulator *mod)
     return  mod->val;
 }
 /*-----------------------------------------------------------------------------
- Reads the sample value out of the modulated delay line.
+ Reads the two samples the all-pass interpolator needs out of the modulated
+ delay line. The interpolation itself is done for all the voices at once in
+ fluid_chorus_process().
 
  @param chorus pointer on chorus unit.
  @param mod pointer on modulator structure.
- @return current value.
+ @param tap0 receives the sample at the modulated position.
+ @param tap1 receives the sample following it.
 -----------------------------------------------------------------------------*/
-static FLUID_INLINE fluid_real_t get_mod_delay(fluid_chorus_t *chorus,
-                                               modulator *mod)
+static FLUID_INLINE void get_mod_delay_taps(fluid_chorus_t *chorus,
+                                            modulator *mod,
+                                            fluid_real_t *tap0,
+                                            fluid_real_t *tap1)
 {
     fluid_real_t out_index;  /* new modulated index position */
     int int_out_index; /* integer part of out_index */
-    fluid_real_t out; /* value to return */
 
     /* Checks if the modulator must be updated (every mod_rate samples). */
     /* Important: center_pos_mod must be used immediately for the
@@ -419,10 +428,8 @@ static FLUID_INLINE fluid_real_t get_mod_delay(fluid_chorus_t *chorus,
         mod->frac_pos_mod = out_index - int_out_index;
     }
 
-    /*  First order all-pass interpolation ----------------------------------*/
-    /* https://ccrma.stanford.edu/~jos/pasp/First_Order_Allpass_Interpolation.html */
-    /*  begins interpolation: read current sample */
-    out = chorus->line[mod->line_out];
+    /* read current sample */
+    *tap0 = chorus->line[mod->line_out];
 
     /* updates line_out to the next sample.
        Boundary check and circular motion as needed */
@@ -431,12 +438,8 @@ static FLUID_INLINE fluid_real_t get_mod_delay(fluid_chorus_t *chorus,
         mod->line_out -= chorus->size;
     }
 
-    /* Fractional interpolation between next sample (at next position) and
-       previous output added to current sample.
-    */
-    out += mod->frac_pos_mod * (chorus->line[mod->line_out] - mod->buffer);
-    mod->buffer = out; /* memorizes current output */
-    return out;
+    /* and the next one, for the fractional interpolation */
+    *tap1 = chorus->line[mod->line_out];
 }
 
 /*-----------------------------------------------------------------------------
@@ -495,7 +498,7 @@ static void set_center_position(fluid_chorus_t *chorus)
 
     /* index rate to control when to update center_pos_mod */
     /* Important: must be set to get center_pos_mod immediately used for the
-       reading of first sample (see get_mod_delay()) */
+       reading of first sample (see get_mod_delay_taps()) */
     chorus->index_rate = chorus->mod_rate;
 }
 
@@ -695,6 +698,10 @@ fluid_chorus_reset(fluid_chorus_t *chorus)
         chorus->mod[u].buffer = 0;       /* previous delay sample value */
         chorus->mod[u].frac_pos_mod = 0; /* fractional position (between consecutives sample) */
     }
+
+    /* nothing left to play until new input arrives */
+    chorus->quiet_samples = 0;
+    chorus->bypass = TRUE;
 }
 
 /**
@@ -919,43 +926,105 @@ fluid_chorus_samplerate_change(fluid_chorus_t *chorus, fluid_real_t sample_rate)
     update_parameters_from_sample_rate(chorus);
 }
 
-/**
- * Process chorus by mixing the result in output buffer.
- * @param chorus pointer on chorus unit returned by new_fluid_chorus().
- * @param in, pointer on monophonic input buffer of FLUID_BUFSIZE samples.
- * @param left_out, right_out, pointers on stereo output buffers of
- *  FLUID_BUFSIZE samples.
- */
-void fluid_chorus_processmix(fluid_chorus_t *chorus, const fluid_real_t *in,
-                             fluid_real_t *left_out, fluid_real_t *right_out)
+/*-----------------------------------------------------------------------------
+ Process chorus.
+
+ The voices are processed in pairs, as the two lanes of fluid_fx_vec_t:
+ even voices end up in the first lane and odd voices in the second, which is
+ exactly the left/right split of the stereo unit. The last voice of an odd
+ number is processed alone.
+
+ The chorus has no feedback, so once the input has stayed below
+ FLUID_FX_SILENCE_LEVEL for the length of the line, the output is silent
+ too and the chorus is bypassed until some input comes in again.
+
+ @param chorus pointer on chorus unit.
+ @param in, pointer on monophonic input buffer of FLUID_BUFSIZE samples.
+ @param left_out, right_out, pointers on stereo output buffers of
+  FLUID_BUFSIZE samples.
+ @param mix TRUE to mix the result with the samples already in out,
+  FALSE to replace them.
+-----------------------------------------------------------------------------*/
+static FLUID_INLINE void
+fluid_chorus_process(fluid_chorus_t *chorus, const fluid_real_t *in,
+                     fluid_real_t *left_out, fluid_real_t *right_out, int mix)
 {
     int sample_index;
     int i;
+    int nr = chorus->number_blocks;
+    int pairs_nr = nr & ~(FLUID_FX_LANES - 1); /* voices processed in pairs */
     fluid_real_t d_out[2];               /* output stereo Left and Right  */
+    fluid_real_t left, right;
+    int in_silent;
 
-    /* foreach sample, process output sample then input sample */
-    for(sample_index = 0; sample_index < FLUID_BUFSIZE; sample_index++)
+    /* interpolator previous output, one lane per voice */
+    fluid_real_t interp[MAX_CHORUS];
+
+    in_silent = fluid_fx_is_silent(in, FLUID_BUFSIZE);
+
+    if(chorus->bypass)
     {
-        fluid_real_t out; /* block output */
+        if(in_silent)
+        {
+            if(!mix)
+            {
+                FLUID_MEMSET(left_out, 0, FLUID_BUFSIZE * sizeof(fluid_real_t));
+                FLUID_MEMSET(right_out, 0, FLUID_BUFSIZE * sizeof(fluid_real_t));
+            }
 
-        d_out[0] = d_out[1] = 0.0f; /* clear stereo unit input */
+            return;
+        }
 
-#if 0
-        /* Debug: Listen to the chorus signal only */
-        left_out[sample_index] = 0;
-        right_out[sample_index] = 0;
-#endif
+        chorus->bypass = FALSE;
+        chorus->quiet_samples = 0;
+    }
+
+    for(i = 0; i < nr; i++)
+    {
+        interp[i] = chorus->mod[i].buffer;
+    }
+
+    /* foreach sample, process output sample then input sample */
+    for(sample_index = 0; sample_index < FLUID_BUFSIZE; sample_index++)
+    {
+        fluid_fx_vec_t v_out = fluid_fx_vec_zero();
 
         ++chorus->index_rate; /* modulator rate */
 
-        /* foreach chorus block, process output sample */
-        for(i = 0; i < chorus->number_blocks; i++)
+        /* foreach pair of chorus blocks, process output sample */
+        for(i = 0; i < pairs_nr; i += FLUID_FX_LANES)
         {
-            /* get sample from the output of modulated delay line */
-            out = get_mod_delay(chorus, &chorus->mod[i]);
+            fluid_real_t tap0_a, tap1_a, tap0_b, tap1_b;
+            fluid_fx_vec_t v;
+
+            /* get samples from the output of modulated delay line */
+            get_mod_delay_taps(chorus, &chorus->mod[i], &tap0_a, &tap1_a);
+            get_mod_delay_taps(chorus, &chorus->mod[i + 1], &tap0_b, &tap1_b);
+
+            /* First order all-pass interpolation:
+               https://ccrma.stanford.edu/~jos/pasp/First_Order_Allpass_Interpolation.html
+               out = tap0 + frac * (tap1 - previous out) */
+            v = fluid_fx_vec_add(fluid_fx_vec_set(tap0_a, tap0_b),
+                                 fluid_fx_vec_mul(fluid_fx_vec_set(chorus->mod[i].frac_pos_mod,
+                                                                   chorus->mod[i + 1].frac_pos_mod),
+                                                  fluid_fx_vec_sub(fluid_fx_vec_set(tap1_a, tap1_b),
+                                                                   fluid_fx_vec_load(&interp[i]))));
+            fluid_fx_vec_store(&interp[i], v);
 
             /* accumulate out into stereo unit input */
-            d_out[i & 1] += out;
+            v_out = fluid_fx_vec_add(v_out, v);
+        }
+
+        fluid_fx_vec_store(d_out, v_out);
+
+        /* the last block of an odd number goes to the left input */
+        if(i < nr)
+        {
+            fluid_real_t tap0, tap1;
+
+            get_mod_delay_taps(chorus, &chorus->mod[i], &tap0, &tap1);
+            interp[i] = tap0 + chorus->mod[i].frac_pos_mod * (tap1 - interp[i]);
+            d_out[0] += interp[i];
         }
 
         /* update modulator index rate and output center position */
@@ -975,9 +1044,9 @@ void fluid_chorus_processmix(fluid_chorus_t *chorus, const fluid_real_t *in,
            In those case, d_out[1] level is lower than d_out[0], so we need to
            add out value to d_out[1] to have d_out[0] and d_out[1] balanced.
         */
-        if((i & 1) && i > 2)  // i = 3,5,7...
+        if((nr & 1) && nr > 2)  // nr = 3,5,7...
         {
-            d_out[1] +=  out ;
+            d_out[1] += interp[nr - 1];
         }
 
         /* Write the current input sample into the circular buffer.
@@ -988,12 +1057,55 @@ void fluid_chorus_processmix(fluid_chorus_t *chorus, const fluid_real_t *in,
         push_in_delay_line(chorus, in[sample_index]);
 
         /* process stereo unit */
-        /* Add the chorus stereo unit d_out to left and right output */
-        left_out[sample_index]  += d_out[0] * chorus->wet1  + d_out[1] * chorus->wet2;
-        right_out[sample_index] += d_out[1] * chorus->wet1  + d_out[0] * chorus->wet2;
+        left  = d_out[0] * chorus->wet1  + d_out[1] * chorus->wet2;
+        right = d_out[1] * chorus->wet1  + d_out[0] * chorus->wet2;
+
+        if(mix)
+        {
+            left_out[sample_index]  += left;
+            right_out[sample_index] += right;
+        }
+        else
+        {
+            left_out[sample_index]  = left;
+            right_out[sample_index] = right;
+        }
+    }
+
+    for(i = 0; i < nr; i++)
+    {
+        chorus->mod[i].buffer = interp[i];
+    }
+
+    /* tail silence detection, the line is as long as the tail */
+    if(in_silent)
+    {
+        chorus->quiet_samples += FLUID_BUFSIZE;
+
+        if(chorus->quiet_samples >= chorus->size)
+        {
+            chorus->bypass = TRUE;
+        }
+    }
+    else
+    {
+        chorus->quiet_samples = 0;
     }
 }
 
+/**
+ * Process chorus by mixing the result in output buffer.
+ * @param chorus pointer on chorus unit returned by new_fluid_chorus().
+ * @param in, pointer on monophonic input buffer of FLUID_BUFSIZE samples.
+ * @param left_out, right_out, pointers on stereo output buffers of
+ *  FLUID_BUFSIZE samples.
+ */
+void fluid_chorus_processmix(fluid_chorus_t *chorus, const fluid_real_t *in,
+                             fluid_real_t *left_out, fluid_real_t *right_out)
+{
+    fluid_chorus_process(chorus, in, left_out, right_out, TRUE);
+}
+
 /**
  * Process chorus by putting the result in output buffer (no mixing).
  * @param chorus pointer on chorus unit returned by new_fluid_chorus().
@@ -1001,71 +1113,8 @@ void fluid_chorus_processmix(fluid_chorus_t *chorus, const fluid_real_t *in,
  * @param left_out, right_out, pointers on stereo output buffers of
  *  FLUID_BUFSIZE samples.
  */
-/* Duplication of code ... (replaces sample data instead of mixing) */
 void fluid_chorus_processreplace(fluid_chorus_t *chorus, const fluid_real_t *in,
                                  fluid_real_t *left_out, fluid_real_t *right_out)
 {
-    int sample_index;
-    int i;
-    fluid_real_t d_out[2];               /* output stereo Left and Right  */
-
-    /* foreach sample, process output sample then input sample */
-    for(sample_index = 0; sample_index < FLUID_BUFSIZE; sample_index++)
-    {
-        fluid_real_t out; /* block output */
-
-        d_out[0] = d_out[1] = 0.0f; /* clear stereo unit input */
-
-#if 0
-        /* Debug: Listen to the chorus signal only */
-        left_out[sample_index] = 0;
-        right_out[sample_index] = 0;
-#endif
-
-        ++chorus->index_rate; /* modulator rate */
-
-        /* foreach chorus block, process output sample */
-        for(i = 0; i < chorus->number_blocks; i++)
-        {
-            /* get sample from the output of modulated delay line */
-            out = get_mod_delay(chorus, &chorus->mod[i]);
-
-            /* accumulate out into stereo unit input */
-            d_out[i & 1] += out;
-        }
-
-        /* update modulator index rate and output center position */
-        if(chorus->index_rate >= chorus->mod_rate)
-        {
-            chorus->index_rate = 0; /* clear modulator index rate */
-
-            /* updates center position (center_pos_mod) to the next position
-               specified by modulation rate */
-            if((chorus->center_pos_mod += chorus->mod_rate) >= chorus->size)
-            {
-                chorus->center_pos_mod -= chorus->size;
-            }
-        }
-
-        /* Adjust stereo input level in case of number_blocks odd:
-           In those case, d_out[1] level is lower than d_out[0], so we need to
-           add out value to d_out[1] to have d_out[0] and d_out[1] balanced.
-        */
-        if((i & 1) && i > 2)  // i = 3,5,7...
-        {
-            d_out[1] +=  out ;
-        }
-
-        /* Write the current input sample into the circular buffer.
-         * Note that 'in' may be aliased with 'left_out'. Hence this must be done
-         * before "processing stereo unit" (below). This ensures input buffer
-         * not being overwritten by stereo unit output.
-         */
-        push_in_delay_line(chorus, in[sample_index]);
-
-        /* process stereo unit */
-        /* store the chorus stereo unit d_out to left and right output */
-        left_out[sample_index]  = d_out[0] * chorus->wet1  + d_out[1] * chorus->wet2;
-        right_out[sample_index] = d_out[1] * chorus->wet1  + d_out[0] * chorus->wet2;
-    }
+    fluid_chorus_process(chorus, in, left_out, right_out, FALSE);
 }
@@ -0,0 +1,161 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+
+#ifndef _FLUID_FX_SIMD_H
+#define _FLUID_FX_SIMD_H
+
+#include "fluid_sys.h"
+
+/*
+ * Two lane vectors of fluid_real_t for the reverb and chorus units.
+ *
+ * The reverb runs its eight delay lines and the chorus its voices as lanes
+ * of these vectors. SSE2 and NEON are used for double precision builds, any
+ * other build gets a plain C version with the same interface.
+ */
+
+#if !defined(WITH_FLOAT) && (defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FLUID_FX_SSE2 1
+#include <emmintrin.h>
+#elif !defined(WITH_FLOAT) && (defined(__aarch64__) || defined(_M_ARM64))
+#define FLUID_FX_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Number of lanes in a fluid_fx_vec_t. fluid_fx_vec_set() puts a in the
+   first lane and b in the second. */
+#define FLUID_FX_LANES 2
+
+/*
+ * The level below which a reverb or chorus unit is considered silent, about
+ * -100 dB. This is well under the smallest step of 16 bit output.
+ */
+#define FLUID_FX_SILENCE_LEVEL ((fluid_real_t)1e-5)
+
+#if defined(FLUID_FX_SSE2)
+
+typedef __m128d fluid_fx_vec_t;
+
+#define fluid_fx_vec_load(p)      _mm_loadu_pd(p)
+#define fluid_fx_vec_store(p, v)  _mm_storeu_pd((p), (v))
+#define fluid_fx_vec_zero()       _mm_setzero_pd()
+#define fluid_fx_vec_set(a, b)    _mm_set_pd((b), (a))
+#define fluid_fx_vec_add(a, b)    _mm_add_pd((a), (b))
+#define fluid_fx_vec_sub(a, b)    _mm_sub_pd((a), (b))
+#define fluid_fx_vec_mul(a, b)    _mm_mul_pd((a), (b))
+
+#elif defined(FLUID_FX_NEON)
+
+typedef float64x2_t fluid_fx_vec_t;
+
+#define fluid_fx_vec_load(p)      vld1q_f64(p)
+#define fluid_fx_vec_store(p, v)  vst1q_f64((p), (v))
+#define fluid_fx_vec_zero()       vdupq_n_f64(0.0)
+#define fluid_fx_vec_set(a, b)    vcombine_f64(vdup_n_f64(a), vdup_n_f64(b))
+#define fluid_fx_vec_add(a, b)    vaddq_f64((a), (b))
+#define fluid_fx_vec_sub(a, b)    vsubq_f64((a), (b))
+#define fluid_fx_vec_mul(a, b)    vmulq_f64((a), (b))
+
+#else
+
+typedef struct
+{
+    fluid_real_t v[FLUID_FX_LANES];
+} fluid_fx_vec_t;
+
+static FLUID_INLINE fluid_fx_vec_t
+fluid_fx_vec_load(const fluid_real_t *p)
+{
+    fluid_fx_vec_t r;
+    r.v[0] = p[0];
+    r.v[1] = p[1];
+    return r;
+}
+
+static FLUID_INLINE void
+fluid_fx_vec_store(fluid_real_t *p, fluid_fx_vec_t a)
+{
+    p[0] = a.v[0];
+    p[1] = a.v[1];
+}
+
+static FLUID_INLINE fluid_fx_vec_t
+fluid_fx_vec_zero(void)
+{
+    fluid_fx_vec_t r;
+    r.v[0] = r.v[1] = 0;
+    return r;
+}
+
+static FLUID_INLINE fluid_fx_vec_t
+fluid_fx_vec_set(fluid_real_t a, fluid_real_t b)
+{
+    fluid_fx_vec_t r;
+    r.v[0] = a;
+    r.v[1] = b;
+    return r;
+}
+
+static FLUID_INLINE fluid_fx_vec_t
+fluid_fx_vec_add(fluid_fx_vec_t a, fluid_fx_vec_t b)
+{
+    a.v[0] += b.v[0];
+    a.v[1] += b.v[1];
+    return a;
+}
+
+static FLUID_INLINE fluid_fx_vec_t
+fluid_fx_vec_sub(fluid_fx_vec_t a, fluid_fx_vec_t b)
+{
+    a.v[0] -= b.v[0];
+    a.v[1] -= b.v[1];
+    return a;
+}
+
+static FLUID_INLINE fluid_fx_vec_t
+fluid_fx_vec_mul(fluid_fx_vec_t a, fluid_fx_vec_t b)
+{
+    a.v[0] *= b.v[0];
+    a.v[1] *= b.v[1];
+    return a;
+}
+
+#endif
+
+/* Returns TRUE if all of buf[0..count-1] are below FLUID_FX_SILENCE_LEVEL.
+   Gives up at the first sample that is not, which is usually the first. */
+static FLUID_INLINE int
+fluid_fx_is_silent(const fluid_real_t *buf, int count)
+{
+    int i;
+
+    for(i = 0; i < count; i++)
+    {
+        if(buf[i] >= FLUID_FX_SILENCE_LEVEL || buf[i] <= -FLUID_FX_SILENCE_LEVEL)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+#endif /* _FLUID_FX_SIMD_H */
@@ -78,10 +78,13 @@ fluid_iir_filter_apply(fluid_iir_filter_t *iir_filter,
             dsp_hist1 = 0.0f;    /* FIXME JMG - Is this even needed? */
         }
 
-        /* Two versions of the filter loop. One, while the filter is
-        * changing towards its new setting. The other, if the filter
-        * doesn't change.
-        */
+        /* The filter is implemented in Direct-II form. While the filter is
+         * changing towards its new setting, the increment is added to each
+         * filter coefficient after each of the first filter_coeff_incr_count
+         * samples. The samples after that use constant coefficients, without
+         * checking for the ramp every time.
+         */
+        dsp_i = 0;
 
         if(dsp_filter_coeff_incr_count > 0)
         {
@@ -89,47 +92,60 @@ fluid_iir_filter_apply(fluid_iir_filter_t *iir_filter,
             fluid_real_t dsp_a2_incr = iir_filter->a2_incr;
             fluid_real_t dsp_b02_incr = iir_filter->b02_incr;
             fluid_real_t dsp_b1_incr = iir_filter->b1_incr;
+            int ramp = (dsp_filter_coeff_incr_count < count) ? dsp_filter_coeff_incr_count : count;
 
+            dsp_filter_coeff_incr_count -= ramp;
 
-            /* Increment is added to each filter coefficient filter_coeff_incr_count times. */
-            for(dsp_i = 0; dsp_i < count; dsp_i++)
+            if(iir_filter->compensate_incr)
             {
-                /* The filter is implemented in Direct-II form. */
-                dsp_centernode = dsp_buf[dsp_i] - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
-                dsp_buf[dsp_i] = dsp_b02 * (dsp_centernode + dsp_hist2) + dsp_b1 * dsp_hist1;
-                dsp_hist2 = dsp_hist1;
-                dsp_hist1 = dsp_centernode;
-
-                if(dsp_filter_coeff_incr_count-- > 0)
+                for(; dsp_i < ramp; dsp_i++)
                 {
                     fluid_real_t old_b02 = dsp_b02;
+
+                    dsp_centernode = dsp_buf[dsp_i] - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
+                    dsp_buf[dsp_i] = dsp_b02 * (dsp_centernode + dsp_hist2) + dsp_b1 * dsp_hist1;
+                    dsp_hist2 = dsp_hist1;
+                    dsp_hist1 = dsp_centernode;
+
                     dsp_a1 += dsp_a1_incr;
                     dsp_a2 += dsp_a2_incr;
                     dsp_b02 += dsp_b02_incr;
                     dsp_b1 += dsp_b1_incr;
 
                     /* Compensate history to avoid the filter going havoc with large frequency changes */
-                    if(iir_filter->compensate_incr && FLUID_FABS(dsp_b02) > 0.001f)
+                    if(FLUID_FABS(dsp_b02) > 0.001f)
                     {
                         fluid_real_t compensate = old_b02 / dsp_b02;
                         dsp_hist1 *= compensate;
                         dsp_hist2 *= compensate;
                     }
                 }
-            } /* for dsp_i */
-        }
-        else /* The filter parameters are constant.  This is duplicated to save time. */
-        {
-            for(dsp_i = 0; dsp_i < count; dsp_i++)
+            }
+            else
             {
-                /* The filter is implemented in Direct-II form. */
-                dsp_centernode = dsp_buf[dsp_i] - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
-                dsp_buf[dsp_i] = dsp_b02 * (dsp_centernode + dsp_hist2) + dsp_b1 * dsp_hist1;
-                dsp_hist2 = dsp_hist1;
-                dsp_hist1 = dsp_centernode;
+                for(; dsp_i < ramp; dsp_i++)
+                {
+                    dsp_centernode = dsp_buf[dsp_i] - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
+                    dsp_buf[dsp_i] = dsp_b02 * (dsp_centernode + dsp_hist2) + dsp_b1 * dsp_hist1;
+                    dsp_hist2 = dsp_hist1;
+                    dsp_hist1 = dsp_centernode;
+
+                    dsp_a1 += dsp_a1_incr;
+                    dsp_a2 += dsp_a2_incr;
+                    dsp_b02 += dsp_b02_incr;
+                    dsp_b1 += dsp_b1_incr;
+                }
             }
         }
 
+        for(; dsp_i < count; dsp_i++)
+        {
+            dsp_centernode = dsp_buf[dsp_i] - dsp_a1 * dsp_hist1 - dsp_a2 * dsp_hist2;
+            dsp_buf[dsp_i] = dsp_b02 * (dsp_centernode + dsp_hist2) + dsp_b1 * dsp_hist1;
+            dsp_hist2 = dsp_hist1;
+            dsp_hist1 = dsp_centernode;
+        }
+
         iir_filter->hist1 = dsp_hist1;
         iir_filter->hist2 = dsp_hist2;
         iir_filter->a1 = dsp_a1;
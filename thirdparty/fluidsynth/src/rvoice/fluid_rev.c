@@ -168,6 +168,7 @@
  */
 #include "fluid_rev.h"
 #include "fluid_sys.h"
+#include "fluid_fx_simd.h"
 
 /*----------------------------------------------------------------------------
                         Configuration macros at compiler time.
@@ -511,80 +512,111 @@ static int get_mod_delay_line_length(mod_delay_line *mdl)
 }
 
 /*-----------------------------------------------------------------------------
- Reads the sample value out of the modulated delay line.
+ Moves the output position of the modulated delay line to the next position
+ of the modulator. Called every mod_rate samples.
  @param mdl, pointer on modulated delay line.
- @return the sample value.
 -----------------------------------------------------------------------------*/
-static FLUID_INLINE fluid_real_t get_mod_delay(mod_delay_line *mdl)
+static void update_mod_delay_position(mod_delay_line *mdl)
 {
     fluid_real_t out_index;  /* new modulated index position */
     int int_out_index; /* integer part of out_index */
-    fluid_real_t out; /* value to return */
 
-    /* Checks if the modulator must be updated (every mod_rate samples). */
-    /* Important: center_pos_mod must be used immediately for the
-       first sample. So, mdl->index_rate must be initialized
-       to mdl->mod_rate (set_mod_delay_line())  */
+    /* out_index = center position (center_pos_mod) + sinus waweform */
+    out_index = mdl->center_pos_mod +
+                get_mod_sinus(&mdl->mod) * mdl->mod_depth;
 
-    if(++mdl->index_rate >= mdl->mod_rate)
+    /* extracts integer part in int_out_index */
+    if(out_index >= 0.0f)
     {
-        mdl->index_rate = 0;
+        int_out_index = (int)out_index; /* current integer part */
 
-        /* out_index = center position (center_pos_mod) + sinus waweform */
-        out_index = mdl->center_pos_mod +
-                    get_mod_sinus(&mdl->mod) * mdl->mod_depth;
-
-        /* extracts integer part in int_out_index */
-        if(out_index >= 0.0f)
+        /* forces read index (line_out)  with integer modulation value  */
+        /* Boundary check and circular motion as needed */
+        if((mdl->dl.line_out = int_out_index) >= mdl->dl.size)
         {
-            int_out_index = (int)out_index; /* current integer part */
-
-            /* forces read index (line_out)  with integer modulation value  */
-            /* Boundary check and circular motion as needed */
-            if((mdl->dl.line_out = int_out_index) >= mdl->dl.size)
-            {
-                mdl->dl.line_out -= mdl->dl.size;
-            }
+            mdl->dl.line_out -= mdl->dl.size;
         }
-        else /* negative */
+    }
+    else /* negative */
+    {
+        int_out_index = (int)(out_index - 1); /* previous integer part */
+        /* forces read index (line_out) with integer modulation value  */
+        /* circular motion as needed */
+        mdl->dl.line_out   = int_out_index + mdl->dl.size;
+    }
+
+    /* extracts fractionnal part. (it will be used when interpolating
+      between line_out and line_out +1) and memorize it.
+      Memorizing is necessary for modulation rate above 1 */
+    mdl->frac_pos_mod = out_index - int_out_index;
+
+    /* updates center position (center_pos_mod) to the next position
+       specified by modulation rate */
+    if((mdl->center_pos_mod += mdl->mod_rate) >= mdl->dl.size)
+    {
+        mdl->center_pos_mod -= mdl->dl.size;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ Reads a block of FLUID_BUFSIZE samples out of the modulated delay line: for
+ each sample, the two samples the all-pass interpolator needs and its
+ fractional position. The interpolation itself is done for all the lines at
+ once in fluid_revmodel_process().
+
+ The line must be longer than FLUID_BUFSIZE, so that none of the samples read
+ can be written during the block.
+
+ @param mdl, pointer on modulated delay line.
+ @param tap0, receives the samples at the modulated position.
+ @param tap1, receives the samples following them.
+ @param frac, receives the fractional positions.
+ @param stride, distance between two samples in tap0, tap1 and frac.
+-----------------------------------------------------------------------------*/
+static FLUID_INLINE void get_mod_delay_block(mod_delay_line *mdl,
+                                             fluid_real_t *tap0,
+                                             fluid_real_t *tap1,
+                                             fluid_real_t *frac,
+                                             int stride)
+{
+    const fluid_real_t *line = mdl->dl.line;
+    int size = mdl->dl.size;
+    int line_out = mdl->dl.line_out;
+    int index_rate = mdl->index_rate;
+    fluid_real_t frac_pos_mod = mdl->frac_pos_mod;
+    int k;
+
+    for(k = 0; k < FLUID_BUFSIZE; k++)
+    {
+        /* Checks if the modulator must be updated (every mod_rate samples). */
+        /* Important: center_pos_mod must be used immediately for the
+           first sample. So, mdl->index_rate must be initialized
+           to mdl->mod_rate (set_mod_delay_line())  */
+        if(++index_rate >= mdl->mod_rate)
         {
-            int_out_index = (int)(out_index - 1); /* previous integer part */
-            /* forces read index (line_out) with integer modulation value  */
-            /* circular motion as needed */
-            mdl->dl.line_out   = int_out_index + mdl->dl.size;
+            index_rate = 0;
+            update_mod_delay_position(mdl);
+            line_out = mdl->dl.line_out;
+            frac_pos_mod = mdl->frac_pos_mod;
         }
 
-        /* extracts fractionnal part. (it will be used when interpolating
-          between line_out and line_out +1) and memorize it.
-          Memorizing is necessary for modulation rate above 1 */
-        mdl->frac_pos_mod = out_index - int_out_index;
+        /* read current sample */
+        tap0[k * stride] = line[line_out];
 
-        /* updates center position (center_pos_mod) to the next position
-           specified by modulation rate */
-        if((mdl->center_pos_mod += mdl->mod_rate) >= mdl->dl.size)
+        /* updates line_out to the next sample.
+           Boundary check and circular motion as needed */
+        if(++line_out >= size)
         {
-            mdl->center_pos_mod -= mdl->dl.size;
+            line_out -= size;
         }
-    }
 
-    /*  First order all-pass interpolation ----------------------------------*/
-    /* https://ccrma.stanford.edu/~jos/pasp/First_Order_Allpass_Interpolation.html */
-    /*  begins interpolation: read current sample */
-    out = mdl->dl.line[mdl->dl.line_out];
-
-    /* updates line_out to the next sample.
-       Boundary check and circular motion as needed */
-    if(++mdl->dl.line_out >= mdl->dl.size)
-    {
-        mdl->dl.line_out -= mdl->dl.size;
+        /* and the next one, for the fractional interpolation */
+        tap1[k * stride] = line[line_out];
+        frac[k * stride] = frac_pos_mod;
     }
 
-    /* Fractional interpolation between next sample (at next position) and
-       previous output added to current sample.
-    */
-    out += mdl->frac_pos_mod * (mdl->dl.line[mdl->dl.line_out] - mdl->buffer);
-    mdl->buffer = out; /* memorizes current output */
-    return out;
+    mdl->dl.line_out = line_out;
+    mdl->index_rate = index_rate;
 }
 
 /*-----------------------------------------------------------------------------
@@ -619,6 +651,11 @@ struct _fluid_revmodel_t
 
     /* fdn reverberation structure */
     fluid_late  late;
+
+    /* tail silence detection */
+    int tail_samples;  /* silent samples needed before bypassing */
+    int quiet_samples; /* silent samples seen so far */
+    int bypass;        /* the tail has died out, processing is skipped */
 };
 
 /*-----------------------------------------------------------------------------
@@ -993,7 +1030,7 @@ static void initialize_mod_delay_lines(fluid_late *late, fluid_real_t sample_rat
 
         /* index rate to control when to update center_pos_mod.
            Important: must be set to get center_pos_mod immediately used for
-           the reading of first sample (see get_mod_delay())
+           the reading of first sample (see get_mod_delay_block())
         */
         mdl->index_rate = mdl->mod_rate;
 
@@ -1027,6 +1064,10 @@ fluid_revmodel_init(fluid_revmodel_t *rev)
     {
         clear_delay_line(&rev->late.mod_delay_lines[i].dl);
     }
+
+    /* nothing left to play until new input arrives */
+    rev->quiet_samples = 0;
+    rev->bypass = TRUE;
 }
 
 
@@ -1086,6 +1127,7 @@ fluid_revmodel_t *
 new_fluid_revmodel(fluid_real_t sample_rate_max, fluid_real_t sample_rate)
 {
     fluid_revmodel_t *rev;
+    int i;
 
     if(sample_rate <= 0)
     {
@@ -1126,6 +1168,23 @@ new_fluid_revmodel(fluid_real_t sample_rate_max, fluid_real_t sample_rate)
     /* Initialize all modulated lines. */
     initialize_mod_delay_lines(&rev->late, sample_rate);
 
+    /* The unit is bypassed once its output has stayed silent for as long
+       as the longest line, so that every line has had a chance to show up
+       in the output. */
+    rev->tail_samples = 0;
+
+    for(i = 0; i < NBR_DELAYS; i++)
+    {
+        if(rev->late.mod_delay_lines[i].dl.size > rev->tail_samples)
+        {
+            rev->tail_samples = rev->late.mod_delay_lines[i].dl.size;
+        }
+    }
+
+    /* the lines are clear, there is no tail yet */
+    rev->quiet_samples = 0;
+    rev->bypass = TRUE;
+
     return rev;
 }
 
@@ -1259,6 +1318,8 @@ fluid_revmodel_samplerate_change(fluid_revmodel_t *rev, fluid_real_t sample_rate
 
     /* Initialize all modulated lines according to sample rate change. */
     initialize_mod_delay_lines(&rev->late, sample_rate);
+    rev->quiet_samples = 0;
+    rev->bypass = TRUE;
 
     /* updates damping filter coefficients according to sample rate change */
     update_rev_time_damping(&rev->late, rev->roomsize, rev->damp);
@@ -1281,18 +1342,26 @@ fluid_revmodel_reset(fluid_revmodel_t *rev)
 }
 
 /*-----------------------------------------------------------------------------
-* fdn reverb process replace.
+* fdn reverb process.
 * @param rev pointer on reverb.
-* @param in monophonic buffer input (FLUID_BUFSIZE sample).
-* @param left_out stereo left processed output (FLUID_BUFSIZE sample).
-* @param right_out stereo right processed output (FLUID_BUFSIZE sample).
+* @param in monophonic buffer input (FLUID_BUFSIZE samples).
+* @param left_out stereo left processed output (FLUID_BUFSIZE samples).
+* @param right_out stereo right processed output (FLUID_BUFSIZE samples).
+* @param mix TRUE to mix the reverb with the samples already in out,
+*  FALSE to replace them.
 *
-* The processed reverb is replacing anything there in out.
-* Reverb API.
+* The whole block is read out of the delay lines first. The lines are then
+* processed as lanes of fluid_fx_vec_t: the interpolators, the damping
+* filters, the matrix sum and the stereo outputs are computed for all of them
+* at once.
+*
+* Once both the input and the output have stayed below FLUID_FX_SILENCE_LEVEL
+* for tail_samples, the reverb is bypassed until some input comes in again.
 -----------------------------------------------------------------------------*/
-void
-fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
-                              fluid_real_t *left_out, fluid_real_t *right_out)
+static FLUID_INLINE void
+fluid_revmodel_process(fluid_revmodel_t *rev, const fluid_real_t *in,
+                       fluid_real_t *left_out, fluid_real_t *right_out,
+                       int mix)
 {
     int i, k;
 
@@ -1300,13 +1369,67 @@ fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
     fluid_real_t out_tone_filter;      /* tone corrector output */
     fluid_real_t out_left, out_right;  /* output stereo Left  and Right  */
     fluid_real_t matrix_factor;        /* partial matrix computation */
-    fluid_real_t delay_out_s;          /* sample */
+    fluid_real_t left, right;          /* reverb contribution to out */
+    int in_silent;                     /* silence detection */
+    fluid_real_t out_peak;
+
+    /* one lane per delay line */
+    fluid_real_t tap0[FLUID_BUFSIZE][NBR_DELAYS]; /* sample at line_out */
+    fluid_real_t tap1[FLUID_BUFSIZE][NBR_DELAYS]; /* sample at line_out + 1 */
+    fluid_real_t frac[FLUID_BUFSIZE][NBR_DELAYS]; /* interpolator position */
+    fluid_fx_vec_t interp[NBR_DELAYS / FLUID_FX_LANES]; /* interpolator previous output */
+    fluid_fx_vec_t damp[NBR_DELAYS / FLUID_FX_LANES];   /* damping filter state */
+    fluid_fx_vec_t b0[NBR_DELAYS / FLUID_FX_LANES];     /* damping coefficients */
+    fluid_fx_vec_t a1[NBR_DELAYS / FLUID_FX_LANES];
     fluid_real_t delay_out[NBR_DELAYS]; /* Line output + damper output */
+    fluid_real_t sum[FLUID_FX_LANES], sum_left[FLUID_FX_LANES], sum_right[FLUID_FX_LANES];
+
+    in_silent = fluid_fx_is_silent(in, FLUID_BUFSIZE);
+
+    if(rev->bypass)
+    {
+        if(in_silent)
+        {
+            if(!mix)
+            {
+                FLUID_MEMSET(left_out, 0, FLUID_BUFSIZE * sizeof(fluid_real_t));
+                FLUID_MEMSET(right_out, 0, FLUID_BUFSIZE * sizeof(fluid_real_t));
+            }
+
+            return;
+        }
+
+        /* wakes up, whatever is left in the lines is below the threshold */
+        rev->bypass = FALSE;
+        rev->quiet_samples = 0;
+    }
+
+    for(i = 0; i < NBR_DELAYS; i += FLUID_FX_LANES)
+    {
+        mod_delay_line *mdl = &rev->late.mod_delay_lines[i];
+        interp[i / FLUID_FX_LANES] = fluid_fx_vec_set(mdl[0].buffer, mdl[1].buffer);
+        damp[i / FLUID_FX_LANES] = fluid_fx_vec_set(mdl[0].dl.damping.buffer,
+                                                    mdl[1].dl.damping.buffer);
+        b0[i / FLUID_FX_LANES] = fluid_fx_vec_set(mdl[0].dl.damping.b0,
+                                                  mdl[1].dl.damping.b0);
+        a1[i / FLUID_FX_LANES] = fluid_fx_vec_set(mdl[0].dl.damping.a1,
+                                                  mdl[1].dl.damping.a1);
+    }
+
+    /* Reads the whole block out of the lines first. Every line is much
+       longer than FLUID_BUFSIZE, so none of these samples can be written
+       by the block itself. */
+    for(i = 0; i < NBR_DELAYS; i++)
+    {
+        get_mod_delay_block(&rev->late.mod_delay_lines[i],
+                            &tap0[0][i], &tap1[0][i], &frac[0][i], NBR_DELAYS);
+    }
+
+    out_peak = 0;
 
     for(k = 0; k < FLUID_BUFSIZE; k++)
     {
-        /* stereo output */
-        out_left = out_right = 0;
+        fluid_fx_vec_t v_sum, v_left, v_right;
 
 #ifdef DENORMALISING
         /* Input is adjusted by DC_OFFSET. */
@@ -1321,6 +1444,7 @@ fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
         out_tone_filter = xn * rev->late.b1 - rev->late.b2 * rev->late.tone_buffer;
         rev->late.tone_buffer = xn;
         xn = out_tone_filter;
+
         /*--------------------------------------------------------------------
          process  feedback delayed network:
           - xn is the input signal.
@@ -1328,31 +1452,47 @@ fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
             output, filter them and compute output in delay_out[].
           - also matrix_factor is computed (to simplify further matrix product)
         ---------------------------------------------------------------------*/
-        /* We begin with the modulated output delay line + damping filter */
-        matrix_factor = 0;
+        /* We begin with the modulated output delay lines */
+        v_sum = v_left = v_right = fluid_fx_vec_zero();
 
-        for(i = 0; i < NBR_DELAYS; i++)
+        for(i = 0; i < NBR_DELAYS; i += FLUID_FX_LANES)
         {
-            mod_delay_line *mdl = &rev->late.mod_delay_lines[i];
-            /* get current modulated output */
-            delay_out_s = get_mod_delay(mdl);
-
-            /* process low pass damping filter
-              (input:delay_out_s, output:delay_out_s) */
-            process_damping_filter(delay_out_s, delay_out_s, mdl);
+            fluid_fx_vec_t v_out;
+
+            /* First order all-pass interpolation:
+               https://ccrma.stanford.edu/~jos/pasp/First_Order_Allpass_Interpolation.html
+               out = tap0 + frac * (tap1 - previous out) */
+            v_out = fluid_fx_vec_add(fluid_fx_vec_load(&tap0[k][i]),
+                                     fluid_fx_vec_mul(fluid_fx_vec_load(&frac[k][i]),
+                                                      fluid_fx_vec_sub(fluid_fx_vec_load(&tap1[k][i]),
+                                                                       interp[i / FLUID_FX_LANES])));
+            interp[i / FLUID_FX_LANES] = v_out;
+
+            /* low pass damping filter */
+            v_out = fluid_fx_vec_sub(fluid_fx_vec_mul(v_out, b0[i / FLUID_FX_LANES]),
+                                     fluid_fx_vec_mul(damp[i / FLUID_FX_LANES],
+                                                      a1[i / FLUID_FX_LANES]));
+            damp[i / FLUID_FX_LANES] = v_out;
 
             /* Result in delay_out[], and matrix_factor.
                These will be of use later during input line process */
-            delay_out[i] = delay_out_s;   /* result in delay_out[] */
-            matrix_factor += delay_out_s; /* result in matrix_factor */
+            fluid_fx_vec_store(&delay_out[i], v_out);
+            v_sum = fluid_fx_vec_add(v_sum, v_out);
 
             /* Process stereo output */
-            /* stereo left = left + out_left_gain * delay_out */
-            out_left += rev->late.out_left_gain[i] * delay_out_s;
-            /* stereo right= right+ out_right_gain * delay_out */
-            out_right += rev->late.out_right_gain[i] * delay_out_s;
+            v_left = fluid_fx_vec_add(v_left,
+                                      fluid_fx_vec_mul(fluid_fx_vec_load(&rev->late.out_left_gain[i]), v_out));
+            v_right = fluid_fx_vec_add(v_right,
+                                       fluid_fx_vec_mul(fluid_fx_vec_load(&rev->late.out_right_gain[i]), v_out));
         }
 
+        fluid_fx_vec_store(sum, v_sum);
+        fluid_fx_vec_store(sum_left, v_left);
+        fluid_fx_vec_store(sum_right, v_right);
+        matrix_factor = sum[0] + sum[1];
+        out_left = sum_left[0] + sum_left[1];
+        out_right = sum_right[0] + sum_right[1];
+
         /* now we process the input delay line.Each input is a combination of
            - xn: input signal
            - delay_out[] the output of a delay line given by a permutation matrix P
@@ -1385,23 +1525,84 @@ fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
         out_right -= DC_OFFSET;
 #endif
 
-        /* Calculates stereo output REPLACING anything already there: */
-        /*
-            left_out[k]  = out_left * rev->wet1 + out_right * rev->wet2;
-            right_out[k] = out_right * rev->wet1 + out_left * rev->wet2;
+        /* Calculates stereo output:
+            left  = out_left * rev->wet1 + out_right * rev->wet2;
+            right = out_right * rev->wet1 + out_left * rev->wet2;
 
             As wet1 is integrated in stereo coefficient wet 1 is now
             integrated in out_left and out_right, so we simplify previous
-            relation by suppression of one multiply as this:
-
-            left_out[k]  = out_left  + out_right * rev->wet2;
-            right_out[k] = out_right + out_left * rev->wet2;
+            relation by suppression of one multiply.
         */
-        left_out[k]  = out_left  + out_right * rev->wet2;
-        right_out[k] = out_right + out_left * rev->wet2;
+        left  = out_left  + out_right * rev->wet2;
+        right = out_right + out_left * rev->wet2;
+
+        if(mix)
+        {
+            left_out[k]  += left;
+            right_out[k] += right;
+        }
+        else
+        {
+            left_out[k]  = left;
+            right_out[k] = right;
+        }
+
+        /* the output level only matters while the input is silent */
+        if(in_silent)
+        {
+            left = FLUID_FABS(left);
+            right = FLUID_FABS(right);
+            out_peak = (left > out_peak) ? left : out_peak;
+            out_peak = (right > out_peak) ? right : out_peak;
+        }
+    }
+
+    for(i = 0; i < NBR_DELAYS; i += FLUID_FX_LANES)
+    {
+        mod_delay_line *mdl = &rev->late.mod_delay_lines[i];
+        fluid_real_t state[FLUID_FX_LANES];
+
+        fluid_fx_vec_store(state, interp[i / FLUID_FX_LANES]);
+        mdl[0].buffer = state[0];
+        mdl[1].buffer = state[1];
+        fluid_fx_vec_store(state, damp[i / FLUID_FX_LANES]);
+        mdl[0].dl.damping.buffer = state[0];
+        mdl[1].dl.damping.buffer = state[1];
+    }
+
+    /* tail silence detection */
+    if(in_silent && out_peak < FLUID_FX_SILENCE_LEVEL)
+    {
+        rev->quiet_samples += FLUID_BUFSIZE;
+
+        if(rev->quiet_samples >= rev->tail_samples)
+        {
+            rev->bypass = TRUE;
+        }
+    }
+    else
+    {
+        rev->quiet_samples = 0;
     }
 }
 
+/*-----------------------------------------------------------------------------
+* fdn reverb process replace.
+* @param rev pointer on reverb.
+* @param in monophonic buffer input (FLUID_BUFSIZE sample).
+* @param left_out stereo left processed output (FLUID_BUFSIZE sample).
+* @param right_out stereo right processed output (FLUID_BUFSIZE sample).
+*
+* The processed reverb is replacing anything there in out.
+* Reverb API.
+-----------------------------------------------------------------------------*/
+void
+fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
+                              fluid_real_t *left_out, fluid_real_t *right_out)
+{
+    fluid_revmodel_process(rev, in, left_out, right_out, FALSE);
+}
+
 
 /*-----------------------------------------------------------------------------
 * fdn reverb process mix.
@@ -1416,108 +1617,5 @@ fluid_revmodel_processreplace(fluid_revmodel_t *rev, const fluid_real_t *in,
 void fluid_revmodel_processmix(fluid_revmodel_t *rev, const fluid_real_t *in,
                                fluid_real_t *left_out, fluid_real_t *right_out)
 {
-    int i, k;
-
-    fluid_real_t xn;                   /* mono input x(n) */
-    fluid_real_t out_tone_filter;      /* tone corrector output */
-    fluid_real_t out_left, out_right;  /* output stereo Left  and Right  */
-    fluid_real_t matrix_factor;        /* partial matrix term */
-    fluid_real_t delay_out_s;          /* sample */
-    fluid_real_t delay_out[NBR_DELAYS]; /* Line output + damper output */
-
-    for(k = 0; k < FLUID_BUFSIZE; k++)
-    {
-        /* stereo output */
-        out_left = out_right = 0;
-#ifdef DENORMALISING
-        /* Input is adjusted by DC_OFFSET. */
-        xn = (in[k]) * FIXED_GAIN + DC_OFFSET;
-#else
-        xn = (in[k]) * FIXED_GAIN;
-#endif
-
-        /*--------------------------------------------------------------------
-         tone correction
-        */
-        out_tone_filter = xn * rev->late.b1 - rev->late.b2 * rev->late.tone_buffer;
-        rev->late.tone_buffer = xn;
-        xn = out_tone_filter;
-        /*--------------------------------------------------------------------
-         process feedback delayed network:
-          - xn is the input signal.
-          - before inserting in the line input we first we get the delay lines
-            output, filter them and compute output in local delay_out[].
-          - also matrix_factor is computed (to simplify further matrix product).
-        ---------------------------------------------------------------------*/
-        /* We begin with the modulated output delay line + damping filter */
-        matrix_factor = 0;
-
-        for(i = 0; i < NBR_DELAYS; i++)
-        {
-            mod_delay_line *mdl = &rev->late.mod_delay_lines[i];
-            /* get current modulated output */
-            delay_out_s = get_mod_delay(mdl);
-
-            /* process low pass damping filter
-              (input:delay_out_s, output:delay_out_s) */
-            process_damping_filter(delay_out_s, delay_out_s, mdl);
-
-            /* Result in delay_out[], and matrix_factor.
-               These will be of use later during input line process */
-            delay_out[i] = delay_out_s;   /* result in delay_out[] */
-            matrix_factor += delay_out_s; /* result in matrix_factor */
-
-            /* Process stereo output */
-            /* stereo left = left + out_left_gain * delay_out */
-            out_left += rev->late.out_left_gain[i] * delay_out_s;
-            /* stereo right= right+ out_right_gain * delay_out */
-            out_right += rev->late.out_right_gain[i] * delay_out_s;
-        }
-
-        /* now we process the input delay line. Each input is a combination of:
-           - xn: input signal
-           - delay_out[] the output of a delay line given by a permutation matrix P
-           - and matrix_factor.
-          This computes: in_delay_line = xn + (delay_out[] * matrix A) with
-          an algorithm equivalent but faster than using a product with matrix A.
-        */
-        /* matrix_factor = output sum * (-2.0)/N  */
-        matrix_factor *= FDN_MATRIX_FACTOR;
-        matrix_factor += xn; /* adds reverb input signal */
-
-        for(i = 1; i < NBR_DELAYS; i++)
-        {
-            /* delay_in[i-1] = delay_out[i] + matrix_factor */
-            delay_line *dl = &rev->late.mod_delay_lines[i - 1].dl;
-            push_in_delay_line(dl, delay_out[i] + matrix_factor);
-        }
-
-        /* last line input (NB_DELAY-1) */
-        /* delay_in[0] = delay_out[NB_DELAY -1] + matrix_factor */
-        {
-            delay_line *dl = &rev->late.mod_delay_lines[NBR_DELAYS - 1].dl;
-            push_in_delay_line(dl, delay_out[0] + matrix_factor);
-        }
-
-        /*-------------------------------------------------------------------*/
-#ifdef DENORMALISING
-        /* Removes the DC offset */
-        out_left -= DC_OFFSET;
-        out_right -= DC_OFFSET;
-#endif
-        /* Calculates stereo output MIXING anything already there: */
-        /*
-            left_out[k]  += out_left * rev->wet1 + out_right * rev->wet2;
-            right_out[k] += out_right * rev->wet1 + out_left * rev->wet2;
-
-            As wet1 is integrated in stereo coefficient wet 1 is now
-            integrated in out_left and out_right, so we simplify previous
-            relation by suppression of one multiply as this:
-
-            left_out[k]  += out_left  + out_right * rev->wet2;
-            right_out[k] += out_right + out_left * rev->wet2;
-        */
-        left_out[k]  += out_left  + out_right * rev->wet2;
-        right_out[k] += out_right + out_left * rev->wet2;
-    }
+    fluid_revmodel_process(rev, in, left_out, right_out, TRUE);
 }
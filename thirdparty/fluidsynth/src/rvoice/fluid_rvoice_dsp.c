@@ -21,6 +21,7 @@
 #include "fluid_sys.h"
 #include "fluid_phase.h"
 #include "fluid_rvoice.h"
+#include "fluid_rvoice_dsp_tables.h"
 #include "fluid_rvoice_dsp_tables.inc.h"
 
 /* Purpose:
@@ -54,6 +55,470 @@ fluid_rvoice_get_float_sample(const short int *dsp_msb, const char *dsp_lsb, uns
     return (fluid_real_t)sample;
 }
 
+/* Vectorized interpolation kernels.
+ *
+ * These only cover the inner run of each interpolator, where all points come
+ * straight from the sample data, and only for plain 16 bit samples. Everything
+ * near the loop or sample boundaries and all 24 bit samples go through the
+ * scalar code below. The kernels read exactly the same sample points as the
+ * scalar loops do. The 16 bit sample is scaled by 256 afterwards, which is
+ * exact, so the only difference is the order in which the products get summed.
+ *
+ * fluid_rvoice_dsp_init() picks the best kernels the CPU supports.
+ */
+
+#if !defined(WITH_FLOAT) && (defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FLUID_DSP_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__)
+#define FLUID_DSP_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define FLUID_DSP_TARGET_AVX2
+#else
+#define FLUID_DSP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#elif !defined(WITH_FLOAT) && (defined(__aarch64__) || defined(_M_ARM64))
+#define FLUID_DSP_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef unsigned int (*fluid_rvoice_dsp_kernel_t)(const short int *dsp_data, fluid_phase_t *dsp_phase,
+        fluid_phase_t dsp_phase_incr, fluid_real_t *dsp_amp, fluid_real_t dsp_amp_incr,
+        fluid_real_t *FLUID_RESTRICT dsp_buf, unsigned int dsp_i, unsigned int end_index);
+
+static fluid_rvoice_dsp_kernel_t fluid_rvoice_dsp_kernel_linear = NULL;
+static fluid_rvoice_dsp_kernel_t fluid_rvoice_dsp_kernel_4th = NULL;
+static fluid_rvoice_dsp_kernel_t fluid_rvoice_dsp_kernel_7th = NULL;
+
+/* The 7 point coefficients rearranged for two 4 point loads, the first
+ * covering points -3..0 and the second 0..3. Point 0 gets used only once. */
+#if defined(FLUID_DSP_SSE2) || defined(FLUID_DSP_NEON)
+static fluid_real_t sinc_table7_split[FLUID_INTERP_MAX][8];
+#endif
+
+/* Runs the interpolation while all points are inside the sample data.
+ * 'dot' computes the dot product of the points at 'p' with the coefficients
+ * at 'c', unscaled. */
+#define FLUID_DSP_KERNEL_LOOP(table, offset, dot) \
+    fluid_phase_t phase = *dsp_phase; \
+    fluid_real_t amp = *dsp_amp; \
+    while(dsp_i < FLUID_BUFSIZE && fluid_phase_index(phase) <= end_index) \
+    { \
+        const short int *p = dsp_data + fluid_phase_index(phase) - (offset); \
+        const fluid_real_t *c = table[fluid_phase_fract_to_tablerow(phase)]; \
+        dsp_buf[dsp_i++] = amp * (dot * (fluid_real_t)256.0); \
+        fluid_phase_incr(phase, dsp_phase_incr); \
+        amp += dsp_amp_incr; \
+    } \
+    *dsp_phase = phase; \
+    *dsp_amp = amp; \
+    return dsp_i;
+
+#ifdef FLUID_DSP_SSE2
+
+static FLUID_INLINE __m128i
+fluid_rvoice_dsp_load4_sse2(const short int *p)
+{
+    __m128i raw = _mm_loadl_epi64((const __m128i *)p);
+    return _mm_srai_epi32(_mm_unpacklo_epi16(raw, raw), 16);
+}
+
+static FLUID_INLINE __m128d
+fluid_rvoice_dsp_mul4_sse2(const short int *p, const fluid_real_t *c)
+{
+    __m128i s = fluid_rvoice_dsp_load4_sse2(p);
+    __m128d lo = _mm_mul_pd(_mm_cvtepi32_pd(s), _mm_loadu_pd(c));
+    __m128d hi = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2))), _mm_loadu_pd(c + 2));
+    return _mm_add_pd(lo, hi);
+}
+
+static FLUID_INLINE fluid_real_t
+fluid_rvoice_dsp_hsum_sse2(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static FLUID_INLINE fluid_real_t
+fluid_rvoice_dsp_dot2_sse2(const short int *p, const fluid_real_t *c)
+{
+    int32_t pair;
+    __m128i s;
+    FLUID_MEMCPY(&pair, p, sizeof(pair));
+    s = _mm_cvtsi32_si128(pair);
+    s = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    return fluid_rvoice_dsp_hsum_sse2(_mm_mul_pd(_mm_cvtepi32_pd(s), _mm_loadu_pd(c)));
+}
+
+static FLUID_INLINE __m128d
+fluid_rvoice_dsp_mul4f_sse2(const float *p, const fluid_real_t *c)
+{
+    __m128 s = _mm_loadu_ps(p);
+    __m128d lo = _mm_mul_pd(_mm_cvtps_pd(s), _mm_loadu_pd(c));
+    __m128d hi = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(s, s)), _mm_loadu_pd(c + 2));
+    return _mm_add_pd(lo, hi);
+}
+
+#define FLUID_DSP_FLOAT_DOT4(p, c) fluid_rvoice_dsp_hsum_sse2(fluid_rvoice_dsp_mul4f_sse2(p, c))
+#define FLUID_DSP_FLOAT_DOT7(p, c) \
+    fluid_rvoice_dsp_hsum_sse2(_mm_add_pd(fluid_rvoice_dsp_mul4f_sse2(p, c), fluid_rvoice_dsp_mul4f_sse2((p) + 3, (c) + 4)))
+
+static unsigned int
+fluid_rvoice_dsp_kernel_linear_sse2(const short int *dsp_data, fluid_phase_t *dsp_phase,
+                                    fluid_phase_t dsp_phase_incr, fluid_real_t *dsp_amp, fluid_real_t dsp_amp_incr,
+                                    fluid_real_t *FLUID_RESTRICT dsp_buf, unsigned int dsp_i, unsigned int end_index)
+{
+    FLUID_DSP_KERNEL_LOOP(interp_coeff_linear, 0, fluid_rvoice_dsp_dot2_sse2(p, c))
+}
+
+static unsigned int
+fluid_rvoice_dsp_kernel_4th_sse2(const short int *dsp_data, fluid_phase_t *dsp_phase,
+                                 fluid_phase_t dsp_phase_incr, fluid_real_t *dsp_amp, fluid_real_t dsp_amp_incr,
+                                 fluid_real_t *FLUID_RESTRICT dsp_buf, unsigned int dsp_i, unsigned int end_index)
+{
+    FLUID_DSP_KERNEL_LOOP(interp_coeff, 1, fluid_rvoice_dsp_hsum_sse2(fluid_rvoice_dsp_mul4_sse2(p, c)))
+}
+
+static unsigned int
+fluid_rvoice_dsp_kernel_7th_sse2(const short int *dsp_data, fluid_phase_t *dsp_phase,
+                                 fluid_phase_t dsp_phase_incr, fluid_real_t *dsp_amp, fluid_real_t dsp_amp_incr,
+                                 fluid_real_t *FLUID_RESTRICT dsp_buf, unsigned int dsp_i, unsigned int end_index)
+{
+    FLUID_DSP_KERNEL_LOOP(sinc_table7_split, 3,
+                          fluid_rvoice_dsp_hsum_sse2(_mm_add_pd(fluid_rvoice_dsp_mul4_sse2(p, c),
+                                  fluid_rvoice_dsp_mul4_sse2(p + 3, c + 4))))
+}
+
+#endif /* FLUID_DSP_SSE2 */
+
+#ifdef FLUID_DSP_AVX2
+
+static FLUID_INLINE FLUID_DSP_TARGET_AVX2 __m256d
+fluid_rvoice_dsp_mul4_avx2(const short int *p, const fluid_real_t *c)
+{
+    __m128i s = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)p));
+    return _mm256_mul_pd(_mm256_cvtepi32_pd(s), _mm256_loadu_pd(c));
+}
+
+static FLUID_INLINE FLUID_DSP_TARGET_AVX2 fluid_real_t
+fluid_rvoice_dsp_hsum_avx2(__m256d v)
+{
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+static FLUID_DSP_TARGET_AVX2 unsigned int
+fluid_rvoice_dsp_kernel_4th_avx2(const short int *dsp_data, fluid_phase_t *dsp_phase,
+                                 fluid_phase_t dsp_phase_incr, fluid_real_t *dsp_amp, fluid_real_t dsp_amp_incr,
+                                 fluid_real_t *FLUID_RESTRICT dsp_buf, unsigned int dsp_i, unsigned int end_index)
+{
+    FLUID_DSP_KERNEL_LOOP(interp_coeff, 1, fluid_rvoice_dsp_hsum_avx2(fluid_rvoice_dsp_mul4_avx2(p, c)))
+}
+
+static FLUID_DSP_TARGET_AVX2 unsigned int
+fluid_rvoice_dsp_kernel_7th_avx2(const short int *dsp_data, fluid_phase_t *dsp_phase,
+                                 fluid_phase_t dsp_phase_incr, fluid_real_t *dsp_amp, fluid_real_t dsp_amp_incr,
+                                 fluid_real_t *FLUID_RESTRICT dsp_buf, unsigned int dsp_i, unsigned int end_index)
+{
+    FLUID_DSP_KERNEL_LOOP(sinc_table7_split, 3,
+                          fluid_rvoice_dsp_hsum_avx2(_mm256_add_pd(fluid_rvoice_dsp_mul4_avx2(p, c),
+                                  fluid_rvoice_dsp_mul4_avx2(p + 3, c + 4))))
+}
+
+static int
+fluid_rvoice_dsp_has_avx2(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+
+    if(info[0] < 7)
+    {
+        return FALSE;
+    }
+
+    /* the OS has to save the AVX registers as well */
+    __cpuid(info, 1);
+
+    if(!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+    {
+        return FALSE;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif /* FLUID_DSP_AVX2 */
+
+#ifdef FLUID_DSP_NEON
+
+static FLUID_INLINE float64x2_t
+fluid_rvoice_dsp_cvt2_neon(int32x2_t s)
+{
+    return vcvtq_f64_s64(vmovl_s32(s));
+}
+
+static FLUID_INLINE float64x2_t
+fluid_rvoice_dsp_mul4_neon(const short int *p, const fluid_real_t *c)
+{
+    int32x4_t s = vmovl_s16(vld1_s16(p));
+    float64x2_t lo = vmulq_f64(fluid_rvoice_dsp_cvt2_neon(vget_low_s32(s)), vld1q_f64(c));
+    return vfmaq_f64(lo, fluid_rvoice_dsp_cvt2_neon(vget_high_s32(s)), vld1q_f64(c + 2));
+}
+
+static FLUID_INLINE fluid_real_t
+fluid_rvoice_dsp_dot2_neon(const short int *p, const fluid_real_t *c)
+{
+    int32x2_t s = { p[0], p[1] };
+    return vaddvq_f64(vmulq_f64(fluid_rvoice_dsp_cvt2_neon(s), vld1q_f64(c)));
+}
+
+static FLUID_INLINE float64x2_t
+fluid_rvoice_dsp_mul4f_neon(const float *p, const fluid_real_t *c)
+{
+    float32x4_t s = vld1q_f32(p);
+    float64x2_t lo = vmulq_f64(vcvt_f64_f32(vget_low_f32(s)), vld1q_f64(c));
+    return vfmaq_f64(lo, vcvt_high_f64_f32(s), vld1q_f64(c + 2));
+}
+
+#define FLUID_DSP_FLOAT_DOT4(p, c) vaddvq_f64(fluid_rvoice_dsp_mul4f_neon(p, c))
+#define FLUID_DSP_FLOAT_DOT7(p, c) \
+    vaddvq_f64(vaddq_f64(fluid_rvoice_dsp_mul4f_neon(p, c), fluid_rvoice_dsp_mul4f_neon((p) + 3, (c) + 4)))
+
+static unsigned int
+fluid_rvoice_dsp_kernel_linear_neon(const short int *dsp_data, fluid_phase_t *dsp_phase,
+                                    fluid_phase_t dsp_phase_incr, fluid_real_t *dsp_amp, fluid_real_t dsp_amp_incr,
+                                    fluid_real_t *FLUID_RESTRICT dsp_buf, unsigned int dsp_i, unsigned int end_index)
+{
+    FLUID_DSP_KERNEL_LOOP(interp_coeff_linear, 0, fluid_rvoice_dsp_dot2_neon(p, c))
+}
+
+static unsigned int
+fluid_rvoice_dsp_kernel_4th_neon(const short int *dsp_data, fluid_phase_t *dsp_phase,
+                                 fluid_phase_t dsp_phase_incr, fluid_real_t *dsp_amp, fluid_real_t dsp_amp_incr,
+                                 fluid_real_t *FLUID_RESTRICT dsp_buf, unsigned int dsp_i, unsigned int end_index)
+{
+    FLUID_DSP_KERNEL_LOOP(interp_coeff, 1, vaddvq_f64(fluid_rvoice_dsp_mul4_neon(p, c)))
+}
+
+static unsigned int
+fluid_rvoice_dsp_kernel_7th_neon(const short int *dsp_data, fluid_phase_t *dsp_phase,
+                                 fluid_phase_t dsp_phase_incr, fluid_real_t *dsp_amp, fluid_real_t dsp_amp_incr,
+                                 fluid_real_t *FLUID_RESTRICT dsp_buf, unsigned int dsp_i, unsigned int end_index)
+{
+    FLUID_DSP_KERNEL_LOOP(sinc_table7_split, 3,
+                          vaddvq_f64(vaddq_f64(fluid_rvoice_dsp_mul4_neon(p, c), fluid_rvoice_dsp_mul4_neon(p + 3, c + 4))))
+}
+
+#endif /* FLUID_DSP_NEON */
+
+/* Dot products for the float sample path, see fluid_rvoice_dsp_interpolate_float().
+ * The vector versions sum in the same order as the kernels above. */
+#ifdef FLUID_DSP_FLOAT_DOT7
+#define FLUID_DSP_FLOAT_TABLE7 sinc_table7_split
+#else
+#define FLUID_DSP_FLOAT_DOT4(p, c) (c[0] * p[0] + c[1] * p[1] + c[2] * p[2] + c[3] * p[3])
+#define FLUID_DSP_FLOAT_DOT7(p, c) \
+    (c[0] * p[0] + c[1] * p[1] + c[2] * p[2] + c[3] * p[3] + c[4] * p[4] + c[5] * p[5] + c[6] * p[6])
+#define FLUID_DSP_FLOAT_TABLE7 sinc_table7
+#endif
+
+/* Selects the interpolation kernels, called once by fluid_synth_init(). */
+void
+fluid_rvoice_dsp_init(void)
+{
+#if defined(FLUID_DSP_SSE2) || defined(FLUID_DSP_NEON)
+    int i;
+
+    for(i = 0; i < FLUID_INTERP_MAX; i++)
+    {
+        sinc_table7_split[i][0] = sinc_table7[i][0];
+        sinc_table7_split[i][1] = sinc_table7[i][1];
+        sinc_table7_split[i][2] = sinc_table7[i][2];
+        sinc_table7_split[i][3] = sinc_table7[i][3];
+        sinc_table7_split[i][4] = 0;
+        sinc_table7_split[i][5] = sinc_table7[i][4];
+        sinc_table7_split[i][6] = sinc_table7[i][5];
+        sinc_table7_split[i][7] = sinc_table7[i][6];
+    }
+#endif
+
+#ifdef FLUID_DSP_SSE2
+    fluid_rvoice_dsp_kernel_linear = fluid_rvoice_dsp_kernel_linear_sse2;
+    fluid_rvoice_dsp_kernel_4th = fluid_rvoice_dsp_kernel_4th_sse2;
+    fluid_rvoice_dsp_kernel_7th = fluid_rvoice_dsp_kernel_7th_sse2;
+#endif
+#ifdef FLUID_DSP_AVX2
+
+    if(fluid_rvoice_dsp_has_avx2())
+    {
+        fluid_rvoice_dsp_kernel_4th = fluid_rvoice_dsp_kernel_4th_avx2;
+        fluid_rvoice_dsp_kernel_7th = fluid_rvoice_dsp_kernel_7th_avx2;
+    }
+
+#endif
+#ifdef FLUID_DSP_NEON
+    fluid_rvoice_dsp_kernel_linear = fluid_rvoice_dsp_kernel_linear_neon;
+    fluid_rvoice_dsp_kernel_4th = fluid_rvoice_dsp_kernel_4th_neon;
+    fluid_rvoice_dsp_kernel_7th = fluid_rvoice_dsp_kernel_7th_neon;
+#endif
+}
+
+/* Checks whether a voice can play from the float copy of its sample. Voices
+ * whose start, end or loop points have been moved by generators or modulators
+ * use the 16 bit data. */
+static int
+fluid_rvoice_dsp_can_use_float(const fluid_rvoice_dsp_t *voice, int looping)
+{
+    const fluid_sample_t *sample = voice->sample;
+
+    if(fluid_atomic_pointer_get(&voice->sample->float_data) == NULL
+            || (unsigned int)voice->start != sample->start || (unsigned int)voice->end != sample->end)
+    {
+        return FALSE;
+    }
+
+    if(!looping && !voice->has_looped)
+    {
+        return TRUE;
+    }
+
+    return sample->float_loop != NULL
+           && (unsigned int)voice->loopstart == sample->loopstart && (unsigned int)voice->loopend == sample->loopend;
+}
+
+/* Interpolates the points from 'base' onwards while the phase index is at most
+ * 'last'. The padding of the float copy holds every point the interpolation
+ * needs beyond, so there are no special cases. */
+#define FLUID_DSP_FLOAT_LOOP(table, offset, dot) \
+    for(; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= last; dsp_i++) \
+    { \
+        const float *p = points + (dsp_phase_index - base) - (offset); \
+        const fluid_real_t *c = table[fluid_phase_fract_to_tablerow(dsp_phase)]; \
+        dsp_buf[dsp_i] = dsp_amp * (dot); \
+        fluid_phase_incr(dsp_phase, dsp_phase_incr); \
+        dsp_phase_index = fluid_phase_index(dsp_phase); \
+        dsp_amp += dsp_amp_incr; \
+    }
+
+/* Interpolation of the given order (1, 4 or 7) from the float copy of the
+ * sample. Without vector support the output is the same as that of the scalar
+ * code of the interpolators below. Otherwise it matches the kernels, which are
+ * used here for the points near the boundaries as well.
+ * Returns number of samples processed. */
+static int
+fluid_rvoice_dsp_interpolate_float(fluid_rvoice_dsp_t *voice, fluid_real_t *FLUID_RESTRICT dsp_buf, int looping, int order)
+{
+    const fluid_sample_t *sample = voice->sample;
+    const unsigned int pad = FLUID_SAMPLE_FLOAT_PAD;
+    const float *float_data = fluid_atomic_pointer_get(&voice->sample->float_data);
+    const float *points;
+    fluid_phase_t dsp_phase = voice->phase;
+    fluid_phase_t dsp_phase_incr;
+    fluid_real_t dsp_amp = voice->amp;
+    fluid_real_t dsp_amp_incr = voice->amp_incr;
+    unsigned int dsp_i = 0;
+    unsigned int dsp_phase_index;
+    unsigned int base, last;
+    fluid_phase_t last_phase;
+
+    /* points before the loop end the interpolators below handle separately */
+    const unsigned int tail = order == 1 ? 1 : order / 2;
+
+    /* Convert playback "speed" floating point value to phase index/fract */
+    fluid_phase_set_float(dsp_phase_incr, voice->phase_incr);
+
+    /* 7th order interpolation is centered on the 4th sample point */
+    if(order == 7)
+    {
+        fluid_phase_incr(dsp_phase, (fluid_phase_t)0x80000000);
+    }
+
+    while(dsp_i < FLUID_BUFSIZE)
+    {
+        dsp_phase_index = fluid_phase_index(dsp_phase);
+
+        /* go back to loop start */
+        if(looping && dsp_phase_index >= sample->loopend)
+        {
+            fluid_phase_sub_int(dsp_phase, sample->loopend - sample->loopstart);
+            voice->has_looped = 1;
+            continue;
+        }
+
+        /* end of sample */
+        if(!looping && dsp_phase_index > sample->end)
+        {
+            break;
+        }
+
+        /* Once the voice has looped, the points before the loop start are the
+         * ones at the end of the loop. While looping the loop copy also holds
+         * the points after the loop end. */
+        if(dsp_phase_index >= sample->loopstart
+                && (looping ? (voice->has_looped || dsp_phase_index >= sample->loopstart + pad)
+                    : (voice->has_looped && dsp_phase_index < sample->loopstart + pad)))
+        {
+            points = sample->float_loop;
+            base = sample->loopstart - pad;
+            last = looping ? sample->loopend - 1 : sample->loopstart + pad - 1;
+        }
+        else
+        {
+            points = float_data;
+            base = sample->start - pad;
+            last = looping ? sample->loopstart + pad - 1 : sample->end;
+        }
+
+        switch(order)
+        {
+        case 1:
+            FLUID_DSP_FLOAT_LOOP(interp_coeff_linear, 0, c[0] * p[0] + c[1] * p[1])
+            break;
+
+        case 4:
+            FLUID_DSP_FLOAT_LOOP(interp_coeff, 1, FLUID_DSP_FLOAT_DOT4(p, c))
+            break;
+
+        default:
+            FLUID_DSP_FLOAT_LOOP(FLUID_DSP_FLOAT_TABLE7, 3, FLUID_DSP_FLOAT_DOT7(p, c))
+            break;
+        }
+
+        /* The interpolators above only go back to the loop start with a full
+         * buffer if the last point was one of the few before the loop end that
+         * they handle separately. Keep doing the same. */
+        if(looping && dsp_i >= FLUID_BUFSIZE && dsp_phase_index >= sample->loopend)
+        {
+            last_phase = dsp_phase;
+            fluid_phase_decr(last_phase, dsp_phase_incr);
+
+            if(fluid_phase_index(last_phase) + tail >= sample->loopend)
+            {
+                fluid_phase_sub_int(dsp_phase, sample->loopend - sample->loopstart);
+                voice->has_looped = 1;
+            }
+        }
+    }
+
+    if(order == 7)
+    {
+        fluid_phase_decr(dsp_phase, (fluid_phase_t)0x80000000);
+    }
+
+    voice->phase = dsp_phase;
+    voice->amp = dsp_amp;
+
+    return (dsp_i);
+}
+
 /* No interpolation. Just take the sample, which is closest to
   * the playback pointer.  Questionable quality, but very
   * efficient. */
@@ -135,6 +600,11 @@ fluid_rvoice_dsp_interpolate_linear(fluid_rvoice_dsp_t *voice, fluid_real_t *FLU
     fluid_real_t point;
     const fluid_real_t *FLUID_RESTRICT coeffs;
 
+    if(fluid_rvoice_dsp_can_use_float(voice, looping))
+    {
+        return fluid_rvoice_dsp_interpolate_float(voice, dsp_buf, looping, 1);
+    }
+
     /* Convert playback "speed" floating point value to phase index/fract */
     fluid_phase_set_float(dsp_phase_incr, voice->phase_incr);
 
@@ -156,6 +626,13 @@ fluid_rvoice_dsp_interpolate_linear(fluid_rvoice_dsp_t *voice, fluid_real_t *FLU
         dsp_phase_index = fluid_phase_index(dsp_phase);
 
         /* interpolate the sequence of sample points */
+        if(dsp_data24 == NULL && fluid_rvoice_dsp_kernel_linear != NULL)
+        {
+            dsp_i = fluid_rvoice_dsp_kernel_linear(dsp_data, &dsp_phase, dsp_phase_incr, &dsp_amp, dsp_amp_incr,
+                                              dsp_buf, dsp_i, end_index);
+            dsp_phase_index = fluid_phase_index(dsp_phase);
+        }
+
         for(; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
         {
             coeffs = interp_coeff_linear[fluid_phase_fract_to_tablerow(dsp_phase)];
@@ -235,6 +712,11 @@ fluid_rvoice_dsp_interpolate_4th_order(fluid_rvoice_dsp_t *voice, fluid_real_t *
     fluid_real_t start_point, end_point1, end_point2;
     const fluid_real_t *FLUID_RESTRICT coeffs;
 
+    if(fluid_rvoice_dsp_can_use_float(voice, looping))
+    {
+        return fluid_rvoice_dsp_interpolate_float(voice, dsp_buf, looping, 4);
+    }
+
     /* Convert playback "speed" floating point value to phase index/fract */
     fluid_phase_set_float(dsp_phase_incr, voice->phase_incr);
 
@@ -285,6 +767,13 @@ fluid_rvoice_dsp_interpolate_4th_order(fluid_rvoice_dsp_t *voice, fluid_real_t *
         }
 
         /* interpolate the sequence of sample points */
+        if(dsp_data24 == NULL && fluid_rvoice_dsp_kernel_4th != NULL)
+        {
+            dsp_i = fluid_rvoice_dsp_kernel_4th(dsp_data, &dsp_phase, dsp_phase_incr, &dsp_amp, dsp_amp_incr,
+                                              dsp_buf, dsp_i, end_index);
+            dsp_phase_index = fluid_phase_index(dsp_phase);
+        }
+
         for(; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
         {
             coeffs = interp_coeff[fluid_phase_fract_to_tablerow(dsp_phase)];
@@ -394,6 +883,11 @@ fluid_rvoice_dsp_interpolate_7th_order(fluid_rvoice_dsp_t *voice, fluid_real_t *
     fluid_real_t start_points[3], end_points[3];
     const fluid_real_t *FLUID_RESTRICT coeffs;
 
+    if(fluid_rvoice_dsp_can_use_float(voice, looping))
+    {
+        return fluid_rvoice_dsp_interpolate_float(voice, dsp_buf, looping, 7);
+    }
+
     /* Convert playback "speed" floating point value to phase index/fract */
     fluid_phase_set_float(dsp_phase_incr, voice->phase_incr);
 
@@ -505,6 +999,13 @@ fluid_rvoice_dsp_interpolate_7th_order(fluid_rvoice_dsp_t *voice, fluid_real_t *
 
 
         /* interpolate the sequence of sample points */
+        if(dsp_data24 == NULL && fluid_rvoice_dsp_kernel_7th != NULL)
+        {
+            dsp_i = fluid_rvoice_dsp_kernel_7th(dsp_data, &dsp_phase, dsp_phase_incr, &dsp_amp, dsp_amp_incr,
+                                              dsp_buf, dsp_i, end_index);
+            dsp_phase_index = fluid_phase_index(dsp_phase);
+        }
+
         for(; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
         {
             coeffs = sinc_table7[fluid_phase_fract_to_tablerow(dsp_phase)];
@@ -102,6 +102,7 @@ struct _fluid_rvoice_mixer_t
     int with_reverb;        /**< Should the synth use the built-in reverb unit? */
     int with_chorus;        /**< Should the synth use the built-in chorus unit? */
     int mix_fx_to_out;      /**< Should the effects be mixed in with the primary output? */
+    int fx_external;        /**< Leave the effect sends unprocessed for the caller to handle? */
 
 #ifdef LADSPA
     fluid_ladspa_fx_t *ladspa_fx; /**< Used by mixer only: Effects unit for LADSPA support. Never created or freed */
@@ -150,6 +151,12 @@ fluid_rvoice_mixer_process_fx(fluid_rvoice_mixer_t *mixer, int current_blockcoun
 
     fluid_profile_ref_var(prof_ref);
 
+    /* The sends are processed elsewhere, see fluid_synth_set_fx_external() */
+    if(mixer->fx_external)
+    {
+        return;
+    }
+
 #ifdef LADSPA
 
     /* Run the signal through the LADSPA Fx unit. The buffers have already been
@@ -678,6 +685,17 @@ fluid_mixer_buffers_zero(fluid_mixer_buffers_t *buffers, int current_blockcount)
     /* TODO: Optimize by only zero out the buffers we actually use later on. */
     int buf_count = buffers->buf_count, fx_buf_count = buffers->fx_buf_count;
 
+    /* Without any effects nothing gets sent to the fx buffers, and in mix mode
+     * nothing reads them either. */
+    if(!buffers->mixer->with_reverb && !buffers->mixer->with_chorus && buffers->mixer->mix_fx_to_out
+#ifdef LADSPA
+            && buffers->mixer->ladspa_fx == NULL
+#endif
+      )
+    {
+        fx_buf_count = 0;
+    }
+
     fluid_real_t *FLUID_RESTRICT buf_l = fluid_align_ptr(buffers->left_buf, FLUID_DEFAULT_ALIGNMENT);
     fluid_real_t *FLUID_RESTRICT buf_r = fluid_align_ptr(buffers->right_buf, FLUID_DEFAULT_ALIGNMENT);
 
@@ -1189,6 +1207,56 @@ void fluid_rvoice_mixer_set_mix_fx(fluid_rvoice_mixer_t *mixer, int on)
     mixer->mix_fx_to_out = on;
 }
 
+DECLARE_FLUID_RVOICE_FUNCTION(fluid_rvoice_mixer_set_fx_external)
+{
+    fluid_rvoice_mixer_t *mixer = obj;
+    mixer->fx_external = param[0].i;
+}
+
+/* Runs the reverb and chorus of the first fx unit on one block of mono
+ * sends and mixes the result into lout and rout. */
+void fluid_rvoice_mixer_process_external_fx(fluid_rvoice_mixer_t *mixer,
+        const float *reverb_in, const float *chorus_in,
+        float *lout, float *rout)
+{
+    fluid_real_t in[FLUID_BUFSIZE], left[FLUID_BUFSIZE], right[FLUID_BUFSIZE];
+    int i, processed = FALSE;
+
+    FLUID_MEMSET(left, 0, sizeof(left));
+    FLUID_MEMSET(right, 0, sizeof(right));
+
+    if(mixer->with_reverb && mixer->fx[0].reverb_on && reverb_in != NULL)
+    {
+        for(i = 0; i < FLUID_BUFSIZE; i++)
+        {
+            in[i] = reverb_in[i];
+        }
+
+        fluid_revmodel_processmix(mixer->fx[0].reverb, in, left, right);
+        processed = TRUE;
+    }
+
+    if(mixer->with_chorus && mixer->fx[0].chorus_on && chorus_in != NULL)
+    {
+        for(i = 0; i < FLUID_BUFSIZE; i++)
+        {
+            in[i] = chorus_in[i];
+        }
+
+        fluid_chorus_processmix(mixer->fx[0].chorus, in, left, right);
+        processed = TRUE;
+    }
+
+    if(processed)
+    {
+        for(i = 0; i < FLUID_BUFSIZE; i++)
+        {
+            lout[i] += (float)left[i];
+            rout[i] += (float)right[i];
+        }
+    }
+}
+
 DECLARE_FLUID_RVOICE_FUNCTION(fluid_rvoice_mixer_set_chorus_params)
 {
     fluid_rvoice_mixer_t *mixer = obj;
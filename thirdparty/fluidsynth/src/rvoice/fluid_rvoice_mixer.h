@@ -78,7 +78,12 @@ DECLARE_FLUID_RVOICE_FUNCTION(fluid_rvoice_mixer_reset_chorus);
 
 
 
+DECLARE_FLUID_RVOICE_FUNCTION(fluid_rvoice_mixer_set_fx_external);
+
 void fluid_rvoice_mixer_set_mix_fx(fluid_rvoice_mixer_t *mixer, int on);
+void fluid_rvoice_mixer_process_external_fx(fluid_rvoice_mixer_t *mixer,
+        const float *reverb_in, const float *chorus_in,
+        float *lout, float *rout);
 #ifdef LADSPA
 void fluid_rvoice_mixer_set_ladspa(fluid_rvoice_mixer_t *mixer,
                                    fluid_ladspa_fx_t *ladspa_fx, int audio_groups);
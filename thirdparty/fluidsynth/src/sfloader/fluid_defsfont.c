@@ -42,6 +42,9 @@ static int unload_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *pre
 static void unload_sample(fluid_sample_t *sample);
 static int dynamic_samples_preset_notify(fluid_preset_t *preset, int reason, int chan);
 static int dynamic_samples_sample_notify(fluid_sample_t *sample, int reason);
+static int build_preset_float_samples(fluid_preset_t *preset);
+static void decode_samples(fluid_defsfont_t *defsfont, SFData *sfdata, fluid_sample_t **samples,
+                           int *results, int count);
 static int fluid_preset_zone_create_voice_zones(fluid_preset_zone_t *preset_zone);
 static fluid_inst_t *find_inst_by_idx(fluid_defsfont_t *defsfont, int idx);
 
@@ -216,6 +219,15 @@ fluid_defsfont_t *new_fluid_defsfont(fluid_settings_t *settings)
 
     fluid_settings_getint(settings, "synth.lock-memory", &defsfont->mlock);
     fluid_settings_getint(settings, "synth.dynamic-sample-loading", &defsfont->dynamic_samples);
+    fluid_settings_getint(settings, "synth.sample-decode-threads", &defsfont->decode_threads);
+    fluid_settings_getint(settings, "synth.float-samples", &defsfont->float_samples);
+
+    if(fluid_settings_dupstr(settings, "synth.decoded-sample-cache", &defsfont->decoded_cache_dir) == FLUID_OK
+            && defsfont->decoded_cache_dir != NULL && defsfont->decoded_cache_dir[0] == 0)
+    {
+        FLUID_FREE(defsfont->decoded_cache_dir);
+        defsfont->decoded_cache_dir = NULL;
+    }
 
     return defsfont;
 }
@@ -258,6 +270,8 @@ int delete_fluid_defsfont(fluid_defsfont_t *defsfont)
         FLUID_FREE(defsfont->filename);
     }
 
+    FLUID_FREE(defsfont->decoded_cache_dir);
+
     for(list = defsfont->sample; list; list = fluid_list_next(list))
     {
         sample = (fluid_sample_t *) fluid_list_get(list);
@@ -366,6 +380,87 @@ int fluid_defsfont_load_sampledata(fluid_defsfont_t *defsfont, SFData *sfdata, f
     return FLUID_OK;
 }
 
+/* Work shared by the sample decoding threads */
+typedef struct
+{
+    fluid_defsfont_t *defsfont;
+    SFData *sfdata;
+    fluid_sample_t **samples;
+    int *results;
+    int count;
+    fluid_atomic_int_t next;    /* index of the next sample to load */
+} sample_decode_job_t;
+
+static fluid_thread_return_t decode_samples_worker(void *data)
+{
+    sample_decode_job_t *job = data;
+    int i;
+
+    while((i = fluid_atomic_int_exchange_and_add(&job->next, 1)) < job->count)
+    {
+        job->results[i] = fluid_defsfont_load_sampledata(job->defsfont, job->sfdata, job->samples[i]);
+    }
+
+    return FLUID_THREAD_RETURN_VALUE;
+}
+
+/* Loads the sample data of the given samples, storing FLUID_OK or FLUID_FAILED for each one in
+ * results. Samples are taken in order, so the ones at the start of the list become available first.
+ * Compressed samples are spread over up to synth.sample-decode-threads threads, the calling thread
+ * being one of them. The Soundfont file is only accessed under sfdata->mtx. Sanitizing the loaded
+ * samples is left to the caller. */
+static void decode_samples(fluid_defsfont_t *defsfont, SFData *sfdata, fluid_sample_t **samples,
+                           int *results, int count)
+{
+    sample_decode_job_t job;
+    fluid_thread_t *threads[64];
+    int i, num_threads = 0, compressed = 0;
+
+    job.defsfont = defsfont;
+    job.sfdata = sfdata;
+    job.samples = samples;
+    job.results = results;
+    job.count = count;
+    fluid_atomic_int_set(&job.next, 0);
+
+    for(i = 0; i < count; i++)
+    {
+        if(samples[i]->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+        {
+            compressed++;
+        }
+    }
+
+    /* Uncompressed samples are only a read, not worth a thread */
+    if(compressed > 1)
+    {
+        num_threads = defsfont->decode_threads;
+        num_threads = num_threads < compressed ? num_threads : compressed;
+        num_threads = num_threads < (int)FLUID_N_ELEMENTS(threads) ? num_threads : (int)FLUID_N_ELEMENTS(threads);
+        num_threads--;
+    }
+
+    for(i = 0; i < num_threads; i++)
+    {
+        threads[i] = new_fluid_thread("sample-decode", decode_samples_worker, &job, 0, FALSE);
+
+        if(threads[i] == NULL)
+        {
+            /* The threads that did start and this one do the work */
+            num_threads = i;
+            break;
+        }
+    }
+
+    decode_samples_worker(&job);
+
+    for(i = 0; i < num_threads; i++)
+    {
+        fluid_thread_join(threads[i]);
+        delete_fluid_thread(threads[i]);
+    }
+}
+
 /* Loads the sample data for all samples from the Soundfont file. For SF2 files, it loads the data in
  * one large block. For SF3 files, each compressed sample gets loaded individually.
  * Returns FLUID_OK on success, otherwise FLUID_FAILED
@@ -395,42 +490,60 @@ int fluid_defsfont_load_all_sampledata(fluid_defsfont_t *defsfont, SFData *sfdat
         }
     }
 
-    #pragma omp parallel
-    #pragma omp single
-    for(list = defsfont->sample; list; list = fluid_list_next(list))
+    if(sf3_file)
     {
-        sample = fluid_list_get(list);
+        /* SF3 samples get loaded individually, as most (or all) of them are in Ogg Vorbis format
+         * anyway. Decompression is the slow part and runs on several threads. */
+        int i, count = fluid_list_size(defsfont->sample);
+        fluid_sample_t **samples = FLUID_ARRAY(fluid_sample_t *, count + 1);
+        int *results = FLUID_ARRAY(int, count + 1);
+
+        if(samples == NULL || results == NULL)
+        {
+            FLUID_LOG(FLUID_ERR, "Out of memory");
+            FLUID_FREE(samples);
+            FLUID_FREE(results);
+            return FLUID_FAILED;
+        }
+
+        for(i = 0, list = defsfont->sample; list; list = fluid_list_next(list))
+        {
+            samples[i++] = fluid_list_get(list);
+        }
+
+        decode_samples(defsfont, sfdata, samples, results, count);
 
-        if(sf3_file)
+        for(i = 0; i < count; i++)
         {
-            /* SF3 samples get loaded individually, as most (or all) of them are in Ogg Vorbis format
-             * anyway */
-            #pragma omp task firstprivate(sample,sfdata,defsfont) shared(sample_parsing_result, invalid_loops_were_sanitized) default(none)
+            sample = samples[i];
+
+            if(results[i] == FLUID_FAILED)
             {
-                if(fluid_defsfont_load_sampledata(defsfont, sfdata, sample) == FLUID_FAILED)
-                {
-                    #pragma omp critical
-                    {
-                        FLUID_LOG(FLUID_ERR, "Failed to load sample '%s'", sample->name);
-                        sample_parsing_result = FLUID_FAILED;
-                    }
-                }
-                else
+                FLUID_LOG(FLUID_ERR, "Failed to load sample '%s'", sample->name);
+                sample_parsing_result = FLUID_FAILED;
+            }
+            else
+            {
+                if(fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short)))
                 {
-                    int modified = fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short));
-                    if(modified)
-                    {
-                        #pragma omp critical
-                        {
-                            invalid_loops_were_sanitized = TRUE;
-                        }
-                    }
-                    fluid_voice_optimize_sample(sample);
+                    invalid_loops_were_sanitized = TRUE;
                 }
+
+                fluid_voice_optimize_sample(sample);
             }
         }
-        else
+
+        FLUID_FREE(samples);
+        FLUID_FREE(results);
+    }
+    else
+    {
+        #pragma omp parallel
+        #pragma omp single
+        for(list = defsfont->sample; list; list = fluid_list_next(list))
         {
+            sample = fluid_list_get(list);
+
             #pragma omp task firstprivate(sample, defsfont) shared(invalid_loops_were_sanitized) default(none)
             {
                 int modified;
@@ -491,6 +604,8 @@ int fluid_defsfont_load(fluid_defsfont_t *defsfont, const fluid_file_callbacks_t
         return FLUID_FAILED;
     }
 
+    sfdata->decoded_cache_dir = defsfont->decoded_cache_dir;
+
     if(fluid_sffile_parse_presets(sfdata) == FLUID_FAILED)
     {
         FLUID_LOG(FLUID_ERR, "Couldn't parse presets from soundfont file");
@@ -610,7 +725,7 @@ int fluid_defsfont_add_preset(fluid_defsfont_t *defsfont, fluid_defpreset_t *def
         return FLUID_FAILED;
     }
 
-    if(defsfont->dynamic_samples)
+    if(defsfont->dynamic_samples || defsfont->float_samples)
     {
         preset->notify = dynamic_samples_preset_notify;
     }
@@ -2114,40 +2229,70 @@ static int dynamic_samples_sample_notify(fluid_sample_t *sample, int reason)
 }
 
 /* Called if a preset has been selected for or unselected from a channel. Used by
- * dynamic sample loading to load and unload samples on demand. */
+ * dynamic sample loading to load and unload samples on demand. Pinning a preset
+ * also builds the float copies of its samples if float samples are enabled. */
 static int dynamic_samples_preset_notify(fluid_preset_t *preset, int reason, int chan)
 {
-    fluid_defsfont_t *defsfont;
+    fluid_defsfont_t *defsfont = fluid_sfont_get_data(preset->sfont);
 
-    if(reason == FLUID_PRESET_SELECTED)
+    if(reason == FLUID_PRESET_SELECTED && defsfont->dynamic_samples)
     {
         FLUID_LOG(FLUID_DBG, "Selected preset '%s' on channel %d", fluid_preset_get_name(preset), chan);
-        defsfont = fluid_sfont_get_data(preset->sfont);
         return load_preset_samples(defsfont, preset);
     }
 
-    if(reason == FLUID_PRESET_UNSELECTED)
+    if(reason == FLUID_PRESET_UNSELECTED && defsfont->dynamic_samples)
     {
         FLUID_LOG(FLUID_DBG, "Deselected preset '%s' from channel %d", fluid_preset_get_name(preset), chan);
-        defsfont = fluid_sfont_get_data(preset->sfont);
         return unload_preset_samples(defsfont, preset);
     }
 
     if(reason == FLUID_PRESET_PIN)
     {
-        defsfont = fluid_sfont_get_data(preset->sfont);
-        return pin_preset_samples(defsfont, preset);
+        if(defsfont->dynamic_samples && pin_preset_samples(defsfont, preset) == FLUID_FAILED)
+        {
+            return FLUID_FAILED;
+        }
+
+        return defsfont->float_samples ? build_preset_float_samples(preset) : FLUID_OK;
     }
 
-    if(reason == FLUID_PRESET_UNPIN)
+    if(reason == FLUID_PRESET_UNPIN && defsfont->dynamic_samples)
     {
-        defsfont = fluid_sfont_get_data(preset->sfont);
         return unpin_preset_samples(defsfont, preset);
     }
 
     return FLUID_OK;
 }
 
+/* Builds the float copies of all samples used by the passed in preset. The copies
+ * stay until the sample gets unloaded or deleted, as voices may still use them
+ * after the preset has been unpinned. */
+static int build_preset_float_samples(fluid_preset_t *preset)
+{
+    fluid_preset_zone_t *preset_zone;
+    fluid_inst_zone_t *inst_zone;
+    fluid_sample_t *sample;
+
+    for(preset_zone = fluid_defpreset_get_zone(fluid_preset_get_data(preset)); preset_zone != NULL;
+            preset_zone = fluid_preset_zone_next(preset_zone))
+    {
+        for(inst_zone = fluid_inst_get_zone(fluid_preset_zone_get_inst(preset_zone)); inst_zone != NULL;
+                inst_zone = fluid_inst_zone_next(inst_zone))
+        {
+            sample = fluid_inst_zone_get_sample(inst_zone);
+
+            if(sample != NULL && sample->data != NULL && sample->start != sample->end
+                    && fluid_sample_build_float(sample) == FLUID_FAILED)
+            {
+                FLUID_LOG(FLUID_WARN, "No float copy of sample '%s', using the 16 bit data", sample->name);
+            }
+        }
+    }
+
+    return FLUID_OK;
+}
+
 
 static int pin_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *preset)
 {
@@ -2204,17 +2349,42 @@ static int load_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *prese
     fluid_inst_t *inst;
     fluid_inst_zone_t *inst_zone;
     fluid_sample_t *sample;
-    SFData *sffile = NULL;
+    fluid_sample_t **samples;
+    SFData *sffile;
+    int *results;
+    int i, count = 0, max_count = 0;
 
     defpreset = fluid_preset_get_data(preset);
-    preset_zone = fluid_defpreset_get_zone(defpreset);
 
-    while(preset_zone != NULL)
+    /* Upper bound for the number of samples that need loading */
+    for(preset_zone = fluid_defpreset_get_zone(defpreset); preset_zone != NULL;
+            preset_zone = fluid_preset_zone_next(preset_zone))
     {
         inst = fluid_preset_zone_get_inst(preset_zone);
-        inst_zone = fluid_inst_get_zone(inst);
 
-        while(inst_zone != NULL)
+        for(inst_zone = fluid_inst_get_zone(inst); inst_zone != NULL; inst_zone = fluid_inst_zone_next(inst_zone))
+        {
+            max_count++;
+        }
+    }
+
+    samples = FLUID_ARRAY(fluid_sample_t *, max_count + 1);
+    results = FLUID_ARRAY(int, max_count + 1);
+
+    if(samples == NULL || results == NULL)
+    {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        FLUID_FREE(samples);
+        FLUID_FREE(results);
+        return FLUID_FAILED;
+    }
+
+    for(preset_zone = fluid_defpreset_get_zone(defpreset); preset_zone != NULL;
+            preset_zone = fluid_preset_zone_next(preset_zone))
+    {
+        inst = fluid_preset_zone_get_inst(preset_zone);
+
+        for(inst_zone = fluid_inst_get_zone(inst); inst_zone != NULL; inst_zone = fluid_inst_zone_next(inst_zone))
         {
             sample = fluid_inst_zone_get_sample(inst_zone);
 
@@ -2226,44 +2396,48 @@ static int load_preset_samples(fluid_defsfont_t *defsfont, fluid_preset_t *prese
                  * load the sampledata */
                 if(sample->preset_count == 1)
                 {
-                    /* Make sure we have an open Soundfont file. Do this here
-                     * to avoid having to open the file if no loading is necessary
-                     * for a preset */
-                    if(sffile == NULL)
-                    {
-                        sffile = fluid_sffile_open(defsfont->filename, defsfont->fcbs);
-
-                        if(sffile == NULL)
-                        {
-                            FLUID_LOG(FLUID_ERR, "Unable to open Soundfont file");
-                            return FLUID_FAILED;
-                        }
-                    }
-
-                    if(fluid_defsfont_load_sampledata(defsfont, sffile, sample) == FLUID_OK)
-                    {
-                        fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short));
-                        fluid_voice_optimize_sample(sample);
-                    }
-                    else
-                    {
-                        FLUID_LOG(FLUID_ERR, "Unable to load sample '%s', disabling", sample->name);
-                        sample->start = sample->end = 0;
-                    }
+                    samples[count++] = sample;
                 }
             }
-
-            inst_zone = fluid_inst_zone_next(inst_zone);
         }
-
-        preset_zone = fluid_preset_zone_next(preset_zone);
     }
 
-    if(sffile != NULL)
+    /* Only open the Soundfont file if any loading is necessary for a preset */
+    if(count > 0)
     {
+        sffile = fluid_sffile_open(defsfont->filename, defsfont->fcbs);
+
+        if(sffile == NULL)
+        {
+            FLUID_LOG(FLUID_ERR, "Unable to open Soundfont file");
+            FLUID_FREE(samples);
+            FLUID_FREE(results);
+            return FLUID_FAILED;
+        }
+
+        sffile->decoded_cache_dir = defsfont->decoded_cache_dir;
+        decode_samples(defsfont, sffile, samples, results, count);
         fluid_sffile_close(sffile);
+
+        for(i = 0; i < count; i++)
+        {
+            sample = samples[i];
+
+            if(results[i] == FLUID_OK)
+            {
+                fluid_sample_sanitize_loop(sample, (sample->end + 1) * sizeof(short));
+                fluid_voice_optimize_sample(sample);
+            }
+            else
+            {
+                FLUID_LOG(FLUID_ERR, "Unable to load sample '%s', disabling", sample->name);
+                sample->start = sample->end = 0;
+            }
+        }
     }
 
+    FLUID_FREE(samples);
+    FLUID_FREE(results);
     return FLUID_OK;
 }
 
@@ -2324,6 +2498,8 @@ static void unload_sample(fluid_sample_t *sample)
 
     FLUID_LOG(FLUID_DBG, "Unloading sample '%s'", sample->name);
 
+    fluid_sample_free_float(sample);
+
     if(fluid_samplecache_unload(sample->data) == FLUID_FAILED)
     {
         FLUID_LOG(FLUID_ERR, "Unable to unload sample '%s'", sample->name);
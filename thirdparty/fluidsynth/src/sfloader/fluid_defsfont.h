@@ -118,6 +118,9 @@ struct _fluid_defsfont_t
     fluid_list_t *inst;        /* the instruments of this soundfont */
     int mlock;                 /* Should we try memlock (avoid swapping)? */
     int dynamic_samples;       /* Enables dynamic sample loading if set */
+    int float_samples;         /* Keep a float copy of the samples of pinned presets if set */
+    int decode_threads;        /* How many threads may decompress SF3 samples at once */
+    char *decoded_cache_dir;   /* Directory of the persistent decoded sample cache, NULL if disabled */
 
     fluid_list_t *preset_iter_cur;       /* the current preset in the iteration */
 };
@@ -434,7 +434,10 @@ int fluid_sffile_read_sample_data(SFData *sf, unsigned int sample_start, unsigne
     }
     else
     {
+        /* Samples may be loaded from several threads, see fluid_defsfont.c */
+        fluid_rec_mutex_lock(sf->mtx);
         num_samples = fluid_sffile_read_wav(sf, sample_start, sample_end, data, data24);
+        fluid_rec_mutex_unlock(sf->mtx);
     }
 
     return num_samples;
@@ -2313,15 +2316,14 @@ error_exit:
 /* Ogg Vorbis loading and decompression */
 #if LIBSNDFILE_SUPPORT
 
-/* Virtual file access routines to allow loading individually compressed
- * samples from the Soundfont sample data chunk using the file callbacks
- * passing in during opening of the file */
+/* Virtual file access routines to allow decompressing individual samples
+ * from memory. The compressed data of a sample is read from the Soundfont
+ * in one go, so that concurrent decoders only hold the file lock briefly. */
 typedef struct _sfvio_data_t
 {
-    SFData *sffile;
-    sf_count_t start;  /* start byte offset of compressed data */
-    sf_count_t end;    /* end byte offset of compressed data */
-    sf_count_t offset; /* current virtual file offset from start byte offset */
+    const char *data;  /* compressed data */
+    sf_count_t size;   /* size of compressed data */
+    sf_count_t offset; /* current virtual file offset */
 
 } sfvio_data_t;
 
@@ -2329,13 +2331,12 @@ static sf_count_t sfvio_get_filelen(void *user_data)
 {
     sfvio_data_t *data = user_data;
 
-    return (data->end + 1) - data->start;
+    return data->size;
 }
 
 static sf_count_t sfvio_seek(sf_count_t offset, int whence, void *user_data)
 {
     sfvio_data_t *data = user_data;
-    SFData *sf = data->sffile;
     sf_count_t new_offset;
 
     switch(whence)
@@ -2349,21 +2350,17 @@ static sf_count_t sfvio_seek(sf_count_t offset, int whence, void *user_data)
         break;
 
     case SEEK_END:
-        new_offset = sfvio_get_filelen(user_data) + offset;
+        new_offset = data->size + offset;
         break;
 
     default:
         goto fail; /* proper error handling not possible?? */
     }
 
-    new_offset += data->start;
-    fluid_rec_mutex_lock(sf->mtx);
-    if (data->start <= new_offset && new_offset <= data->end &&
-        sf->fcbs->fseek(sf->sffd, new_offset, SEEK_SET) != FLUID_FAILED)
+    if(0 <= new_offset && new_offset <= data->size)
     {
-        data->offset = new_offset - data->start;
+        data->offset = new_offset;
     }
-    fluid_rec_mutex_unlock(sf->mtx);
 
 fail:
     return data->offset;
@@ -2372,47 +2369,141 @@ fail:
 static sf_count_t sfvio_read(void *ptr, sf_count_t count, void *user_data)
 {
     sfvio_data_t *data = user_data;
-    SFData *sf = data->sffile;
     sf_count_t remain;
 
-    remain = sfvio_get_filelen(user_data) - data->offset;
+    remain = data->size - data->offset;
 
     if(count > remain)
     {
         count = remain;
     }
 
-    if(count == 0)
+    FLUID_MEMCPY(ptr, data->data + data->offset, count);
+    data->offset += count;
+
+    return count;
+}
+
+static sf_count_t sfvio_tell(void *user_data)
+{
+    sfvio_data_t *data = user_data;
+
+    return data->offset;
+}
+
+/* Persistent cache of decompressed samples
+ *
+ * Each entry is a file named after a hash of the compressed data, so it stays
+ * valid no matter which Soundfont the sample came from or where that file
+ * lives. The data is stored in the byte order of the machine that wrote it,
+ * the header tells byte order and size apart. */
+#define DECODED_CACHE_MAGIC "FLSF3PCM"
+#define DECODED_CACHE_BOM 0x01020304u
+
+typedef struct
+{
+    char magic[8];
+    uint32_t bom;
+    uint32_t compressed_size;
+    uint32_t frames;
+    uint32_t reserved;
+} decoded_cache_header_t;
+
+static uint64_t decoded_cache_hash(const char *data, unsigned int size)
+{
+    /* 64 bit FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ull;
+    unsigned int i;
+
+    for(i = 0; i < size; i++)
     {
-        return count;
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
     }
 
-    fluid_rec_mutex_lock(sf->mtx);
-    if (sf->fcbs->fseek(sf->sffd, data->start + data->offset, SEEK_SET) == FLUID_FAILED)
+    return hash;
+}
+
+static void decoded_cache_path(char *path, size_t len, const char *dir, uint64_t hash, unsigned int size)
+{
+    FLUID_SNPRINTF(path, len, "%s/%08x%08x-%x.pcm", dir,
+                   (unsigned int)(hash >> 32), (unsigned int)hash, size);
+}
+
+/* Returns the number of frames or -1 if there is no usable entry */
+static int decoded_cache_read(const char *dir, uint64_t hash, unsigned int size, short **data)
+{
+    char path[1024];
+    decoded_cache_header_t header;
+    short *wav_data;
+    FILE *file;
+    int result = -1;
+
+    decoded_cache_path(path, sizeof(path), dir, hash, size);
+    file = FLUID_FOPEN(path, "rb");
+
+    if(file == NULL)
     {
-        FLUID_LOG(FLUID_ERR, "This should never happen: fseek failed in sfvoid_read()");
-        count = 0;
+        return -1;
     }
-    else
+
+    if(FLUID_FREAD(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, DECODED_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.bom == DECODED_CACHE_BOM && header.compressed_size == size &&
+            header.frames > 0 && header.frames < 0x40000000u)
     {
-        if (sf->fcbs->fread(ptr, count, sf->sffd) == FLUID_FAILED)
+        wav_data = FLUID_ARRAY(short, header.frames);
+
+        if(wav_data != NULL && FLUID_FREAD(wav_data, sizeof(short), header.frames, file) == header.frames)
+        {
+            *data = wav_data;
+            result = header.frames;
+        }
+        else
         {
-            FLUID_LOG(FLUID_ERR, "Failed to read compressed sample data");
-            count = 0;
+            FLUID_FREE(wav_data);
         }
     }
-    fluid_rec_mutex_unlock(sf->mtx);
-
-    data->offset += count;
 
-    return count;
+    FLUID_FCLOSE(file);
+    return result;
 }
 
-static sf_count_t sfvio_tell(void *user_data)
+/* Failures are not errors, the sample just gets decoded again next time */
+static void decoded_cache_write(const char *dir, uint64_t hash, unsigned int size, const short *data, int frames)
 {
-    sfvio_data_t *data = user_data;
+    char path[1024], temp[1100];
+    decoded_cache_header_t header;
+    FILE *file;
+    int ok;
 
-    return data->offset;
+    decoded_cache_path(path, sizeof(path), dir, hash, size);
+
+    /* Write under a unique name and move it into place when complete, so that
+     * readers in other processes never see a partial entry */
+    FLUID_SNPRINTF(temp, sizeof(temp), "%s.%p.tmp", path, (const void *)data);
+    file = FLUID_FOPEN(temp, "wb");
+
+    if(file == NULL)
+    {
+        FLUID_LOG(FLUID_DBG, "Unable to write decoded sample cache entry '%s'", temp);
+        return;
+    }
+
+    FLUID_MEMSET(&header, 0, sizeof(header));
+    FLUID_MEMCPY(header.magic, DECODED_CACHE_MAGIC, sizeof(header.magic));
+    header.bom = DECODED_CACHE_BOM;
+    header.compressed_size = size;
+    header.frames = frames;
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(data, sizeof(short), frames, file) == (size_t)frames;
+    ok = (FLUID_FCLOSE(file) == 0) && ok;
+
+    if(!ok || rename(temp, path) != 0)
+    {
+        remove(temp);
+    }
 }
 
 int IsSndFilePresent();
@@ -2424,8 +2515,9 @@ int IsSndFilePresent();
  * Note that this function takes byte indices for start and end source data. The sample headers in SF3
  * files use byte indices, so those pointers can be passed directly to this function.
  *
- * This function uses a virtual file structure in order to read the Ogg Vorbis
- * data from arbitrary locations in the source file.
+ * The compressed data is read into memory and decoded from there through a virtual file structure.
+ * If sf->decoded_cache_dir is set, the decoded data is looked up there first and stored there after
+ * decoding.
  */
 static int fluid_sffile_read_vorbis(SFData *sf, unsigned int start_byte, unsigned int end_byte, short **data)
 {
@@ -2440,7 +2532,11 @@ static int fluid_sffile_read_vorbis(SFData *sf, unsigned int start_byte, unsigne
         sfvio_tell
     };
     sfvio_data_t sfdata;
+    char *compressed = NULL;
+    unsigned int size;
+    uint64_t hash = 0;
     short *wav_data = NULL;
+    int frames, read_ok;
 
     if (!IsSndFilePresent())
     {
@@ -2448,26 +2544,49 @@ static int fluid_sffile_read_vorbis(SFData *sf, unsigned int start_byte, unsigne
         return -1;
     }
 
-    if((start_byte > sf->samplesize) || (end_byte > sf->samplesize))
+    if((start_byte > sf->samplesize) || (end_byte > sf->samplesize) || (end_byte < start_byte))
     {
         FLUID_LOG(FLUID_ERR, "Ogg Vorbis data offsets exceed sample data chunk");
         return -1;
     }
 
-    // Initialize file position indicator and SF_INFO structure
-    sfdata.sffile = sf;
-    sfdata.start = sf->samplepos + start_byte;
-    sfdata.end = sf->samplepos + end_byte;
-    sfdata.offset = -1;
+    size = end_byte + 1 - start_byte;
+    compressed = FLUID_ARRAY(char, size);
 
-    /* Seek to sfdata.start, the beginning of Ogg Vorbis data in Soundfont */
-    sfvio_seek(0, SEEK_SET, &sfdata);
-    if (sfdata.offset != 0)
+    if(compressed == NULL)
     {
-        FLUID_LOG(FLUID_ERR, "Failed to seek to compressed sample position");
+        FLUID_LOG(FLUID_ERR, "Out of memory");
         return -1;
     }
 
+    fluid_rec_mutex_lock(sf->mtx);
+    read_ok = sf->fcbs->fseek(sf->sffd, sf->samplepos + start_byte, SEEK_SET) != FLUID_FAILED &&
+              sf->fcbs->fread(compressed, size, sf->sffd) != FLUID_FAILED;
+    fluid_rec_mutex_unlock(sf->mtx);
+
+    if(!read_ok)
+    {
+        FLUID_LOG(FLUID_ERR, "Failed to read compressed sample data");
+        FLUID_FREE(compressed);
+        return -1;
+    }
+
+    if(sf->decoded_cache_dir != NULL)
+    {
+        hash = decoded_cache_hash(compressed, size);
+        frames = decoded_cache_read(sf->decoded_cache_dir, hash, size, data);
+
+        if(frames > 0)
+        {
+            FLUID_FREE(compressed);
+            return frames;
+        }
+    }
+
+    sfdata.data = compressed;
+    sfdata.size = size;
+    sfdata.offset = 0;
+
     FLUID_MEMSET(&sfinfo, 0, sizeof(sfinfo));
 
     // Open sample as a virtual file
@@ -2476,6 +2595,7 @@ static int fluid_sffile_read_vorbis(SFData *sf, unsigned int start_byte, unsigne
     if(!sndfile)
     {
         FLUID_LOG(FLUID_ERR, "sf_open_virtual(): %s", sf_strerror(sndfile));
+        FLUID_FREE(compressed);
         return -1;
     }
 
@@ -2485,6 +2605,7 @@ static int fluid_sffile_read_vorbis(SFData *sf, unsigned int start_byte, unsigne
         FLUID_LOG(FLUID_DBG, "Empty decompressed sample");
         *data = NULL;
         sf_close(sndfile);
+        FLUID_FREE(compressed);
         return 0;
     }
 
@@ -2517,6 +2638,12 @@ static int fluid_sffile_read_vorbis(SFData *sf, unsigned int start_byte, unsigne
     }
 
     sf_close(sndfile);
+    FLUID_FREE(compressed);
+
+    if(sf->decoded_cache_dir != NULL)
+    {
+        decoded_cache_write(sf->decoded_cache_dir, hash, size, wav_data, sfinfo.frames);
+    }
 
     *data = wav_data;
 
@@ -2524,6 +2651,7 @@ static int fluid_sffile_read_vorbis(SFData *sf, unsigned int start_byte, unsigne
 
 error_exit:
     FLUID_FREE(wav_data);
+    FLUID_FREE(compressed);
     sf_close(sndfile);
     return -1;
 }
@@ -530,9 +530,112 @@ delete_fluid_sample(fluid_sample_t *sample)
         FLUID_FREE(sample->data24);
     }
 
+    fluid_sample_free_float(sample);
     FLUID_FREE(sample);
 }
 
+/* Returns the point at idx the way the voices see it, a 24 bit integer. */
+static float
+fluid_sample_get_float_point(const fluid_sample_t *sample, unsigned int idx)
+{
+    uint32_t msb = (uint32_t)sample->data[idx];
+    uint8_t lsb = sample->data24 != NULL ? (uint8_t)sample->data24[idx] : 0U;
+
+    return (float)(int32_t)((msb << 8) | lsb);
+}
+
+/*
+ * Builds the float copy of a sample's data, see float_data in _fluid_sample_t.
+ * Nothing is done if the copy already exists.
+ *
+ * @return FLUID_OK on success, FLUID_FAILED otherwise
+ */
+int
+fluid_sample_build_float(fluid_sample_t *sample)
+{
+    const unsigned int pad = FLUID_SAMPLE_FLOAT_PAD;
+    unsigned int len, looplen = 0, i;
+    float *data, *loop = NULL;
+
+    fluid_return_val_if_fail(sample != NULL, FLUID_FAILED);
+
+    if(sample->float_data != NULL)
+    {
+        return FLUID_OK;
+    }
+
+    if(sample->data == NULL || sample->start >= sample->end)
+    {
+        return FLUID_FAILED;
+    }
+
+    len = sample->end - sample->start + 1;
+
+    if(sample->loopend >= sample->loopstart + FLUID_SAMPLE_FLOAT_MIN_LOOP
+            && sample->loopstart >= sample->start && sample->loopend <= sample->end + 1)
+    {
+        looplen = sample->loopend - sample->loopstart;
+    }
+
+    data = FLUID_ARRAY(float, len + 2 * pad + (looplen ? looplen + 2 * pad : 0));
+
+    if(data == NULL)
+    {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        return FLUID_FAILED;
+    }
+
+    for(i = 0; i < pad; i++)
+    {
+        data[i] = fluid_sample_get_float_point(sample, sample->start);
+        data[pad + len + i] = fluid_sample_get_float_point(sample, sample->end);
+    }
+
+    for(i = 0; i < len; i++)
+    {
+        data[pad + i] = fluid_sample_get_float_point(sample, sample->start + i);
+    }
+
+    if(looplen)
+    {
+        /* The padding holds what the interpolation reads across the loop
+         * boundaries: the end of the loop before it, the start after it. */
+        loop = data + len + 2 * pad;
+
+        for(i = 0; i < pad; i++)
+        {
+            loop[i] = fluid_sample_get_float_point(sample, sample->loopend - pad + i);
+            loop[pad + looplen + i] = fluid_sample_get_float_point(sample, sample->loopstart + i);
+        }
+
+        for(i = 0; i < looplen; i++)
+        {
+            loop[pad + i] = fluid_sample_get_float_point(sample, sample->loopstart + i);
+        }
+    }
+
+    sample->float_loop = loop;
+    fluid_atomic_pointer_set(&sample->float_data, data);
+    return FLUID_OK;
+}
+
+/*
+ * Frees the float copy of a sample's data. The caller must make sure that no
+ * voice is playing the sample anymore.
+ */
+void
+fluid_sample_free_float(fluid_sample_t *sample)
+{
+    float *data;
+
+    fluid_return_if_fail(sample != NULL);
+
+    data = sample->float_data;
+    fluid_atomic_pointer_set(&sample->float_data, NULL);
+    sample->float_loop = NULL;
+    FLUID_FREE(data);
+}
+
 /**
  * Returns the size of the fluid_sample_t structure.
  *
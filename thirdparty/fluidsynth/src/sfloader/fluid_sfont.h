@@ -26,6 +26,14 @@
 
 int fluid_sample_validate(fluid_sample_t *sample, unsigned int max_end);
 int fluid_sample_sanitize_loop(fluid_sample_t *sample, unsigned int max_end);
+int fluid_sample_build_float(fluid_sample_t *sample);
+void fluid_sample_free_float(fluid_sample_t *sample);
+
+/* Points of padding on either side of the float sample data, enough for the
+ * 7th order interpolation. Loops shorter than FLUID_SAMPLE_FLOAT_MIN_LOOP
+ * don't get a float copy of their loop. */
+#define FLUID_SAMPLE_FLOAT_PAD 3
+#define FLUID_SAMPLE_FLOAT_MIN_LOOP 8
 
 /*
  * Utility macros to access soundfonts, presets, and samples
@@ -170,6 +178,14 @@ struct _fluid_sample_t
     short *data;                  /**< Pointer to the sample's 16 bit PCM data */
     char *data24;                 /**< If not NULL, pointer to the least significant byte counterparts of each sample data point in order to create 24 bit audio samples */
 
+    /* Optional float copy of the data from start to end, built by
+     * fluid_sample_build_float(). Each end is padded with FLUID_SAMPLE_FLOAT_PAD
+     * copies of its last point. float_loop follows in the same allocation and
+     * holds the loop, padded with the points it wraps around to. Only set with
+     * fluid_atomic_pointer_set() since voices may be playing the sample. */
+    float *float_data;
+    float *float_loop;
+
     int amplitude_that_reaches_noise_floor_is_valid;      /**< Indicates if \a amplitude_that_reaches_noise_floor is valid (TRUE), set to FALSE initially to calculate. */
     double amplitude_that_reaches_noise_floor;            /**< The amplitude at which the sample's loop will be below the noise floor.  For voice off optimization, calculated automatically. */
 
@@ -106,6 +106,7 @@ static FLUID_INLINE int16_t round_clip_to_i16(float x);
 static int fluid_synth_render_blocks(fluid_synth_t *synth, int blockcount);
 
 static fluid_voice_t *fluid_synth_free_voice_by_kill_LOCAL(fluid_synth_t *synth);
+static void fluid_synth_push_free_voice(fluid_synth_t *synth, int i);
 static void fluid_synth_kill_by_exclusive_class_LOCAL(fluid_synth_t *synth,
         fluid_voice_t *new_voice);
 static int fluid_synth_sfunload_callback(void *data, unsigned int msec);
@@ -255,6 +256,9 @@ void fluid_synth_settings(fluid_settings_t *settings)
     fluid_settings_add_option(settings, "synth.midi-bank-select", "mma");
 
     fluid_settings_register_int(settings, "synth.dynamic-sample-loading", 0, 0, 1, FLUID_HINT_TOGGLED);
+    fluid_settings_register_int(settings, "synth.sample-decode-threads", 1, 1, 64, 0);
+    fluid_settings_register_str(settings, "synth.decoded-sample-cache", "", 0);
+    fluid_settings_register_int(settings, "synth.float-samples", 0, 0, 1, FLUID_HINT_TOGGLED);
 }
 
 /**
@@ -295,6 +299,7 @@ fluid_synth_init(void)
 #endif
 
     init_dither();
+    fluid_rvoice_dsp_init();
 
     /* custom_breath2att_mod is not a default modulator specified in SF2.01.
      it is intended to replace default_vel2att_mod on demand using
@@ -932,6 +937,20 @@ new_fluid_synth(fluid_settings_t *settings)
         }
     }
 
+    synth->free_voices = FLUID_ARRAY(int, synth->nvoice);
+
+    if(synth->free_voices == NULL)
+    {
+        goto error_recovery;
+    }
+
+    synth->free_voice_count = 0;
+
+    for(i = synth->nvoice; i-- > 0;)
+    {
+        fluid_synth_push_free_voice(synth, i);
+    }
+
     /* sets a default basic channel */
     /* Sets one basic channel: basic channel 0, mode 0 (Omni On - Poly) */
     /* (i.e all channels are polyphonic) */
@@ -1174,6 +1193,8 @@ delete_fluid_synth(fluid_synth_t *synth)
         FLUID_FREE(synth->voice);
     }
 
+    FLUID_FREE(synth->free_voices);
+
 
     /* free the tunings, if any */
     if(synth->tuning != NULL)
@@ -3617,6 +3638,7 @@ static int
 fluid_synth_update_polyphony_LOCAL(fluid_synth_t *synth, int new_polyphony)
 {
     fluid_voice_t *voice;
+    int *new_free_voices;
     int i;
 
     if(new_polyphony > synth->nvoice)
@@ -3644,7 +3666,21 @@ fluid_synth_update_polyphony_LOCAL(fluid_synth_t *synth, int new_polyphony)
             fluid_voice_set_custom_filter(synth->voice[i], synth->custom_filter_type, synth->custom_filter_flags);
         }
 
+        new_free_voices = FLUID_REALLOC(synth->free_voices, sizeof(int) * new_polyphony);
+
+        if(new_free_voices == NULL)
+        {
+            return FLUID_FAILED;
+        }
+
+        synth->free_voices = new_free_voices;
+        i = synth->nvoice;
         synth->nvoice = new_polyphony;
+
+        for(; i < new_polyphony; i++)
+        {
+            fluid_synth_push_free_voice(synth, i);
+        }
     }
 
     synth->polyphony = new_polyphony;
@@ -4287,6 +4323,64 @@ fluid_synth_process_LOCAL(fluid_synth_t *synth, int len, int nfx, float *fx[],
 }
 
 
+/**
+ * Leave the reverb and chorus sends unprocessed.
+ * @param synth FluidSynth instance
+ * @param on TRUE to hand the sends to the caller, FALSE to process them internally
+ *
+ * While this is on, fluid_synth_write_float() and friends only produce the
+ * dry signal, and fluid_synth_process() returns the mono effect sends in the
+ * left channel of the reverb and chorus fx buffers. They can then be summed
+ * over several synths and run through one set of effects with
+ * fluid_synth_process_fx().
+ */
+void
+fluid_synth_set_fx_external(fluid_synth_t *synth, int on)
+{
+    fluid_return_if_fail(synth != NULL);
+    fluid_synth_api_enter(synth);
+    fluid_synth_update_mixer(synth, fluid_rvoice_mixer_set_fx_external, on != 0, 0.0f);
+    fluid_synth_api_exit(synth);
+}
+
+/**
+ * Run externally mixed effect sends through this synth's reverb and chorus.
+ * @param synth FluidSynth instance, usually one without any voices playing
+ * @param len Count of audio frames to process, must be a multiple of 64
+ * @param reverb_in Mono reverb send, may be NULL
+ * @param chorus_in Mono chorus send, may be NULL
+ * @param lout Left output, the effects output gets mixed into it
+ * @param rout Right output, the effects output gets mixed into it
+ * @return #FLUID_OK on success, #FLUID_FAILED otherwise
+ *
+ * Uses the effects settings of the first fx group, including whether
+ * reverb and chorus are enabled at all.
+ */
+int
+fluid_synth_process_fx(fluid_synth_t *synth, int len,
+                       const float *reverb_in, const float *chorus_in,
+                       float *lout, float *rout)
+{
+    int i;
+    fluid_return_val_if_fail(synth != NULL, FLUID_FAILED);
+    fluid_return_val_if_fail(len >= 0 && len % FLUID_BUFSIZE == 0, FLUID_FAILED);
+    fluid_return_val_if_fail(lout != NULL && rout != NULL, FLUID_FAILED);
+    fluid_synth_api_enter(synth);
+
+    /* pick up pending effect parameter changes, normally done by rendering */
+    fluid_rvoice_eventhandler_dispatch_all(synth->eventhandler);
+
+    for(i = 0; i < len; i += FLUID_BUFSIZE)
+    {
+        fluid_rvoice_mixer_process_external_fx(synth->eventhandler->mixer,
+                                               reverb_in ? reverb_in + i : NULL,
+                                               chorus_in ? chorus_in + i : NULL,
+                                               lout + i, rout + i);
+    }
+
+    FLUID_API_RETURN(FLUID_OK);
+}
+
 /**
  * Synthesize a block of floating point audio samples to audio buffers.
  * @param synth FluidSynth instance
@@ -4844,6 +4938,7 @@ fluid_synth_check_finished_voices(fluid_synth_t *synth)
             {
                 fluid_voice_unlock_rvoice(synth->voice[j]);
                 fluid_voice_stop(synth->voice[j]);
+                fluid_synth_push_free_voice(synth, j);
                 break;
             }
             else if(synth->voice[j]->overflow_rvoice == fv)
@@ -5042,6 +5137,16 @@ static void fluid_synth_handle_overflow(void *data, const char *name, double val
     fluid_synth_api_exit(synth);
 }
 
+/* Remembers that a voice became available, for fluid_synth_alloc_voice_LOCAL(). */
+static void
+fluid_synth_push_free_voice(fluid_synth_t *synth, int i)
+{
+    if(synth->free_voice_count < synth->nvoice)
+    {
+        synth->free_voices[synth->free_voice_count++] = i;
+    }
+}
+
 /* Selects a voice for killing. */
 static fluid_voice_t *
 fluid_synth_free_voice_by_kill_LOCAL(fluid_synth_t *synth)
@@ -5124,16 +5229,29 @@ fluid_synth_alloc_voice_LOCAL(fluid_synth_t *synth, fluid_sample_t *sample, int
     fluid_channel_t *channel = NULL;
     unsigned int ticks;
 
-    /* check if there's an available synthesis process */
-    for(i = 0; i < synth->polyphony; i++)
+    /* check if there's an available synthesis process, first among those
+       that finished, which does not depend on the polyphony. Entries that
+       are no longer available or above the polyphony are dropped, the scan
+       below still finds them once they are. */
+    while(synth->free_voice_count > 0)
     {
-        if(_AVAILABLE(synth->voice[i]))
+        i = synth->free_voices[--synth->free_voice_count];
+
+        if(i < synth->polyphony && _AVAILABLE(synth->voice[i]))
         {
             voice = synth->voice[i];
             break;
         }
     }
 
+    for(i = 0; voice == NULL && i < synth->polyphony; i++)
+    {
+        if(_AVAILABLE(synth->voice[i]))
+        {
+            voice = synth->voice[i];
+        }
+    }
+
     /* No success yet? Then stop a running voice. */
     if(voice == NULL)
     {
@@ -5785,6 +5903,58 @@ fluid_synth_get_voicelist(fluid_synth_t *synth, fluid_voice_t *buf[], int bufsiz
     fluid_synth_api_exit(synth);
 }
 
+/**
+ * Get how many voices are playing on each of the first channels, and the
+ * level of the loudest of them.
+ * @param synth FluidSynth instance
+ * @param count Number of channels to report, from channel 0
+ * @param voices Array of count entries receiving the number of voices
+ * @param levels Array of count entries receiving the volume envelope times
+ *   the attenuation of the loudest voice, as linear amplitude
+ *
+ * @note Should only be called from within synthesis thread, like
+ * fluid_synth_get_voicelist().
+ */
+void
+fluid_synth_get_channel_activity(fluid_synth_t *synth, int count, int *voices, float *levels)
+{
+    int i;
+
+    fluid_return_if_fail(synth != NULL);
+    fluid_return_if_fail(voices != NULL);
+    fluid_return_if_fail(levels != NULL);
+    fluid_synth_api_enter(synth);
+
+    FLUID_MEMSET(voices, 0, count * sizeof(int));
+    FLUID_MEMSET(levels, 0, count * sizeof(float));
+
+    for(i = 0; i < synth->polyphony; i++)
+    {
+        fluid_voice_t *voice = synth->voice[i];
+        fluid_real_t level;
+
+        if(!fluid_voice_is_playing(voice) || voice->chan >= count)
+        {
+            continue;
+        }
+
+        voices[voice->chan]++;
+        level = fluid_cb2amp(voice->attenuation);
+
+        if(voice->can_access_rvoice)
+        {
+            level *= fluid_adsr_env_get_val(&voice->rvoice->envlfo.volenv);
+        }
+
+        if(level > levels[voice->chan])
+        {
+            levels[voice->chan] = (float)level;
+        }
+    }
+
+    fluid_synth_api_exit(synth);
+}
+
 /**
  * Enable or disable reverb effect.
  * @param synth FluidSynth instance
@@ -133,6 +133,8 @@ struct _fluid_synth_t
     fluid_channel_t **channel;         /**< the channels */
     int nvoice;                        /**< the length of the synthesis process array (max polyphony allowed) */
     fluid_voice_t **voice;             /**< the synthesis voices */
+    int *free_voices;                  /**< indices of voices that became available, a stack of nvoice entries at most */
+    int free_voice_count;
     int active_voice_count;            /**< count of active voices */
     unsigned int noteid;               /**< the id is incremented for every new note. it's used for noteoff's  */
     unsigned int storeid;
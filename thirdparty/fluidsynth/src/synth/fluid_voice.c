@@ -243,6 +243,7 @@ new_fluid_voice(fluid_rvoice_eventhandler_t *handler, fluid_real_t output_rate)
     voice->eventhandler = handler;
     voice->channel = NULL;
     voice->sample = NULL;
+    voice->mod_deps_valid = 0;
     voice->overflow_sample = NULL;
     voice->output_rate = output_rate;
 
@@ -319,6 +320,7 @@ fluid_voice_init(fluid_voice_t *voice, fluid_sample_t *sample,
     voice->vel = (unsigned char) vel;
     voice->channel = channel;
     voice->mod_count = 0;
+    voice->mod_deps_valid = 0;
     voice->start_time = start_time;
     voice->has_noteoff = 0;
     UPDATE_RVOICE0(fluid_rvoice_reset);
@@ -1195,6 +1197,54 @@ fluid_voice_update_param(fluid_voice_t *voice, int gen)
 #define is_gen_updated(bit,gen)  (bit[gen >> NBR_BIT_BY_VAR_LN2] &  (1 << (gen & NBR_BIT_BY_VAR_ANDMASK)))
 #define set_gen_updated(bit,gen) (bit[gen >> NBR_BIT_BY_VAR_LN2] |= (1 << (gen & NBR_BIT_BY_VAR_ANDMASK)))
 
+/* Registers a modulator source in the dependency table. */
+static void fluid_voice_add_mod_source(fluid_voice_t *voice, unsigned char src, unsigned char flags)
+{
+    uint32_t *bits = (flags & FLUID_MOD_CC) ? voice->mod_src_cc : voice->mod_src_gc;
+    src &= 127;
+    bits[src >> 5] |= 1u << (src & 31);
+}
+
+/*
+ * Builds the tables that let fluid_voice_modulate() skip the controllers
+ * no modulator uses, and find the modulators of a generator without
+ * checking all of them.
+ */
+static void fluid_voice_build_mod_deps(fluid_voice_t *voice)
+{
+    unsigned char last[GEN_LAST];
+    int i;
+
+    FLUID_MEMSET(voice->mod_src_cc, 0, sizeof(voice->mod_src_cc));
+    FLUID_MEMSET(voice->mod_src_gc, 0, sizeof(voice->mod_src_gc));
+    FLUID_MEMSET(last, FLUID_NUM_MOD, sizeof(last));
+
+    for(i = 0; i < voice->mod_count; i++)
+    {
+        fluid_mod_t *mod = &voice->mod[i];
+        int gen = fluid_mod_get_dest(mod);
+
+        fluid_voice_add_mod_source(voice, mod->src1, mod->flags1);
+        fluid_voice_add_mod_source(voice, mod->src2, mod->flags2);
+
+        voice->mod_dest_next[i] = FLUID_NUM_MOD;
+
+        if(last[gen] < FLUID_NUM_MOD)
+        {
+            voice->mod_dest_first[i] = voice->mod_dest_first[last[gen]];
+            voice->mod_dest_next[last[gen]] = i;
+        }
+        else
+        {
+            voice->mod_dest_first[i] = i;
+        }
+
+        last[gen] = i;
+    }
+
+    voice->mod_deps_valid = 1;
+}
+
 int fluid_voice_modulate(fluid_voice_t *voice, int cc, int ctrl)
 {
     int i, k;
@@ -1207,6 +1257,22 @@ int fluid_voice_modulate(fluid_voice_t *voice, int cc, int ctrl)
 
     /*    printf("Chan=%d, CC=%d, Src=%d, Val=%d\n", voice->channel->channum, cc, ctrl, val); */
 
+    if(!voice->mod_deps_valid)
+    {
+        fluid_voice_build_mod_deps(voice);
+    }
+
+    /* Nothing to do for a controller that no modulator uses. */
+    if(ctrl >= 0 && ctrl < 128)
+    {
+        const uint32_t *bits = cc ? voice->mod_src_cc : voice->mod_src_gc;
+
+        if(!(bits[ctrl >> 5] & (1u << (ctrl & 31))))
+        {
+            return FLUID_OK;
+        }
+    }
+
     for(i = 0; i < voice->mod_count; i++)
     {
         mod = &voice->mod[i];
@@ -1225,12 +1291,9 @@ int fluid_voice_modulate(fluid_voice_t *voice, int cc, int ctrl)
 
                 /* step 2: for every attached modulator, calculate the modulation
                  * value for the generator gen */
-                for(k = 0; k < voice->mod_count; k++)
+                for(k = voice->mod_dest_first[i]; k < FLUID_NUM_MOD; k = voice->mod_dest_next[k])
                 {
-                    if(fluid_mod_has_dest(&voice->mod[k], gen))
-                    {
-                        modval += fluid_mod_get_value(&voice->mod[k], voice);
-                    }
+                    modval += fluid_mod_get_value(&voice->mod[k], voice);
                 }
 
                 fluid_gen_set_mod(&voice->gen[gen], modval);
@@ -1554,6 +1617,7 @@ fluid_voice_add_mod_local(fluid_voice_t *voice, fluid_mod_t *mod, int mode, int
     if(voice->mod_count < FLUID_NUM_MOD)
     {
         fluid_mod_clone(&voice->mod[voice->mod_count++], mod);
+        voice->mod_deps_valid = 0;
     }
     else
     {
@@ -77,6 +77,14 @@ struct _fluid_voice_t
     unsigned int start_time;
     int mod_count;
     fluid_mod_t mod[FLUID_NUM_MOD];
+
+    /* Which modulators depend on what, for fluid_voice_modulate(). Built
+       again by it after modulators have been added. */
+    char mod_deps_valid;
+    uint32_t mod_src_cc[4];                      /* a bit for every CC that is a source of any modulator */
+    uint32_t mod_src_gc[4];                      /* the same for the general controllers */
+    unsigned char mod_dest_first[FLUID_NUM_MOD]; /* the first modulator with the same destination */
+    unsigned char mod_dest_next[FLUID_NUM_MOD];  /* the next one with the same destination, FLUID_NUM_MOD after the last */
     fluid_gen_t gen[GEN_LAST];
 
     /* basic parameters */
@@ -50,11 +50,21 @@
 #define FLUID_SYS_TIMER_HIGH_PRIO_LEVEL         10
 
 
+/* ZMusic lets its client set up every thread, see ZMusicCallbacks::ThreadStart.
+ * The roles are those of EZMusicThreadRole. */
+#define FLUID_ZMUSIC_THREAD_SYNTH   2
+#define FLUID_ZMUSIC_THREAD_LOADER  5
+
+void ZMusic_ThreadBegin(int role, const char *name);
+void ZMusic_ThreadEnd(int role);
+
 typedef struct
 {
     fluid_thread_func_t func;
     void *data;
     int prio_level;
+    int role;
+    char name[32];
 } fluid_thread_info_t;
 
 struct _fluid_timer_t
@@ -1013,13 +1023,16 @@ new_fluid_cond(void)
 #endif
 
 static gpointer
-fluid_thread_high_prio(gpointer data)
+fluid_thread_start(gpointer data)
 {
     fluid_thread_info_t *info = data;
 
     fluid_thread_self_set_prio(info->prio_level);
+    ZMusic_ThreadBegin(info->role, info->name);
 
     info->func(info->data);
+
+    ZMusic_ThreadEnd(info->role);
     FLUID_FREE(info);
 
     return NULL;
@@ -1055,34 +1068,27 @@ new_fluid_thread(const char *name, fluid_thread_func_t func, void *data, int pri
 
 #endif
 
-    if(prio_level > 0)
-    {
-        info = FLUID_NEW(fluid_thread_info_t);
-
-        if(!info)
-        {
-            FLUID_LOG(FLUID_ERR, "Out of memory");
-            return NULL;
-        }
+    /* Every thread goes through fluid_thread_start, so that ZMusic's client gets to set it up. */
+    info = FLUID_NEW(fluid_thread_info_t);
 
-        info->func = func;
-        info->data = data;
-        info->prio_level = prio_level;
-#if NEW_GLIB_THREAD_API
-        thread = g_thread_try_new(name, fluid_thread_high_prio, info, &err);
-#else
-        thread = g_thread_create(fluid_thread_high_prio, info, detach == FALSE, &err);
-#endif
+    if(!info)
+    {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        return NULL;
     }
 
-    else
-    {
+    info->func = func;
+    info->data = data;
+    info->prio_level = prio_level;
+    /* The mixer threads render what the audio callback waits for, the others load sound fonts. */
+    info->role = FLUID_STRNCMP(name, "mixer", 5) == 0 ? FLUID_ZMUSIC_THREAD_SYNTH : FLUID_ZMUSIC_THREAD_LOADER;
+    FLUID_SNPRINTF(info->name, sizeof(info->name), "FluidSynth %s", name);
+
 #if NEW_GLIB_THREAD_API
-        thread = g_thread_try_new(name, (GThreadFunc)func, data, &err);
+    thread = g_thread_try_new(name, fluid_thread_start, info, &err);
 #else
-        thread = g_thread_create((GThreadFunc)func, data, detach == FALSE, &err);
+    thread = g_thread_create(fluid_thread_start, info, detach == FALSE, &err);
 #endif
-    }
 
     if(!thread)
     {
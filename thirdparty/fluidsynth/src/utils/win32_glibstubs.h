@@ -135,6 +135,8 @@ typedef DWORD GStaticPrivate;
 #define g_atomic_int_dec_and_test(_pi) (InterlockedDecrement(_pi) == 0)
 #define g_atomic_int_compare_and_exchange(_pi, _old, _new) (InterlockedCompareExchange(_pi, _new, _old) == _old)
 #define g_atomic_int_exchange_and_add(_pi, _add) InterlockedExchangeAdd(_pi, _add)
+#define g_atomic_pointer_get(_pp) (MemoryBarrier(), *(_pp))
+#define g_atomic_pointer_set(_pp, _val) do { MemoryBarrier(); *(_pp) = (_val); } while (0)
 
 #endif
 
@@ -59,6 +59,7 @@ int const C01 = 0x01;
 Ay_Cpu::Ay_Cpu()
 {
 	state = &state_;
+	idle_skip_ = true;
 	for ( int i = 0x100; --i >= 0; )
 	{
 		int even = 1;
@@ -268,6 +269,14 @@ possibly_out_of_time:
 #define EVEN    (flags & P04)
 #define MINUS   (flags & S80)
 
+// A jump to itself changes nothing but the time, so skip to the first pass
+// that would start at or after the end time
+#define IDLE_LOOP( clocks )\
+{\
+	if ( s_time < 0 && idle_skip_ )\
+		s_time += (-s_time + (clocks) - 1) / (clocks) * (clocks);\
+}
+
 // JR
 #define JR( cond ) {\
 	int disp = (int8_t) data;\
@@ -275,6 +284,8 @@ possibly_out_of_time:
 	if ( !(cond) )\
 		goto jr_not_taken;\
 	pc += disp;\
+	if ( disp == -2 && opcode != 0x10 ) /* not DJNZ */\
+		IDLE_LOOP( base_timing [opcode] );\
 	goto loop;\
 }
 	
@@ -303,6 +314,8 @@ possibly_out_of_time:
 	case 0xFA: JP(  MINUS ) // JP M,addr
 	
 	case 0xC3: // JP addr
+		if ( GET_ADDR() == uint16_t (pc - 1) )
+			IDLE_LOOP( base_timing [opcode] );
 		pc = GET_ADDR();
 		goto loop;
 	
@@ -28,6 +28,10 @@ public:
 	void set_time( cpu_time_t t )       { state->time = t - state->base; }
 	void adjust_time( int delta )       { state->time += delta; }
 	
+	// Pass over the remaining time of a jump to itself at once, stopping at
+	// the same instruction boundary running it would have
+	void enable_idle_skip( bool b = true )  { idle_skip_ = b; }
+	
 	#if BLARGG_BIG_ENDIAN
 		struct regs_t { uint8_t b, c, d, e, h, l, flags, a; };
 	#else
@@ -68,6 +72,7 @@ private:
 	uint8_t szpc [0x200];
 	uint8_t* mem;
 	cpu_time_t end_time_;
+	bool idle_skip_;
 	struct state_t {
 		cpu_time_t base;
 		cpu_time_t time;
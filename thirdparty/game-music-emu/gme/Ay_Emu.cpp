@@ -157,6 +157,12 @@ void Ay_Emu::set_tempo_( double t )
 	play_period = blip_time_t (clock_rate() / 50 / t);
 }
 
+void Ay_Emu::enable_accuracy_( bool b )
+{
+	Classic_Emu::enable_accuracy_( b );
+	cpu::enable_idle_skip( !b );
+}
+
 blargg_err_t Ay_Emu::start_track_( int track )
 {
 	RETURN_ERR( Classic_Emu::start_track_( track ) );
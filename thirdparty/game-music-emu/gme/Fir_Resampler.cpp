@@ -184,6 +184,23 @@ int Fir_Resampler_::avail_( blargg_long input_count ) const
 	return output_count;
 }
 
+void Fir_Resampler_::save_state( unsigned char* out ) const
+{
+	int const pos [2] = { imp_phase, (int) (write_pos - buf.begin()) };
+	memcpy( out, pos, sizeof pos );
+	memcpy( out + sizeof pos, buf.begin(), pos [1] * sizeof (sample_t) );
+}
+
+void Fir_Resampler_::load_state( unsigned char const* in )
+{
+	int pos [2];
+	memcpy( pos, in, sizeof pos );
+	assert( (unsigned) pos [1] <= buf.size() );
+	imp_phase = pos [0];
+	write_pos = buf.begin() + pos [1];
+	memcpy( buf.begin(), in + sizeof pos, pos [1] * sizeof (sample_t) );
+}
+
 int Fir_Resampler_::skip_input( long count )
 {
 	int remain = write_pos - buf.begin();
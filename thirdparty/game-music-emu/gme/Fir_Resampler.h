@@ -7,6 +7,14 @@
 #include "blargg_common.h"
 #include <string.h>
 
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define FIR_RESAMPLER_SSE2 1
+	#include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__) || defined (_M_ARM64)
+	#define FIR_RESAMPLER_NEON 1
+	#include <arm_neon.h>
+#endif
+
 class Fir_Resampler_ {
 public:
 	
@@ -53,6 +61,16 @@ public:
 	// Number of output samples available
 	int avail() const { return avail_( write_pos - &buf [width_ * stereo] ); }
 	
+// State
+	
+	// Number of bytes save_state() writes
+	long state_size() const { return 2 * sizeof (int) + buf.size() * sizeof (sample_t); }
+	
+	// Save/restore buffered input and phase. Restoring requires the same
+	// buffer size and ratio as when the state was saved.
+	void save_state( unsigned char* out ) const;
+	void load_state( unsigned char const* in );
+	
 public:
 	~Fir_Resampler_();
 protected:
@@ -124,7 +142,50 @@ int Fir_Resampler<width>::read( sample_t* out_begin, blargg_long count )
 			if ( count < 0 )
 				break;
 			
+			// The vector sums wrap the same way as the scalar ones, so the
+			// result is identical.
+		#if FIR_RESAMPLER_SSE2
+			{
+				__m128i sum = _mm_setzero_si128();
+				for ( int n = width / 4; n; --n )
+				{
+					// L0 R0 L1 R1 L2 R2 L3 R3 -> L0 L1 R0 R1 L2 L3 R2 R3
+					__m128i s = _mm_loadu_si128( (__m128i const*) i );
+					s = _mm_shufflehi_epi16( _mm_shufflelo_epi16( s, 0xD8 ), 0xD8 );
+					// c0 c1 c0 c1 c2 c3 c2 c3
+					__m128i c = _mm_loadl_epi64( (__m128i const*) imp );
+					c = _mm_unpacklo_epi32( c, c );
+					sum = _mm_add_epi32( sum, _mm_madd_epi16( s, c ) );
+					imp += 4;
+					i += 8;
+				}
+				sum = _mm_add_epi32( sum, _mm_unpackhi_epi64( sum, sum ) );
+				l = _mm_cvtsi128_si32( sum );
+				r = _mm_cvtsi128_si32( _mm_srli_si128( sum, 4 ) );
+			}
+			for ( int n = width % 4 / 2; n; --n )
+		#elif FIR_RESAMPLER_NEON
+			{
+				int32x4_t suml = vdupq_n_s32( 0 );
+				int32x4_t sumr = vdupq_n_s32( 0 );
+				for ( int n = width / 4; n; --n )
+				{
+					int16x4x2_t s = vld2_s16( i );
+					int16x4_t c = vld1_s16( imp );
+					suml = vmlal_s16( suml, s.val [0], c );
+					sumr = vmlal_s16( sumr, s.val [1], c );
+					imp += 4;
+					i += 8;
+				}
+				int32x2_t h = vpadd_s32( vadd_s32( vget_low_s32( suml ), vget_high_s32( suml ) ),
+						vadd_s32( vget_low_s32( sumr ), vget_high_s32( sumr ) ) );
+				l = vget_lane_s32( h, 0 );
+				r = vget_lane_s32( h, 1 );
+			}
+			for ( int n = width % 4 / 2; n; --n )
+		#else
 			for ( int n = width / 2; n; --n )
+		#endif
 			{
 				int pt0 = imp [0];
 				l += pt0 * i [0];
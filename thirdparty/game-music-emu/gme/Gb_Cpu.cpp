@@ -156,6 +156,13 @@ loop:
 	switch ( op )
 	{
 
+// A jump to itself changes nothing, so only its last pass needs to be run
+#define IDLE_LOOP()\
+{\
+	if ( idle_skip_ && s.remain > 1 )\
+		s.remain = 1;\
+}
+
 // TODO: more efficient way to handle negative branch that wraps PC around
 #define BRANCH( cond )\
 {\
@@ -163,6 +170,8 @@ loop:
 	int offset = (int8_t) data;\
 	if ( !(cond) ) goto loop;\
 	pc = uint16_t (pc + offset);\
+	if ( offset == -2 )\
+		IDLE_LOOP();\
 	goto loop;\
 }
 
@@ -969,6 +978,8 @@ loop:
 		goto loop;
 
 	case 0xC3: // JP (next-most-common)
+		if ( GET_ADDR() == pc - 1 )
+			IDLE_LOOP();
 		pc = GET_ADDR();
 		goto loop;
 	
@@ -60,8 +60,12 @@ public:
 	// Can read this many bytes past end of a page
 	enum { cpu_padding = 8 };
 	
+	// Pass over the remaining instructions of a jump to itself at once,
+	// stopping at the same point running it would have
+	void enable_idle_skip( bool b = true )  { idle_skip_ = b; }
+	
 public:
-	Gb_Cpu() : rst_base( 0 ) { state = &state_; }
+	Gb_Cpu() : rst_base( 0 ), idle_skip_( true ) { state = &state_; }
 	enum { page_shift = 13 };
 	enum { page_count = 0x10000 >> page_shift };
 private:
@@ -75,6 +79,7 @@ private:
 	};
 	state_t* state; // points to state_ or a local copy within run()
 	state_t state_;
+	bool idle_skip_;
 	
 	void set_code_page( int, uint8_t* );
 };
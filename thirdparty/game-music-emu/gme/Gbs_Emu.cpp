@@ -200,6 +200,12 @@ void Gbs_Emu::set_tempo_( double t )
 	update_timer();
 }
 
+void Gbs_Emu::enable_accuracy_( bool b )
+{
+	Classic_Emu::enable_accuracy_( b );
+	cpu::enable_idle_skip( !b );
+}
+
 blargg_err_t Gbs_Emu::start_track_( int track )
 {
 	RETURN_ERR( Classic_Emu::start_track_( track ) );
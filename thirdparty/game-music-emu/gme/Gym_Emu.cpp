@@ -29,6 +29,7 @@ Gym_Emu::Gym_Emu()
 {
 	data = 0;
 	pos  = 0;
+	native_fm_rate = false;
 	set_type( gme_gym_type );
 	
 	static const char* const names [] = {
@@ -173,7 +174,8 @@ blargg_err_t Gym_Emu::set_sample_rate_( long sample_rate )
 	dac_synth.treble_eq( eq );
 	apu.volume( 0.135 * fm_gain * gain() );
 	dac_synth.volume( 0.125 / 256 * fm_gain * gain() );
-	double factor = Dual_Resampler::setup( oversample_factor, 0.990, fm_gain * gain() );
+	double oversample = native_fm_rate ? base_clock / 7.0 / 144 / sample_rate : oversample_factor;
+	double factor = Dual_Resampler::setup( oversample, 0.990, fm_gain * gain() );
 	fm_sample_rate = sample_rate * factor;
 	
 	RETURN_ERR( blip_buf.set_sample_rate( sample_rate, int (1000 / 60.0 / min_tempo) ) );
@@ -185,6 +187,17 @@ blargg_err_t Gym_Emu::set_sample_rate_( long sample_rate )
 	return 0;
 }
 
+blargg_err_t Gym_Emu::set_fm_options_( int ym2612_core, bool native_rate )
+{
+	fm.set_core( ym2612_core );
+	native_fm_rate = native_rate;
+	
+	// the FM chip is set up along with the sample rate
+	if ( sample_rate() )
+		return set_sample_rate_( sample_rate() );
+	return 0;
+}
+
 void Gym_Emu::set_tempo_( double t )
 {
 	if ( t < min_tempo )
@@ -47,6 +47,7 @@ protected:
 	blargg_err_t load_mem_( byte const*, long );
 	blargg_err_t track_info_( track_info_t*, int track ) const;
 	blargg_err_t set_sample_rate_( long sample_rate );
+	blargg_err_t set_fm_options_( int ym2612_core, bool native_rate );
 	blargg_err_t start_track_( int );
 	blargg_err_t play_( long count, sample_t* );
 	void mute_voices_( int );
@@ -61,6 +62,7 @@ private:
 	blargg_long loop_remain; // frames remaining until loop beginning has been located
 	header_t header_;
 	double fm_sample_rate;
+	bool native_fm_rate;
 	blargg_long clocks_per_frame;
 	void parse_frame();
 	
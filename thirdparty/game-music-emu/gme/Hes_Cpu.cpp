@@ -219,6 +219,14 @@ possibly_out_of_time:
 //#define PAGE_CROSS_PENALTY( lsb ) (void) (s_time += (lsb) >> 8)
 #define PAGE_CROSS_PENALTY( lsb )
 
+// A branch or jump to itself changes nothing but the time, so skip to the
+// first pass that would start at or after the end time
+#define IDLE_LOOP( clocks )\
+{\
+	if ( s_time < 0 && idle_skip_ )\
+		s_time += (-s_time + (clocks) - 1) / (clocks) * (clocks);\
+}
+
 // Branch
 
 // TODO: more efficient way to handle negative branch that wraps PC around
@@ -228,6 +236,8 @@ possibly_out_of_time:
 	pc++;\
 	if ( !(cond) ) goto branch_not_taken;\
 	pc = uint16_t (pc + offset);\
+	if ( offset == -2 && !(opcode & 0x0F) ) /* not BSR, BBR or BBS */\
+		IDLE_LOOP( clock_table [opcode] );\
 	goto loop;\
 }
 
@@ -285,6 +295,8 @@ possibly_out_of_time:
 	}
 
 	case 0x4C: // JMP abs
+		if ( GET_ADDR() == uint16_t (pc - 1) )
+			IDLE_LOOP( clock_table [opcode] );
 		pc = GET_ADDR();
 		goto loop;
 
@@ -62,8 +62,12 @@ public:
 	// Can read this many bytes past end of a page
 	enum { cpu_padding = 8 };
 	
+	// Pass over the remaining time of a branch or jump to itself at once,
+	// stopping at the same instruction boundary running it would have
+	void enable_idle_skip( bool b = true )  { idle_skip_ = b; }
+	
 public:
-	Hes_Cpu() { state = &state_; }
+	Hes_Cpu() { state = &state_; idle_skip_ = true; }
 	enum { irq_inhibit = 0x04 };
 private:
 	// noncopyable
@@ -79,6 +83,7 @@ private:
 	state_t state_;
 	hes_time_t irq_time_;
 	hes_time_t end_time_;
+	bool idle_skip_;
 	
 	void set_code_page( int, void const* );
 	inline int update_end_time( hes_time_t end, hes_time_t irq );
@@ -212,6 +212,12 @@ void Hes_Emu::set_tempo_( double t )
 	recalc_timer_load();
 }
 
+void Hes_Emu::enable_accuracy_( bool b )
+{
+	Classic_Emu::enable_accuracy_( b );
+	cpu::enable_idle_skip( !b );
+}
+
 blargg_err_t Hes_Emu::start_track_( int track )
 {
 	RETURN_ERR( Classic_Emu::start_track_( track ) );
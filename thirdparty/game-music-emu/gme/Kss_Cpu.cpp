@@ -62,6 +62,7 @@ int const C01 = 0x01;
 Kss_Cpu::Kss_Cpu()
 {
 	state = &state_;
+	idle_skip_ = true;
 	
 	for ( int i = 0x100; --i >= 0; )
 	{
@@ -305,6 +306,14 @@ possibly_out_of_time:
 #define EVEN    (flags & P04)
 #define MINUS   (flags & S80)
 
+// A jump to itself changes nothing but the time, so skip to the first pass
+// that would start at or after the end time
+#define IDLE_LOOP( clocks )\
+{\
+	if ( s_time < 0 && idle_skip_ )\
+		s_time += (-s_time + (clocks) - 1) / (clocks) * (clocks);\
+}
+
 // JR
 // TODO: more efficient way to handle negative branch that wraps PC around
 #define JR( cond ) {\
@@ -313,6 +322,8 @@ possibly_out_of_time:
 	if ( !(cond) )\
 		goto jr_not_taken;\
 	pc = uint16_t (pc + offset);\
+	if ( offset == -2 && opcode != 0x10 ) /* not DJNZ */\
+		IDLE_LOOP( base_timing [opcode] );\
 	goto loop;\
 }
 	
@@ -341,6 +352,8 @@ possibly_out_of_time:
 	case 0xFA: JP(  MINUS ) // JP M,addr
 	
 	case 0xC3: // JP addr
+		if ( GET_ADDR() == uint16_t (pc - 1) )
+			IDLE_LOOP( base_timing [opcode] );
 		pc = GET_ADDR();
 		goto loop;
 	
@@ -37,6 +37,10 @@ public:
 	void set_time( cpu_time_t t )       { state->time = t - state->base; }
 	void adjust_time( int delta )       { state->time += delta; }
 	
+	// Pass over the remaining time of a jump to itself at once, stopping at
+	// the same instruction boundary running it would have
+	void enable_idle_skip( bool b = true )  { idle_skip_ = b; }
+	
 	#if BLARGG_BIG_ENDIAN
 		struct regs_t { uint8_t b, c, d, e, h, l, flags, a; };
 	#else
@@ -80,6 +84,7 @@ public:
 private:
 	uint8_t szpc [0x200];
 	cpu_time_t end_time_;
+	bool idle_skip_;
 	struct state_t {
 		uint8_t const* read  [page_count + 1];
 		uint8_t      * write [page_count + 1];
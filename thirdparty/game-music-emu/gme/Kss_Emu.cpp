@@ -191,6 +191,12 @@ void Kss_Emu::set_tempo_( double t )
 	play_period = blip_time_t (period / t);
 }
 
+void Kss_Emu::enable_accuracy_( bool b )
+{
+	Classic_Emu::enable_accuracy_( b );
+	cpu::enable_idle_skip( !b );
+}
+
 blargg_err_t Kss_Emu::start_track_( int track )
 {
 	RETURN_ERR( Classic_Emu::start_track_( track ) );
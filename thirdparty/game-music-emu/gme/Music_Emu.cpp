@@ -232,6 +232,58 @@ blargg_err_t Music_Emu::seek( long msec )
 	return seek_samples( msec_to_samples( msec ) );
 }
 
+// State
+
+long Music_Emu::state_size() const
+{
+	long size = state_size_();
+	return size ? sizeof (track_state_t) + buf_size * sizeof (sample_t) + size : 0;
+}
+
+void Music_Emu::save_state( void* out ) const
+{
+	require( state_size() ); // emulator must support states
+	require( current_track() >= 0 );
+	
+	track_state_t t;
+	t.out_time        = out_time;
+	t.emu_time        = emu_time;
+	t.emu_track_ended = emu_track_ended_;
+	t.track_ended     = track_ended_;
+	t.silence_time    = silence_time;
+	t.silence_count   = silence_count;
+	t.buf_remain      = buf_remain;
+	
+	unsigned char* p = (unsigned char*) out;
+	memcpy( p, &t, sizeof t );
+	p += sizeof t;
+	memcpy( p, buf.begin(), buf_size * sizeof (sample_t) );
+	p += buf_size * sizeof (sample_t);
+	save_state_( p );
+}
+
+void Music_Emu::load_state( void const* in )
+{
+	require( state_size() );
+	require( current_track() >= 0 );
+	
+	track_state_t t;
+	unsigned char const* p = (unsigned char const*) in;
+	memcpy( &t, p, sizeof t );
+	p += sizeof t;
+	memcpy( buf.begin(), p, buf_size * sizeof (sample_t) );
+	p += buf_size * sizeof (sample_t);
+	load_state_( p );
+	
+	out_time         = t.out_time;
+	emu_time         = t.emu_time;
+	emu_track_ended_ = t.emu_track_ended;
+	track_ended_     = t.track_ended;
+	silence_time     = t.silence_time;
+	silence_count    = t.silence_count;
+	buf_remain       = t.buf_remain;
+}
+
 blargg_err_t Music_Emu::skip( long count )
 {
 	require( current_track() >= 0 ); // start_track() must have been called already
@@ -77,6 +77,15 @@ public:
 	// Disable automatic end-of-track detection and skipping of silence at beginning
 	void ignore_silence( bool disable = true );
 	
+	// Number of bytes save_state() writes, or 0 if this emulator can't save its state
+	long state_size() const;
+	
+	// Save complete state of current track, to return to it later with load_state().
+	// A state can only be loaded into the emulator that saved it, playing the same
+	// track with the same settings.
+	void save_state( void* out ) const;
+	void load_state( void const* in );
+	
 	// Info for current track
 	using Gme_File::track_info;
 	blargg_err_t track_info( track_info_t* out ) const;
@@ -106,6 +115,11 @@ public:
 	// equalizer settings.
 	void enable_accuracy( bool enable = true );
 	
+	// Select the YM2612 core of VGM and GYM files, one of the gme_ym2612_* values
+	// in gme.h, and whether their FM chips run at the chip's own rate instead of
+	// above the output rate. See gme_set_fm_options().
+	blargg_err_t set_fm_options( int ym2612_core, bool native_rate );
+	
 // Sound equalization (treble/bass)
 
 	// Frequency equalizer parameters (see gme.txt)
@@ -146,11 +160,15 @@ protected:
 	virtual blargg_err_t set_sample_rate_( long sample_rate ) = 0;
 	virtual void set_equalizer_( equalizer_t const& ) { }
 	virtual void enable_accuracy_( bool /* enable */ ) { }
+	virtual blargg_err_t set_fm_options_( int /* ym2612_core */, bool /* native_rate */ ) { return 0; }
 	virtual void mute_voices_( int mask ) = 0;
 	virtual void set_tempo_( double ) = 0;
 	virtual blargg_err_t start_track_( int ) = 0; // tempo is set before this
 	virtual blargg_err_t play_( long count, sample_t* out ) = 0;
 	virtual blargg_err_t skip_( long count );
+	virtual long state_size_() const { return 0; }
+	virtual void save_state_( unsigned char* ) const { }
+	virtual void load_state_( unsigned char const* ) { }
 protected:
 	virtual void unload();
 	virtual void pre_load();
@@ -198,6 +216,17 @@ private:
 	void fill_buf();
 	void emu_play( long count, sample_t* out );
 	
+	struct track_state_t
+	{
+		blargg_long out_time;
+		blargg_long emu_time;
+		bool emu_track_ended;
+		bool track_ended;
+		long silence_time;
+		long silence_count;
+		long buf_remain;
+	};
+	
 	Multi_Buffer* effects_buffer;
 	friend Music_Emu* gme_internal_new_emu_( gme_type_t, int, bool );
 	friend void gme_set_stereo_depth( Music_Emu*, double );
@@ -230,6 +259,7 @@ inline bool Music_Emu::track_ended() const          { return track_ended_; }
 inline const Music_Emu::equalizer_t& Music_Emu::equalizer() const { return equalizer_; }
 
 inline void Music_Emu::enable_accuracy( bool b )    { enable_accuracy_( b ); }
+inline blargg_err_t Music_Emu::set_fm_options( int core, bool native ) { return set_fm_options_( core, native ); }
 inline void Music_Emu::set_tempo_( double t )       { tempo_ = t; }
 inline void Music_Emu::remute_voices()              { mute_voices( mute_mask_ ); }
 inline void Music_Emu::ignore_silence( bool b )     { ignore_silence_ = b; }
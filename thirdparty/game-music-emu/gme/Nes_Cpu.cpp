@@ -239,6 +239,14 @@ possibly_out_of_time:
 #define NO_PAGE_CROSSING( lsb )
 #define HANDLE_PAGE_CROSSING( lsb ) s_time += (lsb) >> 8;
 
+// A branch or jump to itself changes nothing but the time, so skip to the
+// first pass that would start at or after the end time
+#define IDLE_LOOP( clocks )\
+{\
+	if ( s_time < 0 && idle_skip_ )\
+		s_time += (-s_time + (clocks) - 1) / (clocks) * (clocks);\
+}
+
 #define INC_DEC_XY( reg, n ) reg = uint8_t (nz = reg + n); goto loop;
 
 #define IND_Y( cross, out ) {\
@@ -288,6 +296,8 @@ imm##op:
 	if ( !(cond) ) goto dec_clock_loop;\
 	pc = uint16_t (pc + offset);\
 	s_time += extra_clock >> 8 & 1;\
+	if ( offset == -2 )\
+		IDLE_LOOP( 3 + (extra_clock >> 8 & 1) );\
 	goto loop;\
 }
 
@@ -316,6 +326,8 @@ imm##op:
 	}
 	
 	case 0x4C: // JMP abs
+		if ( GET_ADDR() == uint16_t (pc - 1) )
+			IDLE_LOOP( 3 );
 		pc = GET_ADDR();
 		goto loop;
 	
@@ -61,8 +61,12 @@ public:
 	// CPU invokes bad opcode handler if it encounters this
 	enum { bad_opcode = 0xF2 };
 	
+	// Pass over the remaining time of a branch or jump to itself at once,
+	// stopping at the same instruction boundary running it would have
+	void enable_idle_skip( bool b = true )  { idle_skip_ = b; }
+	
 public:
-	Nes_Cpu() { state = &state_; }
+	Nes_Cpu() { state = &state_; idle_skip_ = true; }
 	enum { page_bits = 11 };
 	enum { page_count = 0x10000 >> page_bits };
 	enum { irq_inhibit = 0x04 };
@@ -77,6 +81,7 @@ private:
 	nes_time_t irq_time_;
 	nes_time_t end_time_;
 	unsigned long error_count_;
+	bool idle_skip_;
 	
 	void set_code_page( int, void const* );
 	inline int update_end_time( nes_time_t end, nes_time_t irq );
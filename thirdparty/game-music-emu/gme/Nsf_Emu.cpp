@@ -159,6 +159,12 @@ void Nsf_Emu::set_tempo_( double t )
 	apu.set_tempo( t );
 }
 
+void Nsf_Emu::enable_accuracy_( bool b )
+{
+	Classic_Emu::enable_accuracy_( b );
+	cpu::enable_idle_skip( !b );
+}
+
 blargg_err_t Nsf_Emu::init_sound()
 {
 	if ( header_.chip_flags & ~(namco_flag | vrc6_flag | fme7_flag) )
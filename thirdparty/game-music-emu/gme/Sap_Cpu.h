@@ -43,8 +43,12 @@ public:
 	sap_time_t end_time() const         { return end_time_; }
 	void set_end_time( sap_time_t );
 	
+	// Pass over the remaining time of a branch or jump to itself at once,
+	// stopping at the same instruction boundary running it would have
+	void enable_idle_skip( bool b = true )  { idle_skip_ = b; }
+	
 public:
-	Sap_Cpu() { state = &state_; }
+	Sap_Cpu() { state = &state_; idle_skip_ = true; }
 	enum { irq_inhibit = 0x04 };
 private:
 	struct state_t {
@@ -56,6 +60,7 @@ private:
 	sap_time_t irq_time_;
 	sap_time_t end_time_;
 	uint8_t* mem;
+	bool idle_skip_;
 	
 	inline sap_time_t update_end_time( sap_time_t end, sap_time_t irq );
 };
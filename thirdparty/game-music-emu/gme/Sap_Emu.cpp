@@ -282,6 +282,12 @@ void Sap_Emu::set_tempo_( double t )
 	scanline_period = sap_time_t (base_scanline_period / t);
 }
 
+void Sap_Emu::enable_accuracy_( bool b )
+{
+	Classic_Emu::enable_accuracy_( b );
+	cpu::enable_idle_skip( !b );
+}
+
 inline sap_time_t Sap_Emu::play_period() const { return info.fastplay * scanline_period; }
 
 void Sap_Emu::cpu_jsr( sap_addr_t addr )
@@ -35,6 +35,7 @@ blargg_err_t Snes_Spc::init()
 	dsp.init( RAM );
 	
 	m.tempo = tempo_unit;
+	m.idle_skip = true;
 	
 	// Most SPC music doesn't need ROM, and almost all the rest only rely
 	// on these two bytes
@@ -258,6 +259,21 @@ void Snes_Spc::clear_echo()
 	}
 }
 
+void Snes_Spc::relocate( Snes_Spc const* from )
+{
+	char const* begin = (char const*) from;
+	char const* end   = begin + sizeof *this;
+	ptrdiff_t   delta = (char const*) this - begin;
+	if ( !delta )
+		return;
+	
+	// Output pointers outside the object are replaced by the next play()
+	Spc_Dsp::relocate_ptr( m.buf_begin, begin, end, delta );
+	Spc_Dsp::relocate_ptr( m.buf_end,   begin, end, delta );
+	Spc_Dsp::relocate_ptr( m.extra_pos, begin, end, delta );
+	dsp.relocate( begin, end, delta );
+}
+
 
 //// Sample output
 
@@ -63,6 +63,10 @@ public:
 	// Only supported by fast DSP.
 	void disable_surround( bool disable = true );
 	
+	// If true, passes over a loop polling a timer that is still zero at once.
+	// Gives the same result as running the loop. Enabled by default.
+	void enable_idle_skip( bool enable = true );
+	
 	// Sets tempo, where tempo_unit = normal, tempo_unit / 2 = half speed, etc.
 	enum { tempo_unit = 0x100 };
 	void set_tempo( int );
@@ -84,6 +88,10 @@ public:
 	// Skips count samples. Several times faster than play() when using fast DSP.
 	blargg_err_t skip( int count );
 	
+	// Fixes up internal pointers after the bytes of another Snes_Spc at from
+	// were copied over this one, so the copy runs on from here.
+	void relocate( Snes_Spc const* from );
+	
 // State save/load (only available with accurate DSP)
 
 #if !SPC_NO_COPY_STATE_FUNCS
@@ -164,6 +172,7 @@ private:
 		bool        echo_accessed;
 		
 		int         tempo;
+		int         idle_skip;
 		int         skipped_kon;
 		int         skipped_koff;
 		const char* cpu_error;
@@ -220,6 +229,7 @@ private:
 	
 	Timer* run_timer_      ( Timer* t, rel_time_t );
 	Timer* run_timer       ( Timer* t, rel_time_t );
+	rel_time_t skip_timer_poll( int opcode, int addr, rel_time_t );
 	int dsp_read           ( rel_time_t );
 	void dsp_write         ( int data, rel_time_t );
 	void cpu_write_smp_reg_( int data, rel_time_t, uint16_t addr );
@@ -276,6 +286,8 @@ inline void Snes_Spc::mute_voices( int mask ) { dsp.mute_voices( mask ); }
 	
 inline void Snes_Spc::disable_surround( bool disable ) { dsp.disable_surround( disable ); }
 
+inline void Snes_Spc::enable_idle_skip( bool enable ) { m.idle_skip = enable; }
+
 #if !SPC_NO_COPY_STATE_FUNCS
 inline bool Snes_Spc::check_kon() { return dsp.check_kon(); }
 #endif
@@ -75,6 +75,32 @@ inline Snes_Spc::Timer* Snes_Spc::run_timer( Timer* t, rel_time_t time )
 	return t;
 }
 
+// A MOV that read 0 from addr at time, followed by a BEQ back to it, spins
+// until the timer counts. Reading a counter that is still 0 changes nothing,
+// so returns the time of the last pass that would read 0 before the end.
+Snes_Spc::rel_time_t Snes_Spc::skip_timer_poll( int opcode, int addr, rel_time_t time )
+{
+	int ti = addr - (r_t0out + 0xF0);
+	if ( !m.idle_skip || (unsigned) ti >= timer_count )
+		return time;
+	
+	Timer const* t = &m.timers [ti];
+	rel_time_t last = 0;
+	if ( t->enabled )
+	{
+		// run_timer_() counts once elapsed reaches remain
+		int remain = IF_0_THEN_256( t->period - t->divider );
+		rel_time_t counted = t->next_time + TIMER_MUL( t, remain - 1 );
+		if ( last > counted - 1 )
+			last = counted - 1;
+	}
+	
+	int pass = m.cycle_table [opcode] + m.cycle_table [0xF0];
+	if ( last > time )
+		time += (last - time) / pass * pass;
+	return time;
+}
+
 
 //// ROM
 
@@ -237,6 +237,8 @@ loop:
 		++pc;
 		// 80% from timer
 		READ_DP_TIMER( 0, data, a = nz );
+		if ( !nz && ram [pc] == 0xF0 && ram [pc + 1] == 0xFC ) // BEQ to this
+			rel_time = skip_timer_poll( opcode, DP_ADDR( data ), rel_time );
 		goto loop;
 	
 	case 0xFA:{// MOV dp,dp
@@ -369,6 +371,8 @@ loop:
 		// 70% from timer
 		pc++;
 		READ_DP_TIMER( 0, data, y = nz );
+		if ( !nz && ram [pc] == 0xF0 && ram [pc + 1] == 0xFC ) // BEQ to this
+			rel_time = skip_timer_poll( opcode, DP_ADDR( data ), rel_time );
 		goto loop;
 	
 	case 0xEC:{// MOV Y,abs
@@ -376,6 +380,8 @@ loop:
 		pc += 2;
 		READ_TIMER( 0, temp, y = nz );
 		//y = nz = READ( 0, temp );
+		if ( !nz && ram [pc] == 0xF0 && ram [pc + 1] == 0xFB ) // BEQ to this
+			rel_time = skip_timer_poll( opcode, temp, rel_time );
 		goto loop;
 	}
 	
@@ -193,8 +193,26 @@ void Spc_Dsp::run( int clock_count )
 	
 	uint8_t* const ram = m.ram;
 	uint8_t const* const dir = &ram [REG(dir) * 0x100];
-	int const slow_gaussian = (REG(pmon) >> 1) | REG(non);
-	int const noise_rate = REG(flg) & 0x1F;
+	
+	// Only the CPU changes these, and it doesn't run until we return. Copies
+	// keep them in registers, since every write to RAM could alias them.
+	int const flg   = REG(flg);
+	int const pmon  = REG(pmon);
+	int const non   = REG(non);
+	int const eon   = REG(eon);
+	int const efb   = (int8_t) REG(efb);
+	int const evoll = (int8_t) REG(evoll);
+	int const evolr = (int8_t) REG(evolr);
+	int const slow_gaussian = (pmon >> 1) | non;
+	int const noise_rate = flg & 0x1F;
+	
+	// FIR coefficients, doubled to match the interleaved echo history
+	int fir [echo_hist_size * 2];
+	for ( int i = 0; i < echo_hist_size; i++ )
+		fir [i * 2] = fir [i * 2 + 1] = (int8_t) REG(fir + i * 0x10);
+	
+	// The FIR output is only heard through EVOL or written back as echo
+	bool const echo_needed = !(flg & 0x20) || evoll || evolr;
 	
 	// Global volume
 	int mvoll = (int8_t) REG(mvoll);
@@ -231,17 +249,26 @@ void Spc_Dsp::run( int clock_count )
 		int echo_out_r = 0;
 		voice_t* v = m.voices;
 		uint8_t* v_regs = m.regs;
-		int vbit = 1;
-		do
+		for ( int vbit = 1; vbit < 0x100; vbit <<= 1, v_regs += 0x10, v++ )
 		{
 			#define SAMPLE_PTR(i) GET_LE16A( &dir [VREG(v_regs,srcn) * 4 + i * 2] )
 			
+			// Silent voices that aren't being keyed on only clear their outputs
+			if ( !v->env && !v->kon_delay && v->env_mode == env_release &&
+					!(m.every_other_sample && (m.kon & vbit)) )
+			{
+				VREG(v_regs,envx) = 0;
+				VREG(v_regs,outx) = 0;
+				pmon_input = 0;
+				continue;
+			}
+			
 			int brr_header = ram [v->brr_addr];
 			int kon_delay = v->kon_delay;
 			
 			// Pitch
 			int pitch = GET_LE16A( &VREG(v_regs,pitchl) ) & 0x3FFF;
-			if ( REG(pmon) & vbit )
+			if ( pmon & vbit )
 				pitch += ((pmon_input >> 5) * pitch) >> 10;
 			
 			// KON phases
@@ -296,7 +323,7 @@ void Spc_Dsp::run( int clock_count )
 					else
 					{
 						output = (int16_t) (m.noise * 2);
-						if ( !(REG(non) & vbit) )
+						if ( !(non & vbit) )
 						{
 							output  = (fwd [0] * in [0]) >> 11;
 							output += (fwd [1] * in [1]) >> 11;
@@ -317,7 +344,7 @@ void Spc_Dsp::run( int clock_count )
 					main_out_l += l;
 					main_out_r += r;
 					
-					if ( REG(eon) & vbit )
+					if ( eon & vbit )
 					{
 						echo_out_l += l;
 						echo_out_r += r;
@@ -329,7 +356,7 @@ void Spc_Dsp::run( int clock_count )
 			}
 			
 			// Soft reset or end of sample
-			if ( REG(flg) & 0x80 || (brr_header & 3) == 1 )
+			if ( flg & 0x80 || (brr_header & 3) == 1 )
 			{
 				v->env_mode = env_release;
 				env         = 0;
@@ -539,12 +566,8 @@ void Spc_Dsp::run( int clock_count )
 				}
 			}
 skip_brr:
-			// Next voice
-			vbit <<= 1;
-			v_regs += 0x10;
-			v++;
+			;
 		}
-		while ( vbit < 0x100 );
 		
 		// Echo position
 		int echo_offset = m.echo_offset;
@@ -568,30 +591,34 @@ skip_brr:
 		echo_hist_pos [0] [0] = echo_hist_pos [8] [0] = echo_in_l;
 		echo_hist_pos [0] [1] = echo_hist_pos [8] [1] = echo_in_r;
 		
-		#define CALC_FIR_( i, in )  ((in) * (int8_t) REG(fir + i * 0x10))
-		echo_in_l = CALC_FIR_( 7, echo_in_l );
-		echo_in_r = CALC_FIR_( 7, echo_in_r );
-		
-		#define CALC_FIR( i, ch )   CALC_FIR_( i, echo_hist_pos [i + 1] [ch] )
-		#define DO_FIR( i )\
-			echo_in_l += CALC_FIR( i, 0 );\
-			echo_in_r += CALC_FIR( i, 1 );
-		DO_FIR( 0 );
-		DO_FIR( 1 );
-		DO_FIR( 2 );
-		#if defined (__MWERKS__) && __MWERKS__ < 0x3200
-			__eieio(); // keeps compiler from stupidly "caching" things in memory
-		#endif
-		DO_FIR( 3 );
-		DO_FIR( 4 );
-		DO_FIR( 5 );
-		DO_FIR( 6 );
+		if ( echo_needed )
+		{
+			// echo_hist_pos [1] to [8] are the 8 most recent samples, oldest first.
+			// Integer sums, so the order doesn't change the result.
+			int const* hist = echo_hist_pos [1];
+			int prod [echo_hist_size * 2];
+			for ( int i = 0; i < echo_hist_size * 2; i++ )
+				prod [i] = hist [i] * fir [i];
+			
+			echo_in_l = 0;
+			echo_in_r = 0;
+			for ( int i = 0; i < echo_hist_size * 2; i += 2 )
+			{
+				echo_in_l += prod [i];
+				echo_in_r += prod [i + 1];
+			}
+		}
+		else
+		{
+			echo_in_l = 0;
+			echo_in_r = 0;
+		}
 		
 		// Echo out
-		if ( !(REG(flg) & 0x20) )
+		if ( !(flg & 0x20) )
 		{
-			int l = (echo_out_l >> 7) + ((echo_in_l * (int8_t) REG(efb)) >> 14);
-			int r = (echo_out_r >> 7) + ((echo_in_r * (int8_t) REG(efb)) >> 14);
+			int l = (echo_out_l >> 7) + ((echo_in_l * efb) >> 14);
+			int r = (echo_out_r >> 7) + ((echo_in_r * efb) >> 14);
 			
 			// just to help pass more validation tests
 			#if SPC_MORE_ACCURACY
@@ -607,13 +634,13 @@ skip_brr:
 		}
 		
 		// Sound out
-		int l = (main_out_l * mvoll + echo_in_l * (int8_t) REG(evoll)) >> 14;
-		int r = (main_out_r * mvolr + echo_in_r * (int8_t) REG(evolr)) >> 14;
+		int l = (main_out_l * mvoll + echo_in_l * evoll) >> 14;
+		int r = (main_out_r * mvolr + echo_in_r * evolr) >> 14;
 		
 		CLAMP16( l );
 		CLAMP16( r );
 		
-		if ( (REG(flg) & 0x40) )
+		if ( (flg & 0x40) )
 		{
 			l = 0;
 			r = 0;
@@ -702,3 +729,16 @@ void Spc_Dsp::load( uint8_t const regs [register_count] )
 }
 
 void Spc_Dsp::reset() { load( initial_regs ); }
+
+void Spc_Dsp::relocate( char const* begin, char const* end, ptrdiff_t delta )
+{
+	for ( int i = voice_count; --i >= 0; )
+		relocate_ptr( m.voices [i].buf_pos, begin, end, delta );
+	relocate_ptr( m.echo_hist_pos, begin, end, delta );
+	for ( int i = 0; i < 32; i++ )
+		relocate_ptr( m.counter_select [i], begin, end, delta );
+	relocate_ptr( m.ram,       begin, end, delta );
+	relocate_ptr( m.out,       begin, end, delta );
+	relocate_ptr( m.out_end,   begin, end, delta );
+	relocate_ptr( m.out_begin, begin, end, delta );
+}
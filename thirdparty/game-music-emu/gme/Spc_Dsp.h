@@ -55,6 +55,18 @@ public:
 	// Resets DSP and uses supplied values to initialize registers
 	enum { register_count = 128 };
 	void load( uint8_t const regs [register_count] );
+	
+	// Updates internal pointers after the state was copied byte for byte from
+	// an object occupying [begin, end), which was delta bytes below this one.
+	void relocate( char const* begin, char const* end, ptrdiff_t delta );
+	
+	// Moves p by delta if it points into [begin, end)
+	template<class T>
+	static void relocate_ptr( T*& p, char const* begin, char const* end, ptrdiff_t delta )
+	{
+		if ( (char const*) p >= begin && (char const*) p < end )
+			p = (T*) ((char*) p + delta);
+	}
 
 // DSP register addresses
 
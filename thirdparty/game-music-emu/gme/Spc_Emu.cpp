@@ -265,6 +265,7 @@ void Spc_Emu::enable_accuracy_( bool b )
 {
 	Music_Emu::enable_accuracy_( b );
 	filter.enable( b );
+	apu.enable_idle_skip( !b );
 }
 
 void Spc_Emu::mute_voices_( int m )
@@ -337,6 +338,47 @@ blargg_err_t Spc_Emu::skip_( long count )
 	return play_( resampler_latency, buf );
 }
 
+// The SPC and filter only hold plain data and pointers into themselves, so a
+// copy of their bytes is their complete state. The address the SPC was saved
+// from is stored too, so its pointers can be fixed up when the state is loaded
+// into another Spc_Emu playing the same file at the same rate. That copies
+// voice muting and tempo as well.
+
+long Spc_Emu::state_size_() const
+{
+	long size = sizeof (Snes_Spc const*) + sizeof apu + sizeof filter;
+	if ( sample_rate() != native_sample_rate )
+		size += resampler.state_size();
+	return size;
+}
+
+void Spc_Emu::save_state_( unsigned char* out ) const
+{
+	Snes_Spc const* from = &apu;
+	memcpy( out, &from, sizeof from );
+	out += sizeof from;
+	memcpy( out, (void const*) &apu, sizeof apu );
+	out += sizeof apu;
+	memcpy( out, (void const*) &filter, sizeof filter );
+	out += sizeof filter;
+	if ( sample_rate() != native_sample_rate )
+		resampler.save_state( out );
+}
+
+void Spc_Emu::load_state_( unsigned char const* in )
+{
+	Snes_Spc const* from;
+	memcpy( &from, in, sizeof from );
+	in += sizeof from;
+	memcpy( (void*) &apu, in, sizeof apu );
+	apu.relocate( from );
+	in += sizeof apu;
+	memcpy( (void*) &filter, in, sizeof filter );
+	in += sizeof filter;
+	if ( sample_rate() != native_sample_rate )
+		resampler.load_state( in );
+}
+
 blargg_err_t Spc_Emu::play_( long count, sample_t* out )
 {
 	if ( sample_rate() == native_sample_rate )
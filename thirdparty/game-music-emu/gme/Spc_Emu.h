@@ -64,6 +64,9 @@ protected:
 	blargg_err_t start_track_( int );
 	blargg_err_t play_( long, sample_t* );
 	blargg_err_t skip_( long );
+	long state_size_() const;
+	void save_state_( unsigned char* ) const;
+	void load_state_( unsigned char const* );
 	void mute_voices_( int );
 	void set_tempo_( double );
 	void enable_accuracy_( bool );
@@ -330,6 +330,13 @@ blargg_err_t Vgm_Emu::load_mem_( byte const* new_data, long new_size )
 	return Classic_Emu::setup_buffer( psg_rate );
 }
 
+blargg_err_t Vgm_Emu::set_fm_options_( int ym2612_core, bool native_rate )
+{
+	set_ym2612_core( ym2612_core );
+	disable_oversampling( native_rate );
+	return 0;
+}
+
 blargg_err_t Vgm_Emu::setup_fm()
 {
 	long ym2612_rate = get_le32( header().ym2612_rate );
@@ -23,6 +23,10 @@ public:
 	// more aliasing of high notes.
 	void disable_oversampling( bool disable = true ) { disable_oversampling_ = disable; }
 	
+	// Select the YM2612 core, one of the Ym2612_Emu::core_* values. Like
+	// disable_oversampling(), only affects files loaded after this.
+	void set_ym2612_core( int core ) { ym2612.set_core( core ); }
+	
 	// VGM header format
 	enum { header_size = 0x40 };
 	struct header_t
@@ -69,6 +73,7 @@ protected:
 	blargg_err_t play_( long count, sample_t* );
 	blargg_err_t run_clocks( blip_time_t&, int );
 	void set_tempo_( double );
+	blargg_err_t set_fm_options_( int ym2612_core, bool native_rate );
 	void mute_voices_( int mask );
 	void set_voice( int, Blip_Buffer*, Blip_Buffer*, Blip_Buffer* );
 	void update_eq( blip_eq_t const& );
@@ -0,0 +1,154 @@
+// Game_Music_Emu https://bitbucket.org/mpyne/game-music-emu/
+
+#include "Ym2612_Emu.h"
+
+/* This module is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version. This module is distributed in the hope
+that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details. You should have received a
+copy of the GNU Lesser General Public License along with this module; if not,
+write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+Boston, MA 02110-1301 USA */
+
+#include "blargg_source.h"
+
+// The core selected with GME_YM2612_EMU
+#if defined(VGM_YM2612_MAME)
+int const default_core = Ym2612_Emu::core_mame;
+#elif defined(VGM_YM2612_GENS)
+int const default_core = Ym2612_Emu::core_gens;
+#else
+int const default_core = Ym2612_Emu::core_nuked;
+#endif
+
+Ym2612_Emu::Ym2612_Emu()
+{
+	core_  = core_default;
+	active = core_default;
+	gens   = 0;
+	nuked  = 0;
+#ifdef VGM_YM2612_MAME
+	mame   = 0;
+#endif
+}
+
+Ym2612_Emu::~Ym2612_Emu() { free_cores(); }
+
+void Ym2612_Emu::free_cores()
+{
+	delete gens;
+	gens = 0;
+	delete nuked;
+	nuked = 0;
+#ifdef VGM_YM2612_MAME
+	delete mame;
+	mame = 0;
+#endif
+	active = core_default;
+}
+
+const char* Ym2612_Emu::set_rate( double sample_rate, double clock_rate )
+{
+	int core = core_;
+#ifndef VGM_YM2612_MAME
+	if ( core == core_mame )
+		core = core_default;
+#endif
+	if ( core != core_nuked && core != core_mame && core != core_gens )
+		core = default_core;
+
+	// only one core is kept, the others can be large
+	if ( core != active )
+	{
+		free_cores();
+		switch ( core )
+		{
+		case core_gens:
+			CHECK_ALLOC( gens = BLARGG_NEW Ym2612_GENS_Emu );
+			break;
+
+	#ifdef VGM_YM2612_MAME
+		case core_mame:
+			CHECK_ALLOC( mame = BLARGG_NEW Ym2612_MAME_Emu );
+			break;
+	#endif
+
+		default:
+			CHECK_ALLOC( nuked = BLARGG_NEW Ym2612_Nuked_Emu );
+			break;
+		}
+		active = core;
+	}
+
+	switch ( active )
+	{
+	case core_gens:  return gens->set_rate( sample_rate, clock_rate );
+#ifdef VGM_YM2612_MAME
+	case core_mame:  return mame->set_rate( sample_rate, clock_rate );
+#endif
+	default:         return nuked->set_rate( sample_rate, clock_rate );
+	}
+}
+
+void Ym2612_Emu::reset()
+{
+	switch ( active )
+	{
+	case core_gens:  gens->reset(); break;
+#ifdef VGM_YM2612_MAME
+	case core_mame:  mame->reset(); break;
+#endif
+	case core_nuked: nuked->reset(); break;
+	}
+}
+
+void Ym2612_Emu::mute_voices( int mask )
+{
+	switch ( active )
+	{
+	case core_gens:  gens->mute_voices( mask ); break;
+#ifdef VGM_YM2612_MAME
+	case core_mame:  mame->mute_voices( mask ); break;
+#endif
+	case core_nuked: nuked->mute_voices( mask ); break;
+	}
+}
+
+void Ym2612_Emu::write0( int addr, int data )
+{
+	switch ( active )
+	{
+	case core_gens:  gens->write0( addr, data ); break;
+#ifdef VGM_YM2612_MAME
+	case core_mame:  mame->write0( addr, data ); break;
+#endif
+	case core_nuked: nuked->write0( addr, data ); break;
+	}
+}
+
+void Ym2612_Emu::write1( int addr, int data )
+{
+	switch ( active )
+	{
+	case core_gens:  gens->write1( addr, data ); break;
+#ifdef VGM_YM2612_MAME
+	case core_mame:  mame->write1( addr, data ); break;
+#endif
+	case core_nuked: nuked->write1( addr, data ); break;
+	}
+}
+
+void Ym2612_Emu::run( int pair_count, sample_t* out )
+{
+	switch ( active )
+	{
+	case core_gens:  gens->run( pair_count, out ); break;
+#ifdef VGM_YM2612_MAME
+	case core_mame:  mame->run( pair_count, out ); break;
+#endif
+	case core_nuked: nuked->run( pair_count, out ); break;
+	}
+}
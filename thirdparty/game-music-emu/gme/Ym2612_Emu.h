@@ -1,19 +1,65 @@
 // YM2612 FM sound chip emulator interface
 
 // Game_Music_Emu https://bitbucket.org/mpyne/game-music-emu/
+#ifndef YM2612_EMU_H
+#define YM2612_EMU_H
 
-#ifdef VGM_YM2612_GENS // LGPL v2.1+ license
-#include "Ym2612_GENS.h"
-typedef Ym2612_GENS_Emu Ym2612_Emu;
+#include "blargg_common.h"
+#include "Ym2612_GENS.h"  // LGPL v2.1+ license
+#include "Ym2612_Nuked.h" // LGPL v2.1+ license
+#ifdef VGM_YM2612_MAME
+#include "Ym2612_MAME.h"  // GPL v2+ license, only built if selected as the default
 #endif
 
-#ifdef VGM_YM2612_NUKED // LGPL v2.1+ license
-#include "Ym2612_Nuked.h"
-typedef Ym2612_Nuked_Emu Ym2612_Emu;
-#endif
+// Forwards to one of the YM2612 cores, chosen at run time. GENS is the
+// fastest and Nuked the most accurate and by far the slowest.
+class Ym2612_Emu {
+public:
+	// Same values as gme_ym2612_* in gme.h. Cores that weren't built
+	// fall back to the default one.
+	enum core_t { core_default, core_nuked, core_mame, core_gens };
+
+	Ym2612_Emu();
+	~Ym2612_Emu();
+
+	// Select core. Takes effect with the next set_rate().
+	void set_core( int core ) { core_ = core; }
+
+	// Set output sample rate and chip clock rates, in Hz. Returns non-zero
+	// if error.
+	const char* set_rate( double sample_rate, double clock_rate );
+
+	// Reset to power-up state
+	void reset();
+
+	// Mute voice n if bit n (1 << n) of mask is set
+	enum { channel_count = 6 };
+	void mute_voices( int mask );
 
-#ifdef VGM_YM2612_MAME // GPL v2+ license
-#include "Ym2612_MAME.h"
-typedef Ym2612_MAME_Emu Ym2612_Emu;
+	// Write addr to register 0 then data to register 1
+	void write0( int addr, int data );
+
+	// Write addr to register 2 then data to register 3
+	void write1( int addr, int data );
+
+	// Run and add pair_count samples into current output buffer contents
+	typedef short sample_t;
+	enum { out_chan_count = 2 }; // stereo
+	void run( int pair_count, sample_t* out );
+
+private:
+	int core_;
+	int active;
+	Ym2612_GENS_Emu* gens;
+	Ym2612_Nuked_Emu* nuked;
+#ifdef VGM_YM2612_MAME
+	Ym2612_MAME_Emu* mame;
 #endif
+	void free_cores();
 
+	// noncopyable
+	Ym2612_Emu( const Ym2612_Emu& );
+	Ym2612_Emu& operator = ( const Ym2612_Emu& );
+};
+
+#endif
@@ -75,6 +75,16 @@ gme_err_t gme_seek( Music_Emu*, int msec );
 /* Equivalent to restarting track then skipping n samples */
 gme_err_t gme_seek_samples( Music_Emu*, int n );
 
+/* Number of bytes gme_save_state() writes, or 0 if emulator can't save its state */
+long gme_state_size( Music_Emu const* );
+
+/* Save complete state of current track into out, to return to it later with
+gme_load_state(). A state can be loaded into the emulator that saved it, or
+into another one of the same type playing the same track at the same sample
+rate. */
+void gme_save_state( Music_Emu const*, void* out );
+void gme_load_state( Music_Emu*, void const* in );
+
 
 /******** Informational ********/
 
@@ -173,6 +183,16 @@ void gme_set_equalizer( Music_Emu*, gme_equalizer_t const* eq );
 /* Enables/disables most accurate sound emulation options */
 void gme_enable_accuracy( Music_Emu*, int enabled );
 
+/* YM2612 emulators VGM and GYM files can use. Nuked is the most accurate and by far
+the slowest, GENS the fastest. MAME is only available if it is the default one. */
+enum { gme_ym2612_default = 0, gme_ym2612_nuked, gme_ym2612_mame, gme_ym2612_gens };
+
+/* Select the YM2612 emulator of VGM and GYM files, and whether their FM chips run at
+the chip's own rate (about 53 kHz for the YM2612) rather than oversampled above the
+output rate. That is cheaper, but high notes alias a little more. VGM files only pick
+these up when they are loaded, so call this before gme_load_data() and the like. */
+gme_err_t gme_set_fm_options( Music_Emu*, int ym2612_core, int native_rate );
+
 
 /******** Game music types ********/
 
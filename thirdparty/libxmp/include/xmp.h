@@ -66,6 +66,7 @@ extern "C" {
 #define XMP_FORMAT_8BIT		(1 << 0) /* Mix to 8-bit instead of 16 */
 #define XMP_FORMAT_UNSIGNED	(1 << 1) /* Mix to unsigned samples */
 #define XMP_FORMAT_MONO		(1 << 2) /* Mix to mono instead of stereo */
+#define XMP_FORMAT_FLOAT	(1 << 3) /* Mix to 32-bit float, -1 to 1 unclipped */
 
 /* player parameters */
 #define XMP_PLAYER_AMP		0	/* Amplification factor */
@@ -82,6 +83,7 @@ extern "C" {
 #define XMP_PLAYER_MODE 	11	/* Player personality */
 #define XMP_PLAYER_MIXER_TYPE	12	/* Current mixer (read only) */
 #define XMP_PLAYER_VOICES	13	/* Maximum number of mixer voices */
+#define XMP_PLAYER_FORMAT	14	/* Sample format flags, only XMP_FORMAT_FLOAT can change */
 
 /* interpolation types */
 #define XMP_INTERP_NEAREST	0	/* Nearest neighbor */
@@ -123,6 +125,7 @@ extern "C" {
 
 /* sample flags */
 #define XMP_SMPCTL_SKIP		(1 << 0) /* Don't load samples */
+#define XMP_SMPCTL_NOSCAN	(1 << 1) /* Don't scan, call xmp_scan_module */
 
 /* limits */
 #define XMP_MAX_KEYS		121	/* Number of valid keys */
@@ -391,6 +394,13 @@ LIBXMP_EXPORT int         xmp_set_player      (xmp_context, int, int);
 LIBXMP_EXPORT int         xmp_get_player      (xmp_context, int);
 LIBXMP_EXPORT int         xmp_set_instrument_path (xmp_context, const char *);
 
+/* Lets loaders decompress the samples of modules loaded from memory in
+ * parallel. parallel_for must call job(job_data, i) once for every i from
+ * 0 to count - 1 and only return when all of them are done. This is global,
+ * a NULL parallel_for (the default) loads everything on the calling thread.
+ */
+LIBXMP_EXPORT void        xmp_set_load_parallel_for (void (*)(void *, int, void (*)(void *, int), void *), void *);
+
 /* External sample mixer API */
 LIBXMP_EXPORT int         xmp_start_smix       (xmp_context, int, int);
 LIBXMP_EXPORT void        xmp_end_smix         (xmp_context);
@@ -422,6 +422,17 @@ int xmp_set_player__(xmp_context opaque, int parm, int val)
 	case XMP_PLAYER_VOICES:
 		s->numvoc = val;
 		break;
+	case XMP_PLAYER_FORMAT:
+		if (((val ^ s->format) & ~XMP_FORMAT_FLOAT) == 0) {
+			if (val != s->format) {
+				/* the rest of the current frame is in the old format */
+				s->format = val;
+				p->buffer_data.consumed = 0;
+				p->buffer_data.in_size = 0;
+			}
+			ret = 0;
+		}
+		break;
 	}
 
 	return ret;
@@ -529,6 +540,9 @@ int xmp_get_player__(xmp_context opaque, int parm)
 	case XMP_PLAYER_VOICES:
 		ret = s->numvoc;
 		break;
+	case XMP_PLAYER_FORMAT:
+		ret = s->format;
+		break;
 	}
 
 	return ret;
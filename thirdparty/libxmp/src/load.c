@@ -38,6 +38,15 @@
 #endif
 
 
+void (*libxmp_load_parallel_for)(void *, int, void (*)(void *, int), void *);
+void *libxmp_load_parallel_data;
+
+void xmp_set_load_parallel_for(void (*parallel_for)(void *, int, void (*)(void *, int), void *), void *data)
+{
+	libxmp_load_parallel_for = parallel_for;
+	libxmp_load_parallel_data = data;
+}
+
 void libxmp_load_prologue(struct context_data *);
 void libxmp_load_epilogue(struct context_data *);
 int  libxmp_prepare_scan(struct context_data *);
@@ -321,10 +330,13 @@ static int load_module(xmp_context opaque, HIO_HANDLE *h)
 		return ret;
 	}
 
-	ret = libxmp_scan_sequences(ctx);
-	if (ret < 0) {
-		xmp_release_module(opaque);
-		return -XMP_ERROR_LOAD;
+	/* The scan can be left for later, but the player needs it */
+	if (~m->smpctl & XMP_SMPCTL_NOSCAN) {
+		ret = libxmp_scan_sequences(ctx);
+		if (ret < 0) {
+			xmp_release_module(opaque);
+			return -XMP_ERROR_LOAD;
+		}
 	}
 
 	ctx->state = XMP_STATE_LOADED;
@@ -478,6 +478,7 @@ void libxmp_free_scan(struct context_data *ctx)
 
 	free(p->scan);
 	p->scan = NULL;
+	m->num_sequences = 0;
 }
 
 /* Process player personality flags */
@@ -726,8 +726,48 @@ static void force_sample_length(struct xmp_sample *xxs, struct extra_sample_data
 	}
 }
 
+/* Compressed samples of modules loaded from memory are decompressed after
+ * all sample headers have been read, each job reading its own handle.
+ */
+struct it_sample_job {
+	int i;
+	const unsigned char *data;
+	long size;
+	long offset;
+	int len;
+	int is_16bit;
+	int diff;
+	int cvt;
+	void *decbuf;
+};
+
+static void it_decompress_job(void *job_data, int index)
+{
+	struct it_sample_job *job = (struct it_sample_job *)job_data + index;
+	HIO_HANDLE *h;
+
+	if ((h = hio_open_mem(job->data, job->size, 0)) == NULL)
+		return;
+
+	if (hio_seek(h, job->offset, SEEK_SET) == 0) {
+		job->decbuf = calloc(1, job->len * 2);
+		if (job->decbuf != NULL) {
+			if (job->is_16bit) {
+				itsex_decompress16(h, (int16 *)job->decbuf, job->len,
+						   job->diff);
+			} else {
+				itsex_decompress8(h, (uint8 *)job->decbuf, job->len,
+						  job->diff);
+			}
+		}
+	}
+	hio_close(h);
+}
+
+/* Returns 1 if the sample data was left to job. */
 static int load_it_sample(struct module_data *m, int i, int start,
-			  int sample_mode, HIO_HANDLE *f)
+			  int sample_mode, HIO_HANDLE *f,
+			  struct it_sample_job *job)
 {
 	struct it_sample_header ish;
 	struct xmp_module *mod = &m->mod;
@@ -898,6 +938,23 @@ static int load_it_sample(struct module_data *m, int i, int start,
 				force_sample_length(xxs, xtra, left << 3);
 			}
 
+			if (job != NULL) {
+#ifdef WORDS_BIGENDIAN
+				if (ish.flags & IT_SMP_16BIT)
+					cvt |= SAMPLE_FLAG_BIGEND;
+#endif
+				job->i = i;
+				job->data = f->handle.mem->start;
+				job->size = f->handle.mem->size;
+				job->offset = start + ish.sample_ptr;
+				job->len = xxs->len;
+				job->is_16bit = ish.flags & IT_SMP_16BIT;
+				job->diff = ish.convert & IT_CVT_DIFF;
+				job->cvt = cvt;
+				job->decbuf = NULL;
+				return 1;
+			}
+
 			decbuf = (uint8 *) calloc(1, xxs->len * 2);
 			if (decbuf == NULL)
 				return -1;
@@ -1073,6 +1130,8 @@ static int it_load(struct module_data *m, HIO_HANDLE *f, const int start)
 	int new_fx, sample_mode;
 	int pat_before_smp = 0;
 	int is_mpt_116 = 0;
+	struct it_sample_job *jobs = NULL;
+	int num_jobs = 0;
 
 	LOAD_INIT();
 
@@ -1264,19 +1323,55 @@ static int it_load(struct module_data *m, HIO_HANDLE *f, const int start)
 
 	D_(D_INFO "Stored Samples: %d", mod->smp);
 
+	if (libxmp_load_parallel_for != NULL && mod->smp > 1 &&
+	    HIO_HANDLE_TYPE(f) == HIO_HANDLE_TYPE_MEMORY) {
+		jobs = (struct it_sample_job *) calloc(mod->smp, sizeof(struct it_sample_job));
+	}
+
 	for (i = 0; i < mod->smp; i++) {
+		int ret;
 
 		if (hio_seek(f, start + pp_smp[i], SEEK_SET) < 0) {
+			free(jobs);
 			goto err4;
 		}
 
-		if (load_it_sample(m, i, start, sample_mode, f) < 0) {
+		ret = load_it_sample(m, i, start, sample_mode, f,
+				     jobs != NULL ? &jobs[num_jobs] : NULL);
+		if (ret < 0) {
+			free(jobs);
 			goto err4;
 		}
+		if (ret > 0) {
+			num_jobs++;
+		}
 	}
 	/* Reset any error status set by truncated samples. */
 	hio_error(f);
 
+	if (num_jobs > 1) {
+		libxmp_load_parallel_for(libxmp_load_parallel_data, num_jobs,
+					 it_decompress_job, jobs);
+	} else if (num_jobs > 0) {
+		it_decompress_job(jobs, 0);
+	}
+	for (j = 0; j < num_jobs; j++) {
+		if (jobs[j].decbuf == NULL || libxmp_load_sample(m, NULL,
+		    SAMPLE_FLAG_NOLOAD | jobs[j].cvt, &mod->xxs[jobs[j].i],
+		    jobs[j].decbuf) < 0) {
+			break;
+		}
+	}
+	if (jobs != NULL) {
+		for (i = 0; i < num_jobs; i++) {
+			free(jobs[i].decbuf);
+		}
+		free(jobs);
+		if (j < num_jobs) {
+			goto err4;
+		}
+	}
+
 	D_(D_INFO "Stored patterns: %d", mod->pat);
 
 	/* Effects in muted channels are processed, so scan patterns first to
@@ -58,6 +58,9 @@ void	libxmp_schism_tracker_string	(char *, size_t, int, int);
 void	libxmp_apply_mpt_preamp	(struct module_data *m);
 #endif
 
+extern void		(*libxmp_load_parallel_for)(void *, int, void (*)(void *, int), void *);
+extern void		*libxmp_load_parallel_data;
+
 extern uint8		libxmp_ord_xlat[];
 extern const int	libxmp_arch_vol_table[];
 
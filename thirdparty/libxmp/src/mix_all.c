@@ -65,20 +65,66 @@
 #define SPLINE_FRACSHIFT ((16 - SPLINE_FRACBITS) - 2)
 #define SPLINE_FRACMASK  (((1L << (16 - SPLINE_FRACSHIFT)) - 1) & ~3)
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPLINE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define SPLINE_NEON
+#include <arm_neon.h>
+#endif
+
+/* Sum of the four taps around x[0], using the coefficients for f. The sums
+ * fit in 32 bits, so the vector versions give exactly the same result as the
+ * scalar one.
+ */
+static inline int spline_taps_16bit(const int16 *x, int f)
+{
+    const int16 *c = cubic_spline_lut[f];
+#if defined(SPLINE_SSE2)
+    __m128i p = _mm_madd_epi16(_mm_loadl_epi64((const __m128i *)(x - 1)),
+                               _mm_loadl_epi64((const __m128i *)c));
+    return _mm_cvtsi128_si32(_mm_add_epi32(p, _mm_srli_epi64(p, 32)));
+#elif defined(SPLINE_NEON)
+    int32x4_t p = vmull_s16(vld1_s16(x - 1), vld1_s16(c));
+    int32x2_t h = vadd_s32(vget_low_s32(p), vget_high_s32(p));
+    return vget_lane_s32(vpadd_s32(h, h), 0);
+#else
+    return c[0] * x[-1] + c[1] * x[0] + c[2] * x[1] + c[3] * x[2];
+#endif
+}
+
+static inline int spline_taps_8bit(const int8 *x, int f)
+{
+    const int16 *c = cubic_spline_lut[f];
+#if defined(SPLINE_SSE2)
+    int v;
+    __m128i s, p;
+    memcpy(&v, x - 1, 4);
+    s = _mm_cvtsi32_si128(v);
+    s = _mm_srai_epi16(_mm_unpacklo_epi8(s, s), 8);
+    p = _mm_madd_epi16(s, _mm_loadl_epi64((const __m128i *)c));
+    return _mm_cvtsi128_si32(_mm_add_epi32(p, _mm_srli_epi64(p, 32)));
+#elif defined(SPLINE_NEON)
+    int v;
+    int16x4_t s;
+    int32x4_t p;
+    int32x2_t h;
+    memcpy(&v, x - 1, 4);
+    s = vget_low_s16(vmovl_s8(vreinterpret_s8_s32(vdup_n_s32(v))));
+    p = vmull_s16(s, vld1_s16(c));
+    h = vadd_s32(vget_low_s32(p), vget_high_s32(p));
+    return vget_lane_s32(vpadd_s32(h, h), 0);
+#else
+    return c[0] * x[-1] + c[1] * x[0] + c[2] * x[1] + c[3] * x[2];
+#endif
+}
+
 #define SPLINE_INTERP() do { \
-    int f = frac >> 6; \
-    smp_in = (cubic_spline_lut0[f] * sptr[(int)pos - 1] + \
-              cubic_spline_lut1[f] * sptr[pos    ] + \
-              cubic_spline_lut3[f] * sptr[pos + 2] + \
-              cubic_spline_lut2[f] * sptr[pos + 1]) >> (SPLINE_SHIFT - 8); \
+    smp_in = spline_taps_8bit(sptr + pos, frac >> 6) >> (SPLINE_SHIFT - 8); \
 } while (0)
 
 #define SPLINE_INTERP_16BIT() do { \
-    int f = frac >> 6; \
-    smp_in = (cubic_spline_lut0[f] * sptr[(int)pos - 1] + \
-              cubic_spline_lut1[f] * sptr[pos    ] + \
-              cubic_spline_lut3[f] * sptr[pos + 2] + \
-              cubic_spline_lut2[f] * sptr[pos + 1]) >> SPLINE_SHIFT; \
+    smp_in = spline_taps_16bit(sptr + pos, frac >> 6) >> SPLINE_SHIFT; \
 } while (0)
 
 #define LOOP_AC for (; count > ramp; count--)
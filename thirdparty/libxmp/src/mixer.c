@@ -212,6 +212,17 @@ static void downmix_int_16bit(int16 *dest, int32 *src, int num, int amp, int off
 	}
 }
 
+/* Convert 32bit samples to float, mono or stereo output */
+static void downmix_float(float *dest, int32 *src, int num, int amp)
+{
+	/* the same scale as the 16 bit output, without its truncation and clipping */
+	float scale = 1.0f / (float)(1 << (DOWNMIX_SHIFT - amp + 15));
+
+	for (; num--; src++, dest++) {
+		*dest = *src * scale;
+	}
+}
+
 static void anticlick(struct mixer_voice *vi)
 {
 	vi->flags |= ANTICLICK;
@@ -752,7 +763,9 @@ void libxmp_mixer_softmixer(struct context_data *ctx)
 		size = XMP_MAX_FRAMESIZE;
 	}
 
-	if (s->format & XMP_FORMAT_8BIT) {
+	if (s->format & XMP_FORMAT_FLOAT) {
+		downmix_float((float *)s->buffer, s->buf32, size, s->amplify);
+	} else if (s->format & XMP_FORMAT_8BIT) {
 		downmix_int_8bit(s->buffer, s->buf32, size, s->amplify,
 				s->format & XMP_FORMAT_UNSIGNED ? 0x80 : 0);
 	} else {
@@ -989,7 +1002,7 @@ int libxmp_mixer_on(struct context_data *ctx, int rate, int format, int c4rate)
 {
 	struct mixer_data *s = &ctx->s;
 
-	s->buffer = (char *) calloc(2, XMP_MAX_FRAMESIZE);
+	s->buffer = (char *) calloc(sizeof(float), XMP_MAX_FRAMESIZE);
 	if (s->buffer == NULL)
 		goto err;
 
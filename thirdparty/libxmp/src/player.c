@@ -1792,6 +1792,10 @@ int xmp_start_player(xmp_context opaque, int rate, int format)
 	if (ctx->state > XMP_STATE_LOADED)
 		xmp_end_player(opaque);
 
+	/* Loaded with XMP_SMPCTL_NOSCAN and not scanned, or the scan failed */
+	if (m->num_sequences == 0)
+		return -XMP_ERROR_STATE;
+
 	if (libxmp_mixer_on(ctx, rate, format, m->c4rate) < 0)
 		return -XMP_ERROR_INTERNAL;
 
@@ -2173,7 +2177,9 @@ void xmp_get_frame_info(xmp_context opaque, struct xmp_frame_info *info)
 	if (~s->format & XMP_FORMAT_MONO) {
 		info->buffer_size *= 2;
 	}
-	if (~s->format & XMP_FORMAT_8BIT) {
+	if (s->format & XMP_FORMAT_FLOAT) {
+		info->buffer_size *= sizeof(float);
+	} else if (~s->format & XMP_FORMAT_8BIT) {
 		info->buffer_size *= 2;
 	}
 
@@ -660,6 +660,7 @@ int libxmp_scan_sequences(struct context_data *ctx)
 		return -1;
 	}
 	p->scan = s;
+	m->num_sequences = 0;
 
 	/* Initialize order data to prevent overwrite when a position is used
 	 * multiple times at different starting points (see janosik.xm).
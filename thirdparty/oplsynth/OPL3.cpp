@@ -87,6 +87,11 @@ protected:
 #define toPhase (4.f)
 
 public:
+	// What getChannelOutput() actually is, so that OPL3::Update() can call
+	// it without going through the vtable for every sample.
+	enum EKind { KIND_2OP, KIND_4OP, KIND_RHYTHM, KIND_BASSDRUM, KIND_DISABLED };
+	EKind kind;
+
 	int channelBaseAddress;
 
 	double leftPan, rightPan;
@@ -137,7 +142,7 @@ public:
 class DisabledChannel : public Channel
 {
 public:
-	DisabledChannel() : Channel(0, 0) { }
+	DisabledChannel() : Channel(0, 0) { kind = KIND_DISABLED; }
 	double getChannelOutput(class OPL3 *OPL3) { return 0; }    
 	void keyOn() { }
 	void keyOff() { }
@@ -249,7 +254,7 @@ class RhythmChannel : public Channel2op
 public:
 	RhythmChannel(int baseAddress, double startvol, Operator *o1, Operator *o2)
 	: Channel2op(baseAddress, startvol, o1, o2)
-	{ }
+	{ kind = KIND_RHYTHM; }
 	double getChannelOutput(class OPL3 *OPL3);
 
 	// Rhythm channels are always running, 
@@ -587,8 +592,8 @@ private:
 	void update_2_CONNECTIONSEL6();
 	void set4opConnections();
 	void setRhythmMode();
-
-	static int InstanceCount;
+	template<class T> void renderChannel(T *channel, float *output, int numsamples);
+	static bool initTables();
 
 	// OPLEmul interface
 public:
@@ -596,38 +601,77 @@ public:
 	void WriteReg(int reg, int v);
 	void Update(float *buffer, int length);
 	void SetPanning(int c, float left, float right);
+	bool IsIdle() const;
 };
 
 OperatorDataStruct *OPL3::OperatorData;
 OPL3DataStruct *OPL3::OPL3Data;
-int OPL3::InstanceCount;
 
-void OPL3::Update(float *output, int numsamples) {
+// The tables only depend on constants, so they are built once for all
+// chips and kept until the library is unloaded.
+bool OPL3::initTables()
+{
+	static OPL3DataStruct opl3Data;
+	static OperatorDataStruct operatorData;
+	OPL3Data = &opl3Data;
+	OperatorData = &operatorData;
+	return true;
+}
+
+// Renders one channel for the whole block. The channel's state stays
+// hot for all of it, and T::getChannelOutput() is called directly.
+// Channels only share the vibrato and tremolo positions, which are
+// stepped here just like Update() used to do after each sample.
+template<class T>
+void OPL3::renderChannel(T *channel, float *output, int numsamples) {
 	while (numsamples--) {
-		// If _new = 0, use OPL2 mode with 9 channels. If _new = 1, use OPL3 18 channels;
-		for(int array=0; array < (_new + 1); array++)
-			for(int channelNumber=0; channelNumber < 9; channelNumber++) {
-				// Reads output from each OPL3 channel, and accumulates it in the output buffer:
-				Channel *channel = channels[array][channelNumber];
-				if (channel != &disabledChannel)
-				{
-					double channelOutput = channel->getChannelOutput(this);
-					output[0] += float(channelOutput * channel->leftPan);
-					output[1] += float(channelOutput * channel->rightPan);
-				}
-			}
+		double channelOutput = channel->T::getChannelOutput(this);
+		output[0] += float(channelOutput * channel->leftPan);
+		output[1] += float(channelOutput * channel->rightPan);
 
-		// Advances the OPL3-wide vibrato index, which is used by 
-		// PhaseGenerator.getPhase() in each Operator.
 		vibratoIndex = (vibratoIndex + 1) & (OPL3DataStruct::vibratoTableLength - 1);
-		// Advances the OPL3-wide tremolo index, which is used by 
-		// EnvelopeGenerator.getEnvelope() in each Operator.
 		tremoloIndex++;
 		if(tremoloIndex >= OPL3DataStruct::tremoloTableLength) tremoloIndex = 0;
 		output += 2;
 	}
 }
 
+void OPL3::Update(float *output, int numsamples) {
+	// Channels are independent within a block, so rendering one channel
+	// after the other adds the same values to each sample in the same
+	// order as going through all channels for each sample.
+	const int startVibrato = vibratoIndex, startTremolo = tremoloIndex;
+
+	// If _new = 0, use OPL2 mode with 9 channels. If _new = 1, use OPL3 18 channels;
+	for(int array=0; array < (_new + 1); array++)
+		for(int channelNumber=0; channelNumber < 9; channelNumber++) {
+			Channel *channel = channels[array][channelNumber];
+			vibratoIndex = startVibrato;
+			tremoloIndex = startTremolo;
+			switch (channel->kind) {
+				case Channel::KIND_2OP:
+					renderChannel(static_cast<Channel2op *>(channel), output, numsamples);
+					break;
+				case Channel::KIND_4OP:
+					renderChannel(static_cast<Channel4op *>(channel), output, numsamples);
+					break;
+				case Channel::KIND_RHYTHM:
+					renderChannel(static_cast<RhythmChannel *>(channel), output, numsamples);
+					break;
+				case Channel::KIND_BASSDRUM:
+					renderChannel(static_cast<BassDrumChannel *>(channel), output, numsamples);
+					break;
+				case Channel::KIND_DISABLED:
+					break;
+			}
+		}
+
+	// Advances the OPL3-wide vibrato and tremolo indexes, which are used by
+	// PhaseGenerator.getPhase() and EnvelopeGenerator.getEnvelope() in each Operator.
+	vibratoIndex = (startVibrato + numsamples) & (OPL3DataStruct::vibratoTableLength - 1);
+	tremoloIndex = (startTremolo + numsamples) % OPL3DataStruct::tremoloTableLength;
+}
+
 void OPL3::write(int array, int address, int data) {
     // The OPL3 has two registers arrays, each with adresses ranging
     // from 0x00 to 0xF5.
@@ -722,11 +766,8 @@ OPL3::OPL3(bool fullpan)
     nts = dam = dvb = ryt = bd = sd = tom = tc = hh = _new = connectionsel = 0;
     vibratoIndex = tremoloIndex = 0; 
 
-	if (InstanceCount++ == 0)
-	{
-		OPL3Data = new struct OPL3DataStruct;
-		OperatorData = new struct OperatorDataStruct;
-	}
+	static const bool tablesBuilt = initTables();
+	(void)tablesBuilt;
 
     initOperators();
     initChannels2op();
@@ -757,13 +798,6 @@ OPL3::~OPL3()
 			delete channels4op[array][channelNumber];
 		}
 	}
-	if (--InstanceCount == 0)
-	{
-		delete OPL3Data;
-		OPL3Data = NULL;
-		delete OperatorData;
-		OperatorData = NULL;
-	}
 }
 
 
@@ -977,6 +1011,7 @@ static double EnvelopeFromDB(double db)
 }
 
 Channel::Channel (int baseAddress, double startvol) {
+	kind = KIND_2OP;
 	channelBaseAddress = baseAddress;
 	fnuml = fnumh = kon = block = fb = cnt = 0;
 	feedback[0] = feedback[1] = 0;
@@ -1101,6 +1136,7 @@ void Channel2op::updateOperators(OPL3 *OPL3) {
 Channel4op::Channel4op (int baseAddress, double startvol, Operator *o1, Operator *o2, Operator *o3, Operator *o4)
 : Channel(baseAddress, startvol)
 {
+	kind = KIND_4OP;
 	op1 = o1;
 	op2 = o2;
 	op3 = o3;
@@ -1684,7 +1720,9 @@ double SnareDrumOperator::getOperatorOutput(OPL3 *OPL3, double modulator) {
 BassDrumChannel::BassDrumChannel(double startvol)
 : Channel2op(bassDrumChannelBaseAddress, startvol, &my_op1, &my_op2),
   my_op1(op1BaseAddress), my_op2(op2BaseAddress)
-{ }
+{
+	kind = KIND_BASSDRUM;
+}
 
 double BassDrumChannel::getChannelOutput(OPL3 *OPL3) {
 	// Bass Drum ignores first operator, when it is in series.
@@ -1848,6 +1886,25 @@ void OPL3::WriteReg(int reg, int v)
 	write(reg >> 8, reg & 0xFF, v);
 }
 
+bool OPL3::IsIdle() const
+{
+	// The rhythm operators replace some of the regular ones while rhythm mode is on.
+	const Operator *const rhythm[] = { &highHatOperator, &snareDrumOperator, &tomTomOperator, &topCymbalOperator };
+	for (const Operator *op : rhythm)
+	{
+		if (op->envelopeGenerator.stage != EnvelopeGenerator::OFF) return false;
+	}
+	for (int array = 0; array < 2; array++)
+	{
+		for (int i = 0; i < 0x20; i++)
+		{
+			const Operator *op = operators[array][i];
+			if (op != NULL && op->envelopeGenerator.stage != EnvelopeGenerator::OFF) return false;
+		}
+	}
+	return true;
+}
+
 void OPL3::SetPanning(int c, float left, float right)
 {
 	if (FullPan)
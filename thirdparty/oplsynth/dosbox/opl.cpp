@@ -465,9 +465,43 @@ void DBOPL::disable_operator(op_type* op_pt, Bit32u act_type) {
 	}
 }
 
+// create the waveform and key scale level tables
+static bool init_tables() {
+	Bits i, j, oct;
+
+	// create waveform tables
+	for (i=0;i<(WAVEPREC>>1);i++) {
+		wavtable[(i<<1)  +WAVEPREC]	= (Bit16s)(16384*sin((fltype)((i<<1)  )*PI*2/WAVEPREC));
+		wavtable[(i<<1)+1+WAVEPREC]	= (Bit16s)(16384*sin((fltype)((i<<1)+1)*PI*2/WAVEPREC));
+		wavtable[i]					= wavtable[(i<<1)  +WAVEPREC];
+		// alternative: (zero-less)
+/*			wavtable[(i<<1)  +WAVEPREC]	= (Bit16s)(16384*sin((fltype)((i<<2)+1)*PI/WAVEPREC));
+		wavtable[(i<<1)+1+WAVEPREC]	= (Bit16s)(16384*sin((fltype)((i<<2)+3)*PI/WAVEPREC));
+		wavtable[i]					= wavtable[(i<<1)-1+WAVEPREC]; */
+	}
+	for (i=0;i<(WAVEPREC>>3);i++) {
+		wavtable[i+(WAVEPREC<<1)]		= wavtable[i+(WAVEPREC>>3)]-16384;
+		wavtable[i+((WAVEPREC*17)>>3)]	= wavtable[i+(WAVEPREC>>2)]+16384;
+	}
+
+	// key scale level table verified ([table in book]*8/3)
+	kslev[7][0] = 0;	kslev[7][1] = 24;	kslev[7][2] = 32;	kslev[7][3] = 37;
+	kslev[7][4] = 40;	kslev[7][5] = 43;	kslev[7][6] = 45;	kslev[7][7] = 47;
+	kslev[7][8] = 48;
+	for (i=9;i<16;i++) kslev[7][i] = (Bit8u)(i+41);
+	for (j=6;j>=0;j--) {
+		for (i=0;i<16;i++) {
+			oct = (Bits)kslev[j+1][i]-8;
+			if (oct < 0) oct = 0;
+			kslev[j][i] = (Bit8u)oct;
+		}
+	}
+	return true;
+}
+
 void DBOPL::Reset() {
 	Bit32u samplerate = (Bit32u)OPL_SAMPLE_RATE;
-	Bits i, j, oct;
+	Bits i;
 
 	int_samplerate = samplerate;
 
@@ -551,38 +585,9 @@ void DBOPL::Reset() {
 	for (i=0; i<BLOCKBUF_SIZE; i++) tremval_const[i] = FIXEDPT;
 
 
-	static Bitu initfirstime = 0;
-	if (!initfirstime) {
-		initfirstime = 1;
-
-		// create waveform tables
-		for (i=0;i<(WAVEPREC>>1);i++) {
-			wavtable[(i<<1)  +WAVEPREC]	= (Bit16s)(16384*sin((fltype)((i<<1)  )*PI*2/WAVEPREC));
-			wavtable[(i<<1)+1+WAVEPREC]	= (Bit16s)(16384*sin((fltype)((i<<1)+1)*PI*2/WAVEPREC));
-			wavtable[i]					= wavtable[(i<<1)  +WAVEPREC];
-			// alternative: (zero-less)
-/*			wavtable[(i<<1)  +WAVEPREC]	= (Bit16s)(16384*sin((fltype)((i<<2)+1)*PI/WAVEPREC));
-			wavtable[(i<<1)+1+WAVEPREC]	= (Bit16s)(16384*sin((fltype)((i<<2)+3)*PI/WAVEPREC));
-			wavtable[i]					= wavtable[(i<<1)-1+WAVEPREC]; */
-		}
-		for (i=0;i<(WAVEPREC>>3);i++) {
-			wavtable[i+(WAVEPREC<<1)]		= wavtable[i+(WAVEPREC>>3)]-16384;
-			wavtable[i+((WAVEPREC*17)>>3)]	= wavtable[i+(WAVEPREC>>2)]+16384;
-		}
-
-		// key scale level table verified ([table in book]*8/3)
-		kslev[7][0] = 0;	kslev[7][1] = 24;	kslev[7][2] = 32;	kslev[7][3] = 37;
-		kslev[7][4] = 40;	kslev[7][5] = 43;	kslev[7][6] = 45;	kslev[7][7] = 47;
-		kslev[7][8] = 48;
-		for (i=9;i<16;i++) kslev[7][i] = (Bit8u)(i+41);
-		for (j=6;j>=0;j--) {
-			for (i=0;i<16;i++) {
-				oct = (Bits)kslev[j+1][i]-8;
-				if (oct < 0) oct = 0;
-				kslev[j][i] = (Bit8u)oct;
-			}
-		}
-	}
+	// The tables are shared by all chips and built by the first one.
+	static const bool tables_built = init_tables();
+	(void)tables_built;
 
 }
 
@@ -1420,6 +1425,18 @@ void DBOPL::Update(float* sndptr, int numsamples) {
 	}
 }
 
+bool DBOPL::IsIdle() const
+{
+	for (Bitu i = 0; i < MAXOPERATORS; i++)
+	{
+		if (op[i].op_state != OF_TYPE_OFF)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 void DBOPL::SetPanning(int c, float left, float right)
 {
 	if (FullPan)
@@ -223,6 +223,7 @@ public:
 	void Update(float* sndptr, int numsamples);
 	void WriteReg(int idx, int val);
 	void SetPanning(int c, float left, float right);
+	bool IsIdle() const;
 
 	DBOPL(bool stereo);
 };
@@ -560,8 +560,19 @@ static signed int output;
 static uint32_t	LFO_AM;
 static int32_t	LFO_PM;
 
-static bool CalcVoice (FM_OPL *OPL, int voice, float *buffer, int length);
-static bool CalcRhythm (FM_OPL *OPL, float *buffer, int length);
+/* The LFOs and the envelope generator clock are the same for every voice,
+   so they are stepped once for each sample of a block, not once per voice. */
+#define OPL_BLOCK_SIZE 256
+struct OPL_BLOCK_CLOCK
+{
+	uint32_t	lfo_am[OPL_BLOCK_SIZE];
+	int32_t		lfo_pm[OPL_BLOCK_SIZE];
+	uint32_t	eg_steps[OPL_BLOCK_SIZE];	/* envelope generator ticks after each sample */
+	uint32_t	eg_cnt;						/* at the start of the block */
+};
+
+static bool CalcVoice (FM_OPL *OPL, int voice, float *buffer, int length, const OPL_BLOCK_CLOCK &ticks);
+static bool CalcRhythm (FM_OPL *OPL, float *buffer, int length, const OPL_BLOCK_CLOCK &ticks);
 
 
 
@@ -603,43 +614,53 @@ static inline void OPL_STATUSMASK_SET(FM_OPL *OPL,int flag)
 }
 
 
-/* advance LFO to next sample */
-static inline void advance_lfo(FM_OPL *OPL)
+/* step the LFOs and the envelope generator clock through a block */
+static void advance_clock(FM_OPL *OPL, OPL_BLOCK_CLOCK &ticks, int length)
 {
-	uint8_t tmp;
+	ticks.eg_cnt = OPL->eg_cnt;
+	for (int i = 0; i < length; ++i)
+	{
+		/* LFO */
+		OPL->lfo_am_cnt += OPL->lfo_am_inc;
+		if (OPL->lfo_am_cnt >= (uint32_t)(LFO_AM_TAB_ELEMENTS<<LFO_SH) )	/* lfo_am_table is 210 elements long */
+			OPL->lfo_am_cnt -= (LFO_AM_TAB_ELEMENTS<<LFO_SH);
 
-	/* LFO */
-	OPL->lfo_am_cnt += OPL->lfo_am_inc;
-	if (OPL->lfo_am_cnt >= (uint32_t)(LFO_AM_TAB_ELEMENTS<<LFO_SH) )	/* lfo_am_table is 210 elements long */
-		OPL->lfo_am_cnt -= (LFO_AM_TAB_ELEMENTS<<LFO_SH);
+		uint8_t tmp = lfo_am_table[ OPL->lfo_am_cnt >> LFO_SH ];
 
-	tmp = lfo_am_table[ OPL->lfo_am_cnt >> LFO_SH ];
+		if (OPL->lfo_am_depth)
+			ticks.lfo_am[i] = tmp;
+		else
+			ticks.lfo_am[i] = tmp>>2;
 
-	if (OPL->lfo_am_depth)
-		LFO_AM = tmp;
-	else
-		LFO_AM = tmp>>2;
+		OPL->lfo_pm_cnt += OPL->lfo_pm_inc;
+		ticks.lfo_pm[i] = ((OPL->lfo_pm_cnt>>LFO_SH) & 7) | OPL->lfo_pm_depth_range;
 
-	OPL->lfo_pm_cnt += OPL->lfo_pm_inc;
-	LFO_PM = ((OPL->lfo_pm_cnt>>LFO_SH) & 7) | OPL->lfo_pm_depth_range;
+		/* envelope generator clock */
+		uint32_t steps = 0;
+		OPL->eg_timer += OPL->eg_timer_add;
+		while (OPL->eg_timer >= OPL->eg_timer_overflow)
+		{
+			OPL->eg_timer -= OPL->eg_timer_overflow;
+			steps++;
+		}
+		ticks.eg_steps[i] = steps;
+		OPL->eg_cnt += steps;
+	}
 }
 
 /* advance to next sample */
-static inline void advance(FM_OPL *OPL, int loch, int hich)
+static inline void advance(FM_OPL *OPL, uint32_t &eg_cnt, uint32_t eg_steps, int loch, int hich)
 {
 	OPL_CH *CH;
 	OPL_SLOT *op;
 	int i;
 
-	OPL->eg_timer += OPL->eg_timer_add;
 	loch *= 2;
 	hich *= 2;
 
-	while (OPL->eg_timer >= OPL->eg_timer_overflow)
+	while (eg_steps--)
 	{
-		OPL->eg_timer -= OPL->eg_timer_overflow;
-
-		OPL->eg_cnt++;
+		eg_cnt++;
 
 		for (i = loch; i <= hich + 1; i++)
 		{
@@ -650,10 +671,10 @@ static inline void advance(FM_OPL *OPL, int loch, int hich)
 			switch(op->state)
 			{
 			case EG_ATT:		/* attack phase */
-				if ( !(OPL->eg_cnt & ((1<<op->eg_sh_ar)-1) ) )
+				if ( !(eg_cnt & ((1<<op->eg_sh_ar)-1) ) )
 				{
 					op->volume += (~op->volume *
-	                        		           (eg_inc[op->eg_sel_ar + ((OPL->eg_cnt>>op->eg_sh_ar)&7)])
+	                        		           (eg_inc[op->eg_sel_ar + ((eg_cnt>>op->eg_sh_ar)&7)])
         			                          ) >>3;
 
 					if (op->volume <= MIN_ATT_INDEX)
@@ -666,9 +687,9 @@ static inline void advance(FM_OPL *OPL, int loch, int hich)
 			break;
 
 			case EG_DEC:    /* decay phase */
-				if ( !(OPL->eg_cnt & ((1<<op->eg_sh_dr)-1) ) )
+				if ( !(eg_cnt & ((1<<op->eg_sh_dr)-1) ) )
 				{
-					op->volume += eg_inc[op->eg_sel_dr + ((OPL->eg_cnt>>op->eg_sh_dr)&7)];
+					op->volume += eg_inc[op->eg_sel_dr + ((eg_cnt>>op->eg_sh_dr)&7)];
 
 					if ( op->volume >= (int32_t)op->sl )
 						op->state = EG_SUS;
@@ -689,9 +710,9 @@ static inline void advance(FM_OPL *OPL, int loch, int hich)
 				else                /* percussive mode */
 				{
 					/* during sustain phase chip adds Release Rate (in percussive mode) */
-					if ( !(OPL->eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
+					if ( !(eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
 					{
-						op->volume += eg_inc[op->eg_sel_rr + ((OPL->eg_cnt>>op->eg_sh_rr)&7)];
+						op->volume += eg_inc[op->eg_sel_rr + ((eg_cnt>>op->eg_sh_rr)&7)];
 
 						if ( op->volume >= MAX_ATT_INDEX )
 							op->volume = MAX_ATT_INDEX;
@@ -701,9 +722,9 @@ static inline void advance(FM_OPL *OPL, int loch, int hich)
 			break;
 
 			case EG_REL:    /* release phase */
-				if ( !(OPL->eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
+				if ( !(eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
 				{
-					op->volume += eg_inc[op->eg_sel_rr + ((OPL->eg_cnt>>op->eg_sh_rr)&7)];
+					op->volume += eg_inc[op->eg_sel_rr + ((eg_cnt>>op->eg_sh_rr)&7)];
 
 					if ( op->volume >= MAX_ATT_INDEX )
 					{
@@ -1052,20 +1073,12 @@ static inline void OPL_CALC_RH( OPL_CH *CH, unsigned int noise )
 
 
 /* generic table initialize */
-static void init_tables(void)
+static bool init_tables(void)
 {
 	signed int i,x;
 	signed int n;
 	double o,m;
 
-	/* We only need to do this once. */
-	static bool did_init = false;
-
-	if (did_init)
-	{
-		return;
-	}
-
 	for (x=0; x<TL_RES_LEN; x++)
 	{
 		m = (1<<16) / pow(2.0, (x+1) * (ENV_STEP/4.0) / 8.0);
@@ -1139,7 +1152,7 @@ static void init_tables(void)
 			sin_tab[3*SIN_LEN+i] = sin_tab[i & (SIN_MASK>>2)];
 	}
 
-	did_init = true;
+	return true;
 }
 
 static void OPL_initalize(FM_OPL *OPL)
@@ -1537,7 +1550,9 @@ public:
 	/* Create one of virtual YM3812 */
 	YM3812(bool stereo)
 	{
-		init_tables();
+		/* We only need to do this once, for all chips. */
+		static const bool did_init = init_tables();
+		(void)did_init;
 
 		/* clear */
 		memset(&Chip, 0, sizeof(Chip));
@@ -1580,38 +1595,24 @@ public:
 		int i;
 
 		uint8_t		rhythm = Chip.rhythm&0x20;
+		const int	channels = Chip.IsStereo ? 2 : 1;
+		OPL_BLOCK_CLOCK	ticks;
 
-		uint32_t lfo_am_cnt_bak = Chip.lfo_am_cnt;
-		uint32_t eg_timer_bak = Chip.eg_timer;
-		uint32_t eg_cnt_bak = Chip.eg_cnt;
-
-		uint32_t lfo_am_cnt_out = lfo_am_cnt_bak;
-		uint32_t eg_timer_out = eg_timer_bak;
-		uint32_t eg_cnt_out = eg_cnt_bak;
-
-		for (i = 0; i <= (rhythm ? 5 : 8); ++i)
+		while (length > 0)
 		{
-			Chip.lfo_am_cnt = lfo_am_cnt_bak;
-			Chip.eg_timer = eg_timer_bak;
-			Chip.eg_cnt = eg_cnt_bak;
-			if (CalcVoice (&Chip, i, buffer, length))
+			int block = length < OPL_BLOCK_SIZE ? length : OPL_BLOCK_SIZE;
+			advance_clock(&Chip, ticks, block);
+
+			for (i = 0; i <= (rhythm ? 5 : 8); ++i)
 			{
-				lfo_am_cnt_out = Chip.lfo_am_cnt;
-				eg_timer_out = Chip.eg_timer;
-				eg_cnt_out = Chip.eg_cnt;
+				CalcVoice (&Chip, i, buffer, block, ticks);
 			}
-		}
-
-		Chip.lfo_am_cnt = lfo_am_cnt_out;
-		Chip.eg_timer = eg_timer_out;
-		Chip.eg_cnt = eg_cnt_out;
-
-		if (rhythm)		/* Rhythm part */
-		{
-			Chip.lfo_am_cnt = lfo_am_cnt_bak;
-			Chip.eg_timer = eg_timer_bak;
-			Chip.eg_cnt = eg_cnt_bak;
-			CalcRhythm (&Chip, buffer, length);
+			if (rhythm)		/* Rhythm part */
+			{
+				CalcRhythm (&Chip, buffer, block, ticks);
+			}
+			buffer += block * channels;
+			length -= block;
 		}
 	}
 
@@ -1649,9 +1650,10 @@ OPLEmul *YM3812Create(bool stereo)
 // [RH] Render a whole voice at once. If nothing else, it lets us avoid
 // wasting a lot of time on voices that aren't playing anything.
 
-static bool CalcVoice (FM_OPL *OPL, int voice, float *buffer, int length)
+static bool CalcVoice (FM_OPL *OPL, int voice, float *buffer, int length, const OPL_BLOCK_CLOCK &ticks)
 {
 	OPL_CH *const CH = &OPL->P_CH[voice];
+	uint32_t eg_cnt = ticks.eg_cnt;
 	int i;
 
 	if (CH->SLOT[0].state == EG_OFF && CH->SLOT[1].state == EG_OFF)
@@ -1661,7 +1663,8 @@ static bool CalcVoice (FM_OPL *OPL, int voice, float *buffer, int length)
 
 	for (i = 0; i < length; ++i)
 	{
-		advance_lfo(OPL);
+		LFO_AM = ticks.lfo_am[i];
+		LFO_PM = ticks.lfo_pm[i];
 
 		output = 0;
 		float sample = OPL_CALC_CH(CH);
@@ -1675,18 +1678,20 @@ static bool CalcVoice (FM_OPL *OPL, int voice, float *buffer, int length)
 			buffer[i*2+1] += sample * CH->RightVol;
 		}
 
-		advance(OPL, voice, voice);
+		advance(OPL, eg_cnt, ticks.eg_steps[i], voice, voice);
 	}
 	return true;
 }
 
-static bool CalcRhythm (FM_OPL *OPL, float *buffer, int length)
+static bool CalcRhythm (FM_OPL *OPL, float *buffer, int length, const OPL_BLOCK_CLOCK &ticks)
 {
+	uint32_t eg_cnt = ticks.eg_cnt;
 	int i;
 
 	for (i = 0; i < length; ++i)
 	{
-		advance_lfo(OPL);
+		LFO_AM = ticks.lfo_am[i];
+		LFO_PM = ticks.lfo_pm[i];
 
 		output = 0;
 		OPL_CALC_RH(&OPL->P_CH[0], OPL->noise_rng & 1);
@@ -1704,7 +1709,7 @@ static bool CalcRhythm (FM_OPL *OPL, float *buffer, int length)
 			buffer[i*2+1] += sample * CENTER_PANNING_POWER;
 		}
 
-		advance(OPL, 6, 8);
+		advance(OPL, eg_cnt, ticks.eg_steps[i], 6, 8);
 		advance_noise(OPL);
 	}
 	return true;
@@ -34,12 +34,48 @@ musicBlock::musicBlock ()
 	memset (this, 0, sizeof(*this));
 	for(auto &oplchannel : oplchannels) oplchannel.Panning = 64;	// default to center panning.
 	for(auto &voice : voices) voice.index = ~0u;	// mark all free.
+	resetVoiceLists();
 }
 
 musicBlock::~musicBlock ()
 {
 }
 
+//----------------------------------------------------------------------------
+//
+// Voice lists
+//
+//----------------------------------------------------------------------------
+
+void musicBlock::resetVoiceLists()
+{
+	for (int i = 0; i < NUM_LISTS; i++) listHead[i] = listTail[i] = -1;
+	for (auto &link : voiceLinks) link = { -1, -1, LIST_NONE };
+}
+
+void musicBlock::linkVoice(uint32_t slot, int list)
+{
+	unlinkVoice(slot);
+	auto &link = voiceLinks[slot];
+	link.list = list;
+	link.prev = listTail[list];
+	link.next = -1;
+	if (link.prev >= 0) voiceLinks[link.prev].next = slot;
+	else listHead[list] = slot;
+	listTail[list] = slot;
+}
+
+void musicBlock::unlinkVoice(uint32_t slot)
+{
+	auto &link = voiceLinks[slot];
+	if (link.list == LIST_NONE) return;
+	if (link.prev >= 0) voiceLinks[link.prev].next = link.next;
+	else listHead[link.list] = link.next;
+	if (link.next >= 0) voiceLinks[link.next].prev = link.prev;
+	else listTail[link.list] = link.prev;
+	link = { -1, -1, LIST_NONE };
+}
+
 //----------------------------------------------------------------------------
 //
 // 
@@ -54,6 +90,7 @@ int musicBlock::releaseVoice(uint32_t slot, uint32_t killed)
 	ch->sustained = false;
 	if (!killed) ch->timestamp = ++timeCounter;
 	if (killed) io->MuteChannel(slot);
+	linkVoice(slot, LIST_FREE);
 	return slot;
 }
 
@@ -68,17 +105,8 @@ int musicBlock::findFreeVoice()
 	// We want to prefer the least recently freed voice, as more recently
 	// freed voices can still play a tone from their release state.
 	// Sustained voices are replaced when there are no free voices.
-	uint32_t min_value = ~0u;
-	int result = -1;
-	for (uint32_t i = 0; i < io->NumChannels; ++i)
-	{
-		uint32_t voice_value = voices[i].timestamp + (voices[i].sustained ? (1 << 31) : 0);
-		if ((voices[i].index == ~0u || voices[i].sustained) && (voice_value < min_value))
-		{
-			min_value = voice_value;
-			result = i;
-		}
-	}
+	int result = listHead[LIST_FREE];
+	if (result < 0) result = listHead[LIST_SUSTAINED];
 	if (result >= 0)
 	{
 		releaseVoice(result, 1);
@@ -97,23 +125,15 @@ int musicBlock::findFreeVoice()
 
 int musicBlock::replaceExistingVoice()
 {
-	// Check the allocated voices, if we find an instrument that is
-	// of a lower priority to the new instrument, discard it.
 	// If a voice is being used to play the second voice of an instrument,
 	// use that, as second voices are non-essential.
 	// Lower numbered MIDI channels implicitly have a higher priority
 	// than higher-numbered channels, eg. MIDI channel 1 is never
-	// discarded for MIDI channel 2.
-	int result = 0;
-
-	for (uint32_t i = 0; i < io->NumChannels; ++i)
-	{
-		if (voices[i].current_instr_voice == &voices[i].current_instr->voices[1] ||
-			voices[i].index >= voices[result].index)
-		{
-			result = i;
-		}
-	}
+	// discarded for MIDI channel 2. Within a channel the oldest note goes.
+	int result = -1;
+	for (int i = NUM_CHANNELS - 1; i >= 0 && result < 0; i--) result = listHead[LIST_SECOND + i];
+	for (int i = NUM_CHANNELS - 1; i >= 0 && result < 0; i--) result = listHead[LIST_FIRST + i];
+	if (result < 0) return -1;
 
 	releaseVoice(result, 1);
 	return result;
@@ -133,6 +153,7 @@ void musicBlock::voiceKeyOn(uint32_t slot, uint32_t channo, GenMidiInstrument *i
 
 	voice->index = channo;
 	voice->key = key;
+	linkVoice(slot, (instrument_voice != 0 ? LIST_SECOND : LIST_FIRST) + channo);
 
 	// Program the voice with the instrument data:
 	voice->current_instr = instrument;
@@ -249,6 +270,7 @@ void musicBlock::noteOff(uint32_t id, uint8_t note)
 			{
 				voices[i].sustained = true;
 				voices[i].timestamp = ++timeCounter;
+				linkVoice(i, LIST_SUSTAINED);
 			}
 			else releaseVoice(i, 0);
 		}
@@ -374,6 +396,7 @@ void musicBlock::notesOff(uint32_t id, int value)
 			{
 				voices[i].sustained = true;
 				voices[i].timestamp = ++timeCounter;
+				linkVoice(i, LIST_SUSTAINED);
 			}
 			else releaseVoice(i, 0);
 		}
@@ -495,4 +518,8 @@ void musicBlock::stopAllVoices()
 		voices[i].timestamp = 0;
 	}
 	timeCounter = 0;
+
+	// With all of them released at once they go in the order of their slots.
+	resetVoiceLists();
+	for (uint32_t i = 0; i < io->NumChannels; i++) linkVoice(i, LIST_FREE);
 }
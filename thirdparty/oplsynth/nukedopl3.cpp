@@ -297,21 +297,21 @@ void envelope_gen_release(opl_slot *slot) {
 	slot->eg_rout += slot->eg_inc;
 }
 
-void envelope_calc(opl_slot *slot) {
+void envelope_calc(opl_slot *slot, Bit16u timer, Bit8u trem) {
 	Bit8u rate_h, rate_l;
 	rate_h = slot->eg_rate >> 2;
 	rate_l = slot->eg_rate & 3;
 	Bit8u inc = 0;
 	if (eg_incsh[rate_h] > 0) {
-		if ((slot->chip->timer & ((1 << eg_incsh[rate_h]) - 1)) == 0) {
-			inc = eg_incstep[eg_incdesc[rate_h]][rate_l][((slot->chip->timer) >> eg_incsh[rate_h]) & 0x07];
+		if ((timer & ((1 << eg_incsh[rate_h]) - 1)) == 0) {
+			inc = eg_incstep[eg_incdesc[rate_h]][rate_l][(timer >> eg_incsh[rate_h]) & 0x07];
 		}
 	}
 	else {
-		inc = eg_incstep[eg_incdesc[rate_h]][rate_l][slot->chip->timer & 0x07] << (-eg_incsh[rate_h]);
+		inc = eg_incstep[eg_incdesc[rate_h]][rate_l][timer & 0x07] << (-eg_incsh[rate_h]);
 	}
 	slot->eg_inc = inc;
-	slot->eg_out = slot->eg_rout + (slot->reg_tl << 2) + (slot->eg_ksl >> kslshift[slot->reg_ksl]) + *slot->trem;
+	slot->eg_out = slot->eg_rout + (slot->reg_tl << 2) + (slot->eg_ksl >> kslshift[slot->reg_ksl]) + trem;
 	envelope_gen[slot->eg_gen](slot);
 }
 
@@ -343,11 +343,11 @@ void eg_keyoff(opl_slot *slot, Bit8u type) {
 // Phase Generator
 //
 
-void pg_generate(opl_slot *slot) {
+void pg_generate(opl_slot *slot, Bit16u timer) {
 	Bit16u f_num = slot->channel->f_num;
 	if (slot->reg_vib) {
-		Bit8u f_num_high = f_num >> (7 + vib_table[(slot->chip->timer >> 10) & 0x07] + (0x01 - slot->chip->dvb));
-		f_num += f_num_high * vibsgn_table[(slot->chip->timer >> 10) & 0x07];
+		Bit8u f_num_high = f_num >> (7 + vib_table[(timer >> 10) & 0x07] + (0x01 - slot->chip->dvb));
+		f_num += f_num_high * vibsgn_table[(timer >> 10) & 0x07];
 	}
 	slot->pg_phase += (((f_num << slot->channel->block) >> 1) * mt[slot->reg_mult]) >> 1;
 }
@@ -409,16 +409,16 @@ void slot_writee0(opl_slot *slot, Bit8u data) {
 	}
 }
 
-void slot_generatephase(opl_slot *slot, Bit16u phase) {
-	slot->out = envelope_sin[slot->reg_wf](phase, slot->eg_out);
+void slot_generatephase(opl_slot *slot, Bit16u phase, Bit16s eg_out) {
+	slot->out = envelope_sin[slot->reg_wf](phase, eg_out);
 }
 
-void slot_generate(opl_slot *slot) {
-	slot->out = envelope_sin[slot->reg_wf]((Bit16u)(slot->pg_phase >> 9) + (*slot->mod), slot->eg_out);
+void slot_generate(opl_slot *slot, Bit32u pg_phase, Bit16s eg_out) {
+	slot->out = envelope_sin[slot->reg_wf]((Bit16u)(pg_phase >> 9) + (*slot->mod), eg_out);
 }
 
-void slot_generatezm(opl_slot *slot) {
-	slot->out = envelope_sin[slot->reg_wf]((Bit16u)(slot->pg_phase >> 9), slot->eg_out);
+void slot_generatezm(opl_slot *slot, Bit32u pg_phase, Bit16s eg_out) {
+	slot->out = envelope_sin[slot->reg_wf]((Bit16u)(pg_phase >> 9), eg_out);
 }
 
 void slot_calcfb(opl_slot *slot) {
@@ -666,39 +666,124 @@ void chan_writec0(opl_channel *channel, Bit8u data) {
 	}
 }
 
-void chan_generaterhythm1(opl_chip *chip) {
-	opl_channel *channel6 = &chip->channel[6];
-	opl_channel *channel7 = &chip->channel[7];
-	opl_channel *channel8 = &chip->channel[8];
-	slot_generate(channel6->slots[0]);
-	Bit16u phase14 = (channel7->slots[0]->pg_phase >> 9) & 0x3ff;
-	Bit16u phase17 = (channel8->slots[1]->pg_phase >> 9) & 0x3ff;
+//
+// Block generation
+//
+
+// The phase and envelope generators don't depend on the slot outputs, so
+// Update runs them for a block of samples one slot at a time and keeps the
+// results here. The sample loop then only does the waveforms and mixing.
+#define OPL_BLOCK 64
+
+struct opl_block {
+	Bit32u pg_phase[36][OPL_BLOCK + 1];	// [0] is the phase before the block
+	Bit16s eg_out[36][OPL_BLOCK];
+};
+
+#define BLOCK_PHASE(ii) blk->pg_phase[ii][i + 1]
+#define BLOCK_EG(ii) blk->eg_out[ii][i]
+#define BLOCK_SLOT(ii) &chip->slot[ii], BLOCK_PHASE(ii), BLOCK_EG(ii)
+
+void chip_prepare(opl_chip *chip, opl_block *blk, Bit32u count) {
+	Bit8u trem[OPL_BLOCK];
+	Bit16u timer = chip->timer;
+
+	for (Bit32u i = 0; i < count; i++) {
+		trem[i] = chip->tremval;
+		if (((timer + i) & 0x3f) == 0x3f) {
+			if (!chip->tremdir) {
+				if (chip->tremtval == 105) {
+					chip->tremtval--;
+					chip->tremdir = 1;
+				}
+				else {
+					chip->tremtval++;
+				}
+			}
+			else {
+				if (chip->tremtval == 0) {
+					chip->tremtval++;
+					chip->tremdir = 0;
+				}
+				else {
+					chip->tremtval--;
+				}
+			}
+			chip->tremval = (chip->tremtval >> 2) >> ((1 - chip->dam) << 1);
+		}
+	}
+	chip->timer = timer + count;
+
+	for (Bit8u ii = 0; ii < 36; ii++) {
+		opl_slot *slot = &chip->slot[ii];
+		bool tremolo = slot->trem == &chip->tremval;
+		Bit32u *pg_phase = blk->pg_phase[ii];
+		Bit16s *eg_out = blk->eg_out[ii];
+
+		pg_phase[0] = slot->pg_phase;
+		if (slot->reg_vib) {
+			for (Bit32u i = 0; i < count; i++) {
+				pg_generate(slot, timer + i);
+				pg_phase[i + 1] = slot->pg_phase;
+			}
+		}
+		else {
+			// without vibrato the phase step is the same for every sample
+			Bit32u step = (((slot->channel->f_num << slot->channel->block) >> 1) * mt[slot->reg_mult]) >> 1;
+			for (Bit32u i = 0; i < count; i++) {
+				pg_phase[i + 1] = pg_phase[i] + step;
+			}
+			slot->pg_phase = pg_phase[count];
+		}
+
+		envelope_calc(slot, timer, tremolo ? trem[0] : 0);
+		eg_out[0] = slot->eg_out;
+		if (slot->eg_gen == envelope_gen_num_off || (slot->eg_gen == envelope_gen_num_sustain && slot->reg_type)) {
+			// a switched off slot or a held note keeps its envelope level,
+			// only the tremolo can still change the output
+			Bit32s level = slot->eg_rout + (slot->reg_tl << 2) + (slot->eg_ksl >> kslshift[slot->reg_ksl]);
+			for (Bit32u i = 1; i < count; i++) {
+				eg_out[i] = level + (tremolo ? trem[i] : 0);
+			}
+			slot->eg_out = eg_out[count - 1];
+		}
+		else {
+			for (Bit32u i = 1; i < count; i++) {
+				envelope_calc(slot, timer + i, tremolo ? trem[i] : 0);
+				eg_out[i] = slot->eg_out;
+			}
+		}
+	}
+}
+
+void chan_generaterhythm1(opl_chip *chip, const opl_block *blk, Bit32u i) {
+	slot_generate(BLOCK_SLOT(12));
+	Bit16u phase14 = (BLOCK_PHASE(13) >> 9) & 0x3ff;
+	// slot 17 is only stepped after this, so it still has the last sample's phase
+	Bit16u phase17 = (blk->pg_phase[17][i] >> 9) & 0x3ff;
 	Bit16u phase = 0x00;
 	//hh tc phase bit
 	Bit16u phasebit = ((phase14 & 0x08) | (((phase14 >> 5) ^ phase14) & 0x04) | (((phase17 >> 2) ^ phase17) & 0x08)) ? 0x01 : 0x00;
 	//hh
 	phase = (phasebit << 9) | (0x34 << ((phasebit ^ (chip->noise & 0x01) << 1)));
-	slot_generatephase(channel7->slots[0], phase);
+	slot_generatephase(&chip->slot[13], phase, BLOCK_EG(13));
 	//tt
-	slot_generatezm(channel8->slots[0]);
+	slot_generatezm(BLOCK_SLOT(14));
 }
 
-void chan_generaterhythm2(opl_chip *chip) {
-	opl_channel *channel6 = &chip->channel[6];
-	opl_channel *channel7 = &chip->channel[7];
-	opl_channel *channel8 = &chip->channel[8];
-	slot_generate(channel6->slots[1]);
-	Bit16u phase14 = (channel7->slots[0]->pg_phase >> 9) & 0x3ff;
-	Bit16u phase17 = (channel8->slots[1]->pg_phase >> 9) & 0x3ff;
+void chan_generaterhythm2(opl_chip *chip, const opl_block *blk, Bit32u i) {
+	slot_generate(BLOCK_SLOT(15));
+	Bit16u phase14 = (BLOCK_PHASE(13) >> 9) & 0x3ff;
+	Bit16u phase17 = (BLOCK_PHASE(17) >> 9) & 0x3ff;
 	Bit16u phase = 0x00;
 	//hh tc phase bit
 	Bit16u phasebit = ((phase14 & 0x08) | (((phase14 >> 5) ^ phase14) & 0x04) | (((phase17 >> 2) ^ phase17) & 0x08)) ? 0x01 : 0x00;
 	//sd
 	phase = (0x100 << ((phase14 >> 8) & 0x01)) ^ ((chip->noise & 0x01) << 8);
-	slot_generatephase(channel7->slots[1], phase);
+	slot_generatephase(&chip->slot[16], phase, BLOCK_EG(16));
 	//tc
 	phase = 0x100 | (phasebit << 9);
-	slot_generatephase(channel8->slots[1], phase);
+	slot_generatephase(&chip->slot[17], phase, BLOCK_EG(17));
 }
 
 void chan_enable(opl_channel *channel) {
@@ -766,29 +851,25 @@ Bit16s limshort(Bit32s a) {
 	return (Bit16s)a;
 }
 
-void chip_generate(opl_chip *chip, Bit16s *buff) {
+void chip_generate(opl_chip *chip, const opl_block *blk, Bit32u i, Bit16s *buff) {
 	buff[1] = limshort(chip->mixbuff[1]);
 
 	for (Bit8u ii = 0; ii < 12; ii++) {
 		slot_calcfb(&chip->slot[ii]);
-		pg_generate(&chip->slot[ii]);
-		envelope_calc(&chip->slot[ii]);
-		slot_generate(&chip->slot[ii]);
+		slot_generate(BLOCK_SLOT(ii));
 	}
 
 	for (Bit8u ii = 12; ii < 15; ii++) {
 		slot_calcfb(&chip->slot[ii]);
-		pg_generate(&chip->slot[ii]);
-		envelope_calc(&chip->slot[ii]);
 	}
 
 	if (chip->rhy & 0x20) {
-		chan_generaterhythm1(chip);
+		chan_generaterhythm1(chip, blk, i);
 	}
 	else {
-		slot_generate(&chip->slot[12]);
-		slot_generate(&chip->slot[13]);
-		slot_generate(&chip->slot[14]);
+		slot_generate(BLOCK_SLOT(12));
+		slot_generate(BLOCK_SLOT(13));
+		slot_generate(BLOCK_SLOT(14));
 	}
 
 	chip->mixbuff[0] = 0;
@@ -807,26 +888,22 @@ void chip_generate(opl_chip *chip, Bit16s *buff) {
 
 	for (Bit8u ii = 15; ii < 18; ii++) {
 		slot_calcfb(&chip->slot[ii]);
-		pg_generate(&chip->slot[ii]);
-		envelope_calc(&chip->slot[ii]);
 	}
 
 	if (chip->rhy & 0x20) {
-		chan_generaterhythm2(chip);
+		chan_generaterhythm2(chip, blk, i);
 	}
 	else {
-		slot_generate(&chip->slot[15]);
-		slot_generate(&chip->slot[16]);
-		slot_generate(&chip->slot[17]);
+		slot_generate(BLOCK_SLOT(15));
+		slot_generate(BLOCK_SLOT(16));
+		slot_generate(BLOCK_SLOT(17));
 	}
 
 	buff[0] = limshort(chip->mixbuff[0]);
 
 	for (Bit8u ii = 18; ii < 33; ii++) {
 		slot_calcfb(&chip->slot[ii]);
-		pg_generate(&chip->slot[ii]);
-		envelope_calc(&chip->slot[ii]);
-		slot_generate(&chip->slot[ii]);
+		slot_generate(BLOCK_SLOT(ii));
 	}
 
 	chip->mixbuff[1] = 0;
@@ -845,38 +922,16 @@ void chip_generate(opl_chip *chip, Bit16s *buff) {
 
 	for (Bit8u ii = 33; ii < 36; ii++) {
 		slot_calcfb(&chip->slot[ii]);
-		pg_generate(&chip->slot[ii]);
-		envelope_calc(&chip->slot[ii]);
-		slot_generate(&chip->slot[ii]);
+		slot_generate(BLOCK_SLOT(ii));
 	}
 
 	n_generate(chip);
-
-	if ((chip->timer & 0x3f) == 0x3f) {
-		if (!chip->tremdir) {
-			if (chip->tremtval == 105) {
-				chip->tremtval--;
-				chip->tremdir = 1;
-			}
-			else {
-				chip->tremtval++;
-			}
-		}
-		else {
-			if (chip->tremtval == 0) {
-				chip->tremtval++;
-				chip->tremdir = 0;
-			}
-			else {
-				chip->tremtval--;
-			}
-		}
-		chip->tremval = (chip->tremtval >> 2) >> ((1 - chip->dam) << 1);
-	}
-
-	chip->timer++;
 }
 
+#undef BLOCK_PHASE
+#undef BLOCK_EG
+#undef BLOCK_SLOT
+
 void NukedOPL3::Reset() {
 	memset(&opl3, 0, sizeof(opl_chip));
 	for (Bit8u slotnum = 0; slotnum < 36; slotnum++) {
@@ -1001,11 +1056,26 @@ void NukedOPL3::WriteReg(int reg, int v) {
 
 void NukedOPL3::Update(float* sndptr, int numsamples) {
 	Bit16s buffer[2];
-	for (Bit32u i = 0; i < (Bit32u)numsamples; i++) {
-		chip_generate(&opl3, buffer);
-		*sndptr++ += (float)(buffer[0] / 10240.0);
-		*sndptr++ += (float)(buffer[1] / 10240.0);
+	opl_block blk;
+	while (numsamples > 0) {
+		Bit32u count = numsamples < OPL_BLOCK ? numsamples : OPL_BLOCK;
+		chip_prepare(&opl3, &blk, count);
+		for (Bit32u i = 0; i < count; i++) {
+			chip_generate(&opl3, &blk, i, buffer);
+			*sndptr++ += (float)(buffer[0] / 10240.0);
+			*sndptr++ += (float)(buffer[1] / 10240.0);
+		}
+		numsamples -= count;
+	}
+}
+
+bool NukedOPL3::IsIdle() const {
+	for (Bit8u slotnum = 0; slotnum < 36; slotnum++) {
+		if (opl3.slot[slotnum].key || opl3.slot[slotnum].eg_rout != 0x1ff) {
+			return false;
+		}
 	}
+	return true;
 }
 
 void NukedOPL3::SetPanning(int c, float left, float right) {
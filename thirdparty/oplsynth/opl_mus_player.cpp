@@ -42,32 +42,78 @@
 #include "opl_mus_player.h"
 #include "opl.h"
 #include "o_swap.h"
+#include "../../source/zmusic/parallel.h"
+#include "../../source/zmusic/emulatorselect.h"
 
 
 #define IMF_RATE				700.0
+#define SEEK_SETTLE_TIME		(2 * OPL_SAMPLE_RATE)
+#define SNAPSHOT_INTERVAL		(10 * OPL_SAMPLE_RATE)
 
-OPLmusicBlock::OPLmusicBlock(int core, int numchips)
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+OPLmusicBlock::OPLmusicBlock(int core, int numchips, int threads)
 {
-	currentCore = core;
-	scoredata = NULL;
 	NextTickIn = 0;
 	LastOffset = 0;
-	NumChips = std::min(numchips, 2);
+	NumChips = std::min<int>(numchips, MAXOPL2CHIPS);
 	Looping = false;
 	FullPan = false;
+	ChipThreads = NULL;
 	io = NULL;
+
+	if (threads <= 0) threads = (int)ZMusic_JobThreads();
+	if (core == EMULATOR_AUTO) core = SelectCore(threads);
+	currentCore = core;
+
+	// The OPL3 cores emulate two OPL2 chips with one.
+	int realchips = (core >= 1 && core <= 3) ? (NumChips + 1) >> 1 : NumChips;
+	if (threads > realchips) threads = realchips;
+	// The YM3812 core keeps some of its work state in globals shared by all chips.
+	if (threads > 1 && core != 0)
+	{
+		ChipThreads = new FWorkerGroup;
+		if (ChipThreads->Start(threads) < 2)
+		{
+			delete ChipThreads;
+			ChipThreads = NULL;
+		}
+	}
 	io = new OPLio;
 }
 
+//==========================================================================
+//
+// For the "auto" core, which only picks from the OPL3 ones, so that it
+// always plays in stereo.
+//
+//==========================================================================
+
+int OPLmusicBlock::SelectCore(int threads)
+{
+	static const int cores[] = { 3, 1, 2 };	// Nuked, DOSBox, Java
+	const int realchips = (NumChips + 1) >> 1;
+	const int workers = std::max(std::min(threads, realchips), 1);
+	const int rounds = (realchips + workers - 1) / workers;	// chips each thread renders one after the other.
+	std::string key = "opl/" + std::to_string(rounds);
+	int pick = ZMusic_SelectEmulator(key, 3, [=](int i) { return OPLio::MeasureCore(cores[i]) * rounds; });
+	return cores[pick];
+}
+
 OPLmusicBlock::~OPLmusicBlock()
 {
 	delete io;
+	delete ChipThreads;
 }
 
 void OPLmusicBlock::ResetChips (int numchips)
 {
 	io->Reset ();
-	NumChips = io->Init(currentCore, std::min(numchips, 2), FullPan, false);
+	NumChips = io->Init(currentCore, std::min<int>(numchips, MAXOPL2CHIPS), FullPan, false);
 }
 
 void OPLmusicBlock::Restart()
@@ -78,42 +124,171 @@ void OPLmusicBlock::Restart()
 	LastOffset = 0;
 }
 
-OPLmusicFile::OPLmusicFile (const void *data, size_t length, int core, int numchips, const char *&errormessage)
-	: OPLmusicBlock(core, numchips), ScoreLen ((int)length)
+OPLmusicFile::OPLmusicFile (const void *data, size_t length, int core, int numchips, int threads, const char *&errormessage)
+	: OPLmusicBlock(core, numchips, threads)
 {
-	static char errorbuffer[80];
 	errormessage = nullptr;
 	if (io == nullptr)
 	{
 		return;
 	}
 
-	scoredata = new uint8_t[ScoreLen];
-	memcpy(scoredata, data, length);
-
 	if (0 == (NumChips = io->Init(core, NumChips, false, false)))
 	{
-		goto fail;
+		return;
+	}
+	if (!Compile((const uint8_t *)data, length, errormessage))
+	{
+		return;
 	}
+	TakeSnapshots();
+	Valid = true;
+	Restart ();
+}
+
+//==========================================================================
+//
+// Converts the score to the event list. Each format's delays, chip
+// selection and register encoding only need to be decoded here, playback
+// works on the events alone.
+//
+//==========================================================================
 
+static uint32_t MakeEvent(int type, uint32_t value)
+{
+	return (uint32_t(type) << 30) | value;
+}
+
+static uint32_t MakeWrite(int chip, uint8_t reg, uint8_t data)
+{
+	return (uint32_t(chip & 1) << 16) | (reg << 8) | data;
+}
+
+bool OPLmusicFile::Compile(const uint8_t *scoredata, size_t length, const char *&errormessage)
+{
+	static char errorbuffer[80];
+	const uint8_t *score;
+	const uint8_t *end = scoredata + length;
+	int whichchip = 0;
+
+	auto delay = [this](uint32_t ticks)
+	{
+		if (ticks > 0) Events.push_back(MakeEvent(EV_DELAY, ticks));
+	};
+
+	if (length < 8)
+	{
+		errormessage = "Unknown OPL format";
+		return false;
+	}
 	// Check for RDosPlay raw OPL format
 	if (!memcmp(scoredata, "RAWADATA", 8))
 	{
-		RawPlayer = RDosPlay;
-		if (*(uint16_t *)(scoredata + 8) == 0)
+		if (length < 10)
+		{
+			return false;
+		}
+		uint16_t clock = scoredata[8] | (scoredata[9] << 8);
+		if (clock == 0)
 		{ // A clock speed of 0 is bad
-			*(uint16_t *)(scoredata + 8) = 0xFFFF; 
+			clock = 0xFFFF;
+		}
+		StartSamplesPerTick = clock / ADLIB_CLOCK_MUL;
+		for (score = scoredata + 10; end - score >= 2; )
+		{
+			uint8_t data = *score++;
+			uint8_t reg = *score++;
+			switch (reg)
+			{
+			case 0:		// Delay
+				delay(data);
+				break;
+
+			case 2:		// Speed change or OPL3 switch
+				if (data == 0)
+				{
+					if (end - score < 2) return true;
+					Events.push_back(MakeEvent(EV_CLOCK, score[0] | (score[1] << 8)));
+					score += 2;
+				}
+				else if (data == 1)
+				{
+					whichchip = 0;
+				}
+				else if (data == 2)
+				{
+					whichchip = 1;
+				}
+				break;
+
+			case 0xFF:	// End of song
+				if (data == 0xFF)
+				{
+					return true;
+				}
+				break;
+
+			default:	// It's something to stuff into the OPL chip
+				Events.push_back(MakeWrite(whichchip, reg, data));
+				break;
+			}
 		}
-		SamplesPerTick = LittleShort(*(uint16_t *)(scoredata + 8)) / ADLIB_CLOCK_MUL;
+		return true;
 	}
 	// Check for DosBox OPL dump
 	else if (!memcmp(scoredata, "DBRAWOPL", 8))
 	{
+		if (length < 24)
+		{
+			errormessage = "Unknown OPL format";
+			return false;
+		}
+		StartSamplesPerTick = OPL_SAMPLE_RATE / 1000;
 		if (LittleShort(((uint16_t *)scoredata)[5]) == 1)
 		{
-			RawPlayer = DosBox1;
-			SamplesPerTick = OPL_SAMPLE_RATE / 1000;
-			ScoreLen = std::min<int>(ScoreLen - 24, LittleLong(((uint32_t *)scoredata)[4])) + 24;
+			end = scoredata + std::min<size_t>(length - 24, LittleLong(((uint32_t *)scoredata)[4])) + 24;
+			for (score = scoredata + 24; score < end; )
+			{
+				uint8_t reg = *score++;
+				uint8_t data;
+
+				if (reg == 4)
+				{
+					if (end - score < 2) break;
+					reg = *score++;
+					data = *score++;
+				}
+				else if (reg == 0)
+				{ // One-byte delay
+					if (score == end) break;
+					delay(*score++ + 1);
+					continue;
+				}
+				else if (reg == 1)
+				{ // Two-byte delay
+					if (end - score < 2) break;
+					delay(score[0] + (score[1] << 8) + 1);
+					score += 2;
+					continue;
+				}
+				else if (reg == 2)
+				{ // Select OPL chip 0
+					whichchip = 0;
+					continue;
+				}
+				else if (reg == 3)
+				{ // Select OPL chip 1
+					whichchip = 1;
+					continue;
+				}
+				else
+				{
+					if (score == end) break;
+					data = *score++;
+				}
+				Events.push_back(MakeWrite(whichchip, reg, data));
+			}
+			return true;
 		}
 		else if (LittleLong(((uint32_t *)scoredata)[2]) == 2)
 		{
@@ -130,74 +305,174 @@ OPLmusicFile::OPLmusicFile (const void *data, size_t length, int core, int numch
 				errormessage = errorbuffer;
 				okay = false;
 			}
-			if (!okay)
-				goto fail;
-			RawPlayer = DosBox2;
-			SamplesPerTick = OPL_SAMPLE_RATE / 1000;
-			int headersize = 0x1A + scoredata[0x19];
-			ScoreLen = std::min<int>(ScoreLen - headersize, LittleLong(((uint32_t *)scoredata)[3]) * 2) + headersize;
+			size_t headersize = 0x1A + scoredata[0x19];
+			if (!okay || length < headersize)
+				return false;
+			end = scoredata + std::min<size_t>(length - headersize, size_t(LittleLong(((uint32_t *)scoredata)[3])) * 2) + headersize;
+
+			const uint8_t *to_reg = scoredata + 0x1A;
+			uint8_t to_reg_size = scoredata[0x19];
+			uint8_t short_delay_code = scoredata[0x17];
+			uint8_t long_delay_code = scoredata[0x18];
+
+			for (score = scoredata + headersize; end - score >= 2; )
+			{
+				uint8_t code = *score++;
+				uint8_t data = *score++;
+
+				// Which OPL chip to write to is encoded in the high bit of the code value.
+				int which = !!(code & 0x80);
+				code &= 0x7F;
+
+				if (code == short_delay_code)
+				{
+					delay(data + 1);
+				}
+				else if (code == long_delay_code)
+				{
+					delay((data + 1) << 8);
+				}
+				else if (code < to_reg_size)
+				{
+					Events.push_back(MakeWrite(which, to_reg[code], data));
+				}
+			}
+			return true;
 		}
 		else
 		{
 			snprintf(errorbuffer, 80, "Unsupported DOSBox Raw OPL version %d.%d\n", LittleShort(((uint16_t *)scoredata)[4]), LittleShort(((uint16_t *)scoredata)[5]));
 			errormessage = errorbuffer;
-			goto fail;
+			return false;
 		}
 	}
 	// Check for modified IMF format (includes a header)
 	else if (!memcmp(scoredata, "ADLIB\1", 6))
 	{
-		int songlen;
-		uint8_t *max = scoredata + ScoreLen;
-		RawPlayer = IMF;
-		SamplesPerTick = OPL_SAMPLE_RATE / IMF_RATE;
+		StartSamplesPerTick = OPL_SAMPLE_RATE / IMF_RATE;
 
 		score = scoredata + 6;
 		// Skip track and game name
 		for (int i = 2; i != 0; --i)
 		{
-			while (score < max && *score++ != '\0') {}
+			while (score < end && *score++ != '\0') {}
 		}
-		if (score < max) score++;	// Skip unknown byte
-		if (score + 8 > max)
+		if (score < end) score++;	// Skip unknown byte
+		if (score + 8 > end)
 		{ // Not enough room left for song data
-			goto fail;
+			return false;
 		}
-		songlen = LittleLong(*(uint32_t *)score);
-		if (songlen != 0 && (songlen +=4) < ScoreLen - (score - scoredata))
+		uint32_t songlen = LittleLong(*(uint32_t *)score);
+		if (songlen != 0)
 		{
-			ScoreLen = songlen + int(score - scoredata);
+			if (songlen + 4 < size_t(end - score))
+			{
+				end = score + songlen + 4;
+			}
+			score += 4;		// Skip song length
 		}
+		for (; end - score >= 4; score += 4)
+		{
+			if (*(uint32_t *)score == 0xFFFFFFFF)
+			{ // This is a special value that means to end the song.
+				return true;
+			}
+			Events.push_back(MakeWrite(0, score[0], score[1]));
+			delay(score[2] | (score[3] << 8));
+		}
+		return true;
 	}
-	else
+	errormessage = "Unknown OPL format";
+	return false;
+}
+
+//==========================================================================
+//
+// Plays the score through once to record the registers every
+// SNAPSHOT_INTERVAL samples, with the same arithmetic as Seek.
+//
+//==========================================================================
+
+void OPLmusicFile::TakeSnapshots()
+{
+	Snapshot state = {};
+	double samplespertick = StartSamplesPerTick;
+	double tick = 0;
+	double next = SNAPSHOT_INTERVAL;
+
+	for (size_t i = 0; i < Events.size(); i++)
 	{
-		errormessage = "Unknown OPL format";
-		goto fail;
+		uint32_t ev = Events[i];
+		switch (ev >> 30)
+		{
+		case EV_WRITE:
+		{
+			int chip = (ev >> 16) & 1, reg = (ev >> 8) & 0xFF;
+			state.Regs[chip][reg] = uint8_t(ev);
+			state.Written[chip][reg >> 3] |= 1 << (reg & 7);
+			break;
+		}
+
+		case EV_CLOCK:
+			samplespertick = (ev & 0xFFFF) / ADLIB_CLOCK_MUL;
+			break;
+
+		case EV_DELAY:
+			tick += samplespertick * (ev & 0x3FFFFFFF);
+			if (tick >= next)
+			{
+				state.Event = i + 1;
+				state.Tick = tick;
+				state.SamplesPerTick = samplespertick;
+				Snapshots.push_back(state);
+				while (next <= tick) next += SNAPSHOT_INTERVAL;
+			}
+			break;
+		}
 	}
+	SongLength = tick;
+}
 
-	Restart ();
-	return;
+//==========================================================================
+//
+// Writes the registers a snapshot has, with the ones that start notes
+// last. Registers the score had not written yet keep their reset state.
+//
+//==========================================================================
 
-fail:
-	delete[] scoredata;
-	scoredata = nullptr;
-	return;
+void OPLmusicFile::RestoreSnapshot(const Snapshot &snap)
+{
+	static const uint8_t ranges[][2] = { { 0x00, 0x1F }, { 0x20, 0xAF }, { 0xC0, 0xFF }, { 0xB0, 0xBF } };
 
+	for (auto &range : ranges)
+	{
+		for (int chip = 0; chip < 2; chip++)
+		{
+			for (int reg = range[0]; reg <= range[1]; reg++)
+			{
+				if (snap.Written[chip][reg >> 3] & (1 << (reg & 7)))
+				{
+					io->WriteRegister(chip, reg, snap.Regs[chip][reg]);
+				}
+			}
+		}
+	}
+	EventPos = snap.Event;
+	SamplesPerTick = snap.SamplesPerTick;
+	io->SetClockRate(SamplesPerTick);
 }
 
 OPLmusicFile::~OPLmusicFile ()
 {
-	if (scoredata != NULL)
+	if (Valid)
 	{
 		io->Reset ();
-		delete[] scoredata;
-		scoredata = NULL;
 	}
 }
 
 bool OPLmusicFile::IsValid () const
 {
-	return scoredata != NULL;
+	return Valid;
 }
 
 void OPLmusicFile::SetLooping (bool loop)
@@ -208,42 +483,111 @@ void OPLmusicFile::SetLooping (bool loop)
 void OPLmusicFile::Restart ()
 {
 	OPLmusicBlock::Restart();
-	WhichChip = 0;
-	switch (RawPlayer)
-	{
-	case RDosPlay:
-		score = scoredata + 10;
-		SamplesPerTick = LittleShort(*(uint16_t *)(scoredata + 8)) / ADLIB_CLOCK_MUL;
-		break;
-
-	case DosBox1:
-		score = scoredata + 24;
-		SamplesPerTick = OPL_SAMPLE_RATE / 1000;
-		break;
-
-	case DosBox2:
-		score = scoredata + 0x1A + scoredata[0x19];
-		SamplesPerTick = OPL_SAMPLE_RATE / 1000;
-		break;
-
-	case IMF:
-		score = scoredata + 6;
+	EventPos = 0;
+	SamplesPerTick = StartSamplesPerTick;
+	io->SetClockRate(SamplesPerTick);
+}
 
-		// Skip track and game name
-		for (int i = 2; i != 0; --i)
+//==========================================================================
+//
+// Moves playback to 'position' samples from the start of the song.
+//
+// The score is replayed from the last snapshot before the target, or from
+// the start if the target is past a loop, and every register write is
+// applied right away. Only the last two seconds before the target get
+// emulated, which is enough for most notes sounding there to reach their
+// proper volume, so everything before that costs little more than reading
+// the score.
+//
+//==========================================================================
+
+bool OPLmusicFile::Seek(double position)
+{
+	double settle = position - SEEK_SETTLE_TIME;
+	double now = 0;
+	double tick = 0;	// when the next tick is due
+	bool prevEnded = false;
+	bool wrapped = false;
+	bool done = false;
+
+	ResetChips(NumChips);
+	Restart();
+	io->Position = 0;
+	if (!Looping || position < SongLength)
+	{
+		auto snap = std::upper_bound(Snapshots.begin(), Snapshots.end(), settle,
+			[](double pos, const Snapshot &snap) { return pos < snap.Tick; });
+		if (snap != Snapshots.begin())
 		{
-			while (*score++ != '\0') {}
+			--snap;
+			RestoreSnapshot(*snap);
+			tick = now = snap->Tick;
 		}
-		score++;	// Skip unknown byte
-		if (*(uint32_t *)score != 0)
+	}
+	for (;;)
+	{
+		double end = std::min(tick, position);
+		if (end > settle)
 		{
-			score += 4;		// Skip song length
+			int length = int(end) - int(std::max(now, settle));
+			for (uint32_t i = 0; i < io->NumChips; ++i)
+			{
+				io->chips[i]->Advance(length);
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < io->NumChips; ++i)
+			{
+				io->chips[i]->FlushQueue();
+			}
+		}
+		now = end;
+		if (done || tick > position)
+		{
+			break;
+		}
+
+		int next = PlayTick();
+		if (next == 0)
+		{ // end of song
+			if (!Looping || prevEnded || tick == 0)
+			{
+				// Still let the chips run up to the target.
+				tick = position;
+				done = true;
+				continue;
+			}
+			// Don't replay the song over and over for targets far beyond its end.
+			if (!wrapped)
+			{
+				position = tick + fmod(position - tick, tick);
+				settle = position - SEEK_SETTLE_TIME;
+				wrapped = true;
+			}
+			prevEnded = true;
+			Restart();
+		}
+		else
+		{
+			prevEnded = false;
+			io->WriteDelay(next);
+			tick += SamplesPerTick * next;
 		}
-		break;
 	}
-	io->SetClockRate(SamplesPerTick);
+	NextTickIn = tick - position;
+	LastOffset = 0;
+	return true;
 }
 
+//==========================================================================
+//
+// The score is played for the whole buffer first. The register writes are
+// queued with the sample they belong to, so every chip can render the
+// buffer in one go instead of once for every tick.
+//
+//==========================================================================
+
 bool OPLmusicBlock::ServiceStream (void *buff, int numbytes)
 {
 	float *samples1 = (float *)buff;
@@ -254,23 +598,21 @@ bool OPLmusicBlock::ServiceStream (void *buff, int numbytes)
 
 	memset(buff, 0, numbytes);
 
+	Segments.clear();
+	io->Position = 0;
 	while (numsamples > 0)
 	{
 		int tick_in = int(NextTickIn);
 		int samplesleft = std::min(numsamples, tick_in);
-		size_t i;
 
 		if (samplesleft > 0)
 		{
-			for (i = 0; i < io->NumChips; ++i)
-			{
-				io->chips[i]->Update(samples1, samplesleft);
-			}
-			OffsetSamples(samples1, samplesleft << stereoshift);
+			Segments.push_back(io->Position);
+			Segments.push_back(samplesleft);
+			io->Position += samplesleft;
 			NextTickIn -= samplesleft;
 			assert (NextTickIn >= 0);
 			numsamples -= samplesleft;
-			samples1 += samplesleft << stereoshift;
 		}
 		
 		if (NextTickIn < 1)
@@ -283,11 +625,9 @@ bool OPLmusicBlock::ServiceStream (void *buff, int numbytes)
 				{
 					if (numsamples > 0)
 					{
-						for (i = 0; i < io->NumChips; ++i)
-						{
-							io->chips[i]->Update(samples1, numsamples);
-						}
-						OffsetSamples(samples1, numsamples << stereoshift);
+						Segments.push_back(io->Position);
+						Segments.push_back(numsamples);
+						io->Position += numsamples;
 					}
 					res = false;
 					break;
@@ -308,9 +648,59 @@ bool OPLmusicBlock::ServiceStream (void *buff, int numbytes)
 			}
 		}
 	}
+
+	int rendered = io->Position;
+	if (ChipThreads != NULL && io->NumChips > 1)
+	{
+		RenderThreaded(samples1, rendered, stereoshift);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < io->NumChips; ++i)
+		{
+			io->chips[i]->Render(samples1, rendered, stereoshift);
+		}
+	}
+	for (size_t i = 0; i < Segments.size(); i += 2)
+	{
+		OffsetSamples(samples1 + (Segments[i] << stereoshift), Segments[i + 1] << stereoshift);
+	}
+
+	// Anything written before the next call belongs to its start.
+	io->Position = 0;
 	return res;
 }
 
+//==========================================================================
+//
+// Renders every chip into its own buffer on the worker threads.
+//
+//==========================================================================
+
+void OPLmusicBlock::RenderThreaded(float *buff, int numsamples, int stereoshift)
+{
+	int count = numsamples << stereoshift;
+
+	ChipBuffers.resize(io->NumChips);
+	auto render = [&](size_t i)
+	{
+		ChipBuffers[i].assign(count, 0.f);
+		io->chips[i]->Render(ChipBuffers[i].data(), numsamples, stereoshift);
+	};
+	ChipThreads->Run(io->NumChips, render);
+
+	// Adding the chips up in order matches rendering them one after another into the same buffer,
+	// apart from rounding in the cores that add every channel to the buffer separately.
+	for (uint32_t i = 0; i < io->NumChips; i++)
+	{
+		const float *chipbuf = ChipBuffers[i].data();
+		for (int j = 0; j < count; j++)
+		{
+			buff[j] += chipbuf[j];
+		}
+	}
+}
+
 void OPLmusicBlock::OffsetSamples(float *buff, int count)
 {
 	// Three out of four of the OPL waveforms are non-negative. Depending on
@@ -386,142 +776,23 @@ void OPLmusicBlock::OffsetSamples(float *buff, int count)
 
 int OPLmusicFile::PlayTick ()
 {
-	uint8_t reg, data;
-	uint16_t delay;
-
-	switch (RawPlayer)
+	while (EventPos < Events.size())
 	{
-	case RDosPlay:
-		while (score < scoredata + ScoreLen)
+		uint32_t ev = Events[EventPos++];
+		switch (ev >> 30)
 		{
-			data = *score++;
-			reg = *score++;
-			switch (reg)
-			{
-			case 0:		// Delay
-				if (data != 0)
-				{
-					return data;
-				}
-				break;
+		case EV_WRITE:
+			io->WriteRegister((ev >> 16) & 1, (ev >> 8) & 0xFF, uint8_t(ev));
+			break;
 
-			case 2:		// Speed change or OPL3 switch
-				if (data == 0)
-				{
-					SamplesPerTick = LittleShort(*(uint16_t *)(score)) / ADLIB_CLOCK_MUL;
-					io->SetClockRate(SamplesPerTick);
-					score += 2;
-				}
-				else if (data == 1)
-				{
-					WhichChip = 0;
-				}
-				else if (data == 2)
-				{
-					WhichChip = 1;
-				}
-				break;
-
-			case 0xFF:	// End of song
-				if (data == 0xFF)
-				{
-					return 0;
-				}
-				break;
+		case EV_DELAY:
+			return int(ev & 0x3FFFFFFF);
 
-			default:	// It's something to stuff into the OPL chip
-				io->WriteRegister(WhichChip, reg, data);
-				break;
-			}
+		case EV_CLOCK:
+			SamplesPerTick = (ev & 0xFFFF) / ADLIB_CLOCK_MUL;
+			io->SetClockRate(SamplesPerTick);
+			break;
 		}
-		break;
-
-	case DosBox1:
-		while (score < scoredata + ScoreLen)
-		{
-			reg = *score++;
-
-			if (reg == 4)
-			{
-				reg = *score++;
-				data = *score++;
-			}
-			else if (reg == 0)
-			{ // One-byte delay
-				return *score++ + 1;
-			}
-			else if (reg == 1)
-			{ // Two-byte delay
-				int delay = score[0] + (score[1] << 8) + 1;
-				score += 2;
-				return delay;
-			}
-			else if (reg == 2)
-			{ // Select OPL chip 0
-				WhichChip = 0;
-				continue;
-			}
-			else if (reg == 3)
-			{ // Select OPL chip 1
-				WhichChip = 1;
-				continue;
-			}
-			else
-			{
-				data = *score++;
-			}
-			io->WriteRegister(WhichChip, reg, data);
-		}
-		break;
-
-	case DosBox2:
-		{
-			uint8_t *to_reg = scoredata + 0x1A;
-			uint8_t to_reg_size = scoredata[0x19];
-			uint8_t short_delay_code = scoredata[0x17];
-			uint8_t long_delay_code = scoredata[0x18];
-
-			while (score < scoredata + ScoreLen)
-			{
-				uint8_t code = *score++;
-				data = *score++;
-
-				// Which OPL chip to write to is encoded in the high bit of the code value.
-				int which = !!(code & 0x80);
-				code &= 0x7F;
-
-				if (code == short_delay_code)
-				{
-					return data + 1;
-				}
-				else if (code == long_delay_code)
-				{
-					return (data + 1) << 8;
-				}
-				else if (code < to_reg_size)
-				{
-					io->WriteRegister(which, to_reg[code], data);
-				}
-			}
-		}
-		break;
-
-	case IMF:
-		delay = 0;
-		while (delay == 0 && score + 4 - scoredata <= ScoreLen)
-		{
-			if (*(uint32_t *)score == 0xFFFFFFFF)
-			{ // This is a special value that means to end the song.
-				return 0;
-			}
-			reg = score[0];
-			data = score[1];
-			delay = LittleShort(((uint16_t *)score)[1]);
-			score += 4;
-			io->WriteRegister (0, reg, data);
-		}
-		return delay;
 	}
 	return 0;
 }
-
@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <algorithm>
 #include <string.h>
+#include <chrono>
 
 #include "genmidi.h"
 #include "oplio.h"
@@ -34,6 +35,15 @@
 
 const double HALF_PI = (3.14159265358979323846 * 0.5);
 
+using CoreInit = OPLEmul* (*)(bool);
+static const CoreInit CoreInits[] =
+{
+	YM3812Create,
+	DBOPLCreate,
+	JavaOPLCreate,
+	NukedOPL3Create,
+};
+
 OPLio::~OPLio()
 {
 }
@@ -58,15 +68,6 @@ int OPLio::Init(int core, uint32_t numchips, bool stereo, bool initopl3)
 	uint32_t i;
 	IsOPL3 = (core == 1 || core == 2 || core == 3);
 
-	using CoreInit = OPLEmul* (*)(bool);
-	static CoreInit inits[] =
-	{
-		YM3812Create,
-		DBOPLCreate,
-		JavaOPLCreate,
-		NukedOPL3Create,
-	};
-
 	if (core < 0) core = 0;
 	if (core > 3) core = 3;
 
@@ -77,7 +78,7 @@ int OPLio::Init(int core, uint32_t numchips, bool stereo, bool initopl3)
 	}
 	for (i = 0; i < numchips; ++i)
 	{
-		OPLEmul* chip = inits[core](stereo);
+		OPLEmul* chip = CoreInits[core](stereo);
 		if (chip == NULL)
 		{
 			break;
@@ -90,6 +91,40 @@ int OPLio::Init(int core, uint32_t numchips, bool stereo, bool initopl3)
 	return i;
 }
 
+//----------------------------------------------------------------------------
+//
+// The time one chip of a core takes to render a second with a note
+// playing, in seconds. For the "auto" core.
+//
+//----------------------------------------------------------------------------
+
+double OPLio::MeasureCore(int core)
+{
+	if (core < 0 || core > 3) return 0;
+	OPLEmul *chip = CoreInits[core](true);
+	if (chip == NULL) return 0;
+
+	// A plain sine on the first channel, both operators at full volume.
+	static const uint8_t regs[][2] =
+	{
+		{ 0x20, 0x01 }, { 0x23, 0x01 }, { 0x40, 0x00 }, { 0x43, 0x00 },
+		{ 0x60, 0xf0 }, { 0x63, 0xf0 }, { 0x80, 0x07 }, { 0x83, 0x07 },
+		{ 0xc0, 0x31 }, { 0xa0, 0x98 }, { 0xb0, 0x31 },
+	};
+	for (auto &r : regs) chip->WriteReg(r[0], r[1]);
+
+	const int block = 512;
+	const int blocks = int(OPL_SAMPLE_RATE / 20 / block);
+	float buffer[block * 2];
+	memset(buffer, 0, sizeof(buffer));
+	chip->Update(buffer, block);
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < blocks; i++) chip->Update(buffer, block);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	delete chip;
+	return elapsed.count() * OPL_SAMPLE_RATE / (double(blocks) * block);
+}
+
 //----------------------------------------------------------------------------
 //
 // 
@@ -152,7 +187,7 @@ void OPLio::WriteRegister(int chipnum, uint32_t reg, uint8_t data)
 	}
 	if (chips[chipnum] != nullptr)
 	{
-		chips[chipnum]->WriteReg(reg, data);
+		chips[chipnum]->QueueReg(Position, reg, data);
 	}
 }
 
@@ -410,7 +445,7 @@ void OPLio::WritePan(uint32_t channel, struct GenMidiVoice *voice, int pan)
 			// This is the MIDI-recommended pan formula. 0 and 1 are
 			// both hard left so that 64 can be perfectly center.
 			double level = (pan <= 1) ? 0 : (pan - 1) / 126.0;
-			chips[which]->SetPanning(channel % chanper,
+			chips[which]->QueuePanning(Position, channel % chanper,
 				(float)cos(HALF_PI * level), (float)sin(HALF_PI * level));
 		}
 	}
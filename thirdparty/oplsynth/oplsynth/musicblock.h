@@ -47,6 +47,32 @@ struct musicBlock {
 protected:
 	OPLVoice voices[NUM_VOICES];
 
+	// Voice lists, so that finding a voice for a note does not depend on how many
+	// there are: the free voices in the order they were released, the sustained
+	// ones in the order their notes ended, and the playing ones of every channel,
+	// first and second voices apart, in the order they started.
+	enum
+	{
+		LIST_FREE,
+		LIST_SUSTAINED,
+		LIST_FIRST,
+		LIST_SECOND = LIST_FIRST + NUM_CHANNELS,
+		NUM_LISTS = LIST_SECOND + NUM_CHANNELS,
+		LIST_NONE = NUM_LISTS
+	};
+	struct VoiceLink
+	{
+		int16_t prev, next;
+		uint8_t list;
+	};
+	VoiceLink voiceLinks[NUM_VOICES];
+	int16_t listHead[NUM_LISTS];
+	int16_t listTail[NUM_LISTS];
+
+	void resetVoiceLists();
+	void linkVoice(uint32_t slot, int list);
+	void unlinkVoice(uint32_t slot);
+
 	int findFreeVoice();
 	int replaceExistingVoice();
 	void voiceKeyOn(uint32_t slot, uint32_t channo, GenMidiInstrument *instrument, uint32_t instrument_voice, uint32_t, uint32_t volume);
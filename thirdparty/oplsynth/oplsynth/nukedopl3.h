@@ -233,6 +233,7 @@ public:
 	void Update(float* sndptr, int numsamples);
 	void WriteReg(int reg, int v);
 	void SetPanning(int c, float left, float right);
+	bool IsIdle() const;
 
 	NukedOPL3(bool stereo);
 };
@@ -1,6 +1,10 @@
 #ifndef OPL_H
 #define OPL_H
 
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
 // Abstract base class for OPL emulators
 
 class OPLEmul
@@ -13,6 +17,92 @@ public:
 	virtual void WriteReg(int reg, int v) = 0;
 	virtual void Update(float *buffer, int length) = 0;
 	virtual void SetPanning(int c, float left, float right) = 0;
+
+	// True when every operator has gone silent and the chip only waits for
+	// its next key on. Render skips such chips until a write is queued.
+	virtual bool IsIdle() const { return false; }
+
+	// Register writes and panning changes can also be queued with the sample
+	// of the next Render call they belong to. Render generates the whole
+	// buffer and only splits it where a queued write has to be applied.
+	void QueueReg(int pos, int reg, int v)
+	{
+		Queue.push_back({ pos, reg, v, 0, 0 });
+	}
+
+	void QueuePanning(int pos, int c, float left, float right)
+	{
+		Queue.push_back({ pos, -1, c, left, right });
+	}
+
+	virtual void Render(float *buffer, int length, int stereoshift)
+	{
+		if (Queue.empty() && IsIdle())
+		{
+			return;
+		}
+		size_t w = 0;
+		for (int pos = 0; pos < length; )
+		{
+			for (; w < Queue.size() && Queue[w].Position <= pos; w++)
+			{
+				ApplyQueued(Queue[w]);
+			}
+			int end = (w < Queue.size() && Queue[w].Position < length) ? Queue[w].Position : length;
+			Update(buffer + (pos << stereoshift), end - pos);
+			pos = end;
+		}
+		// Writes made after the last sample take effect for the next buffer.
+		for (; w < Queue.size(); w++)
+		{
+			ApplyQueued(Queue[w]);
+		}
+		Queue.clear();
+	}
+
+	// Applies everything that was queued right away. Used when skipping
+	// through a song, where the chip's output isn't needed.
+	void FlushQueue()
+	{
+		for (auto &w : Queue)
+		{
+			ApplyQueued(w);
+		}
+		Queue.clear();
+	}
+
+	// Lets the chip run on for 'length' samples without output, so the
+	// envelopes are where they would be after playing them. Stops as soon
+	// as the chip is idle, since nothing changes after that.
+	virtual void Advance(int length)
+	{
+		float scratch[2 * 512];
+		FlushQueue();
+		while (length > 0 && !IsIdle())
+		{
+			int count = length < 512 ? length : 512;
+			memset(scratch, 0, sizeof(scratch));
+			Update(scratch, count);
+			length -= count;
+		}
+	}
+
+protected:
+	struct QueuedWrite
+	{
+		int Position;
+		int Reg;	// -1 for panning changes
+		int Value;
+		float Left, Right;
+	};
+
+	void ApplyQueued(const QueuedWrite &w)
+	{
+		if (w.Reg >= 0) WriteReg(w.Reg, w.Value);
+		else SetPanning(w.Value, w.Left, w.Right);
+	}
+
+	std::vector<QueuedWrite> Queue;	// sorted by position
 };
 
 OPLEmul *YM3812Create(bool stereo);
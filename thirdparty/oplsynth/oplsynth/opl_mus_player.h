@@ -4,23 +4,26 @@
 #include <string>
 #include "musicblock.h"
 
+class FWorkerGroup;
+
 class OPLmusicBlock : public musicBlock
 {
 public:
-	OPLmusicBlock(int core, int numchips);
+	OPLmusicBlock(int core, int numchips, int threads);
 	virtual ~OPLmusicBlock();
 
 	bool ServiceStream(void *buff, int numbytes);
 	void ResetChips(int numchips);
+	int GetCore() const { return currentCore; }
 
 	virtual void Restart();
 
 protected:
 	virtual int PlayTick() = 0;
 	void OffsetSamples(float *buff, int count);
+	void RenderThreaded(float *buff, int numsamples, int stereoshift);
+	int SelectCore(int threads);
 
-	uint8_t *score;
-	uint8_t *scoredata;
 	double NextTickIn;
 	double SamplesPerTick;
 	double LastOffset;
@@ -29,23 +32,53 @@ protected:
 	int currentCore;
 	bool Looping;
 	bool FullPan;
+
+	// Only set up when the chips are emulated on several threads.
+	FWorkerGroup *ChipThreads;
+	std::vector<std::vector<float>> ChipBuffers;
+
+	std::vector<int> Segments;	// start and length of the parts between two ticks
 };
 
 class OPLmusicFile : public OPLmusicBlock
 {
 public:
-	OPLmusicFile(const void *data, size_t length, int core, int numchips, const char *&errormessage);
+	OPLmusicFile(const void *data, size_t length, int core, int numchips, int threads, const char *&errormessage);
 	virtual ~OPLmusicFile();
 
 	bool IsValid() const;
 	void SetLooping(bool loop);
 	void Restart();
+	bool Seek(double position);
 
 protected:
-	OPLmusicFile(int core, int numchips) : OPLmusicBlock(core, numchips) {}
+	OPLmusicFile(int core, int numchips, int threads) : OPLmusicBlock(core, numchips, threads) {}
 	int PlayTick();
 
-	enum { RDosPlay, IMF, DosBox1, DosBox2 } RawPlayer;
-	int ScoreLen;
-	int WhichChip;
+	// All formats get compiled into one list of events when loading, each
+	// a register write, a delay in ticks or a change of the tick length.
+	enum { EV_WRITE, EV_DELAY, EV_CLOCK };
+
+	// The registers as the score left them at the start of a tick, written
+	// every SNAPSHOT_INTERVAL samples, for seeking without replaying the
+	// whole score.
+	struct Snapshot
+	{
+		size_t Event;
+		double Tick;
+		double SamplesPerTick;
+		uint8_t Regs[2][256];
+		uint8_t Written[2][256 / 8];
+	};
+
+	bool Compile(const uint8_t *data, size_t length, const char *&errormessage);
+	void TakeSnapshots();
+	void RestoreSnapshot(const Snapshot &snap);
+
+	std::vector<uint32_t> Events;
+	std::vector<Snapshot> Snapshots;
+	size_t EventPos = 0;
+	double StartSamplesPerTick = 0;
+	double SongLength = 0;	// samples until the end of the score.
+	bool Valid = false;
 };
@@ -79,7 +79,10 @@ struct OPLio
 	virtual void SetClockRate(double samples_per_tick);
 	virtual void WriteDelay(int ticks);
 
+	static double MeasureCore(int core);
+
 	class OPLEmul *chips[OPL_NUM_VOICES];
+	int Position = 0;	// sample of the next rendered buffer that new writes belong to
 	uint32_t NumChannels;
 	uint32_t NumChips;
 	bool IsOPL3;
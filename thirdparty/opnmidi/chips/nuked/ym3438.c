@@ -244,7 +244,7 @@ static const Bit16u panlawtable[] =
 
 static Bit32u chip_type = ym3438_mode_readmode;
 
-void OPN2_DoIO(ym3438_t *chip)
+static void OPN2_DoIO(ym3438_t *chip)
 {
     /* Write signal check */
     chip->write_a_en = (chip->write_a & 0x03) == 0x01;
@@ -258,7 +258,7 @@ void OPN2_DoIO(ym3438_t *chip)
     chip->write_busy_cnt &= 0x1f;
 }
 
-void OPN2_DoRegWrite(ym3438_t *chip)
+static void OPN2_DoRegWrite(ym3438_t *chip)
 {
     Bit32u i;
     Bit32u slot = chip->cycles % 12;
@@ -477,7 +477,7 @@ void OPN2_DoRegWrite(ym3438_t *chip)
     }
 }
 
-void OPN2_PhaseCalcIncrement(ym3438_t *chip)
+static void OPN2_PhaseCalcIncrement(ym3438_t *chip)
 {
     Bit32u chan = chip->channel;
     Bit32u slot = chip->cycles;
@@ -546,7 +546,7 @@ void OPN2_PhaseCalcIncrement(ym3438_t *chip)
     chip->pg_inc[slot] &= 0xfffff;
 }
 
-void OPN2_PhaseGenerate(ym3438_t *chip)
+static void OPN2_PhaseGenerate(ym3438_t *chip)
 {
     Bit32u slot;
     /* Mask increment */
@@ -565,7 +565,7 @@ void OPN2_PhaseGenerate(ym3438_t *chip)
     }
 }
 
-void OPN2_EnvelopeSSGEG(ym3438_t *chip)
+static void OPN2_EnvelopeSSGEG(ym3438_t *chip)
 {
     Bit32u slot = chip->cycles;
     Bit8u direction = 0;
@@ -612,7 +612,7 @@ void OPN2_EnvelopeSSGEG(ym3438_t *chip)
     chip->eg_ssg_enable[slot] = (chip->ssg_eg[slot] >> 3) & 0x01;
 }
 
-void OPN2_EnvelopeADSR(ym3438_t *chip)
+static void OPN2_EnvelopeADSR(ym3438_t *chip)
 {
     Bit32u slot = (chip->cycles + 22) % 24;
 
@@ -736,7 +736,7 @@ void OPN2_EnvelopeADSR(ym3438_t *chip)
     chip->eg_state[slot] = nextstate;
 }
 
-void OPN2_EnvelopePrepare(ym3438_t *chip)
+static void OPN2_EnvelopePrepare(ym3438_t *chip)
 {
     Bit8u rate;
     Bit8u sum;
@@ -824,7 +824,7 @@ void OPN2_EnvelopePrepare(ym3438_t *chip)
     chip->eg_sl[0] = chip->sl[slot];
 }
 
-void OPN2_EnvelopeGenerate(ym3438_t *chip)
+static void OPN2_EnvelopeGenerate(ym3438_t *chip)
 {
     Bit32u slot = (chip->cycles + 23) % 24;
     Bit16u level;
@@ -857,7 +857,7 @@ void OPN2_EnvelopeGenerate(ym3438_t *chip)
     chip->eg_out[slot] = level;
 }
 
-void OPN2_UpdateLFO(ym3438_t *chip)
+static void OPN2_UpdateLFO(ym3438_t *chip)
 {
     if ((chip->lfo_quotient & lfo_cycles[chip->lfo_freq]) == lfo_cycles[chip->lfo_freq])
     {
@@ -871,7 +871,7 @@ void OPN2_UpdateLFO(ym3438_t *chip)
     chip->lfo_cnt &= chip->lfo_en;
 }
 
-void OPN2_FMPrepare(ym3438_t *chip)
+static void OPN2_FMPrepare(ym3438_t *chip)
 {
     Bit32u slot = (chip->cycles + 6) % 24;
     Bit32u channel = chip->channel;
@@ -933,7 +933,7 @@ void OPN2_FMPrepare(ym3438_t *chip)
     }
 }
 
-void OPN2_ChGenerate(ym3438_t *chip)
+static void OPN2_ChGenerate(ym3438_t *chip)
 {
     Bit32u slot = (chip->cycles + 18) % 24;
     Bit32u channel = chip->channel;
@@ -968,7 +968,7 @@ void OPN2_ChGenerate(ym3438_t *chip)
     chip->ch_acc[channel] = sum;
 }
 
-void OPN2_ChOutput(ym3438_t *chip)
+static void OPN2_ChOutput(ym3438_t *chip)
 {
     Bit32u cycles = chip->cycles;
     Bit32u slot = chip->cycles;
@@ -1051,7 +1051,7 @@ void OPN2_ChOutput(ym3438_t *chip)
     }
 }
 
-void OPN2_FMGenerate(ym3438_t *chip)
+static void OPN2_FMGenerate(ym3438_t *chip)
 {
     Bit32u slot = (chip->cycles + 19) % 24;
     /* Calculate phase */
@@ -1089,7 +1089,7 @@ void OPN2_FMGenerate(ym3438_t *chip)
     chip->fm_out[slot] = output;
 }
 
-void OPN2_DoTimerA(ym3438_t *chip)
+static void OPN2_DoTimerA(ym3438_t *chip)
 {
     Bit16u time;
     Bit8u load;
@@ -1138,7 +1138,7 @@ void OPN2_DoTimerA(ym3438_t *chip)
     chip->timer_a_cnt = time & 0x3ff;
 }
 
-void OPN2_DoTimerB(ym3438_t *chip)
+static void OPN2_DoTimerB(ym3438_t *chip)
 {
     Bit16u time;
     Bit8u load;
@@ -1183,7 +1183,7 @@ void OPN2_DoTimerB(ym3438_t *chip)
     chip->timer_b_cnt = time & 0xff;
 }
 
-void OPN2_KeyOn(ym3438_t*chip)
+static void OPN2_KeyOn(ym3438_t*chip)
 {
     Bit32u slot = chip->cycles;
     Bit32u chan = chip->channel;
@@ -1507,70 +1507,86 @@ void OPN2_WriteBuffered(ym3438_t *chip, Bit32u port, Bit8u data)
 
 void OPN2_Generate(ym3438_t *chip, Bit16s *buf)
 {
-    Bit32u i;
+    OPN2_GenerateBlock(chip, buf, 1);
+}
+
+/* Same as OPN2_Generate for each of numsamples interleaved stereo samples.
+ * Which channel the output of each of the 24 cycles belongs to is worked out
+ * once per block instead of once per cycle. */
+void OPN2_GenerateBlock(ym3438_t *chip, Bit16s *buf, Bit32u numsamples)
+{
+    Bit32u i, n;
     Bit16s buffer[2];
     Bit32u mute;
-    Bit32s channel = -1;
-
-    buf[0] = 0;
-    buf[1] = 0;
+    Bit32s channel[24];
+    Bit32s ch;
+    Bit32s out_l, out_r;
 
     for (i = 0; i < 24; i++)
     {
-        switch (chip->cycles >> 2)
+        switch (((chip->cycles + i) % 24) >> 2)
         {
         case 0: /* Ch 2 */
-            mute = chip->mute[1];
-            channel = 1;
+            channel[i] = 1;
             break;
         case 1: /* Ch 6, DAC */
-            mute = chip->mute[5 + chip->dacen];
-            channel = 5;
+            channel[i] = 5;
             break;
         case 2: /* Ch 4 */
-            mute = chip->mute[3];
-            channel = 3;
+            channel[i] = 3;
             break;
         case 3: /* Ch 1 */
-            mute = chip->mute[0];
-            channel = 0;
+            channel[i] = 0;
             break;
         case 4: /* Ch 5 */
-            mute = chip->mute[4];
-            channel = 4;
+            channel[i] = 4;
             break;
         case 5: /* Ch 3 */
-            mute = chip->mute[2];
-            channel = 2;
+            channel[i] = 2;
             break;
         default:
-            mute = 0;
+            channel[i] = -1;
             break;
         }
-        OPN2_Clock(chip, buffer);
-        if (!mute)
+    }
+
+    for (n = 0; n < numsamples; n++)
+    {
+        out_l = 0;
+        out_r = 0;
+        for (i = 0; i < 24; i++)
         {
-            if (channel >= 0)
+            ch = channel[i];
+            /* The DAC can be switched on by a write during the sample. */
+            mute = ch < 0 ? 0 : chip->mute[ch == 5 ? 5 + chip->dacen : ch];
+            OPN2_Clock(chip, buffer);
+            if (!mute)
             {
-                buffer[0] = buffer[0] * chip->pan_volume_l[channel] / 65535;
-                buffer[1] = buffer[1] * chip->pan_volume_r[channel] / 65535;
+                if (ch >= 0)
+                {
+                    buffer[0] = buffer[0] * chip->pan_volume_l[ch] / 65535;
+                    buffer[1] = buffer[1] * chip->pan_volume_r[ch] / 65535;
+                }
+                out_l += buffer[0];
+                out_r += buffer[1];
             }
-            buf[0] += buffer[0];
-            buf[1] += buffer[1];
-        }
 
-        while (chip->writebuf[chip->writebuf_cur].time <= chip->writebuf_samplecnt)
-        {
-            if (!(chip->writebuf[chip->writebuf_cur].port & 0x04))
+            while (chip->writebuf[chip->writebuf_cur].time <= chip->writebuf_samplecnt)
             {
-                break;
+                if (!(chip->writebuf[chip->writebuf_cur].port & 0x04))
+                {
+                    break;
+                }
+                chip->writebuf[chip->writebuf_cur].port &= 0x03;
+                OPN2_Write(chip, chip->writebuf[chip->writebuf_cur].port,
+                           chip->writebuf[chip->writebuf_cur].data);
+                chip->writebuf_cur = (chip->writebuf_cur + 1) % OPN_WRITEBUF_SIZE;
             }
-            chip->writebuf[chip->writebuf_cur].port &= 0x03;
-            OPN2_Write(chip, chip->writebuf[chip->writebuf_cur].port,
-                       chip->writebuf[chip->writebuf_cur].data);
-            chip->writebuf_cur = (chip->writebuf_cur + 1) % OPN_WRITEBUF_SIZE;
+            chip->writebuf_samplecnt++;
         }
-        chip->writebuf_samplecnt++;
+        buf[0] = (Bit16s)out_l;
+        buf[1] = (Bit16s)out_r;
+        buf += 2;
     }
 }
 
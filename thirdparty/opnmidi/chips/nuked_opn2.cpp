@@ -70,6 +70,12 @@ void NukedOPN2::nativeGenerate(int16_t *frame)
     OPN2_Generate(chip_r, frame);
 }
 
+void NukedOPN2::nativeGenerateBlock(int16_t *output, size_t frames)
+{
+    ym3438_t *chip_r = reinterpret_cast<ym3438_t*>(chip);
+    OPN2_GenerateBlock(chip_r, output, (Bit32u)frames);
+}
+
 const char *NukedOPN2::emulatorName()
 {
     return "Nuked OPN2";
@@ -38,6 +38,7 @@ public:
     void nativePreGenerate() override {}
     void nativePostGenerate() override {}
     void nativeGenerate(int16_t *frame) override;
+    void nativeGenerateBlock(int16_t *output, size_t frames);
     const char *emulatorName() override;
     // amplitude scale factors to use in resampling
     enum { resamplerPreAmplify = 11, resamplerPostAttenuate = 2 };
@@ -40,15 +40,36 @@ extern void opn2_audioTickHandler(void *instance, uint32_t chipId, uint32_t rate
 
 class OPNChipBase
 {
+public:
+    //! Silent output frames without any keyed on channel after which the chip counts as idle
+    enum { idleFrames = 4096 };
 protected:
     uint32_t m_id;
     uint32_t m_rate;
     uint32_t m_clock;
     OPNFamily m_family;
+    //! Keyed on FM channels (bits 0-5)
+    uint32_t m_keysOn;
+    //! Silent output frames since the last register write while nothing was keyed on
+    uint32_t m_silentFrames;
 public:
     explicit OPNChipBase(OPNFamily f);
     virtual ~OPNChipBase();
 
+    /**
+     * @brief Track key on state for the idle detection, call for every register write
+     * @param port Register port
+     * @param addr Register address
+     * @param data Written value
+     */
+    void noteWrite(uint32_t port, uint16_t addr, uint8_t data);
+
+    /**
+     * @brief True when the chip has been silent with all keys off since its last register write.
+     * The generate functions then output silence without emulating the chip.
+     */
+    bool isIdle() const { return m_silentFrames >= (uint32_t)idleFrames; }
+
     virtual OPNFamily family() const = 0;
     uint32_t clockRate() const;
     virtual uint32_t nativeClockRate() const = 0;
@@ -81,6 +102,14 @@ public:
     virtual void generate32(int32_t *output, size_t frames) = 0;
     virtual void generateAndMix32(int32_t *output, size_t frames) = 0;
 
+    /**
+     * @brief Let the chip run on for some time without producing any output,
+     * so released notes fade out the same way they would while playing.
+     * The chip runs at its native rate without the resampler and stops early once it is idle.
+     * @param frames Number of frames at the output rate
+     */
+    virtual void advance(size_t frames) = 0;
+
     virtual const char* emulatorName() = 0;
 private:
     OPNChipBase(const OPNChipBase &c);
@@ -113,15 +142,28 @@ public:
     void generateAndMix(int16_t *output, size_t frames) override;
     void generate32(int32_t *output, size_t frames) override;
     void generateAndMix32(int32_t *output, size_t frames) override;
+    void advance(size_t frames) override;
+
+    /**
+     * @brief Generate frames at the native rate, the same as calling nativeGenerate for each.
+     * Chips that can make a whole block faster hide this with their own.
+     * @param output Interleaved stereo output
+     * @param frames Number of frames
+     */
+    void nativeGenerateBlock(int16_t *output, size_t frames);
 private:
     bool m_runningAtPcmRate;
 #if defined(OPNMIDI_AUDIO_TICK_HANDLER)
     void *m_audioTickHandlerInstance;
 #endif
     void nativeTick(int16_t *frame);
+    void countSilence(const int32_t *frame);
     void setupResampler(uint32_t rate);
     void resetResampler();
     void resampledGenerate(int32_t *output);
+    void resampledGenerateBlock(int32_t *output, size_t frames);
+    // frames generated at a time by the generate functions
+    enum { blockFrames = 64 };
 #if defined(OPNMIDI_ENABLE_HQ_RESAMPLER)
     VResampler *m_resampler;
 #else
@@ -1,6 +1,7 @@
 #include "opn_chip_base.h"
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 
 #if defined(OPNMIDI_ENABLE_HQ_RESAMPLER)
 #include <zita-resampler/vresampler.h>
@@ -23,10 +24,25 @@ inline OPNChipBase::OPNChipBase(OPNFamily f) :
     m_id(0),
     m_rate(44100),
     m_clock(7670454),
-    m_family(f)
+    m_family(f),
+    m_keysOn(0),
+    m_silentFrames(0)
 {
 }
 
+inline void OPNChipBase::noteWrite(uint32_t port, uint16_t addr, uint8_t data)
+{
+    m_silentFrames = 0;
+    if(port == 0 && addr == 0x28 && (data & 3) != 3)
+    {
+        uint32_t bit = 1u << ((data & 3) + ((data & 4) ? 3 : 0));
+        if(data & 0xF0)
+            m_keysOn |= bit;
+        else
+            m_keysOn &= ~bit;
+    }
+}
+
 inline OPNChipBase::~OPNChipBase()
 {
 }
@@ -128,24 +144,38 @@ uint32_t OPNChipBaseT<T>::nativeRate() const
 template <class T>
 void OPNChipBaseT<T>::reset()
 {
+    m_keysOn = 0;
+    m_silentFrames = 0;
     resetResampler();
 }
 
 template <class T>
 void OPNChipBaseT<T>::generate(int16_t *output, size_t frames)
 {
+    if(isIdle())
+    {
+        std::memset(output, 0, frames * 2 * sizeof(int16_t));
+        return;
+    }
     static_cast<T *>(this)->nativePreGenerate();
-    for(size_t i = 0; i < frames; ++i)
+    while(frames > 0)
     {
-        int32_t frame[2];
-        static_cast<T *>(this)->resampledGenerate(frame);
-        for (unsigned c = 0; c < 2; ++c) {
-            int32_t temp = frame[c];
-            temp = (temp > -32768) ? temp : -32768;
-            temp = (temp < 32767) ? temp : 32767;
-            output[c] = (int16_t)temp;
+        int32_t block[2 * blockFrames];
+        size_t count = (frames < (size_t)blockFrames) ? frames : (size_t)blockFrames;
+        resampledGenerateBlock(block, count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            const int32_t *frame = block + 2 * i;
+            countSilence(frame);
+            for (unsigned c = 0; c < 2; ++c) {
+                int32_t temp = frame[c];
+                temp = (temp > -32768) ? temp : -32768;
+                temp = (temp < 32767) ? temp : 32767;
+                output[c] = (int16_t)temp;
+            }
+            output += 2;
         }
-        output += 2;
+        frames -= count;
     }
     static_cast<T *>(this)->nativePostGenerate();
 }
@@ -153,18 +183,27 @@ void OPNChipBaseT<T>::generate(int16_t *output, size_t frames)
 template <class T>
 void OPNChipBaseT<T>::generateAndMix(int16_t *output, size_t frames)
 {
+    if(isIdle())
+        return;
     static_cast<T *>(this)->nativePreGenerate();
-    for(size_t i = 0; i < frames; ++i)
+    while(frames > 0)
     {
-        int32_t frame[2];
-        static_cast<T *>(this)->resampledGenerate(frame);
-        for (unsigned c = 0; c < 2; ++c) {
-            int32_t temp = (int32_t)output[c] + frame[c];
-            temp = (temp > -32768) ? temp : -32768;
-            temp = (temp < 32767) ? temp : 32767;
-            output[c] = (int16_t)temp;
+        int32_t block[2 * blockFrames];
+        size_t count = (frames < (size_t)blockFrames) ? frames : (size_t)blockFrames;
+        resampledGenerateBlock(block, count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            const int32_t *frame = block + 2 * i;
+            countSilence(frame);
+            for (unsigned c = 0; c < 2; ++c) {
+                int32_t temp = (int32_t)output[c] + frame[c];
+                temp = (temp > -32768) ? temp : -32768;
+                temp = (temp < 32767) ? temp : 32767;
+                output[c] = (int16_t)temp;
+            }
+            output += 2;
         }
-        output += 2;
+        frames -= count;
     }
     static_cast<T *>(this)->nativePostGenerate();
 }
@@ -172,28 +211,76 @@ void OPNChipBaseT<T>::generateAndMix(int16_t *output, size_t frames)
 template <class T>
 void OPNChipBaseT<T>::generate32(int32_t *output, size_t frames)
 {
+    if(isIdle())
+    {
+        std::memset(output, 0, frames * 2 * sizeof(int32_t));
+        return;
+    }
     static_cast<T *>(this)->nativePreGenerate();
+    resampledGenerateBlock(output, frames);
     for(size_t i = 0; i < frames; ++i)
+        countSilence(output + 2 * i);
+    static_cast<T *>(this)->nativePostGenerate();
+}
+
+template <class T>
+void OPNChipBaseT<T>::generateAndMix32(int32_t *output, size_t frames)
+{
+    if(isIdle())
+        return;
+    static_cast<T *>(this)->nativePreGenerate();
+    while(frames > 0)
     {
-        static_cast<T *>(this)->resampledGenerate(output);
-        output += 2;
+        int32_t block[2 * blockFrames];
+        size_t count = (frames < (size_t)blockFrames) ? frames : (size_t)blockFrames;
+        resampledGenerateBlock(block, count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            const int32_t *frame = block + 2 * i;
+            countSilence(frame);
+            output[0] += frame[0];
+            output[1] += frame[1];
+            output += 2;
+        }
+        frames -= count;
     }
     static_cast<T *>(this)->nativePostGenerate();
 }
 
 template <class T>
-void OPNChipBaseT<T>::generateAndMix32(int32_t *output, size_t frames)
+void OPNChipBaseT<T>::advance(size_t frames)
 {
+    if(isIdle())
+        return;
+    uint64_t ticks = m_runningAtPcmRate ? (uint64_t)frames : (uint64_t)frames * nativeRate() / m_rate;
     static_cast<T *>(this)->nativePreGenerate();
-    for(size_t i = 0; i < frames; ++i)
+    for(uint64_t i = 0; i < ticks && !isIdle(); ++i)
     {
-        int32_t frame[2];
-        static_cast<T *>(this)->resampledGenerate(frame);
-        output[0] += frame[0];
-        output[1] += frame[1];
-        output += 2;
+        // Not nativeTick: the audio tick handler must not see this time pass.
+        int16_t in[2];
+        static_cast<T *>(this)->nativeGenerate(in);
+        int32_t frame[2] = { in[0], in[1] };
+        countSilence(frame);
     }
     static_cast<T *>(this)->nativePostGenerate();
+    // What the resampler still holds was generated before the skip.
+    resetResampler();
+}
+
+template <class T>
+inline void OPNChipBaseT<T>::countSilence(const int32_t *frame)
+{
+#if !defined(OPNMIDI_AUDIO_TICK_HANDLER) // the tick handler needs every sample to be generated
+    if(m_keysOn == 0 && frame[0] == 0 && frame[1] == 0)
+    {
+        if(m_silentFrames < (uint32_t)idleFrames)
+            ++m_silentFrames;
+    }
+    else
+        m_silentFrames = 0;
+#else
+    (void)frame;
+#endif
 }
 
 template <class T>
@@ -205,6 +292,13 @@ void OPNChipBaseT<T>::nativeTick(int16_t *frame)
     static_cast<T *>(this)->nativeGenerate(frame);
 }
 
+template <class T>
+void OPNChipBaseT<T>::nativeGenerateBlock(int16_t *output, size_t frames)
+{
+    for(size_t i = 0; i < frames; ++i)
+        static_cast<T *>(this)->nativeGenerate(output + 2 * i);
+}
+
 template <class T>
 void OPNChipBaseT<T>::setupResampler(uint32_t rate)
 {
@@ -300,6 +394,88 @@ void OPNChipBaseT<T>::resampledGenerate(int32_t *output)
 }
 #endif
 
+// Same as calling resampledGenerate for each frame, but the native frames
+// are generated a block at a time. Only as many are generated as these
+// frames take, so register writes after this still land where they would.
+template <class T>
+void OPNChipBaseT<T>::resampledGenerateBlock(int32_t *output, size_t frames)
+{
+#if defined(OPNMIDI_AUDIO_TICK_HANDLER) || defined(OPNMIDI_ENABLE_HQ_RESAMPLER)
+    // The tick handler runs before every native frame, and the HQ resampler takes them one at a time.
+    for(size_t i = 0; i < frames; ++i)
+        static_cast<T *>(this)->resampledGenerate(output + 2 * i);
+#else
+    int16_t in[2 * blockFrames];
+    if(UNLIKELY(m_runningAtPcmRate))
+    {
+        while(frames > 0)
+        {
+            size_t count = (frames < (size_t)blockFrames) ? frames : (size_t)blockFrames;
+            static_cast<T *>(this)->nativeGenerateBlock(in, count);
+            for(size_t i = 0; i < 2 * count; ++i)
+                output[i] = (int32_t)in[i] * T::resamplerPreAmplify / T::resamplerPostAttenuate;
+            output += 2 * count;
+            frames -= count;
+        }
+        return;
+    }
+
+    int32_t samplecnt = m_samplecnt;
+    const int32_t rateratio = m_rateratio;
+    while(frames > 0)
+    {
+        // Count the output frames the next block of native frames is enough for
+        size_t count = 0, ticks = 0;
+        int32_t cnt = samplecnt;
+        while(count < frames)
+        {
+            size_t need = 0;
+            int32_t c = cnt;
+            for(; c >= rateratio; c -= rateratio)
+                ++need;
+            if(ticks + need > (size_t)blockFrames)
+                break;
+            ticks += need;
+            cnt = c + (1 << rsm_frac);
+            ++count;
+        }
+        if(count == 0)
+        {
+            // Output rates this low take more than a block for a single frame
+            m_samplecnt = samplecnt;
+            static_cast<T *>(this)->resampledGenerate(output);
+            samplecnt = m_samplecnt;
+            output += 2;
+            --frames;
+            continue;
+        }
+
+        static_cast<T *>(this)->nativeGenerateBlock(in, ticks);
+        const int16_t *buffer = in;
+        for(size_t i = 0; i < count; ++i)
+        {
+            while(samplecnt >= rateratio)
+            {
+                m_oldsamples[0] = m_samples[0];
+                m_oldsamples[1] = m_samples[1];
+                m_samples[0] = buffer[0] * T::resamplerPreAmplify;
+                m_samples[1] = buffer[1] * T::resamplerPreAmplify;
+                buffer += 2;
+                samplecnt -= rateratio;
+            }
+            output[0] = (int32_t)(((m_oldsamples[0] * (rateratio - samplecnt)
+                                    + m_samples[0] * samplecnt) / rateratio)/T::resamplerPostAttenuate);
+            output[1] = (int32_t)(((m_oldsamples[1] * (rateratio - samplecnt)
+                                    + m_samples[1] * samplecnt) / rateratio)/T::resamplerPostAttenuate);
+            samplecnt += 1 << rsm_frac;
+            output += 2;
+        }
+        frames -= count;
+    }
+    m_samplecnt = samplecnt;
+#endif
+}
+
 /* OPNChipBaseBufferedT */
 
 template <class T, unsigned Buffer>
@@ -454,6 +454,16 @@ OPNMIDI_EXPORT void opn2_setSoftPanEnabled(OPN2_MIDIPlayer *device, int softPanE
     play->m_synth->m_softPanning = (softPanEn != 0);
 }
 
+OPNMIDI_EXPORT void opn2_setParallelFor(struct OPN2_MIDIPlayer *device, OPN2_ParallelFor parallelFor, void *context)
+{
+    if(!device)
+        return;
+    MidiPlayer *play = GET_MIDI_PLAYER(device);
+    assert(play);
+    play->m_parallelFor = parallelFor;
+    play->m_parallelForContext = context;
+}
+
 /* !!!DEPRECATED!!! */
 OPNMIDI_EXPORT void opn2_setLogarithmicVolumes(struct OPN2_MIDIPlayer *device, int logvol)
 {
@@ -773,6 +783,8 @@ OPNMIDI_EXPORT void opn2_positionSeek(struct OPN2_MIDIPlayer *device, double sec
     MidiPlayer *play = GET_MIDI_PLAYER(device);
     assert(play);
     play->realTime_panic();
+    // Let the notes cut by the panic die away instead of fading out at the new position.
+    play->m_synth->advanceChips(play->m_setup.PCM_RATE);
     play->m_setup.delay = play->m_sequencer->seek(seconds, play->m_setup.mindelay);
     play->m_setup.carry = 0.0;
 #else
@@ -1134,6 +1146,45 @@ static int SendStereoAudio(int         samples_requested,
 }
 
 
+struct ChipJobs
+{
+    Synth *synth;
+    int32_t *bufs;
+    size_t frames;
+};
+
+static void renderChipJob(void *context, size_t card)
+{
+    ChipJobs *jobs = static_cast<ChipJobs *>(context);
+    jobs->synth->m_chips[card]->generate32(jobs->bufs + card * jobs->frames * 2, jobs->frames);
+}
+
+/* Generate data from every chip and mix result */
+static void renderChips(MidiPlayer *player, int32_t *out_buf, size_t frames)
+{
+    Synth &synth = *player->m_synth;
+    unsigned int chips = synth.m_numChips;
+    if(chips == 1)
+        synth.m_chips[0]->generate32(out_buf, frames);
+    else if(player->m_parallelFor && frames > 0)
+    {
+        player->m_chipBufs.resize(chips * frames * 2);
+        ChipJobs jobs = { &synth, player->m_chipBufs.data(), frames };
+        player->m_parallelFor(player->m_parallelForContext, chips, renderChipJob, &jobs);
+        for(size_t card = 0; card < chips; ++card)
+        {
+            const int32_t *in = jobs.bufs + card * frames * 2;
+            for(size_t i = 0; i < frames * 2; ++i)
+                out_buf[i] += in[i];
+        }
+    }
+    else
+    {
+        for(size_t card = 0; card < chips; ++card)
+            synth.m_chips[card]->generateAndMix32(out_buf, frames);
+    }
+}
+
 OPNMIDI_EXPORT int opn2_play(struct OPN2_MIDIPlayer *device, int sampleCount, short *out)
 {
     return opn2_playFormat(device, sampleCount, (OPN2_UInt8 *)out, (OPN2_UInt8 *)(out + 1), &opn2_DefaultAudioFormat);
@@ -1206,16 +1257,7 @@ OPNMIDI_EXPORT int opn2_playFormat(OPN2_MIDIPlayer *device, int sampleCount,
             //fill buffer with zeros
             int32_t *out_buf = player->m_outBuf;
             std::memset(out_buf, 0, static_cast<size_t>(in_generatedPhys) * sizeof(out_buf[0]));
-            Synth &synth = *player->m_synth;
-            unsigned int chips = synth.m_numChips;
-            if(chips == 1)
-                synth.m_chips[0]->generate32(out_buf, (size_t)in_generatedStereo);
-            else/* if(n_periodCountStereo > 0)*/
-            {
-                /* Generate data from every chip and mix result */
-                for(size_t card = 0; card < chips; ++card)
-                    synth.m_chips[card]->generateAndMix32(out_buf, (size_t)in_generatedStereo);
-            }
+            renderChips(player, out_buf, (size_t)in_generatedStereo);
             /* Process it */
             if(SendStereoAudio(sampleCount, in_generatedStereo, out_buf, gotten_len, out_left, out_right, format) == -1)
                 return 0;
@@ -1284,16 +1326,7 @@ OPNMIDI_EXPORT int opn2_generateFormat(struct OPN2_MIDIPlayer *device, int sampl
             //fill buffer with zeros
             int32_t *out_buf = player->m_outBuf;
             std::memset(out_buf, 0, static_cast<size_t>(in_generatedPhys) * sizeof(out_buf[0]));
-            Synth &synth = *player->m_synth;
-            unsigned int chips = synth.m_numChips;
-            if(chips == 1)
-                synth.m_chips[0]->generate32(out_buf, (size_t)in_generatedStereo);
-            else/* if(n_periodCountStereo > 0)*/
-            {
-                /* Generate data from every chip and mix result */
-                for(size_t card = 0; card < chips; ++card)
-                    synth.m_chips[card]->generateAndMix32(out_buf, (size_t)in_generatedStereo);
-            }
+            renderChips(player, out_buf, (size_t)in_generatedStereo);
             /* Process it */
             if(SendStereoAudio(sampleCount, in_generatedStereo, out_buf, gotten_len, out_left, out_right, format) == -1)
                 return 0;
@@ -481,6 +481,23 @@ extern OPNMIDI_DECLSPEC void opn2_setLoopHooksOnly(struct OPN2_MIDIPlayer *devic
  */
 extern OPNMIDI_DECLSPEC void opn2_setSoftPanEnabled(struct OPN2_MIDIPlayer *device, int softPanEn);
 
+/**
+ * @brief Function that calls job(jobContext, i) for every i in [0, count) and returns when all calls have finished
+ */
+typedef void (*OPN2_ParallelFor)(void *context, size_t count, void (*job)(void *jobContext, size_t index), void *jobContext);
+
+/**
+ * @brief Render several emulated chips at the same time
+ *
+ * Every chip is rendered into a buffer of its own by a separate job, the buffers are mixed afterwards.
+ * The chip emulators don't share any state while generating, so the jobs may run on different threads.
+ *
+ * @param device Instance of the library
+ * @param parallelFor Function that runs the jobs, NULL renders the chips one after another
+ * @param context Passed to parallelFor
+ */
+extern OPNMIDI_DECLSPEC void opn2_setParallelFor(struct OPN2_MIDIPlayer *device, OPN2_ParallelFor parallelFor, void *context);
+
 /**
  * @brief [DEPRECATED] Enable or disable Logarithmic volume changer
  *
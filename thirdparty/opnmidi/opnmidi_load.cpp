@@ -55,12 +55,25 @@ void cvt_FMIns_to_OPNI(OPN2_Instrument &ins, const OpnInstMeta &in)
     cvt_FMIns_to_generic(ins, in);
 }
 
+/* FNV-1a of the bank data */
+static uint64_t bankCacheKey(const char *data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash ^ size;
+}
+
 bool OPNMIDIplay::LoadBank(FileAndMemReader &fr)
 {
     int err = 0;
     WOPNFile *wopn = NULL;
     char *raw_file_data = NULL;
     size_t  fsize;
+    uint64_t cacheKey;
     if(!fr.isValid())
     {
         errorStringOut = "Custom bank: Invalid data stream!";
@@ -79,6 +92,21 @@ bool OPNMIDIplay::LoadBank(FileAndMemReader &fr)
     }
     fr.read(raw_file_data, 1, fsize);
 
+    Synth &synth = *m_synth;
+
+    // A bank that was already converted only needs to be copied
+    cacheKey = bankCacheKey(raw_file_data, fsize);
+    if(synth.loadCachedBanks(cacheKey))
+    {
+        free(raw_file_data);
+        m_setup.VolumeModel = OPNMIDI_VolumeModel_AUTO;
+        m_setup.lfoEnable = -1;
+        m_setup.lfoFrequency = -1;
+        m_setup.chipType = -1;
+        applySetup();
+        return true;
+    }
+
     // Parse bank file from the memory
     wopn = WOPN_LoadBankFromMem((void*)raw_file_data, fsize, &err);
     //Free the buffer no more needed
@@ -110,7 +138,6 @@ bool OPNMIDIplay::LoadBank(FileAndMemReader &fr)
         }
     }
 
-    Synth &synth = *m_synth;
     synth.m_insBankSetup.volumeModel = wopn->volume_model;
     synth.m_insBankSetup.lfoEnable = (wopn->lfo_freq & 8) != 0;
     synth.m_insBankSetup.lfoFrequency = wopn->lfo_freq & 7;
@@ -145,6 +172,7 @@ bool OPNMIDIplay::LoadBank(FileAndMemReader &fr)
         }
     }
 
+    synth.storeCachedBanks(cacheKey);
     applySetup();
 
     WOPN_Free(wopn);
@@ -65,10 +65,12 @@ void OPNMIDIplay::OpnChannel::addAge(int64_t us)
 OPNMIDIplay::OPNMIDIplay(unsigned long sampleRate) :
     m_sysExDeviceId(0),
     m_synthMode(Mode_XG),
-    m_arpeggioCounter(0)
+    m_arpeggioCounter(0),
 #if defined(ADLMIDI_AUDIO_TICK_HANDLER)
-    , m_audioTickCounter(0)
+    m_audioTickCounter(0),
 #endif
+    m_parallelFor(NULL),
+    m_parallelForContext(NULL)
 {
     m_midiDevices.clear();
 
@@ -620,6 +620,13 @@ public:
     //! Generator output buffer
     int32_t m_outBuf[1024];
 
+    //! Runs the chips of one buffer as separate jobs, NULL renders them in order
+    OPN2_ParallelFor m_parallelFor;
+    //! Passed to m_parallelFor
+    void *m_parallelForContext;
+    //! Output of every chip while they are rendered as separate jobs
+    std::vector<int32_t> m_chipBufs;
+
     //! Synthesizer setup
     Setup m_setup;
 
@@ -23,6 +23,8 @@
 
 #include "opnmidi_opn2.hpp"
 #include "opnmidi_private.hpp"
+#include <map>
+#include <mutex>
 
 #if defined(OPNMIDI_DISABLE_NUKED_EMULATOR) && defined(OPNMIDI_DISABLE_MAME_EMULATOR) && \
     defined(OPNMIDI_DISABLE_GENS_EMULATOR) && defined(OPNMIDI_DISABLE_GX_EMULATOR) && \
@@ -238,6 +240,48 @@ OPN2::~OPN2()
     clearChips();
 }
 
+/*
+ * Converted bank sets, shared by all players of the process, so that
+ * loading the same bank data again only copies them. The key is a hash of the bank data.
+ */
+struct CachedBankSet
+{
+    OpnBankSetup setup;
+    std::vector<std::pair<size_t, OPN2::Bank> > banks;
+};
+
+static std::mutex s_bankCacheLock;
+static std::map<uint64_t, CachedBankSet> s_bankCache;
+
+bool OPN2::loadCachedBanks(uint64_t key)
+{
+    std::lock_guard<std::mutex> lock(s_bankCacheLock);
+    std::map<uint64_t, CachedBankSet>::const_iterator found = s_bankCache.find(key);
+    if(found == s_bankCache.end())
+        return false;
+
+    const CachedBankSet &set = found->second;
+    m_insBanks.clear();
+    m_insBanks.reserve(set.banks.size());
+    for(size_t i = 0; i < set.banks.size(); i++)
+        m_insBanks[set.banks[i].first] = set.banks[i].second;
+    m_insBankSetup = set.setup;
+    return true;
+}
+
+void OPN2::storeCachedBanks(uint64_t key)
+{
+    CachedBankSet set;
+    set.setup = m_insBankSetup;
+    set.banks.reserve(m_insBanks.size());
+    for(BankMap::iterator it = m_insBanks.begin(); it != m_insBanks.end(); ++it)
+        set.banks.push_back(*it);
+
+    std::lock_guard<std::mutex> lock(s_bankCacheLock);
+    s_bankCache[key].banks.swap(set.banks);
+    s_bankCache[key].setup = set.setup;
+}
+
 bool OPN2::setupLocked()
 {
     return (m_musicMode == MODE_CMF ||
@@ -247,11 +291,13 @@ bool OPN2::setupLocked()
 
 void OPN2::writeReg(size_t chip, uint8_t port, uint8_t index, uint8_t value)
 {
+    m_chips[chip]->noteWrite(port, index, value);
     m_chips[chip]->writeReg(port, index, value);
 }
 
 void OPN2::writeRegI(size_t chip, uint8_t port, uint32_t index, uint32_t value)
 {
+    m_chips[chip]->noteWrite(port, static_cast<uint8_t>(index), static_cast<uint8_t>(value));
     m_chips[chip]->writeReg(port, static_cast<uint8_t>(index), static_cast<uint8_t>(value));
 }
 
@@ -594,6 +640,12 @@ void OPN2::clearChips()
     m_chips.clear();
 }
 
+void OPN2::advanceChips(size_t frames)
+{
+    for(size_t i = 0; i < m_chips.size(); i++)
+        m_chips[i]->advance(frames);
+}
+
 void OPN2::reset(int emulator, unsigned long PCM_RATE, OPNFamily family, void *audioTickHandler)
 {
 #if !defined(ADLMIDI_AUDIO_TICK_HANDLER)
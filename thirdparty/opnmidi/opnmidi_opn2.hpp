@@ -161,6 +161,19 @@ public:
      */
     bool setupLocked();
 
+    /**
+     * @brief Replace the current banks with a copy from the process-wide bank cache
+     * @param key Identifier of the bank set
+     * @return true when the bank set was in the cache
+     */
+    bool loadCachedBanks(uint64_t key);
+
+    /**
+     * @brief Store a copy of the current banks in the process-wide bank cache
+     * @param key Identifier of the bank set
+     */
+    void storeCachedBanks(uint64_t key);
+
     /**
      * @brief Write data to OPN2 chip register
      * @param chip Index of emulated chip. In hardware OPN2 builds, this parameter is ignored
@@ -252,6 +265,12 @@ public:
      */
     void clearChips();
 
+    /**
+     * @brief Run all chips on without output, see OPNChipBase::advance()
+     * @param frames Number of frames at the output rate
+     */
+    void advanceChips(size_t frames);
+
     /**
      * @brief Reset chip properties and initialize them
      * @param emulator Type of chip emulator
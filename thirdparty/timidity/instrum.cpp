@@ -37,6 +37,8 @@
 #include "common.h"
 #include "instrum.h"
 #include "playmidi.h"
+#include "../../source/zmusic/parallel.h"
+#include "../../source/zmusic/memusage.h"
 
 namespace Timidity
 {
@@ -44,7 +46,7 @@ namespace Timidity
 Instrument *load_instrument_dls(Renderer *song, int drum, int bank, int instrument);
 
 Instrument::Instrument()
-: samples(0), sample(NULL)
+: samples(0), sample(NULL), data_bytes(0)
 {
 }
 
@@ -53,14 +55,18 @@ Instrument::~Instrument()
 	Sample *sp;
 	int i;
 
+	const uintptr_t mapstart = (uintptr_t)mapping.get(), mapend = mapstart + mapping_size;
 	for (i = samples, sp = &(sample[0]); i != 0; i--, sp++)
 	{
-		if (sp->type == INST_GUS && sp->data != NULL)
+		/* Samples that were misaligned in the mapping got copied out of it. */
+		const uintptr_t data = (uintptr_t)sp->data;
+		if (sp->type == INST_GUS && sp->data != NULL && (data < mapstart || data >= mapend))
 		{
 			free(sp->data);
 		}
 	}
 	free(sample);
+	ZMusic_AccountInstruments(-(ptrdiff_t)data_bytes);
 }
 
 ToneBank::ToneBank()
@@ -135,29 +141,172 @@ static void reverse_data(sample_t *sp, int ls, int le)
 	}
 }
 
-/* 
-	If panning or note_to_use != -1, it will be used for all samples,
-	instead of the sample-specific values in the instrument file. 
+/* Persistent cache of converted patches
 
-	For note_to_use, any value <0 or >127 will be forced to 0.
+   Each entry holds one instrument as read_instrument produced it, in a file
+   named after a hash of the patch and everything else the conversion
+   depends on. The Sample records are stored as they are laid out in memory,
+   so the header tells byte order and layout apart. Every record is followed
+   by its data at an 8 byte aligned offset, so that a mapped entry can be
+   played from as it is. */
+#define GUS_CACHE_MAGIC "TMGUSPT1"
+#define GUS_CACHE_BOM 0x01020304u
 
-	For other parameters, 1 means yes, 0 means no, other values are
-	undefined.
+struct GUSCacheHeader
+{
+	char magic[8];
+	uint32_t bom;
+	uint32_t record_size;
+	uint32_t samples;
+	uint32_t reserved;
+};
+
+struct GUSCacheRecord
+{
+	Sample sample;
+	uint32_t frames;
+	uint32_t reserved;
+};
+
+/* Returns NULL if there is no usable entry. If the file can be mapped, the
+   samples play straight from the mapping, otherwise their data gets read. */
+static Instrument *read_cached_instrument(const char *path)
+{
+	auto reader = MusicIO::OpenMappedFile(path);
+	std::shared_ptr<const uint8_t> mapping;
+	std::vector<uint8_t> buffer;
+	const uint8_t *data;
+	size_t size;
 
-	TODO: do reverse loops right */
-Instrument *Renderer::load_instrument(const char *name, int percussion,
-					int panning, int note_to_use,
-					int strip_loop, int strip_envelope,
-					int strip_tail)
+	if (reader != NULL)
+	{
+		mapping = reader->shareData();
+		size = reader->filelength();
+		reader->close();
+		data = mapping.get();
+	}
+	else
+	{
+		FILE *f = MusicIO::utf8_fopen(path, "rb");
+		if (f == NULL)
+		{
+			return NULL;
+		}
+		auto fr = new MusicIO::StdioFileReader;
+		fr->f = f;
+		buffer = Renderer::read_patch_file(fr);
+		data = buffer.data();
+		size = buffer.size();
+	}
+
+	GUSCacheHeader header;
+	if (data == NULL || size < sizeof(header))
+	{
+		return NULL;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, GUS_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.bom != GUS_CACHE_BOM ||
+		header.record_size != sizeof(GUSCacheRecord) || header.samples == 0 || header.samples >= 256)
+	{
+		return NULL;
+	}
+
+	Instrument *ip = new Instrument;
+	ip->samples = header.samples;
+	ip->sample = (Sample *)safe_malloc(sizeof(Sample) * header.samples);
+	memset(ip->sample, 0, sizeof(Sample) * header.samples);
+	ip->mapping = mapping;
+	ip->mapping_size = mapping != nullptr ? size : 0;
+	size_t pos = sizeof(header);
+	for (uint32_t i = 0; i < header.samples; i++)
+	{
+		GUSCacheRecord record;
+		if (size - pos < sizeof(record))
+		{
+			delete ip;
+			return NULL;
+		}
+		memcpy(&record, data + pos, sizeof(record));
+		pos += sizeof(record);
+		size_t bytes = record.frames * sizeof(sample_t);
+		if (record.frames == 0 || record.frames > MAX_SAMPLE_SIZE + 1 || size - pos < bytes)
+		{
+			delete ip;
+			return NULL;
+		}
+		Sample *sp = &ip->sample[i];
+		*sp = record.sample;
+		sp->type = INST_GUS;
+		if (mapping != nullptr && ((uintptr_t)(data + pos) & (alignof(sample_t) - 1)) == 0)
+		{
+			/* The records are 8 byte aligned in the file, so their data normally is as well */
+			sp->data = (sample_t *)(data + pos);
+		}
+		else
+		{
+			sp->data = (sample_t *)safe_malloc(bytes);
+			memcpy(sp->data, data + pos, bytes);
+			ip->data_bytes += bytes;
+			ZMusic_AccountInstruments(bytes);
+		}
+		pos += (bytes + 7) & ~size_t(7);
+		if (pos > size) pos = size;
+	}
+	return ip;
+}
+
+/* Failures are not errors, the patch just gets converted again next time */
+static void write_cached_instrument(const char *path, const Instrument *ip, const std::vector<uint32_t> &frames)
+{
+	GUSCacheHeader header = {};
+	GUSCacheRecord record;
+	char temp[64];
+
+	if (frames.size() != (size_t)ip->samples)
+	{
+		return;
+	}
+
+	/* Write under a unique name and move it into place when complete, so that
+	   readers in other processes never see a partial entry */
+	snprintf(temp, sizeof(temp), ".%p.tmp", (const void *)ip);
+	std::string tempname = std::string(path) + temp;
+	FILE *f = MusicIO::utf8_fopen(tempname.c_str(), "wb");
+	if (f == NULL)
+	{
+		printMessage(CMSG_INFO, VERB_DEBUG, "Unable to write patch cache entry '%s'\n", tempname.c_str());
+		return;
+	}
+
+	memcpy(header.magic, GUS_CACHE_MAGIC, sizeof(header.magic));
+	header.bom = GUS_CACHE_BOM;
+	header.record_size = sizeof(GUSCacheRecord);
+	header.samples = ip->samples;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for (int i = 0; i < ip->samples && ok; i++)
+	{
+		static const uint8_t pad[8] = {};
+		size_t padding = (frames[i] * sizeof(sample_t)) & 7;
+
+		memset(&record, 0, sizeof(record));
+		record.sample = ip->sample[i];
+		record.sample.data = NULL;
+		record.frames = frames[i];
+		ok = fwrite(&record, sizeof(record), 1, f) == 1 &&
+			fwrite(ip->sample[i].data, sizeof(sample_t), frames[i], f) == frames[i] &&
+			fwrite(pad, 1, padding, f) == padding;
+	}
+	ok = fclose(f) == 0 && ok;
+
+	if (!ok || rename(tempname.c_str(), path) != 0)
+	{
+		remove(tempname.c_str());
+	}
+}
+
+/* Opens a patch file, trying the usual extensions if necessary. */
+MusicIO::FileInterface *Renderer::open_instrument(const char *name)
 {
-	Instrument *ip;
-	Sample *sp;
-	GF1PatchHeader header;
-	GF1InstrumentData idata;
-	GF1LayerData layer_data;
-	GF1PatchData patch_data;
-	int i, j;
-	bool noluck = false;
 	auto reader = instruments->sfreader;
 
 	if (!name || reader == nullptr) return nullptr;
@@ -170,24 +319,122 @@ Instrument *Renderer::load_instrument(const char *name, int percussion,
 		std::string tmp = name;
 		tmp += ".pat";
 		fp = reader->open_file(tmp.c_str());
+#ifndef _WIN32			// Windows isn't case-sensitive.
 		if (!fp)
 		{
-#ifndef _WIN32			// Windows isn't case-sensitive.
 			std::transform(tmp.begin(), tmp.end(), tmp.begin(), [](unsigned char c){ return toupper(c); } );
 			fp = reader->open_file(tmp.c_str());
-			if (!fp)
-#endif
-			{
-				noluck = true;
-			}
 		}
+#endif
 	}
 
-	if (noluck)
+	if (!fp)
 	{
 		printMessage(CMSG_ERROR, VERB_DEBUG, "Instrument `%s' can't be found.\n", name);
-		return 0;
 	}
+	return fp;
+}
+
+/* 
+	If panning or note_to_use != -1, it will be used for all samples,
+	instead of the sample-specific values in the instrument file. 
+
+	For note_to_use, any value <0 or >127 will be forced to 0.
+
+	For other parameters, 1 means yes, 0 means no, other values are
+	undefined.
+
+	TODO: do reverse loops right */
+Instrument *Renderer::load_instrument(const char *name, int percussion,
+					int panning, int note_to_use,
+					int strip_loop, int strip_envelope,
+					int strip_tail)
+{
+	auto fp = open_instrument(name);
+	if (!fp) return nullptr;
+	return load_instrument_data(read_patch_file(fp), name, percussion, panning, note_to_use, strip_loop, strip_envelope, strip_tail);
+}
+
+/* Reads a whole patch file into memory and closes it, so that it can be
+   parsed away from the sound font reader, which may not be usable from
+   other threads. */
+std::vector<uint8_t> Renderer::read_patch_file(MusicIO::FileInterface *fp)
+{
+	/* Read in chunks, the length reported for something that is not
+	   a regular file cannot be trusted. */
+	const long chunk = 65536;
+	std::vector<uint8_t> buffer;
+	long pos = 0, got;
+	do
+	{
+		buffer.resize(pos + chunk);
+		got = fp->read(buffer.data() + pos, chunk);
+		if (got > 0) pos += got;
+	} while (got == chunk);
+	buffer.resize(pos);
+	fp->close();
+	return buffer;
+}
+
+/* Converts a patch that has been read into memory, or takes it from the
+   sample cache if there is one. This only touches the new instrument and
+   the cache file, so several patches may be loaded at once. */
+Instrument *Renderer::load_instrument_data(const std::vector<uint8_t> &data, const char *name, int percussion,
+					int panning, int note_to_use,
+					int strip_loop, int strip_envelope,
+					int strip_tail)
+{
+	const std::string &cachedir = instruments->sample_cache_dir;
+	std::vector<uint32_t> frames;
+	std::string cachefile;
+	Instrument *ip;
+
+	if (!cachedir.empty())
+	{
+		/* The converted data depends on the load options and the output rate as well */
+		uint64_t hash = 0xcbf29ce484222325ull;	/* 64 bit FNV-1a */
+		auto add = [&](const void *p, size_t len)
+		{
+			for (size_t i = 0; i < len; i++) hash = (hash ^ ((const uint8_t *)p)[i]) * 0x100000001b3ull;
+		};
+		int options[] = { percussion, panning, note_to_use, strip_loop, strip_envelope, strip_tail, control_ratio };
+		add(data.data(), data.size());
+		add(options, sizeof(options));
+		add(&rate, sizeof(rate));
+
+		char fn[40];
+		snprintf(fn, sizeof(fn), "/%08x%08x-%x.gus", (unsigned)(hash >> 32), (unsigned)hash, (unsigned)data.size());
+		cachefile = cachedir + fn;
+		ip = read_cached_instrument(cachefile.c_str());
+		if (ip != NULL)
+		{
+			return ip;
+		}
+	}
+
+	ip = read_instrument(new MusicIO::MemoryReader(data.data(), (long)data.size()), name, percussion, panning, note_to_use,
+		strip_loop, strip_envelope, strip_tail, cachefile.empty() ? NULL : &frames);
+	if (ip != NULL && !cachefile.empty())
+	{
+		write_cached_instrument(cachefile.c_str(), ip, frames);
+	}
+	return ip;
+}
+
+/* Parses an opened patch file and closes it. If frames is given it receives
+   the number of values stored in each sample's data. */
+Instrument *Renderer::read_instrument(MusicIO::FileInterface *fp, const char *name, int percussion,
+					int panning, int note_to_use,
+					int strip_loop, int strip_envelope,
+					int strip_tail, std::vector<uint32_t> *frames)
+{
+	Instrument *ip;
+	Sample *sp;
+	GF1PatchHeader header;
+	GF1InstrumentData idata;
+	GF1LayerData layer_data;
+	GF1PatchData patch_data;
+	int i, j;
 
 	printMessage(CMSG_INFO, VERB_NOISY, "Loading instrument %s\n", name);
 
@@ -456,10 +703,21 @@ fail:
 
 		/* If this instrument will always be played on the same note,
 		   and it's not looped, we can resample it now. */
+		bool resampled = false;
 		if (sp->scale_factor == 0 && !(sp->modes & PATCH_LOOPEN))
 		{
+			sample_t *olddata = sp->data;
 			pre_resample(this, sp);
+			resampled = sp->data != olddata;
+		}
+		/* Converted data carries one extra point for interpolation, resampled data does not. */
+		uint32_t data_frames = (sp->data_length >> FRACTION_BITS) + (resampled ? 0 : 1);
+		if (frames != NULL)
+		{
+			frames->push_back(data_frames);
 		}
+		ip->data_bytes += data_frames * sizeof(sample_t);
+		ZMusic_AccountInstruments(data_frames * sizeof(sample_t));
 
 		if (strip_tail == 1)
 		{
@@ -571,7 +829,10 @@ void convert_sample_data(Sample *sp, const void *data)
 	sp->data = newdata;
 }
 
-int Renderer::fill_bank(int dr, int b)
+/* Picks the instrument for a marked slot. Anything coming from DLS or
+   sound fonts is loaded right away, GUS patches are only opened and
+   queued so that load_missing_instruments can parse them in parallel. */
+int Renderer::fill_bank(int dr, int b, std::vector<PatchLoad> &patches)
 {
 	int i, errors = 0;
 	ToneBank *bank = ((dr) ? instruments->drumset[b] : instruments->tonebank[b]);
@@ -586,9 +847,9 @@ int Renderer::fill_bank(int dr, int b)
 	{
 		if (bank->instrument[i] == MAGIC_LOAD_INSTRUMENT)
 		{
-			bank->instrument[i] = NULL;
-			bank->instrument[i] = load_instrument_dls(this, dr, b, i);
-			if (bank->instrument[i] != NULL)
+			Instrument *dls = load_instrument_dls(this, dr, b, i);
+			bank->instrument[i].store(dls, std::memory_order_release);
+			if (dls != NULL)
 			{
 				continue;
 			}
@@ -602,61 +863,100 @@ int Renderer::fill_bank(int dr, int b)
 				}
 				else
 				{
-					ip = load_instrument(bank->tone[i].name.c_str(), 
-						(dr) ? 1 : 0,
-						bank->tone[i].pan,
-						(bank->tone[i].note != -1) ? bank->tone[i].note : ((dr) ? i : -1),
-						(bank->tone[i].strip_loop != -1) ? bank->tone[i].strip_loop : ((dr) ? 1 : -1),
-						(bank->tone[i].strip_envelope != -1) ? bank->tone[i].strip_envelope : ((dr) ? 1 : -1),
-						bank->tone[i].strip_tail);
-				}
-				if (ip == NULL)
-				{
-					ip = load_instrument_font_order(1, dr, b, i);
-				}
-			}
-			bank->instrument[i] = ip;
-			if (ip == NULL)
-			{
-				if (bank->tone[i].name.length() == 0)
-				{
-					printMessage(CMSG_WARNING, (b != 0) ? VERB_VERBOSE : VERB_DEBUG,
-						"No instrument mapped to %s %d, program %d%s\n",
-						(dr) ? "drum set" : "tone bank", b, i, 
-						(b != 0) ? "" : " - this instrument will not be heard");
-				}
-				else
-				{
-					printMessage(CMSG_ERROR, VERB_DEBUG,
-						"Couldn't load instrument %s (%s %d, program %d)\n",
-						bank->tone[i].name.c_str(),
-						(dr) ? "drum set" : "tone bank", b, i);
-				}
-				if (b != 0)
-				{
-					/* Mark the corresponding instrument in the default
-					   bank / drumset for loading (if it isn't already) */
-					if (((dr) ? instruments->drumset[0] : instruments->tonebank[0])->instrument[i] != NULL)
+					auto fp = open_instrument(bank->tone[i].name.c_str());
+					if (fp != NULL)
 					{
-						((dr) ? instruments->drumset[0] : instruments->tonebank[0])->instrument[i] = MAGIC_LOAD_INSTRUMENT;
+						patches.push_back({ dr, b, i, read_patch_file(fp), NULL });
+						continue;
 					}
 				}
-				errors++;
 			}
+			errors += finish_instrument(dr, b, i, ip);
 		}
 	}
 	return errors;
 }
 
+/* Falls back to the sound fonts if the patch could not be loaded and
+   publishes the result in the bank. */
+int Renderer::finish_instrument(int dr, int b, int i, Instrument *ip)
+{
+	ToneBank *bank = ((dr) ? instruments->drumset[b] : instruments->tonebank[b]);
+	if (ip == NULL)
+	{
+		ip = load_instrument_font_order(1, dr, b, i);
+	}
+	bank->instrument[i].store(ip, std::memory_order_release);
+	if (ip != NULL)
+	{
+		return 0;
+	}
+	if (bank->tone[i].name.length() == 0)
+	{
+		printMessage(CMSG_WARNING, (b != 0) ? VERB_VERBOSE : VERB_DEBUG,
+			"No instrument mapped to %s %d, program %d%s\n",
+			(dr) ? "drum set" : "tone bank", b, i, 
+			(b != 0) ? "" : " - this instrument will not be heard");
+	}
+	else
+	{
+		printMessage(CMSG_ERROR, VERB_DEBUG,
+			"Couldn't load instrument %s (%s %d, program %d)\n",
+			bank->tone[i].name.c_str(),
+			(dr) ? "drum set" : "tone bank", b, i);
+	}
+	if (b != 0)
+	{
+		/* Mark the corresponding instrument in the default
+		   bank / drumset for loading (if it isn't already) */
+		if (((dr) ? instruments->drumset[0] : instruments->tonebank[0])->instrument[i] != NULL)
+		{
+			((dr) ? instruments->drumset[0] : instruments->tonebank[0])->instrument[i].store(MAGIC_LOAD_INSTRUMENT, std::memory_order_release);
+		}
+	}
+	return 1;
+}
+
 int Renderer::load_missing_instruments()
 {
-	int i = MAXBANK, errors = 0;
-	while (i--)
+	std::vector<PatchLoad> patches;
+	int errors = 0;
+
+	/* A failed instrument may mark its counterpart in the default bank
+	   again, so keep going until nothing is left to load. */
+	for (bool more = true; more; )
 	{
-		if (instruments->tonebank[i] != NULL)
-			errors += fill_bank(0, i);
-		if (instruments->drumset[i] != NULL)
-			errors += fill_bank(1, i);
+		int i = MAXBANK;
+		while (i--)
+		{
+			if (instruments->tonebank[i] != NULL)
+				errors += fill_bank(0, i, patches);
+			if (instruments->drumset[i] != NULL)
+				errors += fill_bank(1, i, patches);
+		}
+
+		/* Decoding, format conversion and pre-resampling take most of the
+		   time and each patch only touches its own data. */
+		ZMusic_ParallelFor(patches.size(), [&](size_t j)
+		{
+			PatchLoad &patch = patches[j];
+			ToneBankElement &tone = ((patch.dr) ? instruments->drumset[patch.b] : instruments->tonebank[patch.b])->tone[patch.i];
+			patch.ip = load_instrument_data(patch.data, tone.name.c_str(),
+				(patch.dr) ? 1 : 0,
+				tone.pan,
+				(tone.note != -1) ? tone.note : ((patch.dr) ? patch.i : -1),
+				(tone.strip_loop != -1) ? tone.strip_loop : ((patch.dr) ? 1 : -1),
+				(tone.strip_envelope != -1) ? tone.strip_envelope : ((patch.dr) ? 1 : -1),
+				tone.strip_tail);
+		});
+
+		more = false;
+		for (auto &patch : patches)
+		{
+			errors += finish_instrument(patch.dr, patch.b, patch.i, patch.ip);
+			if (patch.b != 0 && patch.ip == NULL) more = true;
+		}
+		patches.clear();
 	}
 	return errors;
 }
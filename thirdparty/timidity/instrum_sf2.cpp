@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <math.h>
 #include <memory>
+#include <vector>
 #include <assert.h>
 #include <algorithm>
 
@@ -12,6 +13,7 @@
 #include "instrum.h"
 #include "playmidi.h"
 #include "sf2.h"
+#include "../../source/zmusic/memusage.h"
 
 namespace Timidity
 {
@@ -232,26 +234,6 @@ static inline uint32_t read_id(timidity_file *f)
 	return id;
 }
 
-static inline int read_byte(timidity_file *f)
-{
-	uint8_t x;
-	if (f->read(&x, 1) != 1)
-	{
-		throw CIOErr();
-	}
-	return x;
-}
-
-static inline int read_char(timidity_file *f)
-{
-	int8_t x;
-	if (f->read(&x, 1) != 1)
-	{
-		throw CIOErr();
-	}
-	return x;
-}
-
 static inline int read_uword(timidity_file *f)
 {
 	uint16_t x;
@@ -302,6 +284,88 @@ static inline void skip_chunk(timidity_file *f, uint32_t len)
 	}
 }
 
+//==========================================================================
+//
+// Holds the data of one chunk, so that its records get decoded from memory
+// instead of with a file read for every field. Readers that have the file
+// in memory are used in place.
+//
+//==========================================================================
+
+class ChunkData
+{
+	std::vector<uint8_t> Buffer;
+	const uint8_t *Pos;
+	const uint8_t *End;
+
+	const uint8_t *take(uint32_t n)
+	{
+		if (uint32_t(End - Pos) < n)
+		{
+			throw CIOErr();
+		}
+		const uint8_t *p = Pos;
+		Pos += n;
+		return p;
+	}
+
+public:
+	ChunkData(timidity_file *f, uint32_t len)
+	{
+		const uint8_t *mem = f->memoryData();
+		long start = f->tell();
+		if (mem != nullptr && start >= 0 && len <= uint32_t(f->filelength() - start))
+		{
+			Pos = mem + start;
+			skip_chunk(f, len);
+		}
+		else
+		{
+			Buffer.resize(len);
+			if (f->read(Buffer.data(), len) != (long)len)
+			{
+				throw CIOErr();
+			}
+			Pos = Buffer.data();
+			skip_chunk(f, len & 1);
+		}
+		End = Pos + len;
+	}
+
+	int read_byte()
+	{
+		return *take(1);
+	}
+
+	int read_char()
+	{
+		return (int8_t)*take(1);
+	}
+
+	int read_uword()
+	{
+		const uint8_t *p = take(2);
+		return p[0] | (p[1] << 8);
+	}
+
+	uint32_t read_dword()
+	{
+		const uint8_t *p = take(4);
+		return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+	}
+
+	void read_name(char name[21])
+	{
+		memcpy(name, take(20), 20);
+		name[20] = 0;
+	}
+
+	void skip(uint32_t n)
+	{
+		take(n);
+	}
+};
+
 static void check_list(timidity_file *f, uint32_t id, uint32_t filelen, uint32_t &chunklen)
 {
 	if (read_id(f) != ID_LIST)
@@ -453,13 +517,14 @@ static void ParsePhdr(SFFile *sf2, timidity_file *f, uint32_t chunkid, uint32_t
 	sf2->Presets = new SFPreset[sf2->NumPresets];
 	preset = sf2->Presets;
 
+	ChunkData data(f, chunklen);
 	for (int i = sf2->NumPresets; i != 0; --i, ++preset)
 	{
-		read_name(f, preset->Name);
-		preset->Program = read_uword(f);
-		preset->Bank = read_uword(f);
-		preset->BagIndex = read_uword(f);
-		skip_chunk(f, 4*3);	// Skip library, genre, and morphology
+		data.read_name(preset->Name);
+		preset->Program = data.read_uword();
+		preset->Bank = data.read_uword();
+		preset->BagIndex = data.read_uword();
+		data.skip(4*3);	// Skip library, genre, and morphology
 
 		// Section 7.2, page 22:
 		//		The preset bag indices will be monotonically increasing with
@@ -514,10 +579,11 @@ static void ParseBag(SFFile *sf2, timidity_file *f, uint32_t chunkid, uint32_t c
 		sf2->NumInstrBags = numbags;
 	}
 
+	ChunkData data(f, chunklen);
 	for (bag = bags, i = numbags; i != 0; --i, ++bag)
 	{
-		bag->GenIndex = read_uword(f);
-		uint16_t mod = read_uword(f);
+		bag->GenIndex = data.read_uword();
+		uint16_t mod = data.read_uword();
 		// Section 7.3, page 22:
 		//		If the generator or modulator indices are non-monotonic or do not
 		//		match the size of the respective PGEN or PMOD sub-chunks, the file
@@ -587,10 +653,11 @@ static void ParseGen(SFFile *sf2, timidity_file *f, uint32_t chunkid, uint32_t c
 		sf2->NumInstrGenerators = numgens;
 	}
 	
+	ChunkData data(f, chunklen);
 	for (i = numgens, gen = gens; i != 0; --i, ++gen)
 	{
-		gen->Oper = read_uword(f);
-		gen->uAmount = read_uword(f);
+		gen->Oper = data.read_uword();
+		gen->uAmount = data.read_uword();
 #ifdef __BIG_ENDIAN__
 		if (gen->Oper == GEN_keyRange || gen->Oper == GEN_velRange)
 		{
@@ -617,10 +684,11 @@ static void ParseInst(SFFile *sf2, timidity_file *f, uint32_t chunkid, uint32_t
 
 	sf2->NumInstruments = chunklen / 22;
 	sf2->Instruments = inst = new SFInst[sf2->NumInstruments];
+	ChunkData data(f, chunklen);
 	for (i = sf2->NumInstruments; i != 0; --i, ++inst)
 	{
-		read_name(f, inst->Name);
-		inst->BagIndex = read_uword(f);
+		data.read_name(inst->Name);
+		inst->BagIndex = data.read_uword();
 
 		// Section 7.6, page 25:
 		//		If the instrument bag indices are non-monotonic or if the terminal
@@ -651,19 +719,20 @@ static void ParseShdr(SFFile *sf2, timidity_file *f, uint32_t chunkid, uint32_t
 
 	sf2->NumSamples = chunklen / 46;
 	sf2->Samples = sample = new SFSample[sf2->NumSamples];
+	ChunkData data(f, chunklen);
 	for (i = sf2->NumSamples; i != 0; --i, ++sample)
 	{
 		sample->InMemoryData = NULL;
-		read_name(f, sample->Name);
-		sample->Start = read_dword(f);
-		sample->End = read_dword(f);
-		sample->StartLoop = read_dword(f);
-		sample->EndLoop = read_dword(f);
-		sample->SampleRate = read_dword(f);
-		sample->OriginalPitch = read_byte(f);
-		sample->PitchCorrection = read_char(f);
-		sample->SampleLink = read_uword(f);
-		sample->SampleType = read_uword(f);
+		data.read_name(sample->Name);
+		sample->Start = data.read_dword();
+		sample->End = data.read_dword();
+		sample->StartLoop = data.read_dword();
+		sample->EndLoop = data.read_dword();
+		sample->SampleRate = data.read_dword();
+		sample->OriginalPitch = data.read_byte();
+		sample->PitchCorrection = data.read_char();
+		sample->SampleLink = data.read_uword();
+		sample->SampleType = data.read_uword();
 
 		if (sample->SampleRate == 0)
 		{
@@ -783,6 +852,8 @@ SFFile::SFFile(const char *filename)
 	NumInstrBags = 0;
 	NumInstrGenerators = 0;
 	NumSamples = 0;
+	SampleReader = NULL;
+	SampleBytes = 0;
 }
 
 SFFile::~SFFile()
@@ -822,6 +893,11 @@ SFFile::~SFFile()
 		}
 		delete[] Samples;
 	}
+	if (SampleReader != NULL)
+	{
+		SampleReader->close();
+	}
+	ZMusic_AccountInstruments(-(ptrdiff_t)SampleBytes);
 }
 
 bool SFFile::FinalStructureTest()
@@ -1500,40 +1576,68 @@ void SFFile::ApplyGeneratorsToRegion(SFGenComposite *gen, SFSample *sfsamp, Rend
 // SFFile :: LoadSample
 //
 // Loads a sample's data and converts it from 16/24-bit to floating point.
+// The font stays open for the samples that follow. If the reader has it
+// in memory, as a mapping does, they are converted straight from there.
 //
 //===========================================================================
 
 void SFFile::LoadSample(Renderer *song, SFSample *sample)
 {
-	auto fp = song->instruments->sfreader->open_file(Filename.c_str());
-	uint32_t i;
+	if (SampleReader == NULL)
+	{
+		SampleReader = song->instruments->sfreader->open_file(Filename.c_str());
+		if (SampleReader == NULL)
+		{
+			return;
+		}
+	}
+	uint32_t count = sample->End - sample->Start;
+	bool lsb = SampleDataLSBOffset != 0;
+	const uint8_t *data16 = NULL, *data8 = NULL;
+	std::vector<uint8_t> buffer;
 
-	if (!fp)
+	const uint8_t *mem = SampleReader->memoryData();
+	size_t filelen = (size_t)SampleReader->filelength();
+	if (mem != NULL && SampleDataOffset + (size_t)sample->End * 2 <= filelen &&
+		(!lsb || SampleDataLSBOffset + (size_t)sample->End <= filelen))
 	{
-		return;
+		data16 = mem + SampleDataOffset + (size_t)sample->Start * 2;
+		if (lsb) data8 = mem + SampleDataLSBOffset + sample->Start;
 	}
-	sample->InMemoryData = new float[sample->End - sample->Start + 1];
-	fp->seek(SampleDataOffset + sample->Start * 2, SEEK_SET);
-	// Load 16-bit sample data.
-	for (i = 0; i < sample->End - sample->Start; ++i)
+	else
 	{
-		uint16_t samp;
-		fp->read(&samp, 2);
-		samp = LittleShort(samp);
-		sample->InMemoryData[i] = samp / 32768.f;
+		// Anything that cannot be read stays silent.
+		buffer.resize((size_t)count * (lsb ? 3 : 2));
+		SampleReader->seek(SampleDataOffset + sample->Start * 2, SEEK_SET);
+		SampleReader->read(buffer.data(), count * 2);
+		data16 = buffer.data();
+		if (lsb)
+		{
+			SampleReader->seek(SampleDataLSBOffset + sample->Start, SEEK_SET);
+			SampleReader->read(buffer.data() + count * 2, count);
+			data8 = buffer.data() + count * 2;
+		}
+	}
+
+	sample->InMemoryData = new float[count + 1];
+	if (data8 == NULL)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			sample->InMemoryData[i] = int16_t(data16[i * 2] | (data16[i * 2 + 1] << 8)) / 32768.f;
+		}
 	}
-	if (SampleDataLSBOffset != 0)
-	{ // Load lower 8 bits of 24-bit sample data.
-		fp->seek(SampleDataLSBOffset + sample->Start, SEEK_SET);
-		for (i = 0; i < sample->End - sample->Start; ++i)
+	else
+	{
+		for (uint32_t i = 0; i < count; ++i)
 		{
-			uint8_t samp;
-			fp->read(&samp, 1);
-			sample->InMemoryData[i] = ((((int32_t(sample->InMemoryData[i] * 32768) << 8) | samp) << 8) >> 8) / 8388608.f;
+			int32_t samp = int16_t(data16[i * 2] | (data16[i * 2 + 1] << 8)) * 256 + data8[i];
+			sample->InMemoryData[i] = samp / 8388608.f;
 		}
 	}
 	// Final 0 byte is for interpolation.
-	sample->InMemoryData[i] = 0;
-	fp->close();
+	sample->InMemoryData[count] = 0;
+	SampleBytes += (count + 1) * sizeof(float);
+	ZMusic_AccountInstruments((count + 1) * sizeof(float));
 }
 }
\ No newline at end of file
@@ -24,6 +24,13 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIMIDITY_MIX_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define TIMIDITY_MIX_NEON
+#include <arm_neon.h>
+#endif
 
 #include "timidity.h"
 #include "common.h"
@@ -414,7 +421,7 @@ static void update_tremolo(Voice *v)
 }
 
 /* Returns 1 if the note died */
-static int update_signal(Voice *v)
+static int update_signal(Renderer *song, Voice *v)
 {
 	if (v->eg1.env.bUpdating && v->eg1.Update(v))
 	{
@@ -425,21 +432,166 @@ static int update_signal(Voice *v)
 		update_tremolo(v);
 	}
 	apply_envelope_to_amp(v);
+	/* Released and sustained notes that can no longer be heard get ramped out
+	   by the next mix_voice, like ones whose envelope ran out. */
+	if ((v->status & (VOICE_RELEASING | NOTE_SUSTAIN)) && !(v->status & VOICE_STOPPING) &&
+		fabsf(v->left_mix) < song->voice_floor && fabsf(v->right_mix) < song->voice_floor)
+	{
+		shutoff_voice(v);
+		return 1;
+	}
 	return 0;
 }
 
-static void mix_mystery_signal(int32_t control_ratio, const sample_t *sp, float *lp, Voice *v, int count)
+/* The mixing kernels. The envelope and tremolo only change every
+   control_ratio samples, so everything in between is mixed with constant
+   volumes, several samples at once where the CPU can do it. */
+
+#if defined(TIMIDITY_MIX_SSE2)
+
+/* Adds sp[i] * left to lp[i * 2] and sp[i] * right to lp[i * 2 + 1]. */
+void mix_span_stereo(const sample_t *sp, float *lp, final_volume_t left, final_volume_t right, int count)
+{
+	__m128 vol = _mm_setr_ps(left, right, left, right);
+	for (; count >= 4; count -= 4, sp += 4, lp += 8)
+	{
+		__m128 s = _mm_loadu_ps(sp);
+		_mm_storeu_ps(lp, _mm_add_ps(_mm_loadu_ps(lp), _mm_mul_ps(_mm_unpacklo_ps(s, s), vol)));
+		_mm_storeu_ps(lp + 4, _mm_add_ps(_mm_loadu_ps(lp + 4), _mm_mul_ps(_mm_unpackhi_ps(s, s), vol)));
+	}
+	for (; count > 0; count--, lp += 2)
+	{
+		sample_t s = *sp++;
+		lp[0] += s * left;
+		lp[1] += s * right;
+	}
+}
+
+/* Adds sp[i] * amp to lp[i * 2]. Every group of 4 samples also loads and
+   stores the 4 floats in between, the last of which is lp[i * 2 + 1] of the
+   next sample. For the right channel that is past the end of the buffer
+   after the last sample, so the last group is always left to the scalar
+   loop. */
+void mix_span_single(const sample_t *sp, float *lp, final_volume_t amp, int count)
+{
+	__m128 vol = _mm_set1_ps(amp), zero = _mm_setzero_ps();
+	for (; count > 4; count -= 4, sp += 4, lp += 8)
+	{
+		__m128 s = _mm_mul_ps(_mm_loadu_ps(sp), vol);
+		_mm_storeu_ps(lp, _mm_add_ps(_mm_loadu_ps(lp), _mm_unpacklo_ps(s, zero)));
+		_mm_storeu_ps(lp + 4, _mm_add_ps(_mm_loadu_ps(lp + 4), _mm_unpackhi_ps(s, zero)));
+	}
+	for (; count > 0; count--, lp += 2)
+	{
+		lp[0] += *sp++ * amp;
+	}
+}
+
+/* Adds sp[i] * amp to lp[i]. */
+void mix_span_mono(const sample_t *sp, float *lp, final_volume_t amp, int count)
+{
+	__m128 vol = _mm_set1_ps(amp);
+	for (; count >= 4; count -= 4, sp += 4, lp += 4)
+	{
+		_mm_storeu_ps(lp, _mm_add_ps(_mm_loadu_ps(lp), _mm_mul_ps(_mm_loadu_ps(sp), vol)));
+	}
+	while (count-- > 0)
+	{
+		*lp++ += *sp++ * amp;
+	}
+}
+
+#elif defined(TIMIDITY_MIX_NEON)
+
+void mix_span_stereo(const sample_t *sp, float *lp, final_volume_t left, final_volume_t right, int count)
+{
+	const float volumes[4] = { left, right, left, right };
+	float32x4_t vol = vld1q_f32(volumes);
+	for (; count >= 4; count -= 4, sp += 4, lp += 8)
+	{
+		float32x4_t s = vld1q_f32(sp);
+		float32x4x2_t pairs = vzipq_f32(s, s);
+		vst1q_f32(lp, vaddq_f32(vld1q_f32(lp), vmulq_f32(pairs.val[0], vol)));
+		vst1q_f32(lp + 4, vaddq_f32(vld1q_f32(lp + 4), vmulq_f32(pairs.val[1], vol)));
+	}
+	for (; count > 0; count--, lp += 2)
+	{
+		sample_t s = *sp++;
+		lp[0] += s * left;
+		lp[1] += s * right;
+	}
+}
+
+/* Like the SSE2 version, this must not reach the floats after the last sample. */
+void mix_span_single(const sample_t *sp, float *lp, final_volume_t amp, int count)
+{
+	for (; count > 4; count -= 4, sp += 4, lp += 8)
+	{
+		float32x4x2_t out = vld2q_f32(lp);
+		out.val[0] = vaddq_f32(out.val[0], vmulq_n_f32(vld1q_f32(sp), amp));
+		vst2q_f32(lp, out);
+	}
+	for (; count > 0; count--, lp += 2)
+	{
+		lp[0] += *sp++ * amp;
+	}
+}
+
+void mix_span_mono(const sample_t *sp, float *lp, final_volume_t amp, int count)
+{
+	for (; count >= 4; count -= 4, sp += 4, lp += 4)
+	{
+		vst1q_f32(lp, vaddq_f32(vld1q_f32(lp), vmulq_n_f32(vld1q_f32(sp), amp)));
+	}
+	while (count-- > 0)
+	{
+		*lp++ += *sp++ * amp;
+	}
+}
+
+#else
+
+void mix_span_stereo(const sample_t *sp, float *lp, final_volume_t left, final_volume_t right, int count)
+{
+	while (count-- > 0)
+	{
+		sample_t s = *sp++;
+		lp[0] += s * left;
+		lp[1] += s * right;
+		lp += 2;
+	}
+}
+
+void mix_span_single(const sample_t *sp, float *lp, final_volume_t amp, int count)
+{
+	while (count-- > 0)
+	{
+		lp[0] += *sp++ * amp;
+		lp += 2;
+	}
+}
+
+void mix_span_mono(const sample_t *sp, float *lp, final_volume_t amp, int count)
+{
+	while (count-- > 0)
+	{
+		*lp++ += *sp++ * amp;
+	}
+}
+
+#endif
+
+static void mix_mystery_signal(Renderer *song, const sample_t *sp, float *lp, Voice *v, int count)
 {
 	final_volume_t 
 		left = v->left_mix, 
 		right = v->right_mix;
 	int cc;
-	sample_t s;
 
 	if (!(cc = v->control_counter))
 	{
-		cc = control_ratio;
-		if (update_signal(v))
+		cc = song->control_ratio;
+		if (update_signal(song, v))
 			return;	/* Envelope ran out */
 
 		left = v->left_mix;
@@ -451,15 +603,11 @@ static void mix_mystery_signal(int32_t control_ratio, const sample_t *sp, float
 		if (cc < count)
 		{
 			count -= cc;
-			while (cc--)
-			{
-				s = *sp++;
-				lp[0] += left * s;
-				lp[1] += right * s;
-				lp += 2;
-			}
-			cc = control_ratio;
-			if (update_signal(v))
+			mix_span_stereo(sp, lp, left, right, cc);
+			sp += cc;
+			lp += cc * 2;
+			cc = song->control_ratio;
+			if (update_signal(song, v))
 				return;	/* Envelope ran out */
 			left = v->left_mix;
 			right = v->right_mix;
@@ -467,27 +615,21 @@ static void mix_mystery_signal(int32_t control_ratio, const sample_t *sp, float
 		else
 		{
 			v->control_counter = cc - count;
-			while (count--)
-			{
-				s = *sp++;
-				lp[0] += left * s;
-				lp[1] += right * s;
-				lp += 2;
-			}
+			mix_span_stereo(sp, lp, left, right, count);
 			return;
 		}
 	}
 }
 
-static void mix_single_signal(int32_t control_ratio, const sample_t *sp, float *lp, Voice *v, float *ampat, int count)
+static void mix_single_signal(Renderer *song, const sample_t *sp, float *lp, Voice *v, float *ampat, int count)
 {
 	final_volume_t amp;
 	int cc;
 
 	if (0 == (cc = v->control_counter))
 	{
-		cc = control_ratio;
-		if (update_signal(v))
+		cc = song->control_ratio;
+		if (update_signal(song, v))
 			return;		/* Envelope ran out */
 	}
 	amp = *ampat;
@@ -497,51 +639,45 @@ static void mix_single_signal(int32_t control_ratio, const sample_t *sp, float *
 		if (cc < count)
 		{
 			count -= cc;
-			while (cc--)
-			{
-				lp[0] += *sp++ * amp;
-				lp += 2;
-			}
-			cc = control_ratio;
-			if (update_signal(v))
+			mix_span_single(sp, lp, amp, cc);
+			sp += cc;
+			lp += cc * 2;
+			cc = song->control_ratio;
+			if (update_signal(song, v))
 				return;	/* Envelope ran out */
 			amp = *ampat;
 		}
 		else
 		{
 			v->control_counter = cc - count;
-			while (count--)
-			{
-				lp[0] += *sp++ * amp;
-				lp += 2;
-			}
+			mix_span_single(sp, lp, amp, count);
 			return;
 		}
 	}
 }
 
-static void mix_single_left_signal(int32_t control_ratio, const sample_t *sp, float *lp, Voice *v, int count)
+static void mix_single_left_signal(Renderer *song, const sample_t *sp, float *lp, Voice *v, int count)
 {
-	mix_single_signal(control_ratio, sp, lp, v, &v->left_mix, count);
+	mix_single_signal(song, sp, lp, v, &v->left_mix, count);
 }
 
-static void mix_single_right_signal(int32_t control_ratio, const sample_t *sp, float *lp, Voice *v, int count)
+static void mix_single_right_signal(Renderer *song, const sample_t *sp, float *lp, Voice *v, int count)
 {
-	mix_single_signal(control_ratio, sp, lp + 1, v, &v->right_mix, count);
+	mix_single_signal(song, sp, lp + 1, v, &v->right_mix, count);
 }
 
-static void mix_mono_signal(int32_t control_ratio, const sample_t *sp, float *lp, Voice *v, int count)
+static void mix_mono_signal(Renderer *song, const sample_t *sp, float *lp, Voice *v, int count)
 {
 	final_volume_t 
-		left = v->left_mix;
+		left = (v->left_mix + v->right_mix) * 0.5f;
 	int cc;
 
 	if (!(cc = v->control_counter))
 	{
-		cc = control_ratio;
-		if (update_signal(v))
+		cc = song->control_ratio;
+		if (update_signal(song, v))
 			return;	/* Envelope ran out */
-		left = v->left_mix;
+		left = (v->left_mix + v->right_mix) * 0.5f;
 	}
 
 	while (count)
@@ -549,22 +685,18 @@ static void mix_mono_signal(int32_t control_ratio, const sample_t *sp, float *lp
 		if (cc < count)
 		{
 			count -= cc;
-			while (cc--)
-			{
-				*lp++ += *sp++ * left;
-			}
-			cc = control_ratio;
-			if (update_signal(v))
+			mix_span_mono(sp, lp, left, cc);
+			sp += cc;
+			lp += cc;
+			cc = song->control_ratio;
+			if (update_signal(song, v))
 				return;	/* Envelope ran out */
-			left = v->left_mix;
+			left = (v->left_mix + v->right_mix) * 0.5f;
 		}
 		else
 		{
 			v->control_counter = cc - count;
-			while (count--)
-			{
-				*lp++ += *sp++ * left;
-			}
+			mix_span_mono(sp, lp, left, count);
 			return;
 		}
 	}
@@ -572,51 +704,25 @@ static void mix_mono_signal(int32_t control_ratio, const sample_t *sp, float *lp
 
 static void mix_mystery(int32_t control_ratio, const sample_t *sp, float *lp, Voice *v, int count)
 {
-	final_volume_t 
-		left = v->left_mix, 
-		right = v->right_mix;
-	sample_t s;
-
-	while (count--)
-	{
-		s = *sp++;
-		lp[0] += s * left;
-		lp[1] += s * right;
-		lp += 2;
-	}
-}
-
-static void mix_single(const sample_t *sp, float *lp, final_volume_t amp, int count)
-{
-	while (count--)
-	{
-		lp[0] += *sp++ * amp;
-		lp += 2;
-	}
+	mix_span_stereo(sp, lp, v->left_mix, v->right_mix, count);
 }
 
 static void mix_single_left(const sample_t *sp, float *lp, Voice *v, int count)
 {
-	mix_single(sp, lp, v->left_mix, count);
+	mix_span_single(sp, lp, v->left_mix, count);
 }
 static void mix_single_right(const sample_t *sp, float *lp, Voice *v, int count)
 {
-	mix_single(sp, lp + 1, v->right_mix, count);
+	mix_span_single(sp, lp + 1, v->right_mix, count);
 }
 
 static void mix_mono(const sample_t *sp, float *lp, Voice *v, int count)
 {
-	final_volume_t 
-		left = v->left_mix;
-
-	while (count--)
-	{
-		*lp++ += *sp++ * left;
-	}
+	mix_span_mono(sp, lp, (v->left_mix + v->right_mix) * 0.5f, count);
 }
 
 /* Ramp a note out in c samples */
-static void ramp_out(const sample_t *sp, float *lp, Voice *v, int c)
+static void ramp_out(const sample_t *sp, float *lp, Voice *v, int c, bool mono)
 {
 	final_volume_t left, right, li, ri;
 
@@ -625,6 +731,22 @@ static void ramp_out(const sample_t *sp, float *lp, Voice *v, int c)
 	/* Fix by James Caldwell */
 	if ( c == 0 ) c = 1;
 
+	if (mono)
+	{
+		left = (v->left_mix + v->right_mix) * 0.5f;
+		li = -(left/c);
+		if (li == 0) li = -1;
+
+		while (c--)
+		{
+			left += li;
+			if (left < 0)
+				return;
+			*lp++ += *sp++ * left;
+		}
+		return;
+	}
+
 	/* printf("Ramping out: left=%d, c=%d, li=%d\n", left, c, li); */
 
 	if (v->right_mix == 0)			// All the way to the left
@@ -709,7 +831,7 @@ void mix_voice(Renderer *song, float *buf, Voice *v, int c)
 		if (count >= MAX_DIE_TIME)
 			count = MAX_DIE_TIME;
 		sp = resample_voice(song, v, &count);
-		ramp_out(sp, buf, v, count);
+		ramp_out(sp, buf, v, count, song->mono);
 		v->status = 0;
 	}
 	else
@@ -719,11 +841,22 @@ void mix_voice(Renderer *song, float *buf, Voice *v, int c)
 		{
 			return;
 		}
-		if (v->right_mix == 0)			// All the way to the left
+		if (song->mono)
+		{
+			if (v->eg1.env.bUpdating || v->tremolo_phase_increment != 0)
+			{
+				mix_mono_signal(song, sp, buf, v, count);
+			}
+			else
+			{
+				mix_mono(sp, buf, v, count);
+			}
+		}
+		else if (v->right_mix == 0)			// All the way to the left
 		{
 			if (v->eg1.env.bUpdating || v->tremolo_phase_increment != 0)
 			{
-				mix_single_left_signal(song->control_ratio, sp, buf, v, count);
+				mix_single_left_signal(song, sp, buf, v, count);
 			}
 			else
 			{
@@ -734,7 +867,7 @@ void mix_voice(Renderer *song, float *buf, Voice *v, int c)
 		{
 			if (v->eg1.env.bUpdating || v->tremolo_phase_increment != 0)
 			{
-				mix_single_right_signal(song->control_ratio, sp, buf, v, count);
+				mix_single_right_signal(song, sp, buf, v, count);
 			}
 			else
 			{
@@ -745,7 +878,7 @@ void mix_voice(Renderer *song, float *buf, Voice *v, int c)
 		{
 			if (v->eg1.env.bUpdating || v->tremolo_phase_increment)
 			{
-				mix_mystery_signal(song->control_ratio, sp, buf, v, count);
+				mix_mystery_signal(song, sp, buf, v, count);
 			}
 			else
 			{
@@ -58,6 +58,11 @@ void Envelope::Release(struct Voice* v)
 void Renderer::reset_voices()
 {
 	memset(voice, 0, sizeof(voice[0]) * voices);
+	free_voices.clear();
+	for (int i = voices; i-- > 0; )
+	{
+		free_voices.push_back(i);
+	}
 }
 
 /* Process the Reset All Controllers event */
@@ -366,15 +371,14 @@ void Renderer::start_note(int chan, int note, int vel)
 	note &= 0x7f;
 	if (ISDRUMCHANNEL(chan))
 	{
-		if (NULL == instruments->drumset[bank] || NULL == (ip = instruments->drumset[bank]->instrument[note]))
+		if (NULL == instruments->drumset[bank] || NULL == (ip = instruments->drumset[bank]->instrument[note].load(std::memory_order_acquire)))
 		{
-			if (!(ip = instruments->drumset[0]->instrument[note]))
+			if (!(ip = instruments->drumset[0]->instrument[note].load(std::memory_order_acquire)))
 				return; /* No instrument? Then we can't play. */
 		}
-		assert(ip != MAGIC_LOAD_INSTRUMENT);
 		if (ip == MAGIC_LOAD_INSTRUMENT)
 		{
-			return;
+			return;	/* Marked for loading by another renderer sharing the instruments. */
 		}
 		if (ip->samples != 1 && ip->sample->type == INST_GUS)
 		{
@@ -388,15 +392,14 @@ void Renderer::start_note(int chan, int note, int vel)
 		{
 			ip = default_instrument;
 		}
-		else if (NULL == instruments->tonebank[bank] || NULL == (ip = instruments->tonebank[bank]->instrument[prog]))
+		else if (NULL == instruments->tonebank[bank] || NULL == (ip = instruments->tonebank[bank]->instrument[prog].load(std::memory_order_acquire)))
 		{
-			if (NULL == (ip = instruments->tonebank[0]->instrument[prog]))
+			if (NULL == (ip = instruments->tonebank[0]->instrument[prog].load(std::memory_order_acquire)))
 				return; /* No instrument? Then we can't play. */
 		}
-		assert(ip != MAGIC_LOAD_INSTRUMENT);
 		if (ip == MAGIC_LOAD_INSTRUMENT)
 		{
-			return;
+			return;	/* Marked for loading by another renderer sharing the instruments. */
 		}
 	}
 
@@ -491,12 +494,13 @@ int Renderer::allocate_voice()
 	int i, lowest;
 	float lv, v;
 
-	for (i = 0; i < voices; ++i)
+	/* ComputeOutput puts the voices that stopped back on the list, so that
+	   notes can start without searching for one as long as any are left. */
+	if (!free_voices.empty())
 	{
-		if (!(voice[i].status & VOICE_RUNNING))
-		{
-			return i; /* Can't get a lower volume than silence */
-		}
+		i = free_voices.back();
+		free_voices.pop_back();
+		return i; /* Can't get a lower volume than silence */
 	}
 
 	/* Look for the decaying note with the lowest volume */
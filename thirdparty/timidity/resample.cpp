@@ -24,6 +24,13 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIMIDITY_RESAMPLE_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define TIMIDITY_RESAMPLE_NEON
+#include <arm_neon.h>
+#endif
 
 #include "timidity.h"
 #include "common.h"
@@ -42,6 +49,79 @@ namespace Timidity
 #define FINALINTERP if (ofs == le) *dest++ = src[ofs >> FRACTION_BITS];
 /* So it isn't interpolation. At least it's final. */
 
+/* Does RESAMPLATION count times, advancing ofs by incr each time. The
+   callers have already made sure that no loop point gets crossed on the
+   way, so there is nothing to check for here, and 4 samples at a time get
+   interpolated where the CPU can do it. The points still have to be fetched
+   one by one, but the positions, fractions and arithmetic are shared.
+   Dividing by 1 << FRACTION_BITS and multiplying by its inverse round the
+   same, so this gives the same output as the scalar loop. */
+
+#if defined(TIMIDITY_RESAMPLE_SSE2)
+
+sample_t *resample_span(sample_t *dest, const sample_t *src, int ofs, int incr, int count)
+{
+	const __m128i step = _mm_set1_epi32(incr * 4), mask = _mm_set1_epi32(FRACTION_MASK);
+	const __m128 scale = _mm_set1_ps(1.f / (1 << FRACTION_BITS));
+	__m128i pos = _mm_add_epi32(_mm_set1_epi32(ofs), _mm_setr_epi32(0, incr, incr * 2, incr * 3));
+	for (; count >= 4; count -= 4, dest += 4, ofs += incr * 4)
+	{
+		int o0 = ofs >> FRACTION_BITS, o1 = (ofs + incr) >> FRACTION_BITS;
+		int o2 = (ofs + incr * 2) >> FRACTION_BITS, o3 = (ofs + incr * 3) >> FRACTION_BITS;
+		__m128 a = _mm_setr_ps(src[o0], src[o1], src[o2], src[o3]);
+		__m128 b = _mm_setr_ps(src[o0 + 1], src[o1 + 1], src[o2 + 1], src[o3 + 1]);
+		__m128 m = _mm_cvtepi32_ps(_mm_and_si128(pos, mask));
+		_mm_storeu_ps(dest, _mm_add_ps(a, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(b, a), m), scale)));
+		pos = _mm_add_epi32(pos, step);
+	}
+	while (count-- > 0)
+	{
+		RESAMPLATION;
+		ofs += incr;
+	}
+	return dest;
+}
+
+#elif defined(TIMIDITY_RESAMPLE_NEON)
+
+sample_t *resample_span(sample_t *dest, const sample_t *src, int ofs, int incr, int count)
+{
+	const int32_t lanes[4] = { 0, incr, incr * 2, incr * 3 };
+	const int32x4_t step = vdupq_n_s32(incr * 4), mask = vdupq_n_s32(FRACTION_MASK);
+	int32x4_t pos = vaddq_s32(vdupq_n_s32(ofs), vld1q_s32(lanes));
+	for (; count >= 4; count -= 4, dest += 4, ofs += incr * 4)
+	{
+		int o0 = ofs >> FRACTION_BITS, o1 = (ofs + incr) >> FRACTION_BITS;
+		int o2 = (ofs + incr * 2) >> FRACTION_BITS, o3 = (ofs + incr * 3) >> FRACTION_BITS;
+		const float pa[4] = { src[o0], src[o1], src[o2], src[o3] };
+		const float pb[4] = { src[o0 + 1], src[o1 + 1], src[o2 + 1], src[o3 + 1] };
+		float32x4_t a = vld1q_f32(pa), b = vld1q_f32(pb);
+		float32x4_t m = vcvtq_f32_s32(vandq_s32(pos, mask));
+		vst1q_f32(dest, vaddq_f32(a, vmulq_n_f32(vmulq_f32(vsubq_f32(b, a), m), 1.f / (1 << FRACTION_BITS))));
+		pos = vaddq_s32(pos, step);
+	}
+	while (count-- > 0)
+	{
+		RESAMPLATION;
+		ofs += incr;
+	}
+	return dest;
+}
+
+#else
+
+sample_t *resample_span(sample_t *dest, const sample_t *src, int ofs, int incr, int count)
+{
+	while (count-- > 0)
+	{
+		RESAMPLATION;
+		ofs += incr;
+	}
+	return dest;
+}
+
+#endif
+
 /*************** resampling with fixed increment *****************/
 
 static sample_t *rs_plain(sample_t *resample_buffer, Voice *v, int *countptr)
@@ -76,11 +156,8 @@ static sample_t *rs_plain(sample_t *resample_buffer, Voice *v, int *countptr)
 		count -= i;
 	}
 
-	while (i--) 
-	{
-		RESAMPLATION;
-		ofs += incr;
-	}
+	dest = resample_span(dest, src, ofs, incr, i);
+	ofs += incr * i;
 
 	if (ofs >= le) 
 	{
@@ -125,11 +202,8 @@ static sample_t *rs_loop(sample_t *resample_buffer, Voice *vp, int count)
 		{
 			count -= i;
 		}
-		while (i--) 
-		{
-			RESAMPLATION;
-			ofs += incr;
-		}
+		dest = resample_span(dest, src, ofs, incr, i);
+		ofs += incr * i;
 	}
 
 	vp->sample_offset=ofs; /* Update offset */
@@ -169,11 +243,8 @@ static sample_t *rs_bidir(sample_t *resample_buffer, Voice *vp, int count)
 		{
 			count -= i;
 		}
-		while (i--) 
-		{
-			RESAMPLATION;
-			ofs += incr;
-		}
+		dest = resample_span(dest, src, ofs, incr, i);
+		ofs += incr * i;
 	}
 
 	/* Then do the bidirectional looping */
@@ -191,11 +262,8 @@ static sample_t *rs_bidir(sample_t *resample_buffer, Voice *vp, int count)
 		{
 			count -= i;
 		}
-		while (i--) 
-		{
-			RESAMPLATION;
-			ofs += incr;
-		}
+		dest = resample_span(dest, src, ofs, incr, i);
+		ofs += incr * i;
 		if (ofs >= le) 
 		{
 			/* fold the overshoot back in */
@@ -364,11 +432,8 @@ static sample_t *rs_vib_loop(sample_t *resample_buffer, float rate, Voice *vp, i
 			cc -= i;
 		}
 		count -= i;
-		while (i--) 
-		{
-			RESAMPLATION;
-			ofs += incr;
-		}
+		dest = resample_span(dest, src, ofs, incr, i);
+		ofs += incr * i;
 		if (vibflag) 
 		{
 			cc = vp->vibrato_control_ratio;
@@ -422,11 +487,8 @@ static sample_t *rs_vib_bidir(sample_t *resample_buffer, float rate, Voice *vp,
 			cc -= i;
 		}
 		count -= i;
-		while (i--) 
-		{
-			RESAMPLATION;
-			ofs += incr;
-		}
+		dest = resample_span(dest, src, ofs, incr, i);
+		ofs += incr * i;
 		if (vibflag) 
 		{
 			cc = vp->vibrato_control_ratio;
@@ -455,11 +517,8 @@ static sample_t *rs_vib_bidir(sample_t *resample_buffer, float rate, Voice *vp,
 			cc -= i;
 		}
 		count -= i;
-		while (i--) 
-		{
-			RESAMPLATION;
-			ofs += incr;
-		}
+		dest = resample_span(dest, src, ofs, incr, i);
+		ofs += incr * i;
 		if (vibflag) 
 		{
 			cc = vp->vibrato_control_ratio;
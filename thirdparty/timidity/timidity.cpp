@@ -747,6 +747,8 @@ Renderer::Renderer(float sample_rate, int voices_, Instruments *inst)
 
 	voices = std::max(voices_, 16);
 	voice = new Voice[voices];
+	free_voices.reserve(voices);
+	reset_voices();
 	drumchannels = DEFAULT_DRUMCHANNELS;
 }
 
@@ -775,7 +777,7 @@ void Renderer::ComputeOutput(float *buffer, int count)
 	}
 	Voice *v = &voice[0];
 
-	memset(buffer, 0, sizeof(float)*count*2);		// An integer 0 is also a float 0.
+	memset(buffer, 0, sizeof(float)*count*(mono ? 1 : 2));		// An integer 0 is also a float 0.
 	if (resample_buffer_size < count)
 	{
 		resample_buffer_size = count;
@@ -786,6 +788,10 @@ void Renderer::ComputeOutput(float *buffer, int count)
 		if (v->status & VOICE_RUNNING)
 		{
 			mix_voice(this, buffer, v, count);
+			if (!(v->status & VOICE_RUNNING))
+			{
+				free_voices.push_back(i);
+			}
 		}
 	}
 }
@@ -817,7 +823,7 @@ void Renderer::MarkInstrument(int banknum, int percussion, int instr)
 	}
 	if (bank->instrument[instr] == NULL)
 	{
-		bank->instrument[instr] = MAGIC_LOAD_INSTRUMENT;
+		bank->instrument[instr].store(MAGIC_LOAD_INSTRUMENT, std::memory_order_release);
 	}
 }
 
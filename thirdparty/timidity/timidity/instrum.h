@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include "../../../source/zmusic/fileio.h"
 
 namespace Timidity
@@ -111,6 +113,9 @@ struct Instrument
 
 	int samples;
 	Sample *sample;
+	size_t data_bytes;	/* of GUS sample data, as reported by ZMusic_AccountInstruments. */
+	std::shared_ptr<const uint8_t> mapping;	/* of the cache entry the GUS sample data points into, if it does. */
+	size_t mapping_size = 0;	/* samples whose data lies outside of it own their data. */
 };
 
 struct ToneBankElement
@@ -140,7 +145,9 @@ struct ToneBank
 	~ToneBank();
 
 	ToneBankElement *tone;
-	Instrument *instrument[MAXPROG];
+	// Renderers that share the set read these while playing, without LoadLock, so
+	// an instrument gets stored with release once it is completely loaded.
+	std::atomic<Instrument *> instrument[MAXPROG];
 };
 
 
@@ -172,6 +179,8 @@ public:
 	ToneBank* drumset[MAXBANK] = {};
 	FontFile* Fonts = nullptr;
 	std::string def_instr_name;
+	std::string sample_cache_dir;	// keeps converted patches between runs if not empty
+	std::mutex LoadLock;	// held while loading, a set may be shared by several renderers
 
 	Instruments(MusicIO::SoundFontReaderInterface* reader);
 	~Instruments();
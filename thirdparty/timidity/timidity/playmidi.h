@@ -10,6 +10,13 @@ extern void mix_voice(struct Renderer *song, float *buf, struct Voice *v, int c)
 extern int recompute_envelope(struct Voice *v);
 extern void apply_envelope_to_amp(struct Voice *v);
 
+/* The mixing kernels, which add count samples to interleaved stereo output
+   or, for mono, to lp[i]. mix_span_single only writes the channel lp points
+   at, so the right channel gets passed lp + 1. */
+extern void mix_span_stereo(const sample_t *sp, float *lp, final_volume_t left, final_volume_t right, int count);
+extern void mix_span_single(const sample_t *sp, float *lp, final_volume_t amp, int count);
+extern void mix_span_mono(const sample_t *sp, float *lp, final_volume_t amp, int count);
+
 /*
 playmidi.h
 */
@@ -107,6 +114,11 @@ resample.h
 extern sample_t *resample_voice(struct Renderer *song, Voice *v, int *countptr);
 extern void pre_resample(struct Renderer *song, Sample *sp);
 
+/* The interpolation kernel, which writes count samples from src, starting at
+   the fixed point position ofs and advancing by incr. No loop point may lie
+   in between. */
+extern sample_t *resample_span(sample_t *dest, const sample_t *src, int ofs, int incr, int count);
+
 /* 
 tables.h
 */
@@ -321,6 +321,8 @@ struct SFFile : public FontFile
 	int			 NumInstrBags;
 	int			 NumInstrGenerators;
 	int			 NumSamples;
+	timidity_file *SampleReader;	// kept open while samples are loaded
+	size_t		 SampleBytes;
 };
 
 SFFile *ReadSF2(const char *filename, timidity_file *f);
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 #include "../../../source/zmusic/fileio.h"
 
 namespace Timidity
@@ -186,8 +187,12 @@ struct Renderer
 	int drumchannels;
 	int adjust_panning_immediately;
 	int voices;
+	std::vector<int> free_voices;	// the voices that are not running, for allocate_voice.
 	int lost_notes, cut_notes;
 public:
+	bool mono = false;	// ComputeOutput writes one channel with every voice at the average of its left and right volume.
+	float voice_floor = 0;	// mix level below which released and sustained notes get ramped out early. 0 lets them play to their end.
+
 	Renderer(float sample_rate, int voices, Instruments *instr);
 	~Renderer();
 
@@ -239,11 +244,29 @@ public:
 	void DataEntryCoarseNRPN(int chan, int nrpn, int val);
 	void DataEntryFineNRPN(int chan, int nrpn, int val);
 
-	int fill_bank(int dr, int b);
+	struct PatchLoad
+	{
+		int dr, b, i;
+		std::vector<uint8_t> data;
+		Instrument* ip;
+	};
+
+	int fill_bank(int dr, int b, std::vector<PatchLoad>& patches);
+	int finish_instrument(int dr, int b, int i, Instrument* ip);
+	MusicIO::FileInterface* open_instrument(const char* name);
 	Instrument* load_instrument(const char* name, int percussion,
 		int panning, int note_to_use,
 		int strip_loop, int strip_envelope,
 		int strip_tail);
+	static std::vector<uint8_t> read_patch_file(MusicIO::FileInterface* fp);
+	Instrument* load_instrument_data(const std::vector<uint8_t>& data, const char* name, int percussion,
+		int panning, int note_to_use,
+		int strip_loop, int strip_envelope,
+		int strip_tail);
+	Instrument* read_instrument(MusicIO::FileInterface* fp, const char* name, int percussion,
+		int panning, int note_to_use,
+		int strip_loop, int strip_envelope,
+		int strip_tail, std::vector<uint32_t>* frames);
 
 	Instrument* load_instrument_font(const char* font, int drum, int bank, int instrument);
 	Instrument* load_instrument_font_order(int order, int drum, int bank, int instrument);
@@ -637,6 +637,7 @@ int Instruments::read_config_file(const char *name, int self, int allow_missing_
 	if (tf == NULL)
 		return allow_missing_file ? READ_CONFIG_FILE_NOT_FOUND :
 		READ_CONFIG_ERROR;
+	sourceFiles.push_back(tf->filename);
 
 	init_mblock(&varbuf);
 	if (!self)
@@ -694,6 +694,24 @@ float Freq::freq_fourier(Sample *sp, int *chord)
 
 
 
+/* Run the pitch detection that the instrument loader deferred.
+ * Each call uses its own Freq, so different samples can be analyzed in parallel. */
+void detect_sample_pitch(Sample *sp)
+{
+	if (!sp->pitch_detect_pending)
+		return;
+
+	Freq freq;
+	sp->chord = -1;
+	sp->root_freq_detected = freq.freq_fourier(sp, &(sp->chord));
+	sp->transpose_detected =
+		assign_pitch_to_freq(sp->root_freq_detected) -
+		assign_pitch_to_freq(sp->root_freq / 1024.0);
+	sp->pitch_detect_pending = 0;
+}
+
+
+
 int assign_pitch_to_freq(float freq)
 {
 	/* round to nearest integer using: ceil(fraction - 0.5) */
@@ -28,11 +28,13 @@
 #include <string.h>
 
 #include "../../../source/zmusic/fileio.h"
+#include "../../../source/zmusic/parallel.h"
 #include "timidity.h"
 #include "common.h"
 #include "instrum.h"
 #include "playmidi.h"
 #include "resample.h"
+#include "recache.h"
 #include "tables.h"
 #include "filter.h"
 #include "quantity.h"
@@ -945,17 +947,13 @@ Instrument *Instruments::load_gus_instrument(char *name, ToneBank *bank, int dr,
 		 */
 		if (sp->note_to_use && !(sp->modes & MODES_LOOPING))
 			pre_resample(sp);
+		else if (GetDefaultSettings().timidity_pre_resample)
+			Recache::pre_resample_looped(sp);
 
-		/* do pitch detection on drums if surround chorus is used */
-		if (dr && timidity_surround_chorus)
-		{
-			Freq freq;
-			sp->chord = -1;
-			sp->root_freq_detected = freq.freq_fourier(sp, &(sp->chord));
-			sp->transpose_detected =
-				assign_pitch_to_freq(sp->root_freq_detected) -
-				assign_pitch_to_freq(sp->root_freq / 1024.0);
-		}
+		/* do pitch detection on drums if surround chorus is used;
+		 * it runs on first use or when precaching */
+		if (dr && GetDefaultSettings().timidity_surround_chorus)
+			sp->pitch_detect_pending = 1;
 
 		if (strip_tail == 1) {
 			/* Let's not really, just say we did. */
@@ -1217,6 +1215,35 @@ void Instruments::PrecacheInstruments(const uint16_t *instruments, int count)
 		MarkInstrument((instruments[i] >> 7) & 127, instruments[i] >> 14, instruments[i] & 127);
 	}
 	load_missing_instruments(nullptr);
+	detect_pending_pitches();
+}
+
+/* Run the deferred pitch detection of all loaded samples on a few threads,
+ * so that playback does not have to do it when the first note sounds. */
+void Instruments::detect_pending_pitches()
+{
+	std::vector<Sample *> pending;
+	for (int i = 0; i < 128 + map_bank_counter; i++)
+	{
+		for (int dr = 0; dr < 2; dr++)
+		{
+			ToneBank *bank = dr ? drumset[i] : tonebank[i];
+			if (bank == NULL)
+				continue;
+			for (int j = 0; j < 128; j++)
+			{
+				Instrument *ip = bank->tone[j].instrument;
+				if (ip == NULL || IS_MAGIC_INSTRUMENT(ip))
+					continue;
+				for (int k = 0; k < ip->samples; k++)
+				{
+					if (ip->sample[k].pitch_detect_pending)
+						pending.push_back(&ip->sample[k]);
+				}
+			}
+		}
+	}
+	ZMusic_ParallelFor(pending.size(), [&](size_t i) { detect_sample_pitch(pending[i]); });
 }
 
 
@@ -30,8 +30,10 @@
 namespace TimidityPlus
 {
 
+// Shared by all players, which may run on different threads.
 struct MBlock
 {
+	std::mutex lock;
 	MBlockNode* free_mblock_list = NULL;
 
 	~MBlock()
@@ -72,16 +74,20 @@ static MBlockNode *new_mblock_node(size_t n)
 			return NULL;
 		p->block_size = n;
 	}
-	else if (free_list.free_mblock_list == NULL)
-	{
-		if ((p = (MBlockNode *)safe_malloc(sizeof(MBlockNode) + MIN_MBLOCK_SIZE)) == NULL)
-			return NULL;
-		p->block_size = MIN_MBLOCK_SIZE;
-	}
 	else
 	{
-		p = free_list.free_mblock_list;
-		free_list.free_mblock_list = free_list.free_mblock_list->next;
+		{
+			std::lock_guard<std::mutex> lock(free_list.lock);
+			p = free_list.free_mblock_list;
+			if (p != NULL)
+				free_list.free_mblock_list = p->next;
+		}
+		if (p == NULL)
+		{
+			if ((p = (MBlockNode *)safe_malloc(sizeof(MBlockNode) + MIN_MBLOCK_SIZE)) == NULL)
+				return NULL;
+			p->block_size = MIN_MBLOCK_SIZE;
+		}
 	}
 
 	p->offset = 0;
@@ -137,6 +143,7 @@ static void reuse_mblock1(MBlockNode *p)
 		free(p);
 	else /* p->block_size <= MIN_MBLOCK_SIZE */
 	{
+		std::lock_guard<std::mutex> lock(free_list.lock);
 		p->next = free_list.free_mblock_list;
 		free_list.free_mblock_list = p;
 	}
@@ -35,7 +35,6 @@
 
 namespace TimidityPlus
 {
-extern float min_sustain_time;
 
 
 #define FROM_FINAL_VOLUME(a) (a)
@@ -54,22 +53,21 @@ typedef int32_t mix_t;
 
 
 
+static_assert(VOICE_FILTER_LANES == 4, "Mixer::resamplers needs an initializer for each lane");
+
 /**************** interface function ****************/
+/* Voices with a filter are only resampled here. Their filters are run
+ * together once VOICE_FILTER_LANES of them have been, or when
+ * flush_voices() is called, and only then are they mixed into buf. */
 void Mixer::mix_voice(int32_t *buf, int v, int32_t c)
 {
-	Resampler re(player);
 	Voice *vp = player->voice + v;
 	resample_t *sp;
 
-	if (vp->status == VOICE_DIE) 
+	if (vp->status == VOICE_DIE)
 	{
 		if (c >= MAX_DIE_TIME)
 			c = MAX_DIE_TIME;
-		sp = re.resample_voice(v, &c);
-		if (do_voice_filter(v, sp, filter_buffer, c)) { sp = filter_buffer; }
-		if (c > 0)
-			ramp_out(sp, buf, v, c);
-		player->free_voice(v);
 	}
 	else {
 		vp->delay_counter = c;
@@ -78,7 +76,7 @@ void Mixer::mix_voice(int32_t *buf, int v, int32_t c)
 				vp->delay -= c;
 				if (vp->tremolo_phase_increment)
 					update_tremolo(v);
-				if (timidity_modulation_envelope && vp->sample->modes & MODES_ENVELOPE)
+				if (player->settings.timidity_modulation_envelope && vp->sample->modes & MODES_ENVELOPE)
 					update_modulation_envelope(v);
 				return;
 			}
@@ -86,9 +84,47 @@ void Mixer::mix_voice(int32_t *buf, int v, int32_t c)
 			c -= vp->delay;
 			vp->delay = 0;
 		}
-		sp = re.resample_voice(v, &c);
-		if (do_voice_filter(v, sp, filter_buffer, c)) { sp = filter_buffer; }
+	}
 
+	if (vp->fc.type != 1 && vp->fc.type != 2) {
+		sp = resamplers[VOICE_FILTER_LANES].resample_voice(v, &c);
+		finish_voice(sp, buf, v, c);
+		return;
+	}
+
+	PendingVoice *pv = &pending[num_pending];
+	pv->v = v;
+	pv->buf = buf;
+	pv->sp = resamplers[num_pending].resample_voice(v, &c);
+	pv->count = c;
+	if (++num_pending == VOICE_FILTER_LANES)
+		flush_voices();
+}
+
+/* Filter and mix the voices mix_voice() has held back. */
+void Mixer::flush_voices()
+{
+	int i;
+
+	if (num_pending == 0)
+		return;
+	filter_voices(pending, num_pending);
+	for (i = 0; i < num_pending; i++)
+		finish_voice(pending[i].sp, pending[i].buf, pending[i].v, pending[i].count);
+	num_pending = 0;
+}
+
+void Mixer::finish_voice(resample_t *sp, int32_t *buf, int v, int32_t c)
+{
+	Voice *vp = player->voice + v;
+
+	if (vp->status == VOICE_DIE) 
+	{
+		if (c > 0)
+			ramp_out(sp, buf, v, c);
+		player->free_voice(v);
+	}
+	else {
 		if (vp->panned == PANNED_MYSTERY) {
 			if (vp->envelope_increment || vp->tremolo_phase_increment)
 				mix_mystery_signal(sp, buf, v, c);
@@ -115,41 +151,47 @@ void Mixer::mix_voice(int32_t *buf, int v, int32_t c)
 	}
 }
 
-/* return 1 if filter is enabled. */
-int Mixer::do_voice_filter(int v, resample_t *sp, mix_t *lp, int32_t count)
+/* Run the filters of the pending voices in place, those of each type
+ * together. Lanes without a voice get filter_buffer as their data. */
+void Mixer::filter_voices(PendingVoice *pv, int count)
 {
-	FilterCoefficients *fc = &(player->voice[v].fc);
-	int32_t i, f, q, p, b0, b1, b2, b3, b4, t1, t2, x;
-	
-	if (fc->type == 1) {	/* copy with applying Chamberlin's lowpass filter. */
-		recalc_voice_resonance(v);
-		recalc_voice_fc(v);
-		f = fc->f, q = fc->q, b0 = fc->b0, b1 = fc->b1, b2 = fc->b2;
-		for(i = 0; i < count; i++) {
-			b0 = b0 + imuldiv24(b2, f);
-			b1 = sp[i] - b0 - imuldiv24(b2, q);
-			b2 = imuldiv24(b1, f) + b2;
-			lp[i] = b0;
-		}
-		fc->b0 = b0, fc->b1 = b1, fc->b2 = b2;
-		return 1;
-	} else if(fc->type == 2) {	/* copy with applying Moog lowpass VCF. */
-		recalc_voice_resonance(v);
-		recalc_voice_fc(v);
-		f = fc->f, q = fc->q, p = fc->p, b0 = fc->b0, b1 = fc->b1,
-			b2 = fc->b2, b3 = fc->b3, b4 = fc->b4;
-		for(i = 0; i < count; i++) {
-			x = sp[i] - imuldiv24(q, b4);	/* feedback */
-			t1 = b1;  b1 = imuldiv24(x + b0, p) - imuldiv24(b1, f);
-			t2 = b2;  b2 = imuldiv24(b1 + t1, p) - imuldiv24(b2, f);
-			t1 = b3;  b3 = imuldiv24(b2 + t2, p) - imuldiv24(b3, f);
-			lp[i] = b4 = imuldiv24(b3 + t1, p) - imuldiv24(b4, f);
-			b0 = x;
-		}
-		fc->b0 = b0, fc->b1 = b1, fc->b2 = b2, fc->b3 = b3, fc->b4 = b4;
-		return 1;
-	} else {
-		return 0;
+	VoiceFilterLanes lanes[2];
+	int i, l, type, used[2] = { 0, 0 };
+
+	memset(lanes, 0, sizeof(lanes));
+	for (i = 0; i < count; i++) {
+		FilterCoefficients *fc = &(player->voice[pv[i].v].fc);
+
+		recalc_voice_resonance(pv[i].v);
+		recalc_voice_fc(pv[i].v);
+		type = fc->type - 1;
+		l = used[type]++;
+		lanes[type].data[l] = pv[i].sp;
+		lanes[type].count[l] = pv[i].count;
+		lanes[type].f[l] = fc->f, lanes[type].q[l] = fc->q, lanes[type].p[l] = fc->p;
+		lanes[type].b0[l] = fc->b0, lanes[type].b1[l] = fc->b1, lanes[type].b2[l] = fc->b2;
+		lanes[type].b3[l] = fc->b3, lanes[type].b4[l] = fc->b4;
+	}
+	for (type = 0; type < 2; type++) {
+		if (used[type] == 0)
+			continue;
+		for (l = used[type]; l < VOICE_FILTER_LANES; l++)
+			lanes[type].data[l] = filter_buffer;
+		if (type == 0)
+			chamberlin_filter_lanes(&lanes[type]);
+		else
+			moog_filter_lanes(&lanes[type]);
+	}
+
+	used[0] = used[1] = 0;
+	for (i = 0; i < count; i++) {
+		FilterCoefficients *fc = &(player->voice[pv[i].v].fc);
+
+		type = fc->type - 1;
+		l = used[type]++;
+		fc->b0 = lanes[type].b0[l], fc->b1 = lanes[type].b1[l], fc->b2 = lanes[type].b2[l];
+		if (type == 1)
+			fc->b3 = lanes[type].b3[l], fc->b4 = lanes[type].b4[l];
 	}
 }
 
@@ -1047,7 +1089,7 @@ int Mixer::update_signal(int v)
 		return 1;
 	if (vp->tremolo_phase_increment)
 		update_tremolo(v);
-	if (timidity_modulation_envelope && vp->sample->modes & MODES_ENVELOPE)
+	if (player->settings.timidity_modulation_envelope && vp->sample->modes & MODES_ENVELOPE)
 		update_modulation_envelope(v);
 	return apply_envelope_to_amp(v);
 }
@@ -1125,18 +1167,18 @@ int Mixer::recompute_envelope(int v)
 		if (vp->status & VOICE_ON)
 			return 0;
 		
-		if (min_sustain_time > 0 || player->channel[ch].loop_timeout > 0) {
-			if (min_sustain_time == 1)
+		if (player->settings.min_sustain_time > 0 || player->channel[ch].loop_timeout > 0) {
+			if (player->settings.min_sustain_time == 1)
 				/* The sustain stage is ignored. */
 				return next_stage(v);
 
 			if (player->channel[ch].loop_timeout > 0 &&
-				player->channel[ch].loop_timeout * 1000 < min_sustain_time) {
+				player->channel[ch].loop_timeout * 1000 < player->settings.min_sustain_time) {
 				/* timeout (See also "#extension timeout" line in *.cfg file */
 				sustain_time = player->channel[ch].loop_timeout * 1000;
 			}
 			else {
-				sustain_time = min_sustain_time;
+				sustain_time = player->settings.min_sustain_time;
 			}
 
 			/* Sustain must not be 0 or else lots of dead notes! */
@@ -1385,6 +1427,10 @@ int Mixer::apply_envelope_to_amp(int v)
 			player->free_voice(v);
 			return 1;
 		}
+		if ((vp->status & (VOICE_OFF | VOICE_SUSTAINED))
+				&& lamp < player->settings.timidity_voice_floor
+				&& ramp < player->settings.timidity_voice_floor)
+			vp->status = VOICE_DIE;	/* inaudible, fade it out on the next mix_voice */
 		vp->left_mix = FINAL_VOLUME(la);
 		vp->right_mix = FINAL_VOLUME(ra);
 	} else {
@@ -1412,6 +1458,9 @@ int Mixer::apply_envelope_to_amp(int v)
 			player->free_voice(v);
 			return 1;
 		}
+		if ((vp->status & (VOICE_OFF | VOICE_SUSTAINED))
+				&& lamp < player->settings.timidity_voice_floor)
+			vp->status = VOICE_DIE;
 		vp->left_mix = FINAL_VOLUME(la);
 	}
 	return 0;
@@ -1473,7 +1522,7 @@ int Mixer::apply_modulation_envelope(int v)
 {
 	Voice *vp = &player->voice[v];
 
-	if(!timidity_modulation_envelope) {return 0;}
+	if(!player->settings.timidity_modulation_envelope) {return 0;}
 
 	if (vp->sample->modes & MODES_ENVELOPE) {
 		vp->last_modenv_volume = modenv_vol_table[vp->modenv_volume >> 20];
@@ -1566,7 +1615,7 @@ int Mixer::recompute_modulation_envelope(int v)
 	int32_t modenv_width;
 	Voice *vp = &player->voice[v];
 
-	if(!timidity_modulation_envelope) {return 0;}
+	if(!player->settings.timidity_modulation_envelope) {return 0;}
 
 	stage = vp->modenv_stage;
 	if (stage > EG_GUS_RELEASE3) {return 1;}
@@ -1589,18 +1638,18 @@ int Mixer::recompute_modulation_envelope(int v)
 		if (vp->status & VOICE_ON)
 			return 0;
 		
-		if (min_sustain_time > 0 || player->channel[ch].loop_timeout > 0) {
-			if (min_sustain_time == 1)
+		if (player->settings.min_sustain_time > 0 || player->channel[ch].loop_timeout > 0) {
+			if (player->settings.min_sustain_time == 1)
 				/* The sustain stage is ignored. */
 				return modenv_next_stage(v);
 
 			if (player->channel[ch].loop_timeout > 0 &&
-				player->channel[ch].loop_timeout * 1000 < min_sustain_time) {
+				player->channel[ch].loop_timeout * 1000 < player->settings.min_sustain_time) {
 				/* timeout (See also "#extension timeout" line in *.cfg file */
 				sustain_time = player->channel[ch].loop_timeout * 1000;
 			}
 			else {
-				sustain_time = min_sustain_time;
+				sustain_time = player->settings.min_sustain_time;
 			}
 
 			/* Sustain must not be 0 or else lots of dead notes! */
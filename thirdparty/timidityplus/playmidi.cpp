@@ -38,27 +38,19 @@
 #include "quantity.h"
 #include "tables.h"
 #include "effect.h"
+#include "../../../source/zmusic/parallel.h"
 
 
 namespace TimidityPlus
 {
 	FCriticalSection ConfigMutex;
-	int timidity_modulation_wheel = true;
-	int timidity_portamento = false;
-	int timidity_reverb = 0;
-	int timidity_chorus = 0;
-	int timidity_surround_chorus = false;	// requires restart!
-	int timidity_channel_pressure = false;
-	int timidity_lpf_def = true;
-	int timidity_temper_control = true;
-	int timidity_modulation_envelope = true;
-	int timidity_overlap_voice_allow = true;
-	int timidity_drum_effect = false;
-	int timidity_pan_delay = false;
-	float timidity_drum_power = 1.f;
-	int timidity_key_adjust = 0;
-	float timidity_tempo_adjust = 1.f;
-	float min_sustain_time = 5000;
+	PlayerSettings default_settings;
+
+	PlayerSettings GetDefaultSettings()
+	{
+		std::lock_guard<FCriticalSection> lock(ConfigMutex);
+		return default_settings;
+	}
 
 	// The following options have no generic use and are only meaningful for some SYSEX events not normally found in common MIDIs.
 	// For now they are kept as unchanging global variables
@@ -86,6 +78,23 @@ int32_t playback_rate = 22050;
 #define DEFAULT_AMPLIFICATION 		70
 #define VIBRATO_DEPTH_MAX 384	/* 600 cent */
 
+/* Rendering voices on several threads only pays off for larger blocks. */
+#define MIN_PARALLEL_SAMPLES 64
+#define MIN_PARALLEL_VOICES 8
+
+/* State for rendering a share of the voices on another thread. Voices are
+ * split up by channel, so the only buffers workers have in common are the
+ * dry and insertion effect buffers, which each one gets a copy of. */
+struct VoiceWorker
+{
+	Mixer mixer;
+	int32_t *vpblist[MAX_CHANNELS];
+	int32_t buffer[AUDIO_BUFFER_SIZE * 2];
+	int32_t insertion_buffer[AUDIO_BUFFER_SIZE * 2];
+
+	VoiceWorker(Player *p) : mixer(p) {}
+};
+
 void set_playback_rate(int freq)
 {
 	const int CONTROLS_PER_SECOND = 1000;
@@ -102,25 +111,40 @@ void set_playback_rate(int freq)
 
 Player::Player(Instruments *instr)
 {
-	last_reverb_setting = timidity_reverb;
 	memset(this, 0, sizeof(*this));
+	settings = GetDefaultSettings();
+	xg_effect_types = XGEffectTypes();
 
 	// init one-time global stuff - this should go to the device class once it exists.
 	instruments = instr;
 	initialize_resampler_coeffs();
 	init_tables();
+	// Scale tuning sysex messages change this, so each player needs its own copy.
+	memcpy(freq_table_tuning, TimidityPlus::freq_table_tuning, sizeof(freq_table_tuning));
 
 	new_midi_file_info();
 	init_mblock(&playmidi_pool);
 
-	reverb = new Reverb;
+	reverb = new Reverb(settings);
 	reverb->init_effect_status(play_system_mode);
-	effect = new Effect(reverb);
+	effect = new Effect(reverb, settings);
 
 
 	mixer = new Mixer(this);
 	recache = new Recache(this);
 
+	num_voice_workers = settings.timidity_threads > 0 ? settings.timidity_threads : (int)ZMusic_JobThreads();
+	if (num_voice_workers > MAX_VOICE_WORKERS)
+		num_voice_workers = MAX_VOICE_WORKERS;
+	if (num_voice_workers > 1)
+	{
+		voice_threads = new FWorkerGroup;
+		num_voice_workers = voice_threads->Start(num_voice_workers);
+		/* worker 0 is the player itself */
+		for (int i = 1; i < num_voice_workers; i++)
+			voice_workers[i] = new VoiceWorker(this);
+	}
+
 	for (int i = 0; i < MAX_CHANNELS; i++)
 		init_channel_layer(i);
 
@@ -173,6 +197,8 @@ Player::~Player()
 	reuse_mblock(&playmidi_pool);
 	if (reverb_buffer != nullptr) free(reverb_buffer);
 	for (int i = 0; i < MAX_CHANNELS; i++) free_drum_effect(i);
+	delete voice_threads;
+	for (int i = 1; i < num_voice_workers; i++) delete voice_workers[i];
 	delete mixer;
 	delete recache;
 	delete effect;
@@ -226,7 +252,7 @@ int Player::new_vidq(int ch, int note)
 {
     int i;
 
-    if(timidity_overlap_voice_allow)
+    if(settings.timidity_overlap_voice_allow)
     {
 	i = ch * 128 + note;
 	return vidq_head[i]++;
@@ -238,7 +264,7 @@ int Player::last_vidq(int ch, int note)
 {
     int i;
 
-    if(timidity_overlap_voice_allow)
+    if(settings.timidity_overlap_voice_allow)
     {
 	i = ch * 128 + note;
 	if(vidq_head[i] == vidq_tail[i])
@@ -412,10 +438,10 @@ void Player::reset_controllers(int c)
 	for (j = 0; j < 6; j++) { channel[c].envelope_rate[j] = -1; }
 	update_portamento_controls(c);
 	set_reverb_level(c, -1);
-	if (timidity_chorus == 1)
+	if (settings.timidity_chorus == 1)
 		channel[c].chorus_level = 0;
 	else
-		channel[c].chorus_level = -timidity_chorus;
+		channel[c].chorus_level = -settings.timidity_chorus;
 	channel[c].mono = 0;
 	channel[c].delay_level = 0;
 }
@@ -502,9 +528,9 @@ void Player::recompute_freq(int v)
 
 	if (! voice[v].sample->sample_rate)
 		return;
-	if (! timidity_modulation_wheel)
+	if (! settings.timidity_modulation_wheel)
 		channel[ch].mod.val = 0;
-	if (! timidity_portamento)
+	if (! settings.timidity_portamento)
 		voice[v].porta_control_ratio = 0;
 	voice[v].vibrato_control_ratio = voice[v].orig_vibrato_control_ratio;
 	if (voice[v].vibrato_control_ratio || channel[ch].mod.val > 0) {
@@ -513,7 +539,7 @@ void Player::recompute_freq(int v)
 		 */
 
 		/* MIDI controllers LFO pitch depth */
-		if (timidity_channel_pressure || timidity_modulation_wheel) {
+		if (settings.timidity_channel_pressure || settings.timidity_modulation_wheel) {
 			vp->vibrato_depth = vp->sample->vibrato_depth + channel[ch].vibrato_depth;
 			vp->vibrato_depth += get_midi_controller_pitch_depth(&(channel[ch].mod))
 				+ get_midi_controller_pitch_depth(&(channel[ch].bend))
@@ -557,7 +583,7 @@ void Player::recompute_freq(int v)
 				+ channel[ch].drums[note]->coarse * 64) << 7;
 	}
 	/* MIDI controllers pitch control */
-	if (timidity_channel_pressure) {
+	if (settings.timidity_channel_pressure) {
 		tuning += get_midi_controller_pitch(&(channel[ch].mod))
 			+ get_midi_controller_pitch(&(channel[ch].bend))
 			+ get_midi_controller_pitch(&(channel[ch].caf))
@@ -565,7 +591,7 @@ void Player::recompute_freq(int v)
 			+ get_midi_controller_pitch(&(channel[ch].cc1))
 			+ get_midi_controller_pitch(&(channel[ch].cc2));
 	}
-	if (timidity_modulation_envelope) {
+	if (settings.timidity_modulation_envelope) {
 		if (voice[v].sample->tremolo_to_pitch) {
 			tuning += lookup_triangular(voice[v].tremolo_phase >> RATE_SHIFT)
 					* (voice[v].sample->tremolo_to_pitch << 13) / 100.0 + 0.5;
@@ -586,7 +612,7 @@ void Player::recompute_freq(int v)
 		}
 	}
 	if (! opt_pure_intonation
-			&& timidity_temper_control && voice[v].temper_instant) {
+			&& settings.timidity_temper_control && voice[v].temper_instant) {
 		switch (tt) {
 		case 0:
 			f = freq_table_tuning[tp][note];
@@ -729,7 +755,7 @@ void Player::recompute_amp(int v)
 	 * so that it must be reduced in advance.
 	 */
 	if (
-		(timidity_reverb || timidity_chorus || opt_delay_control
+		(settings.timidity_reverb || settings.timidity_chorus || opt_delay_control
 			|| (opt_eq_control && (reverb->eq_status_gs.low_gain != 0x40
 				|| reverb->eq_status_gs.high_gain != 0x40))
 			|| opt_insertion_effect))
@@ -763,11 +789,11 @@ void Player::recompute_amp(int v)
 		if (channel[ch].drums[voice[v].note] != NULL) {
 			tempamp *= channel[ch].drums[voice[v].note]->drum_level;
 		}
-		tempamp *= (double)timidity_drum_power;	/* global drum power */
+		tempamp *= (double)settings.timidity_drum_power;	/* global drum power */
 	}
 
 	/* MIDI controllers amplitude control */
-	if (timidity_channel_pressure) {
+	if (settings.timidity_channel_pressure) {
 		tempamp *= get_midi_controller_amp(&(channel[ch].mod))
 			* get_midi_controller_amp(&(channel[ch].bend))
 			* get_midi_controller_amp(&(channel[ch].caf))
@@ -854,14 +880,14 @@ void Player::recompute_channel_filter(int ch, int note)
 void Player::init_voice_filter(int i)
 {
   memset(&(voice[i].fc), 0, sizeof(FilterCoefficients));
-  if(timidity_lpf_def && voice[i].sample->cutoff_freq) {
+  if(settings.timidity_lpf_def && voice[i].sample->cutoff_freq) {
 	  voice[i].fc.orig_freq = voice[i].sample->cutoff_freq;
 	  voice[i].fc.orig_reso_dB = (double)voice[i].sample->resonance / 10.0f - 3.01f;
 	  if (voice[i].fc.orig_reso_dB < 0.0f) {voice[i].fc.orig_reso_dB = 0.0f;}
-	  if (timidity_lpf_def == 2) {
+	  if (settings.timidity_lpf_def == 2) {
 		  voice[i].fc.gain = 1.0;
 		  voice[i].fc.type = 2;
-	  } else if(timidity_lpf_def == 1) {
+	  } else if(settings.timidity_lpf_def == 1) {
 		  voice[i].fc.gain = pow(10.0f, -voice[i].fc.orig_reso_dB / 2.0f / 20.0f);
 		  voice[i].fc.type = 1;
 	  }
@@ -891,7 +917,7 @@ void Player::recompute_voice_filter(int v)
 	}
 
 	/* MIDI controllers filter cutoff control and LFO filter depth */
-	if(timidity_channel_pressure) {
+	if(settings.timidity_channel_pressure) {
 		cent += get_midi_controller_filter_cutoff(&(channel[ch].mod))
 			+ get_midi_controller_filter_cutoff(&(channel[ch].bend))
 			+ get_midi_controller_filter_cutoff(&(channel[ch].caf))
@@ -919,7 +945,7 @@ void Player::recompute_voice_filter(int v)
 		cent += sp->key_to_fc * (double)(voice[v].note - sp->key_to_fc_bpo);
 	}
 
-	if(timidity_modulation_envelope) {
+	if(settings.timidity_modulation_envelope) {
 		if(voice[v].sample->tremolo_to_fc + (int16_t)depth_cent) {
 			cent += ((double)voice[v].sample->tremolo_to_fc + depth_cent) * lookup_triangular(voice[v].tremolo_phase >> RATE_SHIFT);
 		}
@@ -1332,7 +1358,7 @@ int Player::find_samples(MidiEvent *e, int *vlist)
 		note = MIDI_EVENT_NOTE(e);
 	for (i = 0; i < nv; i++) {
 		j = vlist[i];
-		if (! opt_realtime_playing && allocate_cache_size > 0
+		if (! opt_realtime_playing && recache->enabled()
 				&& ! channel[ch].portamento) {
 			voice[j].cache = recache->resamp_cache_fetch(voice[j].sample, note);
 			if (voice[j].cache)	/* cache hit */
@@ -1362,7 +1388,7 @@ int Player::select_play_sample(Sample *splist, int nsp, int *note, int *vlist, M
 				f = freq_table_pureint[current_freq_table][*note];
 			else
 				f = freq_table_pureint[current_freq_table + 12][*note];
-		} else if (timidity_temper_control)
+		} else if (settings.timidity_temper_control)
 			switch (tt) {
 			case 0:
 				f = freq_table_tuning[tp][*note];
@@ -1405,7 +1431,7 @@ int Player::select_play_sample(Sample *splist, int nsp, int *note, int *vlist, M
 			}
 		else
 			f = freq_table[*note];
-		if (! opt_pure_intonation && timidity_temper_control
+		if (! opt_pure_intonation && settings.timidity_temper_control
 				&& tt == 0 && f != freq_table[*note]) {
 			*note = log(f / 440000.0) / log(2) * 12 + 69.5;
 			*note = (*note < 0) ? 0 : ((*note > 127) ? 127 : *note);
@@ -1534,7 +1560,7 @@ int Player::find_voice(MidiEvent *e)
 	AlternateAssign *altassign;
 	int i, lowest = -1;
 	
-	status_check = (timidity_overlap_voice_allow)
+	status_check = (settings.timidity_overlap_voice_allow)
 			? (VOICE_OFF | VOICE_SUSTAINED) : 0xff;
 	mono_check = channel[ch].mono;
 	altassign = instruments->find_altassign(channel[ch].altassign, note);
@@ -1650,7 +1676,7 @@ void Player::init_voice_pan_delay(int v)
 		vp->pan_delay_buf = NULL;
 	}
 	vp->pan_delay_rpt = 0;
-	if (timidity_pan_delay && channel[ch].insertion_effect == 0 && !timidity_surround_chorus) {
+	if (settings.timidity_pan_delay && channel[ch].insertion_effect == 0 && !settings.timidity_surround_chorus) {
 		if (vp->panning == 64) {vp->delay += pan_delay_table[64] * playback_rate / 1000;}
 		else {
 			if(pan_delay_table[vp->panning] > pan_delay_table[127 - vp->panning]) {
@@ -1900,6 +1926,7 @@ void Player::new_chorus_voice_alternate(int v1, int level)
 
     /* Try to keep the delayed voice from cancelling out the other voice */
     /* Pitch detection is used to find the real pitches for drums and MODs */
+    detect_sample_pitch(voice[v1].sample);
     note_adjusted = voice[v1].note + voice[v1].sample->transpose_detected;
     if (note_adjusted > 127) note_adjusted = 127;
     else if (note_adjusted < 0) note_adjusted = 0;
@@ -2084,7 +2111,7 @@ void Player::note_on(MidiEvent *e)
 	voice[v].old_left_mix = voice[v].old_right_mix =
 	voice[v].left_mix_inc = voice[v].left_mix_offset =
 	voice[v].right_mix_inc = voice[v].right_mix_offset = 0;
-	if(timidity_surround_chorus)
+	if(settings.timidity_surround_chorus)
 	    new_chorus_voice_alternate(v, 0);
     }
 
@@ -2227,7 +2254,7 @@ void Player::adjust_pressure(MidiEvent *e)
     int i, uv = upper_voices;
     int note, ch;
 
-    if(timidity_channel_pressure)
+    if(settings.timidity_channel_pressure)
     {
 	ch = e->channel;
     note = MIDI_EVENT_NOTE(e);
@@ -2250,7 +2277,7 @@ void Player::adjust_pressure(MidiEvent *e)
 /*! adjust channel pressure (channel aftertouch, CAf, CAT) */
 void Player::adjust_channel_pressure(MidiEvent *e)
 {
-    if(timidity_channel_pressure)
+    if(settings.timidity_channel_pressure)
     {
 	int i, uv = upper_voices;
 	int ch;
@@ -2284,7 +2311,7 @@ void Player::adjust_panning(int c)
             pan = get_panning(c, voice[i].note, i);
 
 	    /* Hack to handle -EFchorus=2 in a "reasonable" way */
-	    if(timidity_surround_chorus && voice[i].chorus_link != i)
+	    if(settings.timidity_surround_chorus && voice[i].chorus_link != i)
 	    {
 		int v1, v2;
 
@@ -2297,7 +2324,7 @@ void Player::adjust_panning(int c)
 		v1 = i;				/* base voice */
 		v2 = voice[i].chorus_link;	/* sub voice (detuned) */
 
-		if(timidity_surround_chorus) /* Surround chorus mode by Eric. */
+		if(settings.timidity_surround_chorus) /* Surround chorus mode by Eric. */
 		{
 		    int panlevel;
 
@@ -2400,8 +2427,8 @@ void Player::set_reverb_level(int ch, int level)
 {
 	if (level == -1) {
 		channel[ch].reverb_level = channel[ch].reverb_id =
-				(timidity_reverb < 0)
-				? -timidity_reverb & 0x7f : DEFAULT_REVERB_SEND_LEVEL;
+				(settings.timidity_reverb < 0)
+				? -settings.timidity_reverb & 0x7f : DEFAULT_REVERB_SEND_LEVEL;
 		make_rvid_flag = 1;
 		return;
 	}
@@ -2412,8 +2439,8 @@ void Player::set_reverb_level(int ch, int level)
 int Player::get_reverb_level(int ch)
 {
 	if (channel[ch].reverb_level == -1)
-		return (timidity_reverb < 0)
-			? -timidity_reverb & 0x7f : DEFAULT_REVERB_SEND_LEVEL;
+		return (settings.timidity_reverb < 0)
+			? -settings.timidity_reverb & 0x7f : DEFAULT_REVERB_SEND_LEVEL;
 	return channel[ch].reverb_level;
 }
 
@@ -2423,9 +2450,9 @@ int Player::get_chorus_level(int ch)
     if(ISDRUMCHANNEL(ch))
 	return 0; /* Not supported drum channel chorus */
 #endif
-    if(timidity_chorus == 1)
+    if(settings.timidity_chorus == 1)
 	return channel[ch].chorus_level;
-    return -timidity_chorus;
+    return -settings.timidity_chorus;
 }
 
 
@@ -4342,13 +4369,13 @@ void Player::update_rpn_map(int ch, int addr, int update_now)
 			adjust_pitch(ch);
 		break;
 	case NRPN_ADDR_0120:	/* Filter Cutoff Frequency */
-		if (timidity_lpf_def) {
+		if (settings.timidity_lpf_def) {
 			//printMessage(CMSG_INFO, VERB_NOISY,	"Filter Cutoff (CH:%d VAL:%d)", ch, val - 64);
 			channel[ch].param_cutoff_freq = val - 64;
 		}
 		break;
 	case NRPN_ADDR_0121:	/* Filter Resonance */
-		if (timidity_lpf_def) {
+		if (settings.timidity_lpf_def) {
 			//printMessage(CMSG_INFO,VERB_NOISY,"Filter Resonance (CH:%d VAL:%d)", ch, val - 64);
 			channel[ch].param_resonance = val - 64;
 		}
@@ -4743,10 +4770,104 @@ int Player::is_insertion_effect_xg(int ch)
 	return 0;
 }
 
+/*! Mix all voices, or with worker >= 0 only those of the channels assigned
+ * to that worker. The drum part effect buffers must already exist. */
+void Player::mix_voices(Mixer *m, int32_t **vpblist, int32_t *dry, int channel_effect, int worker, int32_t count)
+{
+	int i, j, ch, note, nmixed = 0;
+	int mixed[max_voices];
+
+	for (i = 0; i < upper_voices; i++) {
+		/* Check the channel first, other workers may be freeing their voices. */
+		if ((worker < 0 || channel_worker[voice[i].channel] == worker)
+				&& voice[i].status != VOICE_FREE) {
+			int32_t *vpb = NULL;
+			int8_t flag;
+			
+			if (channel_effect) {
+				flag = 0;
+				ch = voice[i].channel;
+				if (settings.timidity_drum_effect && ISDRUMCHANNEL(ch)) {
+					note = voice[i].note;
+					for (j = 0; j < channel[ch].drum_effect_num; j++) {
+						if (channel[ch].drum_effect[j].note == note) {
+							vpb = channel[ch].drum_effect[j].buf;
+							flag = 1;
+						}
+					}
+					if (flag == 0) {vpb = vpblist[ch];}
+				} else {
+					vpb = vpblist[ch];
+				}
+			} else {
+				vpb = dry;
+			}
+
+			if(!IS_SET_CHANNELMASK(channel_mute, voice[i].channel)) {
+				m->mix_voice(vpb, i, count);
+			} else {
+				free_voice(i);
+			}
+			mixed[nmixed++] = i;
+		}
+	}
+
+	/* The mixer holds back some voices until it can filter them together,
+	 * so voices that ran out may only be freed once it is done. */
+	m->flush_voices();
+	for (j = 0; j < nmixed; j++) {
+		i = mixed[j];
+		if(voice[i].timeout == 1 && voice[i].timeout < current_sample) {
+			free_voice(i);
+		}
+	}
+}
+
+/*! Spread the channels with active voices over the voice workers so that
+ * every worker gets about the same number of voices. A channel always stays
+ * on a single worker because voices write to their channel's state.
+ * Returns the number of workers to use. */
+int Player::assign_voice_workers(int uv)
+{
+	int i, w, jobs, nch = 0, total = 0;
+	int nvoices[MAX_CHANNELS], order[MAX_CHANNELS], load[MAX_VOICE_WORKERS];
+
+	if (num_voice_workers <= 1)
+		return 1;
+	memset(nvoices, 0, sizeof(nvoices));
+	for (i = 0; i < uv; i++) {
+		if (voice[i].status != VOICE_FREE) {
+			nvoices[voice[i].channel]++;
+			total++;
+		}
+	}
+	if (total < MIN_PARALLEL_VOICES)
+		return 1;
+	for (i = 0; i < MAX_CHANNELS; i++) {
+		if (nvoices[i]) {order[nch++] = i;}
+	}
+	jobs = std::min(num_voice_workers, nch);
+	if (jobs <= 1)
+		return 1;
+
+	/* largest channels first, each onto the least loaded worker */
+	std::sort(order, order + nch, [&](int a, int b) { return nvoices[a] > nvoices[b]; });
+	memset(load, 0, sizeof(load));
+	for (i = 0; i < nch; i++) {
+		int best = 0;
+		for (w = 1; w < jobs; w++) {
+			if (load[w] < load[best]) {best = w;}
+		}
+		channel_worker[order[i]] = best;
+		load[best] += nvoices[order[i]];
+	}
+	return jobs;
+}
+
 /* do_compute_data_midi() with DSP Effect */
 void Player::do_compute_data(int32_t count)
 {
-	int i, j, uv, stereo, n, ch, note;
+	int i, j, uv, stereo, n, nw;
 	int32_t *vpblist[MAX_CHANNELS];
 	int channel_effect, channel_reverb, channel_chorus, channel_delay, channel_eq;
 	int32_t cnt = count * 2, rev_max_delay_out;
@@ -4758,17 +4879,17 @@ void Player::do_compute_data(int32_t count)
 	memset(buffer_pointer, 0, n);
 	memset(insertion_effect_buffer, 0, n);
 
-	if (timidity_reverb == 3) {
+	if (settings.timidity_reverb == 3) {
 		rev_max_delay_out = 0x7fffffff;	/* disable */
 	} else {
 		rev_max_delay_out = REVERB_MAX_DELAY_OUT;
 	}
 
 	/* are effects valid? / don't supported in mono */
-	channel_reverb = (stereo && (timidity_reverb == 1
-			|| timidity_reverb == 3
-			|| (timidity_reverb < 0 && timidity_reverb & 0x80)));
-	channel_chorus = (stereo && timidity_chorus && !timidity_surround_chorus);
+	channel_reverb = (stereo && (settings.timidity_reverb == 1
+			|| settings.timidity_reverb == 3
+			|| (settings.timidity_reverb < 0 && settings.timidity_reverb & 0x80)));
+	channel_chorus = (stereo && settings.timidity_chorus && !settings.timidity_surround_chorus);
 	channel_delay = 0;
 
 	/* is EQ valid? */
@@ -4800,7 +4921,7 @@ void Player::do_compute_data(int32_t count)
 					|| channel[i].chorus_level > 0 || channel[i].delay_level > 0
 					|| channel[i].eq_xg.valid
 					|| channel[i].dry_level != 127
-					|| (timidity_drum_effect && ISDRUMCHANNEL(i))
+					|| (settings.timidity_drum_effect && ISDRUMCHANNEL(i))
 					|| is_insertion_effect_xg(i)) {
 				vpblist[i] = (int32_t*)(reverb_buffer + buf_index);
 				buf_index += n;
@@ -4808,7 +4929,7 @@ void Player::do_compute_data(int32_t count)
 				vpblist[i] = buffer_pointer;
 			}
 			/* clear buffers of drum-part effect */
-			if (timidity_drum_effect && ISDRUMCHANNEL(i)) {
+			if (settings.timidity_drum_effect && ISDRUMCHANNEL(i)) {
 				for (j = 0; j < channel[i].drum_effect_num; j++) {
 					if (channel[i].drum_effect[j].buf != NULL) {
 						memset(channel[i].drum_effect[j].buf, 0, n);
@@ -4820,40 +4941,39 @@ void Player::do_compute_data(int32_t count)
 		if(buf_index) {memset(reverb_buffer, 0, buf_index);}
 	}
 
-	for (i = 0; i < uv; i++) {
-		if (voice[i].status != VOICE_FREE) {
-			int32_t *vpb = NULL;
-			int8_t flag;
-			
-			if (channel_effect) {
-				flag = 0;
-				ch = voice[i].channel;
-				if (timidity_drum_effect && ISDRUMCHANNEL(ch)) {
-					make_drum_effect(ch);
-					note = voice[i].note;
-					for (j = 0; j < channel[ch].drum_effect_num; j++) {
-						if (channel[ch].drum_effect[j].note == note) {
-							vpb = channel[ch].drum_effect[j].buf;
-							flag = 1;
-						}
-					}
-					if (flag == 0) {vpb = vpblist[ch];}
-				} else {
-					vpb = vpblist[ch];
-				}
-			} else {
-				vpb = buffer_pointer;
+	if (channel_effect && settings.timidity_drum_effect) {
+		for (i = 0; i < uv; i++) {
+			if (voice[i].status != VOICE_FREE && ISDRUMCHANNEL(voice[i].channel)) {
+				make_drum_effect(voice[i].channel);
 			}
+		}
+	}
 
-			if(!IS_SET_CHANNELMASK(channel_mute, voice[i].channel)) {
-				mixer->mix_voice(vpb, i, count);
-			} else {
-				free_voice(i);
-			}
+	if (count < MIN_PARALLEL_SAMPLES || (nw = assign_voice_workers(uv)) <= 1) {
+		mix_voices(mixer, vpblist, buffer_pointer, channel_effect, -1, count);
+	} else {
+		auto job = [&](size_t w) {
+			VoiceWorker *wk = voice_workers[w];
 
-			if(voice[i].timeout == 1 && voice[i].timeout < current_sample) {
-				free_voice(i);
+			if (w == 0) {
+				mix_voices(mixer, vpblist, buffer_pointer, channel_effect, 0, count);
+				return;
+			}
+			memset(wk->buffer, 0, cnt * sizeof(int32_t));
+			memset(wk->insertion_buffer, 0, cnt * sizeof(int32_t));
+			if (channel_effect) {
+				for (int c = 0; c < MAX_CHANNELS; c++) {
+					if (vpblist[c] == buffer_pointer) {wk->vpblist[c] = wk->buffer;}
+					else if (vpblist[c] == insertion_effect_buffer) {wk->vpblist[c] = wk->insertion_buffer;}
+					else {wk->vpblist[c] = vpblist[c];}
+				}
 			}
+			mix_voices(&wk->mixer, wk->vpblist, wk->buffer, channel_effect, (int)w, count);
+		};
+		voice_threads->Run(nw, job);
+		for (i = 1; i < nw; i++) {
+			mix_signal(buffer_pointer, voice_workers[i]->buffer, cnt);
+			mix_signal(insertion_effect_buffer, voice_workers[i]->insertion_buffer, cnt);
 		}
 	}
 
@@ -4877,7 +4997,7 @@ void Player::do_compute_data(int32_t count)
 			int32_t *p;
 			p = vpblist[i];
 			if(p != buffer_pointer) {
-				if (timidity_drum_effect && ISDRUMCHANNEL(i)) {
+				if (settings.timidity_drum_effect && ISDRUMCHANNEL(i)) {
 					for (j = 0; j < channel[i].drum_effect_num; j++) {
 						de = &(channel[i].drum_effect[j]);
 						if (de->reverb_send > 0) {
@@ -4944,7 +5064,7 @@ void Player::do_compute_data(int32_t count)
 			int32_t *p;	
 			p = vpblist[i];
 			if(p != buffer_pointer && p != insertion_effect_buffer) {
-				if (timidity_drum_effect && ISDRUMCHANNEL(i)) {
+				if (settings.timidity_drum_effect && ISDRUMCHANNEL(i)) {
 					for (j = 0; j < channel[i].drum_effect_num; j++) {
 						de = &(channel[i].drum_effect[j]);
 						if (de->reverb_send > 0) {
@@ -4998,14 +5118,12 @@ int Player::compute_data(float *buffer, int32_t count)
 {
 	if (count == 0) return RC_OK;
 
-	std::lock_guard<FCriticalSection> lock(ConfigMutex);
-
-	if (last_reverb_setting != timidity_reverb)
+	if (last_reverb_setting != settings.timidity_reverb)
 	{
 		// If the reverb mode has changed some buffers need to be reallocated before doing any sound generation.
 		reverb->free_effect_buffers();
 		reverb->init_reverb();
-		last_reverb_setting = timidity_reverb;
+		last_reverb_setting = settings.timidity_reverb;
 	}
 
 	buffer_pointer = common_buffer;
@@ -5256,21 +5374,21 @@ int Player::play_event(MidiEvent *ev)
 				break;
 
 			case ME_SOFT_PEDAL:
-				if (timidity_lpf_def) {
+				if (settings.timidity_lpf_def) {
 					channel[ch].soft_pedal = ev->a;
 					//printMessage(CMSG_INFO,VERB_NOISY,"Soft Pedal (CH:%d VAL:%d)", ch, channel[ch].soft_pedal);
 				}
 				break;
 
 			case ME_HARMONIC_CONTENT:
-				if (timidity_lpf_def) {
+				if (settings.timidity_lpf_def) {
 					channel[ch].param_resonance = ev->a - 64;
 					//printMessage(CMSG_INFO,VERB_NOISY,"Harmonic Content (CH:%d VAL:%d)", ch, channel[ch].param_resonance);
 				}
 				break;
 
 			case ME_BRIGHTNESS:
-				if (timidity_lpf_def) {
+				if (settings.timidity_lpf_def) {
 					channel[ch].param_cutoff_freq = ev->a - 64;
 					//printMessage(CMSG_INFO,VERB_NOISY,"Brightness (CH:%d VAL:%d)", ch, channel[ch].param_cutoff_freq);
 				}
@@ -5296,21 +5414,21 @@ int Player::play_event(MidiEvent *ev)
 				break;
 
 			case ME_REVERB_EFFECT:
-				if (timidity_reverb) {
+				if (settings.timidity_reverb) {
 					if (ISDRUMCHANNEL(ch) && get_reverb_level(ch) != ev->a) { channel[ch].drum_effect_flag = 0; }
 					set_reverb_level(ch, ev->a);
 				}
 				break;
 
 			case ME_CHORUS_EFFECT:
-				if (timidity_chorus)
+				if (settings.timidity_chorus)
 				{
-					if (timidity_chorus == 1) {
+					if (settings.timidity_chorus == 1) {
 						if (ISDRUMCHANNEL(ch) && channel[ch].chorus_level != ev->a) { channel[ch].drum_effect_flag = 0; }
 						channel[ch].chorus_level = ev->a;
 					}
 					else {
-						channel[ch].chorus_level = -timidity_chorus;
+						channel[ch].chorus_level = -settings.timidity_chorus;
 					}
 					if (ev->a) {
 						//printMessage(CMSG_INFO,VERB_NOISY,"Chorus Send (CH:%d LEVEL:%d)", ch, ev->a);
@@ -5487,8 +5605,8 @@ int Player::play_event(MidiEvent *ev)
 						i += (i > 0) ? -5 : 7, j++;
 					while (abs(j - note_key_offset) > 7)
 						j += (j > note_key_offset) ? -12 : 12;
-					if (abs(j - timidity_key_adjust) >= 12)
-						j += (j > timidity_key_adjust) ? -12 : 12;
+					if (abs(j - settings.timidity_key_adjust) >= 12)
+						j += (j > settings.timidity_key_adjust) ? -12 : 12;
 					note_key_offset = j;
 					kill_all_voices();
 				}
@@ -5505,7 +5623,6 @@ int Player::play_event(MidiEvent *ev)
 				break;
 
 			case ME_SCALE_TUNING:
-				recache->resamp_cache_refer_alloff(ch, computed_samples);
 				channel[ch].scale_tuning[current_event->a] = current_event->b;
 				adjust_pitch(ch);
 				break;
@@ -5631,9 +5748,9 @@ void Player::set_master_tuning(int tune)
 
 void Player::set_single_note_tuning(int part, int a, int b, int rt)
 {
-	static int tp;	/* tuning program number */
-	static int kn;	/* MIDI key number */
-	static int st;	/* the nearest equal-tempered semitone */
+	int &tp = single_note_tuning.tp;	/* tuning program number */
+	int &kn = single_note_tuning.kn;	/* MIDI key number */
+	int &st = single_note_tuning.st;	/* the nearest equal-tempered semitone */
 	double f, fst;	/* fraction of semitone */
 	int i;
 	
@@ -5662,15 +5779,16 @@ void Player::set_single_note_tuning(int part, int a, int b, int rt)
 
 void Player::set_user_temper_entry(int part, int a, int b)
 {
-	static int tp;		/* temperament program number */
-	static int ll;		/* number of formula */
-	static int fh, fl;	/* applying pitch bit mask (forward) */
-	static int bh, bl;	/* applying pitch bit mask (backward) */
-	static int aa, bb;	/* fraction (aa/bb) */
-	static int cc, dd;	/* power (cc/dd)^(ee/ff) */
-	static int ee, ff;
-	static int ifmax, ibmax, count;
-	static double rf[11], rb[11];
+	auto &t = user_temper;
+	int &tp = t.tp;		/* temperament program number */
+	int &ll = t.ll;		/* number of formula */
+	int &fh = t.fh, &fl = t.fl;	/* applying pitch bit mask (forward) */
+	int &bh = t.bh, &bl = t.bl;	/* applying pitch bit mask (backward) */
+	int &aa = t.aa, &bb = t.bb;	/* fraction (aa/bb) */
+	int &cc = t.cc, &dd = t.dd;	/* power (cc/dd)^(ee/ff) */
+	int &ee = t.ee, &ff = t.ff;
+	int &ifmax = t.ifmax, &ibmax = t.ibmax, &count = t.count;
+	double (&rf)[11] = t.rf, (&rb)[11] = t.rb;
 	int i, j, k, l, n, m;
 	double ratio[12], f, sc;
 	
@@ -5774,27 +5892,27 @@ struct midi_file_info *Player::new_midi_file_info()
 
 
 
+/* Queue the drum notes of the coming song for the resample cache. */
+void Player::precache_notes(const uint16_t *instrumentlist, int count)
+{
+	recache->resamp_cache_prefill(instruments, instrumentlist, count);
+}
+
 /*
  * For MIDI stream player.
  */
 void Player::playmidi_stream_init(void)
 {
     int i;
-    static int first = 1;
 
-    note_key_offset = timidity_key_adjust;
-    midi_time_ratio = timidity_tempo_adjust;
+    note_key_offset = settings.timidity_key_adjust;
+    midi_time_ratio = settings.timidity_tempo_adjust;
     CLEAR_CHANNELMASK(channel_mute);
 	if (temper_type_mute & 1)
 		FILL_CHANNELMASK(channel_mute);
-	if (first)
-	{
-		first = 0;
-		init_mblock(&playmidi_pool);
-		midi_streaming = 1;
-	}
-    else
-        reuse_mblock(&playmidi_pool);
+	// The pool got set up by the constructor.
+	reuse_mblock(&playmidi_pool);
+	midi_streaming = 1;
 
     /* Fill in current_file_info */
 	current_file_info = &midifileinfo;
@@ -6113,7 +6231,7 @@ void Player::send_long_event(const uint8_t *sysexbuffer, int exlen)
 	int i, ne;
 	MidiEvent ev;
 	MidiEvent evm[260];
-	SysexConvert sc;
+	SysexConvert sc(xg_effect_types);
 
 	if ((sysexbuffer[0] != 0xf0) && (sysexbuffer[0] != 0xf7)) return;
 	
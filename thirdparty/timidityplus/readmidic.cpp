@@ -210,8 +210,6 @@ int SysexConvert::parse_sysex_event_multi(const uint8_t *val, int32_t len, MidiE
 
 	uint32_t channel_tt;
 	int i, j;
-	static uint8_t xg_reverb_type_msb = 0x01, xg_reverb_type_lsb = 0x00;
-	static uint8_t xg_chorus_type_msb = 0x41, xg_chorus_type_lsb = 0x00;
 
 	/* Effect 1 or Multi EQ */
 	if (len >= 8 &&
@@ -250,7 +248,7 @@ int SysexConvert::parse_sysex_event_multi(const uint8_t *val, int32_t len, MidiE
 			if (addmid == 0x01) {	/* Effect 1 */
 				switch (ent) {
 				case 0x00:	/* Reverb Type MSB */
-					xg_reverb_type_msb = *body;
+					xg_effect_types.reverb_msb = *body;
 #if 0	/* XG specific reverb is not supported yet, use GS instead */
 					SETMIDIEVENT(evm[num_events], 0, ME_SYSEX_XG_LSB, 0, *body, ent);
 					num_events++;
@@ -258,12 +256,12 @@ int SysexConvert::parse_sysex_event_multi(const uint8_t *val, int32_t len, MidiE
 					break;
 
 				case 0x01:	/* Reverb Type LSB */
-					xg_reverb_type_lsb = *body;
+					xg_effect_types.reverb_lsb = *body;
 #if 0	/* XG specific reverb is not supported yet, use GS instead */
 					SETMIDIEVENT(evm[num_events], 0, ME_SYSEX_XG_LSB, 0, *body, ent);
 					num_events++;
 #else
-					v = set_xg_reverb_type(xg_reverb_type_msb, xg_reverb_type_lsb);
+					v = set_xg_reverb_type(xg_effect_types.reverb_msb, xg_effect_types.reverb_lsb);
 					if (v >= 0) {
 						SETMIDIEVENT(evm[num_events], 0, ME_SYSEX_GS_LSB, 0, v, 0x05);
 						num_events++;
@@ -277,7 +275,7 @@ int SysexConvert::parse_sysex_event_multi(const uint8_t *val, int32_t len, MidiE
 					break;
 
 				case 0x20:	/* Chorus Type MSB */
-					xg_chorus_type_msb = *body;
+					xg_effect_types.chorus_msb = *body;
 #if 0	/* XG specific chorus is not supported yet, use GS instead */
 					SETMIDIEVENT(evm[num_events], 0, ME_SYSEX_XG_LSB, 0, *body, ent);
 					num_events++;
@@ -285,12 +283,12 @@ int SysexConvert::parse_sysex_event_multi(const uint8_t *val, int32_t len, MidiE
 					break;
 
 				case 0x21:	/* Chorus Type LSB */
-					xg_chorus_type_lsb = *body;
+					xg_effect_types.chorus_lsb = *body;
 #if 0	/* XG specific chorus is not supported yet, use GS instead */
 					SETMIDIEVENT(evm[num_events], 0, ME_SYSEX_XG_LSB, 0, *body, ent);
 					num_events++;
 #else
-					v = set_xg_chorus_type(xg_chorus_type_msb, xg_chorus_type_lsb);
+					v = set_xg_chorus_type(xg_effect_types.chorus_msb, xg_effect_types.chorus_lsb);
 					if (v >= 0) {
 						SETMIDIEVENT(evm[num_events], 0, ME_SYSEX_GS_LSB, 0, v, 0x0D);
 						num_events++;
@@ -26,6 +26,8 @@
 #include <stdlib.h>
 
 #include <string.h>
+#include <algorithm>
+#include <chrono>
 
 #include "timidity.h"
 #include "common.h"
@@ -34,12 +36,11 @@
 #include "tables.h"
 #include "recache.h"
 #include "resample.h"
+#include "../../source/zmusic/memusage.h"
 
 namespace TimidityPlus
 {
 
-#define CACHE_DATA_LEN (allocate_cache_size / sizeof(sample_t))
-
 inline uint32_t sp_hash(Sample *sp, int note)
 {
 	return ((uint32_t)(intptr_t)(sp)+(uint32_t)(note));
@@ -52,24 +53,51 @@ inline uint32_t sp_hash(Sample *sp, int note)
 
 
 
+Recache::Recache(Player *p)
+{
+	player = p;
+	budget = (size_t)std::max(p->settings.timidity_resample_cache, 0) * 1024;
+	playing.reserve(max_voices);
+}
 
-void Recache::free_cache_data(void) {
-	free(cache_data);
-	reuse_mblock(&hash_entry_pool);
+Recache::~Recache()
+{
+	if (worker.joinable())
+	{
+		quit.store(true, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex);
+		}
+		wake.notify_one();
+		worker.join();
+	}
+	free_cache_data();
 }
 
-void Recache::resamp_cache_reset(void)
+/* Also releases entries the worker has finished but not handed back yet.
+ * Must only be called while the worker is not running. */
+void Recache::free_cache_data(void)
 {
-	if (cache_data == NULL) {
-		cache_data = (sample_t *)
-				safe_large_malloc((CACHE_DATA_LEN + 1) * sizeof(sample_t));
-		memset(cache_data, 0, (CACHE_DATA_LEN + 1) * sizeof(sample_t));
-		init_mblock(&hash_entry_pool);
+	for (int i = 0; i < HASH_TABLE_SIZE; i++)
+	{
+		struct cache_hash *p = cache_hash_table[i], *next;
+		for (; p; p = next)
+		{
+			next = p->next;
+			if (p->resampled != NULL)
+				ZMusic_AccountSamples(-(ptrdiff_t)p->size);
+			free(p->resampled);
+			delete p;
+		}
+		cache_hash_table[i] = NULL;
 	}
-	cache_data_len = 0;
-	memset(cache_hash_table, 0, sizeof(cache_hash_table));
-	memset(channel_note_table, 0, sizeof(channel_note_table));
-	reuse_mblock(&hash_entry_pool);
+}
+
+bool Recache::is_cacheable(Sample *sp)
+{
+	return !(sp->vibrato_control_ratio || (sp->modes & MODES_PINGPONG)
+			|| (sp->sample_rate == playback_rate
+			&& sp->root_freq == get_note_freq(sp, sp->note_to_use)));
 }
 
 struct cache_hash *Recache::resamp_cache_fetch(Sample *sp, int note)
@@ -77,170 +105,159 @@ struct cache_hash *Recache::resamp_cache_fetch(Sample *sp, int note)
 	unsigned int addr;
 	struct cache_hash *p;
 	
-	if (sp->vibrato_control_ratio || (sp->modes & MODES_PINGPONG)
-			|| (sp->sample_rate == playback_rate
-			&& sp->root_freq == get_note_freq(sp, sp->note_to_use)))
+	if (!enabled() || !is_cacheable(sp))
 		return NULL;
+	collect_results();
 	addr = sp_hash(sp, note) % HASH_TABLE_SIZE;
 	p = cache_hash_table[addr];
 	while (p && (p->note != note || p->sp != sp))
 		p = p->next;
-	if (p && p->resampled != NULL)
-		return p;
-	return NULL;
+	if (p == NULL) {
+		request(sp, note);
+		return NULL;
+	}
+	if (p->state != CACHE_READY)
+		return NULL;
+	p->last_use = ++use_counter;
+	return p;
 }
 
-void Recache::resamp_cache_refer_on(Voice *vp, int32_t sample_start)
+/*! Queue a note for the worker thread. It can be played from the cache
+ * once the result has been collected. */
+void Recache::request(Sample *sp, int note)
 {
 	unsigned int addr;
 	struct cache_hash *p;
-	int note, ch;
-	
-	ch = vp->channel;
-	if (vp->vibrato_control_ratio || player->channel[ch].portamento
-			|| (vp->sample->modes & MODES_PINGPONG)
-			|| vp->orig_frequency != vp->frequency
-			|| (vp->sample->sample_rate == playback_rate
-			&& vp->sample->root_freq
-			== get_note_freq(vp->sample, vp->sample->note_to_use)))
+
+	if (in_flight >= QUEUE_SIZE)
 		return;
-	note = vp->note;
-	if (channel_note_table[ch].cache[note])
-		resamp_cache_refer_off(ch, note, sample_start);
-	addr = sp_hash(vp->sample, note) % HASH_TABLE_SIZE;
-	p = cache_hash_table[addr];
-	while (p && (p->note != note || p->sp != vp->sample))
-		p = p->next;
-	if (! p) {
-		p = (struct cache_hash *)
-		new_segment(&hash_entry_pool, sizeof(struct cache_hash));
-		p->cnt = 0;
-		p->note = vp->note;
-		p->sp = vp->sample;
-		p->resampled = NULL;
-		p->next = cache_hash_table[addr];
-		cache_hash_table[addr] = p;
+	if (!worker.joinable()) {
+		try {
+			worker = std::thread([this]() { worker_loop(); });
+		}
+		catch (const std::system_error &) {
+			budget = 0;
+			return;
+		}
 	}
-	channel_note_table[ch].cache[note] = p;
-	channel_note_table[ch].on[note] = sample_start;
+	p = new cache_hash;
+	p->note = note;
+	p->sp = sp;
+	p->state = p->result = CACHE_PENDING;
+	p->last_use = ++use_counter;
+	p->size = 0;
+	p->resampled = NULL;
+	memcpy(&p->proto, sp, sizeof(Sample));
+	addr = sp_hash(sp, note) % HASH_TABLE_SIZE;
+	p->next = cache_hash_table[addr];
+	cache_hash_table[addr] = p;
+	requests.push(p);
+	in_flight++;
+	wake.notify_one();
 }
 
-void Recache::resamp_cache_refer_off(int ch, int note, int32_t sample_end)
+void Recache::collect_results(void)
 {
-	int32_t sample_start, len;
 	struct cache_hash *p;
-	Sample *sp;
-	
-	p = channel_note_table[ch].cache[note];
-	if (p == NULL)
-		return;
-	sp = p->sp;
-	if (sp->sample_rate == playback_rate
-			&& sp->root_freq == get_note_freq(sp, sp->note_to_use))
-		return;
-	sample_start = channel_note_table[ch].on[note];
-	len = sample_end - sample_start;
-	if (len < 0) {
-		channel_note_table[ch].cache[note] = NULL;
-		return;
-	}
-	if (! (sp->modes & MODES_LOOPING)) {
-		double a;
-		int32_t slen;
-		
-		a = ((double) sp->root_freq * playback_rate)
-				/ ((double) sp->sample_rate * get_note_freq(sp, note));
-		slen = (int32_t) ((sp->data_length >> FRACTION_BITS) * a);
-		if (len > slen)
-			len = slen;
+
+	while (results.pop(p)) {
+		in_flight--;
+		p->state = p->result;
+		if (p->state == CACHE_NO_ROOM) {
+			/* Drop the entry either way so that the note gets requested
+			 * again the next time it is played. */
+			evict(p->size);
+			unlink_entry(p);
+			delete p;
+		} else if (p->state == CACHE_READY && !p->sp->pitch_detect_pending) {
+			/* pitch detection may have finished since the copy was taken */
+			p->resampled->root_freq_detected = p->sp->root_freq_detected;
+			p->resampled->transpose_detected = p->sp->transpose_detected;
+			p->resampled->chord = p->sp->chord;
+			p->resampled->pitch_detect_pending = 0;
+		}
 	}
-	p->cnt += len;
-	channel_note_table[ch].cache[note] = NULL;
 }
 
-void Recache::resamp_cache_refer_alloff(int ch, int32_t sample_end)
+void Recache::unlink_entry(struct cache_hash *p)
 {
-	int i;
-	
-	for (i = 0; i < 128; i++)
-		resamp_cache_refer_off(ch, i, sample_end);
+	struct cache_hash **link = &cache_hash_table[sp_hash(p->sp, p->note) % HASH_TABLE_SIZE];
+
+	while (*link != p)
+		link = &(*link)->next;
+	*link = p->next;
 }
 
-void Recache::resamp_cache_create(void)
+/*! Drop least recently used notes until size more bytes fit into the budget.
+ * Notes still referenced by a voice are kept. */
+bool Recache::evict(size_t size)
 {
-	int i, skip;
-	int32_t n, t1, t2, total;
-	struct cache_hash **array;
-	
-	/* It is NP completion that solve the best cache hit rate.
-	 * So I thought better algorism O(n log n), but not a best solution.
-	 * Follows implementation takes good hit rate, and it is fast.
-	 */
-	n = t1 = t2 = 0;
-	total = 0;
-	/* set size per count */
-	for (i = 0; i < HASH_TABLE_SIZE; i++) {
-		struct cache_hash *p, *q;
-		
-		p = cache_hash_table[i], q = NULL;
-		while (p) {
-			struct cache_hash *tmp;
-			
-			t1 += p->cnt;
-			tmp = p, p = p->next;
-			if (tmp->cnt > 0) {
-				Sample *sp;
-				splen_t newlen;
-				
-				sp = tmp->sp;
-				sample_resamp_info(sp, tmp->note, NULL, NULL, &newlen);
-				if (newlen > 0) {
-					total += tmp->cnt;
-					tmp->r = (double) newlen / tmp->cnt;
-					tmp->next = q, q = tmp;
-					n++;
-				}
+	playing.clear();
+	for (int i = 0; i < max_voices; i++)
+		if (player->voice[i].status != VOICE_FREE)
+			playing.push_back(player->voice[i].sample);
+	std::sort(playing.begin(), playing.end());
+
+	while (budget - cache_used.load(std::memory_order_acquire) < size) {
+		struct cache_hash *victim = NULL;
+
+		for (int i = 0; i < HASH_TABLE_SIZE; i++) {
+			for (struct cache_hash *p = cache_hash_table[i]; p; p = p->next) {
+				if (p->state == CACHE_READY
+						&& (victim == NULL || p->last_use - victim->last_use > UINT32_MAX / 2)
+						&& !std::binary_search(playing.begin(), playing.end(), p->resampled))
+					victim = p;
 			}
 		}
-		cache_hash_table[i] = q;
+		if (victim == NULL)
+			return false;
+		unlink_entry(victim);
+		free(victim->resampled);
+		cache_used.fetch_sub(victim->size, std::memory_order_release);
+		ZMusic_AccountSamples(-(ptrdiff_t)victim->size);
+		delete victim;
 	}
-	if (n == 0) {
+	return true;
+}
+
+/*! Queue the drum notes of a song before it starts. Melodic notes are only
+ * known once they are played and get queued on their first note-on. */
+void Recache::resamp_cache_prefill(Instruments *instruments, const uint16_t *instrumentlist, int count)
+{
+	if (!enabled())
 		return;
+	for (int i = 0; i < count; i++) {
+		int prog = instrumentlist[i] & 127, bank = (instrumentlist[i] >> 7) & 127;
+		const ToneBank *drumset;
+		Instrument *ip;
+
+		if (!(instrumentlist[i] & (1 << 14)) || (drumset = instruments->drumSet(bank)) == NULL)
+			continue;
+		ip = drumset->tone[prog].instrument;
+		if (ip == NULL || IS_MAGIC_INSTRUMENT(ip))
+			continue;
+		for (int j = 0; j < ip->samples; j++)
+			resamp_cache_fetch(&ip->sample[j], prog);
 	}
-	array = (struct cache_hash **) new_segment(&hash_entry_pool,
-			n * sizeof(struct cache_hash *));
-	n = 0;
-	for (i = 0; i < HASH_TABLE_SIZE; i++) {
-		struct cache_hash *p;
-		
-		for (p = cache_hash_table[i]; p; p = p->next)
-			array[n++] = p;
-	}
-	if ((uint32_t)total > CACHE_DATA_LEN)
-		qsort_cache_array(array, 0, n - 1);
-	skip = 0;
-	for (i = 0; i < n; i++) {
-		if (array[i]->r != 0
-				&& cache_resampling(array[i]) == CACHE_RESAMPLING_OK)
-			t2 += array[i]->cnt;
-		else
-			skip++;
-	}
-	/* update cache_hash_table */
-	if (skip)
-		for (i = 0; i < HASH_TABLE_SIZE; i++) {
-			struct cache_hash *p, *q;
-			
-			p = cache_hash_table[i], q = NULL;
-			while (p) {
-				struct cache_hash *tmp;
-				
-				tmp = p, p = p->next;
-				if (tmp->resampled)
-					tmp->next = q, q = tmp;
-			}
-			cache_hash_table[i] = q;
+}
+
+void Recache::worker_loop(void)
+{
+	struct cache_hash *p;
+
+	while (!quit.load(std::memory_order_acquire)) {
+		if (!requests.pop(p)) {
+			/* The player notifies without taking the mutex so that it
+			 * never has to wait for it. The timeout catches a wakeup that
+			 * slipped in before the wait started. */
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			wake.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+				return quit.load(std::memory_order_acquire) || !requests.empty(); });
+			continue;
 		}
+		cache_resampling(p);
+		results.push(p);
+	}
 }
 
 double Recache::sample_resamp_info(Sample *sp, int note,
@@ -310,76 +327,77 @@ double Recache::sample_resamp_info(Sample *sp, int note,
 	return a;
 }
 
-void Recache::qsort_cache_array(struct cache_hash **a, int32_t first, int32_t last)
-{
-	int32_t i = first, j = last;
-	struct cache_hash *x, *t;
-	
-	if (j - i < SORT_THRESHOLD) {
-		insort_cache_array(a + i, j - i + 1);
-		return;
-	}
-	x = a[(first + last) / 2];
-	for (;;) {
-		while (a[i]->r < x->r)
-			i++;
-		while (x->r < a[j]->r)
-			j--;
-		if (i >= j)
-			break;
-		t = a[i], a[i] = a[j], a[j] = t;
-		i++, j--;
-	}
-	if (first < i - 1)
-		qsort_cache_array(a, first, i - 1);
-	if (j + 1 < last)
-		qsort_cache_array(a, j + 1, last);
-}
-
-void Recache::insort_cache_array(struct cache_hash **data, int32_t n)
-{
-	int32_t i, j;
-	struct cache_hash *x;
-	
-	for (i = 1; i < n; i++) {
-		x = data[i];
-		for (j = i - 1; j >= 0 && x->r < data[j]->r; j--)
-			data[j + 1] = data[j];
-		data[j + 1] = x;
-	}
-}
-
-int Recache::cache_resampling(struct cache_hash *p)
+/*! Runs on the worker thread. It only reads p->proto and the sample data,
+ * which stay unchanged while loaded, and the player does not look at the
+ * entry before it comes back. */
+void Recache::cache_resampling(struct cache_hash *p)
 {
 	Sample *sp, *newsp;
-	sample_t *src, *dest;
-	splen_t newlen, ofs, le, ls, ll, xls, xle;
-	int32_t incr, _x;
-	resample_rec_t resrc;
+	sample_t *dest;
+	splen_t newlen, xls, xle;
 	double a;
 	int8_t note;
+	size_t size, used;
 	
-	sp = p->sp;
+	sp = &p->proto;
 	if (sp->note_to_use)
 		note = sp->note_to_use;
 	else
 		note = p->note;
 	a = sample_resamp_info(sp, note, &xls, &xle, &newlen);
-	if (newlen == 0)
-		return CACHE_RESAMPLING_NOTOK;
 	newlen >>= FRACTION_BITS;
-	if (cache_data_len + newlen + 1 > CACHE_DATA_LEN)
-		return CACHE_RESAMPLING_NOTOK;
-	resrc.loop_start = ls = sp->loop_start;
-	resrc.loop_end = le = sp->loop_end;
-	resrc.data_length = sp->data_length;
-	ll = sp->loop_end - sp->loop_start;
-	dest = cache_data + cache_data_len;
-	src = sp->data;
-	newsp = (Sample *) new_segment(&hash_entry_pool, sizeof(Sample));
+	/* the sample after the loop end gets written as well */
+	size = sizeof(Sample) + (std::max(newlen, xle >> FRACTION_BITS) + 1) * sizeof(sample_t);
+	if (newlen == 0 || size > budget) {
+		p->result = CACHE_FAILED;
+		return;
+	}
+	used = cache_used.load(std::memory_order_acquire);
+	do {
+		if (used + size > budget) {
+			p->size = size;
+			p->result = CACHE_NO_ROOM;
+			return;
+		}
+	} while (!cache_used.compare_exchange_weak(used, used + size));
+	newsp = (Sample *)malloc(size);
+	if (newsp == NULL) {
+		cache_used.fetch_sub(size);
+		p->result = CACHE_FAILED;
+		return;
+	}
+	dest = (sample_t *)(newsp + 1);
 	memcpy(newsp, sp, sizeof(Sample));
 	newsp->data = dest;
-	ofs = 0;
+	newsp->data_alloced = 0;
+	resample_to_output(sp, a, dest, newlen);
+	newsp->loop_start = xls;
+	newsp->loop_end = xle;
+	newsp->data_length = newlen << FRACTION_BITS;
+	if (sp->modes & MODES_LOOPING)
+		loop_connect(dest, (int32_t) (xls >> FRACTION_BITS),
+				(int32_t) (xle >> FRACTION_BITS));
+	dest[xle >> FRACTION_BITS] = dest[xls >> FRACTION_BITS];
+	newsp->root_freq = get_note_freq(newsp, note);
+	newsp->sample_rate = playback_rate;
+	p->resampled = newsp;
+	p->size = size;
+	ZMusic_AccountSamples(size);
+	p->result = CACHE_READY;
+}
+
+/*! Resample sp by the step a into newlen samples at dest, running through
+ * the loop as often as needed. */
+void Recache::resample_to_output(Sample *sp, double a, sample_t *dest, splen_t newlen)
+{
+	sample_t *src = sp->data;
+	splen_t ofs = 0, le = sp->loop_end, ll = sp->loop_end - sp->loop_start;
+	int32_t incr, _x;
+	resample_rec_t resrc;
+
+	resrc.loop_start = sp->loop_start;
+	resrc.loop_end = sp->loop_end;
+	resrc.data_length = sp->data_length;
 	incr = (splen_t) (TIM_FSCALE(a, FRACTION_BITS) + 0.5);
 	if (sp->modes & MODES_LOOPING)
 		for (splen_t i = 0; i < newlen; i++) {
@@ -393,18 +411,43 @@ int Recache::cache_resampling(struct cache_hash *p)
 			RESAMPLATION_CACHE;
 			ofs += incr;
 		}
-	newsp->loop_start = xls;
-	newsp->loop_end = xle;
-	newsp->data_length = newlen << FRACTION_BITS;
-	if (sp->modes & MODES_LOOPING)
-		loop_connect(dest, (int32_t) (xls >> FRACTION_BITS),
-				(int32_t) (xle >> FRACTION_BITS));
+}
+
+/*! Convert a looped sample that is always played on the same note to the
+ * output rate at load time, like pre_resample() does for unlooped ones.
+ * Returns false if the sample was left alone. */
+bool Recache::pre_resample_looped(Sample *sp)
+{
+	splen_t newlen, xls, xle, len;
+	sample_t *dest;
+	double a;
+	int note = sp->note_to_use;
+
+	if (!note || !(sp->modes & MODES_LOOPING) || (sp->modes & MODES_PINGPONG)
+			|| (sp->sample_rate == playback_rate && sp->root_freq == get_note_freq(sp, note)))
+		return false;
+	a = sample_resamp_info(sp, note, &xls, &xle, &newlen);
+	newlen >>= FRACTION_BITS;
+	if (newlen == 0)
+		return false;
+	/* room for the sample after the loop end and what the interpolators read past it */
+	len = std::max(newlen, xle >> FRACTION_BITS) + 4;
+	dest = (sample_t *)safe_malloc(len * sizeof(sample_t));
+	memset(dest, 0, len * sizeof(sample_t));
+	resample_to_output(sp, a, dest, newlen);
+	loop_connect(dest, (int32_t) (xls >> FRACTION_BITS), (int32_t) (xle >> FRACTION_BITS));
 	dest[xle >> FRACTION_BITS] = dest[xls >> FRACTION_BITS];
-	newsp->root_freq = get_note_freq(newsp, note);
-	newsp->sample_rate = playback_rate;
-	p->resampled = newsp;
-	cache_data_len += newlen + 1;
-	return CACHE_RESAMPLING_OK;
+
+	if (sp->data_alloced)
+		free(sp->data);
+	sp->data = dest;
+	sp->data_alloced = 1;
+	sp->loop_start = xls;
+	sp->loop_end = xle;
+	sp->data_length = newlen << FRACTION_BITS;
+	sp->root_freq = get_note_freq(sp, note);
+	sp->sample_rate = playback_rate;
+	return true;
 }
 
 void Recache::loop_connect(sample_t *data, int32_t start, int32_t end)
@@ -435,4 +478,4 @@ void Recache::loop_connect(sample_t *data, int32_t start, int32_t end)
 	}
 }
 
-}
\ No newline at end of file
+}
@@ -247,16 +247,18 @@ void free_gauss_table(void)
 /* initialize the coefficients of the current resampling algorithm */
 void initialize_resampler_coeffs(void)
 {
-	// Only needs to be done once.
-	static bool done = false;
-	if (done) return;
-	done = true;
-
-	initialize_newton_coeffs();
-	initialize_gauss_table(gauss_n);
-
-	sample_bounds_min = -32768;
-	sample_bounds_max = 32767;
+	// Only needs to be done once. The first caller builds the tables
+	// while any other thread waits for it.
+	static const bool done = []()
+	{
+		initialize_newton_coeffs();
+		initialize_gauss_table(gauss_n);
+
+		sample_bounds_min = -32768;
+		sample_bounds_max = 32767;
+		return true;
+	}();
+	(void)done;
 }
 
 
@@ -849,13 +851,19 @@ resample_t *Resampler::normal_resample_voice(int v, int32_t *countptr, int mode)
 resample_t *Resampler::resample_voice(int v, int32_t *countptr)
 {
 	Voice *vp = &player->voice[v];
-	int mode;
+	int mode, native, looping;
 	resample_t *result;
 	int32_t i;
 
-	if (vp->sample->sample_rate == playback_rate &&
+	mode = vp->sample->modes;
+	looping = (mode & MODES_LOOPING) &&
+		((mode & MODES_ENVELOPE) ||
+		(vp->status & (VOICE_ON | VOICE_SUSTAINED)));
+	native = vp->sample->sample_rate == playback_rate &&
 		vp->sample->root_freq == get_note_freq(vp->sample, vp->sample->note_to_use) &&
-		vp->frequency == vp->orig_frequency)
+		vp->frequency == vp->orig_frequency;
+
+	if (native && !looping)
 	{
 		int32_t ofs;
 
@@ -880,10 +888,26 @@ resample_t *Resampler::resample_voice(int v, int32_t *countptr)
 		return resample_buffer;
 	}
 
-	mode = vp->sample->modes;
-	if ((mode & MODES_LOOPING) &&
-		((mode & MODES_ENVELOPE) ||
-		(vp->status & (VOICE_ON | VOICE_SUSTAINED))))
+	if (native && looping && !(mode & MODES_PINGPONG) &&
+		!((vp->sample_offset | vp->sample->loop_start | vp->sample->loop_end) & FRACTION_MASK))
+	{
+		int32_t ofs, ls, le;
+
+		/* Looped pre-resampled data on whole sample positions -- copy it
+			and jump back at the loop end. */
+		ofs = (int32_t)(vp->sample_offset >> FRACTION_BITS);
+		ls = (int32_t)(vp->sample->loop_start >> FRACTION_BITS);
+		le = (int32_t)(vp->sample->loop_end >> FRACTION_BITS);
+		for (i = 0; i < *countptr; i++) {
+			if (ofs >= le)
+				ofs -= le - ls;
+			resample_buffer[i] = vp->sample->data[ofs++];
+		}
+		vp->sample_offset = (splen_t)ofs << FRACTION_BITS;
+		return resample_buffer;
+	}
+
+	if (looping)
 	{
 		if (mode & MODES_PINGPONG)
 		{
@@ -134,6 +134,49 @@ void Reverb::do_delay(int32_t *stream, int32_t *buf, int32_t size, int32_t *inde
 	*stream = output;
 }
 
+/*! true if all samples are zero */
+static bool is_silent(const int32_t *buf, int32_t count)
+{
+	int32_t acc = 0;
+	for (int32_t i = 0; i < count; i++) {acc |= buf[i];}
+	return acc == 0;
+}
+
+static bool is_silent(const simple_delay *delay)
+{
+	return delay->buf == NULL || is_silent(delay->buf, delay->size);
+}
+
+static bool is_silent(const allpass *allpass)
+{
+	return allpass->buf == NULL || is_silent(allpass->buf, allpass->size);
+}
+
+static bool is_silent(const comb *comb)
+{
+	return comb->filterstore == 0 && (comb->buf == NULL || is_silent(comb->buf, comb->size));
+}
+
+static bool is_silent(const filter_lowpass1 *p)
+{
+	return p->x1l == 0 && p->x1r == 0;
+}
+
+/*! Recheck a silent system effect for a fully decayed state every 100ms.
+    Scanning the delay lines after every block would cost more than running
+    the effect while its tail is still decaying. */
+bool Reverb::idle_check_due(bool silent, int32_t count, int32_t *quiet)
+{
+	if (!silent) {
+		*quiet = 0;
+		return false;
+	}
+	*quiet += count;
+	if (*quiet < playback_rate / 5) {return false;}
+	*quiet = 0;
+	return true;
+}
+
 /*! LFO (low frequency oscillator) */
 void Reverb::init_lfo(lfo *lfo, double freq, int type, double phase)
 {
@@ -1581,8 +1624,8 @@ void Reverb::init_reverb(void)
 	init_filter_lowpass1(&(reverb_status_gs.lpf));
 	/* Only initialize freeverb if stereo output */
 	/* Old non-freeverb must be initialized for mono reverb not to crash */
-	if ( (timidity_reverb == 3 || timidity_reverb == 4
-			|| (timidity_reverb < 0 && ! (timidity_reverb & 0x100)))) {
+	if ( (settings->timidity_reverb == 3 || settings->timidity_reverb == 4
+			|| (settings->timidity_reverb < 0 && ! (settings->timidity_reverb & 0x100)))) {
 		switch(reverb_status_gs.character) {	/* select reverb algorithm */
 		case 5:	/* Plate Reverb */
 			do_ch_plate_reverb(NULL, MAGIC_INIT_EFFECT_INFO, &(reverb_status_gs.info_plate_reverb));
@@ -1607,17 +1650,65 @@ void Reverb::init_reverb(void)
 	}
 	memset(reverb_effect_buffer, 0, reverb_effect_bufsize);
 	memset(direct_buffer, 0, direct_bufsize);
+	reverb_idle = 0;
+	reverb_quiet = 0;
+}
+
+/*! true if the reverb tail has decayed to exact zero, so silent input
+    produces silent output until something is sent again */
+bool Reverb::is_reverb_idle(void)
+{
+	int i;
+
+	if (!is_silent(&(reverb_status_gs.lpf))) {return false;}
+	if (settings->timidity_reverb == 3 || settings->timidity_reverb == 4
+			|| (settings->timidity_reverb < 0 && ! (settings->timidity_reverb & 0x100))) {
+		switch(reverb_status_gs.character) {
+		case 5:	/* Plate Reverb; its LFOs keep running */
+			return false;
+		case 6:	/* Delay */
+		case 7:	/* Panning Delay */
+		{
+			InfoDelay3 *info = &(reverb_status_gs.info_reverb_delay);
+			return is_silent(&(info->delayL)) && is_silent(&(info->delayR));
+		}
+		default: /* Freeverb */
+		{
+			InfoFreeverb *rev = &(reverb_status_gs.info_freeverb);
+			if (!is_silent(&(rev->pdelay))) {return false;}
+			for (i = 0; i < numcombs; i++) {
+				if (!is_silent(&(rev->combL[i])) || !is_silent(&(rev->combR[i]))) {return false;}
+			}
+			for (i = 0; i < numallpasses; i++) {
+				if (!is_silent(&(rev->allpassL[i])) || !is_silent(&(rev->allpassR[i]))) {return false;}
+			}
+			return true;
+		}
+		}
+	} else {	/* Old Reverb */
+		InfoStandardReverb *info = &(reverb_status_gs.info_standard_reverb);
+		return !(info->ta | info->tb | info->HPFL | info->HPFR
+			| info->LPFL | info->LPFR | info->EPFL | info->EPFR)
+			&& is_silent(&(info->buf0_L)) && is_silent(&(info->buf0_R))
+			&& is_silent(&(info->buf1_L)) && is_silent(&(info->buf1_R))
+			&& is_silent(&(info->buf2_L)) && is_silent(&(info->buf2_R))
+			&& is_silent(&(info->buf3_L)) && is_silent(&(info->buf3_R));
+	}
 }
 
 void Reverb::do_ch_reverb(int32_t *buf, int32_t count)
 {
+	/* nothing sent and nothing left ringing: the output would be all zeros */
+	bool silent = is_silent(reverb_effect_buffer, count);
+	if (silent && reverb_idle) {return;}
+
 #ifdef SYS_EFFECT_PRE_LPF
-	if ((timidity_reverb == 3 || timidity_reverb == 4
-			|| (timidity_reverb < 0 && ! (timidity_reverb & 0x100))) && reverb_status_gs.pre_lpf)
+	if ((settings->timidity_reverb == 3 || settings->timidity_reverb == 4
+			|| (settings->timidity_reverb < 0 && ! (settings->timidity_reverb & 0x100))) && reverb_status_gs.pre_lpf)
 		do_filter_lowpass1_stereo(reverb_effect_buffer, count, &(reverb_status_gs.lpf));
 #endif /* SYS_EFFECT_PRE_LPF */
-	if (timidity_reverb == 3 || timidity_reverb == 4
-			|| (timidity_reverb < 0 && ! (timidity_reverb & 0x100))) {
+	if (settings->timidity_reverb == 3 || settings->timidity_reverb == 4
+			|| (settings->timidity_reverb < 0 && ! (settings->timidity_reverb & 0x100))) {
 		switch(reverb_status_gs.character) {	/* select reverb algorithm */
 		case 5:	/* Plate Reverb */
 			do_ch_plate_reverb(buf, count, &(reverb_status_gs.info_plate_reverb));
@@ -1639,6 +1730,7 @@ void Reverb::do_ch_reverb(int32_t *buf, int32_t count)
 	} else {	/* Old Reverb */
 		do_ch_standard_reverb(buf, count, &(reverb_status_gs.info_standard_reverb));
 	}
+	reverb_idle = idle_check_due(silent, count, &reverb_quiet) && is_reverb_idle();
 }
 
 /*                   */
@@ -1650,13 +1742,25 @@ void Reverb::init_ch_delay(void)
 	memset(delay_effect_buffer, 0, sizeof(delay_effect_buffer));
 	init_filter_lowpass1(&(delay_status_gs.lpf));
 	do_ch_3tap_delay(NULL, MAGIC_INIT_EFFECT_INFO, &(delay_status_gs.info_delay));
+	delay_idle = 0;
+	delay_quiet = 0;
+}
+
+bool Reverb::is_delay_idle(void)
+{
+	InfoDelay3 *info = &(delay_status_gs.info_delay);
+	return is_silent(&(delay_status_gs.lpf))
+		&& is_silent(&(info->delayL)) && is_silent(&(info->delayR));
 }
 
 void Reverb::do_ch_delay(int32_t *buf, int32_t count)
 {
+	bool silent = is_silent(delay_effect_buffer, count);
+	if (silent && delay_idle) {return;}
+
 #ifdef SYS_EFFECT_PRE_LPF
-	if ((timidity_reverb == 3 || timidity_reverb == 4
-			|| (timidity_reverb < 0 && ! (timidity_reverb & 0x100))) && delay_status_gs.pre_lpf)
+	if ((settings->timidity_reverb == 3 || settings->timidity_reverb == 4
+			|| (settings->timidity_reverb < 0 && ! (settings->timidity_reverb & 0x100))) && delay_status_gs.pre_lpf)
 		do_filter_lowpass1_stereo(delay_effect_buffer, count, &(delay_status_gs.lpf));
 #endif /* SYS_EFFECT_PRE_LPF */
 	switch (delay_status_gs.type) {
@@ -1670,6 +1774,7 @@ void Reverb::do_ch_delay(int32_t *buf, int32_t count)
 		do_ch_normal_delay(buf, count, &(delay_status_gs.info_delay));
 		break;
 	}
+	delay_idle = idle_check_due(silent, count, &delay_quiet) && is_delay_idle();
 }
 
 void Reverb::set_ch_delay(int32_t *sbuffer, int32_t n, int32_t level)
@@ -1942,6 +2047,15 @@ void Reverb::init_ch_chorus(void)
 	init_filter_lowpass1(&(chorus_status_gs.lpf));
 	do_ch_stereo_chorus(NULL, MAGIC_INIT_EFFECT_INFO, &(chorus_status_gs.info_stereo_chorus));
 	memset(chorus_effect_buffer, 0, sizeof(chorus_effect_buffer));
+	chorus_idle = 0;
+	chorus_quiet = 0;
+}
+
+bool Reverb::is_chorus_idle(void)
+{
+	InfoStereoChorus *info = &(chorus_status_gs.info_stereo_chorus);
+	return is_silent(&(chorus_status_gs.lpf)) && !(info->hist0 | info->hist1)
+		&& is_silent(&(info->delayL)) && is_silent(&(info->delayR));
 }
 
 void Reverb::set_ch_chorus(int32_t *sbuffer,int32_t n, int32_t level)
@@ -1959,13 +2073,24 @@ void Reverb::set_ch_chorus(int32_t *sbuffer,int32_t n, int32_t level)
 
 void Reverb::do_ch_chorus(int32_t *buf, int32_t count)
 {
+	bool silent = is_silent(chorus_effect_buffer, count);
+	if (silent && chorus_idle) {
+		/* the delay lines are empty, only the LFO phase has to move on */
+		InfoStereoChorus *info = &(chorus_status_gs.info_stereo_chorus);
+		if (info->lfoL.cycle > 0) {
+			info->lfoL.count = info->lfoR.count = (info->lfoL.count + count / 2) % info->lfoL.cycle;
+		}
+		return;
+	}
+
 #ifdef SYS_EFFECT_PRE_LPF
-	if ((timidity_reverb == 3 || timidity_reverb == 4
-			|| (timidity_reverb < 0 && ! (timidity_reverb & 0x100))) && chorus_status_gs.pre_lpf)
+	if ((settings->timidity_reverb == 3 || settings->timidity_reverb == 4
+			|| (settings->timidity_reverb < 0 && ! (settings->timidity_reverb & 0x100))) && chorus_status_gs.pre_lpf)
 		do_filter_lowpass1_stereo(chorus_effect_buffer, count, &(chorus_status_gs.lpf));
 #endif /* SYS_EFFECT_PRE_LPF */
 
 	do_ch_stereo_chorus(buf, count, &(chorus_status_gs.info_stereo_chorus));
+	chorus_idle = idle_check_due(silent, count, &chorus_quiet) && is_chorus_idle();
 }
 
 /*                             */
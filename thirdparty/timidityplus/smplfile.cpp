@@ -33,6 +33,7 @@
 #include "instrum.h"
 #include "playmidi.h"
 #include "resample.h"
+#include "recache.h"
 #include "tables.h"
 
 namespace TimidityPlus
@@ -117,6 +118,8 @@ Instrument *Instruments::extract_sample_file(char *sample_file)
 		/* resample it if possible */
 		if (sample->note_to_use && !(sample->modes & MODES_LOOPING))
 			pre_resample(sample);
+		else if (GetDefaultSettings().timidity_pre_resample)
+			Recache::pre_resample_looped(sample);
 	}
 	return inst;
 }
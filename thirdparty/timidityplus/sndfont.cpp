@@ -128,6 +128,10 @@ struct SFInsts {
 	int8_t def_order, def_cutoff_allowed, def_resonance_allowed;
 	uint16_t version, minorversion;
 	int32_t samplepos, samplesize;
+	const uint8_t *mapping;		/* whole file if it could be mapped, else NULL */
+	size_t mapsize;
+	SFInfo *sfinfo;			/* the presets, which get parsed when first asked for */
+	char *preset_parsed;
 	InstList *instlist[INSTHASHSIZE];
 	char **inst_namebuf;
 	SFExclude *sfexclude;
@@ -222,6 +226,7 @@ void Instruments::free_soundfonts()
 	for (sf = sfrecs; sf != NULL; sf = next) {
 		if (sf->tf != nullptr) tf_close(sf->tf);
 		sf->tf = nullptr;
+		free_presets(sf);
 		reuse_mblock(&sf->pool);
 		next = sf->next;
 		free(sf);
@@ -240,6 +245,7 @@ char *Instruments::soundfont_preset_name(int bank, int preset, int keynote,
 	    int addr;
 	    InstList *ip;
 
+	    parse_presets(rec, bank, preset);
 	    addr = INSTHASH(bank, preset, keynote);
 	    for(ip = rec->instlist[addr]; ip; ip = ip->next)
 		if(ip->pat.bank == bank && ip->pat.preset == preset &&
@@ -257,7 +263,7 @@ char *Instruments::soundfont_preset_name(int bank, int preset, int keynote,
 
 void Instruments::init_sf(SFInsts *rec)
 {
-	SFInfo sfinfo;
+	SFInfo *sfinfo;
 	int i;
 
 	if ((rec->tf = open_file(rec->fname, sfreader)) == NULL) {
@@ -266,49 +272,100 @@ void Instruments::init_sf(SFInsts *rec)
 		end_soundfont(rec);
 		return;
 	}
+	sourceFiles.push_back(rec->tf->filename);
+
+	sfinfo = rec->sfinfo = (SFInfo *)safe_malloc(sizeof(SFInfo));
+	memset(sfinfo, 0, sizeof(SFInfo));
 
 	// SoundFont spec, 7.2: ... contains a minimum of two records, one record for each preset and one for a terminal record
-	if(load_soundfont(&sfinfo, rec->tf) || sfinfo.npresets < 2)
+	if(load_soundfont(sfinfo, rec->tf) || sfinfo->npresets < 2)
 	{
 	    end_soundfont(rec);
 	    return;
 	}
 
-	correct_samples(&sfinfo);
+	/* Only the banks get set up here. A preset's layers are converted by
+	 * parse_presets() when an instrument from it is first loaded, so a
+	 * large font costs no more than the presets a song plays. */
+	correct_samples(sfinfo);
+	rec->preset_parsed = (char *)SFMalloc(rec, sfinfo->npresets);
+	memset(rec->preset_parsed, 0, sfinfo->npresets);
 	current_sfrec = rec;
-	for (i = 0; i < sfinfo.npresets - 1; i++) {
-		int bank = sfinfo.preset[i].bank;
-		int preset = sfinfo.preset[i].preset;
+	for (i = 0; i < sfinfo->npresets - 1; i++) {
+		int bank = sfinfo->preset[i].bank;
+		int preset = sfinfo->preset[i].preset;
 
 		if (bank == 128)
 		    /* FIXME: why not allow exclusion of drumsets? */
 		    alloc_instrument_bank(1, preset);
 		else {
-			if (is_excluded(rec, bank, preset, -1))
+			if (is_excluded(rec, bank, preset, -1)) {
+				rec->preset_parsed[i] = 1;
 				continue;
+			}
 			alloc_instrument_bank(0, bank);
 		}
-		load_font(&sfinfo, i);
 	}
 
 	/* copy header info */
-	rec->version = sfinfo.version;
-	rec->minorversion = sfinfo.minorversion;
-	rec->samplepos = sfinfo.samplepos;
-	rec->samplesize = sfinfo.samplesize;
+	rec->version = sfinfo->version;
+	rec->minorversion = sfinfo->minorversion;
+	rec->samplepos = sfinfo->samplepos;
+	rec->samplesize = sfinfo->samplesize;
 	rec->inst_namebuf =
-	    (char **)SFMalloc(rec, sfinfo.npresets * sizeof(char *));
-	for(i = 0; i < sfinfo.npresets; i++)
+	    (char **)SFMalloc(rec, sfinfo->npresets * sizeof(char *));
+	for(i = 0; i < sfinfo->npresets; i++)
 	    rec->inst_namebuf[i] =
-		(char *)SFStrdup(rec, sfinfo.preset[i].hdr.name);
-	free_soundfont(&sfinfo);
+		(char *)SFStrdup(rec, sfinfo->preset[i].hdr.name);
+
+	/* With the file mapped, sample data is taken from the mapping and the
+	 * file does not need to stay open. */
+	auto mapping = rec->tf->shareData();
+	if (mapping != nullptr) {
+		rec->mapping = mapping.get();
+		rec->mapsize = rec->tf->filelength();
+		sf_mappings.push_back(std::move(mapping));
+	}
 
-	if (opt_sf_close_each_file) {
+	if (opt_sf_close_each_file || rec->mapping != NULL) {
 		tf_close(rec->tf);
 		rec->tf = NULL;
 	}
 }
 
+/* Convert the layers of all presets in the font with the given bank and
+ * program number that have not been converted yet. */
+void Instruments::parse_presets(SFInsts *rec, int bank, int preset)
+{
+	SFInfo *sfinfo = rec->sfinfo;
+	SFInsts *prev_sfrec = current_sfrec;
+	int i;
+
+	if (sfinfo == NULL)
+		return;
+	current_sfrec = rec;
+	for (i = 0; i < sfinfo->npresets - 1; i++) {
+		if (rec->preset_parsed[i] || sfinfo->preset[i].bank != bank ||
+		    sfinfo->preset[i].preset != preset)
+			continue;
+		rec->preset_parsed[i] = 1;
+		load_font(sfinfo, i);
+	}
+	current_sfrec = prev_sfrec;
+}
+
+void Instruments::free_presets(SFInsts *rec)
+{
+	if (rec->sfinfo != NULL) {
+		free_soundfont(rec->sfinfo);
+		free(rec->sfinfo);
+		rec->sfinfo = NULL;
+	}
+	rec->preset_parsed = NULL;
+	rec->mapping = NULL;
+	rec->mapsize = 0;
+}
+
 void Instruments::init_load_soundfont(void)
 {
     SFInsts *rec;
@@ -324,6 +381,7 @@ void Instruments::end_soundfont(SFInsts *rec)
 		rec->tf = NULL;
 	}
 
+	free_presets(rec);
 	rec->fname = NULL;
 	rec->inst_namebuf = NULL;
 	rec->sfexclude = NULL;
@@ -355,9 +413,9 @@ Instrument *Instruments::try_load_soundfont(SFInsts *rec, int order, int bank,in
 	Instrument *inst = NULL;
 	int addr;
 
-	if (rec->tf == NULL) {
-		if (rec->fname == NULL)
-			return NULL;
+	if (rec->fname == NULL)
+		return NULL;
+	if (rec->tf == NULL && rec->mapping == NULL) {
 		if ((rec->tf = open_file(rec->fname, sfreader)) == NULL)
 		{
 			printMessage(CMSG_ERROR, VERB_NORMAL,
@@ -367,6 +425,7 @@ Instrument *Instruments::try_load_soundfont(SFInsts *rec, int order, int bank,in
 		}
 	}
 
+	parse_presets(rec, bank, preset);
 	addr = INSTHASH(bank, preset, keynote);
 	for (ip = rec->instlist[addr]; ip; ip = ip->next) {
 		if (ip->pat.bank == bank && ip->pat.preset == preset &&
@@ -378,7 +437,7 @@ Instrument *Instruments::try_load_soundfont(SFInsts *rec, int order, int bank,in
 	if (ip && ip->samples)
 		inst = load_from_file(rec, ip);
 
-	if (opt_sf_close_each_file) {
+	if (opt_sf_close_each_file && rec->tf != NULL) {
 		tf_close(rec->tf);
 		rec->tf = NULL;
 	}
@@ -489,6 +548,32 @@ int32_t Instruments::calc_sustain(int sust_cB)
 	else {return (1000 - sust_cB) * 65533 / 1000;}
 }
 
+/* A sample can be played straight from the mapped file if nothing needs to
+ * be done to its data: it is little endian, neither antialiased nor
+ * resampled at load time, and is followed by the three zero samples that
+ * load_from_file() would otherwise append. The SoundFont spec asks for 46,
+ * so this is true of nearly every font. */
+bool Instruments::play_from_mapping(SFInsts *rec, SampleList *sp, Sample *sample)
+{
+#ifdef _BIG_ENDIAN_
+	return false;
+#else
+	const int16_t *data;
+	int32_t len = sp->len / 2;
+
+	if (rec->mapping == NULL || antialiasing_allowed ||
+	    (sample->note_to_use && !(sample->modes & MODES_LOOPING)))
+		return false;
+	if (sp->start < 0 || (sp->start & 1) || (sp->len & 1) ||
+	    (size_t)sp->start + sp->len + 2 * 3 > rec->mapsize)
+		return false;
+	data = (const int16_t *)(rec->mapping + sp->start);
+	if (((uintptr_t)data & 1) != 0)
+		return false;
+	return data[len] == 0 && data[len + 1] == 0 && data[len + 2] == 0;
+#endif
+}
+
 Instrument *Instruments::load_from_file(SFInsts *rec, InstList *ip)
 {
 	SampleList *sp;
@@ -547,11 +632,31 @@ Instrument *Instruments::load_from_file(SFInsts *rec, InstList *ip)
 		    }
 		}
 
+		if (play_from_mapping(rec, sp, sample))
+		{
+			/* the data is played as it is stored in the file */
+			sample->data = (sample_t *)(rec->mapping + sp->start);
+			sample->data_alloced = 0;
+			if (ip->pat.bank == 128 && GetDefaultSettings().timidity_surround_chorus)
+				sample->pitch_detect_pending = 1;
+			continue;
+		}
+
 		sample->data = (sample_t *)safe_large_malloc(sp->len + 2 * 3);
 		sample->data_alloced = 1;
 
-		tf_seek(rec->tf, sp->start, SEEK_SET);
-		tf_read(sample->data, sp->len, rec->tf);
+		if (rec->mapping != NULL)
+		{
+			if (sp->start >= 0 && (size_t)sp->start + sp->len <= rec->mapsize)
+				memcpy(sample->data, rec->mapping + sp->start, sp->len);
+			else
+				memset(sample->data, 0, sp->len);
+		}
+		else
+		{
+			tf_seek(rec->tf, sp->start, SEEK_SET);
+			tf_read(sample->data, sp->len, rec->tf);
+		}
 
 #ifdef _BIG_ENDIAN_
 		tmp = (int16_t*)sample->data;
@@ -576,16 +681,8 @@ Instrument *Instruments::load_from_file(SFInsts *rec, InstList *ip)
 			pre_resample(sample);
 
 		/* do pitch detection on drums if surround chorus is used */
-		if (ip->pat.bank == 128 && timidity_surround_chorus)
-		{
-			Freq freq;
-		    sample->chord = -1;
-		    sample->root_freq_detected =
-		    	freq.freq_fourier(sample, &(sample->chord));
-		    sample->transpose_detected =
-			assign_pitch_to_freq(sample->root_freq_detected) -
-			assign_pitch_to_freq(sample->root_freq / 1024.0);
-		}
+		if (ip->pat.bank == 128 && GetDefaultSettings().timidity_surround_chorus)
+			sample->pitch_detect_pending = 1;
 	}
 
 	return inst;
@@ -1295,7 +1392,7 @@ void Instruments::set_init_info(SFInfo *sf, SampleList *vp, LayerTable *tbl)
     val = (int)tbl->val[SF_initialFilterFc];
 	val = abscent_to_Hz(val);
 
-	if(!timidity_modulation_envelope) {
+	if(!GetDefaultSettings().timidity_modulation_envelope) {
 		if(tbl->set[SF_env1ToFilterFc] && (int)tbl->val[SF_env1ToFilterFc] > 0)
 		{
 			val = int( val * pow(2.0,(double)tbl->val[SF_env1ToFilterFc] / 1200.0f));
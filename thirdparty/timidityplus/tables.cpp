@@ -970,27 +970,29 @@ const float lofi_sampling_freq_table_xg[] =
 
 void init_tables(void)
 {
-	// Only needs to be done once.
-	static bool done = false;
-	if (done) return;
-	done = true;
-
-	init_freq_table();
-	init_freq_table_tuning();
-	init_freq_table_pytha();
-	init_freq_table_meantone();
-	init_freq_table_pureint();
-	init_bend_fine();
-	init_bend_coarse();
-	init_triangular_table();
-	init_gm2_pan_table();
-	init_attack_vol_table();
-	init_sb_vol_table();
-	init_modenv_vol_table();
-	init_def_vol_table();
-	init_gs_vol_table();
-	init_perceived_vol_table();
-	init_gm2_vol_table();
+	// Only needs to be done once. The first caller builds the tables
+	// while any other thread waits for it.
+	static const bool done = []()
+	{
+		init_freq_table();
+		init_freq_table_tuning();
+		init_freq_table_pytha();
+		init_freq_table_meantone();
+		init_freq_table_pureint();
+		init_bend_fine();
+		init_bend_coarse();
+		init_triangular_table();
+		init_gm2_pan_table();
+		init_attack_vol_table();
+		init_sb_vol_table();
+		init_modenv_vol_table();
+		init_def_vol_table();
+		init_gs_vol_table();
+		init_perceived_vol_table();
+		init_gm2_vol_table();
+		return true;
+	}();
+	(void)done;
 }
 
 int32_t get_note_freq(Sample *sp, int note)
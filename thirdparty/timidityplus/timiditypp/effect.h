@@ -21,11 +21,13 @@ class Effect
 	int32_t prev[AUDIO_BUFFER_SIZE * 2] = { 0 };
 
 	Reverb *reverb;
+	const PlayerSettings *settings;
 
 public:
-	Effect(Reverb *_reverb)
+	Effect(Reverb *_reverb, const PlayerSettings &s)
 	{
 		reverb = _reverb;
+		settings = &s;
 		init_effect();
 	}
 
@@ -23,12 +23,15 @@
 namespace TimidityPlus
 {
 
+struct Sample;
+
 extern const float pitch_freq_table[129];
 extern const float pitch_freq_ub_table[129];
 extern const float pitch_freq_lb_table[129];
 extern const int chord_table[4][3][3];
 
 extern int assign_pitch_to_freq(float freq);
+extern void detect_sample_pitch(Sample *sp);
 
 enum
 {
@@ -40,8 +43,6 @@ enum
 	HIGHEST_PITCH = 127
 };
 
-struct Sample;
-
 class Freq
 {
 	std::vector<float> floatData;
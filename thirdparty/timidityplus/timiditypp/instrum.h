@@ -25,6 +25,8 @@
 #define ___INSTRUM_H_
 
 #include <string>
+#include <vector>
+#include <memory>
 #include "common.h"
 #include "sysdep.h"
 #include "sffile.h"
@@ -87,6 +89,7 @@ struct Sample
 	double root_freq_detected;	/* root freq from pitch detection */
 	int transpose_detected;	/* note offset from detected root */
 	int chord;			/* type of chord for detected pitch */
+	int8_t pitch_detect_pending;	/* the three above have not been computed yet */
 };
 
 /* Bits in modes: */
@@ -235,6 +238,7 @@ class Instruments
 {
 	std::string configFileName;
     MusicIO::SoundFontReaderInterface *sfreader;
+	std::vector<std::string> sourceFiles;	// the config files and sound fonts that were read
 
 	ToneBank standard_tonebank, standard_drumset;
 
@@ -339,6 +343,7 @@ class Instruments
 	char def_instr_name[256] = { '\0' };
 	SFInsts *sfrecs = nullptr;
 	SFInsts *current_sfrec = nullptr;
+	std::vector<std::shared_ptr<const uint8_t>> sf_mappings;	/* kept until the instruments are freed */
 
 	int last_sample_type = 0;
 	int last_sample_instrument = 0;
@@ -395,8 +400,11 @@ class Instruments
 	SFInsts *find_soundfont(char *sf_file);
 	SFInsts *new_soundfont(char *sf_file);
 	void init_sf(SFInsts *rec);
+	void parse_presets(SFInsts *rec, int bank, int preset);
+	void free_presets(SFInsts *rec);
 	void end_soundfont(SFInsts *rec);
 	Instrument *try_load_soundfont(SFInsts *rec, int order, int bank, int preset, int keynote);
+	bool play_from_mapping(SFInsts *rec, SampleList *sp, Sample *sample);
 	Instrument *load_from_file(SFInsts *rec, InstList *ip);
 	int is_excluded(SFInsts *rec, int bank, int preset, int keynote);
 	int is_ordered(SFInsts *rec, int bank, int preset, int keynote);
@@ -466,6 +474,11 @@ public:
 	bool load(MusicIO::SoundFontReaderInterface *);
 	~Instruments();
 
+	const std::vector<std::string> &loadedFiles() const
+	{
+		return sourceFiles;
+	}
+
 	const ToneBank *toneBank(int i) const
 	{
 		return tonebank[i];
@@ -497,6 +510,7 @@ public:
 
 	/* instrum.c */
 	int load_missing_instruments(int *rc);
+	void detect_pending_pitches();
 	void free_instruments(int reload_default_inst);
 	void free_special_patch(int id);
 	void clear_magic_instruments(void);
@@ -26,6 +26,7 @@
 #define ___MIX_H_
 
 #include "resample.h"
+#include "voicefilter.h"
 
 namespace TimidityPlus
 {
@@ -36,10 +37,25 @@ class Player;
 
 class Mixer
 {
+	/* A filtered voice that has been resampled and waits for others to be
+	 * filtered together with, see mix_voice(). */
+	struct PendingVoice
+	{
+		int v;
+		int32_t *buf;
+		resample_t *sp;
+		int32_t count;
+	};
+
 	Player *player;
 	int32_t filter_buffer[AUDIO_BUFFER_SIZE];
+	/* one for each pending voice and one for the voices without a filter */
+	Resampler resamplers[VOICE_FILTER_LANES + 1];
+	PendingVoice pending[VOICE_FILTER_LANES];
+	int num_pending = 0;
 
-	int do_voice_filter(int, resample_t*, mix_t*, int32_t);
+	void finish_voice(resample_t *, int32_t *, int, int32_t);
+	void filter_voices(PendingVoice *, int);
 	void recalc_voice_resonance(int);
 	void recalc_voice_fc(int);
 	void ramp_out(mix_t *, int32_t *, int, int32_t);
@@ -62,10 +78,11 @@ class Mixer
 
 public:
 	Mixer(Player *p)
+		: player(p), resamplers{ p, p, p, p, p }
 	{
-		player = p;
 	}
 	void mix_voice(int32_t *, int, int32_t);
+	void flush_voices();
 	int recompute_envelope(int);
 	int apply_envelope_to_amp(int);
 	int recompute_modulation_envelope(int);
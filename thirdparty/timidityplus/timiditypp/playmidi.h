@@ -24,6 +24,8 @@
 #define ___PLAYMIDI_H_
 #include <stdint.h>
 
+class FWorkerGroup;
+
 namespace TimidityPlus
 {
 
@@ -508,10 +510,25 @@ class Recache;
 class Mixer;
 class Reverb;
 class Effect;
+struct VoiceWorker;
+
+enum
+{
+	MAX_VOICE_WORKERS = 8,
+};
+
+// Effect types selected by XG sysex messages, which later ones refer to.
+struct XGEffectTypes
+{
+	uint8_t reverb_msb = 0x01, reverb_lsb = 0x00;
+	uint8_t chorus_msb = 0x41, chorus_lsb = 0x00;
+};
 
 class Player
 {
 public:
+	PlayerSettings settings;	// only to be changed from the render thread.
+
 	Channel channel[MAX_CHANNELS];
 	Voice voice[max_voices];
 	ChannelBitMask default_drumchannel_mask;
@@ -529,6 +546,11 @@ private:
 	Reverb *reverb;
 	Effect *effect;
 
+	/* For rendering voices on several threads */
+	FWorkerGroup *voice_threads;
+	VoiceWorker *voice_workers[MAX_VOICE_WORKERS];
+	int num_voice_workers;
+	int8_t channel_worker[MAX_CHANNELS];
 
 	MidiEvent *current_event;
 	int32_t sample_count;	/* Length of event_list */
@@ -564,6 +586,20 @@ private:
 	struct midi_file_info midifileinfo, *current_file_info;
 	MBlockList playmidi_pool;
 	int32_t freq_table_user[4][48][128];
+	int32_t freq_table_tuning[128][128];
+
+	/* state of the multi-part tuning and temperament messages */
+	struct
+	{
+		int tp, kn, st;
+	} single_note_tuning;
+	struct
+	{
+		int tp, ll, fh, fl, bh, bl, aa, bb, cc, dd, ee, ff;
+		int ifmax, ibmax, count;
+		double rf[11], rb[11];
+	} user_temper;
+	XGEffectTypes xg_effect_types;
 	char *reverb_buffer; /* MAX_CHANNELS*AUDIO_BUFFER_SIZE*8 */
 
 	int32_t lost_notes, cut_notes;
@@ -647,6 +683,8 @@ private:
 	void mix_signal(int32_t *dest, int32_t *src, int32_t count);
 	int is_insertion_effect_xg(int ch);
 	void do_compute_data(int32_t count);
+	void mix_voices(Mixer *m, int32_t **vpblist, int32_t *dry, int channel_effect, int worker, int32_t count);
+	int assign_voice_workers(int uv);
 	int check_midi_play_end(MidiEvent *e, int len);
 	int midi_play_end(void);
 	void update_modulation_wheel(int ch);
@@ -711,6 +749,7 @@ public:
 	void play_midi_setup_drums(int ch, int note);
 
 	/* For stream player */
+	void precache_notes(const uint16_t *instrumentlist, int count);
 	void playmidi_stream_init(void);
 	void playmidi_tmr_reset(void);
 	int play_event(MidiEvent *ev);
@@ -732,8 +771,11 @@ class SysexConvert
 	const int midi_port_number = 0;
 	uint8_t rhythm_part[2] = { 0,0 };	/* for GS */
 	uint8_t drum_setup_xg[16] = { 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9 };	/* for XG */
+	XGEffectTypes &xg_effect_types;	/* owned by the player, because it must survive between messages */
 
 public:
+	SysexConvert(XGEffectTypes &xg) : xg_effect_types(xg) {}
+
 	int parse_sysex_event_multi(const uint8_t *val, int32_t len, MidiEvent *evm, Instruments *instruments);
 	int parse_sysex_event(const uint8_t *val, int32_t len, MidiEvent *ev, Instruments *instruments);
 };
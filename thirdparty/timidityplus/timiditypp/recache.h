@@ -22,6 +22,11 @@
 #define ___RECACHE_H_
 
 #include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 
 namespace TimidityPlus
 {
@@ -33,14 +38,56 @@ struct cache_hash
     int note;
     Sample *sp;
 
-    int32_t cnt;			/* counter */
-    double r;			/* size/refcnt */
+    int state;			/* CACHE_PENDING, CACHE_READY, ... */
+    int result;			/* state set by the worker, taken over on collection */
+    uint32_t last_use;		/* for LRU eviction */
+    size_t size;		/* bytes used by resampled */
     Sample *resampled;
+    Sample proto;		/* copy of *sp the worker resamples from */
     struct cache_hash *next;
 };
 
+/* Single producer, single consumer ring buffer. Neither side ever blocks. */
+template<class T, unsigned N> class CacheQueue
+{
+	T items[N];
+	std::atomic<unsigned> head{ 0 }, tail{ 0 };
+
+public:
+	bool empty() const
+	{
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+	bool push(T item)
+	{
+		unsigned t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N)
+			return false;
+		items[t % N] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &item)
+	{
+		unsigned h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = items[h % N];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+};
+
 class Player;
+class Instruments;
 
+/* Keeps notes resampled to the output rate so that they can be played without
+ * interpolation. The table belongs to the thread playing the song. Misses are
+ * resampled by a worker thread and handed back through a lock-free queue, so
+ * note-ons never wait for it. The memory used is capped by
+ * timidity_resample_cache, least recently used notes are dropped first. */
 class Recache
 {
 	Player *player;
@@ -53,55 +100,58 @@ class Recache
 		MIN_LOOPLEN = 1024,
 		MAX_EXPANDLEN = (1024 * 32),
 
-		CACHE_RESAMPLING_OK = 0,
-		CACHE_RESAMPLING_NOTOK = 1,
-		SORT_THRESHOLD = 20
+		QUEUE_SIZE = 256,
 	};
 
-	struct CNote 
+	enum
 	{
-		int32_t on[128];
-		struct cache_hash *cache[128];
+		CACHE_PENDING,
+		CACHE_READY,
+		CACHE_FAILED,	/* cannot be cached, not requested again */
+		CACHE_NO_ROOM,	/* did not fit into the budget */
 	};
 
-	CNote channel_note_table[MAX_CHANNELS];
-	sample_t *cache_data;
-	splen_t cache_data_len;
-	struct cache_hash *cache_hash_table[HASH_TABLE_SIZE];
-	MBlockList hash_entry_pool;
+	struct cache_hash *cache_hash_table[HASH_TABLE_SIZE] = {};
+	size_t budget;			/* in bytes, 0 disables the cache */
+	std::atomic<size_t> cache_used{ 0 };
+	uint32_t use_counter = 0;
+	int in_flight = 0;
+	std::vector<Sample *> playing;
 
+	CacheQueue<cache_hash *, QUEUE_SIZE> requests, results;
+	std::thread worker;
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	std::atomic<bool> quit{ false };
 
 	void free_cache_data(void);
-	double sample_resamp_info(Sample *, int, splen_t *, splen_t *, splen_t *);
-	void qsort_cache_array(struct cache_hash **, int32_t, int32_t);
-	void insort_cache_array(struct cache_hash **, int32_t);
-	int cache_resampling(struct cache_hash *);
-	void loop_connect(sample_t *, int32_t, int32_t);
+	bool is_cacheable(Sample *sp);
+	void request(Sample *sp, int note);
+	void collect_results(void);
+	void unlink_entry(struct cache_hash *p);
+	bool evict(size_t size);
+	static double sample_resamp_info(Sample *, int, splen_t *, splen_t *, splen_t *);
+	static void resample_to_output(Sample *sp, double a, sample_t *dest, splen_t newlen);
+	void cache_resampling(struct cache_hash *);
+	static void loop_connect(sample_t *, int32_t, int32_t);
+	void worker_loop(void);
 
 public:
 
-	Recache(Player *p)
-	{
-        memset(this, 0, sizeof(*this));
-		player = p;
-		resamp_cache_reset();
-	}
+	Recache(Player *p);
+	~Recache();
 
-	~Recache()
+	bool enabled() const
 	{
-		free_cache_data();
+		return budget > 0;
 	}
 
-	void resamp_cache_reset(void);
-	void resamp_cache_refer_on(Voice *vp, int32_t sample_start);
-	void resamp_cache_refer_off(int ch, int note, int32_t sample_end);
-	void resamp_cache_refer_alloff(int ch, int32_t sample_end);
-	void resamp_cache_create(void);
+	void resamp_cache_prefill(Instruments *instruments, const uint16_t *instrumentlist, int count);
 	struct cache_hash *resamp_cache_fetch(Sample *sp, int note);
 
-};
+	static bool pre_resample_looped(Sample *sp);
 
-const int32_t allocate_cache_size = DEFAULT_CACHE_DATA_SIZE;
+};
 
 }
 #endif /* ___RECACHE_H_ */
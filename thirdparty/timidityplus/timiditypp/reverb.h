@@ -563,9 +563,15 @@ class Reverb
 	int32_t chorus_effect_buffer[AUDIO_BUFFER_SIZE * 2];
 	int32_t eq_buffer[AUDIO_BUFFER_SIZE * 2];
 
+	/* set once a system effect was fed silence and its state has fully decayed */
+	int8_t reverb_idle, chorus_idle, delay_idle;
+	/* samples of silent input since the state was last checked */
+	int32_t reverb_quiet, chorus_quiet, delay_quiet;
 
 	static const struct _EffectEngine effect_engine[];
 
+	const PlayerSettings *settings;
+
 	void free_delay(simple_delay *delay);
 	void set_delay(simple_delay *delay, int32_t size);
 	void do_delay(int32_t *stream, int32_t *buf, int32_t size, int32_t *index);
@@ -633,6 +639,10 @@ class Reverb
 	void do_ch_cross_delay(int32_t *buf, int32_t count, InfoDelay3 *info);
 	void do_ch_normal_delay(int32_t *buf, int32_t count, InfoDelay3 *info);
 	void do_ch_stereo_chorus(int32_t *buf, int32_t count, InfoStereoChorus *info);
+	bool is_reverb_idle(void);
+	bool is_chorus_idle(void);
+	bool is_delay_idle(void);
+	bool idle_check_due(bool silent, int32_t count, int32_t *quiet);
 	void alloc_effect(EffectList *ef);
 	void do_eq2(int32_t *buf, int32_t count, EffectList *ef);
 	int32_t do_left_panning(int32_t sample, int32_t pan);
@@ -692,10 +702,11 @@ class Reverb
 	void do_xg_auto_wah_od(int32_t *buf, int32_t count, EffectList *ef);
 
 public:
-	Reverb()
+	Reverb(const PlayerSettings &s)
 	{
 		// Make sure that this starts out with all zeros.
 		memset(this, 0, sizeof(*this));
+		settings = &s;
 		REV_INP_LEV = 1.0;
 		direct_bufsize = sizeof(direct_buffer);
 		reverb_effect_bufsize = sizeof(reverb_effect_buffer);
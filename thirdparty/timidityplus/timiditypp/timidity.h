@@ -68,13 +68,6 @@
 #define MAX_DIE_TIME 20
 
 
-/* Define the pre-resampling cache size.
- * This value is default. You can change the cache saze with
- * command line option.
- */
-#define DEFAULT_CACHE_DATA_SIZE (2*1024*1024)
-
-
 /*****************************************************************************\
  section 2: some important definitions
 \*****************************************************************************/
@@ -126,24 +119,36 @@
 namespace TimidityPlus
 {
 
-extern FCriticalSection ConfigMutex;
-extern int timidity_modulation_wheel;
-extern int timidity_portamento;
-extern int timidity_reverb;
-extern int timidity_chorus;
-extern int timidity_surround_chorus;
-extern int timidity_channel_pressure;
-extern int timidity_lpf_de;
-extern int timidity_temper_control;
-extern int timidity_modulation_envelope;
-extern int timidity_overlap_voice_allow;
-extern int timidity_drum_effect;
-extern int timidity_pan_delay;
-extern float timidity_drum_power;
-extern int timidity_key_adjust;
-extern float timidity_tempo_adjust;
-extern float min_sustain_time;
-extern int timidity_lpf_def;
+// The settings a player works with. Each player has its own copy so that
+// several of them can render at the same time. New players start out with
+// the defaults, later changes get copied to a playing one from its render thread.
+struct PlayerSettings
+{
+	int timidity_modulation_wheel = true;
+	int timidity_portamento = false;
+	int timidity_reverb = 0;
+	int timidity_chorus = 0;
+	int timidity_surround_chorus = false;	// requires restart!
+	int timidity_channel_pressure = false;
+	int timidity_lpf_def = true;
+	int timidity_temper_control = true;
+	int timidity_modulation_envelope = true;
+	int timidity_overlap_voice_allow = true;
+	int timidity_drum_effect = false;
+	int timidity_pan_delay = false;
+	float timidity_drum_power = 1.f;
+	int timidity_key_adjust = 0;
+	float timidity_tempo_adjust = 1.f;
+	float min_sustain_time = 5000;
+	float timidity_voice_floor = 0;	// level, 1 being full scale, below which released and sustained voices get cut off. 0 is off.
+	int timidity_resample_cache = 0;	/* in kilobytes, requires restart! */
+	int timidity_threads = 1;	// requires restart!
+	int timidity_pre_resample = false;	// only affects instruments loaded afterward
+};
+
+extern FCriticalSection ConfigMutex;	// guards default_settings.
+extern PlayerSettings default_settings;
+PlayerSettings GetDefaultSettings();
 
 extern int32_t playback_rate;
 extern int32_t control_ratio;	// derived from playback_rate
@@ -0,0 +1,67 @@
+/*
+    TiMidity++ -- MIDI to WAVE converter and player
+    Copyright (C) 1999-2002 Masanao Izumo <mo@goice.co.jp>
+    Copyright (C) 1995 Tuukka Toivonen <tt@cgs.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    voicefilter.h
+
+    The voices' resonant lowpass filters, run for several voices at once.
+    Units compiled for a further instruction set include this, so it must
+    not define any inline functions (see source/zmusic/cpufeatures.h).
+*/
+
+#ifndef ___VOICEFILTER_H_
+#define ___VOICEFILTER_H_
+
+#include <stdint.h>
+
+namespace TimidityPlus
+{
+
+enum
+{
+	VOICE_FILTER_LANES = 4,
+};
+
+/* Up to VOICE_FILTER_LANES voices that use the same filter type, one per
+ * lane. Each lane's data is filtered in place. A lane with a count of 0 is
+ * left alone, but its data must still point to AUDIO_BUFFER_SIZE samples
+ * that may be overwritten. The coefficients and state are those of
+ * FilterCoefficients, the Chamberlin filter does not use p, b3 and b4. */
+struct VoiceFilterLanes
+{
+	int32_t *data[VOICE_FILTER_LANES];
+	int32_t count[VOICE_FILTER_LANES];
+	int32_t f[VOICE_FILTER_LANES], q[VOICE_FILTER_LANES], p[VOICE_FILTER_LANES];
+	int32_t b0[VOICE_FILTER_LANES], b1[VOICE_FILTER_LANES], b2[VOICE_FILTER_LANES];
+	int32_t b3[VOICE_FILTER_LANES], b4[VOICE_FILTER_LANES];
+};
+
+typedef void (*VoiceFilterFunc)(VoiceFilterLanes *lanes);
+
+/* These give the same results on every CPU. */
+void chamberlin_filter_lanes(VoiceFilterLanes *lanes);
+void moog_filter_lanes(VoiceFilterLanes *lanes);
+
+/* The versions for each instruction set, only for voicefilter*.cpp */
+void chamberlin_filter_lanes_base(VoiceFilterLanes *lanes);
+void moog_filter_lanes_base(VoiceFilterLanes *lanes);
+void chamberlin_filter_lanes_sse41(VoiceFilterLanes *lanes);
+void moog_filter_lanes_sse41(VoiceFilterLanes *lanes);
+
+}
+#endif /* ___VOICEFILTER_H_ */
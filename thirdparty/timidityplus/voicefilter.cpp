@@ -0,0 +1,104 @@
+/*
+    TiMidity++ -- MIDI to WAVE converter and player
+    Copyright (C) 1999-2002 Masanao Izumo <mo@goice.co.jp>
+    Copyright (C) 1995 Tuukka Toivonen <tt@cgs.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    voicefilter.cpp
+
+    The voices' resonant lowpass filters, one voice after the other.
+*/
+
+#include "optcode.h"
+#include "voicefilter.h"
+#include "../../source/zmusic/cpufeatures.h"
+
+namespace TimidityPlus
+{
+
+/* Chamberlin's lowpass filter */
+void chamberlin_filter_lanes_base(VoiceFilterLanes *lanes)
+{
+	int32_t i, l, f, q, b0, b1, b2, *sp;
+
+	for (l = 0; l < VOICE_FILTER_LANES; l++) {
+		if (lanes->count[l] <= 0)
+			continue;
+		sp = lanes->data[l];
+		f = lanes->f[l], q = lanes->q[l];
+		b0 = lanes->b0[l], b1 = lanes->b1[l], b2 = lanes->b2[l];
+		for (i = 0; i < lanes->count[l]; i++) {
+			b0 = b0 + imuldiv24(b2, f);
+			b1 = sp[i] - b0 - imuldiv24(b2, q);
+			b2 = imuldiv24(b1, f) + b2;
+			sp[i] = b0;
+		}
+		lanes->b0[l] = b0, lanes->b1[l] = b1, lanes->b2[l] = b2;
+	}
+}
+
+/* Moog lowpass VCF */
+void moog_filter_lanes_base(VoiceFilterLanes *lanes)
+{
+	int32_t i, l, f, q, p, b0, b1, b2, b3, b4, t1, t2, x, *sp;
+
+	for (l = 0; l < VOICE_FILTER_LANES; l++) {
+		if (lanes->count[l] <= 0)
+			continue;
+		sp = lanes->data[l];
+		f = lanes->f[l], q = lanes->q[l], p = lanes->p[l];
+		b0 = lanes->b0[l], b1 = lanes->b1[l], b2 = lanes->b2[l],
+			b3 = lanes->b3[l], b4 = lanes->b4[l];
+		for (i = 0; i < lanes->count[l]; i++) {
+			x = sp[i] - imuldiv24(q, b4);	/* feedback */
+			t1 = b1;  b1 = imuldiv24(x + b0, p) - imuldiv24(b1, f);
+			t2 = b2;  b2 = imuldiv24(b1 + t1, p) - imuldiv24(b2, f);
+			t1 = b3;  b3 = imuldiv24(b2 + t2, p) - imuldiv24(b3, f);
+			sp[i] = b4 = imuldiv24(b3 + t1, p) - imuldiv24(b4, f);
+			b0 = x;
+		}
+		lanes->b0[l] = b0, lanes->b1[l] = b1, lanes->b2[l] = b2,
+			lanes->b3[l] = b3, lanes->b4[l] = b4;
+	}
+}
+
+static const TCPUDispatch<VoiceFilterFunc> ChamberlinFilterLanes =
+{
+#ifdef ZMUSIC_ISA_SSE41
+	{ CPU_SSE41, chamberlin_filter_lanes_sse41 },
+#endif
+	{ 0, chamberlin_filter_lanes_base },
+};
+
+static const TCPUDispatch<VoiceFilterFunc> MoogFilterLanes =
+{
+#ifdef ZMUSIC_ISA_SSE41
+	{ CPU_SSE41, moog_filter_lanes_sse41 },
+#endif
+	{ 0, moog_filter_lanes_base },
+};
+
+void chamberlin_filter_lanes(VoiceFilterLanes *lanes)
+{
+	ChamberlinFilterLanes.Get()(lanes);
+}
+
+void moog_filter_lanes(VoiceFilterLanes *lanes)
+{
+	MoogFilterLanes.Get()(lanes);
+}
+
+}
@@ -0,0 +1,189 @@
+/*
+    TiMidity++ -- MIDI to WAVE converter and player
+    Copyright (C) 1999-2002 Masanao Izumo <mo@goice.co.jp>
+    Copyright (C) 1995 Tuukka Toivonen <tt@cgs.fi>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    voicefilter_sse41.cpp
+
+    The voices' resonant lowpass filters with one voice in each lane of an
+    SSE register. The filters are recursive, so a single voice cannot be
+    split up, but four of them run in about the time of one.
+
+    Compiled with SSE4.1 enabled, so nothing here may run before
+    ZMusic_CPUFeatures reported CPU_SSE41.
+*/
+
+#include <smmintrin.h>
+#include "voicefilter.h"
+
+namespace TimidityPlus
+{
+
+/* imuldiv24 in every lane. Only bits 24 to 55 of the products are kept, so
+ * a logical shift gives the same result as the arithmetic one. */
+static inline __m128i mul24(__m128i a, __m128i b)
+{
+	__m128i even = _mm_srli_epi64(_mm_mul_epi32(a, b), 24);
+	__m128i odd = _mm_slli_epi64(_mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)), 8);
+	return _mm_blend_epi16(even, odd, 0xcc);
+}
+
+static inline void transpose(__m128i &r0, __m128i &r1, __m128i &r2, __m128i &r3)
+{
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+	__m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+	r0 = _mm_unpacklo_epi64(t0, t1);
+	r1 = _mm_unpackhi_epi64(t0, t1);
+	r2 = _mm_unpacklo_epi64(t2, t3);
+	r3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+static inline __m128i load_lanes(const int32_t *v)
+{
+	return _mm_loadu_si128((const __m128i *)v);
+}
+
+/* The number of samples all lanes that have any can be run for together,
+ * or 0 if fewer than two lanes have samples. */
+static int32_t common_count(const VoiceFilterLanes *lanes)
+{
+	int32_t n = 0, active = 0;
+
+	for (int l = 0; l < VOICE_FILTER_LANES; l++) {
+		if (lanes->count[l] <= 0)
+			continue;
+		n = active++ ? (lanes->count[l] < n ? lanes->count[l] : n) : lanes->count[l];
+	}
+	return active >= 2 ? n & ~3 : 0;
+}
+
+/* Writes back the state of the lanes that had samples. */
+static void store_lanes(const VoiceFilterLanes *lanes, int32_t *dst, __m128i v)
+{
+	alignas(16) int32_t tmp[VOICE_FILTER_LANES];
+
+	_mm_store_si128((__m128i *)tmp, v);
+	for (int l = 0; l < VOICE_FILTER_LANES; l++) {
+		if (lanes->count[l] > 0)
+			dst[l] = tmp[l];
+	}
+}
+
+/* Moves the lanes that had samples past the n filtered ones, for the base
+ * version to finish. */
+static void advance_lanes(VoiceFilterLanes *lanes, int32_t n)
+{
+	for (int l = 0; l < VOICE_FILTER_LANES; l++) {
+		if (lanes->count[l] > 0) {
+			lanes->data[l] += n;
+			lanes->count[l] -= n;
+		}
+	}
+}
+
+void chamberlin_filter_lanes_sse41(VoiceFilterLanes *lanes)
+{
+	int32_t i, n = common_count(lanes);
+
+	if (n > 0) {
+		int32_t *d0 = lanes->data[0], *d1 = lanes->data[1], *d2 = lanes->data[2], *d3 = lanes->data[3];
+		__m128i f = load_lanes(lanes->f), q = load_lanes(lanes->q);
+		__m128i b0 = load_lanes(lanes->b0), b1 = load_lanes(lanes->b1), b2 = load_lanes(lanes->b2);
+
+		for (i = 0; i < n; i += 4) {
+			/* one register per sample, one lane per voice */
+			__m128i s0 = _mm_loadu_si128((const __m128i *)(d0 + i));
+			__m128i s1 = _mm_loadu_si128((const __m128i *)(d1 + i));
+			__m128i s2 = _mm_loadu_si128((const __m128i *)(d2 + i));
+			__m128i s3 = _mm_loadu_si128((const __m128i *)(d3 + i));
+			transpose(s0, s1, s2, s3);
+
+#define CHAMBERLIN_STEP(s) \
+			b0 = _mm_add_epi32(b0, mul24(b2, f)); \
+			b1 = _mm_sub_epi32(_mm_sub_epi32(s, b0), mul24(b2, q)); \
+			b2 = _mm_add_epi32(mul24(b1, f), b2); \
+			s = b0;
+
+			CHAMBERLIN_STEP(s0)
+			CHAMBERLIN_STEP(s1)
+			CHAMBERLIN_STEP(s2)
+			CHAMBERLIN_STEP(s3)
+#undef CHAMBERLIN_STEP
+
+			transpose(s0, s1, s2, s3);
+			_mm_storeu_si128((__m128i *)(d0 + i), s0);
+			_mm_storeu_si128((__m128i *)(d1 + i), s1);
+			_mm_storeu_si128((__m128i *)(d2 + i), s2);
+			_mm_storeu_si128((__m128i *)(d3 + i), s3);
+		}
+		store_lanes(lanes, lanes->b0, b0);
+		store_lanes(lanes, lanes->b1, b1);
+		store_lanes(lanes, lanes->b2, b2);
+		advance_lanes(lanes, n);
+	}
+	chamberlin_filter_lanes_base(lanes);
+}
+
+void moog_filter_lanes_sse41(VoiceFilterLanes *lanes)
+{
+	int32_t i, n = common_count(lanes);
+
+	if (n > 0) {
+		int32_t *d0 = lanes->data[0], *d1 = lanes->data[1], *d2 = lanes->data[2], *d3 = lanes->data[3];
+		__m128i f = load_lanes(lanes->f), q = load_lanes(lanes->q), p = load_lanes(lanes->p);
+		__m128i b0 = load_lanes(lanes->b0), b1 = load_lanes(lanes->b1), b2 = load_lanes(lanes->b2);
+		__m128i b3 = load_lanes(lanes->b3), b4 = load_lanes(lanes->b4);
+		__m128i x, t1, t2;
+
+		for (i = 0; i < n; i += 4) {
+			__m128i s0 = _mm_loadu_si128((const __m128i *)(d0 + i));
+			__m128i s1 = _mm_loadu_si128((const __m128i *)(d1 + i));
+			__m128i s2 = _mm_loadu_si128((const __m128i *)(d2 + i));
+			__m128i s3 = _mm_loadu_si128((const __m128i *)(d3 + i));
+			transpose(s0, s1, s2, s3);
+
+#define MOOG_STEP(s) \
+			x = _mm_sub_epi32(s, mul24(q, b4)); \
+			t1 = b1;  b1 = _mm_sub_epi32(mul24(_mm_add_epi32(x, b0), p), mul24(b1, f)); \
+			t2 = b2;  b2 = _mm_sub_epi32(mul24(_mm_add_epi32(b1, t1), p), mul24(b2, f)); \
+			t1 = b3;  b3 = _mm_sub_epi32(mul24(_mm_add_epi32(b2, t2), p), mul24(b3, f)); \
+			s = b4 = _mm_sub_epi32(mul24(_mm_add_epi32(b3, t1), p), mul24(b4, f)); \
+			b0 = x;
+
+			MOOG_STEP(s0)
+			MOOG_STEP(s1)
+			MOOG_STEP(s2)
+			MOOG_STEP(s3)
+#undef MOOG_STEP
+
+			transpose(s0, s1, s2, s3);
+			_mm_storeu_si128((__m128i *)(d0 + i), s0);
+			_mm_storeu_si128((__m128i *)(d1 + i), s1);
+			_mm_storeu_si128((__m128i *)(d2 + i), s2);
+			_mm_storeu_si128((__m128i *)(d3 + i), s3);
+		}
+		store_lanes(lanes, lanes->b0, b0);
+		store_lanes(lanes, lanes->b1, b1);
+		store_lanes(lanes, lanes->b2, b2);
+		store_lanes(lanes, lanes->b3, b3);
+		store_lanes(lanes, lanes->b4, b4);
+		advance_lanes(lanes, n);
+	}
+	moog_filter_lanes_base(lanes);
+}
+
+}
@@ -756,8 +756,16 @@ static int convert_16urp(unsigned char *data, struct _sample *gus_sample) {
 
 struct _sample * Instruments::load_gus_pat(const char *filename)
 {
-	unsigned char *gus_patch;
-	unsigned long int gus_size;
+	unsigned long int gus_size = 0;
+	unsigned char *gus_patch = _WM_BufferFile(sfreader, filename, &gus_size);
+	return parse_gus_pat(filename, gus_patch, gus_size);
+}
+
+/* Converts a patch file that has already been read into memory and frees
+   the buffer. Only the new samples are written to, so this may run for
+   several patches at once. */
+struct _sample * Instruments::parse_gus_pat(const char *filename, unsigned char *gus_patch, unsigned long int gus_size)
+{
 	unsigned long int gus_ptr;
 	unsigned char no_of_samples;
 	struct _sample *gus_sample = NULL;
@@ -786,7 +794,7 @@ struct _sample * Instruments::load_gus_pat(const char *filename)
 
 	SAMPLE_CONVERT_DEBUG(__FUNCTION__); SAMPLE_CONVERT_DEBUG(filename);
 
-	if ((gus_patch = _WM_BufferFile(sfreader, filename, &gus_size)) == NULL) {
+	if (gus_patch == NULL) {
 		return NULL;
 	}
 	if (gus_size < 239) {
@@ -28,6 +28,14 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WM_REVERB_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define WM_REVERB_NEON
+#include <arm_neon.h>
+#endif
 
 #include "common.h"
 #include "reverb.h"
@@ -38,23 +46,17 @@ namespace WildMidi
  reverb function
  */
 void _WM_reset_reverb(struct _rvb *rvb) {
-	int i, j, k;
+	int i;
 	for (i = 0; i < rvb->l_buf_size; i++) {
 		rvb->l_buf[i] = 0;
 	}
 	for (i = 0; i < rvb->r_buf_size; i++) {
 		rvb->r_buf[i] = 0;
 	}
-	for (k = 0; k < 8; k++) {
-		for (i = 0; i < 6; i++) {
-			for (j = 0; j < 2; j++) {
-				rvb->l_buf_flt_in[k][i][j] = 0;
-				rvb->l_buf_flt_out[k][i][j] = 0;
-				rvb->r_buf_flt_in[k][i][j] = 0;
-				rvb->r_buf_flt_out[k][i][j] = 0;
-			}
-		}
-	}
+	memset(rvb->l_buf_flt_in, 0, sizeof(rvb->l_buf_flt_in));
+	memset(rvb->l_buf_flt_out, 0, sizeof(rvb->l_buf_flt_out));
+	memset(rvb->r_buf_flt_in, 0, sizeof(rvb->r_buf_flt_in));
+	memset(rvb->r_buf_flt_out, 0, sizeof(rvb->r_buf_flt_out));
 }
 
 /*
@@ -271,11 +273,11 @@ _WM_init_reverb(int rate, float room_x, float room_y, float listen_x,
 			double a1 = -2 * cs;
 			double a2 = 1 - (alpha / A);
 
-			rtn_rvb->coeff[j][i][0] = (signed int) ((b0 / a0) * 1024.0);
-			rtn_rvb->coeff[j][i][1] = (signed int) ((b1 / a0) * 1024.0);
-			rtn_rvb->coeff[j][i][2] = (signed int) ((b2 / a0) * 1024.0);
-			rtn_rvb->coeff[j][i][3] = (signed int) ((a1 / a0) * 1024.0);
-			rtn_rvb->coeff[j][i][4] = (signed int) ((a2 / a0) * 1024.0);
+			rtn_rvb->coeff[0][j * 6 + i] = (signed int) ((b0 / a0) * 1024.0);
+			rtn_rvb->coeff[1][j * 6 + i] = (signed int) ((b1 / a0) * 1024.0);
+			rtn_rvb->coeff[2][j * 6 + i] = (signed int) ((b2 / a0) * 1024.0);
+			rtn_rvb->coeff[3][j * 6 + i] = (signed int) ((a1 / a0) * 1024.0);
+			rtn_rvb->coeff[4][j * 6 + i] = (signed int) ((a2 / a0) * 1024.0);
 		}
 	}
 
@@ -315,10 +317,128 @@ void _WM_free_reverb(struct _rvb *rvb) {
 	free(rvb);
 }
 
+/*
+ run the filter bank of one side for a single input value
+
+ Every filter computes
+   out = (in * c0 + in[-1] * c1 + in[-2] * c2 - out[-1] * c3 - out[-2] * c4) / 1024
+ and adds out / 8 to the result. The vector versions give exactly the same
+ result as the plain loop, including the rounding of the divisions.
+ */
+#if defined(WM_REVERB_SSE2)
+
+static inline __m128i mullo_epi32(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* signed division by 1 << shift, rounding towards zero like '/' does */
+#define DIV_POW2(x, shift) _mm_srai_epi32(_mm_add_epi32((x), _mm_srli_epi32(_mm_srai_epi32((x), 31), 32 - (shift))), (shift))
+
+static signed int do_filters(const signed int (*coeff)[RVB_FILTERS], signed int *flt_in, signed int (*flt_out)[RVB_FILTERS], signed int rfl) {
+	__m128i in0 = _mm_set1_epi32(rfl);
+	__m128i in1 = _mm_set1_epi32(flt_in[0]);
+	__m128i in2 = _mm_set1_epi32(flt_in[1]);
+	__m128i sum = _mm_setzero_si128();
+	int i;
+
+	for (i = 0; i < RVB_FILTERS; i += 4) {
+		__m128i out1 = _mm_loadu_si128((const __m128i *)&flt_out[0][i]);
+		__m128i out2 = _mm_loadu_si128((const __m128i *)&flt_out[1][i]);
+		__m128i acc = mullo_epi32(in0, _mm_loadu_si128((const __m128i *)&coeff[0][i]));
+		acc = _mm_add_epi32(acc, mullo_epi32(in1, _mm_loadu_si128((const __m128i *)&coeff[1][i])));
+		acc = _mm_add_epi32(acc, mullo_epi32(in2, _mm_loadu_si128((const __m128i *)&coeff[2][i])));
+		acc = _mm_sub_epi32(acc, mullo_epi32(out1, _mm_loadu_si128((const __m128i *)&coeff[3][i])));
+		acc = _mm_sub_epi32(acc, mullo_epi32(out2, _mm_loadu_si128((const __m128i *)&coeff[4][i])));
+		acc = DIV_POW2(acc, 10);
+		_mm_storeu_si128((__m128i *)&flt_out[1][i], out1);
+		_mm_storeu_si128((__m128i *)&flt_out[0][i], acc);
+		sum = _mm_add_epi32(sum, DIV_POW2(acc, 3));
+	}
+	flt_in[1] = flt_in[0];
+	flt_in[0] = rfl;
+
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(sum);
+}
+
+#undef DIV_POW2
+
+#elif defined(WM_REVERB_NEON)
+
+static inline int32x4_t div_pow2_10(int32x4_t x) {
+	return vshrq_n_s32(vaddq_s32(x, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(x, 31)), 22))), 10);
+}
+
+static inline int32x4_t div_pow2_3(int32x4_t x) {
+	return vshrq_n_s32(vaddq_s32(x, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(x, 31)), 29))), 3);
+}
+
+static signed int do_filters(const signed int (*coeff)[RVB_FILTERS], signed int *flt_in, signed int (*flt_out)[RVB_FILTERS], signed int rfl) {
+	int32x4_t in0 = vdupq_n_s32(rfl);
+	int32x4_t in1 = vdupq_n_s32(flt_in[0]);
+	int32x4_t in2 = vdupq_n_s32(flt_in[1]);
+	int32x4_t sum = vdupq_n_s32(0);
+	int32x2_t half;
+	int i;
+
+	for (i = 0; i < RVB_FILTERS; i += 4) {
+		int32x4_t out1 = vld1q_s32(&flt_out[0][i]);
+		int32x4_t out2 = vld1q_s32(&flt_out[1][i]);
+		int32x4_t acc = vmulq_s32(in0, vld1q_s32(&coeff[0][i]));
+		acc = vmlaq_s32(acc, in1, vld1q_s32(&coeff[1][i]));
+		acc = vmlaq_s32(acc, in2, vld1q_s32(&coeff[2][i]));
+		acc = vmlsq_s32(acc, out1, vld1q_s32(&coeff[3][i]));
+		acc = vmlsq_s32(acc, out2, vld1q_s32(&coeff[4][i]));
+		acc = div_pow2_10(acc);
+		vst1q_s32(&flt_out[1][i], out1);
+		vst1q_s32(&flt_out[0][i], acc);
+		sum = vaddq_s32(sum, div_pow2_3(acc));
+	}
+	flt_in[1] = flt_in[0];
+	flt_in[0] = rfl;
+
+	half = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+	return vget_lane_s32(vpadd_s32(half, half), 0);
+}
+
+#else
+
+static signed int do_filters(const signed int (*coeff)[RVB_FILTERS], signed int *flt_in, signed int (*flt_out)[RVB_FILTERS], signed int rfl) {
+	signed int sum = 0;
+	int i;
+
+	for (i = 0; i < RVB_FILTERS; i++) {
+		signed int buf_flt = ((rfl * coeff[0][i])
+				+ (flt_in[0] * coeff[1][i])
+				+ (flt_in[1] * coeff[2][i])
+				- (flt_out[0][i] * coeff[3][i])
+				- (flt_out[1][i] * coeff[4][i]))
+				/ 1024;
+		flt_out[1][i] = flt_out[0][i];
+		flt_out[0][i] = buf_flt;
+		sum += buf_flt / 8;
+	}
+	flt_in[1] = flt_in[0];
+	flt_in[0] = rfl;
+	return sum;
+}
+
+#endif
+
+/* advance a position in one of the delay buffers. Some of the
+ * start positions are one past the end, so this must not simply wrap to 0 */
+static inline int next_pos(int pos, int size) {
+	pos++;
+	if (pos >= size) pos -= size;
+	return pos;
+}
+
 void _WM_do_reverb(struct _rvb *rvb, signed int *buffer, int size) {
-	int i, j, k;
-	signed int l_buf_flt = 0;
-	signed int r_buf_flt = 0;
+	int i, j;
 	signed int l_rfl = 0;
 	signed int r_rfl = 0;
 	int vol_div = 64;
@@ -334,14 +454,14 @@ void _WM_do_reverb(struct _rvb *rvb, signed int *buffer, int size) {
 		tmp_r_val = buffer[i + 1] / vol_div;
 		for (j = 0; j < 4; j++) {
 			rvb->l_buf[rvb->l_sp_in[j]] += tmp_l_val;
-			rvb->l_sp_in[j] = (rvb->l_sp_in[j] + 1) % rvb->l_buf_size;
+			rvb->l_sp_in[j] = next_pos(rvb->l_sp_in[j], rvb->l_buf_size);
 			rvb->l_buf[rvb->r_sp_in[j]] += tmp_r_val;
-			rvb->r_sp_in[j] = (rvb->r_sp_in[j] + 1) % rvb->l_buf_size;
+			rvb->r_sp_in[j] = next_pos(rvb->r_sp_in[j], rvb->l_buf_size);
 
 			rvb->r_buf[rvb->l_sp_in[j + 4]] += tmp_l_val;
-			rvb->l_sp_in[j + 4] = (rvb->l_sp_in[j + 4] + 1) % rvb->r_buf_size;
+			rvb->l_sp_in[j + 4] = next_pos(rvb->l_sp_in[j + 4], rvb->r_buf_size);
 			rvb->r_buf[rvb->r_sp_in[j + 4]] += tmp_r_val;
-			rvb->r_sp_in[j + 4] = (rvb->r_sp_in[j + 4] + 1) % rvb->r_buf_size;
+			rvb->r_sp_in[j + 4] = next_pos(rvb->r_sp_in[j + 4], rvb->r_buf_size);
 		}
 
 		/*
@@ -349,39 +469,14 @@ void _WM_do_reverb(struct _rvb *rvb, signed int *buffer, int size) {
 		 */
 		l_rfl = rvb->l_buf[rvb->l_out];
 		rvb->l_buf[rvb->l_out] = 0;
-		rvb->l_out = (rvb->l_out + 1) % rvb->l_buf_size;
+		rvb->l_out = next_pos(rvb->l_out, rvb->l_buf_size);
 
 		r_rfl = rvb->r_buf[rvb->r_out];
 		rvb->r_buf[rvb->r_out] = 0;
-		rvb->r_out = (rvb->r_out + 1) % rvb->r_buf_size;
-
-		for (k = 0; k < 8; k++) {
-			for (j = 0; j < 6; j++) {
-				l_buf_flt = ((l_rfl * rvb->coeff[k][j][0])
-						+ (rvb->l_buf_flt_in[k][j][0] * rvb->coeff[k][j][1])
-						+ (rvb->l_buf_flt_in[k][j][1] * rvb->coeff[k][j][2])
-						- (rvb->l_buf_flt_out[k][j][0] * rvb->coeff[k][j][3])
-						- (rvb->l_buf_flt_out[k][j][1] * rvb->coeff[k][j][4]))
-						/ 1024;
-				rvb->l_buf_flt_in[k][j][1] = rvb->l_buf_flt_in[k][j][0];
-				rvb->l_buf_flt_in[k][j][0] = l_rfl;
-				rvb->l_buf_flt_out[k][j][1] = rvb->l_buf_flt_out[k][j][0];
-				rvb->l_buf_flt_out[k][j][0] = l_buf_flt;
-				buffer[i] += l_buf_flt / 8;
-
-				r_buf_flt = ((r_rfl * rvb->coeff[k][j][0])
-						+ (rvb->r_buf_flt_in[k][j][0] * rvb->coeff[k][j][1])
-						+ (rvb->r_buf_flt_in[k][j][1] * rvb->coeff[k][j][2])
-						- (rvb->r_buf_flt_out[k][j][0] * rvb->coeff[k][j][3])
-						- (rvb->r_buf_flt_out[k][j][1] * rvb->coeff[k][j][4]))
-						/ 1024;
-				rvb->r_buf_flt_in[k][j][1] = rvb->r_buf_flt_in[k][j][0];
-				rvb->r_buf_flt_in[k][j][0] = r_rfl;
-				rvb->r_buf_flt_out[k][j][1] = rvb->r_buf_flt_out[k][j][0];
-				rvb->r_buf_flt_out[k][j][0] = r_buf_flt;
-				buffer[i + 1] += r_buf_flt / 8;
-			}
-		}
+		rvb->r_out = next_pos(rvb->r_out, rvb->r_buf_size);
+
+		buffer[i] += do_filters(rvb->coeff, rvb->l_buf_flt_in, rvb->l_buf_flt_out, l_rfl);
+		buffer[i + 1] += do_filters(rvb->coeff, rvb->r_buf_flt_in, rvb->r_buf_flt_out, r_rfl);
 
 		/*
 		 add filtered result back into the buffers but on the opposite side
@@ -390,10 +485,10 @@ void _WM_do_reverb(struct _rvb *rvb, signed int *buffer, int size) {
 		tmp_r_val = buffer[i] / vol_div;
 		for (j = 0; j < 4; j++) {
 			rvb->l_buf[rvb->l_in[j]] += tmp_l_val;
-			rvb->l_in[j] = (rvb->l_in[j] + 1) % rvb->l_buf_size;
+			rvb->l_in[j] = next_pos(rvb->l_in[j], rvb->l_buf_size);
 
 			rvb->r_buf[rvb->r_in[j]] += tmp_r_val;
-			rvb->r_in[j] = (rvb->r_in[j] + 1) % rvb->r_buf_size;
+			rvb->r_in[j] = next_pos(rvb->r_in[j], rvb->r_buf_size);
 		}
 	}
 }
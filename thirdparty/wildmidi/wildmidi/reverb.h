@@ -30,13 +30,18 @@
 namespace WildMidi
 {
 
+/* one filter per reflective point and band */
+#define RVB_FILTERS (8 * 6)
+
 struct _rvb {
-	/* filter data */
-	signed int l_buf_flt_in[8][6][2];
-	signed int l_buf_flt_out[8][6][2];
-	signed int r_buf_flt_in[8][6][2];
-	signed int r_buf_flt_out[8][6][2];
-	signed int coeff[8][6][5];
+	/* filter data, stored by filter so several can be run at once.
+	 * All filters of a side are fed the same input, so only the
+	 * outputs have a history of their own. */
+	signed int l_buf_flt_in[2];
+	signed int l_buf_flt_out[2][RVB_FILTERS];
+	signed int r_buf_flt_in[2];
+	signed int r_buf_flt_out[2][RVB_FILTERS];
+	signed int coeff[5][RVB_FILTERS];
 	/* buffer data */
 	signed int *l_buf;
 	signed int *r_buf;
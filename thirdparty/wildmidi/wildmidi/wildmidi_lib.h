@@ -29,6 +29,8 @@
 
 #include "../../../source/zmusic/fileio.h"
 #include <stdarg.h>
+#include <mutex>
+#include <vector>
 
 namespace WildMidi
 {
@@ -81,14 +83,29 @@ struct Instruments
 	~Instruments();
 	
 	int LoadConfig(const char *config_file);
+	void SetPatchCache(unsigned long int bytes);
+	unsigned long int ReleaseUnusedPatches();	// returns the bytes freed.
 	int load_sample(struct _patch *sample_patch);
+	int setup_sample(struct _patch *sample_patch, struct _sample *guspat);
 	struct _patch *get_patch_data(unsigned short patchid);
 	void load_patch(struct _mdi *mdi, unsigned short patchid);
+	void load_patches(struct _mdi *mdi, const unsigned short *patchids, int count);
+	void release_patch(struct _patch *sample_patch);
 	int GetSampleRate() { return _WM_SampleRate; }
 	struct _sample * load_gus_pat(const char *filename);
+	struct _sample * parse_gus_pat(const char *filename, unsigned char *gus_patch, unsigned long int gus_size);
 
 private:
+	/* Patches no song uses any longer stay loaded up to this many bytes,
+	 * so that the next song does not have to read them again. */
+	unsigned long int patch_cache_limit = 0;
+	unsigned long int patch_cache_size = 0;
+	std::vector<struct _patch *> unused_patches;	// oldest first
+	std::mutex patch_mutex;
+
 	void FreePatches(void);
+	void claim_patch(struct _patch *sample_patch);
+	void trim_patch_cache(unsigned long int limit);
 };
 
 const char * WildMidi_GetString (unsigned short int info);
@@ -110,8 +127,10 @@ public:
 	void LongEvent(const unsigned char *data, int len);
 	void ComputeOutput(float *buffer, int len);
 	void LoadInstrument(int bank, int percussion, int instr);
+	void LoadInstruments(const uint16_t *list, int count);	// packed as for MIDIDevice::PrecacheInstruments
 	int GetVoiceCount();
 	int SetOption(int opt, int set);
+	void SetVoiceFloor(float level);	// 1 being full scale, 0 to turn it off.
 	
 	void SetMasterVolume(unsigned char master_volume);
 	midi * NewMidi();
@@ -38,6 +38,14 @@
 #include <stdlib.h>
 #include <memory>
 #include <algorithm>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WM_MIX_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define WM_MIX_NEON
+#include <arm_neon.h>
+#endif
 
 #include "common.h"
 #include "wm_error.h"
@@ -45,6 +53,8 @@
 #include "reverb.h"
 #include "gus_pat.h"
 #include "wildmidi_lib.h"
+#include "../../source/zmusic/parallel.h"
+#include "../../source/zmusic/memusage.h"
 
 namespace WildMidi
 {
@@ -131,6 +141,7 @@ struct _mdi {
 		mix_buffer = NULL;
 		mix_buffer_size = 0;
 		reverb = NULL;
+		voice_floor = 0;
 	}
 
 	unsigned long int samples_to_mix;
@@ -150,6 +161,10 @@ struct _mdi {
 	unsigned long int mix_buffer_size;
 
 	struct _rvb *reverb;
+
+	/* env_level times mix volume below which released and held notes get
+	   faded out early, 0 to let them play to their end. */
+	signed long long int voice_floor;
 };
 
 #define FPBITS 10
@@ -157,10 +172,10 @@ struct _mdi {
 
 /* Gauss Interpolation code adapted from code supplied by Eric. A. Welsh */
 static double newt_coeffs[58][58];	/* for start/end of samples */
-static std::vector<double> gauss_table;	/* *gauss_table[1<<FPBITS] */
+static std::vector<float> gauss_table;	/* *gauss_table[1<<FPBITS], floats are precise enough */
 static const int gauss_n = 34;	/* 34 is as high as we can go before errors crop up */
 
-static void init_gauss(void) {
+static bool init_gauss(void) {
 	/* init gauss table */
 	int n = gauss_n;
 	int m, i, k, n_half = (n >> 1);
@@ -169,11 +184,7 @@ static void init_gauss(void) {
 	double ck;
 	double x, x_inc, xz;
 	double z[35];
-	double *gptr, *t;
-
-	if (gauss_table.size()) {
-		return;
-	}
+	float *gptr, *t;
 
 	newt_coeffs[0][0] = 1;
 	for (i = 0; i <= n; i++) {
@@ -214,9 +225,10 @@ static void init_gauss(void) {
 
 				ck *= (sin(xz - z[i])) / (sin(z[k] - z[i]));
 			}
-			*gptr++ = ck;
+			*gptr++ = (float)ck;
 		}
 	}
+	return true;
 }
 
 
@@ -512,14 +524,43 @@ static const unsigned int freq_table[] = { 837201792, 837685632, 838169728,
  */
 
 
+/* roughly how much memory the samples of a patch take */
+static unsigned long int patch_size(const struct _patch *sample_patch)
+{
+	const struct _sample *tmp_sample;
+	unsigned long int size = 0;
+
+	for (tmp_sample = sample_patch->first_sample; tmp_sample; tmp_sample = tmp_sample->next) {
+		size += sizeof(struct _sample) + ((tmp_sample->data_length >> 10) + 1) * sizeof(signed short);
+	}
+	return size;
+}
+
+static void free_patch_samples(struct _patch *sample_patch)
+{
+	struct _sample *tmp_sample;
+
+	ZMusic_AccountInstruments(-(ptrdiff_t)patch_size(sample_patch));
+	while (sample_patch->first_sample) {
+		tmp_sample = sample_patch->first_sample->next;
+		free(sample_patch->first_sample->data);
+		free(sample_patch->first_sample);
+		sample_patch->first_sample = tmp_sample;
+	}
+	sample_patch->loaded = 0;
+}
+
 void Instruments::FreePatches()
 {
 	int i;
 	struct _patch * tmp_patch;
 	struct _sample * tmp_sample;
 
+	unused_patches.clear();
+	patch_cache_size = 0;
 	for (i = 0; i < 128; i++) {
 		while (patch[i]) {
+			ZMusic_AccountInstruments(-(ptrdiff_t)patch_size(patch[i]));
 			while (patch[i]->first_sample) {
 				tmp_sample = patch[i]->first_sample->next;
 				free(patch[i]->first_sample->data);
@@ -1148,15 +1189,20 @@ int Instruments::LoadConfig(const char *config_parm)
 /* sample loading */
 
 int Instruments::load_sample(struct _patch *sample_patch)
+{
+	/* we only want to try loading the guspat once. */
+	sample_patch->loaded = 1;
+
+	return setup_sample(sample_patch, load_gus_pat(sample_patch->filename));
+}
+
+/* Applies the patch's config settings to freshly loaded samples. */
+int Instruments::setup_sample(struct _patch *sample_patch, struct _sample *guspat)
 	{
-	struct _sample *guspat = NULL;
 	struct _sample *tmp_sample = NULL;
 	unsigned int i = 0;
 
-	/* we only want to try loading the guspat once. */
-	sample_patch->loaded = 1;
-
-	if ((guspat = load_gus_pat(sample_patch->filename)) == NULL) {
+	if (guspat == NULL) {
 		return -1;
 	}
 
@@ -1265,6 +1311,7 @@ int Instruments::load_sample(struct _patch *sample_patch)
 
 		guspat = guspat->next;
 	} while (guspat);
+	ZMusic_AccountInstruments(patch_size(sample_patch));
 	return 0;
 }
 
@@ -1290,8 +1337,65 @@ struct _patch *Instruments::get_patch_data(unsigned short patchid)
 	return NULL;
 }
 
+void Instruments::SetPatchCache(unsigned long int bytes)
+{
+	std::lock_guard<std::mutex> lock(patch_mutex);
+	patch_cache_limit = bytes;
+}
+
+unsigned long int Instruments::ReleaseUnusedPatches()
+{
+	std::lock_guard<std::mutex> lock(patch_mutex);
+	unsigned long int size = patch_cache_size;
+	trim_patch_cache(0);
+	return size - patch_cache_size;
+}
+
+/* Frees the oldest unused patches until the rest fit into limit. */
+void Instruments::trim_patch_cache(unsigned long int limit)
+{
+	while (patch_cache_size > limit && unused_patches.size()) {
+		struct _patch *tmp_patch = unused_patches.front();
+		unused_patches.erase(unused_patches.begin());
+		patch_cache_size -= patch_size(tmp_patch);
+		free_patch_samples(tmp_patch);
+	}
+}
+
+/* Takes a patch that is about to be used out of the cache. */
+void Instruments::claim_patch(struct _patch *sample_patch)
+{
+	if (sample_patch->inuse_count == 0) {
+		auto it = std::find(unused_patches.begin(), unused_patches.end(), sample_patch);
+		if (it != unused_patches.end()) {
+			unused_patches.erase(it);
+			patch_cache_size -= patch_size(sample_patch);
+		}
+	}
+	sample_patch->inuse_count++;
+}
+
+/* Called for every patch a song loaded once it is done. */
+void Instruments::release_patch(struct _patch *sample_patch)
+{
+	std::lock_guard<std::mutex> lock(patch_mutex);
+
+	sample_patch->inuse_count--;
+	if (sample_patch->inuse_count != 0) {
+		return;
+	}
+	if (patch_cache_limit == 0) {
+		free_patch_samples(sample_patch);
+		return;
+	}
+	unused_patches.push_back(sample_patch);
+	patch_cache_size += patch_size(sample_patch);
+	trim_patch_cache(patch_cache_limit);
+}
+
 void Instruments::load_patch(struct _mdi *mdi, unsigned short patchid)
 {
+	std::lock_guard<std::mutex> lock(patch_mutex);
 	unsigned int i;
 	struct _patch *tmp_patch = NULL;
 
@@ -1320,7 +1424,48 @@ void Instruments::load_patch(struct _mdi *mdi, unsigned short patchid)
 	mdi->patches = (struct _patch**)realloc(mdi->patches,
 			(sizeof(struct _patch*) * mdi->patch_count));
 	mdi->patches[mdi->patch_count - 1] = tmp_patch;
-	tmp_patch->inuse_count++;
+	claim_patch(tmp_patch);
+}
+
+/* Loads a list of patches at once. The files are read one after another
+   on the calling thread because the sound font reader may not be usable
+   from other threads, the decoding is spread over worker threads. */
+void Instruments::load_patches(struct _mdi *mdi, const unsigned short *patchids, int count)
+{
+	struct PatchFile
+	{
+		struct _patch *patch;
+		unsigned char *data;
+		unsigned long int size;
+	};
+	std::vector<PatchFile> files;
+	int i;
+
+	{
+		std::lock_guard<std::mutex> lock(patch_mutex);
+		for (i = 0; i < count; i++) {
+			struct _patch *tmp_patch = get_patch_data(patchids[i]);
+			if (tmp_patch == NULL || tmp_patch->loaded) {
+				continue;
+			}
+			/* we only want to try loading the guspat once. */
+			tmp_patch->loaded = 1;
+
+			PatchFile file = { tmp_patch, NULL, 0 };
+			file.data = _WM_BufferFile(sfreader, tmp_patch->filename, &file.size);
+			files.push_back(file);
+		}
+	}
+
+	ZMusic_ParallelFor(files.size(), [&](size_t j)
+	{
+		PatchFile &file = files[j];
+		setup_sample(file.patch, parse_gus_pat(file.patch->filename, file.data, file.size));
+	});
+
+	for (i = 0; i < count; i++) {
+		load_patch(mdi, patchids[i]);
+	}
 }
 
 Instruments::~Instruments()
@@ -2013,24 +2158,13 @@ struct _mdi *Renderer::Init_MDI()
 	return mdi;
 }
 
-static void freeMDI(struct _mdi *mdi)
+static void freeMDI(Instruments *instruments, struct _mdi *mdi)
 {
-	struct _sample *tmp_sample;
 	unsigned long int i;
 
 	if (mdi->patch_count != 0) {
 		for (i = 0; i < mdi->patch_count; i++) {
-			mdi->patches[i]->inuse_count--;
-			if (mdi->patches[i]->inuse_count == 0) {
-				/* free samples here */
-				while (mdi->patches[i]->first_sample) {
-					tmp_sample = mdi->patches[i]->first_sample->next;
-					free(mdi->patches[i]->first_sample->data);
-					free(mdi->patches[i]->first_sample);
-					mdi->patches[i]->first_sample = tmp_sample;
-				}
-				mdi->patches[i]->loaded = 0;
-			}
+			instruments->release_patch(mdi->patches[i]);
 		}
 		free(mdi->patches);
 	}
@@ -2041,416 +2175,348 @@ static void freeMDI(struct _mdi *mdi)
 	delete mdi;
 }
 
-static int *WM_Mix_Linear(midi * handle, int * buffer, unsigned long int count)
+/*
+ * The mixer renders one note at a time over the whole buffer. Most samples
+ * of a note only advance its position and envelope, so these are done in a
+ * tight loop and only the samples where the note loops, ends or reaches an
+ * envelope target go through mix_note_step. The mix is summed in integers,
+ * which makes the result the same as mixing all notes sample by sample.
+ */
+enum {
+	MIX_NEXT_SAMPLE,	/* go on with the next sample */
+	MIX_SAME_SAMPLE,	/* the note changed its state and must render this sample again */
+	MIX_NOTE_DONE		/* the note has ended */
+};
+
+static inline signed int premix_linear(const struct _sample *sample, unsigned int sample_pos, signed int env_level)
 {
-	struct _mdi *mdi = (struct _mdi *)handle;
-	unsigned long int data_pos;
-	signed int premix, left_mix, right_mix;
-	struct _note *note_data = NULL;
+	unsigned long int data_pos = sample_pos >> FPBITS;
+	return ((sample->data[data_pos] + (((sample->data[data_pos + 1] - sample->data[data_pos]) * (int)(sample_pos & FPMASK)) / 1024)) * (env_level >> 12)) / 1024;
+}
 
+static inline double gauss_sum(const signed short int *sptr, const float *gptr)
+{
+#if defined(WM_MIX_SSE2)
+	/* gauss_n + 1 = 35 taps: 32 with SSE2 and 3 at the end */
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	int i;
+	for (i = 0; i < 32; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(sptr + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_cvtepi32_ps(lo), _mm_loadu_ps(gptr + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_cvtepi32_ps(hi), _mm_loadu_ps(gptr + i + 4)));
+	}
+	sum0 = _mm_add_ps(sum0, sum1);
+	sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+	sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(sum0) + sptr[32] * gptr[32] + sptr[33] * gptr[33] + sptr[34] * gptr[34];
+#elif defined(WM_MIX_NEON)
+	float32x4_t sum0 = vdupq_n_f32(0);
+	float32x4_t sum1 = vdupq_n_f32(0);
+	int i;
+	for (i = 0; i < 32; i += 8) {
+		int16x8_t s = vld1q_s16(sptr + i);
+		sum0 = vmlaq_f32(sum0, vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), vld1q_f32(gptr + i));
+		sum1 = vmlaq_f32(sum1, vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), vld1q_f32(gptr + i + 4));
+	}
+	return vaddvq_f32(vaddq_f32(sum0, sum1)) + sptr[32] * gptr[32] + sptr[33] * gptr[33] + sptr[34] * gptr[34];
+#else
+	const float *gend = gptr + gauss_n;
+	double y = 0;
 	do {
-		note_data = mdi->note;
-		left_mix = right_mix = 0;
-		if (note_data != NULL) {
-			while (note_data) {
-				/*
-				 * ===================
-				 * resample the sample
-				 * ===================
-				 */
-				data_pos = note_data->sample_pos >> FPBITS;
-				premix = ((note_data->sample->data[data_pos] + (((note_data->sample->data[data_pos + 1] - note_data->sample->data[data_pos]) * (int)(note_data->sample_pos & FPMASK)) / 1024)) * (note_data->env_level >> 12)) / 1024;
-
-
-				left_mix += (premix * (int)note_data->left_mix_volume) / 1024;
-				right_mix += (premix * (int)note_data->right_mix_volume) / 1024;
-
-				/*
-				 * ========================
-				 * sample position checking
-				 * ========================
-				 */
-				note_data->sample_pos += note_data->sample_inc;
-				if (note_data->modes & SAMPLE_LOOP) {
-					if (note_data->sample_pos > note_data->sample->loop_end) {
-						note_data->sample_pos =
-							note_data->sample->loop_start
-									+ ((note_data->sample_pos
-											- note_data->sample->loop_start)
-											% note_data->sample->loop_size);
-					}
-				} else if (note_data->sample_pos >= note_data->sample->data_length) {
-					goto END_THIS_NOTE;
-				}
-
-				if (note_data->env_inc == 0) {
-					note_data = note_data->next;
-					continue;
-				}
-
-				note_data->env_level += note_data->env_inc;
-				if (note_data->env_inc < 0) {
-					if (note_data->env_level > note_data->sample->env_target[note_data->env]) {
-						note_data = note_data->next;
-						continue;
-					}
-				} else if (note_data->env_inc > 0) {
-					if (note_data->env_level < note_data->sample->env_target[note_data->env]) {
-						note_data = note_data->next;
-						continue;
-					}
-				}
-
-				// Yes could have a condition here but
-				// it would create another bottleneck
-				note_data->env_level =
-						note_data->sample->env_target[note_data->env];
-				switch (note_data->env) {
-				case 0:
-					if (!(note_data->modes & SAMPLE_ENVELOPE)) {
-						note_data->env_inc = 0;
-						note_data = note_data->next;
-						continue;
-					}
-					break;
-				case 2:
-					if (note_data->modes & SAMPLE_SUSTAIN /*|| note_data->hold*/) {
-						note_data->env_inc = 0;
-						note_data = note_data->next;
-						continue;
-					} else if (note_data->modes & SAMPLE_CLAMPED) {
-						note_data->env = 5;
-						if (note_data->env_level
-								> note_data->sample->env_target[5]) {
-							note_data->env_inc =
-									-note_data->sample->env_rate[5];
-						} else {
-							note_data->env_inc =
-									note_data->sample->env_rate[5];
-						}
-						continue;
-					}
-					break;
-				case 5:
-					if (note_data->env_level == 0) {
-						goto END_THIS_NOTE;
-					}
-					/* sample release */
-					if (note_data->modes & SAMPLE_LOOP)
-						note_data->modes ^= SAMPLE_LOOP;
-					note_data->env_inc = 0;
-					note_data = note_data->next;
-					continue;
-				case 6:
-					END_THIS_NOTE:
-					if (note_data->replay != NULL) {
-						note_data->active = 0;
-						{
-							struct _note *prev_note = NULL;
-							struct _note *nte_array = mdi->note;
-
-							if (nte_array != note_data) {
-								do {
-									prev_note = nte_array;
-									nte_array = nte_array->next;
-								} while (nte_array != note_data);
-							}
-							if (prev_note) {
-								prev_note->next = note_data->replay;
-							} else {
-								mdi->note = note_data->replay;
-							}
-							note_data->replay->next = note_data->next;
-							note_data = note_data->replay;
-							note_data->active = 1;
-						}
-					} else {
-						note_data->active = 0;
-						{
-							struct _note *prev_note = NULL;
-							struct _note *nte_array = mdi->note;
-
-							if (nte_array != note_data) {
-								do {
-									prev_note = nte_array;
-									nte_array = nte_array->next;
-								} while ((nte_array != note_data)
-										&& (nte_array));
-							}
-							if (prev_note) {
-								prev_note->next = note_data->next;
-							} else {
-								mdi->note = note_data->next;
-							}
-							note_data = note_data->next;
-						}
-					}
-					continue;
-				}
-				note_data->env++;
-
-				if (note_data->is_off == 1) {
-					do_note_off_extra(note_data);
-				}
+		y += *(sptr++) * *(gptr++);
+	} while (gptr <= gend);
+	return y;
+#endif
+}
 
-				if (note_data->env_level
-						> note_data->sample->env_target[note_data->env]) {
-					note_data->env_inc =
-							-note_data->sample->env_rate[note_data->env];
-				} else {
-					note_data->env_inc =
-							note_data->sample->env_rate[note_data->env];
-				}
-				note_data = note_data->next;
-				continue;
-			}
+static inline signed int premix_gauss(const struct _sample *sample, unsigned int sample_pos, signed int env_level)
+{
+	unsigned long int data_pos = sample_pos >> FPBITS;
+	const signed short int *sptr;
+	double y, xd;
+	int left, right, temp_n;
+	int ii, jj;
 
-			/*
-			 * =========================
-			 * mix the channels together
-			 * =========================
-			 */
+	/* check to see if we're near one of the ends */
+	left = data_pos;
+	right = (sample->data_length >> FPBITS) - left - 1;
+	temp_n = (right << 1) - 1;
+	if (temp_n <= 0)
+		temp_n = 1;
+	if (temp_n > (left << 1) + 1)
+		temp_n = (left << 1) + 1;
+
+	/* use Newton if we can't fill the window */
+	if (temp_n < gauss_n) {
+		xd = sample_pos & FPMASK;
+		xd /= (1L << FPBITS);
+		xd += temp_n >> 1;
+		y = 0;
+		sptr = sample->data + data_pos - (temp_n >> 1);
+		for (ii = temp_n; ii;) {
+			for (jj = 0; jj <= ii; jj++)
+				y += sptr[jj] * newt_coeffs[ii][jj];
+			y *= xd - --ii;
 		}
-		*buffer++ = left_mix;
-		*buffer++ = right_mix;
-	} while (--count);
-	return buffer;
+		y += *sptr;
+	} else { /* otherwise, use Gauss as usual */
+		y = gauss_sum(sample->data + data_pos - (gauss_n >> 1),
+				&gauss_table[(sample_pos & FPMASK) * (gauss_n + 1)]);
+	}
+
+	return (int)((y * (env_level >> 12)) / 1024);
 }
 
-static int *WM_Mix_Gauss(midi * handle, int * buffer, unsigned long int count)
+template<bool gauss>
+static inline signed int premix_note(const struct _sample *sample, unsigned int sample_pos, signed int env_level)
 {
-	if (!gauss_table.size()) init_gauss();
+	return gauss ? premix_gauss(sample, sample_pos, env_level) : premix_linear(sample, sample_pos, env_level);
+}
 
-	struct _mdi *mdi = (struct _mdi *)handle;
-	unsigned long int data_pos;
-	signed int premix, left_mix, right_mix;
-	struct _note *note_data = NULL;
-	signed short int *sptr;
-	double y, xd;
-	double *gptr, *gend;
-	int left, right, temp_n;
-	int ii, jj;
+/* Renders one sample of a note and does all the position and envelope checks. */
+template<bool gauss>
+static int mix_note_step(struct _mdi *mdi, struct _note **pnote, int *buffer)
+{
+	struct _note *note_data = *pnote;
+	signed int premix = premix_note<gauss>(note_data->sample, note_data->sample_pos, note_data->env_level);
+
+	buffer[0] += (premix * (int)note_data->left_mix_volume) / 1024;
+	buffer[1] += (premix * (int)note_data->right_mix_volume) / 1024;
+
+	/*
+	 * ========================
+	 * sample position checking
+	 * ========================
+	 */
+	note_data->sample_pos += note_data->sample_inc;
+	if (gauss) {
+		if (note_data->sample_pos > note_data->sample->loop_end) {
+			if (note_data->modes & SAMPLE_LOOP) {
+				note_data->sample_pos =
+						note_data->sample->loop_start
+								+ ((note_data->sample_pos
+										- note_data->sample->loop_start)
+										% note_data->sample->loop_size);
+			} else if (note_data->sample_pos >= note_data->sample->data_length) {
+				goto END_THIS_NOTE;
+			}
+		}
+	} else if (note_data->modes & SAMPLE_LOOP) {
+		if (note_data->sample_pos > note_data->sample->loop_end) {
+			note_data->sample_pos =
+				note_data->sample->loop_start
+						+ ((note_data->sample_pos
+								- note_data->sample->loop_start)
+								% note_data->sample->loop_size);
+		}
+	} else if (note_data->sample_pos >= note_data->sample->data_length) {
+		goto END_THIS_NOTE;
+	}
 
-	do {
-		note_data = mdi->note;
-		left_mix = right_mix = 0;
-		if (note_data != NULL) {
-			while (note_data) {
-				/*
-				 * ===================
-				 * resample the sample
-				 * ===================
-				 */
-				data_pos = note_data->sample_pos >> FPBITS;
-
-				/* check to see if we're near one of the ends */
-				left = data_pos;
-				right = (note_data->sample->data_length >> FPBITS) - left
-						- 1;
-				temp_n = (right << 1) - 1;
-				if (temp_n <= 0)
-					temp_n = 1;
-				if (temp_n > (left << 1) + 1)
-					temp_n = (left << 1) + 1;
-
-				/* use Newton if we can't fill the window */
-				if (temp_n < gauss_n) {
-					xd = note_data->sample_pos & FPMASK;
-					xd /= (1L << FPBITS);
-					xd += temp_n >> 1;
-					y = 0;
-					sptr = note_data->sample->data
-							+ (note_data->sample_pos >> FPBITS)
-							- (temp_n >> 1);
-					for (ii = temp_n; ii;) {
-						for (jj = 0; jj <= ii; jj++)
-							y += sptr[jj] * newt_coeffs[ii][jj];
-						y *= xd - --ii;
-					}
-					y += *sptr;
-				} else { /* otherwise, use Gauss as usual */
-					y = 0;
-					gptr = &gauss_table[(note_data->sample_pos & FPMASK) *
-							     (gauss_n + 1)];
-					gend = gptr + gauss_n;
-					sptr = note_data->sample->data
-							+ (note_data->sample_pos >> FPBITS)
-							- (gauss_n >> 1);
-					do {
-						y += *(sptr++) * *(gptr++);
-					} while (gptr <= gend);
-				}
+	if (note_data->env_inc == 0) {
+		return MIX_NEXT_SAMPLE;
+	}
 
-				premix = (int)((y * (note_data->env_level >> 12)) / 1024);
+	note_data->env_level += note_data->env_inc;
+	if (note_data->env_inc < 0) {
+		if (note_data->env_level > note_data->sample->env_target[note_data->env]) {
+			return MIX_NEXT_SAMPLE;
+		}
+	} else if (note_data->env_inc > 0) {
+		if (note_data->env_level < note_data->sample->env_target[note_data->env]) {
+			return MIX_NEXT_SAMPLE;
+		}
+	}
 
-				left_mix += (premix * (int)note_data->left_mix_volume) / 1024;
-				right_mix += (premix * (int)note_data->right_mix_volume) / 1024;
+	// Yes could have a condition here but
+	// it would create another bottleneck
+	note_data->env_level =
+			note_data->sample->env_target[note_data->env];
+	switch (note_data->env) {
+	case 0:
+		if (!(note_data->modes & SAMPLE_ENVELOPE)) {
+			note_data->env_inc = 0;
+			return MIX_NEXT_SAMPLE;
+		}
+		break;
+	case 2:
+		if (note_data->modes & SAMPLE_SUSTAIN /*|| note_data->hold*/) {
+			note_data->env_inc = 0;
+			return MIX_NEXT_SAMPLE;
+		} else if (note_data->modes & SAMPLE_CLAMPED) {
+			note_data->env = 5;
+			if (note_data->env_level
+					> note_data->sample->env_target[5]) {
+				note_data->env_inc =
+						-note_data->sample->env_rate[5];
+			} else {
+				note_data->env_inc =
+						note_data->sample->env_rate[5];
+			}
+			return MIX_SAME_SAMPLE;
+		}
+		break;
+	case 5:
+		if (note_data->env_level == 0) {
+			goto END_THIS_NOTE;
+		}
+		/* sample release */
+		if (note_data->modes & SAMPLE_LOOP)
+			note_data->modes ^= SAMPLE_LOOP;
+		note_data->env_inc = 0;
+		return MIX_NEXT_SAMPLE;
+	case 6:
+		END_THIS_NOTE:
+		{
+			struct _note *prev_note = NULL;
+			struct _note *nte_array = mdi->note;
 
-				/*
-				 * ========================
-				 * sample position checking
-				 * ========================
-				 */
-				note_data->sample_pos += note_data->sample_inc;
-				if (note_data->sample_pos > note_data->sample->loop_end)
-				{
-					if (note_data->modes & SAMPLE_LOOP) {
-						note_data->sample_pos =
-								note_data->sample->loop_start
-										+ ((note_data->sample_pos
-												- note_data->sample->loop_start)
-												% note_data->sample->loop_size);
-					} else if (note_data->sample_pos >= note_data->sample->data_length) {
-						goto END_THIS_NOTE;
-					}
+			note_data->active = 0;
+			if (nte_array != note_data) {
+				do {
+					prev_note = nte_array;
+					nte_array = nte_array->next;
+				} while ((nte_array != note_data)
+						&& (nte_array));
+			}
+			if (note_data->replay != NULL) {
+				if (prev_note) {
+					prev_note->next = note_data->replay;
+				} else {
+					mdi->note = note_data->replay;
 				}
+				note_data->replay->next = note_data->next;
+				*pnote = note_data->replay;
+				(*pnote)->active = 1;
+				return MIX_SAME_SAMPLE;
+			}
+			if (prev_note) {
+				prev_note->next = note_data->next;
+			} else {
+				mdi->note = note_data->next;
+			}
+		}
+		return MIX_NOTE_DONE;
+	}
+	note_data->env++;
 
-				if (note_data->env_inc == 0) {
-					note_data = note_data->next;
-					continue;
-				}
+	if (note_data->is_off == 1) {
+		do_note_off_extra(note_data);
+	}
 
-				note_data->env_level += note_data->env_inc;
-				if (note_data->env_inc < 0) {
-					if (note_data->env_level
-						> note_data->sample->env_target[note_data->env]) {
-						note_data = note_data->next;
-						continue;
-					}
-				} else if (note_data->env_inc > 0) {
-					if (note_data->env_level
-						< note_data->sample->env_target[note_data->env]) {
-						note_data = note_data->next;
-						continue;
-					}
-				}
+	if (note_data->env_level
+			> note_data->sample->env_target[note_data->env]) {
+		note_data->env_inc =
+				-note_data->sample->env_rate[note_data->env];
+	} else {
+		note_data->env_inc =
+				note_data->sample->env_rate[note_data->env];
+	}
+	return MIX_NEXT_SAMPLE;
+}
 
-				// Yes could have a condition here but
-				// it would create another bottleneck
-
-				note_data->env_level =
-						note_data->sample->env_target[note_data->env];
-				switch (note_data->env) {
-				case 0:
-					if (!(note_data->modes & SAMPLE_ENVELOPE)) {
-						note_data->env_inc = 0;
-						note_data = note_data->next;
-						continue;
-					}
-					break;
-				case 2:
-					if (note_data->modes & SAMPLE_SUSTAIN) {
-						note_data->env_inc = 0;
-						note_data = note_data->next;
-						continue;
-					} else if (note_data->modes & SAMPLE_CLAMPED) {
-						note_data->env = 5;
-						if (note_data->env_level
-								> note_data->sample->env_target[5]) {
-							note_data->env_inc =
-									-note_data->sample->env_rate[5];
-						} else {
-							note_data->env_inc =
-									note_data->sample->env_rate[5];
-						}
-						continue;
-					}
-					break;
-				case 5:
-					if (note_data->env_level == 0) {
-						goto END_THIS_NOTE;
-					}
-					/* sample release */
-					if (note_data->modes & SAMPLE_LOOP)
-						note_data->modes ^= SAMPLE_LOOP;
-					note_data->env_inc = 0;
-					note_data = note_data->next;
-					continue;
-				case 6:
-					END_THIS_NOTE:
-					if (note_data->replay != NULL) {
-						note_data->active = 0;
-						{
-							struct _note *prev_note = NULL;
-							struct _note *nte_array = mdi->note;
-
-							if (nte_array != note_data) {
-								do {
-									prev_note = nte_array;
-									nte_array = nte_array->next;
-								} while (nte_array != note_data);
-							}
-							if (prev_note) {
-								prev_note->next = note_data->replay;
-							} else {
-								mdi->note = note_data->replay;
-							}
-							note_data->replay->next = note_data->next;
-							note_data = note_data->replay;
-							note_data->active = 1;
-						}
-					} else {
-						note_data->active = 0;
-						{
-							struct _note *prev_note = NULL;
-							struct _note *nte_array = mdi->note;
-
-							if (nte_array != note_data) {
-								do {
-									prev_note = nte_array;
-									nte_array = nte_array->next;
-								} while ((nte_array != note_data)
-										&& (nte_array));
-							}
-							if (prev_note) {
-								prev_note->next = note_data->next;
-							} else {
-								mdi->note = note_data->next;
-							}
-							note_data = note_data->next;
-						}
-					}
-					continue;
-				}
-				note_data->env++;
+/* How many samples the note can render before mix_note_step has to look at it. */
+static unsigned long int quiet_samples(const struct _note *note_data, unsigned long int count)
+{
+	const struct _sample *sample = note_data->sample;
+	signed long long int last_pos = (signed long long int)sample->data_length - 1;
+
+	if (last_pos > (signed long long int)sample->loop_end)
+		last_pos = sample->loop_end;
+	if (last_pos < (signed long long int)note_data->sample_pos)
+		return 0;
+	if (note_data->sample_inc != 0) {
+		unsigned long long int n = (unsigned long long int)(last_pos - note_data->sample_pos) / note_data->sample_inc;
+		if (n < count)
+			count = (unsigned long int)n;
+	}
+
+	if (note_data->env_inc != 0) {
+		signed long long int target = note_data->sample->env_target[note_data->env];
+		signed long long int dist = note_data->env_inc < 0 ? note_data->env_level - target : target - note_data->env_level;
+		unsigned long long int n;
+
+		if (dist <= 0)
+			return 0;
+		n = (unsigned long long int)(dist - 1) / (note_data->env_inc < 0 ? -(signed long long int)note_data->env_inc : note_data->env_inc);
+		if (n < count)
+			count = (unsigned long int)n;
+	}
+	return count;
+}
 
-				if (note_data->is_off == 1) {
-					do_note_off_extra(note_data);
-				}
+template<bool gauss>
+static int *WM_Mix_Notes(midi * handle, int * buffer, unsigned long int count)
+{
+	struct _mdi *mdi = (struct _mdi *)handle;
+	struct _note *note_data = mdi->note;
 
-				if (note_data->env_level
-						> note_data->sample->env_target[note_data->env]) {
-					note_data->env_inc =
-							-note_data->sample->env_rate[note_data->env];
-				} else {
-					note_data->env_inc =
-							note_data->sample->env_rate[note_data->env];
-				}
-				note_data = note_data->next;
-				continue;
+	memset(buffer, 0, count * 2 * sizeof(int));
+	while (note_data) {
+		struct _note *next_note = note_data->next;
+		int *out = buffer;
+		unsigned long int left = count;
+
+		if (mdi->voice_floor && note_data->env < 6
+				&& (note_data->env >= 3 || (note_data->hold & HOLD_OFF))) {
+			unsigned int vol = note_data->left_mix_volume > note_data->right_mix_volume
+					? note_data->left_mix_volume : note_data->right_mix_volume;
+			if ((signed long long int)note_data->env_level * vol < mdi->voice_floor) {
+				/* can't be heard any more, take it out the way a retriggered note goes */
+				note_data->env = 6;
+				note_data->env_inc = -note_data->sample->env_rate[6];
+			}
+		}
+
+		while (left) {
+			unsigned long int n = quiet_samples(note_data, left);
+			if (n) {
+				const struct _sample *sample = note_data->sample;
+				unsigned int sample_pos = note_data->sample_pos;
+				unsigned int sample_inc = note_data->sample_inc;
+				signed int env_level = note_data->env_level;
+				signed int env_inc = note_data->env_inc;
+				int left_vol = note_data->left_mix_volume;
+				int right_vol = note_data->right_mix_volume;
+
+				left -= n;
+				do {
+					signed int premix = premix_note<gauss>(sample, sample_pos, env_level);
+					out[0] += (premix * left_vol) / 1024;
+					out[1] += (premix * right_vol) / 1024;
+					out += 2;
+					sample_pos += sample_inc;
+					env_level += env_inc;
+				} while (--n);
+				note_data->sample_pos = sample_pos;
+				note_data->env_level = env_level;
+				if (!left) break;
 			}
 
-			/*
-			 * =========================
-			 * mix the channels together
-			 * =========================
-			 */
+			int result = mix_note_step<gauss>(mdi, &note_data, out);
+			if (result == MIX_NOTE_DONE) break;
+			if (result == MIX_NEXT_SAMPLE) {
+				out += 2;
+				left--;
+			}
 		}
-		*buffer++ = left_mix;
-		*buffer++ = right_mix;
-	} while (--count);
-	return buffer;
+		note_data = next_note;
+	}
+	return buffer + count * 2;
 }
 
 int *WM_Mix(midi *handle, int *buffer, unsigned long count)
 {
 	if (((struct _mdi *)handle)->info.mixer_options & WM_MO_ENHANCED_RESAMPLING)
 	{
-		return WM_Mix_Gauss(handle, buffer, count);
+		return WM_Mix_Notes<true>(handle, buffer, count);
 	}
 	else
 	{
-		return WM_Mix_Linear(handle, buffer, count);
+		return WM_Mix_Notes<false>(handle, buffer, count);
 	}
 }
 
@@ -2482,6 +2548,12 @@ midi * Renderer::NewMidi()
 	return ret;
 }
 
+void Renderer::SetVoiceFloor(float level)
+{
+	/* a full scale note has an env_level of 1 << 22 and a mix volume of 1024 */
+	((struct _mdi *)handle)->voice_floor = (signed long long int)(level * 4194304.0 * 1024.0);
+}
+
 int Renderer::SetOption(int options, int setting)
 {
 	struct _mdi *mdi;
@@ -2520,7 +2592,9 @@ int Renderer::SetOption(int options, int setting)
 
 Renderer::Renderer(Instruments *instr, unsigned mixOpt)
 {
-	init_gauss();
+	/* built once, by the first renderer, and shared by all of them */
+	static const bool gauss_ready = init_gauss();
+	(void)gauss_ready;
 	instruments = instr;
 	WM_MixerOptions = mixOpt;
 	handle = NewMidi();
@@ -2528,7 +2602,7 @@ Renderer::Renderer(Instruments *instr, unsigned mixOpt)
 
 Renderer::~Renderer()
 {
-	freeMDI((_mdi *)handle);
+	freeMDI(instruments, (_mdi *)handle);
 }
 
 void Renderer::ShortEvent(int status, int parm1, int parm2)
@@ -2671,6 +2745,16 @@ void Renderer::LoadInstrument(int bank, int percussion, int instr)
 	instruments->load_patch((_mdi *)handle, (bank << 8) | instr | (percussion ? 0x80 : 0));
 }
 
+void Renderer::LoadInstruments(const uint16_t *list, int count)
+{
+	std::vector<unsigned short> patchids(count);
+	for (int i = 0; i < count; i++)
+	{
+		patchids[i] = (((list[i] >> 7) & 127) << 8) | (list[i] & 127) | ((list[i] >> 14) ? 0x80 : 0);
+	}
+	instruments->load_patches((_mdi *)handle, patchids.data(), count);
+}
+
 int Renderer::GetVoiceCount()
 {
 	int count = 0;